@@ -51,7 +51,6 @@ else
         --extra-cflags="-O2 -fPIC"
         --disable-programs
         --disable-doc
-        --disable-swscale
         --disable-postproc
         --disable-avfilter
         --disable-network
@@ -60,6 +59,7 @@ else
         --disable-vaapi
         --disable-vdpau
         --enable-swresample
+        --enable-swscale
         --enable-libdav1d
         --enable-decoder=h264
         --enable-decoder=hevc
@@ -95,6 +95,29 @@ else
         )
     fi
 
+    if [[ "$HOST" == win32 || "$HOST" == win64 ]]
+    then
+        # Hardware-accelerated decoding (--video-hwaccel)
+        conf+=(
+            --enable-d3d11va
+            --enable-dxva2
+            --enable-hwaccel=h264_d3d11va
+            --enable-hwaccel=hevc_d3d11va
+            --enable-hwaccel=av1_d3d11va
+            --enable-hwaccel=h264_dxva2
+            --enable-hwaccel=hevc_dxva2
+            --enable-hwaccel=av1_dxva2
+        )
+    elif [[ "$HOST" == macos ]]
+    then
+        conf+=(
+            --enable-videotoolbox
+            --enable-hwaccel=h264_videotoolbox
+            --enable-hwaccel=hevc_videotoolbox
+            --enable-hwaccel=av1_videotoolbox
+        )
+    fi
+
     if [[ "$LINK_TYPE" == static ]]
     then
         conf+=(
@@ -7,6 +7,7 @@
 #include <sys/types.h>
 
 #include "adb/adb_device.h"
+#include "adb/adb_host.h"
 #include "adb/adb_parser.h"
 #include "util/env.h"
 #include "util/file.h"
@@ -201,7 +202,7 @@ process_check_success_intr(struct sc_intr *intr, sc_pid pid, const char *name,
     return ret;
 }
 
-static sc_pid
+sc_pid
 sc_adb_execute_p(const char *const argv[], unsigned flags, sc_pipe *pout) {
     unsigned process_flags = 0;
     if (flags & SC_ADB_NO_STDOUT) {
@@ -262,6 +263,12 @@ sc_adb_forward(struct sc_intr *intr, const char *serial, uint16_t local_port,
     }
 
     assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_forward(intr, serial, local, remote, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", local, remote);
 
@@ -278,6 +285,12 @@ sc_adb_forward_remove(struct sc_intr *intr, const char *serial,
     (void) r;
 
     assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_forward_remove(intr, serial, local, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", "--remove", local);
 
@@ -302,6 +315,12 @@ sc_adb_reverse(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_reverse(intr, serial, remote, local, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", remote, local);
 
@@ -321,6 +340,12 @@ sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_reverse_remove(intr, serial, remote, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", "--remove", remote);
 
@@ -359,9 +384,29 @@ sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
     return process_check_success_intr(intr, pid, "adb push", flags);
 }
 
+bool
+sc_adb_push_file(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote, unsigned flags) {
+    assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_push(intr, serial, local, remote, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
+    return sc_adb_push(intr, serial, local, remote, flags);
+}
+
 bool
 sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
                unsigned flags) {
+    assert(serial);
+    enum sc_adb_host_result res =
+        sc_adb_host_install(intr, serial, local, flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        return res == SC_ADB_HOST_OK;
+    }
+
 #ifdef _WIN32
     // Windows will parse the string, so the local name must be quoted
     // (see sys/win/command.c)
@@ -371,7 +416,6 @@ sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
     }
 #endif
 
-    assert(serial);
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "install", "-r", local);
 
@@ -454,8 +498,6 @@ sc_adb_disconnect(struct sc_intr *intr, const char *ip_port, unsigned flags) {
 static bool
 sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
                     struct sc_vec_adb_devices *out_vec) {
-    const char *const argv[] = SC_ADB_COMMAND("devices", "-l");
-
 #define BUFSIZE 65536
     char *buf = malloc(BUFSIZE);
     if (!buf) {
@@ -463,6 +505,18 @@ sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
         return false;
     }
 
+    // Avoid to start an adb process if the adb server is reachable
+    enum sc_adb_host_result res = sc_adb_host_devices(intr, buf, BUFSIZE,
+                                                      flags);
+    if (res != SC_ADB_HOST_UNAVAILABLE) {
+        bool ok = res == SC_ADB_HOST_OK
+               && sc_adb_parse_devices(buf, out_vec);
+        free(buf);
+        return ok;
+    }
+
+    const char *const argv[] = SC_ADB_COMMAND("devices", "-l");
+
     sc_pipe pout;
     sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
     if (pid == SC_PROCESS_NONE) {
@@ -696,35 +750,133 @@ sc_adb_select_device(struct sc_intr *intr,
     return true;
 }
 
-char *
-sc_adb_getprop(struct sc_intr *intr, const char *serial, const char *prop,
-               unsigned flags) {
+// Remove the "\n:<code>\n" suffix appended to the output of a shell command
+// executed through the adb server, and return the resulting length, or -1 if
+// the exit code is not 0
+static ssize_t
+sc_adb_shell_strip_exit_code(char *buf, unsigned flags) {
+    char *end = NULL;
+    for (char *p = buf; (p = strstr(p, "\n:")); ++p) {
+        end = p;
+    }
+
+    long code;
+    bool ok = end != NULL; // not found if the output is truncated
+    if (ok) {
+        char *code_str = end + 2;
+        code_str[strcspn(code_str, "\r\n")] = '\0';
+        ok = sc_str_parse_integer(code_str, &code) && !code;
+    }
+
+    if (!ok) {
+        if (!(flags & SC_ADB_NO_LOGERR)) {
+            LOGE("\"adb shell\" failed");
+        }
+        return -1;
+    }
+
+    // Remove the line break added before the exit code (possibly "\r\n" if
+    // the shell runs in a terminal)
+    if (end > buf && end[-1] == '\r') {
+        --end;
+    }
+    *end = '\0';
+    return end - buf;
+}
+
+ssize_t
+sc_adb_shell_read(struct sc_intr *intr, const char *serial, const char *cmd,
+                  char *buf, size_t len, unsigned flags) {
     assert(serial);
-    const char *const argv[] =
-        SC_ADB_COMMAND("-s", serial, "shell", "getprop", prop);
+    assert(len);
+
+    // The shell service of the adb server does not report the exit code, so
+    // print it on a last line
+    char *host_cmd;
+    if (asprintf(&host_cmd, "%s; echo; echo :$?", cmd) == -1) {
+        LOG_OOM();
+        return -1;
+    }
+
+    enum sc_adb_host_result res =
+        sc_adb_host_shell_read(intr, serial, host_cmd, buf, len, NULL, flags);
+    free(host_cmd);
+    if (res == SC_ADB_HOST_ERROR) {
+        return -1;
+    }
+    if (res == SC_ADB_HOST_OK) {
+        return sc_adb_shell_strip_exit_code(buf, flags);
+    }
+
+    const char *const argv[] = SC_ADB_COMMAND("-s", serial, "shell", cmd);
 
     sc_pipe pout;
     sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
     if (pid == SC_PROCESS_NONE) {
-        LOGE("Could not execute \"adb getprop\"");
-        return NULL;
+        LOGE("Could not execute \"adb shell\"");
+        return -1;
     }
 
-    char buf[128];
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, len - 1);
     sc_pipe_close(pout);
 
-    bool ok = process_check_success_intr(intr, pid, "adb getprop", flags);
-    if (!ok) {
-        return NULL;
+    bool ok = process_check_success_intr(intr, pid, "adb shell", flags);
+    if (!ok || r == -1) {
+        return -1;
     }
 
-    if (r == -1) {
+    assert((size_t) r < len);
+    buf[r] = '\0';
+    return r;
+}
+
+char *
+sc_adb_getprop(struct sc_intr *intr, const char *serial, const char *prop,
+               unsigned flags) {
+    assert(serial);
+
+    char buf[128];
+
+    char cmd[128];
+    int ret = snprintf(cmd, sizeof(cmd), "getprop %s", prop);
+    assert(ret > 0 && (size_t) ret < sizeof(cmd));
+    (void) ret;
+
+    enum sc_adb_host_result res =
+        sc_adb_host_shell_read(intr, serial, cmd, buf, sizeof(buf), NULL,
+                               flags);
+    if (res == SC_ADB_HOST_ERROR) {
         return NULL;
     }
 
-    assert((size_t) r < sizeof(buf));
-    buf[r] = '\0';
+    if (res == SC_ADB_HOST_UNAVAILABLE) {
+        const char *const argv[] =
+            SC_ADB_COMMAND("-s", serial, "shell", "getprop", prop);
+
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGE("Could not execute \"adb getprop\"");
+            return NULL;
+        }
+
+        ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf,
+                                          sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        bool ok = process_check_success_intr(intr, pid, "adb getprop", flags);
+        if (!ok) {
+            return NULL;
+        }
+
+        if (r == -1) {
+            return NULL;
+        }
+
+        assert((size_t) r < sizeof(buf));
+        buf[r] = '\0';
+    }
+
     size_t len = strcspn(buf, " \r\n");
     buf[len] = '\0';
 
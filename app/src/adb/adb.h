@@ -5,6 +5,7 @@
 
 #include <stdbool.h>
 #include <inttypes.h>
+#include <sys/types.h>
 
 #include "adb/adb_device.h"
 #include "util/intr.h"
@@ -39,6 +40,13 @@ struct sc_adb_device_selector {
 sc_pid
 sc_adb_execute(const char *const argv[], unsigned flags);
 
+/**
+ * Execute an adb command, with its stdout redirected to a pipe (if pout is not
+ * NULL)
+ */
+sc_pid
+sc_adb_execute_p(const char *const argv[], unsigned flags, sc_pipe *pout);
+
 bool
 sc_adb_start_server(struct sc_intr *intr, unsigned flags);
 
@@ -66,6 +74,22 @@ bool
 sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
             const char *remote, unsigned flags);
 
+/**
+ * Push a single regular file to the given remote file path (not a directory)
+ *
+ * Contrary to sc_adb_push(), it does not start an adb process (unless the adb
+ * server cannot be reached directly).
+ */
+bool
+sc_adb_push_file(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote, unsigned flags);
+
+/**
+ * Install an APK, replacing the existing application
+ *
+ * The APK is streamed to the package manager through the adb server if
+ * possible, without starting an adb process.
+ */
 bool
 sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
                unsigned flags);
@@ -104,6 +128,18 @@ sc_adb_select_device(struct sc_intr *intr,
                      const struct sc_adb_device_selector *selector,
                      unsigned flags, struct sc_adb_device *out_device);
 
+/**
+ * Execute `adb shell <cmd>`, where cmd is interpreted by the device shell
+ *
+ * The output is written to buf as a NUL-terminated string (truncated to
+ * len - 1 bytes).
+ *
+ * Return the output length, or -1 on error (including a non-zero exit code).
+ */
+ssize_t
+sc_adb_shell_read(struct sc_intr *intr, const char *serial, const char *cmd,
+                  char *buf, size_t len, unsigned flags);
+
 /**
  * Execute `adb getprop <prop>`
  */
@@ -0,0 +1,72 @@
+#ifndef SC_ADB_AUTH_H
+#define SC_ADB_AUTH_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// adbd only accepts 2048-bit RSA keys
+#define SC_ADB_AUTH_KEY_SIZE 256 // in bytes
+#define SC_ADB_AUTH_KEY_WORDS (SC_ADB_AUTH_KEY_SIZE / 4)
+// Size of the token sent by adbd, to be signed
+#define SC_ADB_AUTH_TOKEN_SIZE 20
+
+/**
+ * RSA private key of the adb client, to authenticate to adbd without the adb
+ * server (the key generated by adb, so that the device does not ask to allow
+ * a new computer)
+ *
+ * <https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/protocol.txt>
+ */
+struct sc_adb_auth_key {
+    // Big integers, least significant word first
+    uint32_t n[SC_ADB_AUTH_KEY_WORDS]; // modulus
+    uint32_t d[SC_ADB_AUTH_KEY_WORDS]; // private exponent
+    uint32_t e; // public exponent
+};
+
+/**
+ * Parse a PEM-encoded RSA private key ("PRIVATE KEY" or "RSA PRIVATE KEY")
+ */
+bool
+sc_adb_auth_key_parse(struct sc_adb_auth_key *key, const char *pem);
+
+/**
+ * Wipe the key from memory
+ */
+void
+sc_adb_auth_key_destroy(struct sc_adb_auth_key *key);
+
+/**
+ * Load the key of the adb client ($ANDROID_USER_HOME/adbkey, or
+ * ~/.android/adbkey)
+ */
+bool
+sc_adb_auth_key_load(struct sc_adb_auth_key *key);
+
+/**
+ * Sign a token (PKCS#1 v1.5, the token being used as a SHA-1 digest, like
+ * adb does)
+ *
+ * The exponentiation is blinded and does not branch on the private exponent.
+ *
+ * Return false if no secure random bytes are available for the blinding.
+ */
+bool
+sc_adb_auth_sign(const struct sc_adb_auth_key *key,
+                 const uint8_t token[SC_ADB_AUTH_TOKEN_SIZE],
+                 uint8_t signature[SC_ADB_AUTH_KEY_SIZE]);
+
+/**
+ * Return the public key in the adb format ("<base64> <name>"), to be sent to
+ * the device when the signature is rejected (the user is asked to allow the
+ * computer)
+ *
+ * The result must be freed by the caller.
+ */
+char *
+sc_adb_auth_get_public_key(const struct sc_adb_auth_key *key,
+                           const char *name);
+
+#endif
@@ -0,0 +1,569 @@
+#include "adb_host.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adb/adb.h"
+#include "util/binary.h"
+#include "util/env.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/net_intr.h"
+#include "util/str.h"
+
+#define SC_ADB_HOST_PORT_DEFAULT 5037
+
+// Maximum size of a DATA chunk in the sync protocol
+#define SC_ADB_SYNC_DATA_MAX (64 * 1024)
+
+#define SC_ADB_PUSH_FILE_MODE 0644
+
+static uint16_t
+sc_adb_host_get_port(void) {
+    char *env = sc_get_env("ANDROID_ADB_SERVER_PORT");
+    if (!env) {
+        return SC_ADB_HOST_PORT_DEFAULT;
+    }
+
+    long value;
+    bool ok = sc_str_parse_integer(env, &value);
+    free(env);
+    if (!ok || value <= 0 || value > 0xFFFF) {
+        LOGW("Invalid ANDROID_ADB_SERVER_PORT, using %d",
+             SC_ADB_HOST_PORT_DEFAULT);
+        return SC_ADB_HOST_PORT_DEFAULT;
+    }
+
+    return value;
+}
+
+static sc_socket
+sc_adb_host_connect(struct sc_intr *intr) {
+    char *server_socket = sc_get_env("ADB_SERVER_SOCKET");
+    if (server_socket) {
+        // Let the adb executable handle the custom adb server address
+        free(server_socket);
+        return SC_SOCKET_NONE;
+    }
+
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    uint16_t port = sc_adb_host_get_port();
+    if (!net_connect_intr(intr, socket, IPV4_LOCALHOST, port)) {
+        LOGD("Could not connect to the adb server on port %" PRIu16, port);
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+static bool
+sc_adb_host_send(struct sc_intr *intr, sc_socket socket, const void *buf,
+                 size_t len) {
+    ssize_t w = net_send_all_intr(intr, socket, buf, len);
+    return w >= 0 && (size_t) w == len;
+}
+
+static bool
+sc_adb_host_recv(struct sc_intr *intr, sc_socket socket, void *buf,
+                 size_t len) {
+    ssize_t r = net_recv_all_intr(intr, socket, buf, len);
+    return r >= 0 && (size_t) r == len;
+}
+
+// Send a request prefixed by its length (4 hexadecimal digits)
+static bool
+sc_adb_host_send_request(struct sc_intr *intr, sc_socket socket,
+                         const char *request) {
+    size_t len = strlen(request);
+    assert(len <= 0xFFFF);
+
+    char header[5];
+    int r = snprintf(header, sizeof(header), "%04x", (unsigned) len);
+    assert(r == 4);
+    (void) r;
+
+    return sc_adb_host_send(intr, socket, header, 4)
+        && sc_adb_host_send(intr, socket, request, len);
+}
+
+// Log an error message of the given length, received from the socket
+static void
+sc_adb_host_log_failure(struct sc_intr *intr, sc_socket socket,
+                        const char *name, size_t len, unsigned flags) {
+    char msg[256];
+    size_t n = MIN(len, sizeof(msg) - 1);
+    if (!sc_adb_host_recv(intr, socket, msg, n)) {
+        n = 0;
+    }
+    msg[n] = '\0';
+
+    if (!(flags & SC_ADB_NO_LOGERR)) {
+        LOGE("\"adb %s\" failed: %s", name, msg);
+    }
+}
+
+// Read a length (4 hexadecimal digits)
+static bool
+sc_adb_host_read_length(struct sc_intr *intr, sc_socket socket,
+                        const char *name, size_t *out_len) {
+    char hex_len[5];
+    if (!sc_adb_host_recv(intr, socket, hex_len, 4)) {
+        LOGE("\"adb %s\": could not read the adb server response", name);
+        return false;
+    }
+    hex_len[4] = '\0';
+
+    char *endptr;
+    unsigned long len = strtoul(hex_len, &endptr, 16);
+    if (*endptr != '\0') {
+        LOGE("\"adb %s\": unexpected adb server response", name);
+        return false;
+    }
+
+    *out_len = len;
+    return true;
+}
+
+// Read a status: "OKAY", or "FAIL" followed by an error message
+static bool
+sc_adb_host_read_status(struct sc_intr *intr, sc_socket socket,
+                        const char *name, unsigned flags) {
+    char status[4];
+    if (!sc_adb_host_recv(intr, socket, status, sizeof(status))) {
+        LOGE("\"adb %s\": could not read the adb server status", name);
+        return false;
+    }
+
+    if (!memcmp(status, "OKAY", 4)) {
+        return true;
+    }
+
+    if (memcmp(status, "FAIL", 4)) {
+        LOGE("\"adb %s\": unexpected adb server status", name);
+        return false;
+    }
+
+    size_t len;
+    if (!sc_adb_host_read_length(intr, socket, name, &len)) {
+        return false;
+    }
+
+    sc_adb_host_log_failure(intr, socket, name, len, flags);
+    return false;
+}
+
+// Switch the connection to the device transport
+static bool
+sc_adb_host_transport(struct sc_intr *intr, sc_socket socket,
+                      const char *serial, const char *name, unsigned flags) {
+    char request[256];
+    int r = snprintf(request, sizeof(request), "host:transport:%s", serial);
+    if (r < 0 || (size_t) r >= sizeof(request)) {
+        LOGE("Serial too long");
+        return false;
+    }
+
+    return sc_adb_host_send_request(intr, socket, request)
+        && sc_adb_host_read_status(intr, socket, name, flags);
+}
+
+// Execute a service replying with two statuses (one for the connection to the
+// service and one for the command result), like forward and reverse
+static enum sc_adb_host_result
+sc_adb_host_execute(struct sc_intr *intr, const char *serial, bool transport,
+                    const char *service, const char *name, unsigned flags) {
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return SC_ADB_HOST_UNAVAILABLE;
+    }
+
+    bool ok = (!transport
+                 || sc_adb_host_transport(intr, socket, serial, name, flags))
+           && sc_adb_host_send_request(intr, socket, service)
+           && sc_adb_host_read_status(intr, socket, name, flags)
+           && sc_adb_host_read_status(intr, socket, name, flags);
+
+    net_close(socket);
+    return ok ? SC_ADB_HOST_OK : SC_ADB_HOST_ERROR;
+}
+
+enum sc_adb_host_result
+sc_adb_host_forward(struct sc_intr *intr, const char *serial,
+                    const char *local, const char *remote, unsigned flags) {
+    char service[512];
+    int r = snprintf(service, sizeof(service), "host-serial:%s:forward:%s;%s",
+                     serial, local, remote);
+    if (r < 0 || (size_t) r >= sizeof(service)) {
+        LOGE("Could not write forward request");
+        return SC_ADB_HOST_ERROR;
+    }
+
+    return sc_adb_host_execute(intr, serial, false, service, "forward", flags);
+}
+
+enum sc_adb_host_result
+sc_adb_host_forward_remove(struct sc_intr *intr, const char *serial,
+                           const char *local, unsigned flags) {
+    char service[512];
+    int r = snprintf(service, sizeof(service), "host-serial:%s:killforward:%s",
+                     serial, local);
+    if (r < 0 || (size_t) r >= sizeof(service)) {
+        LOGE("Could not write forward request");
+        return SC_ADB_HOST_ERROR;
+    }
+
+    return sc_adb_host_execute(intr, serial, false, service,
+                               "forward --remove", flags);
+}
+
+enum sc_adb_host_result
+sc_adb_host_reverse(struct sc_intr *intr, const char *serial,
+                    const char *remote, const char *local, unsigned flags) {
+    char service[512];
+    int r = snprintf(service, sizeof(service), "reverse:forward:%s;%s", remote,
+                     local);
+    if (r < 0 || (size_t) r >= sizeof(service)) {
+        LOGE("Could not write reverse request");
+        return SC_ADB_HOST_ERROR;
+    }
+
+    return sc_adb_host_execute(intr, serial, true, service, "reverse", flags);
+}
+
+enum sc_adb_host_result
+sc_adb_host_reverse_remove(struct sc_intr *intr, const char *serial,
+                           const char *remote, unsigned flags) {
+    char service[512];
+    int r = snprintf(service, sizeof(service), "reverse:killforward:%s",
+                     remote);
+    if (r < 0 || (size_t) r >= sizeof(service)) {
+        LOGE("Could not write reverse request");
+        return SC_ADB_HOST_ERROR;
+    }
+
+    return sc_adb_host_execute(intr, serial, true, service,
+                               "reverse --remove", flags);
+}
+
+enum sc_adb_host_result
+sc_adb_host_devices(struct sc_intr *intr, char *buf, size_t len,
+                    unsigned flags) {
+    assert(len);
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return SC_ADB_HOST_UNAVAILABLE;
+    }
+
+    enum sc_adb_host_result result = SC_ADB_HOST_ERROR;
+
+    size_t size;
+    bool ok = sc_adb_host_send_request(intr, socket, "host:devices-l")
+           && sc_adb_host_read_status(intr, socket, "devices", flags)
+           && sc_adb_host_read_length(intr, socket, "devices", &size);
+    if (!ok) {
+        goto end;
+    }
+
+    if (size >= len) {
+        LOGE("\"adb devices\": response too large");
+        goto end;
+    }
+
+    if (!sc_adb_host_recv(intr, socket, buf, size)) {
+        LOGE("\"adb devices\": could not read the response");
+        goto end;
+    }
+    buf[size] = '\0';
+
+    result = SC_ADB_HOST_OK;
+
+end:
+    net_close(socket);
+    return result;
+}
+
+bool
+sc_adb_host_read_output(struct sc_intr *intr, sc_socket socket, char *buf,
+                        size_t len, size_t *out_len) {
+    assert(len);
+
+    // The output is terminated by the end of the stream
+    size_t total = 0;
+    while (total < len - 1) {
+        ssize_t n = net_recv_intr(intr, socket, buf + total, len - 1 - total);
+        if (n < 0) {
+            return false;
+        }
+        if (!n) {
+            break;
+        }
+        total += n;
+    }
+    buf[total] = '\0';
+    if (out_len) {
+        *out_len = total;
+    }
+
+    return true;
+}
+
+enum sc_adb_host_result
+sc_adb_host_shell_read(struct sc_intr *intr, const char *serial,
+                       const char *cmd, char *buf, size_t len,
+                       size_t *out_len, unsigned flags) {
+    assert(len);
+
+    char service[1024];
+    int r = snprintf(service, sizeof(service), "shell:%s", cmd);
+    if (r < 0 || (size_t) r >= sizeof(service)) {
+        LOGE("Shell command too long");
+        return SC_ADB_HOST_ERROR;
+    }
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return SC_ADB_HOST_UNAVAILABLE;
+    }
+
+    enum sc_adb_host_result result = SC_ADB_HOST_ERROR;
+
+    bool ok = sc_adb_host_transport(intr, socket, serial, "shell", flags)
+           && sc_adb_host_send_request(intr, socket, service)
+           && sc_adb_host_read_status(intr, socket, "shell", flags);
+    if (!ok) {
+        goto end;
+    }
+
+    if (!sc_adb_host_read_output(intr, socket, buf, len, out_len)) {
+        LOGE("\"adb shell\": could not read the output");
+        goto end;
+    }
+
+    result = SC_ADB_HOST_OK;
+
+end:
+    net_close(socket);
+    return result;
+}
+
+// Send a sync request: a 4-byte id, a 32-bit little-endian length, then the
+// data
+static bool
+sc_adb_sync_send(struct sc_intr *intr, sc_socket socket, const char *id,
+                 uint32_t len, const void *data) {
+    uint8_t header[8];
+    memcpy(header, id, 4);
+    sc_write32le(&header[4], len);
+    return sc_adb_host_send(intr, socket, header, sizeof(header))
+        && (!data || sc_adb_host_send(intr, socket, data, len));
+}
+
+static bool
+sc_adb_sync_send_file(struct sc_intr *intr, sc_socket socket, FILE *file,
+                      const char *remote) {
+    char path_mode[512];
+    int r = snprintf(path_mode, sizeof(path_mode), "%s,%d", remote,
+                     SC_ADB_PUSH_FILE_MODE);
+    if (r < 0 || (size_t) r >= sizeof(path_mode)) {
+        LOGE("Remote path too long");
+        return false;
+    }
+
+    if (!sc_adb_sync_send(intr, socket, "SEND", r, path_mode)) {
+        return false;
+    }
+
+    uint8_t *buf = malloc(SC_ADB_SYNC_DATA_MAX);
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = true;
+    size_t n;
+    while (ok && (n = fread(buf, 1, SC_ADB_SYNC_DATA_MAX, file))) {
+        ok = sc_adb_sync_send(intr, socket, "DATA", n, buf);
+    }
+
+    free(buf);
+
+    if (ok && ferror(file)) {
+        LOGE("Could not read the file to push");
+        ok = false;
+    }
+
+    if (!ok) {
+        return false;
+    }
+
+    // The DONE length is the modification time of the pushed file
+    return sc_adb_sync_send(intr, socket, "DONE", (uint32_t) time(NULL),
+                            NULL);
+}
+
+bool
+sc_adb_host_sync_push(struct sc_intr *intr, sc_socket socket, FILE *file,
+                      const char *remote, unsigned flags) {
+    if (!sc_adb_sync_send_file(intr, socket, file, remote)) {
+        return false;
+    }
+
+    // The reply is "OKAY" or "FAIL", followed by a 32-bit little-endian
+    // length of the error message
+    uint8_t reply[8];
+    if (!sc_adb_host_recv(intr, socket, reply, sizeof(reply))) {
+        LOGE("\"adb push\": could not read the result");
+        return false;
+    }
+
+    if (!memcmp(reply, "FAIL", 4)) {
+        sc_adb_host_log_failure(intr, socket, "push", sc_read32le(&reply[4]),
+                                flags);
+        return false;
+    }
+
+    if (memcmp(reply, "OKAY", 4)) {
+        LOGE("\"adb push\": unexpected result");
+        return false;
+    }
+
+    // Close the sync session gracefully (ignore errors)
+    sc_adb_sync_send(intr, socket, "QUIT", 0, NULL);
+    return true;
+}
+
+enum sc_adb_host_result
+sc_adb_host_push(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote, unsigned flags) {
+    FILE *file = sc_file_open(local, "rb");
+    if (!file) {
+        LOGE("Could not open \"%s\": %s", local, strerror(errno));
+        return SC_ADB_HOST_ERROR;
+    }
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        fclose(file);
+        return SC_ADB_HOST_UNAVAILABLE;
+    }
+
+    bool ok = sc_adb_host_transport(intr, socket, serial, "push", flags)
+           && sc_adb_host_send_request(intr, socket, "sync:")
+           && sc_adb_host_read_status(intr, socket, "push", flags)
+           && sc_adb_host_sync_push(intr, socket, file, remote, flags);
+
+    net_close(socket);
+    fclose(file);
+    return ok ? SC_ADB_HOST_OK : SC_ADB_HOST_ERROR;
+}
+
+enum sc_adb_host_result
+sc_adb_host_install(struct sc_intr *intr, const char *serial,
+                    const char *local, unsigned flags) {
+    FILE *file = sc_file_open(local, "rb");
+    if (!file) {
+        LOGE("Could not open \"%s\": %s", local, strerror(errno));
+        return SC_ADB_HOST_ERROR;
+    }
+
+    long size;
+    if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0
+            || fseek(file, 0, SEEK_SET)) {
+        LOGE("Could not get the size of \"%s\"", local);
+        fclose(file);
+        return SC_ADB_HOST_ERROR;
+    }
+
+    char service[64];
+    int r = snprintf(service, sizeof(service),
+                     "exec:cmd package install -r -S %ld", size);
+    assert(r >= 0 && (size_t) r < sizeof(service));
+    (void) r;
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        fclose(file);
+        return SC_ADB_HOST_UNAVAILABLE;
+    }
+
+    enum sc_adb_host_result result = SC_ADB_HOST_ERROR;
+
+    uint8_t *buf = NULL;
+    bool ok = sc_adb_host_transport(intr, socket, serial, "install", flags)
+           && sc_adb_host_send_request(intr, socket, service)
+           && sc_adb_host_read_status(intr, socket, "install", flags);
+    if (!ok) {
+        goto end;
+    }
+
+    buf = malloc(SC_ADB_SYNC_DATA_MAX);
+    if (!buf) {
+        LOG_OOM();
+        goto end;
+    }
+
+    // The package manager reads exactly `size` bytes from its input
+    size_t n;
+    while ((n = fread(buf, 1, SC_ADB_SYNC_DATA_MAX, file))) {
+        if (!sc_adb_host_send(intr, socket, buf, n)) {
+            // The command may have failed without reading its input (for
+            // example if "cmd" does not exist, before Android 7)
+            break;
+        }
+    }
+
+    if (ferror(file)) {
+        LOGE("Could not read the file to install");
+        goto end;
+    }
+
+    // The output is terminated by the end of the stream
+    char output[256];
+    size_t total = 0;
+    while (total < sizeof(output) - 1) {
+        ssize_t rn = net_recv_intr(intr, socket, output + total,
+                                   sizeof(output) - 1 - total);
+        if (rn <= 0) {
+            break;
+        }
+        total += rn;
+    }
+    output[total] = '\0';
+
+    if (sc_intr_is_interrupted(intr)) {
+        goto end;
+    }
+
+    // Keep only the first line
+    output[strcspn(output, "\r\n")] = '\0';
+
+    if (!strncmp(output, "Success", 7)) {
+        result = SC_ADB_HOST_OK;
+    } else if (strstr(output, "Failure")) {
+        if (!(flags & SC_ADB_NO_LOGERR)) {
+            LOGE("\"adb install\" failed: %s", output);
+        }
+    } else {
+        // Streamed installation not supported, let the adb executable handle
+        // it
+        LOGD("\"adb install\": unexpected output: %s", output);
+        result = SC_ADB_HOST_UNAVAILABLE;
+    }
+
+end:
+    free(buf);
+    net_close(socket);
+    fclose(file);
+    return result;
+}
@@ -0,0 +1,104 @@
+#ifndef SC_ADB_HOST_H
+#define SC_ADB_HOST_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "util/intr.h"
+#include "util/net.h"
+
+/**
+ * Client of the adb server "smart socket" protocol, to execute some adb
+ * commands without starting an adb process.
+ *
+ * <https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/docs/dev/protocol.md>
+ *
+ * The flags are the same as for the adb.h functions (only SC_ADB_NO_LOGERR is
+ * relevant).
+ */
+
+enum sc_adb_host_result {
+    SC_ADB_HOST_OK,
+    // The command failed (the error has been logged)
+    SC_ADB_HOST_ERROR,
+    // The adb server could not be reached, the command must be executed by
+    // the adb executable instead
+    SC_ADB_HOST_UNAVAILABLE,
+};
+
+enum sc_adb_host_result
+sc_adb_host_forward(struct sc_intr *intr, const char *serial,
+                    const char *local, const char *remote, unsigned flags);
+
+enum sc_adb_host_result
+sc_adb_host_forward_remove(struct sc_intr *intr, const char *serial,
+                           const char *local, unsigned flags);
+
+enum sc_adb_host_result
+sc_adb_host_reverse(struct sc_intr *intr, const char *serial,
+                    const char *remote, const char *local, unsigned flags);
+
+enum sc_adb_host_result
+sc_adb_host_reverse_remove(struct sc_intr *intr, const char *serial,
+                           const char *remote, unsigned flags);
+
+/**
+ * List the devices ("adb devices -l")
+ *
+ * The output is written as a NUL-terminated string to `buf` (of size `len`).
+ */
+enum sc_adb_host_result
+sc_adb_host_devices(struct sc_intr *intr, char *buf, size_t len,
+                    unsigned flags);
+
+/**
+ * Execute a shell command on the device and read its output ("adb shell")
+ *
+ * The output (stdout and stderr) is written as a NUL-terminated string to
+ * `buf` (of size `len`), and its length to `out_len` (if not NULL). The exit
+ * status of the command is not available.
+ */
+enum sc_adb_host_result
+sc_adb_host_shell_read(struct sc_intr *intr, const char *serial,
+                       const char *cmd, char *buf, size_t len,
+                       size_t *out_len, unsigned flags);
+
+/**
+ * Push a local file to the device (via the sync protocol)
+ */
+enum sc_adb_host_result
+sc_adb_host_push(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote, unsigned flags);
+
+/**
+ * Install an APK on the device, streaming it to the package manager (like
+ * "adb install --streamed")
+ *
+ * Return SC_ADB_HOST_UNAVAILABLE if the device does not support streamed
+ * installation (before Android 7).
+ */
+enum sc_adb_host_result
+sc_adb_host_install(struct sc_intr *intr, const char *serial,
+                    const char *local, unsigned flags);
+
+/**
+ * Read the output of a service until the end of the stream
+ *
+ * The socket is connected to the service, through the adb server or another
+ * transport (see adb_usb.h). The output is written as a NUL-terminated string
+ * to `buf` (of size `len`), and its length to `out_len` (if not NULL).
+ */
+bool
+sc_adb_host_read_output(struct sc_intr *intr, sc_socket socket, char *buf,
+                        size_t len, size_t *out_len);
+
+/**
+ * Push a file over a socket connected to the "sync:" service
+ */
+bool
+sc_adb_host_sync_push(struct sc_intr *intr, sc_socket socket, FILE *file,
+                      const char *remote, unsigned flags);
+
+#endif
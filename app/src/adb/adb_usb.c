@@ -0,0 +1,1041 @@
+#include "adb_usb.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <signal.h>
+#endif
+
+#include "adb/adb.h"
+#include "adb/adb_host.h"
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+#define SC_ADB_USB_CLASS 0xFF
+#define SC_ADB_USB_SUBCLASS 0x42
+#define SC_ADB_USB_PROTOCOL 0x01
+
+#define SC_ADB_CMD_CNXN 0x4E584E43
+#define SC_ADB_CMD_AUTH 0x48545541
+#define SC_ADB_CMD_OPEN 0x4E45504F
+#define SC_ADB_CMD_OKAY 0x59414B4F
+#define SC_ADB_CMD_CLSE 0x45534C43
+#define SC_ADB_CMD_WRTE 0x45545257
+
+#define SC_ADB_AUTH_TOKEN 1
+#define SC_ADB_AUTH_SIGNATURE 2
+#define SC_ADB_AUTH_RSAPUBLICKEY 3
+
+#define SC_ADB_VERSION 0x01000001
+#define SC_ADB_MAX_PAYLOAD (1024 * 1024)
+#define SC_ADB_HEADER_SIZE 24
+// Payload limit before the connection is established (the device banner may
+// be longer than the 512 bytes of the connection messages of old devices)
+#define SC_ADB_HANDSHAKE_PAYLOAD_MAX 4096
+
+// Timeout of a single USB transfer, to check regularly if the transport is
+// stopped
+#define SC_ADB_USB_TRANSFER_TIMEOUT_MS 200
+// Maximum delay for adbd to accept or reject a stream
+#define SC_ADB_USB_OPEN_TIMEOUT SC_TICK_FROM_SEC(10)
+
+struct sc_adb_usb_stream {
+    struct sc_adb_usb *au;
+    uint32_t local_id;
+    uint32_t remote_id; // 0 until the stream is accepted by adbd
+
+    // The transport end of the socket pair (the other end is returned to the
+    // caller)
+    sc_socket socket;
+
+    sc_thread writer; // from the socket to the device
+    bool has_writer;
+    sc_thread deliverer; // from the device to the socket
+    bool has_deliverer;
+
+    // All the following fields are protected by au->mutex
+    bool opened; // accepted by adbd
+    bool closed; // CLSE sent or received
+    bool write_pending; // a WRTE is waiting for its OKAY
+    // The payload of the last WRTE received, until it is written to the
+    // socket (adbd does not send another WRTE on this stream before OKAY, so
+    // there is at most one)
+    uint8_t *delivery;
+    uint32_t delivery_len;
+    bool delivery_pending;
+    bool finished; // the writer thread has terminated
+    bool deliverer_finished;
+
+    struct sc_adb_usb_stream *next;
+};
+
+struct sc_adb_usb_interface {
+    uint8_t number;
+    uint8_t endpoint_in;
+    uint8_t endpoint_out;
+    uint16_t max_packet_size; // of the OUT endpoint
+};
+
+struct sc_adb_message {
+    uint32_t cmd;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t len;
+};
+
+static bool
+sc_adb_usb_is_stopped(struct sc_adb_usb *au) {
+    return atomic_load(&au->stopped) || atomic_load(&au->interrupted);
+}
+
+static bool
+sc_adb_usb_transfer(struct sc_adb_usb *au, uint8_t endpoint, uint8_t *data,
+                    size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        if (sc_adb_usb_is_stopped(au)) {
+            return false;
+        }
+
+        int transferred;
+        int r = libusb_bulk_transfer(au->handle, endpoint, data + total,
+                                     len - total, &transferred,
+                                     SC_ADB_USB_TRANSFER_TIMEOUT_MS);
+        total += transferred;
+        if (r == LIBUSB_ERROR_TIMEOUT) {
+            continue;
+        }
+        if (r < 0) {
+            LOGD("ADB USB transfer: libusb error: %s", libusb_strerror(r));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_adb_usb_send(struct sc_adb_usb *au, uint32_t cmd, uint32_t arg0,
+                uint32_t arg1, const void *data, uint32_t len) {
+    const uint8_t *payload = data;
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        checksum += payload[i];
+    }
+
+    uint8_t header[SC_ADB_HEADER_SIZE];
+    sc_write32le(header, cmd);
+    sc_write32le(&header[4], arg0);
+    sc_write32le(&header[8], arg1);
+    sc_write32le(&header[12], len);
+    sc_write32le(&header[16], checksum);
+    sc_write32le(&header[20], cmd ^ 0xFFFFFFFF);
+
+    sc_mutex_lock(&au->write_mutex);
+    bool ok = sc_adb_usb_transfer(au, au->endpoint_out, header,
+                                  sizeof(header));
+    if (ok && len) {
+        ok = sc_adb_usb_transfer(au, au->endpoint_out, (uint8_t *) payload,
+                                 len);
+        if (ok && !(len % au->max_packet_size)) {
+            // Terminate the transfer by a zero-length packet
+            int transferred;
+            int r = libusb_bulk_transfer(au->handle, au->endpoint_out, NULL, 0,
+                                         &transferred,
+                                         SC_ADB_USB_TRANSFER_TIMEOUT_MS);
+            ok = r >= 0;
+        }
+    }
+    sc_mutex_unlock(&au->write_mutex);
+
+    return ok;
+}
+
+// Only called from a single thread (the handshake, then the reader thread)
+static bool
+sc_adb_usb_recv(struct sc_adb_usb *au, struct sc_adb_message *msg,
+                uint8_t *payload, size_t payload_size) {
+    uint8_t header[SC_ADB_HEADER_SIZE];
+    if (!sc_adb_usb_transfer(au, au->endpoint_in, header, sizeof(header))) {
+        return false;
+    }
+
+    msg->cmd = sc_read32le(header);
+    msg->arg0 = sc_read32le(&header[4]);
+    msg->arg1 = sc_read32le(&header[8]);
+    msg->len = sc_read32le(&header[12]);
+    if (sc_read32le(&header[20]) != (msg->cmd ^ 0xFFFFFFFF)) {
+        LOGE("ADB USB: invalid message header");
+        return false;
+    }
+
+    if (msg->len > payload_size) {
+        LOGE("ADB USB: message too large (%" PRIu32 " bytes)", msg->len);
+        return false;
+    }
+
+    return !msg->len
+        || sc_adb_usb_transfer(au, au->endpoint_in, payload, msg->len);
+}
+
+// Find the ADB interface of the device
+static bool
+sc_adb_usb_find_interface(libusb_device *device,
+                          struct sc_adb_usb_interface *out) {
+    struct libusb_config_descriptor *config;
+    if (libusb_get_active_config_descriptor(device, &config) < 0) {
+        return false;
+    }
+
+    bool found = false;
+    for (unsigned i = 0; !found && i < config->bNumInterfaces; ++i) {
+        const struct libusb_interface *interface = &config->interface[i];
+        if (!interface->num_altsetting) {
+            continue;
+        }
+
+        const struct libusb_interface_descriptor *desc =
+            &interface->altsetting[0];
+        if (desc->bInterfaceClass != SC_ADB_USB_CLASS
+                || desc->bInterfaceSubClass != SC_ADB_USB_SUBCLASS
+                || desc->bInterfaceProtocol != SC_ADB_USB_PROTOCOL) {
+            continue;
+        }
+
+        int in_ep = -1;
+        int out_ep = -1;
+        uint16_t max_packet_size = 0;
+        for (unsigned j = 0; j < desc->bNumEndpoints; ++j) {
+            const struct libusb_endpoint_descriptor *ep = &desc->endpoint[j];
+            if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK)
+                    != LIBUSB_TRANSFER_TYPE_BULK) {
+                continue;
+            }
+            if (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+                in_ep = ep->bEndpointAddress;
+            } else {
+                out_ep = ep->bEndpointAddress;
+                max_packet_size = ep->wMaxPacketSize;
+            }
+        }
+
+        if (in_ep != -1 && out_ep != -1 && max_packet_size) {
+            out->number = desc->bInterfaceNumber;
+            out->endpoint_in = in_ep;
+            out->endpoint_out = out_ep;
+            out->max_packet_size = max_packet_size;
+            found = true;
+        }
+    }
+
+    libusb_free_config_descriptor(config);
+    return found;
+}
+
+static char *
+sc_adb_usb_read_serial(libusb_device *device, libusb_device_handle *handle) {
+    struct libusb_device_descriptor desc;
+    if (libusb_get_device_descriptor(device, &desc) < 0
+            || !desc.iSerialNumber) {
+        return NULL;
+    }
+
+    unsigned char buf[128];
+    int r = libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, buf,
+                                               sizeof(buf) - 1);
+    if (r < 0) {
+        return NULL;
+    }
+    buf[r] = '\0';
+
+    return strdup((const char *) buf);
+}
+
+// Open the ADB USB device (with the given serial, if not NULL)
+static bool
+sc_adb_usb_open_device(struct sc_adb_usb *au, const char *serial,
+                       unsigned flags) {
+    bool log_errors = !(flags & SC_ADB_NO_LOGERR);
+
+    libusb_device **list;
+    ssize_t count = libusb_get_device_list(au->context, &list);
+    if (count < 0) {
+        if (log_errors) {
+            LOGE("List USB devices: libusb error: %s",
+                 libusb_strerror((int) count));
+        }
+        return false;
+    }
+
+    unsigned matches = 0;
+    for (ssize_t i = 0; i < count; ++i) {
+        libusb_device *device = list[i];
+
+        struct sc_adb_usb_interface iface;
+        if (!sc_adb_usb_find_interface(device, &iface)) {
+            continue;
+        }
+
+        libusb_device_handle *handle;
+        int r = libusb_open(device, &handle);
+        if (r < 0) {
+            LOGD("Open ADB USB device: libusb error: %s", libusb_strerror(r));
+            continue;
+        }
+
+        char *device_serial = sc_adb_usb_read_serial(device, handle);
+        if (!device_serial || (serial && strcmp(serial, device_serial))) {
+            free(device_serial);
+            libusb_close(handle);
+            continue;
+        }
+
+        if (++matches > 1) {
+            if (matches == 2 && log_errors) {
+                LOGE("Multiple ADB USB devices:");
+                LOGE("    %s", au->serial);
+            }
+            if (log_errors) {
+                LOGE("    %s", device_serial);
+            }
+            free(device_serial);
+            libusb_close(handle);
+            continue;
+        }
+
+        au->handle = handle;
+        au->serial = device_serial;
+        au->interface = iface.number;
+        au->endpoint_in = iface.endpoint_in;
+        au->endpoint_out = iface.endpoint_out;
+        au->max_packet_size = iface.max_packet_size;
+    }
+
+    libusb_free_device_list(list, 1);
+
+    if (matches != 1) {
+        if (matches) {
+            if (log_errors) {
+                LOGE("Select a device via -s (--serial)");
+            }
+            libusb_close(au->handle);
+            free(au->serial);
+        } else if (log_errors) {
+            if (serial) {
+                LOGE("Could not find ADB USB device %s", serial);
+            } else {
+                LOGE("Could not find any ADB USB device");
+            }
+        }
+        au->handle = NULL;
+        au->serial = NULL;
+        return false;
+    }
+
+    int r = libusb_claim_interface(au->handle, au->interface);
+    if (r < 0) {
+        if (log_errors) {
+            LOGE("Claim ADB USB interface: libusb error: %s",
+                 libusb_strerror(r));
+            if (r == LIBUSB_ERROR_BUSY) {
+                LOGE("The device is used by the adb server, stop it with "
+                     "\"adb kill-server\"");
+            }
+        }
+        libusb_close(au->handle);
+        free(au->serial);
+        au->handle = NULL;
+        au->serial = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static char *
+sc_adb_usb_get_key_name(void) {
+    char host[64];
+    const char *user = getenv("USER");
+#ifdef _WIN32
+    const char *computer = getenv("COMPUTERNAME");
+#else
+    const char *computer = getenv("HOSTNAME");
+#endif
+    int r = snprintf(host, sizeof(host), "%s@%s", user ? user : "scrcpy",
+                     computer ? computer : "host");
+    if (r < 0 || (size_t) r >= sizeof(host)) {
+        return strdup("scrcpy@host");
+    }
+    return strdup(host);
+}
+
+// Connect and authenticate to adbd
+static bool
+sc_adb_usb_handshake(struct sc_adb_usb *au, unsigned flags) {
+    bool log_errors = !(flags & SC_ADB_NO_LOGERR);
+
+    static const char banner[] = "host::";
+    // The banner must include the final '\0'
+    bool ok = sc_adb_usb_send(au, SC_ADB_CMD_CNXN, SC_ADB_VERSION,
+                              SC_ADB_MAX_PAYLOAD, banner, sizeof(banner));
+    if (!ok) {
+        if (log_errors) {
+            LOGE("ADB USB: could not send the connection request");
+        }
+        return false;
+    }
+
+    uint8_t payload[SC_ADB_HANDSHAKE_PAYLOAD_MAX];
+    bool signature_sent = false;
+    bool public_key_sent = false;
+    for (;;) {
+        struct sc_adb_message msg;
+        if (!sc_adb_usb_recv(au, &msg, payload, sizeof(payload))) {
+            if (log_errors && !sc_adb_usb_is_stopped(au)) {
+                LOGE("ADB USB: could not read the device response");
+            }
+            return false;
+        }
+
+        if (msg.cmd == SC_ADB_CMD_CNXN) {
+            au->max_payload = MIN(msg.arg1, SC_ADB_MAX_PAYLOAD);
+            LOGD("ADB USB: connected (max payload %" PRIu32 ")",
+                 au->max_payload);
+            return true;
+        }
+
+        if (msg.cmd != SC_ADB_CMD_AUTH || msg.arg0 != SC_ADB_AUTH_TOKEN
+                || msg.len != SC_ADB_AUTH_TOKEN_SIZE) {
+            // Ignore stale messages from a previous session
+            continue;
+        }
+
+        if (!signature_sent) {
+            uint8_t signature[SC_ADB_AUTH_KEY_SIZE];
+            ok = sc_adb_auth_sign(&au->key, payload, signature);
+            if (ok) {
+                ok = sc_adb_usb_send(au, SC_ADB_CMD_AUTH, SC_ADB_AUTH_SIGNATURE,
+                                     0, signature, sizeof(signature));
+            }
+            signature_sent = true;
+        } else if (!public_key_sent) {
+            // The key is not known by the device, send it so that the user
+            // can allow it
+            char *name = sc_adb_usb_get_key_name();
+            char *public_key =
+                name ? sc_adb_auth_get_public_key(&au->key, name) : NULL;
+            free(name);
+            if (!public_key) {
+                return false;
+            }
+
+            // The key must include the final '\0'
+            ok = sc_adb_usb_send(au, SC_ADB_CMD_AUTH, SC_ADB_AUTH_RSAPUBLICKEY,
+                                 0, public_key, strlen(public_key) + 1);
+            free(public_key);
+            public_key_sent = true;
+            LOGI("Allow USB debugging on the device...");
+        }
+
+        if (!ok) {
+            if (log_errors) {
+                LOGE("ADB USB: could not authenticate");
+            }
+            return false;
+        }
+    }
+}
+
+static struct sc_adb_usb_stream *
+sc_adb_usb_find_stream_locked(struct sc_adb_usb *au, uint32_t local_id) {
+    sc_mutex_assert(&au->mutex);
+
+    for (struct sc_adb_usb_stream *s = au->streams; s; s = s->next) {
+        if (s->local_id == local_id) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Mark the stream as closed, and wake up its users
+static void
+sc_adb_usb_close_stream_locked(struct sc_adb_usb *au,
+                               struct sc_adb_usb_stream *stream) {
+    sc_mutex_assert(&au->mutex);
+
+    if (!stream->closed) {
+        stream->closed = true;
+        // Wake up the writer thread and the user of the other end
+        net_interrupt(stream->socket);
+        sc_cond_broadcast(&au->cond);
+    }
+}
+
+// Called from the reader thread: it must never block on the socket, otherwise
+// a single slow stream would stall all the others
+static void
+sc_adb_usb_on_write(struct sc_adb_usb *au, const struct sc_adb_message *msg,
+                    const uint8_t *payload) {
+    uint8_t *data = NULL;
+    if (msg->len) {
+        data = malloc(msg->len);
+        if (!data) {
+            LOG_OOM();
+            // Without OKAY, adbd will not send more data on this stream
+            return;
+        }
+        memcpy(data, payload, msg->len);
+    }
+
+    sc_mutex_lock(&au->mutex);
+    struct sc_adb_usb_stream *stream =
+        sc_adb_usb_find_stream_locked(au, msg->arg1);
+    if (!stream || stream->closed) {
+        sc_mutex_unlock(&au->mutex);
+        free(data);
+        return;
+    }
+
+    if (stream->delivery_pending) {
+        // adbd must wait for OKAY before writing again
+        LOGW("ADB USB: unexpected write on stream %" PRIu32 ", closing it",
+             stream->local_id);
+        uint32_t local_id = stream->local_id;
+        uint32_t remote_id = stream->remote_id;
+        sc_adb_usb_close_stream_locked(au, stream);
+        sc_mutex_unlock(&au->mutex);
+        free(data);
+        sc_adb_usb_send(au, SC_ADB_CMD_CLSE, local_id, remote_id, NULL, 0);
+        return;
+    }
+
+    stream->delivery = data;
+    stream->delivery_len = msg->len;
+    stream->delivery_pending = true;
+    sc_cond_broadcast(&au->cond);
+    sc_mutex_unlock(&au->mutex);
+}
+
+static int
+run_adb_usb_reader(void *data) {
+    struct sc_adb_usb *au = data;
+
+    uint8_t *payload = malloc(au->max_payload);
+    if (!payload) {
+        LOG_OOM();
+        goto end;
+    }
+
+    for (;;) {
+        struct sc_adb_message msg;
+        if (!sc_adb_usb_recv(au, &msg, payload, au->max_payload)) {
+            break;
+        }
+
+        if (msg.cmd == SC_ADB_CMD_WRTE) {
+            sc_adb_usb_on_write(au, &msg, payload);
+            continue;
+        }
+
+        sc_mutex_lock(&au->mutex);
+        struct sc_adb_usb_stream *stream =
+            sc_adb_usb_find_stream_locked(au, msg.arg1);
+        if (stream) {
+            if (msg.cmd == SC_ADB_CMD_OKAY) {
+                if (!stream->opened) {
+                    stream->opened = true;
+                    stream->remote_id = msg.arg0;
+                } else {
+                    stream->write_pending = false;
+                }
+                sc_cond_broadcast(&au->cond);
+            } else if (msg.cmd == SC_ADB_CMD_CLSE) {
+                sc_adb_usb_close_stream_locked(au, stream);
+            }
+        }
+        sc_mutex_unlock(&au->mutex);
+    }
+
+    free(payload);
+
+end:
+    if (!sc_adb_usb_is_stopped(au)) {
+        LOGW("ADB USB device disconnected");
+    }
+
+    sc_mutex_lock(&au->mutex);
+    au->connected = false;
+    for (struct sc_adb_usb_stream *s = au->streams; s; s = s->next) {
+        sc_adb_usb_close_stream_locked(au, s);
+    }
+    sc_cond_broadcast(&au->cond);
+    sc_mutex_unlock(&au->mutex);
+
+    return 0;
+}
+
+static int
+run_adb_usb_writer(void *data) {
+    struct sc_adb_usb_stream *stream = data;
+    struct sc_adb_usb *au = stream->au;
+
+    uint8_t *buf = malloc(au->max_payload);
+    if (!buf) {
+        LOG_OOM();
+    }
+
+    while (buf) {
+        ssize_t r = net_recv(stream->socket, buf, au->max_payload);
+        if (r <= 0) {
+            break;
+        }
+
+        // Wait for the previous write to be acknowledged
+        sc_mutex_lock(&au->mutex);
+        while (stream->write_pending && !stream->closed) {
+            sc_cond_wait(&au->cond, &au->mutex);
+        }
+        bool closed = stream->closed;
+        stream->write_pending = true;
+        sc_mutex_unlock(&au->mutex);
+
+        if (closed || !sc_adb_usb_send(au, SC_ADB_CMD_WRTE, stream->local_id,
+                                       stream->remote_id, buf, r)) {
+            break;
+        }
+    }
+
+    free(buf);
+
+    sc_mutex_lock(&au->mutex);
+    bool was_closed = stream->closed;
+    sc_adb_usb_close_stream_locked(au, stream);
+    stream->finished = true;
+    sc_mutex_unlock(&au->mutex);
+
+    if (!was_closed) {
+        // The user has closed the stream
+        sc_adb_usb_send(au, SC_ADB_CMD_CLSE, stream->local_id,
+                        stream->remote_id, NULL, 0);
+    }
+
+    return 0;
+}
+
+// Write the data received from the device to the socket
+static int
+run_adb_usb_deliverer(void *data) {
+    struct sc_adb_usb_stream *stream = data;
+    struct sc_adb_usb *au = stream->au;
+
+#ifndef _WIN32
+    // Block SIGPIPE in this thread, so that writing to a stream closed by its
+    // user makes the write fail instead of killing scrcpy
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+
+    for (;;) {
+        sc_mutex_lock(&au->mutex);
+        while (!stream->delivery_pending && !stream->closed) {
+            sc_cond_wait(&au->cond, &au->mutex);
+        }
+        if (stream->closed) {
+            sc_mutex_unlock(&au->mutex);
+            break;
+        }
+        const uint8_t *payload = stream->delivery;
+        uint32_t len = stream->delivery_len;
+        sc_mutex_unlock(&au->mutex);
+
+        // This may block until the user of the stream reads the data. The
+        // OKAY is sent only once the data is consumed: this is the flow
+        // control of adb (adbd does not send more data on this stream until
+        // then).
+        ssize_t w = net_send_all(stream->socket, payload, len);
+        bool ok = w >= 0 && (size_t) w == len;
+
+        sc_mutex_lock(&au->mutex);
+        free(stream->delivery);
+        stream->delivery = NULL;
+        stream->delivery_pending = false;
+        bool was_closed = stream->closed;
+        if (!ok) {
+            // The user has closed the stream
+            sc_adb_usb_close_stream_locked(au, stream);
+        }
+        sc_mutex_unlock(&au->mutex);
+
+        if (was_closed) {
+            break;
+        }
+
+        if (!ok) {
+            sc_adb_usb_send(au, SC_ADB_CMD_CLSE, stream->local_id,
+                            stream->remote_id, NULL, 0);
+            break;
+        }
+
+        sc_adb_usb_send(au, SC_ADB_CMD_OKAY, stream->local_id,
+                        stream->remote_id, NULL, 0);
+    }
+
+    sc_mutex_lock(&au->mutex);
+    stream->deliverer_finished = true;
+    sc_mutex_unlock(&au->mutex);
+
+    return 0;
+}
+
+static void
+sc_adb_usb_stream_destroy(struct sc_adb_usb_stream *stream) {
+    if (stream->has_writer) {
+        sc_thread_join(&stream->writer, NULL);
+    }
+    if (stream->has_deliverer) {
+        sc_thread_join(&stream->deliverer, NULL);
+    }
+    free(stream->delivery);
+    net_close(stream->socket);
+    free(stream);
+}
+
+// Release the streams which are not used anymore
+static void
+sc_adb_usb_reap_streams(struct sc_adb_usb *au) {
+    struct sc_adb_usb_stream *reaped = NULL;
+
+    sc_mutex_lock(&au->mutex);
+    struct sc_adb_usb_stream **pnext = &au->streams;
+    while (*pnext) {
+        struct sc_adb_usb_stream *stream = *pnext;
+        if (stream->finished && stream->deliverer_finished) {
+            *pnext = stream->next;
+            stream->next = reaped;
+            reaped = stream;
+        } else {
+            pnext = &stream->next;
+        }
+    }
+    sc_mutex_unlock(&au->mutex);
+
+    while (reaped) {
+        struct sc_adb_usb_stream *next = reaped->next;
+        sc_adb_usb_stream_destroy(reaped);
+        reaped = next;
+    }
+}
+
+sc_socket
+sc_adb_usb_open_stream(struct sc_adb_usb *au, const char *service,
+                       unsigned flags) {
+    bool log_errors = !(flags & SC_ADB_NO_LOGERR);
+
+    sc_adb_usb_reap_streams(au);
+
+    struct sc_adb_usb_stream *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        LOG_OOM();
+        return SC_SOCKET_NONE;
+    }
+
+    sc_socket socket;
+    if (!net_socketpair(&socket, &stream->socket)) {
+        LOGE("ADB USB: could not create a socket pair");
+        free(stream);
+        return SC_SOCKET_NONE;
+    }
+
+    stream->au = au;
+    stream->remote_id = 0;
+    stream->has_writer = false;
+    stream->has_deliverer = false;
+    stream->opened = false;
+    stream->closed = false;
+    stream->write_pending = false;
+    stream->delivery = NULL;
+    stream->delivery_len = 0;
+    stream->delivery_pending = false;
+    stream->finished = false;
+    stream->deliverer_finished = false;
+
+    sc_mutex_lock(&au->mutex);
+    if (!au->connected) {
+        sc_mutex_unlock(&au->mutex);
+        net_close(stream->socket);
+        net_close(socket);
+        free(stream);
+        return SC_SOCKET_NONE;
+    }
+    stream->local_id = ++au->last_local_id;
+    stream->next = au->streams;
+    au->streams = stream;
+    sc_mutex_unlock(&au->mutex);
+
+    // The service must include the final '\0'
+    bool ok = sc_adb_usb_send(au, SC_ADB_CMD_OPEN, stream->local_id, 0,
+                              service, strlen(service) + 1);
+
+    sc_mutex_lock(&au->mutex);
+    sc_tick deadline = sc_tick_now() + SC_ADB_USB_OPEN_TIMEOUT;
+    bool timed_out = false;
+    while (ok && !stream->opened && !stream->closed && !timed_out
+            && !sc_adb_usb_is_stopped(au)) {
+        timed_out = !sc_cond_timedwait(&au->cond, &au->mutex, deadline);
+    }
+    ok = ok && stream->opened && !stream->closed;
+    if (!ok) {
+        // Never accepted, the stream can be released immediately
+        sc_adb_usb_close_stream_locked(au, stream);
+        stream->finished = true;
+        stream->deliverer_finished = true;
+    }
+    sc_mutex_unlock(&au->mutex);
+
+    if (!ok) {
+        if (log_errors) {
+            LOGE("ADB USB: could not open \"%s\"", service);
+        }
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    // The flags are set before the threads are started, since the stream may
+    // be released as soon as they terminate
+    stream->has_deliverer = true;
+    if (!sc_thread_create(&stream->deliverer, run_adb_usb_deliverer,
+                          "scrcpy-adbusb-d", stream)) {
+        stream->has_deliverer = false;
+    } else {
+        stream->has_writer = true;
+        if (!sc_thread_create(&stream->writer, run_adb_usb_writer,
+                              "scrcpy-adbusb-w", stream)) {
+            stream->has_writer = false;
+        }
+    }
+
+    if (!stream->has_writer) {
+        LOGE("ADB USB: could not start stream thread");
+        uint32_t local_id = stream->local_id;
+        uint32_t remote_id = stream->remote_id;
+        sc_mutex_lock(&au->mutex);
+        // This also terminates the deliverer thread, if any
+        sc_adb_usb_close_stream_locked(au, stream);
+        stream->finished = true;
+        if (!stream->has_deliverer) {
+            stream->deliverer_finished = true;
+        }
+        sc_mutex_unlock(&au->mutex);
+        sc_adb_usb_send(au, SC_ADB_CMD_CLSE, local_id, remote_id, NULL, 0);
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+bool
+sc_adb_usb_init(struct sc_adb_usb *au) {
+    if (!sc_adb_auth_key_load(&au->key)) {
+        return false;
+    }
+
+    if (libusb_init(&au->context) != LIBUSB_SUCCESS) {
+        LOGE("Could not initialize libusb");
+        sc_adb_auth_key_destroy(&au->key);
+        return false;
+    }
+
+    if (!sc_mutex_init(&au->mutex)) {
+        goto error_exit_libusb;
+    }
+
+    if (!sc_mutex_init(&au->write_mutex)) {
+        goto error_destroy_mutex;
+    }
+
+    if (!sc_cond_init(&au->cond)) {
+        goto error_destroy_write_mutex;
+    }
+
+    au->handle = NULL;
+    au->serial = NULL;
+    au->connected = false;
+    atomic_init(&au->stopped, false);
+    atomic_init(&au->interrupted, false);
+    au->last_local_id = 0;
+    au->streams = NULL;
+
+    return true;
+
+error_destroy_write_mutex:
+    sc_mutex_destroy(&au->write_mutex);
+error_destroy_mutex:
+    sc_mutex_destroy(&au->mutex);
+error_exit_libusb:
+    libusb_exit(au->context);
+    sc_adb_auth_key_destroy(&au->key);
+
+    return false;
+}
+
+bool
+sc_adb_usb_connect(struct sc_adb_usb *au, const char *serial, unsigned flags) {
+    assert(!au->handle);
+
+    if (atomic_load(&au->interrupted)) {
+        return false;
+    }
+    atomic_store(&au->stopped, false);
+
+    if (!sc_adb_usb_open_device(au, serial, flags)) {
+        return false;
+    }
+
+    if (!sc_adb_usb_handshake(au, flags)) {
+        goto error_release;
+    }
+
+    sc_mutex_lock(&au->mutex);
+    au->connected = true;
+    sc_mutex_unlock(&au->mutex);
+
+    bool ok = sc_thread_create(&au->reader, run_adb_usb_reader,
+                               "scrcpy-adbusb-r", au);
+    if (!ok) {
+        LOGE("ADB USB: could not start reader thread");
+        au->connected = false;
+        goto error_release;
+    }
+
+    return true;
+
+error_release:
+    libusb_release_interface(au->handle, au->interface);
+    libusb_close(au->handle);
+    au->handle = NULL;
+    free(au->serial);
+    au->serial = NULL;
+
+    return false;
+}
+
+bool
+sc_adb_usb_is_connected(struct sc_adb_usb *au) {
+    sc_mutex_lock(&au->mutex);
+    bool connected = au->connected;
+    sc_mutex_unlock(&au->mutex);
+
+    return connected;
+}
+
+void
+sc_adb_usb_disconnect(struct sc_adb_usb *au) {
+    if (!au->handle) {
+        return;
+    }
+
+    // Stop the reader thread (it checks the flag between USB transfers)
+    atomic_store(&au->stopped, true);
+
+    // Close all the streams, to interrupt the stream threads blocked on their
+    // socket
+    sc_mutex_lock(&au->mutex);
+    for (struct sc_adb_usb_stream *s = au->streams; s; s = s->next) {
+        sc_adb_usb_close_stream_locked(au, s);
+    }
+    sc_mutex_unlock(&au->mutex);
+
+    sc_thread_join(&au->reader, NULL);
+
+    sc_mutex_lock(&au->mutex);
+    struct sc_adb_usb_stream *streams = au->streams;
+    au->streams = NULL;
+    sc_mutex_unlock(&au->mutex);
+
+    while (streams) {
+        struct sc_adb_usb_stream *next = streams->next;
+        sc_adb_usb_stream_destroy(streams);
+        streams = next;
+    }
+
+    libusb_release_interface(au->handle, au->interface);
+    libusb_close(au->handle);
+    au->handle = NULL;
+    free(au->serial);
+    au->serial = NULL;
+}
+
+void
+sc_adb_usb_interrupt(struct sc_adb_usb *au) {
+    atomic_store(&au->interrupted, true);
+
+    sc_mutex_lock(&au->mutex);
+    sc_cond_broadcast(&au->cond);
+    sc_mutex_unlock(&au->mutex);
+}
+
+void
+sc_adb_usb_destroy(struct sc_adb_usb *au) {
+    sc_adb_usb_disconnect(au);
+    sc_cond_destroy(&au->cond);
+    sc_mutex_destroy(&au->write_mutex);
+    sc_mutex_destroy(&au->mutex);
+    libusb_exit(au->context);
+    sc_adb_auth_key_destroy(&au->key);
+}
+
+bool
+sc_adb_usb_shell_read(struct sc_adb_usb *au, struct sc_intr *intr,
+                      const char *cmd, char *buf, size_t len, size_t *out_len,
+                      unsigned flags) {
+    char *service;
+    if (asprintf(&service, "shell:%s", cmd) == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    sc_socket socket = sc_adb_usb_open_stream(au, service, flags);
+    free(service);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    bool ok = sc_adb_host_read_output(intr, socket, buf, len, out_len);
+    if (!ok && !(flags & SC_ADB_NO_LOGERR)) {
+        LOGE("\"adb shell\": could not read the output");
+    }
+
+    net_close(socket);
+    return ok;
+}
+
+bool
+sc_adb_usb_push(struct sc_adb_usb *au, struct sc_intr *intr,
+                const char *local, const char *remote, unsigned flags) {
+    FILE *file = sc_file_open(local, "rb");
+    if (!file) {
+        LOGE("Could not open \"%s\": %s", local, strerror(errno));
+        return false;
+    }
+
+    sc_socket socket = sc_adb_usb_open_stream(au, "sync:", flags);
+    if (socket == SC_SOCKET_NONE) {
+        fclose(file);
+        return false;
+    }
+
+    bool ok = sc_adb_host_sync_push(intr, socket, file, remote, flags);
+
+    net_close(socket);
+    fclose(file);
+    return ok;
+}
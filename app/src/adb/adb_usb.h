@@ -0,0 +1,120 @@
+#ifndef SC_ADB_USB_H
+#define SC_ADB_USB_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libusb-1.0/libusb.h>
+
+#include "adb/adb_auth.h"
+#include "util/intr.h"
+#include "util/net.h"
+#include "util/thread.h"
+
+/**
+ * ADB transport over libusb, talking directly to adbd on the device (--adb-usb)
+ *
+ * It replaces the adb server (which must not hold the device, since only one
+ * process may claim the ADB USB interface) for all the communication with the
+ * device: the shell commands, the server push and execution, and the
+ * connections to the scrcpy server.
+ *
+ * Each adb stream is exposed as a local socket (one end of a loopback socket
+ * pair), so that the rest of the client is unchanged.
+ *
+ * <https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/protocol.txt>
+ *
+ * The flags are the same as for the adb.h functions (only SC_ADB_NO_LOGERR is
+ * relevant).
+ */
+
+struct sc_adb_usb_stream;
+
+struct sc_adb_usb {
+    libusb_context *context;
+    libusb_device_handle *handle;
+    struct sc_adb_auth_key key;
+    char *serial;
+
+    uint8_t interface;
+    uint8_t endpoint_in;
+    uint8_t endpoint_out;
+    uint16_t max_packet_size; // of the OUT endpoint
+    uint32_t max_payload; // negotiated with adbd
+
+    sc_thread reader;
+    sc_mutex write_mutex; // a message (header + payload) is written at once
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled on stream state change or transport error
+    bool connected; // protected by mutex
+    atomic_bool stopped; // the transport is being disconnected
+    atomic_bool interrupted; // definitively, by sc_adb_usb_interrupt()
+    uint32_t last_local_id; // protected by mutex
+    struct sc_adb_usb_stream *streams; // linked list, protected by mutex
+};
+
+bool
+sc_adb_usb_init(struct sc_adb_usb *au);
+
+void
+sc_adb_usb_destroy(struct sc_adb_usb *au);
+
+/**
+ * Open the USB device (with the given serial, or the only ADB USB device if
+ * serial is NULL) and authenticate to adbd
+ *
+ * This may wait for the user to allow USB debugging on the device, until
+ * sc_adb_usb_interrupt() is called.
+ */
+bool
+sc_adb_usb_connect(struct sc_adb_usb *au, const char *serial, unsigned flags);
+
+/**
+ * Indicate if the transport is still usable (the device may have been
+ * disconnected)
+ */
+bool
+sc_adb_usb_is_connected(struct sc_adb_usb *au);
+
+void
+sc_adb_usb_disconnect(struct sc_adb_usb *au);
+
+/**
+ * Wake up and fail any blocking call (definitively)
+ */
+void
+sc_adb_usb_interrupt(struct sc_adb_usb *au);
+
+/**
+ * Open a stream to an adb service ("shell:...", "localabstract:...", etc.)
+ *
+ * Return the local end of the stream, to be closed by the caller (which
+ * closes the stream), or SC_SOCKET_NONE on error.
+ */
+sc_socket
+sc_adb_usb_open_stream(struct sc_adb_usb *au, const char *service,
+                       unsigned flags);
+
+/**
+ * Execute a shell command on the device and read its output
+ *
+ * Like sc_adb_host_shell_read(), the exit status of the command is not
+ * available.
+ */
+bool
+sc_adb_usb_shell_read(struct sc_adb_usb *au, struct sc_intr *intr,
+                      const char *cmd, char *buf, size_t len, size_t *out_len,
+                      unsigned flags);
+
+/**
+ * Push a local file to the device (via the sync protocol)
+ */
+bool
+sc_adb_usb_push(struct sc_adb_usb *au, struct sc_intr *intr,
+                const char *local, const char *remote, unsigned flags);
+
+#endif
@@ -0,0 +1,82 @@
+#include "audio_mixer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "util/audio_convert.h"
+#include "util/log.h"
+
+void
+sc_audio_mixer_init(struct sc_audio_mixer *mixer, size_t channels,
+                    uint32_t max_samples) {
+    assert(channels);
+    assert(max_samples);
+    mixer->count = 0;
+    mixer->channels = channels;
+    mixer->max_samples = max_samples;
+    mixer->buf = NULL;
+}
+
+void
+sc_audio_mixer_destroy(struct sc_audio_mixer *mixer) {
+    free(mixer->buf);
+}
+
+bool
+sc_audio_mixer_add_source(struct sc_audio_mixer *mixer,
+                          struct sc_audio_regulator *regulator, float gain) {
+    assert(regulator->sample_size == mixer->channels * sizeof(float));
+    assert(gain >= 0);
+
+    if (mixer->count == SC_AUDIO_MIXER_MAX_SOURCES) {
+        LOGE("Too many audio sources (max %d)", SC_AUDIO_MIXER_MAX_SOURCES);
+        return false;
+    }
+
+    if (mixer->count) {
+        assert(regulator->sample_rate
+                == mixer->sources[0].regulator->sample_rate);
+        if (!mixer->buf) {
+            // The buffer is allocated here, not from the audio callback
+            mixer->buf = malloc(mixer->max_samples * mixer->channels
+                                                   * sizeof(float));
+            if (!mixer->buf) {
+                LOG_OOM();
+                return false;
+            }
+        }
+    }
+
+    struct sc_audio_mixer_source *source = &mixer->sources[mixer->count++];
+    source->regulator = regulator;
+    source->gain = gain;
+
+    return true;
+}
+
+int64_t
+sc_audio_mixer_pull(struct sc_audio_mixer *mixer, float *out,
+                    uint32_t samples) {
+    assert(mixer->count);
+    assert(samples <= mixer->max_samples);
+
+    size_t count = samples * mixer->channels;
+
+    // The first source is pulled directly into the output buffer, so that a
+    // single source without gain costs nothing more than the regulator
+    struct sc_audio_mixer_source *first = &mixer->sources[0];
+    int64_t pts = sc_audio_regulator_pull(first->regulator, (uint8_t *) out,
+                                          samples);
+    if (first->gain != 1.0f) {
+        sc_audio_scale_flt(out, count, first->gain);
+    }
+
+    for (unsigned i = 1; i < mixer->count; ++i) {
+        struct sc_audio_mixer_source *source = &mixer->sources[i];
+        sc_audio_regulator_pull(source->regulator, (uint8_t *) mixer->buf,
+                                samples);
+        sc_audio_mix_flt(out, mixer->buf, count, source->gain);
+    }
+
+    return pts;
+}
@@ -0,0 +1,69 @@
+#ifndef SC_AUDIO_MIXER_H
+#define SC_AUDIO_MIXER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio_regulator.h"
+
+#define SC_AUDIO_MIXER_MAX_SOURCES 8
+
+/**
+ * Audio mixer
+ *
+ * It pulls the samples of several audio regulators (with the same sample rate
+ * and channel layout), applies a gain to each one, and mixes them into a
+ * single output buffer, so that several streams are played by a single audio
+ * output device.
+ *
+ * The sources must be added before the playback starts. The mixing is
+ * performed by the audio output thread (in the callback).
+ */
+struct sc_audio_mixer {
+    struct sc_audio_mixer_source {
+        struct sc_audio_regulator *regulator;
+        float gain;
+    } sources[SC_AUDIO_MIXER_MAX_SOURCES];
+    unsigned count;
+
+    // Number of float values per sample (for all channels)
+    size_t channels;
+
+    // Maximum number of samples pulled at once
+    uint32_t max_samples;
+
+    // Samples of a source before they are mixed (only allocated if there are
+    // several sources)
+    float *buf;
+};
+
+void
+sc_audio_mixer_init(struct sc_audio_mixer *mixer, size_t channels,
+                    uint32_t max_samples);
+
+void
+sc_audio_mixer_destroy(struct sc_audio_mixer *mixer);
+
+/**
+ * Add a source, with a linear gain (1 to keep the samples unchanged)
+ *
+ * Its samples must be interleaved floats, with the mixer channel count.
+ */
+bool
+sc_audio_mixer_add_source(struct sc_audio_mixer *mixer,
+                          struct sc_audio_regulator *regulator, float gain);
+
+/**
+ * Pull `samples` mixed samples into `out`
+ *
+ * Return the PTS of the samples of the first source (the reference for the
+ * synchronization), or -1 if unknown.
+ */
+int64_t
+sc_audio_mixer_pull(struct sc_audio_mixer *mixer, float *out,
+                    uint32_t samples);
+
+#endif
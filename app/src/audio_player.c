@@ -1,9 +1,15 @@
 #include "audio_player.h"
 
+#include <inttypes.h>
+
+#include "trace.h"
 #include "util/log.h"
 
 /** Downcast frame_sink to sc_audio_player */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_audio_player, frame_sink)
+/** Downcast packet_sink to sc_audio_player */
+#define DOWNCAST_PACKET(SINK) \
+    container_of(SINK, struct sc_audio_player, packet_sink)
 
 #define SC_SDL_SAMPLE_FMT AUDIO_F32
 
@@ -11,13 +17,29 @@ static void SDLCALL
 sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     struct sc_audio_player *ap = userdata;
 
+    if (!ap->callback_sched_applied) {
+        // The audio thread is created by SDL, it can only be configured from
+        // the callback
+        sc_thread_apply_sched(ap->callback_sched);
+        ap->callback_sched_applied = true;
+    }
+
     assert(len_int > 0);
     size_t len = len_int;
 
     assert(len % ap->audioreg.sample_size == 0);
     uint32_t out_samples = len / ap->audioreg.sample_size;
 
-    sc_audio_regulator_pull(&ap->audioreg, stream, out_samples);
+    sc_tick begin = sc_trace_begin();
+    int64_t pts = sc_audio_mixer_pull(&ap->mixer, (float *) stream,
+                                      out_samples);
+    sc_trace_end("audio_pull", begin);
+    if (pts != -1) {
+        // These samples will be played once the output buffer has been played
+        sc_tick play_date = sc_tick_now() + ap->output_latency;
+        sc_tick offset = SC_TICK_FROM_US(pts) - play_date;
+        atomic_store_explicit(&ap->clock_offset, offset, memory_order_relaxed);
+    }
 }
 
 static bool
@@ -25,14 +47,15 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
                                 const AVFrame *frame) {
     struct sc_audio_player *ap = DOWNCAST(sink);
 
-    return sc_audio_regulator_push(&ap->audioreg, frame);
+    sc_tick begin = sc_trace_begin();
+    bool ok = sc_audio_regulator_push(&ap->audioreg, frame);
+    sc_trace_end("audio_push", begin);
+
+    return ok;
 }
 
 static bool
-sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
-                                const AVCodecContext *ctx) {
-    struct sc_audio_player *ap = DOWNCAST(sink);
-
+sc_audio_player_open(struct sc_audio_player *ap, const AVCodecContext *ctx) {
 #ifdef SCRCPY_LAVU_HAS_CHLAYOUT
     assert(ctx->ch_layout.nb_channels > 0 && ctx->ch_layout.nb_channels < 256);
     uint8_t nb_channels = ctx->ch_layout.nb_channels;
@@ -49,13 +72,18 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
 
     uint32_t target_buffering_samples =
         ap->target_buffering_delay * ctx->sample_rate / SC_TICK_FREQ;
+    uint32_t max_buffering_samples =
+        ap->max_buffering_delay * ctx->sample_rate / SC_TICK_FREQ;
 
     size_t sample_size = nb_channels * out_bytes_per_sample;
     bool ok = sc_audio_regulator_init(&ap->audioreg, sample_size, ctx,
-                                      target_buffering_samples);
+                                      target_buffering_samples,
+                                      max_buffering_samples,
+                                      ap->print_stats);
     if (!ok) {
         return false;
     }
+    ap->audioreg.metrics = ap->metrics;
 
     uint64_t aout_samples = ap->output_buffer_duration * ctx->sample_rate
                                                        / SC_TICK_FREQ;
@@ -71,6 +99,7 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
     };
     SDL_AudioSpec obtained;
 
+    ap->callback_sched_applied = false;
     ap->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
     if (!ap->device) {
         LOGE("Could not open audio device: %s", SDL_GetError());
@@ -78,6 +107,22 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
         return false;
     }
 
+    // The callback is not called before the device is unpaused
+    sc_audio_mixer_init(&ap->mixer, nb_channels, obtained.samples);
+    ok = sc_audio_mixer_add_source(&ap->mixer, &ap->audioreg, ap->gain);
+    if (!ok) {
+        sc_audio_mixer_destroy(&ap->mixer);
+        SDL_CloseAudioDevice(ap->device);
+        sc_audio_regulator_destroy(&ap->audioreg);
+        return false;
+    }
+
+    ap->output_latency = SC_TICK_FROM_SEC(obtained.samples) / obtained.freq;
+
+    // The driver may be selected by the SDL_AUDIODRIVER environment variable
+    LOGD("Audio output: driver %s, %d Hz, %" PRIu16 " samples per period",
+         SDL_GetCurrentAudioDriver(), obtained.freq, obtained.samples);
+
     // The thread calling open() is the thread calling push(), which fills the
     // audio buffer consumed by the SDL audio thread.
     ok = sc_thread_set_priority(SC_THREAD_PRIORITY_TIME_CRITICAL);
@@ -92,21 +137,88 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
 }
 
 static void
-sc_audio_player_frame_sink_close(struct sc_frame_sink *sink) {
-    struct sc_audio_player *ap = DOWNCAST(sink);
-
+sc_audio_player_close(struct sc_audio_player *ap) {
     assert(ap->device);
     SDL_PauseAudioDevice(ap->device, 1);
     SDL_CloseAudioDevice(ap->device);
 
+    sc_audio_mixer_destroy(&ap->mixer);
     sc_audio_regulator_destroy(&ap->audioreg);
 }
 
+static bool
+sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
+                                const AVCodecContext *ctx) {
+    struct sc_audio_player *ap = DOWNCAST(sink);
+    return sc_audio_player_open(ap, ctx);
+}
+
+static void
+sc_audio_player_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_audio_player *ap = DOWNCAST(sink);
+    sc_audio_player_close(ap);
+}
+
+static bool
+sc_audio_player_packet_sink_open(struct sc_packet_sink *sink,
+                                 AVCodecContext *ctx) {
+    struct sc_audio_player *ap = DOWNCAST_PACKET(sink);
+
+    // Only raw PCM packets may be played without decoding: they contain
+    // interleaved samples in the sample format of the codec context
+    assert(ctx->codec_id == AV_CODEC_ID_PCM_S16LE);
+    assert(!av_sample_fmt_is_planar(ctx->sample_fmt));
+
+    int bytes_per_sample = av_get_bytes_per_sample(ctx->sample_fmt);
+    assert(bytes_per_sample > 0);
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    ap->packet_sample_size = bytes_per_sample * ctx->ch_layout.nb_channels;
+#else
+    ap->packet_sample_size = bytes_per_sample
+                   * av_get_channel_layout_nb_channels(ctx->channel_layout);
+#endif
+    assert(ap->packet_sample_size);
+
+    return sc_audio_player_open(ap, ctx);
+}
+
+static void
+sc_audio_player_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_audio_player *ap = DOWNCAST_PACKET(sink);
+    sc_audio_player_close(ap);
+}
+
+static bool
+sc_audio_player_packet_sink_push(struct sc_packet_sink *sink,
+                                 const AVPacket *packet) {
+    struct sc_audio_player *ap = DOWNCAST_PACKET(sink);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packet, nothing to play
+        return true;
+    }
+
+    assert(packet->size % ap->packet_sample_size == 0);
+    uint32_t samples = packet->size / ap->packet_sample_size;
+
+    const uint8_t *data = packet->data;
+    return sc_audio_regulator_push_samples(&ap->audioreg, &data, samples,
+                                           packet->pts);
+}
+
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick output_buffer_duration) {
+                     sc_tick max_buffering, sc_tick output_buffer_duration,
+                     bool print_stats) {
     ap->target_buffering_delay = target_buffering;
+    ap->max_buffering_delay = max_buffering;
+    atomic_init(&ap->clock_offset, INT64_MIN);
     ap->output_buffer_duration = output_buffer_duration;
+    ap->print_stats = print_stats;
+    ap->callback_sched = NULL;
+    ap->callback_sched_applied = false;
+    ap->gain = 1;
+    ap->metrics = (struct sc_audio_regulator_metrics) {0};
 
     static const struct sc_frame_sink_ops ops = {
         .open = sc_audio_player_frame_sink_open,
@@ -115,4 +227,60 @@ sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
     };
 
     ap->frame_sink.ops = &ops;
+
+    static const struct sc_packet_sink_ops packet_ops = {
+        .open = sc_audio_player_packet_sink_open,
+        .close = sc_audio_player_packet_sink_close,
+        .push = sc_audio_player_packet_sink_push,
+    };
+
+    ap->packet_sink.ops = &packet_ops;
+}
+
+void
+sc_audio_player_set_callback_sched(struct sc_audio_player *ap,
+                                   const struct sc_thread_sched *sched) {
+    ap->callback_sched = sched;
+}
+
+void
+sc_audio_player_set_gain(struct sc_audio_player *ap, float gain) {
+    ap->gain = gain;
+}
+
+void
+sc_audio_player_set_metrics(struct sc_audio_player *ap,
+                            struct sc_metrics *metrics) {
+    struct sc_audio_regulator_metrics *m = &ap->metrics;
+    m->buffering =
+        sc_metrics_register_gauge(metrics, "scrcpy_audio_buffering_us",
+                                  "Average audio buffering");
+    m->target_buffering =
+        sc_metrics_register_gauge(metrics, "scrcpy_audio_target_buffering_us",
+                                  "Target audio buffering");
+    m->compensation =
+        sc_metrics_register_gauge(metrics, "scrcpy_audio_compensation_ppm",
+                                  "Audio clock drift compensation");
+    m->underflow =
+        sc_metrics_register_counter(metrics,
+                                    "scrcpy_audio_underflow_samples_total",
+                                    "Silence samples inserted on underflow");
+    m->skipped =
+        sc_metrics_register_counter(metrics,
+                                    "scrcpy_audio_skipped_samples_total",
+                                    "Audio samples dropped (buffering too "
+                                    "high)");
+}
+
+bool
+sc_audio_player_get_clock_offset(struct sc_audio_player *ap,
+                                 sc_tick *offset) {
+    int64_t value = atomic_load_explicit(&ap->clock_offset,
+                                         memory_order_relaxed);
+    if (value == INT64_MIN) {
+        return false;
+    }
+
+    *offset = value;
+    return true;
 }
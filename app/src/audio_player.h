@@ -3,14 +3,27 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <SDL2/SDL_audio.h>
 
+#include "audio_mixer.h"
 #include "audio_regulator.h"
 #include "trait/frame_sink.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
 #include "util/tick.h"
 
+/**
+ * Audio player
+ *
+ * It is a frame sink of the audio decoder. For raw PCM, it may instead be a
+ * packet sink of the audio demuxer directly, to avoid the "decoding" copy.
+ */
 struct sc_audio_player {
     struct sc_frame_sink frame_sink;
+    struct sc_packet_sink packet_sink;
 
     // The target buffering between the producer and the consumer. This value
     // is directly use for compensation.
@@ -19,15 +32,84 @@ struct sc_audio_player {
     // value should be higher.
     sc_tick target_buffering_delay;
 
+    // If non-zero, the target buffering adapts to the network conditions, up
+    // to this value
+    sc_tick max_buffering_delay;
+
     // SDL audio output buffer size
     sc_tick output_buffer_duration;
 
+    // Print the audio buffering statistics every second
+    bool print_stats;
+
+    // Size of an input sample (for all channels) when used as a packet sink
+    size_t packet_sample_size;
+
+    // Duration of the samples queued in the output device
+    sc_tick output_latency;
+
+    // Offset between the PTS of the samples currently played and the system
+    // time (INT64_MIN if unknown), written by the SDL audio thread
+    atomic_int_least64_t clock_offset;
+
+    // Scheduling constraints of the SDL audio thread (may be NULL), applied
+    // from the first callback (the flag is only accessed from that thread
+    // once the device is open)
+    const struct sc_thread_sched *callback_sched;
+    bool callback_sched_applied;
+
+    // Gain applied to the samples (1 to keep them unchanged)
+    float gain;
+
+    // Passed to the audio regulator on open
+    struct sc_audio_regulator_metrics metrics;
+
     SDL_AudioDeviceID device;
     struct sc_audio_regulator audioreg;
+    // Mix the sources played by the output device (currently only audioreg)
+    struct sc_audio_mixer mixer;
 };
 
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick audio_output_buffer);
+                     sc_tick max_buffering, sc_tick audio_output_buffer,
+                     bool print_stats);
+
+/**
+ * Apply scheduling constraints to the thread calling the audio output callback
+ *
+ * It must be called before the frame sink is opened.
+ */
+void
+sc_audio_player_set_callback_sched(struct sc_audio_player *ap,
+                                   const struct sc_thread_sched *sched);
+
+/**
+ * Set the gain applied to the played samples (1 by default)
+ *
+ * It must be called before the frame sink is opened.
+ */
+void
+sc_audio_player_set_gain(struct sc_audio_player *ap, float gain);
+
+/**
+ * Register the audio buffering metrics to the registry
+ *
+ * It must be called before the frame sink is opened.
+ */
+void
+sc_audio_player_set_metrics(struct sc_audio_player *ap,
+                            struct sc_metrics *metrics);
+
+/**
+ * Get the audio playback clock, to synchronize the video to the audio
+ *
+ * The PTS of the samples currently played is the system time plus this
+ * offset. It may be called from any thread.
+ *
+ * Return false if no sample has been played yet.
+ */
+bool
+sc_audio_player_get_clock_offset(struct sc_audio_player *ap, sc_tick *offset);
 
 #endif
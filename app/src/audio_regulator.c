@@ -7,6 +7,7 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 
+#include "util/audio_convert.h"
 #include "util/log.h"
 
 //#define SC_AUDIO_REGULATOR_DEBUG // uncomment to debug
@@ -29,14 +30,24 @@
  * too high, then latency will become unacceptable. This target value is
  * configured using the scrcpy option --audio-buffer.
  *
+ * If --audio-buffer-max is set, the target is adaptive: it is raised as soon
+ * as an underflow occurs, and lowered progressively while the buffering level
+ * never drops close to zero, so that the latency follows the network
+ * conditions. The consumer only reads the target before the playback starts,
+ * so it is only modified by the producer afterwards.
+ *
  * The regulator cannot adjust the sample input rate (it receives samples
  * produced in real-time) or the sample output rate (it must provide samples as
  * requested by the audio player). Therefore, it may only apply compensation by
  * resampling (converting _m_ input samples to _n_ output samples).
  *
- * The compensation itself is applied by libswresample (FFmpeg). It is
- * configured using swr_set_compensation(). An important work for the regulator
- * is to estimate the compensation value regularly and apply it.
+ * For the common input formats (float or signed 16-bit, packed or planar),
+ * the samples are converted directly, without libswresample, and the
+ * compensation is applied by inserting or dropping a single sample at regular
+ * intervals, each time by resampling a short window by linear interpolation.
+ * For the other formats, the compensation is applied by libswresample
+ * (FFmpeg), configured using swr_set_compensation(). An important work for the
+ * regulator is to estimate the compensation value regularly and apply it.
  *
  * The estimated buffering level is the result of averaging the "natural"
  * buffering (samples are produced and consumed by blocks, so it must be
@@ -54,21 +65,96 @@
  * Therefore, the regulator doesn't drop any sample on underflow. The
  * compensation mechanism will absorb the delay introduced by the inserted
  * silence.
+ *
+ * To make the gap less audible, the beginning of the inserted silence is
+ * replaced by the last samples played backwards, faded out.
+ *
+ * The consumer (the SDL audio callback) runs on a real-time thread, so it must
+ * never wait for the producer: the two sides share no lock. When the
+ * buffering is too high, the producer does not drop old samples itself (this
+ * would require to move the reader cursor concurrently with the consumer), it
+ * requests the consumer to skip them on its next pull.
  */
 
 #define TO_BYTES(SAMPLES) sc_audiobuf_to_bytes(&ar->buf, (SAMPLES))
 #define TO_SAMPLES(BYTES) sc_audiobuf_to_samples(&ar->buf, (BYTES))
 
-void
+// Lowest adaptive target buffering (in ms)
+#define SC_AUDIO_REGULATOR_ADAPTIVE_MIN_MS 10
+// Number of seconds without underflow before lowering the target buffering
+#define SC_AUDIO_REGULATOR_ADAPTIVE_CLEAN_PERIODS 5
+// Duration of the concealment on underflow (in ms)
+#define SC_AUDIO_REGULATOR_CONCEALMENT_MS 10
+// Number of input samples over which a single sample is inserted or dropped
+#define SC_AUDIO_REGULATOR_DRIFT_WINDOW 32
+
+// Keep the last samples played, to conceal a future underflow
+static void
+sc_audio_regulator_save_history(struct sc_audio_regulator *ar,
+                                const uint8_t *samples, uint32_t count) {
+    uint32_t cap = ar->plc.capacity;
+    uint8_t *history = ar->plc.history;
+
+    if (count >= cap) {
+        memcpy(history, samples + TO_BYTES(count - cap), TO_BYTES(cap));
+        ar->plc.size = cap;
+        return;
+    }
+
+    uint32_t keep = MIN(ar->plc.size, cap - count);
+    memmove(history, history + TO_BYTES(ar->plc.size - keep), TO_BYTES(keep));
+    memcpy(history + TO_BYTES(keep), samples, TO_BYTES(count));
+    ar->plc.size = keep + count;
+}
+
+// Fill the missing samples by playing the last samples backwards with a
+// fade-out, so that the waveform stays continuous (an abrupt drop to silence
+// is very audible), then silence
+static void
+sc_audio_regulator_conceal(struct sc_audio_regulator *ar, uint8_t *out,
+                           uint32_t samples) {
+    static_assert(SC_AV_SAMPLE_FMT == AV_SAMPLE_FMT_FLT, "Unexpected format");
+
+    uint32_t size = ar->plc.size;
+    uint32_t i = 0;
+    if (size) {
+        size_t channels = ar->sample_size / sizeof(float);
+        const float *history = (const float *) ar->plc.history;
+        float *dst = (float *) out;
+        for (; i < samples && ar->plc.position < size; ++i) {
+            uint32_t pos = ar->plc.position++;
+            const float *src = &history[(size - 1 - pos) * channels];
+            float gain = 1.f - (float) pos / size;
+            for (size_t c = 0; c < channels; ++c) {
+                dst[i * channels + c] = src[c] * gain;
+            }
+        }
+    }
+
+    memset(out + TO_BYTES(i), 0, TO_BYTES(samples - i));
+}
+
+int64_t
 sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
                         uint32_t out_samples) {
 #ifdef SC_AUDIO_REGULATOR_DEBUG
     LOGD("[Audio] Audio regulator pulls %" PRIu32 " samples", out_samples);
 #endif
 
-    // A lock is necessary in the rare case where the producer needs to drop
-    // samples already pushed (when the buffer is full)
-    sc_mutex_lock(&ar->mutex);
+    uint32_t skip = atomic_load_explicit(&ar->skip_request,
+                                         memory_order_relaxed);
+    if (skip) {
+        // Drop the old samples as requested by the producer
+        uint32_t skipped = sc_audiobuf_read(&ar->buf, NULL, skip);
+        ar->read_samples += skipped;
+#ifdef SC_AUDIO_REGULATOR_DEBUG
+        LOGD("[Audio] Skipping %" PRIu32 " samples", skipped);
+#endif
+        // Decrement only once the samples are consumed, so that the producer
+        // never counts them twice
+        atomic_fetch_sub_explicit(&ar->skip_request, skip,
+                                  memory_order_relaxed);
+    }
 
     bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
     if (!played) {
@@ -84,14 +170,28 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
             // whole buffer with silence (len is small compared to the
             // arbitrary margin value).
             memset(out, 0, out_samples * ar->sample_size);
-            sc_mutex_unlock(&ar->mutex);
-            return;
+            return -1;
         }
     }
 
+    // The PTS of the first sample read, from the mapping maintained by the
+    // producer
+    int64_t pts = -1;
+    int64_t pts_origin = atomic_load_explicit(&ar->pts_origin,
+                                              memory_order_relaxed);
+
     uint32_t read = sc_audiobuf_read(&ar->buf, out, out_samples);
+    if (read && pts_origin != -1) {
+        pts = pts_origin
+            + (int64_t) (ar->read_samples * 1000000 / ar->sample_rate);
+    }
+    ar->read_samples += read;
 
-    sc_mutex_unlock(&ar->mutex);
+    if (read) {
+        sc_audio_regulator_save_history(ar, out, read);
+        // Real samples are played, so a new underflow must be concealed
+        ar->plc.position = 0;
+    }
 
     if (read < out_samples) {
         uint32_t silence = out_samples - read;
@@ -104,7 +204,7 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
         LOGD("[Audio] Buffer underflow, inserting silence: %" PRIu32 " samples",
              silence);
 #endif
-        memset(out + TO_BYTES(read), 0, TO_BYTES(silence));
+        sc_audio_regulator_conceal(ar, out + TO_BYTES(read), silence);
 
         bool received = atomic_load_explicit(&ar->received,
                                              memory_order_relaxed);
@@ -116,35 +216,247 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
     }
 
     atomic_store_explicit(&ar->played, true, memory_order_relaxed);
+
+    return pts;
 }
 
 static uint8_t *
-sc_audio_regulator_get_swr_buf(struct sc_audio_regulator *ar,
-                               uint32_t min_samples) {
+sc_audio_regulator_get_buf(struct sc_audio_regulator *ar, uint8_t **pbuf,
+                           size_t *palloc_size, uint32_t min_samples) {
     size_t min_buf_size = TO_BYTES(min_samples);
-    if (min_buf_size > ar->swr_buf_alloc_size) {
+    if (min_buf_size > *palloc_size) {
         size_t new_size = min_buf_size + 4096;
-        uint8_t *buf = realloc(ar->swr_buf, new_size);
+        uint8_t *buf = realloc(*pbuf, new_size);
         if (!buf) {
             LOG_OOM();
             // Could not realloc to the requested size
             return NULL;
         }
-        ar->swr_buf = buf;
-        ar->swr_buf_alloc_size = new_size;
+        *pbuf = buf;
+        *palloc_size = new_size;
+    }
+
+    return *pbuf;
+}
+
+static void
+sc_audio_regulator_log_stats(struct sc_audio_regulator *ar, float avg,
+                             uint32_t can_read, int diff, int distance) {
+    enum sc_log_level level = ar->print_stats ? SC_LOG_LEVEL_INFO
+                                              : SC_LOG_LEVEL_VERBOSE;
+    float ms_per_sample = 1000.f / ar->sample_rate;
+    int64_t ppm = (int64_t) diff * 1000000 / distance;
+    int64_t swr_delay = swr_get_delay(ar->swr_ctx, ar->sample_rate);
+    LOG(level, "[Audio] buffering: target=%.1fms avg=%.1fms cur=%.1fms "
+               "compensation=%" PRIi64 "ppm underflow=%" PRIu32
+               " skipped=%" PRIu32 " resampler_delay=%" PRIi64,
+        ar->target_buffering * ms_per_sample, avg * ms_per_sample,
+        can_read * ms_per_sample, ppm, ar->underflow_report,
+        ar->skipped_report, swr_delay);
+}
+
+static void
+sc_audio_regulator_update_metrics(struct sc_audio_regulator *ar, float avg,
+                                  int diff, int distance) {
+    struct sc_audio_regulator_metrics *m = &ar->metrics;
+    sc_metric_set(m->buffering, (int64_t) (avg * 1000000 / ar->sample_rate));
+    sc_metric_set(m->target_buffering,
+                  (int64_t) ar->target_buffering * 1000000 / ar->sample_rate);
+    sc_metric_set(m->compensation, (int64_t) diff * 1000000 / distance);
+    sc_metric_add(m->underflow, ar->underflow_report);
+    sc_metric_add(m->skipped, ar->skipped_report);
+}
+
+// Called every second to follow the network conditions
+static void
+sc_audio_regulator_adapt_target(struct sc_audio_regulator *ar) {
+    assert(ar->adaptive.enabled);
+
+    uint32_t target = ar->target_buffering;
+    if (ar->underflow_report) {
+        // The packets arrived too late: raise the target immediately by the
+        // missing samples, plus a margin
+        target += ar->underflow_report + ar->sample_rate / 100; // 10ms
+        ar->adaptive.clean_periods = 0;
+    } else if (++ar->adaptive.clean_periods
+                    >= SC_AUDIO_REGULATOR_ADAPTIVE_CLEAN_PERIODS
+            && !ar->compensation_active) {
+        // The buffering level never went below min_level since the last
+        // update, so part of this margin is not necessary. Wait for the
+        // compensation to reach the previous target first.
+        target -= MIN(target, ar->adaptive.min_level / 4);
+    }
+
+    target = CLAMP(target, ar->adaptive.min, ar->adaptive.max);
+    if (target != ar->target_buffering) {
+        LOGV("[Audio] Target buffering: %" PRIu32 " -> %" PRIu32 " samples",
+             ar->target_buffering, target);
+        ar->target_buffering = target;
+    }
+
+    ar->adaptive.min_level = UINT32_MAX;
+}
+
+static bool
+sc_audio_regulator_supports_direct_conversion(const AVCodecContext *ctx,
+                                              size_t sample_size) {
+    static_assert(SC_AV_SAMPLE_FMT == AV_SAMPLE_FMT_FLT, "Unexpected format");
+
+    size_t channels = sample_size / sizeof(float);
+    switch (ctx->sample_fmt) {
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_S16:
+            return true;
+        case AV_SAMPLE_FMT_FLTP:
+        case AV_SAMPLE_FMT_S16P:
+            // The planes are passed via AVFrame.data
+            return channels <= AV_NUM_DATA_POINTERS;
+        default:
+            return false;
+    }
+}
+
+// Convert the samples to the output format without libswresample
+static void
+sc_audio_regulator_convert_direct(struct sc_audio_regulator *ar, uint8_t *out,
+                                  const uint8_t *const *data,
+                                  uint32_t samples) {
+    static_assert(SC_AV_SAMPLE_FMT == AV_SAMPLE_FMT_FLT, "Unexpected format");
+
+    size_t channels = ar->sample_size / sizeof(float);
+    float *dst = (float *) out;
+    switch (ar->in_fmt) {
+        case AV_SAMPLE_FMT_FLT:
+            memcpy(out, data[0], TO_BYTES(samples));
+            break;
+        case AV_SAMPLE_FMT_S16:
+            sc_audio_convert_s16_to_flt(dst, (const int16_t *) data[0],
+                                        samples * channels);
+            break;
+        case AV_SAMPLE_FMT_FLTP:
+            sc_audio_convert_fltp_to_flt(dst, (const float *const *) data,
+                                         channels, samples);
+            break;
+        default:
+            assert(ar->in_fmt == AV_SAMPLE_FMT_S16P);
+            sc_audio_convert_s16p_to_flt(dst, (const int16_t *const *) data,
+                                         channels, samples);
+            break;
+    }
+}
+
+// Apply a compensation of diff samples (inserted if positive, dropped if
+// negative) over distance input samples
+static int
+sc_audio_regulator_set_compensation(struct sc_audio_regulator *ar, int diff,
+                                    int distance) {
+    if (!ar->direct_conversion) {
+        return swr_set_compensation(ar->swr_ctx, diff, distance);
     }
 
-    return ar->swr_buf;
+    ar->drift.remaining = diff;
+    ar->drift.interval = diff ? distance / abs(diff) : 0;
+    ar->drift.countdown = ar->drift.interval;
+    return 0;
+}
+
+// Copy the samples, inserting or dropping a single sample at regular
+// intervals to compensate the clock drift. Each correction resamples a window
+// of (W + 1) input samples to (W + 2) or W output samples by linear
+// interpolation, which is inaudible, contrary to an abrupt duplication or
+// deletion. A correction which does not fit in the block is postponed.
+//
+// Return the number of samples written to out.
+static uint32_t
+sc_audio_regulator_compensate(struct sc_audio_regulator *ar, uint8_t *out,
+                              uint32_t out_samples, const uint8_t *in,
+                              uint32_t samples) {
+    static_assert(SC_AV_SAMPLE_FMT == AV_SAMPLE_FMT_FLT, "Unexpected format");
+
+    const uint32_t w = SC_AUDIO_REGULATOR_DRIFT_WINDOW;
+    size_t channels = ar->sample_size / sizeof(float);
+    const float *src = (const float *) in;
+    float *dst = (float *) out;
+
+    uint32_t i = 0; // input position
+    uint32_t o = 0; // output position
+    while (ar->drift.remaining) {
+        uint32_t n = MIN(ar->drift.countdown, samples - i);
+        memcpy(&dst[o * channels], &src[i * channels], TO_BYTES(n));
+        i += n;
+        o += n;
+        ar->drift.countdown -= n;
+
+        int d = ar->drift.remaining > 0 ? 1 : -1;
+        if (ar->drift.countdown || samples - i <= w
+                || o + (samples - i) + d > out_samples) {
+            // The next correction will be applied in a next block
+            break;
+        }
+
+        uint32_t count = w + 1 + d;
+        for (uint32_t k = 0; k < count; ++k) {
+            // Position in the window, from 0 to w
+            float pos = (float) k * w / (w + d);
+            uint32_t index = MIN((uint32_t) pos, w - 1);
+            float frac = pos - index;
+            const float *a = &src[(i + index) * channels];
+            const float *b = a + channels;
+            float *s = &dst[(o + k) * channels];
+            for (size_t c = 0; c < channels; ++c) {
+                s[c] = a[c] + (b[c] - a[c]) * frac;
+            }
+        }
+
+        i += w + 1;
+        o += count;
+        ar->drift.remaining -= d;
+        ar->drift.countdown = ar->drift.interval > w + 1
+                            ? ar->drift.interval - (w + 1) : 0;
+    }
+
+    uint32_t n = samples - i;
+    memcpy(&dst[o * channels], &src[i * channels], TO_BYTES(n));
+    return o + n;
+}
+
+// Return the number of samples written to out
+static int
+sc_audio_regulator_convert(struct sc_audio_regulator *ar, uint8_t *out,
+                           int out_samples, const uint8_t *const *data,
+                           uint32_t input_samples) {
+    if (!ar->direct_conversion) {
+        return swr_convert(ar->swr_ctx, &out, out_samples,
+                           (const uint8_t **) data, input_samples);
+    }
+
+    assert(input_samples <= (uint32_t) out_samples);
+
+    if (!ar->drift.remaining) {
+        // Steady state: a plain conversion (or copy)
+        sc_audio_regulator_convert_direct(ar, out, data, input_samples);
+        return input_samples;
+    }
+
+    uint8_t *conv_buf =
+        sc_audio_regulator_get_buf(ar, &ar->conv_buf, &ar->conv_buf_alloc_size,
+                                   input_samples);
+    if (!conv_buf) {
+        return AVERROR(ENOMEM);
+    }
+
+    sc_audio_regulator_convert_direct(ar, conv_buf, data, input_samples);
+    return sc_audio_regulator_compensate(ar, out, out_samples, conv_buf,
+                                         input_samples);
 }
 
 bool
-sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
+sc_audio_regulator_push_samples(struct sc_audio_regulator *ar,
+                                const uint8_t *const *data,
+                                uint32_t input_samples, int64_t pts) {
     SwrContext *swr_ctx = ar->swr_ctx;
 
-    uint32_t input_samples = frame->nb_samples;
-
-    assert(frame->pts >= 0);
-    int64_t pts = frame->pts;
+    assert(pts >= 0);
     if (ar->next_expected_pts && pts - ar->next_expected_pts > 100000) {
         LOGV("[Audio] Discontinuity detected: %" PRIi64 "µs",
              pts - ar->next_expected_pts);
@@ -154,15 +466,18 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         if (input_samples + can_read < ar->target_buffering) {
             // Adjust buffering to the target value directly
             uint32_t silence = ar->target_buffering - can_read - input_samples;
-            sc_audiobuf_write_silence(&ar->buf, silence);
+            ar->written_samples +=
+                sc_audiobuf_write_silence(&ar->buf, silence);
         }
 
         // Reset state
         ar->avg_buffering.avg = ar->target_buffering;
-        int ret = swr_set_compensation(swr_ctx, 0, 0);
-        (void) ret;
-        assert(!ret); // disabling compensation should never fail
-        ar->compensation_active = false;
+        if (ar->compensation_active) {
+            int ret = sc_audio_regulator_set_compensation(ar, 0, 0);
+            (void) ret;
+            assert(!ret); // disabling compensation should never fail
+            ar->compensation_active = false;
+        }
         ar->samples_since_resync = 0;
         atomic_store_explicit(&ar->underflow, 0, memory_order_relaxed);
     }
@@ -171,18 +486,31 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
                             / ar->sample_rate;
     ar->next_expected_pts = pts + packet_duration;
 
+    if (ar->adaptive.enabled
+            && atomic_load_explicit(&ar->played, memory_order_relaxed)) {
+        // The buffering level just before new samples are written is the
+        // margin that was left to absorb the input jitter
+        uint32_t level = sc_audiobuf_can_read(&ar->buf);
+        uint32_t pending_skip = atomic_load_explicit(&ar->skip_request,
+                                                     memory_order_relaxed);
+        level = level > pending_skip ? level - pending_skip : 0;
+        ar->adaptive.min_level = MIN(ar->adaptive.min_level, level);
+    }
+
     int64_t swr_delay = swr_get_delay(swr_ctx, ar->sample_rate);
     // No need to av_rescale_rnd(), input and output sample rates are the same.
     // Add more space (256) for clock compensation.
-    int dst_nb_samples = swr_delay + frame->nb_samples + 256;
+    int dst_nb_samples = swr_delay + input_samples + 256;
 
-    uint8_t *swr_buf = sc_audio_regulator_get_swr_buf(ar, dst_nb_samples);
+    uint8_t *swr_buf =
+        sc_audio_regulator_get_buf(ar, &ar->swr_buf, &ar->swr_buf_alloc_size,
+                                   dst_nb_samples);
     if (!swr_buf) {
         return false;
     }
 
-    int ret = swr_convert(swr_ctx, &swr_buf, dst_nb_samples,
-                          (const uint8_t **) frame->data, frame->nb_samples);
+    int ret = sc_audio_regulator_convert(ar, swr_buf, dst_nb_samples, data,
+                                         input_samples);
     if (ret < 0) {
         LOGE("Resampling failed: %d", ret);
         return false;
@@ -208,35 +536,21 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
 
     uint32_t written = sc_audiobuf_write(&ar->buf, swr_buf, samples);
     if (written < samples) {
-        uint32_t remaining = samples - written;
-
-        // All samples that could be written without locking have been written,
-        // now we need to lock to drop/consume old samples
-        sc_mutex_lock(&ar->mutex);
-
-        // Retry with the lock
-        written += sc_audiobuf_write(&ar->buf,
-                                     swr_buf + TO_BYTES(written),
-                                     remaining);
-        if (written < samples) {
-            remaining = samples - written;
-            // Still insufficient, drop old samples to make space
-            skipped_samples = sc_audiobuf_read(&ar->buf, NULL, remaining);
-            assert(skipped_samples == remaining);
-        }
-
-        sc_mutex_unlock(&ar->mutex);
-
-        if (written < samples) {
-            // Now there is enough space
-            uint32_t w = sc_audiobuf_write(&ar->buf,
-                                           swr_buf + TO_BYTES(written),
-                                           remaining);
-            assert(w == remaining);
-            (void) w;
-        }
+        // Very unlikely: the buffer is large enough to contain 1 second more
+        // than the target buffering, so the consumer is stalled. The old
+        // samples cannot be dropped from the producer side without locking,
+        // so drop the remaining new samples instead.
+        skipped_samples = samples - written;
+        LOGD("[Audio] Buffer full, dropping %" PRIu32 " samples",
+             skipped_samples);
     }
 
+    // The last sample written ends at the end of the input samples
+    ar->written_samples += written;
+    int64_t pts_origin = ar->next_expected_pts
+        - (int64_t) (ar->written_samples * 1000000 / ar->sample_rate);
+    atomic_store_explicit(&ar->pts_origin, pts_origin, memory_order_relaxed);
+
     uint32_t underflow = 0;
     uint32_t max_buffered_samples;
     bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
@@ -255,34 +569,33 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
                              + 10 * ar->sample_rate / 1000 /* 10 ms */;
     }
 
+    // The samples already requested to be skipped do not count
+    uint32_t pending_skip = atomic_load_explicit(&ar->skip_request,
+                                                 memory_order_relaxed);
     uint32_t can_read = sc_audiobuf_can_read(&ar->buf);
+    can_read = can_read > pending_skip ? can_read - pending_skip : 0;
     if (can_read > max_buffered_samples) {
-        uint32_t skip_samples = 0;
-
-        sc_mutex_lock(&ar->mutex);
-        can_read = sc_audiobuf_can_read(&ar->buf);
-        if (can_read > max_buffered_samples) {
-            skip_samples = can_read - max_buffered_samples;
-            uint32_t r = sc_audiobuf_read(&ar->buf, NULL, skip_samples);
-            assert(r == skip_samples);
-            (void) r;
-            skipped_samples += skip_samples;
-        }
-        sc_mutex_unlock(&ar->mutex);
-
-        if (skip_samples) {
-            if (played) {
-                LOGD("[Audio] Buffering threshold exceeded, skipping %" PRIu32
-                     " samples", skip_samples);
+        uint32_t skip_samples = can_read - max_buffered_samples;
+        // The consumer will drop them on its next pull
+        atomic_fetch_add_explicit(&ar->skip_request, skip_samples,
+                                  memory_order_relaxed);
+        // Consider them dropped immediately for the buffering estimation
+        can_read = max_buffered_samples;
+        skipped_samples += skip_samples;
+
+        if (played) {
+            LOGD("[Audio] Buffering threshold exceeded, skipping %" PRIu32
+                 " samples", skip_samples);
 #ifdef SC_AUDIO_REGULATOR_DEBUG
-            } else {
-                LOGD("[Audio] Playback not started, skipping %" PRIu32
-                     " samples", skip_samples);
+        } else {
+            LOGD("[Audio] Playback not started, skipping %" PRIu32
+                 " samples", skip_samples);
 #endif
-            }
         }
     }
 
+    ar->skipped_report += skipped_samples;
+
     atomic_store_explicit(&ar->received, true, memory_order_relaxed);
     if (!played) {
         // Nothing more to do
@@ -322,6 +635,10 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         // Recompute compensation every second
         ar->samples_since_resync = 0;
 
+        if (ar->adaptive.enabled) {
+            sc_audio_regulator_adapt_target(ar);
+        }
+
         float avg = sc_average_get(&ar->avg_buffering);
         int diff = ar->target_buffering - avg;
 
@@ -345,26 +662,37 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         // Limit compensation rate to 2%
         int abs_max_diff = distance / 50;
         diff = CLAMP(diff, -abs_max_diff, abs_max_diff);
-        LOGV("[Audio] Buffering: target=%" PRIu32 " avg=%f cur=%" PRIu32
-             " compensation=%d (underflow=%" PRIu32 ")",
-             ar->target_buffering, avg, can_read, diff, ar->underflow_report);
+        sc_audio_regulator_log_stats(ar, avg, can_read, diff, distance);
+        sc_audio_regulator_update_metrics(ar, avg, diff, distance);
         ar->underflow_report = 0;
-
-        int ret = swr_set_compensation(swr_ctx, diff, distance);
-        if (ret < 0) {
-            LOGW("Resampling compensation failed: %d", ret);
-            // not fatal
-        } else {
-            ar->compensation_active = diff != 0;
+        ar->skipped_report = 0;
+
+        // Do not create a resampler if there is nothing to compensate
+        if (diff || ar->compensation_active) {
+            int ret = sc_audio_regulator_set_compensation(ar, diff, distance);
+            if (ret < 0) {
+                LOGW("Resampling compensation failed: %d", ret);
+                // not fatal
+            } else {
+                ar->compensation_active = diff != 0;
+            }
         }
     }
 
     return true;
 }
 
+bool
+sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
+    return sc_audio_regulator_push_samples(ar,
+                                           (const uint8_t *const *) frame->data,
+                                           frame->nb_samples, frame->pts);
+}
+
 bool
 sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
-                        const AVCodecContext *ctx, uint32_t target_buffering) {
+                        const AVCodecContext *ctx, uint32_t target_buffering,
+                        uint32_t max_buffering, bool print_stats) {
     SwrContext *swr_ctx = swr_alloc();
     if (!swr_ctx) {
         LOG_OOM();
@@ -394,24 +722,38 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
         goto error_free_swr_ctx;
     }
 
-    bool ok = sc_mutex_init(&ar->mutex);
-    if (!ok) {
-        goto error_free_swr_ctx;
-    }
-
     ar->target_buffering = target_buffering;
     ar->sample_size = sample_size;
     ar->sample_rate = ctx->sample_rate;
+    ar->in_fmt = ctx->sample_fmt;
+    ar->direct_conversion =
+        sc_audio_regulator_supports_direct_conversion(ctx, sample_size);
+    ar->drift.remaining = 0;
+    ar->drift.interval = 0;
+    ar->drift.countdown = 0;
+    LOGD("[Audio] Sample conversion: %s",
+         ar->direct_conversion ? "direct" : "libswresample");
+
+    ar->adaptive.enabled = max_buffering > target_buffering;
+    if (ar->adaptive.enabled) {
+        uint32_t min = SC_AUDIO_REGULATOR_ADAPTIVE_MIN_MS * ar->sample_rate
+                     / 1000;
+        ar->adaptive.min = MIN(min, target_buffering);
+        ar->adaptive.max = max_buffering;
+        ar->adaptive.min_level = UINT32_MAX;
+        ar->adaptive.clean_periods = 0;
+    }
 
-    // Use a ring-buffer of the target buffering size plus 1 second between the
-    // producer and the consumer. It's too big on purpose, to guarantee that
-    // the producer and the consumer will be able to access it in parallel
-    // without locking.
-    uint32_t audiobuf_samples = target_buffering + ar->sample_rate;
+    // Use a ring-buffer of the maximum target buffering size plus 1 second
+    // between the producer and the consumer. It's too big on purpose, to
+    // guarantee that the producer and the consumer will be able to access it
+    // in parallel without locking.
+    uint32_t max_target = MAX(target_buffering, max_buffering);
+    uint32_t audiobuf_samples = max_target + ar->sample_rate;
 
-    ok = sc_audiobuf_init(&ar->buf, sample_size, audiobuf_samples);
+    bool ok = sc_audiobuf_init(&ar->buf, sample_size, audiobuf_samples);
     if (!ok) {
-        goto error_destroy_mutex;
+        goto error_free_swr_ctx;
     }
 
     size_t initial_swr_buf_size = TO_BYTES(4096);
@@ -421,6 +763,18 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
         goto error_destroy_audiobuf;
     }
     ar->swr_buf_alloc_size = initial_swr_buf_size;
+    ar->conv_buf = NULL;
+    ar->conv_buf_alloc_size = 0;
+
+    ar->plc.capacity = SC_AUDIO_REGULATOR_CONCEALMENT_MS * ar->sample_rate
+                     / 1000;
+    ar->plc.history = malloc(TO_BYTES(ar->plc.capacity));
+    if (!ar->plc.history) {
+        LOG_OOM();
+        goto error_free_swr_buf;
+    }
+    ar->plc.size = 0;
+    ar->plc.position = 0;
 
     // Samples are produced and consumed by blocks, so the buffering must be
     // smoothed to get a relatively stable value.
@@ -431,16 +785,23 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
     atomic_init(&ar->played, false);
     atomic_init(&ar->received, false);
     atomic_init(&ar->underflow, 0);
+    atomic_init(&ar->skip_request, 0);
+    atomic_init(&ar->pts_origin, -1);
+    ar->written_samples = 0;
+    ar->read_samples = 0;
     ar->underflow_report = 0;
+    ar->skipped_report = 0;
+    ar->print_stats = print_stats;
+    ar->metrics = (struct sc_audio_regulator_metrics) {0};
     ar->compensation_active = false;
     ar->next_expected_pts = 0;
 
     return true;
 
+error_free_swr_buf:
+    free(ar->swr_buf);
 error_destroy_audiobuf:
     sc_audiobuf_destroy(&ar->buf);
-error_destroy_mutex:
-    sc_mutex_destroy(&ar->mutex);
 error_free_swr_ctx:
     swr_free(&ar->swr_ctx);
 
@@ -449,8 +810,9 @@ error_free_swr_ctx:
 
 void
 sc_audio_regulator_destroy(struct sc_audio_regulator *ar) {
+    free(ar->plc.history);
+    free(ar->conv_buf);
     free(ar->swr_buf);
     sc_audiobuf_destroy(&ar->buf);
-    sc_mutex_destroy(&ar->mutex);
     swr_free(&ar->swr_ctx);
 }
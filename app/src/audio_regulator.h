@@ -11,16 +11,36 @@
 #include <libswresample/swresample.h>
 #include "util/audiobuf.h"
 #include "util/average.h"
-#include "util/thread.h"
+#include "util/metrics.h"
 
 #define SC_AV_SAMPLE_FMT AV_SAMPLE_FMT_FLT
 
-struct sc_audio_regulator {
-    sc_mutex mutex;
+// Metrics updated every second by the regulator (NULL if disabled)
+struct sc_audio_regulator_metrics {
+    struct sc_metric *buffering; // gauge (average, in microseconds)
+    struct sc_metric *target_buffering; // gauge (in microseconds)
+    struct sc_metric *compensation; // gauge (in ppm)
+    struct sc_metric *underflow; // counter (silence samples inserted)
+    struct sc_metric *skipped; // counter (samples dropped)
+};
 
+struct sc_audio_regulator {
     // Target buffering between the producer and the consumer (in samples)
+    // (only modified by the receiver thread once the playback has started)
     uint32_t target_buffering;
 
+    // Adaptive target buffering (only used by the receiver thread)
+    struct {
+        bool enabled;
+        // Bounds of the target buffering (in samples)
+        uint32_t min;
+        uint32_t max;
+        // Lowest buffering level observed since the last update
+        uint32_t min_level;
+        // Number of consecutive updates without underflow
+        unsigned clean_periods;
+    } adaptive;
+
     // Audio buffer to communicate between the receiver and the player
     struct sc_audiobuf buf;
 
@@ -32,10 +52,29 @@ struct sc_audio_regulator {
     // The number of bytes per sample (for all channels)
     size_t sample_size;
 
+    // Input sample format
+    enum AVSampleFormat in_fmt;
+    // Whether the input samples are converted without libswresample (the
+    // compensation is then applied by inserting or dropping single samples)
+    bool direct_conversion;
+
+    // Clock drift compensation without libswresample (only used by the
+    // receiver thread)
+    struct {
+        int32_t remaining; // samples to insert (if positive) or drop
+        uint32_t interval; // input samples between two corrections
+        uint32_t countdown; // input samples before the next correction
+    } drift;
+
     // Target buffer for resampling (only used by the receiver thread)
     uint8_t *swr_buf;
     size_t swr_buf_alloc_size;
 
+    // Converted input samples, when a compensation is applied without
+    // libswresample (only used by the receiver thread)
+    uint8_t *conv_buf;
+    size_t conv_buf_alloc_size;
+
     // Number of buffered samples (may be negative on underflow) (only used by
     // the receiver thread)
     struct sc_average avg_buffering;
@@ -46,8 +85,31 @@ struct sc_audio_regulator {
     // Number of silence samples inserted since the last received packet
     atomic_uint_least32_t underflow;
 
+    // Underflow concealment (only used by the player thread)
+    struct {
+        // Last samples played
+        uint8_t *history;
+        uint32_t capacity; // in samples
+        uint32_t size; // in samples
+        // Number of samples concealed since the last real samples
+        uint32_t position;
+    } plc;
+
+    // Number of old samples the consumer must drop (requested by the producer
+    // when the buffering is too high, since only the consumer may consume
+    // samples without locking)
+    atomic_uint_least32_t skip_request;
+
     // Number of silence samples inserted since the last log
     uint32_t underflow_report;
+    // Number of samples dropped since the last log
+    uint32_t skipped_report;
+    // Log the buffering statistics every second at info level (instead of
+    // verbose)
+    bool print_stats;
+    // May be set after sc_audio_regulator_init() (only used by the receiver
+    // thread)
+    struct sc_audio_regulator_metrics metrics;
 
     // Non-zero compensation applied (only used by the receiver thread)
     bool compensation_active;
@@ -60,11 +122,25 @@ struct sc_audio_regulator {
 
     // PTS of the next expected packet (useful to detect discontinuities)
     int64_t next_expected_pts;
+
+    // Total number of samples written to the buffer (only used by the
+    // receiver thread)
+    uint64_t written_samples;
+    // Total number of samples read from the buffer (only used by the player
+    // thread)
+    uint64_t read_samples;
+    // PTS (in microseconds) of the sample at index 0 in the stream of
+    // buffered samples, so that the PTS of the n-th sample is
+    // pts_origin + n / sample_rate (-1 if unknown)
+    atomic_int_least64_t pts_origin;
 };
 
+// If max_buffering is greater than target_buffering, the target buffering is
+// adaptive (up to max_buffering)
 bool
 sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
-                        const AVCodecContext *ctx, uint32_t target_buffering);
+                        const AVCodecContext *ctx, uint32_t target_buffering,
+                        uint32_t max_buffering, bool print_stats);
 
 void
 sc_audio_regulator_destroy(struct sc_audio_regulator *ar);
@@ -72,7 +148,15 @@ sc_audio_regulator_destroy(struct sc_audio_regulator *ar);
 bool
 sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame);
 
-void
+// Push samples in the input format (one pointer per plane)
+bool
+sc_audio_regulator_push_samples(struct sc_audio_regulator *ar,
+                                const uint8_t *const *data,
+                                uint32_t input_samples, int64_t pts);
+
+// Return the PTS of the first sample read (in microseconds), or -1 if only
+// silence has been written
+int64_t
 sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
                         uint32_t samples);
 
@@ -0,0 +1,313 @@
+#include "automation.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_msg.h"
+#include "util/acksync.h"
+#include "util/log.h"
+
+// The device messages not sent yet to the client, beyond which the client is
+// disconnected
+#define SC_AUTOMATION_PENDING_SIZE (2 * DEVICE_MSG_MAX_SIZE)
+
+bool
+sc_automation_init(struct sc_automation *automation, uint16_t port,
+                   const struct sc_automation_callbacks *cbs,
+                   void *cbs_userdata) {
+    bool ok = sc_mutex_init(&automation->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&automation->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    automation->pending = malloc(SC_AUTOMATION_PENDING_SIZE);
+    if (!automation->pending) {
+        LOG_OOM();
+        goto error_destroy_cond;
+    }
+
+    automation->sending = malloc(SC_AUTOMATION_PENDING_SIZE);
+    if (!automation->sending) {
+        LOG_OOM();
+        goto error_free_pending;
+    }
+
+    automation->server_socket = net_socket();
+    if (automation->server_socket == SC_SOCKET_NONE) {
+        LOGE("Could not create automation socket");
+        goto error_free_sending;
+    }
+
+    // Only accept local connections
+    ok = net_listen(automation->server_socket, IPV4_LOCALHOST, port, 1);
+    if (!ok) {
+        LOGE("Could not listen on automation port %" PRIu16, port);
+        goto error_close_socket;
+    }
+
+    automation->client_socket = SC_SOCKET_NONE;
+    automation->client_connected = false;
+    automation->stopped = false;
+    automation->pending_len = 0;
+
+    assert(cbs && cbs->on_msg);
+    automation->cbs = cbs;
+    automation->cbs_userdata = cbs_userdata;
+
+    LOGI("Automation server listening on 127.0.0.1:%" PRIu16, port);
+
+    return true;
+
+error_close_socket:
+    net_close(automation->server_socket);
+error_free_sending:
+    free(automation->sending);
+error_free_pending:
+    free(automation->pending);
+error_destroy_cond:
+    sc_cond_destroy(&automation->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&automation->mutex);
+
+    return false;
+}
+
+void
+sc_automation_destroy(struct sc_automation *automation) {
+    assert(automation->client_socket == SC_SOCKET_NONE);
+    net_close(automation->server_socket);
+    free(automation->sending);
+    free(automation->pending);
+    sc_cond_destroy(&automation->cond);
+    sc_mutex_destroy(&automation->mutex);
+}
+
+// Return the number of bytes consumed, or -1 on error
+static ssize_t
+sc_automation_process_msgs(struct sc_automation *automation,
+                           const uint8_t *buf, size_t len) {
+    size_t head = 0;
+    while (head < len) {
+        struct sc_control_msg msg;
+        ssize_t r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+        if (r == -1) {
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+
+        if (msg.type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD) {
+            // The clipboard acknowledgments are reserved to scrcpy
+            msg.set_clipboard.sequence = SC_SEQUENCE_INVALID;
+        }
+
+        bool ok = automation->cbs->on_msg(automation, &msg,
+                                          automation->cbs_userdata);
+        if (!ok) {
+            LOGW("Could not forward automation message");
+            sc_control_msg_destroy(&msg);
+        }
+
+        head += r;
+        assert(head <= len);
+    }
+
+    return head;
+}
+
+static void
+sc_automation_serve(struct sc_automation *automation, sc_socket socket,
+                    uint8_t *buf) {
+    size_t head = 0;
+
+    for (;;) {
+        assert(head < SC_CONTROL_MSG_MAX_SIZE);
+        ssize_t r = net_recv(socket, buf + head,
+                             SC_CONTROL_MSG_MAX_SIZE - head);
+        if (r <= 0) {
+            // disconnected
+            return;
+        }
+
+        head += r;
+        ssize_t consumed = sc_automation_process_msgs(automation, buf, head);
+        if (consumed == -1) {
+            LOGW("Invalid automation message, disconnecting");
+            return;
+        }
+
+        if (consumed) {
+            head -= consumed;
+            // shift the remaining data in the buffer
+            memmove(buf, &buf[consumed], head);
+        }
+    }
+}
+
+struct sc_automation_sender {
+    struct sc_automation *automation;
+    sc_socket socket;
+};
+
+static int
+run_automation_sender(void *data) {
+    struct sc_automation_sender *sender = data;
+    struct sc_automation *automation = sender->automation;
+
+    for (;;) {
+        sc_mutex_lock(&automation->mutex);
+        while (automation->client_connected && !automation->pending_len) {
+            sc_cond_wait(&automation->cond, &automation->mutex);
+        }
+        if (!automation->client_connected) {
+            sc_mutex_unlock(&automation->mutex);
+            break;
+        }
+        size_t len = automation->pending_len;
+        memcpy(automation->sending, automation->pending, len);
+        automation->pending_len = 0;
+        sc_mutex_unlock(&automation->mutex);
+
+        // Send without holding the mutex, so that a client which does not read
+        // never blocks the caller of sc_automation_forward_device_msg()
+        ssize_t w = net_send_all(sender->socket, automation->sending, len);
+        if (w != (ssize_t) len) {
+            // Wake up the automation thread, which disconnects the client
+            net_interrupt(sender->socket);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int
+run_automation(void *data) {
+    struct sc_automation *automation = data;
+
+    // Large enough to contain at least one msg of maximal size
+    uint8_t *buf = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    if (!buf) {
+        LOG_OOM();
+        return 0;
+    }
+
+    for (;;) {
+        sc_socket socket = net_accept(automation->server_socket);
+        if (socket == SC_SOCKET_NONE) {
+            // interrupted
+            break;
+        }
+
+        sc_mutex_lock(&automation->mutex);
+        if (automation->stopped) {
+            sc_mutex_unlock(&automation->mutex);
+            net_close(socket);
+            break;
+        }
+        automation->client_socket = socket;
+        automation->client_connected = true;
+        automation->pending_len = 0;
+        sc_mutex_unlock(&automation->mutex);
+
+        LOGI("Automation client connected");
+
+        bool ok = net_set_tcp_nodelay(socket, true);
+        (void) ok; // error already logged
+
+        struct sc_automation_sender sender = {
+            .automation = automation,
+            .socket = socket,
+        };
+        ok = sc_thread_create(&automation->sender, run_automation_sender,
+                              "scrcpy-autosend", &sender);
+        if (ok) {
+            sc_automation_serve(automation, socket, buf);
+        } else {
+            LOGE("Could not start automation sender thread");
+        }
+
+        sc_mutex_lock(&automation->mutex);
+        automation->client_socket = SC_SOCKET_NONE;
+        automation->client_connected = false;
+        bool stopped = automation->stopped;
+        sc_cond_signal(&automation->cond);
+        sc_mutex_unlock(&automation->mutex);
+
+        if (ok) {
+            sc_thread_join(&automation->sender, NULL);
+        }
+
+        net_close(socket);
+
+        LOGI("Automation client disconnected");
+
+        if (stopped) {
+            break;
+        }
+    }
+
+    free(buf);
+
+    LOGD("Automation server stopped");
+
+    return 0;
+}
+
+bool
+sc_automation_start(struct sc_automation *automation) {
+    LOGD("Starting automation thread");
+
+    bool ok = sc_thread_create(&automation->thread, run_automation,
+                               "scrcpy-automate", automation);
+    if (!ok) {
+        LOGE("Could not start automation thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_automation_stop(struct sc_automation *automation) {
+    sc_mutex_lock(&automation->mutex);
+    automation->stopped = true;
+    if (automation->client_socket != SC_SOCKET_NONE) {
+        net_interrupt(automation->client_socket);
+    }
+    sc_mutex_unlock(&automation->mutex);
+
+    net_interrupt(automation->server_socket);
+}
+
+void
+sc_automation_join(struct sc_automation *automation) {
+    sc_thread_join(&automation->thread, NULL);
+}
+
+void
+sc_automation_forward_device_msg(struct sc_automation *automation,
+                                 const uint8_t *buf, size_t len) {
+    sc_mutex_lock(&automation->mutex);
+    if (automation->client_socket != SC_SOCKET_NONE) {
+        if (automation->pending_len + len <= SC_AUTOMATION_PENDING_SIZE) {
+            memcpy(&automation->pending[automation->pending_len], buf, len);
+            automation->pending_len += len;
+            sc_cond_signal(&automation->cond);
+        } else {
+            LOGW("Automation client too slow, disconnecting");
+            // The automation thread disconnects the client
+            net_interrupt(automation->client_socket);
+            automation->client_socket = SC_SOCKET_NONE;
+        }
+    }
+    sc_mutex_unlock(&automation->mutex);
+}
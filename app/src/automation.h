@@ -0,0 +1,86 @@
+#ifndef SC_AUTOMATION_H
+#define SC_AUTOMATION_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "control_msg.h"
+#include "util/net.h"
+#include "util/thread.h"
+
+/**
+ * Local automation server (--automation-port)
+ *
+ * It listens on localhost, and accepts one client at a time. The client sends
+ * control messages in the format of the control socket (as serialized by
+ * sc_control_msg_serialize()), they are forwarded as is to the controller
+ * (without going through the SDL event loop). All the device messages
+ * received from the device are forwarded back to the client, in the format of
+ * the control socket.
+ *
+ * The device messages are never sent from the caller thread: they are copied
+ * to a bounded buffer, sent to the client by a separate thread. A client
+ * which does not read them fast enough is disconnected.
+ *
+ * This provides a low-overhead input path for scripts.
+ */
+struct sc_automation {
+    sc_socket server_socket;
+    sc_thread thread;
+    sc_thread sender;
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled when data is pending or the client disconnects
+    // The connected client, or SC_SOCKET_NONE
+    sc_socket client_socket;
+    bool client_connected;
+    bool stopped;
+
+    // The device messages to send to the client
+    uint8_t *pending;
+    size_t pending_len;
+    // The device messages being sent (only accessed by the sender thread)
+    uint8_t *sending;
+
+    const struct sc_automation_callbacks *cbs;
+    void *cbs_userdata;
+};
+
+struct sc_automation_callbacks {
+    // Called from the automation thread for each message received from the
+    // client. On success, the callee takes ownership of the msg.
+    bool (*on_msg)(struct sc_automation *automation,
+                   const struct sc_control_msg *msg, void *userdata);
+};
+
+bool
+sc_automation_init(struct sc_automation *automation, uint16_t port,
+                   const struct sc_automation_callbacks *cbs,
+                   void *cbs_userdata);
+
+void
+sc_automation_destroy(struct sc_automation *automation);
+
+bool
+sc_automation_start(struct sc_automation *automation);
+
+void
+sc_automation_stop(struct sc_automation *automation);
+
+void
+sc_automation_join(struct sc_automation *automation);
+
+/**
+ * Forward a serialized device message to the client (if any)
+ *
+ * It is called from the controller thread. It never blocks on the client
+ * socket.
+ */
+void
+sc_automation_forward_device_msg(struct sc_automation *automation,
+                                 const uint8_t *buf, size_t len);
+
+#endif
@@ -114,6 +114,92 @@ enum {
     OPT_NO_VD_SYSTEM_DECORATIONS,
     OPT_NO_VD_DESTROY_CONTENT,
     OPT_DISPLAY_IME_POLICY,
+    OPT_VIDEO_HWACCEL,
+    OPT_VIDEO_DECODER_THREADS,
+    OPT_VIDEO_DECODER_THREAD_TYPE,
+    OPT_VIDEO_PACING,
+    OPT_VIDEO_DECODER_SKIP_NONREF,
+    OPT_PRINT_LATENCY,
+    OPT_VIDEO_SKIP_REPEATED_FRAMES,
+    OPT_BENCHMARK_DECODE,
+    OPT_ADAPTIVE_BIT_RATE,
+    OPT_VIDEO_SOCKET_BUFFER_SIZE,
+    OPT_VIDEO_SOCKET_BUSY_POLL,
+    OPT_VIDEO_BUFFER_MAX,
+    OPT_AUDIO_BUFFER_MAX,
+    OPT_AV_SYNC,
+    OPT_PRINT_AUDIO_STATS,
+    OPT_RECORD_SEGMENT_DURATION,
+    OPT_RECORD_SEGMENT_SIZE,
+    OPT_RECORD_SEGMENT_COUNT,
+    OPT_RECORD_MEMORY_LIMIT,
+    OPT_REPLAY_BUFFER,
+    OPT_REPLAY_FILE,
+    OPT_RECORD_FRAGMENT_DURATION,
+    OPT_RECORD_INDEX,
+    OPT_RECORD_ON_DEMAND,
+    OPT_V4L2_FORMAT,
+    OPT_V4L2_FPS,
+    OPT_SHM_SINK,
+    OPT_RESTREAM,
+    OPT_THUMBNAIL,
+    OPT_THUMBNAIL_INTERVAL,
+    OPT_THUMBNAIL_SIZE,
+    OPT_RAW_VIDEO,
+    OPT_RAW_VIDEO_HEADER,
+    OPT_FRAME_SINK_PLUGIN,
+    OPT_INPUT_RECORD,
+    OPT_INPUT_REPLAY,
+    OPT_AUTOMATION_PORT,
+    OPT_GAMEPAD_REPORT_RATE,
+    OPT_VIDEO_LATENCY,
+    OPT_RECORD_STREAM,
+    OPT_RECORD_VIDEO_BIT_RATE,
+    OPT_RECORD_MAX_SIZE,
+    OPT_VIDEO_INTRA_REFRESH,
+    OPT_BACKGROUND_MAX_FPS,
+    OPT_VIDEO_IDLE_TIMEOUT,
+    OPT_PRINT_STARTUP_TIMING,
+    OPT_RECONNECT,
+    OPT_ALT_VIDEO_PROFILE,
+    OPT_THREAD_AFFINITY,
+    OPT_THREAD_POLICY,
+    OPT_METRICS_FILE,
+    OPT_METRICS_INTERVAL,
+    OPT_METRICS_PORT,
+    OPT_TRACE_FILE,
+    OPT_STREAM_CAPTURE,
+    OPT_STREAM_REPLAY,
+    OPT_STREAM_REPLAY_FAST,
+    OPT_VIDEO_BUFFER_PACKETS,
+    OPT_ADAPTIVE_MAX_SIZE,
+    OPT_YUV_SHADER,
+    OPT_PRESENT_MODE,
+    OPT_LATENCY_PROFILE,
+    OPT_SCREENSHOT_DIR,
+    OPT_SCREENSHOT_FORMAT,
+    OPT_VIDEO_DECODER_RESILIENT,
+    OPT_VIDEO_CATCH_UP,
+    OPT_EXTRA_DISPLAY,
+    OPT_INPUT_PACING,
+    OPT_CPU_BUDGET,
+    OPT_POWER_SAVING,
+    OPT_SOAK,
+    OPT_BENCHMARK_TOUCH,
+    OPT_RECORD_TRANSCODE,
+    OPT_RECORD_TRANSCODE_QUALITY,
+    OPT_RECORD_UPLOAD,
+    OPT_RECORD_UPLOAD_ONLY,
+    OPT_AUDIO_VOLUME,
+    OPT_NEW_DISPLAY_FOLLOW_WINDOW,
+    OPT_VIDEO_BIT_RATE_MODE,
+    OPT_VIDEO_QUALITY,
+    OPT_VIDEO_MAX_BIT_RATE,
+    OPT_MATCH_REFRESH_RATE,
+    OPT_ADB_USB,
+    OPT_DIRECT_TCP,
+    OPT_AUTO_TUNNEL,
+    OPT_RECORD_SYNC,
 };
 
 struct sc_option {
@@ -150,6 +236,49 @@ struct sc_getopt_adapter {
 };
 
 static const struct sc_option options[] = {
+    {
+        .longopt_id = OPT_ADAPTIVE_BIT_RATE,
+        .longopt = "adaptive-bit-rate",
+        .text = "Periodically report the video reception statistics to the "
+                "device, so that it lowers the video bit rate when the "
+                "connection cannot keep up (and raises it back, up to "
+                "--video-bit-rate, once it can).\n"
+                "It requires control to be enabled.",
+    },
+    {
+        .longopt_id = OPT_ADAPTIVE_MAX_SIZE,
+        .longopt = "adaptive-max-size",
+        .text = "Report the size of the video in the window to the device "
+                "(once the window has not been resized for a moment), so that "
+                "it captures the video at that resolution (never above "
+                "--max-size), instead of sending a larger video which would "
+                "be downscaled on rendering.\n"
+                "It requires video playback and control, and has no effect "
+                "if the video is also recorded or forwarded.",
+    },
+    {
+        .longopt_id = OPT_ADB_USB,
+        .longopt = "adb-usb",
+        .text = "Communicate with the device over USB directly (with the "
+                "key of the adb client, ~/.android/adbkey), without the adb "
+                "server.\n"
+                "The adb server must not be running (or not hold the "
+                "device): run \"adb kill-server\" first.\n"
+                "File drag & drop is not supported in this mode.",
+    },
+    {
+        .longopt_id = OPT_ALT_VIDEO_PROFILE,
+        .longopt = "alt-video-profile",
+        .argdesc = "key=value[,...]",
+        .text = "Define an alternative video profile, to switch at runtime "
+                "between the initial video settings and this one with "
+                "MOD+Shift+p, without restarting the session.\n"
+                "The possible keys are: max-size, bit-rate, max-fps and crop "
+                "(width:height:x:y). The settings not defined keep their "
+                "initial value.\n"
+                "For example: max-size=1024,bit-rate=2M,max-fps=15\n"
+                "It requires video playback and control to be enabled.",
+    },
     {
         .longopt_id = OPT_ALWAYS_ON_TOP,
         .longopt = "always-on-top",
@@ -179,6 +308,16 @@ static const struct sc_option options[] = {
                 "likelihood of buffer underrun (causing audio glitches).\n"
                 "Default is 50.",
     },
+    {
+        .longopt_id = OPT_AUDIO_BUFFER_MAX,
+        .longopt = "audio-buffer-max",
+        .argdesc = "ms",
+        .text = "Enable adaptive audio buffering: the buffering delay starts "
+                "at --audio-buffer, then is raised on buffer underrun and "
+                "lowered while the network is stable, up to this value (in "
+                "milliseconds).\n"
+                "Default is 0 (no adaptive buffering).",
+    },
     {
         .longopt_id = OPT_AUDIO_CODEC,
         .longopt = "audio-codec",
@@ -254,6 +393,56 @@ static const struct sc_option options[] = {
                 "a higher value (10). Do not change this setting otherwise.\n"
                 "Default is 5.",
     },
+    {
+        .longopt_id = OPT_AUDIO_VOLUME,
+        .longopt = "audio-volume",
+        .argdesc = "percent",
+        .text = "Apply a gain to the audio playback, in percent of the "
+                "original volume (between 0 and 400).\n"
+                "Values above 100 may cause clipping.\n"
+                "Default is 100.",
+    },
+    {
+        .longopt_id = OPT_AV_SYNC,
+        .longopt = "av-sync",
+        .text = "Synchronize the video playback to the audio playback: each "
+                "frame is displayed when the audio having the same timestamp "
+                "is played.\n"
+                "This delays the video by the audio buffering.",
+    },
+    {
+        .longopt_id = OPT_AUTO_TUNNEL,
+        .longopt = "auto-tunnel",
+        .text = "On the first connection to a device, measure the throughput "
+                "and the round-trip time of each tunnel mode (adb reverse, "
+                "adb forward, and --direct-tcp over TCP/IP only if it is also "
+                "set), and use the fastest one.\n"
+                "The result is cached for the device build and transport, "
+                "and used on later starts.",
+    },
+    {
+        .longopt_id = OPT_AUTOMATION_PORT,
+        .longopt = "automation-port",
+        .argdesc = "port",
+        .text = "Listen on the given TCP port (on localhost only) for an "
+                "automation client.\n"
+                "The client sends control messages in the scrcpy control "
+                "protocol format, which are forwarded as is to the device "
+                "(without going through the window events). The device "
+                "messages are forwarded back to the client.\n"
+                "Only one client is accepted at a time.",
+    },
+    {
+        .longopt_id = OPT_BACKGROUND_MAX_FPS,
+        .longopt = "background-max-fps",
+        .argdesc = "value",
+        .text = "Limit the device frame rate while the window is unfocused, "
+                "and suspend the video encoding while it is minimized (unless "
+                "the video is also recorded or forwarded).\n"
+                "The initial limit (--max-fps) is restored when the window "
+                "gets the focus again.\n"
+                "It requires control to be enabled.",
+    },
     {
         .shortopt = 'b',
         .longopt = "video-bit-rate",
@@ -262,6 +451,32 @@ static const struct sc_option options[] = {
                 "Unit suffixes are supported: 'K' (x1000) and 'M' (x1000000).\n"
                 "Default is 8M (8000000).",
     },
+    {
+        .longopt_id = OPT_BENCHMARK_DECODE,
+        .longopt = "benchmark-decode",
+        .text = "Decode the video stream without displaying it, and print "
+                "the decoding statistics (frame rate, bit rate and decoding "
+                "time percentiles) when the stream ends.\n"
+                "Combine with --time-limit to benchmark for a given "
+                "duration.\n"
+                "Implies --no-window, --no-audio and --no-control.",
+    },
+    {
+        .longopt_id = OPT_BENCHMARK_TOUCH,
+        .longopt = "benchmark-touch",
+        .argdesc = "trials",
+        .optional_arg = true,
+        .text = "Measure the latency from a tap injected on the device to its "
+                "visible effect in the decoded video, over the given number "
+                "of trials, then exit.\n"
+                "The taps are injected at the center of the screen, and the "
+                "effect is the pointer location overlay drawn by the device "
+                "(the \"Pointer location\" developer option is enabled "
+                "during the benchmark). Each tap should have no other effect "
+                "(for example, open an empty screen).\n"
+                "Passing the option without argument is equivalent to passing "
+                "20.",
+    },
     {
         // deprecated
         .longopt_id = OPT_BIT_RATE,
@@ -345,13 +560,32 @@ static const struct sc_option options[] = {
         .longopt = "codec-options",
         .argdesc = "key[:type]=value[,...]",
     },
+    {
+        .longopt_id = OPT_CPU_BUDGET,
+        .longopt = "cpu-budget",
+        .argdesc = "percent",
+        .text = "Keep the CPU usage of scrcpy within a budget, in percent of "
+                "one CPU core (it may exceed 100 on multicore CPUs).\n"
+                "While the budget is exceeded, the video is degraded step by "
+                "step: the non-reference frames are not decoded (it enables "
+                "--video-decoder-skip-nonref), the render rate is lowered, "
+                "the device frame rate is lowered, then the video resolution "
+                "is lowered. The steps are restored once the usage is low "
+                "enough.\n"
+                "Lowering the device frame rate and resolution requires "
+                "control, and the resolution is never lowered if the video is "
+                "also recorded or forwarded.",
+    },
     {
         .longopt_id = OPT_CROP,
         .longopt = "crop",
-        .argdesc = "width:height:x:y",
+        .argdesc = "width:height:x:y[,...]",
         .text = "Crop the device screen on the server.\n"
                 "The values are expressed in the device natural orientation "
-                "(typically, portrait for a phone, landscape for a tablet).",
+                "(typically, portrait for a phone, landscape for a tablet).\n"
+                "Several crop areas may be separated by ','. They are "
+                "captured at full resolution and tiled into a single video "
+                "(only with --video-source=display, without --new-display).",
     },
     {
         .shortopt = 'd',
@@ -359,6 +593,22 @@ static const struct sc_option options[] = {
         .text = "Use USB device (if there is exactly one, like adb -d).\n"
                 "Also see -e (--select-tcpip).",
     },
+    {
+        .longopt_id = OPT_DIRECT_TCP,
+        .longopt = "direct-tcp",
+        .argdesc = "port",
+        .optional_arg = true,
+        .text = "Only use adb to start the server, then connect to it over "
+                "TCP/IP directly, on the given device port (the device must "
+                "be reachable from the computer, typically on the same "
+                "Wi-Fi network).\n"
+                "This avoids the overhead of the adb transport (especially "
+                "over TCP/IP, with --tcpip). The server only listens on the "
+                "device address reached by the computer, and each connection "
+                "is authenticated by its own one-time token, but the streams "
+                "are not encrypted.\n"
+                "Default is " STR(SC_DIRECT_TCP_PORT_DEFAULT) ".",
+    },
     {
         .longopt_id = OPT_DISABLE_SCREENSAVER,
         .longopt = "disable-screensaver",
@@ -421,6 +671,20 @@ static const struct sc_option options[] = {
         .longopt = "encoder",
         .argdesc = "name",
     },
+    {
+        .longopt_id = OPT_EXTRA_DISPLAY,
+        .longopt = "extra-display",
+        .argdesc = "id|new[:[<width>x<height>][/<dpi>]]",
+        .text = "Stream an additional display in a separate view-only window, "
+                "over the same connection. It is either an existing display "
+                "(see --list-displays) or a new virtual display (with the "
+                "same syntax as --new-display).\n"
+                "The input events are only injected to the main display.\n"
+                "This option may be repeated (up to 4 extra displays).\n"
+                "Examples:\n"
+                "    --extra-display=2\n"
+                "    --extra-display=new:1920x1080/240",
+    },
     {
         .shortopt = 'f',
         .longopt = "fullscreen",
@@ -432,6 +696,16 @@ static const struct sc_option options[] = {
         .text = "Do not attempt to use \"adb reverse\" to connect to the "
                 "device.",
     },
+    {
+        .longopt_id = OPT_FRAME_SINK_PLUGIN,
+        .longopt = "frame-sink-plugin",
+        .argdesc = "library",
+        .text = "Load a plugin from the given shared library, and forward the "
+                "decoded video frames to it.\n"
+                "The plugin ABI is described in the header "
+                "<scrcpy/frame_sink_plugin.h>.\n"
+                "This option may be repeated to load several plugins.",
+    },
     {
         // deprecated
         .longopt_id = OPT_FORWARD_ALL_CLICKS,
@@ -454,11 +728,54 @@ static const struct sc_option options[] = {
                 "It may only work over USB.\n"
                 "Also see --keyboard and --mouse.",
     },
+    {
+        .longopt_id = OPT_GAMEPAD_REPORT_RATE,
+        .longopt = "gamepad-report-rate",
+        .argdesc = "value",
+        .text = "Limit the number of HID reports sent per second for each "
+                "gamepad on axis (analog sticks and triggers) changes. The "
+                "latest state is always sent. Button changes are sent "
+                "immediately.\n"
+                "0 means unlimited.\n"
+                "Default is 250.",
+    },
     {
         .shortopt = 'h',
         .longopt = "help",
         .text = "Print this help.",
     },
+    {
+        .longopt_id = OPT_INPUT_PACING,
+        .longopt = "input-pacing",
+        .argdesc = "ms",
+        .text = "Delay the injection of the touch and scroll events on the "
+                "device by a fixed amount, so that they are replayed with "
+                "their original spacing even if the network jitter is "
+                "larger.\n"
+                "By default, the events are injected as soon as they are "
+                "received, with device times corrected from their client "
+                "timestamps.\n"
+                "Default is 0 (no delay).",
+    },
+    {
+        .longopt_id = OPT_INPUT_RECORD,
+        .longopt = "input-record",
+        .argdesc = "file",
+        .text = "Record the input events sent to the device (keys, text, "
+                "touch and scroll events injected by the Android system API) "
+                "with their timestamps to a binary file, to replay them later "
+                "with --input-replay.",
+    },
+    {
+        .longopt_id = OPT_INPUT_REPLAY,
+        .longopt = "input-replay",
+        .argdesc = "file",
+        .text = "Replay the input events recorded by --input-record, at their "
+                "original timing (relative to the start of the session).\n"
+                "The positions being relative to the video size, the session "
+                "must use the same device orientation and video size as the "
+                "recorded one.",
+    },
     {
         .shortopt = 'K',
         .text = "Same as --keyboard=uhid, or --keyboard=aoa if --otg is set.",
@@ -498,6 +815,29 @@ static const struct sc_option options[] = {
         .longopt_id = OPT_HID_KEYBOARD_DEPRECATED,
         .longopt = "hid-keyboard",
     },
+    {
+        .longopt_id = OPT_LATENCY_PROFILE,
+        .longopt = "latency-profile",
+        .argdesc = "profile",
+        .text = "Set consistent defaults for the options affecting the "
+                "latency.\n"
+                "Possible values are \"ultra\", \"balanced\" and "
+                "\"quality\".\n"
+                "\"ultra\": no video buffering, 20 ms audio buffering, "
+                "low-latency encoder, slice decoder threads, immediate "
+                "presentation.\n"
+                "\"balanced\": no video buffering, default audio buffering, "
+                "low-latency encoder, slice decoder threads, vsync "
+                "presentation.\n"
+                "\"quality\": 50 ms video buffering, 120 ms audio "
+                "buffering, default encoder latency, frame decoder threads, "
+                "video pacing.\n"
+                "Options passed explicitly take precedence over the "
+                "profile.\n"
+                "With --print-latency, a warning is printed if the measured "
+                "latency exceeds the budget of the profile (20, 50 and "
+                "150 ms respectively).",
+    },
     {
         .longopt_id = OPT_LEGACY_PASTE,
         .longopt = "legacy-paste",
@@ -556,6 +896,16 @@ static const struct sc_option options[] = {
         .shortopt = 'M',
         .text = "Same as --mouse=uhid, or --mouse=aoa if --otg is set.",
     },
+    {
+        .longopt_id = OPT_MATCH_REFRESH_RATE,
+        .longopt = "match-refresh-rate",
+        .text = "Limit the refresh rate of the device display to the lowest "
+                "supported refresh rate not lower than --max-fps, so that "
+                "the device does not compose frames which are not captured "
+                "(this saves GPU and power on high refresh rate devices).\n"
+                "The initial refresh rate setting is restored on exit.\n"
+                "Requires --max-fps and Android >= 10.",
+    },
     {
         .longopt_id = OPT_MAX_FPS,
         .longopt = "max-fps",
@@ -563,6 +913,30 @@ static const struct sc_option options[] = {
         .text = "Limit the frame rate of screen capture (officially supported "
                 "since Android 10, but may work on earlier versions).",
     },
+    {
+        .longopt_id = OPT_METRICS_FILE,
+        .longopt = "metrics-file",
+        .argdesc = "file",
+        .text = "Periodically write the metrics (packets, frames, audio "
+                "buffering, latency...) as JSON lines to the given file, or "
+                "to stdout if the file is \"-\".\n"
+                "See --metrics-interval.",
+    },
+    {
+        .longopt_id = OPT_METRICS_INTERVAL,
+        .longopt = "metrics-interval",
+        .argdesc = "ms",
+        .text = "Set the interval between two lines written to the "
+                "--metrics-file.\n"
+                "Default is 1000.",
+    },
+    {
+        .longopt_id = OPT_METRICS_PORT,
+        .longopt = "metrics-port",
+        .argdesc = "port",
+        .text = "Serve the metrics in the Prometheus text format on "
+                "http://localhost:port/metrics.",
+    },
     {
         .longopt_id = OPT_MOUSE,
         .longopt = "mouse",
@@ -632,6 +1006,17 @@ static const struct sc_option options[] = {
                 "    --new-display         # main display size and density\n"
                 "    --new-display=/240    # main display size and 240 dpi",
     },
+    {
+        .longopt_id = OPT_NEW_DISPLAY_FOLLOW_WINDOW,
+        .longopt = "new-display-follow-window",
+        .text = "Resize the new display to the size of the window (once the "
+                "window has not been resized for a moment), with a density "
+                "matching the window scale (unless forced by --new-display), "
+                "so that it is rendered without scaling on the device or on "
+                "the computer.\n"
+                "It requires --new-display, video playback and control, and "
+                "has no effect if the video is also recorded or forwarded.",
+    },
     {
         .longopt_id = OPT_NO_AUDIO,
         .longopt = "no-audio",
@@ -772,6 +1157,20 @@ static const struct sc_option options[] = {
         .longopt = "power-off-on-close",
         .text = "Turn the device screen off when closing scrcpy.",
     },
+    {
+        .longopt_id = OPT_POWER_SAVING,
+        .longopt = "power-saving",
+        .text = "Save power while the computer is on battery: the frames are "
+                "rendered at most at the display refresh rate, and the device "
+                "frame rate is limited to 10 fps while the window is "
+                "unfocused (unless --background-max-fps is set). The initial "
+                "behavior is restored on AC power.\n"
+                "In addition, whatever the power state, the video is decoded "
+                "in hardware if possible (unless --video-hwaccel is set) and "
+                "the video streaming stops once the device screen has been "
+                "idle for 10 seconds (unless --video-idle-timeout is set).\n"
+                "Limiting the device frame rate requires control.",
+    },
     {
         .longopt_id = OPT_PREFER_TEXT,
         .longopt = "prefer-text",
@@ -781,11 +1180,65 @@ static const struct sc_option options[] = {
                 "special character, but breaks the expected behavior of alpha "
                 "keys in games (typically WASD).",
     },
+    {
+        .longopt_id = OPT_PRESENT_MODE,
+        .longopt = "present-mode",
+        .argdesc = "mode",
+        .text = "Select how the video frames are presented on the computer "
+                "display.\n"
+                "Possible values are \"auto\", \"vsync\", \"immediate\", "
+                "\"adaptive\" and \"vrr\".\n"
+                "\"vsync\" waits for the vertical blank (no tearing).\n"
+                "\"immediate\" presents as soon as possible (lowest latency, "
+                "tearing may occur).\n"
+                "\"adaptive\" waits for the vertical blank, unless the frame "
+                "is late (OpenGL renderer only, vsync otherwise).\n"
+                "\"vrr\" is intended for variable refresh rate displays: it "
+                "waits for the vertical blank, but --video-pacing forwards the "
+                "frames at their own timestamps instead of aligning them on "
+                "the refresh period.\n"
+                "The effect on the latency is reported by --print-latency.\n"
+                "Default is \"auto\" (\"vsync\" with --video-pacing, "
+                "\"immediate\" otherwise).",
+    },
     {
         .longopt_id = OPT_PRINT_FPS,
         .longopt = "print-fps",
-        .text = "Start FPS counter, to print framerate logs to the console. "
-                "It can be started or stopped at any time with MOD+i.",
+        .text = "Start FPS counter, to print framerate logs to the console, "
+                "along with the received bit rate and the size of the largest "
+                "keyframe. It can be started or stopped at any time with "
+                "MOD+i.",
+    },
+    {
+        .longopt_id = OPT_PRINT_AUDIO_STATS,
+        .longopt = "print-audio-stats",
+        .text = "Print the audio buffering statistics to the console every "
+                "second: target, average and current buffering, clock "
+                "compensation, underflow and skipped samples, and resampler "
+                "delay.",
+    },
+    {
+        .longopt_id = OPT_PRINT_LATENCY,
+        .longopt = "print-latency",
+        .text = "Measure the time spent by each video frame in each stage "
+                "(decoding, buffering, texture upload and rendering) from the "
+                "reception of its packet, and print the 50th, 95th and 99th "
+                "percentiles to the console every second.\n"
+                "If control is enabled, the network latency and the total "
+                "latency from the device encoder are also reported, as well "
+                "as the input latency (from an input event to its injection "
+                "on the device) and the round-trip time of the control "
+                "channel.",
+    },
+    {
+        .longopt_id = OPT_PRINT_STARTUP_TIMING,
+        .longopt = "print-startup-timing",
+        .text = "Print the time elapsed since the start at each phase of the "
+                "startup, up to the first rendered frame: adb server start, "
+                "device selection, server push, tunnel, server process "
+                "start, socket connections, device info, video codec, "
+                "decoder, first packet, first decoded frame and first "
+                "rendered frame.",
     },
     {
         .longopt_id = OPT_PUSH_TARGET,
@@ -808,6 +1261,33 @@ static const struct sc_option options[] = {
         .longopt = "raw-key-events",
         .text = "Inject key events for all input keys, and ignore text events."
     },
+    {
+        .longopt_id = OPT_RAW_VIDEO,
+        .longopt = "raw-video",
+        .argdesc = "file",
+        .text = "Write the raw video elementary stream (Annex B for H.264 and "
+                "H.265, OBU for AV1), without container, to <file> (typically "
+                "a named pipe, to be read by another program).\n"
+                "The codec parameters are repeated before every keyframe.",
+    },
+    {
+        .longopt_id = OPT_RAW_VIDEO_HEADER,
+        .longopt = "raw-video-header",
+        .text = "Prefix each packet of the raw video stream (see --raw-video) "
+                "by a 12-byte header containing its PTS, flags and size (the "
+                "same format as the stream sent by the device)."
+    },
+    {
+        .longopt_id = OPT_RECONNECT,
+        .longopt = "reconnect",
+        .text = "Reconnect automatically when the device is disconnected (USB "
+                "glitch, Wi-Fi drop), without closing the window, the decoder "
+                "nor the recording: only the server is restarted (without "
+                "pushing it again), and the streams resume on the next "
+                "keyframe.\n"
+                "It only supports --keyboard=sdk and --mouse=sdk (the HID "
+                "devices would not be recreated on the device).",
+    },
     {
         .longopt_id = OPT_RECORD_FORMAT,
         .longopt = "record-format",
@@ -815,6 +1295,58 @@ static const struct sc_option options[] = {
         .text = "Force recording format (mp4, mkv, m4a, mka, opus, aac, flac "
                 "or wav).",
     },
+    {
+        .longopt_id = OPT_RECORD_FRAGMENT_DURATION,
+        .longopt = "record-fragment-duration",
+        .argdesc = "ms",
+        .text = "Set the maximum duration of the fragments of MP4 and M4A "
+                "recordings. A fragmented file remains playable if scrcpy is "
+                "killed or crashes (only the last fragment is lost), and "
+                "nothing needs to be rewritten at the end of the recording.\n"
+                "A new fragment is also started on every video keyframe.\n"
+                "Set to 0 to disable fragmentation (the file is then only "
+                "playable once the recording is properly stopped).\n"
+                "Default is 1000.",
+    },
+    {
+        .longopt_id = OPT_RECORD_INDEX,
+        .longopt = "record-index",
+        .text = "Write the timestamp and the byte offset of every video "
+                "keyframe of the recording to <file>.idx (one line per "
+                "keyframe), to seek into the file without parsing it.\n"
+                "Requires an MKV recording, or a fragmented MP4 recording "
+                "(see --record-fragment-duration).",
+    },
+    {
+        .longopt_id = OPT_RECORD_MAX_SIZE,
+        .longopt = "record-max-size",
+        .argdesc = "value",
+        .text = "Limit both the width and height of the recorded video to "
+                "value (see -m/--max-size).\n"
+                "Requires --record-stream.\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_RECORD_MEMORY_LIMIT,
+        .longopt = "record-memory-limit",
+        .argdesc = "bytes",
+        .text = "Limit the memory used by the packets waiting to be written "
+                "to the recording file. If the output cannot keep up, the "
+                "video packets are dropped until the next keyframe (and the "
+                "audio packets are dropped individually) rather than slowing "
+                "down the mirroring.\n"
+                "Unit suffixes are supported: 'K' (x1000) and 'M' (x1000000).\n"
+                "Default is 256M.",
+    },
+    {
+        .longopt_id = OPT_RECORD_ON_DEMAND,
+        .longopt = "record-on-demand",
+        .text = "Do not record from the start, but start and stop recordings "
+                "at runtime with MOD+Shift+e. Each recording starts on a "
+                "video keyframe and is written to "
+                "<name>-<date>-<time>-<ms>.<ext> (the name being given by "
+                "--record).",
+    },
     {
         .longopt_id = OPT_RECORD_ORIENTATION,
         .longopt = "record-orientation",
@@ -824,6 +1356,117 @@ static const struct sc_option options[] = {
                 "the clockwise rotation in degrees.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_COUNT,
+        .longopt = "record-segment-count",
+        .argdesc = "n",
+        .text = "Keep only the last n recording segments (older segment "
+                "files are deleted during the recording).\n"
+                "Requires --record-segment-duration or "
+                "--record-segment-size.\n"
+                "Default is 0 (keep all segments).",
+    },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_DURATION,
+        .longopt = "record-segment-duration",
+        .argdesc = "seconds",
+        .text = "Split the recording into several files of about the given "
+                "duration. Each segment starts on a video keyframe and is a "
+                "complete file, so a crash loses at most the last segment.\n"
+                "The segment files are named <name>-0001.<ext>, "
+                "<name>-0002.<ext>, etc.\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_SIZE,
+        .longopt = "record-segment-size",
+        .argdesc = "bytes",
+        .text = "Split the recording into several files of about the given "
+                "size (see --record-segment-duration).\n"
+                "Unit suffixes are supported: 'K' (x1000) and 'M' (x1000000).\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_RECORD_STREAM,
+        .longopt = "record-stream",
+        .text = "Record a separate video stream, encoded by a second encoder "
+                "on the device from the same display, instead of the video "
+                "stream used for the window.\n"
+                "This allows to mirror a low-definition preview (for example "
+                "with -m1280 --max-fps=30 -b2M) while recording at full "
+                "quality (see --record-max-size and "
+                "--record-video-bit-rate).\n"
+                "The recorded stream is not limited by --max-fps.",
+    },
+    {
+        .longopt_id = OPT_RECORD_SYNC,
+        .longopt = "record-sync",
+        .text = "Write the date of the timestamp 0 of each recording file to "
+                "<file>.sync, mapped from the device clock to the computer "
+                "clocks (monotonic and UTC, in microseconds).\n"
+                "This allows to align exactly the recordings of several "
+                "devices, recorded simultaneously by several scrcpy "
+                "instances.",
+    },
+    {
+        .longopt_id = OPT_RECORD_TRANSCODE,
+        .longopt = "record-transcode",
+        .argdesc = "codec",
+        .optional_arg = true,
+        .text = "Re-encode the recorded video from the decoded frames, at a "
+                "constant quality (see --record-transcode-quality), instead "
+                "of recording the video stream received from the device.\n"
+                "A hardware encoder is used if available (NVENC, Quick Sync, "
+                "AMF, VideoToolbox or VA-API), otherwise a software encoder "
+                "(libx264, libx265 or libsvtav1).\n"
+                "The video size is fixed by the first frame: if it changes "
+                "(e.g. on rotation), the frames are scaled. If the encoder "
+                "is too slow, frames are dropped from the recording, the "
+                "display is never delayed.\n"
+                "Possible values are \"h264\", \"h265\" and \"av1\".\n"
+                "Default is h265.",
+    },
+    {
+        .longopt_id = OPT_RECORD_TRANSCODE_QUALITY,
+        .longopt = "record-transcode-quality",
+        .argdesc = "value",
+        .text = "Set the constant quality of --record-transcode, on a "
+                "quantizer scale from 0 (best) to 51 (worst).\n"
+                "Default is 28.",
+    },
+    {
+        .longopt_id = OPT_RECORD_UPLOAD,
+        .longopt = "record-upload",
+        .argdesc = "url",
+        .text = "Upload the recording to S3-compatible object storage while "
+                "it is written, as a multipart upload, so that it is "
+                "available a few seconds after the end of the session.\n"
+                "The URL is http[s]://<host>[:<port>]/<bucket>[/<prefix>]. "
+                "Each file (or segment) is uploaded as an object named after "
+                "the file.\n"
+                "The credentials are read from the environment variables "
+                "AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY, AWS_SESSION_TOKEN "
+                "(optional) and AWS_REGION (us-east-1 by default).\n"
+                "Over https, the server certificate is verified against the "
+                "system CA certificates, or the AWS_CA_BUNDLE file if set.\n"
+                "The file is still written locally, unless "
+                "--record-upload-only is set.",
+    },
+    {
+        .longopt_id = OPT_RECORD_UPLOAD_ONLY,
+        .longopt = "record-upload-only",
+        .text = "With --record-upload, do not write the recording locally.",
+    },
+    {
+        .longopt_id = OPT_RECORD_VIDEO_BIT_RATE,
+        .longopt = "record-video-bit-rate",
+        .argdesc = "value",
+        .text = "Encode the recorded video at the given bit rate, expressed "
+                "in bits/s. Unit suffixes are supported: 'K' (x1000) and 'M' "
+                "(x1000000).\n"
+                "Requires --record-stream.\n"
+                "Default is 16M.",
+    },
     {
         .longopt_id = OPT_RENDER_DRIVER,
         .longopt = "render-driver",
@@ -834,6 +1477,27 @@ static const struct sc_option options[] = {
                 "\"opengles2\", \"opengles\", \"metal\" and \"software\".\n"
                 "<https://wiki.libsdl.org/SDL_HINT_RENDER_DRIVER>",
     },
+    {
+        .longopt_id = OPT_REPLAY_BUFFER,
+        .longopt = "replay-buffer",
+        .argdesc = "seconds",
+        .text = "Keep (at least) the last given seconds of the video and audio "
+                "streams in memory, to save them to a file on demand (instant "
+                "replay) with MOD+e.\n"
+                "The buffer starts on a video keyframe, so it may contain up "
+                "to one more keyframe interval.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_REPLAY_FILE,
+        .longopt = "replay-file",
+        .argdesc = "file",
+        .text = "Set the file name of the instant replays (see "
+                "--replay-buffer). Each replay is saved to "
+                "<name>-<date>-<time>-<ms>.<ext>, the format is determined by "
+                "the extension.\n"
+                "Default is \"scrcpy-replay.mkv\".",
+    },
     {
         .longopt_id = OPT_REQUIRE_AUDIO,
         .longopt = "require-audio",
@@ -841,6 +1505,22 @@ static const struct sc_option options[] = {
                 "fails on the device. This option makes scrcpy fail if audio "
                 "is enabled but does not work."
     },
+    {
+        .longopt_id = OPT_RESTREAM,
+        .longopt = "restream",
+        .argdesc = "url",
+        .text = "Forward the encoded video stream (without re-encoding) to "
+                "<url>, for remote viewers.\n"
+                "The container is selected from the URL scheme: \"rtsp://\" "
+                "pushes the stream to an RTSP server, \"rtmp://\" uses FLV, "
+                "and any other protocol (for example \"srt://\" or "
+                "\"udp://\") carries MPEG-TS.\n"
+                "If the URL listens for a viewer (for example "
+                "\"tcp://127.0.0.1:1234?listen\"), viewers may attach and "
+                "detach at any time. Every new viewer starts immediately on "
+                "the packets since the last keyframe (or on a keyframe "
+                "requested from the device).",
+    },
     {
         // deprecated
         .longopt_id = OPT_ROTATION,
@@ -866,6 +1546,31 @@ static const struct sc_option options[] = {
         .text = "Set the screen off timeout while scrcpy is running (restore "
                 "the initial value on exit).",
     },
+    {
+        .longopt_id = OPT_SCREENSHOT_DIR,
+        .longopt = "screenshot-dir",
+        .argdesc = "dir",
+        .text = "Set the directory where the screenshots (MOD+Shift+s) are "
+                "saved.\n"
+                "Default is the current directory.",
+    },
+    {
+        .longopt_id = OPT_SCREENSHOT_FORMAT,
+        .longopt = "screenshot-format",
+        .argdesc = "format",
+        .text = "Set the image format of the screenshots (MOD+Shift+s).\n"
+                "Possible values are \"png\", \"jpg\" and \"webp\".\n"
+                "Default is png.",
+    },
+    {
+        .longopt_id = OPT_SHM_SINK,
+        .longopt = "shm-sink",
+        .argdesc = "name",
+        .text = "Publish the decoded video frames into a shared memory ring "
+                "named <name>, so that local processes can read them without "
+                "copy.\n"
+                "The layout is described in the header <scrcpy/shm_frame.h>.",
+    },
     {
         .longopt_id = OPT_SHORTCUT_MOD,
         .longopt = "shortcut-mod",
@@ -900,6 +1605,18 @@ static const struct sc_option options[] = {
                 "on exit.\n"
                 "It only shows physical touches (not clicks from scrcpy).",
     },
+    {
+        .longopt_id = OPT_SOAK,
+        .longopt = "soak",
+        .text = "Monitor a long session to catch slow resource growth: the "
+                "process memory, the queue depths (recorder, video buffer, "
+                "control messages), the audio buffering and the latencies "
+                "are written to the --metrics-file at every "
+                "--metrics-interval, and on exit, the ones which grew "
+                "steadily over the session are reported.\n"
+                "Combine with --time-limit to run for a given duration.\n"
+                "It requires --metrics-file.",
+    },
     {
         .longopt_id = OPT_TCPIP,
         .longopt = "tcpip",
@@ -915,12 +1632,81 @@ static const struct sc_option options[] = {
                 "this address before starting.\n"
                 "Prefix the address with a '+' to force a reconnection.",
     },
+    {
+        .longopt_id = OPT_THREAD_AFFINITY,
+        .longopt = "thread-affinity",
+        .argdesc = "role=cpus",
+        .text = "Restrict the threads of a role to a set of CPUs, given as a "
+                "list of CPU indexes or ranges (lower than 64).\n"
+                "The possible roles are: video (video demuxer and decoder), "
+                "audio (audio demuxer and decoder), audio-callback (audio "
+                "output), controller (controller and device message "
+                "receiver) and recorder.\n"
+                "For example: --thread-affinity=video=2-3 "
+                "--thread-affinity=recorder=0,1\n"
+                "This option may be repeated, once per role. It is not "
+                "supported on macOS.",
+    },
+    {
+        .longopt_id = OPT_THREAD_POLICY,
+        .longopt = "thread-policy",
+        .argdesc = "role=policy",
+        .text = "Set the scheduling policy of the threads of a role (see "
+                "--thread-affinity for the list of roles).\n"
+                "On Linux and macOS, the possible policies are fifo[:prio] and "
+                "rr[:prio], the real-time policies SCHED_FIFO and SCHED_RR "
+                "(the priority is in the range [1; 99], default is 1). They "
+                "require the permission to use real-time scheduling (e.g. "
+                "CAP_SYS_NICE or RLIMIT_RTPRIO on Linux), otherwise a warning "
+                "is printed and the default policy is kept.\n"
+                "On Windows, the possible policies are mmcss-pro-audio and "
+                "mmcss-games, to register the threads to the Multimedia Class "
+                "Scheduler Service tasks \"Pro Audio\" and \"Games\".\n"
+                "For example: --thread-policy=audio-callback=fifo:10\n"
+                "This option may be repeated, once per role.",
+    },
+    {
+        .longopt_id = OPT_THUMBNAIL,
+        .longopt = "thumbnail",
+        .argdesc = "file",
+        .text = "Periodically write a downscaled snapshot of the video to "
+                "<file> (replaced atomically), for example to monitor many "
+                "devices from a dashboard.\n"
+                "The format is determined by the extension: .jpg, .png or "
+                ".webp.",
+    },
+    {
+        .longopt_id = OPT_THUMBNAIL_INTERVAL,
+        .longopt = "thumbnail-interval",
+        .argdesc = "ms",
+        .text = "Set the minimum interval between two thumbnails (see "
+                "--thumbnail).\n"
+                "Default is 1000.",
+    },
+    {
+        .longopt_id = OPT_THUMBNAIL_SIZE,
+        .longopt = "thumbnail-size",
+        .argdesc = "value",
+        .text = "Limit both the width and height of the thumbnails (see "
+                "--thumbnail) to value, preserving the aspect ratio.\n"
+                "Default is 320.",
+    },
     {
         .longopt_id = OPT_TIME_LIMIT,
         .longopt = "time-limit",
         .argdesc = "seconds",
         .text = "Set the maximum mirroring time, in seconds.",
     },
+    {
+        .longopt_id = OPT_TRACE_FILE,
+        .longopt = "trace-file",
+        .argdesc = "file.json",
+        .text = "Record the duration of the main operations of each thread "
+                "(receiving, decoding, rendering, audio, recording, "
+                "control...) and write them at exit in the Chrome trace "
+                "format, to be opened in chrome://tracing or "
+                "https://ui.perfetto.dev.",
+    },
     {
         .longopt_id = OPT_TUNNEL_HOST,
         .longopt = "tunnel-host",
@@ -974,6 +1760,41 @@ static const struct sc_option options[] = {
                 "Default is 0 (no buffering).\n"
                 "This option is only available on Linux.",
     },
+    {
+        .longopt_id = OPT_V4L2_FORMAT,
+        .longopt = "v4l2-format",
+        .argdesc = "format",
+        .text = "Select the pixel format of the V4L2 sink (yuv420p, nv12, "
+                "yuyv or uyvy).\n"
+                "Many consumers prefer yuyv or nv12, then the conversion is "
+                "performed once by scrcpy rather than by each consumer.\n"
+                "Default is yuv420p.\n"
+                "This option is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_V4L2_FPS,
+        .longopt = "v4l2-fps",
+        .argdesc = "value",
+        .text = "Write the frames to the V4L2 sink at a constant rate, "
+                "repeating the last frame if the device did not produce a new "
+                "one in time (Android only sends a frame when the screen "
+                "content changes).\n"
+                "Default is 0 (disabled, the frames are written as soon as "
+                "they are received).\n"
+                "This option is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_BIT_RATE_MODE,
+        .longopt = "video-bit-rate-mode",
+        .argdesc = "mode",
+        .text = "Select the bit rate mode of the video encoder.\n"
+                "Possible values are \"cbr\" (constant bit rate), \"vbr\" "
+                "(variable bit rate) and \"cq\" (constant quality, the bit "
+                "rate is not controlled, see --video-quality).\n"
+                "The mode is ignored (with a warning) if the encoder does "
+                "not support it.\n"
+                "By default, the encoder default mode is used.",
+    },
     {
         .longopt_id = OPT_VIDEO_BUFFER,
         .longopt = "video-buffer",
@@ -983,11 +1804,44 @@ static const struct sc_option options[] = {
                 "This increases latency to compensate for jitter.\n"
                 "Default is 0 (no buffering).",
     },
+    {
+        .longopt_id = OPT_VIDEO_BUFFER_MAX,
+        .longopt = "video-buffer-max",
+        .argdesc = "ms",
+        .text = "Enable adaptive video buffering: the buffering delay "
+                "follows the measured network jitter, between --video-buffer "
+                "(the minimum) and this value (in milliseconds).\n"
+                "Default is 0 (no adaptive buffering).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_BUFFER_PACKETS,
+        .longopt = "video-buffer-packets",
+        .text = "Apply the --video-buffer delay to the encoded packets, "
+                "before decoding, rather than to the decoded frames. This "
+                "uses far less memory for large delays.\n"
+                "The delay then also applies to the other consumers of the "
+                "decoded frames (like the V4L2 sink).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_CATCH_UP,
+        .longopt = "video-catch-up",
+        .text = "When the video lags behind the device (typically after a "
+                "network stall), drop the delayed packets until a recent "
+                "keyframe (requested immediately if control is enabled), "
+                "instead of decoding and displaying the whole backlog.\n"
+                "It is not compatible with a recording of the video stream "
+                "(except with --record-stream), the replay buffer, "
+                "restreaming and the raw video output.",
+    },
     {
         .longopt_id = OPT_VIDEO_CODEC,
         .longopt = "video-codec",
         .argdesc = "name",
-        .text = "Select a video codec (h264, h265 or av1).\n"
+        .text = "Select a video codec (h264, h265, av1 or auto).\n"
+                "With \"auto\", the most efficient codec which can be "
+                "decoded by a hardware decoder of the computer (see "
+                "--video-hwaccel) and encoded by a hardware encoder of the "
+                "device is selected, or H.264 otherwise.\n"
                 "Default is h264.",
     },
     {
@@ -1002,13 +1856,170 @@ static const struct sc_option options[] = {
                 "Android documentation: "
                 "<https://d.android.com/reference/android/media/MediaFormat>",
     },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_RESILIENT,
+        .longopt = "video-decoder-resilient",
+        .text = "Never stop on video decoding errors: skip the packets until "
+                "the next keyframe (requested immediately if control is "
+                "enabled, otherwise the next periodic keyframe), and output "
+                "the partially corrupt frames with error concealment.\n"
+                "This is useful for long-running unattended mirroring over "
+                "unreliable links.\n"
+                "Without this option, the decoding errors are only recovered "
+                "if control is enabled.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_SKIP_NONREF,
+        .longopt = "video-decoder-skip-nonref",
+        .text = "Skip decoding the non-reference video frames while the "
+                "display cannot keep up (i.e. while many frames are dropped "
+                "before being rendered), and restore full decoding "
+                "afterwards.\n"
+                "This reduces the CPU usage when the computer is overloaded.\n"
+                "The non-reference frames are also skipped while the window "
+                "is unfocused and either minimized or showing the video at "
+                "half its size or less, unless the decoded frames are also "
+                "used by something else.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_THREADS,
+        .longopt = "video-decoder-threads",
+        .argdesc = "value",
+        .text = "Set the number of threads used to decode the video on the "
+                "computer.\n"
+                "Default is 0 (automatic).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_THREAD_TYPE,
+        .longopt = "video-decoder-thread-type",
+        .argdesc = "type",
+        .text = "Select the video decoder threading mode (slice or frame).\n"
+                "Frame threading may decode faster, but it adds one frame of "
+                "latency per additional thread.\n"
+                "Default is slice.",
+    },
     {
         .longopt_id = OPT_VIDEO_ENCODER,
         .longopt = "video-encoder",
         .argdesc = "name",
         .text = "Use a specific MediaCodec video encoder (depending on the "
                 "codec provided by --video-codec).\n"
-                "The available encoders can be listed by --list-encoders.",
+                "The available encoders can be listed by --list-encoders.\n"
+                "If the value is \"auto-benchmark\", then the server "
+                "benchmarks all the encoders to select the one having the "
+                "lowest latency (the result is cached for the device build).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_HWACCEL,
+        .longopt = "video-hwaccel",
+        .argdesc = "name",
+        .text = "Use a hardware-accelerated video decoder on the computer.\n"
+                "Possible values are \"none\", \"auto\", \"vaapi\", "
+                "\"vdpau\", \"d3d11va\", \"dxva2\", \"videotoolbox\" and "
+                "\"vulkan\".\n"
+                "If the hardware decoder could not be initialized, the video "
+                "is decoded in software.\n"
+                "Default is none.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_IDLE_TIMEOUT,
+        .longopt = "video-idle-timeout",
+        .argdesc = "seconds",
+        .text = "Stop streaming the video once the device screen content has "
+                "not changed for the given delay. The last frame stays "
+                "displayed, and the video resumes as soon as the content "
+                "changes.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_INTRA_REFRESH,
+        .longopt = "video-intra-refresh",
+        .argdesc = "frames",
+        .text = "Refresh the video progressively over the given number of "
+                "frames (intra refresh) instead of sending periodic "
+                "keyframes, to avoid bit rate spikes.\n"
+                "Keyframes are still requested when necessary (for example "
+                "to split or resume a recording).\n"
+                "This requires an encoder supporting intra refresh (Android "
+                ">= 7).\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_LATENCY,
+        .longopt = "video-latency",
+        .argdesc = "value",
+        .text = "Configure the device video encoder for latency.\n"
+                "Possible values are \"default\" and \"low\".\n"
+                "With \"low\", the encoder is configured in low-latency mode "
+                "(realtime priority, no B-frames, and the low-latency "
+                "extensions of the encoder vendor, if supported by the "
+                "encoder). This may reduce the video quality for a given "
+                "bit rate.\n"
+                "Default is default.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_MAX_BIT_RATE,
+        .longopt = "video-max-bit-rate",
+        .argdesc = "value",
+        .text = "Limit the video bit rate measured over each second to the "
+                "given value, expressed in bits/s. Unit suffixes are "
+                "supported: 'K' (x1000) and 'M' (x1000000).\n"
+                "When exceeded, the encoder target bit rate is temporarily "
+                "lowered, or in \"cq\" mode, the encoder falls back to "
+                "\"vbr\" mode.\n"
+                "Default is 0 (no limit).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_PACING,
+        .longopt = "video-pacing",
+        .text = "Present video frames at regular intervals according to their "
+                "timestamps, synchronized with the display refresh (vsync).\n"
+                "This reduces judder due to network jitter, at the cost of "
+                "about one refresh period of additional latency.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_QUALITY,
+        .longopt = "video-quality",
+        .argdesc = "value",
+        .text = "Set the quality target of the video encoder in \"cq\" "
+                "mode (see --video-bit-rate-mode), between 0 and 100 "
+                "(higher is better).\n"
+                "The value is clamped to the range supported by the encoder "
+                "(Android >= 9).\n"
+                "By default, the encoder default quality is used.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SKIP_REPEATED_FRAMES,
+        .longopt = "video-skip-repeated-frames",
+        .text = "Do not display the frames repeated by the device encoder "
+                "when the screen content does not change (they are still "
+                "decoded and recorded).\n"
+                "This reduces the CPU and GPU usage for static content, but "
+                "the quality refinements brought by these frames are not "
+                "displayed. To detect them, the device observes the captured "
+                "frames through an additional OpenGL pass.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SOCKET_BUFFER_SIZE,
+        .longopt = "video-socket-buffer-size",
+        .argdesc = "bytes",
+        .text = "Set the receive buffer size of the video socket (SO_RCVBUF). "
+                "Unit suffixes are supported: 'K' (x1000) and 'M' "
+                "(x1000000).\n"
+                "A larger buffer may avoid throttling the bursts of large "
+                "keyframes on high-bandwidth connections.\n"
+                "Default is 0 (system default).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SOCKET_BUSY_POLL,
+        .longopt = "video-socket-busy-poll",
+        .argdesc = "us",
+        .text = "Busy poll the network device queue for up to the given "
+                "delay (in microseconds) when waiting for video data "
+                "(SO_BUSY_POLL), to reduce the latency at the cost of CPU "
+                "usage.\n"
+                "Only supported on Linux.\n"
+                "Default is 0 (disabled).",
     },
     {
         .longopt_id = OPT_VIDEO_SOURCE,
@@ -1024,6 +2035,33 @@ static const struct sc_option options[] = {
         .text = "Keep the device on while scrcpy is running, when the device "
                 "is plugged in.",
     },
+    {
+        .longopt_id = OPT_STREAM_CAPTURE,
+        .longopt = "stream-capture",
+        .argdesc = "prefix",
+        .text = "Write the raw video and audio streams received from the "
+                "device to <prefix>.video and <prefix>.audio, to replay the "
+                "session later with --stream-replay.",
+    },
+    {
+        .longopt_id = OPT_STREAM_REPLAY,
+        .longopt = "stream-replay",
+        .argdesc = "prefix",
+        .text = "Replay the streams captured by --stream-capture "
+                "(<prefix>.video and <prefix>.audio) through the client "
+                "pipeline (demuxing, decoding, display, recording), without "
+                "any device, at their original pacing.\n"
+                "Only the window, playback, decoding, recording "
+                "(--record), --benchmark-decode and --trace-file options "
+                "apply.",
+    },
+    {
+        .longopt_id = OPT_STREAM_REPLAY_FAST,
+        .longopt = "stream-replay-fast",
+        .text = "With --stream-replay, send the packets as fast as the "
+                "pipeline consumes them, instead of at their original pacing "
+                "(the audio is not played).",
+    },
     {
         .longopt_id = OPT_WINDOW_BORDERLESS,
         .longopt = "window-borderless",
@@ -1063,6 +2101,15 @@ static const struct sc_option options[] = {
         .text = "Set the initial window height.\n"
                 "Default is 0 (automatic).",
     },
+    {
+        .longopt_id = OPT_YUV_SHADER,
+        .longopt = "yuv-shader",
+        .text = "Render the video with a custom shader converting YUV to RGB "
+                "(according to the color space and range of each frame), "
+                "instead of the SDL renderer.\n"
+                "It requires an OpenGL 3.0+ or OpenGL ES 3.0+ renderer (it "
+                "falls back to the SDL renderer otherwise).",
+    },
 };
 
 static const struct sc_shortcut shortcuts[] = {
@@ -1098,6 +2145,11 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+Shift+r" },
         .text = "Reset video capture/encoding",
     },
+    {
+        .shortcuts = { "MOD+Shift+p" },
+        .text = "Switch between the initial and the alternative video profile "
+                "(--alt-video-profile)",
+    },
     {
         .shortcuts = { "MOD+g" },
         .text = "Resize window to 1:1 (pixel-perfect)",
@@ -1187,6 +2239,24 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+i" },
         .text = "Enable/disable FPS counter (print frames/second in logs)",
     },
+    {
+        .shortcuts = { "MOD+Shift+i" },
+        .text = "Log the memory used by each component (requires "
+                "--metrics-file or --metrics-port)",
+    },
+    {
+        .shortcuts = { "MOD+e" },
+        .text = "Save instant replay (only with --replay-buffer)",
+    },
+    {
+        .shortcuts = { "MOD+Shift+e" },
+        .text = "Start/stop recording (only with --record-on-demand)",
+    },
+    {
+        .shortcuts = { "MOD+Shift+s" },
+        .text = "Save a screenshot of the current video frame (see "
+                "--screenshot-dir)",
+    },
     {
         .shortcuts = { "Ctrl+click-and-move" },
         .text = "Pinch-to-zoom and rotate from the center of the screen",
@@ -1219,6 +2289,11 @@ static const struct sc_envvar envvars[] = {
         .text = "Device serial to use if no selector (-s, -d, -e or "
                 "--tcpip=<addr>) is specified",
     },
+    {
+        .name = "AWS_CA_BUNDLE",
+        .text = "CA certificates file to verify the server certificate for "
+                "--record-upload (the system CA certificates by default)",
+    },
     {
         .name = "SCRCPY_ICON_PATH",
         .text = "Path to the program icon",
@@ -1646,6 +2721,18 @@ parse_audio_output_buffer(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_audio_volume(const char *s, uint16_t *volume) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 400, "audio volume");
+    if (!ok) {
+        return false;
+    }
+
+    *volume = value;
+    return true;
+}
+
 static bool
 parse_display_ime_policy(const char *s, enum sc_display_ime_policy *policy) {
     if (!strcmp(s, "local")) {
@@ -1665,6 +2752,66 @@ parse_display_ime_policy(const char *s, enum sc_display_ime_policy *policy) {
     return false;
 }
 
+static bool
+parse_video_latency(const char *s, bool *low_latency) {
+    if (!strcmp(s, "default")) {
+        *low_latency = false;
+        return true;
+    }
+    if (!strcmp(s, "low")) {
+        *low_latency = true;
+        return true;
+    }
+    LOGE("Unsupported video latency: %s (expected default or low)", s);
+    return false;
+}
+
+static bool
+parse_latency_profile(const char *s, enum sc_latency_profile *profile) {
+    if (!strcmp(s, "ultra")) {
+        *profile = SC_LATENCY_PROFILE_ULTRA;
+        return true;
+    }
+    if (!strcmp(s, "balanced")) {
+        *profile = SC_LATENCY_PROFILE_BALANCED;
+        return true;
+    }
+    if (!strcmp(s, "quality")) {
+        *profile = SC_LATENCY_PROFILE_QUALITY;
+        return true;
+    }
+    LOGE("Unsupported latency profile: %s (expected ultra, balanced or "
+         "quality)", s);
+    return false;
+}
+
+static bool
+parse_present_mode(const char *s, enum sc_present_mode *mode) {
+    if (!strcmp(s, "auto")) {
+        *mode = SC_PRESENT_MODE_AUTO;
+        return true;
+    }
+    if (!strcmp(s, "vsync")) {
+        *mode = SC_PRESENT_MODE_VSYNC;
+        return true;
+    }
+    if (!strcmp(s, "immediate")) {
+        *mode = SC_PRESENT_MODE_IMMEDIATE;
+        return true;
+    }
+    if (!strcmp(s, "adaptive")) {
+        *mode = SC_PRESENT_MODE_ADAPTIVE;
+        return true;
+    }
+    if (!strcmp(s, "vrr")) {
+        *mode = SC_PRESENT_MODE_VRR;
+        return true;
+    }
+    LOGE("Unsupported present mode: %s (expected auto, vsync, immediate, "
+         "adaptive or vrr)", s);
+    return false;
+}
+
 static bool
 parse_orientation(const char *s, enum sc_orientation *orientation) {
     if (!strcmp(s, "0")) {
@@ -1804,6 +2951,21 @@ parse_display_id(const char *s, uint32_t *display_id) {
     return true;
 }
 
+static bool
+parse_extra_display(const char *s) {
+    if (!strcmp(s, "new") || !strncmp(s, "new:", 4)) {
+        // The new display size and density are parsed by the server
+        if (strchr(s, ',')) {
+            LOGE("Invalid extra display: %s", s);
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t display_id;
+    return parse_display_id(s, &display_id);
+}
+
 static bool
 parse_log_level(const char *s, enum sc_log_level *log_level) {
     if (!strcmp(s, "verbose")) {
@@ -1960,46 +3122,613 @@ parse_ip(const char *optarg, uint32_t *ipv4) {
 }
 
 static bool
-parse_port(const char *optarg, uint16_t *port) {
+parse_gamepad_report_rate(const char *optarg, uint16_t *rate) {
     long value;
-    if (!parse_integer_arg(optarg, &value, false, 0, 0xFFFF, "port")) {
+    // A USB HID device may not be polled at more than 1000 Hz
+    if (!parse_integer_arg(optarg, &value, false, 0, 1000,
+                           "gamepad report rate")) {
         return false;
     }
-    *port = (uint16_t) value;
+    *rate = (uint16_t) value;
     return true;
 }
 
-static enum sc_record_format
-guess_record_format(const char *filename) {
-    const char *dot = strrchr(filename, '.');
-    if (!dot) {
-        return 0;
+static bool
+parse_video_intra_refresh(const char *optarg, uint16_t *frames) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 0xFFFF,
+                           "intra refresh period")) {
+        return false;
     }
-
-    const char *ext = dot + 1;
-    return get_record_format(ext);
+    *frames = (uint16_t) value;
+    return true;
 }
 
 static bool
-parse_video_codec(const char *optarg, enum sc_codec *codec) {
-    if (!strcmp(optarg, "h264")) {
-        *codec = SC_CODEC_H264;
+parse_video_bit_rate_mode(const char *optarg,
+                          enum sc_video_bit_rate_mode *mode) {
+    if (!strcmp(optarg, "cbr")) {
+        *mode = SC_VIDEO_BIT_RATE_MODE_CBR;
         return true;
     }
-    if (!strcmp(optarg, "h265")) {
-        *codec = SC_CODEC_H265;
+
+    if (!strcmp(optarg, "vbr")) {
+        *mode = SC_VIDEO_BIT_RATE_MODE_VBR;
         return true;
     }
-    if (!strcmp(optarg, "av1")) {
-        *codec = SC_CODEC_AV1;
+
+    if (!strcmp(optarg, "cq")) {
+        *mode = SC_VIDEO_BIT_RATE_MODE_CQ;
         return true;
     }
-    LOGE("Unsupported video codec: %s (expected h264, h265 or av1)", optarg);
+
+    LOGE("Unsupported video bit rate mode: %s (expected cbr, vbr or cq)",
+         optarg);
     return false;
 }
 
 static bool
-parse_audio_codec(const char *optarg, enum sc_codec *codec) {
+parse_video_quality(const char *optarg, int8_t *quality) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 100, "video quality")) {
+        return false;
+    }
+    *quality = (int8_t) value;
+    return true;
+}
+
+static bool
+parse_input_pacing(const char *optarg, uint16_t *ms) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 1000, "input pacing")) {
+        return false;
+    }
+    *ms = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_video_idle_timeout(const char *s, sc_tick *tick) {
+    long value;
+    // value in seconds, but must fit in 31 bits in milliseconds
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF / 1000,
+                                "video idle timeout");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_metrics_interval(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0x7FFFFFFF,
+                                "metrics interval");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_background_max_fps(const char *optarg, uint16_t *max_fps) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 1, 1000,
+                           "background max fps")) {
+        return false;
+    }
+    *max_fps = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_cpu_budget(const char *optarg, uint16_t *budget) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 1, 10000, "cpu budget")) {
+        return false;
+    }
+    *budget = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_benchmark_touch(const char *optarg, uint16_t *trials) {
+    if (!optarg) {
+        *trials = 20;
+        return true;
+    }
+
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 1, 1000,
+                           "touch benchmark trials")) {
+        return false;
+    }
+    *trials = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_record_transcode(const char *optarg, enum sc_codec *codec) {
+    if (!optarg) {
+        *codec = SC_CODEC_H265;
+        return true;
+    }
+
+    if (!strcmp(optarg, "h264")) {
+        *codec = SC_CODEC_H264;
+        return true;
+    }
+    if (!strcmp(optarg, "h265")) {
+        *codec = SC_CODEC_H265;
+        return true;
+    }
+    if (!strcmp(optarg, "av1")) {
+        *codec = SC_CODEC_AV1;
+        return true;
+    }
+    LOGE("Unsupported transcoding codec: %s (expected h264, h265 or av1)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_record_transcode_quality(const char *optarg, uint8_t *quality) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 51,
+                           "transcoding quality")) {
+        return false;
+    }
+    *quality = (uint8_t) value;
+    return true;
+}
+
+static bool
+parse_video_profile_item(const char *key, const char *value,
+                         struct sc_video_profile *profile) {
+    if (!strcmp(key, "max-size")) {
+        return parse_max_size(value, &profile->max_size);
+    }
+    if (!strcmp(key, "bit-rate")) {
+        return parse_bit_rate(value, &profile->bit_rate);
+    }
+    if (!strcmp(key, "max-fps")) {
+        long fps;
+        if (!parse_integer_arg(value, &fps, false, 0, 0xFFFF, "max fps")) {
+            return false;
+        }
+        profile->max_fps = (uint16_t) fps;
+        return true;
+    }
+    if (!strcmp(key, "crop")) {
+        long crop[4];
+        size_t count =
+            parse_integers_arg(value, ':', 4, crop, 0, 0xFFFF, "crop");
+        if (!count) {
+            return false;
+        }
+        if (count != 4 || !crop[0] || !crop[1]) {
+            LOGE("Invalid crop (expected width:height:x:y): %s", value);
+            return false;
+        }
+        profile->crop.width = (uint16_t) crop[0];
+        profile->crop.height = (uint16_t) crop[1];
+        profile->crop.x = (uint16_t) crop[2];
+        profile->crop.y = (uint16_t) crop[3];
+        return true;
+    }
+
+    LOGE("Unknown video profile key: %s "
+         "(must be one of: max-size, bit-rate, max-fps, crop)", key);
+    return false;
+}
+
+static bool
+parse_video_profile(const char *s, struct sc_video_profile *profile) {
+    // A list of key=value, for example "max-size=1024,bit-rate=2M"
+    char *dup = strdup(s);
+    if (!dup) {
+        LOG_OOM();
+        return false;
+    }
+
+    struct sc_video_profile p = {0};
+    bool ok = true;
+
+    char *item = dup;
+    for (;;) {
+        char *comma = strchr(item, ',');
+        if (comma) {
+            *comma = '\0';
+        }
+
+        char *equal = strchr(item, '=');
+        if (!equal) {
+            LOGE("Invalid video profile item (expected key=value): %s", item);
+            ok = false;
+            break;
+        }
+        *equal = '\0';
+
+        ok = parse_video_profile_item(item, equal + 1, &p);
+        if (!ok || !comma) {
+            break;
+        }
+
+        item = comma + 1;
+    }
+
+    free(dup);
+
+    if (!ok) {
+        return false;
+    }
+
+    *profile = p;
+    return true;
+}
+
+#ifdef SC_TEST
+// expose the function to unit-tests
+bool
+sc_parse_video_profile(const char *s, struct sc_video_profile *profile) {
+    return parse_video_profile(s, profile);
+}
+#endif
+
+static bool
+parse_thread_role(const char *s, enum sc_thread_role *role) {
+    if (!strcmp(s, "video")) {
+        *role = SC_THREAD_ROLE_VIDEO;
+        return true;
+    }
+    if (!strcmp(s, "audio")) {
+        *role = SC_THREAD_ROLE_AUDIO;
+        return true;
+    }
+    if (!strcmp(s, "audio-callback")) {
+        *role = SC_THREAD_ROLE_AUDIO_CALLBACK;
+        return true;
+    }
+    if (!strcmp(s, "controller")) {
+        *role = SC_THREAD_ROLE_CONTROLLER;
+        return true;
+    }
+    if (!strcmp(s, "recorder")) {
+        *role = SC_THREAD_ROLE_RECORDER;
+        return true;
+    }
+    LOGE("Unsupported thread role: %s (expected video, audio, "
+         "audio-callback, controller or recorder)", s);
+    return false;
+}
+
+// Split "role=value" in place, return the value
+static char *
+split_thread_role(char *s, enum sc_thread_role *role) {
+    char *equal = strchr(s, '=');
+    if (!equal) {
+        LOGE("Invalid thread option (expected role=value): %s", s);
+        return NULL;
+    }
+    *equal = '\0';
+
+    if (!parse_thread_role(s, role)) {
+        return NULL;
+    }
+
+    return equal + 1;
+}
+
+static bool
+parse_cpu_index(const char *s, size_t len, unsigned *out) {
+    if (!len || len > 2) {
+        return false;
+    }
+
+    unsigned value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (s[i] - '0');
+    }
+
+    if (value >= SC_THREAD_SCHED_MAX_CPUS) {
+        return false;
+    }
+
+    *out = value;
+    return true;
+}
+
+static bool
+parse_cpu_list(const char *s, uint64_t *cpus) {
+    // A list of CPU indexes or ranges, for example "0,2-3"
+    uint64_t mask = 0;
+
+    const char *item = s;
+    for (;;) {
+        size_t len = strcspn(item, ",");
+        const char *dash = memchr(item, '-', len);
+
+        unsigned first;
+        unsigned last;
+        bool ok;
+        if (dash) {
+            size_t first_len = dash - item;
+            ok = parse_cpu_index(item, first_len, &first)
+              && parse_cpu_index(dash + 1, len - first_len - 1, &last)
+              && first <= last;
+        } else {
+            ok = parse_cpu_index(item, len, &first);
+            last = first;
+        }
+        if (!ok) {
+            LOGE("Invalid CPU list (expected indexes or ranges lower than %d, "
+                 "for example \"0,2-3\"): %s", SC_THREAD_SCHED_MAX_CPUS, s);
+            return false;
+        }
+
+        for (unsigned i = first; i <= last; ++i) {
+            mask |= UINT64_C(1) << i;
+        }
+
+        if (item[len] == '\0') {
+            break;
+        }
+        item += len + 1;
+    }
+
+    *cpus = mask;
+    return true;
+}
+
+static bool
+parse_thread_affinity(const char *optarg,
+                      struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]) {
+    char *dup = strdup(optarg);
+    if (!dup) {
+        LOG_OOM();
+        return false;
+    }
+
+    enum sc_thread_role role;
+    const char *value = split_thread_role(dup, &role);
+    bool ok = value && parse_cpu_list(value, &sched[role].cpus);
+
+    free(dup);
+    return ok;
+}
+
+static bool
+parse_thread_policy_value(const char *s, enum sc_thread_sched_policy *policy,
+                          uint8_t *priority) {
+    if (!strcmp(s, "mmcss-pro-audio") || !strcmp(s, "mmcss-games")) {
+#ifdef _WIN32
+        *policy = !strcmp(s, "mmcss-pro-audio")
+                ? SC_THREAD_SCHED_POLICY_MMCSS_PRO_AUDIO
+                : SC_THREAD_SCHED_POLICY_MMCSS_GAMES;
+        *priority = 0;
+        return true;
+#else
+        LOGE("Thread policy %s is only supported on Windows", s);
+        return false;
+#endif
+    }
+
+    const char *prio = NULL;
+    enum sc_thread_sched_policy p = SC_THREAD_SCHED_POLICY_DEFAULT;
+    if (!strncmp(s, "fifo", 4)) {
+        p = SC_THREAD_SCHED_POLICY_FIFO;
+        prio = s + 4;
+    } else if (!strncmp(s, "rr", 2)) {
+        p = SC_THREAD_SCHED_POLICY_RR;
+        prio = s + 2;
+    }
+
+    if (!prio || (*prio != '\0' && *prio != ':')) {
+        LOGE("Unsupported thread policy: %s (expected fifo[:prio], rr[:prio], "
+             "mmcss-pro-audio or mmcss-games)", s);
+        return false;
+    }
+
+#ifdef _WIN32
+    (void) p;
+    LOGE("Real-time thread policies are not supported on Windows "
+         "(use mmcss-pro-audio or mmcss-games)");
+    return false;
+#else
+    long value = 1;
+    if (*prio == ':'
+            && !parse_integer_arg(prio + 1, &value, false, 1, 99,
+                                  "thread priority")) {
+        return false;
+    }
+
+    *policy = p;
+    *priority = (uint8_t) value;
+    return true;
+#endif
+}
+
+static bool
+parse_thread_policy(const char *optarg,
+                    struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]) {
+    char *dup = strdup(optarg);
+    if (!dup) {
+        LOG_OOM();
+        return false;
+    }
+
+    enum sc_thread_role role;
+    const char *value = split_thread_role(dup, &role);
+    bool ok = value && parse_thread_policy_value(value, &sched[role].policy,
+                                                 &sched[role].priority);
+
+    free(dup);
+    return ok;
+}
+
+#ifdef SC_TEST
+// expose the functions to unit-tests
+bool
+sc_parse_thread_affinity(const char *s,
+                         struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]) {
+    return parse_thread_affinity(s, sched);
+}
+
+bool
+sc_parse_thread_policy(const char *s,
+                       struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]) {
+    return parse_thread_policy(s, sched);
+}
+#endif
+
+static bool
+parse_port(const char *optarg, uint16_t *port) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 0xFFFF, "port")) {
+        return false;
+    }
+    *port = (uint16_t) value;
+    return true;
+}
+
+static enum sc_record_format
+guess_record_format(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot) {
+        return 0;
+    }
+
+    const char *ext = dot + 1;
+    return get_record_format(ext);
+}
+
+static bool
+parse_video_codec(const char *optarg, enum sc_codec *codec) {
+    if (!strcmp(optarg, "h264")) {
+        *codec = SC_CODEC_H264;
+        return true;
+    }
+    if (!strcmp(optarg, "h265")) {
+        *codec = SC_CODEC_H265;
+        return true;
+    }
+    if (!strcmp(optarg, "av1")) {
+        *codec = SC_CODEC_AV1;
+        return true;
+    }
+    if (!strcmp(optarg, "auto")) {
+        *codec = SC_CODEC_AUTO;
+        return true;
+    }
+    LOGE("Unsupported video codec: %s (expected h264, h265, av1 or auto)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_video_hwaccel(const char *optarg, enum sc_hwaccel *hwaccel) {
+    if (!strcmp(optarg, "none")) {
+        *hwaccel = SC_HWACCEL_NONE;
+        return true;
+    }
+    if (!strcmp(optarg, "auto")) {
+        *hwaccel = SC_HWACCEL_AUTO;
+        return true;
+    }
+    if (!strcmp(optarg, "vaapi")) {
+        *hwaccel = SC_HWACCEL_VAAPI;
+        return true;
+    }
+    if (!strcmp(optarg, "vdpau")) {
+        *hwaccel = SC_HWACCEL_VDPAU;
+        return true;
+    }
+    if (!strcmp(optarg, "d3d11va")) {
+        *hwaccel = SC_HWACCEL_D3D11VA;
+        return true;
+    }
+    if (!strcmp(optarg, "dxva2")) {
+        *hwaccel = SC_HWACCEL_DXVA2;
+        return true;
+    }
+    if (!strcmp(optarg, "videotoolbox")) {
+        *hwaccel = SC_HWACCEL_VIDEOTOOLBOX;
+        return true;
+    }
+    if (!strcmp(optarg, "vulkan")) {
+        *hwaccel = SC_HWACCEL_VULKAN;
+        return true;
+    }
+    LOGE("Unsupported video hwaccel: %s (expected none, auto, vaapi, vdpau, "
+         "d3d11va, dxva2, videotoolbox or vulkan)", optarg);
+    return false;
+}
+
+static bool
+parse_video_decoder_threads(const char *s, uint16_t *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 64,
+                                "video decoder threads");
+    if (!ok) {
+        return false;
+    }
+
+    *threads = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_video_socket_buffer_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "video socket buffer size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_video_socket_busy_poll(const char *s, uint32_t *usecs) {
+    long value;
+    // More than 1 second would make no sense
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000000,
+                                "video socket busy poll");
+    if (!ok) {
+        return false;
+    }
+
+    *usecs = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_video_decoder_thread_type(const char *optarg,
+                                enum sc_decoder_thread_type *type) {
+    if (!strcmp(optarg, "slice")) {
+        *type = SC_DECODER_THREAD_TYPE_SLICE;
+        return true;
+    }
+    if (!strcmp(optarg, "frame")) {
+        *type = SC_DECODER_THREAD_TYPE_FRAME;
+        return true;
+    }
+    LOGE("Unsupported video decoder thread type: %s (expected slice or frame)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_audio_codec(const char *optarg, enum sc_codec *codec) {
     if (!strcmp(optarg, "opus")) {
         *codec = SC_CODEC_OPUS;
         return true;
@@ -2037,6 +3766,45 @@ parse_video_source(const char *optarg, enum sc_video_source *source) {
     return false;
 }
 
+static bool
+parse_v4l2_format(const char *optarg, enum sc_v4l2_format *format) {
+    if (!strcmp(optarg, "yuv420p")) {
+        *format = SC_V4L2_FORMAT_YUV420P;
+        return true;
+    }
+
+    if (!strcmp(optarg, "nv12")) {
+        *format = SC_V4L2_FORMAT_NV12;
+        return true;
+    }
+
+    if (!strcmp(optarg, "yuyv")) {
+        *format = SC_V4L2_FORMAT_YUYV;
+        return true;
+    }
+
+    if (!strcmp(optarg, "uyvy")) {
+        *format = SC_V4L2_FORMAT_UYVY;
+        return true;
+    }
+
+    LOGE("Unsupported v4l2 format: %s (expected yuv420p, nv12, yuyv or uyvy)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_v4l2_fps(const char *s, uint16_t *fps) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000, "v4l2 fps");
+    if (!ok) {
+        return false;
+    }
+
+    *fps = (uint16_t) value;
+    return true;
+}
+
 static bool
 parse_audio_source(const char *optarg, enum sc_audio_source *source) {
     if (!strcmp(optarg, "mic")) {
@@ -2242,6 +4010,151 @@ parse_time_limit(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_thumbnail_interval(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0x7FFFFFFF,
+                                "thumbnail interval");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_thumbnail_size(const char *s, uint16_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 16, 4096, "thumbnail size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint16_t) value;
+    return true;
+}
+
+static enum sc_thumbnail_format
+guess_thumbnail_format(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot) {
+        return SC_THUMBNAIL_FORMAT_AUTO;
+    }
+
+    const char *ext = dot + 1;
+    if (!strcmp(ext, "jpg") || !strcmp(ext, "jpeg")) {
+        return SC_THUMBNAIL_FORMAT_JPEG;
+    }
+    if (!strcmp(ext, "png")) {
+        return SC_THUMBNAIL_FORMAT_PNG;
+    }
+    if (!strcmp(ext, "webp")) {
+        return SC_THUMBNAIL_FORMAT_WEBP;
+    }
+    return SC_THUMBNAIL_FORMAT_AUTO;
+}
+
+static bool
+parse_screenshot_format(const char *s, enum sc_thumbnail_format *format) {
+    if (!strcmp(s, "png")) {
+        *format = SC_THUMBNAIL_FORMAT_PNG;
+        return true;
+    }
+    if (!strcmp(s, "jpg") || !strcmp(s, "jpeg")) {
+        *format = SC_THUMBNAIL_FORMAT_JPEG;
+        return true;
+    }
+    if (!strcmp(s, "webp")) {
+        *format = SC_THUMBNAIL_FORMAT_WEBP;
+        return true;
+    }
+    LOGE("Unsupported screenshot format: %s (expected png, jpg or webp)", s);
+    return false;
+}
+
+static bool
+parse_record_segment_duration(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "record segment duration");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_record_fragment_duration(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "record fragment duration");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_record_segment_size(const char *s, uint32_t *size) {
+    long value;
+    // long may be 32 bits (it is the case on mingw), so do not use more than
+    // 31 bits (long is signed)
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "record segment size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_memory_limit(const char *s, uint32_t *limit) {
+    long value;
+    // long may be 32 bits (it is the case on mingw), so do not use more than
+    // 31 bits (long is signed)
+    bool ok = parse_integer_arg(s, &value, true, 1, 0x7FFFFFFF,
+                                "record memory limit");
+    if (!ok) {
+        return false;
+    }
+
+    *limit = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_segment_count(const char *s, unsigned *count) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF,
+                                "record segment count");
+    if (!ok) {
+        return false;
+    }
+
+    *count = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_replay_buffer(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "replay buffer");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
 static bool
 parse_screen_off_timeout(const char *s, sc_tick *tick) {
     long value;
@@ -2353,10 +4266,172 @@ parse_mouse_bindings(const char *s, struct sc_mouse_bindings *mb) {
     return true;
 }
 
+static bool
+validate_record_output(const struct scrcpy_options *opts,
+                       enum sc_record_format format) {
+    if (opts->record_orientation != SC_ORIENTATION_0) {
+        if (sc_orientation_is_mirror(opts->record_orientation)) {
+            LOGE("Record orientation only supports rotation, not "
+                 "flipping: %s",
+                 sc_orientation_get_name(opts->record_orientation));
+            return false;
+        }
+    }
+
+    if (opts->video && sc_record_format_is_audio_only(format)) {
+        LOGE("Audio container does not support video stream");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_OPUS && opts->audio_codec != SC_CODEC_OPUS) {
+        LOGE("Recording to OPUS file requires an OPUS audio stream "
+             "(try with --audio-codec=opus)");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_AAC && opts->audio_codec != SC_CODEC_AAC) {
+        LOGE("Recording to AAC file requires an AAC audio stream "
+             "(try with --audio-codec=aac)");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_FLAC && opts->audio_codec != SC_CODEC_FLAC) {
+        LOGE("Recording to FLAC file requires a FLAC audio stream "
+             "(try with --audio-codec=flac)");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_WAV && opts->audio_codec != SC_CODEC_RAW) {
+        LOGE("Recording to WAV file requires a RAW audio stream "
+             "(try with --audio-codec=raw)");
+        return false;
+    }
+
+    if ((format == SC_RECORD_FORMAT_MP4 || format == SC_RECORD_FORMAT_M4A)
+            && opts->audio_codec == SC_CODEC_RAW) {
+        LOGE("Recording to MP4 container does not support RAW audio");
+        return false;
+    }
+
+    return true;
+}
+
+// Options passed explicitly, which take precedence over the latency profile
+struct sc_latency_profile_overrides {
+    bool video_buffer;
+    bool audio_output_buffer;
+    bool video_latency;
+    bool video_decoder_thread_type;
+};
+
+// The options explicitly set, which --power-saving must not change
+struct sc_power_saving_overrides {
+    bool video_hwaccel;
+    bool video_idle_timeout;
+};
+
+static void
+apply_power_saving(struct scrcpy_options *opts,
+                   const struct sc_power_saving_overrides *overrides) {
+    if (!opts->power_saving) {
+        return;
+    }
+
+    if (!overrides->video_hwaccel) {
+        opts->video_hwaccel = SC_HWACCEL_AUTO;
+    }
+    if (!overrides->video_idle_timeout) {
+        opts->video_idle_timeout = SC_TICK_FROM_SEC(10);
+    }
+}
+
+static void
+apply_latency_profile(struct scrcpy_options *opts,
+                      const struct sc_latency_profile_overrides *overrides) {
+    struct sc_latency_profile_defaults {
+        sc_tick video_buffer;
+        sc_tick audio_buffer;
+        sc_tick audio_output_buffer;
+        bool video_low_latency;
+        enum sc_decoder_thread_type video_decoder_thread_type;
+        bool video_pacing;
+        enum sc_present_mode present_mode;
+        sc_tick budget;
+    };
+
+    static const struct sc_latency_profile_defaults profiles[] = {
+        [SC_LATENCY_PROFILE_ULTRA] = {
+            .video_buffer = 0,
+            .audio_buffer = SC_TICK_FROM_MS(20),
+            .audio_output_buffer = SC_TICK_FROM_MS(5),
+            .video_low_latency = true,
+            .video_decoder_thread_type = SC_DECODER_THREAD_TYPE_SLICE,
+            .video_pacing = false,
+            .present_mode = SC_PRESENT_MODE_IMMEDIATE,
+            .budget = SC_TICK_FROM_MS(20),
+        },
+        [SC_LATENCY_PROFILE_BALANCED] = {
+            .video_buffer = 0,
+            .audio_buffer = SC_TICK_FROM_MS(50),
+            .audio_output_buffer = SC_TICK_FROM_MS(5),
+            .video_low_latency = true,
+            .video_decoder_thread_type = SC_DECODER_THREAD_TYPE_SLICE,
+            .video_pacing = false,
+            .present_mode = SC_PRESENT_MODE_VSYNC,
+            .budget = SC_TICK_FROM_MS(50),
+        },
+        [SC_LATENCY_PROFILE_QUALITY] = {
+            .video_buffer = SC_TICK_FROM_MS(50),
+            .audio_buffer = SC_TICK_FROM_MS(120),
+            .audio_output_buffer = SC_TICK_FROM_MS(10),
+            .video_low_latency = false,
+            .video_decoder_thread_type = SC_DECODER_THREAD_TYPE_FRAME,
+            .video_pacing = true,
+            .present_mode = SC_PRESENT_MODE_VSYNC,
+            .budget = SC_TICK_FROM_MS(150),
+        },
+    };
+
+    if (opts->latency_profile == SC_LATENCY_PROFILE_NONE) {
+        return;
+    }
+
+    assert(opts->latency_profile < ARRAY_LEN(profiles));
+    const struct sc_latency_profile_defaults *profile =
+        &profiles[opts->latency_profile];
+
+    if (!overrides->video_buffer) {
+        opts->video_buffer = profile->video_buffer;
+    }
+    // The FLAC encoder is not low latency, keep its specific default
+    if (opts->audio_buffer == -1 && opts->audio_codec != SC_CODEC_FLAC) {
+        opts->audio_buffer = profile->audio_buffer;
+    }
+    if (!overrides->audio_output_buffer) {
+        opts->audio_output_buffer = profile->audio_output_buffer;
+    }
+    if (!overrides->video_latency) {
+        opts->video_low_latency = profile->video_low_latency;
+    }
+    if (!overrides->video_decoder_thread_type) {
+        opts->video_decoder_thread_type = profile->video_decoder_thread_type;
+    }
+    // There is no option to disable video pacing, so only enable it
+    if (profile->video_pacing) {
+        opts->video_pacing = true;
+    }
+    if (opts->present_mode == SC_PRESENT_MODE_AUTO) {
+        opts->present_mode = profile->present_mode;
+    }
+    opts->latency_budget = profile->budget;
+}
+
 static bool
 parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                        const char *optstring, const struct option *longopts) {
     struct scrcpy_options *opts = &args->opts;
+    struct sc_latency_profile_overrides overrides = {0};
+    struct sc_power_saving_overrides power_overrides = {0};
 
     optind = 0; // reset to start from the first argument in tests
 
@@ -2532,42 +4607,113 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
-            case OPT_WINDOW_HEIGHT:
-                if (!parse_window_dimension(optarg, &opts->window_height)) {
+            case OPT_WINDOW_HEIGHT:
+                if (!parse_window_dimension(optarg, &opts->window_height)) {
+                    return false;
+                }
+                break;
+            case OPT_WINDOW_BORDERLESS:
+                opts->window_borderless = true;
+                break;
+            case OPT_PUSH_TARGET:
+                opts->push_target = optarg;
+                break;
+            case OPT_PREFER_TEXT:
+                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
+                    LOGE("--prefer-text is incompatible with --raw-key-events");
+                    return false;
+                }
+                opts->key_inject_mode = SC_KEY_INJECT_MODE_TEXT;
+                break;
+            case OPT_RAW_KEY_EVENTS:
+                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
+                    LOGE("--prefer-text is incompatible with --raw-key-events");
+                    return false;
+                }
+                opts->key_inject_mode = SC_KEY_INJECT_MODE_RAW;
+                break;
+            case OPT_ROTATION:
+                LOGE("--rotation has been removed, use --orientation or "
+                     "--capture-orientation instead.");
+                return false;
+            case OPT_DISPLAY_ORIENTATION:
+                if (!parse_orientation(optarg, &opts->display_orientation)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_ORIENTATION:
+                if (!parse_orientation(optarg, &opts->record_orientation)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_DURATION:
+                if (!parse_record_segment_duration(optarg,
+                                              &opts->record_segment_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_SIZE:
+                if (!parse_record_segment_size(optarg,
+                                               &opts->record_segment_size)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_FRAGMENT_DURATION:
+                if (!parse_record_fragment_duration(optarg,
+                                            &opts->record_fragment_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_INDEX:
+                opts->record_index = true;
+                break;
+            case OPT_RECORD_ON_DEMAND:
+                opts->record_on_demand = true;
+                break;
+            case OPT_RECORD_STREAM:
+                opts->record_stream = true;
+                break;
+            case OPT_RECORD_SYNC:
+                opts->record_sync = true;
+                break;
+            case OPT_RECORD_VIDEO_BIT_RATE:
+                if (!parse_bit_rate(optarg, &opts->record_video_bit_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_MAX_SIZE:
+                if (!parse_max_size(optarg, &opts->record_max_size)) {
                     return false;
                 }
                 break;
-            case OPT_WINDOW_BORDERLESS:
-                opts->window_borderless = true;
-                break;
-            case OPT_PUSH_TARGET:
-                opts->push_target = optarg;
-                break;
-            case OPT_PREFER_TEXT:
-                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
-                    LOGE("--prefer-text is incompatible with --raw-key-events");
+            case OPT_RECORD_TRANSCODE:
+                if (!parse_record_transcode(optarg,
+                                            &opts->record_transcode_codec)) {
                     return false;
                 }
-                opts->key_inject_mode = SC_KEY_INJECT_MODE_TEXT;
+                opts->record_transcode = true;
                 break;
-            case OPT_RAW_KEY_EVENTS:
-                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
-                    LOGE("--prefer-text is incompatible with --raw-key-events");
+            case OPT_RECORD_UPLOAD:
+                opts->record_upload_url = optarg;
+                break;
+            case OPT_RECORD_UPLOAD_ONLY:
+                opts->record_upload_only = true;
+                break;
+            case OPT_RECORD_TRANSCODE_QUALITY:
+                if (!parse_record_transcode_quality(optarg,
+                                        &opts->record_transcode_quality)) {
                     return false;
                 }
-                opts->key_inject_mode = SC_KEY_INJECT_MODE_RAW;
                 break;
-            case OPT_ROTATION:
-                LOGE("--rotation has been removed, use --orientation or "
-                     "--capture-orientation instead.");
-                return false;
-            case OPT_DISPLAY_ORIENTATION:
-                if (!parse_orientation(optarg, &opts->display_orientation)) {
+            case OPT_RECORD_MEMORY_LIMIT:
+                if (!parse_record_memory_limit(optarg,
+                                               &opts->record_memory_limit)) {
                     return false;
                 }
                 break;
-            case OPT_RECORD_ORIENTATION:
-                if (!parse_orientation(optarg, &opts->record_orientation)) {
+            case OPT_RECORD_SEGMENT_COUNT:
+                if (!parse_record_segment_count(optarg,
+                                                &opts->record_segment_count)) {
                     return false;
                 }
                 break;
@@ -2583,6 +4729,14 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_RENDER_DRIVER:
                 opts->render_driver = optarg;
                 break;
+            case OPT_REPLAY_BUFFER:
+                if (!parse_replay_buffer(optarg, &opts->replay_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_REPLAY_FILE:
+                opts->replay_filename = optarg;
+                break;
             case OPT_NO_MIPMAPS:
                 opts->mipmaps = false;
                 break;
@@ -2612,6 +4766,9 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_FORCE_ADB_FORWARD:
                 opts->force_adb_forward = true;
                 break;
+            case OPT_AUTO_TUNNEL:
+                opts->auto_tunnel = true;
+                break;
             case OPT_DISABLE_SCREENSAVER:
                 opts->disable_screensaver = true;
                 break;
@@ -2638,6 +4795,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 if (!parse_buffering_time(optarg, &opts->video_buffer)) {
                     return false;
                 }
+                overrides.video_buffer = true;
+                break;
+            case OPT_VIDEO_BUFFER_MAX:
+                if (!parse_buffering_time(optarg, &opts->video_buffer_max)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_BUFFER_PACKETS:
+                opts->video_buffer_packets = true;
+                break;
+            case OPT_VIDEO_PACING:
+                opts->video_pacing = true;
+                break;
+            case OPT_PRINT_AUDIO_STATS:
+                opts->print_audio_stats = true;
+                break;
+            case OPT_AV_SYNC:
+                opts->av_sync = true;
                 break;
             case OPT_NO_CLIPBOARD_AUTOSYNC:
                 opts->clipboard_autosync = false;
@@ -2646,6 +4821,19 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 opts->tcpip = true;
                 opts->tcpip_dst = optarg;
                 break;
+            case OPT_DIRECT_TCP:
+                if (optarg) {
+                    if (!parse_port(optarg, &opts->direct_tcp_port)) {
+                        return false;
+                    }
+                    if (!opts->direct_tcp_port) {
+                        LOGE("The direct TCP port may not be 0");
+                        return false;
+                    }
+                } else {
+                    opts->direct_tcp_port = SC_DIRECT_TCP_PORT_DEFAULT;
+                }
+                break;
             case OPT_NO_DOWNSIZE_ON_ERROR:
                 opts->downsize_on_error = false;
                 break;
@@ -2664,6 +4852,51 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_PRINT_FPS:
                 opts->start_fps_counter = true;
                 break;
+            case OPT_PRINT_LATENCY:
+                opts->print_latency = true;
+                break;
+            case OPT_PRINT_STARTUP_TIMING:
+                opts->print_startup_timing = true;
+                break;
+            case OPT_BENCHMARK_DECODE:
+                opts->benchmark_decode = true;
+                break;
+            case OPT_BENCHMARK_TOUCH:
+                if (!parse_benchmark_touch(optarg, &opts->benchmark_touch)) {
+                    return false;
+                }
+                break;
+            case OPT_ADAPTIVE_BIT_RATE:
+                opts->adaptive_bit_rate = true;
+                break;
+            case OPT_ADAPTIVE_MAX_SIZE:
+                opts->adaptive_max_size = true;
+                break;
+            case OPT_YUV_SHADER:
+                opts->yuv_shader = true;
+                break;
+            case OPT_PRESENT_MODE:
+                if (!parse_present_mode(optarg, &opts->present_mode)) {
+                    return false;
+                }
+                break;
+            case OPT_LATENCY_PROFILE:
+                if (!parse_latency_profile(optarg, &opts->latency_profile)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_SOCKET_BUFFER_SIZE:
+                if (!parse_video_socket_buffer_size(optarg,
+                                            &opts->video_socket_buffer_size)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_SOCKET_BUSY_POLL:
+                if (!parse_video_socket_busy_poll(optarg,
+                                              &opts->video_socket_busy_poll)) {
+                    return false;
+                }
+                break;
             case OPT_CODEC:
                 LOGE("--codec has been removed, "
                      "use --video-codec or --audio-codec.");
@@ -2678,6 +4911,48 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_VIDEO_HWACCEL:
+                if (!parse_video_hwaccel(optarg, &opts->video_hwaccel)) {
+                    return false;
+                }
+                power_overrides.video_hwaccel = true;
+                break;
+            case OPT_VIDEO_DECODER_THREADS:
+                if (!parse_video_decoder_threads(optarg,
+                                            &opts->video_decoder_threads)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_DECODER_THREAD_TYPE:
+                if (!parse_video_decoder_thread_type(optarg,
+                                            &opts->video_decoder_thread_type)) {
+                    return false;
+                }
+                overrides.video_decoder_thread_type = true;
+                break;
+            case OPT_VIDEO_DECODER_SKIP_NONREF:
+                opts->video_decoder_skip_nonref = true;
+                break;
+            case OPT_VIDEO_DECODER_RESILIENT:
+                opts->video_decoder_resilient = true;
+                break;
+            case OPT_VIDEO_CATCH_UP:
+                opts->video_catch_up = true;
+                break;
+            case OPT_EXTRA_DISPLAY:
+                if (opts->extra_display_count == SC_MAX_EXTRA_DISPLAYS) {
+                    LOGE("Too many extra displays (max %d)",
+                         SC_MAX_EXTRA_DISPLAYS);
+                    return false;
+                }
+                if (!parse_extra_display(optarg)) {
+                    return false;
+                }
+                opts->extra_displays[opts->extra_display_count++] = optarg;
+                break;
+            case OPT_VIDEO_SKIP_REPEATED_FRAMES:
+                opts->video_skip_repeated_frames = true;
+                break;
             case OPT_OTG:
 #ifdef HAVE_USB
                 opts->otg = true;
@@ -2686,6 +4961,96 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 LOGE("OTG mode (--otg) is disabled.");
                 return false;
 #endif
+            case OPT_ADB_USB:
+#ifdef HAVE_USB
+                opts->adb_usb = true;
+                break;
+#else
+                LOGE("Direct USB communication (--adb-usb) is disabled.");
+                return false;
+#endif
+            case OPT_SHM_SINK:
+                opts->shm_name = optarg;
+                break;
+            case OPT_RESTREAM:
+                opts->restream_url = optarg;
+                break;
+            case OPT_FRAME_SINK_PLUGIN:
+                if (opts->frame_sink_plugin_count
+                        == SC_MAX_FRAME_SINK_PLUGINS) {
+                    LOGE("Too many frame sink plugins (max %d)",
+                         SC_MAX_FRAME_SINK_PLUGINS);
+                    return false;
+                }
+                opts->frame_sink_plugins[opts->frame_sink_plugin_count++] =
+                    optarg;
+                break;
+            case OPT_RAW_VIDEO:
+                opts->raw_video_filename = optarg;
+                break;
+            case OPT_INPUT_PACING:
+                if (!parse_input_pacing(optarg, &opts->input_pacing)) {
+                    return false;
+                }
+                break;
+            case OPT_INPUT_RECORD:
+                opts->input_record_filename = optarg;
+                break;
+            case OPT_INPUT_REPLAY:
+                opts->input_replay_filename = optarg;
+                break;
+            case OPT_AUTOMATION_PORT:
+                if (!parse_port(optarg, &opts->automation_port)) {
+                    return false;
+                }
+                if (!opts->automation_port) {
+                    LOGE("Invalid automation port: 0");
+                    return false;
+                }
+                break;
+            case OPT_METRICS_FILE:
+                opts->metrics_filename = optarg;
+                break;
+            case OPT_METRICS_INTERVAL:
+                if (!parse_metrics_interval(optarg, &opts->metrics_interval)) {
+                    return false;
+                }
+                break;
+            case OPT_METRICS_PORT:
+                if (!parse_port(optarg, &opts->metrics_port)) {
+                    return false;
+                }
+                if (!opts->metrics_port) {
+                    LOGE("Invalid metrics port: 0");
+                    return false;
+                }
+                break;
+            case OPT_RAW_VIDEO_HEADER:
+                opts->raw_video_header = true;
+                break;
+            case OPT_THUMBNAIL:
+                opts->thumbnail_filename = optarg;
+                break;
+            case OPT_THUMBNAIL_INTERVAL:
+                if (!parse_thumbnail_interval(optarg,
+                                              &opts->thumbnail_interval)) {
+                    return false;
+                }
+                break;
+            case OPT_THUMBNAIL_SIZE:
+                if (!parse_thumbnail_size(optarg, &opts->thumbnail_size)) {
+                    return false;
+                }
+                break;
+            case OPT_SCREENSHOT_DIR:
+                opts->screenshot_dir = optarg;
+                break;
+            case OPT_SCREENSHOT_FORMAT:
+                if (!parse_screenshot_format(optarg,
+                                             &opts->screenshot_format)) {
+                    return false;
+                }
+                break;
             case OPT_V4L2_SINK:
 #ifdef HAVE_V4L2
                 opts->v4l2_device = optarg;
@@ -2705,6 +5070,28 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 LOGE("V4L2 (--v4l2-buffer) is disabled (or unsupported on this "
                      "platform).");
                 return false;
+#endif
+            case OPT_V4L2_FORMAT:
+#ifdef HAVE_V4L2
+                if (!parse_v4l2_format(optarg, &opts->v4l2_format)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("V4L2 (--v4l2-format) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
+#endif
+            case OPT_V4L2_FPS:
+#ifdef HAVE_V4L2
+                if (!parse_v4l2_fps(optarg, &opts->v4l2_fps)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("V4L2 (--v4l2-fps) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
 #endif
             case OPT_LIST_ENCODERS:
                 opts->list |= SC_OPTION_LIST_ENCODERS;
@@ -2724,16 +5111,30 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_REQUIRE_AUDIO:
                 opts->require_audio = true;
                 break;
+            case OPT_RECONNECT:
+                opts->reconnect = true;
+                break;
             case OPT_AUDIO_BUFFER:
                 if (!parse_buffering_time(optarg, &opts->audio_buffer)) {
                     return false;
                 }
                 break;
+            case OPT_AUDIO_BUFFER_MAX:
+                if (!parse_buffering_time(optarg, &opts->audio_buffer_max)) {
+                    return false;
+                }
+                break;
             case OPT_AUDIO_OUTPUT_BUFFER:
                 if (!parse_audio_output_buffer(optarg,
                                                &opts->audio_output_buffer)) {
                     return false;
                 }
+                overrides.audio_output_buffer = true;
+                break;
+            case OPT_AUDIO_VOLUME:
+                if (!parse_audio_volume(optarg, &opts->audio_volume)) {
+                    return false;
+                }
                 break;
             case OPT_VIDEO_SOURCE:
                 if (!parse_video_source(optarg, &opts->video_source)) {
@@ -2753,6 +5154,18 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_TRACE_FILE:
+                opts->trace_filename = optarg;
+                break;
+            case OPT_STREAM_CAPTURE:
+                opts->stream_capture_prefix = optarg;
+                break;
+            case OPT_STREAM_REPLAY:
+                opts->stream_replay_prefix = optarg;
+                break;
+            case OPT_STREAM_REPLAY_FAST:
+                opts->stream_replay_fast = true;
+                break;
             case OPT_PAUSE_ON_EXIT:
                 if (!parse_pause_on_exit(optarg, &args->pause_on_exit)) {
                     return false;
@@ -2794,9 +5207,89 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_GAMEPAD_REPORT_RATE:
+                if (!parse_gamepad_report_rate(optarg,
+                                               &opts->gamepad_report_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_BACKGROUND_MAX_FPS:
+                if (!parse_background_max_fps(optarg,
+                                              &opts->background_max_fps)) {
+                    return false;
+                }
+                break;
+            case OPT_POWER_SAVING:
+                opts->power_saving = true;
+                break;
+            case OPT_SOAK:
+                opts->soak = true;
+                break;
+            case OPT_CPU_BUDGET:
+                if (!parse_cpu_budget(optarg, &opts->cpu_budget)) {
+                    return false;
+                }
+                break;
+            case OPT_ALT_VIDEO_PROFILE:
+                if (!parse_video_profile(optarg, &opts->alt_video_profile)) {
+                    return false;
+                }
+                opts->has_alt_video_profile = true;
+                break;
+            case OPT_THREAD_AFFINITY:
+                if (!parse_thread_affinity(optarg, opts->thread_sched)) {
+                    return false;
+                }
+                break;
+            case OPT_THREAD_POLICY:
+                if (!parse_thread_policy(optarg, opts->thread_sched)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_IDLE_TIMEOUT:
+                if (!parse_video_idle_timeout(optarg,
+                                              &opts->video_idle_timeout)) {
+                    return false;
+                }
+                power_overrides.video_idle_timeout = true;
+                break;
+            case OPT_VIDEO_INTRA_REFRESH:
+                if (!parse_video_intra_refresh(optarg,
+                                               &opts->video_intra_refresh)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_LATENCY:
+                if (!parse_video_latency(optarg, &opts->video_low_latency)) {
+                    return false;
+                }
+                overrides.video_latency = true;
+                break;
             case OPT_NEW_DISPLAY:
                 opts->new_display = optarg ? optarg : "";
                 break;
+            case OPT_NEW_DISPLAY_FOLLOW_WINDOW:
+                opts->new_display_follow_window = true;
+                break;
+            case OPT_VIDEO_BIT_RATE_MODE:
+                if (!parse_video_bit_rate_mode(optarg,
+                                               &opts->video_bit_rate_mode)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_QUALITY:
+                if (!parse_video_quality(optarg, &opts->video_quality)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_MAX_BIT_RATE:
+                if (!parse_bit_rate(optarg, &opts->video_max_bit_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_MATCH_REFRESH_RATE:
+                opts->match_refresh_rate = true;
+                break;
             case OPT_START_APP:
                 opts->start_app = optarg;
                 break;
@@ -2833,6 +5326,8 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    apply_latency_profile(opts, &overrides);
+
     // If a TCP/IP address is provided, then tcpip must be enabled
     assert(opts->tcpip || !opts->tcpip_dst);
 
@@ -2853,11 +5348,55 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     bool v4l2 = false;
 #ifdef HAVE_USB
     otg = opts->otg;
+
+    if (opts->adb_usb) {
+        if (otg) {
+            LOGE("--adb-usb is incompatible with --otg");
+            return false;
+        }
+
+        if (opts->tcpip || opts->select_tcpip) {
+            LOGE("--adb-usb is incompatible with --tcpip and "
+                 "--select-tcpip (-e)");
+            return false;
+        }
+
+        if (opts->kill_adb_on_close) {
+            LOGE("--adb-usb does not use the adb server, "
+                 "--kill-adb-on-close is meaningless");
+            return false;
+        }
+
+        if (opts->tunnel_host || opts->tunnel_port) {
+            LOGE("--adb-usb does not use adb tunnels, --tunnel-host and "
+                 "--tunnel-port are meaningless");
+            return false;
+        }
+    }
 #endif
 #ifdef HAVE_V4L2
     v4l2 = !!opts->v4l2_device;
 #endif
 
+    if (opts->benchmark_decode) {
+        if (!opts->video) {
+            LOGE("--benchmark-decode requires video");
+            return false;
+        }
+
+        // Only decode the video stream
+        opts->window = false;
+        opts->audio = false;
+        opts->control = false;
+    }
+
+    if (opts->benchmark_touch) {
+        if (!opts->video || !opts->control) {
+            LOGE("--benchmark-touch requires video and control");
+            return false;
+        }
+    }
+
     if (!opts->window) {
         // Without window, there cannot be any video playback
         opts->video_playback = false;
@@ -2876,12 +5415,16 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     }
 
     if (opts->video && !opts->video_playback && !opts->record_filename
-            && !v4l2) {
+            && !opts->replay_buffer && !v4l2 && !opts->shm_name
+            && !opts->restream_url && !opts->thumbnail_filename
+            && !opts->raw_video_filename && !opts->frame_sink_plugin_count
+            && !opts->benchmark_decode && !opts->benchmark_touch) {
         LOGI("No video playback, no recording, no V4L2 sink: video disabled");
         opts->video = false;
     }
 
-    if (opts->audio && !opts->audio_playback && !opts->record_filename) {
+    if (opts->audio && !opts->audio_playback && !opts->record_filename
+            && !opts->replay_buffer) {
         LOGI("No audio playback, no recording: audio disabled");
         opts->audio = false;
     }
@@ -2896,17 +5439,94 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->require_audio = true;
     }
 
-    if (opts->audio_playback && opts->audio_buffer == -1) {
-        if (opts->audio_codec == SC_CODEC_FLAC) {
-            // Use 50 ms audio buffer by default, but use a higher value for
-            // FLAC, which is not low latency (the default encoder produces
-            // blocks of 4096 samples, which represent ~85.333ms).
-            LOGI("FLAC audio: audio buffer increased to 120 ms (use "
-                 "--audio-buffer to set a custom value)");
-            opts->audio_buffer = SC_TICK_FROM_MS(120);
-        } else {
-            opts->audio_buffer = SC_TICK_FROM_MS(50);
+    if (opts->audio_playback && opts->audio_buffer == -1) {
+        if (opts->audio_codec == SC_CODEC_FLAC) {
+            // Use 50 ms audio buffer by default, but use a higher value for
+            // FLAC, which is not low latency (the default encoder produces
+            // blocks of 4096 samples, which represent ~85.333ms).
+            LOGI("FLAC audio: audio buffer increased to 120 ms (use "
+                 "--audio-buffer to set a custom value)");
+            opts->audio_buffer = SC_TICK_FROM_MS(120);
+        } else {
+            opts->audio_buffer = SC_TICK_FROM_MS(50);
+        }
+    }
+
+    if (opts->audio_playback && opts->audio_buffer_max
+            && opts->audio_buffer_max <= opts->audio_buffer) {
+        LOGE("--audio-buffer-max must be greater than --audio-buffer");
+        return false;
+    }
+
+    if (opts->audio_volume != 100 && !opts->audio_playback) {
+        LOGW("--audio-volume has no effect without audio playback");
+    }
+
+    if (opts->av_sync && (!opts->video_playback || !opts->audio_playback)) {
+        LOGW("--av-sync has no effect without video and audio playback");
+        opts->av_sync = false;
+    }
+
+    if (opts->shm_name) {
+        if (!opts->video) {
+            LOGE("Shared memory sink requires video capture, but --no-video "
+                 "was set.");
+            return false;
+        }
+
+        if (!*opts->shm_name) {
+            LOGE("The shared memory name must not be empty");
+            return false;
+        }
+    }
+
+    if (opts->restream_url) {
+        if (!opts->video) {
+            LOGE("Restreaming requires video capture, but --no-video was "
+                 "set.");
+            return false;
+        }
+
+        if (!*opts->restream_url) {
+            LOGE("The restream URL must not be empty");
+            return false;
+        }
+    }
+
+    if (opts->frame_sink_plugin_count && !opts->video) {
+        LOGE("Frame sink plugins require video capture, but --no-video was "
+             "set.");
+        return false;
+    }
+
+    if (opts->raw_video_filename) {
+        if (!opts->video) {
+            LOGE("Raw video output requires video capture, but --no-video "
+                 "was set.");
+            return false;
+        }
+    } else if (opts->raw_video_header) {
+        LOGE("--raw-video-header requires --raw-video");
+        return false;
+    }
+
+    if (opts->thumbnail_filename) {
+        if (!opts->video) {
+            LOGE("Thumbnails require video capture, but --no-video was set.");
+            return false;
+        }
+
+        opts->thumbnail_format =
+            guess_thumbnail_format(opts->thumbnail_filename);
+        if (opts->thumbnail_format == SC_THUMBNAIL_FORMAT_AUTO) {
+            LOGE("Unsupported thumbnail format for \"%s\" (expected .jpg, "
+                 ".jpeg, .png or .webp)", opts->thumbnail_filename);
+            return false;
         }
+    } else if (opts->thumbnail_interval != SC_TICK_FROM_SEC(1)
+            || opts->thumbnail_size != 320) {
+        LOGE("Thumbnail options require --thumbnail");
+        return false;
     }
 
 #ifdef HAVE_V4L2
@@ -2926,6 +5546,16 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         LOGE("V4L2 buffer value without V4L2 sink");
         return false;
     }
+
+    if (opts->v4l2_format != SC_V4L2_FORMAT_YUV420P && !opts->v4l2_device) {
+        LOGE("V4L2 format without V4L2 sink");
+        return false;
+    }
+
+    if (opts->v4l2_fps && !opts->v4l2_device) {
+        LOGE("V4L2 fps value without V4L2 sink");
+        return false;
+    }
 #endif
 
     if (opts->control) {
@@ -3007,6 +5637,29 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
     }
 
+    if (opts->new_display_follow_window) {
+        if (!opts->new_display) {
+            LOGE("--new-display-follow-window requires --new-display");
+            return false;
+        }
+
+        // The window must match the display content
+        if (opts->crop || opts->angle
+                || opts->capture_orientation != SC_ORIENTATION_0
+                || opts->capture_orientation_lock
+                        != SC_ORIENTATION_UNLOCKED) {
+            LOGE("--new-display-follow-window is incompatible with --crop, "
+                 "--angle and --capture-orientation");
+            return false;
+        }
+
+        if (opts->adaptive_max_size) {
+            LOGE("--new-display-follow-window is incompatible with "
+                 "--adaptive-max-size");
+            return false;
+        }
+    }
+
     if (otg) {
         if (!opts->control) {
             LOGE("--no-control is not allowed in OTG mode");
@@ -3065,6 +5718,57 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    if (opts->reconnect && opts->control) {
+        // The UHID devices are not recreated on the new server, and the AOA
+        // devices are lost on USB disconnection
+        enum sc_keyboard_input_mode kmode = opts->keyboard_input_mode;
+        enum sc_mouse_input_mode mmode = opts->mouse_input_mode;
+        if ((kmode != SC_KEYBOARD_INPUT_MODE_SDK
+                    && kmode != SC_KEYBOARD_INPUT_MODE_DISABLED)
+                || (mmode != SC_MOUSE_INPUT_MODE_SDK
+                    && mmode != SC_MOUSE_INPUT_MODE_DISABLED)
+                || opts->gamepad_input_mode
+                    != SC_GAMEPAD_INPUT_MODE_DISABLED) {
+            LOGE("--reconnect only supports --keyboard=sdk and --mouse=sdk, "
+                 "without --gamepad");
+            return false;
+        }
+    }
+
+    if (opts->auto_tunnel) {
+        // --direct-tcp is allowed: it makes the direct TCP connection a
+        // candidate
+        if (opts->force_adb_forward || opts->tunnel_host
+                || opts->tunnel_port) {
+            LOGE("--auto-tunnel selects the tunnel mode, it is incompatible "
+                 "with --force-adb-forward, --tunnel-host and --tunnel-port");
+            return false;
+        }
+
+#ifdef HAVE_USB
+        if (opts->adb_usb) {
+            LOGE("--auto-tunnel is incompatible with --adb-usb");
+            return false;
+        }
+#endif
+    }
+
+    if (opts->direct_tcp_port) {
+        if (opts->tunnel_host || opts->tunnel_port
+                || opts->force_adb_forward) {
+            LOGE("--direct-tcp does not use adb tunnels, --tunnel-host, "
+                 "--tunnel-port and --force-adb-forward are meaningless");
+            return false;
+        }
+
+#ifdef HAVE_USB
+        if (opts->adb_usb) {
+            LOGE("--direct-tcp is incompatible with --adb-usb");
+            return false;
+        }
+#endif
+    }
+
     if ((opts->tunnel_host || opts->tunnel_port) && !opts->force_adb_forward) {
         LOGI("Tunnel host/port is set, "
              "--force-adb-forward automatically enabled.");
@@ -3119,6 +5823,14 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    if (opts->crop && strchr(opts->crop, ',')
+            && (opts->video_source != SC_VIDEO_SOURCE_DISPLAY
+                || opts->new_display)) {
+        LOGE("Several crop areas are only supported with "
+             "--video-source=display, without --new-display");
+        return false;
+    }
+
     if (opts->display_id != 0 && opts->new_display) {
         LOGE("Cannot specify both --display-id and --new-display");
         return false;
@@ -3163,6 +5875,133 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    bool record_segmented = opts->record_segment_duration
+                         || opts->record_segment_size;
+    if (record_segmented && !opts->record_filename) {
+        LOGE("Record segments specified without recording");
+        return false;
+    }
+
+    if (opts->record_index && !opts->record_filename) {
+        LOGE("--record-index requires --record");
+        return false;
+    }
+
+    if (opts->record_sync) {
+        if (!opts->record_filename) {
+            LOGE("--record-sync requires --record");
+            return false;
+        }
+
+        if (opts->record_stream) {
+            // The separate record stream is not mapped to the computer clock
+            LOGE("--record-sync is incompatible with --record-stream");
+            return false;
+        }
+    }
+
+    if (opts->record_on_demand) {
+        if (!opts->record_filename) {
+            LOGE("--record-on-demand requires --record");
+            return false;
+        }
+
+        if (!opts->window) {
+            LOGE("--record-on-demand requires a window (to toggle recording "
+                 "with a shortcut)");
+            return false;
+        }
+    }
+
+    if (opts->record_stream) {
+        if (!opts->record_filename) {
+            LOGE("--record-stream requires --record");
+            return false;
+        }
+
+        if (!opts->video) {
+            LOGE("--record-stream requires video");
+            return false;
+        }
+
+        if (opts->video_source != SC_VIDEO_SOURCE_DISPLAY
+                || opts->new_display) {
+            LOGE("--record-stream is only available with "
+                 "--video-source=display, without --new-display");
+            return false;
+        }
+
+        if (opts->record_on_demand) {
+            LOGE("Cannot specify both --record-stream and --record-on-demand");
+            return false;
+        }
+    } else if (opts->record_video_bit_rate || opts->record_max_size) {
+        LOGE("--record-video-bit-rate and --record-max-size require "
+             "--record-stream");
+        return false;
+    }
+
+    if (opts->record_transcode) {
+        if (!opts->record_filename) {
+            LOGE("--record-transcode requires --record");
+            return false;
+        }
+
+        if (!opts->video) {
+            LOGE("--record-transcode requires video");
+            return false;
+        }
+
+        if (opts->record_stream || opts->record_on_demand) {
+            LOGE("--record-transcode is incompatible with --record-stream and "
+                 "--record-on-demand");
+            return false;
+        }
+
+        if (opts->video_decoder_skip_nonref) {
+            // The recording would miss the skipped frames
+            LOGE("--record-transcode is incompatible with "
+                 "--video-decoder-skip-nonref");
+            return false;
+        }
+    }
+
+    if (opts->record_upload_url) {
+        if (!opts->record_filename) {
+            LOGE("--record-upload requires --record");
+            return false;
+        }
+
+        if (opts->record_on_demand) {
+            LOGE("--record-upload is incompatible with --record-on-demand");
+            return false;
+        }
+
+        if (opts->record_upload_only
+                && (opts->record_index || opts->record_sync
+                    || opts->record_segment_count)) {
+            // These write or delete local files
+            LOGE("--record-upload-only is incompatible with --record-index, "
+                 "--record-sync and --record-segment-count");
+            return false;
+        }
+    } else if (opts->record_upload_only) {
+        LOGE("--record-upload-only requires --record-upload");
+        return false;
+    }
+
+    if (opts->extra_display_count && !opts->video_playback) {
+        // The extra displays are only rendered in their own windows
+        LOGE("--extra-display requires video playback in a window");
+        return false;
+    }
+
+    if (opts->record_segment_count && !record_segmented) {
+        LOGE("--record-segment-count requires --record-segment-duration or "
+             "--record-segment-size");
+        return false;
+    }
+
     if (opts->record_filename) {
         if (!opts->video && !opts->audio) {
             LOGE("Video and audio disabled, nothing to record");
@@ -3179,52 +6018,63 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             }
         }
 
-        if (opts->record_orientation != SC_ORIENTATION_0) {
-            if (sc_orientation_is_mirror(opts->record_orientation)) {
-                LOGE("Record orientation only supports rotation, not "
-                     "flipping: %s",
-                     sc_orientation_get_name(opts->record_orientation));
+        if (!validate_record_output(opts, opts->record_format)) {
+            return false;
+        }
+
+        if (opts->record_index) {
+            if (!opts->video) {
+                LOGE("--record-index requires video");
                 return false;
             }
-        }
 
-        if (opts->video
-                && sc_record_format_is_audio_only(opts->record_format)) {
-            LOGE("Audio container does not support video stream");
-            return false;
+            enum sc_record_format fmt = opts->record_format;
+            bool mp4 = fmt == SC_RECORD_FORMAT_MP4;
+            bool mkv = fmt == SC_RECORD_FORMAT_MKV;
+            if (!mkv && !(mp4 && opts->record_fragment_duration)) {
+                LOGE("--record-index requires an MKV or a fragmented MP4 "
+                     "recording");
+                return false;
+            }
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_OPUS
-                && opts->audio_codec != SC_CODEC_OPUS) {
-            LOGE("Recording to OPUS file requires an OPUS audio stream "
-                 "(try with --audio-codec=opus)");
-            return false;
+        if (opts->record_upload_url) {
+            enum sc_record_format fmt = opts->record_format;
+            bool mp4 = fmt == SC_RECORD_FORMAT_MP4
+                    || fmt == SC_RECORD_FORMAT_M4A;
+            if (mp4 && !opts->record_fragment_duration) {
+                // An uploaded file is written sequentially, a non-fragmented
+                // MP4 needs to seek back to write its index
+                LOGE("--record-upload requires a fragmented MP4 recording "
+                     "(see --record-fragment-duration)");
+                return false;
+            }
         }
+    }
+
+    if (opts->replay_filename && !opts->replay_buffer) {
+        LOGE("--replay-file requires --replay-buffer");
+        return false;
+    }
 
-        if (opts->record_format == SC_RECORD_FORMAT_AAC
-                && opts->audio_codec != SC_CODEC_AAC) {
-            LOGE("Recording to AAC file requires an AAC audio stream "
-                 "(try with --audio-codec=aac)");
+    if (opts->replay_buffer) {
+        if (!opts->video && !opts->audio) {
+            LOGE("Video and audio disabled, nothing to replay");
             return false;
         }
-        if (opts->record_format == SC_RECORD_FORMAT_FLAC
-                && opts->audio_codec != SC_CODEC_FLAC) {
-            LOGE("Recording to FLAC file requires a FLAC audio stream "
-                 "(try with --audio-codec=flac)");
-            return false;
+
+        if (!opts->replay_filename) {
+            opts->replay_filename = "scrcpy-replay.mkv";
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_WAV
-                && opts->audio_codec != SC_CODEC_RAW) {
-            LOGE("Recording to WAV file requires a RAW audio stream "
-                 "(try with --audio-codec=raw)");
+        opts->replay_format = guess_record_format(opts->replay_filename);
+        if (!opts->replay_format) {
+            LOGE("No format found for \"%s\" (expected mp4, mkv, m4a, mka, "
+                 "opus, aac, flac or wav extension)", opts->replay_filename);
             return false;
         }
 
-        if ((opts->record_format == SC_RECORD_FORMAT_MP4 ||
-             opts->record_format == SC_RECORD_FORMAT_M4A)
-                && opts->audio_codec == SC_CODEC_RAW) {
-            LOGE("Recording to MP4 container does not support RAW audio");
+        if (!validate_record_output(opts, opts->replay_format)) {
             return false;
         }
     }
@@ -3266,6 +6116,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("Cannot start an Android app if control is disabled");
             return false;
         }
+        if (opts->input_record_filename || opts->input_replay_filename) {
+            LOGE("Cannot record or replay input events if control is "
+                 "disabled");
+            return false;
+        }
+        if (opts->automation_port) {
+            LOGE("Cannot accept an automation client if control is disabled");
+            return false;
+        }
+        if (opts->input_pacing) {
+            LOGE("Cannot delay input events if control is disabled");
+            return false;
+        }
+    }
+
+    if (opts->input_record_filename && opts->input_replay_filename) {
+        LOGE("--input-record and --input-replay are mutually exclusive");
+        return false;
     }
 
 # ifdef _WIN32
@@ -3279,15 +6147,188 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     }
 # endif
 
+    if (opts->video_buffer_max
+            && opts->video_buffer_max <= opts->video_buffer) {
+        LOGE("--video-buffer-max must be greater than --video-buffer");
+        return false;
+    }
+
+    if (opts->video_buffer_packets) {
+        if (!opts->video_buffer) {
+            LOGE("--video-buffer-packets requires --video-buffer");
+            return false;
+        }
+        if (opts->video_buffer_max) {
+            LOGE("Adaptive video buffering (--video-buffer-max) is not "
+                 "supported with --video-buffer-packets");
+            return false;
+        }
+        if (opts->av_sync) {
+            LOGE("--av-sync is not supported with --video-buffer-packets");
+            return false;
+        }
+    }
+
     if (opts->start_fps_counter && !opts->video_playback) {
         LOGW("--print-fps has no effect without video playback");
         opts->start_fps_counter = false;
     }
 
+    if (opts->print_audio_stats && !opts->audio_playback) {
+        LOGW("--print-audio-stats has no effect without audio playback");
+        opts->print_audio_stats = false;
+    }
+
+    if (opts->print_latency && !opts->video_playback) {
+        LOGW("--print-latency has no effect without video playback");
+        opts->print_latency = false;
+    }
+
+    if (opts->adaptive_bit_rate && (!opts->video || !opts->control)) {
+        LOGW("--adaptive-bit-rate has no effect without video and control");
+        opts->adaptive_bit_rate = false;
+    }
+
+    if (opts->present_mode == SC_PRESENT_MODE_AUTO) {
+        opts->present_mode = opts->video_pacing ? SC_PRESENT_MODE_VSYNC
+                                                : SC_PRESENT_MODE_IMMEDIATE;
+    }
+
+    if (opts->adaptive_max_size
+            && (!opts->video_playback || !opts->control)) {
+        LOGW("--adaptive-max-size has no effect without video playback and "
+             "control");
+        opts->adaptive_max_size = false;
+    }
+
+    if (opts->new_display_follow_window
+            && (!opts->video_playback || !opts->control)) {
+        LOGW("--new-display-follow-window has no effect without video "
+             "playback and control");
+        opts->new_display_follow_window = false;
+    }
+
+    if (opts->background_max_fps
+            && (!opts->video_playback || !opts->control)) {
+        LOGW("--background-max-fps has no effect without video playback and "
+             "control");
+        opts->background_max_fps = 0;
+    }
+
+    if (opts->cpu_budget) {
+        if (!opts->video_playback) {
+            LOGW("--cpu-budget has no effect without video playback");
+            opts->cpu_budget = 0;
+        } else if (!opts->record_transcode) {
+            // The first step of the CPU governor (but the transcoded
+            // recording needs all the frames)
+            opts->video_decoder_skip_nonref = true;
+        }
+    }
+
+    if (opts->power_saving && !opts->video_playback) {
+        LOGW("--power-saving has no effect without video playback");
+        opts->power_saving = false;
+    }
+    apply_power_saving(opts, &power_overrides);
+
+    if (opts->has_alt_video_profile
+            && (!opts->video_playback || !opts->control)) {
+        // The profile is switched by a shortcut on the window
+        LOGE("--alt-video-profile requires video playback and control");
+        return false;
+    }
+
+    if (opts->video_idle_timeout && !opts->video) {
+        LOGE("--video-idle-timeout requires video");
+        return false;
+    }
+
+    if (opts->video_intra_refresh) {
+        if (!opts->video) {
+            LOGE("--video-intra-refresh requires video");
+            return false;
+        }
+        if (opts->replay_buffer) {
+            // The replay buffer may only start on a keyframe
+            LOGE("--video-intra-refresh is incompatible with --replay-buffer");
+            return false;
+        }
+        if (opts->record_filename && !opts->record_stream && !opts->control) {
+            LOGW("Without control, the recording could not be split nor "
+                 "resumed on a keyframe with --video-intra-refresh");
+        }
+    }
+
+    if (opts->match_refresh_rate) {
+        if (!opts->max_fps) {
+            LOGE("--match-refresh-rate requires --max-fps");
+            return false;
+        }
+        if (opts->video_source != SC_VIDEO_SOURCE_DISPLAY
+                || opts->new_display) {
+            LOGE("--match-refresh-rate is only available when mirroring an "
+                 "existing display");
+            return false;
+        }
+        if (!opts->cleanup) {
+            // The refresh rate setting could not be restored
+            LOGE("--match-refresh-rate is incompatible with --no-cleanup");
+            return false;
+        }
+    }
+
+    if (opts->video_quality >= 0
+            && opts->video_bit_rate_mode != SC_VIDEO_BIT_RATE_MODE_CQ) {
+        LOGE("--video-quality requires --video-bit-rate-mode=cq");
+        return false;
+    }
+
+    if (opts->video_max_bit_rate) {
+        if (!opts->video) {
+            LOGE("--video-max-bit-rate requires video");
+            return false;
+        }
+        if (opts->video_bit_rate
+                && opts->video_max_bit_rate < opts->video_bit_rate) {
+            LOGE("--video-max-bit-rate must not be lower than "
+                 "--video-bit-rate");
+            return false;
+        }
+    }
+
+    if (opts->video_codec == SC_CODEC_AUTO && opts->video_encoder) {
+        // An encoder supports a single codec
+        LOGE("--video-encoder requires an explicit --video-codec");
+        return false;
+    }
+
+    if (opts->video_catch_up) {
+        if (!opts->video_playback) {
+            LOGE("--video-catch-up requires video playback");
+            return false;
+        }
+        // The dropped packets are lost for all the consumers of the stream
+        if ((opts->record_filename && !opts->record_stream)
+                || opts->replay_buffer || opts->restream_url
+                || opts->raw_video_filename) {
+            LOGE("--video-catch-up is incompatible with the recording of the "
+                 "video stream (unless --record-stream), --replay-buffer, "
+                 "--restream and --raw-video");
+            return false;
+        }
+        if (opts->video_intra_refresh && !opts->control) {
+            // There would be no keyframe to resume on
+            LOGE("--video-catch-up requires control with "
+                 "--video-intra-refresh");
+            return false;
+        }
+    }
+
     if (otg) {
         // OTG mode is compatible with only very few options.
         // Only report obvious errors.
-        if (opts->record_filename) {
+        if (opts->record_filename || opts->replay_buffer) {
             LOGE("OTG mode: cannot record");
             return false;
         }
@@ -3303,6 +6344,10 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("OTG mode: could not request to show touches");
             return false;
         }
+        if (opts->match_refresh_rate) {
+            LOGE("OTG mode: could not match the refresh rate");
+            return false;
+        }
         if (opts->power_off_on_close) {
             LOGE("OTG mode: could not request power off on close");
             return false;
@@ -3315,6 +6360,60 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("OTG mode: could not sink to V4L2 device");
             return false;
         }
+        if (opts->input_record_filename || opts->input_replay_filename) {
+            LOGE("OTG mode: could not record or replay input events");
+            return false;
+        }
+        if (opts->automation_port) {
+            LOGE("OTG mode: could not accept an automation client");
+            return false;
+        }
+        if (opts->metrics_filename || opts->metrics_port) {
+            LOGE("OTG mode: could not export metrics");
+            return false;
+        }
+        if (opts->trace_filename) {
+            LOGE("OTG mode: could not record a trace");
+            return false;
+        }
+        if (opts->stream_capture_prefix || opts->stream_replay_prefix) {
+            LOGE("OTG mode: could not capture or replay streams");
+            return false;
+        }
+    }
+
+    if (opts->stream_capture_prefix) {
+        if (opts->stream_replay_prefix) {
+            LOGE("--stream-capture is incompatible with --stream-replay");
+            return false;
+        }
+        if (opts->video_playback && opts->print_latency) {
+            // The device timestamps change the format of the stream
+            LOGE("--stream-capture is incompatible with --print-latency");
+            return false;
+        }
+    }
+
+    if (opts->stream_replay_fast && !opts->stream_replay_prefix) {
+        LOGE("--stream-replay-fast requires --stream-replay");
+        return false;
+    }
+
+    if (opts->soak) {
+        if (!opts->metrics_filename) {
+            // The time series is written to the metrics file
+            LOGE("--soak requires --metrics-file");
+            return false;
+        }
+        if (opts->stream_replay_prefix) {
+            LOGE("--soak is incompatible with --stream-replay");
+            return false;
+        }
+    }
+
+    if (opts->benchmark_touch && opts->stream_replay_prefix) {
+        LOGE("--benchmark-touch is incompatible with --stream-replay");
+        return false;
     }
 
     return true;
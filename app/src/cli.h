@@ -29,6 +29,17 @@ scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]);
 #ifdef SC_TEST
 bool
 sc_parse_shortcut_mods(const char *s, uint8_t *shortcut_mods);
+
+bool
+sc_parse_video_profile(const char *s, struct sc_video_profile *profile);
+
+bool
+sc_parse_thread_affinity(const char *s,
+                         struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]);
+
+bool
+sc_parse_thread_policy(const char *s,
+                       struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT]);
 #endif
 
 #endif
@@ -10,9 +10,11 @@
 
 #ifndef _WIN32
 # define PRIu64_ PRIu64
+# define PRIx64_ PRIx64
 # define SC_PRIsizet "zu"
 #else
 # define PRIu64_ "I64u"  // Windows...
+# define PRIx64_ "I64x"
 # define SC_PRIsizet "Iu"
 #endif
 
@@ -61,6 +63,40 @@
 # define SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
 #endif
 
+// In ffmpeg/doc/APIchanges (lavf 57.80.100 - avio.h):
+//   Add avio_context_free(). From now on it must be used for freeing
+//   AVIOContext.
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 80, 100)
+# define SCRCPY_LAVF_HAS_AVIO_CONTEXT_FREE
+#endif
+
+// The buffer passed to the write_packet callback of AVIOContext is
+// pointer-to-const since lavf 61 (FF_API_AVIO_WRITE_NONCONST).
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+# define SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+#endif
+
+// In ffmpeg/doc/APIchanges (lavf 57.41.100 - avio.h):
+//   Add AVIODataMarkerType, write_data_type, ignore_boundary_point and
+//   avio_write_marker.
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 41, 100)
+# define SCRCPY_LAVF_HAS_AVIO_DATA_MARKERS
+#endif
+
+// In ffmpeg/doc/APIchanges:
+// 2017-11-18 - 8b79f397dad - lavc 58.6.100 - avcodec.h
+//   Add AVCodecHWConfig and avcodec_get_hw_config().
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 6, 100)
+# define SCRCPY_LAVC_HAS_HWACCEL
+#endif
+
+// In ffmpeg/doc/APIchanges:
+// 2019-06-21 - 5d30efb39c - lavu 56.30.100 - hwcontext.h
+//   Add AV_HWDEVICE_TYPE_VULKAN and implementation.
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 30, 100)
+# define SCRCPY_LAVU_HAS_HWDEVICE_VULKAN
+#endif
+
 #if SDL_VERSION_ATLEAST(2, 0, 6)
 // <https://github.com/libsdl-org/SDL/commit/d7a318de563125e5bb465b1000d6bc9576fbc6fc>
 # define SCRCPY_SDL_HAS_HINT_TOUCH_MOUSE_EVENTS
@@ -73,6 +109,7 @@
 
 #if SDL_VERSION_ATLEAST(2, 0, 16)
 # define SCRCPY_SDL_HAS_THREAD_PRIORITY_TIME_CRITICAL
+# define SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
 #endif
 
 #if SDL_VERSION_ATLEAST(2, 0, 18)
@@ -83,6 +120,10 @@
 # define SCRCPY_SDL_HAS_HINT_AUDIO_DEVICE_APP_NAME
 #endif
 
+#if SDL_VERSION_ATLEAST(2, 26, 0)
+# define SCRCPY_SDL_HAS_HINT_MOUSE_RELATIVE_SYSTEM_SCALE
+#endif
+
 #ifndef HAVE_STRDUP
 char *strdup(const char *s);
 #endif
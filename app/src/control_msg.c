@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
 #include "util/binary.h"
 #include "util/log.h"
 #include "util/str.h"
@@ -72,6 +76,42 @@ write_position(uint8_t *buf, const struct sc_position *position) {
     sc_write16be(&buf[10], position->screen_size.height);
 }
 
+// Write the samples of a touch batch, and return the size
+static size_t
+write_touch_batch_samples(uint8_t *buf, const struct sc_control_msg *msg) {
+    unsigned count = msg->inject_touch_batch.count;
+    assert(count && count <= SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES);
+
+    // The sample times are sent relative to the most recent one, so that the
+    // device does not need to know the client clock
+    sc_tick last = msg->inject_touch_batch.samples[count - 1].timestamp;
+
+    size_t index = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        const struct sc_point *point =
+            &msg->inject_touch_batch.samples[i].point;
+        float pressure = msg->inject_touch_batch.samples[i].pressure;
+        sc_tick age = last - msg->inject_touch_batch.samples[i].timestamp;
+        assert(age >= 0);
+        sc_write32be(&buf[index], point->x);
+        sc_write32be(&buf[index + 4], point->y);
+        sc_write16be(&buf[index + 8], sc_float_to_u16fp(pressure));
+        sc_write32be(&buf[index + 10], MIN(SC_TICK_TO_US(age), UINT32_MAX));
+        index += 14;
+    }
+
+    return index;
+}
+
+static int16_t
+scroll_to_i16fp(float scroll) {
+    // Accept values in the range [-16, 16].
+    // Normalize to [-1, 1] in order to use sc_float_to_i16fp().
+    float norm = scroll / 16;
+    norm = CLAMP(norm, -1, 1);
+    return sc_float_to_i16fp(norm);
+}
+
 // Write truncated string, and return the size
 static size_t
 write_string_payload(uint8_t *payload, const char *utf8, size_t max_len) {
@@ -91,6 +131,30 @@ write_string(uint8_t *buf, const char *utf8, size_t max_len) {
     return 4 + len;
 }
 
+// Write the clipboard text, compressed if it is worth it
+static size_t
+write_clipboard_text(uint8_t *buf, const char *utf8) {
+#ifdef HAVE_ZLIB
+    size_t max_len = SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH;
+    size_t len = utf8 ? sc_str_utf8_truncation_index(utf8, max_len) : 0;
+    if (len >= SC_CLIPBOARD_COMPRESSION_MIN_LENGTH) {
+        // Only keep the compressed text if it is smaller than the raw text
+        uLongf compressed_len = len - 4;
+        int r = compress2(&buf[8], &compressed_len, (const Bytef *) utf8, len,
+                          Z_BEST_SPEED);
+        if (r == Z_OK) {
+            sc_write32be(buf, (compressed_len + 4)
+                                  | SC_CLIPBOARD_COMPRESSED_FLAG);
+            sc_write32be(&buf[4], len);
+            return 8 + compressed_len;
+        }
+        // Otherwise, the text is not compressible enough, write it raw
+    }
+#endif
+
+    return write_string(buf, utf8, SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+}
+
 // Write length (1 byte) + string (non null-terminated)
 static size_t
 write_string_tiny(uint8_t *buf, const char *utf8, size_t max_len) {
@@ -115,6 +179,12 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
                                       SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH);
             return 1 + len;
         }
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM: {
+            size_t len =
+                write_string(&buf[1], msg->inject_text.text,
+                             SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH);
+            return 1 + len;
+        }
         case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
             buf[1] = msg->inject_touch_event.action;
             sc_write64be(&buf[2], msg->inject_touch_event.pointer_id);
@@ -125,16 +195,26 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             sc_write32be(&buf[24], msg->inject_touch_event.action_button);
             sc_write32be(&buf[28], msg->inject_touch_event.buttons);
             return 32;
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH: {
+            buf[1] = msg->inject_touch_batch.action;
+            sc_write64be(&buf[2], msg->inject_touch_batch.pointer_id);
+            sc_write16be(&buf[10], msg->inject_touch_batch.screen_size.width);
+            sc_write16be(&buf[12], msg->inject_touch_batch.screen_size.height);
+            sc_write32be(&buf[14], msg->inject_touch_batch.action_button);
+            sc_write32be(&buf[18], msg->inject_touch_batch.buttons);
+            unsigned count = msg->inject_touch_batch.count;
+            assert(count);
+            // Time of the most recent sample, the other ones are relative
+            sc_tick last = msg->inject_touch_batch.samples[count - 1].timestamp;
+            sc_write64be(&buf[22], SC_TICK_TO_US(last));
+            buf[30] = count;
+            size_t len = write_touch_batch_samples(&buf[31], msg);
+            return 31 + len;
+        }
         case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
             write_position(&buf[1], &msg->inject_scroll_event.position);
-            // Accept values in the range [-16, 16].
-            // Normalize to [-1, 1] in order to use sc_float_to_i16fp().
-            float hscroll_norm = msg->inject_scroll_event.hscroll / 16;
-            hscroll_norm = CLAMP(hscroll_norm, -1, 1);
-            float vscroll_norm = msg->inject_scroll_event.vscroll / 16;
-            vscroll_norm = CLAMP(vscroll_norm, -1, 1);
-            int16_t hscroll = sc_float_to_i16fp(hscroll_norm);
-            int16_t vscroll = sc_float_to_i16fp(vscroll_norm);
+            int16_t hscroll = scroll_to_i16fp(msg->inject_scroll_event.hscroll);
+            int16_t vscroll = scroll_to_i16fp(msg->inject_scroll_event.vscroll);
             sc_write16be(&buf[13], (uint16_t) hscroll);
             sc_write16be(&buf[15], (uint16_t) vscroll);
             sc_write32be(&buf[17], msg->inject_scroll_event.buttons);
@@ -148,8 +228,13 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
         case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
             sc_write64be(&buf[1], msg->set_clipboard.sequence);
             buf[9] = !!msg->set_clipboard.paste;
-            size_t len = write_string(&buf[10], msg->set_clipboard.text,
-                                      SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+            if (msg->set_clipboard.by_hash) {
+                sc_write32be(&buf[10], 8 | SC_CLIPBOARD_HASH_FLAG);
+                sc_write64be(&buf[14], msg->set_clipboard.hash);
+                return 22;
+            }
+            size_t len = write_clipboard_text(&buf[10],
+                                              msg->set_clipboard.text);
             return 10 + len;
         case SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER:
             buf[1] = msg->set_display_power.on;
@@ -182,12 +267,47 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             size_t len = write_string_tiny(&buf[1], msg->start_app.name, 255);
             return 1 + len;
         }
+        case SC_CONTROL_MSG_TYPE_GET_CLOCK:
+            sc_write64be(&buf[1], msg->get_clock.timestamp);
+            return 9;
+        case SC_CONTROL_MSG_TYPE_PING:
+            sc_write64be(&buf[1], msg->ping.sequence);
+            sc_write64be(&buf[9], msg->ping.timestamp);
+            return 17;
+        case SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK:
+            sc_write32be(&buf[1], msg->video_feedback.receive_rate);
+            sc_write32be(&buf[5], msg->video_feedback.delay);
+            sc_write16be(&buf[9], msg->video_feedback.frames);
+            sc_write16be(&buf[11], msg->video_feedback.skipped_frames);
+            return 13;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE:
+            sc_write16be(&buf[1], msg->set_video_throttle.max_fps);
+            buf[3] = msg->set_video_throttle.paused;
+            return 4;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE:
+            sc_write16be(&buf[1], msg->set_video_profile.max_size);
+            sc_write32be(&buf[3], msg->set_video_profile.bit_rate);
+            sc_write16be(&buf[7], msg->set_video_profile.max_fps);
+            sc_write16be(&buf[9], msg->set_video_profile.crop.width);
+            sc_write16be(&buf[11], msg->set_video_profile.crop.height);
+            sc_write16be(&buf[13], msg->set_video_profile.crop.x);
+            sc_write16be(&buf[15], msg->set_video_profile.crop.y);
+            return 17;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE:
+            sc_write16be(&buf[1], msg->set_video_view_size.max_size);
+            return 3;
+        case SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY:
+            sc_write16be(&buf[1], msg->resize_display.width);
+            sc_write16be(&buf[3], msg->resize_display.height);
+            sc_write16be(&buf[5], msg->resize_display.dpi);
+            return 7;
         case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
         case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
         case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
         case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
         case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
         case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
+        case SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME:
             // no additional data
             return 1;
         default:
@@ -196,6 +316,433 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
     }
 }
 
+size_t
+sc_control_msg_serialize_fragment(const uint8_t *data, size_t len, bool last,
+                                  uint8_t *buf) {
+    assert(len <= SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH);
+    buf[0] = SC_CONTROL_MSG_TYPE_FRAGMENT;
+    buf[1] = last;
+    sc_write16be(&buf[2], len);
+    memcpy(&buf[4], data, len);
+    return 4 + len;
+}
+
+// Fields present in a compact message (the other ones are unchanged)
+#define COMPACT_FLAG_POINTER_ID    0x01 // new pointer in this slot
+#define COMPACT_FLAG_SCREEN_SIZE   0x02
+#define COMPACT_FLAG_PRESSURE      0x04
+#define COMPACT_FLAG_ACTION_BUTTON 0x08
+#define COMPACT_FLAG_BUTTONS       0x10
+#define COMPACT_FLAG_HSCROLL       0x20
+#define COMPACT_FLAG_VSCROLL       0x40
+
+void
+sc_control_msg_compact_state_init(struct sc_control_msg_compact_state *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+// Write an unsigned LEB128 variable-length integer, and return the size
+static size_t
+write_varint(uint8_t *buf, uint64_t value) {
+    size_t index = 0;
+    while (value >= 0x80) {
+        buf[index++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[index++] = value;
+    return index;
+}
+
+// Write a signed value as a zigzag-encoded varint (so that small negative
+// values are small too), and return the size
+static size_t
+write_zigzag(uint8_t *buf, int64_t value) {
+    uint64_t zigzag = value < 0 ? ~((uint64_t) value << 1)
+                                : (uint64_t) value << 1;
+    return write_varint(buf, zigzag);
+}
+
+// Write the difference between two coordinates, and return the size
+static size_t
+write_delta(uint8_t *buf, int32_t prev, int32_t value) {
+    return write_zigzag(buf, (int64_t) value - prev);
+}
+
+// Write the event timestamp (in microseconds) relative to the previous compact
+// event, and return the size
+static size_t
+write_compact_timestamp(struct sc_control_msg_compact_state *state,
+                        sc_tick timestamp, uint8_t *buf) {
+    int64_t delta = SC_TICK_TO_US(timestamp) - SC_TICK_TO_US(state->timestamp);
+    state->timestamp = timestamp;
+    return write_zigzag(buf, delta);
+}
+
+// Write the screen size if it changed, and return the size
+static size_t
+write_compact_screen_size(struct sc_control_msg_compact_state *state,
+                          const struct sc_size *size, uint8_t *buf,
+                          uint8_t *flags) {
+    if (size->width == state->screen_size.width
+            && size->height == state->screen_size.height) {
+        return 0;
+    }
+
+    *flags |= COMPACT_FLAG_SCREEN_SIZE;
+    state->screen_size = *size;
+    size_t index = write_varint(buf, size->width);
+    index += write_varint(&buf[index], size->height);
+    return index;
+}
+
+// Return the slot of the pointer, assigning one (the least recently used) if
+// it is not tracked yet
+static unsigned
+get_compact_pointer_slot(struct sc_control_msg_compact_state *state,
+                         uint64_t pointer_id, bool *assigned) {
+    ++state->use_counter;
+
+    for (unsigned i = 0; i < SC_CONTROL_MSG_COMPACT_POINTERS; ++i) {
+        if (state->pointers[i].used
+                && state->pointers[i].pointer_id == pointer_id) {
+            state->pointers[i].last_use = state->use_counter;
+            *assigned = false;
+            return i;
+        }
+    }
+
+    unsigned slot = 0;
+    for (unsigned i = 0; i < SC_CONTROL_MSG_COMPACT_POINTERS; ++i) {
+        if (!state->pointers[i].used) {
+            slot = i;
+            break;
+        }
+        if (state->pointers[i].last_use < state->pointers[slot].last_use) {
+            slot = i;
+        }
+    }
+
+    // The device resets the slot values on a new pointer
+    state->pointers[slot].used = true;
+    state->pointers[slot].pointer_id = pointer_id;
+    state->pointers[slot].last_use = state->use_counter;
+    state->pointers[slot].point.x = 0;
+    state->pointers[slot].point.y = 0;
+    state->pointers[slot].pressure = 0;
+    state->pointers[slot].action_button = 0;
+    state->pointers[slot].buttons = 0;
+    *assigned = true;
+    return slot;
+}
+
+static size_t
+serialize_touch_compact(const struct sc_control_msg *msg,
+                        struct sc_control_msg_compact_state *state,
+                        uint8_t *buf) {
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+    if ((unsigned) action > 0xF) {
+        // Does not fit in 4 bits
+        return sc_control_msg_serialize(msg, buf);
+    }
+
+    uint64_t pointer_id = msg->inject_touch_event.pointer_id;
+    const struct sc_position *position = &msg->inject_touch_event.position;
+    uint16_t pressure = sc_float_to_u16fp(msg->inject_touch_event.pressure);
+    uint32_t action_button = msg->inject_touch_event.action_button;
+    uint32_t buttons = msg->inject_touch_event.buttons;
+
+    bool assigned;
+    unsigned slot = get_compact_pointer_slot(state, pointer_id, &assigned);
+    assert(slot <= 0xF);
+
+    buf[0] = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_COMPACT;
+    buf[1] = action | (slot << 4);
+    uint8_t flags = 0;
+    size_t index = 3;
+
+    if (assigned) {
+        flags |= COMPACT_FLAG_POINTER_ID;
+        sc_write64be(&buf[index], pointer_id);
+        index += 8;
+    }
+
+    index += write_compact_screen_size(state, &position->screen_size,
+                                       &buf[index], &flags);
+
+    struct sc_point *prev = &state->pointers[slot].point;
+    index += write_delta(&buf[index], prev->x, position->point.x);
+    index += write_delta(&buf[index], prev->y, position->point.y);
+    *prev = position->point;
+
+    index += write_compact_timestamp(state, msg->inject_touch_event.timestamp,
+                                     &buf[index]);
+
+    if (pressure != state->pointers[slot].pressure) {
+        flags |= COMPACT_FLAG_PRESSURE;
+        sc_write16be(&buf[index], pressure);
+        index += 2;
+        state->pointers[slot].pressure = pressure;
+    }
+
+    if (action_button != state->pointers[slot].action_button) {
+        flags |= COMPACT_FLAG_ACTION_BUTTON;
+        index += write_varint(&buf[index], action_button);
+        state->pointers[slot].action_button = action_button;
+    }
+
+    if (buttons != state->pointers[slot].buttons) {
+        flags |= COMPACT_FLAG_BUTTONS;
+        index += write_varint(&buf[index], buttons);
+        state->pointers[slot].buttons = buttons;
+    }
+
+    buf[2] = flags;
+    return index;
+}
+
+static size_t
+serialize_scroll_compact(const struct sc_control_msg *msg,
+                         struct sc_control_msg_compact_state *state,
+                         uint8_t *buf) {
+    const struct sc_position *position = &msg->inject_scroll_event.position;
+    int16_t hscroll = scroll_to_i16fp(msg->inject_scroll_event.hscroll);
+    int16_t vscroll = scroll_to_i16fp(msg->inject_scroll_event.vscroll);
+    uint32_t buttons = msg->inject_scroll_event.buttons;
+
+    buf[0] = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_COMPACT;
+    uint8_t flags = 0;
+    size_t index = 2;
+
+    index += write_compact_screen_size(state, &position->screen_size,
+                                       &buf[index], &flags);
+
+    struct sc_point *prev = &state->scroll_point;
+    index += write_delta(&buf[index], prev->x, position->point.x);
+    index += write_delta(&buf[index], prev->y, position->point.y);
+    *prev = position->point;
+
+    index += write_compact_timestamp(state, msg->inject_scroll_event.timestamp,
+                                     &buf[index]);
+
+    // A scroll event is usually either horizontal or vertical
+    if (hscroll) {
+        flags |= COMPACT_FLAG_HSCROLL;
+        sc_write16be(&buf[index], (uint16_t) hscroll);
+        index += 2;
+    }
+
+    if (vscroll) {
+        flags |= COMPACT_FLAG_VSCROLL;
+        sc_write16be(&buf[index], (uint16_t) vscroll);
+        index += 2;
+    }
+
+    if (buttons != state->scroll_buttons) {
+        flags |= COMPACT_FLAG_BUTTONS;
+        index += write_varint(&buf[index], buttons);
+        state->scroll_buttons = buttons;
+    }
+
+    buf[1] = flags;
+    return index;
+}
+
+size_t
+sc_control_msg_serialize_compact(const struct sc_control_msg *msg,
+                                 struct sc_control_msg_compact_state *state,
+                                 uint8_t *buf) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+            return serialize_touch_compact(msg, state, buf);
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            return serialize_scroll_compact(msg, state, buf);
+        default:
+            return sc_control_msg_serialize(msg, buf);
+    }
+}
+
+static void
+read_position(const uint8_t *buf, struct sc_position *position) {
+    position->point.x = (int32_t) sc_read32be(&buf[0]);
+    position->point.y = (int32_t) sc_read32be(&buf[4]);
+    position->screen_size.width = sc_read16be(&buf[8]);
+    position->screen_size.height = sc_read16be(&buf[10]);
+}
+
+// Copy a non-nul-terminated string to a new nul-terminated string
+static char *
+copy_string(const uint8_t *data, size_t len) {
+    char *s = malloc(len + 1);
+    if (!s) {
+        LOG_OOM();
+        return NULL;
+    }
+    memcpy(s, data, len);
+    s[len] = '\0';
+    return s;
+}
+
+ssize_t
+sc_control_msg_deserialize(const uint8_t *buf, size_t len,
+                           struct sc_control_msg *msg) {
+    if (len < 1) {
+        return 0; // no complete message
+    }
+
+    msg->type = buf[0];
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+            if (len < 14) {
+                return 0;
+            }
+            msg->inject_keycode.action = buf[1];
+            msg->inject_keycode.keycode = sc_read32be(&buf[2]);
+            msg->inject_keycode.repeat = sc_read32be(&buf[6]);
+            msg->inject_keycode.metastate = sc_read32be(&buf[10]);
+            return 14;
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM: {
+            if (len < 5) {
+                return 0;
+            }
+            size_t text_len = sc_read32be(&buf[1]);
+            size_t max_len = msg->type == SC_CONTROL_MSG_TYPE_INJECT_TEXT
+                           ? SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH
+                           : SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH;
+            if (text_len > max_len) {
+                LOGW("Text too long: %" SC_PRIsizet, text_len);
+                return -1;
+            }
+            if (len < 5 + text_len) {
+                return 0;
+            }
+            char *text = copy_string(&buf[5], text_len);
+            if (!text) {
+                return -1;
+            }
+            msg->inject_text.text = text;
+            return 5 + text_len;
+        }
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+            if (len < 32) {
+                return 0;
+            }
+            msg->inject_touch_event.action = buf[1];
+            msg->inject_touch_event.pointer_id = sc_read64be(&buf[2]);
+            read_position(&buf[10], &msg->inject_touch_event.position);
+            msg->inject_touch_event.pressure =
+                sc_u16fp_to_float(sc_read16be(&buf[22]));
+            msg->inject_touch_event.action_button = sc_read32be(&buf[24]);
+            msg->inject_touch_event.buttons = sc_read32be(&buf[28]);
+            return 32;
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            if (len < 21) {
+                return 0;
+            }
+            read_position(&buf[1], &msg->inject_scroll_event.position);
+            // Serialized in the range [-1, 1], see sc_control_msg_serialize()
+            msg->inject_scroll_event.hscroll =
+                sc_i16fp_to_float((int16_t) sc_read16be(&buf[13])) * 16;
+            msg->inject_scroll_event.vscroll =
+                sc_i16fp_to_float((int16_t) sc_read16be(&buf[15])) * 16;
+            msg->inject_scroll_event.buttons = sc_read32be(&buf[17]);
+            return 21;
+        case SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON:
+            if (len < 2) {
+                return 0;
+            }
+            msg->back_or_screen_on.action = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_GET_CLIPBOARD:
+            if (len < 2) {
+                return 0;
+            }
+            msg->get_clipboard.copy_key = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD: {
+            if (len < 14) {
+                return 0;
+            }
+            uint32_t text_len = sc_read32be(&buf[10]);
+            if (text_len & SC_CLIPBOARD_COMPRESSED_FLAG) {
+                LOGW("Compressed clipboard text not supported");
+                return -1;
+            }
+            if (text_len & SC_CLIPBOARD_HASH_FLAG) {
+                LOGW("Clipboard hash not supported");
+                return -1;
+            }
+            if (text_len > SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH) {
+                LOGW("Clipboard text too long: %" PRIu32, text_len);
+                return -1;
+            }
+            if (len < 14 + text_len) {
+                return 0;
+            }
+            char *text = copy_string(&buf[14], text_len);
+            if (!text) {
+                return -1;
+            }
+            msg->set_clipboard.sequence = sc_read64be(&buf[1]);
+            msg->set_clipboard.paste = buf[9];
+            msg->set_clipboard.text = text;
+            msg->set_clipboard.by_hash = false;
+            return 14 + text_len;
+        }
+        case SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER:
+            if (len < 2) {
+                return 0;
+            }
+            msg->set_display_power.on = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_UHID_INPUT: {
+            if (len < 5) {
+                return 0;
+            }
+            uint16_t size = sc_read16be(&buf[3]);
+            if (size > SC_HID_MAX_SIZE) {
+                LOGW("HID input too large: %" PRIu16, size);
+                return -1;
+            }
+            if (len < 5u + size) {
+                return 0;
+            }
+            msg->uhid_input.id = sc_read16be(&buf[1]);
+            msg->uhid_input.size = size;
+            memcpy(msg->uhid_input.data, &buf[5], size);
+            return 5 + size;
+        }
+        case SC_CONTROL_MSG_TYPE_START_APP: {
+            if (len < 2) {
+                return 0;
+            }
+            size_t name_len = buf[1];
+            if (len < 2 + name_len) {
+                return 0;
+            }
+            char *name = copy_string(&buf[2], name_len);
+            if (!name) {
+                return -1;
+            }
+            msg->start_app.name = name;
+            return 2 + name_len;
+        }
+        case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
+        case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
+        case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
+        case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
+        case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+        case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
+        case SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME:
+            // no additional data
+            return 1;
+        default:
+            LOGW("Unsupported message type to deserialize: %u",
+                 (unsigned) msg->type);
+            return -1;
+    }
+}
+
 void
 sc_control_msg_log(const struct sc_control_msg *msg) {
 #define LOG_CMSG(fmt, ...) LOGV("input: " fmt, ## __VA_ARGS__)
@@ -210,6 +757,10 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
         case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
             LOG_CMSG("text \"%s\"", msg->inject_text.text);
             break;
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM:
+            LOG_CMSG("text stream chunk length=%" SC_PRIsizet,
+                     strlen(msg->inject_text.text));
+            break;
         case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT: {
             int action = msg->inject_touch_event.action
                        & AMOTION_EVENT_ACTION_MASK;
@@ -241,6 +792,20 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
             }
             break;
         }
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH: {
+            int action = msg->inject_touch_batch.action
+                       & AMOTION_EVENT_ACTION_MASK;
+            unsigned count = msg->inject_touch_batch.count;
+            const struct sc_point *last =
+                &msg->inject_touch_batch.samples[count - 1].point;
+            LOG_CMSG("touch batch [id=%" PRIu64_ "] %-4s samples=%u"
+                         " last_position=%" PRIi32 ",%" PRIi32
+                         " buttons=%06lx",
+                     msg->inject_touch_batch.pointer_id,
+                     MOTIONEVENT_ACTION_LABEL(action), count, last->x, last->y,
+                     (long) msg->inject_touch_batch.buttons);
+            break;
+        }
         case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
             LOG_CMSG("scroll position=%" PRIi32 ",%" PRIi32 " hscroll=%f"
                          " vscroll=%f buttons=%06lx",
@@ -259,6 +824,13 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
                      copy_key_labels[msg->get_clipboard.copy_key]);
             break;
         case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
+            if (msg->set_clipboard.by_hash) {
+                LOG_CMSG("clipboard %" PRIu64_ " %s hash=%016" PRIx64_,
+                         msg->set_clipboard.sequence,
+                         msg->set_clipboard.paste ? "paste" : "nopaste",
+                         msg->set_clipboard.hash);
+                break;
+            }
             LOG_CMSG("clipboard %" PRIu64_ " %s \"%s\"",
                      msg->set_clipboard.sequence,
                      msg->set_clipboard.paste ? "paste" : "nopaste",
@@ -318,6 +890,49 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
         case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
             LOG_CMSG("reset video");
             break;
+        case SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME:
+            LOG_CMSG("request keyframe");
+            break;
+        case SC_CONTROL_MSG_TYPE_GET_CLOCK:
+            LOG_CMSG("get clock %" PRIu64_, msg->get_clock.timestamp);
+            break;
+        case SC_CONTROL_MSG_TYPE_PING:
+            LOG_CMSG("ping sequence=%" PRIu64_, msg->ping.sequence);
+            break;
+        case SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK:
+            LOG_CMSG("video feedback rate=%" PRIu32 " delay=%" PRIu32
+                     " frames=%" PRIu16 " skipped=%" PRIu16,
+                     msg->video_feedback.receive_rate,
+                     msg->video_feedback.delay,
+                     msg->video_feedback.frames,
+                     msg->video_feedback.skipped_frames);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE:
+            LOG_CMSG("video throttle max_fps=%" PRIu16 " paused=%s",
+                     msg->set_video_throttle.max_fps,
+                     msg->set_video_throttle.paused ? "true" : "false");
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE:
+            LOG_CMSG("video profile max_size=%" PRIu16 " bit_rate=%" PRIu32
+                     " max_fps=%" PRIu16 " crop=%" PRIu16 ":%" PRIu16 ":%"
+                     PRIu16 ":%" PRIu16,
+                     msg->set_video_profile.max_size,
+                     msg->set_video_profile.bit_rate,
+                     msg->set_video_profile.max_fps,
+                     msg->set_video_profile.crop.width,
+                     msg->set_video_profile.crop.height,
+                     msg->set_video_profile.crop.x,
+                     msg->set_video_profile.crop.y);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE:
+            LOG_CMSG("video view size max_size=%" PRIu16,
+                     msg->set_video_view_size.max_size);
+            break;
+        case SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY:
+            LOG_CMSG("resize display %" PRIu16 "x%" PRIu16 "/%" PRIu16,
+                     msg->resize_display.width, msg->resize_display.height,
+                     msg->resize_display.dpi);
+            break;
         default:
             LOG_CMSG("unknown type: %u", (unsigned) msg->type);
             break;
@@ -330,14 +945,120 @@ sc_control_msg_is_droppable(const struct sc_control_msg *msg) {
     // UHID_INPUT messages for this device to be invalid.
     // Cannot drop UHID_DESTROY messages either, because a further UHID_CREATE
     // with the same id may fail.
+    // Cannot drop INJECT_TEXT_STREAM messages, because the text would be
+    // incomplete.
+    // Cannot drop SET_VIDEO_THROTTLE, SET_VIDEO_PROFILE, SET_VIDEO_VIEW_SIZE
+    // and RESIZE_DISPLAY messages, because the video settings would not match
+    // the client state.
     return msg->type != SC_CONTROL_MSG_TYPE_UHID_CREATE
-        && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY;
+        && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY
+        && msg->type != SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM
+        && msg->type != SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE
+        && msg->type != SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE
+        && msg->type != SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE
+        && msg->type != SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY;
+}
+
+static bool
+size_equals(const struct sc_size *a, const struct sc_size *b) {
+    return a->width == b->width && a->height == b->height;
+}
+
+static bool
+is_touch_move(const struct sc_control_msg *msg) {
+    if (msg->type != SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        return false;
+    }
+
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+    return action == AMOTION_EVENT_ACTION_MOVE
+        || action == AMOTION_EVENT_ACTION_HOVER_MOVE;
+}
+
+static void
+init_touch_batch(struct sc_control_msg *batch,
+                 const struct sc_control_msg *msg, sc_tick timestamp) {
+    assert(is_touch_move(msg));
+
+    // Copy the fields before overwriting the union (batch may be msg)
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+    enum android_motionevent_buttons action_button =
+        msg->inject_touch_event.action_button;
+    enum android_motionevent_buttons buttons = msg->inject_touch_event.buttons;
+    uint64_t pointer_id = msg->inject_touch_event.pointer_id;
+    struct sc_position position = msg->inject_touch_event.position;
+    float pressure = msg->inject_touch_event.pressure;
+
+    batch->type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH;
+    batch->inject_touch_batch.action = action;
+    batch->inject_touch_batch.action_button = action_button;
+    batch->inject_touch_batch.buttons = buttons;
+    batch->inject_touch_batch.pointer_id = pointer_id;
+    batch->inject_touch_batch.screen_size = position.screen_size;
+    batch->inject_touch_batch.count = 1;
+    batch->inject_touch_batch.samples[0].point = position.point;
+    batch->inject_touch_batch.samples[0].pressure = pressure;
+    batch->inject_touch_batch.samples[0].timestamp = timestamp;
+}
+
+bool
+sc_control_msg_merge_touch(struct sc_control_msg *prev, sc_tick prev_timestamp,
+                           const struct sc_control_msg *msg,
+                           sc_tick timestamp) {
+    if (!is_touch_move(msg)) {
+        return false;
+    }
+
+    const struct sc_size *screen_size =
+        &msg->inject_touch_event.position.screen_size;
+
+    if (is_touch_move(prev)) {
+        if (prev->inject_touch_event.action != msg->inject_touch_event.action
+                || prev->inject_touch_event.pointer_id
+                        != msg->inject_touch_event.pointer_id
+                || prev->inject_touch_event.action_button
+                        != msg->inject_touch_event.action_button
+                || prev->inject_touch_event.buttons
+                        != msg->inject_touch_event.buttons
+                || !size_equals(&prev->inject_touch_event.position.screen_size,
+                                screen_size)) {
+            return false;
+        }
+
+        init_touch_batch(prev, prev, prev_timestamp);
+    } else if (prev->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH) {
+        if (prev->inject_touch_batch.action != msg->inject_touch_event.action
+                || prev->inject_touch_batch.pointer_id
+                        != msg->inject_touch_event.pointer_id
+                || prev->inject_touch_batch.action_button
+                        != msg->inject_touch_event.action_button
+                || prev->inject_touch_batch.buttons
+                        != msg->inject_touch_event.buttons
+                || !size_equals(&prev->inject_touch_batch.screen_size,
+                                   screen_size)
+                || prev->inject_touch_batch.count
+                        == SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    unsigned i = prev->inject_touch_batch.count++;
+    prev->inject_touch_batch.samples[i].point =
+        msg->inject_touch_event.position.point;
+    prev->inject_touch_batch.samples[i].pressure =
+        msg->inject_touch_event.pressure;
+    prev->inject_touch_batch.samples[i].timestamp = timestamp;
+
+    return true;
 }
 
 void
 sc_control_msg_destroy(struct sc_control_msg *msg) {
     switch (msg->type) {
         case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM:
             free(msg->inject_text.text);
             break;
         case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
@@ -6,18 +6,45 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "android/input.h"
 #include "android/keycodes.h"
 #include "coords.h"
 #include "hid/hid_event.h"
+#include "util/tick.h"
 
 #define SC_CONTROL_MSG_MAX_SIZE (1 << 18) // 256k
 
 #define SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH 300
+// Maximum length of a chunk of text stream (to paste a large text)
+#define SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH 4096
 // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
 #define SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH (SC_CONTROL_MSG_MAX_SIZE - 14)
 
+// If this flag is set in the length of a clipboard text, then the payload is
+// the uncompressed length (4 bytes) followed by the zlib-compressed text
+#define SC_CLIPBOARD_COMPRESSED_FLAG UINT32_C(0x80000000)
+// Do not compress smaller clipboard texts
+#define SC_CLIPBOARD_COMPRESSION_MIN_LENGTH 1024
+// If this flag is set in the length of a clipboard text, then the payload is
+// only the hash (8 bytes, see sc_str_hash()) of a text that the device
+// clipboard already contains
+#define SC_CLIPBOARD_HASH_FLAG UINT32_C(0x40000000)
+// Always send smaller clipboard texts
+#define SC_CLIPBOARD_HASH_MIN_LENGTH 128
+
+// Large messages are sent in fragments of this maximum length, so that the
+// input events may be sent in between
+#define SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH 16384
+
+// Maximum number of samples of a touch batch
+#define SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES 16
+
+// Number of pointers tracked by the compact encoding of the touch events (the
+// least recently used one is replaced)
+#define SC_CONTROL_MSG_COMPACT_POINTERS 16
+
 #define SC_POINTER_ID_MOUSE UINT64_C(-1)
 #define SC_POINTER_ID_GENERIC_FINGER UINT64_C(-2)
 
@@ -43,6 +70,21 @@ enum sc_control_msg_type {
     SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS,
     SC_CONTROL_MSG_TYPE_START_APP,
     SC_CONTROL_MSG_TYPE_RESET_VIDEO,
+    SC_CONTROL_MSG_TYPE_GET_CLOCK,
+    SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+    SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME,
+    SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+    SC_CONTROL_MSG_TYPE_PING,
+    SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM,
+    SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE,
+    SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE,
+    SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE,
+    // Never queued, see sc_control_msg_serialize_fragment()
+    SC_CONTROL_MSG_TYPE_FRAGMENT,
+    // Never queued, see sc_control_msg_serialize_compact()
+    SC_CONTROL_MSG_TYPE_INJECT_TOUCH_COMPACT,
+    SC_CONTROL_MSG_TYPE_INJECT_SCROLL_COMPACT,
+    SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY,
 };
 
 enum sc_copy_key {
@@ -62,7 +104,7 @@ struct sc_control_msg {
         } inject_keycode;
         struct {
             char *text; // owned, to be freed by free()
-        } inject_text;
+        } inject_text; // also used by INJECT_TEXT_STREAM (a chunk of a text)
         struct {
             enum android_motionevent_action action;
             enum android_motionevent_buttons action_button;
@@ -70,12 +112,31 @@ struct sc_control_msg {
             uint64_t pointer_id;
             struct sc_position position;
             float pressure;
+            // local time of the event, set by the controller (0 if unknown)
+            sc_tick timestamp;
         } inject_touch_event;
+        struct {
+            // Consecutive moves of a single pointer, injected as one
+            // MotionEvent with historical samples
+            enum android_motionevent_action action; // MOVE or HOVER_MOVE
+            enum android_motionevent_buttons action_button;
+            enum android_motionevent_buttons buttons;
+            uint64_t pointer_id;
+            struct sc_size screen_size;
+            unsigned count;
+            struct {
+                struct sc_point point;
+                float pressure;
+                sc_tick timestamp; // local time of the event
+            } samples[SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES];
+        } inject_touch_batch;
         struct {
             struct sc_position position;
             float hscroll;
             float vscroll;
             enum android_motionevent_buttons buttons;
+            // local time of the event, set by the controller (0 if unknown)
+            sc_tick timestamp;
         } inject_scroll_event;
         struct {
             enum android_keyevent_action action; // action for the BACK key
@@ -88,6 +149,9 @@ struct sc_control_msg {
             uint64_t sequence;
             char *text; // owned, to be freed by free()
             bool paste;
+            // Send only the hash instead of the text
+            bool by_hash;
+            uint64_t hash; // only if by_hash
         } set_clipboard;
         struct {
             bool on;
@@ -111,6 +175,51 @@ struct sc_control_msg {
         struct {
             char *name;
         } start_app;
+        struct {
+            // Client time (echoed by the device in its reply)
+            uint64_t timestamp;
+        } get_clock;
+        struct {
+            uint64_t sequence;
+            // Client time when the ping is sent (echoed by the device in its
+            // acknowledgment), set by the controller
+            uint64_t timestamp;
+        } ping;
+        struct {
+            // Statistics of the video stream received during the last period
+            uint32_t receive_rate; // in bytes per second
+            uint32_t delay; // average queuing delay, in microseconds
+            uint16_t frames;
+            uint16_t skipped_frames; // frames not rendered
+        } video_feedback;
+        struct {
+            uint16_t max_fps; // 0 to restore the initial value (--max-fps)
+            bool paused; // suspend the encoding
+        } set_video_throttle;
+        struct {
+            // For each value, 0 restores the initial value (from the command
+            // line)
+            uint16_t max_size;
+            uint32_t bit_rate;
+            uint16_t max_fps;
+            struct {
+                uint16_t width; // 0 to restore the initial crop
+                uint16_t height;
+                uint16_t x;
+                uint16_t y;
+            } crop;
+        } set_video_profile;
+        struct {
+            // The size of the largest dimension of the video in the client
+            // window, 0 for no limit
+            uint16_t max_size;
+        } set_video_view_size;
+        struct {
+            // The size of the video in the client window (in pixels)
+            uint16_t width;
+            uint16_t height;
+            uint16_t dpi; // 0 to keep the current density
+        } resize_display;
     };
 };
 
@@ -119,6 +228,75 @@ struct sc_control_msg {
 size_t
 sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf);
 
+// Serialize a fragment of a serialized message (at most
+// SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH bytes)
+//
+// The device reassembles the fragments, and processes the message once its
+// last fragment is received.
+//
+// Return the number of bytes written.
+size_t
+sc_control_msg_serialize_fragment(const uint8_t *data, size_t len, bool last,
+                                  uint8_t *buf);
+
+/**
+ * State shared by the consecutive compact messages
+ *
+ * The device keeps the same state to decode them, so all the compact messages
+ * must be sent, in order, on the same connection.
+ */
+struct sc_control_msg_compact_state {
+    struct {
+        bool used;
+        uint64_t pointer_id;
+        uint32_t last_use; // to replace the least recently used pointer
+        // Last values sent for this pointer
+        struct sc_point point;
+        uint16_t pressure;
+        uint32_t action_button;
+        uint32_t buttons;
+    } pointers[SC_CONTROL_MSG_COMPACT_POINTERS];
+    uint32_t use_counter;
+    // Last values sent for any event
+    struct sc_size screen_size;
+    sc_tick timestamp;
+    // Last values sent for the scroll events
+    struct sc_point scroll_point;
+    uint32_t scroll_buttons;
+};
+
+void
+sc_control_msg_compact_state_init(struct sc_control_msg_compact_state *state);
+
+// Serialize a message like sc_control_msg_serialize(), except that the touch
+// and scroll events are encoded compactly (INJECT_TOUCH_COMPACT and
+// INJECT_SCROLL_COMPACT): the positions are delta-coded relative to the
+// previous event (of the same pointer for touch events) as variable-length
+// integers, and the unchanged fields are elided. They also carry the event
+// timestamp, delta-coded relative to the previous compact event.
+//
+// A typical touch move takes 7 or 8 bytes instead of 32.
+//
+// Return the number of bytes written.
+size_t
+sc_control_msg_serialize_compact(const struct sc_control_msg *msg,
+                                 struct sc_control_msg_compact_state *state,
+                                 uint8_t *buf);
+
+// Deserialize a message serialized by sc_control_msg_serialize(), to replay
+// recorded input events or to forward the messages received from an
+// automation client
+//
+// All the messages are supported except the ones managed internally by scrcpy
+// (UHID_CREATE, UHID_DESTROY, GET_CLOCK, VIDEO_FEEDBACK, INJECT_TOUCH_BATCH
+// and PING). The clipboard text must not be compressed.
+//
+// Return the number of bytes consumed (0 for an incomplete msg, -1 on error).
+// On success, the msg must be destroyed by sc_control_msg_destroy().
+ssize_t
+sc_control_msg_deserialize(const uint8_t *buf, size_t len,
+                           struct sc_control_msg *msg);
+
 void
 sc_control_msg_log(const struct sc_control_msg *msg);
 
@@ -127,6 +305,19 @@ sc_control_msg_log(const struct sc_control_msg *msg);
 bool
 sc_control_msg_is_droppable(const struct sc_control_msg *msg);
 
+// Merge msg into prev (a queued message not sent yet) if both are moves of the
+// same pointer with the same buttons: prev becomes (or remains) a touch batch
+// containing all the samples, oldest first
+//
+// The timestamps are the local times when prev (only used if prev is not a
+// batch yet) and msg were pushed.
+//
+// Return false if the messages cannot be merged (prev is left untouched).
+bool
+sc_control_msg_merge_touch(struct sc_control_msg *prev, sc_tick prev_timestamp,
+                           const struct sc_control_msg *msg,
+                           sc_tick timestamp);
+
 void
 sc_control_msg_destroy(struct sc_control_msg *msg);
 
@@ -1,27 +1,49 @@
 #include "controller.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "hid/hid_mouse.h"
+#include "trace.h"
 #include "util/log.h"
+#include "util/str.h"
 
 // Drop droppable events above this limit
 #define SC_CONTROL_MSG_QUEUE_LIMIT 60
-
-static void
-sc_controller_receiver_on_ended(struct sc_receiver *receiver, bool error,
-                                void *userdata) {
-    (void) receiver;
-
-    struct sc_controller *controller = userdata;
-    // Forward the event to the controller listener
-    controller->cbs->on_ended(controller, error, controller->cbs_userdata);
-}
+#define SC_CONTROL_MSG_BULK_QUEUE_LIMIT 8
+
+#define SC_CONTROLLER_CLOCK_REQUEST_INTERVAL SC_TICK_FROM_SEC(1)
+
+// Pools of text payloads: typed texts (small) and pasted chunks
+#define SC_CONTROLLER_TEXT_BLOCK_SIZE \
+    (SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH + 1)
+#define SC_CONTROLLER_TEXT_BLOCK_COUNT 64
+#define SC_CONTROLLER_CHUNK_BLOCK_SIZE \
+    (SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH + 1)
+#define SC_CONTROLLER_CHUNK_BLOCK_COUNT 16
+
+// Maximum number of msgs popped from the queue at once
+#define SC_CONTROLLER_BATCH_MAX 32
+// Large enough to contain at least one msg of maximal size
+#define SC_CONTROLLER_SEND_BUFFER_SIZE (2 * SC_CONTROL_MSG_MAX_SIZE)
+// type: 1 byte; last flag: 1 byte; length: 2 bytes
+#define SC_CONTROLLER_FRAGMENT_MAX_SIZE (4 + SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH)
+
+// The bulk msg being sent in fragments (only accessed from the controller
+// thread)
+struct sc_controller_bulk {
+    uint8_t *buf; // the serialized msg
+    size_t length;
+    size_t offset; // length already sent
+};
 
 bool
 sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
                    const struct sc_controller_callbacks *cbs,
                    void *cbs_userdata) {
     sc_vecdeque_init(&controller->queue);
+    sc_vecdeque_init(&controller->bulk_queue);
 
     // Add 4 to support 4 non-droppable events without re-allocation
     bool ok = sc_vecdeque_reserve(&controller->queue,
@@ -30,40 +52,71 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
         return false;
     }
 
-    static const struct sc_receiver_callbacks receiver_cbs = {
-        .on_ended = sc_controller_receiver_on_ended,
-    };
+    ok = sc_vecdeque_reserve(&controller->bulk_queue,
+                             SC_CONTROL_MSG_BULK_QUEUE_LIMIT);
+    if (!ok) {
+        goto error_destroy_queue;
+    }
 
-    ok = sc_receiver_init(&controller->receiver, control_socket, &receiver_cbs,
-                          controller);
+    ok = sc_slab_init(&controller->text_slab, SC_CONTROLLER_TEXT_BLOCK_SIZE,
+                      SC_CONTROLLER_TEXT_BLOCK_COUNT);
     if (!ok) {
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_bulk_queue;
+    }
+
+    ok = sc_slab_init(&controller->chunk_slab, SC_CONTROLLER_CHUNK_BLOCK_SIZE,
+                      SC_CONTROLLER_CHUNK_BLOCK_COUNT);
+    if (!ok) {
+        goto error_destroy_text_slab;
+    }
+
+    ok = sc_receiver_init(&controller->receiver);
+    if (!ok) {
+        goto error_destroy_chunk_slab;
     }
 
     ok = sc_mutex_init(&controller->mutex);
     if (!ok) {
-        sc_receiver_destroy(&controller->receiver);
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_receiver;
     }
 
-    ok = sc_cond_init(&controller->msg_cond);
+    ok = sc_net_waker_init(&controller->waker);
     if (!ok) {
-        sc_receiver_destroy(&controller->receiver);
-        sc_mutex_destroy(&controller->mutex);
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_mutex;
     }
 
     controller->control_socket = control_socket;
     controller->stopped = false;
+    controller->back_timestamp = 0;
+    controller->clock_sync = false;
+    controller->input_recorder = NULL;
+    controller->clipboard_by_hash = false;
+    controller->compact_input = false;
+    controller->thread_sched = NULL;
+    controller->msgs_metric = NULL;
+    controller->dropped_msgs_metric = NULL;
+    controller->queue_metric = NULL;
 
     assert(cbs && cbs->on_ended);
     controller->cbs = cbs;
     controller->cbs_userdata = cbs_userdata;
 
     return true;
+
+error_destroy_mutex:
+    sc_mutex_destroy(&controller->mutex);
+error_destroy_receiver:
+    sc_receiver_destroy(&controller->receiver);
+error_destroy_chunk_slab:
+    sc_slab_destroy(&controller->chunk_slab);
+error_destroy_text_slab:
+    sc_slab_destroy(&controller->text_slab);
+error_destroy_bulk_queue:
+    sc_vecdeque_destroy(&controller->bulk_queue);
+error_destroy_queue:
+    sc_vecdeque_destroy(&controller->queue);
+
+    return false;
 }
 
 void
@@ -74,21 +127,234 @@ sc_controller_configure(struct sc_controller *controller,
     controller->receiver.uhid_devices = uhid_devices;
 }
 
+void
+sc_controller_set_latency_tracker(struct sc_controller *controller,
+                                  struct sc_latency_tracker *tracker) {
+    assert(tracker);
+    controller->receiver.latency_tracker = tracker;
+    controller->clock_sync = true;
+    controller->next_clock_request = sc_tick_now();
+}
+
+void
+sc_controller_set_input_recorder(struct sc_controller *controller,
+                                 struct sc_input_recorder *recorder) {
+    assert(recorder);
+    controller->input_recorder = recorder;
+}
+
+void
+sc_controller_set_automation(struct sc_controller *controller,
+                             struct sc_automation *automation) {
+    assert(automation);
+    controller->receiver.automation = automation;
+}
+
+void
+sc_controller_set_clipboard_by_hash(struct sc_controller *controller) {
+    controller->clipboard_by_hash = true;
+}
+
+void
+sc_controller_set_compact_input(struct sc_controller *controller) {
+    controller->compact_input = true;
+    sc_control_msg_compact_state_init(&controller->compact_state);
+}
+
+void
+sc_controller_set_thread_sched(struct sc_controller *controller,
+                               const struct sc_thread_sched *sched) {
+    controller->thread_sched = sched;
+}
+
+void
+sc_controller_set_metrics(struct sc_controller *controller,
+                          struct sc_metrics *metrics) {
+    controller->msgs_metric =
+        sc_metrics_register_counter(metrics, "scrcpy_control_msgs_total",
+                                    "Control messages pushed");
+    controller->dropped_msgs_metric =
+        sc_metrics_register_counter(metrics,
+                                    "scrcpy_control_msgs_dropped_total",
+                                    "Control messages dropped (queue full)");
+    controller->queue_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_control_queue_msgs",
+                                  "Control messages queued, not sent yet");
+}
+
+char *
+sc_controller_strndup(struct sc_controller *controller, const char *text,
+                      size_t len) {
+    char *s = NULL;
+    if (len < SC_CONTROLLER_TEXT_BLOCK_SIZE) {
+        s = sc_slab_alloc(&controller->text_slab);
+    } else if (len < SC_CONTROLLER_CHUNK_BLOCK_SIZE) {
+        s = sc_slab_alloc(&controller->chunk_slab);
+    }
+
+    if (!s) {
+        // Too large, or the pool is exhausted
+        s = malloc(len + 1);
+        if (!s) {
+            LOG_OOM();
+            return NULL;
+        }
+    }
+
+    memcpy(s, text, len);
+    s[len] = '\0';
+    return s;
+}
+
+void
+sc_controller_free_text(struct sc_controller *controller, char *text) {
+    if (sc_slab_owns(&controller->text_slab, text)) {
+        sc_slab_free(&controller->text_slab, text);
+    } else if (sc_slab_owns(&controller->chunk_slab, text)) {
+        sc_slab_free(&controller->chunk_slab, text);
+    } else {
+        free(text);
+    }
+}
+
+// Like sc_control_msg_destroy(), but the payload may come from the pools
+static void
+sc_controller_destroy_msg(struct sc_controller *controller,
+                          struct sc_control_msg *msg) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM:
+            sc_controller_free_text(controller, msg->inject_text.text);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
+            sc_controller_free_text(controller, msg->set_clipboard.text);
+            break;
+        default:
+            sc_control_msg_destroy(msg);
+            break;
+    }
+}
+
 void
 sc_controller_destroy(struct sc_controller *controller) {
-    sc_cond_destroy(&controller->msg_cond);
+    sc_net_waker_destroy(&controller->waker);
     sc_mutex_destroy(&controller->mutex);
 
     while (!sc_vecdeque_is_empty(&controller->queue)) {
         struct sc_control_msg *msg = sc_vecdeque_popref(&controller->queue);
         assert(msg);
-        sc_control_msg_destroy(msg);
+        sc_controller_destroy_msg(controller, msg);
     }
     sc_vecdeque_destroy(&controller->queue);
 
+    while (!sc_vecdeque_is_empty(&controller->bulk_queue)) {
+        struct sc_control_msg *msg =
+            sc_vecdeque_popref(&controller->bulk_queue);
+        assert(msg);
+        sc_controller_destroy_msg(controller, msg);
+    }
+    sc_vecdeque_destroy(&controller->bulk_queue);
+
+    sc_slab_destroy(&controller->chunk_slab);
+    sc_slab_destroy(&controller->text_slab);
+
     sc_receiver_destroy(&controller->receiver);
 }
 
+static bool
+is_input_msg(const struct sc_control_msg *msg) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM:
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+        case SC_CONTROL_MSG_TYPE_UHID_INPUT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool
+is_bulk_msg(const struct sc_control_msg *msg) {
+    // Large msgs which are not latency-critical
+    //
+    // UHID_CREATE is not in the bulk lane, because it must not be reordered
+    // with the UHID_INPUT msgs of the same device.
+    return msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD
+        || msg->type == SC_CONTROL_MSG_TYPE_START_APP;
+}
+
+// Merge msg into prev (a queued msg not sent yet) if both are relative
+// motions of the UHID mouse, so that a mouse reporting at a high rate (up to
+// 1000 Hz or more) does not build a backlog while the socket is busy
+static bool
+merge_uhid_mouse_input(struct sc_control_msg *prev,
+                       const struct sc_control_msg *msg) {
+    if (prev->type != SC_CONTROL_MSG_TYPE_UHID_INPUT
+            || msg->type != SC_CONTROL_MSG_TYPE_UHID_INPUT) {
+        return false;
+    }
+
+    struct sc_hid_input prev_input = {
+        .hid_id = prev->uhid_input.id,
+        .size = prev->uhid_input.size,
+    };
+    memcpy(prev_input.data, prev->uhid_input.data, prev->uhid_input.size);
+
+    struct sc_hid_input input = {
+        .hid_id = msg->uhid_input.id,
+        .size = msg->uhid_input.size,
+    };
+    memcpy(input.data, msg->uhid_input.data, msg->uhid_input.size);
+
+    if (!sc_hid_mouse_merge_input(&prev_input, &input)) {
+        return false;
+    }
+
+    memcpy(prev->uhid_input.data, prev_input.data, prev_input.size);
+    return true;
+}
+
+// must be called with mutex locked
+static void
+sc_controller_update_queue_metric(struct sc_controller *controller) {
+    sc_mutex_assert(&controller->mutex);
+
+    if (controller->queue_metric) {
+        size_t size = sc_vecdeque_size(&controller->queue)
+                    + sc_vecdeque_size(&controller->bulk_queue);
+        sc_metric_set(controller->queue_metric, size);
+    }
+}
+
+// Push a ping right after an input event, to measure the input latency
+// must be called with mutex locked
+static void
+sc_controller_push_ping(struct sc_controller *controller, sc_tick input_time) {
+    sc_mutex_assert(&controller->mutex);
+
+    if (sc_vecdeque_size(&controller->queue) >= SC_CONTROL_MSG_QUEUE_LIMIT) {
+        // A ping is droppable
+        return;
+    }
+
+    struct sc_latency_tracker *tracker = controller->receiver.latency_tracker;
+    uint64_t sequence = sc_latency_tracker_start_input_ping(tracker,
+                                                            input_time);
+    if (sequence == SC_SEQUENCE_INVALID) {
+        // A ping is already in flight
+        return;
+    }
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_PING;
+    msg.ping.sequence = sequence;
+    msg.ping.timestamp = 0; // set when it is sent
+    sc_vecdeque_push_noresize(&controller->queue, msg);
+}
+
 bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg) {
@@ -98,14 +364,72 @@ sc_controller_push_msg(struct sc_controller *controller,
 
     bool pushed = false;
 
+    sc_tick now = sc_tick_now();
+
+    if (controller->input_recorder) {
+        sc_input_recorder_record(controller->input_recorder, msg, now);
+    }
+
+    // The device injects the touch and scroll events with their original
+    // spacing, whatever the network jitter
+    struct sc_control_msg stamped;
+    if (msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        stamped = *msg;
+        stamped.inject_touch_event.timestamp = now;
+        msg = &stamped;
+    } else if (msg->type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT) {
+        stamped = *msg;
+        stamped.inject_scroll_event.timestamp = now;
+        msg = &stamped;
+    }
+
     sc_mutex_lock(&controller->mutex);
+
+    if (is_bulk_msg(msg)) {
+        struct sc_control_msg_queue *queue = &controller->bulk_queue;
+        bool was_empty = sc_vecdeque_is_empty(queue);
+        if (sc_vecdeque_size(queue) < SC_CONTROL_MSG_BULK_QUEUE_LIMIT) {
+            sc_vecdeque_push_noresize(queue, *msg);
+            pushed = true;
+        } else if (!sc_control_msg_is_droppable(msg)) {
+            pushed = sc_vecdeque_push(queue, *msg);
+            if (!pushed) {
+                // A non-droppable event must be dropped anyway
+                LOG_OOM();
+            }
+        }
+        // Otherwise, the msg is discarded
+
+        if (pushed && was_empty) {
+            sc_net_waker_wake(&controller->waker);
+        }
+
+        sc_controller_update_queue_metric(controller);
+        sc_mutex_unlock(&controller->mutex);
+        sc_metric_inc(pushed ? controller->msgs_metric
+                             : controller->dropped_msgs_metric);
+        return pushed;
+    }
+
     size_t size = sc_vecdeque_size(&controller->queue);
-    if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
+    if (size && sc_control_msg_merge_touch(sc_vecdeque_back(&controller->queue),
+                                           controller->back_timestamp, msg,
+                                           now)) {
+        // Consecutive moves not sent yet are sent as a single batch, so that
+        // the device receives all the intermediate positions (with their
+        // timing) in one MotionEvent
+        pushed = true;
+    } else if (size && merge_uhid_mouse_input(
+                           sc_vecdeque_back(&controller->queue), msg)) {
+        // Consecutive relative mouse motions not sent yet are sent as a
+        // single report, without losing any motion
+        pushed = true;
+    } else if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
         bool was_empty = sc_vecdeque_is_empty(&controller->queue);
         sc_vecdeque_push_noresize(&controller->queue, *msg);
         pushed = true;
         if (was_empty) {
-            sc_cond_signal(&controller->msg_cond);
+            sc_net_waker_wake(&controller->waker);
         }
     } else if (!sc_control_msg_is_droppable(msg)) {
         bool ok = sc_vecdeque_push(&controller->queue, *msg);
@@ -118,24 +442,196 @@ sc_controller_push_msg(struct sc_controller *controller,
     }
     // Otherwise, the msg is discarded
 
+    if (pushed) {
+        controller->back_timestamp = now;
+        if (controller->clock_sync && is_input_msg(msg)) {
+            sc_controller_push_ping(controller, now);
+        }
+    }
+
+    sc_controller_update_queue_metric(controller);
     sc_mutex_unlock(&controller->mutex);
 
+    sc_metric_inc(pushed ? controller->msgs_metric
+                         : controller->dropped_msgs_metric);
+
     return pushed;
 }
 
 static bool
-process_msg(struct sc_controller *controller,
-            const struct sc_control_msg *msg, bool *eos) {
-    static uint8_t serialized_msg[SC_CONTROL_MSG_MAX_SIZE];
-    size_t length = sc_control_msg_serialize(msg, serialized_msg);
-    if (!length) {
+send_buffer(struct sc_controller *controller, const uint8_t *buf,
+            size_t length) {
+    sc_tick begin = sc_trace_begin();
+    ssize_t w = net_send_all(controller->control_socket, buf, length);
+    sc_trace_end("control_send", begin);
+
+    return w >= 0 && (size_t) w == length;
+}
+
+// Serialize a message at the end of the send buffer, flushing it first if
+// there might not be enough space left
+static bool
+append_msg(struct sc_controller *controller, const struct sc_control_msg *msg,
+           uint8_t *buf, size_t *length, bool *eos) {
+    if (SC_CONTROLLER_SEND_BUFFER_SIZE - *length < SC_CONTROL_MSG_MAX_SIZE) {
+        if (!send_buffer(controller, buf, *length)) {
+            *eos = true;
+            return false;
+        }
+        *length = 0;
+    }
+
+    size_t r = controller->compact_input
+             ? sc_control_msg_serialize_compact(msg, &controller->compact_state,
+                                                &buf[*length])
+             : sc_control_msg_serialize(msg, &buf[*length]);
+    if (!r) {
         *eos = false;
         return false;
     }
 
-    ssize_t w =
-        net_send_all(controller->control_socket, serialized_msg, length);
-    if ((size_t) w != length) {
+    *length += r;
+    return true;
+}
+
+// Replace the clipboard text by its hash if the device clipboard already
+// contains it
+static bool
+replace_clipboard_by_hash(struct sc_controller *controller,
+                          struct sc_control_msg *msg) {
+    assert(msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD);
+
+    const char *text = msg->set_clipboard.text;
+    if (!text) {
+        return false;
+    }
+
+    // Hash the text as it will be received by the device (it may be truncated)
+    size_t len = sc_str_utf8_truncation_index(text,
+                                    SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+    uint64_t hash = sc_str_hash(text, len);
+
+    struct sc_receiver *receiver = &controller->receiver;
+    uint64_t device_hash;
+    bool known = sc_receiver_get_device_clipboard_hash(receiver, &device_hash);
+
+    // In any case, the device clipboard will contain this text
+    sc_receiver_set_device_clipboard_hash(receiver, hash);
+
+    if (len < SC_CLIPBOARD_HASH_MIN_LENGTH || !known || device_hash != hash) {
+        return false;
+    }
+
+    LOGD("Device clipboard unchanged, send its hash only");
+    msg->set_clipboard.by_hash = true;
+    msg->set_clipboard.hash = hash;
+    return true;
+}
+
+// Serialize a bulk msg to be sent in fragments
+static bool
+start_bulk(struct sc_controller *controller, const struct sc_control_msg *msg,
+           struct sc_controller_bulk *bulk) {
+    assert(bulk->offset == bulk->length);
+
+    struct sc_control_msg clipboard;
+    if (msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD
+            && controller->clipboard_by_hash) {
+        clipboard = *msg;
+        if (replace_clipboard_by_hash(controller, &clipboard)) {
+            msg = &clipboard;
+        }
+    }
+
+    size_t r = sc_control_msg_serialize(msg, bulk->buf);
+    if (!r) {
+        return false;
+    }
+
+    bulk->length = r;
+    bulk->offset = 0;
+    return true;
+}
+
+// Append the next part of the bulk msg at the end of the send buffer: the msg
+// itself if it is small enough, or its next fragment
+static bool
+append_bulk(struct sc_controller *controller, struct sc_controller_bulk *bulk,
+            uint8_t *buf, size_t *length, bool *eos) {
+    assert(bulk->offset < bulk->length);
+
+    if (SC_CONTROLLER_SEND_BUFFER_SIZE - *length
+            < SC_CONTROLLER_FRAGMENT_MAX_SIZE) {
+        if (!send_buffer(controller, buf, *length)) {
+            *eos = true;
+            return false;
+        }
+        *length = 0;
+    }
+
+    size_t remaining = bulk->length - bulk->offset;
+    if (!bulk->offset && remaining <= SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH) {
+        // No need to fragment
+        memcpy(&buf[*length], bulk->buf, remaining);
+        *length += remaining;
+        bulk->offset = bulk->length;
+        return true;
+    }
+
+    size_t len = MIN(remaining, SC_CONTROL_MSG_FRAGMENT_MAX_LENGTH);
+    bool last = len == remaining;
+    *length += sc_control_msg_serialize_fragment(&bulk->buf[bulk->offset], len,
+                                                 last, &buf[*length]);
+    bulk->offset += len;
+    return true;
+}
+
+// Serialize all the messages back to back (followed by at most one fragment
+// of the bulk msg, started from bulk_msg if not NULL), then send them at once
+static bool
+process_msgs(struct sc_controller *controller,
+             const struct sc_control_msg *msgs, size_t count,
+             bool clock_request, const struct sc_control_msg *bulk_msg,
+             struct sc_controller_bulk *bulk, uint8_t *buf, bool *eos) {
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const struct sc_control_msg *msg = &msgs[i];
+        struct sc_control_msg ping;
+        if (msg->type == SC_CONTROL_MSG_TYPE_PING) {
+            ping = *msg;
+            // Set the timestamp as late as possible
+            ping.ping.timestamp = sc_tick_now();
+            msg = &ping;
+        }
+
+        if (!append_msg(controller, msg, buf, &length, eos)) {
+            return false;
+        }
+    }
+
+    if (clock_request) {
+        struct sc_control_msg msg;
+        msg.type = SC_CONTROL_MSG_TYPE_GET_CLOCK;
+        // Set the timestamp as late as possible
+        msg.get_clock.timestamp = sc_tick_now();
+        if (!append_msg(controller, &msg, buf, &length, eos)) {
+            return false;
+        }
+    }
+
+    if (bulk_msg && !start_bulk(controller, bulk_msg, bulk)) {
+        *eos = false;
+        return false;
+    }
+
+    if (bulk->offset < bulk->length) {
+        if (!append_bulk(controller, bulk, buf, &length, eos)) {
+            return false;
+        }
+    }
+
+    assert(length);
+    if (!send_buffer(controller, buf, length)) {
         *eos = true;
         return false;
     }
@@ -147,14 +643,40 @@ static int
 run_controller(void *data) {
     struct sc_controller *controller = data;
 
+    sc_thread_apply_sched(controller->thread_sched);
+
     bool error = false;
 
+    uint8_t *buf = malloc(SC_CONTROLLER_SEND_BUFFER_SIZE);
+    if (!buf) {
+        LOG_OOM();
+        error = true;
+        goto end;
+    }
+
+    struct sc_controller_bulk bulk = {
+        .buf = malloc(SC_CONTROL_MSG_MAX_SIZE),
+        .length = 0,
+        .offset = 0,
+    };
+    if (!bulk.buf) {
+        LOG_OOM();
+        free(buf);
+        error = true;
+        goto end;
+    }
+
+    // Discard any partial device msg from a previous connection
+    sc_receiver_reset(&controller->receiver);
+
+    // Wait for the device msgs and for the msgs to send at the same time
+    sc_socket sockets[] = {
+        controller->control_socket,
+        controller->waker.socket,
+    };
+
     for (;;) {
         sc_mutex_lock(&controller->mutex);
-        while (!controller->stopped
-                && sc_vecdeque_is_empty(&controller->queue)) {
-            sc_cond_wait(&controller->msg_cond, &controller->mutex);
-        }
         if (controller->stopped) {
             // stop immediately, do not process further msgs
             sc_mutex_unlock(&controller->mutex);
@@ -162,13 +684,94 @@ run_controller(void *data) {
             break;
         }
 
-        assert(!sc_vecdeque_is_empty(&controller->queue));
-        struct sc_control_msg msg = sc_vecdeque_pop(&controller->queue);
+        sc_tick timeout;
+        if (!sc_vecdeque_is_empty(&controller->queue)
+                || !sc_vecdeque_is_empty(&controller->bulk_queue)
+                || bulk.offset < bulk.length) {
+            // Do not wait, but still receive the available device msgs
+            timeout = 0;
+        } else if (controller->clock_sync) {
+            timeout = controller->next_clock_request - sc_tick_now();
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        } else {
+            timeout = -1;
+        }
         sc_mutex_unlock(&controller->mutex);
 
+        bool readable[ARRAY_LEN(sockets)];
+        int r = net_wait_readable(sockets, readable, ARRAY_LEN(sockets),
+                                  timeout);
+        if (r == -1) {
+            error = true;
+            break;
+        }
+
+        if (readable[1]) {
+            sc_net_waker_reset(&controller->waker);
+        }
+
+        if (readable[0]) {
+            bool recv_error;
+            bool ok = sc_receiver_recv(&controller->receiver,
+                                       controller->control_socket,
+                                       &recv_error);
+            if (!ok) {
+                error = recv_error;
+                break;
+            }
+        }
+
+        sc_mutex_lock(&controller->mutex);
+        if (controller->stopped) {
+            sc_mutex_unlock(&controller->mutex);
+            LOGD("Controller stopped");
+            break;
+        }
+
+        bool clock_request = controller->clock_sync
+                          && sc_tick_now() >= controller->next_clock_request;
+
+        // Drain all the pending msgs at once
+        struct sc_control_msg msgs[SC_CONTROLLER_BATCH_MAX];
+        size_t count = 0;
+        while (count < SC_CONTROLLER_BATCH_MAX
+                && !sc_vecdeque_is_empty(&controller->queue)) {
+            msgs[count++] = sc_vecdeque_pop(&controller->queue);
+        }
+
+        // Preempt the bulk msgs at msg boundaries (or fragment boundaries)
+        struct sc_control_msg bulk_msg;
+        bool has_bulk_msg = bulk.offset == bulk.length
+                         && !sc_vecdeque_is_empty(&controller->bulk_queue);
+        if (has_bulk_msg) {
+            bulk_msg = sc_vecdeque_pop(&controller->bulk_queue);
+        }
+
+        if (clock_request) {
+            controller->next_clock_request =
+                sc_tick_now() + SC_CONTROLLER_CLOCK_REQUEST_INTERVAL;
+        }
+        sc_controller_update_queue_metric(controller);
+        sc_mutex_unlock(&controller->mutex);
+
+        if (!count && !clock_request && !has_bulk_msg
+                && bulk.offset == bulk.length) {
+            // Only device msgs received (or timeout)
+            continue;
+        }
+
         bool eos;
-        bool ok = process_msg(controller, &msg, &eos);
-        sc_control_msg_destroy(&msg);
+        bool ok = process_msgs(controller, msgs, count, clock_request,
+                               has_bulk_msg ? &bulk_msg : NULL, &bulk, buf,
+                               &eos);
+        for (size_t i = 0; i < count; ++i) {
+            sc_controller_destroy_msg(controller, &msgs[i]);
+        }
+        if (has_bulk_msg) {
+            sc_controller_destroy_msg(controller, &bulk_msg);
+        }
         if (!ok) {
             if (eos) {
                 LOGD("Controller stopped (socket closed)");
@@ -178,6 +781,10 @@ run_controller(void *data) {
         }
     }
 
+    free(bulk.buf);
+    free(buf);
+
+end:
     controller->cbs->on_ended(controller, error, controller->cbs_userdata);
 
     return 0;
@@ -194,25 +801,36 @@ sc_controller_start(struct sc_controller *controller) {
         return false;
     }
 
-    if (!sc_receiver_start(&controller->receiver)) {
-        sc_controller_stop(controller);
-        sc_thread_join(&controller->thread, NULL);
-        return false;
+    return true;
+}
+
+bool
+sc_controller_restart(struct sc_controller *controller,
+                      sc_socket control_socket) {
+    // The thread is joined, the pending msgs are sent on the new connection
+    controller->control_socket = control_socket;
+    if (controller->compact_input) {
+        // The new server starts from an empty state
+        sc_control_msg_compact_state_init(&controller->compact_state);
     }
 
-    return true;
+    sc_mutex_lock(&controller->mutex);
+    controller->stopped = false;
+    controller->next_clock_request = sc_tick_now();
+    sc_mutex_unlock(&controller->mutex);
+
+    return sc_controller_start(controller);
 }
 
 void
 sc_controller_stop(struct sc_controller *controller) {
     sc_mutex_lock(&controller->mutex);
     controller->stopped = true;
-    sc_cond_signal(&controller->msg_cond);
+    sc_net_waker_wake(&controller->waker);
     sc_mutex_unlock(&controller->mutex);
 }
 
 void
 sc_controller_join(struct sc_controller *controller) {
     sc_thread_join(&controller->thread, NULL);
-    sc_receiver_join(&controller->receiver);
 }
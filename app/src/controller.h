@@ -6,23 +6,65 @@
 #include <stdbool.h>
 
 #include "control_msg.h"
+#include "input_recorder.h"
+#include "latency_tracker.h"
 #include "receiver.h"
 #include "util/acksync.h"
+#include "util/metrics.h"
 #include "util/net.h"
+#include "util/net_waker.h"
+#include "util/slab.h"
 #include "util/thread.h"
 #include "util/vecdeque.h"
 
 struct sc_control_msg_queue SC_VECDEQUE(struct sc_control_msg);
 
+// A single thread both sends the control msgs and receives the device msgs:
+// it waits for the control socket to be readable or for new msgs to send
+// (signaled by the waker)
 struct sc_controller {
     sc_socket control_socket;
     sc_thread thread;
     sc_mutex mutex;
-    sc_cond msg_cond;
+    struct sc_net_waker waker; // signaled on new msg or stop
     bool stopped;
+    // Two lanes: the latency-critical msgs (input events, etc.) are always
+    // sent first, the bulk msgs (clipboard, etc.) are sent in fragments in
+    // between
     struct sc_control_msg_queue queue;
+    struct sc_control_msg_queue bulk_queue;
+    // Push time of the last msg of the queue
+    sc_tick back_timestamp;
+    // Preallocated blocks for the text payloads of the msgs (typed text and
+    // pasted chunks), to avoid a malloc()/free() pair across threads for
+    // every msg (see sc_controller_strndup())
+    struct sc_slab text_slab;
+    struct sc_slab chunk_slab;
     struct sc_receiver receiver;
 
+    // Periodically request the device clock (to estimate the latency), and
+    // ping the device after input events (to measure the input latency)
+    bool clock_sync;
+    sc_tick next_clock_request;
+
+    struct sc_input_recorder *input_recorder; // may be NULL
+
+    // Send the clipboard texts that the device already contains by hash
+    bool clipboard_by_hash;
+
+    // Encode the touch and scroll events compactly (only accessed from the
+    // controller thread once started)
+    bool compact_input;
+    struct sc_control_msg_compact_state compact_state;
+
+    const struct sc_thread_sched *thread_sched; // may be NULL
+
+    // Control messages pushed and dropped (NULL if metrics are disabled)
+    struct sc_metric *msgs_metric;
+    struct sc_metric *dropped_msgs_metric;
+    // Control messages queued, not sent yet (protected by mutex)
+    struct sc_metric *queue_metric;
+
     const struct sc_controller_callbacks *cbs;
     void *cbs_userdata;
 };
@@ -42,12 +84,88 @@ sc_controller_configure(struct sc_controller *controller,
                         struct sc_acksync *acksync,
                         struct sc_uhid_devices *uhid_devices);
 
+/**
+ * Periodically request the device clock, so that the latency tracker can
+ * convert the device timestamps to local time, and measure the input latency
+ * by pinging the device after input events
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_latency_tracker(struct sc_controller *controller,
+                                  struct sc_latency_tracker *tracker);
+
+/**
+ * Record all the input events pushed to the controller
+ */
+void
+sc_controller_set_input_recorder(struct sc_controller *controller,
+                                 struct sc_input_recorder *recorder);
+
+/**
+ * Forward all the device messages to the automation client
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_automation(struct sc_controller *controller,
+                             struct sc_automation *automation);
+
+/**
+ * Replace the large clipboard texts that the device clipboard already
+ * contains by their hash
+ *
+ * This is only reliable if the device clipboard changes are synchronized to
+ * the computer (otherwise the known device clipboard content may be stale).
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_clipboard_by_hash(struct sc_controller *controller);
+
+/**
+ * Send the touch and scroll events in their compact encoding (see
+ * sc_control_msg_serialize_compact())
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_compact_input(struct sc_controller *controller);
+
+/**
+ * Apply scheduling constraints to the controller thread (which also receives
+ * the device msgs)
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_thread_sched(struct sc_controller *controller,
+                               const struct sc_thread_sched *sched);
+
+/**
+ * Register the controller metrics to the registry
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_metrics(struct sc_controller *controller,
+                          struct sc_metrics *metrics);
+
 void
 sc_controller_destroy(struct sc_controller *controller);
 
 bool
 sc_controller_start(struct sc_controller *controller);
 
+/**
+ * Restart the controller on the socket of a new connection
+ *
+ * It must be called once the controller is stopped and joined.
+ */
+bool
+sc_controller_restart(struct sc_controller *controller,
+                      sc_socket control_socket);
+
 void
 sc_controller_stop(struct sc_controller *controller);
 
@@ -58,4 +176,23 @@ bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg);
 
+/**
+ * Copy len bytes of text (plus a final '\0') as the payload of a msg to push
+ *
+ * The copy is allocated from the controller pools if possible (otherwise by
+ * malloc()). Once the msg is pushed, it is owned by the controller. If the
+ * push fails, it must be released by sc_controller_free_text().
+ *
+ * It may be called from any thread.
+ */
+char *
+sc_controller_strndup(struct sc_controller *controller, const char *text,
+                      size_t len);
+
+/**
+ * Release a payload returned by sc_controller_strndup()
+ */
+void
+sc_controller_free_text(struct sc_controller *controller, char *text);
+
 #endif
@@ -0,0 +1,104 @@
+#include "cpu_governor.h"
+
+#include <assert.h>
+
+#include "util/log.h"
+
+void
+sc_cpu_governor_init(struct sc_cpu_governor *governor, unsigned budget,
+                     struct sc_metrics *metrics) {
+    assert(budget);
+
+    governor->budget = budget;
+    governor->level = SC_CPU_LEVEL_NONE;
+    governor->has_sample = false;
+    governor->last_date = 0;
+    governor->last_cpu_time = 0;
+    governor->over_count = 0;
+    governor->under_count = 0;
+
+    governor->level_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_cpu_governor_level",
+                                  "Degradation step applied to stay within "
+                                  "the CPU budget (0 if none)");
+    governor->usage_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_cpu_usage_percent",
+                                  "CPU usage of the process, in percent of "
+                                  "one core");
+    sc_metric_set(governor->level_metric, SC_CPU_LEVEL_NONE);
+}
+
+static void
+sc_cpu_governor_set_level(struct sc_cpu_governor *governor,
+                          enum sc_cpu_level level, unsigned usage) {
+    LOGI("CPU usage %u%% (budget %u%%): %s", usage, governor->budget,
+         sc_cpu_level_get_name(level));
+    governor->level = level;
+    governor->over_count = 0;
+    governor->under_count = 0;
+    sc_metric_set(governor->level_metric, level);
+}
+
+bool
+sc_cpu_governor_push(struct sc_cpu_governor *governor, sc_tick date,
+                     sc_tick cpu_time) {
+    if (!governor->has_sample) {
+        governor->has_sample = true;
+        governor->last_date = date;
+        governor->last_cpu_time = cpu_time;
+        return false;
+    }
+
+    sc_tick elapsed = date - governor->last_date;
+    if (elapsed <= 0) {
+        return false;
+    }
+
+    sc_tick consumed = cpu_time - governor->last_cpu_time;
+    governor->last_date = date;
+    governor->last_cpu_time = cpu_time;
+
+    unsigned usage = consumed > 0 ? (unsigned) (consumed * 100 / elapsed) : 0;
+    sc_metric_set(governor->usage_metric, usage);
+
+    if (usage > governor->budget) {
+        governor->under_count = 0;
+        if (governor->level < SC_CPU_LEVEL_MAX
+                && ++governor->over_count >= SC_CPU_GOVERNOR_OVER_SAMPLES) {
+            sc_cpu_governor_set_level(governor, governor->level + 1, usage);
+            return true;
+        }
+    } else if (usage * 100 < governor->budget * SC_CPU_GOVERNOR_HEADROOM) {
+        governor->over_count = 0;
+        if (governor->level > SC_CPU_LEVEL_NONE
+                && ++governor->under_count >= SC_CPU_GOVERNOR_UNDER_SAMPLES) {
+            sc_cpu_governor_set_level(governor, governor->level - 1, usage);
+            return true;
+        }
+    } else {
+        // Within budget, but not enough headroom to restore a step
+        governor->over_count = 0;
+        governor->under_count = 0;
+    }
+
+    return false;
+}
+
+const char *
+sc_cpu_level_get_name(enum sc_cpu_level level) {
+    switch (level) {
+        case SC_CPU_LEVEL_NONE:
+            return "full quality";
+        case SC_CPU_LEVEL_SKIP_NONREF:
+            return "skip non-reference frames";
+        case SC_CPU_LEVEL_RENDER_RATE:
+            return "lower render rate";
+        case SC_CPU_LEVEL_MAX_FPS:
+            return "lower device frame rate";
+        case SC_CPU_LEVEL_RESOLUTION:
+            return "lower resolution";
+        default:
+            assert(!"unexpected CPU level");
+            return NULL;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SC_CPU_GOVERNOR_H
+#define SC_CPU_GOVERNOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/metrics.h"
+#include "util/tick.h"
+
+// Interval between two CPU usage samples
+#define SC_CPU_GOVERNOR_PERIOD SC_TICK_FROM_SEC(1)
+// Number of consecutive samples over budget to degrade one more step
+#define SC_CPU_GOVERNOR_OVER_SAMPLES 2
+// Number of consecutive samples with headroom to restore one step
+#define SC_CPU_GOVERNOR_UNDER_SAMPLES 5
+// A sample has headroom if it is below this percentage of the budget
+#define SC_CPU_GOVERNOR_HEADROOM 70
+
+/**
+ * Degradation steps, each one implies the previous ones
+ */
+enum sc_cpu_level {
+    SC_CPU_LEVEL_NONE,
+    // Skip the decoding of the non-reference frames
+    SC_CPU_LEVEL_SKIP_NONREF,
+    // Lower the render rate
+    SC_CPU_LEVEL_RENDER_RATE,
+    // Request the device to lower its frame rate
+    SC_CPU_LEVEL_MAX_FPS,
+    // Request the device to lower the video resolution
+    SC_CPU_LEVEL_RESOLUTION,
+};
+
+#define SC_CPU_LEVEL_MAX SC_CPU_LEVEL_RESOLUTION
+
+/**
+ * Keep the CPU usage of the process within a budget
+ *
+ * It is fed periodically with the CPU time consumed by the process. While the
+ * usage exceeds the budget, it degrades the video one step at a time; once
+ * there is enough headroom again, it restores the steps one at a time. The
+ * hysteresis (more samples are required to restore than to degrade) avoids
+ * oscillating between two steps.
+ *
+ * It only computes the level, the caller applies it. It is not thread-safe.
+ */
+struct sc_cpu_governor {
+    unsigned budget; // in percent of one CPU core
+    enum sc_cpu_level level;
+
+    bool has_sample;
+    sc_tick last_date;
+    sc_tick last_cpu_time;
+
+    unsigned over_count; // consecutive samples over budget
+    unsigned under_count; // consecutive samples with headroom
+
+    struct sc_metric *level_metric; // NULL if metrics are disabled
+    struct sc_metric *usage_metric;
+};
+
+void
+sc_cpu_governor_init(struct sc_cpu_governor *governor, unsigned budget,
+                     struct sc_metrics *metrics);
+
+/**
+ * Push the CPU time consumed by the process so far, measured at `date`
+ *
+ * Return true if the level has changed.
+ */
+bool
+sc_cpu_governor_push(struct sc_cpu_governor *governor, sc_tick date,
+                     sc_tick cpu_time);
+
+const char *
+sc_cpu_level_get_name(enum sc_cpu_level level);
+
+#endif
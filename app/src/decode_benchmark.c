@@ -0,0 +1,186 @@
+#include "decode_benchmark.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+/** Downcast packet sink to sc_decode_benchmark */
+#define DOWNCAST_PACKET(SINK) \
+    container_of(SINK, struct sc_decode_benchmark, packet_sink)
+/** Downcast frame sink to sc_decode_benchmark */
+#define DOWNCAST_FRAME(SINK) \
+    container_of(SINK, struct sc_decode_benchmark, frame_sink)
+
+static int
+compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+// The samples must be sorted
+static double
+get_percentile_ms(const struct sc_decode_benchmark_samples *samples,
+                  unsigned p) {
+    assert(samples->size);
+    assert(p <= 100);
+    size_t index = (samples->size - 1) * p / 100;
+    return (double) samples->data[index] * 1000 / SC_TICK_FREQ;
+}
+
+static void
+sc_decode_benchmark_report(struct sc_decode_benchmark *benchmark) {
+    if (!benchmark->frames) {
+        LOGW("Decode benchmark: no frame decoded");
+        return;
+    }
+
+    struct sc_decode_benchmark_samples *samples = &benchmark->decode_times;
+    assert(samples->size == benchmark->frames);
+
+    sc_tick duration = benchmark->last_frame - benchmark->first_packet;
+    double secs = (double) duration / SC_TICK_FREQ;
+
+    sc_tick total_decode_time = 0;
+    for (size_t i = 0; i < samples->size; ++i) {
+        total_decode_time += samples->data[i];
+    }
+
+    qsort(samples->data, samples->size, sizeof(*samples->data),
+          compare_ticks);
+
+    LOGI("Decode benchmark (%s, %s): %u frames in %.3f s",
+         benchmark->codec_name, benchmark->hwaccel ? "hardware" : "software",
+         benchmark->frames, secs);
+    LOGI("    Resolution:     %dx%d", benchmark->width, benchmark->height);
+    if (duration) {
+        LOGI("    Frame rate:     %.1f fps", benchmark->frames / secs);
+        LOGI("    Bit rate:       %.3f Mbps",
+             benchmark->bytes * 8 / secs / 1000000);
+    }
+    LOGI("    Decoding time:  avg %.2f ms, p50 %.2f ms, p95 %.2f ms, "
+         "p99 %.2f ms, max %.2f ms",
+         (double) total_decode_time * 1000 / SC_TICK_FREQ / samples->size,
+         get_percentile_ms(samples, 50), get_percentile_ms(samples, 95),
+         get_percentile_ms(samples, 99), get_percentile_ms(samples, 100));
+    if (total_decode_time) {
+        // The frame rate is limited by the device, but the decoder could
+        // handle more frames
+        LOGI("    Decoding speed: %.1f fps",
+             (double) benchmark->frames * SC_TICK_FREQ / total_decode_time);
+    }
+}
+
+static bool
+sc_decode_benchmark_packet_sink_open(struct sc_packet_sink *sink,
+                                     AVCodecContext *ctx) {
+    struct sc_decode_benchmark *benchmark = DOWNCAST_PACKET(sink);
+    assert(ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+
+    benchmark->codec_name = ctx->codec->name;
+    benchmark->hwaccel = !!ctx->hw_device_ctx;
+
+    LOGI("Decode benchmark started");
+    return true;
+}
+
+static void
+sc_decode_benchmark_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_decode_benchmark *benchmark = DOWNCAST_PACKET(sink);
+    // The decoder (and its frame sinks) have been closed before, since the
+    // benchmark packet sink has been added first
+    sc_decode_benchmark_report(benchmark);
+}
+
+static bool
+sc_decode_benchmark_packet_sink_push(struct sc_packet_sink *sink,
+                                     const AVPacket *packet) {
+    struct sc_decode_benchmark *benchmark = DOWNCAST_PACKET(sink);
+
+    sc_tick now = sc_tick_now();
+    if (!benchmark->first_packet) {
+        benchmark->first_packet = now;
+    }
+
+    benchmark->bytes += packet->size;
+    // The decoder will receive this packet just after
+    benchmark->decode_start = now;
+
+    return true;
+}
+
+static bool
+sc_decode_benchmark_frame_sink_open(struct sc_frame_sink *sink,
+                                    const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+sc_decode_benchmark_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_decode_benchmark_frame_sink_push(struct sc_frame_sink *sink,
+                                    const AVFrame *frame) {
+    struct sc_decode_benchmark *benchmark = DOWNCAST_FRAME(sink);
+
+    sc_tick now = sc_tick_now();
+    assert(benchmark->first_packet);
+
+    // If a packet produces several frames, measure each one from the
+    // previous frame
+    bool ok = sc_vector_push(&benchmark->decode_times,
+                             now - benchmark->decode_start);
+    if (!ok) {
+        LOG_OOM();
+        return false;
+    }
+
+    benchmark->decode_start = now;
+    benchmark->last_frame = now;
+    benchmark->width = frame->width;
+    benchmark->height = frame->height;
+    ++benchmark->frames;
+
+    // The frame is discarded
+    return true;
+}
+
+void
+sc_decode_benchmark_init(struct sc_decode_benchmark *benchmark) {
+    benchmark->codec_name = NULL;
+    benchmark->hwaccel = false;
+    benchmark->width = 0;
+    benchmark->height = 0;
+    benchmark->first_packet = 0;
+    benchmark->last_frame = 0;
+    benchmark->bytes = 0;
+    benchmark->frames = 0;
+    benchmark->decode_start = 0;
+    sc_vector_init(&benchmark->decode_times);
+
+    static const struct sc_packet_sink_ops packet_sink_ops = {
+        .open = sc_decode_benchmark_packet_sink_open,
+        .close = sc_decode_benchmark_packet_sink_close,
+        .push = sc_decode_benchmark_packet_sink_push,
+    };
+
+    static const struct sc_frame_sink_ops frame_sink_ops = {
+        .open = sc_decode_benchmark_frame_sink_open,
+        .close = sc_decode_benchmark_frame_sink_close,
+        .push = sc_decode_benchmark_frame_sink_push,
+    };
+
+    benchmark->packet_sink.ops = &packet_sink_ops;
+    benchmark->frame_sink.ops = &frame_sink_ops;
+}
+
+void
+sc_decode_benchmark_destroy(struct sc_decode_benchmark *benchmark) {
+    sc_vector_destroy(&benchmark->decode_times);
+}
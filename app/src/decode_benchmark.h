@@ -0,0 +1,54 @@
+#ifndef SC_DECODE_BENCHMARK_H
+#define SC_DECODE_BENCHMARK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "trait/frame_sink.h"
+#include "trait/packet_sink.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+struct sc_decode_benchmark_samples SC_VECTOR(sc_tick);
+
+/**
+ * Measure the video decoding performance, without rendering.
+ *
+ * It must be added as a packet sink of the demuxer before the decoder (so
+ * that it receives each packet just before the decoder), and as a frame sink
+ * of the decoder. It discards the frames.
+ *
+ * The results are printed when the stream ends.
+ *
+ * All the callbacks are called from the demuxer thread.
+ */
+struct sc_decode_benchmark {
+    struct sc_packet_sink packet_sink; // packet sink trait
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    const char *codec_name; // statically allocated by FFmpeg
+    bool hwaccel;
+    int width;
+    int height;
+
+    sc_tick first_packet; // 0 if no packet has been received yet
+    sc_tick last_frame;
+    uint64_t bytes;
+    unsigned frames;
+
+    // Date of the last packet push or frame output, to measure the time spent
+    // in the decoder for each frame
+    sc_tick decode_start;
+    struct sc_decode_benchmark_samples decode_times;
+};
+
+void
+sc_decode_benchmark_init(struct sc_decode_benchmark *benchmark);
+
+void
+sc_decode_benchmark_destroy(struct sc_decode_benchmark *benchmark);
+
+#endif
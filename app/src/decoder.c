@@ -1,14 +1,97 @@
 #include "decoder.h"
 
+#include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <libavcodec/packet.h>
 #include <libavutil/avutil.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/mem.h>
+#include <libswscale/swscale.h>
 
+#include "startup_timing.h"
+#include "trace.h"
 #include "util/log.h"
 
 /** Downcast packet_sink to decoder */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_decoder, packet_sink)
 
+#define SC_DECODER_NONREF_SKIP_PERIOD SC_TICK_FROM_MS(500)
+
+// The device may ignore a request (it rate-limits them), so repeat it while
+// no keyframe is received
+#define SC_DECODER_KEYFRAME_REQUEST_INTERVAL SC_TICK_FROM_SEC(1)
+
+// A buffer allocated by the default allocator, wrapped to be accounted until
+// its last reference is released
+struct sc_decoder_buffer {
+    AVBufferRef *ref; // the wrapped buffer
+    struct sc_decoder *decoder;
+    bool first; // the first buffer of a frame (to count the frames)
+};
+
+static void
+sc_decoder_free_buffer(void *opaque, uint8_t *data) {
+    (void) data;
+    struct sc_decoder_buffer *buffer = opaque;
+    struct sc_decoder *decoder = buffer->decoder;
+
+    sc_metric_add(decoder->memory.bytes_metric, -(int64_t) buffer->ref->size);
+    if (buffer->first) {
+        sc_metric_add(decoder->memory.frames_metric, -1);
+    }
+
+    av_buffer_unref(&buffer->ref);
+    av_free(buffer);
+}
+
+// Called by libavcodec (possibly from its own threads) to allocate the buffers
+// of each decoded frame
+static int
+sc_decoder_get_buffer2(AVCodecContext *ctx, AVFrame *frame, int flags) {
+    struct sc_decoder *decoder = ctx->opaque;
+
+    int r = avcodec_default_get_buffer2(ctx, frame, flags);
+    if (r < 0 || frame->hw_frames_ctx) {
+        // Hardware surfaces are not in system memory
+        return r;
+    }
+
+    for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        AVBufferRef *ref = frame->buf[i];
+
+        struct sc_decoder_buffer *buffer = av_malloc(sizeof(*buffer));
+        if (!buffer) {
+            // The frame is still valid, it is just not accounted
+            break;
+        }
+
+        AVBufferRef *wrapper = av_buffer_create(ref->data, ref->size,
+                                                sc_decoder_free_buffer, buffer,
+                                                0);
+        if (!wrapper) {
+            av_free(buffer);
+            break;
+        }
+
+        buffer->ref = ref;
+        buffer->decoder = decoder;
+        buffer->first = !i;
+        frame->buf[i] = wrapper;
+
+        sc_metric_add(decoder->memory.bytes_metric, ref->size);
+        if (!i) {
+            sc_metric_inc(decoder->memory.frames_metric);
+        }
+    }
+
+    return 0;
+}
+
 static bool
 sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
     decoder->frame = av_frame_alloc();
@@ -17,22 +100,438 @@ sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
         return false;
     }
 
+    decoder->hw_transfer_frame = NULL;
+    decoder->converted_frame = NULL;
+
+    if (ctx->hw_device_ctx) {
+        decoder->hw_transfer_frame = av_frame_alloc();
+        if (!decoder->hw_transfer_frame) {
+            LOG_OOM();
+            goto error_free_frame;
+        }
+    }
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        // The frames may have to be converted (hardware or 10-bit frames)
+        decoder->converted_frame = av_frame_alloc();
+        if (!decoder->converted_frame) {
+            LOG_OOM();
+            goto error_free_hw_transfer_frame;
+        }
+
+        if (!sc_frame_converter_init(&decoder->converter)) {
+            goto error_free_converted_frame;
+        }
+    }
+
     if (!sc_frame_source_sinks_open(&decoder->frame_source, ctx)) {
-        av_frame_free(&decoder->frame);
-        return false;
+        goto error_destroy_converter;
     }
 
     decoder->ctx = ctx;
 
+    decoder->stats.start = sc_tick_now();
+    decoder->stats.total = 0;
+    decoder->stats.max = 0;
+    decoder->stats.count = 0;
+
+    decoder->discarded.count = 0;
+
+    decoder->nonref_skip.active = false;
+    decoder->nonref_skip.applied = false;
+    decoder->nonref_skip.frames = 0;
+    decoder->nonref_skip.start = decoder->stats.start;
+
+    decoder->recovery.waiting = false;
+    decoder->recovery.errors = 0;
+
+    if (decoder->memory.bytes_metric
+            && ctx->codec->capabilities & AV_CODEC_CAP_DR1) {
+        // Account the frame buffers (the decoder threads copy the callback
+        // from the user context before each packet, so it may be set once the
+        // codec is open)
+        ctx->opaque = decoder;
+        ctx->get_buffer2 = sc_decoder_get_buffer2;
+    }
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        sc_startup_timing_mark(SC_STARTUP_PHASE_DECODER_OPEN);
+    }
+
     return true;
+
+error_destroy_converter:
+    if (decoder->converted_frame) {
+        sc_frame_converter_destroy(&decoder->converter);
+    }
+error_free_converted_frame:
+    av_frame_free(&decoder->converted_frame);
+error_free_hw_transfer_frame:
+    av_frame_free(&decoder->hw_transfer_frame);
+error_free_frame:
+    av_frame_free(&decoder->frame);
+
+    return false;
 }
 
 static void
 sc_decoder_close(struct sc_decoder *decoder) {
     sc_frame_source_sinks_close(&decoder->frame_source);
+    if (decoder->converted_frame) {
+        sc_frame_converter_destroy(&decoder->converter);
+    }
+    av_frame_free(&decoder->converted_frame);
+    av_frame_free(&decoder->hw_transfer_frame);
     av_frame_free(&decoder->frame);
 }
 
+static bool
+sc_decoder_convert_frame(struct sc_decoder *decoder, const AVFrame *frame) {
+    AVFrame *out = decoder->converted_frame;
+
+    out->format = AV_PIX_FMT_YUV420P;
+    out->width = frame->width;
+    out->height = frame->height;
+
+    bool ok = sc_frame_converter_convert_frame(&decoder->converter, frame, out,
+                                               SWS_POINT);
+    if (!ok) {
+        LOGE("Decoder '%s': could not convert the pixel format",
+             decoder->name);
+        return false;
+    }
+
+    return true;
+}
+
+// Convert a 10-bit frame to 8 bits by rounding off the least significant bits
+//
+// Unlike a generic swscale conversion, the samples keep their layout (planar
+// or semi-planar), so this is a simple loop over each plane, which the
+// compiler vectorizes.
+static bool
+sc_decoder_reduce_bit_depth(struct sc_decoder *decoder, const AVFrame *frame,
+                            enum AVPixelFormat format, unsigned shift) {
+    AVFrame *out = decoder->converted_frame;
+
+    out->format = format;
+    out->width = frame->width;
+    out->height = frame->height;
+
+    int r = av_frame_get_buffer(out, 0);
+    if (r) {
+        LOG_OOM();
+        return false;
+    }
+
+    r = av_frame_copy_props(out, frame);
+    if (r) {
+        LOG_OOM();
+        av_frame_unref(out);
+        return false;
+    }
+
+    assert(shift);
+    // Round to the nearest value (truncating would bias every sample down by
+    // half a step)
+    unsigned rounding = 1u << (shift - 1);
+
+    bool semi_planar = format == AV_PIX_FMT_NV12;
+    unsigned planes = semi_planar ? 2 : 3;
+    for (unsigned i = 0; i < planes; ++i) {
+        // Number of samples per row and number of rows of the plane
+        int width = frame->width;
+        int height = frame->height;
+        if (i) {
+            // Chroma planes are subsampled (4:2:0)
+            width = semi_planar ? (width + 1) / 2 * 2 : (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+
+        for (int y = 0; y < height; ++y) {
+            const uint16_t *src = (const uint16_t *)
+                (frame->data[i] + (ptrdiff_t) y * frame->linesize[i]);
+            uint8_t *dst = out->data[i] + (ptrdiff_t) y * out->linesize[i];
+            for (int x = 0; x < width; ++x) {
+                unsigned value = (src[x] + rounding) >> shift;
+                // The maximal values would round up to 256
+                dst[x] = value < 255 ? value : 255;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Return true if the frames in this format can be pushed to the sinks as is
+static bool
+sc_decoder_is_output_format(enum AVPixelFormat format) {
+    if (format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P) {
+        // YUVJ420P is YUV420P in full range (the frame color_range is set)
+        return true;
+    }
+
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    // The hardware decoders typically output NV12, which can be uploaded
+    // directly to the screen texture (the other sinks convert it if
+    // necessary)
+    if (format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_NV21) {
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+// Map the hardware frame into system memory, so that the texture can be
+// uploaded directly from the decoder surface, without an intermediate copy.
+//
+// A mapped frame keeps its decoder surface alive as long as it is referenced,
+// but the sinks may retain references to many frames (e.g. the delay buffer).
+// Therefore, only map frames allocated from a dynamic pool (e.g.
+// VideoToolbox); the decoder would run out of surfaces with a fixed-size pool
+// (e.g. VAAPI or D3D11VA).
+static int
+sc_decoder_map_hw_frame(struct sc_decoder *decoder, AVFrame *dst,
+                        const AVFrame *src) {
+    AVHWFramesContext *frames_ctx =
+        (AVHWFramesContext *) src->hw_frames_ctx->data;
+    if (frames_ctx->initial_pool_size) {
+        return AVERROR(ENOSYS);
+    }
+
+    dst->format = frames_ctx->sw_format;
+    int r = av_hwframe_map(dst, src, AV_HWFRAME_MAP_READ);
+    if (r) {
+        LOGD("Decoder '%s': could not map hardware frame: %d",
+             decoder->name, r);
+        // On error, av_hwframe_map() unreferences dst (which resets its
+        // format), so it can be reused for av_hwframe_transfer_data()
+        return r;
+    }
+
+    return 0;
+}
+
+// Return the frame to push to the sinks
+static const AVFrame *
+sc_decoder_prepare_frame(struct sc_decoder *decoder) {
+    AVFrame *frame = decoder->frame;
+    if (decoder->ctx->codec_type != AVMEDIA_TYPE_VIDEO) {
+        return frame;
+    }
+
+    bool hw = frame->hw_frames_ctx;
+    if (hw) {
+        AVFrame *sw_frame = decoder->hw_transfer_frame;
+        int r = sc_decoder_map_hw_frame(decoder, sw_frame, frame);
+        if (r) {
+            // Download the frame from the GPU
+            r = av_hwframe_transfer_data(sw_frame, frame, 0);
+            if (r) {
+                LOGE("Decoder '%s': could not transfer hardware frame: %d",
+                     decoder->name, r);
+                return NULL;
+            }
+        }
+
+        r = av_frame_copy_props(sw_frame, frame);
+        if (r) {
+            LOG_OOM();
+            av_frame_unref(sw_frame);
+            return NULL;
+        }
+
+        frame = sw_frame;
+    }
+    // else software decoding (or the hardware decoder fell back to software
+    // decoding)
+
+    if (sc_decoder_is_output_format(frame->format)) {
+        return frame;
+    }
+
+    // 10-bit streams (e.g. HEVC Main10) are reduced to 8 bits without
+    // changing the layout. The native-endian formats store each sample in a
+    // 16-bit word: in the least significant bits for YUV420P10, in the most
+    // significant bits for P010 (output by the hardware decoders).
+    bool ok;
+    if (frame->format == AV_PIX_FMT_YUV420P10) {
+        ok = sc_decoder_reduce_bit_depth(decoder, frame, AV_PIX_FMT_YUV420P, 2);
+        return ok ? decoder->converted_frame : NULL;
+    }
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    if (frame->format == AV_PIX_FMT_P010) {
+        ok = sc_decoder_reduce_bit_depth(decoder, frame, AV_PIX_FMT_NV12, 8);
+        return ok ? decoder->converted_frame : NULL;
+    }
+#endif
+
+    if (!hw) {
+        // Only the formats deeper than 8 bits are reduced, the other software
+        // frames are pushed as is (the sinks convert them if necessary)
+        return frame;
+    }
+
+    // Convert to a format supported by the sinks
+    ok = sc_decoder_convert_frame(decoder, frame);
+    if (!ok) {
+        return NULL;
+    }
+
+    return decoder->converted_frame;
+}
+
+static void
+sc_decoder_unref_frames(struct sc_decoder *decoder) {
+    av_frame_unref(decoder->frame);
+    if (decoder->hw_transfer_frame) {
+        av_frame_unref(decoder->hw_transfer_frame);
+    }
+    if (decoder->converted_frame) {
+        av_frame_unref(decoder->converted_frame);
+    }
+}
+
+static void
+sc_decoder_add_decode_time(struct sc_decoder *decoder, sc_tick duration) {
+    decoder->stats.total += duration;
+    if (duration > decoder->stats.max) {
+        decoder->stats.max = duration;
+    }
+    ++decoder->stats.count;
+
+    sc_tick now = sc_tick_now();
+    if (now - decoder->stats.start >= SC_TICK_FROM_SEC(1)) {
+        sc_tick avg = decoder->stats.total / decoder->stats.count;
+        LOGV("Decoder '%s': %u frames, decode time avg %" PRItick " us, "
+             "max %" PRItick " us", decoder->name, decoder->stats.count,
+             SC_TICK_TO_US(avg), SC_TICK_TO_US(decoder->stats.max));
+
+        decoder->stats.start = now;
+        decoder->stats.total = 0;
+        decoder->stats.max = 0;
+        decoder->stats.count = 0;
+    }
+}
+
+static void
+sc_decoder_apply_nonref_skip(struct sc_decoder *decoder) {
+    bool requested = atomic_load_explicit(&decoder->nonref_skip.requested,
+                                          memory_order_relaxed);
+    bool skip = decoder->nonref_skip.active || requested;
+    if (skip != decoder->nonref_skip.applied) {
+        decoder->ctx->skip_frame = skip ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        decoder->nonref_skip.applied = skip;
+    }
+}
+
+// Discard the non-reference frames while more than 1 frame out of 4 is skipped
+// by the sinks, and restore full decoding once less than 1 frame out of 20 is
+// skipped
+static void
+sc_decoder_update_nonref_skip(struct sc_decoder *decoder) {
+    assert(decoder->nonref_skip.enabled);
+
+    ++decoder->nonref_skip.frames;
+
+    sc_tick now = sc_tick_now();
+    if (now - decoder->nonref_skip.start < SC_DECODER_NONREF_SKIP_PERIOD) {
+        // A request from the screen is applied immediately
+        sc_decoder_apply_nonref_skip(decoder);
+        return;
+    }
+
+    unsigned frames = decoder->nonref_skip.frames;
+    unsigned skipped = atomic_exchange_explicit(&decoder->nonref_skip.skipped,
+                                                0, memory_order_relaxed);
+
+    bool active = decoder->nonref_skip.active;
+    if (!active && skipped * 4 > frames) {
+        LOGD("Decoder '%s': display falling behind (%u/%u frames skipped), "
+             "skip non-reference frames", decoder->name, skipped, frames);
+        decoder->nonref_skip.active = true;
+    } else if (active && skipped * 20 < frames) {
+        LOGD("Decoder '%s': display keeping up, restore full decoding",
+             decoder->name);
+        decoder->nonref_skip.active = false;
+    }
+
+    sc_decoder_apply_nonref_skip(decoder);
+
+    decoder->nonref_skip.start = now;
+    decoder->nonref_skip.frames = 0;
+}
+
+static void
+sc_decoder_add_discarded(struct sc_decoder *decoder, int64_t pts) {
+    int64_t *array = decoder->discarded.pts;
+    if (decoder->discarded.count == SC_DECODER_DISCARDED_CAPACITY) {
+        // Forget the oldest one (its frame has probably been dropped by
+        // libavcodec)
+        memmove(array, array + 1,
+                (SC_DECODER_DISCARDED_CAPACITY - 1) * sizeof(*array));
+        --decoder->discarded.count;
+    }
+    array[decoder->discarded.count++] = pts;
+}
+
+// Return true if the frame comes from a packet flagged AV_PKT_FLAG_DISCARD
+static bool
+sc_decoder_take_discarded(struct sc_decoder *decoder, int64_t pts) {
+    int64_t *array = decoder->discarded.pts;
+    for (unsigned i = 0; i < decoder->discarded.count; ++i) {
+        if (array[i] == pts) {
+            unsigned remaining = decoder->discarded.count - i - 1;
+            memmove(&array[i], &array[i + 1], remaining * sizeof(*array));
+            --decoder->discarded.count;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+sc_decoder_request_keyframe(struct sc_decoder *decoder, sc_tick now) {
+    assert(decoder->controller);
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME;
+    if (!sc_controller_push_msg(decoder->controller, &msg)) {
+        LOGW("Decoder '%s': could not request a keyframe", decoder->name);
+    }
+
+    decoder->recovery.request_date = now;
+}
+
+// Handle a decoding error: return false if it is fatal
+static bool
+sc_decoder_recover(struct sc_decoder *decoder, const char *error, int ret) {
+    ++decoder->recovery.errors;
+    sc_metric_inc(decoder->recovery.errors_metric);
+
+    if (!decoder->controller && !decoder->recovery.resilient) {
+        LOGE("Decoder '%s': %s: %d", decoder->name, error, ret);
+        return false;
+    }
+
+    LOGW("Decoder '%s': %s: %d, waiting for a keyframe (%" PRIu64 " errors)",
+         decoder->name, error, ret, decoder->recovery.errors);
+
+    // The reference frames are lost, the next frames could not be decoded
+    // correctly until the next keyframe
+    avcodec_flush_buffers(decoder->ctx);
+    decoder->discarded.count = 0;
+    decoder->recovery.waiting = true;
+    if (decoder->controller) {
+        sc_decoder_request_keyframe(decoder, sc_tick_now());
+    }
+    // Otherwise, the device produces keyframes periodically
+
+    return true;
+}
+
 static bool
 sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
     bool is_config = packet->pts == AV_NOPTS_VALUE;
@@ -41,33 +540,92 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
         return true;
     }
 
+    if (decoder->recovery.waiting) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            if (decoder->controller) {
+                sc_tick now = sc_tick_now();
+                if (now - decoder->recovery.request_date
+                        >= SC_DECODER_KEYFRAME_REQUEST_INTERVAL) {
+                    sc_decoder_request_keyframe(decoder, now);
+                }
+            }
+            // Drop the packet
+            return true;
+        }
+
+        LOGI("Decoder '%s': keyframe received, decoding resumed",
+             decoder->name);
+        decoder->recovery.waiting = false;
+    }
+
+    if (packet->flags & AV_PKT_FLAG_DISCARD) {
+        // Depending on the FFmpeg version, such frames are either not output
+        // at all or output as usual: never forward them to the sinks
+        sc_decoder_add_discarded(decoder, packet->pts);
+    }
+
+    sc_tick start = sc_tick_now();
+
+    sc_tick begin = sc_trace_begin();
     int ret = avcodec_send_packet(decoder->ctx, packet);
+    sc_trace_end("avcodec_send_packet", begin);
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
-        LOGE("Decoder '%s': could not send video packet: %d",
-             decoder->name, ret);
-        return false;
+        return sc_decoder_recover(decoder, "could not send video packet", ret);
     }
 
     for (;;) {
+        begin = sc_trace_begin();
         ret = avcodec_receive_frame(decoder->ctx, decoder->frame);
+        sc_trace_end("avcodec_receive_frame", begin);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         }
 
         if (ret) {
-            LOGE("Decoder '%s', could not receive video frame: %d",
-                 decoder->name, ret);
-            return false;
+            return sc_decoder_recover(decoder, "could not receive video frame",
+                                      ret);
         }
 
         // a frame was received
-        bool ok = sc_frame_source_sinks_push(&decoder->frame_source,
-                                             decoder->frame);
-        av_frame_unref(decoder->frame);
+        if (decoder->discarded.count
+                && sc_decoder_take_discarded(decoder, decoder->frame->pts)) {
+            // Decoded only to keep a valid decoder state
+            av_frame_unref(decoder->frame);
+            start = sc_tick_now();
+            continue;
+        }
+
+        const AVFrame *frame = sc_decoder_prepare_frame(decoder);
+        if (!frame) {
+            sc_decoder_unref_frames(decoder);
+            return false;
+        }
+
+        if (decoder->ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            // Measure the time to get the frame, excluding the time spent in
+            // the sinks
+            sc_decoder_add_decode_time(decoder, sc_tick_now() - start);
+
+            if (decoder->nonref_skip.enabled) {
+                sc_decoder_update_nonref_skip(decoder);
+            }
+
+            if (decoder->latency_tracker) {
+                sc_latency_tracker_record(decoder->latency_tracker, frame->pts,
+                                          SC_LATENCY_STAGE_DECODED);
+            }
+
+            sc_startup_timing_mark(SC_STARTUP_PHASE_FIRST_FRAME);
+        }
+
+        bool ok = sc_frame_source_sinks_push(&decoder->frame_source, frame);
+        sc_decoder_unref_frames(decoder);
         if (!ok) {
             // Error already logged
             return false;
         }
+
+        start = sc_tick_now();
     }
 
     return true;
@@ -92,10 +650,22 @@ sc_decoder_packet_sink_push(struct sc_packet_sink *sink,
     return sc_decoder_push(decoder, packet);
 }
 
-void
+bool
 sc_decoder_init(struct sc_decoder *decoder, const char *name) {
+    if (!sc_frame_source_init(&decoder->frame_source)) {
+        return false;
+    }
+
     decoder->name = name; // statically allocated
-    sc_frame_source_init(&decoder->frame_source);
+    decoder->latency_tracker = NULL;
+    decoder->controller = NULL;
+    decoder->recovery.resilient = false;
+    decoder->recovery.errors_metric = NULL;
+    decoder->memory.frames_metric = NULL;
+    decoder->memory.bytes_metric = NULL;
+    decoder->nonref_skip.enabled = false;
+    atomic_init(&decoder->nonref_skip.requested, false);
+    atomic_init(&decoder->nonref_skip.skipped, 0);
 
     static const struct sc_packet_sink_ops ops = {
         .open = sc_decoder_packet_sink_open,
@@ -104,4 +674,66 @@ sc_decoder_init(struct sc_decoder *decoder, const char *name) {
     };
 
     decoder->packet_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_decoder_destroy(struct sc_decoder *decoder) {
+    sc_frame_source_destroy(&decoder->frame_source);
+}
+
+void
+sc_decoder_enable_nonref_skip(struct sc_decoder *decoder) {
+    decoder->nonref_skip.enabled = true;
+}
+
+void
+sc_decoder_request_nonref_skip(struct sc_decoder *decoder, bool skip) {
+    atomic_store_explicit(&decoder->nonref_skip.requested, skip,
+                          memory_order_relaxed);
+}
+
+void
+sc_decoder_set_latency_tracker(struct sc_decoder *decoder,
+                               struct sc_latency_tracker *tracker) {
+    decoder->latency_tracker = tracker;
+}
+
+void
+sc_decoder_set_controller(struct sc_decoder *decoder,
+                          struct sc_controller *controller) {
+    decoder->controller = controller;
+}
+
+void
+sc_decoder_set_resilient(struct sc_decoder *decoder, bool resilient) {
+    decoder->recovery.resilient = resilient;
+}
+
+void
+sc_decoder_set_metrics(struct sc_decoder *decoder, struct sc_metrics *metrics) {
+    char name[SC_METRIC_NAME_MAX];
+    snprintf(name, sizeof(name), "scrcpy_%s_decoder_errors_total",
+             decoder->name);
+    decoder->recovery.errors_metric =
+        sc_metrics_register_counter(metrics, name, "Decoding errors");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_decoder_frames", decoder->name);
+    decoder->memory.frames_metric =
+        sc_metrics_register_gauge(metrics, name,
+                                  "Frames allocated by the decoder and still "
+                                  "referenced");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_decoder_bytes", decoder->name);
+    decoder->memory.bytes_metric =
+        sc_metrics_register_gauge(metrics, name,
+                                  "Bytes of the frames allocated by the "
+                                  "decoder and still referenced");
+}
+
+void
+sc_decoder_report_skipped_frame(struct sc_decoder *decoder) {
+    atomic_fetch_add_explicit(&decoder->nonref_skip.skipped, 1,
+                              memory_order_relaxed);
 }
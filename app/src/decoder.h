@@ -3,10 +3,17 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <libavcodec/avcodec.h>
 
+#include "controller.h"
+#include "frame_converter.h"
+#include "latency_tracker.h"
 #include "trait/frame_source.h"
 #include "trait/packet_sink.h"
+#include "util/metrics.h"
+#include "util/tick.h"
 
 struct sc_decoder {
     struct sc_packet_sink packet_sink; // packet sink trait
@@ -14,12 +21,112 @@ struct sc_decoder {
 
     const char *name; // must be statically allocated (e.g. a string literal)
 
+    struct sc_latency_tracker *latency_tracker; // may be NULL
+    // To request a keyframe on decoding error (may be NULL)
+    struct sc_controller *controller;
+
     AVCodecContext *ctx;
     AVFrame *frame;
+
+    // Only used for hardware-decoded frames
+    AVFrame *hw_transfer_frame; // frame mapped or downloaded from the GPU
+    AVFrame *converted_frame; // frame converted to a format supported by sinks
+    struct sc_frame_converter converter; // only initialized for video
+
+    // Decoding time statistics, logged every second (in verbose mode)
+    struct {
+        sc_tick start;
+        sc_tick total;
+        sc_tick max;
+        unsigned count;
+    } stats;
+
+    // PTS of the last packets flagged AV_PKT_FLAG_DISCARD, whose frames must
+    // not be pushed to the sinks (with frame threading, a frame may be output
+    // after several other packets have been sent)
+    struct {
+#define SC_DECODER_DISCARDED_CAPACITY 16
+        int64_t pts[SC_DECODER_DISCARDED_CAPACITY]; // oldest first
+        unsigned count;
+    } discarded;
+
+    // Skip the non-reference frames while the sinks cannot keep up, or while
+    // the screen requests it (small window in the background)
+    struct {
+        bool enabled;
+        bool active; // the sinks cannot keep up
+        bool applied; // AVDISCARD_NONREF is currently set
+        atomic_bool requested; // requested by the screen (from any thread)
+        atomic_uint skipped; // frames skipped by the sinks (from any thread)
+        unsigned frames; // frames produced during the current period
+        sc_tick start; // start of the current period
+    } nonref_skip;
+
+    // After a decoding error, the packets are dropped until the next keyframe
+    struct {
+        // Recover even without controller (wait for a periodic keyframe)
+        bool resilient;
+        bool waiting;
+        sc_tick request_date; // date of the last keyframe request
+        uint64_t errors; // decoding errors since the decoder is open
+        struct sc_metric *errors_metric; // NULL if metrics are disabled
+    } recovery;
+
+    // Frame buffers allocated by the decoder and still referenced (by the
+    // decoder itself or by the sinks), only accounted if metrics are enabled
+    struct {
+        struct sc_metric *frames_metric;
+        struct sc_metric *bytes_metric;
+    } memory;
 };
 
 // The name must be statically allocated (e.g. a string literal)
-void
+bool
 sc_decoder_init(struct sc_decoder *decoder, const char *name);
 
+void
+sc_decoder_destroy(struct sc_decoder *decoder);
+
+// Enable skipping the non-reference frames while the sinks report skipped
+// frames (must be called before the decoder is opened)
+void
+sc_decoder_enable_nonref_skip(struct sc_decoder *decoder);
+
+// Request to skip the non-reference frames regardless of the sinks (for example
+// while the video is displayed small in a background window), if non-reference
+// frame skipping is enabled
+//
+// It may be called from any thread.
+void
+sc_decoder_request_nonref_skip(struct sc_decoder *decoder, bool skip);
+
+// Record the time when the frames are output (must be called before the
+// decoder is opened)
+void
+sc_decoder_set_latency_tracker(struct sc_decoder *decoder,
+                               struct sc_latency_tracker *tracker);
+
+// Recover from decoding errors by requesting a keyframe to the device, instead
+// of failing (must be called before the decoder is opened)
+void
+sc_decoder_set_controller(struct sc_decoder *decoder,
+                          struct sc_controller *controller);
+
+// Never stop on decoding errors: without controller, wait for the next
+// periodic keyframe (must be called before the decoder is opened)
+void
+sc_decoder_set_resilient(struct sc_decoder *decoder, bool resilient);
+
+// Register the decoder metrics (named after the decoder) to the registry (must
+// be called before the decoder is opened)
+void
+sc_decoder_set_metrics(struct sc_decoder *decoder, struct sc_metrics *metrics);
+
+// Report that a frame produced by the decoder has been skipped by a sink,
+// because it could not keep up
+//
+// It may be called from any thread.
+void
+sc_decoder_report_skipped_frame(struct sc_decoder *decoder);
+
 #endif
@@ -1,6 +1,7 @@
 #include "delay_buffer.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <libavcodec/avcodec.h>
 
@@ -9,12 +10,26 @@
 /** Downcast frame_sink to sc_delay_buffer */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_delay_buffer, frame_sink)
 
+#define SC_DELAY_BUFFER_JITTER_WINDOW SC_TICK_FROM_SEC(5)
+// When the delay shrinks, play 1/20 (5%) faster than real time
+#define SC_DELAY_BUFFER_SHRINK_STRETCH 20
+// Never wait more than this delay for the audio playback to reach a frame
+#define SC_DELAY_BUFFER_AUDIO_MASTER_MAX_WAIT SC_TICK_FROM_SEC(1)
+
+// Must be called with the mutex locked
 static bool
-sc_delayed_frame_init(struct sc_delayed_frame *dframe, const AVFrame *frame) {
-    dframe->frame = av_frame_alloc();
-    if (!dframe->frame) {
-        LOG_OOM();
-        return false;
+sc_delayed_frame_init(struct sc_delay_buffer *db,
+                      struct sc_delayed_frame *dframe, const AVFrame *frame) {
+    sc_mutex_assert(&db->mutex);
+
+    if (db->free_frames.size) {
+        dframe->frame = db->free_frames.data[--db->free_frames.size];
+    } else {
+        dframe->frame = av_frame_alloc();
+        if (!dframe->frame) {
+            LOG_OOM();
+            return false;
+        }
     }
 
     if (av_frame_ref(dframe->frame, frame)) {
@@ -32,79 +47,175 @@ sc_delayed_frame_destroy(struct sc_delayed_frame *dframe) {
     av_frame_free(&dframe->frame);
 }
 
-static int
-run_buffering(void *data) {
-    struct sc_delay_buffer *db = data;
-
-    assert(db->delay > 0);
+// Must be called with the mutex locked
+static void
+sc_delayed_frame_recycle(struct sc_delay_buffer *db,
+                         struct sc_delayed_frame *dframe) {
+    sc_mutex_assert(&db->mutex);
 
-    for (;;) {
-        sc_mutex_lock(&db->mutex);
+    // The frame has already been unreferenced
+    bool ok = sc_vector_push(&db->free_frames, dframe->frame);
+    if (!ok) {
+        // Not fatal, the frame will not be reused
+        av_frame_free(&dframe->frame);
+    }
+}
 
-        while (!db->stopped && sc_vecdeque_is_empty(&db->queue)) {
-            sc_cond_wait(&db->queue_cond, &db->mutex);
-        }
+// Must be called with the mutex locked
+static sc_tick
+sc_delay_buffer_get_deadline(struct sc_delay_buffer *db,
+                             const struct sc_delayed_frame *dframe) {
+    sc_mutex_assert(&db->mutex);
+
+    // PTS (written by the server) are expressed in microseconds
+    sc_tick pts = SC_TICK_FROM_US(dframe->frame->pts);
+
+    sc_tick deadline;
+    sc_tick offset;
+    if (db->audio_master
+            && sc_audio_player_get_clock_offset(db->audio_master, &offset)) {
+        // Present the frame when the audio having the same PTS is played
+        // (immediately if it is already late)
+        deadline = pts - offset;
+    } else {
+        deadline = sc_clock_to_system_time(&db->clock, pts) + db->delay;
+    }
 
-        if (db->stopped) {
-            sc_mutex_unlock(&db->mutex);
-            goto stopped;
-        }
+    sc_tick max_wait = db->audio_master ? SC_DELAY_BUFFER_AUDIO_MASTER_MAX_WAIT
+                                        : db->delay;
+    return MIN(deadline, db->head_date + max_wait);
+}
 
-        struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
+// Called from the timer service thread
+static sc_tick
+sc_delay_buffer_on_timer(struct sc_timer *timer, sc_tick now, void *userdata) {
+    (void) timer;
+    struct sc_delay_buffer *db = userdata;
 
-        sc_tick max_deadline = sc_tick_now() + db->delay;
-        // PTS (written by the server) are expressed in microseconds
-        sc_tick pts = SC_TICK_FROM_US(dframe.frame->pts);
+    assert(db->max_delay > 0);
 
-        bool timed_out = false;
-        while (!db->stopped && !timed_out) {
-            sc_tick deadline = sc_clock_to_system_time(&db->clock, pts)
-                             + db->delay;
-            if (deadline > max_deadline) {
-                deadline = max_deadline;
-            }
+    sc_mutex_lock(&db->mutex);
 
-            timed_out =
-                !sc_cond_timedwait(&db->wait_cond, &db->mutex, deadline);
+    while (!db->stopped && !sc_vecdeque_is_empty(&db->queue)) {
+        struct sc_delayed_frame *head = sc_vecdeque_at(&db->queue, 0);
+        sc_tick deadline = sc_delay_buffer_get_deadline(db, head);
+        if (deadline > now) {
+            sc_mutex_unlock(&db->mutex);
+            return deadline;
         }
 
-        bool stopped = db->stopped;
+        struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
+        db->queue_bytes -= dframe.size;
+        db->head_date = now;
+        sc_metric_set(db->queue_metric, sc_vecdeque_size(&db->queue));
+        sc_metric_set(db->queue_bytes_metric, db->queue_bytes);
         sc_mutex_unlock(&db->mutex);
 
-        if (stopped) {
-            sc_delayed_frame_destroy(&dframe);
-            goto stopped;
-        }
-
 #ifdef SC_BUFFERING_DEBUG
         LOGD("Buffering: %" PRItick ";%" PRItick ";%" PRItick,
-             pts, dframe.push_date, sc_tick_now());
+             SC_TICK_FROM_US(dframe.frame->pts), dframe.push_date,
+             sc_tick_now());
 #endif
 
         bool ok = sc_frame_source_sinks_push(&db->frame_source, dframe.frame);
-        sc_delayed_frame_destroy(&dframe);
+        av_frame_unref(dframe.frame);
+
+        sc_mutex_lock(&db->mutex);
+        sc_delayed_frame_recycle(db, &dframe);
         if (!ok) {
             LOGE("Delayed frame could not be pushed, stopping");
-            sc_mutex_lock(&db->mutex);
             // Prevent to push any new frame
             db->stopped = true;
-            sc_mutex_unlock(&db->mutex);
-            goto stopped;
         }
+
+        // Pushing the frame may take some time
+        now = sc_tick_now();
     }
 
-stopped:
-    assert(db->stopped);
+    sc_mutex_unlock(&db->mutex);
 
-    // Flush queue
-    while (!sc_vecdeque_is_empty(&db->queue)) {
-        struct sc_delayed_frame *dframe = sc_vecdeque_popref(&db->queue);
-        sc_delayed_frame_destroy(dframe);
+    return SC_TIMER_NEVER;
+}
+
+static size_t
+sc_delay_buffer_frame_size(const AVFrame *frame) {
+    size_t size = 0;
+    for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        size += frame->buf[i]->size;
+    }
+    return size;
+}
+
+// Must be called with the mutex locked
+static void
+sc_delay_buffer_make_room(struct sc_delay_buffer *db, size_t size,
+                          sc_tick now) {
+    sc_mutex_assert(&db->mutex);
+
+    while (!sc_vecdeque_is_empty(&db->queue)
+            && (sc_vecdeque_size(&db->queue) >= SC_DELAY_BUFFER_MAX_FRAMES
+                || db->queue_bytes + size > SC_DELAY_BUFFER_MAX_BYTES)) {
+        // Drop the oldest frame
+        struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
+        db->queue_bytes -= dframe.size;
+        db->head_date = now;
+        av_frame_unref(dframe.frame);
+        sc_delayed_frame_recycle(db, &dframe);
+
+        if (!db->dropped++) {
+            LOGW("Delay buffer full, dropping the oldest frames");
+        }
+    }
+}
+
+// Must be called with the mutex locked, after the clock update
+static void
+sc_delay_buffer_adapt(struct sc_delay_buffer *db, sc_tick now, sc_tick pts) {
+    sc_mutex_assert(&db->mutex);
+    assert(db->adaptive);
+
+    // How late the frame arrived, compared to the estimated clock
+    sc_tick lateness = now - sc_clock_to_system_time(&db->clock, pts);
+    if (lateness < 0) {
+        lateness = 0;
+    }
+
+    if (!db->jitter.initialized) {
+        db->jitter.current = lateness;
+        db->jitter.previous = lateness;
+        db->jitter.window_start = now;
+        db->jitter.last_push = now;
+        db->jitter.initialized = true;
+    } else if (now - db->jitter.window_start
+                    >= SC_DELAY_BUFFER_JITTER_WINDOW) {
+        // Start a new window
+        db->jitter.previous = db->jitter.current;
+        db->jitter.current = lateness;
+        db->jitter.window_start = now;
+    } else if (lateness > db->jitter.current) {
+        db->jitter.current = lateness;
+    }
+
+    sc_tick target = MAX(db->jitter.current, db->jitter.previous);
+    target = CLAMP(target, db->min_delay, db->max_delay);
+
+    if (target > db->delay) {
+        // Grow immediately, so that the next late frames do not stutter
+        db->delay = target;
+    } else if (target < db->delay) {
+        // Shrink progressively, so that the playback is time-stretched rather
+        // than skipping
+        sc_tick elapsed = now - db->jitter.last_push;
+        sc_tick step = elapsed / SC_DELAY_BUFFER_SHRINK_STRETCH;
+        db->delay = MAX(db->delay - step, target);
     }
 
-    LOGD("Buffering thread ended");
+    db->jitter.last_push = now;
 
-    return 0;
+#ifdef SC_BUFFERING_DEBUG
+    LOGD("Buffering delay: %" PRItick " (lateness: %" PRItick ")",
+         db->delay, lateness);
+#endif
 }
 
 static bool
@@ -118,27 +229,22 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
         return false;
     }
 
-    ok = sc_cond_init(&db->queue_cond);
-    if (!ok) {
-        goto error_destroy_mutex;
-    }
-
-    ok = sc_cond_init(&db->wait_cond);
-    if (!ok) {
-        goto error_destroy_queue_cond;
-    }
-
     sc_clock_init(&db->clock);
     sc_vecdeque_init(&db->queue);
+    sc_vector_init(&db->free_frames);
+    db->queue_bytes = 0;
+    db->head_date = 0;
+    db->dropped = 0;
     db->stopped = false;
+    db->jitter.initialized = false;
 
     if (!sc_frame_source_sinks_open(&db->frame_source, ctx)) {
-        goto error_destroy_wait_cond;
+        goto error_destroy_mutex;
     }
 
-    ok = sc_thread_create(&db->thread, run_buffering, "scrcpy-dbuf", db);
+    ok = sc_timer_service_add(db->timer_service, &db->timer,
+                              sc_delay_buffer_on_timer, db);
     if (!ok) {
-        LOGE("Could not start buffering thread");
         goto error_close_sinks;
     }
 
@@ -146,10 +252,6 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
 
 error_close_sinks:
     sc_frame_source_sinks_close(&db->frame_source);
-error_destroy_wait_cond:
-    sc_cond_destroy(&db->wait_cond);
-error_destroy_queue_cond:
-    sc_cond_destroy(&db->queue_cond);
 error_destroy_mutex:
     sc_mutex_destroy(&db->mutex);
 
@@ -162,16 +264,29 @@ sc_delay_buffer_frame_sink_close(struct sc_frame_sink *sink) {
 
     sc_mutex_lock(&db->mutex);
     db->stopped = true;
-    sc_cond_signal(&db->queue_cond);
-    sc_cond_signal(&db->wait_cond);
     sc_mutex_unlock(&db->mutex);
 
-    sc_thread_join(&db->thread, NULL);
+    // Wait for the timer callback to return, if it is running
+    sc_timer_service_remove(db->timer_service, &db->timer);
 
     sc_frame_source_sinks_close(&db->frame_source);
 
-    sc_cond_destroy(&db->wait_cond);
-    sc_cond_destroy(&db->queue_cond);
+    if (db->dropped) {
+        LOGW("Delay buffer full: %" PRIu64 " frames dropped", db->dropped);
+    }
+
+    // Flush queue
+    while (!sc_vecdeque_is_empty(&db->queue)) {
+        struct sc_delayed_frame *dframe = sc_vecdeque_popref(&db->queue);
+        sc_delayed_frame_destroy(dframe);
+    }
+    sc_vecdeque_destroy(&db->queue);
+
+    for (size_t i = 0; i < db->free_frames.size; ++i) {
+        av_frame_free(&db->free_frames.data[i]);
+    }
+    sc_vector_destroy(&db->free_frames);
+
     sc_mutex_destroy(&db->mutex);
 }
 
@@ -188,48 +303,79 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
     }
 
     sc_tick pts = SC_TICK_FROM_US(frame->pts);
-    sc_clock_update(&db->clock, sc_tick_now(), pts);
-    sc_cond_signal(&db->wait_cond);
+    sc_tick now = sc_tick_now();
+    sc_clock_update(&db->clock, now, pts);
+    if (db->adaptive) {
+        sc_delay_buffer_adapt(db, now, pts);
+    }
 
     if (db->first_frame_asap && db->clock.range == 1) {
         sc_mutex_unlock(&db->mutex);
         return sc_frame_source_sinks_push(&db->frame_source, frame);
     }
 
+    size_t size = sc_delay_buffer_frame_size(frame);
+    sc_delay_buffer_make_room(db, size, now);
+
     struct sc_delayed_frame dframe;
-    bool ok = sc_delayed_frame_init(&dframe, frame);
+    bool ok = sc_delayed_frame_init(db, &dframe, frame);
     if (!ok) {
         sc_mutex_unlock(&db->mutex);
         return false;
     }
+    dframe.size = size;
 
 #ifdef SC_BUFFERING_DEBUG
-    dframe.push_date = sc_tick_now();
+    dframe.push_date = now;
 #endif
 
+    bool was_empty = sc_vecdeque_is_empty(&db->queue);
     ok = sc_vecdeque_push(&db->queue, dframe);
     if (!ok) {
+        sc_delayed_frame_destroy(&dframe);
         sc_mutex_unlock(&db->mutex);
         LOG_OOM();
         return false;
     }
 
-    sc_cond_signal(&db->queue_cond);
+    db->queue_bytes += size;
+    if (was_empty) {
+        db->head_date = now;
+    }
+    // The frames dropped by sc_delay_buffer_make_room() are accounted here
+    sc_metric_set(db->queue_metric, sc_vecdeque_size(&db->queue));
+    sc_metric_set(db->queue_bytes_metric, db->queue_bytes);
 
     sc_mutex_unlock(&db->mutex);
 
+    // The clock has been updated, so the deadline of the head frame must be
+    // computed again
+    sc_timer_service_schedule(db->timer_service, &db->timer, now);
+
     return true;
 }
 
-void
-sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
-                     bool first_frame_asap) {
-    assert(delay > 0);
+static bool
+sc_delay_buffer_init_internal(struct sc_delay_buffer *db,
+                              struct sc_timer_service *timer_service,
+                              sc_tick min_delay, sc_tick max_delay,
+                              bool first_frame_asap) {
+    assert(max_delay > 0);
+    assert(min_delay <= max_delay);
+
+    if (!sc_frame_source_init(&db->frame_source)) {
+        return false;
+    }
 
-    db->delay = delay;
+    db->timer_service = timer_service;
+    db->delay = min_delay;
     db->first_frame_asap = first_frame_asap;
-
-    sc_frame_source_init(&db->frame_source);
+    db->adaptive = min_delay != max_delay;
+    db->min_delay = min_delay;
+    db->max_delay = max_delay;
+    db->audio_master = NULL;
+    db->queue_metric = NULL;
+    db->queue_bytes_metric = NULL;
 
     static const struct sc_frame_sink_ops ops = {
         .open = sc_delay_buffer_frame_sink_open,
@@ -238,4 +384,48 @@ sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
     };
 
     db->frame_sink.ops = &ops;
+
+    return true;
+}
+
+bool
+sc_delay_buffer_init(struct sc_delay_buffer *db,
+                     struct sc_timer_service *timer_service, sc_tick delay,
+                     bool first_frame_asap) {
+    return sc_delay_buffer_init_internal(db, timer_service, delay, delay,
+                                         first_frame_asap);
+}
+
+bool
+sc_delay_buffer_init_adaptive(struct sc_delay_buffer *db,
+                              struct sc_timer_service *timer_service,
+                              sc_tick min_delay, sc_tick max_delay,
+                              bool first_frame_asap) {
+    assert(min_delay < max_delay);
+    return sc_delay_buffer_init_internal(db, timer_service, min_delay,
+                                         max_delay, first_frame_asap);
+}
+
+void
+sc_delay_buffer_destroy(struct sc_delay_buffer *db) {
+    sc_frame_source_destroy(&db->frame_source);
+}
+
+void
+sc_delay_buffer_set_audio_master(struct sc_delay_buffer *db,
+                                 struct sc_audio_player *audio_master) {
+    assert(audio_master);
+    db->audio_master = audio_master;
+}
+
+void
+sc_delay_buffer_set_metrics(struct sc_delay_buffer *db,
+                            struct sc_metrics *metrics) {
+    db->queue_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_video_buffer_frames",
+                                  "Frames queued in the video buffer");
+    db->queue_bytes_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_video_buffer_bytes",
+                                  "Bytes of the frames queued in the video "
+                                  "buffer");
 }
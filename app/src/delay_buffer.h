@@ -4,44 +4,88 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libavutil/frame.h>
 
+#include "audio_player.h"
 #include "clock.h"
+#include "timer_service.h"
 #include "trait/frame_source.h"
 #include "trait/frame_sink.h"
+#include "util/metrics.h"
 #include "util/thread.h"
 #include "util/tick.h"
 #include "util/vecdeque.h"
+#include "util/vector.h"
 
 //#define SC_BUFFERING_DEBUG // uncomment to debug
 
 // forward declarations
 typedef struct AVFrame AVFrame;
 
+// The delayed frames are dropped (the oldest first) beyond these limits
+#define SC_DELAY_BUFFER_MAX_FRAMES 512
+#define SC_DELAY_BUFFER_MAX_BYTES (512 * 1024 * 1024)
+
 struct sc_delayed_frame {
     AVFrame *frame;
+    size_t size; // in bytes
 #ifdef SC_BUFFERING_DEBUG
     sc_tick push_date;
 #endif
 };
 
 struct sc_delayed_frame_queue SC_VECDEQUE(struct sc_delayed_frame);
+struct sc_frame_ptr_vec SC_VECTOR(AVFrame *);
 
 struct sc_delay_buffer {
     struct sc_frame_source frame_source; // frame source trait
     struct sc_frame_sink frame_sink; // frame sink trait
 
-    sc_tick delay;
+    sc_tick delay; // protected by mutex if adaptive
     bool first_frame_asap;
 
-    sc_thread thread;
+    // If adaptive, the delay varies between min_delay and max_delay, to
+    // follow the measured jitter
+    bool adaptive;
+    sc_tick min_delay;
+    sc_tick max_delay;
+
+    // Maximum lateness of the frames (compared to the clock estimation) over
+    // the current and the previous windows (protected by mutex)
+    struct {
+        sc_tick current;
+        sc_tick previous;
+        sc_tick window_start;
+        sc_tick last_push;
+        bool initialized;
+    } jitter;
+
+    // If set, the frames are presented when the audio samples having the
+    // same PTS are played (the audio playback is the master clock)
+    struct sc_audio_player *audio_master;
+
+    // The delayed frames are released from the timer service thread, so the
+    // sinks must only hand them over (screen, frame pacer or frame queue)
+    struct sc_timer_service *timer_service;
+    struct sc_timer timer;
+
     sc_mutex mutex;
-    sc_cond queue_cond;
-    sc_cond wait_cond;
 
     struct sc_clock clock;
     struct sc_delayed_frame_queue queue;
+    size_t queue_bytes;
+    // The date the frame at the head of the queue became the head
+    sc_tick head_date;
+    uint64_t dropped;
+    // Empty frames to reuse, to avoid an allocation for every delayed frame
+    struct sc_frame_ptr_vec free_frames;
     bool stopped;
+
+    // Frames and bytes queued (NULL if metrics are disabled)
+    struct sc_metric *queue_metric;
+    struct sc_metric *queue_bytes_metric;
 };
 
 struct sc_delay_buffer_callbacks {
@@ -52,12 +96,57 @@ struct sc_delay_buffer_callbacks {
 /**
  * Initialize a delay buffer.
  *
+ * \param timer_service the service releasing the delayed frames
  * \param delay a (strictly) positive delay
  * \param first_frame_asap if true, do not delay the first frame (useful for
                            a video stream).
  */
-void
-sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
+bool
+sc_delay_buffer_init(struct sc_delay_buffer *db,
+                     struct sc_timer_service *timer_service, sc_tick delay,
                      bool first_frame_asap);
 
+/**
+ * Initialize an adaptive delay buffer.
+ *
+ * The delay grows immediately when a frame arrives later than the current
+ * delay allows, and shrinks progressively (by playing slightly faster) when
+ * the jitter decreases.
+ *
+ * \param timer_service the service releasing the delayed frames
+ * \param min_delay the minimal delay (may be 0)
+ * \param max_delay the maximal delay, greater than min_delay
+ * \param first_frame_asap if true, do not delay the first frame
+ */
+bool
+sc_delay_buffer_init_adaptive(struct sc_delay_buffer *db,
+                              struct sc_timer_service *timer_service,
+                              sc_tick min_delay, sc_tick max_delay,
+                              bool first_frame_asap);
+
+void
+sc_delay_buffer_destroy(struct sc_delay_buffer *db);
+
+/**
+ * Synchronize the frames to the audio playback.
+ *
+ * Until the audio playback clock is known, the frames are delayed as
+ * configured on initialization.
+ *
+ * It must be called before the delay buffer is opened.
+ */
+void
+sc_delay_buffer_set_audio_master(struct sc_delay_buffer *db,
+                                 struct sc_audio_player *audio_master);
+
+/**
+ * Register the video buffer metrics to the registry
+ *
+ * It must be called before the delay buffer is opened, and only for the video
+ * buffer (the metric names are fixed).
+ */
+void
+sc_delay_buffer_set_metrics(struct sc_delay_buffer *db,
+                            struct sc_metrics *metrics);
+
 #endif
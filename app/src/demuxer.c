@@ -2,19 +2,36 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
 #include <libavutil/channel_layout.h>
 
+#include "hwaccel.h"
 #include "packet_merger.h"
+#include "startup_timing.h"
+#include "trace.h"
 #include "util/binary.h"
+#include "util/file.h"
 #include "util/log.h"
 
-#define SC_PACKET_HEADER_SIZE 12
+// Large enough to receive many small packets (and their headers) at once
+#define SC_DEMUXER_READ_BUFFER_SIZE (64 * 1024)
 
-#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
-#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+// With send_frame_timestamp=true, the device timestamp is appended
+#define SC_PACKET_HEADER_MAX_SIZE (SC_PACKET_HEADER_SIZE + 8)
 
-#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
+// Lag behind the device from which the backlog is dropped
+#define SC_DEMUXER_CATCH_UP_THRESHOLD SC_TICK_FROM_MS(200)
+
+// Delay before requesting a keyframe again if it has not been received
+#define SC_DEMUXER_CATCH_UP_KEYFRAME_RETRY SC_TICK_FROM_SEC(1)
+
+// Size of the buffers of the first packet pool (each next pool has buffers 4
+// times larger)
+#define SC_PACKET_POOL_MIN_SIZE (1 << 10)
 
 static enum AVCodecID
 sc_demuxer_to_avcodec_id(uint32_t codec_id) {
@@ -54,7 +71,7 @@ sc_demuxer_to_avcodec_id(uint32_t codec_id) {
 static bool
 sc_demuxer_recv_codec_id(struct sc_demuxer *demuxer, uint32_t *codec_id) {
     uint8_t data[4];
-    ssize_t r = net_recv_all(demuxer->socket, data, 4);
+    ssize_t r = sc_net_reader_recv_all(&demuxer->reader, data, 4);
     if (r < 4) {
         return false;
     }
@@ -67,7 +84,7 @@ static bool
 sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
                            uint32_t *height) {
     uint8_t data[8];
-    ssize_t r = net_recv_all(demuxer->socket, data, 8);
+    ssize_t r = sc_net_reader_recv_all(&demuxer->reader, data, 8);
     if (r < 8) {
         return false;
     }
@@ -77,8 +94,120 @@ sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
     return true;
 }
 
+// Allocate the packet data from a buffer pool, to avoid a heap allocation for
+// every packet
+//
+// The buffer is taken from the pool with the smallest buffers large enough,
+// so that small packets (typically audio) do not retain large buffers. The
+// packets larger than the buffers of the last pool (rare, large keyframes)
+// are allocated individually.
+//
+// The packet data starts after headroom bytes, so that the packet merger can
+// prepend a config packet in place.
+static bool
+sc_demuxer_alloc_packet(struct sc_demuxer *demuxer, AVPacket *packet,
+                        uint32_t len, size_t headroom) {
+    size_t size = headroom + len + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    unsigned i = 0;
+    size_t pool_size = SC_PACKET_POOL_MIN_SIZE;
+    while (i < SC_DEMUXER_PACKET_POOL_COUNT && pool_size < size) {
+        ++i;
+        pool_size *= 4;
+    }
+
+    AVBufferRef *buf;
+    if (i < SC_DEMUXER_PACKET_POOL_COUNT) {
+        AVBufferPool **pool = &demuxer->packet_pools[i];
+        if (!*pool) {
+            *pool = av_buffer_pool_init(pool_size, NULL);
+            if (!*pool) {
+                LOG_OOM();
+                return false;
+            }
+        }
+
+        buf = av_buffer_pool_get(*pool);
+    } else {
+        buf = av_buffer_alloc(size);
+    }
+
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    // The padding must be zeroed (the buffer may be reused)
+    memset(buf->data + headroom + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    // The packet is unreferenced, so its other fields have default values
+    packet->buf = buf;
+    packet->data = buf->data + headroom;
+    packet->size = len;
+    return true;
+}
+
+static void
+sc_demuxer_request_keyframe(struct sc_demuxer *demuxer) {
+    demuxer->catch_up.keyframe_request_date = sc_tick_now();
+
+    if (!demuxer->catch_up.controller) {
+        return;
+    }
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME;
+    if (!sc_controller_push_msg(demuxer->catch_up.controller, &msg)) {
+        LOGW("Could not request a keyframe");
+    }
+}
+
+// Return true if the packet must be dropped to catch up with the device
+static bool
+sc_demuxer_catch_up(struct sc_demuxer *demuxer, const AVPacket *packet) {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packets are never dropped
+        return false;
+    }
+
+    sc_tick lag = demuxer->catch_up.lag;
+
+    if (!demuxer->catch_up.active) {
+        if (lag < SC_DEMUXER_CATCH_UP_THRESHOLD) {
+            return false;
+        }
+
+        LOGI("Demuxer '%s': %" PRItick " ms behind, catching up",
+             demuxer->name, SC_TICK_TO_MS(lag));
+        demuxer->catch_up.active = true;
+        demuxer->catch_up.dropped = 0;
+        // The requested keyframe is received after the backlog
+        sc_demuxer_request_keyframe(demuxer);
+    }
+
+    // Resume on a keyframe, since the next packets may not reference the
+    // dropped ones (with hysteresis, to avoid dropping again immediately)
+    if ((packet->flags & AV_PKT_FLAG_KEY)
+            && lag < SC_DEMUXER_CATCH_UP_THRESHOLD / 2) {
+        LOGI("Demuxer '%s': caught up (%" PRIu32 " packets dropped)",
+             demuxer->name, demuxer->catch_up.dropped);
+        demuxer->catch_up.active = false;
+        return false;
+    }
+
+    if (sc_tick_now() - demuxer->catch_up.keyframe_request_date
+            >= SC_DEMUXER_CATCH_UP_KEYFRAME_RETRY) {
+        // The requested keyframe was itself received late
+        sc_demuxer_request_keyframe(demuxer);
+    }
+
+    ++demuxer->catch_up.dropped;
+    return true;
+}
+
 static bool
-sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
+sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet,
+                       size_t headroom) {
     // The video and audio streams contain a sequence of raw packets (as
     // provided by MediaCodec), each prefixed with a "meta" header.
     //
@@ -88,33 +217,50 @@ sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     //        PTS        packet        raw packet
     //                    size
     //
+    // If a latency tracker is set, the server sends an additional 8-byte
+    // field (so the "meta" header length is 20 bytes):
+    // [. . . . . . . .|. . . .|. . . . . . . .]. . . . . . . . . . . ...
+    //  <-------------> <-----> <-------------> <-------------------...
+    //        PTS        packet  device time in     raw packet
+    //                    size   microseconds
+    //
     // It is followed by <packet_size> bytes containing the packet/frame.
     //
     // The most significant bits of the PTS are used for packet flags:
     //
     //  byte 7   byte 6   byte 5   byte 4   byte 3   byte 2   byte 1   byte 0
-    // CK...... ........ ........ ........ ........ ........ ........ ........
-    // ^^<------------------------------------------------------------------->
-    // ||                                PTS
-    // | `- key frame
-    //  `-- config packet
-
-    uint8_t header[SC_PACKET_HEADER_SIZE];
-    ssize_t r = net_recv_all(demuxer->socket, header, SC_PACKET_HEADER_SIZE);
-    if (r < SC_PACKET_HEADER_SIZE) {
+    // CKR..... ........ ........ ........ ........ ........ ........ ........
+    // ^^^<------------------------------------------------------------------>
+    // |||                                PTS
+    // || `- repeated frame (unchanged picture)
+    // | `-- key frame
+    //  `--- config packet
+
+    size_t header_size = demuxer->latency_tracker ? SC_PACKET_HEADER_MAX_SIZE
+                                                  : SC_PACKET_HEADER_SIZE;
+
+    uint8_t header[SC_PACKET_HEADER_MAX_SIZE];
+    ssize_t r = sc_net_reader_recv_all(&demuxer->reader, header, header_size);
+    if (r < 0 || (size_t) r < header_size) {
         return false;
     }
 
+    sc_tick header_date = demuxer->reader.recv_date;
+
     uint64_t pts_flags = sc_read64be(header);
     uint32_t len = sc_read32be(&header[8]);
     assert(len);
 
-    if (av_new_packet(packet, len)) {
-        LOG_OOM();
+    if (pts_flags & SC_PACKET_FLAG_CONFIG) {
+        // Nothing is prepended to a config packet
+        headroom = 0;
+    }
+
+    if (!sc_demuxer_alloc_packet(demuxer, packet, len, headroom)) {
         return false;
     }
 
-    r = net_recv_all(demuxer->socket, packet->data, len);
+    r = sc_net_reader_recv_all(&demuxer->reader, packet->data, len);
     if (r < 0 || ((uint32_t) r) < len) {
         av_packet_unref(packet);
         return false;
@@ -123,30 +269,209 @@ sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     if (pts_flags & SC_PACKET_FLAG_CONFIG) {
         packet->pts = AV_NOPTS_VALUE;
     } else {
-        packet->pts = pts_flags & SC_PACKET_PTS_MASK;
+        int64_t pts = pts_flags & SC_PACKET_PTS_MASK;
+        if (demuxer->resume_date) {
+            // First packet after a reconnection: the PTS of the new device
+            // stream restart from 0, so continue after the last PTS, as if the
+            // stream had been paused during the disconnection
+            sc_tick paused = sc_tick_now() - demuxer->resume_date;
+            int64_t last_pts = demuxer->last_pts != AV_NOPTS_VALUE
+                             ? demuxer->last_pts : 0;
+            demuxer->pts_offset = last_pts + SC_TICK_TO_US(paused) - pts;
+            demuxer->resume_date = 0;
+        }
+        packet->pts = pts + demuxer->pts_offset;
+        demuxer->last_pts = packet->pts;
+        if (demuxer->clock) {
+            sc_stream_clock_update(demuxer->clock, demuxer->clock_source,
+                                   header_date, packet->pts);
+            if (demuxer->catch_up.enabled) {
+                demuxer->catch_up.lag =
+                    sc_stream_clock_get_lag(demuxer->clock,
+                                            demuxer->clock_source, header_date,
+                                            packet->pts);
+            }
+        }
+        if (demuxer->latency_tracker) {
+            // The header has been received at the same time as the start of
+            // the packet
+            sc_latency_tracker_record_arrival(demuxer->latency_tracker,
+                                              packet->pts, header_date);
+            sc_latency_tracker_record(demuxer->latency_tracker, packet->pts,
+                                      SC_LATENCY_STAGE_RECEIVED);
+            sc_latency_tracker_record_device_time(demuxer->latency_tracker,
+                                                  packet->pts,
+                                                  sc_read64be(&header[12]));
+        }
     }
 
     if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
         packet->flags |= AV_PKT_FLAG_KEY;
     }
 
+    if (demuxer->skip_repeated_frames
+            && (pts_flags & SC_PACKET_FLAG_REPEATED)) {
+        // The frame must still be decoded, since the next frames may
+        // reference it
+        packet->flags |= AV_PKT_FLAG_DISCARD;
+    }
+
     packet->dts = packet->pts;
     return true;
 }
 
+static void
+sc_demuxer_count_packet(struct sc_demuxer *demuxer, const AVPacket *packet) {
+    bool config = packet->pts == AV_NOPTS_VALUE;
+    bool keyframe = !config && (packet->flags & AV_PKT_FLAG_KEY);
+    uint32_t size = packet->size;
+
+    sc_stream_stats_add_packet(&demuxer->stats, size, config, keyframe);
+
+    sc_metric_inc(demuxer->packets_metric);
+    sc_metric_add(demuxer->bytes_metric, size);
+    if (config) {
+        sc_metric_inc(demuxer->config_packets_metric);
+    } else if (keyframe) {
+        sc_metric_inc(demuxer->keyframes_metric);
+        sc_metric_add(demuxer->keyframe_bytes_metric, size);
+        sc_metric_observe(demuxer->keyframe_size_metric, size);
+    }
+
+    if (demuxer->bitrate_metric) {
+        sc_tick now = sc_tick_now();
+        if (!demuxer->bitrate_date) {
+            demuxer->bitrate_date = now;
+        }
+        demuxer->bitrate_bytes += size;
+
+        sc_tick elapsed = now - demuxer->bitrate_date;
+        if (elapsed >= SC_TICK_FROM_SEC(1)) {
+            uint32_t kbps =
+                sc_stream_stats_to_kbps(demuxer->bitrate_bytes, elapsed);
+            sc_metric_set(demuxer->bitrate_metric, kbps);
+            demuxer->bitrate_date = now;
+            demuxer->bitrate_bytes = 0;
+        }
+    }
+}
+
+// Continue the stream on the socket of a new connection, without closing the
+// sinks
+static bool
+sc_demuxer_resume(struct sc_demuxer *demuxer, uint32_t raw_codec_id,
+                  bool video, enum sc_demuxer_status *status) {
+    sc_tick eos_date = sc_tick_now();
+
+    LOGD("Demuxer '%s': waiting for reconnection", demuxer->name);
+    sc_socket socket = demuxer->cbs->on_eos(demuxer, demuxer->cbs_userdata);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    if (demuxer->reader.capture) {
+        // The new connection starts a new stream (with its own codec header),
+        // the capture would not be replayable anymore
+        LOGW("Demuxer '%s': capture stopped on reconnection", demuxer->name);
+        sc_net_reader_set_capture(&demuxer->reader, NULL);
+    }
+
+    demuxer->socket = socket;
+    sc_net_reader_reset(&demuxer->reader, socket);
+    if (demuxer->latency_tracker) {
+        sc_net_reader_enable_timestamps(&demuxer->reader);
+    }
+
+    uint32_t new_raw_codec_id;
+    bool ok = sc_demuxer_recv_codec_id(demuxer, &new_raw_codec_id);
+    if (!ok) {
+        LOGE("Demuxer '%s': connection error on reconnection", demuxer->name);
+        *status = SC_DEMUXER_STATUS_ERROR;
+        return false;
+    }
+
+    if (new_raw_codec_id == 0) {
+        LOGW("Demuxer '%s': stream disabled by the device on reconnection",
+             demuxer->name);
+        *status = SC_DEMUXER_STATUS_DISABLED;
+        return false;
+    }
+
+    if (new_raw_codec_id != raw_codec_id) {
+        LOGE("Demuxer '%s': stream codec changed on reconnection",
+             demuxer->name);
+        *status = SC_DEMUXER_STATUS_ERROR;
+        return false;
+    }
+
+    if (video) {
+        // The decoder handles a new size from the stream itself
+        uint32_t width;
+        uint32_t height;
+        ok = sc_demuxer_recv_video_size(demuxer, &width, &height);
+        if (!ok) {
+            *status = SC_DEMUXER_STATUS_ERROR;
+            return false;
+        }
+    }
+
+    // Resume on the next keyframe, so that no packet references a missing
+    // frame
+    demuxer->wait_key_frame = true;
+    demuxer->resume_date = eos_date;
+    demuxer->catch_up.active = false;
+    if (demuxer->clock) {
+        // The PTS offset changes, the clock must be estimated again
+        sc_stream_clock_reset(demuxer->clock, demuxer->clock_source);
+    }
+
+    LOGI("Demuxer '%s': resumed", demuxer->name);
+    return true;
+}
+
 static int
 run_demuxer(void *data) {
     struct sc_demuxer *demuxer = data;
 
+    // Before opening the decoder, so that its threads inherit the constraints
+    sc_thread_apply_sched(demuxer->thread_sched);
+
     // Flag to report end-of-stream (i.e. device disconnected)
     enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
 
+    bool ok = sc_net_reader_init(&demuxer->reader, demuxer->socket,
+                                 SC_DEMUXER_READ_BUFFER_SIZE);
+    if (!ok) {
+        goto end;
+    }
+
+    FILE *capture = NULL;
+    if (demuxer->capture_filename) {
+        capture = sc_file_open(demuxer->capture_filename, "wb");
+        if (!capture) {
+            LOGE("Demuxer '%s': could not open capture file: %s",
+                 demuxer->name, demuxer->capture_filename);
+            goto finally_destroy_reader;
+        }
+        sc_net_reader_set_capture(&demuxer->reader, capture);
+        LOGI("Demuxer '%s': capturing the stream to %s", demuxer->name,
+             demuxer->capture_filename);
+    }
+
+    if (demuxer->latency_tracker) {
+        // Measure the jitter from the kernel receive timestamps if possible
+        if (sc_net_reader_enable_timestamps(&demuxer->reader)) {
+            LOGD("Demuxer '%s': using kernel receive timestamps",
+                 demuxer->name);
+        }
+    }
+
     uint32_t raw_codec_id;
-    bool ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
+    ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
     if (!ok) {
         LOGE("Demuxer '%s': stream disabled due to connection error",
              demuxer->name);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     if (raw_codec_id == 0) {
@@ -154,13 +479,13 @@ run_demuxer(void *data) {
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
         status = SC_DEMUXER_STATUS_DISABLED;
-        goto end;
+        goto finally_destroy_reader;
     }
 
     if (raw_codec_id == 1) {
         LOGE("Demuxer '%s': stream configuration error on the device",
              demuxer->name);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     enum AVCodecID codec_id = sc_demuxer_to_avcodec_id(raw_codec_id);
@@ -168,7 +493,7 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to unsupported codec",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     const AVCodec *codec = avcodec_find_decoder(codec_id);
@@ -176,13 +501,13 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to missing decoder",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
     if (!codec_ctx) {
         LOG_OOM();
-        goto end;
+        goto finally_destroy_reader;
     }
 
     codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
@@ -197,7 +522,42 @@ run_demuxer(void *data) {
 
         codec_ctx->width = width;
         codec_ctx->height = height;
+        sc_startup_timing_mark(SC_STARTUP_PHASE_CODEC_META);
         codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+        if (demuxer->decoder_thread_type == SC_DECODER_THREAD_TYPE_FRAME) {
+            // FFmpeg disables frame threading in low delay mode
+            codec_ctx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+            codec_ctx->thread_type = FF_THREAD_FRAME;
+        } else {
+            // Slice threading does not add any latency
+            codec_ctx->thread_type = FF_THREAD_SLICE;
+        }
+        codec_ctx->thread_count = demuxer->decoder_threads;
+
+        if (demuxer->decoder_error_concealment) {
+            // Guess the missing macroblocks from their neighbors and output
+            // the partially corrupt frames, rather than dropping them
+            codec_ctx->error_concealment = FF_EC_GUESS_MVS | FF_EC_DEBLOCK;
+            codec_ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+        }
+
+        if (demuxer->hwaccel != SC_HWACCEL_NONE) {
+            bool hw_ok = false;
+            if (demuxer->hw_device) {
+                // The device has been created for the expected codec, check
+                // that it also supports the actual one
+                hw_ok = sc_hwaccel_configure_device(codec_ctx, codec,
+                                                    demuxer->hw_device);
+                // The reference has been transferred (or released)
+                demuxer->hw_device = NULL;
+            }
+            if (!hw_ok) {
+                // On failure, the video is decoded in software (already
+                // logged)
+                sc_hwaccel_configure(codec_ctx, codec, demuxer->hwaccel);
+            }
+        }
     } else {
         // Hardcoded audio properties
 #ifdef SCRCPY_LAVU_HAS_CHLAYOUT
@@ -219,6 +579,15 @@ run_demuxer(void *data) {
         goto finally_free_context;
     }
 
+    if (codec->type == AVMEDIA_TYPE_VIDEO) {
+        const char *thread_type =
+            codec_ctx->active_thread_type == FF_THREAD_FRAME ? "frame"
+          : codec_ctx->active_thread_type == FF_THREAD_SLICE ? "slice"
+                                                             : "none";
+        LOGD("Demuxer '%s': decoder threads: %d (%s)", demuxer->name,
+             codec_ctx->thread_count, thread_type);
+    }
+
     if (!sc_packet_source_sinks_open(&demuxer->packet_source, codec_ctx)) {
         goto finally_free_context;
     }
@@ -241,16 +610,49 @@ run_demuxer(void *data) {
     }
 
     for (;;) {
-        bool ok = sc_demuxer_recv_packet(demuxer, packet);
+        sc_tick begin = sc_trace_begin();
+        // Reserve room to prepend the pending config packet without copying
+        // the media packet
+        size_t headroom = must_merge_config_packet
+                        ? sc_packet_merger_get_headroom(&merger) : 0;
+        bool ok = sc_demuxer_recv_packet(demuxer, packet, headroom);
+        sc_trace_end("recv", begin);
         if (!ok) {
             // end of stream
             status = SC_DEMUXER_STATUS_EOS;
+            if (demuxer->cbs->on_eos
+                    && sc_demuxer_resume(demuxer, raw_codec_id,
+                                         codec->type == AVMEDIA_TYPE_VIDEO,
+                                         &status)) {
+                continue;
+            }
             break;
         }
 
+        sc_demuxer_count_packet(demuxer, packet);
+
+        if (demuxer->wait_key_frame && packet->pts != AV_NOPTS_VALUE) {
+            if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(packet);
+                continue;
+            }
+            demuxer->wait_key_frame = false;
+        }
+
+        if (demuxer->catch_up.enabled && sc_demuxer_catch_up(demuxer, packet)) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        if (codec->type == AVMEDIA_TYPE_VIDEO) {
+            sc_startup_timing_mark(SC_STARTUP_PHASE_FIRST_PACKET);
+        }
+
         if (must_merge_config_packet) {
             // Prepend any config packet to the next media packet
+            begin = sc_trace_begin();
             ok = sc_packet_merger_merge(&merger, packet);
+            sc_trace_end("packet_merge", begin);
             if (!ok) {
                 av_packet_unref(packet);
                 break;
@@ -272,33 +674,211 @@ run_demuxer(void *data) {
     }
 
     av_packet_free(&packet);
+    // The buffers in use remain valid: each pool is freed once all its
+    // buffers are released
+    for (unsigned i = 0; i < SC_DEMUXER_PACKET_POOL_COUNT; ++i) {
+        av_buffer_pool_uninit(&demuxer->packet_pools[i]);
+    }
 finally_close_sinks:
     sc_packet_source_sinks_close(&demuxer->packet_source);
 finally_free_context:
     avcodec_free_context(&codec_ctx);
+finally_destroy_reader:
+    if (capture) {
+        fclose(capture);
+    }
+    sc_net_reader_destroy(&demuxer->reader);
 end:
+    sc_packet_source_end(&demuxer->packet_source);
     demuxer->cbs->on_ended(demuxer, status, demuxer->cbs_userdata);
 
     return 0;
 }
 
-void
+bool
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata) {
     assert(socket != SC_SOCKET_NONE);
 
+    if (!sc_packet_source_init(&demuxer->packet_source)) {
+        return false;
+    }
+
     demuxer->name = name; // statically allocated
     demuxer->socket = socket;
-    sc_packet_source_init(&demuxer->packet_source);
+    demuxer->hwaccel = SC_HWACCEL_NONE;
+    demuxer->hw_device = NULL;
+    demuxer->decoder_threads = 0;
+    demuxer->decoder_thread_type = SC_DECODER_THREAD_TYPE_SLICE;
+    demuxer->decoder_error_concealment = false;
+    demuxer->latency_tracker = NULL;
+    demuxer->skip_repeated_frames = false;
+    demuxer->thread_sched = NULL;
+    demuxer->capture_filename = NULL;
+    sc_stream_stats_init(&demuxer->stats);
+    demuxer->packets_metric = NULL;
+    demuxer->bytes_metric = NULL;
+    demuxer->keyframes_metric = NULL;
+    demuxer->keyframe_bytes_metric = NULL;
+    demuxer->keyframe_size_metric = NULL;
+    demuxer->config_packets_metric = NULL;
+    demuxer->bitrate_metric = NULL;
+    demuxer->bitrate_date = 0;
+    demuxer->bitrate_bytes = 0;
+    for (unsigned i = 0; i < SC_DEMUXER_PACKET_POOL_COUNT; ++i) {
+        demuxer->packet_pools[i] = NULL;
+    }
+    demuxer->last_pts = AV_NOPTS_VALUE;
+    demuxer->pts_offset = 0;
+    demuxer->resume_date = 0;
+    demuxer->wait_key_frame = false;
+    demuxer->clock = NULL;
+    demuxer->clock_source = SC_STREAM_CLOCK_SOURCE_VIDEO;
+    demuxer->catch_up.enabled = false;
+    demuxer->catch_up.controller = NULL;
+    demuxer->catch_up.lag = 0;
+    demuxer->catch_up.active = false;
+    demuxer->catch_up.keyframe_request_date = 0;
+    demuxer->catch_up.dropped = 0;
 
     assert(cbs && cbs->on_ended);
 
     demuxer->cbs = cbs;
     demuxer->cbs_userdata = cbs_userdata;
+
+    return true;
+}
+
+void
+sc_demuxer_destroy(struct sc_demuxer *demuxer) {
+    av_buffer_unref(&demuxer->hw_device);
+    free(demuxer->capture_filename);
+    sc_packet_source_destroy(&demuxer->packet_source);
+}
+
+void
+sc_demuxer_set_hwaccel(struct sc_demuxer *demuxer, enum sc_hwaccel hwaccel) {
+    demuxer->hwaccel = hwaccel;
+}
+
+void
+sc_demuxer_set_hwaccel_device(struct sc_demuxer *demuxer,
+                              AVBufferRef *device) {
+    assert(demuxer->hwaccel != SC_HWACCEL_NONE);
+    assert(!demuxer->hw_device);
+    demuxer->hw_device = device;
+}
+
+void
+sc_demuxer_set_decoder_threads(struct sc_demuxer *demuxer, uint16_t threads,
+                               enum sc_decoder_thread_type type) {
+    demuxer->decoder_threads = threads;
+    demuxer->decoder_thread_type = type;
+}
+
+void
+sc_demuxer_set_decoder_error_concealment(struct sc_demuxer *demuxer,
+                                         bool enabled) {
+    demuxer->decoder_error_concealment = enabled;
+}
+
+void
+sc_demuxer_set_latency_tracker(struct sc_demuxer *demuxer,
+                               struct sc_latency_tracker *tracker) {
+    demuxer->latency_tracker = tracker;
+}
+
+void
+sc_demuxer_set_skip_repeated_frames(struct sc_demuxer *demuxer, bool skip) {
+    demuxer->skip_repeated_frames = skip;
+}
+
+void
+sc_demuxer_set_stream_clock(struct sc_demuxer *demuxer,
+                            struct sc_stream_clock *clock,
+                            enum sc_stream_clock_source source) {
+    demuxer->clock = clock;
+    demuxer->clock_source = source;
+}
+
+void
+sc_demuxer_set_catch_up(struct sc_demuxer *demuxer, bool enabled) {
+    demuxer->catch_up.enabled = enabled;
+}
+
+void
+sc_demuxer_set_keyframe_requester(struct sc_demuxer *demuxer,
+                                  struct sc_controller *controller) {
+    demuxer->catch_up.controller = controller;
+}
+
+void
+sc_demuxer_set_metrics(struct sc_demuxer *demuxer, struct sc_metrics *metrics) {
+    char name[SC_METRIC_NAME_MAX];
+
+    snprintf(name, sizeof(name), "scrcpy_%s_packets_total", demuxer->name);
+    demuxer->packets_metric =
+        sc_metrics_register_counter(metrics, name, "Packets received");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_bytes_total", demuxer->name);
+    demuxer->bytes_metric =
+        sc_metrics_register_counter(metrics, name, "Bytes of packets received");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_keyframes_total", demuxer->name);
+    demuxer->keyframes_metric =
+        sc_metrics_register_counter(metrics, name, "Keyframes received");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_keyframe_bytes_total",
+             demuxer->name);
+    demuxer->keyframe_bytes_metric =
+        sc_metrics_register_counter(metrics, name,
+                                    "Bytes of keyframes received");
+
+    // In bytes
+    static const int64_t bounds[] = {
+        8192, 16384, 32768, 65536, 131072, 262144, 524288, 1048576, 2097152,
+    };
+
+    snprintf(name, sizeof(name), "scrcpy_%s_keyframe_size_bytes",
+             demuxer->name);
+    demuxer->keyframe_size_metric =
+        sc_metrics_register_histogram(metrics, name, "Size of the keyframes",
+                                      bounds, ARRAY_LEN(bounds));
+
+    snprintf(name, sizeof(name), "scrcpy_%s_config_packets_total",
+             demuxer->name);
+    demuxer->config_packets_metric =
+        sc_metrics_register_counter(metrics, name, "Config packets received");
+
+    snprintf(name, sizeof(name), "scrcpy_%s_bitrate_kbps", demuxer->name);
+    demuxer->bitrate_metric =
+        sc_metrics_register_gauge(metrics, name,
+                                  "Bit rate received during the last second");
+}
+
+void
+sc_demuxer_set_thread_sched(struct sc_demuxer *demuxer,
+                            const struct sc_thread_sched *sched) {
+    demuxer->thread_sched = sched;
+}
+
+bool
+sc_demuxer_set_capture(struct sc_demuxer *demuxer, const char *filename) {
+    assert(!demuxer->capture_filename);
+    demuxer->capture_filename = strdup(filename);
+    if (!demuxer->capture_filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    return true;
 }
 
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer) {
+    // The lag is measured by the stream clock
+    assert(!demuxer->catch_up.enabled || demuxer->clock);
+
     LOGD("Demuxer '%s': starting thread", demuxer->name);
 
     bool ok = sc_thread_create(&demuxer->thread, run_demuxer, "scrcpy-demuxer",
@@ -4,10 +4,33 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/buffer.h>
 
+#include "controller.h"
+#include "latency_tracker.h"
+#include "options.h"
+#include "stream_clock.h"
+#include "stream_stats.h"
 #include "trait/packet_source.h"
+#include "util/metrics.h"
 #include "util/net.h"
 #include "util/thread.h"
+#include "util/tick.h"
+
+// Frame header of the packets received from the device (see doc/develop.md),
+// also written by the raw stream sink
+#define SC_PACKET_HEADER_SIZE 12
+
+#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
+#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+#define SC_PACKET_FLAG_REPEATED  (UINT64_C(1) << 61)
+
+// Number of packet pools (buffers from 1 KiB to 1 MiB, by factors of 4)
+#define SC_DEMUXER_PACKET_POOL_COUNT 6
+
+#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_REPEATED - 1)
 
 struct sc_demuxer {
     struct sc_packet_source packet_source; // packet source trait
@@ -17,6 +40,63 @@ struct sc_demuxer {
     sc_socket socket;
     sc_thread thread;
 
+    // only used for video
+    enum sc_hwaccel hwaccel;
+    AVBufferRef *hw_device; // created ahead of time, may be NULL
+    uint16_t decoder_threads; // 0 for automatic
+    enum sc_decoder_thread_type decoder_thread_type;
+    bool decoder_error_concealment;
+    struct sc_latency_tracker *latency_tracker; // may be NULL
+    bool skip_repeated_frames;
+    const struct sc_thread_sched *thread_sched; // may be NULL
+    char *capture_filename; // may be NULL
+
+    // Bandwidth and packet size statistics (may be read from any thread)
+    struct sc_stream_stats stats;
+
+    // Received packets and bytes (NULL if metrics are disabled)
+    struct sc_metric *packets_metric;
+    struct sc_metric *bytes_metric;
+    struct sc_metric *keyframes_metric;
+    struct sc_metric *keyframe_bytes_metric;
+    struct sc_metric *keyframe_size_metric;
+    struct sc_metric *config_packets_metric;
+    struct sc_metric *bitrate_metric;
+
+    // Bit rate measurement window for bitrate_metric (only accessed from the
+    // demuxer thread)
+    sc_tick bitrate_date;
+    uint64_t bitrate_bytes;
+
+    // Buffered reader for the socket (only accessed from the demuxer thread)
+    struct sc_net_reader reader;
+
+    // Pools for the packets data, one per buffer size, initialized on first
+    // use (only accessed from the demuxer thread)
+    AVBufferPool *packet_pools[SC_DEMUXER_PACKET_POOL_COUNT];
+
+    // To resume the stream after a reconnection (only accessed from the
+    // demuxer thread)
+    int64_t last_pts; // AV_NOPTS_VALUE if none
+    int64_t pts_offset; // added to the device PTS
+    sc_tick resume_date; // date of the disconnection, 0 if not resuming
+    bool wait_key_frame;
+
+    // Session clock fed with the reception dates of the packets (may be NULL)
+    struct sc_stream_clock *clock;
+    enum sc_stream_clock_source clock_source;
+
+    // Drop the backlog accumulated after a network stall (only accessed from
+    // the demuxer thread)
+    struct {
+        bool enabled;
+        struct sc_controller *controller; // to request a keyframe, may be NULL
+        sc_tick lag; // of the last received packet
+        bool active; // dropping the packets until a recent keyframe
+        sc_tick keyframe_request_date;
+        uint32_t dropped;
+    } catch_up;
+
     const struct sc_demuxer_callbacks *cbs;
     void *cbs_userdata;
 };
@@ -30,13 +110,103 @@ enum sc_demuxer_status {
 struct sc_demuxer_callbacks {
     void (*on_ended)(struct sc_demuxer *demuxer, enum sc_demuxer_status,
                      void *userdata);
+
+    // Optional: called on end-of-stream to wait for the socket of a new
+    // connection, to resume the stream without closing the sinks
+    //
+    // Return SC_SOCKET_NONE to end the stream.
+    sc_socket (*on_eos)(struct sc_demuxer *demuxer, void *userdata);
 };
 
 // The name must be statically allocated (e.g. a string literal)
-void
+bool
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata);
 
+void
+sc_demuxer_destroy(struct sc_demuxer *demuxer);
+
+// Request hardware-accelerated decoding for the video codec context (must be
+// called before sc_demuxer_start())
+void
+sc_demuxer_set_hwaccel(struct sc_demuxer *demuxer, enum sc_hwaccel hwaccel);
+
+// Use a hardware device created ahead of time by sc_hwaccel_create_device(),
+// if it supports the actual codec (must be called after
+// sc_demuxer_set_hwaccel() and before sc_demuxer_start())
+//
+// The demuxer takes ownership of the device reference.
+void
+sc_demuxer_set_hwaccel_device(struct sc_demuxer *demuxer,
+                              AVBufferRef *device);
+
+// Configure the threading of the video decoder (must be called before
+// sc_demuxer_start())
+void
+sc_demuxer_set_decoder_threads(struct sc_demuxer *demuxer, uint16_t threads,
+                               enum sc_decoder_thread_type type);
+
+// Output the partially corrupt frames with error concealment, instead of
+// dropping them (must be called before sc_demuxer_start())
+void
+sc_demuxer_set_decoder_error_concealment(struct sc_demuxer *demuxer,
+                                         bool enabled);
+
+// Record the reception time and the device encoding time of the packets (must
+// be called before sc_demuxer_start())
+//
+// The stream must contain the device timestamps (the server must be started
+// with send_frame_timestamp=true).
+void
+sc_demuxer_set_latency_tracker(struct sc_demuxer *demuxer,
+                               struct sc_latency_tracker *tracker);
+
+// Mark the packets containing a frame repeated by the device encoder with
+// AV_PKT_FLAG_DISCARD, so that they are decoded but not displayed (must be
+// called before sc_demuxer_start())
+void
+sc_demuxer_set_skip_repeated_frames(struct sc_demuxer *demuxer, bool skip);
+
+// Feed the session clock with the reception dates of the packets (must be
+// called before sc_demuxer_start())
+void
+sc_demuxer_set_stream_clock(struct sc_demuxer *demuxer,
+                            struct sc_stream_clock *clock,
+                            enum sc_stream_clock_source source);
+
+// Drop the non-key packets when the stream lags behind the device (typically
+// the backlog received at once after a network stall), until a recent
+// keyframe (must be called before sc_demuxer_start(), and requires a stream
+// clock)
+//
+// The packets are dropped for all the sinks, so it must not be enabled if a
+// sink needs the whole stream (e.g. a recorder).
+void
+sc_demuxer_set_catch_up(struct sc_demuxer *demuxer, bool enabled);
+
+// Request a keyframe from the device on catch-up, instead of waiting for the
+// next periodic keyframe (must be called before sc_demuxer_start())
+void
+sc_demuxer_set_keyframe_requester(struct sc_demuxer *demuxer,
+                                  struct sc_controller *controller);
+
+// Apply scheduling constraints to the demuxer thread, which also decodes the
+// stream (must be called before sc_demuxer_start())
+void
+sc_demuxer_set_thread_sched(struct sc_demuxer *demuxer,
+                            const struct sc_thread_sched *sched);
+
+// Register the demuxer metrics (named after the demuxer) to the registry (must
+// be called before sc_demuxer_start())
+void
+sc_demuxer_set_metrics(struct sc_demuxer *demuxer, struct sc_metrics *metrics);
+
+// Write the raw byte stream received from the socket to a file, so that the
+// session can be replayed without a device (must be called before
+// sc_demuxer_start())
+bool
+sc_demuxer_set_capture(struct sc_demuxer *demuxer, const char *filename);
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer);
 
@@ -0,0 +1,237 @@
+#include "device_cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_error.h>
+#include <SDL2/SDL_filesystem.h>
+#include <SDL2/SDL_stdinc.h>
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/str.h"
+#include "util/strbuf.h"
+
+#define SC_DEVICE_CACHE_FILENAME "device_cache.txt"
+#define SC_DEVICE_CACHE_MAX_SIZE (64 * 1024)
+
+// Return the length of the line starting at `line` (excluding '\n')
+static size_t
+line_length(const char *line) {
+    const char *end = strchr(line, '\n');
+    return end ? (size_t) (end - line) : strlen(line);
+}
+
+// Return the offset of the value if `line` is the entry for `key`
+static size_t
+match_entry(const char *line, size_t len, const char *key) {
+    size_t key_len = strlen(key);
+    if (len > key_len && !memcmp(line, key, key_len)
+            && line[key_len] == '\t') {
+        return key_len + 1;
+    }
+    return 0;
+}
+
+char *
+sc_device_cache_find(const char *content, const char *key) {
+    const char *line = content;
+    while (*line) {
+        size_t len = line_length(line);
+        size_t offset = match_entry(line, len, key);
+        if (offset) {
+            size_t name_len = len - offset;
+            // Tolerate "\r\n" line endings (if the file was edited manually)
+            if (name_len && line[offset + name_len - 1] == '\r') {
+                --name_len;
+            }
+            if (!name_len) {
+                return NULL;
+            }
+            char *name = malloc(name_len + 1);
+            if (!name) {
+                LOG_OOM();
+                return NULL;
+            }
+            memcpy(name, &line[offset], name_len);
+            name[name_len] = '\0';
+            return name;
+        }
+
+        line += len;
+        if (*line == '\n') {
+            ++line;
+        }
+    }
+
+    return NULL;
+}
+
+char *
+sc_device_cache_update(const char *content, const char *key,
+                       const char *value) {
+    assert(!strchr(key, '\t') && !strchr(key, '\n'));
+    assert(!strchr(value, '\n'));
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, strlen(content) + 128)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    // Copy all the other entries
+    const char *line = content;
+    while (*line) {
+        size_t len = line_length(line);
+        if (len && !match_entry(line, len, key)) {
+            if (!sc_strbuf_append(&buf, line, len)
+                    || !sc_strbuf_append_char(&buf, '\n')) {
+                goto error;
+            }
+        }
+
+        line += len;
+        if (*line == '\n') {
+            ++line;
+        }
+    }
+
+    if (!sc_strbuf_append_str(&buf, key)
+            || !sc_strbuf_append_char(&buf, '\t')
+            || !sc_strbuf_append_str(&buf, value)
+            || !sc_strbuf_append_char(&buf, '\n')) {
+        goto error;
+    }
+
+    return buf.s;
+
+error:
+    LOG_OOM();
+    free(buf.s);
+    return NULL;
+}
+
+static char *
+get_cache_path(void) {
+    char *dir = SDL_GetPrefPath("Genymobile", "scrcpy");
+    if (!dir) {
+        LOGW("Could not get the preferences directory: %s", SDL_GetError());
+        return NULL;
+    }
+
+    // SDL_GetPrefPath() returns a path ending with a path separator
+    char *path = sc_str_concat(dir, SC_DEVICE_CACHE_FILENAME);
+    SDL_free(dir);
+    if (!path) {
+        LOG_OOM();
+    }
+    return path;
+}
+
+// Read the whole cache file content (empty if it does not exist)
+static char *
+read_cache(const char *path) {
+    FILE *file = sc_file_open(path, "rb");
+    if (!file) {
+        // Not cached yet
+        char *empty = strdup("");
+        if (!empty) {
+            LOG_OOM();
+        }
+        return empty;
+    }
+
+    char *content = malloc(SC_DEVICE_CACHE_MAX_SIZE + 1);
+    if (!content) {
+        LOG_OOM();
+        fclose(file);
+        return NULL;
+    }
+
+    size_t r = fread(content, 1, SC_DEVICE_CACHE_MAX_SIZE, file);
+    bool error = ferror(file);
+    fclose(file);
+    if (error) {
+        LOGW("Could not read %s", path);
+        free(content);
+        return NULL;
+    }
+
+    content[r] = '\0';
+    return content;
+}
+
+char *
+sc_device_cache_get(const char *key) {
+    char *path = get_cache_path();
+    if (!path) {
+        return NULL;
+    }
+
+    char *content = read_cache(path);
+    free(path);
+    if (!content) {
+        return NULL;
+    }
+
+    char *value = sc_device_cache_find(content, key);
+    free(content);
+    return value;
+}
+
+bool
+sc_device_cache_put(const char *key, const char *value) {
+    char *path = get_cache_path();
+    if (!path) {
+        return false;
+    }
+
+    bool ok = false;
+
+    char *content = read_cache(path);
+    if (!content) {
+        goto end_free_path;
+    }
+
+    char *updated = sc_device_cache_update(content, key, value);
+    free(content);
+    if (!updated) {
+        goto end_free_path;
+    }
+
+    char *tmp_path = sc_str_concat(path, ".tmp");
+    if (!tmp_path) {
+        LOG_OOM();
+        goto end_free_updated;
+    }
+
+    FILE *file = sc_file_open(tmp_path, "wb");
+    if (!file) {
+        LOGW("Could not open %s", tmp_path);
+        goto end_free_tmp_path;
+    }
+
+    size_t len = strlen(updated);
+    bool written = fwrite(updated, 1, len, file) == len;
+    if (fclose(file) || !written) {
+        LOGW("Could not write %s", tmp_path);
+        sc_file_remove(tmp_path);
+        goto end_free_tmp_path;
+    }
+
+    ok = sc_file_replace(tmp_path, path);
+    if (!ok) {
+        LOGW("Could not write %s", path);
+        sc_file_remove(tmp_path);
+    }
+
+end_free_tmp_path:
+    free(tmp_path);
+end_free_updated:
+    free(updated);
+end_free_path:
+    free(path);
+
+    return ok;
+}
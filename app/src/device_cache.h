@@ -0,0 +1,51 @@
+#ifndef SC_DEVICE_CACHE_H
+#define SC_DEVICE_CACHE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+/**
+ * Persistent cache of the settings selected for a device (by measurements or
+ * on errors), so that they are not selected again on the next runs:
+ *  - the video encoders selected by --video-encoder=auto-benchmark;
+ *  - the max sizes selected by downsizing on error;
+ *  - the tunnel modes selected by --auto-tunnel.
+ *
+ * It is stored in a text file in the user preferences directory, with one
+ * entry per line: "<key>\t<value>\n". The key identifies the device build
+ * and what is cached (for example the video codec of an encoder).
+ */
+
+/**
+ * Find the value for `key` in the cache file content
+ *
+ * Return the new allocated string, or NULL if not found (or on error).
+ */
+char *
+sc_device_cache_find(const char *content, const char *key);
+
+/**
+ * Return the cache file content with the entry for `key` set to `value`
+ *
+ * Return the new allocated string, or NULL on error.
+ */
+char *
+sc_device_cache_update(const char *content, const char *key,
+                       const char *value);
+
+/**
+ * Read the cached value for `key`
+ *
+ * Return the new allocated string, or NULL if not found (or on error).
+ */
+char *
+sc_device_cache_get(const char *key);
+
+/**
+ * Store the value for `key` in the cache
+ */
+bool
+sc_device_cache_put(const char *key, const char *value);
+
+#endif
@@ -1,8 +1,7 @@
 #include "device_msg.h"
 
+#include <inttypes.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "util/binary.h"
 #include "util/log.h"
@@ -21,21 +20,34 @@ sc_device_msg_deserialize(const uint8_t *buf, size_t len,
                 // at least type + empty string length
                 return 0; // no complete message
             }
-            size_t clipboard_len = sc_read32be(&buf[1]);
+            uint32_t value = sc_read32be(&buf[1]);
+            bool compressed = value & DEVICE_MSG_CLIPBOARD_COMPRESSED_FLAG;
+            size_t clipboard_len =
+                value & ~DEVICE_MSG_CLIPBOARD_COMPRESSED_FLAG;
             if (clipboard_len > len - 5) {
                 return 0; // no complete message
             }
-            char *text = malloc(clipboard_len + 1);
-            if (!text) {
-                LOG_OOM();
-                return -1;
-            }
-            if (clipboard_len) {
-                memcpy(text, &buf[5], clipboard_len);
-            }
-            text[clipboard_len] = '\0';
 
-            msg->clipboard.text = text;
+            msg->clipboard.compressed = compressed;
+            if (compressed) {
+                if (clipboard_len < 4) {
+                    LOGE("Invalid compressed clipboard");
+                    return -1;
+                }
+                uint32_t uncompressed_len = sc_read32be(&buf[5]);
+                if (uncompressed_len > DEVICE_MSG_TEXT_MAX_LENGTH) {
+                    LOGE("Compressed clipboard too large: %" PRIu32,
+                         uncompressed_len);
+                    return -1;
+                }
+                msg->clipboard.uncompressed_length = uncompressed_len;
+                msg->clipboard.text = (const char *) &buf[9];
+                msg->clipboard.length = clipboard_len - 4;
+            } else {
+                msg->clipboard.uncompressed_length = clipboard_len;
+                msg->clipboard.text = (const char *) &buf[5];
+                msg->clipboard.length = clipboard_len;
+            }
             return 5 + clipboard_len;
         }
         case DEVICE_MSG_TYPE_ACK_CLIPBOARD: {
@@ -56,38 +68,38 @@ sc_device_msg_deserialize(const uint8_t *buf, size_t len,
             if (size > len - 5) {
                 return 0; // not available
             }
-            uint8_t *data = malloc(size);
-            if (!data) {
-                LOG_OOM();
-                return -1;
-            }
-            if (size) {
-                memcpy(data, &buf[5], size);
-            }
 
             msg->uhid_output.id = id;
             msg->uhid_output.size = size;
-            msg->uhid_output.data = data;
+            msg->uhid_output.data = &buf[5];
 
             return 5 + size;
         }
+        case DEVICE_MSG_TYPE_CLOCK: {
+            if (len < 17) {
+                return 0; // no complete message
+            }
+            msg->clock.timestamp = sc_read64be(&buf[1]);
+            msg->clock.device_timestamp = sc_read64be(&buf[9]);
+            return 17;
+        }
+        case DEVICE_MSG_TYPE_ACK_PING: {
+            if (len < 17) {
+                return 0; // no complete message
+            }
+            msg->ack_ping.sequence = sc_read64be(&buf[1]);
+            msg->ack_ping.timestamp = sc_read64be(&buf[9]);
+            return 17;
+        }
+        case DEVICE_MSG_TYPE_VIDEO_IDLE: {
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            msg->video_idle.idle = buf[1];
+            return 2;
+        }
         default:
             LOGW("Unknown device message type: %d", (int) msg->type);
             return -1; // error, we cannot recover
     }
 }
-
-void
-sc_device_msg_destroy(struct sc_device_msg *msg) {
-    switch (msg->type) {
-        case DEVICE_MSG_TYPE_CLIPBOARD:
-            free(msg->clipboard.text);
-            break;
-        case DEVICE_MSG_TYPE_UHID_OUTPUT:
-            free(msg->uhid_output.data);
-            break;
-        default:
-            // nothing to do
-            break;
-    }
-}
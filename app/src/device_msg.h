@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -11,17 +12,30 @@
 // type: 1 byte; length: 4 bytes
 #define DEVICE_MSG_TEXT_MAX_LENGTH (DEVICE_MSG_MAX_SIZE - 5)
 
+// If this flag is set in the length of the clipboard text, then the payload is
+// the uncompressed length (4 bytes) followed by the zlib-compressed text
+#define DEVICE_MSG_CLIPBOARD_COMPRESSED_FLAG UINT32_C(0x80000000)
+
 enum sc_device_msg_type {
     DEVICE_MSG_TYPE_CLIPBOARD,
     DEVICE_MSG_TYPE_ACK_CLIPBOARD,
     DEVICE_MSG_TYPE_UHID_OUTPUT,
+    DEVICE_MSG_TYPE_CLOCK,
+    DEVICE_MSG_TYPE_ACK_PING,
+    DEVICE_MSG_TYPE_VIDEO_IDLE,
 };
 
+// The variable-length fields are not copied: they point into the deserialized
+// buffer, so they are only valid as long as this buffer is
 struct sc_device_msg {
     enum sc_device_msg_type type;
     union {
         struct {
-            char *text; // owned, to be freed by free()
+            const char *text; // not nul-terminated
+            size_t length;
+            // If compressed, text contains length bytes of zlib data
+            bool compressed;
+            uint32_t uncompressed_length;
         } clipboard;
         struct {
             uint64_t sequence;
@@ -29,8 +43,19 @@ struct sc_device_msg {
         struct {
             uint16_t id;
             uint16_t size;
-            uint8_t *data; // owned, to be freed by free()
+            const uint8_t *data;
         } uhid_output;
+        struct {
+            uint64_t timestamp; // client time of the request
+            uint64_t device_timestamp; // device time of the reply
+        } clock;
+        struct {
+            uint64_t sequence;
+            uint64_t timestamp; // client time of the ping (echoed)
+        } ack_ping;
+        struct {
+            bool idle;
+        } video_idle;
     };
 };
 
@@ -39,7 +64,4 @@ ssize_t
 sc_device_msg_deserialize(const uint8_t *buf, size_t len,
                           struct sc_device_msg *msg);
 
-void
-sc_device_msg_destroy(struct sc_device_msg *msg);
-
 #endif
@@ -2,11 +2,226 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 #include <libavutil/pixfmt.h>
 
+#include "trace.h"
 #include "util/log.h"
 
+static bool
+sc_display_supports_pbo(struct sc_opengl *gl) {
+#ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
+    // The OpenGL version has been retrieved from the Core Profile context,
+    // which is not the context used by the SDL renderer
+    (void) gl;
+    return false;
+#else
+    // glMapBufferRange() requires OpenGL 3.0+ or ES 3.0+
+    return sc_opengl_version_at_least(gl, 3, 0, /* OpenGL 3.0+ */
+                                          3, 0  /* OpenGL ES 3.0+ */)
+        && sc_opengl_has_pbo_functions(gl);
+#endif
+}
+
+static bool
+sc_display_supports_shader(struct sc_opengl *gl) {
+#ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
+    // The OpenGL version has been retrieved from the Core Profile context,
+    // which is not the context used by the SDL renderer
+    (void) gl;
+    return false;
+#else
+    // The single-channel (GL_RED) and two-channel (GL_RG) textures, and
+    // GLSL 1.30 or GLSL ES 3.00, require OpenGL 3.0+ or ES 3.0+
+    return sc_opengl_version_at_least(gl, 3, 0, /* OpenGL 3.0+ */
+                                          3, 0  /* OpenGL ES 3.0+ */)
+        && sc_opengl_has_shader_functions(gl);
+#endif
+}
+
+#define SC_DISPLAY_SHADER_ATTRIB_POSITION 0
+#define SC_DISPLAY_SHADER_ATTRIB_TEXCOORD 1
+
+// Values of the u_format uniform
+#define SC_DISPLAY_SHADER_FORMAT_PLANAR 0
+#define SC_DISPLAY_SHADER_FORMAT_NV12 1
+#define SC_DISPLAY_SHADER_FORMAT_NV21 2
+
+static const char *const sc_display_vertex_shader =
+    "in vec2 a_position;\n"
+    "in vec2 a_texcoord;\n"
+    "out vec2 v_texcoord;\n"
+    "void main() {\n"
+    "    v_texcoord = a_texcoord;\n"
+    "    gl_Position = vec4(a_position, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *const sc_display_fragment_shader =
+    "in vec2 v_texcoord;\n"
+    "uniform sampler2D u_tex_y;\n"
+    "uniform sampler2D u_tex_u; // U, or interleaved UV for NV12/NV21\n"
+    "uniform sampler2D u_tex_v;\n"
+    "uniform int u_format;\n"
+    "uniform mat3 u_matrix;\n"
+    "uniform vec3 u_offset;\n"
+    "uniform vec4 u_texcoord_max; // luma (xy) and chroma (zw)\n"
+    "void main() {\n"
+    "    // Never sample the texels beyond the frame area\n"
+    "    vec2 luma_texcoord = min(v_texcoord, u_texcoord_max.xy);\n"
+    "    vec2 chroma_texcoord = min(v_texcoord, u_texcoord_max.zw);\n"
+    "    vec3 yuv;\n"
+    "    yuv.x = texture(u_tex_y, luma_texcoord).r;\n"
+    "    if (u_format == 0) {\n"
+    "        yuv.y = texture(u_tex_u, chroma_texcoord).r;\n"
+    "        yuv.z = texture(u_tex_v, chroma_texcoord).r;\n"
+    "    } else {\n"
+    "        vec2 uv = texture(u_tex_u, chroma_texcoord).rg;\n"
+    "        yuv.yz = u_format == 1 ? uv : uv.yx;\n"
+    "    }\n"
+    "    FRAG_COLOR = vec4(clamp(u_matrix * (yuv - u_offset), 0.0, 1.0),\n"
+    "                      1.0);\n"
+    "}\n";
+
+static GLuint
+sc_display_compile_shader(struct sc_opengl *gl, GLenum type,
+                          const char *source) {
+    const char *header;
+    if (gl->is_opengles) {
+        header = type == GL_VERTEX_SHADER
+               ? "#version 300 es\n"
+               : "#version 300 es\n"
+                 "precision highp float;\n"
+                 "out vec4 frag_color;\n"
+                 "#define FRAG_COLOR frag_color\n";
+    } else {
+        header = type == GL_VERTEX_SHADER
+               ? "#version 130\n"
+               : "#version 130\n"
+                 "#define FRAG_COLOR gl_FragColor\n";
+    }
+
+    GLuint shader = gl->CreateShader(type);
+    if (!shader) {
+        LOGW("Could not create shader");
+        return 0;
+    }
+
+    const GLchar *sources[] = {header, source};
+    gl->ShaderSource(shader, 2, sources, NULL);
+    gl->CompileShader(shader);
+
+    GLint status;
+    gl->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[512];
+        gl->GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        LOGW("Could not compile %s shader: %s",
+             type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+        gl->DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+// Make the OpenGL context of the renderer current, before raw OpenGL calls
+//
+// The SDL renderer functions (and SDL_GL_BindTexture()) activate their own
+// context, but several windows (and renderers) may be used from the same
+// thread.
+static bool
+sc_display_make_gl_current(struct sc_display *display) {
+    assert(display->renderer_gl_context);
+    if (SDL_GL_GetCurrentContext() == display->renderer_gl_context) {
+        return true;
+    }
+
+    if (SDL_GL_MakeCurrent(display->window, display->renderer_gl_context)) {
+        LOGE("Could not make the OpenGL context current: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_display_init_shader(struct sc_display *display) {
+    struct sc_opengl *gl = &display->gl;
+
+    if (!sc_display_supports_shader(gl)) {
+        LOGW("YUV shader disabled (OpenGL 3.0+ or ES 3.0+ required)");
+        return false;
+    }
+
+    GLuint vertex_shader =
+        sc_display_compile_shader(gl, GL_VERTEX_SHADER,
+                                  sc_display_vertex_shader);
+    if (!vertex_shader) {
+        return false;
+    }
+
+    GLuint fragment_shader =
+        sc_display_compile_shader(gl, GL_FRAGMENT_SHADER,
+                                  sc_display_fragment_shader);
+    if (!fragment_shader) {
+        gl->DeleteShader(vertex_shader);
+        return false;
+    }
+
+    GLuint program = gl->CreateProgram();
+    if (!program) {
+        LOGW("Could not create shader program");
+        gl->DeleteShader(fragment_shader);
+        gl->DeleteShader(vertex_shader);
+        return false;
+    }
+
+    gl->AttachShader(program, vertex_shader);
+    gl->AttachShader(program, fragment_shader);
+    gl->BindAttribLocation(program, SC_DISPLAY_SHADER_ATTRIB_POSITION,
+                           "a_position");
+    gl->BindAttribLocation(program, SC_DISPLAY_SHADER_ATTRIB_TEXCOORD,
+                           "a_texcoord");
+    gl->LinkProgram(program);
+
+    // The shaders are kept alive by the program
+    gl->DeleteShader(fragment_shader);
+    gl->DeleteShader(vertex_shader);
+
+    GLint status;
+    gl->GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[512];
+        gl->GetProgramInfoLog(program, sizeof(log), NULL, log);
+        LOGW("Could not link shader program: %s", log);
+        gl->DeleteProgram(program);
+        return false;
+    }
+
+    gl->UseProgram(program);
+    // Texture unit of each plane
+    gl->Uniform1i(gl->GetUniformLocation(program, "u_tex_y"), 0);
+    gl->Uniform1i(gl->GetUniformLocation(program, "u_tex_u"), 1);
+    gl->Uniform1i(gl->GetUniformLocation(program, "u_tex_v"), 2);
+    gl->UseProgram(0);
+
+    display->shader.program = program;
+    display->shader.format_location =
+        gl->GetUniformLocation(program, "u_format");
+    display->shader.matrix_location =
+        gl->GetUniformLocation(program, "u_matrix");
+    display->shader.offset_location =
+        gl->GetUniformLocation(program, "u_offset");
+    display->shader.texcoord_max_location =
+        gl->GetUniformLocation(program, "u_texcoord_max");
+
+    gl->GenTextures(3, display->shader.textures);
+    display->shader.texture_format = AV_PIX_FMT_NONE;
+
+    return true;
+}
+
 static bool
 sc_display_init_novideo_icon(struct sc_display *display,
                              SDL_Surface *icon_novideo) {
@@ -30,9 +245,19 @@ sc_display_init_novideo_icon(struct sc_display *display,
 
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps) {
-    display->renderer =
-        SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+                SDL_Surface *icon_novideo, bool mipmaps,
+                enum sc_present_mode present_mode, bool yuv_shader) {
+    assert(present_mode != SC_PRESENT_MODE_AUTO);
+
+    uint32_t flags = SDL_RENDERER_ACCELERATED;
+    // Adaptive vsync is enabled on the OpenGL context once the renderer is
+    // created, so request vsync as a fallback
+    if (present_mode != SC_PRESENT_MODE_IMMEDIATE) {
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+
+    display->window = window;
+    display->renderer = SDL_CreateRenderer(window, -1, flags);
     if (!display->renderer) {
         LOGE("Could not create renderer: %s", SDL_GetError());
         return false;
@@ -42,8 +267,18 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
     int r = SDL_GetRendererInfo(display->renderer, &renderer_info);
     const char *renderer_name = r ? NULL : renderer_info.name;
     LOGI("Renderer: %s", renderer_name ? renderer_name : "(unknown)");
+    LOGD("Present mode: %s", sc_present_mode_get_name(present_mode));
 
     display->mipmaps = false;
+    display->downscaling = false;
+    display->pbo.enabled = false;
+    display->pbo.initialized = false;
+    display->pbo.index = 0;
+    display->shader.enabled = false;
+    display->sws.enabled = false;
+    display->sws.texture = NULL;
+    display->sws.frame = NULL;
+    display->sws.dirty = false;
 
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
     display->gl_context = NULL;
@@ -51,6 +286,25 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
 
     // starts with "opengl"
     bool use_opengl = renderer_name && !strncmp(renderer_name, "opengl", 6);
+
+    // An OpenGL renderer makes its context current on creation
+    display->renderer_gl_context = use_opengl ? SDL_GL_GetCurrentContext()
+                                              : NULL;
+
+    if (present_mode == SC_PRESENT_MODE_ADAPTIVE) {
+        // The renderer context is current (it must be set before creating
+        // another context below)
+        if (!use_opengl) {
+            LOGW("Adaptive vsync unavailable (not an OpenGL renderer), "
+                 "fallback to vsync");
+        } else if (SDL_GL_SetSwapInterval(-1)) {
+            LOGW("Adaptive vsync unavailable (%s), fallback to vsync",
+                 SDL_GetError());
+        } else {
+            LOGD("Adaptive vsync enabled");
+        }
+    }
+
     if (use_opengl) {
 
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
@@ -87,11 +341,49 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
         } else {
             LOGI("Trilinear filtering disabled");
         }
-    } else if (mipmaps) {
-        LOGD("Trilinear filtering disabled (not an OpenGL renderer)");
+
+        display->pbo.enabled = sc_display_supports_pbo(gl);
+        if (display->pbo.enabled) {
+            LOGD("Texture upload through pixel buffer objects enabled");
+        }
+
+        if (yuv_shader) {
+            display->shader.enabled = sc_display_init_shader(display);
+            if (display->shader.enabled) {
+                LOGI("YUV shader enabled");
+            } else {
+                LOGW("YUV shader disabled, fallback to the SDL renderer");
+            }
+        }
+    } else {
+        if (mipmaps) {
+            LOGD("Trilinear filtering disabled (not an OpenGL renderer)");
+        }
+        if (yuv_shader) {
+            LOGW("YUV shader disabled (not an OpenGL renderer)");
+        }
+
+        if (renderer_name && !strcmp(renderer_name, "software")) {
+            display->sws.frame = av_frame_alloc();
+            if (!display->sws.frame) {
+                LOG_OOM();
+                // Not fatal, fallback to the SDL conversion
+            } else if (!sc_frame_converter_init(&display->sws.converter)) {
+                av_frame_free(&display->sws.frame);
+            } else {
+                display->sws.enabled = true;
+                LOGD("Software rendering through swscale enabled");
+            }
+        }
     }
 
     display->texture = NULL;
+    for (unsigned i = 0; i < SC_DISPLAY_TEXTURE_CACHE_SIZE; ++i) {
+        display->texture_cache[i].texture = NULL;
+    }
+    display->prepare_transposed = false;
+    // The actual format will be known from the first frame
+    display->texture_format = SDL_PIXELFORMAT_YV12;
     display->pending.flags = 0;
     display->pending.frame = NULL;
     display->has_frame = false;
@@ -100,6 +392,14 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
         // Without video, set a static scrcpy icon as window content
         bool ok = sc_display_init_novideo_icon(display, icon_novideo);
         if (!ok) {
+            if (display->shader.enabled) {
+                display->gl.DeleteTextures(3, display->shader.textures);
+                display->gl.DeleteProgram(display->shader.program);
+            }
+            if (display->sws.enabled) {
+                sc_frame_converter_destroy(&display->sws.converter);
+                av_frame_free(&display->sws.frame);
+            }
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
             SDL_GL_DeleteContext(display->gl_context);
 #endif
@@ -116,20 +416,134 @@ sc_display_destroy(struct sc_display *display) {
     if (display->pending.frame) {
         av_frame_free(&display->pending.frame);
     }
+    if (display->pbo.initialized || display->shader.enabled) {
+        // The objects belong to the renderer context
+        sc_display_make_gl_current(display);
+    }
+    if (display->pbo.initialized) {
+        display->gl.DeleteBuffers(SC_DISPLAY_PBO_COUNT, display->pbo.ids);
+    }
+    if (display->shader.enabled) {
+        display->gl.DeleteTextures(3, display->shader.textures);
+        display->gl.DeleteProgram(display->shader.program);
+    }
+    if (display->sws.enabled) {
+        if (display->sws.texture) {
+            SDL_DestroyTexture(display->sws.texture);
+        }
+        sc_frame_converter_destroy(&display->sws.converter);
+        av_frame_free(&display->sws.frame);
+    }
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
     SDL_GL_DeleteContext(display->gl_context);
 #endif
+    for (unsigned i = 0; i < SC_DISPLAY_TEXTURE_CACHE_SIZE; ++i) {
+        if (display->texture_cache[i].texture) {
+            SDL_DestroyTexture(display->texture_cache[i].texture);
+        }
+    }
     if (display->texture) {
         SDL_DestroyTexture(display->texture);
     }
     SDL_DestroyRenderer(display->renderer);
 }
 
+static uint32_t
+sc_display_to_sdl_pixel_format(enum AVPixelFormat format) {
+    switch (format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            // The color range of YUVJ420P is applied from the frame
+            return SDL_PIXELFORMAT_YV12;
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+        case AV_PIX_FMT_NV12:
+            return SDL_PIXELFORMAT_NV12;
+        case AV_PIX_FMT_NV21:
+            return SDL_PIXELFORMAT_NV21;
+#endif
+        default:
+            return SDL_PIXELFORMAT_UNKNOWN;
+    }
+}
+
+// The decoded pictures are padded to the macroblock size of H.264 (e.g. 1088
+// lines for a 1080p stream)
+#define SC_DISPLAY_TEXTURE_ALIGN 16
+
+static struct sc_size
+sc_display_get_alloc_size(struct sc_size size) {
+    uint32_t mask = SC_DISPLAY_TEXTURE_ALIGN - 1;
+    uint32_t width = ((uint32_t) size.width + mask) & ~mask;
+    uint32_t height = ((uint32_t) size.height + mask) & ~mask;
+    return (struct sc_size) {
+        .width = width <= 0xFFFF ? width : size.width,
+        .height = height <= 0xFFFF ? height : size.height,
+    };
+}
+
+// Allocate the planes of a black YUV 4:2:0 image (the chroma planes are
+// contiguous, so that they may also be used as an interleaved UV plane)
+static uint8_t *
+sc_display_alloc_black_planes(struct sc_size size, size_t *luma_size) {
+    size_t y_size = (size_t) size.width * size.height;
+    size_t c_size = (size_t) ((size.width + 1) / 2) * ((size.height + 1) / 2);
+
+    uint8_t *data = malloc(y_size + 2 * c_size);
+    if (!data) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    memset(data, 16, y_size);
+    memset(data + y_size, 128, 2 * c_size);
+
+    *luma_size = y_size;
+    return data;
+}
+
+// Fill a new texture with black, so that the padding beyond the frame area
+// does not bleed into the edges through linear filtering or mipmaps
+static void
+sc_display_clear_texture(struct sc_display *display, SDL_Texture *texture,
+                         struct sc_size size) {
+    size_t y_size;
+    uint8_t *data = sc_display_alloc_black_planes(size, &y_size);
+    if (!data) {
+        // Not fatal
+        return;
+    }
+
+    int chroma_width = (size.width + 1) / 2;
+    size_t c_size = (size_t) chroma_width * ((size.height + 1) / 2);
+
+    int ret;
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    if (display->texture_format == SDL_PIXELFORMAT_NV12
+            || display->texture_format == SDL_PIXELFORMAT_NV21) {
+        ret = SDL_UpdateNVTexture(texture, NULL, data, size.width,
+                                  data + y_size, chroma_width * 2);
+    } else
+#else
+    (void) display;
+#endif
+    {
+        ret = SDL_UpdateYUVTexture(texture, NULL, data, size.width,
+                                   data + y_size, chroma_width,
+                                   data + y_size + c_size, chroma_width);
+    }
+    if (ret) {
+        LOGD("Could not clear texture: %s", SDL_GetError());
+    }
+
+    free(data);
+}
+
+// size is the allocated size (see sc_display_get_alloc_size())
 static SDL_Texture *
 sc_display_create_texture(struct sc_display *display,
                           struct sc_size size) {
     SDL_Renderer *renderer = display->renderer;
-    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12,
+    SDL_Texture *texture = SDL_CreateTexture(renderer, display->texture_format,
                                              SDL_TEXTUREACCESS_STREAMING,
                                              size.width, size.height);
     if (!texture) {
@@ -143,16 +557,145 @@ sc_display_create_texture(struct sc_display *display,
         SDL_GL_BindTexture(texture, NULL, NULL);
 
         // Enable trilinear filtering for downscaling
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                          GL_LINEAR_MIPMAP_LINEAR);
+        GLint min_filter = display->downscaling ? GL_LINEAR_MIPMAP_LINEAR
+                                                : GL_LINEAR;
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
         gl->TexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, -1.f);
 
         SDL_GL_UnbindTexture(texture);
     }
 
+    sc_display_clear_texture(display, texture, size);
+
+    return texture;
+}
+
+// Return the index of the cached texture for the format and the allocated
+// size, or -1 if there is none
+static int
+sc_display_cache_find(struct sc_display *display, uint32_t format,
+                      struct sc_size size) {
+    for (unsigned i = 0; i < SC_DISPLAY_TEXTURE_CACHE_SIZE; ++i) {
+        struct sc_display_cached_texture *entry = &display->texture_cache[i];
+        if (!entry->texture) {
+            // The unused entries are at the end
+            break;
+        }
+        if (entry->format == format && entry->size.width == size.width
+                && entry->size.height == size.height) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Remove the cached texture for the format and the allocated size, and return
+// it (or NULL if there is none)
+static SDL_Texture *
+sc_display_cache_take(struct sc_display *display, uint32_t format,
+                      struct sc_size size) {
+    int index = sc_display_cache_find(display, format, size);
+    if (index == -1) {
+        return NULL;
+    }
+
+    struct sc_display_cached_texture *cache = display->texture_cache;
+    SDL_Texture *texture = cache[index].texture;
+    memmove(&cache[index], &cache[index + 1],
+            (SC_DISPLAY_TEXTURE_CACHE_SIZE - index - 1) * sizeof(*cache));
+    cache[SC_DISPLAY_TEXTURE_CACHE_SIZE - 1].texture = NULL;
+    return texture;
+}
+
+// Insert a texture as the most recently used, destroying the least recently
+// used one if the cache is full
+static void
+sc_display_cache_put(struct sc_display *display, SDL_Texture *texture,
+                     uint32_t format, struct sc_size size) {
+    struct sc_display_cached_texture *cache = display->texture_cache;
+    if (cache[SC_DISPLAY_TEXTURE_CACHE_SIZE - 1].texture) {
+        SDL_DestroyTexture(cache[SC_DISPLAY_TEXTURE_CACHE_SIZE - 1].texture);
+    }
+
+    memmove(&cache[1], &cache[0],
+            (SC_DISPLAY_TEXTURE_CACHE_SIZE - 1) * sizeof(*cache));
+    cache[0].texture = texture;
+    cache[0].format = format;
+    cache[0].size = size;
+}
+
+// Return a texture of the current format for the given allocated size, from
+// the cache if possible (then `cached` is set)
+static SDL_Texture *
+sc_display_acquire_texture(struct sc_display *display, struct sc_size size,
+                           bool *cached) {
+    SDL_Texture *texture =
+        sc_display_cache_take(display, display->texture_format, size);
+    if (texture) {
+        if (display->mipmaps) {
+            // The downscaling state may have changed since it was used
+            struct sc_opengl *gl = &display->gl;
+            SDL_GL_BindTexture(texture, NULL, NULL);
+            GLint min_filter = display->downscaling ? GL_LINEAR_MIPMAP_LINEAR
+                                                    : GL_LINEAR;
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+            SDL_GL_UnbindTexture(texture);
+        }
+
+        *cached = true;
+        return texture;
+    }
+
+    *cached = false;
+    texture = sc_display_create_texture(display, size);
+    if (texture) {
+        display->prepare_transposed = true;
+    }
     return texture;
 }
 
+// Move the current texture (if any) to the cache
+static void
+sc_display_release_texture(struct sc_display *display) {
+    if (display->texture) {
+        sc_display_cache_put(display, display->texture, display->texture_format,
+                             display->texture_alloc_size);
+        display->texture = NULL;
+    }
+}
+
+// Pre-allocate a texture for the transposed size of the current texture, so
+// that a device rotation does not wait for a texture creation
+static void
+sc_display_prepare_transposed_texture(struct sc_display *display) {
+    assert(display->texture);
+
+    struct sc_size size = display->texture_size;
+    struct sc_size transposed = {size.height, size.width};
+    struct sc_size alloc_size = sc_display_get_alloc_size(transposed);
+    if (alloc_size.width == display->texture_alloc_size.width
+            && alloc_size.height == display->texture_alloc_size.height) {
+        // The current texture is also used for the rotated size
+        return;
+    }
+
+    if (sc_display_cache_find(display, display->texture_format, alloc_size)
+            != -1) {
+        // Already available
+        return;
+    }
+
+    SDL_Texture *texture = sc_display_create_texture(display, alloc_size);
+    if (!texture) {
+        // Not fatal, the texture will just be created on rotation
+        return;
+    }
+
+    sc_display_cache_put(display, texture, display->texture_format,
+                         alloc_size);
+}
+
 static inline void
 sc_display_set_pending_size(struct sc_display *display, struct sc_size size) {
     assert(!display->texture);
@@ -191,12 +734,18 @@ static bool
 sc_display_apply_pending(struct sc_display *display) {
     if (display->pending.flags & SC_DISPLAY_PENDING_FLAG_SIZE) {
         assert(!display->texture);
+        struct sc_size alloc_size =
+            sc_display_get_alloc_size(display->pending.size);
+        bool cached;
         display->texture =
-            sc_display_create_texture(display, display->pending.size);
+            sc_display_acquire_texture(display, alloc_size, &cached);
         if (!display->texture) {
             return false;
         }
 
+        display->texture_size = display->pending.size;
+        display->texture_alloc_size = alloc_size;
+
         display->pending.flags &= ~SC_DISPLAY_PENDING_FLAG_SIZE;
     }
 
@@ -220,21 +769,78 @@ sc_display_set_texture_size_internal(struct sc_display *display,
                                      struct sc_size size) {
     assert(size.width && size.height);
 
-    if (display->texture) {
-        SDL_DestroyTexture(display->texture);
+    struct sc_size alloc_size = sc_display_get_alloc_size(size);
+
+    if (display->texture
+            && display->texture_alloc_size.width == alloc_size.width
+            && display->texture_alloc_size.height == alloc_size.height) {
+        // Only the area rendered from the texture changes
+        display->texture_size = size;
+        LOGI("Texture: %" PRIu16 "x%" PRIu16 " (reused)", size.width,
+             size.height);
+        return true;
+    }
+
+    // Typically on device rotation, the texture is swapped with the one
+    // pre-allocated for the transposed size, and the current one is kept for
+    // the next rotation
+    bool cached;
+    SDL_Texture *texture =
+        sc_display_acquire_texture(display, alloc_size, &cached);
+    sc_display_release_texture(display);
+    if (!texture) {
+        return false;
+    }
+
+    display->texture = texture;
+    display->texture_size = size;
+    display->texture_alloc_size = alloc_size;
+
+    LOGI("Texture: %" PRIu16 "x%" PRIu16 "%s", size.width, size.height,
+         cached ? " (cached)" : "");
+    return true;
+}
+
+// Recreate the texture if the pixel format of the frame has changed
+static bool
+sc_display_set_texture_format(struct sc_display *display,
+                              enum AVPixelFormat format) {
+    uint32_t sdl_format = sc_display_to_sdl_pixel_format(format);
+    // The decoder only outputs frames in formats supported by the display
+    assert(sdl_format != SDL_PIXELFORMAT_UNKNOWN);
+
+    if (display->texture && sdl_format == display->texture_format) {
+        // Nothing to do
+        return true;
     }
 
-    display->texture = sc_display_create_texture(display, size);
+    // The texture is kept in the cache for its format
+    sc_display_release_texture(display);
+
+    display->texture_format = sdl_format;
+    bool cached;
+    display->texture = sc_display_acquire_texture(display,
+                                                  display->texture_alloc_size,
+                                                  &cached);
     if (!display->texture) {
         return false;
     }
 
-    LOGI("Texture: %" PRIu16 "x%" PRIu16, size.width, size.height);
+    LOGD("Texture format: %s%s", SDL_GetPixelFormatName(sdl_format),
+         cached ? " (cached)" : "");
     return true;
 }
 
 enum sc_display_result
 sc_display_set_texture_size(struct sc_display *display, struct sc_size size) {
+    if (display->shader.enabled || display->sws.enabled) {
+        // The textures are (re)allocated on upload or on render, for the
+        // format and the size of the frame
+        display->texture_size = size;
+        LOGI("Texture: %" PRIu16 "x%" PRIu16, size.width, size.height);
+        return SC_DISPLAY_RESULT_OK;
+    }
+
     bool ok = sc_display_set_texture_size_internal(display, size);
     if (!ok) {
         sc_display_set_pending_size(display, size);
@@ -251,9 +857,387 @@ sc_display_to_sdl_color_range(enum AVColorRange color_range) {
                                            : SDL_YUV_CONVERSION_AUTOMATIC;
 }
 
+static bool
+sc_display_has_positive_strides(const AVFrame *frame, int plane_count) {
+    for (int i = 0; i < plane_count; ++i) {
+        if (frame->linesize[i] <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copy the frame planes into the next pixel buffer object of the ring.
+//
+// On success, the buffer is left bound to GL_PIXEL_UNPACK_BUFFER, and the
+// offset of each plane in the buffer is written to offsets.
+static bool
+sc_display_pbo_write_frame(struct sc_display *display, const AVFrame *frame,
+                           int plane_count, size_t offsets[3]) {
+    struct sc_opengl *gl = &display->gl;
+
+    assert(sc_display_has_positive_strides(frame, plane_count));
+
+    int chroma_height = (frame->height + 1) / 2;
+
+    size_t total_size = 0;
+    for (int i = 0; i < plane_count; ++i) {
+        int height = i ? chroma_height : frame->height;
+        offsets[i] = total_size;
+        total_size += (size_t) frame->linesize[i] * height;
+    }
+
+    if (!display->pbo.initialized) {
+        gl->GenBuffers(SC_DISPLAY_PBO_COUNT, display->pbo.ids);
+        memset(display->pbo.sizes, 0, sizeof(display->pbo.sizes));
+        display->pbo.initialized = true;
+    }
+
+    unsigned index = display->pbo.index;
+    display->pbo.index = (index + 1) % SC_DISPLAY_PBO_COUNT;
+
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, display->pbo.ids[index]);
+    if (display->pbo.sizes[index] < total_size) {
+        gl->BufferData(GL_PIXEL_UNPACK_BUFFER, total_size, NULL,
+                       GL_STREAM_DRAW);
+        display->pbo.sizes[index] = total_size;
+    }
+
+    // Invalidate the previous content, so that the driver never waits for a
+    // pending transfer from this buffer
+    uint8_t *mapped =
+        gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total_size,
+                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        LOGW("Could not map pixel buffer object");
+        return false;
+    }
+
+    for (int i = 0; i < plane_count; ++i) {
+        int height = i ? chroma_height : frame->height;
+        memcpy(mapped + offsets[i], frame->data[i],
+               (size_t) frame->linesize[i] * height);
+    }
+
+    gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    return true;
+}
+
+// Upload the frame planes through the next pixel buffer object of the ring.
+//
+// The frame is copied into the buffer, then the copy to the texture is
+// performed asynchronously by the driver, instead of blocking the main thread
+// until the data has been transferred, like SDL_UpdateYUVTexture() does.
+static bool
+sc_display_update_texture_pbo(struct sc_display *display,
+                              const AVFrame *frame) {
+    struct sc_opengl *gl = &display->gl;
+
+    bool nv = frame->format == AV_PIX_FMT_NV12
+           || frame->format == AV_PIX_FMT_NV21;
+    int plane_count = nv ? 2 : 3;
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+
+    if (!sc_display_has_positive_strides(frame, plane_count)) {
+        // Negative strides are not supported
+        return false;
+    }
+
+    if (SDL_GL_BindTexture(display->texture, NULL, NULL)) {
+        LOGW("Could not bind texture: %s", SDL_GetError());
+        goto disable;
+    }
+
+    // SDL binds the texture of each plane to its own texture unit (0 for Y,
+    // 1 for U or UV, 2 for V)
+    for (int i = plane_count - 1; i >= 0; --i) {
+        GLint texture_id;
+        gl->ActiveTexture(GL_TEXTURE0 + i);
+        gl->GetIntegerv(GL_TEXTURE_BINDING_2D, &texture_id);
+        if (!texture_id) {
+            gl->ActiveTexture(GL_TEXTURE0);
+            SDL_GL_UnbindTexture(display->texture);
+            LOGW("Unexpected texture layout for pixel buffer objects");
+            goto disable;
+        }
+    }
+
+    size_t offsets[3];
+    if (!sc_display_pbo_write_frame(display, frame, plane_count, offsets)) {
+        gl->ActiveTexture(GL_TEXTURE0);
+        SDL_GL_UnbindTexture(display->texture);
+        goto disable;
+    }
+
+    // Upload the Y plane last, to leave texture unit 0 active for SDL
+    for (int i = plane_count - 1; i >= 0; --i) {
+        int width = i ? chroma_width : frame->width;
+        int height = i ? chroma_height : frame->height;
+        // The interleaved UV plane of NV12/NV21 has 2 bytes per pixel
+        bool uv = nv && i == 1;
+        GLenum format = uv ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+        int row_length = uv ? frame->linesize[i] / 2 : frame->linesize[i];
+
+        gl->ActiveTexture(GL_TEXTURE0 + i);
+        gl->PixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+        gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format,
+                          GL_UNSIGNED_BYTE,
+                          (const void *) (uintptr_t) offsets[i]);
+    }
+
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    SDL_GL_UnbindTexture(display->texture);
+
+    return true;
+
+disable:
+    LOGW("Texture upload through pixel buffer objects disabled");
+    display->pbo.enabled = false;
+    return false;
+}
+
+static bool
+sc_display_update_texture_sdl(struct sc_display *display,
+                              const AVFrame *frame) {
+    // Only the frame area of the texture
+    SDL_Rect rect = {0, 0, frame->width, frame->height};
+
+    int ret;
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    if (frame->format == AV_PIX_FMT_NV12 || frame->format == AV_PIX_FMT_NV21) {
+        ret = SDL_UpdateNVTexture(display->texture, &rect,
+                                  frame->data[0], frame->linesize[0],
+                                  frame->data[1], frame->linesize[1]);
+    } else
+#endif
+    {
+        ret = SDL_UpdateYUVTexture(display->texture, &rect,
+                                   frame->data[0], frame->linesize[0],
+                                   frame->data[1], frame->linesize[1],
+                                   frame->data[2], frame->linesize[2]);
+    }
+    if (ret) {
+        LOGD("Could not update texture: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+static GLint
+sc_display_get_min_filter(struct sc_display *display) {
+    return display->mipmaps && display->downscaling ? GL_LINEAR_MIPMAP_LINEAR
+                                                    : GL_LINEAR;
+}
+
+static void
+sc_display_shader_alloc_textures(struct sc_display *display,
+                                 enum AVPixelFormat format,
+                                 struct sc_size size) {
+    struct sc_opengl *gl = &display->gl;
+
+    bool nv = format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_NV21;
+    int plane_count = nv ? 2 : 3;
+
+    // Initialize the textures with black, so that the padding beyond the
+    // frame area does not bleed into the mipmaps (if the allocation fails,
+    // the content is just undefined)
+    size_t y_size;
+    uint8_t *black = sc_display_alloc_black_planes(size, &y_size);
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int i = 0; i < plane_count; ++i) {
+        int width = i ? (size.width + 1) / 2 : size.width;
+        int height = i ? (size.height + 1) / 2 : size.height;
+        // The interleaved UV plane of NV12/NV21 has 2 bytes per pixel
+        bool uv = nv && i == 1;
+        const void *data = black ? (i ? black + y_size : black) : NULL;
+
+        gl->BindTexture(GL_TEXTURE_2D, display->shader.textures[i]);
+        gl->TexImage2D(GL_TEXTURE_2D, 0, uv ? GL_RG8 : GL_R8, width, height,
+                       0, uv ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, data);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                          sc_display_get_min_filter(display));
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                          GL_CLAMP_TO_EDGE);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                          GL_CLAMP_TO_EDGE);
+        if (display->mipmaps) {
+            gl->TexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, -1.f);
+        }
+    }
+
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+    free(black);
+
+    display->shader.texture_format = format;
+    display->shader.texture_size = size;
+
+    LOGD("Shader textures: %" PRIu16 "x%" PRIu16 " (%s)", size.width,
+         size.height, nv ? "2 planes" : "3 planes");
+}
+
+// Compute the YUV to RGB conversion of the frame, according to its color
+// space and color range
+static void
+sc_display_shader_set_colors(struct sc_display *display,
+                             const AVFrame *frame) {
+    // Luma coefficients of red and blue
+    double kr;
+    double kb;
+    switch (frame->colorspace) {
+        case AVCOL_SPC_BT709:
+            kr = 0.2126;
+            kb = 0.0722;
+            break;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            kr = 0.2627;
+            kb = 0.0593;
+            break;
+        case AVCOL_SPC_SMPTE170M:
+        case AVCOL_SPC_BT470BG:
+            kr = 0.299;
+            kb = 0.114;
+            break;
+        default:
+            // Unspecified: like SDL_YUV_CONVERSION_AUTOMATIC, BT.709 for HD,
+            // BT.601 for SD
+            if (frame->height > 576) {
+                kr = 0.2126;
+                kb = 0.0722;
+            } else {
+                kr = 0.299;
+                kb = 0.114;
+            }
+            break;
+    }
+    double kg = 1 - kr - kb;
+
+    bool full_range = frame->color_range == AVCOL_RANGE_JPEG;
+    // Expand the limited range ([16, 235] for luma, [16, 240] for chroma)
+    double y_scale = full_range ? 1 : 255. / 219;
+    double c_scale = full_range ? 1 : 255. / 224;
+
+    GLfloat *m = display->shader.matrix;
+    // Column 0: Y
+    m[0] = y_scale;
+    m[1] = y_scale;
+    m[2] = y_scale;
+    // Column 1: Cb
+    m[3] = 0;
+    m[4] = -c_scale * 2 * kb * (1 - kb) / kg;
+    m[5] = c_scale * 2 * (1 - kb);
+    // Column 2: Cr
+    m[6] = c_scale * 2 * (1 - kr);
+    m[7] = -c_scale * 2 * kr * (1 - kr) / kg;
+    m[8] = 0;
+
+    GLfloat *offset = display->shader.offset;
+    offset[0] = full_range ? 0 : 16. / 255;
+    offset[1] = 128. / 255;
+    offset[2] = 128. / 255;
+}
+
+// Upload the frame planes to the textures sampled by the YUV shader, through
+// a pixel buffer object if enabled
+static bool
+sc_display_shader_update_texture(struct sc_display *display,
+                                 const AVFrame *frame) {
+    struct sc_opengl *gl = &display->gl;
+
+    if (!sc_display_make_gl_current(display)) {
+        return false;
+    }
+
+    bool nv = frame->format == AV_PIX_FMT_NV12
+           || frame->format == AV_PIX_FMT_NV21;
+    int plane_count = nv ? 2 : 3;
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+
+    if (!sc_display_has_positive_strides(frame, plane_count)) {
+        LOGE("Negative strides are not supported by the YUV shader");
+        return false;
+    }
+
+    struct sc_size size = {frame->width, frame->height};
+    struct sc_size alloc_size = sc_display_get_alloc_size(size);
+    if (frame->format != display->shader.texture_format
+            || alloc_size.width != display->shader.texture_size.width
+            || alloc_size.height != display->shader.texture_size.height) {
+        sc_display_shader_alloc_textures(display, frame->format, alloc_size);
+    }
+    display->shader.frame_size = size;
+
+    sc_display_shader_set_colors(display, frame);
+
+    size_t offsets[3];
+    bool pbo = display->pbo.enabled
+            && sc_display_pbo_write_frame(display, frame, plane_count,
+                                          offsets);
+    if (display->pbo.enabled && !pbo) {
+        LOGW("Texture upload through pixel buffer objects disabled");
+        display->pbo.enabled = false;
+    }
+
+    // The rows are not necessarily aligned on 4 bytes
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int i = 0; i < plane_count; ++i) {
+        int width = i ? chroma_width : frame->width;
+        int height = i ? chroma_height : frame->height;
+        bool uv = nv && i == 1;
+        int row_length = uv ? frame->linesize[i] / 2 : frame->linesize[i];
+        const void *data = pbo ? (const void *) (uintptr_t) offsets[i]
+                               : frame->data[i];
+
+        gl->BindTexture(GL_TEXTURE_2D, display->shader.textures[i]);
+        gl->PixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+        gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                          uv ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, data);
+        if (display->mipmaps && display->downscaling) {
+            gl->GenerateMipmap(GL_TEXTURE_2D);
+        }
+    }
+
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (pbo) {
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+
+    return true;
+}
+
 static bool
 sc_display_update_texture_internal(struct sc_display *display,
                                    const AVFrame *frame) {
+    if (display->shader.enabled) {
+        // The color space and range are handled by the shader, for each frame
+        display->has_frame = true;
+        return sc_display_shader_update_texture(display, frame);
+    }
+
+    if (display->sws.enabled) {
+        // The frame is converted on render, once the content size is known
+        av_frame_unref(display->sws.frame);
+        if (av_frame_ref(display->sws.frame, frame)) {
+            LOG_OOM();
+            return false;
+        }
+        display->sws.dirty = true;
+        display->has_frame = true;
+        return true;
+    }
+
     if (!display->has_frame) {
         // First frame
         display->has_frame = true;
@@ -264,16 +1248,21 @@ sc_display_update_texture_internal(struct sc_display *display,
         SDL_SetYUVConversionMode(sdl_color_range);
     }
 
-    int ret = SDL_UpdateYUVTexture(display->texture, NULL,
-                                   frame->data[0], frame->linesize[0],
-                                   frame->data[1], frame->linesize[1],
-                                   frame->data[2], frame->linesize[2]);
-    if (ret) {
-        LOGD("Could not update texture: %s", SDL_GetError());
+    bool ok = sc_display_set_texture_format(display, frame->format);
+    if (!ok) {
         return false;
     }
 
-    if (display->mipmaps) {
+    bool uploaded = display->pbo.enabled
+                 && sc_display_update_texture_pbo(display, frame);
+    if (!uploaded) {
+        ok = sc_display_update_texture_sdl(display, frame);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (display->mipmaps && display->downscaling) {
         SDL_GL_BindTexture(display->texture, NULL, NULL);
         display->gl.GenerateMipmap(GL_TEXTURE_2D);
         SDL_GL_UnbindTexture(display->texture);
@@ -284,7 +1273,9 @@ sc_display_update_texture_internal(struct sc_display *display,
 
 enum sc_display_result
 sc_display_update_texture(struct sc_display *display, const AVFrame *frame) {
+    sc_tick begin = sc_trace_begin();
     bool ok = sc_display_update_texture_internal(display, frame);
+    sc_trace_end("texture_upload", begin);
     if (!ok) {
         ok = sc_display_set_pending_frame(display, frame);
         if (!ok) {
@@ -298,9 +1289,339 @@ sc_display_update_texture(struct sc_display *display, const AVFrame *frame) {
     return SC_DISPLAY_RESULT_OK;
 }
 
+void
+sc_display_set_downscaling(struct sc_display *display, bool downscaling) {
+    if (downscaling == display->downscaling) {
+        // Nothing to do
+        return;
+    }
+
+    display->downscaling = downscaling;
+
+    if (display->shader.enabled) {
+        if (!display->mipmaps
+                || display->shader.texture_format == AV_PIX_FMT_NONE) {
+            return;
+        }
+
+        LOGV("Trilinear filtering %s", downscaling ? "active" : "inactive");
+
+        // Like for the SDL texture, the mipmaps must be up-to-date before the
+        // textures are sampled with a mipmap filter
+        struct sc_opengl *gl = &display->gl;
+        enum AVPixelFormat format = display->shader.texture_format;
+        int plane_count =
+            format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_NV21 ? 2 : 3;
+        for (int i = 0; i < plane_count; ++i) {
+            gl->BindTexture(GL_TEXTURE_2D, display->shader.textures[i]);
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                              sc_display_get_min_filter(display));
+            if (downscaling && display->has_frame) {
+                gl->GenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+        gl->BindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    if (!display->mipmaps || !display->texture) {
+        return;
+    }
+
+    LOGV("Trilinear filtering %s", downscaling ? "active" : "inactive");
+
+    struct sc_opengl *gl = &display->gl;
+
+    SDL_GL_BindTexture(display->texture, NULL, NULL);
+
+    if (downscaling) {
+        // The mipmaps have not been generated while upscaling, the texture
+        // must not be sampled until they are up-to-date
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                          GL_LINEAR_MIPMAP_LINEAR);
+        if (display->has_frame) {
+            gl->GenerateMipmap(GL_TEXTURE_2D);
+        }
+    } else {
+        // Do not reference the (outdated) mipmaps
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    SDL_GL_UnbindTexture(display->texture);
+}
+
+// Texture coordinates of the point (u, v) of the content (both in [0, 1],
+// from the top-left corner), for the given orientation
+static void
+sc_display_get_texcoords(enum sc_orientation orientation, GLfloat u,
+                         GLfloat v, GLfloat *s, GLfloat *t) {
+    switch (orientation) {
+        case SC_ORIENTATION_0:
+            *s = u;
+            *t = v;
+            break;
+        case SC_ORIENTATION_90:
+            *s = v;
+            *t = 1 - u;
+            break;
+        case SC_ORIENTATION_180:
+            *s = 1 - u;
+            *t = 1 - v;
+            break;
+        case SC_ORIENTATION_270:
+            *s = 1 - v;
+            *t = u;
+            break;
+        case SC_ORIENTATION_FLIP_0:
+            *s = 1 - u;
+            *t = v;
+            break;
+        case SC_ORIENTATION_FLIP_90:
+            *s = 1 - v;
+            *t = 1 - u;
+            break;
+        case SC_ORIENTATION_FLIP_180:
+            *s = u;
+            *t = 1 - v;
+            break;
+        default:
+            assert(orientation == SC_ORIENTATION_FLIP_270);
+            *s = v;
+            *t = u;
+            break;
+    }
+}
+
+// Draw the frame in a single draw call: the YUV to RGB conversion, the
+// orientation and the scaling to the content rectangle are all performed by
+// the shader, without any intermediate texture.
+//
+// The SDL renderer is not used to draw anything while the shader is enabled,
+// so its cached OpenGL state does not need to be restored.
+static enum sc_display_result
+sc_display_shader_render(struct sc_display *display, const SDL_Rect *geometry,
+                         enum sc_orientation orientation) {
+    struct sc_opengl *gl = &display->gl;
+
+    if (!sc_display_make_gl_current(display)) {
+        return SC_DISPLAY_RESULT_ERROR;
+    }
+
+    int output_width;
+    int output_height;
+    if (SDL_GetRendererOutputSize(display->renderer, &output_width,
+                                  &output_height)) {
+        LOGE("Could not get renderer output size: %s", SDL_GetError());
+        return SC_DISPLAY_RESULT_ERROR;
+    }
+
+    gl->Disable(GL_SCISSOR_TEST);
+    gl->Disable(GL_BLEND);
+    gl->Viewport(0, 0, output_width, output_height);
+    gl->ClearColor(0, 0, 0, 1);
+    gl->Clear(GL_COLOR_BUFFER_BIT);
+
+    enum AVPixelFormat format = display->shader.texture_format;
+    if (format == AV_PIX_FMT_NONE) {
+        // No frame uploaded yet
+        return SC_DISPLAY_RESULT_OK;
+    }
+
+    // The OpenGL origin is the bottom-left corner
+    gl->Viewport(geometry->x, output_height - geometry->y - geometry->h,
+                 geometry->w, geometry->h);
+
+    // Only the frame area of the textures is rendered
+    struct sc_size frame_size = display->shader.frame_size;
+    struct sc_size texture_size = display->shader.texture_size;
+    GLfloat max_s = (GLfloat) frame_size.width / texture_size.width;
+    GLfloat max_t = (GLfloat) frame_size.height / texture_size.height;
+
+    // Triangle strip: top-left, top-right, bottom-left, bottom-right
+    // (x, y, s, t) for each vertex
+    GLfloat vertices[16];
+    for (int i = 0; i < 4; ++i) {
+        GLfloat u = i & 1;
+        GLfloat v = i >> 1;
+        GLfloat *vertex = &vertices[i * 4];
+        vertex[0] = 2 * u - 1;
+        vertex[1] = 1 - 2 * v;
+        sc_display_get_texcoords(orientation, u, v, &vertex[2], &vertex[3]);
+        vertex[2] *= max_s;
+        vertex[3] *= max_t;
+    }
+
+    // The last texel centers of the frame area, to never interpolate with the
+    // padding (the chroma planes have half the size)
+    GLfloat texcoord_max[4] = {
+        (frame_size.width - 0.5f) / texture_size.width,
+        (frame_size.height - 0.5f) / texture_size.height,
+        ((frame_size.width + 1) / 2 - 0.5f) / ((texture_size.width + 1) / 2),
+        ((frame_size.height + 1) / 2 - 0.5f) / ((texture_size.height + 1) / 2),
+    };
+
+    int plane_count;
+    GLint shader_format;
+    if (format == AV_PIX_FMT_NV12) {
+        plane_count = 2;
+        shader_format = SC_DISPLAY_SHADER_FORMAT_NV12;
+    } else if (format == AV_PIX_FMT_NV21) {
+        plane_count = 2;
+        shader_format = SC_DISPLAY_SHADER_FORMAT_NV21;
+    } else {
+        plane_count = 3;
+        shader_format = SC_DISPLAY_SHADER_FORMAT_PLANAR;
+    }
+
+    gl->UseProgram(display->shader.program);
+
+    for (int i = plane_count - 1; i >= 0; --i) {
+        gl->ActiveTexture(GL_TEXTURE0 + i);
+        gl->BindTexture(GL_TEXTURE_2D, display->shader.textures[i]);
+    }
+
+    gl->Uniform1i(display->shader.format_location, shader_format);
+    gl->UniformMatrix3fv(display->shader.matrix_location, 1, GL_FALSE,
+                         display->shader.matrix);
+    gl->Uniform3fv(display->shader.offset_location, 1,
+                   display->shader.offset);
+    gl->Uniform4fv(display->shader.texcoord_max_location, 1, texcoord_max);
+
+    // The vertices are read from client memory
+    gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl->VertexAttribPointer(SC_DISPLAY_SHADER_ATTRIB_POSITION, 2, GL_FLOAT,
+                            GL_FALSE, 4 * sizeof(GLfloat), &vertices[0]);
+    gl->VertexAttribPointer(SC_DISPLAY_SHADER_ATTRIB_TEXCOORD, 2, GL_FLOAT,
+                            GL_FALSE, 4 * sizeof(GLfloat), &vertices[2]);
+    gl->EnableVertexAttribArray(SC_DISPLAY_SHADER_ATTRIB_POSITION);
+    gl->EnableVertexAttribArray(SC_DISPLAY_SHADER_ATTRIB_TEXCOORD);
+
+    gl->DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    gl->DisableVertexAttribArray(SC_DISPLAY_SHADER_ATTRIB_TEXCOORD);
+    gl->DisableVertexAttribArray(SC_DISPLAY_SHADER_ATTRIB_POSITION);
+    gl->UseProgram(0);
+
+    return SC_DISPLAY_RESULT_OK;
+}
+
+static bool
+sc_display_sws_prepare_texture(struct sc_display *display,
+                               struct sc_size size) {
+    if (display->sws.texture
+            && display->sws.texture_size.width == size.width
+            && display->sws.texture_size.height == size.height) {
+        // Nothing to do
+        return true;
+    }
+
+    if (display->sws.texture) {
+        SDL_DestroyTexture(display->sws.texture);
+    }
+
+    // SDL_PIXELFORMAT_ARGB8888 matches AV_PIX_FMT_RGB32 (native-endian
+    // packed ARGB), the native format of the software renderer
+    display->sws.texture =
+        SDL_CreateTexture(display->renderer, SDL_PIXELFORMAT_ARGB8888,
+                          SDL_TEXTUREACCESS_STREAMING, size.width, size.height);
+    if (!display->sws.texture) {
+        LOGE("Could not create texture: %s", SDL_GetError());
+        return false;
+    }
+
+    display->sws.texture_size = size;
+    return true;
+}
+
+static bool
+sc_display_sws_convert(struct sc_display *display) {
+    SDL_Texture *texture = display->sws.texture;
+    struct sc_size size = display->sws.texture_size;
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+        LOGE("Could not lock texture: %s", SDL_GetError());
+        return false;
+    }
+
+    const AVFrame *frame = display->sws.frame;
+    bool scaled = frame->width != size.width || frame->height != size.height;
+    int flags = scaled ? SWS_FAST_BILINEAR : SWS_POINT;
+
+    uint8_t *const data[4] = {pixels};
+    const int linesize[4] = {pitch};
+    bool ok = sc_frame_converter_convert(&display->sws.converter, frame, data,
+                                         linesize, AV_PIX_FMT_RGB32,
+                                         size.width, size.height, flags);
+
+    SDL_UnlockTexture(texture);
+    return ok;
+}
+
+// Convert the last frame to the RGB texture at the size it is rendered, so
+// that the software renderer only copies (and possibly rotates) the pixels
+static SDL_Texture *
+sc_display_sws_prepare(struct sc_display *display, const SDL_Rect *geometry,
+                       enum sc_orientation orientation) {
+    assert(display->sws.enabled);
+    assert(display->has_frame);
+    assert(geometry->w > 0 && geometry->h > 0);
+
+    // The texture is rotated by the renderer
+    bool swap = sc_orientation_is_swap(orientation);
+    struct sc_size size = {
+        .width = swap ? geometry->h : geometry->w,
+        .height = swap ? geometry->w : geometry->h,
+    };
+
+    bool resized = !display->sws.texture
+                || display->sws.texture_size.width != size.width
+                || display->sws.texture_size.height != size.height;
+    if (!resized && !display->sws.dirty) {
+        // Already converted
+        return display->sws.texture;
+    }
+
+    bool ok = sc_display_sws_prepare_texture(display, size);
+    if (!ok) {
+        return NULL;
+    }
+
+    sc_tick begin = sc_trace_begin();
+    ok = sc_display_sws_convert(display);
+    sc_trace_end("sws_convert", begin);
+    if (!ok) {
+        return NULL;
+    }
+
+    display->sws.dirty = false;
+    return display->sws.texture;
+}
+
 enum sc_display_result
 sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
                   enum sc_orientation orientation) {
+    if (display->shader.enabled) {
+        if (display->pending.flags) {
+            bool ok = sc_display_apply_pending(display);
+            if (!ok) {
+                return SC_DISPLAY_RESULT_PENDING;
+            }
+        }
+
+        // Do not call SDL_RenderClear(): the SDL commands are batched, so the
+        // clear would be executed on SDL_RenderPresent(), after the draw
+        enum sc_display_result res =
+            sc_display_shader_render(display, geometry, orientation);
+        if (res != SC_DISPLAY_RESULT_OK) {
+            return res;
+        }
+
+        SDL_RenderPresent(display->renderer);
+        return SC_DISPLAY_RESULT_OK;
+    }
+
     SDL_RenderClear(display->renderer);
 
     if (display->pending.flags) {
@@ -313,8 +1634,29 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
     SDL_Renderer *renderer = display->renderer;
     SDL_Texture *texture = display->texture;
 
+    // Only the frame area of the texture (the whole texture for the icon
+    // displayed without video)
+    SDL_Rect frame_rect = {0, 0, display->texture_size.width,
+                           display->texture_size.height};
+    const SDL_Rect *srcrect = display->has_frame ? &frame_rect : NULL;
+
+    if (display->sws.enabled && display->has_frame) {
+        if (geometry->w <= 0 || geometry->h <= 0) {
+            // Nothing to render
+            SDL_RenderPresent(display->renderer);
+            return SC_DISPLAY_RESULT_OK;
+        }
+
+        texture = sc_display_sws_prepare(display, geometry, orientation);
+        if (!texture) {
+            return SC_DISPLAY_RESULT_ERROR;
+        }
+        // The RGB texture has exactly the content size
+        srcrect = NULL;
+    }
+
     if (orientation == SC_ORIENTATION_0) {
-        int ret = SDL_RenderCopy(renderer, texture, NULL, geometry);
+        int ret = SDL_RenderCopy(renderer, texture, srcrect, geometry);
         if (ret) {
             LOGE("Could not render texture: %s", SDL_GetError());
             return SC_DISPLAY_RESULT_ERROR;
@@ -338,8 +1680,8 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
         SDL_RendererFlip flip = sc_orientation_is_mirror(orientation)
                               ? SDL_FLIP_HORIZONTAL : 0;
 
-        int ret = SDL_RenderCopyEx(renderer, texture, NULL, dstrect, angle,
-                                   NULL, flip);
+        int ret = SDL_RenderCopyEx(renderer, texture, srcrect, dstrect,
+                                   angle, NULL, flip);
         if (ret) {
             LOGE("Could not render texture: %s", SDL_GetError());
             return SC_DISPLAY_RESULT_ERROR;
@@ -347,5 +1689,56 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
     }
 
     SDL_RenderPresent(display->renderer);
+
+    if (display->prepare_transposed && display->has_frame
+            && display->texture) {
+        // Once the frame is presented, so that the first frame of a new size
+        // is not delayed by the additional texture creation
+        display->prepare_transposed = false;
+        sc_display_prepare_transposed_texture(display);
+    }
+
     return SC_DISPLAY_RESULT_OK;
 }
+
+// All the frame textures are YUV 4:2:0 (1.5 byte per pixel)
+static size_t
+sc_display_yuv_texture_bytes(struct sc_size size) {
+    return (size_t) size.width * size.height * 3 / 2;
+}
+
+size_t
+sc_display_get_texture_bytes(const struct sc_display *display) {
+    size_t bytes = 0;
+
+    if (display->texture) {
+        bytes += sc_display_yuv_texture_bytes(display->texture_alloc_size);
+    }
+
+    for (unsigned i = 0; i < SC_DISPLAY_TEXTURE_CACHE_SIZE; ++i) {
+        const struct sc_display_cached_texture *cached =
+            &display->texture_cache[i];
+        if (cached->texture) {
+            bytes += sc_display_yuv_texture_bytes(cached->size);
+        }
+    }
+
+    if (display->shader.enabled
+            && display->shader.texture_format != AV_PIX_FMT_NONE) {
+        bytes += sc_display_yuv_texture_bytes(display->shader.texture_size);
+    }
+
+    if (display->pbo.initialized) {
+        for (unsigned i = 0; i < SC_DISPLAY_PBO_COUNT; ++i) {
+            bytes += display->pbo.sizes[i];
+        }
+    }
+
+    if (display->sws.enabled && display->sws.texture) {
+        // ARGB8888
+        struct sc_size size = display->sws.texture_size;
+        bytes += (size_t) size.width * size.height * 4;
+    }
+
+    return bytes;
+}
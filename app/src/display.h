@@ -6,9 +6,11 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
 #include <SDL2/SDL.h>
 
 #include "coords.h"
+#include "frame_converter.h"
 #include "opengl.h"
 #include "options.h"
 
@@ -17,8 +19,32 @@
 #endif
 
 struct sc_display {
+    SDL_Window *window;
     SDL_Renderer *renderer;
+    // The OpenGL context of the renderer (NULL if it is not an OpenGL
+    // renderer), made current before any raw OpenGL call: with several
+    // windows, the current context is the one of the last used renderer
+    SDL_GLContext renderer_gl_context;
     SDL_Texture *texture;
+    uint32_t texture_format; // SDL_PixelFormatEnum
+    struct sc_size texture_size; // the size of the frames
+    // The textures are allocated at the frame size aligned to the coded block
+    // size, and only the frame area is rendered: a frame size change which
+    // only moves the cropping within the coded size reuses the texture
+    struct sc_size texture_alloc_size;
+    // Textures previously used or pre-allocated (for the transposed size of
+    // the current texture), most recently used first, so that a device
+    // rotation or a format change swaps the textures instead of allocating
+    // them
+    struct sc_display_cached_texture {
+#define SC_DISPLAY_TEXTURE_CACHE_SIZE 3
+        SDL_Texture *texture; // NULL if the entry is unused
+        uint32_t format; // SDL_PixelFormatEnum
+        struct sc_size size; // allocated size
+    } texture_cache[SC_DISPLAY_TEXTURE_CACHE_SIZE];
+    // A texture has been created, the texture for the transposed size must be
+    // pre-allocated once its first frame is presented
+    bool prepare_transposed;
 
     struct sc_opengl gl;
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
@@ -26,6 +52,57 @@ struct sc_display {
 #endif
 
     bool mipmaps;
+    // Whether the texture is rendered smaller than its size (mipmaps are
+    // only generated in that case)
+    bool downscaling;
+
+    // Ring of pixel buffer objects to upload the frames asynchronously
+    struct {
+#define SC_DISPLAY_PBO_COUNT 3
+        bool enabled;
+        bool initialized;
+        GLuint ids[SC_DISPLAY_PBO_COUNT];
+        size_t sizes[SC_DISPLAY_PBO_COUNT];
+        unsigned index; // index of the next buffer to use
+    } pbo;
+
+    // Render the frames with a custom shader converting YUV to RGB, instead
+    // of the SDL renderer (which converts YUV with a global conversion mode
+    // and may copy the frames internally)
+    struct {
+        bool enabled;
+        GLuint program;
+        GLint format_location;
+        GLint matrix_location;
+        GLint offset_location;
+        GLint texcoord_max_location;
+        // One texture per plane (the UV plane is interleaved for NV12/NV21)
+        GLuint textures[3];
+        // The format and (aligned) size the textures are allocated for
+        // (AV_PIX_FMT_NONE if not allocated)
+        enum AVPixelFormat texture_format;
+        struct sc_size texture_size;
+        // The size of the last uploaded frame, rendered from the top-left
+        // corner of the textures
+        struct sc_size frame_size;
+        // The YUV to RGB conversion of the last uploaded frame:
+        // rgb = matrix * (yuv - offset)
+        GLfloat matrix[9]; // column-major
+        GLfloat offset[3];
+    } shader;
+
+    // With the software renderer, convert and scale the frames to RGB at the
+    // size of the content with libswscale (SIMD, sliced across threads),
+    // instead of letting SDL convert YUV and scale with plain C loops
+    struct {
+        bool enabled;
+        struct sc_frame_converter converter;
+        // Streaming RGB texture of the content size (may be NULL)
+        SDL_Texture *texture;
+        struct sc_size texture_size;
+        AVFrame *frame; // the last frame, converted on render
+        bool dirty; // the texture does not contain the last frame
+    } sws;
 
     struct {
 #define SC_DISPLAY_PENDING_FLAG_SIZE 1
@@ -46,7 +123,8 @@ enum sc_display_result {
 
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps);
+                SDL_Surface *icon_novideo, bool mipmaps,
+                enum sc_present_mode present_mode, bool yuv_shader);
 
 void
 sc_display_destroy(struct sc_display *display);
@@ -57,8 +135,17 @@ sc_display_set_texture_size(struct sc_display *display, struct sc_size size);
 enum sc_display_result
 sc_display_update_texture(struct sc_display *display, const AVFrame *frame);
 
+// Must be called whenever the content rectangle changes
+void
+sc_display_set_downscaling(struct sc_display *display, bool downscaling);
+
 enum sc_display_result
 sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
                   enum sc_orientation orientation);
 
+// Return the (approximate) memory allocated for the textures and the pixel
+// buffers, excluding the mipmaps
+size_t
+sc_display_get_texture_bytes(const struct sc_display *display);
+
 #endif
@@ -1,12 +1,47 @@
 #include "events.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "util/log.h"
 #include "util/thread.h"
 
+// One bit per terminal event type (relative to SDL_USEREVENT) already pushed
+static atomic_uint_least32_t sc_terminal_events_pushed;
+
+static bool
+is_terminal_event(uint32_t type) {
+    switch (type) {
+        case SC_EVENT_DEVICE_DISCONNECTED:
+        case SC_EVENT_USB_DEVICE_DISCONNECTED:
+        case SC_EVENT_DEMUXER_ERROR:
+        case SC_EVENT_RECORDER_ERROR:
+        case SC_EVENT_TIME_LIMIT_REACHED:
+        case SC_EVENT_CONTROLLER_ERROR:
+        case SC_EVENT_AOA_OPEN_ERROR:
+        case SC_EVENT_TOUCH_BENCHMARK_DONE:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool
 sc_push_event_impl(uint32_t type, const char *name) {
+    uint_least32_t bit = 0;
+    if (is_terminal_event(type)) {
+        assert(type >= SDL_USEREVENT && type - SDL_USEREVENT < 32);
+        bit = UINT32_C(1) << (type - SDL_USEREVENT);
+        uint_least32_t prev =
+            atomic_fetch_or_explicit(&sc_terminal_events_pushed, bit,
+                                     memory_order_relaxed);
+        if (prev & bit) {
+            // Already pushed, the event loop will terminate anyway
+            LOGD("Coalesced %s event", name);
+            return true;
+        }
+    }
+
     SDL_Event event;
     event.type = type;
     int ret = SDL_PushEvent(&event);
@@ -15,12 +50,25 @@ sc_push_event_impl(uint32_t type, const char *name) {
     // ret == 1: success
     if (ret != 1) {
         LOGE("Could not post %s event: %s", name, SDL_GetError());
+        if (bit) {
+            // Not pushed, a later attempt must not be coalesced
+            atomic_fetch_and_explicit(&sc_terminal_events_pushed, ~bit,
+                                      memory_order_relaxed);
+        }
         return false;
     }
 
     return true;
 }
 
+void
+sc_rearm_event(uint32_t type) {
+    assert(is_terminal_event(type));
+    uint_least32_t bit = UINT32_C(1) << (type - SDL_USEREVENT);
+    atomic_fetch_and_explicit(&sc_terminal_events_pushed, ~bit,
+                              memory_order_relaxed);
+}
+
 bool
 sc_post_to_main_thread(sc_runnable_fn run, void *userdata) {
     SDL_Event event = {
@@ -20,13 +20,25 @@ enum {
     SC_EVENT_TIME_LIMIT_REACHED,
     SC_EVENT_CONTROLLER_ERROR,
     SC_EVENT_AOA_OPEN_ERROR,
+    SC_EVENT_TOUCH_BENCHMARK_DONE,
 };
 
+// The events terminating the event loop (disconnections and errors) may be
+// posted by several threads (e.g. by both the video and audio demuxers): they
+// are coalesced, so that each of them is pushed at most once.
+//
+// SC_EVENT_NEW_FRAME is not coalesced here, the frame buffer already
+// guarantees that at most one is pending (see sc_frame_buffer_push()).
 bool
 sc_push_event_impl(uint32_t type, const char *name);
 
 #define sc_push_event(TYPE) sc_push_event_impl(TYPE, # TYPE)
 
+// Allow a terminal event which did not terminate the event loop to be pushed
+// again (e.g. SC_EVENT_DEVICE_DISCONNECTED once reconnected)
+void
+sc_rearm_event(uint32_t type);
+
 typedef void (*sc_runnable_fn)(void *userdata);
 
 bool
@@ -0,0 +1,298 @@
+#include "extra_screen.h"
+
+#include <assert.h>
+
+#include "events.h"
+#include "icon.h"
+#include "util/log.h"
+
+#define DISPLAY_MARGINS 96
+
+#define DOWNCAST(SINK) container_of(SINK, struct sc_extra_screen, frame_sink)
+
+// Return the id of the window targeted by the event, or 0 if none
+static uint32_t
+get_event_window_id(const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_WINDOWEVENT:
+            return event->window.windowID;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            return event->key.windowID;
+        case SDL_TEXTINPUT:
+            return event->text.windowID;
+        case SDL_MOUSEMOTION:
+            return event->motion.windowID;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            return event->button.windowID;
+        case SDL_MOUSEWHEEL:
+            return event->wheel.windowID;
+        case SDL_DROPFILE:
+        case SDL_DROPTEXT:
+        case SDL_DROPBEGIN:
+        case SDL_DROPCOMPLETE:
+            return event->drop.windowID;
+        default:
+            return 0;
+    }
+}
+
+// The largest size preserving the aspect ratio of the content and fitting in
+// the usable bounds of the display (the window is never enlarged)
+static struct sc_size
+get_initial_window_size(struct sc_extra_screen *es, struct sc_size content) {
+    struct sc_size size = content;
+
+    int display_index = SDL_GetWindowDisplayIndex(es->window);
+    SDL_Rect bounds;
+    if (display_index < 0
+            || SDL_GetDisplayUsableBounds(display_index, &bounds)) {
+        LOGW("Could not get display usable bounds: %s", SDL_GetError());
+        return size;
+    }
+
+    int max_w = bounds.w > DISPLAY_MARGINS ? bounds.w - DISPLAY_MARGINS
+                                           : bounds.w;
+    int max_h = bounds.h > DISPLAY_MARGINS ? bounds.h - DISPLAY_MARGINS
+                                           : bounds.h;
+
+    if (size.width > max_w) {
+        size.height = (uint32_t) size.height * max_w / size.width;
+        size.width = max_w;
+    }
+    if (size.height > max_h) {
+        size.width = (uint32_t) size.width * max_h / size.height;
+        size.height = max_h;
+    }
+
+    return size;
+}
+
+static void
+sc_extra_screen_render(struct sc_extra_screen *es) {
+    assert(es->has_frame);
+
+    int dw;
+    int dh;
+    SDL_GL_GetDrawableSize(es->window, &dw, &dh);
+
+    // Letterbox the content into the window, preserving its aspect ratio
+    int fw = es->frame_size.width;
+    int fh = es->frame_size.height;
+    SDL_Rect rect;
+    if ((int64_t) dw * fh > (int64_t) dh * fw) {
+        rect.h = dh;
+        rect.w = (int64_t) dh * fw / fh;
+        rect.x = (dw - rect.w) / 2;
+        rect.y = 0;
+    } else {
+        rect.w = dw;
+        rect.h = (int64_t) dw * fh / fw;
+        rect.x = 0;
+        rect.y = (dh - rect.h) / 2;
+    }
+
+    enum sc_display_result res =
+        sc_display_render(&es->display, &rect, SC_ORIENTATION_0);
+    (void) res; // any error already logged
+}
+
+static void
+sc_extra_screen_show(struct sc_extra_screen *es) {
+    struct sc_size size = get_initial_window_size(es, es->frame_size);
+    SDL_SetWindowSize(es->window, size.width, size.height);
+    SDL_SetWindowPosition(es->window, SDL_WINDOWPOS_CENTERED,
+                                      SDL_WINDOWPOS_CENTERED);
+    SDL_ShowWindow(es->window);
+}
+
+static void
+sc_extra_screen_on_new_frame(void *userdata) {
+    struct sc_extra_screen *es = userdata;
+
+    // Always consume the frame, so that the next one triggers a new runnable
+    sc_frame_buffer_consume(&es->fb, es->frame);
+
+    if (es->closed) {
+        return;
+    }
+
+    AVFrame *frame = es->frame;
+    struct sc_size frame_size = {frame->width, frame->height};
+    if (frame_size.width != es->frame_size.width
+            || frame_size.height != es->frame_size.height) {
+        es->frame_size = frame_size;
+        enum sc_display_result res =
+            sc_display_set_texture_size(&es->display, frame_size);
+        if (res != SC_DISPLAY_RESULT_OK) {
+            // Any error already logged (a pending size is applied on render)
+            return;
+        }
+    }
+
+    enum sc_display_result res =
+        sc_display_update_texture(&es->display, frame);
+    if (res != SC_DISPLAY_RESULT_OK) {
+        return;
+    }
+
+    if (!es->has_frame) {
+        es->has_frame = true;
+        // This is the very first frame, show the window
+        sc_extra_screen_show(es);
+    }
+
+    sc_extra_screen_render(es);
+}
+
+static bool
+sc_extra_screen_frame_sink_open(struct sc_frame_sink *sink,
+                                const AVCodecContext *ctx) {
+    (void) sink;
+
+    if (ctx->width <= 0 || ctx->width > 0xFFFF
+            || ctx->height <= 0 || ctx->height > 0xFFFF) {
+        LOGE("Invalid video size: %dx%d", ctx->width, ctx->height);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_extra_screen_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+    // nothing to do, the lifecycle is not managed by the frame producer
+}
+
+static bool
+sc_extra_screen_frame_sink_push(struct sc_frame_sink *sink,
+                                const AVFrame *frame) {
+    struct sc_extra_screen *es = DOWNCAST(sink);
+
+    bool previous_skipped;
+    bool ok = sc_frame_buffer_push(&es->fb, frame, &previous_skipped);
+    if (!ok) {
+        return false;
+    }
+
+    if (!previous_skipped) {
+        // Otherwise, the runnable posted for the previous frame will consume
+        // this new frame instead
+        sc_post_to_main_thread(sc_extra_screen_on_new_frame, es);
+    }
+
+    return true;
+}
+
+bool
+sc_extra_screen_init(struct sc_extra_screen *es, const char *title,
+                     bool always_on_top) {
+    es->frame_size.width = 0;
+    es->frame_size.height = 0;
+    es->has_frame = false;
+    es->closed = false;
+
+    bool ok = sc_frame_buffer_init(&es->fb);
+    if (!ok) {
+        return false;
+    }
+
+    // The window will be shown on first frame
+    uint32_t window_flags = SDL_WINDOW_ALLOW_HIGHDPI
+                          | SDL_WINDOW_HIDDEN
+                          | SDL_WINDOW_RESIZABLE;
+    if (always_on_top) {
+        window_flags |= SDL_WINDOW_ALWAYS_ON_TOP;
+    }
+
+    es->window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED, 256, 256,
+                                  window_flags);
+    if (!es->window) {
+        LOGE("Could not create window: %s", SDL_GetError());
+        goto error_destroy_frame_buffer;
+    }
+
+    es->window_id = SDL_GetWindowID(es->window);
+
+    SDL_Surface *icon = scrcpy_icon_load();
+    if (icon) {
+        SDL_SetWindowIcon(es->window, icon);
+        scrcpy_icon_destroy(icon);
+    } else {
+        // just a warning
+        LOGW("Could not load icon");
+    }
+
+    // All the windows are rendered from the main thread: do not wait for the
+    // vertical sync of each one
+    ok = sc_display_init(&es->display, es->window, NULL, false,
+                         SC_PRESENT_MODE_IMMEDIATE, false);
+    if (!ok) {
+        goto error_destroy_window;
+    }
+
+    es->frame = av_frame_alloc();
+    if (!es->frame) {
+        LOG_OOM();
+        goto error_destroy_display;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_extra_screen_frame_sink_open,
+        .close = sc_extra_screen_frame_sink_close,
+        .push = sc_extra_screen_frame_sink_push,
+    };
+
+    es->frame_sink.ops = &ops;
+
+    return true;
+
+error_destroy_display:
+    sc_display_destroy(&es->display);
+error_destroy_window:
+    SDL_DestroyWindow(es->window);
+error_destroy_frame_buffer:
+    sc_frame_buffer_destroy(&es->fb);
+
+    return false;
+}
+
+void
+sc_extra_screen_destroy(struct sc_extra_screen *es) {
+    av_frame_free(&es->frame);
+    sc_display_destroy(&es->display);
+    SDL_DestroyWindow(es->window);
+    sc_frame_buffer_destroy(&es->fb);
+}
+
+bool
+sc_extra_screen_handle_event(struct sc_extra_screen *es,
+                             const SDL_Event *event) {
+    if (get_event_window_id(event) != es->window_id) {
+        return false;
+    }
+
+    // The input events are ignored, the window is view-only
+    if (event->type != SDL_WINDOWEVENT) {
+        return true;
+    }
+
+    switch (event->window.event) {
+        case SDL_WINDOWEVENT_CLOSE:
+            // The session continues in the other windows
+            SDL_HideWindow(es->window);
+            es->closed = true;
+            break;
+        case SDL_WINDOWEVENT_EXPOSED:
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+            if (es->has_frame && !es->closed) {
+                sc_extra_screen_render(es);
+            }
+            break;
+    }
+
+    return true;
+}
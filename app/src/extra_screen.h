@@ -0,0 +1,58 @@
+#ifndef SC_EXTRA_SCREEN_H
+#define SC_EXTRA_SCREEN_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <SDL2/SDL.h>
+
+#include "coords.h"
+#include "display.h"
+#include "frame_buffer.h"
+#include "trait/frame_sink.h"
+
+/**
+ * View-only window displaying the video stream of an extra device display
+ * (--extra-display)
+ *
+ * Contrary to sc_screen, it does not handle input events nor shortcuts: the
+ * input events are only injected to the main display.
+ *
+ * The frames are pushed by the decoder thread, then uploaded and rendered on
+ * the main thread (via sc_post_to_main_thread()).
+ */
+struct sc_extra_screen {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    SDL_Window *window;
+    uint32_t window_id;
+    struct sc_display display;
+    struct sc_frame_buffer fb;
+    AVFrame *frame;
+
+    // Only accessed from the main thread
+    struct sc_size frame_size;
+    bool has_frame;
+    bool closed; // hidden by the user, the frames are not rendered anymore
+};
+
+bool
+sc_extra_screen_init(struct sc_extra_screen *es, const char *title,
+                     bool always_on_top);
+
+void
+sc_extra_screen_destroy(struct sc_extra_screen *es);
+
+/**
+ * Handle an SDL event targeting the extra screen window
+ *
+ * Return true if the event has been consumed (it must not be forwarded to the
+ * main screen).
+ */
+bool
+sc_extra_screen_handle_event(struct sc_extra_screen *es,
+                             const SDL_Event *event);
+
+#endif
@@ -5,7 +5,9 @@
 #include <string.h>
 
 #include "adb/adb.h"
+#include "util/file.h"
 #include "util/log.h"
+#include "util/str.h"
 
 #define DEFAULT_PUSH_TARGET "/sdcard/Download/"
 
@@ -32,17 +34,9 @@ sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
         return false;
     }
 
-    ok = sc_intr_init(&fp->intr);
-    if (!ok) {
-        sc_cond_destroy(&fp->event_cond);
-        sc_mutex_destroy(&fp->mutex);
-        return false;
-    }
-
     fp->serial = strdup(serial);
     if (!fp->serial) {
         LOG_OOM();
-        sc_intr_destroy(&fp->intr);
         sc_cond_destroy(&fp->event_cond);
         sc_mutex_destroy(&fp->mutex);
         return false;
@@ -52,6 +46,7 @@ sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
     fp->initialized = false;
 
     fp->stopped = false;
+    fp->worker_count = 0;
 
     fp->push_target = push_target ? push_target : DEFAULT_PUSH_TARGET;
 
@@ -62,7 +57,9 @@ void
 sc_file_pusher_destroy(struct sc_file_pusher *fp) {
     sc_cond_destroy(&fp->event_cond);
     sc_mutex_destroy(&fp->mutex);
-    sc_intr_destroy(&fp->intr);
+    for (unsigned i = 0; i < fp->worker_count; ++i) {
+        sc_intr_destroy(&fp->workers[i].intr);
+    }
     free(fp->serial);
 
     while (!sc_vecdeque_is_empty(&fp->queue)) {
@@ -92,7 +89,6 @@ sc_file_pusher_request(struct sc_file_pusher *fp,
     };
 
     sc_mutex_lock(&fp->mutex);
-    bool was_empty = sc_vecdeque_is_empty(&fp->queue);
     bool res = sc_vecdeque_push(&fp->queue, req);
     if (!res) {
         LOG_OOM();
@@ -100,18 +96,42 @@ sc_file_pusher_request(struct sc_file_pusher *fp,
         return false;
     }
 
-    if (was_empty) {
-        sc_cond_signal(&fp->event_cond);
-    }
+    // Wake up one idle worker (if any)
+    sc_cond_signal(&fp->event_cond);
     sc_mutex_unlock(&fp->mutex);
 
     return true;
 }
 
+// Push to the target directory through the adb server if possible (the target
+// may also be a file path if it does not end with '/')
+static bool
+push_file(struct sc_intr *intr, const char *serial, const char *file,
+          const char *push_target) {
+    size_t len = strlen(push_target);
+    if (!len || push_target[len - 1] != '/' || !sc_file_is_regular(file)) {
+        // Let adb resolve the remote path and push directories recursively
+        return sc_adb_push(intr, serial, file, push_target, 0);
+    }
+
+    const char *sep = strrchr(file, SC_PATH_SEPARATOR);
+    const char *name = sep ? sep + 1 : file;
+    char *remote = sc_str_concat(push_target, name);
+    if (!remote) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_adb_push_file(intr, serial, file, remote, 0);
+    free(remote);
+    return ok;
+}
+
 static int
 run_file_pusher(void *data) {
-    struct sc_file_pusher *fp = data;
-    struct sc_intr *intr = &fp->intr;
+    struct sc_file_pusher_worker *worker = data;
+    struct sc_file_pusher *fp = worker->fp;
+    struct sc_intr *intr = &worker->intr;
 
     const char *serial = fp->serial;
     assert(serial);
@@ -144,7 +164,7 @@ run_file_pusher(void *data) {
             }
         } else {
             LOGI("Pushing %s...", req.file);
-            bool ok = sc_adb_push(intr, serial, req.file, push_target, 0);
+            bool ok = push_file(intr, serial, req.file, push_target);
             if (ok) {
                 LOGI("%s successfully pushed to %s", req.file, push_target);
             } else {
@@ -159,10 +179,29 @@ run_file_pusher(void *data) {
 
 bool
 sc_file_pusher_start(struct sc_file_pusher *fp) {
-    LOGD("Starting file_pusher thread");
+    LOGD("Starting file_pusher threads");
 
-    bool ok = sc_thread_create(&fp->thread, run_file_pusher, "scrcpy-file", fp);
-    if (!ok) {
+    assert(!fp->worker_count);
+    for (unsigned i = 0; i < SC_FILE_PUSHER_WORKERS; ++i) {
+        struct sc_file_pusher_worker *worker = &fp->workers[i];
+        worker->fp = fp;
+
+        bool ok = sc_intr_init(&worker->intr);
+        if (!ok) {
+            break;
+        }
+
+        ok = sc_thread_create(&worker->thread, run_file_pusher, "scrcpy-file",
+                              worker);
+        if (!ok) {
+            sc_intr_destroy(&worker->intr);
+            break;
+        }
+
+        ++fp->worker_count;
+    }
+
+    if (!fp->worker_count) {
         LOGE("Could not start file_pusher thread");
         return false;
     }
@@ -175,8 +214,10 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
     if (fp->initialized) {
         sc_mutex_lock(&fp->mutex);
         fp->stopped = true;
-        sc_cond_signal(&fp->event_cond);
-        sc_intr_interrupt(&fp->intr);
+        sc_cond_broadcast(&fp->event_cond);
+        for (unsigned i = 0; i < fp->worker_count; ++i) {
+            sc_intr_interrupt(&fp->workers[i].intr);
+        }
         sc_mutex_unlock(&fp->mutex);
     }
 }
@@ -184,6 +225,8 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
 void
 sc_file_pusher_join(struct sc_file_pusher *fp) {
     if (fp->initialized) {
-        sc_thread_join(&fp->thread, NULL);
+        for (unsigned i = 0; i < fp->worker_count; ++i) {
+            sc_thread_join(&fp->workers[i].thread, NULL);
+        }
     }
 }
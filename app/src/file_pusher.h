@@ -21,17 +21,29 @@ struct sc_file_pusher_request {
 
 struct sc_file_pusher_request_queue SC_VECDEQUE(struct sc_file_pusher_request);
 
+// Maximum number of concurrent transfers
+#define SC_FILE_PUSHER_WORKERS 4
+
+struct sc_file_pusher;
+
+struct sc_file_pusher_worker {
+    struct sc_file_pusher *fp;
+    sc_thread thread;
+    struct sc_intr intr;
+};
+
 struct sc_file_pusher {
     char *serial;
     const char *push_target;
-    sc_thread thread;
     sc_mutex mutex;
     sc_cond event_cond;
     bool stopped;
     bool initialized;
     struct sc_file_pusher_request_queue queue;
 
-    struct sc_intr intr;
+    // Each worker processes one request at a time
+    struct sc_file_pusher_worker workers[SC_FILE_PUSHER_WORKERS];
+    unsigned worker_count; // number of started workers
 };
 
 bool
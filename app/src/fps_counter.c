@@ -1,162 +1,154 @@
 #include "fps_counter.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
 
+#include "events.h"
 #include "util/log.h"
+#include "util/thread.h"
 
-#define SC_FPS_COUNTER_INTERVAL SC_TICK_FROM_SEC(1)
+#define SC_FPS_COUNTER_INTERVAL_MS 1000
 
-bool
-sc_fps_counter_init(struct sc_fps_counter *counter) {
-    bool ok = sc_mutex_init(&counter->mutex);
-    if (!ok) {
-        return false;
-    }
-
-    ok = sc_cond_init(&counter->state_cond);
-    if (!ok) {
-        sc_mutex_destroy(&counter->mutex);
-        return false;
-    }
-
-    counter->thread_started = false;
-    atomic_init(&counter->started, 0);
-    // no need to initialize the other fields, they are unused until started
-
-    return true;
+void
+sc_fps_counter_init(struct sc_fps_counter *counter,
+                    struct sc_stream_stats *stream_stats) {
+    atomic_init(&counter->started, false);
+    atomic_init(&counter->nr_rendered, 0);
+    atomic_init(&counter->nr_skipped, 0);
+    counter->stream_stats = stream_stats;
+    counter->timer = 0;
+    counter->last_timestamp = 0;
+    counter->last_bytes = 0;
 }
 
 void
 sc_fps_counter_destroy(struct sc_fps_counter *counter) {
-    sc_cond_destroy(&counter->state_cond);
-    sc_mutex_destroy(&counter->mutex);
+    if (counter->timer) {
+        SDL_RemoveTimer(counter->timer);
+    }
 }
 
 static inline bool
 is_started(struct sc_fps_counter *counter) {
-    return atomic_load_explicit(&counter->started, memory_order_acquire);
+    return atomic_load_explicit(&counter->started, memory_order_relaxed);
 }
 
-static inline void
-set_started(struct sc_fps_counter *counter, bool started) {
-    atomic_store_explicit(&counter->started, started, memory_order_release);
-}
-
-// must be called with mutex locked
 static void
-display_fps(struct sc_fps_counter *counter) {
+sc_fps_counter_report(void *userdata) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    struct sc_fps_counter *counter = userdata;
+    if (!counter->timer) {
+        // Stopped after the timer fired
+        return;
+    }
+
+    sc_tick now = sc_tick_now();
+    sc_tick elapsed = now - counter->last_timestamp;
+    if (elapsed <= 0) {
+        return;
+    }
+    counter->last_timestamp = now;
+
+    unsigned nr_rendered = atomic_exchange_explicit(&counter->nr_rendered, 0,
+                                                    memory_order_relaxed);
+    unsigned nr_skipped = atomic_exchange_explicit(&counter->nr_skipped, 0,
+                                                   memory_order_relaxed);
+
+    // The timer may be slightly late (or the event loop busy): use the actual
+    // elapsed duration, rounded to the nearest integer
     unsigned rendered_per_second =
-        counter->nr_rendered * SC_TICK_FREQ / SC_FPS_COUNTER_INTERVAL;
-    if (counter->nr_skipped) {
-        LOGI("%u fps (+%u frames skipped)", rendered_per_second,
-                                            counter->nr_skipped);
-    } else {
-        LOGI("%u fps", rendered_per_second);
+        ((uint64_t) nr_rendered * SC_TICK_FREQ + elapsed / 2) / elapsed;
+
+    char skipped[32] = "";
+    if (nr_skipped) {
+        snprintf(skipped, sizeof(skipped), " (+%u frames skipped)", nr_skipped);
     }
-}
 
-// must be called with mutex locked
-static void
-check_interval_expired(struct sc_fps_counter *counter, sc_tick now) {
-    if (now < counter->next_timestamp) {
+    if (!counter->stream_stats) {
+        LOGI("%u fps%s", rendered_per_second, skipped);
         return;
     }
 
-    display_fps(counter);
-    counter->nr_rendered = 0;
-    counter->nr_skipped = 0;
-    // add a multiple of the interval
-    uint32_t elapsed_slices =
-        (now - counter->next_timestamp) / SC_FPS_COUNTER_INTERVAL + 1;
-    counter->next_timestamp += SC_FPS_COUNTER_INTERVAL * elapsed_slices;
+    uint64_t bytes = sc_stream_stats_get_bytes(counter->stream_stats);
+    uint32_t kbps =
+        sc_stream_stats_to_kbps(bytes - counter->last_bytes, elapsed);
+    counter->last_bytes = bytes;
+
+    uint32_t max_keyframe_size =
+        sc_stream_stats_take_max_keyframe_size(counter->stream_stats);
+    if (max_keyframe_size) {
+        // The keyframe burst, sent at once after a scene change or on request
+        LOGI("%u fps%s, %" PRIu32 " kbps, keyframe %" PRIu32 " KiB",
+             rendered_per_second, skipped, kbps,
+             (max_keyframe_size + 512) / 1024);
+    } else {
+        LOGI("%u fps%s, %" PRIu32 " kbps", rendered_per_second, skipped, kbps);
+    }
 }
 
-static int
-run_fps_counter(void *data) {
-    struct sc_fps_counter *counter = data;
-
-    sc_mutex_lock(&counter->mutex);
-    while (!counter->interrupted) {
-        while (!counter->interrupted && !is_started(counter)) {
-            sc_cond_wait(&counter->state_cond, &counter->mutex);
-        }
-        while (!counter->interrupted && is_started(counter)) {
-            sc_tick now = sc_tick_now();
-            check_interval_expired(counter, now);
-
-            // ignore the reason (timeout or signaled), we just loop anyway
-            sc_cond_timedwait(&counter->state_cond, &counter->mutex,
-                              counter->next_timestamp);
-        }
-    }
-    sc_mutex_unlock(&counter->mutex);
-    return 0;
+static Uint32 SDLCALL
+sc_fps_counter_on_timer(Uint32 interval, void *userdata) {
+    // Called from the SDL timer thread, report from the main thread
+    sc_post_to_main_thread(sc_fps_counter_report, userdata);
+
+    // Periodic timer
+    return interval;
 }
 
 bool
 sc_fps_counter_start(struct sc_fps_counter *counter) {
-    sc_mutex_lock(&counter->mutex);
-    counter->interrupted = false;
-    counter->next_timestamp = sc_tick_now() + SC_FPS_COUNTER_INTERVAL;
-    counter->nr_rendered = 0;
-    counter->nr_skipped = 0;
-    sc_mutex_unlock(&counter->mutex);
-
-    set_started(counter, true);
-    sc_cond_signal(&counter->state_cond);
-
-    // counter->thread_started and counter->thread are always accessed from the
-    // same thread, no need to lock
-    if (!counter->thread_started) {
-        bool ok = sc_thread_create(&counter->thread, run_fps_counter,
-                                   "scrcpy-fps", counter);
-        if (!ok) {
-            LOGE("Could not start FPS counter thread");
-            return false;
-        }
-
-        counter->thread_started = true;
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    if (counter->timer) {
+        // Already started
+        return true;
+    }
+
+    atomic_store_explicit(&counter->nr_rendered, 0, memory_order_relaxed);
+    atomic_store_explicit(&counter->nr_skipped, 0, memory_order_relaxed);
+    counter->last_timestamp = sc_tick_now();
+    if (counter->stream_stats) {
+        counter->last_bytes =
+            sc_stream_stats_get_bytes(counter->stream_stats);
+        // Only report the keyframes received while the counter is started
+        sc_stream_stats_take_max_keyframe_size(counter->stream_stats);
+    }
+
+    counter->timer = SDL_AddTimer(SC_FPS_COUNTER_INTERVAL_MS,
+                                  sc_fps_counter_on_timer, counter);
+    if (!counter->timer) {
+        LOGE("Could not start FPS counter timer: %s", SDL_GetError());
+        return false;
     }
 
+    atomic_store_explicit(&counter->started, true, memory_order_relaxed);
+
     LOGI("FPS counter started");
     return true;
 }
 
 void
 sc_fps_counter_stop(struct sc_fps_counter *counter) {
-    set_started(counter, false);
-    sc_cond_signal(&counter->state_cond);
-    LOGI("FPS counter stopped");
-}
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
 
-bool
-sc_fps_counter_is_started(struct sc_fps_counter *counter) {
-    return is_started(counter);
-}
-
-void
-sc_fps_counter_interrupt(struct sc_fps_counter *counter) {
-    if (!counter->thread_started) {
+    if (!counter->timer) {
         return;
     }
 
-    sc_mutex_lock(&counter->mutex);
-    counter->interrupted = true;
-    sc_mutex_unlock(&counter->mutex);
-    // wake up blocking wait
-    sc_cond_signal(&counter->state_cond);
-}
+    atomic_store_explicit(&counter->started, false, memory_order_relaxed);
+    SDL_RemoveTimer(counter->timer);
+    // A report already posted to the main thread will be ignored
+    counter->timer = 0;
 
-void
-sc_fps_counter_join(struct sc_fps_counter *counter) {
-    if (counter->thread_started) {
-        // interrupted must be set by the thread calling join(), so no need to
-        // lock for the assertion
-        assert(counter->interrupted);
+    LOGI("FPS counter stopped");
+}
 
-        sc_thread_join(&counter->thread, NULL);
-    }
+bool
+sc_fps_counter_is_started(struct sc_fps_counter *counter) {
+    return is_started(counter);
 }
 
 void
@@ -165,11 +157,7 @@ sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter) {
         return;
     }
 
-    sc_mutex_lock(&counter->mutex);
-    sc_tick now = sc_tick_now();
-    check_interval_expired(counter, now);
-    ++counter->nr_rendered;
-    sc_mutex_unlock(&counter->mutex);
+    atomic_fetch_add_explicit(&counter->nr_rendered, 1, memory_order_relaxed);
 }
 
 void
@@ -178,9 +166,5 @@ sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter) {
         return;
     }
 
-    sc_mutex_lock(&counter->mutex);
-    sc_tick now = sc_tick_now();
-    check_interval_expired(counter, now);
-    ++counter->nr_skipped;
-    sc_mutex_unlock(&counter->mutex);
+    atomic_fetch_add_explicit(&counter->nr_skipped, 1, memory_order_relaxed);
 }
@@ -5,51 +5,56 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <SDL2/SDL_timer.h>
 
-#include "util/thread.h"
+#include "stream_stats.h"
 #include "util/tick.h"
 
+/**
+ * Count the rendered and skipped frames, and log the rates every second
+ *
+ * If the statistics of the video stream are provided, the received bit rate
+ * and the size of the largest keyframe are logged alongside.
+ *
+ * The frames are counted with relaxed atomics (the skipped frames are reported
+ * by the decoder thread), without any lock. The rates are computed on the main
+ * thread, from a periodic SDL timer: there is no dedicated thread.
+ */
 struct sc_fps_counter {
-    sc_thread thread;
-    sc_mutex mutex;
-    sc_cond state_cond;
+    // atomic so that the frame callbacks can check it without locking
+    // written only from the main thread
+    atomic_bool started;
 
-    bool thread_started;
+    atomic_uint nr_rendered;
+    atomic_uint nr_skipped;
 
-    // atomic so that we can check without locking the mutex
-    // if the FPS counter is disabled, we don't want to lock unnecessarily
-    atomic_bool started;
+    struct sc_stream_stats *stream_stats; // may be NULL
 
-    // the following fields are protected by the mutex
-    bool interrupted;
-    unsigned nr_rendered;
-    unsigned nr_skipped;
-    sc_tick next_timestamp;
+    // the following fields are accessed only from the main thread
+    SDL_TimerID timer;
+    sc_tick last_timestamp;
+    uint64_t last_bytes;
 };
 
-bool
-sc_fps_counter_init(struct sc_fps_counter *counter);
+void
+sc_fps_counter_init(struct sc_fps_counter *counter,
+                    struct sc_stream_stats *stream_stats);
 
+// must be called from the main thread
 void
 sc_fps_counter_destroy(struct sc_fps_counter *counter);
 
+// must be called from the main thread
 bool
 sc_fps_counter_start(struct sc_fps_counter *counter);
 
+// must be called from the main thread
 void
 sc_fps_counter_stop(struct sc_fps_counter *counter);
 
 bool
 sc_fps_counter_is_started(struct sc_fps_counter *counter);
 
-// request to stop the thread (on quit)
-// must be called before sc_fps_counter_join()
-void
-sc_fps_counter_interrupt(struct sc_fps_counter *counter);
-
-void
-sc_fps_counter_join(struct sc_fps_counter *counter);
-
 void
 sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter);
 
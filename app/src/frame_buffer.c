@@ -4,85 +4,77 @@
 
 #include "util/log.h"
 
+#define SC_FRAME_BUFFER_INDEX_MASK 0x3
+
 bool
 sc_frame_buffer_init(struct sc_frame_buffer *fb) {
-    fb->pending_frame = av_frame_alloc();
-    if (!fb->pending_frame) {
-        LOG_OOM();
-        return false;
-    }
-
-    fb->tmp_frame = av_frame_alloc();
-    if (!fb->tmp_frame) {
-        LOG_OOM();
-        av_frame_free(&fb->pending_frame);
-        return false;
-    }
-
-    bool ok = sc_mutex_init(&fb->mutex);
-    if (!ok) {
-        av_frame_free(&fb->pending_frame);
-        av_frame_free(&fb->tmp_frame);
-        return false;
+    for (unsigned i = 0; i < 3; ++i) {
+        fb->frames[i] = av_frame_alloc();
+        if (!fb->frames[i]) {
+            LOG_OOM();
+            while (i) {
+                av_frame_free(&fb->frames[--i]);
+            }
+            return false;
+        }
     }
 
+    fb->write_index = 0;
+    fb->read_index = 1;
     // there is initially no frame, so consider it has already been consumed
-    fb->pending_frame_consumed = true;
+    atomic_init(&fb->ready, 2);
 
     return true;
 }
 
 void
 sc_frame_buffer_destroy(struct sc_frame_buffer *fb) {
-    sc_mutex_destroy(&fb->mutex);
-    av_frame_free(&fb->pending_frame);
-    av_frame_free(&fb->tmp_frame);
-}
-
-static inline void
-swap_frames(AVFrame **lhs, AVFrame **rhs) {
-    AVFrame *tmp = *lhs;
-    *lhs = *rhs;
-    *rhs = tmp;
+    for (unsigned i = 0; i < 3; ++i) {
+        av_frame_free(&fb->frames[i]);
+    }
 }
 
 bool
 sc_frame_buffer_push(struct sc_frame_buffer *fb, const AVFrame *frame,
                      bool *previous_frame_skipped) {
-    // Use a temporary frame to preserve pending_frame in case of error.
-    // tmp_frame is an empty frame, no need to call av_frame_unref() beforehand.
-    int r = av_frame_ref(fb->tmp_frame, frame);
+    // The write slot is owned by the producer, and it is always empty.
+    AVFrame *write_frame = fb->frames[fb->write_index];
+    int r = av_frame_ref(write_frame, frame);
     if (r) {
         LOGE("Could not ref frame: %d", r);
         return false;
     }
 
-    sc_mutex_lock(&fb->mutex);
+    // Publish the new frame, and take ownership of the previous ready slot
+    unsigned ready = fb->write_index | SC_FRAME_BUFFER_READY_PENDING;
+    unsigned prev = atomic_exchange_explicit(&fb->ready, ready,
+                                             memory_order_acq_rel);
 
-    // Now that av_frame_ref() succeeded, we can replace the previous
-    // pending_frame
-    swap_frames(&fb->pending_frame, &fb->tmp_frame);
-    av_frame_unref(fb->tmp_frame);
+    fb->write_index = prev & SC_FRAME_BUFFER_INDEX_MASK;
 
-    if (previous_frame_skipped) {
-        *previous_frame_skipped = !fb->pending_frame_consumed;
+    bool skipped = prev & SC_FRAME_BUFFER_READY_PENDING;
+    if (skipped) {
+        // The previous pending frame has never been consumed, drop it
+        av_frame_unref(fb->frames[fb->write_index]);
     }
-    fb->pending_frame_consumed = false;
+    // else the slot has been emptied by sc_frame_buffer_consume()
 
-    sc_mutex_unlock(&fb->mutex);
+    if (previous_frame_skipped) {
+        *previous_frame_skipped = skipped;
+    }
 
     return true;
 }
 
 void
 sc_frame_buffer_consume(struct sc_frame_buffer *fb, AVFrame *dst) {
-    sc_mutex_lock(&fb->mutex);
-    assert(!fb->pending_frame_consumed);
-    fb->pending_frame_consumed = true;
+    // Give back the (empty) read slot, and take ownership of the pending frame
+    unsigned prev = atomic_exchange_explicit(&fb->ready, fb->read_index,
+                                             memory_order_acq_rel);
+    assert(prev & SC_FRAME_BUFFER_READY_PENDING);
 
-    av_frame_move_ref(dst, fb->pending_frame);
-    // av_frame_move_ref() resets its source frame, so no need to call
-    // av_frame_unref()
+    fb->read_index = prev & SC_FRAME_BUFFER_INDEX_MASK;
 
-    sc_mutex_unlock(&fb->mutex);
+    av_frame_move_ref(dst, fb->frames[fb->read_index]);
+    // av_frame_move_ref() resets its source frame, so the read slot is empty
 }
@@ -3,11 +3,10 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <libavutil/frame.h>
 
-#include "util/thread.h"
-
 // forward declarations
 typedef struct AVFrame AVFrame;
 
@@ -18,15 +17,24 @@ typedef struct AVFrame AVFrame;
  * If a pending frame has not been consumed when the producer pushes a new
  * frame, then it is lost. The intent is to always provide access to the very
  * last frame to minimize latency.
+ *
+ * It is implemented as a lock-free triple buffer, for a single producer and a
+ * single consumer: the producer writes to its own slot, then exchanges it
+ * atomically with the "ready" slot; the consumer exchanges its own slot with
+ * the "ready" slot to read the pending frame. Therefore, pushing a frame never
+ * waits for the consumer (and vice versa).
  */
 
 struct sc_frame_buffer {
-    AVFrame *pending_frame;
-    AVFrame *tmp_frame; // To preserve the pending frame on error
+    AVFrame *frames[3];
 
-    sc_mutex mutex;
+    // Slots owned by the producer and the consumer respectively
+    unsigned write_index;
+    unsigned read_index;
 
-    bool pending_frame_consumed;
+#define SC_FRAME_BUFFER_READY_PENDING 0x4 // flag set if not consumed yet
+    // Index of the ready slot | SC_FRAME_BUFFER_READY_PENDING
+    atomic_uint ready;
 };
 
 bool
@@ -0,0 +1,246 @@
+#include "frame_converter.h"
+
+#include <assert.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+
+#include "util/log.h"
+
+// Since FFmpeg 5.0, a swscale context may convert the slices of a frame in
+// parallel (only through the frame API)
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+# define SC_FRAME_CONVERTER_THREADS
+#endif
+
+#define SC_FRAME_CONVERTER_ALIGN 32
+
+bool
+sc_frame_converter_init(struct sc_frame_converter *fc) {
+    fc->wrapper = av_frame_alloc();
+    if (!fc->wrapper) {
+        LOG_OOM();
+        return false;
+    }
+
+    fc->ctx = NULL;
+    fc->pool = NULL;
+    fc->pool_size = 0;
+    return true;
+}
+
+void
+sc_frame_converter_destroy(struct sc_frame_converter *fc) {
+    // The buffers still referenced by converted frames remain valid
+    av_buffer_pool_uninit(&fc->pool);
+    sws_freeContext(fc->ctx);
+    av_frame_free(&fc->wrapper);
+}
+
+static struct SwsContext *
+sc_frame_converter_create_context(const AVFrame *src,
+                                  enum AVPixelFormat dst_format,
+                                  int dst_width, int dst_height, int flags) {
+#ifdef SC_FRAME_CONVERTER_THREADS
+    struct SwsContext *ctx = sws_alloc_context();
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    av_opt_set_int(ctx, "srcw", src->width, 0);
+    av_opt_set_int(ctx, "srch", src->height, 0);
+    av_opt_set_int(ctx, "src_format", src->format, 0);
+    av_opt_set_int(ctx, "dstw", dst_width, 0);
+    av_opt_set_int(ctx, "dsth", dst_height, 0);
+    av_opt_set_int(ctx, "dst_format", dst_format, 0);
+    av_opt_set_int(ctx, "sws_flags", flags, 0);
+    // One slice per CPU core
+    av_opt_set_int(ctx, "threads", 0, 0);
+
+    if (sws_init_context(ctx, NULL, NULL) < 0) {
+        sws_freeContext(ctx);
+        return NULL;
+    }
+#else
+    struct SwsContext *ctx =
+        sws_getContext(src->width, src->height, src->format, dst_width,
+                       dst_height, dst_format, flags, NULL, NULL, NULL);
+    if (!ctx) {
+        return NULL;
+    }
+#endif
+
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(dst_format);
+    if (desc && (desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+        // Convert YUV to RGB according to the color space and range of the
+        // frame (sws_getCoefficients() accepts the AVColorSpace values, the
+        // unspecified ones fallback to BT.601)
+        bool full_range = src->color_range == AVCOL_RANGE_JPEG;
+        sws_setColorspaceDetails(ctx, sws_getCoefficients(src->colorspace),
+                                 full_range,
+                                 sws_getCoefficients(SWS_CS_DEFAULT), 1, 0,
+                                 1 << 16, 1 << 16);
+    }
+
+    return ctx;
+}
+
+static bool
+sc_frame_converter_prepare_context(struct sc_frame_converter *fc,
+                                   const AVFrame *src,
+                                   enum AVPixelFormat dst_format,
+                                   int dst_width, int dst_height, int flags) {
+    if (fc->ctx
+            && fc->src_width == src->width
+            && fc->src_height == src->height
+            && fc->src_format == src->format
+            && fc->src_color_range == src->color_range
+            && fc->src_colorspace == src->colorspace
+            && fc->dst_width == dst_width
+            && fc->dst_height == dst_height
+            && fc->dst_format == dst_format
+            && fc->flags == flags) {
+        // Nothing to do
+        return true;
+    }
+
+    sws_freeContext(fc->ctx);
+    fc->ctx = sc_frame_converter_create_context(src, dst_format, dst_width,
+                                                dst_height, flags);
+    if (!fc->ctx) {
+        LOGE("Could not initialize the conversion from %s %dx%d to %s %dx%d",
+             av_get_pix_fmt_name(src->format), src->width, src->height,
+             av_get_pix_fmt_name(dst_format), dst_width, dst_height);
+        return false;
+    }
+
+    fc->src_width = src->width;
+    fc->src_height = src->height;
+    fc->src_format = src->format;
+    fc->src_color_range = src->color_range;
+    fc->src_colorspace = src->colorspace;
+    fc->dst_width = dst_width;
+    fc->dst_height = dst_height;
+    fc->dst_format = dst_format;
+    fc->flags = flags;
+    return true;
+}
+
+// dst->data and dst->linesize must be set (and dst->buf[0] with the frame API)
+static bool
+sc_frame_converter_scale(struct sc_frame_converter *fc, const AVFrame *src,
+                         AVFrame *dst, int flags) {
+    bool ok = sc_frame_converter_prepare_context(fc, src, dst->format,
+                                                 dst->width, dst->height,
+                                                 flags);
+    if (!ok) {
+        return false;
+    }
+
+#ifdef SC_FRAME_CONVERTER_THREADS
+    int ret = sws_scale_frame(fc->ctx, dst, src);
+#else
+    int ret = sws_scale(fc->ctx, (const uint8_t *const *) src->data,
+                        src->linesize, 0, src->height, dst->data,
+                        dst->linesize);
+#endif
+    if (ret < 0) {
+        LOGE("Could not convert frame");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_frame_converter_free_nothing(void *opaque, uint8_t *data) {
+    (void) opaque;
+    (void) data;
+    // The planes belong to the caller
+}
+
+bool
+sc_frame_converter_convert(struct sc_frame_converter *fc, const AVFrame *src,
+                           uint8_t *const dst_data[4],
+                           const int dst_linesize[4],
+                           enum AVPixelFormat dst_format, int dst_width,
+                           int dst_height, int flags) {
+    AVFrame *wrapper = fc->wrapper;
+
+    // sws_scale_frame() writes into the destination planes as long as the
+    // frame has a buffer (otherwise it would allocate a new one)
+    wrapper->buf[0] = av_buffer_create(dst_data[0], 0,
+                                       sc_frame_converter_free_nothing, NULL,
+                                       0);
+    if (!wrapper->buf[0]) {
+        LOG_OOM();
+        return false;
+    }
+
+    wrapper->format = dst_format;
+    wrapper->width = dst_width;
+    wrapper->height = dst_height;
+    for (int i = 0; i < 4; ++i) {
+        wrapper->data[i] = dst_data[i];
+        wrapper->linesize[i] = dst_linesize[i];
+    }
+
+    bool ok = sc_frame_converter_scale(fc, src, wrapper, flags);
+    av_frame_unref(wrapper);
+    return ok;
+}
+
+bool
+sc_frame_converter_convert_frame(struct sc_frame_converter *fc,
+                                 const AVFrame *src, AVFrame *dst, int flags) {
+    assert(!dst->buf[0]);
+
+    int size = av_image_get_buffer_size(dst->format, dst->width, dst->height,
+                                        SC_FRAME_CONVERTER_ALIGN);
+    if (size < 0) {
+        LOGE("Invalid frame: %s %dx%d", av_get_pix_fmt_name(dst->format),
+             dst->width, dst->height);
+        return false;
+    }
+
+    if (!fc->pool || fc->pool_size != size) {
+        // The buffers of the previous pool are freed once unreferenced
+        av_buffer_pool_uninit(&fc->pool);
+        fc->pool = av_buffer_pool_init(size, NULL);
+        if (!fc->pool) {
+            LOG_OOM();
+            return false;
+        }
+        fc->pool_size = size;
+    }
+
+    dst->buf[0] = av_buffer_pool_get(fc->pool);
+    if (!dst->buf[0]) {
+        LOG_OOM();
+        return false;
+    }
+
+    int r = av_image_fill_arrays(dst->data, dst->linesize, dst->buf[0]->data,
+                                 dst->format, dst->width, dst->height,
+                                 SC_FRAME_CONVERTER_ALIGN);
+    if (r < 0) {
+        av_frame_unref(dst);
+        return false;
+    }
+
+    r = av_frame_copy_props(dst, src);
+    if (r) {
+        LOG_OOM();
+        av_frame_unref(dst);
+        return false;
+    }
+
+    bool ok = sc_frame_converter_scale(fc, src, dst, flags);
+    if (!ok) {
+        av_frame_unref(dst);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef SC_FRAME_CONVERTER_H
+#define SC_FRAME_CONVERTER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+/**
+ * Pixel format conversion (and scaling) of whole frames, shared by all the
+ * components converting frames with swscale.
+ *
+ * The swscale context is kept as long as the conversion parameters do not
+ * change. With FFmpeg 5.0+, it converts the slices of each frame in parallel
+ * on all the CPU cores.
+ *
+ * The frames allocated by sc_frame_converter_convert_frame() come from a
+ * buffer pool, so that converting a stream does not allocate on every frame.
+ *
+ * It is not thread-safe: each converter must be used by a single thread.
+ */
+struct sc_frame_converter {
+    struct SwsContext *ctx;
+
+    // The parameters the context is initialized for
+    int src_width;
+    int src_height;
+    enum AVPixelFormat src_format;
+    enum AVColorRange src_color_range;
+    enum AVColorSpace src_colorspace;
+    int dst_width;
+    int dst_height;
+    enum AVPixelFormat dst_format;
+    int flags;
+
+    // Buffers of the converted frames, for the current destination format
+    // and size (NULL if not initialized)
+    AVBufferPool *pool;
+    int pool_size;
+
+    AVFrame *wrapper; // to pass caller-provided planes to swscale
+};
+
+bool
+sc_frame_converter_init(struct sc_frame_converter *fc);
+
+void
+sc_frame_converter_destroy(struct sc_frame_converter *fc);
+
+/**
+ * Convert `src` into the planes provided by the caller (e.g. a mapped device
+ * buffer or a locked texture), in the given format and size
+ *
+ * `flags` are the swscale flags (e.g. SWS_POINT or SWS_BILINEAR).
+ */
+bool
+sc_frame_converter_convert(struct sc_frame_converter *fc, const AVFrame *src,
+                           uint8_t *const dst_data[4],
+                           const int dst_linesize[4],
+                           enum AVPixelFormat dst_format, int dst_width,
+                           int dst_height, int flags);
+
+/**
+ * Convert `src` into `dst`, allocated from the pool
+ *
+ * `dst` must be unreferenced, with its format, width and height set. On
+ * success, its properties (pts, color range, etc.) are copied from `src`.
+ */
+bool
+sc_frame_converter_convert_frame(struct sc_frame_converter *fc,
+                                 const AVFrame *src, AVFrame *dst, int flags);
+
+#endif
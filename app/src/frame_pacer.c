@@ -0,0 +1,222 @@
+#include "frame_pacer.h"
+
+#include <assert.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_frame_pacer */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_frame_pacer, frame_sink)
+
+static int
+run_frame_pacer(void *data) {
+    struct sc_frame_pacer *fp = data;
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        sc_mutex_lock(&fp->mutex);
+        // Prevent to push any new frame
+        fp->stopped = true;
+        sc_mutex_unlock(&fp->mutex);
+        return 0;
+    }
+
+    for (;;) {
+        sc_mutex_lock(&fp->mutex);
+
+        while (!fp->stopped && !fp->has_frame) {
+            sc_cond_wait(&fp->cond, &fp->mutex);
+        }
+
+        // The deadline may change if a new frame replaces the pending frame
+        // in the meantime
+        while (!fp->stopped && sc_tick_now() < fp->deadline) {
+            sc_cond_timedwait(&fp->cond, &fp->mutex, fp->deadline);
+        }
+
+        if (fp->stopped) {
+            sc_mutex_unlock(&fp->mutex);
+            break;
+        }
+
+        assert(fp->has_frame);
+        av_frame_move_ref(frame, fp->frame);
+        fp->has_frame = false;
+
+        sc_mutex_unlock(&fp->mutex);
+
+        bool ok = sc_frame_source_sinks_push(&fp->frame_source, frame);
+        av_frame_unref(frame);
+        if (!ok) {
+            LOGE("Paced frame could not be pushed, stopping");
+            sc_mutex_lock(&fp->mutex);
+            // Prevent to push any new frame
+            fp->stopped = true;
+            sc_mutex_unlock(&fp->mutex);
+            break;
+        }
+    }
+
+    av_frame_free(&frame);
+
+    LOGD("Frame pacer thread ended");
+
+    return 0;
+}
+
+static bool
+sc_frame_pacer_frame_sink_open(struct sc_frame_sink *sink,
+                               const AVCodecContext *ctx) {
+    struct sc_frame_pacer *fp = DOWNCAST(sink);
+
+    fp->frame = av_frame_alloc();
+    if (!fp->frame) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&fp->mutex);
+    if (!ok) {
+        goto error_free_frame;
+    }
+
+    ok = sc_cond_init(&fp->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    sc_clock_init(&fp->clock);
+    fp->has_frame = false;
+    fp->deadline = 0;
+    fp->stopped = false;
+
+    if (!sc_frame_source_sinks_open(&fp->frame_source, ctx)) {
+        goto error_destroy_cond;
+    }
+
+    ok = sc_thread_create(&fp->thread, run_frame_pacer, "scrcpy-pacer", fp);
+    if (!ok) {
+        LOGE("Could not start frame pacer thread");
+        goto error_close_sinks;
+    }
+
+    return true;
+
+error_close_sinks:
+    sc_frame_source_sinks_close(&fp->frame_source);
+error_destroy_cond:
+    sc_cond_destroy(&fp->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&fp->mutex);
+error_free_frame:
+    av_frame_free(&fp->frame);
+
+    return false;
+}
+
+static void
+sc_frame_pacer_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_frame_pacer *fp = DOWNCAST(sink);
+
+    sc_mutex_lock(&fp->mutex);
+    fp->stopped = true;
+    sc_cond_signal(&fp->cond);
+    sc_mutex_unlock(&fp->mutex);
+
+    sc_thread_join(&fp->thread, NULL);
+
+    sc_frame_source_sinks_close(&fp->frame_source);
+
+    sc_cond_destroy(&fp->cond);
+    sc_mutex_destroy(&fp->mutex);
+    av_frame_free(&fp->frame);
+}
+
+static bool
+sc_frame_pacer_frame_sink_push(struct sc_frame_sink *sink,
+                               const AVFrame *frame) {
+    struct sc_frame_pacer *fp = DOWNCAST(sink);
+
+    sc_mutex_lock(&fp->mutex);
+
+    if (fp->stopped) {
+        sc_mutex_unlock(&fp->mutex);
+        return false;
+    }
+
+    sc_tick now = sc_tick_now();
+    // PTS (written by the server) are expressed in microseconds
+    sc_tick pts = SC_TICK_FROM_US(frame->pts);
+    sc_clock_update(&fp->clock, now, pts);
+
+    // If a frame is pending, it is replaced but its deadline is kept:
+    // otherwise, if the frame rate is higher than the display refresh rate,
+    // the deadline would be postponed by every new frame, and no frame would
+    // ever be forwarded
+    bool replace = fp->has_frame;
+    if (replace) {
+        // The latest frame wins
+        LOGV("Frame pacer: frame dropped");
+        av_frame_unref(fp->frame);
+        fp->has_frame = false;
+    }
+
+    if (av_frame_ref(fp->frame, frame)) {
+        sc_mutex_unlock(&fp->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    if (replace) {
+        // Keep the current deadline
+    } else if (fp->clock.range == 1) {
+        // First frame, forward it as soon as possible
+        fp->deadline = now;
+    } else {
+        // Present the frame one refresh period after its expected arrival
+        // time, to absorb the jitter. With vsync, the rendering blocks until
+        // the next vertical blank, so forward it half a period earlier, so
+        // that it is presented on the vertical blank nearest to its target.
+        // Otherwise (vrr or immediate), it is presented when it is rendered.
+        sc_tick target = sc_clock_to_system_time(&fp->clock, pts)
+                       + fp->refresh_period;
+        fp->deadline = fp->vblank_aligned ? target - fp->refresh_period / 2
+                                          : target;
+    }
+
+    fp->has_frame = true;
+    sc_cond_signal(&fp->cond);
+
+    sc_mutex_unlock(&fp->mutex);
+
+    return true;
+}
+
+bool
+sc_frame_pacer_init(struct sc_frame_pacer *fp, sc_tick refresh_period,
+                    bool vblank_aligned) {
+    assert(refresh_period > 0);
+
+    if (!sc_frame_source_init(&fp->frame_source)) {
+        return false;
+    }
+
+    fp->refresh_period = refresh_period;
+    fp->vblank_aligned = vblank_aligned;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_frame_pacer_frame_sink_open,
+        .close = sc_frame_pacer_frame_sink_close,
+        .push = sc_frame_pacer_frame_sink_push,
+    };
+
+    fp->frame_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_frame_pacer_destroy(struct sc_frame_pacer *fp) {
+    sc_frame_source_destroy(&fp->frame_source);
+}
@@ -0,0 +1,64 @@
+#ifndef SC_FRAME_PACER_H
+#define SC_FRAME_PACER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavutil/frame.h>
+
+#include "clock.h"
+#include "trait/frame_source.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+/**
+ * A frame pacer forwards each frame at a time derived from its PTS, aligned
+ * on the display refresh, to present frames at regular intervals despite the
+ * network jitter.
+ *
+ * It holds at most 1 frame: if a new frame is received before the pending
+ * frame is forwarded, the pending frame is dropped (the latest frame wins)
+ * so that the latency never accumulates. The new frame is forwarded at the
+ * deadline of the dropped frame, so that frame rates higher than the display
+ * refresh rate are presented at the refresh rate.
+ *
+ * On variable refresh rate displays, the frames are presented as soon as they
+ * are rendered, so they are forwarded at their own target time instead.
+ */
+struct sc_frame_pacer {
+    struct sc_frame_source frame_source; // frame source trait
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    sc_tick refresh_period;
+    bool vblank_aligned;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+
+    struct sc_clock clock;
+    AVFrame *frame; // the pending frame
+    bool has_frame;
+    sc_tick deadline; // the system time to forward the pending frame
+    bool stopped;
+};
+
+/**
+ * Initialize a frame pacer.
+ *
+ * \param refresh_period the display refresh period (strictly positive)
+ * \param vblank_aligned true if the rendering blocks until the next vertical
+ *                       blank
+ */
+bool
+sc_frame_pacer_init(struct sc_frame_pacer *fp, sc_tick refresh_period,
+                    bool vblank_aligned);
+
+void
+sc_frame_pacer_destroy(struct sc_frame_pacer *fp);
+
+#endif
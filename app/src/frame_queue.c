@@ -0,0 +1,273 @@
+#include "frame_queue.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_frame_queue */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_frame_queue, frame_sink)
+
+// Must be called with the mutex locked
+static AVFrame *
+sc_frame_queue_take_free_frame(struct sc_frame_queue *fq) {
+    sc_mutex_assert(&fq->mutex);
+
+    if (fq->free_frames.size) {
+        return fq->free_frames.data[--fq->free_frames.size];
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+    }
+    return frame;
+}
+
+// Must be called with the mutex locked
+static void
+sc_frame_queue_recycle(struct sc_frame_queue *fq, AVFrame *frame) {
+    sc_mutex_assert(&fq->mutex);
+
+    av_frame_unref(frame);
+    bool ok = sc_vector_push(&fq->free_frames, frame);
+    if (!ok) {
+        // Not fatal, the frame will not be reused
+        av_frame_free(&frame);
+    }
+}
+
+static int
+run_frame_queue(void *data) {
+    struct sc_frame_queue *fq = data;
+
+    for (;;) {
+        sc_mutex_lock(&fq->mutex);
+
+        while (!fq->stopped && sc_vecdeque_is_empty(&fq->queue)) {
+            sc_cond_wait(&fq->queue_cond, &fq->mutex);
+        }
+
+        if (fq->stopped) {
+            sc_mutex_unlock(&fq->mutex);
+            break;
+        }
+
+        AVFrame *frame = sc_vecdeque_pop(&fq->queue);
+        sc_cond_signal(&fq->space_cond);
+
+        sc_mutex_unlock(&fq->mutex);
+
+        bool ok = sc_frame_source_sinks_push(&fq->frame_source, frame);
+
+        sc_mutex_lock(&fq->mutex);
+        sc_frame_queue_recycle(fq, frame);
+        if (ok) {
+            ++fq->stats.forwarded;
+        } else {
+            // Prevent to push any new frame
+            fq->stopped = true;
+            sc_cond_signal(&fq->space_cond);
+        }
+        sc_mutex_unlock(&fq->mutex);
+
+        if (!ok) {
+            LOGE("Frame queue '%s': frame could not be pushed, stopping",
+                 fq->name);
+            break;
+        }
+    }
+
+    LOGD("Frame queue '%s': thread ended", fq->name);
+
+    return 0;
+}
+
+static bool
+sc_frame_queue_frame_sink_open(struct sc_frame_sink *sink,
+                               const AVCodecContext *ctx) {
+    struct sc_frame_queue *fq = DOWNCAST(sink);
+
+    fq->stopped = false;
+
+    if (!sc_frame_source_sinks_open(&fq->frame_source, ctx)) {
+        return false;
+    }
+
+    bool ok = sc_thread_create(&fq->thread, run_frame_queue, "scrcpy-frameq",
+                               fq);
+    if (!ok) {
+        LOGE("Frame queue '%s': could not start thread", fq->name);
+        sc_frame_source_sinks_close(&fq->frame_source);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_frame_queue_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_frame_queue *fq = DOWNCAST(sink);
+
+    sc_mutex_lock(&fq->mutex);
+    fq->stopped = true;
+    sc_cond_signal(&fq->queue_cond);
+    sc_cond_signal(&fq->space_cond);
+    sc_mutex_unlock(&fq->mutex);
+
+    sc_thread_join(&fq->thread, NULL);
+
+    sc_frame_source_sinks_close(&fq->frame_source);
+
+    // The thread is stopped, the mutex is not necessary anymore, but it is
+    // required by the recycle function
+    sc_mutex_lock(&fq->mutex);
+    while (!sc_vecdeque_is_empty(&fq->queue)) {
+        AVFrame *frame = sc_vecdeque_pop(&fq->queue);
+        sc_frame_queue_recycle(fq, frame);
+    }
+
+    LOGD("Frame queue '%s': %" PRIu64 " frames pushed, %" PRIu64
+         " forwarded, %" PRIu64 " dropped, %" PRIu64 " blocked", fq->name,
+         fq->stats.pushed, fq->stats.forwarded, fq->stats.dropped,
+         fq->stats.blocked);
+    sc_mutex_unlock(&fq->mutex);
+}
+
+static bool
+sc_frame_queue_frame_sink_push(struct sc_frame_sink *sink,
+                               const AVFrame *frame) {
+    struct sc_frame_queue *fq = DOWNCAST(sink);
+
+    sc_mutex_lock(&fq->mutex);
+
+    if (fq->stopped) {
+        sc_mutex_unlock(&fq->mutex);
+        return false;
+    }
+
+    ++fq->stats.pushed;
+
+    if (sc_vecdeque_size(&fq->queue) >= fq->capacity) {
+        if (fq->policy == SC_FRAME_QUEUE_POLICY_BLOCK) {
+            ++fq->stats.blocked;
+            while (!fq->stopped
+                    && sc_vecdeque_size(&fq->queue) >= fq->capacity) {
+                sc_cond_wait(&fq->space_cond, &fq->mutex);
+            }
+
+            if (fq->stopped) {
+                sc_mutex_unlock(&fq->mutex);
+                return false;
+            }
+        } else {
+            AVFrame *oldest = sc_vecdeque_pop(&fq->queue);
+            sc_frame_queue_recycle(fq, oldest);
+            ++fq->stats.dropped;
+        }
+    }
+
+    AVFrame *f = sc_frame_queue_take_free_frame(fq);
+    if (!f) {
+        sc_mutex_unlock(&fq->mutex);
+        return false;
+    }
+
+    if (av_frame_ref(f, frame)) {
+        LOG_OOM();
+        av_frame_free(&f);
+        sc_mutex_unlock(&fq->mutex);
+        return false;
+    }
+
+    bool ok = sc_vecdeque_push(&fq->queue, f);
+    if (!ok) {
+        LOG_OOM();
+        av_frame_free(&f);
+        sc_mutex_unlock(&fq->mutex);
+        return false;
+    }
+
+    sc_cond_signal(&fq->queue_cond);
+
+    sc_mutex_unlock(&fq->mutex);
+
+    return true;
+}
+
+bool
+sc_frame_queue_init(struct sc_frame_queue *fq, const char *name,
+                    enum sc_frame_queue_policy policy, size_t capacity) {
+    assert(policy == SC_FRAME_QUEUE_POLICY_LATEST || capacity > 0);
+
+    bool ok = sc_mutex_init(&fq->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&fq->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&fq->space_cond);
+    if (!ok) {
+        goto error_destroy_queue_cond;
+    }
+
+    if (!sc_frame_source_init(&fq->frame_source)) {
+        goto error_destroy_space_cond;
+    }
+
+    fq->name = name; // statically allocated
+    fq->policy = policy;
+    // Keeping only the last frame is dropping the oldest with a capacity of 1
+    fq->capacity = policy == SC_FRAME_QUEUE_POLICY_LATEST ? 1 : capacity;
+    fq->stopped = false;
+    sc_vecdeque_init(&fq->queue);
+    sc_vector_init(&fq->free_frames);
+    fq->stats = (struct sc_frame_queue_stats) {0};
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_frame_queue_frame_sink_open,
+        .close = sc_frame_queue_frame_sink_close,
+        .push = sc_frame_queue_frame_sink_push,
+    };
+
+    fq->frame_sink.ops = &ops;
+
+    return true;
+
+error_destroy_space_cond:
+    sc_cond_destroy(&fq->space_cond);
+error_destroy_queue_cond:
+    sc_cond_destroy(&fq->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&fq->mutex);
+
+    return false;
+}
+
+void
+sc_frame_queue_destroy(struct sc_frame_queue *fq) {
+    assert(sc_vecdeque_is_empty(&fq->queue));
+    sc_vecdeque_destroy(&fq->queue);
+
+    for (size_t i = 0; i < fq->free_frames.size; ++i) {
+        av_frame_free(&fq->free_frames.data[i]);
+    }
+    sc_vector_destroy(&fq->free_frames);
+
+    sc_frame_source_destroy(&fq->frame_source);
+    sc_cond_destroy(&fq->space_cond);
+    sc_cond_destroy(&fq->queue_cond);
+    sc_mutex_destroy(&fq->mutex);
+}
+
+void
+sc_frame_queue_get_stats(struct sc_frame_queue *fq,
+                         struct sc_frame_queue_stats *stats) {
+    sc_mutex_lock(&fq->mutex);
+    *stats = fq->stats;
+    sc_mutex_unlock(&fq->mutex);
+}
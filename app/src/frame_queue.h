@@ -0,0 +1,89 @@
+#ifndef SC_FRAME_QUEUE_H
+#define SC_FRAME_QUEUE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "trait/frame_sink.h"
+#include "trait/frame_source.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+#include "util/vector.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+enum sc_frame_queue_policy {
+    // Only keep the last frame: a pending frame not consumed yet is replaced
+    // by the new one (minimal latency)
+    SC_FRAME_QUEUE_POLICY_LATEST,
+    // Keep up to capacity frames, the oldest pending frame is dropped when the
+    // queue is full
+    SC_FRAME_QUEUE_POLICY_DROP_OLDEST,
+    // Keep up to capacity frames, the producer waits when the queue is full
+    // (no frame is ever dropped, but a slow consumer slows down the producer)
+    SC_FRAME_QUEUE_POLICY_BLOCK,
+};
+
+struct sc_frame_queue_stats {
+    uint64_t pushed; // frames received
+    uint64_t forwarded; // frames pushed to the sinks
+    uint64_t dropped; // frames dropped because the queue was full
+    uint64_t blocked; // pushes which had to wait for the consumer
+};
+
+/**
+ * A frame queue forwards the frames to its sinks from a separate thread, so
+ * that the producer (typically the decoder) never waits for a slow consumer
+ * (except with the BLOCK policy).
+ *
+ * The policy selects the tradeoff between latency and completeness.
+ */
+struct sc_frame_queue {
+    struct sc_frame_source frame_source; // frame source trait
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    const char *name; // must be statically allocated
+    enum sc_frame_queue_policy policy;
+    size_t capacity;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond; // signaled when a frame is queued
+    sc_cond space_cond; // signaled when a frame is dequeued
+
+    struct SC_VECDEQUE(AVFrame *) queue;
+    // Empty frames to reuse, to avoid an allocation for every frame
+    struct SC_VECTOR(AVFrame *) free_frames;
+    bool stopped;
+
+    struct sc_frame_queue_stats stats; // protected by the mutex
+};
+
+/**
+ * Initialize a frame queue.
+ *
+ * \param name the name of the queue (for logs), statically allocated
+ * \param policy the drop policy
+ * \param capacity the maximum number of pending frames (strictly positive),
+ *                 ignored for SC_FRAME_QUEUE_POLICY_LATEST
+ */
+bool
+sc_frame_queue_init(struct sc_frame_queue *fq, const char *name,
+                    enum sc_frame_queue_policy policy, size_t capacity);
+
+void
+sc_frame_queue_destroy(struct sc_frame_queue *fq);
+
+/**
+ * Get a snapshot of the counters (can be called from any thread)
+ */
+void
+sc_frame_queue_get_stats(struct sc_frame_queue *fq,
+                         struct sc_frame_queue_stats *stats);
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SCRCPY_FRAME_SINK_PLUGIN_H
+#define SCRCPY_FRAME_SINK_PLUGIN_H
+
+/**
+ * Frame sink plugin ABI (--frame-sink-plugin)
+ *
+ * A plugin is a shared library receiving the decoded video frames in-process
+ * (for example to analyze them), without going through a shared memory or a
+ * V4L2 device.
+ *
+ * This header is standalone: it depends neither on scrcpy internals nor on
+ * FFmpeg, so that a plugin built against it keeps working with future
+ * versions of scrcpy exposing the same ABI version.
+ *
+ * The library must export a function named "scrcpy_frame_sink_plugin", taking
+ * no arguments and returning a pointer to a statically allocated
+ * struct scrcpy_frame_sink_plugin:
+ *
+ *     static const struct scrcpy_frame_sink_plugin plugin = {
+ *         .abi_version = SCRCPY_FRAME_SINK_PLUGIN_ABI_VERSION,
+ *         .name = "my-plugin",
+ *         .open = my_open,
+ *         .close = my_close,
+ *         .push = my_push,
+ *     };
+ *
+ *     SCRCPY_PLUGIN_EXPORT const struct scrcpy_frame_sink_plugin *
+ *     scrcpy_frame_sink_plugin(void) {
+ *         return &plugin;
+ *     }
+ *
+ * The callbacks are never called concurrently. open() is called once when the
+ * video stream starts, then push() for each frame, then close() once when the
+ * stream ends. The frames are pushed from a dedicated thread, through a queue
+ * which keeps only the latest frame: a slow plugin skips frames, but never
+ * delays the mirroring.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCRCPY_FRAME_SINK_PLUGIN_ABI_VERSION 1
+
+// Name of the function to export
+#define SCRCPY_FRAME_SINK_PLUGIN_ENTRY "scrcpy_frame_sink_plugin"
+
+#ifdef _WIN32
+# define SCRCPY_PLUGIN_EXPORT __declspec(dllexport)
+#else
+# define SCRCPY_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+enum scrcpy_plugin_pixel_format {
+    // 3 planes: Y, U, V (chroma subsampled by 2 in both dimensions)
+    SCRCPY_PLUGIN_PIXEL_FORMAT_YUV420P = 1,
+    // 2 planes: Y, interleaved UV (chroma subsampled by 2 in both dimensions)
+    SCRCPY_PLUGIN_PIXEL_FORMAT_NV12 = 2,
+};
+
+enum scrcpy_plugin_color_range {
+    // Y in [16, 235], U and V in [16, 240] (8-bit "TV" range, the usual one)
+    SCRCPY_PLUGIN_COLOR_RANGE_LIMITED = 1,
+    // Y, U and V in [0, 255] (8-bit "PC" or JPEG range)
+    SCRCPY_PLUGIN_COLOR_RANGE_FULL = 2,
+};
+
+struct scrcpy_plugin_video_info {
+    const char *codec; // "h264", "h265" or "av1"
+    // Initial video size (it changes on device rotation, see the frames)
+    uint32_t width;
+    uint32_t height;
+};
+
+struct scrcpy_plugin_frame {
+    int64_t pts; // in microseconds
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // enum scrcpy_plugin_pixel_format
+    uint32_t color_range; // enum scrcpy_plugin_color_range
+    uint32_t plane_count;
+    // Only valid during the push() call, copy the pixels to keep them
+    const uint8_t *data[4];
+    int32_t linesize[4];
+};
+
+struct scrcpy_frame_sink_plugin {
+    uint32_t abi_version; // must be SCRCPY_FRAME_SINK_PLUGIN_ABI_VERSION
+    const char *name; // for logs
+
+    // Store any plugin state into *userdata, it is passed to the other
+    // callbacks. Return false to disable the plugin.
+    bool (*open)(void **userdata, const struct scrcpy_plugin_video_info *info);
+    void (*close)(void *userdata);
+    // Return false to disable the plugin (close() is still called)
+    bool (*push)(void *userdata, const struct scrcpy_plugin_frame *frame);
+};
+
+typedef const struct scrcpy_frame_sink_plugin *
+(*scrcpy_frame_sink_plugin_fn)(void);
+
+#endif
@@ -0,0 +1,71 @@
+#include "gop_cache.h"
+
+#include <assert.h>
+#include <libavutil/avutil.h>
+
+#include "util/log.h"
+
+// Memory retained by a cached packet (its whole buffer)
+static size_t
+sc_gop_cache_packet_bytes(const AVPacket *packet) {
+    return packet->buf ? packet->buf->size : (size_t) packet->size;
+}
+
+void
+sc_gop_cache_init(struct sc_gop_cache *cache) {
+    sc_vector_init(&cache->packets);
+    cache->bytes = 0;
+}
+
+void
+sc_gop_cache_clear(struct sc_gop_cache *cache) {
+    for (size_t i = 0; i < cache->packets.size; ++i) {
+        av_packet_free(&cache->packets.data[i]);
+    }
+    // Keep the allocation for the next GOP
+    cache->packets.size = 0;
+    cache->bytes = 0;
+}
+
+void
+sc_gop_cache_destroy(struct sc_gop_cache *cache) {
+    sc_gop_cache_clear(cache);
+    sc_vector_destroy(&cache->packets);
+}
+
+void
+sc_gop_cache_push(struct sc_gop_cache *cache, const AVPacket *packet) {
+    assert(packet->pts != AV_NOPTS_VALUE);
+
+    if (packet->flags & AV_PKT_FLAG_KEY) {
+        sc_gop_cache_clear(cache);
+    } else if (sc_gop_cache_is_empty(cache)) {
+        // Not decodable without the missing previous packets
+        return;
+    }
+
+    size_t bytes = sc_gop_cache_packet_bytes(packet);
+    if (cache->packets.size == SC_GOP_CACHE_MAX_PACKETS
+            || cache->bytes + bytes > SC_GOP_CACHE_MAX_BYTES) {
+        LOGD("GOP too large, not cached");
+        sc_gop_cache_clear(cache);
+        return;
+    }
+
+    AVPacket *ref = av_packet_clone(packet);
+    if (!ref) {
+        LOG_OOM();
+        sc_gop_cache_clear(cache);
+        return;
+    }
+
+    bool ok = sc_vector_push(&cache->packets, ref);
+    if (!ok) {
+        LOG_OOM();
+        av_packet_free(&ref);
+        sc_gop_cache_clear(cache);
+        return;
+    }
+
+    cache->bytes += bytes;
+}
@@ -0,0 +1,54 @@
+#ifndef SC_GOP_CACHE_H
+#define SC_GOP_CACHE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavcodec/packet.h>
+
+#include "util/vector.h"
+
+// Bounds of the cached GOP (10 seconds at 60 fps)
+#define SC_GOP_CACHE_MAX_PACKETS 600
+#define SC_GOP_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+/**
+ * Cache of the video packets since the last keyframe (the current GOP)
+ *
+ * A consumer attached mid-stream may be primed with these packets, so that it
+ * can decode immediately instead of waiting for the next keyframe.
+ *
+ * The packets are referenced, not copied. If the GOP exceeds the bounds, the
+ * cache is emptied until the next keyframe.
+ *
+ * It is not thread-safe.
+ */
+struct sc_gop_cache {
+    struct SC_VECTOR(AVPacket *) packets;
+    size_t bytes;
+};
+
+void
+sc_gop_cache_init(struct sc_gop_cache *cache);
+
+void
+sc_gop_cache_destroy(struct sc_gop_cache *cache);
+
+void
+sc_gop_cache_clear(struct sc_gop_cache *cache);
+
+/**
+ * Add a media packet (config packets must not be pushed)
+ *
+ * A keyframe starts a new GOP.
+ */
+void
+sc_gop_cache_push(struct sc_gop_cache *cache, const AVPacket *packet);
+
+static inline bool
+sc_gop_cache_is_empty(const struct sc_gop_cache *cache) {
+    return !cache->packets.size;
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include "util/binary.h"
@@ -208,6 +209,8 @@ sc_hid_gamepad_slot_init(struct sc_hid_gamepad_slot *slot,
     slot->axis_right_y = AXIS_RESCALE(0);
     slot->axis_left_trigger = 0;
     slot->axis_right_trigger = 0;
+    slot->has_sent = false;
+    slot->pending = false;
 }
 
 static ssize_t
@@ -223,10 +226,11 @@ sc_hid_gamepad_slot_find(struct sc_hid_gamepad *hid, uint32_t gamepad_id) {
 }
 
 void
-sc_hid_gamepad_init(struct sc_hid_gamepad *hid) {
+sc_hid_gamepad_init(struct sc_hid_gamepad *hid, unsigned rate) {
     for (size_t i = 0; i < SC_MAX_GAMEPADS; ++i) {
         hid->slots[i].gamepad_id = SC_GAMEPAD_ID_INVALID;
     }
+    hid->min_interval = rate ? SC_TICK_FREQ / rate : 0;
 }
 
 static inline uint16_t
@@ -328,6 +332,41 @@ sc_hid_gamepad_event_from_slot(uint16_t hid_id,
     data[14] = sc_hid_gamepad_get_dpad_value(slot->buttons);
 }
 
+// Generate the report of the current state of the slot
+//
+// Return false if it is identical to the last report, or if it is
+// rate-limited (unless force is set).
+static bool
+sc_hid_gamepad_generate_input(struct sc_hid_gamepad *hid, size_t slot_idx,
+                              struct sc_hid_input *hid_input, bool force) {
+    struct sc_hid_gamepad_slot *slot = &hid->slots[slot_idx];
+
+    uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
+    sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
+
+    if (slot->has_sent
+            && !memcmp(slot->sent_report, hid_input->data, hid_input->size)) {
+        // Nothing changed since the last report (including if the state
+        // changed then went back to the last reported value)
+        slot->pending = false;
+        return false;
+    }
+
+    sc_tick now = sc_tick_now();
+    if (!force && slot->has_sent && hid->min_interval
+            && now - slot->sent_time < hid->min_interval) {
+        slot->pending = true;
+        return false;
+    }
+
+    assert(hid_input->size <= SC_HID_MAX_SIZE);
+    memcpy(slot->sent_report, hid_input->data, hid_input->size);
+    slot->has_sent = true;
+    slot->sent_time = now;
+    slot->pending = false;
+    return true;
+}
+
 static uint32_t
 sc_hid_gamepad_get_button_id(enum sc_gamepad_button button) {
     switch (button) {
@@ -400,10 +439,7 @@ sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
         slot->buttons &= ~button;
     }
 
-    uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
-    sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
-
-    return true;
+    return sc_hid_gamepad_generate_input(hid, slot_idx, hid_input, true);
 }
 
 bool
@@ -447,8 +483,40 @@ sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
             return false;
     }
 
-    uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
-    sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
+    return sc_hid_gamepad_generate_input(hid, slot_idx, hid_input, false);
+}
 
-    return true;
+bool
+sc_hid_gamepad_get_pending_deadline(struct sc_hid_gamepad *hid,
+                                    sc_tick *deadline) {
+    bool found = false;
+    for (size_t i = 0; i < SC_MAX_GAMEPADS; ++i) {
+        struct sc_hid_gamepad_slot *slot = &hid->slots[i];
+        if (slot->gamepad_id != SC_GAMEPAD_ID_INVALID && slot->pending) {
+            sc_tick slot_deadline = slot->sent_time + hid->min_interval;
+            if (!found || slot_deadline < *deadline) {
+                *deadline = slot_deadline;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+bool
+sc_hid_gamepad_generate_pending_input(struct sc_hid_gamepad *hid,
+                                      struct sc_hid_input *hid_input) {
+    sc_tick now = sc_tick_now();
+    for (size_t i = 0; i < SC_MAX_GAMEPADS; ++i) {
+        struct sc_hid_gamepad_slot *slot = &hid->slots[i];
+        if (slot->gamepad_id != SC_GAMEPAD_ID_INVALID && slot->pending
+                && now >= slot->sent_time + hid->min_interval) {
+            if (sc_hid_gamepad_generate_input(hid, i, hid_input, true)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
 }
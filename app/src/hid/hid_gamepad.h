@@ -8,6 +8,7 @@
 
 #include "hid/hid_event.h"
 #include "input_events.h"
+#include "util/tick.h"
 
 #define SC_MAX_GAMEPADS 8
 #define SC_HID_ID_GAMEPAD_FIRST 3
@@ -22,14 +23,31 @@ struct sc_hid_gamepad_slot {
     uint16_t axis_right_y;
     uint16_t axis_left_trigger;
     uint16_t axis_right_trigger;
+
+    // Last report generated, to only generate reports on changes
+    uint8_t sent_report[SC_HID_MAX_SIZE];
+    bool has_sent;
+    sc_tick sent_time;
+    // The state changed, but the report was rate-limited
+    bool pending;
 };
 
 struct sc_hid_gamepad {
     struct sc_hid_gamepad_slot slots[SC_MAX_GAMEPADS];
+    // Minimal interval between two reports triggered by axis events for a
+    // gamepad (0 for unlimited)
+    sc_tick min_interval;
 };
 
+/**
+ * Initialize a HID gamepad generating at most `rate` reports per second per
+ * gamepad for axis events (0 for unlimited)
+ *
+ * The button events always generate a report immediately (a quick press and
+ * release must not be lost).
+ */
 void
-sc_hid_gamepad_init(struct sc_hid_gamepad *hid);
+sc_hid_gamepad_init(struct sc_hid_gamepad *hid, unsigned rate);
 
 bool
 sc_hid_gamepad_generate_open(struct sc_hid_gamepad *hid,
@@ -46,9 +64,36 @@ sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
                                           struct sc_hid_input *hid_input,
                                 const struct sc_gamepad_button_event *event);
 
+/**
+ * Update the gamepad state from an axis event
+ *
+ * Return true if a report must be sent. If the report is rate-limited, it
+ * returns false and the report becomes pending: the caller must call
+ * sc_hid_gamepad_generate_pending_input() once the deadline returned by
+ * sc_hid_gamepad_get_pending_deadline() is reached, so that the latest state
+ * is never lost.
+ */
 bool
 sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
                                         struct sc_hid_input *hid_input,
                                 const struct sc_gamepad_axis_event *event);
 
+/**
+ * Get the earliest deadline of the pending reports
+ *
+ * Return false if there is no pending report.
+ */
+bool
+sc_hid_gamepad_get_pending_deadline(struct sc_hid_gamepad *hid,
+                                    sc_tick *deadline);
+
+/**
+ * Generate one pending report whose deadline is reached
+ *
+ * Return false if there is none (it must be called until it returns false).
+ */
+bool
+sc_hid_gamepad_generate_pending_input(struct sc_hid_gamepad *hid,
+                                      struct sc_hid_input *hid_input);
+
 #endif
@@ -211,6 +211,32 @@ sc_hid_mouse_generate_input_from_scroll(struct sc_hid_input *hid_input,
     return true;
 }
 
+bool
+sc_hid_mouse_merge_input(struct sc_hid_input *prev,
+                         const struct sc_hid_input *input) {
+    if (prev->hid_id != SC_HID_ID_MOUSE || input->hid_id != SC_HID_ID_MOUSE) {
+        return false;
+    }
+
+    uint8_t *p = prev->data;
+    const uint8_t *d = input->data;
+    if (p[0] != d[0] || p[3] || p[4] || d[3] || d[4]) {
+        // Different buttons state or scrolling
+        return false;
+    }
+
+    int x = (int8_t) p[1] + (int8_t) d[1];
+    int y = (int8_t) p[2] + (int8_t) d[2];
+    if (x < -127 || x > 127 || y < -127 || y > 127) {
+        // The sum does not fit in a single report
+        return false;
+    }
+
+    p[1] = x;
+    p[2] = y;
+    return true;
+}
+
 void sc_hid_mouse_generate_open(struct sc_hid_open *hid_open) {
     hid_open->hid_id = SC_HID_ID_MOUSE;
     hid_open->report_desc = SC_HID_MOUSE_REPORT_DESC;
@@ -26,4 +26,13 @@ bool
 sc_hid_mouse_generate_input_from_scroll(struct sc_hid_input *hid_input,
                                     const struct sc_mouse_scroll_event *event);
 
+// Merge input into prev (a mouse input not sent yet) if both are relative
+// motions with the same buttons state, by summing their deltas (without losing
+// any motion)
+//
+// Return false if the inputs cannot be merged (prev is left untouched).
+bool
+sc_hid_mouse_merge_input(struct sc_hid_input *prev,
+                         const struct sc_hid_input *input);
+
 #endif
@@ -0,0 +1,376 @@
+#include "hwaccel.h"
+
+#include <assert.h>
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+# include <libavutil/hwcontext.h>
+# include <libavutil/pixdesc.h>
+#endif
+
+#include "util/log.h"
+
+const char *
+sc_hwaccel_get_name(enum sc_hwaccel hwaccel) {
+    switch (hwaccel) {
+        case SC_HWACCEL_NONE:
+            return "none";
+        case SC_HWACCEL_AUTO:
+            return "auto";
+        case SC_HWACCEL_VAAPI:
+            return "vaapi";
+        case SC_HWACCEL_VDPAU:
+            return "vdpau";
+        case SC_HWACCEL_D3D11VA:
+            return "d3d11va";
+        case SC_HWACCEL_DXVA2:
+            return "dxva2";
+        case SC_HWACCEL_VIDEOTOOLBOX:
+            return "videotoolbox";
+        case SC_HWACCEL_VULKAN:
+            return "vulkan";
+        default:
+            return "(unknown)";
+    }
+}
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+static enum AVHWDeviceType
+sc_hwaccel_to_av_device_type(enum sc_hwaccel hwaccel) {
+    switch (hwaccel) {
+        case SC_HWACCEL_VAAPI:
+            return AV_HWDEVICE_TYPE_VAAPI;
+        case SC_HWACCEL_VDPAU:
+            return AV_HWDEVICE_TYPE_VDPAU;
+        case SC_HWACCEL_D3D11VA:
+            return AV_HWDEVICE_TYPE_D3D11VA;
+        case SC_HWACCEL_DXVA2:
+            return AV_HWDEVICE_TYPE_DXVA2;
+        case SC_HWACCEL_VIDEOTOOLBOX:
+            return AV_HWDEVICE_TYPE_VIDEOTOOLBOX;
+#ifdef SCRCPY_LAVU_HAS_HWDEVICE_VULKAN
+        case SC_HWACCEL_VULKAN:
+            return AV_HWDEVICE_TYPE_VULKAN;
+#endif
+        default:
+            return AV_HWDEVICE_TYPE_NONE;
+    }
+}
+
+// Return the hardware pixel format produced by the codec for the device type,
+// or AV_PIX_FMT_NONE if the codec does not support this device type
+static enum AVPixelFormat
+sc_hwaccel_find_pix_fmt(const AVCodec *codec, enum AVHWDeviceType type) {
+    for (int i = 0;; ++i) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+        if (!config) {
+            return AV_PIX_FMT_NONE;
+        }
+
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)
+                && config->device_type == type) {
+            return config->pix_fmt;
+        }
+    }
+}
+
+static enum AVPixelFormat
+sc_hwaccel_get_format(AVCodecContext *ctx, const enum AVPixelFormat *fmts) {
+    assert(ctx->hw_device_ctx);
+    AVHWDeviceContext *device_ctx =
+        (AVHWDeviceContext *) ctx->hw_device_ctx->data;
+    enum AVPixelFormat hw_fmt =
+        sc_hwaccel_find_pix_fmt(ctx->codec, device_ctx->type);
+
+    for (const enum AVPixelFormat *p = fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        if (*p == hw_fmt) {
+            return hw_fmt;
+        }
+    }
+
+    // The hardware decoder does not support this stream (for example, the
+    // profile or the resolution), use the first software format instead
+    for (const enum AVPixelFormat *p = fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*p);
+        if (desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            LOGW("Hardware decoding not supported for this stream, "
+                 "fallback to software decoding");
+            return *p;
+        }
+    }
+
+    LOGE("No suitable pixel format for decoding");
+    return AV_PIX_FMT_NONE;
+}
+
+// Create a device of the given type, if it supports the codec
+static AVBufferRef *
+sc_hwaccel_create_device_type(const AVCodec *codec, enum AVHWDeviceType type) {
+    const char *type_name = av_hwdevice_get_type_name(type);
+
+    if (sc_hwaccel_find_pix_fmt(codec, type) == AV_PIX_FMT_NONE) {
+        LOGD("Decoder %s does not support hwaccel %s", codec->name, type_name);
+        return NULL;
+    }
+
+    AVBufferRef *device_ctx;
+    int r = av_hwdevice_ctx_create(&device_ctx, type, NULL, NULL, 0);
+    if (r < 0) {
+        LOGD("Could not create hwaccel %s device: %d", type_name, r);
+        return NULL;
+    }
+
+    return device_ctx;
+}
+
+static void
+sc_hwaccel_attach_device(AVCodecContext *ctx, AVBufferRef *device_ctx) {
+    // The codec context takes ownership of the reference
+    ctx->hw_device_ctx = device_ctx;
+    ctx->get_format = sc_hwaccel_get_format;
+
+    AVHWDeviceContext *device = (AVHWDeviceContext *) device_ctx->data;
+    LOGI("Hardware video decoding enabled: %s",
+         av_hwdevice_get_type_name(device->type));
+}
+
+static bool
+sc_hwaccel_try_device(AVCodecContext *ctx, const AVCodec *codec,
+                      enum AVHWDeviceType type) {
+    AVBufferRef *device_ctx = sc_hwaccel_create_device_type(codec, type);
+    if (!device_ctx) {
+        return false;
+    }
+
+    sc_hwaccel_attach_device(ctx, device_ctx);
+    return true;
+}
+#endif
+
+static enum AVCodecID
+sc_hwaccel_to_avcodec_id(enum sc_codec codec) {
+    switch (codec) {
+        case SC_CODEC_H264:
+            return AV_CODEC_ID_H264;
+        case SC_CODEC_H265:
+            return AV_CODEC_ID_HEVC;
+        case SC_CODEC_AV1:
+#ifdef SCRCPY_LAVC_HAS_AV1
+            return AV_CODEC_ID_AV1;
+#endif
+        default:
+            return AV_CODEC_ID_NONE;
+    }
+}
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+// Larger than the number of AVHWDeviceType values
+# define SC_HWACCEL_MAX_DEVICE_TYPES 32
+
+// Return true if the device type supports the codec and the device can be
+// created on this computer
+static bool
+sc_hwaccel_can_decode(const AVCodec *codec, enum AVHWDeviceType type,
+                      bool *device_ok) {
+    if (sc_hwaccel_find_pix_fmt(codec, type) == AV_PIX_FMT_NONE) {
+        return false;
+    }
+
+    // The device creation does not depend on the codec, only probe it once
+    if (!*device_ok) {
+        AVBufferRef *device_ctx;
+        int r = av_hwdevice_ctx_create(&device_ctx, type, NULL, NULL, 0);
+        if (r < 0) {
+            return false;
+        }
+        av_buffer_unref(&device_ctx);
+        *device_ok = true;
+    }
+
+    return true;
+}
+
+static bool
+sc_hwaccel_can_decode_any(const AVCodec *codec, enum sc_hwaccel hwaccel,
+                          bool device_ok[]) {
+    if (hwaccel == SC_HWACCEL_AUTO) {
+        enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+        while ((type = av_hwdevice_iterate_types(type))
+                != AV_HWDEVICE_TYPE_NONE) {
+            if (type < SC_HWACCEL_MAX_DEVICE_TYPES
+                    && sc_hwaccel_can_decode(codec, type, &device_ok[type])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    enum AVHWDeviceType type = sc_hwaccel_to_av_device_type(hwaccel);
+    return type != AV_HWDEVICE_TYPE_NONE && type < SC_HWACCEL_MAX_DEVICE_TYPES
+        && sc_hwaccel_can_decode(codec, type, &device_ok[type]);
+}
+#endif
+
+unsigned
+sc_hwaccel_rank_video_codecs(enum sc_hwaccel hwaccel,
+                             enum sc_codec out[SC_VIDEO_CODEC_COUNT]) {
+    // By compression efficiency
+    static const enum sc_codec codecs[] = {
+        SC_CODEC_AV1,
+        SC_CODEC_H265,
+        SC_CODEC_H264,
+    };
+    static const enum AVCodecID codec_ids[] = {
+        AV_CODEC_ID_AV1,
+        AV_CODEC_ID_HEVC,
+        AV_CODEC_ID_H264,
+    };
+    static_assert(ARRAY_LEN(codecs) == SC_VIDEO_CODEC_COUNT,
+                  "Invalid video codec count");
+
+    bool hw[SC_VIDEO_CODEC_COUNT] = {0};
+    bool supported[SC_VIDEO_CODEC_COUNT] = {0};
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    // Indexed by AVHWDeviceType
+    bool device_ok[SC_HWACCEL_MAX_DEVICE_TYPES] = {0};
+#endif
+
+    for (unsigned i = 0; i < SC_VIDEO_CODEC_COUNT; ++i) {
+        const AVCodec *codec = avcodec_find_decoder(codec_ids[i]);
+        if (!codec) {
+            LOGD("No %s decoder", avcodec_get_name(codec_ids[i]));
+            continue;
+        }
+        supported[i] = true;
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+        if (hwaccel != SC_HWACCEL_NONE) {
+            hw[i] = sc_hwaccel_can_decode_any(codec, hwaccel, device_ok);
+        }
+#else
+        (void) hwaccel;
+#endif
+    }
+
+    unsigned count = 0;
+
+    // Hardware-decodable codecs, by compression efficiency
+    for (unsigned i = 0; i < SC_VIDEO_CODEC_COUNT; ++i) {
+        if (supported[i] && hw[i]) {
+            out[count++] = codecs[i];
+        }
+    }
+
+    // Software-decodable codecs, by decoding cost
+    for (unsigned i = SC_VIDEO_CODEC_COUNT; i-- > 0;) {
+        if (supported[i] && !hw[i]) {
+            out[count++] = codecs[i];
+        }
+    }
+
+    return count;
+}
+
+bool
+sc_hwaccel_configure(AVCodecContext *ctx, const AVCodec *codec,
+                     enum sc_hwaccel hwaccel) {
+    assert(hwaccel != SC_HWACCEL_NONE);
+    assert(codec->type == AVMEDIA_TYPE_VIDEO);
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    if (hwaccel == SC_HWACCEL_AUTO) {
+        enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+        while ((type = av_hwdevice_iterate_types(type))
+                != AV_HWDEVICE_TYPE_NONE) {
+            if (sc_hwaccel_try_device(ctx, codec, type)) {
+                return true;
+            }
+        }
+
+        LOGW("No hardware video decoder available, "
+             "fallback to software decoding");
+        return false;
+    }
+
+    enum AVHWDeviceType type = sc_hwaccel_to_av_device_type(hwaccel);
+    if (type == AV_HWDEVICE_TYPE_NONE) {
+        // Only possible for a device type unknown to this FFmpeg version
+        LOGW("Hardware video decoding (%s) not supported by this FFmpeg "
+             "version", sc_hwaccel_get_name(hwaccel));
+        return false;
+    }
+    if (!sc_hwaccel_try_device(ctx, codec, type)) {
+        LOGW("Could not initialize hwaccel %s, "
+             "fallback to software decoding", sc_hwaccel_get_name(hwaccel));
+        return false;
+    }
+
+    return true;
+#else
+    (void) ctx;
+    (void) codec;
+    LOGW("Hardware video decoding (%s) not supported by this FFmpeg version",
+         sc_hwaccel_get_name(hwaccel));
+    return false;
+#endif
+}
+
+AVBufferRef *
+sc_hwaccel_create_device(enum sc_codec codec, enum sc_hwaccel hwaccel) {
+    assert(hwaccel != SC_HWACCEL_NONE);
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    const AVCodec *decoder =
+        avcodec_find_decoder(sc_hwaccel_to_avcodec_id(codec));
+    if (!decoder) {
+        return NULL;
+    }
+
+    if (hwaccel == SC_HWACCEL_AUTO) {
+        enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+        while ((type = av_hwdevice_iterate_types(type))
+                != AV_HWDEVICE_TYPE_NONE) {
+            AVBufferRef *device_ctx =
+                sc_hwaccel_create_device_type(decoder, type);
+            if (device_ctx) {
+                return device_ctx;
+            }
+        }
+        return NULL;
+    }
+
+    enum AVHWDeviceType type = sc_hwaccel_to_av_device_type(hwaccel);
+    if (type == AV_HWDEVICE_TYPE_NONE) {
+        return NULL;
+    }
+    return sc_hwaccel_create_device_type(decoder, type);
+#else
+    (void) codec;
+    return NULL;
+#endif
+}
+
+bool
+sc_hwaccel_configure_device(AVCodecContext *ctx, const AVCodec *codec,
+                            AVBufferRef *device_ctx) {
+    assert(device_ctx);
+    assert(codec->type == AVMEDIA_TYPE_VIDEO);
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    AVHWDeviceContext *device = (AVHWDeviceContext *) device_ctx->data;
+    if (sc_hwaccel_find_pix_fmt(codec, device->type) == AV_PIX_FMT_NONE) {
+        LOGD("Decoder %s does not support the hwaccel %s device created "
+             "ahead of time", codec->name,
+             av_hwdevice_get_type_name(device->type));
+        av_buffer_unref(&device_ctx);
+        return false;
+    }
+
+    sc_hwaccel_attach_device(ctx, device_ctx);
+    return true;
+#else
+    (void) ctx;
+    (void) codec;
+    av_buffer_unref(&device_ctx);
+    return false;
+#endif
+}
@@ -0,0 +1,70 @@
+#ifndef SC_HWACCEL_H
+#define SC_HWACCEL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+
+/**
+ * Configure hardware-accelerated decoding on a video codec context.
+ *
+ * It must be called before avcodec_open2().
+ *
+ * On failure, the codec context is left untouched, so that the video can
+ * still be decoded in software.
+ */
+bool
+sc_hwaccel_configure(AVCodecContext *ctx, const AVCodec *codec,
+                     enum sc_hwaccel hwaccel);
+
+/**
+ * Create the hardware device to decode `codec` ahead of time
+ *
+ * The device creation may take tens or hundreds of milliseconds, so it may be
+ * created while the server is starting, for the codec expected from the
+ * device, then passed to sc_hwaccel_configure_device() once the actual codec
+ * is known.
+ *
+ * Return a new reference, or NULL if no device is available.
+ */
+AVBufferRef *
+sc_hwaccel_create_device(enum sc_codec codec, enum sc_hwaccel hwaccel);
+
+/**
+ * Configure hardware-accelerated decoding with a device created by
+ * sc_hwaccel_create_device().
+ *
+ * It must be called before avcodec_open2(). It takes ownership of the device
+ * reference.
+ *
+ * Return false if the device does not support the codec (the codec context is
+ * left untouched, sc_hwaccel_configure() may be called instead).
+ */
+bool
+sc_hwaccel_configure_device(AVCodecContext *ctx, const AVCodec *codec,
+                            AVBufferRef *device_ctx);
+
+/**
+ * Rank the video codecs for --video-codec=auto, from the preferred one
+ *
+ * The codecs which can be decoded by an available hardware decoder come first,
+ * ordered by compression efficiency (AV1, H.265, H.264). The other codecs
+ * follow, H.264 first (it is the cheapest to decode in software). The codecs
+ * not supported by the FFmpeg build are excluded.
+ *
+ * Return the number of codecs written to out.
+ */
+unsigned
+sc_hwaccel_rank_video_codecs(enum sc_hwaccel hwaccel,
+                             enum sc_codec out[SC_VIDEO_CODEC_COUNT]);
+
+/**
+ * Return a short name for the hardware acceleration type (for logging)
+ */
+const char *
+sc_hwaccel_get_name(enum sc_hwaccel hwaccel);
+
+#endif
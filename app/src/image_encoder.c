@@ -0,0 +1,190 @@
+#include "image_encoder.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "util/file.h"
+#include "util/log.h"
+
+static enum AVCodecID
+sc_image_encoder_get_codec_id(enum sc_thumbnail_format format) {
+    switch (format) {
+        case SC_THUMBNAIL_FORMAT_JPEG:
+            return AV_CODEC_ID_MJPEG;
+        case SC_THUMBNAIL_FORMAT_PNG:
+            return AV_CODEC_ID_PNG;
+        case SC_THUMBNAIL_FORMAT_WEBP:
+            return AV_CODEC_ID_WEBP;
+        default:
+            assert(!"unexpected image format");
+            return AV_CODEC_ID_NONE;
+    }
+}
+
+static enum AVPixelFormat
+sc_image_encoder_get_pix_fmt(enum sc_thumbnail_format format) {
+    switch (format) {
+        case SC_THUMBNAIL_FORMAT_JPEG:
+            // Full range, as expected by the MJPEG encoder
+            return AV_PIX_FMT_YUVJ420P;
+        case SC_THUMBNAIL_FORMAT_PNG:
+            return AV_PIX_FMT_RGB24;
+        case SC_THUMBNAIL_FORMAT_WEBP:
+            return AV_PIX_FMT_YUV420P;
+        default:
+            assert(!"unexpected image format");
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+static bool
+sc_image_encoder_open(struct sc_image_encoder *enc, int width, int height) {
+    enum AVCodecID codec_id = sc_image_encoder_get_codec_id(enc->format);
+    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        LOGE("%s: %s encoder not found", enc->name,
+             avcodec_get_name(codec_id));
+        return false;
+    }
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = sc_image_encoder_get_pix_fmt(enc->format);
+    ctx->time_base = (AVRational) {1, 1};
+    if (enc->format == SC_THUMBNAIL_FORMAT_JPEG) {
+        // Fixed quality (the default bit rate is too low for still images)
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality = FF_QP2LAMBDA * 3;
+    }
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGE("%s: could not open the %s encoder", enc->name, codec->name);
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    avcodec_free_context(&enc->codec_ctx);
+    enc->codec_ctx = ctx;
+
+    av_frame_unref(enc->frame);
+    enc->frame->format = ctx->pix_fmt;
+    enc->frame->width = width;
+    enc->frame->height = height;
+    if (av_frame_get_buffer(enc->frame, 0) < 0) {
+        LOG_OOM();
+        avcodec_free_context(&enc->codec_ctx);
+        return false;
+    }
+
+    LOGD("%s: %dx%d %s", enc->name, width, height, codec->name);
+    return true;
+}
+
+bool
+sc_image_encoder_init(struct sc_image_encoder *enc,
+                      enum sc_thumbnail_format format, const char *name) {
+    assert(format != SC_THUMBNAIL_FORMAT_AUTO);
+
+    enc->frame = av_frame_alloc();
+    if (!enc->frame) {
+        LOG_OOM();
+        return false;
+    }
+
+    enc->packet = av_packet_alloc();
+    if (!enc->packet) {
+        LOG_OOM();
+        av_frame_free(&enc->frame);
+        return false;
+    }
+
+    if (!sc_frame_converter_init(&enc->converter)) {
+        av_packet_free(&enc->packet);
+        av_frame_free(&enc->frame);
+        return false;
+    }
+
+    enc->format = format;
+    enc->name = name;
+    enc->codec_ctx = NULL;
+
+    return true;
+}
+
+void
+sc_image_encoder_destroy(struct sc_image_encoder *enc) {
+    sc_frame_converter_destroy(&enc->converter);
+    avcodec_free_context(&enc->codec_ctx);
+    av_packet_free(&enc->packet);
+    av_frame_free(&enc->frame);
+}
+
+bool
+sc_image_encoder_encode(struct sc_image_encoder *enc, const AVFrame *frame,
+                        int width, int height) {
+    if (!enc->codec_ctx || enc->codec_ctx->width != width
+                        || enc->codec_ctx->height != height) {
+        if (!sc_image_encoder_open(enc, width, height)) {
+            return false;
+        }
+    }
+
+    if (av_frame_make_writable(enc->frame) < 0) {
+        LOG_OOM();
+        return false;
+    }
+
+    // SWS_AREA gives the best quality for large downscaling factors
+    bool ok = sc_frame_converter_convert(&enc->converter, frame,
+                                         enc->frame->data,
+                                         enc->frame->linesize,
+                                         enc->frame->format, width, height,
+                                         SWS_AREA);
+    if (!ok) {
+        LOGE("%s: could not convert the frame", enc->name);
+        return false;
+    }
+
+    if (enc->format == SC_THUMBNAIL_FORMAT_JPEG) {
+        enc->frame->quality = enc->codec_ctx->global_quality;
+    }
+
+    int r = avcodec_send_frame(enc->codec_ctx, enc->frame);
+    if (r < 0) {
+        LOGE("%s: could not encode the image", enc->name);
+        return false;
+    }
+
+    // Image encoders output one packet per frame immediately
+    r = avcodec_receive_packet(enc->codec_ctx, enc->packet);
+    if (r < 0) {
+        LOGE("%s: could not receive the encoded image", enc->name);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+sc_image_encoder_write_file(struct sc_image_encoder *enc, const char *path) {
+    FILE *file = sc_file_open(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    size_t w = fwrite(enc->packet->data, 1, enc->packet->size, file);
+    bool ok = w == (size_t) enc->packet->size;
+    ok &= !fclose(file);
+    if (!ok) {
+        sc_file_remove(path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef SC_IMAGE_ENCODER_H
+#define SC_IMAGE_ENCODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_converter.h"
+#include "options.h"
+
+/**
+ * Encoder of video frames to still images (JPEG, PNG or WebP)
+ *
+ * The frames are converted (and scaled) by swscale, then encoded by the
+ * FFmpeg image encoder, which is reopened on size change.
+ */
+struct sc_image_encoder {
+    enum sc_thumbnail_format format;
+    const char *name; // prefix of the log messages
+
+    struct sc_frame_converter converter;
+    AVFrame *frame; // converted frame
+    AVCodecContext *codec_ctx; // reopened on size change
+    AVPacket *packet; // the encoded image
+};
+
+bool
+sc_image_encoder_init(struct sc_image_encoder *enc,
+                      enum sc_thumbnail_format format, const char *name);
+
+void
+sc_image_encoder_destroy(struct sc_image_encoder *enc);
+
+/**
+ * Convert the frame to an image of the requested size and encode it
+ *
+ * On success, the encoded image is available in enc->packet, which must be
+ * unreferenced by the caller.
+ */
+bool
+sc_image_encoder_encode(struct sc_image_encoder *enc, const AVFrame *frame,
+                        int width, int height);
+
+/**
+ * Write the encoded image to a file
+ */
+bool
+sc_image_encoder_write_file(struct sc_image_encoder *enc, const char *path);
+
+#endif
@@ -11,6 +11,8 @@
 #include "screen.h"
 #include "shortcut_mod.h"
 #include "util/log.h"
+#include "util/str.h"
+#include "util/strbuf.h"
 
 void
 sc_input_manager_init(struct sc_input_manager *im,
@@ -24,7 +26,11 @@ sc_input_manager_init(struct sc_input_manager *im,
 
     im->controller = params->controller;
     im->fp = params->fp;
+    im->replay_buffer = params->replay_buffer;
+    im->record_switch = params->record_switch;
+    im->screenshot = params->screenshot;
     im->screen = params->screen;
+    im->metrics = params->metrics;
     im->kp = params->kp;
     im->mp = params->mp;
     im->gp = params->gp;
@@ -33,6 +39,9 @@ sc_input_manager_init(struct sc_input_manager *im,
     im->legacy_paste = params->legacy_paste;
     im->clipboard_autosync = params->clipboard_autosync;
 
+    im->alt_video_profile = params->alt_video_profile;
+    im->alt_video_profile_active = false;
+
     im->sdl_shortcut_mods = sc_shortcut_mods_to_sdl(params->shortcut_mods);
 
     im->vfinger_down = false;
@@ -184,7 +193,7 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
         return false;
     }
 
-    char *text_dup = strdup(text);
+    char *text_dup = sc_controller_strndup(im->controller, text, strlen(text));
     SDL_free(text);
     if (!text_dup) {
         LOGW("Could not strdup input text");
@@ -196,9 +205,10 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
     msg.set_clipboard.sequence = sequence;
     msg.set_clipboard.text = text_dup;
     msg.set_clipboard.paste = paste;
+    msg.set_clipboard.by_hash = false;
 
     if (!sc_controller_push_msg(im->controller, &msg)) {
-        free(text_dup);
+        sc_controller_free_text(im->controller, text_dup);
         LOGW("Could not request 'set device clipboard'");
         return false;
     }
@@ -233,6 +243,72 @@ switch_fps_counter_state(struct sc_input_manager *im) {
     }
 }
 
+static void
+log_memory_report(struct sc_input_manager *im) {
+    if (!im->metrics) {
+        LOGW("Memory report requires --metrics-file or --metrics-port");
+        return;
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 512)) {
+        LOG_OOM();
+        return;
+    }
+
+    if (!sc_metrics_format_memory(im->metrics, &buf)) {
+        LOG_OOM();
+        free(buf.s);
+        return;
+    }
+
+    LOGI("Memory report:\n%s", buf.s);
+    free(buf.s);
+}
+
+static void
+take_screenshot(struct sc_input_manager *im) {
+    struct sc_screen *screen = im->screen;
+    if (!screen->video || !screen->has_frame) {
+        LOGW("No video frame to take a screenshot of");
+        return;
+    }
+
+    // Only a new reference to the frame is taken, any error is already logged
+    sc_screenshot_take(im->screenshot, screen->frame);
+}
+
+// Inject a large text as a stream of chunks, sent back to back and injected
+// by the device in order
+static void
+inject_text_stream(struct sc_input_manager *im, const char *text) {
+    size_t len = strlen(text);
+    size_t head = 0;
+    while (head < len) {
+        size_t chunk_len =
+            sc_str_utf8_truncation_index(&text[head],
+                                SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH);
+        assert(chunk_len);
+
+        char *chunk =
+            sc_controller_strndup(im->controller, &text[head], chunk_len);
+        if (!chunk) {
+            return;
+        }
+
+        struct sc_control_msg msg;
+        msg.type = SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM;
+        msg.inject_text.text = chunk;
+        if (!sc_controller_push_msg(im->controller, &msg)) {
+            sc_controller_free_text(im->controller, chunk);
+            LOGW("Could not request 'paste clipboard'");
+            return;
+        }
+
+        head += chunk_len;
+    }
+}
+
 static void
 clipboard_paste(struct sc_input_manager *im) {
     assert(im->controller && im->kp);
@@ -248,7 +324,14 @@ clipboard_paste(struct sc_input_manager *im) {
         return;
     }
 
-    char *text_dup = strdup(text);
+    if (strlen(text) > SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH) {
+        // Too large for a single INJECT_TEXT message
+        inject_text_stream(im, text);
+        SDL_free(text);
+        return;
+    }
+
+    char *text_dup = sc_controller_strndup(im->controller, text, strlen(text));
     SDL_free(text);
     if (!text_dup) {
         LOGW("Could not strdup input text");
@@ -259,7 +342,7 @@ clipboard_paste(struct sc_input_manager *im) {
     msg.type = SC_CONTROL_MSG_TYPE_INJECT_TEXT;
     msg.inject_text.text = text_dup;
     if (!sc_controller_push_msg(im->controller, &msg)) {
-        free(text_dup);
+        sc_controller_free_text(im->controller, text_dup);
         LOGW("Could not request 'paste clipboard'");
     }
 }
@@ -300,6 +383,38 @@ reset_video(struct sc_input_manager *im) {
     }
 }
 
+static void
+switch_video_profile(struct sc_input_manager *im) {
+    assert(im->controller);
+    assert(im->alt_video_profile);
+
+    bool activate = !im->alt_video_profile_active;
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE;
+    if (activate) {
+        const struct sc_video_profile *profile = im->alt_video_profile;
+        msg.set_video_profile.max_size = profile->max_size;
+        msg.set_video_profile.bit_rate = profile->bit_rate;
+        msg.set_video_profile.max_fps = profile->max_fps;
+        msg.set_video_profile.crop.width = profile->crop.width;
+        msg.set_video_profile.crop.height = profile->crop.height;
+        msg.set_video_profile.crop.x = profile->crop.x;
+        msg.set_video_profile.crop.y = profile->crop.y;
+    } else {
+        // All zero: restore the initial values
+        memset(&msg.set_video_profile, 0, sizeof(msg.set_video_profile));
+    }
+
+    if (!sc_controller_push_msg(im->controller, &msg)) {
+        LOGW("Could not request video profile change");
+        return;
+    }
+
+    im->alt_video_profile_active = activate;
+    LOGI("Video profile: %s", activate ? "alternative" : "initial");
+}
+
 static void
 apply_orientation_transform(struct sc_input_manager *im,
                             enum sc_orientation transform) {
@@ -416,6 +531,8 @@ sc_input_manager_process_key(struct sc_input_manager *im,
             case SDLK_s:
                 if (im->kp && !shift && !repeat && !paused) {
                     action_app_switch(im, action);
+                } else if (shift && !repeat && down && im->screenshot) {
+                    take_screenshot(im);
                 }
                 return;
             case SDLK_m:
@@ -426,6 +543,9 @@ sc_input_manager_process_key(struct sc_input_manager *im,
             case SDLK_p:
                 if (im->kp && !shift && !repeat && !paused) {
                     action_power(im, action);
+                } else if (control && shift && !repeat && down
+                        && im->alt_video_profile) {
+                    switch_video_profile(im);
                 }
                 return;
             case SDLK_o:
@@ -521,8 +641,12 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                 }
                 return;
             case SDLK_i:
-                if (video && !shift && !repeat && down) {
-                    switch_fps_counter_state(im);
+                if (!repeat && down) {
+                    if (shift) {
+                        log_memory_report(im);
+                    } else if (video) {
+                        switch_fps_counter_state(im);
+                    }
                 }
                 return;
             case SDLK_n:
@@ -545,6 +669,17 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                     }
                 }
                 return;
+            case SDLK_e:
+                if (!repeat && down) {
+                    if (shift) {
+                        if (im->record_switch) {
+                            sc_record_switch_toggle(im->record_switch);
+                        }
+                    } else if (im->replay_buffer) {
+                        sc_replay_buffer_save(im->replay_buffer);
+                    }
+                }
+                return;
             case SDLK_k:
                 if (control && !shift && !repeat && down && !paused
                         && im->kp && im->kp->hid) {
@@ -993,6 +1128,13 @@ is_apk(const char *file) {
 static void
 sc_input_manager_process_file(struct sc_input_manager *im,
                               const SDL_DropEvent *event) {
+    if (!im->fp) {
+        // No file pusher (--adb-usb)
+        LOGW("Drag & drop is not supported with --adb-usb");
+        SDL_free(event->file);
+        return;
+    }
+
     char *file = strdup(event->file);
     SDL_free(event->file);
     if (!file) {
@@ -11,14 +11,22 @@
 #include "controller.h"
 #include "file_pusher.h"
 #include "options.h"
+#include "record_switch.h"
+#include "replay_buffer.h"
+#include "screenshot.h"
 #include "trait/gamepad_processor.h"
 #include "trait/key_processor.h"
 #include "trait/mouse_processor.h"
+#include "util/metrics.h"
 
 struct sc_input_manager {
     struct sc_controller *controller;
     struct sc_file_pusher *fp;
+    struct sc_replay_buffer *replay_buffer; // may be NULL
+    struct sc_record_switch *record_switch; // may be NULL
+    struct sc_screenshot *screenshot; // may be NULL
     struct sc_screen *screen;
+    struct sc_metrics *metrics; // may be NULL
 
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
@@ -28,6 +36,9 @@ struct sc_input_manager {
     bool legacy_paste;
     bool clipboard_autosync;
 
+    const struct sc_video_profile *alt_video_profile; // may be NULL
+    bool alt_video_profile_active;
+
     uint16_t sdl_shortcut_mods;
 
     bool vfinger_down;
@@ -49,7 +60,11 @@ struct sc_input_manager {
 struct sc_input_manager_params {
     struct sc_controller *controller;
     struct sc_file_pusher *fp;
+    struct sc_replay_buffer *replay_buffer;
+    struct sc_record_switch *record_switch;
+    struct sc_screenshot *screenshot;
     struct sc_screen *screen;
+    struct sc_metrics *metrics;
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
     struct sc_gamepad_processor *gp;
@@ -57,6 +72,7 @@ struct sc_input_manager_params {
     struct sc_mouse_bindings mouse_bindings;
     bool legacy_paste;
     bool clipboard_autosync;
+    const struct sc_video_profile *alt_video_profile; // may be NULL
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
 };
 
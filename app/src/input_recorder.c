@@ -0,0 +1,97 @@
+#include "input_recorder.h"
+
+#include <assert.h>
+
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+static bool
+is_recordable(const struct sc_control_msg *msg) {
+    // Only the input events (a subset of the types supported by
+    // sc_control_msg_deserialize())
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+        case SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool
+sc_input_recorder_init(struct sc_input_recorder *recorder,
+                       const char *filename) {
+    bool ok = sc_mutex_init(&recorder->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    recorder->file = sc_file_open(filename, "wb");
+    if (!recorder->file) {
+        LOGE("Could not open input record file: %s", filename);
+        sc_mutex_destroy(&recorder->mutex);
+        return false;
+    }
+
+    size_t w = fwrite(SC_INPUT_RECORD_MAGIC, 1, SC_INPUT_RECORD_MAGIC_LENGTH,
+                      recorder->file);
+    if (w != SC_INPUT_RECORD_MAGIC_LENGTH) {
+        LOGE("Could not write input record file: %s", filename);
+        fclose(recorder->file);
+        sc_mutex_destroy(&recorder->mutex);
+        return false;
+    }
+
+    recorder->start = sc_tick_now();
+    recorder->failed = false;
+
+    LOGI("Recording input events to %s", filename);
+
+    return true;
+}
+
+void
+sc_input_recorder_destroy(struct sc_input_recorder *recorder) {
+    if (fclose(recorder->file)) {
+        LOGW("Could not close input record file");
+    }
+    sc_mutex_destroy(&recorder->mutex);
+}
+
+void
+sc_input_recorder_record(struct sc_input_recorder *recorder,
+                         const struct sc_control_msg *msg, sc_tick date) {
+    if (!is_recordable(msg)) {
+        return;
+    }
+
+    uint8_t buf[SC_INPUT_RECORD_HEADER_SIZE + SC_INPUT_RECORD_MSG_MAX_SIZE];
+    uint8_t *payload = &buf[SC_INPUT_RECORD_HEADER_SIZE];
+    size_t len = sc_control_msg_serialize(msg, payload);
+    assert(len && len <= SC_INPUT_RECORD_MSG_MAX_SIZE);
+
+    sc_mutex_lock(&recorder->mutex);
+
+    if (recorder->failed) {
+        sc_mutex_unlock(&recorder->mutex);
+        return;
+    }
+
+    sc_tick timestamp = date - recorder->start;
+    assert(timestamp >= 0);
+    sc_write64be(buf, SC_TICK_TO_US(timestamp));
+    sc_write16be(&buf[8], len);
+
+    size_t size = SC_INPUT_RECORD_HEADER_SIZE + len;
+    size_t w = fwrite(buf, 1, size, recorder->file);
+    if (w != size) {
+        LOGW("Could not write input record file, recording stopped");
+        recorder->failed = true;
+    }
+
+    sc_mutex_unlock(&recorder->mutex);
+}
@@ -0,0 +1,60 @@
+#ifndef SC_INPUT_RECORDER_H
+#define SC_INPUT_RECORDER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "control_msg.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Input record file format (--input-record and --input-replay)
+ *
+ * The file starts with an 8-byte magic, followed by one record per message:
+ *  - timestamp: 8 bytes, in microseconds since the start of the recording;
+ *  - length: 2 bytes;
+ *  - the message, serialized as sent on the control socket.
+ *
+ * All values are big-endian.
+ */
+#define SC_INPUT_RECORD_MAGIC "SCINPUT1"
+#define SC_INPUT_RECORD_MAGIC_LENGTH 8
+#define SC_INPUT_RECORD_HEADER_SIZE 10
+// The recordable messages are small (the injected text length is limited)
+#define SC_INPUT_RECORD_MSG_MAX_SIZE 512
+
+/**
+ * Record the input events pushed to the controller to a file, with their
+ * timestamps, so that they can be replayed later by an sc_input_replayer
+ *
+ * Only the messages supported by sc_control_msg_deserialize() are recorded.
+ *
+ * The messages are written synchronously to a buffered file, it is
+ * thread-safe.
+ */
+struct sc_input_recorder {
+    FILE *file;
+    sc_mutex mutex;
+    sc_tick start;
+    // Set on write error, nothing is recorded anymore
+    bool failed;
+};
+
+bool
+sc_input_recorder_init(struct sc_input_recorder *recorder,
+                       const char *filename);
+
+void
+sc_input_recorder_destroy(struct sc_input_recorder *recorder);
+
+/**
+ * Record a message pushed to the controller at the given local time
+ */
+void
+sc_input_recorder_record(struct sc_input_recorder *recorder,
+                         const struct sc_control_msg *msg, sc_tick date);
+
+#endif
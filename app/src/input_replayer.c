@@ -0,0 +1,188 @@
+#include "input_replayer.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "input_recorder.h"
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+// The condition wait has a millisecond granularity: wait until this delay
+// before the deadline, then spin
+#define SC_INPUT_REPLAYER_SPIN_DELAY SC_TICK_FROM_MS(2)
+
+bool
+sc_input_replayer_init(struct sc_input_replayer *replayer,
+                       const char *filename,
+                       struct sc_controller *controller) {
+    replayer->file = sc_file_open(filename, "rb");
+    if (!replayer->file) {
+        LOGE("Could not open input record file: %s", filename);
+        return false;
+    }
+
+    char magic[SC_INPUT_RECORD_MAGIC_LENGTH];
+    size_t r = fread(magic, 1, sizeof(magic), replayer->file);
+    if (r != sizeof(magic)
+            || memcmp(magic, SC_INPUT_RECORD_MAGIC, sizeof(magic))) {
+        LOGE("Not an input record file: %s", filename);
+        goto error_close_file;
+    }
+
+    bool ok = sc_mutex_init(&replayer->mutex);
+    if (!ok) {
+        goto error_close_file;
+    }
+
+    ok = sc_cond_init(&replayer->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    replayer->controller = controller;
+    replayer->stopped = false;
+
+    return true;
+
+error_destroy_mutex:
+    sc_mutex_destroy(&replayer->mutex);
+error_close_file:
+    fclose(replayer->file);
+
+    return false;
+}
+
+void
+sc_input_replayer_destroy(struct sc_input_replayer *replayer) {
+    sc_cond_destroy(&replayer->cond);
+    sc_mutex_destroy(&replayer->mutex);
+    fclose(replayer->file);
+}
+
+// Return false if stopped
+static bool
+sc_input_replayer_wait(struct sc_input_replayer *replayer, sc_tick deadline) {
+    sc_tick coarse_deadline = deadline - SC_INPUT_REPLAYER_SPIN_DELAY;
+
+    sc_mutex_lock(&replayer->mutex);
+    while (!replayer->stopped && sc_tick_now() < coarse_deadline) {
+        sc_cond_timedwait(&replayer->cond, &replayer->mutex, coarse_deadline);
+    }
+    bool stopped = replayer->stopped;
+    sc_mutex_unlock(&replayer->mutex);
+
+    if (stopped) {
+        return false;
+    }
+
+    while (sc_tick_now() < deadline) {
+        // Spin for the last milliseconds, for accuracy
+    }
+
+    return true;
+}
+
+// Read the next message, return false on end of file or error
+static bool
+sc_input_replayer_read(struct sc_input_replayer *replayer,
+                       sc_tick *timestamp, struct sc_control_msg *msg) {
+    uint8_t header[SC_INPUT_RECORD_HEADER_SIZE];
+    size_t r = fread(header, 1, sizeof(header), replayer->file);
+    if (r != sizeof(header)) {
+        if (r || ferror(replayer->file)) {
+            LOGE("Input replay: could not read the record file");
+        }
+        return false;
+    }
+
+    uint64_t us = sc_read64be(header);
+    size_t len = sc_read16be(&header[8]);
+    if (us > INT64_MAX || len > SC_INPUT_RECORD_MSG_MAX_SIZE) {
+        LOGE("Input replay: invalid record");
+        return false;
+    }
+
+    uint8_t buf[SC_INPUT_RECORD_MSG_MAX_SIZE];
+    r = fread(buf, 1, len, replayer->file);
+    if (r != len) {
+        LOGE("Input replay: truncated record file");
+        return false;
+    }
+
+    ssize_t n = sc_control_msg_deserialize(buf, len, msg);
+    if (n < 0 || (size_t) n != len) {
+        if (n > 0) {
+            sc_control_msg_destroy(msg);
+        }
+        LOGE("Input replay: invalid message");
+        return false;
+    }
+
+    *timestamp = SC_TICK_FROM_US(us);
+    return true;
+}
+
+static int
+run_input_replayer(void *data) {
+    struct sc_input_replayer *replayer = data;
+
+    // The timing accuracy matters
+    bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_HIGH);
+    (void) ok; // We don't care if it worked
+
+    sc_tick start = sc_tick_now();
+    uint64_t count = 0;
+
+    for (;;) {
+        sc_tick timestamp;
+        struct sc_control_msg msg;
+        if (!sc_input_replayer_read(replayer, &timestamp, &msg)) {
+            break;
+        }
+
+        if (!sc_input_replayer_wait(replayer, start + timestamp)) {
+            sc_control_msg_destroy(&msg);
+            LOGD("Input replay stopped");
+            return 0;
+        }
+
+        // The controller takes ownership of the message on success
+        if (!sc_controller_push_msg(replayer->controller, &msg)) {
+            sc_control_msg_destroy(&msg);
+            LOGW("Input replay: could not push message");
+        }
+        ++count;
+    }
+
+    LOGI("Input replay finished (%" PRIu64 " events)", count);
+    return 0;
+}
+
+bool
+sc_input_replayer_start(struct sc_input_replayer *replayer) {
+    LOGD("Starting input replayer thread");
+
+    bool ok = sc_thread_create(&replayer->thread, run_input_replayer,
+                               "scrcpy-replayin", replayer);
+    if (!ok) {
+        LOGE("Could not start input replayer thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_input_replayer_stop(struct sc_input_replayer *replayer) {
+    sc_mutex_lock(&replayer->mutex);
+    replayer->stopped = true;
+    sc_cond_signal(&replayer->cond);
+    sc_mutex_unlock(&replayer->mutex);
+}
+
+void
+sc_input_replayer_join(struct sc_input_replayer *replayer) {
+    sc_thread_join(&replayer->thread, NULL);
+}
@@ -0,0 +1,50 @@
+#ifndef SC_INPUT_REPLAYER_H
+#define SC_INPUT_REPLAYER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "controller.h"
+#include "util/thread.h"
+
+/**
+ * Replay the input events recorded by an sc_input_recorder, at their original
+ * timing
+ *
+ * The messages are pushed to the controller from a dedicated thread (without
+ * going through the SDL event loop), which waits for the deadline of each
+ * message with a sub-millisecond precision.
+ */
+struct sc_input_replayer {
+    FILE *file;
+    struct sc_controller *controller;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+};
+
+bool
+sc_input_replayer_init(struct sc_input_replayer *replayer,
+                       const char *filename,
+                       struct sc_controller *controller);
+
+void
+sc_input_replayer_destroy(struct sc_input_replayer *replayer);
+
+/**
+ * Start replaying (the timestamps are relative to this call)
+ */
+bool
+sc_input_replayer_start(struct sc_input_replayer *replayer);
+
+void
+sc_input_replayer_stop(struct sc_input_replayer *replayer);
+
+void
+sc_input_replayer_join(struct sc_input_replayer *replayer);
+
+#endif
@@ -316,13 +316,14 @@ sc_key_processor_process_text(struct sc_key_processor *kp,
 
     struct sc_control_msg msg;
     msg.type = SC_CONTROL_MSG_TYPE_INJECT_TEXT;
-    msg.inject_text.text = strdup(event->text);
+    msg.inject_text.text = sc_controller_strndup(kb->controller, event->text,
+                                                 strlen(event->text));
     if (!msg.inject_text.text) {
         LOGW("Could not strdup input text");
         return;
     }
     if (!sc_controller_push_msg(kb->controller, &msg)) {
-        free(msg.inject_text.text);
+        sc_controller_free_text(kb->controller, msg.inject_text.text);
         LOGW("Could not request 'inject text'");
     }
 }
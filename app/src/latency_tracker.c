@@ -0,0 +1,473 @@
+#include "latency_tracker.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+#define SC_LATENCY_TRACKER_INTERVAL SC_TICK_FROM_SEC(1)
+
+// Consider a ping lost if it is not acknowledged within this delay
+#define SC_LATENCY_TRACKER_PING_TIMEOUT SC_TICK_FROM_SEC(1)
+
+// Renew the device clock estimation periodically, to follow the clock drift
+#define SC_LATENCY_TRACKER_CLOCK_VALIDITY SC_TICK_FROM_SEC(10)
+
+static const char *const stage_names[SC_LATENCY_STAGE_COUNT] = {
+    [SC_LATENCY_STAGE_RECEIVED] = "network",
+    [SC_LATENCY_STAGE_DECODED] = "decode",
+    [SC_LATENCY_STAGE_BUFFERED] = "buffer",
+    [SC_LATENCY_STAGE_UPLOADED] = "upload",
+    [SC_LATENCY_STAGE_PRESENTED] = "render",
+};
+
+bool
+sc_latency_tracker_init(struct sc_latency_tracker *tracker) {
+    bool ok = sc_mutex_init(&tracker->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < SC_LATENCY_TRACKER_CAPACITY; ++i) {
+        tracker->entries[i].used = false;
+    }
+    tracker->next = 0;
+
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        sc_vector_init(&tracker->durations[i]);
+    }
+    sc_vector_init(&tracker->totals);
+    sc_vector_init(&tracker->device_totals);
+    sc_vector_init(&tracker->jitters);
+    tracker->last_arrival.valid = false;
+    tracker->next_report = sc_tick_now() + SC_LATENCY_TRACKER_INTERVAL;
+
+    tracker->device_clock.valid = false;
+
+    tracker->input.next_sequence = 1; // 0 is SC_SEQUENCE_INVALID
+    tracker->input.sequence = SC_SEQUENCE_INVALID;
+    sc_vector_init(&tracker->input.acks);
+    sc_vector_init(&tracker->input.rtts);
+    tracker->input.next_report = 0;
+
+    tracker->present_mode = SC_PRESENT_MODE_AUTO;
+    tracker->budget = 0;
+
+    tracker->total_metric = NULL;
+    tracker->device_total_metric = NULL;
+    tracker->input_metric = NULL;
+
+    return true;
+}
+
+void
+sc_latency_tracker_set_metrics(struct sc_latency_tracker *tracker,
+                               struct sc_metrics *metrics) {
+    // In microseconds
+    static const int64_t bounds[] = {
+        2000, 5000, 10000, 16000, 20000, 25000, 33000, 50000, 75000, 100000,
+        200000, 500000, 1000000,
+    };
+    unsigned count = ARRAY_LEN(bounds);
+
+    tracker->total_metric =
+        sc_metrics_register_histogram(metrics, "scrcpy_video_latency_us",
+                                      "Video latency from reception to "
+                                      "presentation", bounds, count);
+    tracker->device_total_metric =
+        sc_metrics_register_histogram(metrics,
+                                      "scrcpy_video_device_latency_us",
+                                      "Video latency from device encoding to "
+                                      "presentation", bounds, count);
+    tracker->input_metric =
+        sc_metrics_register_histogram(metrics, "scrcpy_input_latency_us",
+                                      "Latency from an input event to its "
+                                      "injection on the device", bounds,
+                                      count);
+}
+
+void
+sc_latency_tracker_set_present_mode(struct sc_latency_tracker *tracker,
+                                    enum sc_present_mode present_mode) {
+    tracker->present_mode = present_mode;
+}
+
+void
+sc_latency_tracker_set_budget(struct sc_latency_tracker *tracker,
+                              sc_tick budget) {
+    tracker->budget = budget;
+}
+
+void
+sc_latency_tracker_destroy(struct sc_latency_tracker *tracker) {
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        sc_vector_destroy(&tracker->durations[i]);
+    }
+    sc_vector_destroy(&tracker->totals);
+    sc_vector_destroy(&tracker->device_totals);
+    sc_vector_destroy(&tracker->jitters);
+    sc_vector_destroy(&tracker->input.acks);
+    sc_vector_destroy(&tracker->input.rtts);
+    sc_mutex_destroy(&tracker->mutex);
+}
+
+static int
+compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+// The samples must be sorted
+static double
+get_percentile_ms(const struct sc_latency_samples *samples, unsigned p) {
+    assert(samples->size);
+    assert(p <= 100);
+    size_t index = (samples->size - 1) * p / 100;
+    return (double) samples->data[index] * 1000 / SC_TICK_FREQ;
+}
+
+// Append the percentiles of the samples to the buffer, and reset the samples
+static void
+format_samples(char *buf, size_t bufsize, size_t *len, const char *name,
+               struct sc_latency_samples *samples) {
+    if (!samples->size) {
+        // Nothing to report
+        return;
+    }
+
+    qsort(samples->data, samples->size, sizeof(*samples->data),
+          compare_ticks);
+
+    if (*len < bufsize) {
+        int r = snprintf(buf + *len, bufsize - *len, "%s%s %.1f/%.1f/%.1f",
+                         *len ? ", " : "", name,
+                         get_percentile_ms(samples, 50),
+                         get_percentile_ms(samples, 95),
+                         get_percentile_ms(samples, 99));
+        if (r > 0) {
+            *len += r;
+        }
+    }
+
+    // Keep the allocation for the next period
+    samples->size = 0;
+}
+
+// must be called with mutex locked
+static void
+sc_latency_tracker_report(struct sc_latency_tracker *tracker) {
+    sc_mutex_assert(&tracker->mutex);
+
+    if (!tracker->totals.size) {
+        return;
+    }
+
+    // Retrieve the p95 before the samples are reset by format_samples()
+    double total_p95 = 0;
+    if (tracker->budget) {
+        qsort(tracker->totals.data, tracker->totals.size,
+              sizeof(*tracker->totals.data), compare_ticks);
+        total_p95 = get_percentile_ms(&tracker->totals, 95);
+    }
+
+    char buf[256];
+    size_t len = 0;
+    for (unsigned i = 1; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        format_samples(buf, sizeof(buf), &len, stage_names[i],
+                       &tracker->durations[i]);
+    }
+    format_samples(buf, sizeof(buf), &len, "total", &tracker->totals);
+    format_samples(buf, sizeof(buf), &len, "device-to-screen",
+                   &tracker->device_totals);
+    format_samples(buf, sizeof(buf), &len, "jitter", &tracker->jitters);
+
+    LOGI("Latency p50/p95/p99 (ms, present mode %s): %s",
+         sc_present_mode_get_name(tracker->present_mode), buf);
+
+    if (tracker->budget) {
+        double budget_ms = (double) tracker->budget * 1000 / SC_TICK_FREQ;
+        if (total_p95 > budget_ms) {
+            LOGW("Latency p95 %.1f ms exceeds the latency profile budget "
+                 "(%.1f ms)", total_p95, budget_ms);
+        }
+    }
+}
+
+// must be called with mutex locked
+static struct sc_latency_entry *
+sc_latency_tracker_find(struct sc_latency_tracker *tracker, int64_t pts) {
+    sc_mutex_assert(&tracker->mutex);
+
+    // Search from the most recent entry
+    for (unsigned i = 1; i <= SC_LATENCY_TRACKER_CAPACITY; ++i) {
+        unsigned index = (tracker->next + SC_LATENCY_TRACKER_CAPACITY - i)
+                       % SC_LATENCY_TRACKER_CAPACITY;
+        struct sc_latency_entry *entry = &tracker->entries[index];
+        if (entry->used && entry->pts == pts) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+push_sample(struct sc_latency_samples *samples, sc_tick duration) {
+    bool ok = sc_vector_push(samples, duration);
+    if (!ok) {
+        LOG_OOM();
+        // The sample is lost, but this is not fatal
+    }
+}
+
+// must be called with mutex locked
+static void
+sc_latency_tracker_add_samples(struct sc_latency_tracker *tracker,
+                               const struct sc_latency_entry *entry) {
+    sc_mutex_assert(&tracker->mutex);
+
+    // The encoding time is only known if the device clock offset is known
+    for (unsigned i = SC_LATENCY_STAGE_RECEIVED; i < SC_LATENCY_STAGE_COUNT;
+            ++i) {
+        if (!entry->ticks[i]) {
+            // This frame did not go through all the stages, ignore it
+            return;
+        }
+    }
+
+    const sc_tick *ticks = entry->ticks;
+    bool has_encoded = ticks[SC_LATENCY_STAGE_ENCODED];
+    unsigned first = has_encoded ? SC_LATENCY_STAGE_RECEIVED
+                                 : SC_LATENCY_STAGE_DECODED;
+    for (unsigned i = first; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        push_sample(&tracker->durations[i], ticks[i] - ticks[i - 1]);
+    }
+
+    sc_tick total = ticks[SC_LATENCY_STAGE_PRESENTED]
+                  - ticks[SC_LATENCY_STAGE_RECEIVED];
+    push_sample(&tracker->totals, total);
+    sc_metric_observe(tracker->total_metric, SC_TICK_TO_US(total));
+    if (has_encoded) {
+        sc_tick device_total = ticks[SC_LATENCY_STAGE_PRESENTED]
+                             - ticks[SC_LATENCY_STAGE_ENCODED];
+        push_sample(&tracker->device_totals, device_total);
+        sc_metric_observe(tracker->device_total_metric,
+                          SC_TICK_TO_US(device_total));
+    }
+}
+
+void
+sc_latency_tracker_record(struct sc_latency_tracker *tracker, int64_t pts,
+                          enum sc_latency_stage stage) {
+    assert(stage > SC_LATENCY_STAGE_ENCODED);
+    assert(stage < SC_LATENCY_STAGE_COUNT);
+
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&tracker->mutex);
+
+    if (stage == SC_LATENCY_STAGE_RECEIVED) {
+        // Overwrite the oldest entry
+        struct sc_latency_entry *entry = &tracker->entries[tracker->next];
+        tracker->next = (tracker->next + 1) % SC_LATENCY_TRACKER_CAPACITY;
+
+        entry->used = true;
+        entry->pts = pts;
+        for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+            entry->ticks[i] = 0;
+        }
+        entry->ticks[SC_LATENCY_STAGE_RECEIVED] = now;
+
+        sc_mutex_unlock(&tracker->mutex);
+        return;
+    }
+
+    struct sc_latency_entry *entry = sc_latency_tracker_find(tracker, pts);
+    if (!entry) {
+        // Not tracked (or discarded)
+        sc_mutex_unlock(&tracker->mutex);
+        return;
+    }
+
+    entry->ticks[stage] = now;
+
+    if (stage == SC_LATENCY_STAGE_PRESENTED) {
+        sc_latency_tracker_add_samples(tracker, entry);
+        entry->used = false;
+
+        if (now >= tracker->next_report) {
+            sc_latency_tracker_report(tracker);
+            tracker->next_report = now + SC_LATENCY_TRACKER_INTERVAL;
+        }
+    }
+
+    sc_mutex_unlock(&tracker->mutex);
+}
+
+void
+sc_latency_tracker_record_device_time(struct sc_latency_tracker *tracker,
+                                      int64_t pts, uint64_t device_time) {
+    sc_mutex_lock(&tracker->mutex);
+
+    if (!tracker->device_clock.valid) {
+        // The device time cannot be converted to the local time yet
+        sc_mutex_unlock(&tracker->mutex);
+        return;
+    }
+
+    struct sc_latency_entry *entry = sc_latency_tracker_find(tracker, pts);
+    if (entry) {
+        sc_tick local_time =
+            (sc_tick) device_time - tracker->device_clock.offset;
+        entry->ticks[SC_LATENCY_STAGE_ENCODED] = local_time;
+    }
+
+    sc_mutex_unlock(&tracker->mutex);
+}
+
+void
+sc_latency_tracker_record_arrival(struct sc_latency_tracker *tracker,
+                                  int64_t pts, sc_tick date) {
+    sc_mutex_lock(&tracker->mutex);
+
+    if (tracker->last_arrival.valid && pts > tracker->last_arrival.pts) {
+        // Both the PTS and the ticks are in microseconds
+        sc_tick d = (date - tracker->last_arrival.date)
+                  - (pts - tracker->last_arrival.pts);
+        push_sample(&tracker->jitters, d < 0 ? -d : d);
+    }
+
+    tracker->last_arrival.valid = true;
+    tracker->last_arrival.pts = pts;
+    tracker->last_arrival.date = date;
+
+    sc_mutex_unlock(&tracker->mutex);
+}
+
+void
+sc_latency_tracker_add_clock_sample(struct sc_latency_tracker *tracker,
+                                    sc_tick request_time, uint64_t device_time,
+                                    sc_tick response_time) {
+    assert(response_time >= request_time);
+
+    // Assume that the request and the response took the same time to
+    // transit, so the device handled the request in the middle of the round
+    // trip
+    sc_tick rtt = response_time - request_time;
+    sc_tick offset = (sc_tick) device_time - (request_time + rtt / 2);
+
+    sc_mutex_lock(&tracker->mutex);
+
+    // The lower the round-trip time, the more accurate the estimation
+    bool expired = response_time - tracker->device_clock.date
+                        >= SC_LATENCY_TRACKER_CLOCK_VALIDITY;
+    if (!tracker->device_clock.valid || expired
+            || rtt <= tracker->device_clock.rtt) {
+        LOGD("Device clock offset: %" PRItick " us (round-trip time: %"
+             PRItick " us)", offset, rtt);
+        tracker->device_clock.valid = true;
+        tracker->device_clock.offset = offset;
+        tracker->device_clock.rtt = rtt;
+        tracker->device_clock.date = response_time;
+    }
+
+    sc_mutex_unlock(&tracker->mutex);
+}
+
+uint64_t
+sc_latency_tracker_start_input_ping(struct sc_latency_tracker *tracker,
+                                    sc_tick input_time) {
+    uint64_t sequence = SC_SEQUENCE_INVALID;
+
+    sc_mutex_lock(&tracker->mutex);
+
+    // A single ping in flight, so that the pings do not flood the control
+    // channel (and a lost ping does not block the measurements forever)
+    bool in_flight = tracker->input.sequence != SC_SEQUENCE_INVALID
+                  && input_time - tracker->input.input_time
+                        < SC_LATENCY_TRACKER_PING_TIMEOUT;
+    if (!in_flight) {
+        sequence = tracker->input.next_sequence++;
+        tracker->input.sequence = sequence;
+        tracker->input.input_time = input_time;
+    }
+
+    sc_mutex_unlock(&tracker->mutex);
+
+    return sequence;
+}
+
+// must be called with mutex locked
+static void
+sc_latency_tracker_report_input(struct sc_latency_tracker *tracker) {
+    sc_mutex_assert(&tracker->mutex);
+
+    struct sc_latency_samples *acks = &tracker->input.acks;
+    struct sc_latency_samples *rtts = &tracker->input.rtts;
+    assert(acks->size == rtts->size);
+    if (!acks->size) {
+        return;
+    }
+
+    // The acknowledgment also travels back to the computer: estimate its
+    // transit time as half of the lowest round-trip time of the period
+    sc_tick min_rtt = rtts->data[0];
+    for (size_t i = 1; i < rtts->size; ++i) {
+        min_rtt = MIN(min_rtt, rtts->data[i]);
+    }
+    for (size_t i = 0; i < acks->size; ++i) {
+        acks->data[i] = MAX(acks->data[i] - min_rtt / 2, 0);
+    }
+
+    char buf[128];
+    size_t len = 0;
+    format_samples(buf, sizeof(buf), &len, "input-to-injection", acks);
+    format_samples(buf, sizeof(buf), &len, "control-rtt", rtts);
+
+    LOGI("Input latency p50/p95/p99 (ms): %s", buf);
+}
+
+void
+sc_latency_tracker_ack_input_ping(struct sc_latency_tracker *tracker,
+                                  uint64_t sequence, sc_tick send_time,
+                                  sc_tick ack_time) {
+    sc_mutex_lock(&tracker->mutex);
+
+    if (sequence != tracker->input.sequence) {
+        // Timed out (a more recent ping has been sent)
+        sc_mutex_unlock(&tracker->mutex);
+        return;
+    }
+
+    tracker->input.sequence = SC_SEQUENCE_INVALID;
+
+    sc_tick input_time = tracker->input.input_time;
+    if (send_time < input_time || ack_time < send_time) {
+        LOGW("Invalid ping acknowledgment");
+        sc_mutex_unlock(&tracker->mutex);
+        return;
+    }
+
+    push_sample(&tracker->input.acks, ack_time - input_time);
+    sc_metric_observe(tracker->input_metric,
+                      SC_TICK_TO_US(ack_time - input_time));
+    push_sample(&tracker->input.rtts, ack_time - send_time);
+    if (tracker->input.acks.size != tracker->input.rtts.size) {
+        // One of the pushes failed (OOM), keep the vectors consistent
+        size_t size = MIN(tracker->input.acks.size, tracker->input.rtts.size);
+        tracker->input.acks.size = size;
+        tracker->input.rtts.size = size;
+    }
+
+    if (!tracker->input.next_report) {
+        tracker->input.next_report = ack_time + SC_LATENCY_TRACKER_INTERVAL;
+    } else if (ack_time >= tracker->input.next_report) {
+        sc_latency_tracker_report_input(tracker);
+        tracker->input.next_report = ack_time + SC_LATENCY_TRACKER_INTERVAL;
+    }
+
+    sc_mutex_unlock(&tracker->mutex);
+}
@@ -0,0 +1,212 @@
+#ifndef SC_LATENCY_TRACKER_H
+#define SC_LATENCY_TRACKER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "options.h"
+#include "util/acksync.h"
+#include "util/metrics.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+/**
+ * The successive stages of a video frame, from the encoding of its packet on
+ * the device to its presentation on the screen.
+ */
+enum sc_latency_stage {
+    SC_LATENCY_STAGE_ENCODED,   // packet output by the device encoder
+    SC_LATENCY_STAGE_RECEIVED,  // packet received from the socket
+    SC_LATENCY_STAGE_DECODED,   // frame output by the decoder
+    SC_LATENCY_STAGE_BUFFERED,  // frame pushed to the screen frame buffer
+    SC_LATENCY_STAGE_UPLOADED,  // frame uploaded to the texture
+    SC_LATENCY_STAGE_PRESENTED, // frame presented by the renderer
+};
+
+#define SC_LATENCY_STAGE_COUNT 6
+
+// Number of frames tracked simultaneously (the oldest ones are discarded)
+#define SC_LATENCY_TRACKER_CAPACITY 64
+
+struct sc_latency_entry {
+    bool used;
+    int64_t pts;
+    sc_tick ticks[SC_LATENCY_STAGE_COUNT]; // 0 if not reached yet
+};
+
+struct sc_latency_samples SC_VECTOR(sc_tick);
+
+/**
+ * Track the time spent by each video frame in each stage of the pipeline (the
+ * frames are identified by their PTS), and report the latency percentiles
+ * every second.
+ *
+ * All the functions are thread-safe.
+ */
+struct sc_latency_tracker {
+    sc_mutex mutex;
+
+    struct sc_latency_entry entries[SC_LATENCY_TRACKER_CAPACITY];
+    unsigned next; // index of the next entry to use
+
+    // Samples of the frames presented during the current period:
+    //  - durations[i] contains the durations from stage i-1 to stage i (for
+    //    i > 0);
+    //  - totals contains the durations from received to presented;
+    //  - device_totals contains the durations from encoded to presented.
+    struct sc_latency_samples durations[SC_LATENCY_STAGE_COUNT];
+    struct sc_latency_samples totals;
+    struct sc_latency_samples device_totals;
+    // Variations of the transit time between consecutive packets (the
+    // difference between their arrival interval and their PTS interval)
+    struct sc_latency_samples jitters;
+    sc_tick next_report;
+
+    // Last packet received, to compute the jitter
+    struct {
+        bool valid;
+        int64_t pts;
+        sc_tick date;
+    } last_arrival;
+
+    // Estimation of the device clock offset, from the clock request having
+    // the lowest round-trip time
+    struct {
+        bool valid;
+        sc_tick offset; // device time - local time
+        sc_tick rtt;
+        sc_tick date; // local time of the estimation
+    } device_clock;
+
+    // Input latency, measured by a ping pushed right after an input event:
+    // the device handles the control messages in order, so the ping is
+    // acknowledged once the input event has been injected
+    struct {
+        uint64_t next_sequence;
+        uint64_t sequence; // of the ping in flight, or SC_SEQUENCE_INVALID
+        sc_tick input_time; // local time of the input event
+        // Durations from the input events to the acknowledgments
+        struct sc_latency_samples acks;
+        // Round-trip times of the control channel
+        struct sc_latency_samples rtts;
+        sc_tick next_report;
+    } input;
+
+    // Reported along with the latencies, the presentation (render stage)
+    // depends on it
+    enum sc_present_mode present_mode;
+    // Expected p95 of the totals (0 if none), checked on every report
+    sc_tick budget;
+
+    // Latency histograms (NULL if metrics are disabled)
+    struct sc_metric *total_metric; // received to presented
+    struct sc_metric *device_total_metric; // encoded to presented
+    struct sc_metric *input_metric; // input event to acknowledgment
+};
+
+bool
+sc_latency_tracker_init(struct sc_latency_tracker *tracker);
+
+void
+sc_latency_tracker_destroy(struct sc_latency_tracker *tracker);
+
+/**
+ * Register the latency histograms to the registry
+ *
+ * It must be called before the tracker is used from other threads.
+ */
+void
+sc_latency_tracker_set_metrics(struct sc_latency_tracker *tracker,
+                               struct sc_metrics *metrics);
+
+/**
+ * Set the present mode of the screen, reported along with the latencies
+ */
+void
+sc_latency_tracker_set_present_mode(struct sc_latency_tracker *tracker,
+                                    enum sc_present_mode present_mode);
+
+/**
+ * Set the latency budget of the latency profile
+ *
+ * A warning is logged when the p95 of the latency from reception to
+ * presentation exceeds the budget.
+ */
+void
+sc_latency_tracker_set_budget(struct sc_latency_tracker *tracker,
+                              sc_tick budget);
+
+/**
+ * Record that the frame identified by pts has reached a stage
+ *
+ * A frame is tracked from SC_LATENCY_STAGE_RECEIVED; the other stages of
+ * untracked frames are ignored.
+ *
+ * SC_LATENCY_STAGE_ENCODED must be recorded by
+ * sc_latency_tracker_record_device_time() instead.
+ */
+void
+sc_latency_tracker_record(struct sc_latency_tracker *tracker, int64_t pts,
+                          enum sc_latency_stage stage);
+
+/**
+ * Record the device time (in microseconds) at which the frame identified by
+ * pts has been output by the encoder
+ *
+ * It must be called after SC_LATENCY_STAGE_RECEIVED has been recorded. It is
+ * ignored until the device clock offset is known.
+ */
+void
+sc_latency_tracker_record_device_time(struct sc_latency_tracker *tracker,
+                                      int64_t pts, uint64_t device_time);
+
+/**
+ * Record the date when the packet identified by pts has been received, to
+ * measure the network jitter
+ *
+ * The date may be earlier than SC_LATENCY_STAGE_RECEIVED (for example a
+ * kernel receive timestamp).
+ */
+void
+sc_latency_tracker_record_arrival(struct sc_latency_tracker *tracker,
+                                  int64_t pts, sc_tick date);
+
+/**
+ * Add a device clock sample, to estimate the offset between the device clock
+ * and the local clock
+ *
+ * \param request_time the local time when the request was sent
+ * \param device_time the device time when the request was handled
+ * \param response_time the local time when the response was received
+ */
+void
+sc_latency_tracker_add_clock_sample(struct sc_latency_tracker *tracker,
+                                    sc_tick request_time, uint64_t device_time,
+                                    sc_tick response_time);
+
+/**
+ * Start an input latency measurement for an input event pushed at input_time
+ *
+ * Return the sequence of the ping to push right after the input event, or
+ * SC_SEQUENCE_INVALID if a measurement is already in progress.
+ */
+uint64_t
+sc_latency_tracker_start_input_ping(struct sc_latency_tracker *tracker,
+                                    sc_tick input_time);
+
+/**
+ * Record the acknowledgment of a ping by the device
+ *
+ * \param sequence the sequence of the ping
+ * \param send_time the local time when the ping was sent
+ * \param ack_time the local time when the acknowledgment was received
+ */
+void
+sc_latency_tracker_ack_input_ping(struct sc_latency_tracker *tracker,
+                                  uint64_t sequence, sc_tick send_time,
+                                  sc_tick ack_time);
+
+#endif
@@ -2,17 +2,16 @@
 
 #include <stdbool.h>
 #include <stdio.h>
-#ifdef HAVE_V4L2
-# include <libavdevice/avdevice.h>
-#endif
 #define SDL_MAIN_HANDLED // avoid link error on Linux Windows Subsystem
 #include <SDL2/SDL.h>
 
 #include "cli.h"
 #include "options.h"
 #include "scrcpy.h"
+#include "scrcpy_replay.h"
 #include "usb/scrcpy_otg.h"
 #include "util/log.h"
+#include "util/log_async.h"
 #include "util/net.h"
 #include "util/thread.h"
 #include "version.h"
@@ -73,12 +72,6 @@ main_scrcpy(int argc, char *argv[]) {
     av_register_all();
 #endif
 
-#ifdef HAVE_V4L2
-    if (args.opts.v4l2_device) {
-        avdevice_register_all();
-    }
-#endif
-
     if (!net_init()) {
         ret = SCRCPY_EXIT_FAILURE;
         goto end;
@@ -86,11 +79,23 @@ main_scrcpy(int argc, char *argv[]) {
 
     sc_log_configure();
 
+    // Never block the threads logging on the terminal (on failure, log
+    // synchronously)
+    bool log_async = sc_log_async_start();
+
+    if (args.opts.stream_replay_prefix) {
+        ret = scrcpy_replay(&args.opts);
+    } else {
 #ifdef HAVE_USB
-    ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
+        ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
 #else
-    ret = scrcpy(&args.opts);
+        ret = scrcpy(&args.opts);
 #endif
+    }
+
+    if (log_async) {
+        sc_log_async_stop();
+    }
 
 end:
     if (args.pause_on_exit == SC_PAUSE_ON_EXIT_TRUE ||
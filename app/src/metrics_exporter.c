@@ -0,0 +1,341 @@
+#include "metrics_exporter.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/strbuf.h"
+
+#define SC_METRICS_HTTP_REQUEST_MAX_SIZE 1024
+// Delay to receive the whole request, after which the connection is closed (so
+// that an idle client does not block the server)
+#define SC_METRICS_HTTP_REQUEST_TIMEOUT SC_TICK_FROM_SEC(2)
+
+bool
+sc_metrics_exporter_init(struct sc_metrics_exporter *exporter,
+                         struct sc_metrics *metrics, const char *filename,
+                         sc_tick interval, uint16_t port) {
+    assert(filename || port);
+    assert(interval > 0);
+
+    bool ok = sc_mutex_init(&exporter->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&exporter->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    exporter->file = NULL;
+    exporter->close_file = false;
+    if (filename) {
+        if (!strcmp(filename, "-")) {
+            exporter->file = stdout;
+        } else {
+            exporter->file = sc_file_open(filename, "w");
+            if (!exporter->file) {
+                LOGE("Could not open metrics file: %s", filename);
+                goto error_destroy_cond;
+            }
+            exporter->close_file = true;
+        }
+    }
+
+    exporter->server_socket = SC_SOCKET_NONE;
+    exporter->client_socket = SC_SOCKET_NONE;
+    if (port) {
+        exporter->server_socket = net_socket();
+        if (exporter->server_socket == SC_SOCKET_NONE) {
+            LOGE("Could not create metrics socket");
+            goto error_close_file;
+        }
+
+        // Only accept local connections
+        ok = net_listen(exporter->server_socket, IPV4_LOCALHOST, port, 4);
+        if (!ok) {
+            LOGE("Could not listen on metrics port %" PRIu16, port);
+            net_close(exporter->server_socket);
+            goto error_close_file;
+        }
+
+        LOGI("Metrics available on http://127.0.0.1:%" PRIu16 "/metrics",
+             port);
+    }
+
+    exporter->metrics = metrics;
+    exporter->interval = interval;
+    exporter->stopped = false;
+
+    return true;
+
+error_close_file:
+    if (exporter->close_file) {
+        fclose(exporter->file);
+    }
+error_destroy_cond:
+    sc_cond_destroy(&exporter->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&exporter->mutex);
+
+    return false;
+}
+
+void
+sc_metrics_exporter_destroy(struct sc_metrics_exporter *exporter) {
+    assert(exporter->client_socket == SC_SOCKET_NONE);
+    if (exporter->server_socket != SC_SOCKET_NONE) {
+        net_close(exporter->server_socket);
+    }
+    if (exporter->close_file && fclose(exporter->file)) {
+        LOGW("Could not close metrics file");
+    }
+    sc_cond_destroy(&exporter->cond);
+    sc_mutex_destroy(&exporter->mutex);
+}
+
+static bool
+sc_metrics_exporter_write_json(struct sc_metrics_exporter *exporter,
+                               struct sc_strbuf *buf) {
+    buf->len = 0;
+    bool ok = sc_metrics_format_json(exporter->metrics, buf, time(NULL))
+           && sc_strbuf_append_char(buf, '\n');
+    if (!ok) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (fwrite(buf->s, 1, buf->len, exporter->file) != buf->len
+            || fflush(exporter->file)) {
+        LOGE("Could not write metrics");
+        return false;
+    }
+
+    return true;
+}
+
+static int
+run_metrics_exporter(void *data) {
+    struct sc_metrics_exporter *exporter = data;
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 1024)) {
+        LOG_OOM();
+        return 0;
+    }
+
+    sc_tick deadline = sc_tick_now() + exporter->interval;
+
+    sc_mutex_lock(&exporter->mutex);
+    for (;;) {
+        while (!exporter->stopped && sc_tick_now() < deadline) {
+            // ignore the reason (timeout or signaled), we just loop anyway
+            sc_cond_timedwait(&exporter->cond, &exporter->mutex, deadline);
+        }
+        if (exporter->stopped) {
+            break;
+        }
+        sc_mutex_unlock(&exporter->mutex);
+
+        bool ok = sc_metrics_exporter_write_json(exporter, &buf);
+
+        sc_mutex_lock(&exporter->mutex);
+        if (!ok) {
+            break;
+        }
+
+        deadline += exporter->interval;
+        sc_tick now = sc_tick_now();
+        if (deadline < now) {
+            // Do not try to catch up
+            deadline = now + exporter->interval;
+        }
+    }
+    sc_mutex_unlock(&exporter->mutex);
+
+    free(buf.s);
+
+    return 0;
+}
+
+static void
+sc_metrics_exporter_send_response(sc_socket socket, const char *status,
+                                  const char *content_type, const char *body,
+                                  size_t body_len) {
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %" PRIu64 "\r\n"
+                       "Connection: close\r\n"
+                       "\r\n",
+                       status, content_type, (uint64_t) body_len);
+    assert(len > 0 && (size_t) len < sizeof(header));
+
+    if (net_send_all(socket, header, len) == (ssize_t) len && body_len) {
+        net_send_all(socket, body, body_len);
+    }
+}
+
+static void
+sc_metrics_exporter_serve(struct sc_metrics_exporter *exporter,
+                          sc_socket socket) {
+    // Read the request headers (the body, if any, is ignored)
+    char req[SC_METRICS_HTTP_REQUEST_MAX_SIZE + 1];
+    size_t len = 0;
+    sc_tick deadline = sc_tick_now() + SC_METRICS_HTTP_REQUEST_TIMEOUT;
+    for (;;) {
+        sc_tick timeout = deadline - sc_tick_now();
+        if (timeout <= 0) {
+            LOGD("Metrics request timeout, closing the connection");
+            return;
+        }
+
+        bool readable;
+        int w = net_wait_readable(&socket, &readable, 1, timeout);
+        if (w == -1) {
+            return;
+        }
+        if (!w) {
+            // Timeout or spurious wake-up, the deadline is checked above
+            continue;
+        }
+
+        ssize_t r = net_recv(socket, req + len,
+                             SC_METRICS_HTTP_REQUEST_MAX_SIZE - len);
+        if (r <= 0) {
+            return;
+        }
+        len += r;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+        if (len == SC_METRICS_HTTP_REQUEST_MAX_SIZE) {
+            LOGW("Metrics request too large");
+            return;
+        }
+    }
+
+    bool found = !strncmp(req, "GET /metrics ", 13)
+              || !strncmp(req, "GET /metrics?", 13);
+    if (!found) {
+        static const char msg[] = "Not found\n";
+        sc_metrics_exporter_send_response(socket, "404 Not Found",
+                                          "text/plain", msg, sizeof(msg) - 1);
+        return;
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 4096)) {
+        LOG_OOM();
+        return;
+    }
+
+    if (!sc_metrics_format_prometheus(exporter->metrics, &buf)) {
+        LOG_OOM();
+        free(buf.s);
+        return;
+    }
+
+    sc_metrics_exporter_send_response(socket, "200 OK",
+                                      "text/plain; version=0.0.4", buf.s,
+                                      buf.len);
+    free(buf.s);
+}
+
+static int
+run_metrics_http(void *data) {
+    struct sc_metrics_exporter *exporter = data;
+
+    for (;;) {
+        // The requests are served sequentially: a scraper sends one request
+        // at a time, formatting the metrics is fast, and an idle connection is
+        // closed after SC_METRICS_HTTP_REQUEST_TIMEOUT
+        sc_socket socket = net_accept(exporter->server_socket);
+        if (socket == SC_SOCKET_NONE) {
+            // interrupted
+            break;
+        }
+
+        sc_mutex_lock(&exporter->mutex);
+        if (exporter->stopped) {
+            sc_mutex_unlock(&exporter->mutex);
+            net_close(socket);
+            break;
+        }
+        exporter->client_socket = socket;
+        sc_mutex_unlock(&exporter->mutex);
+
+        sc_metrics_exporter_serve(exporter, socket);
+
+        sc_mutex_lock(&exporter->mutex);
+        exporter->client_socket = SC_SOCKET_NONE;
+        sc_mutex_unlock(&exporter->mutex);
+
+        net_close(socket);
+    }
+
+    LOGD("Metrics HTTP server stopped");
+
+    return 0;
+}
+
+bool
+sc_metrics_exporter_start(struct sc_metrics_exporter *exporter) {
+    LOGD("Starting metrics exporter");
+
+    if (exporter->file) {
+        bool ok = sc_thread_create(&exporter->thread, run_metrics_exporter,
+                                   "scrcpy-metrics", exporter);
+        if (!ok) {
+            LOGE("Could not start metrics exporter thread");
+            return false;
+        }
+    }
+
+    if (exporter->server_socket != SC_SOCKET_NONE) {
+        bool ok = sc_thread_create(&exporter->http_thread, run_metrics_http,
+                                   "scrcpy-metrics-http", exporter);
+        if (!ok) {
+            LOGE("Could not start metrics HTTP thread");
+            if (exporter->file) {
+                sc_metrics_exporter_stop(exporter);
+                sc_thread_join(&exporter->thread, NULL);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+sc_metrics_exporter_stop(struct sc_metrics_exporter *exporter) {
+    sc_mutex_lock(&exporter->mutex);
+    exporter->stopped = true;
+    sc_cond_signal(&exporter->cond);
+    if (exporter->client_socket != SC_SOCKET_NONE) {
+        net_interrupt(exporter->client_socket);
+    }
+    sc_mutex_unlock(&exporter->mutex);
+
+    if (exporter->server_socket != SC_SOCKET_NONE) {
+        net_interrupt(exporter->server_socket);
+    }
+}
+
+void
+sc_metrics_exporter_join(struct sc_metrics_exporter *exporter) {
+    if (exporter->file) {
+        sc_thread_join(&exporter->thread, NULL);
+    }
+    if (exporter->server_socket != SC_SOCKET_NONE) {
+        sc_thread_join(&exporter->http_thread, NULL);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef SC_METRICS_EXPORTER_H
+#define SC_METRICS_EXPORTER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "util/metrics.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Export the metrics registry (--metrics-file and --metrics-port)
+ *
+ * The metrics may be written periodically as JSON lines to a file (or
+ * stdout), and/or served in the Prometheus text format on
+ * http://localhost:<port>/metrics.
+ */
+struct sc_metrics_exporter {
+    struct sc_metrics *metrics;
+
+    // JSON lines (file is NULL if disabled)
+    FILE *file;
+    bool close_file; // false for stdout
+    sc_tick interval;
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    // HTTP endpoint (SC_SOCKET_NONE if disabled)
+    sc_socket server_socket;
+    sc_thread http_thread;
+    // The connected client, or SC_SOCKET_NONE (protected by mutex)
+    sc_socket client_socket;
+};
+
+/**
+ * Initialize the exporter
+ *
+ * The filename may be NULL (disabled) or "-" (stdout). The port may be 0
+ * (disabled).
+ */
+bool
+sc_metrics_exporter_init(struct sc_metrics_exporter *exporter,
+                         struct sc_metrics *metrics, const char *filename,
+                         sc_tick interval, uint16_t port);
+
+void
+sc_metrics_exporter_destroy(struct sc_metrics_exporter *exporter);
+
+bool
+sc_metrics_exporter_start(struct sc_metrics_exporter *exporter);
+
+void
+sc_metrics_exporter_stop(struct sc_metrics_exporter *exporter);
+
+void
+sc_metrics_exporter_join(struct sc_metrics_exporter *exporter);
+
+#endif
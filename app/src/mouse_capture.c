@@ -1,8 +1,32 @@
 #include "mouse_capture.h"
 
+#include "compat.h"
 #include "shortcut_mod.h"
 #include "util/log.h"
 
+void
+sc_mouse_capture_set_hints(void) {
+    // In relative mode, read the raw input of the platform (Raw Input on
+    // Windows, XInput2 raw events on X11) instead of warping the cursor to the
+    // center of the window on every motion, which produces irregular deltas
+    if (!SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_MODE_WARP, "0")) {
+        LOGW("Could not disable relative mouse mode warping");
+    }
+
+    // Forward the deltas as received, not scaled to the renderer logical size
+    if (!SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_SCALING, "0")) {
+        LOGW("Could not disable relative mouse motion scaling");
+    }
+
+#ifdef SCRCPY_SDL_HAS_HINT_MOUSE_RELATIVE_SYSTEM_SCALE
+    // Do not apply the pointer acceleration of the computer: the device
+    // applies its own
+    if (!SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_SYSTEM_SCALE, "0")) {
+        LOGW("Could not disable relative mouse system scale");
+    }
+#endif
+}
+
 void
 sc_mouse_capture_init(struct sc_mouse_capture *mc, SDL_Window *window,
                       uint8_t shortcut_mods) {
@@ -17,6 +17,14 @@ struct sc_mouse_capture {
 
 };
 
+/**
+ * Configure SDL to capture the raw motions of the mouse in relative mode
+ *
+ * It must be called before the window is created.
+ */
+void
+sc_mouse_capture_set_hints(void);
+
 void
 sc_mouse_capture_init(struct sc_mouse_capture *mc, SDL_Window *window,
                       uint8_t shortcut_mods);
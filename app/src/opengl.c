@@ -18,6 +18,49 @@ sc_opengl_init(struct sc_opengl *gl) {
 
     // optional
     gl->GenerateMipmap = SDL_GL_GetProcAddress("glGenerateMipmap");
+    gl->GetIntegerv = SDL_GL_GetProcAddress("glGetIntegerv");
+    gl->PixelStorei = SDL_GL_GetProcAddress("glPixelStorei");
+    gl->ActiveTexture = SDL_GL_GetProcAddress("glActiveTexture");
+    gl->TexSubImage2D = SDL_GL_GetProcAddress("glTexSubImage2D");
+    gl->GenBuffers = SDL_GL_GetProcAddress("glGenBuffers");
+    gl->DeleteBuffers = SDL_GL_GetProcAddress("glDeleteBuffers");
+    gl->BindBuffer = SDL_GL_GetProcAddress("glBindBuffer");
+    gl->BufferData = SDL_GL_GetProcAddress("glBufferData");
+    gl->MapBufferRange = SDL_GL_GetProcAddress("glMapBufferRange");
+    gl->UnmapBuffer = SDL_GL_GetProcAddress("glUnmapBuffer");
+    gl->GenTextures = SDL_GL_GetProcAddress("glGenTextures");
+    gl->DeleteTextures = SDL_GL_GetProcAddress("glDeleteTextures");
+    gl->BindTexture = SDL_GL_GetProcAddress("glBindTexture");
+    gl->TexImage2D = SDL_GL_GetProcAddress("glTexImage2D");
+    gl->CreateShader = SDL_GL_GetProcAddress("glCreateShader");
+    gl->ShaderSource = SDL_GL_GetProcAddress("glShaderSource");
+    gl->CompileShader = SDL_GL_GetProcAddress("glCompileShader");
+    gl->GetShaderiv = SDL_GL_GetProcAddress("glGetShaderiv");
+    gl->GetShaderInfoLog = SDL_GL_GetProcAddress("glGetShaderInfoLog");
+    gl->DeleteShader = SDL_GL_GetProcAddress("glDeleteShader");
+    gl->CreateProgram = SDL_GL_GetProcAddress("glCreateProgram");
+    gl->AttachShader = SDL_GL_GetProcAddress("glAttachShader");
+    gl->BindAttribLocation = SDL_GL_GetProcAddress("glBindAttribLocation");
+    gl->LinkProgram = SDL_GL_GetProcAddress("glLinkProgram");
+    gl->GetProgramiv = SDL_GL_GetProcAddress("glGetProgramiv");
+    gl->GetProgramInfoLog = SDL_GL_GetProcAddress("glGetProgramInfoLog");
+    gl->DeleteProgram = SDL_GL_GetProcAddress("glDeleteProgram");
+    gl->UseProgram = SDL_GL_GetProcAddress("glUseProgram");
+    gl->GetUniformLocation = SDL_GL_GetProcAddress("glGetUniformLocation");
+    gl->Uniform1i = SDL_GL_GetProcAddress("glUniform1i");
+    gl->Uniform3fv = SDL_GL_GetProcAddress("glUniform3fv");
+    gl->Uniform4fv = SDL_GL_GetProcAddress("glUniform4fv");
+    gl->UniformMatrix3fv = SDL_GL_GetProcAddress("glUniformMatrix3fv");
+    gl->VertexAttribPointer = SDL_GL_GetProcAddress("glVertexAttribPointer");
+    gl->EnableVertexAttribArray =
+        SDL_GL_GetProcAddress("glEnableVertexAttribArray");
+    gl->DisableVertexAttribArray =
+        SDL_GL_GetProcAddress("glDisableVertexAttribArray");
+    gl->DrawArrays = SDL_GL_GetProcAddress("glDrawArrays");
+    gl->Viewport = SDL_GL_GetProcAddress("glViewport");
+    gl->ClearColor = SDL_GL_GetProcAddress("glClearColor");
+    gl->Clear = SDL_GL_GetProcAddress("glClear");
+    gl->Disable = SDL_GL_GetProcAddress("glDisable");
 
     const char *version = (const char *) gl->GetString(GL_VERSION);
     assert(version);
@@ -55,3 +98,56 @@ sc_opengl_version_at_least(struct sc_opengl *gl,
         || (gl->version_major == minver_major
          && gl->version_minor >= minver_minor);
 }
+
+bool
+sc_opengl_has_pbo_functions(struct sc_opengl *gl) {
+    return gl->GetIntegerv
+        && gl->PixelStorei
+        && gl->ActiveTexture
+        && gl->TexSubImage2D
+        && gl->GenBuffers
+        && gl->DeleteBuffers
+        && gl->BindBuffer
+        && gl->BufferData
+        && gl->MapBufferRange
+        && gl->UnmapBuffer;
+}
+
+bool
+sc_opengl_has_shader_functions(struct sc_opengl *gl) {
+    return gl->PixelStorei
+        && gl->ActiveTexture
+        && gl->TexSubImage2D
+        && gl->BindBuffer
+        && gl->GenTextures
+        && gl->DeleteTextures
+        && gl->BindTexture
+        && gl->TexImage2D
+        && gl->CreateShader
+        && gl->ShaderSource
+        && gl->CompileShader
+        && gl->GetShaderiv
+        && gl->GetShaderInfoLog
+        && gl->DeleteShader
+        && gl->CreateProgram
+        && gl->AttachShader
+        && gl->BindAttribLocation
+        && gl->LinkProgram
+        && gl->GetProgramiv
+        && gl->GetProgramInfoLog
+        && gl->DeleteProgram
+        && gl->UseProgram
+        && gl->GetUniformLocation
+        && gl->Uniform1i
+        && gl->Uniform3fv
+        && gl->Uniform4fv
+        && gl->UniformMatrix3fv
+        && gl->VertexAttribPointer
+        && gl->EnableVertexAttribArray
+        && gl->DisableVertexAttribArray
+        && gl->DrawArrays
+        && gl->Viewport
+        && gl->ClearColor
+        && gl->Clear
+        && gl->Disable;
+}
@@ -23,6 +23,145 @@ struct sc_opengl {
 
     void
     (*GenerateMipmap)(GLenum target);
+
+    // Pixel buffer objects (optional)
+
+    void
+    (*GetIntegerv)(GLenum pname, GLint *data);
+
+    void
+    (*PixelStorei)(GLenum pname, GLint param);
+
+    void
+    (*ActiveTexture)(GLenum texture);
+
+    void
+    (*TexSubImage2D)(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                     GLsizei width, GLsizei height, GLenum format, GLenum type,
+                     const void *pixels);
+
+    void
+    (*GenBuffers)(GLsizei n, GLuint *buffers);
+
+    void
+    (*DeleteBuffers)(GLsizei n, const GLuint *buffers);
+
+    void
+    (*BindBuffer)(GLenum target, GLuint buffer);
+
+    void
+    (*BufferData)(GLenum target, GLsizeiptr size, const void *data,
+                  GLenum usage);
+
+    void *
+    (*MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length,
+                      GLbitfield access);
+
+    GLboolean
+    (*UnmapBuffer)(GLenum target);
+
+    // YUV shader (optional)
+
+    void
+    (*GenTextures)(GLsizei n, GLuint *textures);
+
+    void
+    (*DeleteTextures)(GLsizei n, const GLuint *textures);
+
+    void
+    (*BindTexture)(GLenum target, GLuint texture);
+
+    void
+    (*TexImage2D)(GLenum target, GLint level, GLint internalformat,
+                  GLsizei width, GLsizei height, GLint border, GLenum format,
+                  GLenum type, const void *pixels);
+
+    GLuint
+    (*CreateShader)(GLenum type);
+
+    void
+    (*ShaderSource)(GLuint shader, GLsizei count, const GLchar *const *string,
+                    const GLint *length);
+
+    void
+    (*CompileShader)(GLuint shader);
+
+    void
+    (*GetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+
+    void
+    (*GetShaderInfoLog)(GLuint shader, GLsizei max_length, GLsizei *length,
+                        GLchar *info_log);
+
+    void
+    (*DeleteShader)(GLuint shader);
+
+    GLuint
+    (*CreateProgram)(void);
+
+    void
+    (*AttachShader)(GLuint program, GLuint shader);
+
+    void
+    (*BindAttribLocation)(GLuint program, GLuint index, const GLchar *name);
+
+    void
+    (*LinkProgram)(GLuint program);
+
+    void
+    (*GetProgramiv)(GLuint program, GLenum pname, GLint *params);
+
+    void
+    (*GetProgramInfoLog)(GLuint program, GLsizei max_length, GLsizei *length,
+                         GLchar *info_log);
+
+    void
+    (*DeleteProgram)(GLuint program);
+
+    void
+    (*UseProgram)(GLuint program);
+
+    GLint
+    (*GetUniformLocation)(GLuint program, const GLchar *name);
+
+    void
+    (*Uniform1i)(GLint location, GLint v0);
+
+    void
+    (*Uniform3fv)(GLint location, GLsizei count, const GLfloat *value);
+
+    void
+    (*Uniform4fv)(GLint location, GLsizei count, const GLfloat *value);
+
+    void
+    (*UniformMatrix3fv)(GLint location, GLsizei count, GLboolean transpose,
+                        const GLfloat *value);
+
+    void
+    (*VertexAttribPointer)(GLuint index, GLint size, GLenum type,
+                           GLboolean normalized, GLsizei stride,
+                           const void *pointer);
+
+    void
+    (*EnableVertexAttribArray)(GLuint index);
+
+    void
+    (*DisableVertexAttribArray)(GLuint index);
+
+    void
+    (*DrawArrays)(GLenum mode, GLint first, GLsizei count);
+
+    void
+    (*Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void
+    (*ClearColor)(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+    void
+    (*Clear)(GLbitfield mask);
+
+    void
+    (*Disable)(GLenum cap);
 };
 
 void
@@ -33,4 +172,14 @@ sc_opengl_version_at_least(struct sc_opengl *gl,
                            int minver_major, int minver_minor,
                            int minver_es_major, int minver_es_minor);
 
+// Return true if all the functions required to upload textures through pixel
+// buffer objects have been loaded
+bool
+sc_opengl_has_pbo_functions(struct sc_opengl *gl);
+
+// Return true if all the functions required to render the frames with the YUV
+// shader have been loaded
+bool
+sc_opengl_has_shader_functions(struct sc_opengl *gl);
+
 #endif
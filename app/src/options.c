@@ -6,6 +6,7 @@ const struct scrcpy_options scrcpy_options_default = {
     .serial = NULL,
     .crop = NULL,
     .record_filename = NULL,
+    .replay_filename = NULL,
     .window_title = NULL,
     .push_target = NULL,
     .render_driver = NULL,
@@ -23,9 +24,11 @@ const struct scrcpy_options scrcpy_options_default = {
     .video_source = SC_VIDEO_SOURCE_DISPLAY,
     .audio_source = SC_AUDIO_SOURCE_AUTO,
     .record_format = SC_RECORD_FORMAT_AUTO,
+    .replay_format = SC_RECORD_FORMAT_AUTO,
     .keyboard_input_mode = SC_KEYBOARD_INPUT_MODE_AUTO,
     .mouse_input_mode = SC_MOUSE_INPUT_MODE_AUTO,
     .gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_DISABLED,
+    .gamepad_report_rate = 250,
     .mouse_bindings = {
         .pri = {
             .right_click = SC_MOUSE_BINDING_AUTO,
@@ -41,15 +44,21 @@ const struct scrcpy_options scrcpy_options_default = {
         },
     },
     .camera_facing = SC_CAMERA_FACING_ANY,
+    .video_hwaccel = SC_HWACCEL_NONE,
+    .video_decoder_thread_type = SC_DECODER_THREAD_TYPE_SLICE,
     .port_range = {
         .first = DEFAULT_LOCAL_PORT_RANGE_FIRST,
         .last = DEFAULT_LOCAL_PORT_RANGE_LAST,
     },
     .tunnel_host = 0,
     .tunnel_port = 0,
+    .direct_tcp_port = 0,
     .shortcut_mods = SC_SHORTCUT_MOD_LALT | SC_SHORTCUT_MOD_LSUPER,
     .max_size = 0,
+    .video_decoder_threads = 0,
     .video_bit_rate = 0,
+    .video_socket_buffer_size = 0,
+    .video_socket_busy_poll = 0,
     .audio_bit_rate = 0,
     .max_fps = NULL,
     .capture_orientation = SC_ORIENTATION_0,
@@ -63,18 +72,63 @@ const struct scrcpy_options scrcpy_options_default = {
     .window_height = 0,
     .display_id = 0,
     .video_buffer = 0,
+    .video_buffer_max = 0,
     .audio_buffer = -1, // depends on the audio format,
+    .audio_buffer_max = 0,
     .audio_output_buffer = SC_TICK_FROM_MS(5),
+    .audio_volume = 100,
     .time_limit = 0,
     .screen_off_timeout = -1,
+    .record_segment_duration = 0,
+    .record_segment_size = 0,
+    .record_segment_count = 0,
+    .record_memory_limit = 256000000,
+    .record_fragment_duration = SC_TICK_FROM_MS(1000),
+    .record_index = false,
+    .record_sync = false,
+    .record_on_demand = false,
+    .record_stream = false,
+    .record_video_bit_rate = 0,
+    .record_max_size = 0,
+    .record_transcode = false,
+    .record_transcode_codec = SC_CODEC_H265,
+    .record_transcode_quality = 28,
+    .record_upload_url = NULL,
+    .record_upload_only = false,
+    .replay_buffer = 0,
 #ifdef HAVE_V4L2
     .v4l2_device = NULL,
     .v4l2_buffer = 0,
+    .v4l2_format = SC_V4L2_FORMAT_YUV420P,
+    .v4l2_fps = 0,
 #endif
+    .shm_name = NULL,
+    .restream_url = NULL,
+    .raw_video_filename = NULL,
+    .input_record_filename = NULL,
+    .input_replay_filename = NULL,
+    .automation_port = 0,
+    .metrics_filename = NULL,
+    .metrics_interval = SC_TICK_FROM_SEC(1),
+    .metrics_port = 0,
+    .trace_filename = NULL,
+    .stream_capture_prefix = NULL,
+    .stream_replay_prefix = NULL,
+    .stream_replay_fast = false,
+    .raw_video_header = false,
+    .thumbnail_filename = NULL,
+    .frame_sink_plugin_count = 0,
+    .thumbnail_format = SC_THUMBNAIL_FORMAT_AUTO,
+    .thumbnail_size = 320,
+    .thumbnail_interval = SC_TICK_FROM_SEC(1),
+    .screenshot_dir = NULL,
+    .screenshot_format = SC_THUMBNAIL_FORMAT_PNG,
 #ifdef HAVE_USB
     .otg = false,
+    .adb_usb = false,
 #endif
     .show_touches = false,
+    .match_refresh_rate = false,
     .fullscreen = false,
     .always_on_top = false,
     .control = true,
@@ -84,8 +138,34 @@ const struct scrcpy_options scrcpy_options_default = {
     .key_inject_mode = SC_KEY_INJECT_MODE_MIXED,
     .window_borderless = false,
     .mipmaps = true,
+    .yuv_shader = false,
+    .video_pacing = false,
+    .present_mode = SC_PRESENT_MODE_AUTO,
+    .latency_profile = SC_LATENCY_PROFILE_NONE,
+    .latency_budget = 0,
+    .video_buffer_packets = false,
+    .av_sync = false,
+    .video_decoder_skip_nonref = false,
+    .video_decoder_resilient = false,
+    .video_catch_up = false,
+    .video_skip_repeated_frames = false,
+    .print_latency = false,
+    .print_startup_timing = false,
+    .reconnect = false,
+    .print_audio_stats = false,
+    .benchmark_decode = false,
+    .benchmark_touch = 0,
+    .adaptive_bit_rate = false,
+    .adaptive_max_size = false,
+    .new_display_follow_window = false,
+    .background_max_fps = 0,
+    .cpu_budget = 0,
+    .power_saving = false,
+    .soak = false,
+    .has_alt_video_profile = false,
     .stay_awake = false,
     .force_adb_forward = false,
+    .auto_tunnel = false,
     .disable_screensaver = false,
     .forward_key_repeat = true,
     .legacy_paste = false,
@@ -104,11 +184,19 @@ const struct scrcpy_options scrcpy_options_default = {
     .require_audio = false,
     .kill_adb_on_close = false,
     .camera_high_speed = false,
+    .video_low_latency = false,
+    .video_intra_refresh = 0,
+    .video_bit_rate_mode = SC_VIDEO_BIT_RATE_MODE_DEFAULT,
+    .video_quality = -1,
+    .video_max_bit_rate = 0,
+    .input_pacing = 0,
+    .video_idle_timeout = 0,
     .list = 0,
     .window = true,
     .mouse_hover = true,
     .audio_dup = false,
     .new_display = NULL,
+    .extra_display_count = 0,
     .start_app = NULL,
     .angle = NULL,
     .vd_destroy_content = true,
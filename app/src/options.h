@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "util/thread.h"
 #include "util/tick.h"
 
 enum sc_log_level {
@@ -39,6 +40,20 @@ sc_record_format_is_audio_only(enum sc_record_format fmt) {
         || fmt == SC_RECORD_FORMAT_WAV;
 }
 
+enum sc_v4l2_format {
+    SC_V4L2_FORMAT_YUV420P,
+    SC_V4L2_FORMAT_NV12,
+    SC_V4L2_FORMAT_YUYV,
+    SC_V4L2_FORMAT_UYVY,
+};
+
+enum sc_thumbnail_format {
+    SC_THUMBNAIL_FORMAT_AUTO, // guessed from the file extension
+    SC_THUMBNAIL_FORMAT_JPEG,
+    SC_THUMBNAIL_FORMAT_PNG,
+    SC_THUMBNAIL_FORMAT_WEBP,
+};
+
 enum sc_codec {
     SC_CODEC_H264,
     SC_CODEC_H265,
@@ -47,8 +62,12 @@ enum sc_codec {
     SC_CODEC_AAC,
     SC_CODEC_FLAC,
     SC_CODEC_RAW,
+    SC_CODEC_AUTO, // only for video: negotiated with the device
 };
 
+// Number of video codecs (H.264, H.265 and AV1)
+#define SC_VIDEO_CODEC_COUNT 3
+
 enum sc_video_source {
     SC_VIDEO_SOURCE_DISPLAY,
     SC_VIDEO_SOURCE_CAMERA,
@@ -76,6 +95,29 @@ enum sc_camera_facing {
     SC_CAMERA_FACING_EXTERNAL,
 };
 
+enum sc_video_bit_rate_mode {
+    SC_VIDEO_BIT_RATE_MODE_DEFAULT, // the encoder default
+    SC_VIDEO_BIT_RATE_MODE_CBR,
+    SC_VIDEO_BIT_RATE_MODE_VBR,
+    SC_VIDEO_BIT_RATE_MODE_CQ,
+};
+
+enum sc_decoder_thread_type {
+    SC_DECODER_THREAD_TYPE_SLICE,
+    SC_DECODER_THREAD_TYPE_FRAME,
+};
+
+enum sc_hwaccel {
+    SC_HWACCEL_NONE,
+    SC_HWACCEL_AUTO,
+    SC_HWACCEL_VAAPI,
+    SC_HWACCEL_VDPAU,
+    SC_HWACCEL_D3D11VA,
+    SC_HWACCEL_DXVA2,
+    SC_HWACCEL_VIDEOTOOLBOX,
+    SC_HWACCEL_VULKAN,
+};
+
                               // ,----- hflip (applied before the rotation)
                               // | ,--- 180°
                               // | | ,- 90° clockwise
@@ -150,6 +192,39 @@ sc_orientation_get_name(enum sc_orientation orientation) {
     }
 }
 
+enum sc_present_mode {
+    SC_PRESENT_MODE_AUTO, // vsync with video pacing, immediate otherwise
+    SC_PRESENT_MODE_VSYNC,
+    SC_PRESENT_MODE_IMMEDIATE,
+    SC_PRESENT_MODE_ADAPTIVE, // vsync, unless the frame is late
+    SC_PRESENT_MODE_VRR, // vsync, frames paced on their own timestamps
+};
+
+static inline const char *
+sc_present_mode_get_name(enum sc_present_mode mode) {
+    switch (mode) {
+        case SC_PRESENT_MODE_AUTO:
+            return "auto";
+        case SC_PRESENT_MODE_VSYNC:
+            return "vsync";
+        case SC_PRESENT_MODE_IMMEDIATE:
+            return "immediate";
+        case SC_PRESENT_MODE_ADAPTIVE:
+            return "adaptive";
+        case SC_PRESENT_MODE_VRR:
+            return "vrr";
+        default:
+            return "(unknown)";
+    }
+}
+
+enum sc_latency_profile {
+    SC_LATENCY_PROFILE_NONE,
+    SC_LATENCY_PROFILE_ULTRA,
+    SC_LATENCY_PROFILE_BALANCED,
+    SC_LATENCY_PROFILE_QUALITY,
+};
+
 enum sc_keyboard_input_mode {
     SC_KEYBOARD_INPUT_MODE_AUTO,
     SC_KEYBOARD_INPUT_MODE_UHID_OR_AOA, // normal vs otg mode
@@ -225,12 +300,42 @@ struct sc_port_range {
     uint16_t last;
 };
 
+// Video settings which can be changed at runtime (0 keeps the initial value)
+struct sc_video_profile {
+    uint16_t max_size;
+    uint32_t bit_rate;
+    uint16_t max_fps;
+    struct {
+        uint16_t width; // 0 to keep the initial crop
+        uint16_t height;
+        uint16_t x;
+        uint16_t y;
+    } crop;
+};
+
+// Threads which can be pinned to CPUs or given a scheduling policy
+enum sc_thread_role {
+    SC_THREAD_ROLE_VIDEO, // video demuxer and decoder
+    SC_THREAD_ROLE_AUDIO, // audio demuxer and decoder
+    SC_THREAD_ROLE_AUDIO_CALLBACK, // audio output device callback
+    SC_THREAD_ROLE_CONTROLLER, // controller and device message receiver
+    SC_THREAD_ROLE_RECORDER,
+    SC_THREAD_ROLE_COUNT,
+};
+
 #define SC_WINDOW_POSITION_UNDEFINED (-0x8000)
 
+#define SC_MAX_FRAME_SINK_PLUGINS 8
+#define SC_MAX_EXTRA_DISPLAYS 4
+
+// Device TCP port of the server for --direct-tcp without argument
+#define SC_DIRECT_TCP_PORT_DEFAULT 27183
+
 struct scrcpy_options {
     const char *serial;
     const char *crop;
     const char *record_filename;
+    const char *replay_filename;
     const char *window_title;
     const char *push_target;
     const char *render_driver;
@@ -248,18 +353,26 @@ struct scrcpy_options {
     enum sc_video_source video_source;
     enum sc_audio_source audio_source;
     enum sc_record_format record_format;
+    enum sc_record_format replay_format;
     enum sc_keyboard_input_mode keyboard_input_mode;
     enum sc_mouse_input_mode mouse_input_mode;
     enum sc_gamepad_input_mode gamepad_input_mode;
+    uint16_t gamepad_report_rate; // 0 for unlimited
     struct sc_mouse_bindings mouse_bindings;
     enum sc_camera_facing camera_facing;
+    enum sc_hwaccel video_hwaccel;
+    enum sc_decoder_thread_type video_decoder_thread_type;
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    uint16_t direct_tcp_port; // 0 if disabled
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
     uint16_t max_size;
+    uint16_t video_decoder_threads; // 0 for automatic
     uint32_t video_bit_rate;
     uint32_t audio_bit_rate;
+    uint32_t video_socket_buffer_size; // 0 for the system default
+    uint32_t video_socket_busy_poll; // in microseconds, 0 to disable
     const char *max_fps; // float to be parsed by the server
     const char *angle; // float to be parsed by the server
     enum sc_orientation capture_orientation;
@@ -273,18 +386,64 @@ struct scrcpy_options {
     uint16_t window_height;
     uint32_t display_id;
     sc_tick video_buffer;
+    sc_tick video_buffer_max; // 0 if the video buffering is not adaptive
     sc_tick audio_buffer;
+    sc_tick audio_buffer_max; // 0 if the audio buffering is not adaptive
     sc_tick audio_output_buffer;
+    uint16_t audio_volume; // in percent
     sc_tick time_limit;
     sc_tick screen_off_timeout;
+    sc_tick record_segment_duration; // 0 for no duration limit
+    uint32_t record_segment_size; // in bytes, 0 for no size limit
+    unsigned record_segment_count; // 0 to keep all segments
+    uint32_t record_memory_limit; // in bytes
+    sc_tick record_fragment_duration; // 0 for no fragmentation
+    bool record_index;
+    bool record_sync;
+    bool record_on_demand;
+    bool record_stream;
+    uint32_t record_video_bit_rate;
+    uint16_t record_max_size;
+    bool record_transcode;
+    enum sc_codec record_transcode_codec;
+    uint8_t record_transcode_quality; // from 0 (best) to 51 (worst)
+    const char *record_upload_url;
+    bool record_upload_only;
+    sc_tick replay_buffer; // 0 if the instant replay is disabled
 #ifdef HAVE_V4L2
     const char *v4l2_device;
     sc_tick v4l2_buffer;
+    enum sc_v4l2_format v4l2_format;
+    uint16_t v4l2_fps;
 #endif
+    const char *shm_name;
+    const char *restream_url;
+    const char *raw_video_filename;
+    const char *input_record_filename;
+    const char *input_replay_filename;
+    uint16_t automation_port; // 0 if disabled
+    const char *metrics_filename; // "-" for stdout
+    sc_tick metrics_interval;
+    uint16_t metrics_port; // 0 if disabled
+    const char *trace_filename;
+    const char *stream_capture_prefix;
+    const char *stream_replay_prefix; // replay mode (no device) if set
+    bool stream_replay_fast;
+    bool raw_video_header;
+    const char *thumbnail_filename;
+    const char *frame_sink_plugins[SC_MAX_FRAME_SINK_PLUGINS];
+    unsigned frame_sink_plugin_count;
+    enum sc_thumbnail_format thumbnail_format;
+    uint16_t thumbnail_size;
+    sc_tick thumbnail_interval;
+    const char *screenshot_dir; // NULL for the current directory
+    enum sc_thumbnail_format screenshot_format;
 #ifdef HAVE_USB
     bool otg;
+    bool adb_usb;
 #endif
     bool show_touches;
+    bool match_refresh_rate;
     bool fullscreen;
     bool always_on_top;
     bool control;
@@ -294,8 +453,38 @@ struct scrcpy_options {
     enum sc_key_inject_mode key_inject_mode;
     bool window_borderless;
     bool mipmaps;
+    bool yuv_shader;
+    bool video_pacing;
+    enum sc_present_mode present_mode;
+    enum sc_latency_profile latency_profile;
+    // Expected p95 latency from reception to presentation (0 if none)
+    sc_tick latency_budget;
+    bool video_buffer_packets;
+    bool av_sync;
+    bool video_decoder_skip_nonref;
+    bool video_decoder_resilient;
+    bool video_catch_up;
+    bool video_skip_repeated_frames;
+    bool print_latency;
+    bool print_startup_timing;
+    bool reconnect;
+    bool print_audio_stats;
+    bool benchmark_decode;
+    uint16_t benchmark_touch; // number of trials, 0 to disable
+    bool adaptive_bit_rate;
+    bool adaptive_max_size;
+    bool new_display_follow_window;
+    uint16_t background_max_fps; // 0 to disable
+    uint16_t cpu_budget; // in percent of one CPU core, 0 to disable
+    bool power_saving;
+    bool soak;
+    bool has_alt_video_profile;
+    struct sc_video_profile alt_video_profile; // if has_alt_video_profile
+    // indexed by enum sc_thread_role (zero-initialized: unchanged)
+    struct sc_thread_sched thread_sched[SC_THREAD_ROLE_COUNT];
     bool stay_awake;
     bool force_adb_forward;
+    bool auto_tunnel;
     bool disable_screensaver;
     bool forward_key_repeat;
     bool legacy_paste;
@@ -314,6 +503,13 @@ struct scrcpy_options {
     bool require_audio;
     bool kill_adb_on_close;
     bool camera_high_speed;
+    bool video_low_latency;
+    uint16_t video_intra_refresh; // in frames, 0 to disable
+    enum sc_video_bit_rate_mode video_bit_rate_mode;
+    int8_t video_quality; // -1 for the encoder default
+    uint32_t video_max_bit_rate; // 0 for no peak
+    uint16_t input_pacing; // in milliseconds, 0 to disable
+    sc_tick video_idle_timeout; // 0 to disable
 #define SC_OPTION_LIST_ENCODERS 0x1
 #define SC_OPTION_LIST_DISPLAYS 0x2
 #define SC_OPTION_LIST_CAMERAS 0x4
@@ -324,6 +520,10 @@ struct scrcpy_options {
     bool mouse_hover;
     bool audio_dup;
     const char *new_display; // [<width>x<height>][/<dpi>] parsed by the server
+    // <display_id> or new[:[<width>x<height>][/<dpi>]], streamed in separate
+    // view-only windows
+    const char *extra_displays[SC_MAX_EXTRA_DISPLAYS];
+    unsigned extra_display_count;
     const char *start_app;
     bool vd_destroy_content;
     bool vd_system_decorations;
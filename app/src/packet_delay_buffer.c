@@ -0,0 +1,221 @@
+#include "packet_delay_buffer.h"
+
+#include <assert.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_packet_delay_buffer */
+#define DOWNCAST(SINK) \
+    container_of(SINK, struct sc_packet_delay_buffer, packet_sink)
+
+// Must be called with the mutex locked
+static sc_tick
+sc_packet_delay_buffer_get_deadline(struct sc_packet_delay_buffer *pdb,
+                                    const struct sc_delayed_packet *dpacket) {
+    sc_mutex_assert(&pdb->mutex);
+
+    if (dpacket->asap) {
+        return pdb->head_date;
+    }
+
+    // PTS (written by the server) are expressed in microseconds
+    sc_tick pts = SC_TICK_FROM_US(dpacket->packet->pts);
+    sc_tick deadline = sc_clock_to_system_time(&pdb->clock, pts) + pdb->delay;
+    return MIN(deadline, pdb->head_date + pdb->delay);
+}
+
+// Called from the timer service thread
+static sc_tick
+sc_packet_delay_buffer_on_timer(struct sc_timer *timer, sc_tick now,
+                                void *userdata) {
+    (void) timer;
+    struct sc_packet_delay_buffer *pdb = userdata;
+
+    sc_mutex_lock(&pdb->mutex);
+
+    while (!pdb->stopped && !sc_vecdeque_is_empty(&pdb->queue)) {
+        struct sc_delayed_packet *head = sc_vecdeque_at(&pdb->queue, 0);
+        sc_tick deadline = sc_packet_delay_buffer_get_deadline(pdb, head);
+        if (deadline > now) {
+            sc_mutex_unlock(&pdb->mutex);
+            return deadline;
+        }
+
+        struct sc_delayed_packet dpacket = sc_vecdeque_pop(&pdb->queue);
+        pdb->head_date = now;
+        sc_mutex_unlock(&pdb->mutex);
+
+        bool ok = sc_packet_source_sinks_push(&pdb->packet_source,
+                                              dpacket.packet);
+        av_packet_free(&dpacket.packet);
+
+        sc_mutex_lock(&pdb->mutex);
+        if (!ok) {
+            LOGE("Delayed packet could not be pushed, stopping");
+            // Prevent to push any new packet
+            pdb->stopped = true;
+        }
+
+        // Pushing the packet may take some time
+        now = sc_tick_now();
+    }
+
+    sc_mutex_unlock(&pdb->mutex);
+
+    return SC_TIMER_NEVER;
+}
+
+static bool
+sc_packet_delay_buffer_packet_sink_open(struct sc_packet_sink *sink,
+                                        AVCodecContext *ctx) {
+    struct sc_packet_delay_buffer *pdb = DOWNCAST(sink);
+
+    bool ok = sc_mutex_init(&pdb->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    sc_clock_init(&pdb->clock);
+    sc_vecdeque_init(&pdb->queue);
+    pdb->head_date = 0;
+    pdb->stopped = false;
+
+    if (!sc_packet_source_sinks_open(&pdb->packet_source, ctx)) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_timer_service_add(pdb->timer_service, &pdb->timer,
+                              sc_packet_delay_buffer_on_timer, pdb);
+    if (!ok) {
+        goto error_close_sinks;
+    }
+
+    return true;
+
+error_close_sinks:
+    sc_packet_source_sinks_close(&pdb->packet_source);
+error_destroy_mutex:
+    sc_mutex_destroy(&pdb->mutex);
+
+    return false;
+}
+
+static void
+sc_packet_delay_buffer_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_packet_delay_buffer *pdb = DOWNCAST(sink);
+
+    sc_mutex_lock(&pdb->mutex);
+    pdb->stopped = true;
+    sc_mutex_unlock(&pdb->mutex);
+
+    // Wait for the timer callback to return, if it is running
+    sc_timer_service_remove(pdb->timer_service, &pdb->timer);
+
+    sc_packet_source_sinks_close(&pdb->packet_source);
+
+    // Flush queue
+    while (!sc_vecdeque_is_empty(&pdb->queue)) {
+        struct sc_delayed_packet *dpacket = sc_vecdeque_popref(&pdb->queue);
+        av_packet_free(&dpacket->packet);
+    }
+    sc_vecdeque_destroy(&pdb->queue);
+
+    sc_mutex_destroy(&pdb->mutex);
+}
+
+static bool
+sc_packet_delay_buffer_packet_sink_push(struct sc_packet_sink *sink,
+                                        const AVPacket *packet) {
+    struct sc_packet_delay_buffer *pdb = DOWNCAST(sink);
+
+    AVPacket *p = av_packet_clone(packet);
+    if (!p) {
+        LOG_OOM();
+        return false;
+    }
+
+    sc_mutex_lock(&pdb->mutex);
+
+    if (pdb->stopped) {
+        sc_mutex_unlock(&pdb->mutex);
+        av_packet_free(&p);
+        return false;
+    }
+
+    sc_tick now = sc_tick_now();
+
+    // Even if they could be forwarded immediately, the packets are always
+    // forwarded from the timer thread, so that the sinks are never called
+    // concurrently
+    struct sc_delayed_packet dpacket = {
+        .packet = p,
+    };
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packet
+        dpacket.asap = true;
+    } else {
+        sc_tick pts = SC_TICK_FROM_US(packet->pts);
+        sc_clock_update(&pdb->clock, now, pts);
+        // Do not delay the first frame
+        dpacket.asap = pdb->clock.range == 1;
+    }
+
+    bool was_empty = sc_vecdeque_is_empty(&pdb->queue);
+    bool ok = sc_vecdeque_push(&pdb->queue, dpacket);
+    if (!ok) {
+        sc_mutex_unlock(&pdb->mutex);
+        LOG_OOM();
+        av_packet_free(&p);
+        return false;
+    }
+
+    if (was_empty) {
+        pdb->head_date = now;
+    }
+
+    sc_mutex_unlock(&pdb->mutex);
+
+    // The clock has been updated, so the deadline of the head packet must be
+    // computed again
+    sc_timer_service_schedule(pdb->timer_service, &pdb->timer, now);
+
+    return true;
+}
+
+static void
+sc_packet_delay_buffer_packet_sink_disable(struct sc_packet_sink *sink) {
+    struct sc_packet_delay_buffer *pdb = DOWNCAST(sink);
+    sc_packet_source_sinks_disable(&pdb->packet_source);
+}
+
+bool
+sc_packet_delay_buffer_init(struct sc_packet_delay_buffer *pdb,
+                            struct sc_timer_service *timer_service,
+                            sc_tick delay) {
+    assert(delay > 0);
+
+    if (!sc_packet_source_init(&pdb->packet_source)) {
+        return false;
+    }
+
+    pdb->timer_service = timer_service;
+    pdb->delay = delay;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_packet_delay_buffer_packet_sink_open,
+        .close = sc_packet_delay_buffer_packet_sink_close,
+        .push = sc_packet_delay_buffer_packet_sink_push,
+        .disable = sc_packet_delay_buffer_packet_sink_disable,
+    };
+
+    pdb->packet_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_packet_delay_buffer_destroy(struct sc_packet_delay_buffer *pdb) {
+    sc_packet_source_destroy(&pdb->packet_source);
+}
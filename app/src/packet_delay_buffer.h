@@ -0,0 +1,64 @@
+#ifndef SC_PACKET_DELAY_BUFFER_H
+#define SC_PACKET_DELAY_BUFFER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/packet.h>
+
+#include "clock.h"
+#include "timer_service.h"
+#include "trait/packet_sink.h"
+#include "trait/packet_source.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+struct sc_delayed_packet {
+    AVPacket *packet;
+    bool asap; // forward as soon as possible (config packets, first packet)
+};
+
+struct sc_delayed_packet_queue SC_VECDEQUE(struct sc_delayed_packet);
+
+/**
+ * A packet delay buffer delays the encoded packets before they are decoded.
+ *
+ * For the same delay, it holds far less memory than a delay buffer of decoded
+ * frames. The packets are forwarded from the timer service thread, just in
+ * time, so its sinks must only hand them over (a decoder must be behind a
+ * packet queue).
+ */
+struct sc_packet_delay_buffer {
+    struct sc_packet_source packet_source; // packet source trait
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    sc_tick delay;
+
+    struct sc_timer_service *timer_service;
+    struct sc_timer timer;
+
+    sc_mutex mutex;
+
+    struct sc_clock clock;
+    struct sc_delayed_packet_queue queue;
+    // The date the packet at the head of the queue became the head
+    sc_tick head_date;
+    bool stopped;
+};
+
+/**
+ * Initialize a packet delay buffer.
+ *
+ * \param timer_service the service forwarding the delayed packets
+ * \param delay a (strictly) positive delay
+ */
+bool
+sc_packet_delay_buffer_init(struct sc_packet_delay_buffer *pdb,
+                            struct sc_timer_service *timer_service,
+                            sc_tick delay);
+
+void
+sc_packet_delay_buffer_destroy(struct sc_packet_delay_buffer *pdb);
+
+#endif
@@ -3,12 +3,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <libavutil/avutil.h>
+#include <libavutil/buffer.h>
 
 #include "util/log.h"
 
 void
 sc_packet_merger_init(struct sc_packet_merger *merger) {
     merger->config = NULL;
+    merger->repeat = false;
 }
 
 void
@@ -16,6 +18,23 @@ sc_packet_merger_destroy(struct sc_packet_merger *merger) {
     free(merger->config);
 }
 
+void
+sc_packet_merger_set_repeat(struct sc_packet_merger *merger) {
+    merger->repeat = true;
+}
+
+size_t
+sc_packet_merger_get_headroom(const struct sc_packet_merger *merger) {
+    return merger->config ? merger->config_size : 0;
+}
+
+static inline bool
+sc_packet_merger_starts_with_config(struct sc_packet_merger *merger,
+                                    const AVPacket *packet) {
+    return (size_t) packet->size >= merger->config_size
+        && !memcmp(packet->data, merger->config, merger->config_size);
+}
+
 bool
 sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet) {
     bool is_config = packet->pts == AV_NOPTS_VALUE;
@@ -32,20 +51,38 @@ sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet) {
         memcpy(merger->config, packet->data, packet->size);
         merger->config_size = packet->size;
     } else if (merger->config) {
+        if (merger->repeat && (!(packet->flags & AV_PKT_FLAG_KEY)
+                || sc_packet_merger_starts_with_config(merger, packet))) {
+            // Nothing to prepend
+            return true;
+        }
+
         size_t config_size = merger->config_size;
-        size_t media_size = packet->size;
 
-        if (av_grow_packet(packet, config_size)) {
-            LOG_OOM();
-            return false;
+        if (packet->buf && av_buffer_is_writable(packet->buf)
+                && (size_t) (packet->data - packet->buf->data)
+                        >= config_size) {
+            // Enough headroom has been reserved, the media data is not moved
+            packet->data -= config_size;
+            packet->size += config_size;
+        } else {
+            size_t media_size = packet->size;
+
+            if (av_grow_packet(packet, config_size)) {
+                LOG_OOM();
+                return false;
+            }
+
+            memmove(packet->data + config_size, packet->data, media_size);
         }
 
-        memmove(packet->data + config_size, packet->data, media_size);
         memcpy(packet->data, merger->config, config_size);
 
-        free(merger->config);
-        merger->config = NULL;
-        // merger->size is meaningless when merger->config is NULL
+        if (!merger->repeat) {
+            free(merger->config);
+            merger->config = NULL;
+            // merger->size is meaningless when merger->config is NULL
+        }
     }
 
     return true;
@@ -4,6 +4,7 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <libavcodec/packet.h>
 
@@ -18,11 +19,20 @@
  *
  * This helper reads every input packet and modifies each media packet which
  * immediately follows a config packet to prepend the config packet payload.
+ *
+ * To avoid copying the media packet, the packet source may reserve some
+ * headroom before the packet data (see sc_packet_merger_get_headroom()): the
+ * config packet payload is then written in place, in front of the media data.
+ *
+ * In "repeat" mode, the config packet is kept and prepended to every keyframe,
+ * so that a consumer may start decoding at any keyframe (for example a remote
+ * viewer joining a live stream).
  */
 
 struct sc_packet_merger {
     uint8_t *config;
     size_t config_size;
+    bool repeat;
 };
 
 void
@@ -31,6 +41,20 @@ sc_packet_merger_init(struct sc_packet_merger *merger);
 void
 sc_packet_merger_destroy(struct sc_packet_merger *merger);
 
+/**
+ * Prepend the last config packet to every keyframe which does not already
+ * start with it (instead of only the media packet following it).
+ */
+void
+sc_packet_merger_set_repeat(struct sc_packet_merger *merger);
+
+/**
+ * Return the number of bytes to reserve before the data of the next media
+ * packet, so that the pending config packet (if any) may be prepended in place.
+ */
+size_t
+sc_packet_merger_get_headroom(const struct sc_packet_merger *merger);
+
 /**
  * If the packet is a config packet, then keep its data for later.
  * Otherwise (if the packet is a media packet), then if a config packet is
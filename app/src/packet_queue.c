@@ -0,0 +1,227 @@
+#include "packet_queue.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_packet_queue */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_packet_queue, packet_sink)
+
+// Room for the config packets, which are never dropped
+#define SC_PACKET_QUEUE_EXTRA_CAPACITY 4
+
+static bool
+sc_packet_queue_is_ready(void *userdata) {
+    struct sc_packet_queue *pq = userdata;
+    return atomic_load_explicit(&pq->stopped, memory_order_relaxed)
+        || !sc_spsc_ring_is_empty(&pq->queue);
+}
+
+static int
+run_packet_queue(void *data) {
+    struct sc_packet_queue *pq = data;
+
+    for (;;) {
+        sc_notifier_wait(&pq->notifier, sc_packet_queue_is_ready, pq);
+
+        if (atomic_load_explicit(&pq->stopped, memory_order_relaxed)) {
+            break;
+        }
+
+        AVPacket *packet;
+        bool ok = sc_spsc_ring_pop(&pq->queue, &packet);
+        assert(ok);
+
+        ok = sc_packet_source_sinks_push(&pq->packet_source, packet);
+        av_packet_free(&packet);
+        if (!ok) {
+            LOGE("Packet queue '%s': packet could not be pushed, stopping",
+                 pq->name);
+            // Prevent to push any new packet
+            atomic_store_explicit(&pq->stopped, true, memory_order_relaxed);
+            break;
+        }
+    }
+
+    LOGD("Packet queue '%s': thread ended", pq->name);
+
+    return 0;
+}
+
+static void
+sc_packet_queue_flush(struct sc_packet_queue *pq) {
+    AVPacket *packet;
+    while (sc_spsc_ring_pop(&pq->queue, &packet)) {
+        av_packet_free(&packet);
+    }
+}
+
+static bool
+sc_packet_queue_packet_sink_open(struct sc_packet_sink *sink,
+                                 AVCodecContext *ctx) {
+    struct sc_packet_queue *pq = DOWNCAST(sink);
+
+    bool ok = sc_notifier_init(&pq->notifier);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_spsc_ring_init(&pq->queue,
+                           pq->capacity + SC_PACKET_QUEUE_EXTRA_CAPACITY);
+    if (!ok) {
+        LOG_OOM();
+        goto error_destroy_notifier;
+    }
+
+    pq->video = ctx->codec_type == AVMEDIA_TYPE_VIDEO;
+    pq->dropping = false;
+    atomic_init(&pq->stopped, false);
+    pq->dropped = 0;
+
+    if (!sc_packet_source_sinks_open(&pq->packet_source, ctx)) {
+        goto error_destroy_queue;
+    }
+
+    ok = sc_thread_create(&pq->thread, run_packet_queue, "scrcpy-pktq", pq);
+    if (!ok) {
+        LOGE("Packet queue '%s': could not start thread", pq->name);
+        goto error_close_sinks;
+    }
+
+    return true;
+
+error_close_sinks:
+    sc_packet_source_sinks_close(&pq->packet_source);
+error_destroy_queue:
+    sc_spsc_ring_destroy(&pq->queue);
+error_destroy_notifier:
+    sc_notifier_destroy(&pq->notifier);
+
+    return false;
+}
+
+static void
+sc_packet_queue_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_packet_queue *pq = DOWNCAST(sink);
+
+    atomic_store_explicit(&pq->stopped, true, memory_order_relaxed);
+    sc_notifier_notify(&pq->notifier);
+
+    sc_thread_join(&pq->thread, NULL);
+
+    sc_packet_source_sinks_close(&pq->packet_source);
+
+    if (pq->dropped) {
+        LOGW("Packet queue '%s': %" PRIu64 " packets dropped", pq->name,
+             pq->dropped);
+    }
+
+    // The queue thread is joined, the remaining packets can be popped from
+    // this thread
+    sc_packet_queue_flush(pq);
+    sc_spsc_ring_destroy(&pq->queue);
+    sc_notifier_destroy(&pq->notifier);
+}
+
+// Called from the demuxer thread
+static bool
+sc_packet_queue_must_drop(struct sc_packet_queue *pq, const AVPacket *packet) {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packets are never dropped
+        return false;
+    }
+
+    bool full = sc_spsc_ring_size(&pq->queue) >= pq->capacity;
+    if (pq->dropping) {
+        bool resumable = !pq->video || packet->flags & AV_PKT_FLAG_KEY;
+        if (full || !resumable) {
+            return true;
+        }
+
+        pq->dropping = false;
+        LOGI("Packet queue '%s': resumed", pq->name);
+        return false;
+    }
+
+    if (full) {
+        LOGW("Packet queue '%s': sink too slow, dropping packets%s", pq->name,
+             pq->video ? " until the next keyframe" : "");
+        // Audio packets are dropped individually, so that a slow sink does not
+        // lose more than necessary
+        pq->dropping = pq->video;
+        return true;
+    }
+
+    return false;
+}
+
+static bool
+sc_packet_queue_packet_sink_push(struct sc_packet_sink *sink,
+                                 const AVPacket *packet) {
+    struct sc_packet_queue *pq = DOWNCAST(sink);
+
+    if (atomic_load_explicit(&pq->stopped, memory_order_relaxed)) {
+        return false;
+    }
+
+    if (sc_packet_queue_must_drop(pq, packet)) {
+        ++pq->dropped;
+        return true;
+    }
+
+    AVPacket *p = av_packet_clone(packet);
+    if (!p) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_spsc_ring_push(&pq->queue, p);
+    if (!ok) {
+        // Only possible if many config packets are pending
+        LOGW("Packet queue '%s': queue full, packet dropped", pq->name);
+        av_packet_free(&p);
+        ++pq->dropped;
+        return true;
+    }
+
+    sc_notifier_notify(&pq->notifier);
+
+    return true;
+}
+
+static void
+sc_packet_queue_packet_sink_disable(struct sc_packet_sink *sink) {
+    struct sc_packet_queue *pq = DOWNCAST(sink);
+    sc_packet_source_sinks_disable(&pq->packet_source);
+}
+
+bool
+sc_packet_queue_init(struct sc_packet_queue *pq, const char *name,
+                     size_t capacity) {
+    assert(capacity > 0 && capacity <= UINT32_MAX / 2);
+
+    if (!sc_packet_source_init(&pq->packet_source)) {
+        return false;
+    }
+
+    pq->name = name; // statically allocated
+    pq->capacity = capacity;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_packet_queue_packet_sink_open,
+        .close = sc_packet_queue_packet_sink_close,
+        .push = sc_packet_queue_packet_sink_push,
+        .disable = sc_packet_queue_packet_sink_disable,
+    };
+
+    pq->packet_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_packet_queue_destroy(struct sc_packet_queue *pq) {
+    sc_packet_source_destroy(&pq->packet_source);
+}
@@ -0,0 +1,60 @@
+#ifndef SC_PACKET_QUEUE_H
+#define SC_PACKET_QUEUE_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/packet.h>
+
+#include "trait/packet_sink.h"
+#include "trait/packet_source.h"
+#include "util/notifier.h"
+#include "util/spsc_ring.h"
+#include "util/thread.h"
+
+/**
+ * A packet queue forwards the packets to its sinks from a separate thread, so
+ * that a slow sink never delays the other sinks of the same source (the
+ * packet source pushes to its sinks sequentially).
+ *
+ * The queue is bounded: when it is full, the video packets are dropped until
+ * the next keyframe (a packet cannot be decoded without the previous packets
+ * of its GOP), and the audio packets are dropped individually. The config
+ * packets are never dropped.
+ */
+struct sc_packet_queue {
+    struct sc_packet_source packet_source; // packet source trait
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    const char *name; // must be statically allocated
+    size_t capacity; // in packets
+
+    sc_thread thread;
+    struct sc_notifier notifier;
+
+    // Written by the demuxer thread, read by the queue thread
+    struct SC_SPSC_RING(AVPacket *) queue;
+    bool video;
+    atomic_bool stopped;
+    // Only accessed by the demuxer thread (until the queue thread is joined)
+    bool dropping;
+    uint64_t dropped;
+};
+
+/**
+ * Initialize a packet queue.
+ *
+ * \param name the name of the queue (for logs), statically allocated
+ * \param capacity the maximum number of pending packets (strictly positive)
+ */
+bool
+sc_packet_queue_init(struct sc_packet_queue *pq, const char *name,
+                     size_t capacity);
+
+void
+sc_packet_queue_destroy(struct sc_packet_queue *pq);
+
+#endif
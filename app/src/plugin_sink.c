@@ -0,0 +1,203 @@
+#include "plugin_sink.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_loadso.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_plugin_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_plugin_sink, frame_sink)
+
+static const AVFrame *
+sc_plugin_sink_convert(struct sc_plugin_sink *ps, const AVFrame *frame) {
+    if (frame->format == AV_PIX_FMT_YUV420P
+            || frame->format == AV_PIX_FMT_YUVJ420P
+            || frame->format == AV_PIX_FMT_NV12) {
+        // Passed as is
+        return frame;
+    }
+
+    // The previous converted frame returns to the pool
+    AVFrame *converted = ps->converted;
+    av_frame_unref(converted);
+    converted->format = AV_PIX_FMT_YUV420P;
+    converted->width = frame->width;
+    converted->height = frame->height;
+
+    bool ok = sc_frame_converter_convert_frame(&ps->converter, frame,
+                                               converted, SWS_POINT);
+    if (!ok) {
+        LOGE("Plugin '%s': could not convert the pixel format",
+             ps->plugin->name);
+        return NULL;
+    }
+
+    return converted;
+}
+
+static enum scrcpy_plugin_color_range
+sc_plugin_sink_get_color_range(const AVFrame *frame) {
+    // YUVJ420P is YUV420P in full range, passed as is. The conversion of the
+    // other formats to YUV420P keeps the range of the values.
+    bool full_range = frame->color_range == AVCOL_RANGE_JPEG
+                   || frame->format == AV_PIX_FMT_YUVJ420P;
+    return full_range ? SCRCPY_PLUGIN_COLOR_RANGE_FULL
+                      : SCRCPY_PLUGIN_COLOR_RANGE_LIMITED;
+}
+
+static bool
+sc_plugin_sink_frame_sink_open(struct sc_frame_sink *sink,
+                               const AVCodecContext *ctx) {
+    struct sc_plugin_sink *ps = DOWNCAST(sink);
+
+    ps->converted = av_frame_alloc();
+    if (!ps->converted) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_frame_converter_init(&ps->converter)) {
+        av_frame_free(&ps->converted);
+        return false;
+    }
+
+    ps->userdata = NULL;
+    ps->failed = false;
+
+    struct scrcpy_plugin_video_info info = {
+        .codec = avcodec_get_name(ctx->codec_id),
+        .width = ctx->width,
+        .height = ctx->height,
+    };
+
+    ps->opened = ps->plugin->open(&ps->userdata, &info);
+    if (!ps->opened) {
+        // Do not stop the mirroring
+        LOGW("Plugin '%s': could not open, disabled", ps->plugin->name);
+        ps->failed = true;
+    }
+
+    return true;
+}
+
+static void
+sc_plugin_sink_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_plugin_sink *ps = DOWNCAST(sink);
+
+    // close() is called even if push() failed, but not if open() failed
+    if (ps->opened) {
+        ps->plugin->close(ps->userdata);
+    }
+
+    av_frame_free(&ps->converted);
+    sc_frame_converter_destroy(&ps->converter);
+}
+
+static bool
+sc_plugin_sink_frame_sink_push(struct sc_frame_sink *sink,
+                               const AVFrame *frame) {
+    struct sc_plugin_sink *ps = DOWNCAST(sink);
+
+    if (ps->failed) {
+        return true;
+    }
+
+    const AVFrame *f = sc_plugin_sink_convert(ps, frame);
+    if (!f) {
+        ps->failed = true;
+        return true;
+    }
+
+    bool nv12 = f->format == AV_PIX_FMT_NV12;
+    struct scrcpy_plugin_frame pf = {
+        .pts = f->pts,
+        .width = f->width,
+        .height = f->height,
+        .format = nv12 ? SCRCPY_PLUGIN_PIXEL_FORMAT_NV12
+                       : SCRCPY_PLUGIN_PIXEL_FORMAT_YUV420P,
+        // From the source frame, the converted frame does not carry it
+        .color_range = sc_plugin_sink_get_color_range(frame),
+        .plane_count = nv12 ? 2 : 3,
+    };
+    for (unsigned i = 0; i < pf.plane_count; ++i) {
+        pf.data[i] = f->data[i];
+        pf.linesize[i] = f->linesize[i];
+    }
+
+    if (!ps->plugin->push(ps->userdata, &pf)) {
+        LOGW("Plugin '%s': frame rejected, disabled", ps->plugin->name);
+        ps->failed = true;
+    }
+
+    return true;
+}
+
+bool
+sc_plugin_sink_init(struct sc_plugin_sink *ps, const char *path) {
+    ps->path = strdup(path);
+    if (!ps->path) {
+        LOG_OOM();
+        return false;
+    }
+
+    ps->library = SDL_LoadObject(path);
+    if (!ps->library) {
+        LOGE("Could not load plugin %s: %s", path, SDL_GetError());
+        goto error_free_path;
+    }
+
+    scrcpy_frame_sink_plugin_fn fn = (scrcpy_frame_sink_plugin_fn)
+        SDL_LoadFunction(ps->library, SCRCPY_FRAME_SINK_PLUGIN_ENTRY);
+    if (!fn) {
+        LOGE("Plugin %s does not export " SCRCPY_FRAME_SINK_PLUGIN_ENTRY "()",
+             path);
+        goto error_unload;
+    }
+
+    ps->plugin = fn();
+    if (!ps->plugin) {
+        LOGE("Plugin %s: no plugin definition", path);
+        goto error_unload;
+    }
+
+    if (ps->plugin->abi_version != SCRCPY_FRAME_SINK_PLUGIN_ABI_VERSION) {
+        LOGE("Plugin %s: unsupported ABI version %" PRIu32 " (expected %d)",
+             path, ps->plugin->abi_version,
+             SCRCPY_FRAME_SINK_PLUGIN_ABI_VERSION);
+        goto error_unload;
+    }
+
+    if (!ps->plugin->name || !ps->plugin->open || !ps->plugin->close
+            || !ps->plugin->push) {
+        LOGE("Plugin %s: incomplete plugin definition", path);
+        goto error_unload;
+    }
+
+    LOGI("Plugin '%s' loaded from %s", ps->plugin->name, path);
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_plugin_sink_frame_sink_open,
+        .close = sc_plugin_sink_frame_sink_close,
+        .push = sc_plugin_sink_frame_sink_push,
+    };
+
+    ps->frame_sink.ops = &ops;
+
+    return true;
+
+error_unload:
+    SDL_UnloadObject(ps->library);
+error_free_path:
+    free(ps->path);
+
+    return false;
+}
+
+void
+sc_plugin_sink_destroy(struct sc_plugin_sink *ps) {
+    SDL_UnloadObject(ps->library);
+    free(ps->path);
+}
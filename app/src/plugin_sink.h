@@ -0,0 +1,44 @@
+#ifndef SC_PLUGIN_SINK_H
+#define SC_PLUGIN_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_converter.h"
+#include "frame_sink_plugin.h"
+#include "trait/frame_sink.h"
+
+/**
+ * Frame sink forwarding the decoded frames to a plugin loaded at runtime from
+ * a shared library (see frame_sink_plugin.h for the ABI)
+ *
+ * The plugin is called synchronously, so it is expected to be fed by a frame
+ * queue running on its own thread.
+ */
+struct sc_plugin_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    char *path;
+    void *library; // handle returned by SDL_LoadObject()
+    const struct scrcpy_frame_sink_plugin *plugin;
+    void *userdata; // plugin state
+    bool opened; // the plugin open() succeeded
+
+    // Only used to convert the frames in other formats than YUV420P or NV12
+    struct sc_frame_converter converter;
+    AVFrame *converted;
+
+    // Set if the plugin reported an error, it is not called anymore (except
+    // close())
+    bool failed;
+};
+
+bool
+sc_plugin_sink_init(struct sc_plugin_sink *ps, const char *path);
+
+void
+sc_plugin_sink_destroy(struct sc_plugin_sink *ps);
+
+#endif
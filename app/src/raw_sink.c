@@ -0,0 +1,211 @@
+#include "raw_sink.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <signal.h>
+#endif
+
+#include "demuxer.h"
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_raw_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_raw_sink, packet_sink)
+
+static bool
+sc_raw_sink_open_file(struct sc_raw_sink *rs) {
+#ifndef _WIN32
+    // Called from the packet queue thread: block SIGPIPE in this thread, so
+    // that a closed pipe makes the write fail instead of killing scrcpy
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+
+    rs->file = sc_file_open(rs->filename, "wb");
+    if (!rs->file) {
+        LOGE("Raw video: could not open %s", rs->filename);
+        return false;
+    }
+
+    // Each packet is written at once, there is nothing to buffer
+    setvbuf(rs->file, NULL, _IONBF, 0);
+
+    LOGI("Raw video: writing to %s", rs->filename);
+    return true;
+}
+
+static bool
+sc_raw_sink_reserve(struct sc_raw_sink *rs, size_t size) {
+    if (size <= rs->buf_size) {
+        return true;
+    }
+
+    uint8_t *buf = realloc(rs->buf, size);
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    rs->buf = buf;
+    rs->buf_size = size;
+    return true;
+}
+
+static bool
+sc_raw_sink_write(struct sc_raw_sink *rs, const AVPacket *packet) {
+    if (!rs->header) {
+        size_t w = fwrite(packet->data, 1, packet->size, rs->file);
+        return w == (size_t) packet->size;
+    }
+
+    size_t size = SC_PACKET_HEADER_SIZE + packet->size;
+    if (!sc_raw_sink_reserve(rs, size)) {
+        return false;
+    }
+
+    uint64_t pts_flags = packet->pts & SC_PACKET_PTS_MASK;
+    if (packet->flags & AV_PKT_FLAG_KEY) {
+        pts_flags |= SC_PACKET_FLAG_KEY_FRAME;
+    }
+
+    sc_write64be(rs->buf, pts_flags);
+    sc_write32be(&rs->buf[8], packet->size);
+    memcpy(&rs->buf[SC_PACKET_HEADER_SIZE], packet->data, packet->size);
+
+    size_t w = fwrite(rs->buf, 1, size, rs->file);
+    return w == size;
+}
+
+static bool
+sc_raw_sink_push(struct sc_raw_sink *rs, const AVPacket *packet) {
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+
+    if (!is_config && !rs->keyframe_received) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            // The packets before the first keyframe could not be decoded
+            return true;
+        }
+        rs->keyframe_received = true;
+    }
+
+    if (rs->merge_config) {
+        if (av_packet_ref(rs->packet, packet)) {
+            LOG_OOM();
+            return false;
+        }
+
+        // Keep the config packet and prepend it to the keyframes
+        bool ok = sc_packet_merger_merge(&rs->merger, rs->packet);
+        if (!ok) {
+            av_packet_unref(rs->packet);
+            return false;
+        }
+
+        packet = rs->packet;
+    }
+
+    if (is_config) {
+        // Config packets are not written alone: for H.26x, they are merged
+        // into the keyframes, and for AV1, the config packet is a codec
+        // configuration record (not part of the OBU stream)
+        av_packet_unref(rs->packet);
+        return true;
+    }
+
+    if (!rs->file && !sc_raw_sink_open_file(rs)) {
+        av_packet_unref(rs->packet);
+        rs->failed = true;
+        return true;
+    }
+
+    bool ok = sc_raw_sink_write(rs, packet);
+    av_packet_unref(rs->packet);
+    if (!ok) {
+        LOGW("Raw video: could not write to %s, stopped", rs->filename);
+        rs->failed = true;
+    }
+
+    return true;
+}
+
+static bool
+sc_raw_sink_packet_sink_open(struct sc_packet_sink *sink,
+                             AVCodecContext *ctx) {
+    struct sc_raw_sink *rs = DOWNCAST(sink);
+
+    rs->packet = av_packet_alloc();
+    if (!rs->packet) {
+        LOG_OOM();
+        return false;
+    }
+
+    rs->merge_config = ctx->codec_id == AV_CODEC_ID_H264
+                    || ctx->codec_id == AV_CODEC_ID_HEVC;
+    sc_packet_merger_init(&rs->merger);
+    sc_packet_merger_set_repeat(&rs->merger);
+
+    rs->file = NULL;
+    rs->buf = NULL;
+    rs->buf_size = 0;
+    rs->keyframe_received = false;
+    rs->failed = false;
+
+    return true;
+}
+
+static void
+sc_raw_sink_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_raw_sink *rs = DOWNCAST(sink);
+
+    if (rs->file) {
+        fclose(rs->file);
+    }
+
+    free(rs->buf);
+    sc_packet_merger_destroy(&rs->merger);
+    av_packet_free(&rs->packet);
+}
+
+static bool
+sc_raw_sink_packet_sink_push(struct sc_packet_sink *sink,
+                             const AVPacket *packet) {
+    struct sc_raw_sink *rs = DOWNCAST(sink);
+
+    if (rs->failed) {
+        // Do not stop the mirroring
+        return true;
+    }
+
+    return sc_raw_sink_push(rs, packet);
+}
+
+bool
+sc_raw_sink_init(struct sc_raw_sink *rs, const char *filename, bool header) {
+    rs->filename = strdup(filename);
+    if (!rs->filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    rs->header = header;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_raw_sink_packet_sink_open,
+        .close = sc_raw_sink_packet_sink_close,
+        .push = sc_raw_sink_packet_sink_push,
+    };
+
+    rs->packet_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_raw_sink_destroy(struct sc_raw_sink *rs) {
+    free(rs->filename);
+}
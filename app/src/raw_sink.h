@@ -0,0 +1,58 @@
+#ifndef SC_RAW_SINK_H
+#define SC_RAW_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <libavcodec/avcodec.h>
+
+#include "packet_merger.h"
+#include "trait/packet_sink.h"
+
+/**
+ * Packet sink writing the raw video elementary stream (Annex B for H.26x, OBU
+ * for AV1) to a file or a named pipe, without any container
+ *
+ * The config packets are prepended to every keyframe, so that the consumer
+ * may start decoding at any keyframe. Optionally, each packet is prefixed by
+ * the same 12-byte frame header as the one sent by the device (PTS, flags and
+ * size).
+ *
+ * The packets are written synchronously, so it is expected to be fed by a
+ * packet queue running on its own thread.
+ */
+struct sc_raw_sink {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    char *filename;
+    bool header;
+
+    // Open on the first packet (opening a named pipe blocks until a reader
+    // is connected)
+    FILE *file;
+
+    AVPacket *packet;
+    bool merge_config; // H.26x only
+    struct sc_packet_merger merger;
+
+    // Header and packet data, to write them at once
+    uint8_t *buf;
+    size_t buf_size;
+
+    bool keyframe_received;
+
+    // Set on write error (typically, the reader has closed the pipe), the
+    // stream is not written anymore (but the mirroring continues)
+    bool failed;
+};
+
+bool
+sc_raw_sink_init(struct sc_raw_sink *rs, const char *filename, bool header);
+
+void
+sc_raw_sink_destroy(struct sc_raw_sink *rs);
+
+#endif
@@ -2,7 +2,12 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL_clipboard.h>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
 
 #include "device_msg.h"
 #include "events.h"
@@ -14,24 +19,29 @@ struct sc_uhid_output_task_data {
     struct sc_uhid_devices *uhid_devices;
     uint16_t id;
     uint16_t size;
-    uint8_t *data;
+    uint8_t data[]; // allocated along with the struct
 };
 
 bool
-sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
-                 const struct sc_receiver_callbacks *cbs, void *cbs_userdata) {
+sc_receiver_init(struct sc_receiver *receiver) {
+    receiver->buf = malloc(DEVICE_MSG_MAX_SIZE);
+    if (!receiver->buf) {
+        LOG_OOM();
+        return false;
+    }
+
     bool ok = sc_mutex_init(&receiver->mutex);
     if (!ok) {
+        free(receiver->buf);
         return false;
     }
 
-    receiver->control_socket = control_socket;
+    receiver->head = 0;
     receiver->acksync = NULL;
     receiver->uhid_devices = NULL;
-
-    assert(cbs && cbs->on_ended);
-    receiver->cbs = cbs;
-    receiver->cbs_userdata = cbs_userdata;
+    receiver->latency_tracker = NULL;
+    receiver->automation = NULL;
+    receiver->device_clipboard_hash_valid = false;
 
     return true;
 }
@@ -39,6 +49,31 @@ sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
 void
 sc_receiver_destroy(struct sc_receiver *receiver) {
     sc_mutex_destroy(&receiver->mutex);
+    free(receiver->buf);
+}
+
+void
+sc_receiver_reset(struct sc_receiver *receiver) {
+    receiver->head = 0;
+}
+
+bool
+sc_receiver_get_device_clipboard_hash(struct sc_receiver *receiver,
+                                      uint64_t *hash) {
+    sc_mutex_lock(&receiver->mutex);
+    bool valid = receiver->device_clipboard_hash_valid;
+    *hash = receiver->device_clipboard_hash;
+    sc_mutex_unlock(&receiver->mutex);
+    return valid;
+}
+
+void
+sc_receiver_set_device_clipboard_hash(struct sc_receiver *receiver,
+                                      uint64_t hash) {
+    sc_mutex_lock(&receiver->mutex);
+    receiver->device_clipboard_hash = hash;
+    receiver->device_clipboard_hash_valid = true;
+    sc_mutex_unlock(&receiver->mutex);
 }
 
 static void
@@ -69,16 +104,62 @@ task_uhid_output(void *userdata) {
     sc_uhid_devices_process_hid_output(data->uhid_devices, data->id, data->data,
                                        data->size);
 
-    free(data->data);
     free(data);
 }
 
+// Copy (or decompress) the clipboard text to a new nul-terminated string
+static char *
+copy_clipboard_text(const struct sc_device_msg *msg) {
+    assert(msg->type == DEVICE_MSG_TYPE_CLIPBOARD);
+
+    size_t len = msg->clipboard.uncompressed_length;
+    char *text = malloc(len + 1);
+    if (!text) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (msg->clipboard.compressed) {
+#ifdef HAVE_ZLIB
+        uLongf out_len = len;
+        int r = uncompress((Bytef *) text, &out_len,
+                           (const Bytef *) msg->clipboard.text,
+                           msg->clipboard.length);
+        if (r != Z_OK || out_len != len) {
+            LOGE("Could not decompress device clipboard");
+            free(text);
+            return NULL;
+        }
+#else
+        // Never requested
+        LOGE("Unexpected compressed device clipboard");
+        free(text);
+        return NULL;
+#endif
+    } else {
+        assert(msg->clipboard.length == len);
+        memcpy(text, msg->clipboard.text, len);
+    }
+
+    text[len] = '\0';
+    return text;
+}
+
+// The msg fields point into the receive buffer, which is reused as soon as
+// process_msg() returns: the data posted to the main thread must be copied
+// (once, directly into the allocation passed to the main thread)
 static void
 process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
     switch (msg->type) {
         case DEVICE_MSG_TYPE_CLIPBOARD: {
-            // Take ownership of the text (do not destroy the msg)
-            char *text = msg->clipboard.text;
+            char *text = copy_clipboard_text(msg);
+            if (!text) {
+                return;
+            }
+
+            uint64_t hash =
+                sc_str_hash(text, msg->clipboard.uncompressed_length);
+            sc_receiver_set_device_clipboard_hash(receiver, hash);
 
             bool ok = sc_post_to_main_thread(task_set_clipboard, text);
             if (!ok) {
@@ -104,7 +185,6 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
             }
 
             sc_acksync_ack(receiver->acksync, msg->ack_clipboard.sequence);
-            // No allocation to free in the msg
             break;
         case DEVICE_MSG_TYPE_UHID_OUTPUT:
             if (sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
@@ -122,11 +202,11 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
 
             if (!receiver->uhid_devices) {
                 LOGE("Received unexpected HID output message");
-                sc_device_msg_destroy(msg);
                 return;
             }
 
-            struct sc_uhid_output_task_data *data = malloc(sizeof(*data));
+            struct sc_uhid_output_task_data *data =
+                malloc(sizeof(*data) + msg->uhid_output.size);
             if (!data) {
                 LOG_OOM();
                 return;
@@ -138,17 +218,55 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
             // gets deinitialized)
             data->uhid_devices = receiver->uhid_devices;
             data->id = msg->uhid_output.id;
-            data->data = msg->uhid_output.data; // take ownership
             data->size = msg->uhid_output.size;
+            memcpy(data->data, msg->uhid_output.data, data->size);
 
             bool ok = sc_post_to_main_thread(task_uhid_output, data);
             if (!ok) {
                 LOGW("Could not post UHID output to main thread");
-                free(data->data);
                 free(data);
                 return;
             }
 
+            break;
+        case DEVICE_MSG_TYPE_CLOCK:
+            if (!receiver->latency_tracker) {
+                LOGE("Received unexpected clock message");
+                return;
+            }
+
+            sc_tick now = sc_tick_now();
+            sc_tick request_time = (sc_tick) msg->clock.timestamp;
+            if (request_time > now) {
+                LOGW("Received clock message from the future");
+                return;
+            }
+
+            sc_latency_tracker_add_clock_sample(receiver->latency_tracker,
+                                                request_time,
+                                                msg->clock.device_timestamp,
+                                                now);
+            break;
+        case DEVICE_MSG_TYPE_ACK_PING:
+            if (!receiver->latency_tracker) {
+                LOGE("Received unexpected ping acknowledgment");
+                return;
+            }
+
+            sc_latency_tracker_ack_input_ping(receiver->latency_tracker,
+                                              msg->ack_ping.sequence,
+                                              (sc_tick) msg->ack_ping.timestamp,
+                                              sc_tick_now());
+            break;
+        case DEVICE_MSG_TYPE_VIDEO_IDLE:
+            // The device stops streaming while its screen is idle: the last
+            // frame stays on screen, and nothing is decoded nor rendered
+            // until the next packet
+            if (msg->video_idle.idle) {
+                LOGI("Device screen idle, video paused");
+            } else {
+                LOGI("Device screen active, video resumed");
+            }
             break;
     }
 }
@@ -166,8 +284,14 @@ process_msgs(struct sc_receiver *receiver, const uint8_t *buf, size_t len) {
             return head;
         }
 
+        // The msg is parsed in place, no allocation to release
         process_msg(receiver, &msg);
-        // the device msg must be destroyed by process_msg()
+
+        if (receiver->automation) {
+            // Forward the raw msg
+            sc_automation_forward_device_msg(receiver->automation, &buf[head],
+                                             r);
+        }
 
         head += r;
         assert(head <= len);
@@ -177,60 +301,34 @@ process_msgs(struct sc_receiver *receiver, const uint8_t *buf, size_t len) {
     }
 }
 
-static int
-run_receiver(void *data) {
-    struct sc_receiver *receiver = data;
-
-    static uint8_t buf[DEVICE_MSG_MAX_SIZE];
-    size_t head = 0;
-
-    bool error = false;
-
-    for (;;) {
-        assert(head < DEVICE_MSG_MAX_SIZE);
-        ssize_t r = net_recv(receiver->control_socket, buf + head,
-                             DEVICE_MSG_MAX_SIZE - head);
-        if (r <= 0) {
-            LOGD("Receiver stopped");
-            // device disconnected: keep error=false
-            break;
-        }
-
-        head += r;
-        ssize_t consumed = process_msgs(receiver, buf, head);
-        if (consumed == -1) {
-            // an error occurred
-            error = true;
-            break;
-        }
-
-        if (consumed) {
-            head -= consumed;
-            // shift the remaining data in the buffer
-            memmove(buf, &buf[consumed], head);
-        }
-    }
-
-    receiver->cbs->on_ended(receiver, error, receiver->cbs_userdata);
-
-    return 0;
-}
-
 bool
-sc_receiver_start(struct sc_receiver *receiver) {
-    LOGD("Starting receiver thread");
+sc_receiver_recv(struct sc_receiver *receiver, sc_socket control_socket,
+                 bool *error) {
+    uint8_t *buf = receiver->buf;
+
+    assert(receiver->head < DEVICE_MSG_MAX_SIZE);
+    ssize_t r = net_recv(control_socket, buf + receiver->head,
+                         DEVICE_MSG_MAX_SIZE - receiver->head);
+    if (r <= 0) {
+        LOGD("Receiver stopped");
+        // device disconnected
+        *error = false;
+        return false;
+    }
 
-    bool ok = sc_thread_create(&receiver->thread, run_receiver,
-                               "scrcpy-receiver", receiver);
-    if (!ok) {
-        LOGE("Could not start receiver thread");
+    receiver->head += r;
+    ssize_t consumed = process_msgs(receiver, buf, receiver->head);
+    if (consumed == -1) {
+        // an error occurred
+        *error = true;
         return false;
     }
 
-    return true;
-}
+    if (consumed) {
+        receiver->head -= consumed;
+        // shift the remaining data in the buffer
+        memmove(buf, &buf[consumed], receiver->head);
+    }
 
-void
-sc_receiver_join(struct sc_receiver *receiver) {
-    sc_thread_join(&receiver->thread, NULL);
+    return true;
 }
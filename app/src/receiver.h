@@ -4,43 +4,73 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "automation.h"
+#include "latency_tracker.h"
 #include "uhid/uhid_output.h"
 #include "util/acksync.h"
 #include "util/net.h"
 #include "util/thread.h"
 
 // receive events from the device
-// managed by the controller
+// managed by the controller, which reads the control socket from its own
+// thread (there is no receiver thread)
 struct sc_receiver {
-    sc_socket control_socket;
-    sc_thread thread;
     sc_mutex mutex;
 
+    // Partial device msgs received (only accessed from the controller thread)
+    uint8_t *buf;
+    size_t head;
+
     struct sc_acksync *acksync;
     struct sc_uhid_devices *uhid_devices;
+    struct sc_latency_tracker *latency_tracker; // may be NULL
+    struct sc_automation *automation; // may be NULL
 
-    const struct sc_receiver_callbacks *cbs;
-    void *cbs_userdata;
-};
-
-struct sc_receiver_callbacks {
-    void (*on_ended)(struct sc_receiver *receiver, bool error, void *userdata);
+    // Hash of the text that the device clipboard is known to contain
+    // (protected by mutex)
+    uint64_t device_clipboard_hash;
+    bool device_clipboard_hash_valid;
 };
 
 bool
-sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
-                 const struct sc_receiver_callbacks *cbs, void *cbs_userdata);
+sc_receiver_init(struct sc_receiver *receiver);
 
 void
 sc_receiver_destroy(struct sc_receiver *receiver);
 
+// Discard any partial msg (before reading from a new connection)
+void
+sc_receiver_reset(struct sc_receiver *receiver);
+
+/**
+ * Receive the available data from the control socket, and process the
+ * complete device msgs
+ *
+ * It must be called from the controller thread, once the control socket is
+ * readable (so that it does not block).
+ *
+ * Return false on end of stream (*error is false) or on error (*error is
+ * true).
+ */
 bool
-sc_receiver_start(struct sc_receiver *receiver);
+sc_receiver_recv(struct sc_receiver *receiver, sc_socket control_socket,
+                 bool *error);
 
-// no sc_receiver_stop(), it will automatically stop on control_socket shutdown
+/**
+ * Get the hash (see sc_str_hash()) of the last clipboard text received from
+ * the device or set on the device
+ *
+ * Return false if it is unknown.
+ */
+bool
+sc_receiver_get_device_clipboard_hash(struct sc_receiver *receiver,
+                                      uint64_t *hash);
 
 void
-sc_receiver_join(struct sc_receiver *receiver);
+sc_receiver_set_device_clipboard_hash(struct sc_receiver *receiver,
+                                      uint64_t hash);
 
 #endif
@@ -0,0 +1,191 @@
+#include "record_switch.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control_msg.h"
+#include "util/log.h"
+
+static void
+sc_record_switch_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                                   void *userdata) {
+    // The recorder logs the result, and a failure must not stop scrcpy
+    (void) recorder;
+    (void) success;
+    (void) userdata;
+}
+
+bool
+sc_record_switch_init(struct sc_record_switch *rs,
+                      const struct sc_record_switch_params *params) {
+    assert(params->video_source || params->audio_source);
+
+    rs->filename = strdup(params->filename);
+    if (!rs->filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    rs->format = params->format;
+    rs->orientation = params->orientation;
+    rs->segment = params->segment;
+    rs->memory_limit = params->memory_limit;
+    rs->fragment_duration = params->fragment_duration;
+    rs->keyframe_index = params->keyframe_index;
+    rs->sync_clock = params->sync_clock;
+    rs->video_source = params->video_source;
+    rs->audio_source = params->audio_source;
+    rs->controller = params->controller;
+    rs->no_periodic_keyframes = params->no_periodic_keyframes;
+
+    rs->recording = false;
+    rs->recorder_started = false;
+
+    if (rs->video_source) {
+        // Start the recordings on the current GOP, without waiting for (or
+        // requesting) the next keyframe
+        sc_packet_source_enable_gop_cache(rs->video_source);
+    }
+
+    return true;
+}
+
+// Wait for the previous recorder (already stopped) to finish writing its file
+static void
+sc_record_switch_release(struct sc_record_switch *rs) {
+    assert(!rs->recording);
+
+    if (rs->recorder_started) {
+        sc_recorder_join(&rs->recorder);
+        sc_recorder_destroy(&rs->recorder);
+        rs->recorder_started = false;
+    }
+}
+
+static void
+sc_record_switch_request_keyframe(struct sc_record_switch *rs) {
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME;
+    if (!sc_controller_push_msg(rs->controller, &msg)) {
+        LOGW("Could not request a keyframe");
+    }
+}
+
+static void
+sc_record_switch_detach(struct sc_record_switch *rs) {
+    // Once detached (if it was not already, due to a failure), the sinks are
+    // closed, so the recorder writes the end of the file and terminates
+    if (rs->video_source) {
+        sc_packet_source_detach_sink(rs->video_source,
+                                     &rs->recorder.video_packet_sink);
+    }
+    if (rs->audio_source) {
+        sc_packet_source_detach_sink(rs->audio_source,
+                                     &rs->recorder.audio_packet_sink);
+    }
+
+    // The sources are closed anyway if the streams have already ended
+    sc_recorder_stop(&rs->recorder);
+}
+
+static bool
+sc_record_switch_start(struct sc_record_switch *rs) {
+    // The previous recording has been stopped, it is probably already written
+    sc_record_switch_release(rs);
+
+    char *filename = sc_recorder_get_dated_filename(rs->filename);
+    if (!filename) {
+        return false;
+    }
+
+    static const struct sc_recorder_callbacks recorder_cbs = {
+        .on_ended = sc_record_switch_on_recorder_ended,
+    };
+
+    bool video = rs->video_source;
+    bool audio = rs->audio_source;
+    bool ok = sc_recorder_init(&rs->recorder, filename, rs->format, video,
+                               audio, rs->orientation, &rs->segment,
+                               rs->memory_limit, &recorder_cbs, NULL);
+    free(filename);
+    if (!ok) {
+        return false;
+    }
+
+    sc_recorder_set_fragment_duration(&rs->recorder, rs->fragment_duration);
+    if (rs->keyframe_index) {
+        sc_recorder_set_keyframe_index(&rs->recorder);
+    }
+    if (rs->sync_clock) {
+        sc_recorder_set_sync_clock(&rs->recorder, rs->sync_clock);
+    }
+    if (video && rs->controller && rs->no_periodic_keyframes) {
+        sc_recorder_set_keyframe_requester(&rs->recorder, rs->controller);
+    }
+
+    ok = sc_recorder_start(&rs->recorder);
+    if (!ok) {
+        sc_recorder_destroy(&rs->recorder);
+        return false;
+    }
+
+    rs->recorder_started = true;
+
+    bool primed = false;
+    if (video) {
+        ok = sc_packet_source_attach_sink(rs->video_source,
+                                          &rs->recorder.video_packet_sink,
+                                          &primed);
+        if (!ok) {
+            sc_recorder_stop(&rs->recorder);
+            return false;
+        }
+    }
+
+    if (audio) {
+        ok = sc_packet_source_attach_sink(rs->audio_source,
+                                          &rs->recorder.audio_packet_sink,
+                                          NULL);
+        if (!ok) {
+            sc_record_switch_detach(rs);
+            return false;
+        }
+    }
+
+    if (video && !primed && rs->controller) {
+        // The recording starts on the next keyframe, do not wait for the
+        // periodic one
+        sc_record_switch_request_keyframe(rs);
+    }
+
+    return true;
+}
+
+void
+sc_record_switch_toggle(struct sc_record_switch *rs) {
+    if (rs->recording) {
+        // The recorder logs when the file is complete
+        sc_record_switch_detach(rs);
+        rs->recording = false;
+        return;
+    }
+
+    if (!sc_record_switch_start(rs)) {
+        LOGE("Could not start recording");
+        return;
+    }
+
+    rs->recording = true;
+}
+
+void
+sc_record_switch_destroy(struct sc_record_switch *rs) {
+    if (rs->recording) {
+        sc_record_switch_detach(rs);
+        rs->recording = false;
+    }
+
+    sc_record_switch_release(rs);
+    free(rs->filename);
+}
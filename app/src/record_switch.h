@@ -0,0 +1,78 @@
+#ifndef SC_RECORD_SWITCH_H
+#define SC_RECORD_SWITCH_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controller.h"
+#include "options.h"
+#include "recorder.h"
+#include "stream_clock.h"
+#include "trait/packet_source.h"
+#include "util/tick.h"
+
+/**
+ * Start and stop recordings at runtime, by attaching a new recorder to the
+ * running streams
+ */
+
+struct sc_record_switch_params {
+    const char *filename;
+    enum sc_record_format format;
+    enum sc_orientation orientation;
+    struct sc_recorder_segment_params segment;
+    uint32_t memory_limit;
+    sc_tick fragment_duration;
+    bool keyframe_index;
+    // To write the start dates of the recordings (may be NULL)
+    struct sc_stream_clock *sync_clock;
+
+    struct sc_packet_source *video_source; // may be NULL
+    struct sc_packet_source *audio_source; // may be NULL
+    // To request a keyframe when a recording starts (may be NULL)
+    struct sc_controller *controller;
+    // The video stream has no periodic keyframes (--video-intra-refresh), so
+    // request them whenever the recorder needs one
+    bool no_periodic_keyframes;
+};
+
+struct sc_record_switch {
+    char *filename;
+    enum sc_record_format format;
+    enum sc_orientation orientation;
+    struct sc_recorder_segment_params segment;
+    uint32_t memory_limit;
+    sc_tick fragment_duration;
+    bool keyframe_index;
+    struct sc_stream_clock *sync_clock;
+
+    struct sc_packet_source *video_source;
+    struct sc_packet_source *audio_source;
+    struct sc_controller *controller;
+    bool no_periodic_keyframes;
+
+    // Only accessed from the main thread
+    bool recording;
+    // Set while a recorder (recording or finishing) must be joined
+    bool recorder_started;
+    struct sc_recorder recorder;
+};
+
+bool
+sc_record_switch_init(struct sc_record_switch *rs,
+                      const struct sc_record_switch_params *params);
+
+// Stop the current recording (if any) and wait for its file to be written
+void
+sc_record_switch_destroy(struct sc_record_switch *rs);
+
+// Start a new recording to "<name>-<date>-<time>.<ext>", or stop the current
+// recording
+//
+// Must be called from the main thread.
+void
+sc_record_switch_toggle(struct sc_record_switch *rs);
+
+#endif
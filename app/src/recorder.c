@@ -1,14 +1,19 @@
 #include "recorder.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/time.h>
 #include <libavutil/display.h>
 
+#include "trace.h"
+#include "util/async_file.h"
+#include "util/file.h"
 #include "util/log.h"
 #include "util/str.h"
 
@@ -20,6 +25,16 @@
 
 static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
 
+// Maximum number of packets queued per stream (about 1 minute of video at 60
+// fps), after which the packets are dropped rather than blocking the demuxer
+#define SC_RECORDER_QUEUE_CAPACITY 4096
+// Maximum number of released packets kept for reuse per stream
+#define SC_RECORDER_POOL_CAPACITY 64
+
+// The muxer output is buffered by chunks of this size before being written
+// (asynchronously) to the file
+#define SC_RECORDER_IO_BUFFER_SIZE SC_ASYNC_FILE_CHUNK_SIZE
+
 static const AVOutputFormat *
 find_muxer(const char *name) {
 #ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
@@ -37,12 +52,17 @@ find_muxer(const char *name) {
     return oformat;
 }
 
+// Called from a demuxer thread
 static AVPacket *
-sc_recorder_packet_ref(const AVPacket *packet) {
-    AVPacket *p = av_packet_alloc();
-    if (!p) {
-        LOG_OOM();
-        return NULL;
+sc_recorder_packet_ref(struct sc_recorder_packet_ring *pool,
+                       const AVPacket *packet) {
+    AVPacket *p;
+    if (!sc_spsc_ring_pop(pool, &p)) {
+        p = av_packet_alloc();
+        if (!p) {
+            LOG_OOM();
+            return NULL;
+        }
     }
 
     if (av_packet_ref(p, packet)) {
@@ -53,14 +73,186 @@ sc_recorder_packet_ref(const AVPacket *packet) {
     return p;
 }
 
+// Called from the recorder thread
 static void
-sc_recorder_queue_clear(struct sc_recorder_queue *queue) {
-    while (!sc_vecdeque_is_empty(queue)) {
-        AVPacket *p = sc_vecdeque_pop(queue);
+sc_recorder_packet_release(struct sc_recorder_packet_ring *pool,
+                           AVPacket **packet) {
+    av_packet_unref(*packet);
+    if (!sc_spsc_ring_push(pool, *packet)) {
+        // The pool is full
+        av_packet_free(packet);
+    }
+    *packet = NULL;
+}
+
+static void
+sc_recorder_queue_clear(struct sc_recorder_packet_ring *queue) {
+    AVPacket *p;
+    while (sc_spsc_ring_pop(queue, &p)) {
         av_packet_free(&p);
     }
 }
 
+// Called from a demuxer thread
+static void
+sc_recorder_drop(struct sc_recorder_stream *stream, const AVPacket *packet) {
+    atomic_fetch_add_explicit(&stream->dropped_packets, 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&stream->dropped_bytes, packet->size,
+                              memory_order_relaxed);
+    sc_metric_inc(stream->dropped_packets_metric);
+}
+
+// Called from a demuxer thread
+static bool
+sc_recorder_is_over_limit(struct sc_recorder *recorder, uint64_t pending,
+                          int size) {
+    // A single packet is always accepted if the queues are empty
+    return pending && pending + size > recorder->memory_limit;
+}
+
+// Called from a demuxer thread
+static bool
+sc_recorder_enqueue(struct sc_recorder *recorder,
+                    struct sc_recorder_packet_ring *queue, AVPacket *packet,
+                    bool config) {
+    uint64_t pending =
+        atomic_fetch_add_explicit(&recorder->pending_bytes, packet->size,
+                                  memory_order_relaxed);
+    bool over_limit = sc_recorder_is_over_limit(recorder, pending,
+                                                packet->size);
+    if ((!config && over_limit) || !sc_spsc_ring_push(queue, packet)) {
+        atomic_fetch_sub_explicit(&recorder->pending_bytes, packet->size,
+                                  memory_order_relaxed);
+        return false;
+    }
+
+    // The producers and the consumer may set it out of order, it is only an
+    // approximation
+    sc_metric_set(recorder->pending_bytes_metric, pending + packet->size);
+    return true;
+}
+
+// Called from a demuxer thread or from the recorder thread
+static void
+sc_recorder_request_keyframe(struct sc_recorder *recorder) {
+    assert(recorder->keyframe_controller);
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME;
+    if (!sc_controller_push_msg(recorder->keyframe_controller, &msg)) {
+        LOGW("Could not request a keyframe");
+    }
+}
+
+// Called from a demuxer thread
+static bool
+sc_recorder_push(struct sc_recorder *recorder,
+                 struct sc_recorder_stream *stream,
+                 struct sc_recorder_packet_ring *queue,
+                 struct sc_recorder_packet_ring *pool, bool video,
+                 const AVPacket *packet) {
+    if (atomic_load_explicit(&recorder->stopped, memory_order_relaxed)) {
+        // reject any new packet
+        return false;
+    }
+
+    // Config packets are never dropped
+    bool config = packet->pts == AV_NOPTS_VALUE;
+
+    if (!config && stream->dropping) {
+        assert(!recorder->blocking);
+        // A video packet cannot be decoded without the previous packets of
+        // its GOP, so drop until the next keyframe
+        bool resumable = !video || packet->flags & AV_PKT_FLAG_KEY;
+        uint64_t pending = atomic_load_explicit(&recorder->pending_bytes,
+                                                memory_order_relaxed);
+        if (!resumable
+                || sc_recorder_is_over_limit(recorder, pending, packet->size)) {
+            sc_recorder_drop(stream, packet);
+            return true;
+        }
+
+        stream->dropping = false;
+        LOGW("Recording %s resumed", video ? "video" : "audio");
+    }
+
+    AVPacket *rec = sc_recorder_packet_ref(pool, packet);
+    if (!rec) {
+        return false;
+    }
+
+    rec->stream_index = stream->index;
+
+    bool ok = sc_recorder_enqueue(recorder, queue, rec, config);
+    if (!ok && recorder->blocking) {
+        // The source is not live, wait for the recorder thread to consume
+        // some packets
+        sc_mutex_lock(&recorder->mutex);
+        while (!recorder->stopped
+                && !(ok = sc_recorder_enqueue(recorder, queue, rec, config))) {
+            sc_cond_wait(&recorder->queue_cond, &recorder->mutex);
+        }
+        sc_mutex_unlock(&recorder->mutex);
+
+        if (!ok) {
+            // stopped
+            av_packet_free(&rec);
+            return false;
+        }
+    }
+
+    if (!ok) {
+        if (config) {
+            LOGE("Recording too slow, too many pending packets");
+            av_packet_free(&rec);
+            sc_recorder_stop(recorder);
+            return false;
+        }
+
+        // Never block the demuxer: the output cannot keep up
+        LOGW("Recording too slow, dropping %s packets%s",
+             video ? "video" : "audio",
+             video ? " until the next keyframe" : "");
+        sc_recorder_drop(stream, rec);
+        av_packet_free(&rec);
+        stream->dropping = true;
+        if (video && recorder->keyframe_controller) {
+            // Do not wait for a periodic keyframe to resume
+            sc_recorder_request_keyframe(recorder);
+        }
+        return true;
+    }
+
+    sc_notifier_notify(&recorder->notifier);
+    return true;
+}
+
+// Called from the recorder thread
+static AVPacket *
+sc_recorder_pop(struct sc_recorder *recorder,
+                struct sc_recorder_packet_ring *queue) {
+    AVPacket *packet;
+    if (!sc_spsc_ring_pop(queue, &packet)) {
+        return NULL;
+    }
+
+    uint64_t pending =
+        atomic_fetch_sub_explicit(&recorder->pending_bytes, packet->size,
+                                  memory_order_relaxed);
+    sc_metric_set(recorder->pending_bytes_metric, pending - packet->size);
+    if (recorder->blocking) {
+        // Wake up the producers waiting for space in the queues (the packet is
+        // popped before the mutex is locked, so a producer checking the queue
+        // with the mutex locked cannot miss it)
+        sc_mutex_lock(&recorder->mutex);
+        sc_cond_broadcast(&recorder->queue_cond);
+        sc_mutex_unlock(&recorder->mutex);
+    }
+
+    return packet;
+}
+
 static const char *
 sc_recorder_get_format_name(enum sc_record_format format) {
     switch (format) {
@@ -103,91 +295,759 @@ sc_recorder_rescale_packet(AVStream *stream, AVPacket *packet) {
     av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, stream->time_base);
 }
 
-static bool
-sc_recorder_write_stream(struct sc_recorder *recorder,
-                         struct sc_recorder_stream *st, AVPacket *packet) {
-    AVStream *stream = recorder->ctx->streams[st->index];
-    sc_recorder_rescale_packet(stream, packet);
-    if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
-        LOGD("Fixing PTS non monotonically increasing in stream %d "
-             "(%" PRIi64 " >= %" PRIi64 ")",
-             st->index, st->last_pts, packet->pts);
-        packet->pts = ++st->last_pts;
-        packet->dts = packet->pts;
-    } else {
-        st->last_pts = packet->pts;
+static bool
+sc_recorder_write_stream(struct sc_recorder *recorder,
+                         struct sc_recorder_stream *st, AVPacket *packet) {
+    // Each segment starts at 0
+    packet->pts -= recorder->segment.start_pts;
+    packet->dts = packet->pts;
+
+    AVStream *stream = recorder->ctx->streams[st->index];
+    sc_recorder_rescale_packet(stream, packet);
+    if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
+        LOGD("Fixing PTS non monotonically increasing in stream %d "
+             "(%" PRIi64 " >= %" PRIi64 ")",
+             st->index, st->last_pts, packet->pts);
+        packet->pts = ++st->last_pts;
+        packet->dts = packet->pts;
+    } else {
+        st->last_pts = packet->pts;
+    }
+    sc_tick begin = sc_trace_begin();
+    int ret = av_interleaved_write_frame(recorder->ctx, packet);
+    sc_trace_end("recorder_write", begin);
+
+    return ret >= 0;
+}
+
+static inline bool
+sc_recorder_is_segmented(struct sc_recorder *recorder) {
+    return recorder->segment.duration || recorder->segment.size;
+}
+
+// Return a pointer to the extension of the filename (including the '.'), or
+// to the end of the filename if there is no extension
+static const char *
+sc_recorder_get_extension(const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    const char *sep = strrchr(filename, SC_PATH_SEPARATOR);
+    if (!ext || (sep && ext < sep)) {
+        // No extension
+        ext = filename + strlen(filename);
+    }
+
+    return ext;
+}
+
+// Return "<name>-<index>.<ext>" for a filename "<name>.<ext>"
+static char *
+sc_recorder_get_segment_filename(const char *filename, unsigned index) {
+    const char *ext = sc_recorder_get_extension(filename);
+
+    char *segment_filename;
+    int r = asprintf(&segment_filename, "%.*s-%04u%s", (int) (ext - filename),
+                     filename, index, ext);
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return segment_filename;
+}
+
+char *
+sc_recorder_get_dated_filename(const char *filename) {
+    int64_t now_us = av_gettime();
+    time_t now = now_us / 1000000;
+    unsigned ms = (now_us / 1000) % 1000;
+    // Only called from the main thread
+    struct tm *tm = localtime(&now);
+    char date[32];
+    if (!tm || !strftime(date, sizeof(date), "%Y%m%d-%H%M%S", tm)) {
+        LOGE("Could not format the current date");
+        return NULL;
+    }
+
+    const char *ext = sc_recorder_get_extension(filename);
+    int name_len = ext - filename;
+
+    // The milliseconds make collisions unlikely, but never overwrite an
+    // existing file (the clock may also have been set back)
+    for (unsigned i = 1; i <= 100; ++i) {
+        char *dated_filename;
+        int r;
+        if (i == 1) {
+            r = asprintf(&dated_filename, "%.*s-%s-%03u%s", name_len, filename,
+                         date, ms, ext);
+        } else {
+            r = asprintf(&dated_filename, "%.*s-%s-%03u-%u%s", name_len,
+                         filename, date, ms, i, ext);
+        }
+        if (r == -1) {
+            LOG_OOM();
+            return NULL;
+        }
+
+        if (!sc_file_is_regular(dated_filename)) {
+            return dated_filename;
+        }
+
+        free(dated_filename);
+    }
+
+    LOGE("Could not find an unused file name for %s", filename);
+    return NULL;
+}
+
+// Return "<filename><suffix>", for the files written along with a recording
+static char *
+sc_recorder_get_sidecar_filename(const char *filename, const char *suffix) {
+    char *sidecar_filename;
+    int r = asprintf(&sidecar_filename, "%s%s", filename, suffix);
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return sidecar_filename;
+}
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+static int
+sc_recorder_avio_write(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int
+sc_recorder_avio_write(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    struct sc_recorder_output *output = opaque;
+    if (output->local && !sc_async_file_write(&output->file, buf, buf_size)) {
+        return AVERROR(EIO);
+    }
+
+    if (output->uploading
+            && !sc_s3_upload_write(&output->upload, buf, buf_size)) {
+        if (!output->local) {
+            return AVERROR(EIO);
+        }
+
+        // Keep recording locally
+        LOGW("Upload failed, the recording continues locally only");
+        sc_s3_upload_close(&output->upload);
+        output->uploading = false;
+    }
+
+    output->pos += buf_size;
+    return buf_size;
+}
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_DATA_MARKERS
+static void
+sc_recorder_write_index_entry(struct sc_recorder_output *output,
+                              int64_t time) {
+    // One line per keyframe: "<timestamp in us> <offset in bytes>"
+    int r = fprintf(output->index, "%" PRIi64 " %" PRIi64 "\n", time,
+                    output->pos);
+    // Flush on every entry, so that the index is consistent with the file
+    // if scrcpy is killed
+    if (r < 0 || fflush(output->index)) {
+        LOGW("Could not write keyframe index, disabling it");
+        fclose(output->index);
+        output->index = NULL;
+    }
+}
+
+// Called instead of sc_recorder_avio_write() if the keyframe index is enabled
+# ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+static int
+sc_recorder_avio_write_data_type(void *opaque, const uint8_t *buf,
+                                 int buf_size, enum AVIODataMarkerType type,
+                                 int64_t time) {
+# else
+static int
+sc_recorder_avio_write_data_type(void *opaque, uint8_t *buf, int buf_size,
+                                 enum AVIODataMarkerType type, int64_t time) {
+# endif
+    struct sc_recorder_output *output = opaque;
+
+    // The muxers (mp4 in fragmented mode, matroska) report the start of a
+    // fragment or a cluster beginning with a keyframe as a sync point
+    if (output->index && type == AVIO_DATA_MARKER_SYNC_POINT
+            && time != AV_NOPTS_VALUE) {
+        sc_recorder_write_index_entry(output, time);
+    }
+
+    return sc_recorder_avio_write(opaque, buf, buf_size);
+}
+#endif
+
+static int64_t
+sc_recorder_avio_seek(void *opaque, int64_t offset, int whence) {
+    struct sc_recorder_output *output = opaque;
+    // Never called if the file is uploaded (the output is not seekable)
+    assert(output->local && !output->uploading);
+
+    int64_t ret;
+    if (whence & AVSEEK_SIZE) {
+        ret = sc_async_file_size(&output->file);
+    } else {
+        ret = sc_async_file_seek(&output->file, offset, whence & ~AVSEEK_FORCE);
+        if (ret >= 0) {
+            output->pos = ret;
+        }
+    }
+
+    return ret >= 0 ? ret : AVERROR(EIO);
+}
+
+static FILE *
+sc_recorder_open_index(const char *filename) {
+    char *index_filename = sc_recorder_get_sidecar_filename(filename, ".idx");
+    if (!index_filename) {
+        return NULL;
+    }
+
+    FILE *index = sc_file_open(index_filename, "w");
+    if (!index) {
+        LOGE("Could not open keyframe index \"%s\": %s", index_filename,
+             strerror(errno));
+        free(index_filename);
+        return NULL;
+    }
+
+    free(index_filename);
+
+    if (fputs("# <timestamp in us> <offset in bytes>\n", index) < 0) {
+        LOGE("Could not write keyframe index");
+        fclose(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+// Open a file for writing, where the muxer output is written by large chunks
+// from a separate thread, so that the recorder thread does not wait for the
+// storage (which may be slow, for example on network storage) on every write
+//
+// If an upload target is set, the file is also (or only) uploaded while it is
+// written, as an object named after the file.
+static AVIOContext *
+sc_recorder_open_avio(struct sc_recorder *recorder, const char *filename) {
+    bool keyframe_index = recorder->keyframe_index;
+
+    struct sc_recorder_output *output = malloc(sizeof(*output));
+    if (!output) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    output->local = !recorder->upload_only;
+    output->uploading = false;
+    output->pos = 0;
+    output->index = NULL;
+
+    if (keyframe_index) {
+        assert(output->local);
+        output->index = sc_recorder_open_index(filename);
+        if (!output->index) {
+            goto error_free_output;
+        }
+    }
+
+    if (output->local && !sc_async_file_open(&output->file, filename)) {
+        goto error_close_index;
+    }
+
+    if (recorder->upload) {
+        const char *sep = strrchr(filename, SC_PATH_SEPARATOR);
+        const char *key = sep ? sep + 1 : filename;
+        if (!sc_s3_upload_open(&output->upload, recorder->upload, key)) {
+            goto error_close_file;
+        }
+        output->uploading = true;
+    }
+
+    uint8_t *buf = av_malloc(SC_RECORDER_IO_BUFFER_SIZE);
+    if (!buf) {
+        LOG_OOM();
+        goto error_close_upload;
+    }
+
+    // An uploaded output is written sequentially
+    AVIOContext *pb = avio_alloc_context(buf, SC_RECORDER_IO_BUFFER_SIZE, 1,
+                                         output, NULL, sc_recorder_avio_write,
+                                         recorder->upload
+                                            ? NULL : sc_recorder_avio_seek);
+    if (!pb) {
+        LOG_OOM();
+        av_free(buf);
+        goto error_close_upload;
+    }
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_DATA_MARKERS
+    if (keyframe_index) {
+        pb->write_data_type = sc_recorder_avio_write_data_type;
+    }
+#endif
+
+    return pb;
+
+error_close_upload:
+    if (output->uploading) {
+        sc_s3_upload_close(&output->upload);
+    }
+error_close_file:
+    if (output->local) {
+        sc_async_file_close(&output->file);
+    }
+error_close_index:
+    if (output->index) {
+        fclose(output->index);
+    }
+error_free_output:
+    free(output);
+
+    return NULL;
+}
+
+static bool
+sc_recorder_close_avio(AVIOContext *pb) {
+    avio_flush(pb);
+    bool flushed = !pb->error;
+
+    struct sc_recorder_output *output = pb->opaque;
+    bool closed = true;
+    if (output->local) {
+        closed = sc_async_file_close(&output->file);
+    }
+    if (output->uploading) {
+        // Wait for the end of the upload
+        bool uploaded = sc_s3_upload_close(&output->upload);
+        // If the file is also written locally, a failed upload does not
+        // fail the recording
+        closed &= uploaded || output->local;
+    }
+    if (output->index && fclose(output->index)) {
+        LOGW("Could not close keyframe index");
+    }
+    free(output);
+
+    av_freep(&pb->buffer);
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONTEXT_FREE
+    avio_context_free(&pb);
+#else
+    av_free(pb);
+#endif
+
+    return flushed && closed;
+}
+
+static bool
+sc_recorder_write_header(struct sc_recorder *recorder, AVFormatContext *ctx,
+                         const char *filename) {
+    AVDictionary *opts = NULL;
+
+    bool mp4 = recorder->format == SC_RECORD_FORMAT_MP4
+            || recorder->format == SC_RECORD_FORMAT_M4A;
+    if (mp4 && recorder->fragment_duration) {
+        // Fragmented MP4: the file remains playable if the recording is
+        // interrupted, and there is no large index to write on close
+        av_dict_set(&opts, "movflags",
+                    "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set_int(&opts, "frag_duration",
+                        SC_TICK_TO_US(recorder->fragment_duration), 0);
+    }
+
+    int r = avformat_write_header(ctx, &opts);
+    av_dict_free(&opts);
+    if (r < 0) {
+        LOGE("Failed to write header to %s", filename);
+        return false;
+    }
+
+    return true;
+}
+
+static AVFormatContext *
+sc_recorder_open_output_ctx(struct sc_recorder *recorder,
+                            const char *filename) {
+    const char *format_name = sc_recorder_get_format_name(recorder->format);
+    assert(format_name);
+    const AVOutputFormat *format = find_muxer(format_name);
+    if (!format) {
+        LOGE("Could not find muxer");
+        return NULL;
+    }
+
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    ctx->pb = sc_recorder_open_avio(recorder, filename);
+    if (!ctx->pb) {
+        LOGE("Failed to open output file: %s", filename);
+        avformat_free_context(ctx);
+        return NULL;
+    }
+
+    // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
+    // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
+    // still expects a pointer-to-non-const (it has not be updated accordingly)
+    // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
+    ctx->oformat = (AVOutputFormat *) format;
+
+    av_dict_set(&ctx->metadata, "comment",
+                "Recorded by scrcpy " SCRCPY_VERSION, 0);
+
+    return ctx;
+}
+
+static bool
+sc_recorder_close_output_ctx(AVFormatContext *ctx) {
+    bool ok = sc_recorder_close_avio(ctx->pb);
+    ctx->pb = NULL;
+    avformat_free_context(ctx);
+    return ok;
+}
+
+static bool
+sc_recorder_open_output_file(struct sc_recorder *recorder) {
+    const char *filename = recorder->filename;
+
+    char *segment_filename = NULL;
+    if (sc_recorder_is_segmented(recorder)) {
+        assert(recorder->segment.index == 1);
+        segment_filename = sc_recorder_get_segment_filename(filename, 1);
+        if (!segment_filename) {
+            return false;
+        }
+        filename = segment_filename;
+    }
+
+    recorder->ctx = sc_recorder_open_output_ctx(recorder, filename);
+    if (!recorder->ctx) {
+        free(segment_filename);
+        return false;
+    }
+
+    const char *format_name = sc_recorder_get_format_name(recorder->format);
+    LOGI("Recording started to %s file: %s", format_name, filename);
+    free(segment_filename);
+    return true;
+}
+
+static bool
+sc_recorder_close_output_file(struct sc_recorder *recorder) {
+    bool ok = sc_recorder_close_output_ctx(recorder->ctx);
+    if (!ok) {
+        LOGE("Failed to write to %s", recorder->filename);
+    }
+    return ok;
+}
+
+static bool
+sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
+    assert(!sc_orientation_is_mirror(orientation));
+
+    uint8_t *raw_data;
+#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    AVPacketSideData *sd =
+        av_packet_side_data_new(&stream->codecpar->coded_side_data,
+                                &stream->codecpar->nb_coded_side_data,
+                                AV_PKT_DATA_DISPLAYMATRIX,
+                                sizeof(int32_t) * 9, 0);
+    if (!sd) {
+        LOG_OOM();
+        return false;
+    }
+
+    raw_data = sd->data;
+#else
+    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
+                                      sizeof(int32_t) * 9);
+    if (!raw_data) {
+        LOG_OOM();
+        return false;
+    }
+#endif
+
+    int32_t *matrix = (int32_t *) raw_data;
+
+    unsigned rotation = orientation;
+    unsigned angle = rotation * 90;
+
+    av_display_rotation_set(matrix, angle);
+
+    return true;
+}
+
+static bool
+sc_recorder_copy_streams(struct sc_recorder *recorder, AVFormatContext *from,
+                         AVFormatContext *to) {
+    for (unsigned i = 0; i < from->nb_streams; ++i) {
+        AVStream *stream = avformat_new_stream(to, NULL);
+        if (!stream) {
+            LOG_OOM();
+            return false;
+        }
+        assert(stream->index == (int) i);
+
+        // The codec parameters include the extradata (and the display matrix
+        // with the new side data API)
+        int r = avcodec_parameters_copy(stream->codecpar,
+                                        from->streams[i]->codecpar);
+        if (r < 0) {
+            LOG_OOM();
+            return false;
+        }
+
+#ifndef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+        if ((int) i == recorder->video_stream.index
+                && recorder->orientation != SC_ORIENTATION_0) {
+            if (!sc_recorder_set_orientation(stream, recorder->orientation)) {
+                return false;
+            }
+        }
+#else
+        (void) recorder;
+#endif
+    }
+
+    return true;
+}
+
+// Write the dates of the timestamp 0 of the current file to "<file>.sync"
+//
+// The device time is mapped to the computer clocks by the stream clock, so
+// the files recorded simultaneously from several devices (by several scrcpy
+// instances) can be aligned exactly. It is written once the start of the file
+// is known, then rewritten at the end with the refined estimation.
+static void
+sc_recorder_write_sync(struct sc_recorder *recorder) {
+    assert(recorder->sync.clock);
+    assert(recorder->sync.pts_origin != AV_NOPTS_VALUE);
+
+    int64_t pts = recorder->sync.pts_origin + recorder->segment.start_pts;
+    sc_tick host;
+    if (!sc_stream_clock_to_system_time(recorder->sync.clock,
+                                        recorder->sync.source, pts, &host)) {
+        LOGW("Could not map the recording start to the computer clock");
+        return;
+    }
+
+    // The monotonic clock is shared by the processes of the computer, the
+    // wall clock also allows to align recordings from several computers
+    int64_t utc = av_gettime() - SC_TICK_TO_US(sc_tick_now() - host);
+    double drift = sc_stream_clock_get_drift_ppm(recorder->sync.clock);
+
+    char *sync_filename;
+    if (sc_recorder_is_segmented(recorder)) {
+        char *filename =
+            sc_recorder_get_segment_filename(recorder->filename,
+                                             recorder->segment.index);
+        if (!filename) {
+            return;
+        }
+        sync_filename = sc_recorder_get_sidecar_filename(filename, ".sync");
+        free(filename);
+    } else {
+        sync_filename =
+            sc_recorder_get_sidecar_filename(recorder->filename, ".sync");
+    }
+    if (!sync_filename) {
+        return;
+    }
+
+    FILE *file = sc_file_open(sync_filename, "w");
+    if (!file) {
+        LOGW("Could not open sync file \"%s\": %s", sync_filename,
+             strerror(errno));
+        free(sync_filename);
+        return;
+    }
+
+    // Dates of the timestamp 0, in microseconds
+    int r = fprintf(file, "utc_us=%" PRIi64 "\n"
+                          "host_us=%" PRItick "\n"
+                          "device_us=%" PRIi64 "\n"
+                          "drift_ppm=%.3f\n", utc, host, pts, drift);
+    bool closed = !fclose(file);
+    if (r < 0 || !closed) {
+        LOGW("Could not write sync file \"%s\"", sync_filename);
+    }
+
+    free(sync_filename);
+}
+
+// Finish the current segment and start the next one, beginning at pts
+static bool
+sc_recorder_open_next_segment(struct sc_recorder *recorder, int64_t pts) {
+    AVFormatContext *previous = recorder->ctx;
+
+    if (av_write_trailer(previous) < 0) {
+        LOGE("Failed to write trailer of segment %u",
+             recorder->segment.index);
+        return false;
+    }
+
+    unsigned index = recorder->segment.index + 1;
+    char *filename = sc_recorder_get_segment_filename(recorder->filename,
+                                                      index);
+    if (!filename) {
+        return false;
+    }
+
+    AVFormatContext *ctx = sc_recorder_open_output_ctx(recorder, filename);
+    if (!ctx) {
+        goto error_free_filename;
+    }
+
+    if (!sc_recorder_copy_streams(recorder, previous, ctx)) {
+        goto error_close_ctx;
+    }
+
+    if (!sc_recorder_write_header(recorder, ctx, filename)) {
+        goto error_close_ctx;
+    }
+
+    recorder->ctx = ctx;
+    if (!sc_recorder_close_output_ctx(previous)) {
+        LOGE("Failed to write segment %u", recorder->segment.index);
+        free(filename);
+        // The new segment is closed by the caller
+        return false;
+    }
+
+    recorder->segment.index = index;
+    recorder->segment.start_pts = pts;
+    recorder->video_stream.last_pts = AV_NOPTS_VALUE;
+    recorder->audio_stream.last_pts = AV_NOPTS_VALUE;
+
+    LOGI("Recording segment %u: %s", index, filename);
+    free(filename);
+
+    if (recorder->sync.clock) {
+        sc_recorder_write_sync(recorder);
+    }
+
+    if (recorder->segment.count && index > recorder->segment.count) {
+        // Rolling recording: delete the oldest segment
+        unsigned oldest = index - recorder->segment.count;
+        char *oldest_filename =
+            sc_recorder_get_segment_filename(recorder->filename, oldest);
+        if (oldest_filename) {
+            if (sc_file_remove(oldest_filename)) {
+                LOGD("Recording segment deleted: %s", oldest_filename);
+            } else {
+                LOGW("Could not delete recording segment: %s",
+                     oldest_filename);
+            }
+
+            if (recorder->keyframe_index) {
+                char *index_filename =
+                    sc_recorder_get_sidecar_filename(oldest_filename, ".idx");
+                if (index_filename) {
+                    if (!sc_file_remove(index_filename)) {
+                        LOGW("Could not delete keyframe index: %s",
+                             index_filename);
+                    }
+                    free(index_filename);
+                }
+            }
+
+            if (recorder->sync.clock) {
+                char *sync_filename =
+                    sc_recorder_get_sidecar_filename(oldest_filename, ".sync");
+                if (sync_filename) {
+                    if (!sc_file_remove(sync_filename)) {
+                        LOGW("Could not delete sync file: %s", sync_filename);
+                    }
+                    free(sync_filename);
+                }
+            }
+
+            free(oldest_filename);
+        }
     }
-    return av_interleaved_write_frame(recorder->ctx, packet) >= 0;
-}
 
-static inline bool
-sc_recorder_write_video(struct sc_recorder *recorder, AVPacket *packet) {
-    return sc_recorder_write_stream(recorder, &recorder->video_stream, packet);
-}
+    return true;
 
-static inline bool
-sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
-    return sc_recorder_write_stream(recorder, &recorder->audio_stream, packet);
+error_close_ctx:
+    sc_recorder_close_output_ctx(ctx);
+error_free_filename:
+    free(filename);
+
+    return false;
 }
 
+// Indicate if a new segment must be started before writing a packet at pts
 static bool
-sc_recorder_open_output_file(struct sc_recorder *recorder) {
-    const char *format_name = sc_recorder_get_format_name(recorder->format);
-    assert(format_name);
-    const AVOutputFormat *format = find_muxer(format_name);
-    if (!format) {
-        LOGE("Could not find muxer");
-        return false;
+sc_recorder_must_split(struct sc_recorder *recorder, int64_t pts) {
+    sc_tick elapsed = pts - recorder->segment.start_pts;
+    if (recorder->segment.duration && elapsed >= recorder->segment.duration) {
+        return true;
     }
 
-    recorder->ctx = avformat_alloc_context();
-    if (!recorder->ctx) {
-        LOG_OOM();
-        return false;
+    if (recorder->segment.size
+            && avio_tell(recorder->ctx->pb) >= recorder->segment.size) {
+        return true;
     }
 
-    char *file_url = sc_str_concat("file:", recorder->filename);
-    if (!file_url) {
-        avformat_free_context(recorder->ctx);
-        return false;
-    }
+    return false;
+}
 
-    int ret = avio_open(&recorder->ctx->pb, file_url, AVIO_FLAG_WRITE);
-    free(file_url);
-    if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
-        avformat_free_context(recorder->ctx);
-        return false;
+static bool
+sc_recorder_write_video(struct sc_recorder *recorder, AVPacket *packet) {
+    // Split on keyframes only, so that each segment is decodable on its own
+    if (sc_recorder_must_split(recorder, packet->pts)) {
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            if (!sc_recorder_open_next_segment(recorder, packet->pts)) {
+                return false;
+            }
+        } else if (recorder->keyframe_controller) {
+            // The stream has no periodic keyframes, request one (again if it
+            // has not been received after some delay)
+            sc_tick now = sc_tick_now();
+            if (now - recorder->last_split_keyframe_request
+                    >= SC_TICK_FROM_SEC(1)) {
+                recorder->last_split_keyframe_request = now;
+                sc_recorder_request_keyframe(recorder);
+            }
+        }
     }
 
-    // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
-    // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
-    // still expects a pointer-to-non-const (it has not be updated accordingly)
-    // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    recorder->ctx->oformat = (AVOutputFormat *) format;
+    return sc_recorder_write_stream(recorder, &recorder->video_stream, packet);
+}
 
-    av_dict_set(&recorder->ctx->metadata, "comment",
-                "Recorded by scrcpy " SCRCPY_VERSION, 0);
+static bool
+sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
+    if (!recorder->video && sc_recorder_must_split(recorder, packet->pts)) {
+        // Without video, split on any audio packet
+        if (!sc_recorder_open_next_segment(recorder, packet->pts)) {
+            return false;
+        }
+    }
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
-    return true;
-}
+    if (packet->pts < recorder->segment.start_pts) {
+        // Captured before the start of the current segment, received after
+        // the segment split (on a video keyframe)
+        return true;
+    }
 
-static void
-sc_recorder_close_output_file(struct sc_recorder *recorder) {
-    avio_close(recorder->ctx->pb);
-    avformat_free_context(recorder->ctx);
+    return sc_recorder_write_stream(recorder, &recorder->audio_stream, packet);
 }
 
 static inline bool
 sc_recorder_must_wait_for_config_packets(struct sc_recorder *recorder) {
-    if (recorder->video && sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (recorder->video && sc_spsc_ring_is_empty(&recorder->video_queue)) {
         // The video queue is empty
         return true;
     }
 
     if (recorder->audio && recorder->audio_expects_config_packet
-            && sc_vecdeque_is_empty(&recorder->audio_queue)) {
+            && sc_spsc_ring_is_empty(&recorder->audio_queue)) {
         // The audio queue is empty (when audio is enabled)
         return true;
     }
@@ -197,39 +1057,65 @@ sc_recorder_must_wait_for_config_packets(struct sc_recorder *recorder) {
 }
 
 static bool
-sc_recorder_process_header(struct sc_recorder *recorder) {
+sc_recorder_is_header_ready(void *userdata) {
+    struct sc_recorder *recorder = userdata;
+
+    // The streams are initialized with the mutex locked. This is only waited
+    // for once, so there is no need to make it lock-free (the mutex is never
+    // locked while notifying, so it may be locked from here).
     sc_mutex_lock(&recorder->mutex);
+    bool ready = recorder->stopped ||
+              !((recorder->video && !recorder->video_init)
+             || (recorder->audio && !recorder->audio_init)
+             || sc_recorder_must_wait_for_config_packets(recorder));
+    sc_mutex_unlock(&recorder->mutex);
 
-    while (!recorder->stopped &&
-              ((recorder->video && !recorder->video_init)
-            || (recorder->audio && !recorder->audio_init)
-            || sc_recorder_must_wait_for_config_packets(recorder))) {
-        sc_cond_wait(&recorder->cond, &recorder->mutex);
-    }
+    return ready;
+}
+
+struct sc_recorder_wait {
+    struct sc_recorder *recorder;
+    // Whether a new packet could be processed from each queue
+    bool video;
+    bool audio;
+};
+
+static bool
+sc_recorder_is_packet_ready(void *userdata) {
+    struct sc_recorder_wait *wait = userdata;
+    struct sc_recorder *recorder = wait->recorder;
+
+    return atomic_load(&recorder->stopped)
+        || (wait->video && !sc_spsc_ring_is_empty(&recorder->video_queue))
+        || (wait->audio && !sc_spsc_ring_is_empty(&recorder->audio_queue));
+}
+
+static bool
+sc_recorder_process_header(struct sc_recorder *recorder) {
+    sc_notifier_wait(&recorder->notifier, sc_recorder_is_header_ready,
+                     recorder);
 
-    if (recorder->video && sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (recorder->video && sc_spsc_ring_is_empty(&recorder->video_queue)) {
         assert(recorder->stopped);
         // If the recorder is stopped, don't process anything if there are not
         // at least video packets
-        sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
+    // The queues are only consumed by this thread, no need to lock
     AVPacket *video_pkt = NULL;
-    if (!sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (!sc_spsc_ring_is_empty(&recorder->video_queue)) {
         assert(recorder->video);
-        video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        video_pkt = sc_recorder_pop(recorder, &recorder->video_queue);
     }
 
     AVPacket *audio_pkt = NULL;
     if (recorder->audio_expects_config_packet &&
-            !sc_vecdeque_is_empty(&recorder->audio_queue)) {
+            !sc_spsc_ring_is_empty(&recorder->audio_queue)) {
         assert(recorder->audio);
-        audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        audio_pkt = sc_recorder_pop(recorder, &recorder->audio_queue);
     }
 
-    sc_mutex_unlock(&recorder->mutex);
-
     int ret = false;
 
     if (video_pkt) {
@@ -262,9 +1148,9 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
         }
     }
 
-    bool ok = avformat_write_header(recorder->ctx, NULL) >= 0;
+    bool ok = sc_recorder_write_header(recorder, recorder->ctx,
+                                       recorder->filename);
     if (!ok) {
-        LOGE("Failed to write header to %s", recorder->filename);
         goto end;
     }
 
@@ -272,10 +1158,10 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
 
 end:
     if (video_pkt) {
-        av_packet_free(&video_pkt);
+        sc_recorder_packet_release(&recorder->video_pool, &video_pkt);
     }
     if (audio_pkt) {
-        av_packet_free(&audio_pkt);
+        sc_recorder_packet_release(&recorder->audio_pool, &audio_pkt);
     }
 
     return ret;
@@ -300,21 +1186,17 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
     bool error = false;
 
     for (;;) {
-        sc_mutex_lock(&recorder->mutex);
+        // Wait until a new packet may be assigned to video_pkt or audio_pkt
+        // and be processed
+        struct sc_recorder_wait wait = {
+            .recorder = recorder,
+            .video = recorder->video && !video_pkt,
+            .audio = recorder->audio && !audio_pkt,
+        };
+        sc_notifier_wait(&recorder->notifier, sc_recorder_is_packet_ready,
+                         &wait);
 
-        while (!recorder->stopped) {
-            if (recorder->video && !video_pkt &&
-                    !sc_vecdeque_is_empty(&recorder->video_queue)) {
-                // A new packet may be assigned to video_pkt and be processed
-                break;
-            }
-            if (recorder->audio && !audio_pkt
-                    && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
-                // A new packet may be assigned to audio_pkt and be processed
-                break;
-            }
-            sc_cond_wait(&recorder->cond, &recorder->mutex);
-        }
+        bool stopped = atomic_load(&recorder->stopped);
 
         // If stopped is set, continue to process the remaining events (to
         // finish the recording) before actually stopping.
@@ -322,43 +1204,37 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         // If there is no video, then the video_queue will remain empty forever
         // and video_pkt will always be NULL.
         assert(recorder->video || (!video_pkt
-                && sc_vecdeque_is_empty(&recorder->video_queue)));
+                && sc_spsc_ring_is_empty(&recorder->video_queue)));
 
         // If there is no audio, then the audio_queue will remain empty forever
         // and audio_pkt will always be NULL.
         assert(recorder->audio || (!audio_pkt
-                && sc_vecdeque_is_empty(&recorder->audio_queue)));
+                && sc_spsc_ring_is_empty(&recorder->audio_queue)));
 
-        if (!video_pkt && !sc_vecdeque_is_empty(&recorder->video_queue)) {
-            video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        // The queues are only consumed by this thread, no need to lock
+        if (!video_pkt) {
+            video_pkt = sc_recorder_pop(recorder, &recorder->video_queue);
         }
 
-        if (!audio_pkt && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
-            audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        if (!audio_pkt) {
+            audio_pkt = sc_recorder_pop(recorder, &recorder->audio_queue);
         }
 
-        if (recorder->stopped && !video_pkt && !audio_pkt) {
-            assert(sc_vecdeque_is_empty(&recorder->video_queue));
-            assert(sc_vecdeque_is_empty(&recorder->audio_queue));
-            sc_mutex_unlock(&recorder->mutex);
+        if (stopped && !video_pkt && !audio_pkt) {
             break;
         }
 
         assert(video_pkt || audio_pkt); // at least one
 
-        sc_mutex_unlock(&recorder->mutex);
-
         // Ignore further config packets (e.g. on device orientation
         // change). The next non-config packet will have the config packet
         // data prepended.
         if (video_pkt && video_pkt->pts == AV_NOPTS_VALUE) {
-            av_packet_free(&video_pkt);
-            video_pkt = NULL;
+            sc_recorder_packet_release(&recorder->video_pool, &video_pkt);
         }
 
         if (audio_pkt && audio_pkt->pts == AV_NOPTS_VALUE) {
-            av_packet_free(&audio_pkt);
-            audio_pkt = NULL;
+            sc_recorder_packet_release(&recorder->audio_pool, &audio_pkt);
         }
 
         if (pts_origin == AV_NOPTS_VALUE) {
@@ -370,7 +1246,7 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 pts_origin = audio_pkt->pts;
             } else if (video_pkt && audio_pkt) {
                 pts_origin = MIN(video_pkt->pts, audio_pkt->pts);
-            } else if (recorder->stopped) {
+            } else if (stopped) {
                 if (video_pkt) {
                     // The recorder is stopped without audio, record the video
                     // packets
@@ -388,6 +1264,12 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
 
         assert(pts_origin != AV_NOPTS_VALUE);
 
+        if (recorder->sync.clock
+                && recorder->sync.pts_origin == AV_NOPTS_VALUE) {
+            recorder->sync.pts_origin = pts_origin;
+            sc_recorder_write_sync(recorder);
+        }
+
         if (video_pkt) {
             video_pkt->pts -= pts_origin;
             video_pkt->dts = video_pkt->pts;
@@ -398,7 +1280,8 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                                              - video_pkt_previous->pts;
 
                 bool ok = sc_recorder_write_video(recorder, video_pkt_previous);
-                av_packet_free(&video_pkt_previous);
+                sc_recorder_packet_release(&recorder->video_pool,
+                                           &video_pkt_previous);
                 if (!ok) {
                     LOGE("Could not record video packet");
                     error = true;
@@ -421,8 +1304,7 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 goto end;
             }
 
-            av_packet_free(&audio_pkt);
-            audio_pkt = NULL;
+            sc_recorder_packet_release(&recorder->audio_pool, &audio_pkt);
         }
     }
 
@@ -438,7 +1320,13 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
             // will still be valid
             LOGW("Could not record last packet");
         }
-        av_packet_free(&last);
+        sc_recorder_packet_release(&recorder->video_pool,
+                                   &video_pkt_previous);
+    }
+
+    if (recorder->sync.clock && recorder->sync.pts_origin != AV_NOPTS_VALUE) {
+        // Rewrite with the estimation refined during the recording
+        sc_recorder_write_sync(recorder);
     }
 
     int ret = av_write_trailer(recorder->ctx);
@@ -448,11 +1336,14 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
     }
 
 end:
+    if (video_pkt_previous) {
+        sc_recorder_packet_release(&recorder->video_pool, &video_pkt_previous);
+    }
     if (video_pkt) {
-        av_packet_free(&video_pkt);
+        sc_recorder_packet_release(&recorder->video_pool, &video_pkt);
     }
     if (audio_pkt) {
-        av_packet_free(&audio_pkt);
+        sc_recorder_packet_release(&recorder->audio_pool, &audio_pkt);
     }
 
     return !error;
@@ -460,14 +1351,22 @@ end:
 
 static bool
 sc_recorder_record(struct sc_recorder *recorder) {
-    bool ok = sc_recorder_open_output_file(recorder);
-    if (!ok) {
-        return false;
-    }
+    bool ok = sc_recorder_process_packets(recorder);
+    // The pending data is written to the storage on close
+    bool closed = sc_recorder_close_output_file(recorder);
+    return ok && closed;
+}
 
-    ok = sc_recorder_process_packets(recorder);
-    sc_recorder_close_output_file(recorder);
-    return ok;
+static void
+sc_recorder_log_dropped(struct sc_recorder_stream *stream, const char *name) {
+    uint64_t packets = atomic_load_explicit(&stream->dropped_packets,
+                                            memory_order_relaxed);
+    if (packets) {
+        uint64_t bytes = atomic_load_explicit(&stream->dropped_bytes,
+                                              memory_order_relaxed);
+        LOGW("Recording: %" PRIu64 " %s packets dropped (%" PRIu64 " bytes)",
+             packets, name, bytes);
+    }
 }
 
 static int
@@ -478,15 +1377,23 @@ run_recorder(void *data) {
     bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_LOW);
     (void) ok; // We don't care if it worked
 
+    sc_thread_apply_sched(recorder->thread_sched);
+
     bool success = sc_recorder_record(recorder);
 
     sc_mutex_lock(&recorder->mutex);
     // Prevent the producer to push any new packet
     recorder->stopped = true;
-    // Discard pending packets
+    sc_cond_broadcast(&recorder->queue_cond);
+    sc_mutex_unlock(&recorder->mutex);
+
+    // Discard pending packets (a packet pushed concurrently is discarded on
+    // destroy)
     sc_recorder_queue_clear(&recorder->video_queue);
     sc_recorder_queue_clear(&recorder->audio_queue);
-    sc_mutex_unlock(&recorder->mutex);
+
+    sc_recorder_log_dropped(&recorder->video_stream, "video");
+    sc_recorder_log_dropped(&recorder->audio_stream, "audio");
 
     if (success) {
         const char *format_name = sc_recorder_get_format_name(recorder->format);
@@ -503,42 +1410,6 @@ run_recorder(void *data) {
     return 0;
 }
 
-static bool
-sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
-    assert(!sc_orientation_is_mirror(orientation));
-
-    uint8_t *raw_data;
-#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
-    AVPacketSideData *sd =
-        av_packet_side_data_new(&stream->codecpar->coded_side_data,
-                                &stream->codecpar->nb_coded_side_data,
-                                AV_PKT_DATA_DISPLAYMATRIX,
-                                sizeof(int32_t) * 9, 0);
-    if (!sd) {
-        LOG_OOM();
-        return false;
-    }
-
-    raw_data = sd->data;
-#else
-    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
-                                      sizeof(int32_t) * 9);
-    if (!raw_data) {
-        LOG_OOM();
-        return false;
-    }
-#endif
-
-    int32_t *matrix = (int32_t *) raw_data;
-
-    unsigned rotation = orientation;
-    unsigned angle = rotation * 90;
-
-    av_display_rotation_set(matrix, angle);
-
-    return true;
-}
-
 static bool
 sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
                                    AVCodecContext *ctx) {
@@ -577,9 +1448,10 @@ sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
     }
 
     recorder->video_init = true;
-    sc_cond_signal(&recorder->cond);
     sc_mutex_unlock(&recorder->mutex);
 
+    sc_notifier_notify(&recorder->notifier);
+
     return true;
 }
 
@@ -592,8 +1464,9 @@ sc_recorder_video_packet_sink_close(struct sc_packet_sink *sink) {
     sc_mutex_lock(&recorder->mutex);
     // EOS also stops the recorder
     recorder->stopped = true;
-    sc_cond_signal(&recorder->cond);
     sc_mutex_unlock(&recorder->mutex);
+
+    sc_notifier_notify(&recorder->notifier);
 }
 
 static bool
@@ -603,34 +1476,19 @@ sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
     // only written from this thread, no need to lock
     assert(recorder->video_init);
 
-    sc_mutex_lock(&recorder->mutex);
-
-    if (recorder->stopped) {
-        // reject any new packet
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    AVPacket *rec = sc_recorder_packet_ref(packet);
-    if (!rec) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    rec->stream_index = recorder->video_stream.index;
-
-    bool ok = sc_vecdeque_push(&recorder->video_queue, rec);
-    if (!ok) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
+    if (!recorder->video_keyframe_received
+            && packet->pts != AV_NOPTS_VALUE) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            // The recorder has been attached to a running stream, the
+            // packets before the first keyframe could not be decoded
+            return true;
+        }
+        recorder->video_keyframe_received = true;
     }
 
-    sc_cond_signal(&recorder->cond);
-
-    sc_mutex_unlock(&recorder->mutex);
-    return true;
+    return sc_recorder_push(recorder, &recorder->video_stream,
+                            &recorder->video_queue, &recorder->video_pool, true,
+                            packet);
 }
 
 static bool
@@ -662,9 +1520,10 @@ sc_recorder_audio_packet_sink_open(struct sc_packet_sink *sink,
         ctx->codec_id != AV_CODEC_ID_PCM_S16LE;
 
     recorder->audio_init = true;
-    sc_cond_signal(&recorder->cond);
     sc_mutex_unlock(&recorder->mutex);
 
+    sc_notifier_notify(&recorder->notifier);
+
     return true;
 }
 
@@ -678,8 +1537,9 @@ sc_recorder_audio_packet_sink_close(struct sc_packet_sink *sink) {
     sc_mutex_lock(&recorder->mutex);
     // EOS also stops the recorder
     recorder->stopped = true;
-    sc_cond_signal(&recorder->cond);
     sc_mutex_unlock(&recorder->mutex);
+
+    sc_notifier_notify(&recorder->notifier);
 }
 
 static bool
@@ -690,34 +1550,9 @@ sc_recorder_audio_packet_sink_push(struct sc_packet_sink *sink,
     // only written from this thread, no need to lock
     assert(recorder->audio_init);
 
-    sc_mutex_lock(&recorder->mutex);
-
-    if (recorder->stopped) {
-        // reject any new packet
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    AVPacket *rec = sc_recorder_packet_ref(packet);
-    if (!rec) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    rec->stream_index = recorder->audio_stream.index;
-
-    bool ok = sc_vecdeque_push(&recorder->audio_queue, rec);
-    if (!ok) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    sc_cond_signal(&recorder->cond);
-
-    sc_mutex_unlock(&recorder->mutex);
-    return true;
+    return sc_recorder_push(recorder, &recorder->audio_stream,
+                            &recorder->audio_queue, &recorder->audio_pool,
+                            false, packet);
 }
 
 static void
@@ -732,22 +1567,30 @@ sc_recorder_audio_packet_sink_disable(struct sc_packet_sink *sink) {
     sc_mutex_lock(&recorder->mutex);
     recorder->audio = false;
     recorder->audio_init = true;
-    sc_cond_signal(&recorder->cond);
     sc_mutex_unlock(&recorder->mutex);
+
+    sc_notifier_notify(&recorder->notifier);
 }
 
 static void
 sc_recorder_stream_init(struct sc_recorder_stream *stream) {
     stream->index = -1;
     stream->last_pts = AV_NOPTS_VALUE;
+    stream->dropping = false;
+    atomic_init(&stream->dropped_packets, 0);
+    atomic_init(&stream->dropped_bytes, 0);
+    stream->dropped_packets_metric = NULL;
 }
 
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
                  enum sc_orientation orientation,
+                 const struct sc_recorder_segment_params *segment,
+                 uint32_t memory_limit,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata) {
     assert(!sc_orientation_is_mirror(orientation));
+    assert(memory_limit);
 
     recorder->filename = strdup(filename);
     if (!recorder->filename) {
@@ -760,22 +1603,61 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
         goto error_free_filename;
     }
 
-    ok = sc_cond_init(&recorder->cond);
+    ok = sc_notifier_init(&recorder->notifier);
     if (!ok) {
         goto error_mutex_destroy;
     }
 
+    ok = sc_cond_init(&recorder->queue_cond);
+    if (!ok) {
+        goto error_notifier_destroy;
+    }
+
+    ok = sc_spsc_ring_init(&recorder->video_queue, SC_RECORDER_QUEUE_CAPACITY);
+    if (!ok) {
+        LOG_OOM();
+        goto error_queue_cond_destroy;
+    }
+
+    ok = sc_spsc_ring_init(&recorder->audio_queue, SC_RECORDER_QUEUE_CAPACITY);
+    if (!ok) {
+        LOG_OOM();
+        goto error_video_queue_destroy;
+    }
+
+    ok = sc_spsc_ring_init(&recorder->video_pool, SC_RECORDER_POOL_CAPACITY);
+    if (!ok) {
+        LOG_OOM();
+        goto error_audio_queue_destroy;
+    }
+
+    ok = sc_spsc_ring_init(&recorder->audio_pool, SC_RECORDER_POOL_CAPACITY);
+    if (!ok) {
+        LOG_OOM();
+        goto error_video_pool_destroy;
+    }
+
     assert(video || audio);
     recorder->video = video;
     recorder->audio = audio;
 
     recorder->orientation = orientation;
 
-    sc_vecdeque_init(&recorder->video_queue);
-    sc_vecdeque_init(&recorder->audio_queue);
-    recorder->stopped = false;
+    atomic_init(&recorder->stopped, false);
+    atomic_init(&recorder->pending_bytes, 0);
+    recorder->memory_limit = memory_limit;
+    recorder->pending_bytes_metric = NULL;
+    recorder->blocking = false;
+    recorder->fragment_duration = 0;
+    recorder->keyframe_index = false;
+    recorder->upload = NULL;
+    recorder->upload_only = false;
 
     recorder->video_init = false;
+    recorder->video_keyframe_received = false;
+    recorder->keyframe_controller = NULL;
+    recorder->last_split_keyframe_request = 0;
+    recorder->thread_sched = NULL;
     recorder->audio_init = false;
 
     recorder->audio_expects_config_packet = false;
@@ -785,6 +1667,16 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     recorder->format = format;
 
+    recorder->segment.duration = segment ? segment->duration : 0;
+    recorder->segment.size = segment ? segment->size : 0;
+    recorder->segment.count = segment ? segment->count : 0;
+    recorder->segment.index = 1;
+    recorder->segment.start_pts = 0;
+
+    recorder->sync.clock = NULL;
+    recorder->sync.source = SC_STREAM_CLOCK_SOURCE_VIDEO;
+    recorder->sync.pts_origin = AV_NOPTS_VALUE;
+
     assert(cbs && cbs->on_ended);
     recorder->cbs = cbs;
     recorder->cbs_userdata = cbs_userdata;
@@ -812,6 +1704,16 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     return true;
 
+error_video_pool_destroy:
+    sc_spsc_ring_destroy(&recorder->video_pool);
+error_audio_queue_destroy:
+    sc_spsc_ring_destroy(&recorder->audio_queue);
+error_video_queue_destroy:
+    sc_spsc_ring_destroy(&recorder->video_queue);
+error_queue_cond_destroy:
+    sc_cond_destroy(&recorder->queue_cond);
+error_notifier_destroy:
+    sc_notifier_destroy(&recorder->notifier);
 error_mutex_destroy:
     sc_mutex_destroy(&recorder->mutex);
 error_free_filename:
@@ -820,12 +1722,92 @@ error_free_filename:
     return false;
 }
 
+void
+sc_recorder_set_blocking(struct sc_recorder *recorder) {
+    recorder->blocking = true;
+}
+
+void
+sc_recorder_set_fragment_duration(struct sc_recorder *recorder,
+                                  sc_tick duration) {
+    recorder->fragment_duration = duration;
+}
+
+void
+sc_recorder_set_keyframe_index(struct sc_recorder *recorder) {
+#ifdef SCRCPY_LAVF_HAS_AVIO_DATA_MARKERS
+    recorder->keyframe_index = true;
+#else
+    LOGW("Keyframe index not supported by this FFmpeg version");
+#endif
+}
+
+void
+sc_recorder_set_upload(struct sc_recorder *recorder,
+                       const struct sc_s3_target *target, bool upload_only) {
+    assert(target);
+    recorder->upload = target;
+    recorder->upload_only = upload_only;
+}
+
+void
+sc_recorder_set_keyframe_requester(struct sc_recorder *recorder,
+                                   struct sc_controller *controller) {
+    recorder->keyframe_controller = controller;
+}
+
+void
+sc_recorder_set_metrics(struct sc_recorder *recorder,
+                        struct sc_metrics *metrics) {
+    if (recorder->video) {
+        recorder->video_stream.dropped_packets_metric =
+            sc_metrics_register_counter(metrics,
+                                        "scrcpy_recorder_video_dropped_total",
+                                        "Video packets dropped by the "
+                                        "recorder");
+    }
+    if (recorder->audio) {
+        recorder->audio_stream.dropped_packets_metric =
+            sc_metrics_register_counter(metrics,
+                                        "scrcpy_recorder_audio_dropped_total",
+                                        "Audio packets dropped by the "
+                                        "recorder");
+    }
+    recorder->pending_bytes_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_recorder_pending_bytes",
+                                  "Size of the packets queued for recording");
+}
+
+void
+sc_recorder_set_sync_clock(struct sc_recorder *recorder,
+                           struct sc_stream_clock *clock) {
+    recorder->sync.clock = clock;
+    // The video and audio PTS are in the same device time base, but each
+    // stream has its own transit delay: map from the video if any
+    recorder->sync.source = recorder->video ? SC_STREAM_CLOCK_SOURCE_VIDEO
+                                            : SC_STREAM_CLOCK_SOURCE_AUDIO;
+}
+
+void
+sc_recorder_set_thread_sched(struct sc_recorder *recorder,
+                             const struct sc_thread_sched *sched) {
+    recorder->thread_sched = sched;
+}
+
 bool
 sc_recorder_start(struct sc_recorder *recorder) {
-    bool ok = sc_thread_create(&recorder->thread, run_recorder,
-                               "scrcpy-recorder", recorder);
+    // Open the output file before the packet sinks may be opened (they add
+    // the streams to the output context)
+    bool ok = sc_recorder_open_output_file(recorder);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_thread_create(&recorder->thread, run_recorder, "scrcpy-recorder",
+                          recorder);
     if (!ok) {
         LOGE("Could not start recorder thread");
+        sc_recorder_close_output_file(recorder);
         return false;
     }
 
@@ -836,8 +1818,10 @@ void
 sc_recorder_stop(struct sc_recorder *recorder) {
     sc_mutex_lock(&recorder->mutex);
     recorder->stopped = true;
-    sc_cond_signal(&recorder->cond);
+    sc_cond_broadcast(&recorder->queue_cond);
     sc_mutex_unlock(&recorder->mutex);
+
+    sc_notifier_notify(&recorder->notifier);
 }
 
 void
@@ -847,7 +1831,17 @@ sc_recorder_join(struct sc_recorder *recorder) {
 
 void
 sc_recorder_destroy(struct sc_recorder *recorder) {
-    sc_cond_destroy(&recorder->cond);
+    // The demuxers are stopped, there is no concurrent access to the queues
+    sc_recorder_queue_clear(&recorder->video_queue);
+    sc_recorder_queue_clear(&recorder->audio_queue);
+    sc_recorder_queue_clear(&recorder->video_pool);
+    sc_recorder_queue_clear(&recorder->audio_pool);
+    sc_spsc_ring_destroy(&recorder->video_queue);
+    sc_spsc_ring_destroy(&recorder->audio_queue);
+    sc_spsc_ring_destroy(&recorder->video_pool);
+    sc_spsc_ring_destroy(&recorder->audio_pool);
+    sc_cond_destroy(&recorder->queue_cond);
+    sc_notifier_destroy(&recorder->notifier);
     sc_mutex_destroy(&recorder->mutex);
     free(recorder->filename);
 }
@@ -3,21 +3,55 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <libavcodec/packet.h>
 #include <libavformat/avformat.h>
 
+#include "controller.h"
 #include "options.h"
+#include "s3_upload.h"
+#include "stream_clock.h"
 #include "trait/packet_sink.h"
+#include "util/async_file.h"
+#include "util/metrics.h"
+#include "util/notifier.h"
+#include "util/spsc_ring.h"
 #include "util/thread.h"
-#include "util/vecdeque.h"
+#include "util/tick.h"
 
-struct sc_recorder_queue SC_VECDEQUE(AVPacket *);
+struct sc_recorder_packet_ring SC_SPSC_RING(AVPacket *);
+
+struct sc_recorder_segment_params {
+    sc_tick duration; // 0 for no duration limit
+    uint32_t size; // in bytes, 0 for no size limit
+    unsigned count; // number of segments to keep, 0 to keep all
+};
+
+// Opaque of the AVIOContext of an output file
+struct sc_recorder_output {
+    bool local; // the file is written locally
+    struct sc_async_file file;
+    bool uploading; // the file is uploaded (until the upload fails)
+    struct sc_s3_upload upload;
+    int64_t pos; // current position in the file
+    FILE *index; // keyframe index, NULL if disabled
+};
 
 struct sc_recorder_stream {
     int index;
     int64_t last_pts;
+
+    // Only accessed by the demuxer thread of the stream: set while the
+    // packets are dropped because the memory limit is exceeded
+    bool dropping;
+
+    // Written by the demuxer thread, read by the recorder thread
+    atomic_uint_least64_t dropped_packets;
+    atomic_uint_least64_t dropped_bytes;
+
+    struct sc_metric *dropped_packets_metric; // may be NULL
 };
 
 struct sc_recorder {
@@ -41,13 +75,69 @@ struct sc_recorder {
     enum sc_record_format format;
     AVFormatContext *ctx;
 
+    // If a duration or a size is set, the recording is split into several
+    // files "<name>-<index>.<ext>", starting on video keyframes
+    struct {
+        sc_tick duration;
+        uint32_t size;
+        unsigned count;
+        unsigned index; // current segment, starting from 1
+        int64_t start_pts; // relative to the start of the recording
+    } segment;
+
     sc_thread thread;
     sc_mutex mutex;
-    sc_cond cond;
+    // wake up the recorder thread (the packet sinks only lock a mutex if it
+    // is waiting)
+    struct sc_notifier notifier;
     // set on sc_recorder_stop(), packet_sink close or recording failure
-    bool stopped;
-    struct sc_recorder_queue video_queue;
-    struct sc_recorder_queue audio_queue;
+    // (always written with the mutex locked, but read without lock by the
+    // packet sinks)
+    atomic_bool stopped;
+    // signaled when packets are consumed (only in blocking mode) or when the
+    // recorder is stopped
+    sc_cond queue_cond;
+
+    // If set, the packet sinks wait for space in the queues rather than
+    // dropping packets (for sources which are not live)
+    bool blocking;
+
+    // If set, MP4 files are fragmented, with fragments of at most this
+    // duration (also started on every video keyframe)
+    sc_tick fragment_duration;
+    // If set, write the position of the keyframes to "<file>.idx"
+    bool keyframe_index;
+    // If set, write the dates of the start of each file to "<file>.sync", to
+    // align the recordings of several devices
+    struct {
+        struct sc_stream_clock *clock; // NULL if disabled
+        enum sc_stream_clock_source source;
+        // Device PTS of the start of the recording (only accessed from the
+        // recorder thread)
+        int64_t pts_origin;
+    } sync;
+    // If set, upload the files while they are written (the output is not
+    // seekable)
+    const struct sc_s3_target *upload;
+    // If set, do not write the files locally
+    bool upload_only;
+
+    // Packets pushed by the demuxer threads, consumed by the recorder thread
+    // (one producer and one consumer per queue, so they are lock-free)
+    struct sc_recorder_packet_ring video_queue;
+    struct sc_recorder_packet_ring audio_queue;
+
+    // Packets released by the recorder thread, reused by the demuxer threads
+    // to avoid an allocation per packet
+    struct sc_recorder_packet_ring video_pool;
+    struct sc_recorder_packet_ring audio_pool;
+
+    // Total size of the packets in the queues, not exceeding memory_limit
+    // (except for config packets, which are never dropped)
+    atomic_uint_least64_t pending_bytes;
+    uint32_t memory_limit;
+    // Approximate pending_bytes, for monitoring (NULL if metrics are disabled)
+    struct sc_metric *pending_bytes_metric;
 
     // wake up the recorder thread once the video or audio codec is known
     bool video_init;
@@ -55,6 +145,20 @@ struct sc_recorder {
 
     bool audio_expects_config_packet;
 
+    // Set once the first video keyframe has been received (only accessed from
+    // the video demuxer thread)
+    bool video_keyframe_received;
+
+    // If set, request a keyframe when one is needed (to split a segment or to
+    // resume after dropping packets), because the stream has no periodic
+    // keyframes (--video-intra-refresh)
+    struct sc_controller *keyframe_controller;
+    // Last keyframe request for a segment split (only accessed from the
+    // recorder thread)
+    sc_tick last_split_keyframe_request;
+
+    const struct sc_thread_sched *thread_sched; // may be NULL
+
     struct sc_recorder_stream video_stream;
     struct sc_recorder_stream audio_stream;
 
@@ -71,8 +175,62 @@ bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
                  enum sc_orientation orientation,
+                 const struct sc_recorder_segment_params *segment,
+                 uint32_t memory_limit,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata);
 
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_blocking(struct sc_recorder *recorder);
+
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_fragment_duration(struct sc_recorder *recorder,
+                                  sc_tick duration);
+
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_keyframe_index(struct sc_recorder *recorder);
+
+// Write the dates of the timestamp 0 of each file to "<file>.sync", mapped
+// from the device time by the session stream clock
+//
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_sync_clock(struct sc_recorder *recorder,
+                           struct sc_stream_clock *clock);
+
+// Upload the files to S3-compatible object storage while they are written
+//
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_upload(struct sc_recorder *recorder,
+                       const struct sc_s3_target *target, bool upload_only);
+
+// Request keyframes from the device when they are needed, instead of waiting
+// for the next periodic keyframe
+//
+// Must be called before the packet sinks receive any packet.
+void
+sc_recorder_set_keyframe_requester(struct sc_recorder *recorder,
+                                   struct sc_controller *controller);
+
+// Apply scheduling constraints to the recorder thread (for example to keep it
+// away from the CPUs of the latency-critical threads)
+//
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_thread_sched(struct sc_recorder *recorder,
+                             const struct sc_thread_sched *sched);
+
+// Register the recorder metrics to the registry
+//
+// Must be called before sc_recorder_start()
+void
+sc_recorder_set_metrics(struct sc_recorder *recorder,
+                        struct sc_metrics *metrics);
+
+// Open the output file and start the recorder thread
 bool
 sc_recorder_start(struct sc_recorder *recorder);
 
@@ -85,4 +243,13 @@ sc_recorder_join(struct sc_recorder *recorder);
 void
 sc_recorder_destroy(struct sc_recorder *recorder);
 
+// Return "<name>-<date>-<time>-<ms>.<ext>" for a filename "<name>.<ext>"
+//
+// If this file already exists, a counter is appended to the time so that an
+// existing file is never overwritten.
+//
+// Must be called from the main thread.
+char *
+sc_recorder_get_dated_filename(const char *filename);
+
 #endif
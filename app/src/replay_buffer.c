@@ -0,0 +1,667 @@
+#include "replay_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+#include "util/memory.h"
+
+/** Downcast packet sinks to replay buffer */
+#define DOWNCAST_VIDEO(SINK) \
+    container_of(SINK, struct sc_replay_buffer, video_packet_sink)
+#define DOWNCAST_AUDIO(SINK) \
+    container_of(SINK, struct sc_replay_buffer, audio_packet_sink)
+
+// Maximum number of released packets kept for reuse
+#define SC_REPLAY_BUFFER_POOL_CAPACITY 128
+
+// While saving, the packets are pushed to the recorder as fast as it can mux
+// them, so its queues only need to hold a small part of the replay
+#define SC_REPLAY_BUFFER_RECORDER_MEMORY_LIMIT 64000000
+
+// Memory retained by a packet: its whole buffer (which may be larger than the
+// packet data), not only its data
+static size_t
+sc_replay_buffer_packet_bytes(const AVPacket *packet) {
+    return packet->buf ? packet->buf->size : (size_t) packet->size;
+}
+
+// Must be called with the mutex locked
+static AVPacket *
+sc_replay_buffer_packet_ref(struct sc_replay_buffer *rb,
+                            const AVPacket *packet) {
+    AVPacket *p;
+    if (!sc_vecdeque_is_empty(&rb->pool)) {
+        p = sc_vecdeque_pop(&rb->pool);
+    } else {
+        p = av_packet_alloc();
+        if (!p) {
+            LOG_OOM();
+            return NULL;
+        }
+    }
+
+    if (av_packet_ref(p, packet)) {
+        av_packet_free(&p);
+        return NULL;
+    }
+
+    rb->bytes += sc_replay_buffer_packet_bytes(p);
+    return p;
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_packet_release(struct sc_replay_buffer *rb,
+                                AVPacket *packet) {
+    size_t bytes = sc_replay_buffer_packet_bytes(packet);
+    assert(rb->bytes >= bytes);
+    rb->bytes -= bytes;
+    av_packet_unref(packet);
+    if (sc_vecdeque_size(&rb->pool) >= SC_REPLAY_BUFFER_POOL_CAPACITY
+            || !sc_vecdeque_push(&rb->pool, packet)) {
+        av_packet_free(&packet);
+    }
+}
+
+static void
+sc_replay_buffer_stream_init(struct sc_replay_buffer_stream *stream) {
+    stream->codecpar = NULL;
+    stream->config = NULL;
+    sc_vecdeque_init(&stream->packets);
+}
+
+static void
+sc_replay_buffer_stream_destroy(struct sc_replay_buffer_stream *stream) {
+    while (!sc_vecdeque_is_empty(&stream->packets)) {
+        AVPacket *packet = sc_vecdeque_pop(&stream->packets);
+        av_packet_free(&packet);
+    }
+    sc_vecdeque_destroy(&stream->packets);
+    av_packet_free(&stream->config);
+    avcodec_parameters_free(&stream->codecpar);
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_trim_audio(struct sc_replay_buffer *rb, int64_t start_pts) {
+    struct sc_replay_buffer_stream *audio = &rb->audio;
+    while (!sc_vecdeque_is_empty(&audio->packets)) {
+        AVPacket *packet = *sc_vecdeque_at(&audio->packets, 0);
+        if (packet->pts >= start_pts) {
+            break;
+        }
+        (void) sc_vecdeque_pop(&audio->packets);
+        sc_replay_buffer_packet_release(rb, packet);
+    }
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_trim_video(struct sc_replay_buffer *rb, int64_t pts) {
+    struct sc_replay_buffer_stream *video = &rb->video;
+
+    // Drop the oldest GOP as long as the next one still covers the duration
+    while (sc_vecdeque_size(&rb->gops) >= 2) {
+        size_t count = *sc_vecdeque_at(&rb->gops, 0);
+        AVPacket *next = *sc_vecdeque_at(&video->packets, count);
+        if (next->pts > pts - rb->duration) {
+            break;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            AVPacket *packet = sc_vecdeque_pop(&video->packets);
+            sc_replay_buffer_packet_release(rb, packet);
+        }
+        (void) sc_vecdeque_pop(&rb->gops);
+    }
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_update_metrics(struct sc_replay_buffer *rb) {
+    size_t packets = sc_vecdeque_size(&rb->video.packets)
+                   + sc_vecdeque_size(&rb->audio.packets);
+    sc_metric_set(rb->metrics.packets, packets);
+    sc_metric_set(rb->metrics.bytes, rb->bytes);
+    sc_metric_set(rb->metrics.pooled, sc_vecdeque_size(&rb->pool));
+}
+
+// Must be called with the mutex locked
+static bool
+sc_replay_buffer_set_config(struct sc_replay_buffer_stream *stream,
+                            const AVPacket *packet) {
+    if (!stream->config) {
+        stream->config = av_packet_alloc();
+        if (!stream->config) {
+            LOG_OOM();
+            return false;
+        }
+    } else {
+        av_packet_unref(stream->config);
+    }
+
+    if (av_packet_ref(stream->config, packet)) {
+        av_packet_free(&stream->config);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_replay_buffer_stream_open(struct sc_replay_buffer *rb,
+                             struct sc_replay_buffer_stream *stream,
+                             AVCodecContext *ctx) {
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (!codecpar) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (avcodec_parameters_from_context(codecpar, ctx) < 0) {
+        avcodec_parameters_free(&codecpar);
+        return false;
+    }
+
+    sc_mutex_lock(&rb->mutex);
+    assert(!stream->codecpar);
+    stream->codecpar = codecpar;
+    sc_mutex_unlock(&rb->mutex);
+
+    return true;
+}
+
+static bool
+sc_replay_buffer_video_packet_sink_open(struct sc_packet_sink *sink,
+                                        AVCodecContext *ctx) {
+    struct sc_replay_buffer *rb = DOWNCAST_VIDEO(sink);
+    return sc_replay_buffer_stream_open(rb, &rb->video, ctx);
+}
+
+static void
+sc_replay_buffer_video_packet_sink_close(struct sc_packet_sink *sink) {
+    // The buffered packets are kept, they may still be saved
+    (void) sink;
+}
+
+static bool
+sc_replay_buffer_video_packet_sink_push(struct sc_packet_sink *sink,
+                                        const AVPacket *packet) {
+    struct sc_replay_buffer *rb = DOWNCAST_VIDEO(sink);
+    struct sc_replay_buffer_stream *video = &rb->video;
+
+    sc_mutex_lock(&rb->mutex);
+
+    bool ok;
+    if (packet->pts == AV_NOPTS_VALUE) {
+        ok = sc_replay_buffer_set_config(video, packet);
+        goto end;
+    }
+
+    bool key = packet->flags & AV_PKT_FLAG_KEY;
+    if (!key && sc_vecdeque_is_empty(&rb->gops)) {
+        // The packet could not be decoded without the previous ones
+        ok = true;
+        goto end;
+    }
+
+    if (key) {
+        // Reserve the slot for the new GOP, so that it may not fail once the
+        // packet is pushed
+        size_t mincap = sc_vecdeque_size(&rb->gops) + 1;
+        ok = sc_vecdeque_reserve(&rb->gops, mincap);
+        if (!ok) {
+            LOG_OOM();
+            goto end;
+        }
+    }
+
+    AVPacket *p = sc_replay_buffer_packet_ref(rb, packet);
+    if (!p) {
+        ok = false;
+        goto end;
+    }
+
+    ok = sc_vecdeque_push(&video->packets, p);
+    if (!ok) {
+        LOG_OOM();
+        sc_replay_buffer_packet_release(rb, p);
+        goto end;
+    }
+
+    if (key) {
+        sc_vecdeque_push_noresize(&rb->gops, 1);
+    } else {
+        ++*sc_vecdeque_back(&rb->gops);
+    }
+
+    sc_replay_buffer_trim_video(rb, packet->pts);
+    // Do not keep audio older than the video
+    AVPacket *first = *sc_vecdeque_at(&video->packets, 0);
+    sc_replay_buffer_trim_audio(rb, first->pts);
+
+end:
+    sc_replay_buffer_update_metrics(rb);
+    sc_mutex_unlock(&rb->mutex);
+
+    return ok;
+}
+
+static bool
+sc_replay_buffer_audio_packet_sink_open(struct sc_packet_sink *sink,
+                                        AVCodecContext *ctx) {
+    struct sc_replay_buffer *rb = DOWNCAST_AUDIO(sink);
+    return sc_replay_buffer_stream_open(rb, &rb->audio, ctx);
+}
+
+static void
+sc_replay_buffer_audio_packet_sink_close(struct sc_packet_sink *sink) {
+    // The buffered packets are kept, they may still be saved
+    (void) sink;
+}
+
+static bool
+sc_replay_buffer_audio_packet_sink_push(struct sc_packet_sink *sink,
+                                        const AVPacket *packet) {
+    struct sc_replay_buffer *rb = DOWNCAST_AUDIO(sink);
+    struct sc_replay_buffer_stream *audio = &rb->audio;
+
+    sc_mutex_lock(&rb->mutex);
+
+    bool ok;
+    if (packet->pts == AV_NOPTS_VALUE) {
+        ok = sc_replay_buffer_set_config(audio, packet);
+        goto end;
+    }
+
+    AVPacket *p = sc_replay_buffer_packet_ref(rb, packet);
+    if (!p) {
+        ok = false;
+        goto end;
+    }
+
+    ok = sc_vecdeque_push(&audio->packets, p);
+    if (!ok) {
+        LOG_OOM();
+        sc_replay_buffer_packet_release(rb, p);
+        goto end;
+    }
+
+    if (!sc_vecdeque_is_empty(&rb->video.packets)) {
+        // Do not keep audio older than the video
+        AVPacket *first = *sc_vecdeque_at(&rb->video.packets, 0);
+        sc_replay_buffer_trim_audio(rb, first->pts);
+    } else {
+        sc_replay_buffer_trim_audio(rb, packet->pts - rb->duration);
+    }
+
+end:
+    sc_replay_buffer_update_metrics(rb);
+    sc_mutex_unlock(&rb->mutex);
+
+    return ok;
+}
+
+static void
+sc_replay_buffer_snapshot_init(struct sc_replay_buffer_snapshot *snapshot) {
+    snapshot->ctx = NULL;
+    snapshot->config = NULL;
+    snapshot->packets = NULL;
+    snapshot->count = 0;
+}
+
+static void
+sc_replay_buffer_snapshot_destroy(struct sc_replay_buffer_snapshot *snapshot) {
+    for (size_t i = 0; i < snapshot->count; ++i) {
+        av_packet_free(&snapshot->packets[i]);
+    }
+    free(snapshot->packets);
+    av_packet_free(&snapshot->config);
+    avcodec_free_context(&snapshot->ctx);
+}
+
+// Must be called with the mutex locked
+static bool
+sc_replay_buffer_snapshot_stream(struct sc_replay_buffer_snapshot *snapshot,
+                                 struct sc_replay_buffer_stream *stream) {
+    sc_replay_buffer_snapshot_init(snapshot);
+
+    if (!stream->codecpar) {
+        // Not open (or disabled)
+        return true;
+    }
+
+    bool raw = stream->codecpar->codec_id == AV_CODEC_ID_PCM_S16LE;
+    if (!stream->config && !raw) {
+        // Nothing could be decoded
+        return true;
+    }
+
+    snapshot->ctx = avcodec_alloc_context3(NULL);
+    if (!snapshot->ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (avcodec_parameters_to_context(snapshot->ctx, stream->codecpar) < 0) {
+        goto error;
+    }
+
+    if (stream->config) {
+        snapshot->config = av_packet_clone(stream->config);
+        if (!snapshot->config) {
+            LOG_OOM();
+            goto error;
+        }
+    }
+
+    size_t count = sc_vecdeque_size(&stream->packets);
+    if (count) {
+        snapshot->packets = sc_allocarray(count, sizeof(*snapshot->packets));
+        if (!snapshot->packets) {
+            LOG_OOM();
+            goto error;
+        }
+
+        // The packets are reference-counted, their data is not copied
+        for (size_t i = 0; i < count; ++i) {
+            AVPacket *packet = *sc_vecdeque_at(&stream->packets, i);
+            snapshot->packets[i] = av_packet_clone(packet);
+            if (!snapshot->packets[i]) {
+                LOG_OOM();
+                goto error;
+            }
+            ++snapshot->count;
+        }
+    }
+
+    return true;
+
+error:
+    sc_replay_buffer_snapshot_destroy(snapshot);
+    sc_replay_buffer_snapshot_init(snapshot);
+    return false;
+}
+
+static bool
+sc_replay_buffer_push_snapshots(struct sc_recorder *recorder,
+                                struct sc_replay_buffer_snapshot *video,
+                                struct sc_replay_buffer_snapshot *audio) {
+    struct sc_packet_sink *video_sink = &recorder->video_packet_sink;
+    struct sc_packet_sink *audio_sink = &recorder->audio_packet_sink;
+
+    if (video->config && !video_sink->ops->push(video_sink, video->config)) {
+        return false;
+    }
+
+    if (audio->config && !audio_sink->ops->push(audio_sink, audio->config)) {
+        return false;
+    }
+
+    // Interleave the packets as they were received, so that the recorder
+    // does not wait for a packet of one stream while the queue of the other
+    // stream is full
+    size_t i = 0;
+    size_t j = 0;
+    while (i < video->count || j < audio->count) {
+        bool ok;
+        if (j == audio->count || (i < video->count
+                    && video->packets[i]->pts <= audio->packets[j]->pts)) {
+            ok = video_sink->ops->push(video_sink, video->packets[i++]);
+        } else {
+            ok = audio_sink->ops->push(audio_sink, audio->packets[j++]);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+run_replay_buffer_save(void *data) {
+    struct sc_replay_buffer *rb = data;
+    struct sc_recorder *recorder = &rb->recorder;
+    struct sc_replay_buffer_snapshot *video = &rb->video_snapshot;
+    struct sc_replay_buffer_snapshot *audio = &rb->audio_snapshot;
+    struct sc_packet_sink *video_sink = &recorder->video_packet_sink;
+    struct sc_packet_sink *audio_sink = &recorder->audio_packet_sink;
+
+    bool video_open = false;
+    bool audio_open = false;
+
+    bool ok = true;
+    if (video->ctx) {
+        ok = video_sink->ops->open(video_sink, video->ctx);
+        video_open = ok;
+    }
+
+    if (ok && audio->ctx) {
+        ok = audio_sink->ops->open(audio_sink, audio->ctx);
+        audio_open = ok;
+    }
+
+    if (ok) {
+        ok = sc_replay_buffer_push_snapshots(recorder, video, audio);
+    }
+
+    if (!ok) {
+        sc_recorder_stop(recorder);
+    }
+
+    // Closing the sinks makes the recorder finish the recording
+    if (audio_open) {
+        audio_sink->ops->close(audio_sink);
+    }
+    if (video_open) {
+        video_sink->ops->close(video_sink);
+    }
+
+    sc_recorder_join(recorder);
+    sc_recorder_destroy(recorder);
+
+    sc_replay_buffer_snapshot_destroy(video);
+    sc_replay_buffer_snapshot_destroy(audio);
+
+    sc_mutex_lock(&rb->mutex);
+    rb->saving = false;
+    sc_mutex_unlock(&rb->mutex);
+
+    return 0;
+}
+
+static void
+sc_replay_buffer_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                                   void *userdata) {
+    // The recorder logs the result, and a failure must not stop scrcpy
+    (void) recorder;
+    (void) success;
+    (void) userdata;
+}
+
+bool
+sc_replay_buffer_save(struct sc_replay_buffer *rb) {
+    sc_mutex_lock(&rb->mutex);
+    bool saving = rb->saving;
+    sc_mutex_unlock(&rb->mutex);
+
+    if (saving) {
+        LOGW("Instant replay already being saved");
+        return false;
+    }
+
+    if (rb->thread_started) {
+        // The previous saving thread has ended
+        sc_thread_join(&rb->thread, NULL);
+        rb->thread_started = false;
+    }
+
+    sc_mutex_lock(&rb->mutex);
+    bool ok = sc_replay_buffer_snapshot_stream(&rb->video_snapshot, &rb->video);
+    if (ok) {
+        ok = sc_replay_buffer_snapshot_stream(&rb->audio_snapshot, &rb->audio);
+        if (!ok) {
+            sc_replay_buffer_snapshot_destroy(&rb->video_snapshot);
+        }
+    }
+    sc_mutex_unlock(&rb->mutex);
+
+    if (!ok) {
+        return false;
+    }
+
+    bool video = rb->video_snapshot.ctx;
+    bool audio = rb->audio_snapshot.ctx;
+
+    if ((!video && !audio) || (video && !rb->video_snapshot.count)) {
+        LOGW("Instant replay: nothing to save yet");
+        goto error_destroy_snapshots;
+    }
+
+    char *filename = sc_recorder_get_dated_filename(rb->filename);
+    if (!filename) {
+        goto error_destroy_snapshots;
+    }
+
+    static const struct sc_recorder_callbacks recorder_cbs = {
+        .on_ended = sc_replay_buffer_on_recorder_ended,
+    };
+
+    ok = sc_recorder_init(&rb->recorder, filename, rb->format, video, audio,
+                          rb->orientation, NULL,
+                          SC_REPLAY_BUFFER_RECORDER_MEMORY_LIMIT,
+                          &recorder_cbs, NULL);
+    free(filename);
+    if (!ok) {
+        goto error_destroy_snapshots;
+    }
+
+    // The packets are not live, they must not be dropped
+    sc_recorder_set_blocking(&rb->recorder);
+
+    ok = sc_recorder_start(&rb->recorder);
+    if (!ok) {
+        goto error_destroy_recorder;
+    }
+
+    sc_mutex_lock(&rb->mutex);
+    rb->saving = true;
+    sc_mutex_unlock(&rb->mutex);
+
+    ok = sc_thread_create(&rb->thread, run_replay_buffer_save,
+                          "scrcpy-replay", rb);
+    if (!ok) {
+        LOGE("Could not start instant replay thread");
+        sc_mutex_lock(&rb->mutex);
+        rb->saving = false;
+        sc_mutex_unlock(&rb->mutex);
+        sc_recorder_stop(&rb->recorder);
+        sc_recorder_join(&rb->recorder);
+        goto error_destroy_recorder;
+    }
+
+    rb->thread_started = true;
+
+    return true;
+
+error_destroy_recorder:
+    sc_recorder_destroy(&rb->recorder);
+error_destroy_snapshots:
+    sc_replay_buffer_snapshot_destroy(&rb->video_snapshot);
+    sc_replay_buffer_snapshot_destroy(&rb->audio_snapshot);
+
+    return false;
+}
+
+bool
+sc_replay_buffer_init(struct sc_replay_buffer *rb, const char *filename,
+                      enum sc_record_format format,
+                      enum sc_orientation orientation, sc_tick duration) {
+    assert(duration > 0);
+
+    rb->filename = strdup(filename);
+    if (!rb->filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&rb->mutex);
+    if (!ok) {
+        free(rb->filename);
+        return false;
+    }
+
+    rb->format = format;
+    rb->orientation = orientation;
+    rb->duration = duration;
+
+    sc_replay_buffer_stream_init(&rb->video);
+    sc_replay_buffer_stream_init(&rb->audio);
+    sc_vecdeque_init(&rb->gops);
+    sc_vecdeque_init(&rb->pool);
+    rb->bytes = 0;
+    rb->metrics.packets = NULL;
+    rb->metrics.bytes = NULL;
+    rb->metrics.pooled = NULL;
+
+    rb->saving = false;
+    rb->thread_started = false;
+
+    static const struct sc_packet_sink_ops video_ops = {
+        .open = sc_replay_buffer_video_packet_sink_open,
+        .close = sc_replay_buffer_video_packet_sink_close,
+        .push = sc_replay_buffer_video_packet_sink_push,
+    };
+
+    rb->video_packet_sink.ops = &video_ops;
+
+    static const struct sc_packet_sink_ops audio_ops = {
+        .open = sc_replay_buffer_audio_packet_sink_open,
+        .close = sc_replay_buffer_audio_packet_sink_close,
+        .push = sc_replay_buffer_audio_packet_sink_push,
+    };
+
+    rb->audio_packet_sink.ops = &audio_ops;
+
+    return true;
+}
+
+void
+sc_replay_buffer_destroy(struct sc_replay_buffer *rb) {
+    if (rb->thread_started) {
+        // Wait for the replay being saved, if any
+        sc_thread_join(&rb->thread, NULL);
+    }
+
+    sc_replay_buffer_stream_destroy(&rb->video);
+    sc_replay_buffer_stream_destroy(&rb->audio);
+    sc_vecdeque_destroy(&rb->gops);
+
+    while (!sc_vecdeque_is_empty(&rb->pool)) {
+        AVPacket *packet = sc_vecdeque_pop(&rb->pool);
+        av_packet_free(&packet);
+    }
+    sc_vecdeque_destroy(&rb->pool);
+
+    sc_mutex_destroy(&rb->mutex);
+    free(rb->filename);
+}
+
+void
+sc_replay_buffer_set_metrics(struct sc_replay_buffer *rb,
+                             struct sc_metrics *metrics) {
+    rb->metrics.packets =
+        sc_metrics_register_gauge(metrics, "scrcpy_replay_buffer_packets",
+                                  "Packets buffered for instant replay");
+    rb->metrics.bytes =
+        sc_metrics_register_gauge(metrics, "scrcpy_replay_buffer_bytes",
+                                  "Bytes of the packets buffered for instant "
+                                  "replay");
+    rb->metrics.pooled =
+        sc_metrics_register_gauge(metrics, "scrcpy_replay_buffer_pool_packets",
+                                  "Released packets kept for reuse");
+}
@@ -0,0 +1,102 @@
+#ifndef SC_REPLAY_BUFFER_H
+#define SC_REPLAY_BUFFER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+#include "recorder.h"
+#include "trait/packet_sink.h"
+#include "util/metrics.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+/**
+ * Packet sink keeping the last seconds of the encoded streams in memory, to
+ * save them to a file on demand (instant replay)
+ */
+
+struct sc_replay_buffer_stream {
+    // Copied from the codec context on open, NULL if the stream is not open
+    AVCodecParameters *codecpar;
+    AVPacket *config; // the last config packet, NULL if none
+    struct SC_VECDEQUE(AVPacket *) packets;
+};
+
+struct sc_replay_buffer_snapshot {
+    AVCodecContext *ctx; // NULL if the stream is not saved
+    AVPacket *config;
+    AVPacket **packets;
+    size_t count;
+};
+
+struct sc_replay_buffer {
+    struct sc_packet_sink video_packet_sink;
+    struct sc_packet_sink audio_packet_sink;
+
+    char *filename;
+    enum sc_record_format format;
+    enum sc_orientation orientation;
+    sc_tick duration;
+
+    sc_mutex mutex;
+
+    struct sc_replay_buffer_stream video;
+    struct sc_replay_buffer_stream audio;
+
+    // Number of packets of each GOP in video.packets (the first packet of a
+    // GOP is a keyframe, so the buffer always starts on a keyframe)
+    struct SC_VECDEQUE(size_t) gops;
+
+    // Released packets, reused to avoid an allocation per packet
+    struct SC_VECDEQUE(AVPacket *) pool;
+
+    // Memory retained by the buffered packets, counting their whole buffers
+    // (protected by the mutex)
+    size_t bytes;
+
+    // NULL if metrics are disabled
+    struct {
+        struct sc_metric *packets;
+        struct sc_metric *bytes;
+        struct sc_metric *pooled;
+    } metrics;
+
+    // Set while a replay is being saved (protected by the mutex)
+    bool saving;
+
+    // Only accessed from the main thread
+    bool thread_started;
+    sc_thread thread;
+
+    // Only accessed by the saving thread (once started)
+    struct sc_recorder recorder;
+    struct sc_replay_buffer_snapshot video_snapshot;
+    struct sc_replay_buffer_snapshot audio_snapshot;
+};
+
+bool
+sc_replay_buffer_init(struct sc_replay_buffer *rb, const char *filename,
+                      enum sc_record_format format,
+                      enum sc_orientation orientation, sc_tick duration);
+
+void
+sc_replay_buffer_destroy(struct sc_replay_buffer *rb);
+
+// Register the replay buffer metrics to the registry (must be called before
+// the packet sinks are open)
+void
+sc_replay_buffer_set_metrics(struct sc_replay_buffer *rb,
+                             struct sc_metrics *metrics);
+
+// Save the buffered packets asynchronously to "<name>-<date>-<time>.<ext>"
+//
+// Must be called from the main thread.
+bool
+sc_replay_buffer_save(struct sc_replay_buffer *rb);
+
+#endif
@@ -0,0 +1,528 @@
+#include "restreamer.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_restreamer */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_restreamer, packet_sink)
+
+static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
+
+static const char *
+sc_restreamer_get_format_name(const char *url) {
+    if (!strncmp(url, "rtsp://", 7) || !strncmp(url, "rtsps://", 8)) {
+        return "rtsp";
+    }
+    if (!strncmp(url, "rtmp://", 7) || !strncmp(url, "rtmps://", 8)) {
+        return "flv";
+    }
+    // SRT, UDP, TCP...
+    return "mpegts";
+}
+
+static bool
+sc_restreamer_is_listen_url(const char *url) {
+    // "tcp://...?listen", "srt://...?mode=listener"...
+    const char *query = strchr(url, '?');
+    return query && (strstr(query, "listen") != NULL);
+}
+
+static bool
+sc_restreamer_set_extradata(AVCodecParameters *codecpar,
+                            const AVPacket *packet) {
+    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
+    if (!extradata) {
+        LOG_OOM();
+        return false;
+    }
+
+    // copy the config packet to the extra data (used by RTSP for the SDP and
+    // by FLV for the decoder configuration record)
+    memcpy(extradata, packet->data, packet->size);
+
+    av_freep(&codecpar->extradata);
+    codecpar->extradata = extradata;
+    codecpar->extradata_size = packet->size;
+    return true;
+}
+
+static AVFormatContext *
+sc_restreamer_create_output(struct sc_restreamer *rs) {
+    const char *format_name = sc_restreamer_get_format_name(rs->url);
+    AVFormatContext *ctx = NULL;
+    int r = avformat_alloc_output_context2(&ctx, NULL, format_name, rs->url);
+    if (r < 0 || !ctx) {
+        LOGE("Restream: could not allocate %s output context", format_name);
+        return NULL;
+    }
+
+    // Do not buffer the output, the viewers want low latency
+    ctx->flush_packets = 1;
+
+    AVStream *stream = avformat_new_stream(ctx, NULL);
+    if (!stream) {
+        LOG_OOM();
+        goto error_free_ctx;
+    }
+
+    r = avcodec_parameters_copy(stream->codecpar, rs->codecpar);
+    if (r < 0) {
+        goto error_free_ctx;
+    }
+
+    stream->time_base = SCRCPY_TIME_BASE;
+
+    return ctx;
+
+error_free_ctx:
+    avformat_free_context(ctx);
+
+    return NULL;
+}
+
+static void
+sc_restreamer_close_output(struct sc_restreamer *rs) {
+    if (!(rs->ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&rs->ctx->pb);
+    }
+    avformat_free_context(rs->ctx);
+    rs->ctx = NULL;
+}
+
+static void
+sc_restreamer_request_keyframe(struct sc_restreamer *rs) {
+    if (!rs->keyframe_controller) {
+        return;
+    }
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME;
+    if (!sc_controller_push_msg(rs->keyframe_controller, &msg)) {
+        LOGW("Could not request a keyframe");
+    }
+}
+
+// Called from the packet queue thread, in listen mode
+static bool
+sc_restreamer_attach_viewer(struct sc_restreamer *rs) {
+    assert(rs->listen);
+    assert(!rs->ctx);
+
+    sc_mutex_lock(&rs->viewer.mutex);
+    AVIOContext *pb = rs->viewer.pending;
+    rs->viewer.pending = NULL;
+    sc_mutex_unlock(&rs->viewer.mutex);
+
+    if (!pb) {
+        // No viewer
+        return false;
+    }
+
+    rs->ctx = sc_restreamer_create_output(rs);
+    if (!rs->ctx) {
+        avio_closep(&pb);
+        // Accept another viewer
+        sc_mutex_lock(&rs->viewer.mutex);
+        rs->viewer.attached = false;
+        sc_cond_signal(&rs->viewer.cond);
+        sc_mutex_unlock(&rs->viewer.mutex);
+        return false;
+    }
+
+    rs->ctx->pb = pb;
+    rs->header_written = false;
+    rs->keyframe_received = false;
+    rs->last_pts = AV_NOPTS_VALUE;
+
+    if (sc_gop_cache_is_empty(&rs->gop_cache)) {
+        // Do not make the viewer wait for the next periodic keyframe
+        sc_restreamer_request_keyframe(rs);
+    }
+    return true;
+}
+
+// Called from the packet queue thread, in listen mode
+static void
+sc_restreamer_detach_viewer(struct sc_restreamer *rs) {
+    assert(rs->listen);
+    assert(rs->ctx);
+
+    LOGI("Restream: viewer detached");
+    sc_restreamer_close_output(rs);
+
+    sc_mutex_lock(&rs->viewer.mutex);
+    rs->viewer.attached = false;
+    sc_cond_signal(&rs->viewer.cond);
+    sc_mutex_unlock(&rs->viewer.mutex);
+}
+
+static int
+sc_restreamer_interrupt_cb(void *data) {
+    struct sc_restreamer *rs = data;
+    return atomic_load(&rs->viewer.stopped);
+}
+
+static int
+run_viewer_acceptor(void *data) {
+    struct sc_restreamer *rs = data;
+
+    const AVIOInterruptCB int_cb = {
+        .callback = sc_restreamer_interrupt_cb,
+        .opaque = rs,
+    };
+
+    for (;;) {
+        // Block until a viewer connects (or the restreamer is stopped)
+        AVIOContext *pb = NULL;
+        int r = avio_open2(&pb, rs->url, AVIO_FLAG_WRITE, &int_cb, NULL);
+        if (r < 0) {
+            if (!atomic_load(&rs->viewer.stopped)) {
+                LOGE("Restream: could not listen on %s", rs->url);
+            }
+            break;
+        }
+
+        LOGI("Restream: viewer attached to %s", rs->url);
+
+        sc_mutex_lock(&rs->viewer.mutex);
+        rs->viewer.pending = pb;
+        rs->viewer.attached = true;
+        // Only one viewer at a time (a listening URL accepts a single client)
+        while (rs->viewer.attached && !atomic_load(&rs->viewer.stopped)) {
+            sc_cond_wait(&rs->viewer.cond, &rs->viewer.mutex);
+        }
+        sc_mutex_unlock(&rs->viewer.mutex);
+
+        if (atomic_load(&rs->viewer.stopped)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static bool
+sc_restreamer_write_header(struct sc_restreamer *rs) {
+    if (!rs->ctx) {
+        assert(!rs->listen);
+        rs->ctx = sc_restreamer_create_output(rs);
+        if (!rs->ctx) {
+            return false;
+        }
+
+        // Connect to the remote endpoint (this may take some time, but it is
+        // called from the packet queue thread)
+        if (!(rs->ctx->oformat->flags & AVFMT_NOFILE)) {
+            int r = avio_open(&rs->ctx->pb, rs->url, AVIO_FLAG_WRITE);
+            if (r < 0) {
+                LOGE("Restream: could not open %s", rs->url);
+                return false;
+            }
+        }
+    }
+
+    int r = avformat_write_header(rs->ctx, NULL);
+    if (r < 0) {
+        LOGE("Restream: could not write header to %s", rs->url);
+        return false;
+    }
+
+    LOGI("Restreaming video to %s", rs->url);
+    return true;
+}
+
+static bool
+sc_restreamer_write(struct sc_restreamer *rs, AVPacket *packet) {
+    AVStream *stream = rs->ctx->streams[0];
+
+    packet->stream_index = 0;
+    packet->dts = packet->pts;
+    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, stream->time_base);
+    if (rs->last_pts != AV_NOPTS_VALUE && packet->pts <= rs->last_pts) {
+        LOGD("Restream: fixing PTS non monotonically increasing "
+             "(%" PRIi64 " >= %" PRIi64 ")", rs->last_pts, packet->pts);
+        packet->pts = ++rs->last_pts;
+        packet->dts = packet->pts;
+    } else {
+        rs->last_pts = packet->pts;
+    }
+
+    // Only one stream, there is nothing to interleave
+    return av_write_frame(rs->ctx, packet) >= 0;
+}
+
+// Write rs->packet (and unref it) to the current viewer
+static void
+sc_restreamer_write_packet(struct sc_restreamer *rs) {
+    if (!rs->header_written) {
+        if (!sc_restreamer_write_header(rs)) {
+            av_packet_unref(rs->packet);
+            if (rs->listen) {
+                sc_restreamer_detach_viewer(rs);
+            } else {
+                rs->failed = true;
+            }
+            return;
+        }
+        rs->header_written = true;
+    }
+
+    bool ok = sc_restreamer_write(rs, rs->packet);
+    av_packet_unref(rs->packet);
+    if (!ok) {
+        if (rs->listen) {
+            // The viewer left, wait for the next one
+            sc_restreamer_detach_viewer(rs);
+        } else {
+            LOGE("Restream: could not write to %s, restreaming stopped",
+                 rs->url);
+            rs->failed = true;
+        }
+    }
+}
+
+// Write the cached GOP to a new viewer
+static bool
+sc_restreamer_write_gop(struct sc_restreamer *rs) {
+    struct sc_gop_cache *cache = &rs->gop_cache;
+    assert(!sc_gop_cache_is_empty(cache));
+
+    rs->keyframe_received = true;
+    for (size_t i = 0; i < cache->packets.size && rs->ctx; ++i) {
+        if (av_packet_ref(rs->packet, cache->packets.data[i])) {
+            LOG_OOM();
+            return false;
+        }
+        sc_restreamer_write_packet(rs);
+    }
+
+    return true;
+}
+
+static bool
+sc_restreamer_push(struct sc_restreamer *rs, const AVPacket *packet) {
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+
+    if (is_config) {
+        // Keep the stream parameters for the next outputs
+        if (!sc_restreamer_set_extradata(rs->codecpar, packet)) {
+            return false;
+        }
+    }
+
+    if (av_packet_ref(rs->packet, packet)) {
+        LOG_OOM();
+        return false;
+    }
+
+    // Keep the config packet and prepend it to the keyframes
+    bool ok = sc_packet_merger_merge(&rs->merger, rs->packet);
+    if (!ok) {
+        av_packet_unref(rs->packet);
+        return false;
+    }
+
+    if (is_config) {
+        // Config packets are not written alone
+        av_packet_unref(rs->packet);
+        return true;
+    }
+
+    if (rs->listen) {
+        // The keyframes include the config packet, so the cached GOP is
+        // decodable on its own
+        sc_gop_cache_push(&rs->gop_cache, rs->packet);
+
+        if (!rs->ctx) {
+            if (!sc_restreamer_attach_viewer(rs)) {
+                // Nobody is watching
+                av_packet_unref(rs->packet);
+                return true;
+            }
+
+            if (!sc_gop_cache_is_empty(&rs->gop_cache)) {
+                // The current packet is the last one of the cached GOP
+                av_packet_unref(rs->packet);
+                return sc_restreamer_write_gop(rs);
+            }
+        }
+    }
+
+    if (!rs->keyframe_received) {
+        if (!(rs->packet->flags & AV_PKT_FLAG_KEY)) {
+            // The packets before the first keyframe could not be decoded
+            av_packet_unref(rs->packet);
+            return true;
+        }
+        rs->keyframe_received = true;
+    }
+
+    sc_restreamer_write_packet(rs);
+    return true;
+}
+
+static bool
+sc_restreamer_packet_sink_open(struct sc_packet_sink *sink,
+                               AVCodecContext *ctx) {
+    struct sc_restreamer *rs = DOWNCAST(sink);
+
+    rs->codecpar = avcodec_parameters_alloc();
+    if (!rs->codecpar) {
+        LOG_OOM();
+        return false;
+    }
+
+    int r = avcodec_parameters_from_context(rs->codecpar, ctx);
+    if (r < 0) {
+        goto error_free_codecpar;
+    }
+
+    rs->packet = av_packet_alloc();
+    if (!rs->packet) {
+        LOG_OOM();
+        goto error_free_codecpar;
+    }
+
+    sc_packet_merger_init(&rs->merger);
+    sc_packet_merger_set_repeat(&rs->merger);
+    sc_gop_cache_init(&rs->gop_cache);
+
+    rs->ctx = NULL;
+    rs->header_written = false;
+    rs->keyframe_received = false;
+    rs->last_pts = AV_NOPTS_VALUE;
+    rs->failed = false;
+
+    if (rs->listen) {
+        rs->viewer.pending = NULL;
+        rs->viewer.attached = false;
+        atomic_init(&rs->viewer.stopped, false);
+
+        if (!sc_mutex_init(&rs->viewer.mutex)) {
+            goto error_destroy_merger;
+        }
+
+        if (!sc_cond_init(&rs->viewer.cond)) {
+            goto error_mutex_destroy;
+        }
+
+        bool ok = sc_thread_create(&rs->viewer.thread, run_viewer_acceptor,
+                                   "scrcpy-restream", rs);
+        if (!ok) {
+            LOGE("Restream: could not start viewer acceptor thread");
+            goto error_cond_destroy;
+        }
+
+        LOGI("Restream: waiting for viewers on %s", rs->url);
+    }
+
+    return true;
+
+error_cond_destroy:
+    sc_cond_destroy(&rs->viewer.cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&rs->viewer.mutex);
+error_destroy_merger:
+    sc_gop_cache_destroy(&rs->gop_cache);
+    sc_packet_merger_destroy(&rs->merger);
+    av_packet_free(&rs->packet);
+error_free_codecpar:
+    avcodec_parameters_free(&rs->codecpar);
+
+    return false;
+}
+
+static void
+sc_restreamer_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_restreamer *rs = DOWNCAST(sink);
+
+    if (rs->listen) {
+        // Interrupt the viewer acceptor (blocked either in avio_open2() or
+        // waiting for the current viewer to leave)
+        sc_mutex_lock(&rs->viewer.mutex);
+        atomic_store(&rs->viewer.stopped, true);
+        sc_cond_signal(&rs->viewer.cond);
+        sc_mutex_unlock(&rs->viewer.mutex);
+
+        sc_thread_join(&rs->viewer.thread, NULL);
+
+        if (rs->viewer.pending) {
+            avio_closep(&rs->viewer.pending);
+        }
+        sc_cond_destroy(&rs->viewer.cond);
+        sc_mutex_destroy(&rs->viewer.mutex);
+    }
+
+    if (rs->ctx) {
+        if (rs->header_written && !rs->failed) {
+            av_write_trailer(rs->ctx);
+        }
+        sc_restreamer_close_output(rs);
+    }
+
+    sc_gop_cache_destroy(&rs->gop_cache);
+    sc_packet_merger_destroy(&rs->merger);
+    av_packet_free(&rs->packet);
+    avcodec_parameters_free(&rs->codecpar);
+}
+
+static bool
+sc_restreamer_packet_sink_push(struct sc_packet_sink *sink,
+                               const AVPacket *packet) {
+    struct sc_restreamer *rs = DOWNCAST(sink);
+
+    if (rs->failed) {
+        // Restreaming is disabled, but do not stop the mirroring
+        return true;
+    }
+
+    return sc_restreamer_push(rs, packet);
+}
+
+bool
+sc_restreamer_init(struct sc_restreamer *rs, const char *url) {
+    rs->url = strdup(url);
+    if (!rs->url) {
+        LOG_OOM();
+        return false;
+    }
+
+    rs->listen = sc_restreamer_is_listen_url(url);
+    rs->ctx = NULL;
+    rs->codecpar = NULL;
+    rs->packet = NULL;
+    rs->keyframe_controller = NULL;
+
+    int r = avformat_network_init();
+    if (r < 0) {
+        LOGE("Restream: could not initialize the network");
+        free(rs->url);
+        return false;
+    }
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_restreamer_packet_sink_open,
+        .close = sc_restreamer_packet_sink_close,
+        .push = sc_restreamer_packet_sink_push,
+    };
+
+    rs->packet_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_restreamer_set_keyframe_requester(struct sc_restreamer *rs,
+                                     struct sc_controller *controller) {
+    rs->keyframe_controller = controller;
+}
+
+void
+sc_restreamer_destroy(struct sc_restreamer *rs) {
+    avformat_network_deinit();
+    free(rs->url);
+}
@@ -0,0 +1,87 @@
+#ifndef SC_RESTREAMER_H
+#define SC_RESTREAMER_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "controller.h"
+#include "gop_cache.h"
+#include "packet_merger.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+
+/**
+ * Packet sink forwarding the encoded video stream (without re-encoding) to a
+ * network URL, for remote viewers
+ *
+ * The muxer is selected from the URL scheme: "rtsp://" pushes the stream to an
+ * RTSP server (which serves it to the viewers), "rtmp://" uses FLV, and any
+ * other protocol (SRT, UDP, TCP...) carries MPEG-TS.
+ *
+ * If the URL listens for a viewer (for example "tcp://0.0.0.0:1234?listen" or
+ * "srt://0.0.0.0:1234?mode=listener"), viewers may attach and detach at any
+ * time: every new viewer first receives the packets of the current GOP (or a
+ * keyframe is requested if there is none), so that it starts immediately, and
+ * the next viewer is accepted once the current one leaves.
+ *
+ * The packets are written synchronously, so it is expected to be fed by a
+ * packet queue running on its own thread.
+ */
+struct sc_restreamer {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    char *url;
+    bool listen;
+
+    // The output for the current viewer (created on the first keyframe, and
+    // for every new viewer in listen mode)
+    AVFormatContext *ctx;
+    // The stream parameters (including the config packet as extradata)
+    AVCodecParameters *codecpar;
+    AVPacket *packet;
+    // Prepend the config packet to every keyframe, so that a viewer may join
+    // the stream at any time
+    struct sc_packet_merger merger;
+    // In listen mode, the packets since the last keyframe, for the next viewer
+    struct sc_gop_cache gop_cache;
+
+    bool header_written;
+    bool keyframe_received;
+    int64_t last_pts;
+
+    // Set on network error, the stream is not restreamed anymore (but the
+    // mirroring continues)
+    bool failed;
+
+    // In listen mode, the viewers are accepted from a separate thread
+    struct {
+        sc_thread thread;
+        sc_mutex mutex;
+        sc_cond cond;
+        // Accepted, but not yet taken by the packet queue thread
+        AVIOContext *pending;
+        // Set until the packet queue thread detaches the viewer
+        bool attached;
+        atomic_bool stopped;
+    } viewer;
+
+    // If set, request a keyframe for every new viewer (unless a GOP is cached)
+    struct sc_controller *keyframe_controller;
+};
+
+bool
+sc_restreamer_init(struct sc_restreamer *rs, const char *url);
+
+void
+sc_restreamer_set_keyframe_requester(struct sc_restreamer *rs,
+                                     struct sc_controller *controller);
+
+void
+sc_restreamer_destroy(struct sc_restreamer *rs);
+
+#endif
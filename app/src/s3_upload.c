@@ -0,0 +1,803 @@
+#include "s3_upload.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+
+#include "util/env.h"
+#include "util/log.h"
+#include "util/sigv4.h"
+
+#define SC_S3_DEFAULT_REGION "us-east-1"
+// "YYYYMMDDTHHMMSSZ"
+#define SC_S3_DATE_LEN 16
+
+// strndup() is not available on all platforms
+static char *
+sc_s3_strndup(const char *s, size_t n) {
+    char *dup;
+    if (asprintf(&dup, "%.*s", (int) n, s) == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+    return dup;
+}
+
+static char *
+sc_s3_get_env(const char *name, const char *fallback_name) {
+    char *value = sc_get_env(name);
+    if (!value && fallback_name) {
+        value = sc_get_env(fallback_name);
+    }
+    if (value && !*value) {
+        // Set but empty
+        free(value);
+        return NULL;
+    }
+    return value;
+}
+
+bool
+sc_s3_target_init(struct sc_s3_target *target, const char *url) {
+    const char *sep = strstr(url, "://");
+    bool ok = sep && ((sep - url == 4 && !strncmp(url, "http", 4))
+                   || (sep - url == 5 && !strncmp(url, "https", 5)));
+    if (!ok) {
+        LOGE("Upload: invalid URL (expected http[s]://<host>/<bucket>): %s",
+             url);
+        return false;
+    }
+
+    const char *host = sep + 3;
+    const char *path = strchr(host, '/');
+    if (!path || path == host || !path[1]) {
+        LOGE("Upload: no host or no bucket in URL: %s", url);
+        return false;
+    }
+
+    memset(target, 0, sizeof(*target));
+
+    target->origin = sc_s3_strndup(url, path - url);
+    target->host = sc_s3_strndup(host, path - host);
+    if (!target->origin || !target->host) {
+        goto error;
+    }
+
+    // Remove the trailing '/', the key is appended after a '/'
+    size_t path_len = strlen(path);
+    while (path_len > 1 && path[path_len - 1] == '/') {
+        --path_len;
+    }
+
+    char *raw_path = sc_s3_strndup(path, path_len);
+    if (!raw_path) {
+        goto error;
+    }
+    target->path = sc_sigv4_uri_encode(raw_path, true);
+    free(raw_path);
+    if (!target->path) {
+        goto error;
+    }
+
+    target->access_key = sc_s3_get_env("AWS_ACCESS_KEY_ID", NULL);
+    target->secret_key = sc_s3_get_env("AWS_SECRET_ACCESS_KEY", NULL);
+    if (!target->access_key || !target->secret_key) {
+        LOGE("Upload: AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY must be "
+             "set");
+        goto error;
+    }
+
+    target->session_token = sc_s3_get_env("AWS_SESSION_TOKEN", NULL);
+    target->ca_file = sc_s3_get_env("AWS_CA_BUNDLE", NULL);
+
+    target->region = sc_s3_get_env("AWS_REGION", "AWS_DEFAULT_REGION");
+    if (!target->region) {
+        target->region = strdup(SC_S3_DEFAULT_REGION);
+        if (!target->region) {
+            LOG_OOM();
+            goto error;
+        }
+    }
+
+    return true;
+
+error:
+    sc_s3_target_destroy(target);
+    return false;
+}
+
+void
+sc_s3_target_destroy(struct sc_s3_target *target) {
+    free(target->origin);
+    free(target->host);
+    free(target->path);
+    free(target->access_key);
+    free(target->secret_key);
+    free(target->session_token);
+    free(target->region);
+    free(target->ca_file);
+}
+
+static bool
+sc_s3_format_date(char date[SC_S3_DATE_LEN + 1]) {
+    time_t now = time(NULL);
+    struct tm tm;
+#ifdef _WIN32
+    bool ok = !gmtime_s(&tm, &now);
+#else
+    bool ok = gmtime_r(&now, &tm);
+#endif
+    return ok && strftime(date, SC_S3_DATE_LEN + 1, "%Y%m%dT%H%M%SZ", &tm);
+}
+
+static char *
+sc_s3_to_hex(const uint8_t *data, size_t len) {
+    char *hex = malloc(2 * len + 1);
+    if (!hex) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0xF];
+    }
+    hex[2 * len] = '\0';
+    return hex;
+}
+
+// Read the whole response body
+static char *
+sc_s3_read_response(AVIOContext *pb) {
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 1024)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    char chunk[1024];
+    int r;
+    while ((r = avio_read(pb, (unsigned char *) chunk, sizeof(chunk) - 1))
+            > 0) {
+        chunk[r] = '\0';
+        // The body is text (XML), it contains no nul byte
+        size_t len = strlen(chunk);
+        if (len && !sc_strbuf_append(&buf, chunk, len)) {
+            LOG_OOM();
+            free(buf.s);
+            return NULL;
+        }
+    }
+
+    return buf.s;
+}
+
+// Execute a signed request
+//
+// If `response` is not NULL, the response body is returned in it (to be
+// freed by the caller).
+static bool
+sc_s3_request(const struct sc_s3_target *target, const char *method,
+              const char *path, const char *query, const char *content_type,
+              const uint8_t *payload, size_t len, char **response) {
+    char date[SC_S3_DATE_LEN + 1];
+    if (!sc_s3_format_date(date)) {
+        LOGE("Upload: could not format the current date");
+        return false;
+    }
+
+    char payload_hash[SC_SIGV4_HASH_HEX_LEN + 1];
+    if (!sc_sigv4_sha256_hex(payload, len, payload_hash)) {
+        return false;
+    }
+
+    struct sc_sigv4_header headers[] = {
+        {"host", target->host},
+        {"x-amz-content-sha256", payload_hash},
+        {"x-amz-date", date},
+        {"x-amz-security-token", target->session_token},
+    };
+
+    struct sc_sigv4_request req = {
+        .method = method,
+        .path = path,
+        .query = query,
+        .headers = headers,
+        // The session token is signed only if present
+        .header_count = ARRAY_LEN(headers) - !target->session_token,
+        .payload_hash = payload_hash,
+        .date = date,
+    };
+
+    struct sc_sigv4_credentials creds = {
+        .access_key = target->access_key,
+        .secret_key = target->secret_key,
+        .region = target->region,
+        .service = "s3",
+    };
+
+    char *auth = sc_sigv4_authorization(&creds, &req);
+    if (!auth) {
+        return false;
+    }
+
+    // The "Host" header is added by FFmpeg, from the URL
+    char *http_headers;
+    int r = asprintf(&http_headers, "Authorization: %s\r\n"
+                                    "x-amz-content-sha256: %s\r\n"
+                                    "x-amz-date: %s\r\n"
+                                    "%s%s%s"
+                                    "%s",
+                     auth, payload_hash, date,
+                     target->session_token ? "x-amz-security-token: " : "",
+                     target->session_token ? target->session_token : "",
+                     target->session_token ? "\r\n" : "",
+                     // FFmpeg only sets the Content-Length with a body
+                     len ? "" : "Content-Length: 0\r\n");
+    free(auth);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    char *url;
+    r = asprintf(&url, "%s%s%s%s", target->origin, path, *query ? "?" : "",
+                 query);
+    if (r == -1) {
+        LOG_OOM();
+        free(http_headers);
+        return false;
+    }
+
+    AVDictionary *opts = NULL;
+    av_dict_set(&opts, "method", method, 0);
+    av_dict_set(&opts, "headers", http_headers, AV_DICT_DONT_STRDUP_VAL);
+    // Do not add a "Range" header
+    av_dict_set(&opts, "seekable", "0", 0);
+    av_dict_set(&opts, "icy", "0", 0);
+    av_dict_set_int(&opts, "rw_timeout",
+                    SC_TICK_TO_US(SC_S3_UPLOAD_TIMEOUT), 0);
+    // FFmpeg does not verify the server certificate by default (the options
+    // are ignored over http)
+    av_dict_set(&opts, "tls_verify", "1", 0);
+    if (target->ca_file) {
+        av_dict_set(&opts, "ca_file", target->ca_file, 0);
+    }
+    if (content_type) {
+        av_dict_set(&opts, "content_type", content_type, 0);
+    }
+    if (len) {
+        // The request body is sent (with its Content-Length) when the
+        // connection is open, so that the response status can be checked
+        char *post_data = sc_s3_to_hex(payload, len);
+        if (!post_data) {
+            av_dict_free(&opts);
+            free(url);
+            return false;
+        }
+        av_dict_set(&opts, "post_data", post_data, AV_DICT_DONT_STRDUP_VAL);
+    }
+
+    AVIOContext *pb = NULL;
+    r = avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (r < 0) {
+        LOGW("Upload: %s %s failed (error %d)", method, url, r);
+        free(url);
+        return false;
+    }
+
+    free(url);
+
+    bool ok = true;
+    if (response) {
+        *response = sc_s3_read_response(pb);
+        ok = *response;
+    }
+
+    avio_closep(&pb);
+    return ok;
+}
+
+// Execute a request, retrying on failure
+//
+// Must be called from the upload thread.
+static bool
+sc_s3_upload_request(struct sc_s3_upload *upload, const char *method,
+                     const char *query, const char *content_type,
+                     const uint8_t *payload, size_t len, char **response) {
+    sc_tick delay = SC_S3_UPLOAD_RETRY_DELAY;
+    for (unsigned i = 0; i < SC_S3_UPLOAD_MAX_ATTEMPTS; ++i) {
+        if (i) {
+            LOGD("Upload: retrying in %" PRItick " ms", SC_TICK_TO_MS(delay));
+            // Wait without holding the data (the writer may fill the next
+            // parts meanwhile)
+            sc_tick deadline = sc_tick_now() + delay;
+            sc_mutex_lock(&upload->mutex);
+            while (sc_tick_now() < deadline) {
+                sc_cond_timedwait(&upload->cond, &upload->mutex, deadline);
+            }
+            sc_mutex_unlock(&upload->mutex);
+            delay *= 2;
+        }
+
+        if (sc_s3_request(upload->target, method, upload->path, query,
+                          content_type, payload, len, response)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Extract the content of the first <tag> element from an XML response
+static char *
+sc_s3_xml_get(const char *xml, const char *tag) {
+    char *open;
+    char *close;
+    if (asprintf(&open, "<%s>", tag) == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+    if (asprintf(&close, "</%s>", tag) == -1) {
+        LOG_OOM();
+        free(open);
+        return NULL;
+    }
+
+    char *value = NULL;
+    const char *start = strstr(xml, open);
+    if (start) {
+        start += strlen(open);
+        const char *end = strstr(start, close);
+        if (end) {
+            value = sc_s3_strndup(start, end - start);
+        }
+    }
+
+    free(open);
+    free(close);
+    return value;
+}
+
+static bool
+sc_s3_upload_initiate(struct sc_s3_upload *upload) {
+    char *response;
+    if (!sc_s3_upload_request(upload, "POST", "uploads=", NULL, NULL, 0,
+                              &response)) {
+        return false;
+    }
+
+    char *upload_id = sc_s3_xml_get(response, "UploadId");
+    free(response);
+    if (!upload_id) {
+        LOGE("Upload: no upload id in the response");
+        return false;
+    }
+
+    upload->upload_id = sc_sigv4_uri_encode(upload_id, false);
+    free(upload_id);
+    if (!upload->upload_id) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_s3_upload_send_part(struct sc_s3_upload *upload,
+                       const struct sc_s3_upload_part *part) {
+    unsigned number = upload->part_number + 1;
+
+    char *query;
+    // The query parameters must be sorted
+    if (asprintf(&query, "partNumber=%u&uploadId=%s", number,
+                 upload->upload_id) == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_s3_upload_request(upload, "PUT", query,
+                                   "application/octet-stream", part->data,
+                                   part->len, NULL);
+    free(query);
+    if (!ok) {
+        return false;
+    }
+
+    upload->part_number = number;
+    return true;
+}
+
+// Append a <Part> element of a ListParts response to the completion request
+static bool
+sc_s3_upload_append_listed_part(struct sc_s3_upload *upload, const char *xml,
+                                unsigned expected_number) {
+    char *number = sc_s3_xml_get(xml, "PartNumber");
+    // Kept as is (with its XML-escaped quotes)
+    char *etag = sc_s3_xml_get(xml, "ETag");
+
+    bool ok = number && etag && strtoul(number, NULL, 10) == expected_number;
+    if (ok) {
+        char *entry;
+        int r = asprintf(&entry, "<Part><PartNumber>%u</PartNumber>"
+                                 "<ETag>%s</ETag></Part>", expected_number,
+                         etag);
+        if (r != -1) {
+            ok = sc_strbuf_append_str(&upload->completion, entry);
+            free(entry);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            LOG_OOM();
+        }
+    } else {
+        LOGE("Upload: unexpected part in the part list");
+    }
+
+    free(number);
+    free(etag);
+    return ok;
+}
+
+// Append the parts uploaded to the completion request
+//
+// The ETag of a part is not always the MD5 of its content (e.g. with SSE-KMS
+// or SSE-C encryption, or on some S3-compatible services), and the FFmpeg
+// HTTP client does not expose the response headers of the part uploads, so
+// the ETags are read from the part list.
+static bool
+sc_s3_upload_list_parts(struct sc_s3_upload *upload) {
+    unsigned count = 0;
+    for (;;) {
+        char *query;
+        // The query parameters must be sorted
+        if (asprintf(&query, "part-number-marker=%u&uploadId=%s", count,
+                     upload->upload_id) == -1) {
+            LOG_OOM();
+            return false;
+        }
+
+        char *response;
+        bool ok = sc_s3_upload_request(upload, "GET", query, NULL, NULL, 0,
+                                       &response);
+        free(query);
+        if (!ok) {
+            return false;
+        }
+
+        // The parts are listed by increasing part number (at most 1000 per
+        // response)
+        const char *p = response;
+        const char *start;
+        while ((start = strstr(p, "<Part>"))) {
+            const char *end = strstr(start, "</Part>");
+            if (!end) {
+                break;
+            }
+
+            char *xml = sc_s3_strndup(start, end - start);
+            ok = xml && sc_s3_upload_append_listed_part(upload, xml,
+                                                        count + 1);
+            free(xml);
+            if (!ok) {
+                free(response);
+                return false;
+            }
+
+            ++count;
+            p = end + strlen("</Part>");
+        }
+
+        char *truncated = sc_s3_xml_get(response, "IsTruncated");
+        bool more = truncated && !strcmp(truncated, "true");
+        free(truncated);
+        free(response);
+
+        if (!more) {
+            break;
+        }
+    }
+
+    if (count != upload->part_number) {
+        LOGE("Upload: %u parts listed, %u expected", count,
+             upload->part_number);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_s3_upload_complete(struct sc_s3_upload *upload) {
+    if (!sc_strbuf_append_staticstr(&upload->completion,
+                                    "<CompleteMultipartUpload>")) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_s3_upload_list_parts(upload)) {
+        LOGE("Upload: could not list the uploaded parts");
+        return false;
+    }
+
+    if (!sc_strbuf_append_staticstr(&upload->completion,
+                                    "</CompleteMultipartUpload>")) {
+        LOG_OOM();
+        return false;
+    }
+
+    char *query;
+    if (asprintf(&query, "uploadId=%s", upload->upload_id) == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    char *response;
+    bool ok = sc_s3_upload_request(upload, "POST", query, "application/xml",
+                                   (const uint8_t *) upload->completion.s,
+                                   upload->completion.len, &response);
+    free(query);
+    if (!ok) {
+        return false;
+    }
+
+    // The completion may fail after the response status has been sent
+    ok = !strstr(response, "<Error>");
+    if (!ok) {
+        char *message = sc_s3_xml_get(response, "Message");
+        LOGE("Upload: could not complete: %s", message ? message : "error");
+        free(message);
+    }
+
+    free(response);
+    return ok;
+}
+
+static void
+sc_s3_upload_abort(struct sc_s3_upload *upload) {
+    char *query;
+    if (asprintf(&query, "uploadId=%s", upload->upload_id) == -1) {
+        LOG_OOM();
+        return;
+    }
+
+    // Release the parts already uploaded (a single attempt)
+    if (!sc_s3_request(upload->target, "DELETE", upload->path, query, NULL,
+                       NULL, 0, NULL)) {
+        LOGW("Upload: could not abort the multipart upload");
+    }
+
+    free(query);
+}
+
+static int
+run_s3_upload(void *data) {
+    struct sc_s3_upload *upload = data;
+
+    bool ok = sc_s3_upload_initiate(upload);
+
+    sc_mutex_lock(&upload->mutex);
+    if (!ok) {
+        LOGE("Upload: could not start the upload of %s", upload->path);
+        upload->error = true;
+    }
+
+    for (;;) {
+        while (!upload->stopped && !upload->pending) {
+            sc_cond_wait(&upload->cond, &upload->mutex);
+        }
+
+        if (!upload->pending) {
+            // Stopped and all the pending parts are uploaded
+            assert(upload->stopped);
+            break;
+        }
+
+        struct sc_s3_upload_part *part = &upload->parts[upload->head];
+        bool error = upload->error;
+
+        // The part is not modified while it is pending
+        sc_mutex_unlock(&upload->mutex);
+
+        ok = true;
+        if (!error) {
+            ok = sc_s3_upload_send_part(upload, part);
+            if (!ok) {
+                LOGE("Upload: could not upload part %u of %s",
+                     upload->part_number + 1, upload->path);
+            }
+        }
+
+        sc_mutex_lock(&upload->mutex);
+        if (!ok) {
+            upload->error = true;
+        }
+        part->len = 0;
+        upload->head = (upload->head + 1) % SC_S3_UPLOAD_PART_COUNT;
+        --upload->pending;
+        // Wake up the producer waiting for a free part (or for all the
+        // pending parts to be uploaded)
+        sc_cond_signal(&upload->cond);
+    }
+
+    bool error = upload->error;
+    sc_mutex_unlock(&upload->mutex);
+
+    if (!error) {
+        ok = sc_s3_upload_complete(upload);
+        if (ok) {
+            LOGI("Upload completed: %s%s", upload->target->origin,
+                 upload->path);
+        } else {
+            LOGE("Upload: could not complete the upload of %s",
+                 upload->path);
+        }
+    } else {
+        ok = false;
+    }
+
+    if (!ok && upload->upload_id) {
+        sc_s3_upload_abort(upload);
+    }
+
+    sc_mutex_lock(&upload->mutex);
+    upload->error = !ok;
+    sc_mutex_unlock(&upload->mutex);
+
+    return 0;
+}
+
+bool
+sc_s3_upload_open(struct sc_s3_upload *upload,
+                  const struct sc_s3_target *target, const char *key) {
+    char *encoded_key = sc_sigv4_uri_encode(key, false);
+    if (!encoded_key) {
+        return false;
+    }
+
+    int r = asprintf(&upload->path, "%s/%s", target->path, encoded_key);
+    free(encoded_key);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_strbuf_init(&upload->completion, 4096)) {
+        LOG_OOM();
+        goto error_free_path;
+    }
+
+    bool ok = sc_mutex_init(&upload->mutex);
+    if (!ok) {
+        goto error_free_completion;
+    }
+
+    ok = sc_cond_init(&upload->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    for (unsigned i = 0; i < SC_S3_UPLOAD_PART_COUNT; ++i) {
+        // Allocated on first use
+        upload->parts[i].data = NULL;
+        upload->parts[i].len = 0;
+    }
+
+    upload->target = target;
+    upload->head = 0;
+    upload->pending = 0;
+    upload->size = 0;
+    upload->stopped = false;
+    upload->error = false;
+    upload->upload_id = NULL;
+    upload->part_number = 0;
+
+    ok = sc_thread_create(&upload->thread, run_s3_upload, "scrcpy-upload",
+                          upload);
+    if (!ok) {
+        LOGE("Could not start upload thread");
+        goto error_cond_destroy;
+    }
+
+    return true;
+
+error_cond_destroy:
+    sc_cond_destroy(&upload->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&upload->mutex);
+error_free_completion:
+    free(upload->completion.s);
+error_free_path:
+    free(upload->path);
+
+    return false;
+}
+
+bool
+sc_s3_upload_write(struct sc_s3_upload *upload, const uint8_t *data,
+                   size_t len) {
+    sc_mutex_lock(&upload->mutex);
+
+    while (len && !upload->error) {
+        while (upload->pending == SC_S3_UPLOAD_PART_COUNT) {
+            // The network cannot keep up
+            sc_cond_wait(&upload->cond, &upload->mutex);
+        }
+
+        unsigned index =
+            (upload->head + upload->pending) % SC_S3_UPLOAD_PART_COUNT;
+        struct sc_s3_upload_part *part = &upload->parts[index];
+
+        // The part is not pending, the upload thread does not access it
+        sc_mutex_unlock(&upload->mutex);
+
+        if (!part->data) {
+            part->data = malloc(SC_S3_UPLOAD_PART_SIZE);
+            if (!part->data) {
+                LOG_OOM();
+                sc_mutex_lock(&upload->mutex);
+                upload->error = true;
+                break;
+            }
+        }
+
+        size_t n = MIN(len, SC_S3_UPLOAD_PART_SIZE - part->len);
+        memcpy(part->data + part->len, data, n);
+        part->len += n;
+        upload->size += n;
+        data += n;
+        len -= n;
+
+        sc_mutex_lock(&upload->mutex);
+        if (part->len == SC_S3_UPLOAD_PART_SIZE) {
+            ++upload->pending;
+            sc_cond_signal(&upload->cond);
+        }
+    }
+
+    bool ok = !upload->error;
+    sc_mutex_unlock(&upload->mutex);
+
+    return ok;
+}
+
+bool
+sc_s3_upload_close(struct sc_s3_upload *upload) {
+    sc_mutex_lock(&upload->mutex);
+    // If all the parts are pending, none is being filled
+    if (upload->pending < SC_S3_UPLOAD_PART_COUNT) {
+        unsigned index =
+            (upload->head + upload->pending) % SC_S3_UPLOAD_PART_COUNT;
+        // The last part may be smaller (a multipart upload has at least one
+        // part, possibly empty)
+        if (upload->parts[index].len || !upload->size) {
+            ++upload->pending;
+        }
+    }
+    upload->stopped = true;
+    sc_cond_signal(&upload->cond);
+    sc_mutex_unlock(&upload->mutex);
+
+    sc_thread_join(&upload->thread, NULL);
+
+    bool ok = !upload->error;
+
+    for (unsigned i = 0; i < SC_S3_UPLOAD_PART_COUNT; ++i) {
+        free(upload->parts[i].data);
+    }
+
+    free(upload->upload_id);
+    free(upload->completion.s);
+    free(upload->path);
+    sc_cond_destroy(&upload->cond);
+    sc_mutex_destroy(&upload->mutex);
+
+    return ok;
+}
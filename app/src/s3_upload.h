@@ -0,0 +1,110 @@
+#ifndef SC_S3_UPLOAD_H
+#define SC_S3_UPLOAD_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/strbuf.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Size of the uploaded parts (S3 requires at least 5 MiB, except for the last
+// part)
+#define SC_S3_UPLOAD_PART_SIZE (8 << 20) // 8 MiB
+// Maximum number of parts buffered in memory (filled or being uploaded)
+#define SC_S3_UPLOAD_PART_COUNT 4
+// Number of attempts of each request before giving up
+#define SC_S3_UPLOAD_MAX_ATTEMPTS 5
+// Delay before the first retry (doubled on each retry)
+#define SC_S3_UPLOAD_RETRY_DELAY SC_TICK_FROM_SEC(1)
+// Timeout of a network read or write
+#define SC_S3_UPLOAD_TIMEOUT SC_TICK_FROM_SEC(30)
+
+/**
+ * S3-compatible bucket (and key prefix) where the recordings are uploaded
+ * (--record-upload)
+ *
+ * The URL is "http[s]://<host>[:<port>]/<bucket>[/<prefix>]" (path-style
+ * addressing, supported by all the S3-compatible services). The credentials
+ * are read from the usual environment variables: AWS_ACCESS_KEY_ID,
+ * AWS_SECRET_ACCESS_KEY, AWS_SESSION_TOKEN (optional) and AWS_REGION or
+ * AWS_DEFAULT_REGION (us-east-1 by default).
+ *
+ * Over https, the server certificate is always verified, against the system
+ * CA certificates or the AWS_CA_BUNDLE file.
+ */
+struct sc_s3_target {
+    char *origin; // "http[s]://<host>[:<port>]"
+    char *host; // "<host>[:<port>]"
+    char *path; // "/<bucket>[/<prefix>]", URI-encoded
+
+    char *access_key;
+    char *secret_key;
+    char *session_token; // may be NULL
+    char *region;
+    char *ca_file; // may be NULL (the system CA certificates)
+};
+
+bool
+sc_s3_target_init(struct sc_s3_target *target, const char *url);
+
+void
+sc_s3_target_destroy(struct sc_s3_target *target);
+
+/**
+ * Object uploaded to S3 while it is written, as a multipart upload
+ *
+ * A write only copies the data to the current part, and returns immediately,
+ * unless all the parts are pending (the network cannot keep up). The parts are
+ * uploaded by a separate thread, and each request is retried on failure.
+ *
+ * Except for the upload thread, all the functions must be called from the
+ * same thread.
+ */
+struct sc_s3_upload {
+    const struct sc_s3_target *target;
+    char *path; // path of the object, URI-encoded
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond; // signaled on new part, part uploaded, or stop
+
+    struct sc_s3_upload_part {
+        uint8_t *data;
+        size_t len;
+    } parts[SC_S3_UPLOAD_PART_COUNT];
+
+    // pending parts: [head, head + pending) modulo SC_S3_UPLOAD_PART_COUNT,
+    // the part at (head + pending) is being filled
+    unsigned head;
+    unsigned pending;
+    uint64_t size; // total bytes written
+
+    bool stopped;
+    bool error; // the upload has failed (the following writes are discarded)
+
+    // Only accessed by the upload thread
+    char *upload_id; // URI-encoded, NULL until the upload is initiated
+    unsigned part_number; // number of parts uploaded
+    struct sc_strbuf completion; // body of the completion request
+};
+
+bool
+sc_s3_upload_open(struct sc_s3_upload *upload,
+                  const struct sc_s3_target *target, const char *key);
+
+// Return false if the upload has failed
+bool
+sc_s3_upload_write(struct sc_s3_upload *upload, const uint8_t *data,
+                   size_t len);
+
+// Upload the pending data, and complete the upload (or abort it on error)
+//
+// Return false if the upload has failed.
+bool
+sc_s3_upload_close(struct sc_s3_upload *upload);
+
+#endif
@@ -16,16 +16,45 @@
 
 #include "audio_player.h"
 #include "controller.h"
+#include "decode_benchmark.h"
 #include "decoder.h"
 #include "delay_buffer.h"
 #include "demuxer.h"
 #include "events.h"
+#include "extra_screen.h"
 #include "file_pusher.h"
+#include "frame_pacer.h"
+#include "frame_queue.h"
+#include "hwaccel.h"
+#include "automation.h"
+#include "input_recorder.h"
+#include "input_replayer.h"
 #include "keyboard_sdk.h"
+#include "latency_tracker.h"
+#include "metrics_exporter.h"
+#include "mouse_capture.h"
 #include "mouse_sdk.h"
+#include "packet_delay_buffer.h"
+#include "packet_queue.h"
+#include "plugin_sink.h"
+#include "raw_sink.h"
 #include "recorder.h"
+#include "record_switch.h"
+#include "replay_buffer.h"
+#include "screenshot.h"
+#include "restreamer.h"
 #include "screen.h"
 #include "server.h"
+#include "shm_sink.h"
+#include "soak.h"
+#include "startup_timing.h"
+#include "stream_clock.h"
+#include "stream_replayer.h"
+#include "trace.h"
+#include "thumbnail_sink.h"
+#include "touch_benchmark.h"
+#include "timer_service.h"
+#include "transcoder.h"
 #include "uhid/gamepad_uhid.h"
 #include "uhid/keyboard_uhid.h"
 #include "uhid/mouse_uhid.h"
@@ -39,8 +68,10 @@
 #include "util/acksync.h"
 #include "util/log.h"
 #include "util/rand.h"
+#include "util/str.h"
 #include "util/timeout.h"
 #include "util/tick.h"
+#include "video_feedback.h"
 #ifdef HAVE_V4L2
 # include "v4l2_sink.h"
 #endif
@@ -50,17 +81,55 @@ struct scrcpy {
     struct sc_screen screen;
     struct sc_audio_player audio_player;
     struct sc_demuxer video_demuxer;
+    struct sc_demuxer record_demuxer; // for --record-stream
     struct sc_demuxer audio_demuxer;
     struct sc_decoder video_decoder;
     struct sc_decoder audio_decoder;
+    // for --extra-display
+    struct sc_demuxer extra_demuxers[SC_MAX_EXTRA_DISPLAYS];
+    struct sc_decoder extra_decoders[SC_MAX_EXTRA_DISPLAYS];
+    struct sc_extra_screen extra_screens[SC_MAX_EXTRA_DISPLAYS];
     struct sc_recorder recorder;
+    struct sc_s3_target upload_target;
+    struct sc_replay_buffer replay_buffer;
+    struct sc_record_switch record_switch;
+    struct sc_restreamer restreamer;
+    struct sc_packet_queue restream_queue;
+    struct sc_raw_sink raw_sink;
+    struct sc_packet_queue raw_queue;
+    struct sc_timer_service timer_service;
+    struct sc_packet_delay_buffer video_packet_buffer;
+    struct sc_packet_queue video_packet_queue;
     struct sc_delay_buffer video_buffer;
+    struct sc_frame_pacer video_pacer;
+    struct sc_latency_tracker latency_tracker;
+    // Mapping of the device time to the local time, shared by the streams
+    struct sc_stream_clock stream_clock;
+    struct sc_metrics metrics;
+    struct sc_metrics_exporter metrics_exporter;
+    struct sc_soak_monitor soak_monitor;
+    struct sc_decode_benchmark decode_benchmark;
+    struct sc_touch_benchmark touch_benchmark;
+    struct sc_video_feedback video_feedback;
+    struct sc_shm_sink shm_sink;
+    struct sc_frame_queue shm_queue;
+    struct sc_thumbnail_sink thumbnail_sink;
+    struct sc_frame_queue thumbnail_queue;
+    struct sc_transcoder transcoder;
+    struct sc_frame_queue transcode_queue;
+    struct sc_plugin_sink plugin_sinks[SC_MAX_FRAME_SINK_PLUGINS];
+    struct sc_frame_queue plugin_queues[SC_MAX_FRAME_SINK_PLUGINS];
 #ifdef HAVE_V4L2
     struct sc_v4l2_sink v4l2_sink;
     struct sc_delay_buffer v4l2_buffer;
+    struct sc_frame_queue v4l2_queue;
 #endif
     struct sc_controller controller;
+    struct sc_input_recorder input_recorder;
+    struct sc_input_replayer input_replayer;
+    struct sc_automation automation;
     struct sc_file_pusher file_pusher;
+    struct sc_screenshot screenshot;
 #ifdef HAVE_USB
     struct sc_usb usb;
     struct sc_aoa aoa;
@@ -89,6 +158,10 @@ struct scrcpy {
 #endif
     };
     struct sc_timeout timeout;
+
+    const struct scrcpy_options *options;
+    // With --reconnect, the controller is stopped until reconnected
+    bool reconnecting;
 };
 
 #ifdef _WIN32
@@ -152,6 +225,8 @@ sdl_set_hints(const char *render_driver) {
     if (!SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1")) {
         LOGW("Could not allow joystick background events");
     }
+
+    sc_mouse_capture_set_hints();
 }
 
 static void
@@ -175,14 +250,79 @@ sdl_configure(bool video_playback, bool disable_screensaver) {
     }
 }
 
+static bool
+reconnect_controller(struct scrcpy *s) {
+    if (!sc_controller_restart(&s->controller, s->server.control_socket)) {
+        return false;
+    }
+
+    if (s->options->turn_screen_off) {
+        // The new server does not know that the screen was turned off
+        struct sc_control_msg msg;
+        msg.type = SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER;
+        msg.set_display_power.on = false;
+
+        if (!sc_controller_push_msg(&s->controller, &msg)) {
+            LOGW("Could not request 'set display power'");
+        }
+    }
+
+    return true;
+}
+
+// Return true if the event targets the window of an extra display
+static bool
+handle_extra_screen_event(struct scrcpy *s, const SDL_Event *event) {
+    for (unsigned i = 0; i < s->options->extra_display_count; ++i) {
+        if (sc_extra_screen_handle_event(&s->extra_screens[i], event)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+is_main_window_close(struct scrcpy *s, const SDL_Event *event) {
+    // With a single window, SDL_QUIT is sent instead
+    return s->options->extra_display_count
+        && event->type == SDL_WINDOWEVENT
+        && event->window.event == SDL_WINDOWEVENT_CLOSE;
+}
+
 static enum scrcpy_exit_code
 event_loop(struct scrcpy *s, bool has_screen) {
     SDL_Event event;
     while (SDL_WaitEvent(&event)) {
         switch (event.type) {
             case SC_EVENT_DEVICE_DISCONNECTED:
-                LOGW("Device disconnected");
-                return SCRCPY_EXIT_DISCONNECTED;
+                if (!s->options->reconnect) {
+                    LOGW("Device disconnected");
+                    return SCRCPY_EXIT_DISCONNECTED;
+                }
+                if (!s->reconnecting) {
+                    LOGW("Device disconnected, reconnecting...");
+                    s->reconnecting = true;
+                    if (s->options->control) {
+                        // The server reconnects once the control socket is
+                        // released
+                        sc_controller_stop(&s->controller);
+                        sc_controller_join(&s->controller);
+                        sc_server_release_socket(&s->server,
+                                                 &s->server.control_socket);
+                    }
+                }
+                break;
+            case SC_EVENT_SERVER_CONNECTED:
+                // The initial connection is awaited before the event loop
+                assert(s->reconnecting);
+                if (s->options->control && !reconnect_controller(s)) {
+                    return SCRCPY_EXIT_FAILURE;
+                }
+                s->reconnecting = false;
+                // The demuxers are resumed, the next disconnection must be
+                // handled
+                sc_rearm_event(SC_EVENT_DEVICE_DISCONNECTED);
+                break;
             case SC_EVENT_DEMUXER_ERROR:
                 LOGE("Demuxer error");
                 return SCRCPY_EXIT_FAILURE;
@@ -198,6 +338,9 @@ event_loop(struct scrcpy *s, bool has_screen) {
             case SC_EVENT_TIME_LIMIT_REACHED:
                 LOGI("Time limit reached");
                 return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_TOUCH_BENCHMARK_DONE:
+                LOGD("Touch benchmark done");
+                return SCRCPY_EXIT_SUCCESS;
             case SDL_QUIT:
                 LOGD("User requested to quit");
                 return SCRCPY_EXIT_SUCCESS;
@@ -208,9 +351,17 @@ event_loop(struct scrcpy *s, bool has_screen) {
                 break;
             }
             default:
+                if (handle_extra_screen_event(s, &event)) {
+                    break;
+                }
                 if (has_screen && !sc_screen_handle_event(&s->screen, &event)) {
                     return SCRCPY_EXIT_FAILURE;
                 }
+                if (is_main_window_close(s, &event)) {
+                    // SDL only sends SDL_QUIT when the last window is closed
+                    LOGD("User requested to quit");
+                    return SCRCPY_EXIT_SUCCESS;
+                }
                 break;
         }
     }
@@ -270,6 +421,29 @@ sc_recorder_on_ended(struct sc_recorder *recorder, bool success,
     }
 }
 
+static sc_socket
+sc_demuxer_on_eos(struct sc_demuxer *demuxer, void *userdata) {
+    struct scrcpy *s = userdata;
+
+    sc_socket *socket;
+    if (demuxer == &s->video_demuxer) {
+        socket = &s->server.video_socket;
+    } else if (demuxer == &s->record_demuxer) {
+        socket = &s->server.record_socket;
+    } else if (demuxer == &s->audio_demuxer) {
+        socket = &s->server.audio_socket;
+    } else {
+        size_t index = demuxer - s->extra_demuxers;
+        assert(index < s->options->extra_display_count);
+        socket = &s->server.extra_display_sockets[index];
+    }
+
+    // Stop the controller until reconnected
+    sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
+
+    return sc_server_await_socket(&s->server, socket);
+}
+
 static void
 sc_video_demuxer_on_ended(struct sc_demuxer *demuxer,
                           enum sc_demuxer_status status, void *userdata) {
@@ -291,7 +465,8 @@ sc_audio_demuxer_on_ended(struct sc_demuxer *demuxer,
                           enum sc_demuxer_status status, void *userdata) {
     (void) demuxer;
 
-    const struct scrcpy_options *options = userdata;
+    struct scrcpy *s = userdata;
+    const struct scrcpy_options *options = s->options;
 
     // Contrary to the video demuxer, keep mirroring if only the audio fails
     // (unless --require-audio is set).
@@ -301,14 +476,15 @@ sc_audio_demuxer_on_ended(struct sc_demuxer *demuxer,
             || (status == SC_DEMUXER_STATUS_DISABLED
                 && options->require_audio)) {
         sc_push_event(SC_EVENT_DEMUXER_ERROR);
+    } else if (options->reconnect) {
+        // Do not wait for this stream on reconnection
+        sc_server_disable_audio(&s->server);
     }
 }
 
 static void
 sc_controller_on_ended(struct sc_controller *controller, bool error,
                        void *userdata) {
-    // Note: this function may be called twice, once from the controller thread
-    // and once from the receiver thread
     (void) controller;
     (void) userdata;
 
@@ -319,6 +495,15 @@ sc_controller_on_ended(struct sc_controller *controller, bool error,
     }
 }
 
+static bool
+sc_automation_on_msg(struct sc_automation *automation,
+                     const struct sc_control_msg *msg, void *userdata) {
+    (void) automation;
+
+    struct sc_controller *controller = userdata;
+    return sc_controller_push_msg(controller, msg);
+}
+
 static void
 sc_server_on_connection_failed(struct sc_server *server, void *userdata) {
     (void) server;
@@ -353,6 +538,15 @@ sc_timeout_on_timeout(struct sc_timeout *timeout, void *userdata) {
     sc_push_event(SC_EVENT_TIME_LIMIT_REACHED);
 }
 
+static void
+sc_touch_benchmark_on_end(struct sc_touch_benchmark *benchmark,
+                          void *userdata) {
+    (void) benchmark;
+    (void) userdata;
+
+    sc_push_event(SC_EVENT_TOUCH_BENCHMARK_DONE);
+}
+
 // Generate a scrcpy id to differentiate multiple running scrcpy instances
 static uint32_t
 scrcpy_generate_scid(void) {
@@ -362,6 +556,19 @@ scrcpy_generate_scid(void) {
     return sc_rand_u32(&rand) & 0x7FFFFFFF;
 }
 
+static bool
+set_demuxer_capture(struct sc_demuxer *demuxer, const char *prefix,
+                    const char *suffix) {
+    char *filename = sc_str_concat(prefix, suffix);
+    if (!filename) {
+        return false;
+    }
+
+    bool ok = sc_demuxer_set_capture(demuxer, filename);
+    free(filename);
+    return ok;
+}
+
 static void
 init_sdl_gamepads(void) {
     // Trigger a SDL_CONTROLLERDEVICEADDED event for all gamepads already
@@ -379,12 +586,22 @@ init_sdl_gamepads(void) {
 
 enum scrcpy_exit_code
 scrcpy(struct scrcpy_options *options) {
+    if (options->print_startup_timing) {
+        sc_startup_timing_enable();
+    }
+
+    if (options->trace_filename) {
+        sc_trace_enable();
+    }
+
     static struct scrcpy scrcpy;
 #ifndef NDEBUG
     // Detect missing initializations
     memset(&scrcpy, 42, sizeof(scrcpy));
 #endif
     struct scrcpy *s = &scrcpy;
+    s->options = options;
+    s->reconnecting = false;
 
     // Minimal SDL initialization
     if (SDL_Init(SDL_INIT_EVENTS)) {
@@ -398,21 +615,74 @@ scrcpy(struct scrcpy_options *options) {
 
     bool server_started = false;
     bool file_pusher_initialized = false;
+    bool screenshot_initialized = false;
+    bool latency_tracker_initialized = false;
+    bool stream_clock_initialized = false;
+    bool metrics_exporter_initialized = false;
+    bool metrics_exporter_started = false;
+    bool soak_monitor_initialized = false;
+    bool soak_monitor_started = false;
+    bool decode_benchmark_initialized = false;
     bool recorder_initialized = false;
     bool recorder_started = false;
+    bool upload_target_initialized = false;
+    bool replay_buffer_initialized = false;
+    bool record_switch_initialized = false;
+    bool restreamer_initialized = false;
+    bool restream_queue_initialized = false;
+    bool raw_sink_initialized = false;
+    bool raw_queue_initialized = false;
+    bool shm_sink_initialized = false;
+    bool shm_queue_initialized = false;
+    bool thumbnail_sink_initialized = false;
+    bool thumbnail_queue_initialized = false;
+    bool transcoder_initialized = false;
+    bool transcode_queue_initialized = false;
+    bool touch_benchmark_initialized = false;
+    bool touch_benchmark_started = false;
+    unsigned plugin_sinks_initialized = 0;
+    unsigned plugin_queues_initialized = 0;
 #ifdef HAVE_V4L2
     bool v4l2_sink_initialized = false;
+    bool v4l2_buffer_initialized = false;
+    bool v4l2_queue_initialized = false;
 #endif
+    bool video_packet_buffer_initialized = false;
+    bool video_packet_queue_initialized = false;
+    bool video_decoder_initialized = false;
+    bool audio_decoder_initialized = false;
+    bool timer_service_initialized = false;
+    bool timer_service_started = false;
+    bool video_buffer_initialized = false;
+    bool video_pacer_initialized = false;
+    bool video_demuxer_initialized = false;
     bool video_demuxer_started = false;
+    bool record_demuxer_initialized = false;
+    bool record_demuxer_started = false;
+    bool audio_demuxer_initialized = false;
     bool audio_demuxer_started = false;
+    // Number of extra display components initialized (or started)
+    unsigned extra_demuxers_initialized = 0;
+    unsigned extra_demuxers_started = 0;
+    unsigned extra_decoders_initialized = 0;
+    unsigned extra_screens_initialized = 0;
 #ifdef HAVE_USB
     bool aoa_hid_initialized = false;
     bool keyboard_aoa_initialized = false;
     bool mouse_aoa_initialized = false;
     bool gamepad_aoa_initialized = false;
 #endif
+    bool gamepad_uhid_initialized = false;
     bool controller_initialized = false;
     bool controller_started = false;
+    bool input_recorder_initialized = false;
+    bool input_replayer_initialized = false;
+    bool input_replayer_started = false;
+    bool automation_initialized = false;
+    bool automation_started = false;
+    bool screen_window_opened = false;
+    // Hardware decoding device created while the server starts (may be NULL)
+    AVBufferRef *video_hw_device = NULL;
     bool screen_initialized = false;
     bool timeout_initialized = false;
     bool timeout_started = false;
@@ -436,8 +706,13 @@ scrcpy(struct scrcpy_options *options) {
         .port_range = options->port_range,
         .tunnel_host = options->tunnel_host,
         .tunnel_port = options->tunnel_port,
+        .direct_tcp_port = options->direct_tcp_port,
         .max_size = options->max_size,
         .video_bit_rate = options->video_bit_rate,
+        .record_video_bit_rate = options->record_video_bit_rate,
+        .record_max_size = options->record_max_size,
+        .video_socket_buffer_size = options->video_socket_buffer_size,
+        .video_socket_busy_poll = options->video_socket_busy_poll,
         .audio_bit_rate = options->audio_bit_rate,
         .max_fps = options->max_fps,
         .angle = options->angle,
@@ -447,11 +722,17 @@ scrcpy(struct scrcpy_options *options) {
         .control = options->control,
         .display_id = options->display_id,
         .new_display = options->new_display,
+        .extra_displays = options->extra_displays,
+        .extra_display_count = options->extra_display_count,
         .display_ime_policy = options->display_ime_policy,
         .video = options->video,
+        .record_stream = options->record_stream,
         .audio = options->audio,
         .audio_dup = options->audio_dup,
         .show_touches = options->show_touches,
+        // The touch benchmark detects the pointer location overlay
+        .pointer_location = !!options->benchmark_touch,
+        .match_refresh_rate = options->match_refresh_rate,
         .stay_awake = options->stay_awake,
         .video_codec_options = options->video_codec_options,
         .audio_codec_options = options->audio_codec_options,
@@ -462,6 +743,7 @@ scrcpy(struct scrcpy_options *options) {
         .camera_ar = options->camera_ar,
         .camera_fps = options->camera_fps,
         .force_adb_forward = options->force_adb_forward,
+        .auto_tunnel = options->auto_tunnel,
         .power_off_on_close = options->power_off_on_close,
         .clipboard_autosync = options->clipboard_autosync,
         .downsize_on_error = options->downsize_on_error,
@@ -470,12 +752,46 @@ scrcpy(struct scrcpy_options *options) {
         .cleanup = options->cleanup,
         .power_on = options->power_on,
         .kill_adb_on_close = options->kill_adb_on_close,
+#ifdef HAVE_USB
+        .adb_usb = options->adb_usb,
+#endif
         .camera_high_speed = options->camera_high_speed,
+        .video_low_latency = options->video_low_latency,
+        .video_intra_refresh = options->video_intra_refresh,
+        .video_bit_rate_mode = options->video_bit_rate_mode,
+        .video_quality = options->video_quality,
+        .video_max_bit_rate = options->video_max_bit_rate,
+        .input_pacing = options->input_pacing,
+        .video_idle_timeout = options->video_idle_timeout,
+        // The repeated frames are only flagged if the device tracks them
+        .video_mark_repeated_frames = options->video_skip_repeated_frames,
         .vd_destroy_content = options->vd_destroy_content,
         .vd_system_decorations = options->vd_system_decorations,
+        // The device timestamps are only used to measure the latency
+        .send_frame_timestamp = options->video_playback
+                             && options->print_latency,
+        .reconnect = options->reconnect,
         .list = options->list,
     };
 
+    if (params.video_codec == SC_CODEC_AUTO) {
+        if (options->video) {
+            // The device selects the best codec it can encode among those
+            // which can be decoded efficiently
+            unsigned count =
+                sc_hwaccel_rank_video_codecs(options->video_hwaccel,
+                                             params.video_codec_candidates);
+            if (!count) {
+                LOGE("No video decoder available");
+                return SCRCPY_EXIT_FAILURE;
+            }
+            params.video_codec_candidate_count = count;
+        } else {
+            // Unused
+            params.video_codec = SC_CODEC_H264;
+        }
+    }
+
     static const struct sc_server_callbacks cbs = {
         .on_connection_failed = sc_server_on_connection_failed,
         .on_connected = sc_server_on_connected,
@@ -540,6 +856,54 @@ scrcpy(struct scrcpy_options *options) {
 
     sdl_configure(options->video_playback, options->disable_screensaver);
 
+    if (options->window) {
+        // Create the window and its renderer while the server is starting on
+        // the device, they do not depend on it
+        struct sc_screen_window_params window_params = {
+            .video = options->video_playback,
+            .always_on_top = options->always_on_top,
+            .window_x = options->window_x,
+            .window_y = options->window_y,
+            .window_width = options->window_width,
+            .window_height = options->window_height,
+            .window_borderless = options->window_borderless,
+            .mipmaps = options->mipmaps,
+            .present_mode = options->present_mode,
+            .yuv_shader = options->yuv_shader,
+        };
+
+        if (!sc_screen_open_window(&s->screen, &window_params)) {
+            goto end;
+        }
+        screen_window_opened = true;
+    }
+
+    bool needs_video_decoder = options->video_playback
+                            || options->benchmark_decode
+                            || options->shm_name
+                            || options->thumbnail_filename
+                            || options->benchmark_touch
+                            || options->record_transcode
+                            || options->frame_sink_plugin_count;
+#ifdef HAVE_V4L2
+    needs_video_decoder |= !!options->v4l2_device;
+#endif
+
+    if (needs_video_decoder && options->video_hwaccel != SC_HWACCEL_NONE) {
+        // Creating the hardware decoding device does not depend on the
+        // device either, create it for the expected codec (the demuxer checks
+        // that it supports the actual one)
+        enum sc_codec expected_codec = params.video_codec;
+        if (expected_codec == SC_CODEC_AUTO) {
+            // The first candidate is the one the device selects if it can
+            // encode it
+            assert(params.video_codec_candidate_count);
+            expected_codec = params.video_codec_candidates[0];
+        }
+        video_hw_device = sc_hwaccel_create_device(expected_codec,
+                                                   options->video_hwaccel);
+    }
+
     // Await for server without blocking Ctrl+C handling
     bool connected;
     if (!await_for_server(&connected)) {
@@ -564,7 +928,13 @@ scrcpy(struct scrcpy_options *options) {
 
     struct sc_file_pusher *fp = NULL;
 
-    if (options->video_playback && options->control) {
+    bool adb_usb = false;
+#ifdef HAVE_USB
+    // The file pusher executes adb commands, which require the adb server
+    adb_usb = options->adb_usb;
+#endif
+
+    if (options->video_playback && options->control && !adb_usb) {
         if (!sc_file_pusher_init(&s->file_pusher, serial,
                                  options->push_target)) {
             goto end;
@@ -573,66 +943,434 @@ scrcpy(struct scrcpy_options *options) {
         file_pusher_initialized = true;
     }
 
+    struct sc_latency_tracker *latency_tracker = NULL;
+
+    if (options->video_playback && options->print_latency) {
+        if (!sc_latency_tracker_init(&s->latency_tracker)) {
+            goto end;
+        }
+        latency_tracker = &s->latency_tracker;
+        latency_tracker_initialized = true;
+        sc_latency_tracker_set_present_mode(latency_tracker,
+                                            options->present_mode);
+        sc_latency_tracker_set_budget(latency_tracker,
+                                      options->latency_budget);
+    }
+
+    // The components register their metrics on initialization (NULL if the
+    // metrics are not exported)
+    struct sc_metrics *metrics = NULL;
+
+    if (options->metrics_filename || options->metrics_port) {
+        sc_metrics_init(&s->metrics);
+        metrics = &s->metrics;
+
+        if (!sc_metrics_exporter_init(&s->metrics_exporter, metrics,
+                                      options->metrics_filename,
+                                      options->metrics_interval,
+                                      options->metrics_port)) {
+            goto end;
+        }
+        metrics_exporter_initialized = true;
+
+        if (!sc_metrics_exporter_start(&s->metrics_exporter)) {
+            goto end;
+        }
+        metrics_exporter_started = true;
+
+        if (options->soak) {
+            if (!sc_soak_monitor_init(&s->soak_monitor, metrics,
+                                      options->metrics_interval)) {
+                goto end;
+            }
+            soak_monitor_initialized = true;
+
+            if (!sc_soak_monitor_start(&s->soak_monitor)) {
+                goto end;
+            }
+            soak_monitor_started = true;
+        }
+
+        if (latency_tracker) {
+            sc_latency_tracker_set_metrics(latency_tracker, metrics);
+        }
+    }
+
+    if (options->video || options->audio) {
+        if (!sc_stream_clock_init(&s->stream_clock)) {
+            goto end;
+        }
+        stream_clock_initialized = true;
+        sc_stream_clock_set_metrics(&s->stream_clock, metrics);
+    }
+
+    // With --reconnect, the demuxers resume the streams on the new connection
+    sc_socket (*demuxer_on_eos)(struct sc_demuxer *, void *) =
+        options->reconnect ? sc_demuxer_on_eos : NULL;
+
     if (options->video) {
-        static const struct sc_demuxer_callbacks video_demuxer_cbs = {
+        static struct sc_demuxer_callbacks video_demuxer_cbs = {
+            .on_ended = sc_video_demuxer_on_ended,
+        };
+        video_demuxer_cbs.on_eos = demuxer_on_eos;
+        if (!sc_demuxer_init(&s->video_demuxer, "video",
+                             s->server.video_socket, &video_demuxer_cbs, s)) {
+            goto end;
+        }
+        video_demuxer_initialized = true;
+        sc_demuxer_set_thread_sched(&s->video_demuxer,
+                                &options->thread_sched[SC_THREAD_ROLE_VIDEO]);
+        sc_demuxer_set_metrics(&s->video_demuxer, metrics);
+        sc_demuxer_set_stream_clock(&s->video_demuxer, &s->stream_clock,
+                                    SC_STREAM_CLOCK_SOURCE_VIDEO);
+        if (latency_tracker) {
+            sc_demuxer_set_latency_tracker(&s->video_demuxer, latency_tracker);
+        }
+        if (options->stream_capture_prefix
+                && !set_demuxer_capture(&s->video_demuxer,
+                                        options->stream_capture_prefix,
+                                        SC_STREAM_CAPTURE_VIDEO_SUFFIX)) {
+            goto end;
+        }
+    }
+
+    if (options->record_stream) {
+        static struct sc_demuxer_callbacks record_demuxer_cbs = {
             .on_ended = sc_video_demuxer_on_ended,
         };
-        sc_demuxer_init(&s->video_demuxer, "video", s->server.video_socket,
-                        &video_demuxer_cbs, NULL);
+        record_demuxer_cbs.on_eos = demuxer_on_eos;
+        if (!sc_demuxer_init(&s->record_demuxer, "record",
+                             s->server.record_socket, &record_demuxer_cbs,
+                             s)) {
+            goto end;
+        }
+        record_demuxer_initialized = true;
+        // The record stream only feeds the recorder
+        sc_demuxer_set_thread_sched(&s->record_demuxer,
+                              &options->thread_sched[SC_THREAD_ROLE_RECORDER]);
+        sc_demuxer_set_metrics(&s->record_demuxer, metrics);
     }
 
     if (options->audio) {
-        static const struct sc_demuxer_callbacks audio_demuxer_cbs = {
+        static struct sc_demuxer_callbacks audio_demuxer_cbs = {
             .on_ended = sc_audio_demuxer_on_ended,
         };
-        sc_demuxer_init(&s->audio_demuxer, "audio", s->server.audio_socket,
-                        &audio_demuxer_cbs, options);
+        audio_demuxer_cbs.on_eos = demuxer_on_eos;
+        if (!sc_demuxer_init(&s->audio_demuxer, "audio",
+                             s->server.audio_socket, &audio_demuxer_cbs, s)) {
+            goto end;
+        }
+        audio_demuxer_initialized = true;
+        sc_demuxer_set_thread_sched(&s->audio_demuxer,
+                                &options->thread_sched[SC_THREAD_ROLE_AUDIO]);
+        sc_demuxer_set_metrics(&s->audio_demuxer, metrics);
+        sc_demuxer_set_stream_clock(&s->audio_demuxer, &s->stream_clock,
+                                    SC_STREAM_CLOCK_SOURCE_AUDIO);
+        if (options->stream_capture_prefix
+                && !set_demuxer_capture(&s->audio_demuxer,
+                                        options->stream_capture_prefix,
+                                        SC_STREAM_CAPTURE_AUDIO_SUFFIX)) {
+            goto end;
+        }
     }
 
-    bool needs_video_decoder = options->video_playback;
-    bool needs_audio_decoder = options->audio_playback;
+    // Raw PCM samples are played without decoding (they are little-endian)
+    bool audio_passthrough = options->audio_playback
+                          && options->audio_codec == SC_CODEC_RAW
+                          && SDL_BYTEORDER == SDL_LIL_ENDIAN;
+    bool needs_audio_decoder = options->audio_playback && !audio_passthrough;
+
+    // The delayed frames (or packets) of all the delay buffers are released
+    // from a single timer thread
+    bool timer_service_needed = options->window
+                             && options->video_playback
+                             && (options->video_buffer
+                                 || options->video_buffer_max
+                                 || options->av_sync);
 #ifdef HAVE_V4L2
-    needs_video_decoder |= !!options->v4l2_device;
+    timer_service_needed |= options->v4l2_device && options->v4l2_buffer;
 #endif
+    // The video packets may be delayed before decoding
+    bool video_packets_buffered = options->video_playback
+                               && options->video_buffer_packets;
+    timer_service_needed |= video_packets_buffered;
+    // The rate-limited UHID gamepad reports are sent from the timer thread
+    timer_service_needed |=
+        options->gamepad_input_mode == SC_GAMEPAD_INPUT_MODE_UHID
+            && options->gamepad_report_rate;
+    if (timer_service_needed) {
+        if (!sc_timer_service_init(&s->timer_service)) {
+            goto end;
+        }
+        timer_service_initialized = true;
+
+        if (!sc_timer_service_start(&s->timer_service)) {
+            goto end;
+        }
+        timer_service_started = true;
+    }
+
     if (needs_video_decoder) {
-        sc_decoder_init(&s->video_decoder, "video");
-        sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                  &s->video_decoder.packet_sink);
+        if (options->video_hwaccel != SC_HWACCEL_NONE) {
+            sc_demuxer_set_hwaccel(&s->video_demuxer, options->video_hwaccel);
+            if (video_hw_device) {
+                sc_demuxer_set_hwaccel_device(&s->video_demuxer,
+                                              video_hw_device);
+                // The demuxer owns it
+                video_hw_device = NULL;
+            }
+        }
+        sc_demuxer_set_decoder_threads(&s->video_demuxer,
+                                       options->video_decoder_threads,
+                                       options->video_decoder_thread_type);
+        sc_demuxer_set_skip_repeated_frames(&s->video_demuxer,
+                                        options->video_skip_repeated_frames);
+        sc_demuxer_set_decoder_error_concealment(&s->video_demuxer,
+                                            options->video_decoder_resilient);
+        sc_demuxer_set_catch_up(&s->video_demuxer, options->video_catch_up);
+        if (!sc_decoder_init(&s->video_decoder, "video")) {
+            goto end;
+        }
+        video_decoder_initialized = true;
+        sc_decoder_set_resilient(&s->video_decoder,
+                                 options->video_decoder_resilient);
+        sc_decoder_set_metrics(&s->video_decoder, metrics);
+        if (options->video_decoder_skip_nonref) {
+            sc_decoder_enable_nonref_skip(&s->video_decoder);
+        }
+        if (latency_tracker) {
+            sc_decoder_set_latency_tracker(&s->video_decoder, latency_tracker);
+        }
+        struct sc_packet_source *src = &s->video_demuxer.packet_source;
+        if (video_packets_buffered) {
+            if (!sc_packet_delay_buffer_init(&s->video_packet_buffer,
+                                             &s->timer_service,
+                                             options->video_buffer)) {
+                goto end;
+            }
+            video_packet_buffer_initialized = true;
+            if (!sc_packet_source_add_sink(src,
+                                   &s->video_packet_buffer.packet_sink)) {
+                goto end;
+            }
+            src = &s->video_packet_buffer.packet_source;
+
+            // The delayed packets are released from the timer service thread,
+            // which must not decode them
+            if (!sc_packet_queue_init(&s->video_packet_queue, "video-delayed",
+                                      128)) {
+                goto end;
+            }
+            video_packet_queue_initialized = true;
+            if (!sc_packet_source_add_sink(src,
+                                   &s->video_packet_queue.packet_sink)) {
+                goto end;
+            }
+            src = &s->video_packet_queue.packet_source;
+        }
+        if (options->benchmark_decode) {
+            sc_decode_benchmark_init(&s->decode_benchmark);
+            decode_benchmark_initialized = true;
+            // Add it before the decoder, to receive the packets just before
+            if (!sc_packet_source_add_sink(src,
+                                           &s->decode_benchmark.packet_sink)) {
+                goto end;
+            }
+            if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                          &s->decode_benchmark.frame_sink)) {
+                goto end;
+            }
+        }
+        if (!sc_packet_source_add_sink(src, &s->video_decoder.packet_sink)) {
+            goto end;
+        }
     }
     if (needs_audio_decoder) {
-        sc_decoder_init(&s->audio_decoder, "audio");
-        sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
-                                  &s->audio_decoder.packet_sink);
+        if (!sc_decoder_init(&s->audio_decoder, "audio")) {
+            goto end;
+        }
+        audio_decoder_initialized = true;
+        if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                       &s->audio_decoder.packet_sink)) {
+            goto end;
+        }
     }
 
-    if (options->record_filename) {
+    if (options->record_filename && !options->record_on_demand) {
+        if (options->record_upload_url) {
+            if (!sc_s3_target_init(&s->upload_target,
+                                   options->record_upload_url)) {
+                goto end;
+            }
+            upload_target_initialized = true;
+        }
+
         static const struct sc_recorder_callbacks recorder_cbs = {
             .on_ended = sc_recorder_on_ended,
         };
+        struct sc_recorder_segment_params segment = {
+            .duration = options->record_segment_duration,
+            .size = options->record_segment_size,
+            .count = options->record_segment_count,
+        };
         if (!sc_recorder_init(&s->recorder, options->record_filename,
                               options->record_format, options->video,
                               options->audio, options->record_orientation,
+                              &segment, options->record_memory_limit,
                               &recorder_cbs, NULL)) {
             goto end;
         }
         recorder_initialized = true;
 
+        sc_recorder_set_fragment_duration(&s->recorder,
+                                          options->record_fragment_duration);
+        if (options->record_index) {
+            sc_recorder_set_keyframe_index(&s->recorder);
+        }
+        if (options->record_sync) {
+            assert(stream_clock_initialized);
+            sc_recorder_set_sync_clock(&s->recorder, &s->stream_clock);
+        }
+        if (upload_target_initialized) {
+            sc_recorder_set_upload(&s->recorder, &s->upload_target,
+                                   options->record_upload_only);
+        }
+        sc_recorder_set_thread_sched(&s->recorder,
+                              &options->thread_sched[SC_THREAD_ROLE_RECORDER]);
+        sc_recorder_set_metrics(&s->recorder, metrics);
+
         if (!sc_recorder_start(&s->recorder)) {
             goto end;
         }
         recorder_started = true;
 
+        if (options->record_transcode) {
+            assert(options->video);
+            assert(needs_video_decoder);
+
+            if (!sc_transcoder_init(&s->transcoder,
+                                    options->record_transcode_codec,
+                                    options->record_transcode_quality)) {
+                goto end;
+            }
+            transcoder_initialized = true;
+
+            // Encoding must never delay the other sinks: if the encoder is
+            // too slow, frames are dropped from the recording
+            if (!sc_frame_queue_init(&s->transcode_queue, "transcode",
+                                     SC_FRAME_QUEUE_POLICY_DROP_OLDEST, 16)) {
+                goto end;
+            }
+            transcode_queue_initialized = true;
+
+            if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                          &s->transcode_queue.frame_sink)) {
+                goto end;
+            }
+
+            if (!sc_frame_source_add_sink(&s->transcode_queue.frame_source,
+                                          &s->transcoder.frame_sink)) {
+                goto end;
+            }
+
+            if (!sc_packet_source_add_sink(&s->transcoder.packet_source,
+                                           &s->recorder.video_packet_sink)) {
+                goto end;
+            }
+        } else if (options->video) {
+            // With --record-stream, the recorder receives its own video stream
+            struct sc_demuxer *demuxer = options->record_stream
+                                       ? &s->record_demuxer
+                                       : &s->video_demuxer;
+            if (!sc_packet_source_add_sink(&demuxer->packet_source,
+                                           &s->recorder.video_packet_sink)) {
+                goto end;
+            }
+        }
+        if (options->audio) {
+            if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                           &s->recorder.audio_packet_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    struct sc_replay_buffer *replay_buffer = NULL;
+    if (options->replay_buffer) {
+        if (!sc_replay_buffer_init(&s->replay_buffer, options->replay_filename,
+                                   options->replay_format,
+                                   options->record_orientation,
+                                   options->replay_buffer)) {
+            goto end;
+        }
+        replay_buffer_initialized = true;
+        replay_buffer = &s->replay_buffer;
+        sc_replay_buffer_set_metrics(replay_buffer, metrics);
+
         if (options->video) {
-            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                      &s->recorder.video_packet_sink);
+            if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                           &replay_buffer->video_packet_sink)) {
+                goto end;
+            }
         }
         if (options->audio) {
-            sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
-                                      &s->recorder.audio_packet_sink);
+            if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                           &replay_buffer->audio_packet_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    if (options->restream_url) {
+        if (!sc_restreamer_init(&s->restreamer, options->restream_url)) {
+            goto end;
+        }
+        restreamer_initialized = true;
+
+        // Never delay the other sinks on a slow network (about 2 seconds of
+        // video at 60 fps)
+        if (!sc_packet_queue_init(&s->restream_queue, "restream", 128)) {
+            goto end;
+        }
+        restream_queue_initialized = true;
+
+        if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                       &s->restream_queue.packet_sink)) {
+            goto end;
+        }
+
+        if (!sc_packet_source_add_sink(&s->restream_queue.packet_source,
+                                       &s->restreamer.packet_sink)) {
+            goto end;
+        }
+    }
+
+    if (options->raw_video_filename) {
+        if (!sc_raw_sink_init(&s->raw_sink, options->raw_video_filename,
+                              options->raw_video_header)) {
+            goto end;
+        }
+        raw_sink_initialized = true;
+
+        // A slow reader must not delay the other sinks
+        if (!sc_packet_queue_init(&s->raw_queue, "raw", 128)) {
+            goto end;
+        }
+        raw_queue_initialized = true;
+
+        if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                       &s->raw_queue.packet_sink)) {
+            goto end;
+        }
+
+        if (!sc_packet_source_add_sink(&s->raw_queue.packet_source,
+                                       &s->raw_sink.packet_sink)) {
+            goto end;
         }
     }
 
     struct sc_controller *controller = NULL;
+    struct sc_video_feedback *video_feedback = NULL;
     struct sc_key_processor *kp = NULL;
     struct sc_mouse_processor *mp = NULL;
     struct sc_gamepad_processor *gp = NULL;
@@ -650,6 +1388,54 @@ scrcpy(struct scrcpy_options *options) {
 
         controller = &s->controller;
 
+        sc_controller_set_thread_sched(&s->controller,
+                            &options->thread_sched[SC_THREAD_ROLE_CONTROLLER]);
+        sc_controller_set_metrics(&s->controller, metrics);
+
+        if (options->input_record_filename) {
+            if (!sc_input_recorder_init(&s->input_recorder,
+                                        options->input_record_filename)) {
+                goto end;
+            }
+            input_recorder_initialized = true;
+
+            sc_controller_set_input_recorder(&s->controller,
+                                             &s->input_recorder);
+        }
+
+        if (options->input_replay_filename) {
+            if (!sc_input_replayer_init(&s->input_replayer,
+                                        options->input_replay_filename,
+                                        &s->controller)) {
+                goto end;
+            }
+            input_replayer_initialized = true;
+        }
+
+        if (options->automation_port) {
+            static const struct sc_automation_callbacks automation_cbs = {
+                .on_msg = sc_automation_on_msg,
+            };
+
+            if (!sc_automation_init(&s->automation, options->automation_port,
+                                    &automation_cbs, &s->controller)) {
+                goto end;
+            }
+            automation_initialized = true;
+
+            sc_controller_set_automation(&s->controller, &s->automation);
+        }
+
+        if (options->clipboard_autosync) {
+            // The device clipboard changes are received, so its content is
+            // known
+            sc_controller_set_clipboard_by_hash(&s->controller);
+        }
+
+        // The server always has the same version as the client, so it
+        // supports the compact encoding
+        sc_controller_set_compact_input(&s->controller);
+
 #ifdef HAVE_USB
         bool use_keyboard_aoa =
             options->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AOA;
@@ -724,7 +1510,8 @@ scrcpy(struct scrcpy_options *options) {
             }
 
             if (use_gamepad_aoa) {
-                sc_gamepad_aoa_init(&s->gamepad_aoa, &s->aoa);
+                sc_gamepad_aoa_init(&s->gamepad_aoa, &s->aoa,
+                                    options->gamepad_report_rate);
                 gp = &s->gamepad_aoa.gamepad_processor;
                 gamepad_aoa_initialized = true;
             }
@@ -777,8 +1564,14 @@ aoa_complete:
         }
 
         if (options->gamepad_input_mode == SC_GAMEPAD_INPUT_MODE_UHID) {
-            sc_gamepad_uhid_init(&s->gamepad_uhid, &s->controller);
+            bool ok = sc_gamepad_uhid_init(&s->gamepad_uhid, &s->controller,
+                                           options->gamepad_report_rate,
+                                           &s->timer_service);
+            if (!ok) {
+                goto end;
+            }
             gp = &s->gamepad_uhid.gamepad_processor;
+            gamepad_uhid_initialized = true;
         }
 
         struct sc_uhid_devices *uhid_devices = NULL;
@@ -789,41 +1582,188 @@ aoa_complete:
 
         sc_controller_configure(&s->controller, acksync, uhid_devices);
 
-        if (!sc_controller_start(&s->controller)) {
+        if (latency_tracker) {
+            sc_controller_set_latency_tracker(&s->controller, latency_tracker);
+        }
+
+        if (needs_video_decoder) {
+            // Request a keyframe on decoding error
+            sc_decoder_set_controller(&s->video_decoder, &s->controller);
+        }
+
+        if (options->video_catch_up) {
+            // Do not wait for the next periodic keyframe to catch up
+            sc_demuxer_set_keyframe_requester(&s->video_demuxer,
+                                              &s->controller);
+        }
+
+        if (restreamer_initialized) {
+            // Start the stream immediately for every new viewer
+            sc_restreamer_set_keyframe_requester(&s->restreamer,
+                                                 &s->controller);
+        }
+
+        if (recorder_initialized && options->video_intra_refresh
+                && !options->record_stream && !options->record_transcode) {
+            // Without periodic keyframes, the recorder must request them
+            sc_recorder_set_keyframe_requester(&s->recorder, &s->controller);
+        }
+
+        if (options->adaptive_bit_rate) {
+            assert(options->video);
+            sc_video_feedback_init(&s->video_feedback, &s->controller);
+            video_feedback = &s->video_feedback;
+            if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                           &s->video_feedback.packet_sink)) {
+                goto end;
+            }
+        }
+
+        if (!sc_controller_start(&s->controller)) {
             goto end;
         }
         controller_started = true;
+
+        if (input_replayer_initialized) {
+            if (!sc_input_replayer_start(&s->input_replayer)) {
+                goto end;
+            }
+            input_replayer_started = true;
+        }
+
+        if (automation_initialized) {
+            if (!sc_automation_start(&s->automation)) {
+                goto end;
+            }
+            automation_started = true;
+        }
     }
 
     // There is a controller if and only if control is enabled
     assert(options->control == !!controller);
 
+    struct sc_record_switch *record_switch = NULL;
+    if (options->record_on_demand) {
+        assert(options->record_filename);
+        struct sc_record_switch_params rs_params = {
+            .filename = options->record_filename,
+            .format = options->record_format,
+            .orientation = options->record_orientation,
+            .segment = {
+                .duration = options->record_segment_duration,
+                .size = options->record_segment_size,
+                .count = options->record_segment_count,
+            },
+            .memory_limit = options->record_memory_limit,
+            .fragment_duration = options->record_fragment_duration,
+            .keyframe_index = options->record_index,
+            .sync_clock = options->record_sync ? &s->stream_clock : NULL,
+            .video_source = options->video ? &s->video_demuxer.packet_source
+                                           : NULL,
+            .audio_source = options->audio ? &s->audio_demuxer.packet_source
+                                           : NULL,
+            .controller = controller,
+            .no_periodic_keyframes = options->video_intra_refresh
+                                  && !options->record_stream,
+        };
+        if (!sc_record_switch_init(&s->record_switch, &rs_params)) {
+            goto end;
+        }
+        record_switch_initialized = true;
+        record_switch = &s->record_switch;
+    }
+
+    struct sc_screenshot *screenshot = NULL;
+    if (options->video_playback) {
+        if (!sc_screenshot_init(&s->screenshot, options->screenshot_dir,
+                                options->screenshot_format)) {
+            goto end;
+        }
+        screenshot_initialized = true;
+        screenshot = &s->screenshot;
+    }
+
     if (options->window) {
         const char *window_title =
             options->window_title ? options->window_title : info->device_name;
 
+        // Only report the skipped frames if they are handled by the decoder
+        struct sc_decoder *skip_decoder =
+            options->video_playback && options->video_decoder_skip_nonref
+                ? &s->video_decoder : NULL;
+
+        // The encoding may only be suspended while the window is minimized if
+        // the video is not consumed by anything else
+        bool background_pause = !options->record_filename
+                             && !options->replay_buffer
+                             && !options->shm_name
+                             && !options->restream_url
+                             && !options->thumbnail_filename
+                             && !options->raw_video_filename
+                             && !options->frame_sink_plugin_count;
+#ifdef HAVE_V4L2
+        background_pause &= !options->v4l2_device;
+#endif
+
+        // For the same reason, the video resolution may only follow the
+        // window if the video is not consumed by anything else
+        bool adaptive_max_size = options->adaptive_max_size;
+        if (adaptive_max_size && !background_pause) {
+            LOGW("--adaptive-max-size has no effect if the video is also "
+                 "recorded or forwarded");
+            adaptive_max_size = false;
+        }
+
+        bool resize_display = options->new_display_follow_window;
+        if (resize_display && !background_pause) {
+            LOGW("--new-display-follow-window has no effect if the video is "
+                 "also recorded or forwarded");
+            resize_display = false;
+        }
+
+        // The decoder may only skip the non-reference frames for a small
+        // background window if the decoded frames are not consumed by
+        // anything else
+        bool background_skip_nonref = skip_decoder
+                                   && !options->shm_name
+                                   && !options->thumbnail_filename
+                                   && !options->frame_sink_plugin_count
+                                   && !options->benchmark_decode;
+#ifdef HAVE_V4L2
+        background_skip_nonref &= !options->v4l2_device;
+#endif
+
         struct sc_screen_params screen_params = {
-            .video = options->video_playback,
+            .decoder = skip_decoder,
+            .latency_tracker = latency_tracker,
+            .video_feedback = video_feedback,
+            .metrics = metrics,
+            .video_stats = options->video ? &s->video_demuxer.stats : NULL,
             .controller = controller,
             .fp = fp,
+            .replay_buffer = replay_buffer,
+            .record_switch = record_switch,
+            .screenshot = screenshot,
             .kp = kp,
             .mp = mp,
             .gp = gp,
             .mouse_bindings = options->mouse_bindings,
             .legacy_paste = options->legacy_paste,
             .clipboard_autosync = options->clipboard_autosync,
+            .alt_video_profile = options->has_alt_video_profile
+                               ? &options->alt_video_profile : NULL,
             .shortcut_mods = options->shortcut_mods,
             .window_title = window_title,
-            .always_on_top = options->always_on_top,
-            .window_x = options->window_x,
-            .window_y = options->window_y,
-            .window_width = options->window_width,
-            .window_height = options->window_height,
-            .window_borderless = options->window_borderless,
             .orientation = options->display_orientation,
-            .mipmaps = options->mipmaps,
             .fullscreen = options->fullscreen,
             .start_fps_counter = options->start_fps_counter,
+            .background_max_fps = options->background_max_fps,
+            .background_pause = background_pause,
+            .background_skip_nonref = background_skip_nonref,
+            .adaptive_max_size = adaptive_max_size,
+            .resize_display = resize_display,
+            .cpu_budget = options->cpu_budget,
+            .power_saving = options->power_saving,
         };
 
         if (!sc_screen_init(&s->screen, &screen_params)) {
@@ -833,40 +1773,294 @@ aoa_complete:
 
         if (options->video_playback) {
             struct sc_frame_source *src = &s->video_decoder.frame_source;
-            if (options->video_buffer) {
-                sc_delay_buffer_init(&s->video_buffer,
-                                     options->video_buffer, true);
-                sc_frame_source_add_sink(src, &s->video_buffer.frame_sink);
+            bool video_buffered = true;
+            bool ok = true;
+            if (options->video_buffer_max) {
+                ok = sc_delay_buffer_init_adaptive(&s->video_buffer,
+                                                   &s->timer_service,
+                                                   options->video_buffer,
+                                                   options->video_buffer_max,
+                                                   true);
+            } else if (options->video_buffer_packets) {
+                // Already delayed before decoding
+                video_buffered = false;
+            } else if (options->video_buffer) {
+                ok = sc_delay_buffer_init(&s->video_buffer, &s->timer_service,
+                                          options->video_buffer, true);
+            } else if (options->av_sync) {
+                // Until the audio is played, delay the video by the audio
+                // buffering
+                ok = sc_delay_buffer_init(&s->video_buffer, &s->timer_service,
+                                          options->audio_buffer, true);
+            } else {
+                video_buffered = false;
+            }
+
+            if (!ok) {
+                goto end;
+            }
+
+            if (video_buffered) {
+                video_buffer_initialized = true;
+                sc_delay_buffer_set_metrics(&s->video_buffer, metrics);
+                if (options->av_sync) {
+                    sc_delay_buffer_set_audio_master(&s->video_buffer,
+                                                     &s->audio_player);
+                }
+                if (!sc_frame_source_add_sink(src,
+                                              &s->video_buffer.frame_sink)) {
+                    goto end;
+                }
                 src = &s->video_buffer.frame_source;
             }
 
-            sc_frame_source_add_sink(src, &s->screen.frame_sink);
+            if (options->video_pacing) {
+                sc_tick refresh_period =
+                    sc_screen_get_refresh_period(&s->screen);
+                // With vrr, the display refreshes when the frame is
+                // presented; immediate does not wait for the vertical blank
+                enum sc_present_mode mode = options->present_mode;
+                bool vblank_aligned = mode == SC_PRESENT_MODE_VSYNC
+                                   || mode == SC_PRESENT_MODE_ADAPTIVE;
+                if (!sc_frame_pacer_init(&s->video_pacer, refresh_period,
+                                         vblank_aligned)) {
+                    goto end;
+                }
+                video_pacer_initialized = true;
+                if (!sc_frame_source_add_sink(src,
+                                              &s->video_pacer.frame_sink)) {
+                    goto end;
+                }
+                src = &s->video_pacer.frame_source;
+            }
+
+            if (!sc_frame_source_add_sink(src, &s->screen.frame_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    // Each extra display is demuxed, decoded and rendered separately, in its
+    // own view-only window
+    assert(!options->extra_display_count
+           || (options->window && options->video_playback));
+    for (unsigned i = 0; i < options->extra_display_count; ++i) {
+        static const char *const names[] = {
+            "extra1", "extra2", "extra3", "extra4",
+        };
+        static_assert(ARRAY_LEN(names) == SC_MAX_EXTRA_DISPLAYS,
+                      "one name per extra display");
+
+        static struct sc_demuxer_callbacks extra_demuxer_cbs = {
+            .on_ended = sc_video_demuxer_on_ended,
+        };
+        extra_demuxer_cbs.on_eos = demuxer_on_eos;
+        struct sc_demuxer *demuxer = &s->extra_demuxers[i];
+        if (!sc_demuxer_init(demuxer, names[i],
+                             s->server.extra_display_sockets[i],
+                             &extra_demuxer_cbs, s)) {
+            goto end;
+        }
+        extra_demuxers_initialized++;
+        sc_demuxer_set_metrics(demuxer, metrics);
+        sc_demuxer_set_thread_sched(demuxer,
+                                &options->thread_sched[SC_THREAD_ROLE_VIDEO]);
+        if (options->video_hwaccel != SC_HWACCEL_NONE) {
+            sc_demuxer_set_hwaccel(demuxer, options->video_hwaccel);
+        }
+        sc_demuxer_set_decoder_threads(demuxer, options->video_decoder_threads,
+                                       options->video_decoder_thread_type);
+
+        struct sc_decoder *decoder = &s->extra_decoders[i];
+        if (!sc_decoder_init(decoder, names[i])) {
+            goto end;
+        }
+        extra_decoders_initialized++;
+        if (!sc_packet_source_add_sink(&demuxer->packet_source,
+                                       &decoder->packet_sink)) {
+            goto end;
+        }
+
+        const char *window_title =
+            options->window_title ? options->window_title : info->device_name;
+        char title[256];
+        snprintf(title, sizeof(title), "%s (display %s)", window_title,
+                 options->extra_displays[i]);
+
+        struct sc_extra_screen *es = &s->extra_screens[i];
+        if (!sc_extra_screen_init(es, title, options->always_on_top)) {
+            goto end;
+        }
+        extra_screens_initialized++;
+        if (!sc_frame_source_add_sink(&decoder->frame_source,
+                                      &es->frame_sink)) {
+            goto end;
         }
     }
 
     if (options->audio_playback) {
         sc_audio_player_init(&s->audio_player, options->audio_buffer,
-                             options->audio_output_buffer);
-        sc_frame_source_add_sink(&s->audio_decoder.frame_source,
-                                 &s->audio_player.frame_sink);
+                             options->audio_buffer_max,
+                             options->audio_output_buffer,
+                             options->print_audio_stats);
+        sc_audio_player_set_callback_sched(&s->audio_player,
+                        &options->thread_sched[SC_THREAD_ROLE_AUDIO_CALLBACK]);
+        sc_audio_player_set_metrics(&s->audio_player, metrics);
+        sc_audio_player_set_gain(&s->audio_player,
+                                 options->audio_volume / 100.0f);
+        if (audio_passthrough) {
+            if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                           &s->audio_player.packet_sink)) {
+                goto end;
+            }
+        } else if (!sc_frame_source_add_sink(&s->audio_decoder.frame_source,
+                                             &s->audio_player.frame_sink)) {
+            goto end;
+        }
+    }
+
+    if (options->shm_name) {
+        if (!sc_shm_sink_init(&s->shm_sink, options->shm_name)) {
+            goto end;
+        }
+        shm_sink_initialized = true;
+
+        // Never delay the other sinks, only the last frame is kept when the
+        // copy to the shared memory cannot keep up
+        if (!sc_frame_queue_init(&s->shm_queue, "shm",
+                                 SC_FRAME_QUEUE_POLICY_LATEST, 1)) {
+            goto end;
+        }
+        shm_queue_initialized = true;
+
+        if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                      &s->shm_queue.frame_sink)) {
+            goto end;
+        }
+
+        if (!sc_frame_source_add_sink(&s->shm_queue.frame_source,
+                                      &s->shm_sink.frame_sink)) {
+            goto end;
+        }
+    }
+
+    if (options->thumbnail_filename) {
+        if (!sc_thumbnail_sink_init(&s->thumbnail_sink,
+                                    options->thumbnail_filename,
+                                    options->thumbnail_format,
+                                    options->thumbnail_size,
+                                    options->thumbnail_interval)) {
+            goto end;
+        }
+        thumbnail_sink_initialized = true;
+
+        // Encoding an image must not delay the other sinks
+        if (!sc_frame_queue_init(&s->thumbnail_queue, "thumbnail",
+                                 SC_FRAME_QUEUE_POLICY_LATEST, 1)) {
+            goto end;
+        }
+        thumbnail_queue_initialized = true;
+
+        if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                      &s->thumbnail_queue.frame_sink)) {
+            goto end;
+        }
+
+        if (!sc_frame_source_add_sink(&s->thumbnail_queue.frame_source,
+                                      &s->thumbnail_sink.frame_sink)) {
+            goto end;
+        }
+    }
+
+    if (options->benchmark_touch) {
+        assert(controller);
+
+        static const struct sc_touch_benchmark_callbacks cbs = {
+            .on_end = sc_touch_benchmark_on_end,
+        };
+        if (!sc_touch_benchmark_init(&s->touch_benchmark, controller,
+                                     options->benchmark_touch, &cbs, NULL)) {
+            goto end;
+        }
+        touch_benchmark_initialized = true;
+
+        // Only a small region of each frame is copied, it does not need its
+        // own frame queue
+        if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                      &s->touch_benchmark.frame_sink)) {
+            goto end;
+        }
+
+        if (!sc_touch_benchmark_start(&s->touch_benchmark)) {
+            goto end;
+        }
+        touch_benchmark_started = true;
+    }
+
+    for (unsigned i = 0; i < options->frame_sink_plugin_count; ++i) {
+        struct sc_plugin_sink *plugin_sink = &s->plugin_sinks[i];
+        struct sc_frame_queue *plugin_queue = &s->plugin_queues[i];
+
+        if (!sc_plugin_sink_init(plugin_sink,
+                                 options->frame_sink_plugins[i])) {
+            goto end;
+        }
+        ++plugin_sinks_initialized;
+
+        // A slow plugin skips frames, but never delays the other sinks
+        if (!sc_frame_queue_init(plugin_queue, "plugin",
+                                 SC_FRAME_QUEUE_POLICY_LATEST, 1)) {
+            goto end;
+        }
+        ++plugin_queues_initialized;
+
+        if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                      &plugin_queue->frame_sink)) {
+            goto end;
+        }
+
+        if (!sc_frame_source_add_sink(&plugin_queue->frame_source,
+                                      &plugin_sink->frame_sink)) {
+            goto end;
+        }
     }
 
 #ifdef HAVE_V4L2
     if (options->v4l2_device) {
-        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device)) {
+        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device,
+                               options->v4l2_format, options->v4l2_fps)) {
             goto end;
         }
+        v4l2_sink_initialized = true;
 
         struct sc_frame_source *src = &s->video_decoder.frame_source;
         if (options->v4l2_buffer) {
-            sc_delay_buffer_init(&s->v4l2_buffer, options->v4l2_buffer, true);
-            sc_frame_source_add_sink(src, &s->v4l2_buffer.frame_sink);
+            if (!sc_delay_buffer_init(&s->v4l2_buffer, &s->timer_service,
+                                      options->v4l2_buffer, true)) {
+                goto end;
+            }
+            v4l2_buffer_initialized = true;
+            if (!sc_frame_source_add_sink(src, &s->v4l2_buffer.frame_sink)) {
+                goto end;
+            }
             src = &s->v4l2_buffer.frame_source;
         }
 
-        sc_frame_source_add_sink(src, &s->v4l2_sink.frame_sink);
+        // The v4l2 sink writes synchronously, only the last frame is kept
+        // when it cannot keep up
+        if (!sc_frame_queue_init(&s->v4l2_queue, "v4l2",
+                                 SC_FRAME_QUEUE_POLICY_LATEST, 1)) {
+            goto end;
+        }
+        v4l2_queue_initialized = true;
+        if (!sc_frame_source_add_sink(src, &s->v4l2_queue.frame_sink)) {
+            goto end;
+        }
 
-        v4l2_sink_initialized = true;
+        if (!sc_frame_source_add_sink(&s->v4l2_queue.frame_source,
+                                      &s->v4l2_sink.frame_sink)) {
+            goto end;
+        }
     }
 #endif
 
@@ -880,6 +2074,20 @@ aoa_complete:
         video_demuxer_started = true;
     }
 
+    if (options->record_stream) {
+        if (!sc_demuxer_start(&s->record_demuxer)) {
+            goto end;
+        }
+        record_demuxer_started = true;
+    }
+
+    for (unsigned i = 0; i < options->extra_display_count; ++i) {
+        if (!sc_demuxer_start(&s->extra_demuxers[i])) {
+            goto end;
+        }
+        extra_demuxers_started++;
+    }
+
     if (options->audio) {
         if (!sc_demuxer_start(&s->audio_demuxer)) {
             goto end;
@@ -953,6 +2161,9 @@ aoa_complete:
         // may only be called once the video demuxer thread is joined (it may
         // take time)
         sc_screen_hide_window(&s->screen);
+        for (unsigned i = 0; i < options->extra_display_count; ++i) {
+            SDL_HideWindow(s->extra_screens[i].window);
+        }
     }
 
 end:
@@ -980,18 +2191,37 @@ end:
         sc_acksync_destroy(acksync);
     }
 #endif
-    if (controller_started) {
+    if (gamepad_uhid_initialized) {
+        sc_gamepad_uhid_destroy(&s->gamepad_uhid);
+    }
+    if (input_replayer_started) {
+        sc_input_replayer_stop(&s->input_replayer);
+    }
+    if (automation_started) {
+        sc_automation_stop(&s->automation);
+    }
+    if (soak_monitor_started) {
+        sc_soak_monitor_stop(&s->soak_monitor);
+    }
+    if (touch_benchmark_started) {
+        sc_touch_benchmark_stop(&s->touch_benchmark);
+    }
+    if (metrics_exporter_started) {
+        sc_metrics_exporter_stop(&s->metrics_exporter);
+    }
+    // While reconnecting, the controller is already stopped and joined
+    if (controller_started && !s->reconnecting) {
         sc_controller_stop(&s->controller);
     }
     if (file_pusher_initialized) {
         sc_file_pusher_stop(&s->file_pusher);
     }
+    if (screenshot_initialized) {
+        sc_screenshot_stop(&s->screenshot);
+    }
     if (recorder_initialized) {
         sc_recorder_stop(&s->recorder);
     }
-    if (screen_initialized) {
-        sc_screen_interrupt(&s->screen);
-    }
 
     if (server_started) {
         // shutdown the sockets and kill the server
@@ -1011,10 +2241,44 @@ end:
         sc_demuxer_join(&s->video_demuxer);
     }
 
+    if (record_demuxer_started) {
+        sc_demuxer_join(&s->record_demuxer);
+    }
+
+    for (unsigned i = 0; i < extra_demuxers_started; ++i) {
+        sc_demuxer_join(&s->extra_demuxers[i]);
+    }
+
     if (audio_demuxer_started) {
         sc_demuxer_join(&s->audio_demuxer);
     }
 
+    // The delay buffers (closed by the demuxers) do not use the timer service
+    // anymore
+    if (timer_service_started) {
+        sc_timer_service_stop(&s->timer_service);
+        sc_timer_service_join(&s->timer_service);
+    }
+    if (timer_service_initialized) {
+        sc_timer_service_destroy(&s->timer_service);
+    }
+
+    if (shm_sink_initialized) {
+        sc_shm_sink_destroy(&s->shm_sink);
+    }
+
+    if (thumbnail_sink_initialized) {
+        sc_thumbnail_sink_destroy(&s->thumbnail_sink);
+    }
+
+    if (transcoder_initialized) {
+        sc_transcoder_destroy(&s->transcoder);
+    }
+
+    for (unsigned i = 0; i < plugin_sinks_initialized; ++i) {
+        sc_plugin_sink_destroy(&s->plugin_sinks[i]);
+    }
+
 #ifdef HAVE_V4L2
     if (v4l2_sink_initialized) {
         sc_v4l2_sink_destroy(&s->v4l2_sink);
@@ -1035,16 +2299,61 @@ end:
     // finished, because otherwise the screen could receive new frames after
     // destruction
     if (screen_initialized) {
-        sc_screen_join(&s->screen);
         sc_screen_destroy(&s->screen);
     }
 
-    if (controller_started) {
+    if (screen_window_opened) {
+        sc_screen_close_window(&s->screen);
+    }
+
+    av_buffer_unref(&video_hw_device);
+
+    for (unsigned i = 0; i < extra_screens_initialized; ++i) {
+        sc_extra_screen_destroy(&s->extra_screens[i]);
+    }
+
+    if (latency_tracker_initialized) {
+        sc_latency_tracker_destroy(&s->latency_tracker);
+    }
+
+    // The demuxers are joined
+    if (stream_clock_initialized) {
+        sc_stream_clock_destroy(&s->stream_clock);
+    }
+
+    if (decode_benchmark_initialized) {
+        sc_decode_benchmark_destroy(&s->decode_benchmark);
+    }
+
+    if (touch_benchmark_started) {
+        sc_touch_benchmark_join(&s->touch_benchmark);
+    }
+    if (touch_benchmark_initialized) {
+        sc_touch_benchmark_destroy(&s->touch_benchmark);
+    }
+
+    if (input_replayer_started) {
+        sc_input_replayer_join(&s->input_replayer);
+    }
+    if (input_replayer_initialized) {
+        sc_input_replayer_destroy(&s->input_replayer);
+    }
+    if (automation_started) {
+        sc_automation_join(&s->automation);
+    }
+    if (controller_started && !s->reconnecting) {
         sc_controller_join(&s->controller);
     }
     if (controller_initialized) {
         sc_controller_destroy(&s->controller);
     }
+    // The controller (which receives the device messages) may forward them
+    if (automation_initialized) {
+        sc_automation_destroy(&s->automation);
+    }
+    if (input_recorder_initialized) {
+        sc_input_recorder_destroy(&s->input_recorder);
+    }
 
     if (recorder_started) {
         sc_recorder_join(&s->recorder);
@@ -1052,17 +2361,139 @@ end:
     if (recorder_initialized) {
         sc_recorder_destroy(&s->recorder);
     }
+    if (upload_target_initialized) {
+        sc_s3_target_destroy(&s->upload_target);
+    }
+
+    if (replay_buffer_initialized) {
+        // Wait for the replay being saved, if any
+        sc_replay_buffer_destroy(&s->replay_buffer);
+    }
+
+    if (record_switch_initialized) {
+        // Finish the current recording, if any
+        sc_record_switch_destroy(&s->record_switch);
+    }
+
+    if (restream_queue_initialized) {
+        sc_packet_queue_destroy(&s->restream_queue);
+    }
+
+    if (restreamer_initialized) {
+        sc_restreamer_destroy(&s->restreamer);
+    }
+
+    if (raw_queue_initialized) {
+        sc_packet_queue_destroy(&s->raw_queue);
+    }
+
+    if (raw_sink_initialized) {
+        sc_raw_sink_destroy(&s->raw_sink);
+    }
+
+    if (shm_queue_initialized) {
+        sc_frame_queue_destroy(&s->shm_queue);
+    }
+
+    if (thumbnail_queue_initialized) {
+        sc_frame_queue_destroy(&s->thumbnail_queue);
+    }
+
+    if (transcode_queue_initialized) {
+        sc_frame_queue_destroy(&s->transcode_queue);
+    }
+
+    for (unsigned i = 0; i < plugin_queues_initialized; ++i) {
+        sc_frame_queue_destroy(&s->plugin_queues[i]);
+    }
+
+#ifdef HAVE_V4L2
+    if (v4l2_queue_initialized) {
+        sc_frame_queue_destroy(&s->v4l2_queue);
+    }
+    if (v4l2_buffer_initialized) {
+        sc_delay_buffer_destroy(&s->v4l2_buffer);
+    }
+#endif
+
+    if (video_pacer_initialized) {
+        sc_frame_pacer_destroy(&s->video_pacer);
+    }
+
+    if (video_buffer_initialized) {
+        sc_delay_buffer_destroy(&s->video_buffer);
+    }
+
+    if (video_decoder_initialized) {
+        sc_decoder_destroy(&s->video_decoder);
+    }
+
+    if (video_packet_queue_initialized) {
+        sc_packet_queue_destroy(&s->video_packet_queue);
+    }
+
+    if (video_packet_buffer_initialized) {
+        sc_packet_delay_buffer_destroy(&s->video_packet_buffer);
+    }
+
+    if (audio_decoder_initialized) {
+        sc_decoder_destroy(&s->audio_decoder);
+    }
+
+    for (unsigned i = 0; i < extra_decoders_initialized; ++i) {
+        sc_decoder_destroy(&s->extra_decoders[i]);
+    }
+
+    if (video_demuxer_initialized) {
+        sc_demuxer_destroy(&s->video_demuxer);
+    }
+
+    if (record_demuxer_initialized) {
+        sc_demuxer_destroy(&s->record_demuxer);
+    }
+
+    for (unsigned i = 0; i < extra_demuxers_initialized; ++i) {
+        sc_demuxer_destroy(&s->extra_demuxers[i]);
+    }
+
+    if (audio_demuxer_initialized) {
+        sc_demuxer_destroy(&s->audio_demuxer);
+    }
 
     if (file_pusher_initialized) {
         sc_file_pusher_join(&s->file_pusher);
         sc_file_pusher_destroy(&s->file_pusher);
     }
 
+    if (screenshot_initialized) {
+        sc_screenshot_join(&s->screenshot);
+        sc_screenshot_destroy(&s->screenshot);
+    }
+
     if (server_started) {
         sc_server_join(&s->server);
     }
 
+    if (soak_monitor_started) {
+        sc_soak_monitor_join(&s->soak_monitor);
+    }
+    if (soak_monitor_initialized) {
+        sc_soak_monitor_destroy(&s->soak_monitor);
+    }
+
+    if (metrics_exporter_started) {
+        sc_metrics_exporter_join(&s->metrics_exporter);
+    }
+    if (metrics_exporter_initialized) {
+        sc_metrics_exporter_destroy(&s->metrics_exporter);
+    }
+
     sc_server_destroy(&s->server);
 
+    if (options->trace_filename) {
+        // All the threads are joined
+        sc_trace_write(options->trace_filename);
+    }
+
     return ret;
 }
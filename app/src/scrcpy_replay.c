@@ -0,0 +1,533 @@
+#include "scrcpy_replay.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+
+#include "audio_player.h"
+#include "decode_benchmark.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "events.h"
+#include "recorder.h"
+#include "screen.h"
+#include "stream_replayer.h"
+#include "trace.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/str.h"
+#include "util/tick.h"
+
+struct scrcpy_replay {
+    struct sc_stream_replayer video_replayer;
+    struct sc_stream_replayer audio_replayer;
+    struct sc_demuxer video_demuxer;
+    struct sc_demuxer audio_demuxer;
+    struct sc_decoder video_decoder;
+    struct sc_decoder audio_decoder;
+    struct sc_decode_benchmark decode_benchmark;
+    struct sc_recorder recorder;
+    struct sc_screen screen;
+    struct sc_audio_player audio_player;
+
+    // The replay is finished once all the demuxers reached the end-of-stream
+    atomic_uint running_demuxers;
+};
+
+static void
+sc_demuxer_on_ended(struct sc_demuxer *demuxer, enum sc_demuxer_status status,
+                    void *userdata) {
+    (void) demuxer;
+
+    struct scrcpy_replay *s = userdata;
+
+    if (status == SC_DEMUXER_STATUS_ERROR) {
+        sc_push_event(SC_EVENT_DEMUXER_ERROR);
+        return;
+    }
+
+    if (atomic_fetch_sub(&s->running_demuxers, 1) == 1) {
+        // There is no device, this signals the end of the replay
+        sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
+    }
+}
+
+static void
+sc_recorder_on_ended(struct sc_recorder *recorder, bool success,
+                     void *userdata) {
+    (void) recorder;
+    (void) userdata;
+
+    if (!success) {
+        sc_push_event(SC_EVENT_RECORDER_ERROR);
+    }
+}
+
+static enum scrcpy_exit_code
+event_loop(struct scrcpy_replay *s, bool has_screen, sc_tick start) {
+    SDL_Event event;
+    while (SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SC_EVENT_DEVICE_DISCONNECTED: {
+                sc_tick duration = sc_tick_now() - start;
+                LOGI("Stream replay finished in %.3f s",
+                     (double) duration / SC_TICK_FREQ);
+                return SCRCPY_EXIT_SUCCESS;
+            }
+            case SC_EVENT_DEMUXER_ERROR:
+                LOGE("Demuxer error");
+                return SCRCPY_EXIT_FAILURE;
+            case SC_EVENT_RECORDER_ERROR:
+                LOGE("Recorder error");
+                return SCRCPY_EXIT_FAILURE;
+            case SDL_QUIT:
+                LOGD("User requested to quit");
+                return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_RUN_ON_MAIN_THREAD: {
+                sc_runnable_fn run = event.user.data1;
+                void *userdata = event.user.data2;
+                run(userdata);
+                break;
+            }
+            default:
+                if (has_screen && !sc_screen_handle_event(&s->screen, &event)) {
+                    return SCRCPY_EXIT_FAILURE;
+                }
+                break;
+        }
+    }
+    return SCRCPY_EXIT_FAILURE;
+}
+
+static void
+terminate_event_loop(void) {
+    sc_reject_new_runnables();
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SC_EVENT_RUN_ON_MAIN_THREAD) {
+            // Make sure all posted runnables are run, to avoid memory leaks
+            sc_runnable_fn run = event.user.data1;
+            void *userdata = event.user.data2;
+            run(userdata);
+        }
+    }
+}
+
+// Return the capture filename if it exists, NULL otherwise (or on error)
+static char *
+get_capture_filename(const char *prefix, const char *suffix) {
+    char *filename = sc_str_concat(prefix, suffix);
+    if (filename && !sc_file_is_regular(filename)) {
+        LOGD("No capture file %s", filename);
+        free(filename);
+        return NULL;
+    }
+
+    return filename;
+}
+
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options) {
+    static struct scrcpy_replay scrcpy_replay;
+    struct scrcpy_replay *s = &scrcpy_replay;
+
+    if (options->trace_filename) {
+        sc_trace_enable();
+    }
+
+    bool paced = !options->stream_replay_fast;
+
+    char *video_filename = NULL;
+    char *audio_filename = NULL;
+    if (options->video) {
+        video_filename = get_capture_filename(options->stream_replay_prefix,
+                                              SC_STREAM_CAPTURE_VIDEO_SUFFIX);
+    }
+    if (options->audio) {
+        audio_filename = get_capture_filename(options->stream_replay_prefix,
+                                              SC_STREAM_CAPTURE_AUDIO_SUFFIX);
+    }
+
+    bool video_playback = video_filename && options->video_playback;
+    // The audio could not be played faster than real time
+    bool audio_playback = audio_filename && options->audio_playback && paced;
+
+    // Only replay the streams which are consumed
+    bool video = video_filename && (video_playback
+                                 || options->benchmark_decode
+                                 || options->record_filename);
+    bool audio = audio_filename && (audio_playback || options->record_filename);
+    if (!video && !audio) {
+        LOGE("Nothing to replay from %s (no capture file, or nothing to do "
+             "with it)", options->stream_replay_prefix);
+        free(video_filename);
+        free(audio_filename);
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    // Minimal SDL initialization
+    if (SDL_Init(SDL_INIT_EVENTS)) {
+        LOGE("Could not initialize SDL: %s", SDL_GetError());
+        free(video_filename);
+        free(audio_filename);
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    atexit(SDL_Quit);
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    bool video_replayer_initialized = false;
+    bool video_replayer_started = false;
+    bool audio_replayer_initialized = false;
+    bool audio_replayer_started = false;
+    bool video_demuxer_initialized = false;
+    bool video_demuxer_started = false;
+    bool audio_demuxer_initialized = false;
+    bool audio_demuxer_started = false;
+    bool video_decoder_initialized = false;
+    bool audio_decoder_initialized = false;
+    bool decode_benchmark_initialized = false;
+    bool recorder_initialized = false;
+    bool recorder_started = false;
+    bool screen_window_opened = false;
+    bool screen_initialized = false;
+
+    atomic_init(&s->running_demuxers, video + audio);
+
+    if (video_playback) {
+        if (options->render_driver
+                && !SDL_SetHint(SDL_HINT_RENDER_DRIVER,
+                                options->render_driver)) {
+            LOGW("Could not set render driver");
+        }
+
+        if (!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1")) {
+            LOGW("Could not enable linear filtering");
+        }
+
+        if (SDL_Init(SDL_INIT_VIDEO)) {
+            LOGE("Could not initialize SDL video: %s", SDL_GetError());
+            goto end;
+        }
+    }
+
+    if (audio_playback) {
+        if (SDL_Init(SDL_INIT_AUDIO)) {
+            LOGE("Could not initialize SDL audio: %s", SDL_GetError());
+            goto end;
+        }
+    }
+
+    static const struct sc_demuxer_callbacks demuxer_cbs = {
+        .on_ended = sc_demuxer_on_ended,
+    };
+
+    if (video) {
+        if (!sc_stream_replayer_init(&s->video_replayer, "video",
+                                     video_filename, true, paced)) {
+            goto end;
+        }
+        video_replayer_initialized = true;
+
+        if (!sc_demuxer_init(&s->video_demuxer, "video",
+                             s->video_replayer.peer_socket, &demuxer_cbs,
+                             s)) {
+            goto end;
+        }
+        video_demuxer_initialized = true;
+
+        bool needs_video_decoder = video_playback || options->benchmark_decode;
+        if (needs_video_decoder) {
+            if (options->video_hwaccel != SC_HWACCEL_NONE) {
+                sc_demuxer_set_hwaccel(&s->video_demuxer,
+                                       options->video_hwaccel);
+            }
+            sc_demuxer_set_decoder_threads(&s->video_demuxer,
+                                           options->video_decoder_threads,
+                                           options->video_decoder_thread_type);
+            if (!sc_decoder_init(&s->video_decoder, "video")) {
+                goto end;
+            }
+            video_decoder_initialized = true;
+
+            if (options->benchmark_decode) {
+                sc_decode_benchmark_init(&s->decode_benchmark);
+                decode_benchmark_initialized = true;
+                // Add it before the decoder, to receive the packets just
+                // before
+                if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                            &s->decode_benchmark.packet_sink)) {
+                    goto end;
+                }
+                if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                             &s->decode_benchmark.frame_sink)) {
+                    goto end;
+                }
+            }
+
+            if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                           &s->video_decoder.packet_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    if (audio) {
+        if (!sc_stream_replayer_init(&s->audio_replayer, "audio",
+                                     audio_filename, false, paced)) {
+            goto end;
+        }
+        audio_replayer_initialized = true;
+
+        if (!sc_demuxer_init(&s->audio_demuxer, "audio",
+                             s->audio_replayer.peer_socket, &demuxer_cbs,
+                             s)) {
+            goto end;
+        }
+        audio_demuxer_initialized = true;
+
+        if (audio_playback) {
+            if (!sc_decoder_init(&s->audio_decoder, "audio")) {
+                goto end;
+            }
+            audio_decoder_initialized = true;
+
+            if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                           &s->audio_decoder.packet_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    if (options->record_filename) {
+        static const struct sc_recorder_callbacks recorder_cbs = {
+            .on_ended = sc_recorder_on_ended,
+        };
+        struct sc_recorder_segment_params segment = {
+            .duration = options->record_segment_duration,
+            .size = options->record_segment_size,
+            .count = options->record_segment_count,
+        };
+        if (!sc_recorder_init(&s->recorder, options->record_filename,
+                              options->record_format, video, audio,
+                              options->record_orientation, &segment,
+                              options->record_memory_limit, &recorder_cbs,
+                              NULL)) {
+            goto end;
+        }
+        recorder_initialized = true;
+
+        if (!paced) {
+            // The packets arrive faster than real time, they must not be
+            // dropped
+            sc_recorder_set_blocking(&s->recorder);
+        }
+
+        if (!sc_recorder_start(&s->recorder)) {
+            goto end;
+        }
+        recorder_started = true;
+
+        if (video) {
+            if (!sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                           &s->recorder.video_packet_sink)) {
+                goto end;
+            }
+        }
+        if (audio) {
+            if (!sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                           &s->recorder.audio_packet_sink)) {
+                goto end;
+            }
+        }
+    }
+
+    if (video_playback) {
+        const char *window_title = options->window_title
+                                 ? options->window_title : "scrcpy (replay)";
+
+        struct sc_screen_window_params window_params = {
+            .video = true,
+            .always_on_top = options->always_on_top,
+            .window_x = options->window_x,
+            .window_y = options->window_y,
+            .window_width = options->window_width,
+            .window_height = options->window_height,
+            .window_borderless = options->window_borderless,
+            .mipmaps = options->mipmaps,
+            .present_mode = options->present_mode,
+        };
+
+        if (!sc_screen_open_window(&s->screen, &window_params)) {
+            goto end;
+        }
+        screen_window_opened = true;
+
+        struct sc_screen_params screen_params = {
+            .decoder = NULL,
+            .latency_tracker = NULL,
+            .video_feedback = NULL,
+            .metrics = NULL,
+            .video_stats = NULL,
+            .controller = NULL,
+            .fp = NULL,
+            .replay_buffer = NULL,
+            .record_switch = NULL,
+            .screenshot = NULL,
+            .kp = NULL,
+            .mp = NULL,
+            .gp = NULL,
+            .mouse_bindings = options->mouse_bindings,
+            .legacy_paste = false,
+            .clipboard_autosync = false,
+            .alt_video_profile = NULL,
+            .shortcut_mods = options->shortcut_mods,
+            .window_title = window_title,
+            .orientation = options->display_orientation,
+            .fullscreen = options->fullscreen,
+            .start_fps_counter = options->start_fps_counter,
+            .background_max_fps = 0,
+            .background_pause = false,
+            .background_skip_nonref = false,
+        };
+
+        if (!sc_screen_init(&s->screen, &screen_params)) {
+            goto end;
+        }
+        screen_initialized = true;
+
+        if (!sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                      &s->screen.frame_sink)) {
+            goto end;
+        }
+    }
+
+    if (audio_playback) {
+        sc_audio_player_init(&s->audio_player, options->audio_buffer,
+                             options->audio_buffer_max,
+                             options->audio_output_buffer,
+                             options->print_audio_stats);
+        if (!sc_frame_source_add_sink(&s->audio_decoder.frame_source,
+                                      &s->audio_player.frame_sink)) {
+            goto end;
+        }
+    }
+
+    if (video) {
+        if (!sc_demuxer_start(&s->video_demuxer)) {
+            goto end;
+        }
+        video_demuxer_started = true;
+    }
+
+    if (audio) {
+        if (!sc_demuxer_start(&s->audio_demuxer)) {
+            goto end;
+        }
+        audio_demuxer_started = true;
+    }
+
+    sc_tick start = sc_tick_now();
+
+    if (video) {
+        if (!sc_stream_replayer_start(&s->video_replayer)) {
+            goto end;
+        }
+        video_replayer_started = true;
+    }
+
+    if (audio) {
+        if (!sc_stream_replayer_start(&s->audio_replayer)) {
+            goto end;
+        }
+        audio_replayer_started = true;
+    }
+
+    ret = event_loop(s, screen_initialized, start);
+    terminate_event_loop();
+    LOGD("quit...");
+
+    if (screen_initialized) {
+        sc_screen_hide_window(&s->screen);
+    }
+
+end:
+    // Interrupt the replayers and the demuxers reading from them
+    if (video_replayer_initialized) {
+        sc_stream_replayer_stop(&s->video_replayer);
+    }
+    if (audio_replayer_initialized) {
+        sc_stream_replayer_stop(&s->audio_replayer);
+    }
+    if (recorder_initialized) {
+        sc_recorder_stop(&s->recorder);
+    }
+
+    if (video_replayer_started) {
+        sc_stream_replayer_join(&s->video_replayer);
+    }
+    if (audio_replayer_started) {
+        sc_stream_replayer_join(&s->audio_replayer);
+    }
+    if (video_demuxer_started) {
+        sc_demuxer_join(&s->video_demuxer);
+    }
+    if (audio_demuxer_started) {
+        sc_demuxer_join(&s->audio_demuxer);
+    }
+
+    // Destroy the screen only after the video demuxer is joined
+    if (screen_initialized) {
+        sc_screen_destroy(&s->screen);
+    }
+
+    if (screen_window_opened) {
+        sc_screen_close_window(&s->screen);
+    }
+
+    if (decode_benchmark_initialized) {
+        sc_decode_benchmark_destroy(&s->decode_benchmark);
+    }
+
+    if (recorder_started) {
+        sc_recorder_join(&s->recorder);
+    }
+    if (recorder_initialized) {
+        sc_recorder_destroy(&s->recorder);
+    }
+
+    if (video_decoder_initialized) {
+        sc_decoder_destroy(&s->video_decoder);
+    }
+    if (audio_decoder_initialized) {
+        sc_decoder_destroy(&s->audio_decoder);
+    }
+
+    if (video_demuxer_initialized) {
+        sc_demuxer_destroy(&s->video_demuxer);
+    }
+    if (audio_demuxer_initialized) {
+        sc_demuxer_destroy(&s->audio_demuxer);
+    }
+
+    if (video_replayer_initialized) {
+        sc_stream_replayer_destroy(&s->video_replayer);
+    }
+    if (audio_replayer_initialized) {
+        sc_stream_replayer_destroy(&s->audio_replayer);
+    }
+
+    free(video_filename);
+    free(audio_filename);
+
+    if (options->trace_filename) {
+        // All the threads are joined
+        sc_trace_write(options->trace_filename);
+    }
+
+    return ret;
+}
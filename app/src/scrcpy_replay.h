@@ -0,0 +1,13 @@
+#ifndef SCRCPY_REPLAY_H
+#define SCRCPY_REPLAY_H
+
+#include "common.h"
+
+#include "options.h"
+#include "scrcpy.h"
+
+// Replay the streams captured by --stream-capture, without any device
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options);
+
+#endif
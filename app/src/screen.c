@@ -1,16 +1,47 @@
 #include "screen.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <string.h>
 #include <SDL2/SDL.h>
 
 #include "events.h"
 #include "icon.h"
 #include "options.h"
+#include "startup_timing.h"
+#include "trace.h"
 #include "util/log.h"
+#include "util/process.h"
 
 #define DISPLAY_MARGINS 96
 
+// Wait for the window size to be stable before reporting it to the device,
+// since every new max size resets the capture
+#define SC_VIEW_SIZE_DEBOUNCE SC_TICK_FROM_MS(500)
+// Round the reported size, so that small resizes do not reset the capture
+#define SC_VIEW_SIZE_STEP 128
+// Density of a new display for a window without HiDPI scaling (the Android
+// baseline density)
+#define SC_DISPLAY_BASE_DPI 160
+
+// Limits applied by the CPU governor
+#define SC_CPU_RENDER_FPS 30
+#define SC_CPU_MAX_FPS 30
+
+// Interval between two power state checks
+#define SC_POWER_CHECK_PERIOD SC_TICK_FROM_SEC(5)
+// Device frame rate while unfocused on battery (unless --background-max-fps)
+#define SC_POWER_BACKGROUND_MAX_FPS 10
+
+static Uint32 SDLCALL
+sc_screen_on_cpu_sample_timer(Uint32 interval, void *userdata);
+
+static Uint32 SDLCALL
+sc_screen_on_power_timer(Uint32 interval, void *userdata);
+
+static void
+sc_screen_check_power(void *userdata);
+
 #define DOWNCAST(SINK) container_of(SINK, struct sc_screen, frame_sink)
 
 static inline struct sc_size
@@ -162,6 +193,194 @@ sc_screen_is_relative_mode(struct sc_screen *screen) {
     return screen->im.mp && screen->im.mp->relative_mode;
 }
 
+static void
+sc_screen_update_background_skip(struct sc_screen *screen) {
+    assert(screen->background_skip.enabled);
+
+    bool skip = (!screen->background_skip.focused
+                    && (screen->background_skip.small || screen->minimized))
+             || screen->cpu.level >= SC_CPU_LEVEL_SKIP_NONREF;
+    if (skip != screen->background_skip.requested) {
+        LOGD(skip ? "Skip non-reference frames"
+                  : "Restore full decoding for the window");
+        sc_decoder_request_nonref_skip(screen->decoder, skip);
+        screen->background_skip.requested = skip;
+    }
+}
+
+static void
+sc_screen_schedule_view_size(struct sc_screen *screen, sc_tick delay);
+
+static void
+sc_screen_send_view_size(void *userdata) {
+    struct sc_screen *screen = userdata;
+
+    screen->view_size.timer = 0;
+
+    sc_tick elapsed = sc_tick_now() - screen->view_size.last_change;
+    if (elapsed < SC_VIEW_SIZE_DEBOUNCE) {
+        // The window has been resized again since the timer was scheduled
+        sc_screen_schedule_view_size(screen, SC_VIEW_SIZE_DEBOUNCE - elapsed);
+        return;
+    }
+
+    uint16_t max_size = screen->view_size.max_size;
+    if (max_size != screen->view_size.reported) {
+        struct sc_control_msg msg;
+        msg.type = SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE;
+        msg.set_video_view_size.max_size = max_size;
+
+        if (sc_controller_push_msg(screen->view_size.controller, &msg)) {
+            LOGD("Video view size reported: %" PRIu16, max_size);
+            screen->view_size.reported = max_size;
+        } else {
+            LOGW("Could not report the video view size");
+        }
+    }
+
+    struct sc_size size = screen->view_size.display.size;
+    uint16_t dpi = screen->view_size.display.dpi;
+    struct sc_size reported_size = screen->view_size.display.reported_size;
+    if (screen->view_size.display.enabled
+            && (size.width != reported_size.width
+                || size.height != reported_size.height
+                || dpi != screen->view_size.display.reported_dpi)) {
+        struct sc_control_msg msg;
+        msg.type = SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY;
+        msg.resize_display.width = size.width;
+        msg.resize_display.height = size.height;
+        msg.resize_display.dpi = dpi;
+
+        if (sc_controller_push_msg(screen->view_size.controller, &msg)) {
+            LOGD("Display resize requested: %" PRIu16 "x%" PRIu16 "/%" PRIu16,
+                 size.width, size.height, dpi);
+            screen->view_size.display.reported_size = size;
+            screen->view_size.display.reported_dpi = dpi;
+        } else {
+            LOGW("Could not request the display resize");
+        }
+    }
+}
+
+static Uint32 SDLCALL
+sc_screen_on_view_size_timer(Uint32 interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread, send from the main thread
+    sc_post_to_main_thread(sc_screen_send_view_size, userdata);
+
+    // One-shot timer
+    return 0;
+}
+
+static void
+sc_screen_schedule_view_size(struct sc_screen *screen, sc_tick delay) {
+    assert(!screen->view_size.timer);
+
+    // Round up to the next millisecond
+    Uint32 ms = SC_TICK_TO_MS(delay) + 1;
+    screen->view_size.timer =
+        SDL_AddTimer(ms, sc_screen_on_view_size_timer, screen);
+    if (!screen->view_size.timer) {
+        LOGW("Could not schedule the video view size report: %s",
+             SDL_GetError());
+    }
+}
+
+// Apply the most restrictive of the window and CPU max sizes
+static void
+sc_screen_set_view_max_size(struct sc_screen *screen) {
+    assert(screen->view_size.controller);
+
+    uint16_t max_size = screen->view_size.window_max_size;
+    uint16_t cpu_max_size = screen->view_size.cpu_max_size;
+    if (cpu_max_size && (!max_size || cpu_max_size < max_size)) {
+        max_size = cpu_max_size;
+    }
+
+    if (max_size == screen->view_size.max_size) {
+        return;
+    }
+
+    screen->view_size.max_size = max_size;
+    screen->view_size.last_change = sc_tick_now();
+    if (!screen->view_size.timer) {
+        sc_screen_schedule_view_size(screen, SC_VIEW_SIZE_DEBOUNCE);
+    }
+}
+
+// Request a new display with the size (in pixels) and the density of the
+// window, so that it is rendered without scaling
+static void
+sc_screen_update_display_size(struct sc_screen *screen) {
+    assert(screen->view_size.display.enabled);
+
+    struct sc_size drawable_size = screen->rect_sizes.drawable;
+    struct sc_size window_size = get_window_size(screen);
+    if (!window_size.width) {
+        return;
+    }
+
+    // The display size is expressed in the orientation of the video, and
+    // rounded down to a multiple of 8, so that the device does not scale it
+    // for encoding
+    struct sc_size size =
+        get_oriented_size(drawable_size, screen->orientation);
+    size.width &= ~7;
+    size.height &= ~7;
+    if (!size.width || !size.height) {
+        return;
+    }
+
+    // The density follows the HiDPI scale of the window
+    uint32_t dpi = (uint32_t) SC_DISPLAY_BASE_DPI * drawable_size.width
+                                                  / window_size.width;
+    dpi = MIN(dpi, UINT16_MAX);
+
+    if (size.width == screen->view_size.display.size.width
+            && size.height == screen->view_size.display.size.height
+            && dpi == screen->view_size.display.dpi) {
+        return;
+    }
+
+    screen->view_size.display.size = size;
+    screen->view_size.display.dpi = dpi;
+    screen->view_size.last_change = sc_tick_now();
+    if (!screen->view_size.timer) {
+        sc_screen_schedule_view_size(screen, SC_VIEW_SIZE_DEBOUNCE);
+    }
+}
+
+static void
+sc_screen_update_view_size(struct sc_screen *screen) {
+    assert(screen->view_size.controller);
+
+    if (screen->minimized || screen->hidden) {
+        // The content is not visible, keep the current resolution
+        return;
+    }
+
+    if (screen->view_size.display.enabled) {
+        sc_screen_update_display_size(screen);
+        return;
+    }
+
+    if (!screen->view_size.adaptive) {
+        return;
+    }
+
+    uint32_t size = MAX(screen->rect.w, screen->rect.h);
+    if (!size) {
+        return;
+    }
+
+    size = (size + SC_VIEW_SIZE_STEP - 1) / SC_VIEW_SIZE_STEP
+         * SC_VIEW_SIZE_STEP;
+    screen->view_size.window_max_size =
+        MIN(size, UINT16_MAX / SC_VIEW_SIZE_STEP * SC_VIEW_SIZE_STEP);
+    sc_screen_set_view_max_size(screen);
+}
+
 static void
 sc_screen_update_content_rect(struct sc_screen *screen) {
     assert(screen->video);
@@ -174,6 +393,17 @@ sc_screen_update_content_rect(struct sc_screen *screen) {
     // The drawable size is the window size * the HiDPI scale
     struct sc_size drawable_size = {dw, dh};
 
+    if (drawable_size.width == screen->rect_sizes.drawable.width
+            && drawable_size.height == screen->rect_sizes.drawable.height
+            && content_size.width == screen->rect_sizes.content.width
+            && content_size.height == screen->rect_sizes.content.height) {
+        // The content rectangle is up-to-date
+        goto end;
+    }
+
+    screen->rect_sizes.drawable = drawable_size;
+    screen->rect_sizes.content = content_size;
+
     SDL_Rect *rect = &screen->rect;
 
     if (is_optimal_size(drawable_size, content_size)) {
@@ -181,12 +411,20 @@ sc_screen_update_content_rect(struct sc_screen *screen) {
         rect->y = 0;
         rect->w = drawable_size.width;
         rect->h = drawable_size.height;
-        return;
-    }
-
-    bool keep_width = content_size.width * drawable_size.height
-                    > content_size.height * drawable_size.width;
-    if (keep_width) {
+    } else if (screen->view_size.display.enabled
+            && content_size.width <= drawable_size.width
+            && content_size.height <= drawable_size.height
+            && drawable_size.width - content_size.width < 8
+            && drawable_size.height - content_size.height < 8) {
+        // The display follows the window, rounded down to a multiple of 8:
+        // render it without scaling
+        rect->w = content_size.width;
+        rect->h = content_size.height;
+        rect->x = (drawable_size.width - rect->w) / 2;
+        rect->y = (drawable_size.height - rect->h) / 2;
+    } else if (content_size.width * drawable_size.height
+                > content_size.height * drawable_size.width) {
+        // keep width
         rect->x = 0;
         rect->w = drawable_size.width;
         rect->h = drawable_size.width * content_size.height
@@ -199,6 +437,23 @@ sc_screen_update_content_rect(struct sc_screen *screen) {
                                        / content_size.height;
         rect->x = (drawable_size.width - rect->w) / 2;
     }
+
+    bool downscaling = rect->w < content_size.width
+                    || rect->h < content_size.height;
+    sc_display_set_downscaling(&screen->display, downscaling);
+
+    if (screen->background_skip.enabled) {
+        screen->background_skip.small = rect->w * 2 <= content_size.width
+                                     && rect->h * 2 <= content_size.height;
+        sc_screen_update_background_skip(screen);
+    }
+
+end:
+    if (screen->view_size.controller) {
+        // Even if the size has not changed, the window may have been restored
+        // since the last report
+        sc_screen_update_view_size(screen);
+    }
 }
 
 // render the texture to the renderer
@@ -213,9 +468,89 @@ sc_screen_render(struct sc_screen *screen, bool update_content_rect) {
         sc_screen_update_content_rect(screen);
     }
 
+    sc_tick begin = sc_trace_begin();
     enum sc_display_result res =
         sc_display_render(&screen->display, &screen->rect, screen->orientation);
-    (void) res; // any error already logged
+    // any error already logged
+    sc_trace_end("render", begin);
+
+    if (screen->texture_bytes_metric) {
+        // The textures are (re)allocated on frame size or format change, or
+        // on render (pre-allocated textures)
+        sc_metric_set(screen->texture_bytes_metric,
+                      sc_display_get_texture_bytes(&screen->display));
+    }
+
+    if (screen->has_latency_pts && res == SC_DISPLAY_RESULT_OK) {
+        assert(screen->latency_tracker);
+        sc_latency_tracker_record(screen->latency_tracker,
+                                  screen->latency_pts,
+                                  SC_LATENCY_STAGE_PRESENTED);
+        screen->has_latency_pts = false;
+    }
+}
+
+static void
+sc_screen_render_after_resize(void *userdata) {
+    struct sc_screen *screen = userdata;
+
+    screen->resize_render.timer = 0;
+
+    if (!screen->has_frame || screen->hidden) {
+        return;
+    }
+
+    // Render the final size of the window
+    sc_screen_render(screen, true);
+    screen->resize_render.last = sc_tick_now();
+}
+
+static Uint32 SDLCALL
+sc_screen_on_resize_render_timer(Uint32 interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread, render from the main thread
+    sc_post_to_main_thread(sc_screen_render_after_resize, userdata);
+
+    // One-shot timer
+    return 0;
+}
+
+// Render on window resize, at most once per display refresh period
+//
+// While the window is resized interactively, many resize events may be
+// received per refresh period. Rendering for each of them would flood the
+// GPU, so the renders are coalesced, and the last size is always rendered
+// once the period has elapsed.
+static void
+sc_screen_render_for_resize(struct sc_screen *screen) {
+    if (!screen->refresh_period) {
+        // Retrieved lazily, on the first resize
+        screen->refresh_period = sc_screen_get_refresh_period(screen);
+    }
+
+    sc_tick now = sc_tick_now();
+    sc_tick next = screen->resize_render.last + screen->refresh_period;
+    if (now >= next) {
+        sc_screen_render(screen, true);
+        screen->resize_render.last = now;
+        return;
+    }
+
+    if (screen->resize_render.timer) {
+        // A render is already scheduled
+        return;
+    }
+
+    // Round up to the next millisecond
+    Uint32 ms = SC_TICK_TO_MS(next - now) + 1;
+    screen->resize_render.timer =
+        SDL_AddTimer(ms, sc_screen_on_resize_render_timer, screen);
+    if (!screen->resize_render.timer) {
+        LOGW("Could not schedule render: %s", SDL_GetError());
+        sc_screen_render(screen, true);
+        screen->resize_render.last = now;
+    }
 }
 
 static void
@@ -244,7 +579,7 @@ event_watcher(void *data, SDL_Event *event) {
             && event->window.event == SDL_WINDOWEVENT_RESIZED) {
         // In practice, it seems to always be called from the same thread in
         // that specific case. Anyway, it's just a workaround.
-        sc_screen_render(screen, true);
+        sc_screen_render_for_resize(screen);
     }
     return 0;
 }
@@ -302,13 +637,27 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
     assert(screen->video);
 
     bool previous_skipped;
+    sc_tick begin = sc_trace_begin();
     bool ok = sc_frame_buffer_push(&screen->fb, frame, &previous_skipped);
+    sc_trace_end("frame_buffer_push", begin);
     if (!ok) {
         return false;
     }
 
+    if (screen->latency_tracker) {
+        sc_latency_tracker_record(screen->latency_tracker, frame->pts,
+                                  SC_LATENCY_STAGE_BUFFERED);
+    }
+
     if (previous_skipped) {
         sc_fps_counter_add_skipped_frame(&screen->fps_counter);
+        sc_metric_inc(screen->frames_skipped_metric);
+        if (screen->decoder) {
+            sc_decoder_report_skipped_frame(screen->decoder);
+        }
+        if (screen->video_feedback) {
+            sc_video_feedback_report_skipped_frame(screen->video_feedback);
+        }
         // The SC_EVENT_NEW_FRAME triggered for the previous frame will consume
         // this new frame instead
     } else {
@@ -323,42 +672,14 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
 }
 
 bool
-sc_screen_init(struct sc_screen *screen,
-               const struct sc_screen_params *params) {
-    screen->resize_pending = false;
-    screen->has_frame = false;
-    screen->fullscreen = false;
-    screen->maximized = false;
-    screen->minimized = false;
-    screen->paused = false;
-    screen->resume_frame = NULL;
-    screen->orientation = SC_ORIENTATION_0;
-
+sc_screen_open_window(struct sc_screen *screen,
+                      const struct sc_screen_window_params *params) {
     screen->video = params->video;
 
     screen->req.x = params->window_x;
     screen->req.y = params->window_y;
     screen->req.width = params->window_width;
     screen->req.height = params->window_height;
-    screen->req.fullscreen = params->fullscreen;
-    screen->req.start_fps_counter = params->start_fps_counter;
-
-    bool ok = sc_frame_buffer_init(&screen->fb);
-    if (!ok) {
-        return false;
-    }
-
-    if (!sc_fps_counter_init(&screen->fps_counter)) {
-        goto error_destroy_frame_buffer;
-    }
-
-    if (screen->video) {
-        screen->orientation = params->orientation;
-        if (screen->orientation != SC_ORIENTATION_0) {
-            LOGI("Initial display orientation set to %s",
-                 sc_orientation_get_name(screen->orientation));
-        }
-    }
 
     uint32_t window_flags = SDL_WINDOW_ALLOW_HIGHDPI;
     if (params->always_on_top) {
@@ -367,14 +688,15 @@ sc_screen_init(struct sc_screen *screen,
     if (params->window_borderless) {
         window_flags |= SDL_WINDOW_BORDERLESS;
     }
+    // The window will be shown on first frame (or on initialization without
+    // video)
+    window_flags |= SDL_WINDOW_HIDDEN;
     if (params->video) {
-        // The window will be shown on first frame
-        window_flags |= SDL_WINDOW_HIDDEN
-                      | SDL_WINDOW_RESIZABLE;
+        window_flags |= SDL_WINDOW_RESIZABLE;
     }
 
-    const char *title = params->window_title;
-    assert(title);
+    // The title is set on initialization, once the device is known
+    const char *title = "scrcpy";
 
     int x = SDL_WINDOWPOS_UNDEFINED;
     int y = SDL_WINDOWPOS_UNDEFINED;
@@ -397,7 +719,7 @@ sc_screen_init(struct sc_screen *screen,
     screen->window = SDL_CreateWindow(title, x, y, width, height, window_flags);
     if (!screen->window) {
         LOGE("Could not create window: %s", SDL_GetError());
-        goto error_destroy_fps_counter;
+        return false;
     }
 
     SDL_Surface *icon = scrcpy_icon_load();
@@ -414,8 +736,12 @@ sc_screen_init(struct sc_screen *screen,
 
     SDL_Surface *icon_novideo = params->video ? NULL : icon;
     bool mipmaps = params->video && params->mipmaps;
-    ok = sc_display_init(&screen->display, screen->window, icon_novideo,
-                         mipmaps);
+    // Without video, the static icon does not need vsync
+    enum sc_present_mode present_mode =
+        params->video ? params->present_mode : SC_PRESENT_MODE_IMMEDIATE;
+    bool yuv_shader = params->video && params->yuv_shader;
+    bool ok = sc_display_init(&screen->display, screen->window, icon_novideo,
+                              mipmaps, present_mode, yuv_shader);
     if (icon) {
         scrcpy_icon_destroy(icon);
     }
@@ -423,22 +749,142 @@ sc_screen_init(struct sc_screen *screen,
         goto error_destroy_window;
     }
 
+    return true;
+
+error_destroy_window:
+    SDL_DestroyWindow(screen->window);
+
+    return false;
+}
+
+void
+sc_screen_close_window(struct sc_screen *screen) {
+    sc_display_destroy(&screen->display);
+    SDL_DestroyWindow(screen->window);
+}
+
+bool
+sc_screen_init(struct sc_screen *screen,
+               const struct sc_screen_params *params) {
+    screen->resize_pending = false;
+    screen->has_frame = false;
+    screen->fullscreen = false;
+    screen->maximized = false;
+    screen->minimized = false;
+    screen->paused = false;
+    screen->hidden = false;
+    screen->resume_frame = NULL;
+    screen->decoder = params->decoder;
+    screen->latency_tracker = params->latency_tracker;
+    screen->video_feedback = params->video_feedback;
+    screen->frames_rendered_metric =
+        sc_metrics_register_counter(params->metrics,
+                                    "scrcpy_video_frames_rendered_total",
+                                    "Video frames rendered");
+    screen->frames_skipped_metric =
+        sc_metrics_register_counter(params->metrics,
+                                    "scrcpy_video_frames_skipped_total",
+                                    "Video frames skipped before rendering");
+    screen->texture_bytes_metric =
+        sc_metrics_register_gauge(params->metrics,
+                                  "scrcpy_display_texture_bytes",
+                                  "Memory allocated for the display textures");
+    screen->has_latency_pts = false;
+
+    bool throttle = params->background_max_fps || params->cpu_budget
+                 || params->power_saving;
+    screen->throttle.controller = throttle ? params->controller : NULL;
+    screen->throttle.background_max_fps = params->background_max_fps;
+    screen->throttle.pause_when_minimized = params->background_pause;
+    screen->throttle.focused = true;
+    screen->throttle.minimized = false;
+    screen->throttle.max_fps = 0;
+    screen->throttle.paused = false;
+    assert(!params->background_skip_nonref || params->decoder);
+    screen->background_skip.enabled = params->background_skip_nonref;
+    screen->background_skip.focused = true;
+    screen->background_skip.small = false;
+    screen->background_skip.requested = false;
+    // Like --adaptive-max-size, the CPU governor may only lower the
+    // resolution if the video is not consumed by anything else
+    bool cpu_resolution = params->cpu_budget && params->background_pause;
+    bool view_size = params->adaptive_max_size || params->resize_display
+                  || cpu_resolution;
+    screen->view_size.controller = view_size ? params->controller : NULL;
+    screen->view_size.adaptive = params->adaptive_max_size;
+    screen->view_size.display.enabled = params->resize_display;
+    screen->view_size.display.size = (struct sc_size) {0, 0};
+    screen->view_size.display.dpi = 0;
+    screen->view_size.display.reported_size = (struct sc_size) {0, 0};
+    screen->view_size.display.reported_dpi = 0;
+    screen->view_size.timer = 0;
+    screen->view_size.last_change = 0;
+    screen->view_size.window_max_size = 0;
+    screen->view_size.cpu_max_size = 0;
+    screen->view_size.max_size = 0;
+    screen->view_size.reported = 0;
+    screen->resize_render.timer = 0;
+    screen->resize_render.last = 0;
+    screen->refresh_period = 0;
+    screen->cpu.enabled = params->cpu_budget;
+    if (screen->cpu.enabled) {
+        sc_cpu_governor_init(&screen->cpu.governor, params->cpu_budget,
+                             params->metrics);
+    }
+    screen->cpu.sample_timer = 0;
+    screen->cpu.level = SC_CPU_LEVEL_NONE;
+    screen->power.enabled = params->power_saving;
+    screen->power.timer = 0;
+    screen->power.on_battery = false;
+    screen->render_rate.period = 0;
+    screen->render_rate.last = 0;
+    screen->render_rate.timer = 0;
+    screen->rect_sizes.drawable = (struct sc_size) {0, 0};
+    screen->rect_sizes.content = (struct sc_size) {0, 0};
+    screen->orientation = SC_ORIENTATION_0;
+
+    screen->req.fullscreen = params->fullscreen;
+    screen->req.start_fps_counter = params->start_fps_counter;
+
+    bool ok = sc_frame_buffer_init(&screen->fb);
+    if (!ok) {
+        return false;
+    }
+
+    sc_fps_counter_init(&screen->fps_counter, params->video_stats);
+
+    if (screen->video) {
+        screen->orientation = params->orientation;
+        if (screen->orientation != SC_ORIENTATION_0) {
+            LOGI("Initial display orientation set to %s",
+                 sc_orientation_get_name(screen->orientation));
+        }
+    }
+
+    assert(params->window_title);
+    SDL_SetWindowTitle(screen->window, params->window_title);
+
     screen->frame = av_frame_alloc();
     if (!screen->frame) {
         LOG_OOM();
-        goto error_destroy_display;
+        goto error_destroy_fps_counter;
     }
 
     struct sc_input_manager_params im_params = {
         .controller = params->controller,
         .fp = params->fp,
+        .replay_buffer = params->replay_buffer,
+        .record_switch = params->record_switch,
+        .screenshot = params->screenshot,
         .screen = screen,
+        .metrics = params->metrics,
         .kp = params->kp,
         .mp = params->mp,
         .gp = params->gp,
         .mouse_bindings = params->mouse_bindings,
         .legacy_paste = params->legacy_paste,
         .clipboard_autosync = params->clipboard_autosync,
+        .alt_video_profile = params->alt_video_profile,
         .shortcut_mods = params->shortcut_mods,
     };
 
@@ -465,20 +911,41 @@ sc_screen_init(struct sc_screen *screen,
     screen->open = false;
 #endif
 
-    if (!screen->video && sc_screen_is_relative_mode(screen)) {
-        // Capture mouse immediately if video mirroring is disabled
-        sc_mouse_capture_set_active(&screen->mc, true);
+    if (!screen->video) {
+        // Without video, there is no first frame to wait for
+        SDL_ShowWindow(screen->window);
+        if (sc_screen_is_relative_mode(screen)) {
+            // Capture mouse immediately if video mirroring is disabled
+            sc_mouse_capture_set_active(&screen->mc, true);
+        }
+    }
+
+    if (screen->cpu.enabled) {
+        Uint32 ms = SC_TICK_TO_MS(SC_CPU_GOVERNOR_PERIOD);
+        screen->cpu.sample_timer =
+            SDL_AddTimer(ms, sc_screen_on_cpu_sample_timer, screen);
+        if (!screen->cpu.sample_timer) {
+            // Not fatal, the CPU usage is just not governed
+            LOGW("Could not start the CPU governor: %s", SDL_GetError());
+        }
+    }
+
+    if (screen->power.enabled) {
+        sc_screen_check_power(screen);
+
+        Uint32 ms = SC_TICK_TO_MS(SC_POWER_CHECK_PERIOD);
+        screen->power.timer =
+            SDL_AddTimer(ms, sc_screen_on_power_timer, screen);
+        if (!screen->power.timer) {
+            LOGW("Could not start the power state checks: %s",
+                 SDL_GetError());
+        }
     }
 
     return true;
 
-error_destroy_display:
-    sc_display_destroy(&screen->display);
-error_destroy_window:
-    SDL_DestroyWindow(screen->window);
 error_destroy_fps_counter:
     sc_fps_counter_destroy(&screen->fps_counter);
-error_destroy_frame_buffer:
     sc_frame_buffer_destroy(&screen->fb);
 
     return false;
@@ -510,19 +977,29 @@ sc_screen_show_initial_window(struct sc_screen *screen) {
     sc_screen_update_content_rect(screen);
 }
 
-void
-sc_screen_hide_window(struct sc_screen *screen) {
-    SDL_HideWindow(screen->window);
-}
+sc_tick
+sc_screen_get_refresh_period(struct sc_screen *screen) {
+    int refresh_rate = 0;
 
-void
-sc_screen_interrupt(struct sc_screen *screen) {
-    sc_fps_counter_interrupt(&screen->fps_counter);
+    int index = SDL_GetWindowDisplayIndex(screen->window);
+    if (index >= 0) {
+        SDL_DisplayMode mode;
+        if (!SDL_GetCurrentDisplayMode(index, &mode)) {
+            refresh_rate = mode.refresh_rate;
+        }
+    }
+
+    if (refresh_rate <= 0) {
+        LOGW("Could not get the display refresh rate, assuming 60Hz");
+        refresh_rate = 60;
+    }
+
+    return SC_TICK_FREQ / refresh_rate;
 }
 
 void
-sc_screen_join(struct sc_screen *screen) {
-    sc_fps_counter_join(&screen->fps_counter);
+sc_screen_hide_window(struct sc_screen *screen) {
+    SDL_HideWindow(screen->window);
 }
 
 void
@@ -530,9 +1007,23 @@ sc_screen_destroy(struct sc_screen *screen) {
 #ifndef NDEBUG
     assert(!screen->open);
 #endif
-    sc_display_destroy(&screen->display);
+    if (screen->view_size.timer) {
+        SDL_RemoveTimer(screen->view_size.timer);
+    }
+    if (screen->resize_render.timer) {
+        SDL_RemoveTimer(screen->resize_render.timer);
+    }
+    if (screen->cpu.sample_timer) {
+        SDL_RemoveTimer(screen->cpu.sample_timer);
+    }
+    if (screen->power.timer) {
+        SDL_RemoveTimer(screen->power.timer);
+    }
+    if (screen->render_rate.timer) {
+        SDL_RemoveTimer(screen->render_rate.timer);
+    }
     av_frame_free(&screen->frame);
-    SDL_DestroyWindow(screen->window);
+    av_frame_free(&screen->resume_frame);
     sc_fps_counter_destroy(&screen->fps_counter);
     sc_frame_buffer_destroy(&screen->fb);
 }
@@ -542,6 +1033,20 @@ resize_for_content(struct sc_screen *screen, struct sc_size old_content_size,
                    struct sc_size new_content_size) {
     assert(screen->video);
 
+    if (screen->view_size.controller) {
+        // The video resolution follows the window size, so a new resolution
+        // must not resize the window: only a new aspect ratio (typically on
+        // rotation) may. Compare the contents at the same scale.
+        uint32_t old_max = MAX(old_content_size.width,
+                               old_content_size.height);
+        uint32_t new_max = MAX(new_content_size.width,
+                               new_content_size.height);
+        old_content_size.width =
+            MAX(1, old_content_size.width * new_max / old_max);
+        old_content_size.height =
+            MAX(1, old_content_size.height * new_max / old_max);
+    }
+
     struct sc_size window_size = get_window_size(screen);
     struct sc_size target_size = {
         .width = (uint32_t) window_size.width * new_content_size.width
@@ -557,6 +1062,12 @@ static void
 set_content_size(struct sc_screen *screen, struct sc_size new_content_size) {
     assert(screen->video);
 
+    if (screen->view_size.display.enabled) {
+        // The display follows the window, not the other way around
+        screen->content_size = new_content_size;
+        return;
+    }
+
     if (!screen->fullscreen && !screen->maximized && !screen->minimized) {
         resize_for_content(screen, screen->content_size, new_content_size);
     } else if (!screen->resize_pending) {
@@ -646,6 +1157,7 @@ sc_screen_apply_frame(struct sc_screen *screen) {
     assert(screen->video);
 
     sc_fps_counter_add_rendered_frame(&screen->fps_counter);
+    sc_metric_inc(screen->frames_rendered_metric);
 
     AVFrame *frame = screen->frame;
     struct sc_size new_frame_size = {frame->width, frame->height};
@@ -667,6 +1179,13 @@ sc_screen_apply_frame(struct sc_screen *screen) {
         return true;
     }
 
+    if (screen->latency_tracker) {
+        sc_latency_tracker_record(screen->latency_tracker, frame->pts,
+                                  SC_LATENCY_STAGE_UPLOADED);
+        screen->latency_pts = frame->pts;
+        screen->has_latency_pts = true;
+    }
+
     if (!screen->has_frame) {
         screen->has_frame = true;
         // this is the very first frame, show the window
@@ -679,6 +1198,48 @@ sc_screen_apply_frame(struct sc_screen *screen) {
     }
 
     sc_screen_render(screen, false);
+    sc_startup_timing_mark(SC_STARTUP_PHASE_FIRST_PRESENT);
+    return true;
+}
+
+static Uint32 SDLCALL
+sc_screen_on_render_rate_timer(Uint32 interval, void *userdata) {
+    (void) interval;
+    (void) userdata;
+
+    // Consume the deferred frame from the main thread
+    sc_push_event(SC_EVENT_NEW_FRAME);
+
+    // One-shot timer
+    return 0;
+}
+
+// Defer the consumption of the pending frame if the previous render is too
+// recent for the limited render rate
+//
+// Meanwhile, the new frames replace the pending one (they are skipped).
+static bool
+sc_screen_defer_frame(struct sc_screen *screen) {
+    assert(screen->render_rate.period);
+    assert(!screen->render_rate.timer);
+
+    sc_tick now = sc_tick_now();
+    sc_tick next = screen->render_rate.last + screen->render_rate.period;
+    if (now >= next) {
+        screen->render_rate.last = now;
+        return false;
+    }
+
+    // Round up to the next millisecond
+    Uint32 ms = SC_TICK_TO_MS(next - now) + 1;
+    screen->render_rate.timer =
+        SDL_AddTimer(ms, sc_screen_on_render_rate_timer, screen);
+    if (!screen->render_rate.timer) {
+        LOGW("Could not defer frame: %s", SDL_GetError());
+        screen->render_rate.last = now;
+        return false;
+    }
+
     return true;
 }
 
@@ -686,7 +1247,12 @@ static bool
 sc_screen_update_frame(struct sc_screen *screen) {
     assert(screen->video);
 
-    if (screen->paused) {
+    // No other SC_EVENT_NEW_FRAME is posted while a frame is pending, so if a
+    // frame has been deferred, this event comes from its timer
+    screen->render_rate.timer = 0;
+
+    if (screen->paused || screen->hidden) {
+        // Only keep a reference to the last frame
         if (!screen->resume_frame) {
             screen->resume_frame = av_frame_alloc();
             if (!screen->resume_frame) {
@@ -696,15 +1262,54 @@ sc_screen_update_frame(struct sc_screen *screen) {
         } else {
             av_frame_unref(screen->resume_frame);
         }
+        sc_tick begin = sc_trace_begin();
         sc_frame_buffer_consume(&screen->fb, screen->resume_frame);
+        sc_trace_end("frame_buffer_consume", begin);
+        return true;
+    }
+
+    if (screen->render_rate.period && sc_screen_defer_frame(screen)) {
         return true;
     }
 
     av_frame_unref(screen->frame);
+    sc_tick begin = sc_trace_begin();
     sc_frame_buffer_consume(&screen->fb, screen->frame);
+    sc_trace_end("frame_buffer_consume", begin);
+    return sc_screen_apply_frame(screen);
+}
+
+// Apply the last frame received while paused or hidden, if any
+static bool
+sc_screen_apply_resume_frame(struct sc_screen *screen) {
+    if (!screen->resume_frame) {
+        return true;
+    }
+
+    av_frame_free(&screen->frame);
+    screen->frame = screen->resume_frame;
+    screen->resume_frame = NULL;
     return sc_screen_apply_frame(screen);
 }
 
+static void
+sc_screen_set_hidden(struct sc_screen *screen, bool hidden) {
+    if (hidden == screen->hidden) {
+        return;
+    }
+
+    LOGD(hidden ? "Window hidden, stop rendering"
+                : "Window visible, resume rendering");
+    screen->hidden = hidden;
+
+    if (!hidden && !screen->paused) {
+        // Upload the last frame lazily, now that it is visible
+        if (!sc_screen_apply_resume_frame(screen)) {
+            LOGW("Could not apply the last frame");
+        }
+    }
+}
+
 void
 sc_screen_set_paused(struct sc_screen *screen, bool paused) {
     assert(screen->video);
@@ -714,13 +1319,11 @@ sc_screen_set_paused(struct sc_screen *screen, bool paused) {
         return;
     }
 
-    if (screen->paused && screen->resume_frame) {
+    if (screen->paused && !screen->hidden) {
         // If display screen was paused, refresh the frame immediately, even if
-        // the new state is also paused.
-        av_frame_free(&screen->frame);
-        screen->frame = screen->resume_frame;
-        screen->resume_frame = NULL;
-        sc_screen_apply_frame(screen);
+        // the new state is also paused. If the window is hidden, the frame
+        // will be applied once it is visible.
+        sc_screen_apply_resume_frame(screen);
     }
 
     if (!paused) {
@@ -798,6 +1401,181 @@ sc_screen_resize_to_pixel_perfect(struct sc_screen *screen) {
                                             content_size.height);
 }
 
+static void
+sc_screen_update_throttle(struct sc_screen *screen) {
+    assert(screen->throttle.controller);
+
+    uint16_t background_max_fps = screen->throttle.background_max_fps;
+    if (!background_max_fps && screen->power.on_battery) {
+        background_max_fps = SC_POWER_BACKGROUND_MAX_FPS;
+    }
+
+    uint16_t max_fps = screen->throttle.focused
+                     ? 0 // restore the initial value
+                     : background_max_fps;
+    if (screen->cpu.level >= SC_CPU_LEVEL_MAX_FPS
+            && (!max_fps || max_fps > SC_CPU_MAX_FPS)) {
+        max_fps = SC_CPU_MAX_FPS;
+    }
+    // The encoding is only suspended while minimized if the video is throttled
+    // in the background
+    bool paused = background_max_fps
+               && screen->throttle.minimized
+               && screen->throttle.pause_when_minimized;
+    if (max_fps == screen->throttle.max_fps
+            && paused == screen->throttle.paused) {
+        // Nothing changed
+        return;
+    }
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE;
+    msg.set_video_throttle.max_fps = max_fps;
+    msg.set_video_throttle.paused = paused;
+
+    if (!sc_controller_push_msg(screen->throttle.controller, &msg)) {
+        LOGW("Could not request video throttle");
+        return;
+    }
+
+    screen->throttle.max_fps = max_fps;
+    screen->throttle.paused = paused;
+}
+
+static void
+sc_screen_handle_throttle_event(struct sc_screen *screen, uint8_t event) {
+    assert(screen->throttle.controller);
+
+    switch (event) {
+        case SDL_WINDOWEVENT_FOCUS_GAINED:
+            screen->throttle.focused = true;
+            break;
+        case SDL_WINDOWEVENT_FOCUS_LOST:
+            screen->throttle.focused = false;
+            break;
+        case SDL_WINDOWEVENT_MINIMIZED:
+            screen->throttle.minimized = true;
+            break;
+        case SDL_WINDOWEVENT_RESTORED:
+            screen->throttle.minimized = false;
+            break;
+        default:
+            return;
+    }
+
+    sc_screen_update_throttle(screen);
+}
+
+static void
+sc_screen_update_cpu_view_size(struct sc_screen *screen) {
+    assert(screen->view_size.controller);
+
+    uint16_t cpu_max_size = 0;
+    if (screen->cpu.level >= SC_CPU_LEVEL_RESOLUTION) {
+        // Lower the current resolution by a third (this is called on level
+        // change only, so the reduction is not applied repeatedly)
+        uint32_t size = MAX(screen->frame_size.width,
+                            screen->frame_size.height);
+        if (size) {
+            size = size * 2 / 3 / SC_VIEW_SIZE_STEP * SC_VIEW_SIZE_STEP;
+            cpu_max_size = MAX(size, SC_VIEW_SIZE_STEP);
+        }
+    }
+
+    screen->view_size.cpu_max_size = cpu_max_size;
+    sc_screen_set_view_max_size(screen);
+}
+
+static void
+sc_screen_update_render_rate(struct sc_screen *screen) {
+    sc_tick period = 0;
+    if (screen->cpu.level >= SC_CPU_LEVEL_RENDER_RATE) {
+        period = SC_TICK_FREQ / SC_CPU_RENDER_FPS;
+    }
+    if (screen->power.on_battery) {
+        // Rendering faster than the display refreshes is a waste of power
+        if (!screen->refresh_period) {
+            screen->refresh_period = sc_screen_get_refresh_period(screen);
+        }
+        period = MAX(period, screen->refresh_period);
+    }
+
+    screen->render_rate.period = period;
+}
+
+static void
+sc_screen_apply_cpu_level(struct sc_screen *screen, enum sc_cpu_level level) {
+    screen->cpu.level = level;
+
+    if (screen->background_skip.enabled) {
+        sc_screen_update_background_skip(screen);
+    }
+
+    sc_screen_update_render_rate(screen);
+
+    if (screen->throttle.controller) {
+        sc_screen_update_throttle(screen);
+    }
+
+    if (screen->view_size.controller) {
+        sc_screen_update_cpu_view_size(screen);
+    }
+}
+
+static void
+sc_screen_sample_cpu(void *userdata) {
+    struct sc_screen *screen = userdata;
+
+    sc_tick cpu_time;
+    if (!sc_process_get_cpu_time(&cpu_time)) {
+        return;
+    }
+
+    struct sc_cpu_governor *governor = &screen->cpu.governor;
+    if (sc_cpu_governor_push(governor, sc_tick_now(), cpu_time)) {
+        sc_screen_apply_cpu_level(screen, governor->level);
+    }
+}
+
+static Uint32 SDLCALL
+sc_screen_on_cpu_sample_timer(Uint32 interval, void *userdata) {
+    // Called from the SDL timer thread, sample from the main thread
+    sc_post_to_main_thread(sc_screen_sample_cpu, userdata);
+
+    // Periodic timer
+    return interval;
+}
+
+static void
+sc_screen_check_power(void *userdata) {
+    struct sc_screen *screen = userdata;
+
+    SDL_PowerState state = SDL_GetPowerInfo(NULL, NULL);
+    bool on_battery = state == SDL_POWERSTATE_ON_BATTERY;
+    if (on_battery == screen->power.on_battery) {
+        return;
+    }
+
+    LOGI(on_battery ? "On battery, power saving enabled"
+                    : "On AC power, power saving disabled");
+    screen->power.on_battery = on_battery;
+
+    sc_screen_update_render_rate(screen);
+
+    if (screen->throttle.controller) {
+        sc_screen_update_throttle(screen);
+    }
+}
+
+static Uint32 SDLCALL
+sc_screen_on_power_timer(Uint32 interval, void *userdata) {
+    // Called from the SDL timer thread, check from the main thread
+    sc_post_to_main_thread(sc_screen_check_power, userdata);
+
+    // Periodic timer
+    return interval;
+}
+
 bool
 sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
     switch (event->type) {
@@ -824,6 +1602,20 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
                 sc_screen_render_novideo(screen);
             }
 
+            if (screen->throttle.controller) {
+                sc_screen_handle_throttle_event(screen, event->window.event);
+            }
+
+            if (screen->background_skip.enabled) {
+                uint8_t window_event = event->window.event;
+                if (window_event == SDL_WINDOWEVENT_FOCUS_GAINED
+                        || window_event == SDL_WINDOWEVENT_FOCUS_LOST) {
+                    screen->background_skip.focused =
+                        window_event == SDL_WINDOWEVENT_FOCUS_GAINED;
+                    sc_screen_update_background_skip(screen);
+                }
+            }
+
             // !video implies !has_frame
             assert(screen->video || !screen->has_frame);
             if (!screen->has_frame) {
@@ -831,17 +1623,31 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
                 return true;
             }
             switch (event->window.event) {
+                case SDL_WINDOWEVENT_HIDDEN:
+                    sc_screen_set_hidden(screen, true);
+                    break;
+                case SDL_WINDOWEVENT_SHOWN:
+                    sc_screen_set_hidden(screen, false);
+                    break;
                 case SDL_WINDOWEVENT_EXPOSED:
+                    // An exposed window is visible, whatever the previous
+                    // events (the "restored" event may be ignored below)
+                    sc_screen_set_hidden(screen, false);
                     sc_screen_render(screen, true);
                     break;
                 case SDL_WINDOWEVENT_SIZE_CHANGED:
-                    sc_screen_render(screen, true);
+                    sc_screen_render_for_resize(screen);
                     break;
                 case SDL_WINDOWEVENT_MAXIMIZED:
                     screen->maximized = true;
+                    sc_screen_set_hidden(screen, false);
                     break;
                 case SDL_WINDOWEVENT_MINIMIZED:
                     screen->minimized = true;
+                    sc_screen_set_hidden(screen, true);
+                    if (screen->background_skip.enabled) {
+                        sc_screen_update_background_skip(screen);
+                    }
                     break;
                 case SDL_WINDOWEVENT_RESTORED:
                     if (screen->fullscreen) {
@@ -854,6 +1660,7 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
                     }
                     screen->maximized = false;
                     screen->minimized = false;
+                    sc_screen_set_hidden(screen, false);
                     apply_pending_resize(screen);
                     sc_screen_render(screen, true);
                     break;
@@ -12,15 +12,21 @@
 
 #include "controller.h"
 #include "coords.h"
+#include "cpu_governor.h"
+#include "decoder.h"
 #include "display.h"
 #include "fps_counter.h"
 #include "frame_buffer.h"
 #include "input_manager.h"
+#include "latency_tracker.h"
 #include "mouse_capture.h"
 #include "options.h"
 #include "trait/key_processor.h"
 #include "trait/frame_sink.h"
 #include "trait/mouse_processor.h"
+#include "util/metrics.h"
+#include "util/tick.h"
+#include "video_feedback.h"
 
 struct sc_screen {
     struct sc_frame_sink frame_sink; // frame sink trait
@@ -36,6 +42,19 @@ struct sc_screen {
     struct sc_mouse_capture mc; // only used in mouse relative mode
     struct sc_frame_buffer fb;
     struct sc_fps_counter fps_counter;
+    // The video decoder, to report skipped frames (may be NULL)
+    struct sc_decoder *decoder;
+    struct sc_latency_tracker *latency_tracker; // may be NULL
+    // To report skipped frames to the device (may be NULL)
+    struct sc_video_feedback *video_feedback;
+    // Rendered and skipped frames (NULL if metrics are disabled)
+    struct sc_metric *frames_rendered_metric;
+    struct sc_metric *frames_skipped_metric;
+    // Memory allocated for the textures (NULL if metrics are disabled)
+    struct sc_metric *texture_bytes_metric;
+    // The PTS of the frame uploaded but not presented yet
+    int64_t latency_pts;
+    bool has_latency_pts;
 
     // The initial requested window properties
     struct {
@@ -60,6 +79,11 @@ struct sc_screen {
     enum sc_orientation orientation;
     // rectangle of the content (excluding black borders)
     struct SDL_Rect rect;
+    // The sizes the content rectangle has been computed for
+    struct {
+        struct sc_size drawable;
+        struct sc_size content;
+    } rect_sizes;
     bool has_frame;
     bool fullscreen;
     bool maximized;
@@ -68,14 +92,120 @@ struct sc_screen {
     AVFrame *frame;
 
     bool paused;
+    // The window is minimized or hidden: the frames are not uploaded nor
+    // rendered until it is visible again
+    bool hidden;
+    // The last frame received while paused or hidden (may be NULL)
     AVFrame *resume_frame;
+
+    // Throttle the device video while the window is in the background
+    struct {
+        // NULL if disabled (no --background-max-fps)
+        struct sc_controller *controller;
+        uint16_t background_max_fps;
+        // Whether the encoding may be suspended while minimized (no other
+        // video consumer)
+        bool pause_when_minimized;
+        bool focused;
+        bool minimized;
+        // The last values sent to the device
+        uint16_t max_fps;
+        bool paused;
+    } throttle;
+
+    // Request the decoder to skip the non-reference frames while the window
+    // is in the background and shows the video much smaller than its size (or
+    // to stay within the CPU budget)
+    struct {
+        bool enabled;
+        bool focused;
+        bool small; // the content is downscaled by at least 2 on both axes
+        bool requested; // the last value requested to the decoder
+    } background_skip;
+
+    // Coalesce the renders on window resize
+    struct {
+        sc_tick last; // the last render on resize
+        SDL_TimerID timer; // 0 if no render is scheduled
+    } resize_render;
+    sc_tick refresh_period; // 0 if not retrieved yet
+
+    // Report the content size to the device, so that it adapts the video
+    // resolution to the window (or lowers it to stay within the CPU budget)
+    struct {
+        // NULL if disabled (none of --adaptive-max-size,
+        // --new-display-follow-window and --cpu-budget)
+        struct sc_controller *controller;
+        bool adaptive; // follow the window size (--adaptive-max-size)
+        SDL_TimerID timer; // 0 if not scheduled
+        sc_tick last_change; // the last time the max size changed
+        uint16_t window_max_size; // 0 if not adaptive
+        uint16_t cpu_max_size; // 0 unless lowered by the CPU governor
+        uint16_t max_size; // the max size to report
+        uint16_t reported; // the last value sent to the device (0 if none)
+        // Resize the new display to the window (--new-display-follow-window)
+        struct {
+            bool enabled;
+            struct sc_size size; // the display size to report
+            uint16_t dpi;
+            struct sc_size reported_size; // 0x0 if none
+            uint16_t reported_dpi;
+        } display;
+    } view_size;
+
+    // Limit the render rate (to stay within the CPU budget or to save power)
+    struct {
+        sc_tick period; // minimal delay between renders (0 if none)
+        sc_tick last;
+        SDL_TimerID timer; // 0 if no frame is deferred
+    } render_rate;
+
+    // Degrade the video to stay within the CPU budget
+    struct {
+        bool enabled; // --cpu-budget
+        struct sc_cpu_governor governor; // initialized if enabled
+        SDL_TimerID sample_timer; // 0 if not started
+        enum sc_cpu_level level; // the level applied
+    } cpu;
+
+    // Save power while the computer is on battery
+    struct {
+        bool enabled; // --power-saving
+        SDL_TimerID timer; // 0 if not started
+        bool on_battery;
+    } power;
 };
 
-struct sc_screen_params {
+// The window properties, which do not depend on the device
+struct sc_screen_window_params {
     bool video;
 
+    bool always_on_top;
+
+    int16_t window_x; // accepts SC_WINDOW_POSITION_UNDEFINED
+    int16_t window_y; // accepts SC_WINDOW_POSITION_UNDEFINED
+    uint16_t window_width;
+    uint16_t window_height;
+
+    bool window_borderless;
+
+    bool mipmaps;
+    enum sc_present_mode present_mode; // must not be SC_PRESENT_MODE_AUTO
+    bool yuv_shader;
+};
+
+struct sc_screen_params {
+    struct sc_decoder *decoder; // may be NULL
+    struct sc_latency_tracker *latency_tracker; // may be NULL
+    struct sc_video_feedback *video_feedback; // may be NULL
+    struct sc_metrics *metrics; // may be NULL
+    struct sc_stream_stats *video_stats; // may be NULL
+
     struct sc_controller *controller;
     struct sc_file_pusher *fp;
+    struct sc_replay_buffer *replay_buffer; // may be NULL
+    struct sc_record_switch *record_switch; // may be NULL
+    struct sc_screenshot *screenshot; // may be NULL
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
     struct sc_gamepad_processor *gp;
@@ -83,39 +213,57 @@ struct sc_screen_params {
     struct sc_mouse_bindings mouse_bindings;
     bool legacy_paste;
     bool clipboard_autosync;
+    const struct sc_video_profile *alt_video_profile; // may be NULL
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
 
     const char *window_title;
-    bool always_on_top;
-
-    int16_t window_x; // accepts SC_WINDOW_POSITION_UNDEFINED
-    int16_t window_y; // accepts SC_WINDOW_POSITION_UNDEFINED
-    uint16_t window_width;
-    uint16_t window_height;
-
-    bool window_borderless;
 
     enum sc_orientation orientation;
-    bool mipmaps;
 
     bool fullscreen;
     bool start_fps_counter;
+
+    uint16_t background_max_fps; // 0 to disable
+    bool background_pause; // suspend the video encoding while minimized
+    // skip the non-reference frames while small in the background (requires
+    // a decoder)
+    bool background_skip_nonref;
+    // adapt the video resolution to the window size (requires a controller)
+    bool adaptive_max_size;
+    // resize the new display to the window size (requires a controller)
+    bool resize_display;
+    // in percent of one CPU core, 0 to disable (the device frame rate and the
+    // resolution may only be lowered with a controller)
+    uint16_t cpu_budget;
+    // limit the render rate and the device frame rate in the background while
+    // on battery
+    bool power_saving;
 };
 
-// initialize screen, create window, renderer and texture (window is hidden)
+// create the window (hidden) and its renderer
+//
+// It does not depend on the device, so it may be called before the device is
+// connected (creating a renderer may take a few hundred milliseconds).
 bool
-sc_screen_init(struct sc_screen *screen, const struct sc_screen_params *params);
+sc_screen_open_window(struct sc_screen *screen,
+                      const struct sc_screen_window_params *params);
 
-// request to interrupt any inner thread
-// must be called before screen_join()
+// destroy the window and its renderer
+//
+// It must be called after sc_screen_destroy() if the screen has been
+// initialized.
 void
-sc_screen_interrupt(struct sc_screen *screen);
+sc_screen_close_window(struct sc_screen *screen);
 
-// join any inner thread
-void
-sc_screen_join(struct sc_screen *screen);
+// initialize screen (the window must be open)
+bool
+sc_screen_init(struct sc_screen *screen, const struct sc_screen_params *params);
+
+// get the refresh period of the display containing the window
+sc_tick
+sc_screen_get_refresh_period(struct sc_screen *screen);
 
-// destroy window, renderer and texture (if any)
+// destroy screen (but not the window, see sc_screen_close_window())
 void
 sc_screen_destroy(struct sc_screen *screen);
 
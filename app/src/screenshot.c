@@ -0,0 +1,252 @@
+#include "screenshot.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/file.h"
+#include "util/log.h"
+
+// Each pending screenshot holds a reference to a decoded frame, do not
+// accumulate them if the encoding is slower than the requests
+#define SC_SCREENSHOT_MAX_PENDING 8
+
+static void
+sc_screenshot_request_destroy(struct sc_screenshot_request *req) {
+    av_frame_free(&req->frame);
+    free(req->filename);
+}
+
+static const char *
+sc_screenshot_get_extension(enum sc_thumbnail_format format) {
+    switch (format) {
+        case SC_THUMBNAIL_FORMAT_JPEG:
+            return "jpg";
+        case SC_THUMBNAIL_FORMAT_PNG:
+            return "png";
+        case SC_THUMBNAIL_FORMAT_WEBP:
+            return "webp";
+        default:
+            assert(!"unexpected image format");
+            return NULL;
+    }
+}
+
+// Return "<dir>/scrcpy-<date>[-<index>].<ext>"
+static char *
+sc_screenshot_get_filename(struct sc_screenshot *ss) {
+    time_t now = time(NULL);
+    // Only called from the main thread
+    struct tm *tm = localtime(&now);
+    char date[sizeof(ss->last_date)];
+    if (!tm || !strftime(date, sizeof(date), "%Y%m%d-%H%M%S", tm)) {
+        LOGE("Could not format the current date");
+        return NULL;
+    }
+
+    if (!strcmp(date, ss->last_date)) {
+        ++ss->date_index;
+    } else {
+        memcpy(ss->last_date, date, sizeof(date));
+        ss->date_index = 0;
+    }
+
+    const char *ext = sc_screenshot_get_extension(ss->format);
+
+    char *filename;
+    int r;
+    if (ss->date_index) {
+        r = asprintf(&filename, "%s%cscrcpy-%s-%u.%s", ss->dir,
+                     SC_PATH_SEPARATOR, date, ss->date_index, ext);
+    } else {
+        r = asprintf(&filename, "%s%cscrcpy-%s.%s", ss->dir,
+                     SC_PATH_SEPARATOR, date, ext);
+    }
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return filename;
+}
+
+bool
+sc_screenshot_init(struct sc_screenshot *ss, const char *dir,
+                   enum sc_thumbnail_format format) {
+    sc_vecdeque_init(&ss->queue);
+
+    bool ok = sc_mutex_init(&ss->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&ss->event_cond);
+    if (!ok) {
+        sc_mutex_destroy(&ss->mutex);
+        return false;
+    }
+
+    ok = sc_image_encoder_init(&ss->encoder, format, "Screenshot");
+    if (!ok) {
+        sc_cond_destroy(&ss->event_cond);
+        sc_mutex_destroy(&ss->mutex);
+        return false;
+    }
+
+    ss->dir = dir ? dir : ".";
+    ss->format = format;
+    ss->last_date[0] = '\0';
+    ss->date_index = 0;
+
+    // lazy initialization
+    ss->initialized = false;
+
+    ss->stopped = false;
+
+    return true;
+}
+
+void
+sc_screenshot_destroy(struct sc_screenshot *ss) {
+    sc_image_encoder_destroy(&ss->encoder);
+    sc_cond_destroy(&ss->event_cond);
+    sc_mutex_destroy(&ss->mutex);
+
+    while (!sc_vecdeque_is_empty(&ss->queue)) {
+        struct sc_screenshot_request *req = sc_vecdeque_popref(&ss->queue);
+        assert(req);
+        sc_screenshot_request_destroy(req);
+    }
+    sc_vecdeque_destroy(&ss->queue);
+}
+
+static void
+sc_screenshot_process(struct sc_screenshot *ss,
+                      struct sc_screenshot_request *req) {
+    AVFrame *frame = req->frame;
+    bool ok = sc_image_encoder_encode(&ss->encoder, frame, frame->width,
+                                      frame->height);
+    if (!ok) {
+        LOGE("Could not encode screenshot %s", req->filename);
+        return;
+    }
+
+    ok = sc_image_encoder_write_file(&ss->encoder, req->filename);
+    av_packet_unref(ss->encoder.packet);
+    if (!ok) {
+        LOGE("Could not write screenshot %s", req->filename);
+        return;
+    }
+
+    LOGI("Screenshot saved to %s", req->filename);
+}
+
+static int
+run_screenshot(void *data) {
+    struct sc_screenshot *ss = data;
+
+    for (;;) {
+        sc_mutex_lock(&ss->mutex);
+        while (!ss->stopped && sc_vecdeque_is_empty(&ss->queue)) {
+            sc_cond_wait(&ss->event_cond, &ss->mutex);
+        }
+        // Once stopped, the pending requests (at most
+        // SC_SCREENSHOT_MAX_PENDING) are still saved before the thread exits,
+        // so that a screenshot taken just before quitting is not lost
+        if (sc_vecdeque_is_empty(&ss->queue)) {
+            assert(ss->stopped);
+            sc_mutex_unlock(&ss->mutex);
+            break;
+        }
+
+        struct sc_screenshot_request req = sc_vecdeque_pop(&ss->queue);
+        sc_mutex_unlock(&ss->mutex);
+
+        sc_screenshot_process(ss, &req);
+        sc_screenshot_request_destroy(&req);
+    }
+
+    return 0;
+}
+
+static bool
+sc_screenshot_start(struct sc_screenshot *ss) {
+    LOGD("Starting screenshot thread");
+
+    bool ok = sc_thread_create(&ss->thread, run_screenshot,
+                               "scrcpy-screenshot", ss);
+    if (!ok) {
+        LOGE("Could not start screenshot thread");
+        return false;
+    }
+
+    return true;
+}
+
+bool
+sc_screenshot_take(struct sc_screenshot *ss, const AVFrame *frame) {
+    // start the thread if it's used for the first time
+    if (!ss->initialized) {
+        if (!sc_screenshot_start(ss)) {
+            return false;
+        }
+        ss->initialized = true;
+    }
+
+    struct sc_screenshot_request req;
+    req.filename = sc_screenshot_get_filename(ss);
+    if (!req.filename) {
+        return false;
+    }
+
+    // Only take a new reference, the frame is converted on the thread
+    req.frame = av_frame_clone(frame);
+    if (!req.frame) {
+        LOG_OOM();
+        free(req.filename);
+        return false;
+    }
+
+    sc_mutex_lock(&ss->mutex);
+    if (sc_vecdeque_size(&ss->queue) >= SC_SCREENSHOT_MAX_PENDING) {
+        sc_mutex_unlock(&ss->mutex);
+        LOGW("Too many pending screenshots, %s skipped", req.filename);
+        sc_screenshot_request_destroy(&req);
+        return false;
+    }
+
+    bool was_empty = sc_vecdeque_is_empty(&ss->queue);
+    bool ok = sc_vecdeque_push(&ss->queue, req);
+    if (!ok) {
+        sc_mutex_unlock(&ss->mutex);
+        LOG_OOM();
+        sc_screenshot_request_destroy(&req);
+        return false;
+    }
+
+    if (was_empty) {
+        sc_cond_signal(&ss->event_cond);
+    }
+    sc_mutex_unlock(&ss->mutex);
+
+    return true;
+}
+
+void
+sc_screenshot_stop(struct sc_screenshot *ss) {
+    if (ss->initialized) {
+        sc_mutex_lock(&ss->mutex);
+        ss->stopped = true;
+        sc_cond_signal(&ss->event_cond);
+        sc_mutex_unlock(&ss->mutex);
+    }
+}
+
+void
+sc_screenshot_join(struct sc_screenshot *ss) {
+    if (ss->initialized) {
+        sc_thread_join(&ss->thread, NULL);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SC_SCREENSHOT_H
+#define SC_SCREENSHOT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavutil/frame.h>
+
+#include "image_encoder.h"
+#include "options.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+struct sc_screenshot_request {
+    AVFrame *frame;
+    char *filename;
+};
+
+struct sc_screenshot_request_queue SC_VECDEQUE(struct sc_screenshot_request);
+
+/**
+ * Save snapshots of the decoded frames to image files
+ *
+ * The caller only takes a new reference to the frame: the conversion and the
+ * encoding are performed on a separate thread, so that neither the UI nor the
+ * decoder are stalled.
+ */
+struct sc_screenshot {
+    const char *dir; // without trailing separator
+    enum sc_thumbnail_format format;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond event_cond;
+    bool stopped;
+    bool initialized; // the thread is started on the first request
+    struct sc_screenshot_request_queue queue;
+
+    // To make the filenames of screenshots taken the same second unique
+    char last_date[32];
+    unsigned date_index;
+
+    struct sc_image_encoder encoder; // only accessed from the thread
+};
+
+// dir may be NULL (for the current directory)
+bool
+sc_screenshot_init(struct sc_screenshot *ss, const char *dir,
+                   enum sc_thumbnail_format format);
+
+void
+sc_screenshot_destroy(struct sc_screenshot *ss);
+
+// Stop the thread once the pending screenshots are saved
+void
+sc_screenshot_stop(struct sc_screenshot *ss);
+
+void
+sc_screenshot_join(struct sc_screenshot *ss);
+
+/**
+ * Request a screenshot of the frame
+ *
+ * It must be called from the main thread (the filename is generated from the
+ * current date).
+ */
+bool
+sc_screenshot_take(struct sc_screenshot *ss, const AVFrame *frame);
+
+#endif
@@ -8,21 +8,49 @@
 #include <sys/types.h>
 
 #include "adb/adb.h"
+#include "device_cache.h"
+#include "startup_timing.h"
 #include "util/env.h"
 #include "util/file.h"
 #include "util/log.h"
 #include "util/net_intr.h"
 #include "util/process.h"
+#include "util/random.h"
 #include "util/str.h"
+#include "util/strbuf.h"
 
 #define SC_SERVER_FILENAME "scrcpy-server"
 
 #define SC_SERVER_PATH_DEFAULT PREFIX "/share/scrcpy/" SC_SERVER_FILENAME
 #define SC_DEVICE_SERVER_PATH "/data/local/tmp/scrcpy-server.jar"
+// Hash of the local server file last pushed, followed by the size and the
+// modification time of the pushed file (to detect a jar pushed by another
+// client since then)
+#define SC_DEVICE_SERVER_HASH_PATH "/data/local/tmp/scrcpy-server.hash"
+#define SC_DEVICE_SERVER_STAMP_CMD "stat -c %s-%Y " SC_DEVICE_SERVER_PATH
+
+// Line printed by the server once it listens for connections (in forward
+// tunnel mode)
+#define SC_SERVER_READY_MARKER "[server] READY"
+// Line printed by the server with the video encoder selected by the benchmark
+#define SC_SERVER_VIDEO_ENCODER_MARKER "[server] VIDEO_ENCODER "
+// Line printed by the server with the max size selected on encoding error
+#define SC_SERVER_MAX_SIZE_MARKER "[server] MAX_SIZE "
+#define SC_SERVER_OUTPUT_LINE_MAX 4096
+// Maximum delay to wait for the server to be ready, before attempting to
+// connect anyway
+#define SC_SERVER_READY_TIMEOUT SC_TICK_FROM_SEC(10)
 
 #define SC_ADB_PORT_DEFAULT 5555
 #define SC_SOCKET_NAME_PREFIX "scrcpy_"
 
+// For params.auto_tunnel
+#define SC_TUNNEL_BENCHMARK_PINGS 8
+#define SC_TUNNEL_BENCHMARK_BURST_SIZE (4 << 20)
+// The tunnel modes are compared by the estimated delay to receive a video
+// frame of this size (a large frame, so that the throughput matters)
+#define SC_TUNNEL_BENCHMARK_FRAME_SIZE (256 << 10)
+
 static char *
 get_server_path(void) {
     char *server_path = sc_get_env("SCRCPY_SERVER_PATH");
@@ -53,8 +81,143 @@ get_server_path(void) {
     return server_path;
 }
 
+// Indicate if the device is accessed over USB without the adb server
+static bool
+sc_server_is_adb_usb(const struct sc_server *server) {
+#ifdef HAVE_USB
+    return server->params.adb_usb;
+#else
+    (void) server;
+    return false;
+#endif
+}
+
+// Indicate if the client connects to the server without any adb tunnel (each
+// connection is a stream of the USB transport, or a direct TCP connection)
+static bool
+sc_server_is_tunnelless(const struct sc_server *server) {
+    return sc_server_is_adb_usb(server) || server->params.direct_tcp_port;
+}
+
+// Execute a shell command on the device and read its output (silently)
+static ssize_t
+sc_server_shell_read(struct sc_server *server, const char *cmd, char *buf,
+                     size_t len) {
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        size_t out_len;
+        bool ok = sc_adb_usb_shell_read(&server->adb_usb, &server->intr, cmd,
+                                        buf, len, &out_len, SC_ADB_SILENT);
+        return ok ? (ssize_t) out_len : -1;
+    }
+#endif
+
+    return sc_adb_shell_read(&server->intr, server->serial, cmd, buf, len,
+                             SC_ADB_SILENT);
+}
+
+// Read a device property (silently)
+static char *
+sc_server_getprop(struct sc_server *server, const char *prop) {
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        char cmd[128];
+        int r = snprintf(cmd, sizeof(cmd), "getprop %s", prop);
+        assert(r > 0 && (size_t) r < sizeof(cmd));
+        (void) r;
+
+        char buf[128];
+        if (sc_server_shell_read(server, cmd, buf, sizeof(buf)) == -1) {
+            return NULL;
+        }
+
+        buf[strcspn(buf, " \r\n")] = '\0';
+        char *value = strdup(buf);
+        if (!value) {
+            LOG_OOM();
+        }
+        return value;
+    }
+#endif
+
+    return sc_adb_getprop(&server->intr, server->serial, prop, SC_ADB_SILENT);
+}
+
+static bool
+sc_server_push_file(struct sc_server *server, const char *local,
+                    const char *remote) {
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        return sc_adb_usb_push(&server->adb_usb, &server->intr, local, remote,
+                               0);
+    }
+#endif
+
+    return sc_adb_push_file(&server->intr, server->serial, local, remote, 0);
+}
+
+// The device build fingerprint is read by the same command, to avoid another
+// round-trip (it is stored to *fingerprint if available)
 static bool
-push_server(struct sc_intr *intr, const char *serial) {
+is_server_pushed(struct sc_server *server, const char *hash,
+                 char **fingerprint) {
+    // The output is expected to be "<fingerprint>\n<hash> <stamp>\n<stamp>\n"
+    // (only "<fingerprint>\n" if the server has never been pushed)
+    char buf[512];
+    ssize_t r = sc_server_shell_read(server,
+                                     "getprop ro.build.fingerprint; "
+                                     "cat " SC_DEVICE_SERVER_HASH_PATH
+                                     " 2>/dev/null && "
+                                     SC_DEVICE_SERVER_STAMP_CMD "; true",
+                                     buf, sizeof(buf));
+    if (r <= 0) {
+        return false;
+    }
+
+    char *line = strchr(buf, '\n');
+    if (!line) {
+        return false;
+    }
+    *line++ = '\0';
+    buf[strcspn(buf, "\r")] = '\0';
+    if (*buf) {
+        *fingerprint = strdup(buf);
+        if (!*fingerprint) {
+            LOG_OOM();
+        }
+    }
+
+    char *stamp = strchr(line, '\n');
+    if (!stamp) {
+        return false;
+    }
+    *stamp++ = '\0';
+    line[strcspn(line, "\r")] = '\0';
+    stamp[strcspn(stamp, "\r\n")] = '\0';
+
+    size_t hash_len = strlen(hash);
+    return !strncmp(line, hash, hash_len) && line[hash_len] == ' '
+        && *stamp && !strcmp(&line[hash_len + 1], stamp);
+}
+
+static void
+record_server_hash(struct sc_server *server, const char *hash) {
+    char cmd[256];
+    int r = snprintf(cmd, sizeof(cmd), "echo %s $(%s) > "
+                     SC_DEVICE_SERVER_HASH_PATH, hash,
+                     SC_DEVICE_SERVER_STAMP_CMD);
+    assert(r > 0 && (size_t) r < sizeof(cmd));
+    (void) r;
+
+    char out[16];
+    if (sc_server_shell_read(server, cmd, out, sizeof(out)) == -1) {
+        // Not fatal, the server will just be pushed again the next time
+        LOGD("Could not record the server hash on the device");
+    }
+}
+
+static bool
+push_server(struct sc_server *server, char **fingerprint) {
     char *server_path = get_server_path();
     if (!server_path) {
         return false;
@@ -64,8 +227,32 @@ push_server(struct sc_intr *intr, const char *serial) {
         free(server_path);
         return false;
     }
-    bool ok = sc_adb_push(intr, serial, server_path, SC_DEVICE_SERVER_PATH, 0);
+
+    // Skip the push if the device already has the same server
+    uint64_t hash;
+    bool hashed = sc_file_hash(server_path, &hash);
+    char hash_str[17];
+    if (hashed) {
+        snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, hash);
+        if (is_server_pushed(server, hash_str, fingerprint)) {
+            LOGD("Server already pushed, skipping");
+            free(server_path);
+            server->keep_server_file = true;
+            return true;
+        }
+    }
+
+    bool ok = sc_server_push_file(server, server_path, SC_DEVICE_SERVER_PATH);
     free(server_path);
+
+    if (ok && hashed) {
+        record_server_hash(server, hash_str);
+    }
+
+    // Otherwise, the cleanup would delete the server file, so the next start
+    // would always push it again (after a useless check)
+    server->keep_server_file = ok && hashed;
+
     return ok;
 }
 
@@ -102,6 +289,152 @@ sc_server_sleep(struct sc_server *server, sc_tick deadline) {
     return !stopped;
 }
 
+// Wait until the server is listening, or its output is closed
+static bool
+sc_server_wait_ready(struct sc_server *server, sc_tick deadline) {
+    sc_mutex_lock(&server->mutex);
+    bool timed_out = false;
+    while (!server->stopped && !server->output.ready && !server->output.closed
+            && !timed_out) {
+        timed_out = !sc_cond_timedwait(&server->cond_stopped,
+                                       &server->mutex, deadline);
+    }
+    bool stopped = server->stopped;
+    sc_mutex_unlock(&server->mutex);
+
+    return !stopped;
+}
+
+static void
+sc_server_relay_line(struct sc_server *server, const char *line, size_t len) {
+    size_t content_len = len;
+    // The device shell may convert "\n" to "\r\n"
+    while (content_len && (line[content_len - 1] == '\n'
+                               || line[content_len - 1] == '\r')) {
+        --content_len;
+    }
+
+    if (content_len == sizeof(SC_SERVER_READY_MARKER) - 1
+            && !memcmp(line, SC_SERVER_READY_MARKER, content_len)) {
+        LOGD("Server ready");
+        sc_mutex_lock(&server->mutex);
+        server->output.ready = true;
+        sc_cond_broadcast(&server->cond_stopped);
+        sc_mutex_unlock(&server->mutex);
+        return;
+    }
+
+    size_t marker_len = sizeof(SC_SERVER_VIDEO_ENCODER_MARKER) - 1;
+    if (content_len > marker_len
+            && !memcmp(line, SC_SERVER_VIDEO_ENCODER_MARKER, marker_len)) {
+        char name[256];
+        size_t name_len = content_len - marker_len;
+        if (server->encoder_cache_key && name_len < sizeof(name)) {
+            memcpy(name, line + marker_len, name_len);
+            name[name_len] = '\0';
+            if (sc_device_cache_put(server->encoder_cache_key, name)) {
+                LOGD("Video encoder benchmark result cached: %s", name);
+            }
+        }
+        return;
+    }
+
+    marker_len = sizeof(SC_SERVER_MAX_SIZE_MARKER) - 1;
+    if (content_len > marker_len
+            && !memcmp(line, SC_SERVER_MAX_SIZE_MARKER, marker_len)) {
+        char value[8];
+        size_t value_len = content_len - marker_len;
+        if (server->max_size_cache_key && value_len < sizeof(value)) {
+            memcpy(value, line + marker_len, value_len);
+            value[value_len] = '\0';
+            if (sc_device_cache_put(server->max_size_cache_key, value)) {
+                LOGD("Video max size cached: %s", value);
+            }
+        }
+        return;
+    }
+
+    fwrite(line, 1, len, stdout);
+    fflush(stdout);
+}
+
+static ssize_t
+sc_server_read_output(struct sc_server *server, char *buf, size_t len) {
+    if (server->output.socket != SC_SOCKET_NONE) {
+        return net_recv(server->output.socket, buf, len);
+    }
+
+    return sc_pipe_read(server->output.pipe, buf, len);
+}
+
+// Relay the server output until it is closed
+static void
+sc_server_relay_output(struct sc_server *server) {
+    char buf[SC_SERVER_OUTPUT_LINE_MAX];
+    size_t len = 0;
+    for (;;) {
+        ssize_t r = sc_server_read_output(server, buf + len,
+                                          sizeof(buf) - len);
+        if (r <= 0) {
+            break;
+        }
+
+        size_t start = 0;
+        size_t end = len + r;
+        for (size_t i = len; i < end; ++i) {
+            if (buf[i] == '\n') {
+                sc_server_relay_line(server, buf + start, i + 1 - start);
+                start = i + 1;
+            }
+        }
+
+        len = end - start;
+        if (len == sizeof(buf)) {
+            // Line too long, relay it as is
+            sc_server_relay_line(server, buf, len);
+            len = 0;
+        } else {
+            memmove(buf, buf + start, len);
+        }
+    }
+
+    if (len) {
+        // Last line, without '\n'
+        sc_server_relay_line(server, buf, len);
+    }
+
+    sc_mutex_lock(&server->mutex);
+    server->output.closed = true;
+    sc_cond_broadcast(&server->cond_stopped);
+    sc_mutex_unlock(&server->mutex);
+}
+
+static int
+run_server_output(void *data) {
+    struct sc_server *server = data;
+
+    sc_server_relay_output(server);
+
+    return 0;
+}
+
+#ifdef HAVE_USB
+// Wait until the server output is closed (the server has terminated)
+static bool
+sc_server_wait_output_closed(struct sc_server *server, sc_tick deadline) {
+    sc_mutex_lock(&server->mutex);
+    bool timed_out = false;
+    while (!server->output.closed && !timed_out) {
+        timed_out = !sc_cond_timedwait(&server->cond_stopped,
+                                       &server->mutex, deadline);
+    }
+    bool closed = server->output.closed;
+    sc_mutex_unlock(&server->mutex);
+
+    return closed;
+}
+#endif
+
 static const char *
 sc_server_get_codec_name(enum sc_codec codec) {
     switch (codec) {
@@ -119,12 +452,29 @@ sc_server_get_codec_name(enum sc_codec codec) {
             return "flac";
         case SC_CODEC_RAW:
             return "raw";
+        case SC_CODEC_AUTO:
+            return "auto";
         default:
             assert(!"unexpected codec");
             return NULL;
     }
 }
 
+static const char *
+sc_server_get_video_bit_rate_mode_name(enum sc_video_bit_rate_mode mode) {
+    switch (mode) {
+        case SC_VIDEO_BIT_RATE_MODE_CBR:
+            return "cbr";
+        case SC_VIDEO_BIT_RATE_MODE_VBR:
+            return "vbr";
+        case SC_VIDEO_BIT_RATE_MODE_CQ:
+            return "cq";
+        default:
+            assert(!"unexpected video bit rate mode");
+            return NULL;
+    }
+}
+
 static const char *
 sc_server_get_camera_facing_name(enum sc_camera_facing camera_facing) {
     switch (camera_facing) {
@@ -201,10 +551,43 @@ validate_string(const char *s) {
     return true;
 }
 
-static sc_pid
+#ifdef HAVE_USB
+// Execute a command (NULL-terminated) by a shell stream of the USB transport
+// (the arguments are joined by spaces, like "adb shell" does)
+static sc_socket
+sc_server_open_shell(struct sc_server *server, const char *const *argv) {
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 1024)) {
+        LOG_OOM();
+        return SC_SOCKET_NONE;
+    }
+
+    bool ok = sc_strbuf_append_staticstr(&buf, "shell:");
+    for (const char *const *arg = argv; ok && *arg; ++arg) {
+        ok = (arg == argv || sc_strbuf_append_char(&buf, ' '))
+          && sc_strbuf_append_str(&buf, *arg);
+    }
+    if (!ok) {
+        LOG_OOM();
+        free(buf.s);
+        return SC_SOCKET_NONE;
+    }
+
+    sc_socket socket = sc_adb_usb_open_stream(&server->adb_usb, buf.s, 0);
+    free(buf.s);
+    return socket;
+}
+#endif
+
+// If pout is not NULL, then the server stdout is redirected to a pipe
+//
+// With params.adb_usb, the server is executed by a shell stream instead (its
+// output is read from server->output.socket, and *pid is SC_PROCESS_NONE).
+static bool
 execute_server(struct sc_server *server,
-               const struct sc_server_params *params) {
-    sc_pid pid = SC_PROCESS_NONE;
+               const struct sc_server_params *params, sc_pipe *pout,
+               sc_pid *pid) {
+    bool ok = false;
 
     const char *serial = server->serial;
     assert(serial);
@@ -222,7 +605,7 @@ execute_server(struct sc_server *server,
     uint16_t sdk_version = sc_adb_get_device_sdk_version(&server->intr, serial);
     if (!sdk_version) {
         LOGE("Could not determine SDK version");
-        return 0;
+        return false;
     }
 
 # define SERVER_DEBUGGER_PORT "5005"
@@ -271,13 +654,35 @@ execute_server(struct sc_server *server,
     if (params->video_bit_rate) {
         ADD_PARAM("video_bit_rate=%" PRIu32, params->video_bit_rate);
     }
+    if (params->record_stream) {
+        ADD_PARAM("record_stream=true");
+        if (params->record_video_bit_rate) {
+            ADD_PARAM("record_video_bit_rate=%" PRIu32,
+                      params->record_video_bit_rate);
+        }
+        if (params->record_max_size) {
+            ADD_PARAM("record_max_size=%" PRIu16, params->record_max_size);
+        }
+    }
     if (!params->audio) {
         ADD_PARAM("audio=false");
     }
     if (params->audio_bit_rate) {
         ADD_PARAM("audio_bit_rate=%" PRIu32, params->audio_bit_rate);
     }
-    if (params->video_codec != SC_CODEC_H264) {
+    if (params->video_codec == SC_CODEC_AUTO) {
+        // Comma-separated list of the candidates, from the preferred one
+        char codecs[32] = "";
+        size_t len = 0;
+        for (unsigned i = 0; i < params->video_codec_candidate_count; ++i) {
+            const char *name =
+                sc_server_get_codec_name(params->video_codec_candidates[i]);
+            len += snprintf(codecs + len, sizeof(codecs) - len, "%s%s",
+                            i ? "," : "", name);
+            assert(len < sizeof(codecs));
+        }
+        ADD_PARAM("video_codec=%s", codecs);
+    } else if (params->video_codec != SC_CODEC_H264) {
         ADD_PARAM("video_codec=%s",
                   sc_server_get_codec_name(params->video_codec));
     }
@@ -298,8 +703,10 @@ execute_server(struct sc_server *server,
     if (params->audio_dup) {
         ADD_PARAM("audio_dup=true");
     }
-    if (params->max_size) {
-        ADD_PARAM("max_size=%" PRIu16, params->max_size);
+    uint16_t max_size = server->max_size ? server->max_size
+                                         : params->max_size;
+    if (max_size) {
+        ADD_PARAM("max_size=%" PRIu16, max_size);
     }
     if (params->max_fps) {
         VALIDATE_STRING(params->max_fps);
@@ -321,7 +728,17 @@ execute_server(struct sc_server *server,
             ADD_PARAM("capture_orientation=%s%s", locked ? "@" : "", orient);
         }
     }
-    if (server->tunnel.forward) {
+    if (server->tunnel_benchmark) {
+        ADD_PARAM("tunnel_benchmark=%d", SC_TUNNEL_BENCHMARK_BURST_SIZE);
+    }
+    if (params->direct_tcp_port) {
+        uint32_t host = server->direct_tcp_host;
+        ADD_PARAM("direct_tcp_port=%" PRIu16, params->direct_tcp_port);
+        ADD_PARAM("direct_tcp_address=%" PRIu32 ".%" PRIu32 ".%" PRIu32
+                  ".%" PRIu32, host >> 24, (host >> 16) & 0xFF,
+                  (host >> 8) & 0xFF, host & 0xFF);
+        ADD_PARAM("direct_tcp_tokens=%s", server->direct_tcp_tokens);
+    } else if (server->tunnel.forward) {
         ADD_PARAM("tunnel_forward=true");
     }
     if (params->crop) {
@@ -357,9 +774,42 @@ execute_server(struct sc_server *server,
     if (params->camera_high_speed) {
         ADD_PARAM("camera_high_speed=true");
     }
+    if (params->video_low_latency) {
+        ADD_PARAM("video_low_latency=true");
+    }
+    if (params->video_intra_refresh) {
+        ADD_PARAM("video_intra_refresh=%" PRIu16, params->video_intra_refresh);
+    }
+    if (params->video_bit_rate_mode != SC_VIDEO_BIT_RATE_MODE_DEFAULT) {
+        ADD_PARAM("video_bit_rate_mode=%s",
+            sc_server_get_video_bit_rate_mode_name(params->video_bit_rate_mode));
+    }
+    if (params->video_quality >= 0) {
+        ADD_PARAM("video_quality=%" PRIi8, params->video_quality);
+    }
+    if (params->video_max_bit_rate) {
+        ADD_PARAM("video_max_bit_rate=%" PRIu32, params->video_max_bit_rate);
+    }
+    if (params->input_pacing) {
+        ADD_PARAM("input_pacing=%" PRIu16, params->input_pacing);
+    }
+    if (params->video_idle_timeout) {
+        assert(params->video_idle_timeout > 0);
+        uint64_t ms = SC_TICK_TO_MS(params->video_idle_timeout);
+        ADD_PARAM("video_idle_timeout=%" PRIu64, ms);
+    }
+    if (params->video_mark_repeated_frames) {
+        ADD_PARAM("video_mark_repeated_frames=true");
+    }
     if (params->show_touches) {
         ADD_PARAM("show_touches=true");
     }
+    if (params->pointer_location) {
+        ADD_PARAM("pointer_location=true");
+    }
+    if (params->match_refresh_rate) {
+        ADD_PARAM("match_refresh_rate=true");
+    }
     if (params->stay_awake) {
         ADD_PARAM("stay_awake=true");
     }
@@ -376,9 +826,11 @@ execute_server(struct sc_server *server,
         VALIDATE_STRING(params->audio_codec_options);
         ADD_PARAM("audio_codec_options=%s", params->audio_codec_options);
     }
-    if (params->video_encoder) {
-        VALIDATE_STRING(params->video_encoder);
-        ADD_PARAM("video_encoder=%s", params->video_encoder);
+    const char *video_encoder = server->video_encoder ? server->video_encoder
+                                                      : params->video_encoder;
+    if (video_encoder) {
+        VALIDATE_STRING(video_encoder);
+        ADD_PARAM("video_encoder=%s", video_encoder);
     }
     if (params->audio_encoder) {
         VALIDATE_STRING(params->audio_encoder);
@@ -391,14 +843,26 @@ execute_server(struct sc_server *server,
         // By default, clipboard_autosync is true
         ADD_PARAM("clipboard_autosync=false");
     }
+#ifdef HAVE_ZLIB
+    if (params->control) {
+        // The client can decompress large device clipboard texts
+        ADD_PARAM("clipboard_compression=true");
+    }
+#endif
     if (!params->downsize_on_error) {
         // By default, downsize_on_error is true
         ADD_PARAM("downsize_on_error=false");
     }
+    if (server->max_size_cache_key) {
+        ADD_PARAM("notify_max_size=true");
+    }
     if (!params->cleanup) {
         // By default, cleanup is true
         ADD_PARAM("cleanup=false");
     }
+    if (server->keep_server_file) {
+        ADD_PARAM("keep_server_file=true");
+    }
     if (!params->power_on) {
         // By default, power_on is true
         ADD_PARAM("power_on=false");
@@ -407,6 +871,24 @@ execute_server(struct sc_server *server,
         VALIDATE_STRING(params->new_display);
         ADD_PARAM("new_display=%s", params->new_display);
     }
+    if (params->extra_display_count) {
+        assert(params->video);
+        assert(params->extra_display_count <= SC_MAX_EXTRA_DISPLAYS);
+        const char *tokens[SC_MAX_EXTRA_DISPLAYS + 1];
+        for (unsigned i = 0; i < params->extra_display_count; ++i) {
+            VALIDATE_STRING(params->extra_displays[i]);
+            tokens[i] = params->extra_displays[i];
+        }
+        tokens[params->extra_display_count] = NULL;
+        char extra_displays[256];
+        size_t len = sc_str_join(extra_displays, tokens, ',',
+                                 sizeof(extra_displays));
+        if (len >= sizeof(extra_displays)) {
+            LOGE("Extra display list too long");
+            goto end;
+        }
+        ADD_PARAM("extra_displays=%s", extra_displays);
+    }
     if (params->display_ime_policy != SC_DISPLAY_IME_POLICY_UNDEFINED) {
         ADD_PARAM("display_ime_policy=%s",
             sc_server_get_display_ime_policy_name(params->display_ime_policy));
@@ -417,6 +899,9 @@ execute_server(struct sc_server *server,
     if (!params->vd_system_decorations) {
         ADD_PARAM("vd_system_decorations=false");
     }
+    if (params->send_frame_timestamp) {
+        ADD_PARAM("send_frame_timestamp=true");
+    }
     if (params->list & SC_OPTION_LIST_ENCODERS) {
         ADD_PARAM("list_encoders=true");
     }
@@ -452,25 +937,78 @@ execute_server(struct sc_server *server,
     //     Port: 5005
     // Then click on "Debug"
 #endif
-    // Inherit both stdout and stderr (all server logs are printed to stdout)
-    pid = sc_adb_execute(cmd, 0);
+#ifdef HAVE_USB
+    if (params->adb_usb) {
+        // Skip "adb -s <serial> shell"
+        server->output.socket = sc_server_open_shell(server, &cmd[4]);
+        *pid = SC_PROCESS_NONE;
+        ok = server->output.socket != SC_SOCKET_NONE;
+        goto end;
+    }
+#endif
+
+    // Inherit stderr, and stdout unless it is relayed (all server logs are
+    // printed to stdout)
+    *pid = sc_adb_execute_p(cmd, 0, pout);
+    ok = *pid != SC_PROCESS_NONE;
 
 end:
     for (unsigned i = dyn_idx; i < count; ++i) {
         free((char *) cmd[i]);
     }
 
-    return pid;
+    return ok;
 }
 
-static bool
-connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
-                      uint32_t tunnel_host, uint16_t tunnel_port) {
-    bool ok = net_connect_intr(intr, socket, tunnel_host, tunnel_port);
-    if (!ok) {
-        return false;
+// Open a connection to the server (in forward tunnel mode)
+static sc_socket
+sc_server_connect_socket(struct sc_server *server, uint32_t host,
+                         uint16_t port, unsigned flags) {
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        char service[64];
+        int r = snprintf(service, sizeof(service), "localabstract:%s",
+                         server->device_socket_name);
+        assert(r > 0 && (size_t) r < sizeof(service));
+        (void) r;
+
+        return sc_adb_usb_open_stream(&server->adb_usb, service, flags);
+    }
+#else
+    (void) flags;
+#endif
+
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    if (!net_connect_intr(&server->intr, socket, host, port)) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    if (server->params.direct_tcp_port) {
+        // The server only accepts the connections starting with the token of
+        // the next socket
+        unsigned index = server->direct_tcp_socket_count;
+        assert(index < SC_DIRECT_TCP_MAX_SOCKETS);
+        const char *token =
+            &server->direct_tcp_tokens[index * SC_DIRECT_TCP_TOKEN_LENGTH];
+        ssize_t w = net_send_all_intr(&server->intr, socket, token,
+                                      SC_DIRECT_TCP_TOKEN_LENGTH);
+        if (w != SC_DIRECT_TCP_TOKEN_LENGTH) {
+            net_close(socket);
+            return SC_SOCKET_NONE;
+        }
+        ++server->direct_tcp_socket_count;
     }
 
+    return socket;
+}
+
+static bool
+read_first_byte(struct sc_intr *intr, sc_socket socket) {
     char byte;
     // the connection may succeed even if the server behind the "adb tunnel"
     // is not listening, so read one byte to detect a working connection
@@ -485,11 +1023,21 @@ connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
 static sc_socket
 connect_to_server(struct sc_server *server, unsigned attempts, sc_tick delay,
                   uint32_t host, uint16_t port) {
+    // The connection may only succeed once the server is listening, so wait
+    // for its notification rather than polling. On timeout (or if the server
+    // output is closed), fall back to connection attempts.
+    sc_tick ready_deadline = sc_tick_now() + SC_SERVER_READY_TIMEOUT;
+    if (!sc_server_wait_ready(server, ready_deadline)) {
+        LOGI("Connection attempt stopped");
+        return SC_SOCKET_NONE;
+    }
+
     do {
         LOGD("Remaining connection attempts: %u", attempts);
-        sc_socket socket = net_socket();
+        sc_socket socket =
+            sc_server_connect_socket(server, host, port, SC_ADB_SILENT);
         if (socket != SC_SOCKET_NONE) {
-            bool ok = connect_and_read_byte(&server->intr, socket, host, port);
+            bool ok = read_first_byte(&server->intr, socket);
             if (ok) {
                 // it worked!
                 return socket;
@@ -548,11 +1096,46 @@ sc_server_init(struct sc_server *server, const struct sc_server_params *params,
         return false;
     }
 
+#ifdef HAVE_USB
+    if (params->adb_usb) {
+        ok = sc_adb_usb_init(&server->adb_usb);
+        if (!ok) {
+            sc_intr_destroy(&server->intr);
+            sc_cond_destroy(&server->cond_stopped);
+            sc_mutex_destroy(&server->mutex);
+            sc_adb_destroy();
+            return false;
+        }
+    }
+#endif
+
     server->serial = NULL;
     server->device_socket_name = NULL;
+    server->fingerprint = NULL;
+    server->video_encoder = NULL;
+    server->encoder_cache_key = NULL;
+    server->max_size = 0;
+    server->max_size_cache_key = NULL;
     server->stopped = false;
+    server->disconnected = false;
+    server->connection = 0;
+    server->audio_disabled = false;
+    server->output.socket = SC_SOCKET_NONE;
+    server->direct_tcp_host = 0;
+    server->direct_tcp_tokens[0] = '\0';
+    server->direct_tcp_socket_count = 0;
+    server->auto_tunnel_direct_tcp_port =
+        params->auto_tunnel ? params->direct_tcp_port : 0;
+    server->tunnel_benchmark = false;
+    server->keep_server_file = false;
+    server->output.ready = false;
+    server->output.closed = false;
 
     server->video_socket = SC_SOCKET_NONE;
+    server->record_socket = SC_SOCKET_NONE;
+    for (unsigned i = 0; i < SC_MAX_EXTRA_DISPLAYS; ++i) {
+        server->extra_display_sockets[i] = SC_SOCKET_NONE;
+    }
     server->audio_socket = SC_SOCKET_NONE;
     server->control_socket = SC_SOCKET_NONE;
 
@@ -585,20 +1168,41 @@ device_read_info(struct sc_intr *intr, sc_socket device_socket,
     return true;
 }
 
+static void
+sc_server_close_tunnel(struct sc_server *server) {
+    if (sc_server_is_tunnelless(server)) {
+        server->tunnel.enabled = false;
+        return;
+    }
+
+    sc_adb_tunnel_close(&server->tunnel, &server->intr, server->serial,
+                        server->device_socket_name);
+}
+
 static bool
 sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     struct sc_adb_tunnel *tunnel = &server->tunnel;
 
     assert(tunnel->enabled);
-
-    const char *serial = server->serial;
-    assert(serial);
+    assert(server->serial);
 
     bool video = server->params.video;
+    bool record = server->params.record_stream;
+    unsigned extra_count = server->params.extra_display_count;
     bool audio = server->params.audio;
     bool control = server->params.control;
 
+    // The record stream and the extra displays are additional video streams
+    assert(!record || video);
+    assert(!extra_count || video);
+    assert(extra_count <= SC_MAX_EXTRA_DISPLAYS);
+
     sc_socket video_socket = SC_SOCKET_NONE;
+    sc_socket record_socket = SC_SOCKET_NONE;
+    sc_socket extra_sockets[SC_MAX_EXTRA_DISPLAYS];
+    for (unsigned i = 0; i < SC_MAX_EXTRA_DISPLAYS; ++i) {
+        extra_sockets[i] = SC_SOCKET_NONE;
+    }
     sc_socket audio_socket = SC_SOCKET_NONE;
     sc_socket control_socket = SC_SOCKET_NONE;
     if (!tunnel->forward) {
@@ -608,6 +1212,23 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             if (video_socket == SC_SOCKET_NONE) {
                 goto fail;
             }
+            sc_startup_timing_mark(SC_STARTUP_PHASE_VIDEO_SOCKET);
+        }
+
+        if (record) {
+            record_socket =
+                net_accept_intr(&server->intr, tunnel->server_socket);
+            if (record_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+        }
+
+        for (unsigned i = 0; i < extra_count; ++i) {
+            extra_sockets[i] =
+                net_accept_intr(&server->intr, tunnel->server_socket);
+            if (extra_sockets[i] == SC_SOCKET_NONE) {
+                goto fail;
+            }
         }
 
         if (audio) {
@@ -616,6 +1237,7 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             if (audio_socket == SC_SOCKET_NONE) {
                 goto fail;
             }
+            sc_startup_timing_mark(SC_STARTUP_PHASE_AUDIO_SOCKET);
         }
 
         if (control) {
@@ -624,14 +1246,20 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             if (control_socket == SC_SOCKET_NONE) {
                 goto fail;
             }
+            sc_startup_timing_mark(SC_STARTUP_PHASE_CONTROL_SOCKET);
         }
     } else {
         uint32_t tunnel_host = server->params.tunnel_host;
+        uint16_t tunnel_port = server->params.tunnel_port;
+        if (server->params.direct_tcp_port) {
+            tunnel_host = server->direct_tcp_host;
+            tunnel_port = server->params.direct_tcp_port;
+        }
+
         if (!tunnel_host) {
             tunnel_host = IPV4_LOCALHOST;
         }
 
-        uint16_t tunnel_port = server->params.tunnel_port;
         if (!tunnel_port) {
             tunnel_port = tunnel->local_port;
         }
@@ -646,38 +1274,75 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
 
         if (video) {
             video_socket = first_socket;
+            sc_startup_timing_mark(SC_STARTUP_PHASE_VIDEO_SOCKET);
+        }
+
+        if (record) {
+            // The video socket is always the first socket
+            record_socket = sc_server_connect_socket(server, tunnel_host,
+                                                     tunnel_port, 0);
+            if (record_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+        }
+
+        for (unsigned i = 0; i < extra_count; ++i) {
+            extra_sockets[i] = sc_server_connect_socket(server, tunnel_host,
+                                                        tunnel_port, 0);
+            if (extra_sockets[i] == SC_SOCKET_NONE) {
+                goto fail;
+            }
         }
 
         if (audio) {
             if (!video) {
                 audio_socket = first_socket;
             } else {
-                audio_socket = net_socket();
+                audio_socket = sc_server_connect_socket(server, tunnel_host,
+                                                        tunnel_port, 0);
                 if (audio_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, audio_socket,
-                                           tunnel_host, tunnel_port);
-                if (!ok) {
-                    goto fail;
-                }
             }
+            sc_startup_timing_mark(SC_STARTUP_PHASE_AUDIO_SOCKET);
         }
 
         if (control) {
             if (!video && !audio) {
                 control_socket = first_socket;
             } else {
-                control_socket = net_socket();
+                control_socket = sc_server_connect_socket(server, tunnel_host,
+                                                          tunnel_port, 0);
                 if (control_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, control_socket,
-                                           tunnel_host, tunnel_port);
-                if (!ok) {
-                    goto fail;
-                }
             }
+            sc_startup_timing_mark(SC_STARTUP_PHASE_CONTROL_SOCKET);
+        }
+    }
+
+    if (video_socket != SC_SOCKET_NONE) {
+        uint32_t buffer_size = server->params.video_socket_buffer_size;
+        if (buffer_size) {
+            // A larger buffer avoids throttling the bursts of large keyframes
+            bool ok = net_set_recv_buffer_size(video_socket, buffer_size);
+            (void) ok; // error already logged
+
+            if (record_socket != SC_SOCKET_NONE) {
+                ok = net_set_recv_buffer_size(record_socket, buffer_size);
+                (void) ok; // error already logged
+            }
+
+            for (unsigned i = 0; i < extra_count; ++i) {
+                ok = net_set_recv_buffer_size(extra_sockets[i], buffer_size);
+                (void) ok; // error already logged
+            }
+        }
+
+        uint32_t busy_poll = server->params.video_socket_busy_poll;
+        if (busy_poll) {
+            bool ok = net_set_busy_poll(video_socket, busy_poll);
+            (void) ok; // error already logged
         }
     }
 
@@ -690,8 +1355,7 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     }
 
     // we don't need the adb tunnel anymore
-    sc_adb_tunnel_close(tunnel, &server->intr, serial,
-                        server->device_socket_name);
+    sc_server_close_tunnel(server);
 
     sc_socket first_socket = video ? video_socket
                            : audio ? audio_socket
@@ -702,14 +1366,25 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     if (!ok) {
         goto fail;
     }
+    sc_startup_timing_mark(SC_STARTUP_PHASE_DEVICE_INFO);
 
     assert(!video || video_socket != SC_SOCKET_NONE);
+    assert(!record || record_socket != SC_SOCKET_NONE);
+    for (unsigned i = 0; i < extra_count; ++i) {
+        assert(extra_sockets[i] != SC_SOCKET_NONE);
+    }
     assert(!audio || audio_socket != SC_SOCKET_NONE);
     assert(!control || control_socket != SC_SOCKET_NONE);
 
+    sc_mutex_lock(&server->mutex);
     server->video_socket = video_socket;
+    server->record_socket = record_socket;
+    for (unsigned i = 0; i < extra_count; ++i) {
+        server->extra_display_sockets[i] = extra_sockets[i];
+    }
     server->audio_socket = audio_socket;
     server->control_socket = control_socket;
+    sc_mutex_unlock(&server->mutex);
 
     return true;
 
@@ -720,6 +1395,20 @@ fail:
         }
     }
 
+    if (record_socket != SC_SOCKET_NONE) {
+        if (!net_close(record_socket)) {
+            LOGW("Could not close record socket");
+        }
+    }
+
+    for (unsigned i = 0; i < extra_count; ++i) {
+        if (extra_sockets[i] != SC_SOCKET_NONE) {
+            if (!net_close(extra_sockets[i])) {
+                LOGW("Could not close extra display socket");
+            }
+        }
+    }
+
     if (audio_socket != SC_SOCKET_NONE) {
         if (!net_close(audio_socket)) {
             LOGW("Could not close audio socket");
@@ -734,8 +1423,7 @@ fail:
 
     if (tunnel->enabled) {
         // Always leave this function with tunnel disabled
-        sc_adb_tunnel_close(tunnel, &server->intr, serial,
-                            server->device_socket_name);
+        sc_server_close_tunnel(server);
     }
 
     return false;
@@ -751,12 +1439,38 @@ sc_server_on_terminated(void *userdata) {
     // stop() (it is safe to call interrupt() twice).
     sc_intr_interrupt(&server->intr);
 
+    if (server->tunnel_benchmark) {
+        // Expected, the benchmark server exits once the tunnel is measured
+        LOGD("Tunnel benchmark server terminated");
+        return;
+    }
+
+    if (server->params.reconnect) {
+        sc_mutex_lock(&server->mutex);
+        server->disconnected = true;
+        sc_cond_broadcast(&server->cond_stopped);
+        sc_mutex_unlock(&server->mutex);
+    }
+
     server->cbs->on_disconnected(server, server->cbs_userdata);
 
     LOGD("Server terminated");
 }
 
-static uint16_t
+#ifdef HAVE_USB
+// With params.adb_usb, the server terminates when its shell stream is closed
+static int
+run_server_shell(void *data) {
+    struct sc_server *server = data;
+
+    sc_server_relay_output(server);
+    sc_server_on_terminated(server);
+
+    return 0;
+}
+#endif
+
+static uint16_t
 get_adb_tcp_port(struct sc_server *server, const char *serial) {
     struct sc_intr *intr = &server->intr;
 
@@ -937,11 +1651,752 @@ sc_server_kill_adb_if_requested(struct sc_server *server) {
     }
 }
 
-static int
-run_server(void *data) {
-    struct sc_server *server = data;
+// Must be called once the server process is terminated (so that the pipe is
+// closed on the write side)
+static void
+sc_server_join_output(struct sc_server *server) {
+    sc_thread_join(&server->output.thread, NULL);
+    sc_pipe_close(server->output.pipe);
+}
+
+// Return the device build fingerprint (read only once), or NULL if it is not
+// available
+static const char *
+sc_server_get_fingerprint(struct sc_server *server) {
+    if (!server->fingerprint) {
+        char *fingerprint =
+            sc_server_getprop(server, "ro.build.fingerprint");
+        if (fingerprint && !*fingerprint) {
+            free(fingerprint);
+            fingerprint = NULL;
+        }
+        server->fingerprint = fingerprint;
+    }
+
+    return server->fingerprint;
+}
+
+// Use the video encoder selected by a previous benchmark on the same device
+// build, or prepare to cache the result of the benchmark
+static void
+sc_server_prepare_encoder_benchmark(struct sc_server *server) {
+    const char *fingerprint = sc_server_get_fingerprint(server);
+    if (!fingerprint) {
+        LOGW("Could not get the device build fingerprint, the video encoder "
+             "benchmark result will not be cached");
+        return;
+    }
+
+    const char *codec = sc_server_get_codec_name(server->params.video_codec);
+    char *key;
+    int r = asprintf(&key, "%s %s", fingerprint, codec);
+    if (r == -1) {
+        LOG_OOM();
+        return;
+    }
+
+    char *encoder = sc_device_cache_get(key);
+    if (encoder) {
+        LOGI("Using the video encoder selected by a previous benchmark: %s",
+             encoder);
+        server->video_encoder = encoder;
+        free(key);
+        return;
+    }
+
+    server->encoder_cache_key = key;
+}
+
+// Use the max size selected by downsizing on a previous encoding error on the
+// same device build, to avoid failing again before the first frame, or prepare
+// to cache it
+static void
+sc_server_prepare_max_size_cache(struct sc_server *server) {
+    const struct sc_server_params *params = &server->params;
+
+    // Only use the fingerprint if it has already been read (do not delay the
+    // startup only for this)
+    const char *fingerprint = server->fingerprint;
+    if (!fingerprint) {
+        return;
+    }
+
+    const char *codec = sc_server_get_codec_name(params->video_codec);
+    const char *encoder = params->video_encoder ? params->video_encoder
+                                                : "default";
+    char *key;
+    int r = asprintf(&key, "%s %s %s max-size", fingerprint, codec, encoder);
+    if (r == -1) {
+        LOG_OOM();
+        return;
+    }
+
+    char *value = sc_device_cache_get(key);
+    if (value) {
+        long max_size;
+        bool ok = sc_str_parse_integer(value, &max_size);
+        free(value);
+        if (ok && max_size > 0 && max_size <= 0xFFFF) {
+            if (!params->max_size || max_size < params->max_size) {
+                LOGI("Using the max size selected on a previous encoding "
+                     "error: %ld", max_size);
+                server->max_size = max_size;
+            }
+            free(key);
+            return;
+        }
+    }
+
+    server->max_size_cache_key = key;
+}
+
+// Resolve the device IPv4 address for the direct TCP connections
+static bool
+sc_server_resolve_direct_tcp_host(struct sc_server *server) {
+    char *ip = sc_adb_get_device_ip(&server->intr, server->serial, 0);
+    if (!ip) {
+        LOGE("Could not find the device IP address (required by "
+             "--direct-tcp)");
+        return false;
+    }
+
+    bool ok = net_parse_ipv4(ip, &server->direct_tcp_host);
+    if (ok) {
+        LOGD("Direct TCP connection to %s:%" PRIu16, ip,
+             server->params.direct_tcp_port);
+    }
+    free(ip);
+    return ok;
+}
+
+// Generate the one-time tokens authenticating the direct TCP connections
+//
+// The tokens are sent in clear, so each socket has its own token: a token
+// sniffed on the network is useless to open another socket.
+static bool
+sc_server_generate_direct_tcp_tokens(struct sc_server *server) {
+    char *tokens = server->direct_tcp_tokens;
+    size_t len = SC_DIRECT_TCP_MAX_SOCKETS * SC_DIRECT_TCP_TOKEN_LENGTH;
+
+    // 4 random bits per hexadecimal digit
+    uint8_t bytes[SC_DIRECT_TCP_MAX_SOCKETS * SC_DIRECT_TCP_TOKEN_LENGTH / 2];
+    // Predictable tokens would authenticate nothing
+    if (!sc_random_bytes(bytes, sizeof(bytes))) {
+        LOGE("Could not generate the direct TCP tokens");
+        return false;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        tokens[2 * i] = digits[bytes[i] >> 4];
+        tokens[2 * i + 1] = digits[bytes[i] & 0xF];
+    }
+    tokens[len] = '\0';
+    server->direct_tcp_socket_count = 0;
+
+    return true;
+}
+
+// A running server process (with params.reconnect, there is one per
+// connection)
+struct sc_server_process {
+    sc_pid pid;
+    struct sc_process_observer observer;
+    bool relay_output;
+};
+
+// Open the tunnel, execute the server and connect to it
+static bool
+sc_server_run_process(struct sc_server *server, bool encoder_benchmark,
+                      struct sc_server_info *info,
+                      struct sc_server_process *process) {
+    const struct sc_server_params *params = &server->params;
+    const char *serial = server->serial;
+
+    bool ok;
+    if (params->direct_tcp_port) {
+        // The device IP address may change between reconnections
+        ok = sc_server_resolve_direct_tcp_host(server);
+        if (!ok) {
+            return false;
+        }
+
+        // New tokens for each server execution
+        ok = sc_server_generate_direct_tcp_tokens(server);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (sc_server_is_tunnelless(server)) {
+        // No adb tunnel: the client connects to the server (which listens)
+        server->tunnel.enabled = true;
+        server->tunnel.forward = true;
+    } else {
+        ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, serial,
+                                server->device_socket_name, params->port_range,
+                                params->force_adb_forward);
+        if (!ok) {
+            return false;
+        }
+    }
+    sc_startup_timing_mark(SC_STARTUP_PHASE_TUNNEL_OPEN);
+
+    // In forward tunnel mode, relay the server output to know when it listens
+    // (and to retrieve the video encoder benchmark result or the max size)
+    bool relay_output = server->tunnel.forward || encoder_benchmark
+                     || server->max_size_cache_key;
+
+    sc_mutex_lock(&server->mutex);
+    server->output.ready = false;
+    server->output.closed = false;
+    sc_mutex_unlock(&server->mutex);
+
+    // server will connect to our server socket
+    sc_pid pid;
+    ok = execute_server(server, params,
+                        relay_output ? &server->output.pipe : NULL, &pid);
+    if (!ok) {
+        sc_server_close_tunnel(server);
+        return false;
+    }
+    sc_startup_timing_mark(SC_STARTUP_PHASE_SERVER_EXECUTED);
+
+#ifdef HAVE_USB
+    if (params->adb_usb) {
+        // The shell stream thread also detects the server termination (there
+        // is no process to observe)
+        ok = sc_thread_create(&server->output.thread, run_server_shell,
+                              "scrcpy-server-sh", server);
+        if (!ok) {
+            LOGE("Could not start server shell thread");
+            net_close(server->output.socket);
+            server->output.socket = SC_SOCKET_NONE;
+            sc_server_close_tunnel(server);
+            return false;
+        }
+
+        ok = sc_server_connect_to(server, info);
+        // The tunnel is always closed by server_connect_to()
+        if (!ok) {
+            // Closing the shell stream kills the server
+            net_interrupt(server->output.socket);
+            sc_thread_join(&server->output.thread, NULL);
+            net_close(server->output.socket);
+            server->output.socket = SC_SOCKET_NONE;
+            return false;
+        }
+
+        process->pid = SC_PROCESS_NONE;
+        process->relay_output = true;
+        return true;
+    }
+#endif
+
+    if (relay_output) {
+        ok = sc_thread_create(&server->output.thread, run_server_output,
+                              "scrcpy-server-out", server);
+        if (!ok) {
+            LOGE("Could not start server output thread");
+            sc_pipe_close(server->output.pipe);
+            sc_process_terminate(pid);
+            sc_process_wait(pid, true); // ignore exit code
+            sc_server_close_tunnel(server);
+            return false;
+        }
+    }
+
+    static const struct sc_process_listener listener = {
+        .on_terminated = sc_server_on_terminated,
+    };
+    ok = sc_process_observer_init(&process->observer, pid, &listener, server);
+    if (!ok) {
+        sc_process_terminate(pid);
+        sc_process_wait(pid, true); // ignore exit code
+        if (relay_output) {
+            sc_server_join_output(server);
+        }
+        sc_server_close_tunnel(server);
+        return false;
+    }
+
+    ok = sc_server_connect_to(server, info);
+    // The tunnel is always closed by server_connect_to()
+    if (!ok) {
+        sc_process_terminate(pid);
+        sc_process_wait(pid, true); // ignore exit code
+        sc_process_observer_join(&process->observer);
+        sc_process_observer_destroy(&process->observer);
+        if (relay_output) {
+            sc_server_join_output(server);
+        }
+        return false;
+    }
+
+    process->pid = pid;
+    process->relay_output = relay_output;
+    return true;
+}
+
+static void
+sc_server_terminate_process(struct sc_server *server,
+                            struct sc_server_process *process) {
+    // Interrupt sockets to wake up socket blocking calls on the server
+    // (with params.reconnect, they may be released concurrently)
+    sc_mutex_lock(&server->mutex);
+
+    if (server->video_socket != SC_SOCKET_NONE) {
+        // There is no video_socket if --no-video is set
+        net_interrupt(server->video_socket);
+    }
+
+    if (server->record_socket != SC_SOCKET_NONE) {
+        net_interrupt(server->record_socket);
+    }
+
+    for (unsigned i = 0; i < SC_MAX_EXTRA_DISPLAYS; ++i) {
+        if (server->extra_display_sockets[i] != SC_SOCKET_NONE) {
+            net_interrupt(server->extra_display_sockets[i]);
+        }
+    }
+
+    if (server->audio_socket != SC_SOCKET_NONE) {
+        // There is no audio_socket if --no-audio is set
+        net_interrupt(server->audio_socket);
+    }
+
+    if (server->control_socket != SC_SOCKET_NONE) {
+        // There is no control_socket if --no-control is set
+        net_interrupt(server->control_socket);
+    }
+
+    sc_mutex_unlock(&server->mutex);
+
+    // Give some delay for the server to terminate properly
+#define WATCHDOG_DELAY SC_TICK_FROM_SEC(1)
+    sc_tick deadline = sc_tick_now() + WATCHDOG_DELAY;
+
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        if (!sc_server_wait_output_closed(server, deadline)) {
+            // Closing the shell stream kills the server
+            LOGW("Killing the server...");
+            net_interrupt(server->output.socket);
+        }
+
+        sc_thread_join(&server->output.thread, NULL);
+        net_close(server->output.socket);
+        server->output.socket = SC_SOCKET_NONE;
+        return;
+    }
+#endif
+
+    bool terminated =
+        sc_process_observer_timedwait(&process->observer, deadline);
+
+    // After this delay, kill the server if it's not dead already.
+    // On some devices, closing the sockets is not sufficient to wake up the
+    // blocking calls while the device is asleep.
+    if (!terminated) {
+        // The process may have terminated since the check, but it is not
+        // reaped (closed) yet, so its PID is still valid, and it is ok to call
+        // sc_process_terminate() even in that case.
+        LOGW("Killing the server...");
+        sc_process_terminate(process->pid);
+    }
+
+    sc_process_observer_join(&process->observer);
+    sc_process_observer_destroy(&process->observer);
+
+    if (process->relay_output) {
+        sc_server_join_output(server);
+    }
+
+    sc_process_close(process->pid);
+}
+
+enum sc_tunnel_mode {
+    SC_TUNNEL_MODE_REVERSE,
+    SC_TUNNEL_MODE_FORWARD,
+    SC_TUNNEL_MODE_DIRECT_TCP,
+};
+
+static const char *const sc_tunnel_mode_names[] = {
+    [SC_TUNNEL_MODE_REVERSE] = "reverse",
+    [SC_TUNNEL_MODE_FORWARD] = "forward",
+    [SC_TUNNEL_MODE_DIRECT_TCP] = "direct-tcp",
+};
+
+struct sc_tunnel_measure {
+    sc_tick rtt;
+    uint64_t throughput; // in bytes per second
+};
+
+static void
+sc_server_set_tunnel_mode(struct sc_server *server, enum sc_tunnel_mode mode) {
+    server->params.force_adb_forward = mode == SC_TUNNEL_MODE_FORWARD;
+    assert(mode != SC_TUNNEL_MODE_DIRECT_TCP
+            || server->auto_tunnel_direct_tcp_port);
+    server->params.direct_tcp_port = mode == SC_TUNNEL_MODE_DIRECT_TCP
+                                   ? server->auto_tunnel_direct_tcp_port : 0;
+}
+
+static bool
+sc_server_measure_tunnel(struct sc_server *server, sc_socket socket,
+                         struct sc_tunnel_measure *measure) {
+    struct sc_intr *intr = &server->intr;
+
+    // Keep the minimum round-trip time, the other ones include scheduling
+    // delays
+    sc_tick rtt = 0;
+    for (unsigned i = 0; i < SC_TUNNEL_BENCHMARK_PINGS; ++i) {
+        char cmd = 'p';
+        sc_tick start = sc_tick_now();
+        if (net_send_all_intr(intr, socket, &cmd, 1) != 1
+                || net_recv_all_intr(intr, socket, &cmd, 1) != 1) {
+            return false;
+        }
+        sc_tick elapsed = sc_tick_now() - start;
+        if (!i || elapsed < rtt) {
+            rtt = elapsed;
+        }
+    }
+
+    char cmd = 'b';
+    sc_tick start = sc_tick_now();
+    if (net_send_all_intr(intr, socket, &cmd, 1) != 1) {
+        return false;
+    }
+
+    char buf[64 * 1024];
+    size_t remaining = SC_TUNNEL_BENCHMARK_BURST_SIZE;
+    while (remaining) {
+        size_t len = MIN(remaining, sizeof(buf));
+        ssize_t r = net_recv_intr(intr, socket, buf, len);
+        if (r <= 0) {
+            return false;
+        }
+        remaining -= r;
+    }
+
+    // Do not count the request
+    sc_tick elapsed = sc_tick_now() - start - rtt;
+    if (elapsed <= 0) {
+        elapsed = 1;
+    }
+
+    measure->rtt = rtt;
+    measure->throughput =
+        (uint64_t) SC_TUNNEL_BENCHMARK_BURST_SIZE * SC_TICK_FREQ / elapsed;
+    return true;
+}
+
+// Execute the server only to measure the given tunnel mode
+static bool
+sc_server_benchmark_tunnel_mode(struct sc_server *server,
+                                enum sc_tunnel_mode mode,
+                                struct sc_tunnel_measure *measure) {
+    sc_server_set_tunnel_mode(server, mode);
+
+    // The benchmark server only opens a single connection
+    struct sc_server_params saved_params = server->params;
+    server->params.video = true;
+    server->params.record_stream = false;
+    server->params.extra_display_count = 0;
+    server->params.audio = false;
+    server->params.control = false;
+    server->tunnel_benchmark = true;
+
+    struct sc_server_info info;
+    struct sc_server_process process;
+    bool ok = sc_server_run_process(server, false, &info, &process);
+    if (ok) {
+        if (mode == SC_TUNNEL_MODE_REVERSE && server->tunnel.forward) {
+            // "adb reverse" failed, the tunnel fell back to "adb forward"
+            LOGD("Tunnel mode reverse not available");
+            ok = false;
+        } else {
+            ok = sc_server_measure_tunnel(server, server->video_socket,
+                                          measure);
+        }
+
+        sc_server_terminate_process(server, &process);
+        net_close(server->video_socket);
+        server->video_socket = SC_SOCKET_NONE;
+    }
+
+    server->tunnel_benchmark = false;
+    server->params = saved_params;
+
+    // The server termination has interrupted the pending calls
+    sc_mutex_lock(&server->mutex);
+    bool stopped = server->stopped;
+    if (!stopped) {
+        sc_intr_reset(&server->intr);
+    }
+    sc_mutex_unlock(&server->mutex);
+
+    return ok && !stopped;
+}
+
+// Use the tunnel mode selected by a previous benchmark for the same device
+// build and transport, or benchmark them (and cache the result)
+static void
+sc_server_select_tunnel_mode(struct sc_server *server) {
+    enum sc_adb_device_type type = sc_adb_device_get_type(server->serial);
+    const char *transport = type == SC_ADB_DEVICE_TYPE_TCPIP ? "tcpip"
+                          : type == SC_ADB_DEVICE_TYPE_EMULATOR ? "emulator"
+                                                                : "usb";
+
+    // The direct TCP connection is never selected unless explicitly allowed
+    // (it is not encrypted): it is only relevant (and likely to be reachable)
+    // if the device is already connected over TCP/IP
+    bool direct_tcp = server->auto_tunnel_direct_tcp_port
+                   && type == SC_ADB_DEVICE_TYPE_TCPIP;
+
+    char *key = NULL;
+    const char *fingerprint = sc_server_get_fingerprint(server);
+    if (fingerprint) {
+        // The result depends on the candidates
+        int r = asprintf(&key, "%s tunnel %s%s", fingerprint, transport,
+                         direct_tcp ? " direct-tcp" : "");
+        if (r == -1) {
+            LOG_OOM();
+            key = NULL;
+        }
+    } else {
+        LOGW("Could not get the device build fingerprint, the tunnel "
+             "benchmark result will not be cached");
+    }
+
+    if (key) {
+        char *name = sc_device_cache_get(key);
+        if (name) {
+            for (unsigned i = 0; i < ARRAY_LEN(sc_tunnel_mode_names); ++i) {
+                if (i == SC_TUNNEL_MODE_DIRECT_TCP && !direct_tcp) {
+                    continue;
+                }
+                if (!strcmp(name, sc_tunnel_mode_names[i])) {
+                    LOGI("Using the tunnel mode selected by a previous "
+                         "benchmark: %s", name);
+                    sc_server_set_tunnel_mode(server, i);
+                    free(name);
+                    free(key);
+                    return;
+                }
+            }
+            free(name);
+        }
+    }
+
+    enum sc_tunnel_mode candidates[3];
+    unsigned count = 0;
+    candidates[count++] = SC_TUNNEL_MODE_REVERSE;
+    candidates[count++] = SC_TUNNEL_MODE_FORWARD;
+    if (direct_tcp) {
+        candidates[count++] = SC_TUNNEL_MODE_DIRECT_TCP;
+    }
+
+    LOGI("Benchmarking the tunnel modes...");
+
+    bool found = false;
+    enum sc_tunnel_mode best_mode = SC_TUNNEL_MODE_REVERSE;
+    sc_tick best_delay = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        enum sc_tunnel_mode mode = candidates[i];
+        struct sc_tunnel_measure measure;
+        if (!sc_server_benchmark_tunnel_mode(server, mode, &measure)) {
+            if (sc_intr_is_interrupted(&server->intr)) {
+                // stopped
+                free(key);
+                return;
+            }
+            LOGW("Could not measure the tunnel mode %s",
+                 sc_tunnel_mode_names[mode]);
+            continue;
+        }
+
+        sc_tick transfer = (sc_tick) SC_TUNNEL_BENCHMARK_FRAME_SIZE
+                         * SC_TICK_FREQ / measure.throughput;
+        sc_tick delay = measure.rtt / 2 + transfer;
+        LOGI("Tunnel mode %s: %" PRIu64 " KiB/s, RTT %" PRItick " us",
+             sc_tunnel_mode_names[mode], measure.throughput / 1024,
+             SC_TICK_TO_US(measure.rtt));
+
+        if (!found || delay < best_delay) {
+            found = true;
+            best_mode = mode;
+            best_delay = delay;
+        }
+    }
+
+    sc_server_set_tunnel_mode(server, best_mode);
+
+    if (!found) {
+        LOGW("Tunnel benchmark failed, using the default tunnel mode");
+        free(key);
+        return;
+    }
+
+    const char *name = sc_tunnel_mode_names[best_mode];
+    LOGI("Tunnel mode selected by the benchmark: %s", name);
+    if (key) {
+        if (sc_device_cache_put(key, name)) {
+            LOGD("Tunnel benchmark result cached: %s", name);
+        }
+        free(key);
+    }
+}
+
+static bool
+sc_server_has_socket_locked(struct sc_server *server) {
+    if (server->video_socket != SC_SOCKET_NONE
+            || server->record_socket != SC_SOCKET_NONE
+            || server->audio_socket != SC_SOCKET_NONE
+            || server->control_socket != SC_SOCKET_NONE) {
+        return true;
+    }
+
+    for (unsigned i = 0; i < SC_MAX_EXTRA_DISPLAYS; ++i) {
+        if (server->extra_display_sockets[i] != SC_SOCKET_NONE) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Wait until all the sockets of the lost connection are released by their
+// users, then prepare for a new connection
+static bool
+sc_server_prepare_reconnection(struct sc_server *server) {
+    sc_mutex_lock(&server->mutex);
+    while (!server->stopped && sc_server_has_socket_locked(server)) {
+        sc_cond_wait(&server->cond_stopped, &server->mutex);
+    }
+    bool stopped = server->stopped;
+    if (!stopped) {
+        server->disconnected = false;
+        if (server->audio_disabled) {
+            server->params.audio = false;
+        }
+        // No concurrent interruption: sc_server_stop() locks the mutex, and
+        // the previous server process is terminated
+        sc_intr_reset(&server->intr);
+    }
+    sc_mutex_unlock(&server->mutex);
+
+    return !stopped;
+}
+
+// Restart the server on the same device, until connected or stopped
+static bool
+sc_server_reconnect(struct sc_server *server,
+                    struct sc_server_process *process) {
+    const struct sc_server_params *params = &server->params;
+    const char *serial = server->serial;
+
+#define RECONNECTION_DELAY SC_TICK_FROM_SEC(1)
+    for (;;) {
+        if (!sc_server_prepare_reconnection(server)) {
+            return false;
+        }
+
+        LOGD("Reconnecting to %s...", serial);
+
+        if (params->tcpip) {
+            // The device may have been disconnected from adb (ignore errors,
+            // it may also still be connected)
+            sc_adb_connect(&server->intr, serial, SC_ADB_SILENT);
+        }
+
+#ifdef HAVE_USB
+        if (params->adb_usb && !sc_adb_usb_is_connected(&server->adb_usb)) {
+            // The device has been unplugged, open it again once it is back
+            sc_adb_usb_disconnect(&server->adb_usb);
+            sc_adb_usb_connect(&server->adb_usb, serial, SC_ADB_SILENT);
+        }
+#endif
+
+        // Do not try anything (and print adb errors) until the device is back
+        char *fingerprint = sc_server_getprop(server, "ro.build.fingerprint");
+        if (fingerprint) {
+            free(fingerprint);
+
+            // The server is not pushed again if it is still on the device
+            fingerprint = NULL;
+            bool ok = push_server(server, &fingerprint);
+            free(fingerprint);
+
+            if (ok && server->encoder_cache_key && !server->video_encoder) {
+                // Use the encoder selected by the benchmark run on the first
+                // connection, if it succeeded
+                server->video_encoder =
+                    sc_device_cache_get(server->encoder_cache_key);
+            }
+            bool encoder_benchmark = params->video && params->video_encoder
+                && !strcmp(params->video_encoder,
+                           SC_VIDEO_ENCODER_AUTO_BENCHMARK)
+                && !server->video_encoder;
+
+            // Only the device info of the first connection is exposed
+            struct sc_server_info info;
+            if (ok && sc_server_run_process(server, encoder_benchmark, &info,
+                                            process)) {
+                LOGI("Reconnected");
+                sc_mutex_lock(&server->mutex);
+                ++server->connection;
+                sc_cond_broadcast(&server->cond_stopped);
+                sc_mutex_unlock(&server->mutex);
+                return true;
+            }
+        }
+
+        sc_tick deadline = sc_tick_now() + RECONNECTION_DELAY;
+        if (!sc_server_sleep(server, deadline)) {
+            return false;
+        }
+    }
+}
 
+#ifdef HAVE_USB
+static bool
+sc_server_open_adb_usb(struct sc_server *server) {
     const struct sc_server_params *params = &server->params;
+    struct sc_adb_usb *au = &server->adb_usb;
+
+    const char *serial = params->req_serial;
+    if (!serial) {
+        serial = getenv("ANDROID_SERIAL");
+        if (serial) {
+            LOGI("Using ANDROID_SERIAL: %s", serial);
+        }
+    }
+
+    if (!sc_adb_usb_connect(au, serial, 0)) {
+        return false;
+    }
+
+    server->serial = strdup(au->serial);
+    if (!server->serial) {
+        LOG_OOM();
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+// Select the device, and store its serial to server->serial
+static bool
+sc_server_select_device(struct sc_server *server) {
+    const struct sc_server_params *params = &server->params;
+
+#ifdef HAVE_USB
+    if (params->adb_usb) {
+        return sc_server_open_adb_usb(server);
+    }
+#endif
 
     // Execute "adb start-server" before "adb devices" so that daemon starting
     // output/errors is correctly printed in the console ("adb devices" output
@@ -949,8 +2404,9 @@ run_server(void *data) {
     bool ok = sc_adb_start_server(&server->intr, 0);
     if (!ok) {
         LOGE("Could not start adb server");
-        goto error_connection_failed;
+        return false;
     }
+    sc_startup_timing_mark(SC_STARTUP_PHASE_ADB_SERVER);
 
     // params->tcpip_dst implies params->tcpip
     assert(!params->tcpip_dst || params->tcpip);
@@ -992,7 +2448,7 @@ run_server(void *data) {
         struct sc_adb_device device;
         ok = sc_adb_select_device(&server->intr, &selector, 0, &device);
         if (!ok) {
-            goto error_connection_failed;
+            return false;
         }
 
         if (params->tcpip) {
@@ -1001,7 +2457,7 @@ run_server(void *data) {
                                                            device.serial);
             sc_adb_device_destroy(&device);
             if (!ok) {
-                goto error_connection_failed;
+                return false;
             }
             assert(server->serial);
         } else {
@@ -1020,33 +2476,73 @@ run_server(void *data) {
         }
         ok = sc_server_configure_tcpip_known_address(server, tcpip_dst, plus);
         if (!ok) {
-            goto error_connection_failed;
+            return false;
         }
     }
 
+    return true;
+}
+
+static int
+run_server(void *data) {
+    struct sc_server *server = data;
+
+    const struct sc_server_params *params = &server->params;
+
+    bool ok = sc_server_select_device(server);
+    if (!ok) {
+        goto error_connection_failed;
+    }
+
     const char *serial = server->serial;
     assert(serial);
     LOGD("Device serial: %s", serial);
+    sc_startup_timing_mark(SC_STARTUP_PHASE_DEVICE_SELECTED);
 
-    ok = push_server(&server->intr, serial);
+    ok = push_server(server, &server->fingerprint);
     if (!ok) {
         goto error_connection_failed;
     }
+    sc_startup_timing_mark(SC_STARTUP_PHASE_SERVER_PUSHED);
 
     // If --list-* is passed, then the server just prints the requested data
     // then exits.
     if (params->list) {
-        sc_pid pid = execute_server(server, params);
-        if (pid == SC_PROCESS_NONE) {
+        sc_pid pid;
+        ok = execute_server(server, params, NULL, &pid);
+        if (!ok) {
             goto error_connection_failed;
         }
-        sc_process_wait(pid, NULL); // ignore exit code
-        sc_process_close(pid);
+#ifdef HAVE_USB
+        if (params->adb_usb) {
+            // Print the output until the shell stream is closed
+            sc_server_relay_output(server);
+            net_close(server->output.socket);
+            server->output.socket = SC_SOCKET_NONE;
+        } else
+#endif
+        {
+            sc_process_wait(pid, NULL); // ignore exit code
+            sc_process_close(pid);
+        }
         // Wake up await_for_server()
         server->cbs->on_connected(server, server->cbs_userdata);
         return 0;
     }
 
+    bool encoder_benchmark = params->video && params->video_encoder
+        && !strcmp(params->video_encoder, SC_VIDEO_ENCODER_AUTO_BENCHMARK);
+    if (encoder_benchmark) {
+        sc_server_prepare_encoder_benchmark(server);
+        // If the encoder is cached, no benchmark is needed
+        encoder_benchmark = !server->video_encoder;
+    }
+
+    if (params->video && params->downsize_on_error
+            && params->video_source == SC_VIDEO_SOURCE_DISPLAY) {
+        sc_server_prepare_max_size_cache(server);
+    }
+
     int r = asprintf(&server->device_socket_name, SC_SOCKET_NAME_PREFIX "%08x",
                      params->scid);
     if (r == -1) {
@@ -1056,92 +2552,45 @@ run_server(void *data) {
     assert(r == sizeof(SC_SOCKET_NAME_PREFIX) - 1 + 8);
     assert(server->device_socket_name);
 
-    ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name, params->port_range,
-                            params->force_adb_forward);
-    if (!ok) {
-        goto error_connection_failed;
-    }
-
-    // server will connect to our server socket
-    sc_pid pid = execute_server(server, params);
-    if (pid == SC_PROCESS_NONE) {
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
-        goto error_connection_failed;
+    if (params->auto_tunnel) {
+        sc_server_select_tunnel_mode(server);
     }
 
-    static const struct sc_process_listener listener = {
-        .on_terminated = sc_server_on_terminated,
-    };
-    struct sc_process_observer observer;
-    ok = sc_process_observer_init(&observer, pid, &listener, server);
+    struct sc_server_process process;
+    ok = sc_server_run_process(server, encoder_benchmark, &server->info,
+                               &process);
     if (!ok) {
-        sc_process_terminate(pid);
-        sc_process_wait(pid, true); // ignore exit code
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
-        goto error_connection_failed;
-    }
-
-    ok = sc_server_connect_to(server, &server->info);
-    // The tunnel is always closed by server_connect_to()
-    if (!ok) {
-        sc_process_terminate(pid);
-        sc_process_wait(pid, true); // ignore exit code
-        sc_process_observer_join(&observer);
-        sc_process_observer_destroy(&observer);
         goto error_connection_failed;
     }
 
     // Now connected
     server->cbs->on_connected(server, server->cbs_userdata);
 
-    // Wait for server_stop()
-    sc_mutex_lock(&server->mutex);
-    while (!server->stopped) {
-        sc_cond_wait(&server->cond_stopped, &server->mutex);
-    }
-    sc_mutex_unlock(&server->mutex);
-
-    // Interrupt sockets to wake up socket blocking calls on the server
-
-    if (server->video_socket != SC_SOCKET_NONE) {
-        // There is no video_socket if --no-video is set
-        net_interrupt(server->video_socket);
-    }
+    for (;;) {
+        // Wait for server_stop() (or a disconnection, with params.reconnect)
+        sc_mutex_lock(&server->mutex);
+        while (!server->stopped && !server->disconnected) {
+            sc_cond_wait(&server->cond_stopped, &server->mutex);
+        }
+        bool stopped = server->stopped;
+        sc_mutex_unlock(&server->mutex);
 
-    if (server->audio_socket != SC_SOCKET_NONE) {
-        // There is no audio_socket if --no-audio is set
-        net_interrupt(server->audio_socket);
-    }
+        sc_server_terminate_process(server, &process);
 
-    if (server->control_socket != SC_SOCKET_NONE) {
-        // There is no control_socket if --no-control is set
-        net_interrupt(server->control_socket);
-    }
+        if (stopped) {
+            break;
+        }
 
-    // Give some delay for the server to terminate properly
-#define WATCHDOG_DELAY SC_TICK_FROM_SEC(1)
-    sc_tick deadline = sc_tick_now() + WATCHDOG_DELAY;
-    bool terminated = sc_process_observer_timedwait(&observer, deadline);
+        // The benchmark has already been run, if any
+        ok = sc_server_reconnect(server, &process);
+        if (!ok) {
+            // stopped
+            break;
+        }
 
-    // After this delay, kill the server if it's not dead already.
-    // On some devices, closing the sockets is not sufficient to wake up the
-    // blocking calls while the device is asleep.
-    if (!terminated) {
-        // The process may have terminated since the check, but it is not
-        // reaped (closed) yet, so its PID is still valid, and it is ok to call
-        // sc_process_terminate() even in that case.
-        LOGW("Killing the server...");
-        sc_process_terminate(pid);
+        server->cbs->on_connected(server, server->cbs_userdata);
     }
 
-    sc_process_observer_join(&observer);
-    sc_process_observer_destroy(&observer);
-
-    sc_process_close(pid);
-
     sc_server_kill_adb_if_requested(server);
 
     return 0;
@@ -1168,9 +2617,81 @@ void
 sc_server_stop(struct sc_server *server) {
     sc_mutex_lock(&server->mutex);
     server->stopped = true;
-    sc_cond_signal(&server->cond_stopped);
+    sc_cond_broadcast(&server->cond_stopped);
     sc_intr_interrupt(&server->intr);
     sc_mutex_unlock(&server->mutex);
+
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        // Wake up the authentication or the opening of a stream
+        sc_adb_usb_interrupt(&server->adb_usb);
+    }
+#endif
+}
+
+static bool
+sc_server_release_socket_locked(struct sc_server *server, sc_socket *socket) {
+    assert(socket == &server->video_socket
+        || socket == &server->record_socket
+        || (socket >= server->extra_display_sockets
+            && socket < server->extra_display_sockets
+                      + SC_MAX_EXTRA_DISPLAYS)
+        || socket == &server->audio_socket
+        || socket == &server->control_socket);
+
+    if (*socket != SC_SOCKET_NONE) {
+        if (!net_close(*socket)) {
+            LOGW("Could not close socket");
+        }
+        *socket = SC_SOCKET_NONE;
+        sc_cond_broadcast(&server->cond_stopped);
+        return true;
+    }
+
+    return false;
+}
+
+void
+sc_server_release_socket(struct sc_server *server, sc_socket *socket) {
+    assert(server->params.reconnect);
+
+    sc_mutex_lock(&server->mutex);
+    if (sc_server_release_socket_locked(server, socket)) {
+        // A stream has ended, so the connection is lost (if it was not
+        // detected yet)
+        server->disconnected = true;
+    }
+    sc_mutex_unlock(&server->mutex);
+}
+
+sc_socket
+sc_server_await_socket(struct sc_server *server, sc_socket *socket) {
+    assert(server->params.reconnect);
+
+    sc_mutex_lock(&server->mutex);
+    unsigned connection = server->connection;
+    if (sc_server_release_socket_locked(server, socket)) {
+        server->disconnected = true;
+    }
+    while (!server->stopped && server->connection == connection) {
+        sc_cond_wait(&server->cond_stopped, &server->mutex);
+    }
+    sc_socket new_socket = server->stopped ? SC_SOCKET_NONE : *socket;
+    sc_mutex_unlock(&server->mutex);
+
+    return new_socket;
+}
+
+void
+sc_server_disable_audio(struct sc_server *server) {
+    assert(server->params.reconnect);
+
+    sc_mutex_lock(&server->mutex);
+    bool released =
+        sc_server_release_socket_locked(server, &server->audio_socket);
+    (void) released; // the connection is not lost
+    server->audio_disabled = true;
+    sc_mutex_unlock(&server->mutex);
 }
 
 void
@@ -1183,6 +2704,14 @@ sc_server_destroy(struct sc_server *server) {
     if (server->video_socket != SC_SOCKET_NONE) {
         net_close(server->video_socket);
     }
+    if (server->record_socket != SC_SOCKET_NONE) {
+        net_close(server->record_socket);
+    }
+    for (unsigned i = 0; i < SC_MAX_EXTRA_DISPLAYS; ++i) {
+        if (server->extra_display_sockets[i] != SC_SOCKET_NONE) {
+            net_close(server->extra_display_sockets[i]);
+        }
+    }
     if (server->audio_socket != SC_SOCKET_NONE) {
         net_close(server->audio_socket);
     }
@@ -1192,6 +2721,15 @@ sc_server_destroy(struct sc_server *server) {
 
     free(server->serial);
     free(server->device_socket_name);
+    free(server->fingerprint);
+    free(server->video_encoder);
+    free(server->encoder_cache_key);
+    free(server->max_size_cache_key);
+#ifdef HAVE_USB
+    if (server->params.adb_usb) {
+        sc_adb_usb_destroy(&server->adb_usb);
+    }
+#endif
     sc_intr_destroy(&server->intr);
     sc_cond_destroy(&server->cond_stopped);
     sc_mutex_destroy(&server->mutex);
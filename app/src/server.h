@@ -10,10 +10,25 @@
 #include "options.h"
 #include "util/intr.h"
 #include "util/net.h"
+#include "util/process.h"
 #include "util/thread.h"
 #include "util/tick.h"
+#ifdef HAVE_USB
+# include "adb/adb_usb.h"
+#endif
 
 #define SC_DEVICE_NAME_FIELD_LENGTH 64
+
+// Hexadecimal token (128 bits) authenticating a direct TCP connection
+#define SC_DIRECT_TCP_TOKEN_LENGTH 32
+// Each direct TCP socket has its own token: video, record, extra displays,
+// audio and control
+#define SC_DIRECT_TCP_MAX_SOCKETS (SC_MAX_EXTRA_DISPLAYS + 4)
+
+// Value of --video-encoder to select the encoder by benchmarking them all on
+// the device (the result is cached for the device build)
+#define SC_VIDEO_ENCODER_AUTO_BENCHMARK "auto-benchmark"
+
 struct sc_server_info {
     char device_name[SC_DEVICE_NAME_FIELD_LENGTH];
 };
@@ -23,6 +38,10 @@ struct sc_server_params {
     const char *req_serial;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
+    // If video_codec is SC_CODEC_AUTO, the codecs the client can decode, from
+    // the preferred one (the device selects the first one it can encode)
+    enum sc_codec video_codec_candidates[SC_VIDEO_CODEC_COUNT];
+    unsigned video_codec_candidate_count;
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
     enum sc_audio_source audio_source;
@@ -39,8 +58,15 @@ struct sc_server_params {
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    // If non-zero, the client connects to the server on this device TCP port
+    // directly (adb is only used to start the server)
+    uint16_t direct_tcp_port;
     uint16_t max_size;
     uint32_t video_bit_rate;
+    uint16_t record_max_size; // for the record stream
+    uint32_t record_video_bit_rate; // for the record stream
+    uint32_t video_socket_buffer_size;
+    uint32_t video_socket_busy_poll;
     uint32_t audio_bit_rate;
     const char *max_fps; // float to be parsed by the server
     const char *angle; // float to be parsed by the server
@@ -50,13 +76,21 @@ struct sc_server_params {
     bool control;
     uint32_t display_id;
     const char *new_display;
+    const char *const *extra_displays; // extra_display_count items
+    unsigned extra_display_count;
     enum sc_display_ime_policy display_ime_policy;
     bool video;
+    bool record_stream; // a separate video stream for recording
     bool audio;
     bool audio_dup;
     bool show_touches;
+    bool pointer_location;
+    bool match_refresh_rate;
     bool stay_awake;
     bool force_adb_forward;
+    // Select the fastest tunnel mode (measured on the first connection to the
+    // device, then cached)
+    bool auto_tunnel;
     bool power_off_on_close;
     bool clipboard_autosync;
     bool downsize_on_error;
@@ -67,9 +101,22 @@ struct sc_server_params {
     bool cleanup;
     bool power_on;
     bool kill_adb_on_close;
+#ifdef HAVE_USB
+    bool adb_usb; // talk to adbd over USB directly, without the adb server
+#endif
     bool camera_high_speed;
+    bool video_low_latency;
+    uint16_t video_intra_refresh;
+    enum sc_video_bit_rate_mode video_bit_rate_mode;
+    int8_t video_quality;
+    uint32_t video_max_bit_rate;
+    uint16_t input_pacing; // in milliseconds
+    sc_tick video_idle_timeout;
+    bool video_mark_repeated_frames;
     bool vd_destroy_content;
     bool vd_system_decorations;
+    bool send_frame_timestamp;
+    bool reconnect;
     uint8_t list;
 };
 
@@ -79,17 +126,71 @@ struct sc_server {
     char *serial;
     char *device_socket_name;
 
+    char *fingerprint; // the device build fingerprint, may be NULL
+
+    // For --video-encoder=auto-benchmark
+    char *video_encoder; // selected by a previous benchmark, may be NULL
+    char *encoder_cache_key; // to cache the benchmark result, may be NULL
+
+    // For downsizing on error
+    uint16_t max_size; // selected on a previous error, 0 if none
+    char *max_size_cache_key; // to cache the selected max size, may be NULL
+
     sc_thread thread;
     struct sc_server_info info; // initialized once connected
 
     sc_mutex mutex;
+    // Also broadcast when the output state, the sockets or the connection
+    // change
     sc_cond cond_stopped;
     bool stopped;
 
+    // For params.reconnect (protected by mutex)
+    bool disconnected; // the current connection is lost
+    unsigned connection; // incremented on each reconnection
+    bool audio_disabled; // do not request audio anymore on reconnection
+
+    // In forward tunnel mode, the server output is relayed to detect when the
+    // server is listening
+    struct {
+        sc_thread thread;
+        sc_pipe pipe;
+        // With params.adb_usb, the server is executed by a shell stream
+        // instead of an adb process (its output is always relayed)
+        sc_socket socket;
+        bool ready; // protected by mutex
+        bool closed; // protected by mutex
+    } output;
+
     struct sc_intr intr;
     struct sc_adb_tunnel tunnel;
 
+    // For params.direct_tcp_port
+    uint32_t direct_tcp_host; // the device IPv4 address
+    // The one-time tokens of the successive sockets, concatenated
+    char direct_tcp_tokens[SC_DIRECT_TCP_MAX_SOCKETS
+                               * SC_DIRECT_TCP_TOKEN_LENGTH + 1];
+    unsigned direct_tcp_socket_count; // the number of tokens already used
+
+    // For params.auto_tunnel, the direct TCP port if --direct-tcp explicitly
+    // allows to select the direct TCP connection (0 otherwise)
+    uint16_t auto_tunnel_direct_tcp_port;
+
+    // For params.auto_tunnel, the server is only executed to measure the
+    // tunnel (not protected: only accessed by the server thread, and by the
+    // process observer while it is running)
+    bool tunnel_benchmark;
+
+    // The hash of the pushed server is recorded on the device, so the server
+    // must not delete its own file on cleanup (it is reused on the next start)
+    bool keep_server_file;
+#ifdef HAVE_USB
+    struct sc_adb_usb adb_usb; // only initialized if params.adb_usb
+#endif
+
     sc_socket video_socket;
+    sc_socket record_socket; // for the separate record stream, if any
+    sc_socket extra_display_sockets[SC_MAX_EXTRA_DISPLAYS];
     sc_socket audio_socket;
     sc_socket control_socket;
 
@@ -108,6 +209,8 @@ struct sc_server_callbacks {
 
     /**
      * Called on server connection
+     *
+     * With params.reconnect, it is also called on each reconnection.
      */
     void (*on_connected)(struct sc_server *server, void *userdata);
 
@@ -130,6 +233,23 @@ sc_server_start(struct sc_server *server);
 void
 sc_server_stop(struct sc_server *server);
 
+// With params.reconnect, close a socket once the connection is lost: the server
+// reconnects once all the sockets of the previous connection are released
+void
+sc_server_release_socket(struct sc_server *server, sc_socket *socket);
+
+// Release a socket (see above) and wait for the reconnection
+//
+// Return the socket of the new connection, or SC_SOCKET_NONE if the server is
+// stopped.
+sc_socket
+sc_server_await_socket(struct sc_server *server, sc_socket *socket);
+
+// Release the audio socket when the audio is disabled by the device, and do not
+// request audio anymore on reconnection
+void
+sc_server_disable_audio(struct sc_server *server);
+
 // join the server thread
 void
 sc_server_join(struct sc_server *server);
@@ -0,0 +1,76 @@
+#ifndef SC_SHM_FRAME_H
+#define SC_SHM_FRAME_H
+
+/**
+ * Layout of the shared memory published by scrcpy --shm-sink=NAME
+ *
+ * This header does not depend on any other scrcpy header, so that it can be
+ * included directly by the consumers (it is installed as
+ * <scrcpy/shm_frame.h>).
+ *
+ * The shared memory is named NAME (on Unix, it is the POSIX shared memory
+ * object "/NAME", see shm_open(); on Windows, it is the file mapping NAME,
+ * see OpenFileMapping()). It contains:
+ *  - a struct sc_shm_frame_header, at offset 0;
+ *  - slot_count slots of slot_size bytes, starting at slots_offset.
+ *
+ * Each slot starts with a struct sc_shm_frame_slot, describing the frame
+ * stored in the slot. The pixels are stored in the same slot, at
+ * plane_offsets[i] (relative to the start of the slot) for each plane i.
+ *
+ * The frames are written into the slots in a circular way: the frame having
+ * the sequence number n is stored in the slot (n % slot_count). A reader only
+ * reads (without any copy), so it never blocks scrcpy: if it is too slow, it
+ * just misses frames.
+ *
+ * The fields latest_seq and seq are written by scrcpy with release semantics,
+ * so they must be read with acquire semantics (e.g. atomic_load_explicit()
+ * with memory_order_acquire, or __atomic_load_n() with __ATOMIC_ACQUIRE).
+ *
+ * To read the last frame:
+ *  1. n = latest_seq (acquire); if n == 0, there is no frame yet;
+ *  2. slot = slots_offset + (n % slot_count) * slot_size;
+ *  3. if slot->seq (acquire) != n, the slot is being overwritten, retry;
+ *  4. read the frame;
+ *  5. issue an acquire fence, then if slot->seq != n, the slot has been
+ *     overwritten during the read, and the frame must be discarded.
+ *
+ * When scrcpy stops, it sets closed to 1.
+ */
+
+#include <stdint.h>
+
+#define SC_SHM_FRAME_MAGIC "SCRCPYFR" // 8 bytes, not nul-terminated
+#define SC_SHM_FRAME_VERSION 1
+
+enum sc_shm_frame_format {
+    // 3 planes: Y, U and V (U and V are subsampled 2x2)
+    SC_SHM_FRAME_FORMAT_YUV420P = 1,
+    // 2 planes: Y and interleaved UV (subsampled 2x2)
+    SC_SHM_FRAME_FORMAT_NV12 = 2,
+};
+
+struct sc_shm_frame_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_size; // in bytes, including the slot header
+    uint64_t slots_offset; // offset of the first slot
+    uint64_t latest_seq; // sequence number of the last frame, 0 if none
+    uint32_t closed; // 1 once scrcpy has stopped
+    uint32_t reserved;
+};
+
+struct sc_shm_frame_slot {
+    uint64_t seq; // sequence number of the frame, 0 while it is written
+    int64_t pts; // presentation timestamp, in microseconds
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // enum sc_shm_frame_format
+    uint32_t plane_count;
+    uint32_t strides[4]; // in bytes
+    uint64_t plane_offsets[4]; // relative to the start of the slot
+    uint64_t size; // total size of the planes, in bytes
+};
+
+#endif
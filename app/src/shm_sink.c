@@ -0,0 +1,256 @@
+#include "shm_sink.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/imgutils.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_shm_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_shm_sink, frame_sink)
+
+// A reader has the time of (slot count - 1) frames to read a frame before it
+// is overwritten
+#define SC_SHM_SINK_SLOT_COUNT 3
+
+// Keep the pixels aligned (for SIMD code of the consumers)
+#define SC_SHM_SINK_ALIGN 64
+#define SC_SHM_SINK_ALIGNED(x) \
+    (((x) + SC_SHM_SINK_ALIGN - 1) / SC_SHM_SINK_ALIGN * SC_SHM_SINK_ALIGN)
+
+#define SC_SHM_SINK_HEADER_SIZE \
+    SC_SHM_SINK_ALIGNED(sizeof(struct sc_shm_frame_header))
+#define SC_SHM_SINK_SLOT_HEADER_SIZE \
+    SC_SHM_SINK_ALIGNED(sizeof(struct sc_shm_frame_slot))
+
+// The public header declares plain integers (so that it does not require C11
+// atomics), they are accessed with the compiler atomic builtins
+static inline void
+sc_shm_store_release(uint64_t *p, uint64_t value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static inline void
+sc_shm_store_relaxed(uint64_t *p, uint64_t value) {
+    __atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+
+struct sc_shm_sink_layout {
+    enum sc_shm_frame_format format;
+    enum AVPixelFormat pix_fmt;
+    unsigned plane_count;
+    uint32_t strides[4];
+    uint64_t offsets[4]; // relative to the pixels start
+    uint64_t size;
+};
+
+static void
+sc_shm_sink_get_layout(const AVFrame *frame,
+                       struct sc_shm_sink_layout *layout) {
+    uint32_t w = frame->width;
+    uint32_t h = frame->height;
+    uint32_t chroma_w = (w + 1) / 2;
+    uint32_t chroma_h = (h + 1) / 2;
+    uint64_t luma_size = (uint64_t) w * h;
+
+    memset(layout, 0, sizeof(*layout));
+
+    if (frame->format == AV_PIX_FMT_NV12) {
+        // Published as is
+        layout->format = SC_SHM_FRAME_FORMAT_NV12;
+        layout->pix_fmt = AV_PIX_FMT_NV12;
+        layout->plane_count = 2;
+        layout->strides[0] = w;
+        layout->strides[1] = chroma_w * 2;
+        layout->offsets[1] = luma_size;
+        layout->size = luma_size + (uint64_t) chroma_w * 2 * chroma_h;
+        return;
+    }
+
+    // Any other format is published (converted if necessary) as YUV420P
+    layout->format = SC_SHM_FRAME_FORMAT_YUV420P;
+    layout->pix_fmt = AV_PIX_FMT_YUV420P;
+    layout->plane_count = 3;
+    layout->strides[0] = w;
+    layout->strides[1] = chroma_w;
+    layout->strides[2] = chroma_w;
+    layout->offsets[1] = luma_size;
+    layout->offsets[2] = luma_size + (uint64_t) chroma_w * chroma_h;
+    layout->size = luma_size + (uint64_t) chroma_w * chroma_h * 2;
+}
+
+static bool
+sc_shm_sink_write_pixels(struct sc_shm_sink *ss, uint8_t *pixels,
+                         const AVFrame *frame,
+                         const struct sc_shm_sink_layout *layout) {
+    uint8_t *dst_data[4] = {0};
+    int dst_linesize[4] = {0};
+    for (unsigned i = 0; i < layout->plane_count; ++i) {
+        dst_data[i] = pixels + layout->offsets[i];
+        dst_linesize[i] = layout->strides[i];
+    }
+
+    if (frame->format == layout->pix_fmt) {
+        av_image_copy(dst_data, dst_linesize, (const uint8_t **) frame->data,
+                      frame->linesize, layout->pix_fmt, frame->width,
+                      frame->height);
+        return true;
+    }
+
+    bool ok = sc_frame_converter_convert(&ss->converter, frame, dst_data,
+                                         dst_linesize, layout->pix_fmt,
+                                         frame->width, frame->height,
+                                         SWS_POINT);
+    if (!ok) {
+        LOGE("Could not convert the shm pixel format");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_shm_sink_open(struct sc_shm_sink *ss, const AVCodecContext *ctx) {
+    // The frame size changes on device rotation: reserve enough space for
+    // both orientations
+    uint64_t max_dim = MAX(ctx->width, ctx->height);
+    uint64_t chroma_dim = (max_dim + 1) / 2;
+    uint64_t max_pixels_size = max_dim * max_dim + chroma_dim * chroma_dim * 2;
+    uint64_t slot_size =
+        SC_SHM_SINK_ALIGNED(SC_SHM_SINK_SLOT_HEADER_SIZE + max_pixels_size);
+    uint64_t size = SC_SHM_SINK_HEADER_SIZE
+                  + slot_size * SC_SHM_SINK_SLOT_COUNT;
+    if (size > SIZE_MAX) {
+        LOGE("Shared memory too large");
+        return false;
+    }
+
+    if (!sc_frame_converter_init(&ss->converter)) {
+        return false;
+    }
+
+    if (!sc_shm_create(&ss->shm, ss->name, size)) {
+        sc_frame_converter_destroy(&ss->converter);
+        return false;
+    }
+
+    struct sc_shm_frame_header *header = ss->shm.data;
+    memcpy(header->magic, SC_SHM_FRAME_MAGIC, sizeof(header->magic));
+    header->version = SC_SHM_FRAME_VERSION;
+    header->slot_count = SC_SHM_SINK_SLOT_COUNT;
+    header->slot_size = slot_size;
+    header->slots_offset = SC_SHM_SINK_HEADER_SIZE;
+    sc_shm_store_release(&header->latest_seq, 0);
+
+    ss->header = header;
+    ss->seq = 0;
+    ss->too_large_logged = false;
+
+    LOGI("Shared memory frame sink started: %s", ss->name);
+
+    return true;
+}
+
+static void
+sc_shm_sink_close(struct sc_shm_sink *ss) {
+    __atomic_store_n(&ss->header->closed, 1, __ATOMIC_RELEASE);
+
+    sc_frame_converter_destroy(&ss->converter);
+    sc_shm_destroy(&ss->shm);
+}
+
+static bool
+sc_shm_sink_push(struct sc_shm_sink *ss, const AVFrame *frame) {
+    struct sc_shm_frame_header *header = ss->header;
+
+    struct sc_shm_sink_layout layout;
+    sc_shm_sink_get_layout(frame, &layout);
+
+    if (SC_SHM_SINK_SLOT_HEADER_SIZE + layout.size > header->slot_size) {
+        // The video size has increased since the sink was opened
+        if (!ss->too_large_logged) {
+            LOGW("Frame too large for the shared memory (%dx%d), skipped",
+                 frame->width, frame->height);
+            ss->too_large_logged = true;
+        }
+        return true;
+    }
+
+    uint64_t seq = ++ss->seq;
+    uint8_t *base = (uint8_t *) header + header->slots_offset
+                  + (seq % header->slot_count) * header->slot_size;
+    struct sc_shm_frame_slot *slot = (struct sc_shm_frame_slot *) base;
+    uint8_t *pixels = base + SC_SHM_SINK_SLOT_HEADER_SIZE;
+
+    // Mark the slot as being written, before writing anything (like a
+    // seqlock, a reader detects that the slot has changed during its read)
+    sc_shm_store_relaxed(&slot->seq, 0);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (!sc_shm_sink_write_pixels(ss, pixels, frame, &layout)) {
+        return false;
+    }
+
+    slot->pts = frame->pts;
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->format = layout.format;
+    slot->plane_count = layout.plane_count;
+    for (unsigned i = 0; i < 4; ++i) {
+        slot->strides[i] = layout.strides[i];
+        slot->plane_offsets[i] = i < layout.plane_count
+                               ? SC_SHM_SINK_SLOT_HEADER_SIZE
+                                    + layout.offsets[i]
+                               : 0;
+    }
+    slot->size = layout.size;
+
+    // Publish the frame
+    sc_shm_store_release(&slot->seq, seq);
+    sc_shm_store_release(&header->latest_seq, seq);
+
+    return true;
+}
+
+static bool
+sc_shm_frame_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    return sc_shm_sink_open(ss, ctx);
+}
+
+static void
+sc_shm_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    sc_shm_sink_close(ss);
+}
+
+static bool
+sc_shm_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    return sc_shm_sink_push(ss, frame);
+}
+
+bool
+sc_shm_sink_init(struct sc_shm_sink *ss, const char *name) {
+    ss->name = strdup(name);
+    if (!ss->name) {
+        LOG_OOM();
+        return false;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_shm_frame_sink_open,
+        .close = sc_shm_frame_sink_close,
+        .push = sc_shm_frame_sink_push,
+    };
+
+    ss->frame_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_shm_sink_destroy(struct sc_shm_sink *ss) {
+    free(ss->name);
+}
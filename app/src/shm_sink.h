@@ -0,0 +1,41 @@
+#ifndef SC_SHM_SINK_H
+#define SC_SHM_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_converter.h"
+#include "shm_frame.h"
+#include "trait/frame_sink.h"
+#include "util/shm.h"
+
+/**
+ * Frame sink publishing the decoded frames into a shared memory ring, for
+ * local consumers (see shm_frame.h for the layout)
+ *
+ * The frames are written synchronously, so it is expected to be fed by a frame
+ * queue running on its own thread.
+ */
+struct sc_shm_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    char *name;
+    struct sc_shm shm;
+    struct sc_shm_frame_header *header; // at the start of the shared memory
+    uint64_t seq; // sequence number of the last written frame
+
+    // Only used to convert the frames in other formats than YUV420P or NV12
+    struct sc_frame_converter converter;
+    bool too_large_logged;
+};
+
+bool
+sc_shm_sink_init(struct sc_shm_sink *ss, const char *name);
+
+void
+sc_shm_sink_destroy(struct sc_shm_sink *ss);
+
+#endif
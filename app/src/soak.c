@@ -0,0 +1,257 @@
+#include "soak.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+#include "util/process.h"
+
+bool
+sc_soak_monitor_init(struct sc_soak_monitor *monitor,
+                     struct sc_metrics *metrics, sc_tick interval) {
+    assert(metrics);
+    assert(interval > 0);
+
+    monitor->series = calloc(SC_METRICS_CAPACITY, sizeof(*monitor->series));
+    if (!monitor->series) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&monitor->mutex);
+    if (!ok) {
+        goto error_free_series;
+    }
+
+    ok = sc_cond_init(&monitor->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    for (unsigned i = 0; i < SC_METRICS_CAPACITY; ++i) {
+        sc_trend_init(&monitor->series[i].value);
+        sc_trend_init(&monitor->series[i].p99);
+    }
+
+    uint64_t value;
+    monitor->rss_metric = NULL;
+    if (sc_process_get_rss(&value)) {
+        monitor->rss_metric =
+            sc_metrics_register_gauge(metrics, "scrcpy_process_rss_bytes",
+                                      "Resident set size of the process");
+    } else {
+        LOGW("Soak: the process memory is not supported on this platform");
+    }
+
+    monitor->allocated_metric = NULL;
+    if (sc_process_get_allocated(&value)) {
+        monitor->allocated_metric =
+            sc_metrics_register_gauge(metrics,
+                                      "scrcpy_process_allocated_bytes",
+                                      "Bytes allocated on the heap");
+    }
+
+    monitor->metrics = metrics;
+    monitor->interval = interval;
+    monitor->stopped = false;
+    monitor->samples = 0;
+
+    return true;
+
+error_destroy_mutex:
+    sc_mutex_destroy(&monitor->mutex);
+error_free_series:
+    free(monitor->series);
+
+    return false;
+}
+
+void
+sc_soak_monitor_destroy(struct sc_soak_monitor *monitor) {
+    sc_cond_destroy(&monitor->cond);
+    sc_mutex_destroy(&monitor->mutex);
+    free(monitor->series);
+}
+
+// Upper bound of the bucket containing the 99th percentile
+static int64_t
+sc_soak_get_p99(const struct sc_metric *metric, const uint64_t *counts,
+                uint64_t total) {
+    assert(total);
+    uint64_t rank = total - total / 100;
+    uint64_t cumulative = 0;
+    for (unsigned i = 0; i < metric->bound_count; ++i) {
+        cumulative += counts[i];
+        if (cumulative >= rank) {
+            return metric->bounds[i];
+        }
+    }
+
+    // +Inf bucket: use the largest finite bound
+    return metric->bounds[metric->bound_count - 1];
+}
+
+static void
+sc_soak_sample_histogram(struct sc_soak_series *series,
+                         const struct sc_metric *metric) {
+    // Only the values observed since the previous sample
+    uint64_t counts[SC_METRIC_MAX_BOUNDS + 1];
+    uint64_t total = 0;
+    for (unsigned i = 0; i <= metric->bound_count; ++i) {
+        uint64_t bucket = atomic_load_explicit(&metric->buckets[i],
+                                               memory_order_relaxed);
+        counts[i] = bucket - series->last_buckets[i];
+        series->last_buckets[i] = bucket;
+        total += counts[i];
+    }
+
+    int64_t sum = atomic_load_explicit(&metric->value, memory_order_relaxed);
+    int64_t delta = sum - series->last_sum;
+    series->last_sum = sum;
+
+    if (!total) {
+        // Nothing observed during this interval
+        return;
+    }
+
+    sc_trend_push(&series->value, (double) delta / total);
+    sc_trend_push(&series->p99, sc_soak_get_p99(metric, counts, total));
+}
+
+static void
+sc_soak_monitor_sample(struct sc_soak_monitor *monitor) {
+    uint64_t value;
+    if (monitor->rss_metric && sc_process_get_rss(&value)) {
+        sc_metric_set(monitor->rss_metric, value);
+    }
+    if (monitor->allocated_metric && sc_process_get_allocated(&value)) {
+        sc_metric_set(monitor->allocated_metric, value);
+    }
+
+    struct sc_metrics *metrics = monitor->metrics;
+    unsigned count = atomic_load_explicit(&metrics->count,
+                                          memory_order_acquire);
+    for (unsigned i = 0; i < count; ++i) {
+        const struct sc_metric *metric = &metrics->metrics[i];
+        struct sc_soak_series *series = &monitor->series[i];
+        switch (metric->type) {
+            case SC_METRIC_TYPE_GAUGE: {
+                int64_t v = atomic_load_explicit(&metric->value,
+                                                 memory_order_relaxed);
+                sc_trend_push(&series->value, v);
+                break;
+            }
+            case SC_METRIC_TYPE_HISTOGRAM:
+                sc_soak_sample_histogram(series, metric);
+                break;
+            default:
+                // The counters always grow
+                break;
+        }
+    }
+
+    ++monitor->samples;
+}
+
+static bool
+sc_soak_report_trend(const struct sc_trend *trend, const char *name,
+                     const char *suffix) {
+    struct sc_trend_result result;
+    if (!sc_trend_analyze(trend, &result)
+            || !sc_trend_is_growing(&result)) {
+        return false;
+    }
+
+    LOGW("Soak: %s%s grew steadily: %.0f -> %.0f (tau %.2f)", name, suffix,
+         result.first, result.last, result.tau);
+    return true;
+}
+
+static void
+sc_soak_monitor_report(struct sc_soak_monitor *monitor) {
+    LOGI("Soak: %u samples over %" PRItick " seconds", monitor->samples,
+         SC_TICK_TO_SEC(monitor->samples * monitor->interval));
+
+    if (monitor->samples < SC_TREND_MIN_POINTS) {
+        LOGW("Soak: session too short to analyze the trends");
+        return;
+    }
+
+    bool growth = false;
+    struct sc_metrics *metrics = monitor->metrics;
+    unsigned count = atomic_load_explicit(&metrics->count,
+                                          memory_order_acquire);
+    for (unsigned i = 0; i < count; ++i) {
+        const char *name = metrics->metrics[i].name;
+        struct sc_soak_series *series = &monitor->series[i];
+        // Do not short-circuit, report all the growths
+        growth |= sc_soak_report_trend(&series->value, name, "");
+        growth |= sc_soak_report_trend(&series->p99, name, " (p99)");
+    }
+
+    if (!growth) {
+        LOGI("Soak: no steady growth detected");
+    }
+}
+
+static int
+run_soak_monitor(void *data) {
+    struct sc_soak_monitor *monitor = data;
+
+    sc_tick deadline = sc_tick_now() + monitor->interval;
+
+    sc_mutex_lock(&monitor->mutex);
+    for (;;) {
+        while (!monitor->stopped && sc_tick_now() < deadline) {
+            // ignore the reason (timeout or signaled), we just loop anyway
+            sc_cond_timedwait(&monitor->cond, &monitor->mutex, deadline);
+        }
+        if (monitor->stopped) {
+            break;
+        }
+        sc_mutex_unlock(&monitor->mutex);
+
+        sc_soak_monitor_sample(monitor);
+
+        sc_mutex_lock(&monitor->mutex);
+
+        deadline += monitor->interval;
+        sc_tick now = sc_tick_now();
+        if (deadline < now) {
+            // Do not try to catch up
+            deadline = now + monitor->interval;
+        }
+    }
+    sc_mutex_unlock(&monitor->mutex);
+
+    return 0;
+}
+
+bool
+sc_soak_monitor_start(struct sc_soak_monitor *monitor) {
+    LOGD("Starting soak monitor thread");
+
+    bool ok = sc_thread_create(&monitor->thread, run_soak_monitor,
+                               "scrcpy-soak", monitor);
+    if (!ok) {
+        LOGE("Could not start soak monitor thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_soak_monitor_stop(struct sc_soak_monitor *monitor) {
+    sc_mutex_lock(&monitor->mutex);
+    monitor->stopped = true;
+    sc_cond_signal(&monitor->cond);
+    sc_mutex_unlock(&monitor->mutex);
+}
+
+void
+sc_soak_monitor_join(struct sc_soak_monitor *monitor) {
+    sc_thread_join(&monitor->thread, NULL);
+    sc_soak_monitor_report(monitor);
+}
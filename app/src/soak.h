@@ -0,0 +1,71 @@
+#ifndef SC_SOAK_H
+#define SC_SOAK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trend.h"
+#include "util/metrics.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+struct sc_soak_series {
+    // The gauge value, or the mean of the values observed by a histogram
+    // during each interval
+    struct sc_trend value;
+    // The 99th percentile of the values observed by a histogram during each
+    // interval
+    struct sc_trend p99;
+
+    // Histogram state at the previous sample
+    int64_t last_sum;
+    uint64_t last_buckets[SC_METRIC_MAX_BOUNDS + 1];
+};
+
+/**
+ * Monitor a long session (--soak)
+ *
+ * It periodically samples the process memory into gauges, and tracks the
+ * long-term trend of all the gauges and histograms of the registry (memory,
+ * queue depths, audio buffering, latencies...). On stop, it reports the ones
+ * which grew steadily over the session.
+ *
+ * The time series itself is written by the metrics exporter.
+ */
+struct sc_soak_monitor {
+    struct sc_metrics *metrics;
+    sc_tick interval;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    struct sc_metric *rss_metric; // NULL if not supported
+    struct sc_metric *allocated_metric; // NULL if not supported
+
+    // Indexed like the metrics of the registry
+    struct sc_soak_series *series;
+    unsigned samples;
+};
+
+bool
+sc_soak_monitor_init(struct sc_soak_monitor *monitor,
+                     struct sc_metrics *metrics, sc_tick interval);
+
+void
+sc_soak_monitor_destroy(struct sc_soak_monitor *monitor);
+
+bool
+sc_soak_monitor_start(struct sc_soak_monitor *monitor);
+
+void
+sc_soak_monitor_stop(struct sc_soak_monitor *monitor);
+
+// Join the monitor thread, and report the steady growths
+void
+sc_soak_monitor_join(struct sc_soak_monitor *monitor);
+
+#endif
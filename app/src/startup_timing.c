@@ -0,0 +1,53 @@
+#include "startup_timing.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "util/log.h"
+#include "util/tick.h"
+
+static const char *const sc_startup_phase_names[] = {
+    [SC_STARTUP_PHASE_ADB_SERVER] = "adb server started",
+    [SC_STARTUP_PHASE_DEVICE_SELECTED] = "device selected",
+    [SC_STARTUP_PHASE_SERVER_PUSHED] = "server pushed",
+    [SC_STARTUP_PHASE_TUNNEL_OPEN] = "tunnel open",
+    [SC_STARTUP_PHASE_SERVER_EXECUTED] = "server process started",
+    [SC_STARTUP_PHASE_VIDEO_SOCKET] = "video socket connected",
+    [SC_STARTUP_PHASE_AUDIO_SOCKET] = "audio socket connected",
+    [SC_STARTUP_PHASE_CONTROL_SOCKET] = "control socket connected",
+    [SC_STARTUP_PHASE_DEVICE_INFO] = "device info received",
+    [SC_STARTUP_PHASE_CODEC_META] = "video codec received",
+    [SC_STARTUP_PHASE_DECODER_OPEN] = "video decoder open",
+    [SC_STARTUP_PHASE_FIRST_PACKET] = "first video packet",
+    [SC_STARTUP_PHASE_FIRST_FRAME] = "first frame decoded",
+    [SC_STARTUP_PHASE_FIRST_PRESENT] = "first frame rendered",
+};
+
+static atomic_bool sc_startup_timing_enabled;
+static sc_tick sc_startup_timing_origin; // written before enabling
+static atomic_bool sc_startup_phase_reached[SC_STARTUP_PHASE_COUNT];
+
+void
+sc_startup_timing_enable(void) {
+    sc_startup_timing_origin = sc_tick_now();
+    atomic_store(&sc_startup_timing_enabled, true);
+}
+
+void
+sc_startup_timing_mark(enum sc_startup_phase phase) {
+    assert(phase < SC_STARTUP_PHASE_COUNT);
+
+    if (!atomic_load(&sc_startup_timing_enabled)) {
+        return;
+    }
+
+    if (atomic_exchange(&sc_startup_phase_reached[phase], true)) {
+        // Already reported
+        return;
+    }
+
+    sc_tick elapsed = sc_tick_now() - sc_startup_timing_origin;
+    LOGI("Startup: %5" PRItick " ms: %s", SC_TICK_TO_MS(elapsed),
+         sc_startup_phase_names[phase]);
+}
@@ -0,0 +1,45 @@
+#ifndef SC_STARTUP_TIMING_H
+#define SC_STARTUP_TIMING_H
+
+#include "common.h"
+
+/**
+ * The successive phases of the startup, up to the first rendered frame.
+ */
+enum sc_startup_phase {
+    SC_STARTUP_PHASE_ADB_SERVER,       // adb server started
+    SC_STARTUP_PHASE_DEVICE_SELECTED,  // device selected
+    SC_STARTUP_PHASE_SERVER_PUSHED,    // server pushed (or already present)
+    SC_STARTUP_PHASE_TUNNEL_OPEN,      // adb tunnel open
+    SC_STARTUP_PHASE_SERVER_EXECUTED,  // server process started
+    SC_STARTUP_PHASE_VIDEO_SOCKET,     // video socket connected
+    SC_STARTUP_PHASE_AUDIO_SOCKET,     // audio socket connected
+    SC_STARTUP_PHASE_CONTROL_SOCKET,   // control socket connected
+    SC_STARTUP_PHASE_DEVICE_INFO,      // device info received
+    SC_STARTUP_PHASE_CODEC_META,       // video codec and size received
+    SC_STARTUP_PHASE_DECODER_OPEN,     // video decoder open
+    SC_STARTUP_PHASE_FIRST_PACKET,     // first video packet received
+    SC_STARTUP_PHASE_FIRST_FRAME,      // first video frame decoded
+    SC_STARTUP_PHASE_FIRST_PRESENT,    // first video frame rendered
+};
+
+#define SC_STARTUP_PHASE_COUNT 14
+
+/**
+ * Start reporting the startup phases (--print-startup-timing)
+ *
+ * The time of each phase is measured from this call.
+ */
+void
+sc_startup_timing_enable(void);
+
+/**
+ * Report that a startup phase has been reached
+ *
+ * Only the first call for a given phase is reported. It may be called from
+ * any thread, and does nothing if the startup timing is not enabled.
+ */
+void
+sc_startup_timing_mark(enum sc_startup_phase phase);
+
+#endif
@@ -0,0 +1,354 @@
+#include "stream_clock.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+//#define SC_STREAM_CLOCK_DEBUG // uncomment to debug
+
+// Minimal time span of the points to estimate the drift (over a shorter span,
+// the estimation error would be larger than the drift itself)
+#define SC_STREAM_CLOCK_MIN_DRIFT_SPAN SC_TICK_FROM_SEC(30)
+
+// The clocks of real devices drift by a few ppm, larger values are estimation
+// errors
+#define SC_STREAM_CLOCK_MAX_DRIFT 0.001
+
+// The points farther from the estimated line than 3 standard deviations
+// (estimated from the median absolute deviation) are rejected, but never those
+// closer than this tolerance
+#define SC_STREAM_CLOCK_MIN_OUTLIER_DISTANCE SC_TICK_FROM_MS(2)
+
+#define SC_STREAM_CLOCK_MAX_POINTS \
+    (SC_STREAM_CLOCK_SOURCE_COUNT * SC_STREAM_CLOCK_BUCKETS)
+
+bool
+sc_stream_clock_init(struct sc_stream_clock *clock) {
+    bool ok = sc_mutex_init(&clock->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < SC_STREAM_CLOCK_SOURCE_COUNT; ++i) {
+        struct sc_stream_clock_track *track = &clock->tracks[i];
+        track->has_current = false;
+        track->head = 0;
+        track->count = 0;
+        track->has_estimate = false;
+    }
+
+    clock->ref = 0;
+    clock->drift = 0;
+    clock->drift_metric = NULL;
+
+    return true;
+}
+
+void
+sc_stream_clock_destroy(struct sc_stream_clock *clock) {
+    sc_mutex_destroy(&clock->mutex);
+}
+
+void
+sc_stream_clock_set_metrics(struct sc_stream_clock *clock,
+                            struct sc_metrics *metrics) {
+    clock->drift_metric =
+        sc_metrics_register_gauge(metrics, "scrcpy_clock_drift_ppm",
+                                  "Estimated drift of the device clock");
+}
+
+static const struct sc_stream_clock_point *
+sc_stream_clock_track_at(const struct sc_stream_clock_track *track,
+                         unsigned index) {
+    assert(index < track->count);
+    unsigned i = (track->head + SC_STREAM_CLOCK_BUCKETS - track->count + index)
+               % SC_STREAM_CLOCK_BUCKETS;
+    return &track->history[i];
+}
+
+// Fit the included points to lines sharing the same slope (one line per
+// track), and return the slope (or the previous drift if the points do not
+// span enough time)
+static double
+sc_stream_clock_fit(struct sc_stream_clock *clock, sc_tick ref,
+                    bool excluded[][SC_STREAM_CLOCK_BUCKETS],
+                    double means_x[], double means_y[], unsigned counts[]) {
+    double sxx = 0;
+    double sxy = 0;
+    sc_tick min_x = 0;
+    sc_tick max_x = 0;
+    bool has_x = false;
+
+    for (unsigned t = 0; t < SC_STREAM_CLOCK_SOURCE_COUNT; ++t) {
+        const struct sc_stream_clock_track *track = &clock->tracks[t];
+
+        double sum_x = 0;
+        double sum_y = 0;
+        unsigned n = 0;
+        for (unsigned i = 0; i < track->count; ++i) {
+            if (excluded[t][i]) {
+                continue;
+            }
+            const struct sc_stream_clock_point *p =
+                sc_stream_clock_track_at(track, i);
+            sc_tick x = p->system - ref;
+            sum_x += x;
+            sum_y += p->offset;
+            ++n;
+
+            if (!has_x || x < min_x) {
+                min_x = x;
+            }
+            if (!has_x || x > max_x) {
+                max_x = x;
+            }
+            has_x = true;
+        }
+
+        counts[t] = n;
+        if (!n) {
+            continue;
+        }
+
+        means_x[t] = sum_x / n;
+        means_y[t] = sum_y / n;
+
+        for (unsigned i = 0; i < track->count; ++i) {
+            if (excluded[t][i]) {
+                continue;
+            }
+            const struct sc_stream_clock_point *p =
+                sc_stream_clock_track_at(track, i);
+            double dx = (p->system - ref) - means_x[t];
+            double dy = p->offset - means_y[t];
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+    }
+
+    if (!has_x || max_x - min_x < SC_STREAM_CLOCK_MIN_DRIFT_SPAN || !sxx) {
+        return clock->drift;
+    }
+
+    double drift = sxy / sxx;
+    if (drift > SC_STREAM_CLOCK_MAX_DRIFT) {
+        drift = SC_STREAM_CLOCK_MAX_DRIFT;
+    } else if (drift < -SC_STREAM_CLOCK_MAX_DRIFT) {
+        drift = -SC_STREAM_CLOCK_MAX_DRIFT;
+    }
+    return drift;
+}
+
+static int
+sc_stream_clock_compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+// Must be called with the mutex locked
+static void
+sc_stream_clock_estimate(struct sc_stream_clock *clock, sc_tick ref) {
+    sc_mutex_assert(&clock->mutex);
+
+    bool excluded[SC_STREAM_CLOCK_SOURCE_COUNT][SC_STREAM_CLOCK_BUCKETS] = {0};
+    double means_x[SC_STREAM_CLOCK_SOURCE_COUNT];
+    double means_y[SC_STREAM_CLOCK_SOURCE_COUNT];
+    unsigned counts[SC_STREAM_CLOCK_SOURCE_COUNT];
+
+    double drift =
+        sc_stream_clock_fit(clock, ref, excluded, means_x, means_y, counts);
+
+    // Reject the outliers, then fit again
+    sc_tick distances[SC_STREAM_CLOCK_MAX_POINTS];
+    sc_tick residuals[SC_STREAM_CLOCK_MAX_POINTS];
+    unsigned n = 0;
+    for (unsigned t = 0; t < SC_STREAM_CLOCK_SOURCE_COUNT; ++t) {
+        const struct sc_stream_clock_track *track = &clock->tracks[t];
+        for (unsigned i = 0; i < track->count; ++i) {
+            const struct sc_stream_clock_point *p =
+                sc_stream_clock_track_at(track, i);
+            double expected =
+                means_y[t] + drift * ((p->system - ref) - means_x[t]);
+            sc_tick residual = p->offset - (sc_tick) expected;
+            residuals[n] = residual;
+            distances[n] = residual < 0 ? -residual : residual;
+            ++n;
+        }
+    }
+
+    if (!n) {
+        return;
+    }
+
+    qsort(distances, n, sizeof(distances[0]), sc_stream_clock_compare_ticks);
+    sc_tick median = distances[n / 2];
+    // 1.4826 * MAD estimates the standard deviation of a normal distribution
+    sc_tick max_distance = median * 3 * 14826 / 10000;
+    if (max_distance < SC_STREAM_CLOCK_MIN_OUTLIER_DISTANCE) {
+        max_distance = SC_STREAM_CLOCK_MIN_OUTLIER_DISTANCE;
+    }
+
+    unsigned k = 0;
+    for (unsigned t = 0; t < SC_STREAM_CLOCK_SOURCE_COUNT; ++t) {
+        const struct sc_stream_clock_track *track = &clock->tracks[t];
+        for (unsigned i = 0; i < track->count; ++i) {
+            sc_tick residual = residuals[k++];
+            excluded[t][i] = residual > max_distance
+                          || residual < -max_distance;
+        }
+    }
+
+    drift = sc_stream_clock_fit(clock, ref, excluded, means_x, means_y, counts);
+
+    clock->ref = ref;
+    clock->drift = drift;
+    for (unsigned t = 0; t < SC_STREAM_CLOCK_SOURCE_COUNT; ++t) {
+        struct sc_stream_clock_track *track = &clock->tracks[t];
+        track->has_estimate = counts[t] != 0;
+        if (track->has_estimate) {
+            // Offset of the line at the reference date (x = 0)
+            track->offset = (sc_tick) (means_y[t] - drift * means_x[t]);
+        }
+    }
+
+    sc_metric_set(clock->drift_metric, (int64_t) (drift * 1000000));
+
+#ifdef SC_STREAM_CLOCK_DEBUG
+    LOGD("Stream clock: video %" PRItick ", audio %" PRItick ", drift %.1f ppm",
+         clock->tracks[SC_STREAM_CLOCK_SOURCE_VIDEO].offset,
+         clock->tracks[SC_STREAM_CLOCK_SOURCE_AUDIO].offset, drift * 1000000);
+#endif
+}
+
+void
+sc_stream_clock_update(struct sc_stream_clock *clock,
+                       enum sc_stream_clock_source source, sc_tick system,
+                       sc_tick pts) {
+    assert(source < SC_STREAM_CLOCK_SOURCE_COUNT);
+
+    sc_tick offset = system - pts;
+
+    sc_mutex_lock(&clock->mutex);
+    struct sc_stream_clock_track *track = &clock->tracks[source];
+
+    if (track->has_current
+            && system - track->current_start
+                    >= SC_STREAM_CLOCK_BUCKET_DURATION) {
+        // The bucket is complete
+        track->history[track->head] = track->current;
+        track->head = (track->head + 1) % SC_STREAM_CLOCK_BUCKETS;
+        if (track->count < SC_STREAM_CLOCK_BUCKETS) {
+            ++track->count;
+        }
+        track->has_current = false;
+
+        sc_stream_clock_estimate(clock, system);
+    }
+
+    if (!track->has_current) {
+        track->has_current = true;
+        track->current_start = system;
+        track->current.system = system;
+        track->current.offset = offset;
+    } else if (offset < track->current.offset) {
+        track->current.system = system;
+        track->current.offset = offset;
+    }
+
+    sc_mutex_unlock(&clock->mutex);
+}
+
+void
+sc_stream_clock_reset(struct sc_stream_clock *clock,
+                      enum sc_stream_clock_source source) {
+    assert(source < SC_STREAM_CLOCK_SOURCE_COUNT);
+
+    sc_mutex_lock(&clock->mutex);
+    struct sc_stream_clock_track *track = &clock->tracks[source];
+    track->has_current = false;
+    track->head = 0;
+    track->count = 0;
+    track->has_estimate = false;
+    sc_mutex_unlock(&clock->mutex);
+}
+
+// Must be called with the mutex locked
+static bool
+sc_stream_clock_get_offset(struct sc_stream_clock *clock,
+                           const struct sc_stream_clock_track *track,
+                           sc_tick system, sc_tick *offset) {
+    sc_mutex_assert(&clock->mutex);
+
+    bool found = false;
+    sc_tick result = 0;
+    if (track->has_estimate) {
+        sc_tick elapsed = system - clock->ref;
+        result = track->offset + (sc_tick) (clock->drift * elapsed);
+        found = true;
+    }
+
+    // A lower offset in the current bucket is not an outlier (a packet cannot
+    // arrive earlier than possible): the minimal transit time has decreased
+    if (track->has_current && (!found || track->current.offset < result)) {
+        result = track->current.offset;
+        found = true;
+    }
+
+    if (found) {
+        *offset = result;
+    }
+    return found;
+}
+
+bool
+sc_stream_clock_to_system_time(struct sc_stream_clock *clock,
+                               enum sc_stream_clock_source source, sc_tick pts,
+                               sc_tick *system) {
+    assert(source < SC_STREAM_CLOCK_SOURCE_COUNT);
+
+    sc_mutex_lock(&clock->mutex);
+    const struct sc_stream_clock_track *track = &clock->tracks[source];
+
+    // The offset depends on the (unknown) system time: estimate it from the
+    // offset at the reference date first (the drift is tiny)
+    sc_tick offset;
+    bool ok = sc_stream_clock_get_offset(clock, track, clock->ref, &offset);
+    if (ok) {
+        ok = sc_stream_clock_get_offset(clock, track, pts + offset, &offset);
+        assert(ok);
+        *system = pts + offset;
+    }
+
+    sc_mutex_unlock(&clock->mutex);
+    return ok;
+}
+
+sc_tick
+sc_stream_clock_get_lag(struct sc_stream_clock *clock,
+                        enum sc_stream_clock_source source, sc_tick system,
+                        sc_tick pts) {
+    assert(source < SC_STREAM_CLOCK_SOURCE_COUNT);
+
+    sc_mutex_lock(&clock->mutex);
+    const struct sc_stream_clock_track *track = &clock->tracks[source];
+    sc_tick offset;
+    bool ok = sc_stream_clock_get_offset(clock, track, system, &offset);
+    sc_mutex_unlock(&clock->mutex);
+
+    if (!ok) {
+        return 0;
+    }
+
+    return system - pts - offset;
+}
+
+double
+sc_stream_clock_get_drift_ppm(struct sc_stream_clock *clock) {
+    sc_mutex_lock(&clock->mutex);
+    double drift = clock->drift;
+    sc_mutex_unlock(&clock->mutex);
+    return drift * 1000000;
+}
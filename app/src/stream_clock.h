@@ -0,0 +1,134 @@
+#ifndef SC_STREAM_CLOCK_H
+#define SC_STREAM_CLOCK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/metrics.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Duration of the buckets from which the minimal transit time is kept
+#define SC_STREAM_CLOCK_BUCKET_DURATION SC_TICK_FROM_SEC(1)
+// Number of buckets kept per stream (2 minutes)
+#define SC_STREAM_CLOCK_BUCKETS 120
+
+enum sc_stream_clock_source {
+    SC_STREAM_CLOCK_SOURCE_VIDEO,
+    SC_STREAM_CLOCK_SOURCE_AUDIO,
+};
+
+#define SC_STREAM_CLOCK_SOURCE_COUNT 2
+
+struct sc_stream_clock_point {
+    sc_tick system; // reception date
+    sc_tick offset; // reception date - PTS
+};
+
+struct sc_stream_clock_track {
+    // Point having the minimal offset in the current bucket
+    bool has_current;
+    sc_tick current_start;
+    struct sc_stream_clock_point current;
+
+    // Minimal points of the last completed buckets (circular buffer)
+    struct sc_stream_clock_point history[SC_STREAM_CLOCK_BUCKETS];
+    unsigned head; // index of the next point to write
+    unsigned count;
+
+    // Estimated offset at the reference date of the clock
+    bool has_estimate;
+    sc_tick offset;
+};
+
+/**
+ * Session-wide mapping between the device time (the PTS of the received
+ * packets) and the computer time
+ *
+ * Contrary to sc_clock (which smooths the offset observed at a specific stage
+ * of a pipeline), it is fed by the demuxers with the reception dates of the
+ * packets of all the streams, and it may be queried from any thread.
+ *
+ * The transit time of a packet is its minimal transit time plus a positive
+ * delay (network jitter, bursts, stalls). Therefore, only the minimal offset
+ * (reception date - PTS) is kept per bucket of 1 second. The relation between
+ * the device and computer clocks is estimated by linear regression on these
+ * minima, rejecting the outliers (for example the buckets entirely covered by
+ * a network stall):
+ *
+ *     offset(system) = offset_i + drift * (system - ref)
+ *
+ * Each stream has its own offset (the audio and video are not captured nor
+ * encoded with the same delay), but the drift (the slope, caused by the
+ * different frequencies of the device and computer clocks) is estimated from
+ * both streams.
+ */
+struct sc_stream_clock {
+    sc_mutex mutex;
+
+    struct sc_stream_clock_track tracks[SC_STREAM_CLOCK_SOURCE_COUNT];
+
+    sc_tick ref; // reference date of the estimated offsets
+    double drift; // 0 until enough points are received
+
+    // Estimated drift, in ppm (NULL if metrics are disabled)
+    struct sc_metric *drift_metric;
+};
+
+bool
+sc_stream_clock_init(struct sc_stream_clock *clock);
+
+void
+sc_stream_clock_destroy(struct sc_stream_clock *clock);
+
+// Register the clock metrics to the registry
+void
+sc_stream_clock_set_metrics(struct sc_stream_clock *clock,
+                            struct sc_metrics *metrics);
+
+/**
+ * Add a point to the estimation
+ *
+ * \param system the reception date of the packet
+ * \param pts the PTS of the packet, in microseconds
+ */
+void
+sc_stream_clock_update(struct sc_stream_clock *clock,
+                       enum sc_stream_clock_source source, sc_tick system,
+                       sc_tick pts);
+
+/**
+ * Forget the points of a stream (its PTS have been shifted)
+ *
+ * The drift estimated from the previous points is kept.
+ */
+void
+sc_stream_clock_reset(struct sc_stream_clock *clock,
+                      enum sc_stream_clock_source source);
+
+/**
+ * Convert a PTS to the expected (minimal) reception date
+ *
+ * Return false if no point has been received for this stream yet.
+ */
+bool
+sc_stream_clock_to_system_time(struct sc_stream_clock *clock,
+                               enum sc_stream_clock_source source, sc_tick pts,
+                               sc_tick *system);
+
+/**
+ * Return how late a packet received at the given date is, compared to its
+ * expected reception date (0 if unknown)
+ */
+sc_tick
+sc_stream_clock_get_lag(struct sc_stream_clock *clock,
+                        enum sc_stream_clock_source source, sc_tick system,
+                        sc_tick pts);
+
+// Return the estimated drift of the device clock, in ppm (positive if it is
+// slower than the computer clock)
+double
+sc_stream_clock_get_drift_ppm(struct sc_stream_clock *clock);
+
+#endif
@@ -0,0 +1,247 @@
+#include "stream_replayer.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "demuxer.h"
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+// Codec id (4 bytes), followed by the initial video size (8 bytes) for video
+#define SC_STREAM_HEADER_MAX_SIZE 12
+
+bool
+sc_stream_replayer_init(struct sc_stream_replayer *replayer, const char *name,
+                        const char *filename, bool video, bool paced) {
+    replayer->file = sc_file_open(filename, "rb");
+    if (!replayer->file) {
+        LOGE("Could not open capture file: %s", filename);
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&replayer->mutex);
+    if (!ok) {
+        goto error_close_file;
+    }
+
+    ok = sc_cond_init(&replayer->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = net_socketpair(&replayer->socket, &replayer->peer_socket);
+    if (!ok) {
+        LOGE("Stream replay '%s': could not create the local socket", name);
+        goto error_destroy_cond;
+    }
+
+    // Send each packet as soon as it is written
+    net_set_tcp_nodelay(replayer->socket, true);
+
+    replayer->name = name; // statically allocated
+    replayer->video = video;
+    replayer->paced = paced;
+    replayer->stopped = false;
+
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&replayer->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&replayer->mutex);
+error_close_file:
+    fclose(replayer->file);
+
+    return false;
+}
+
+void
+sc_stream_replayer_destroy(struct sc_stream_replayer *replayer) {
+    net_close(replayer->peer_socket);
+    net_close(replayer->socket);
+    sc_cond_destroy(&replayer->cond);
+    sc_mutex_destroy(&replayer->mutex);
+    fclose(replayer->file);
+}
+
+// Return false if stopped
+static bool
+sc_stream_replayer_wait(struct sc_stream_replayer *replayer,
+                        sc_tick deadline) {
+    sc_mutex_lock(&replayer->mutex);
+    while (!replayer->stopped && sc_tick_now() < deadline) {
+        sc_cond_timedwait(&replayer->cond, &replayer->mutex, deadline);
+    }
+    bool stopped = replayer->stopped;
+    sc_mutex_unlock(&replayer->mutex);
+
+    return !stopped;
+}
+
+static bool
+sc_stream_replayer_read(struct sc_stream_replayer *replayer, void *buf,
+                        size_t len) {
+    size_t r = fread(buf, 1, len, replayer->file);
+    if (r != len) {
+        if (r || ferror(replayer->file)) {
+            LOGE("Stream replay '%s': truncated capture file",
+                 replayer->name);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_stream_replayer_send(struct sc_stream_replayer *replayer, const void *buf,
+                        size_t len) {
+    ssize_t w = net_send_all(replayer->socket, buf, len);
+    if (w < 0 || (size_t) w != len) {
+        // The demuxer has stopped (or the replayer is interrupted)
+        LOGD("Stream replay '%s': could not send", replayer->name);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_stream_replayer_send_stream_header(struct sc_stream_replayer *replayer) {
+    uint8_t header[SC_STREAM_HEADER_MAX_SIZE];
+    if (!sc_stream_replayer_read(replayer, header, 4)) {
+        LOGE("Stream replay '%s': empty capture file", replayer->name);
+        return false;
+    }
+
+    size_t size = 4;
+
+    // 0 and 1 mean that the stream was disabled or failed on the device: the
+    // capture contains nothing else
+    uint32_t codec_id = sc_read32be(header);
+    if (codec_id > 1 && replayer->video) {
+        if (!sc_stream_replayer_read(replayer, &header[4], 8)) {
+            return false;
+        }
+        size += 8;
+    }
+
+    return sc_stream_replayer_send(replayer, header, size);
+}
+
+static int
+run_stream_replayer(void *data) {
+    struct sc_stream_replayer *replayer = data;
+
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+
+    uint64_t count = 0;
+    sc_tick start = 0;
+    int64_t first_pts = 0;
+    bool first_media_packet = true;
+
+    if (!sc_stream_replayer_send_stream_header(replayer)) {
+        goto end;
+    }
+
+    for (;;) {
+        uint8_t header[SC_PACKET_HEADER_SIZE];
+        if (!sc_stream_replayer_read(replayer, header, sizeof(header))) {
+            // End of file (or error, already logged)
+            break;
+        }
+
+        uint64_t pts_flags = sc_read64be(header);
+        uint32_t len = sc_read32be(&header[8]);
+        if (!len) {
+            LOGE("Stream replay '%s': invalid capture file", replayer->name);
+            break;
+        }
+
+        size_t size = SC_PACKET_HEADER_SIZE + (size_t) len;
+        if (size > buf_size) {
+            uint8_t *new_buf = realloc(buf, size);
+            if (!new_buf) {
+                LOG_OOM();
+                break;
+            }
+            buf = new_buf;
+            buf_size = size;
+        }
+
+        memcpy(buf, header, SC_PACKET_HEADER_SIZE);
+        if (!sc_stream_replayer_read(replayer, &buf[SC_PACKET_HEADER_SIZE],
+                                     len)) {
+            break;
+        }
+
+        if (replayer->paced && !(pts_flags & SC_PACKET_FLAG_CONFIG)) {
+            // The PTS are the capture timestamps on the device (in
+            // microseconds)
+            int64_t pts = pts_flags & SC_PACKET_PTS_MASK;
+            if (first_media_packet) {
+                start = sc_tick_now();
+                first_pts = pts;
+                first_media_packet = false;
+            } else {
+                sc_tick deadline = start + SC_TICK_FROM_US(pts - first_pts);
+                if (!sc_stream_replayer_wait(replayer, deadline)) {
+                    LOGD("Stream replay '%s' stopped", replayer->name);
+                    goto end;
+                }
+            }
+        }
+
+        if (!sc_stream_replayer_send(replayer, buf, size)) {
+            goto end;
+        }
+
+        ++count;
+    }
+
+    LOGI("Stream replay '%s' finished (%" PRIu64 " packets)", replayer->name,
+         count);
+
+end:
+    free(buf);
+
+    // The demuxer receives the remaining data, then the end-of-stream
+    net_interrupt(replayer->socket);
+
+    return 0;
+}
+
+bool
+sc_stream_replayer_start(struct sc_stream_replayer *replayer) {
+    LOGD("Stream replay '%s': starting thread", replayer->name);
+
+    bool ok = sc_thread_create(&replayer->thread, run_stream_replayer,
+                               "scrcpy-replay", replayer);
+    if (!ok) {
+        LOGE("Stream replay '%s': could not start thread", replayer->name);
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_stream_replayer_stop(struct sc_stream_replayer *replayer) {
+    sc_mutex_lock(&replayer->mutex);
+    replayer->stopped = true;
+    sc_cond_signal(&replayer->cond);
+    sc_mutex_unlock(&replayer->mutex);
+
+    // Interrupt any blocking send() and the demuxer recv()
+    net_interrupt(replayer->socket);
+    net_interrupt(replayer->peer_socket);
+}
+
+void
+sc_stream_replayer_join(struct sc_stream_replayer *replayer) {
+    sc_thread_join(&replayer->thread, NULL);
+}
@@ -0,0 +1,66 @@
+#ifndef SC_STREAM_REPLAYER_H
+#define SC_STREAM_REPLAYER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "util/net.h"
+#include "util/thread.h"
+
+// Appended to the prefix of --stream-capture and --stream-replay
+#define SC_STREAM_CAPTURE_VIDEO_SUFFIX ".video"
+#define SC_STREAM_CAPTURE_AUDIO_SUFFIX ".audio"
+
+/**
+ * Replay a stream captured by a demuxer (see sc_demuxer_set_capture())
+ *
+ * The captured bytes are sent over a local socket, so that a demuxer reads
+ * them exactly as if they were received from the device: the whole client
+ * pipeline (demuxer, decoder, display, recorder…) runs without any device.
+ *
+ * The packets are sent either at their original pacing (from their PTS) or as
+ * fast as the pipeline consumes them.
+ */
+struct sc_stream_replayer {
+    const char *name; // must be statically allocated (e.g. a string literal)
+    FILE *file;
+    bool video; // the stream header contains the video size
+    bool paced;
+
+    sc_socket socket; // written by the replayer
+    // Read by the demuxer (passed to sc_demuxer_init()), owned by the replayer
+    sc_socket peer_socket;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+};
+
+// The name must be statically allocated (e.g. a string literal)
+bool
+sc_stream_replayer_init(struct sc_stream_replayer *replayer, const char *name,
+                        const char *filename, bool video, bool paced);
+
+void
+sc_stream_replayer_destroy(struct sc_stream_replayer *replayer);
+
+/**
+ * Start sending the stream (the pacing is relative to the first packet)
+ *
+ * On end of file, the socket is shut down, so that the demuxer reaches the
+ * end-of-stream once it has received all the packets.
+ */
+bool
+sc_stream_replayer_start(struct sc_stream_replayer *replayer);
+
+// Interrupt the replayer and the demuxer reading from peer_socket
+void
+sc_stream_replayer_stop(struct sc_stream_replayer *replayer);
+
+void
+sc_stream_replayer_join(struct sc_stream_replayer *replayer);
+
+#endif
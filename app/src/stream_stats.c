@@ -0,0 +1,61 @@
+#include "stream_stats.h"
+
+#include <assert.h>
+
+void
+sc_stream_stats_init(struct sc_stream_stats *stats) {
+    atomic_init(&stats->bytes, 0);
+    atomic_init(&stats->packets, 0);
+    atomic_init(&stats->keyframes, 0);
+    atomic_init(&stats->keyframe_bytes, 0);
+    atomic_init(&stats->config_packets, 0);
+    atomic_init(&stats->max_keyframe_size, 0);
+}
+
+void
+sc_stream_stats_add_packet(struct sc_stream_stats *stats, uint32_t size,
+                           bool config, bool keyframe) {
+    atomic_fetch_add_explicit(&stats->bytes, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->packets, 1, memory_order_relaxed);
+
+    if (config) {
+        atomic_fetch_add_explicit(&stats->config_packets, 1,
+                                  memory_order_relaxed);
+        return;
+    }
+
+    if (keyframe) {
+        atomic_fetch_add_explicit(&stats->keyframes, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->keyframe_bytes, size,
+                                  memory_order_relaxed);
+
+        // Only the demuxer thread increases the value, the reader may only
+        // reset it to 0
+        uint32_t max = atomic_load_explicit(&stats->max_keyframe_size,
+                                            memory_order_relaxed);
+        while (size > max
+                && !atomic_compare_exchange_weak_explicit(
+                        &stats->max_keyframe_size, &max, size,
+                        memory_order_relaxed, memory_order_relaxed)) {
+            // max has been updated, retry
+        }
+    }
+}
+
+uint64_t
+sc_stream_stats_get_bytes(struct sc_stream_stats *stats) {
+    return atomic_load_explicit(&stats->bytes, memory_order_relaxed);
+}
+
+uint32_t
+sc_stream_stats_take_max_keyframe_size(struct sc_stream_stats *stats) {
+    return atomic_exchange_explicit(&stats->max_keyframe_size, 0,
+                                    memory_order_relaxed);
+}
+
+uint32_t
+sc_stream_stats_to_kbps(uint64_t bytes, sc_tick elapsed) {
+    assert(elapsed > 0);
+    // Rounded to the nearest integer
+    return (bytes * 8 * SC_TICK_FREQ / 1000 + elapsed / 2) / elapsed;
+}
@@ -0,0 +1,54 @@
+#ifndef SC_STREAM_STATS_H
+#define SC_STREAM_STATS_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+/**
+ * Bandwidth and packet size statistics of a received stream
+ *
+ * The packets are counted by the demuxer thread, with relaxed atomics, and may
+ * be read from any thread (the fps counter reports them from the main thread).
+ */
+struct sc_stream_stats {
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t packets;
+    atomic_uint_least64_t keyframes;
+    atomic_uint_least64_t keyframe_bytes;
+    atomic_uint_least64_t config_packets;
+
+    // Size of the largest keyframe since the last call to
+    // sc_stream_stats_take_max_keyframe_size()
+    atomic_uint_least32_t max_keyframe_size;
+};
+
+void
+sc_stream_stats_init(struct sc_stream_stats *stats);
+
+void
+sc_stream_stats_add_packet(struct sc_stream_stats *stats, uint32_t size,
+                           bool config, bool keyframe);
+
+uint64_t
+sc_stream_stats_get_bytes(struct sc_stream_stats *stats);
+
+/**
+ * Return the size of the largest keyframe received since the previous call (0
+ * if none), and reset it
+ */
+uint32_t
+sc_stream_stats_take_max_keyframe_size(struct sc_stream_stats *stats);
+
+/**
+ * Compute the bit rate, in kbps, from a number of bytes received during an
+ * elapsed duration
+ */
+uint32_t
+sc_stream_stats_to_kbps(uint64_t bytes, sc_tick elapsed);
+
+#endif
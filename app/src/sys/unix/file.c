@@ -94,3 +94,17 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+FILE *
+sc_file_open(const char *path, const char *mode) {
+    return fopen(path, mode);
+}
+
+bool
+sc_file_remove(const char *path) {
+    return !remove(path);
+}
+
+bool
+sc_file_replace(const char *from, const char *to) {
+    return !rename(from, to);
+}
@@ -3,12 +3,21 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __APPLE__
+# include <mach/mach.h>
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+# include <malloc.h>
+# define SC_HAS_MALLINFO2
+#endif
 
 #include "util/log.h"
 
@@ -223,6 +232,74 @@ sc_process_close(pid_t pid) {
     sc_process_wait(pid, true); // ignore exit code
 }
 
+bool
+sc_process_get_cpu_time(sc_tick *cpu_time) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        LOGE("Could not get the process CPU time");
+        return false;
+    }
+
+    *cpu_time = SC_TICK_FROM_SEC(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+              + SC_TICK_FROM_US(usage.ru_utime.tv_usec
+                              + usage.ru_stime.tv_usec);
+    return true;
+}
+
+bool
+sc_process_get_rss(uint64_t *rss) {
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return false;
+    }
+
+    // The second field is the number of resident pages
+    uint64_t pages;
+    int r = fscanf(file, "%*s %" SCNu64, &pages);
+    fclose(file);
+    if (r != 1) {
+        return false;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        return false;
+    }
+
+    *rss = pages * page_size;
+    return true;
+#elif defined(__APPLE__)
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    kern_return_t r = task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                                (task_info_t) &info, &count);
+    if (r != KERN_SUCCESS) {
+        return false;
+    }
+
+    *rss = info.resident_size;
+    return true;
+#else
+    (void) rss;
+    return false;
+#endif
+}
+
+bool
+sc_process_get_allocated(uint64_t *allocated) {
+#ifdef SC_HAS_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    // Bytes in use in all the malloc arenas, plus the chunks allocated by
+    // mmap() (not part of any arena)
+    *allocated = info.uordblks + info.hblkhd;
+    return true;
+#else
+    (void) allocated;
+    return false;
+#endif
+}
+
 ssize_t
 sc_pipe_read(int pipe, char *data, size_t len) {
     return read(pipe, data, len);
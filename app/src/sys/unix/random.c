@@ -0,0 +1,36 @@
+#include "util/random.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/log.h"
+
+bool
+sc_random_bytes(void *buf, size_t len) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        LOGE("Could not open /dev/urandom: %s", strerror(errno));
+        return false;
+    }
+
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t r = read(fd, p, len);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            LOGE("Could not read /dev/urandom");
+            close(fd);
+            return false;
+        }
+        p += r;
+        len -= r;
+    }
+
+    close(fd);
+    return true;
+}
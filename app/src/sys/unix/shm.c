@@ -0,0 +1,68 @@
+#include "util/shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "util/log.h"
+#include "util/str.h"
+
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size) {
+    // A POSIX shared memory object name starts with a '/'
+    if (name[0] == '/') {
+        shm->name = strdup(name);
+    } else {
+        shm->name = sc_str_concat("/", name);
+    }
+    if (!shm->name) {
+        LOG_OOM();
+        return false;
+    }
+
+    int fd = shm_open(shm->name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        LOGE("Could not create shared memory \"%s\": %s", shm->name,
+             strerror(errno));
+        goto error_free_name;
+    }
+
+    if (ftruncate(fd, size)) {
+        LOGE("Could not resize shared memory \"%s\": %s", shm->name,
+             strerror(errno));
+        goto error_unlink;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        LOGE("Could not map shared memory \"%s\": %s", shm->name,
+             strerror(errno));
+        goto error_unlink;
+    }
+
+    // The mapping remains valid after the file descriptor is closed
+    close(fd);
+
+    shm->data = data;
+    shm->size = size;
+
+    return true;
+
+error_unlink:
+    close(fd);
+    shm_unlink(shm->name);
+error_free_name:
+    free(shm->name);
+
+    return false;
+}
+
+void
+sc_shm_destroy(struct sc_shm *shm) {
+    munmap(shm->data, shm->size);
+    shm_unlink(shm->name);
+    free(shm->name);
+}
@@ -41,3 +41,57 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+FILE *
+sc_file_open(const char *path, const char *mode) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    wchar_t *wide_mode = sc_str_to_wchars(mode);
+    if (!wide_mode) {
+        LOG_OOM();
+        free(wide_path);
+        return NULL;
+    }
+
+    FILE *file = _wfopen(wide_path, wide_mode);
+    free(wide_mode);
+    free(wide_path);
+    return file;
+}
+
+bool
+sc_file_remove(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    int r = _wremove(wide_path);
+    free(wide_path);
+    return !r;
+}
+
+bool
+sc_file_replace(const char *from, const char *to) {
+    wchar_t *wide_from = sc_str_to_wchars(from);
+    if (!wide_from) {
+        LOG_OOM();
+        return false;
+    }
+
+    wchar_t *wide_to = sc_str_to_wchars(to);
+    if (!wide_to) {
+        LOG_OOM();
+        free(wide_from);
+        return false;
+    }
+
+    BOOL ok = MoveFileExW(wide_from, wide_to, MOVEFILE_REPLACE_EXISTING);
+    free(wide_from);
+    free(wide_to);
+    return ok;
+}
@@ -1,6 +1,7 @@
 #include "util/process.h"
 
 #include <processthreadsapi.h>
+#include <psapi.h>
 
 #include <assert.h>
 
@@ -243,6 +244,50 @@ sc_process_close(HANDLE handle) {
     (void) closed;
 }
 
+static sc_tick
+sc_filetime_to_tick(const FILETIME *ft) {
+    // In units of 100 ns
+    uint64_t value = ((uint64_t) ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+    return SC_TICK_FROM_NS(value * 100);
+}
+
+bool
+sc_process_get_cpu_time(sc_tick *cpu_time) {
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time,
+                         &kernel_time, &user_time)) {
+        LOGE("Could not get the process CPU time");
+        return false;
+    }
+
+    *cpu_time = sc_filetime_to_tick(&kernel_time)
+              + sc_filetime_to_tick(&user_time);
+    return true;
+}
+
+bool
+sc_process_get_rss(uint64_t *rss) {
+    PROCESS_MEMORY_COUNTERS counters;
+    // K32GetProcessMemoryInfo() is exported by kernel32 (no need to link
+    // psapi)
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                 sizeof(counters))) {
+        return false;
+    }
+
+    *rss = counters.WorkingSetSize;
+    return true;
+}
+
+bool
+sc_process_get_allocated(uint64_t *allocated) {
+    (void) allocated;
+    return false;
+}
+
 ssize_t
 sc_pipe_read(HANDLE pipe, char *data, size_t len) {
     DWORD r;
@@ -0,0 +1,27 @@
+#include "util/random.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <windows.h>
+#include <bcrypt.h>
+
+#include "util/log.h"
+
+bool
+sc_random_bytes(void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len) {
+        ULONG chunk = len > ULONG_MAX ? ULONG_MAX : (ULONG) len;
+        NTSTATUS status = BCryptGenRandom(NULL, p, chunk,
+                                          BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+        if (!BCRYPT_SUCCESS(status)) {
+            LOGE("Could not generate random bytes: 0x%lx",
+                 (unsigned long) status);
+            return false;
+        }
+        p += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
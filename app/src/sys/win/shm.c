@@ -0,0 +1,55 @@
+#include "util/shm.h"
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+#include "util/str.h"
+
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size) {
+    wchar_t *wide_name = sc_str_to_wchars(name);
+    if (!wide_name) {
+        LOG_OOM();
+        return false;
+    }
+
+    uint64_t size64 = size;
+    HANDLE handle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+                                       PAGE_READWRITE, size64 >> 32,
+                                       size64 & 0xFFFFFFFF, wide_name);
+    free(wide_name);
+    if (!handle) {
+        LOGE("Could not create shared memory \"%s\" (error %lu)", name,
+             GetLastError());
+        return false;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        LOGE("Shared memory \"%s\" already exists", name);
+        CloseHandle(handle);
+        return false;
+    }
+
+    void *data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!data) {
+        LOGE("Could not map shared memory \"%s\" (error %lu)", name,
+             GetLastError());
+        CloseHandle(handle);
+        return false;
+    }
+
+    shm->data = data;
+    shm->size = size;
+    shm->handle = handle;
+
+    return true;
+}
+
+void
+sc_shm_destroy(struct sc_shm *shm) {
+    UnmapViewOfFile(shm->data);
+    CloseHandle(shm->handle);
+}
@@ -0,0 +1,150 @@
+#include "thumbnail_sink.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/str.h"
+
+/** Downcast frame_sink to sc_thumbnail_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_thumbnail_sink, frame_sink)
+
+static void
+sc_thumbnail_sink_compute_size(struct sc_thumbnail_sink *ts, int width,
+                               int height, int *out_width, int *out_height) {
+    int max_dim = MAX(width, height);
+    if (max_dim > ts->size) {
+        // Downscale, preserving the aspect ratio
+        width = (int64_t) width * ts->size / max_dim;
+        height = (int64_t) height * ts->size / max_dim;
+    }
+
+    // YUV 4:2:0 requires even dimensions
+    *out_width = MAX(2, width & ~1);
+    *out_height = MAX(2, height & ~1);
+}
+
+static bool
+sc_thumbnail_sink_write_file(struct sc_thumbnail_sink *ts) {
+    if (!sc_image_encoder_write_file(&ts->encoder, ts->tmp_filename)) {
+        return false;
+    }
+
+    return sc_file_replace(ts->tmp_filename, ts->filename);
+}
+
+static bool
+sc_thumbnail_sink_write(struct sc_thumbnail_sink *ts, const AVFrame *frame) {
+    int width;
+    int height;
+    sc_thumbnail_sink_compute_size(ts, frame->width, frame->height, &width,
+                                   &height);
+
+    return sc_image_encoder_encode(&ts->encoder, frame, width, height);
+}
+
+static bool
+sc_thumbnail_sink_frame_sink_open(struct sc_frame_sink *sink,
+                                  const AVCodecContext *ctx) {
+    struct sc_thumbnail_sink *ts = DOWNCAST(sink);
+    (void) ctx;
+
+    if (!sc_image_encoder_init(&ts->encoder, ts->format, "Thumbnail")) {
+        return false;
+    }
+
+    ts->next_tick = 0;
+    ts->failed = false;
+    ts->write_error_logged = false;
+
+    return true;
+}
+
+static void
+sc_thumbnail_sink_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_thumbnail_sink *ts = DOWNCAST(sink);
+
+    sc_image_encoder_destroy(&ts->encoder);
+}
+
+static bool
+sc_thumbnail_sink_frame_sink_push(struct sc_frame_sink *sink,
+                                  const AVFrame *frame) {
+    struct sc_thumbnail_sink *ts = DOWNCAST(sink);
+
+    if (ts->failed) {
+        // Do not stop the mirroring
+        return true;
+    }
+
+    sc_tick now = sc_tick_now();
+    if (now < ts->next_tick) {
+        // Too early, drop the frame
+        return true;
+    }
+
+    if (!sc_thumbnail_sink_write(ts, frame)) {
+        LOGE("Thumbnail: disabled");
+        ts->failed = true;
+        return true;
+    }
+
+    ts->next_tick = now + ts->interval;
+
+    bool ok = sc_thumbnail_sink_write_file(ts);
+    av_packet_unref(ts->encoder.packet);
+    if (!ok) {
+        // The destination may be temporarily unavailable, retry on the next
+        // interval, but do not flood the console
+        if (!ts->write_error_logged) {
+            LOGW("Thumbnail: could not write %s", ts->filename);
+            ts->write_error_logged = true;
+        }
+    } else {
+        ts->write_error_logged = false;
+    }
+
+    return true;
+}
+
+bool
+sc_thumbnail_sink_init(struct sc_thumbnail_sink *ts, const char *filename,
+                       enum sc_thumbnail_format format, uint16_t size,
+                       sc_tick interval) {
+    assert(size >= 2);
+
+    ts->filename = strdup(filename);
+    if (!ts->filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    ts->tmp_filename = sc_str_concat(filename, ".tmp");
+    if (!ts->tmp_filename) {
+        LOG_OOM();
+        free(ts->filename);
+        return false;
+    }
+
+    ts->format = format;
+    ts->size = size;
+    ts->interval = interval;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_thumbnail_sink_frame_sink_open,
+        .close = sc_thumbnail_sink_frame_sink_close,
+        .push = sc_thumbnail_sink_frame_sink_push,
+    };
+
+    ts->frame_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_thumbnail_sink_destroy(struct sc_thumbnail_sink *ts) {
+    free(ts->tmp_filename);
+    free(ts->filename);
+}
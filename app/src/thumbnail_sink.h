@@ -0,0 +1,49 @@
+#ifndef SC_THUMBNAIL_SINK_H
+#define SC_THUMBNAIL_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "image_encoder.h"
+#include "options.h"
+#include "trait/frame_sink.h"
+#include "util/tick.h"
+
+/**
+ * Frame sink writing a downscaled snapshot of the video to an image file at
+ * most once per interval (for monitoring dashboards)
+ *
+ * The file is replaced atomically, so that a reader (for example an HTTP
+ * server) never sees a partially written image.
+ *
+ * The images are encoded synchronously, so it is expected to be fed by a frame
+ * queue running on its own thread.
+ */
+struct sc_thumbnail_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    char *filename;
+    char *tmp_filename;
+    enum sc_thumbnail_format format;
+    uint16_t size; // maximum dimension
+    sc_tick interval;
+
+    sc_tick next_tick; // no thumbnail before this time
+
+    struct sc_image_encoder encoder;
+
+    // Set if the encoder could not be open, no thumbnail is written anymore
+    bool failed;
+    bool write_error_logged;
+};
+
+bool
+sc_thumbnail_sink_init(struct sc_thumbnail_sink *ts, const char *filename,
+                       enum sc_thumbnail_format format, uint16_t size,
+                       sc_tick interval);
+
+void
+sc_thumbnail_sink_destroy(struct sc_thumbnail_sink *ts);
+
+#endif
@@ -0,0 +1,193 @@
+#include "timer_service.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "util/log.h"
+
+// Must be called with the mutex locked
+static struct sc_timer *
+sc_timer_service_next(struct sc_timer_service *service) {
+    sc_mutex_assert(&service->mutex);
+
+    struct sc_timer *next = NULL;
+    for (unsigned i = 0; i < service->count; ++i) {
+        struct sc_timer *timer = service->timers[i];
+        if (timer->deadline != SC_TIMER_NEVER
+                && (!next || timer->deadline < next->deadline)) {
+            next = timer;
+        }
+    }
+
+    return next;
+}
+
+static int
+run_timer_service(void *data) {
+    struct sc_timer_service *service = data;
+
+    sc_mutex_lock(&service->mutex);
+
+    for (;;) {
+        if (service->stopped) {
+            break;
+        }
+
+        struct sc_timer *timer = sc_timer_service_next(service);
+        if (!timer) {
+            sc_cond_wait(&service->cond, &service->mutex);
+            continue;
+        }
+
+        sc_tick now = sc_tick_now();
+        if (timer->deadline > now) {
+            sc_cond_timedwait(&service->cond, &service->mutex,
+                              timer->deadline);
+            continue;
+        }
+
+        // If the timer is scheduled while its callback is running, the new
+        // deadline must not be lost
+        timer->deadline = SC_TIMER_NEVER;
+        service->running = timer;
+        sc_mutex_unlock(&service->mutex);
+
+        sc_tick next = timer->fn(timer, now, timer->userdata);
+
+        sc_mutex_lock(&service->mutex);
+        service->running = NULL;
+        if (next < timer->deadline) {
+            timer->deadline = next;
+        }
+        sc_cond_broadcast(&service->idle_cond);
+    }
+
+    sc_mutex_unlock(&service->mutex);
+
+    LOGD("Timer service thread ended");
+
+    return 0;
+}
+
+bool
+sc_timer_service_init(struct sc_timer_service *service) {
+    bool ok = sc_mutex_init(&service->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&service->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&service->idle_cond);
+    if (!ok) {
+        goto error_destroy_cond;
+    }
+
+    service->count = 0;
+    service->running = NULL;
+    service->stopped = false;
+
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&service->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&service->mutex);
+
+    return false;
+}
+
+void
+sc_timer_service_destroy(struct sc_timer_service *service) {
+    assert(!service->count);
+
+    sc_cond_destroy(&service->idle_cond);
+    sc_cond_destroy(&service->cond);
+    sc_mutex_destroy(&service->mutex);
+}
+
+bool
+sc_timer_service_start(struct sc_timer_service *service) {
+    LOGD("Starting timer service thread");
+
+    bool ok = sc_thread_create(&service->thread, run_timer_service,
+                               "scrcpy-timer", service);
+    if (!ok) {
+        LOGE("Could not start timer service thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_timer_service_stop(struct sc_timer_service *service) {
+    sc_mutex_lock(&service->mutex);
+    service->stopped = true;
+    sc_cond_signal(&service->cond);
+    sc_mutex_unlock(&service->mutex);
+}
+
+void
+sc_timer_service_join(struct sc_timer_service *service) {
+    sc_thread_join(&service->thread, NULL);
+}
+
+bool
+sc_timer_service_add(struct sc_timer_service *service, struct sc_timer *timer,
+                     sc_timer_fn fn, void *userdata) {
+    assert(fn);
+
+    timer->fn = fn;
+    timer->userdata = userdata;
+    timer->deadline = SC_TIMER_NEVER;
+
+    sc_mutex_lock(&service->mutex);
+    if (service->count == SC_TIMER_SERVICE_MAX_TIMERS) {
+        sc_mutex_unlock(&service->mutex);
+        LOGE("Too many timers");
+        return false;
+    }
+    service->timers[service->count++] = timer;
+    sc_mutex_unlock(&service->mutex);
+
+    return true;
+}
+
+void
+sc_timer_service_remove(struct sc_timer_service *service,
+                        struct sc_timer *timer) {
+    sc_mutex_lock(&service->mutex);
+
+    while (service->running == timer) {
+        sc_cond_wait(&service->idle_cond, &service->mutex);
+    }
+
+    for (unsigned i = 0; i < service->count; ++i) {
+        if (service->timers[i] == timer) {
+            // The order of the timers does not matter
+            service->timers[i] = service->timers[--service->count];
+            break;
+        }
+    }
+
+    sc_mutex_unlock(&service->mutex);
+}
+
+void
+sc_timer_service_schedule(struct sc_timer_service *service,
+                          struct sc_timer *timer, sc_tick deadline) {
+    sc_mutex_lock(&service->mutex);
+    if (deadline < timer->deadline) {
+        timer->deadline = deadline;
+        // Do not wake up the thread while the callback is running, the
+        // deadline will be taken into account once it returns
+        if (service->running != timer) {
+            sc_cond_signal(&service->cond);
+        }
+    }
+    sc_mutex_unlock(&service->mutex);
+}
@@ -0,0 +1,100 @@
+#ifndef SC_TIMER_SERVICE_H
+#define SC_TIMER_SERVICE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define SC_TIMER_SERVICE_MAX_TIMERS 8
+
+// Deadline of a timer which is not scheduled
+#define SC_TIMER_NEVER INT64_MAX
+
+struct sc_timer;
+
+/**
+ * Callback called from the timer thread once the deadline of the timer is
+ * reached.
+ *
+ * The thread is shared by all the timers of the service, so a slow callback
+ * delays all the others: it must not block, and it must only hand the data
+ * over to another thread (never decode, encode or write it). It returns the
+ * next deadline of the timer, or SC_TIMER_NEVER to wait until it is scheduled
+ * again.
+ */
+typedef sc_tick (*sc_timer_fn)(struct sc_timer *timer, sc_tick now,
+                               void *userdata);
+
+struct sc_timer {
+    sc_timer_fn fn;
+    void *userdata;
+    sc_tick deadline; // protected by the service mutex
+};
+
+/**
+ * A timer service calls the callbacks of all its timers at their deadlines,
+ * from a single thread.
+ *
+ * This avoids to run one thread per component which needs to release data at
+ * a given time.
+ */
+struct sc_timer_service {
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond; // signaled when a deadline changes or on stop
+    sc_cond idle_cond; // signaled when a callback returns
+
+    struct sc_timer *timers[SC_TIMER_SERVICE_MAX_TIMERS];
+    unsigned count;
+    struct sc_timer *running; // the timer whose callback is running
+    bool stopped;
+};
+
+bool
+sc_timer_service_init(struct sc_timer_service *service);
+
+void
+sc_timer_service_destroy(struct sc_timer_service *service);
+
+bool
+sc_timer_service_start(struct sc_timer_service *service);
+
+void
+sc_timer_service_stop(struct sc_timer_service *service);
+
+void
+sc_timer_service_join(struct sc_timer_service *service);
+
+/**
+ * Register a timer (initially not scheduled)
+ *
+ * It may be called from any thread, before or after the service is started.
+ */
+bool
+sc_timer_service_add(struct sc_timer_service *service, struct sc_timer *timer,
+                     sc_timer_fn fn, void *userdata);
+
+/**
+ * Unregister a timer
+ *
+ * If its callback is running, wait for it to return. Therefore, it must not be
+ * called from the callback itself.
+ */
+void
+sc_timer_service_remove(struct sc_timer_service *service,
+                        struct sc_timer *timer);
+
+/**
+ * Call the timer callback at deadline at the latest
+ *
+ * If the timer is already scheduled earlier, this has no effect.
+ */
+void
+sc_timer_service_schedule(struct sc_timer_service *service,
+                          struct sc_timer *timer, sc_tick deadline);
+
+#endif
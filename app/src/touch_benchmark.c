@@ -0,0 +1,349 @@
+#include "touch_benchmark.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/pixfmt.h>
+
+#include "control_msg.h"
+#include "util/log.h"
+
+/** Downcast frame sink to sc_touch_benchmark */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_touch_benchmark, frame_sink)
+
+static int
+compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+// The samples must be sorted
+static double
+get_percentile_ms(const struct sc_touch_benchmark_samples *samples,
+                  unsigned p) {
+    assert(samples->size);
+    assert(p <= 100);
+    size_t index = (samples->size - 1) * p / 100;
+    return (double) samples->data[index] * 1000 / SC_TICK_FREQ;
+}
+
+// Side of the square region observed at the center of the frame
+static unsigned
+get_region_side(int width, int height) {
+    int side = MIN(width, height) / 16;
+    return CLAMP(side, 1, SC_TOUCH_BENCHMARK_REGION_MAX);
+}
+
+static void
+copy_region(uint8_t *dst, const AVFrame *frame, unsigned side) {
+    // For both YUV420P and NV12, the first plane contains the 8-bit luma
+    int x = (frame->width - (int) side) / 2;
+    int y = (frame->height - (int) side) / 2;
+    const uint8_t *src = frame->data[0] + y * frame->linesize[0] + x;
+    for (unsigned i = 0; i < side; ++i) {
+        memcpy(dst, src, side);
+        dst += side;
+        src += frame->linesize[0];
+    }
+}
+
+static bool
+has_changed(const uint8_t *region, const uint8_t *reference, unsigned count) {
+    unsigned changed = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        if (abs((int) region[i] - (int) reference[i])
+                >= SC_TOUCH_BENCHMARK_SAMPLE_THRESHOLD) {
+            ++changed;
+        }
+    }
+    return changed * SC_TOUCH_BENCHMARK_REGION_THRESHOLD >= count;
+}
+
+static bool
+sc_touch_benchmark_frame_sink_open(struct sc_frame_sink *sink,
+                                   const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+sc_touch_benchmark_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_touch_benchmark_frame_sink_push(struct sc_frame_sink *sink,
+                                   const AVFrame *frame) {
+    struct sc_touch_benchmark *benchmark = DOWNCAST(sink);
+
+    sc_tick now = sc_tick_now();
+
+    if (frame->format != AV_PIX_FMT_YUV420P
+            && frame->format != AV_PIX_FMT_NV12) {
+        if (!benchmark->format_warned) {
+            LOGW("Touch benchmark: unsupported frame format: %d",
+                 frame->format);
+            benchmark->format_warned = true;
+        }
+        return true;
+    }
+
+    unsigned side = get_region_side(frame->width, frame->height);
+
+    sc_mutex_lock(&benchmark->mutex);
+    bool size_changed = benchmark->has_frame
+                     && (frame->width != benchmark->width
+                         || frame->height != benchmark->height);
+    if (size_changed && benchmark->armed) {
+        // The reference and the tap position are not valid anymore
+        benchmark->aborted = true;
+        sc_cond_signal(&benchmark->cond);
+    }
+
+    copy_region(benchmark->region, frame, side);
+    benchmark->width = frame->width;
+    benchmark->height = frame->height;
+    if (!benchmark->has_frame) {
+        benchmark->has_frame = true;
+        sc_cond_signal(&benchmark->cond);
+    }
+
+    if (benchmark->armed && !benchmark->detected && !benchmark->aborted) {
+        if (has_changed(benchmark->region, benchmark->reference,
+                        side * side)) {
+            benchmark->detected = true;
+            benchmark->detection_date = now;
+            sc_cond_signal(&benchmark->cond);
+        }
+    }
+    sc_mutex_unlock(&benchmark->mutex);
+
+    // The frame is not retained
+    return true;
+}
+
+static void
+sc_touch_benchmark_inject(struct sc_touch_benchmark *benchmark,
+                          enum android_motionevent_action action,
+                          struct sc_size size) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = action,
+            .pointer_id = SC_POINTER_ID_GENERIC_FINGER,
+            .position = {
+                .screen_size = size,
+                .point = {
+                    .x = size.width / 2,
+                    .y = size.height / 2,
+                },
+            },
+            .pressure = action == AMOTION_EVENT_ACTION_DOWN ? 1.f : 0.f,
+            .buttons = 0,
+        },
+    };
+
+    if (!sc_controller_push_msg(benchmark->controller, &msg)) {
+        LOGW("Could not request 'inject touch event'");
+    }
+}
+
+static void
+sc_touch_benchmark_report(struct sc_touch_benchmark *benchmark) {
+    struct sc_touch_benchmark_samples *samples = &benchmark->latencies;
+    unsigned done = samples->size + benchmark->missed;
+    if (!done) {
+        LOGW("Touch benchmark: no trial done");
+        return;
+    }
+
+    LOGI("Touch benchmark: %u trials, %u missed", done, benchmark->missed);
+    if (!samples->size) {
+        LOGW("Touch benchmark: no visible effect detected, is the tap "
+             "position covered by the video?");
+        return;
+    }
+
+    sc_tick total = 0;
+    for (size_t i = 0; i < samples->size; ++i) {
+        total += samples->data[i];
+    }
+
+    qsort(samples->data, samples->size, sizeof(*samples->data),
+          compare_ticks);
+
+    LOGI("    Touch-to-frame latency: avg %.1f ms, min %.1f ms, "
+         "p50 %.1f ms, p90 %.1f ms, max %.1f ms",
+         (double) total * 1000 / SC_TICK_FREQ / samples->size,
+         get_percentile_ms(samples, 0), get_percentile_ms(samples, 50),
+         get_percentile_ms(samples, 90), get_percentile_ms(samples, 100));
+}
+
+// Wait until the deadline, with the mutex held
+//
+// Return false if the benchmark has been stopped.
+static bool
+sc_touch_benchmark_sleep(struct sc_touch_benchmark *benchmark,
+                         sc_tick deadline) {
+    while (!benchmark->stopped && sc_tick_now() < deadline) {
+        sc_cond_timedwait(&benchmark->cond, &benchmark->mutex, deadline);
+    }
+    return !benchmark->stopped;
+}
+
+static int
+run_touch_benchmark(void *data) {
+    struct sc_touch_benchmark *benchmark = data;
+
+    LOGI("Touch benchmark started (%u trials)", benchmark->trials);
+
+    for (unsigned i = 0; i < benchmark->trials; ++i) {
+        sc_mutex_lock(&benchmark->mutex);
+        while (!benchmark->stopped && !benchmark->has_frame) {
+            sc_cond_wait(&benchmark->cond, &benchmark->mutex);
+        }
+
+        sc_tick deadline = sc_tick_now() + SC_TOUCH_BENCHMARK_SETTLE;
+        if (!sc_touch_benchmark_sleep(benchmark, deadline)) {
+            sc_mutex_unlock(&benchmark->mutex);
+            break;
+        }
+
+        memcpy(benchmark->reference, benchmark->region,
+               sizeof(benchmark->reference));
+        struct sc_size size = {
+            .width = benchmark->width,
+            .height = benchmark->height,
+        };
+        benchmark->armed = true;
+        benchmark->detected = false;
+        benchmark->aborted = false;
+        sc_tick tap_date = sc_tick_now();
+        sc_mutex_unlock(&benchmark->mutex);
+
+        sc_touch_benchmark_inject(benchmark, AMOTION_EVENT_ACTION_DOWN, size);
+
+        sc_mutex_lock(&benchmark->mutex);
+        deadline = tap_date + SC_TOUCH_BENCHMARK_TIMEOUT;
+        while (!benchmark->stopped && !benchmark->detected
+                && !benchmark->aborted && sc_tick_now() < deadline) {
+            sc_cond_timedwait(&benchmark->cond, &benchmark->mutex, deadline);
+        }
+        benchmark->armed = false;
+        bool stopped = benchmark->stopped;
+        bool detected = benchmark->detected;
+        bool aborted = benchmark->aborted;
+        sc_tick detection_date = benchmark->detection_date;
+        sc_mutex_unlock(&benchmark->mutex);
+
+        sc_touch_benchmark_inject(benchmark, AMOTION_EVENT_ACTION_UP, size);
+
+        if (stopped) {
+            break;
+        }
+
+        if (detected) {
+            sc_tick latency = detection_date - tap_date;
+            LOGD("Touch benchmark: trial %u: %.1f ms", i + 1,
+                 (double) latency * 1000 / SC_TICK_FREQ);
+            if (!sc_vector_push(&benchmark->latencies, latency)) {
+                LOG_OOM();
+                break;
+            }
+        } else {
+            LOGD("Touch benchmark: trial %u: %s", i + 1,
+                 aborted ? "video size changed" : "no visible effect");
+            ++benchmark->missed;
+        }
+
+        if (i + 1 == benchmark->trials) {
+            benchmark->cbs->on_end(benchmark, benchmark->cbs_userdata);
+        }
+    }
+
+    return 0;
+}
+
+bool
+sc_touch_benchmark_init(struct sc_touch_benchmark *benchmark,
+                        struct sc_controller *controller, unsigned trials,
+                        const struct sc_touch_benchmark_callbacks *cbs,
+                        void *cbs_userdata) {
+    assert(controller);
+    assert(trials);
+    assert(cbs && cbs->on_end);
+
+    bool ok = sc_mutex_init(&benchmark->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&benchmark->cond);
+    if (!ok) {
+        sc_mutex_destroy(&benchmark->mutex);
+        return false;
+    }
+
+    benchmark->controller = controller;
+    benchmark->trials = trials;
+    benchmark->stopped = false;
+    benchmark->has_frame = false;
+    benchmark->width = 0;
+    benchmark->height = 0;
+    benchmark->format_warned = false;
+    benchmark->armed = false;
+    benchmark->detected = false;
+    benchmark->aborted = false;
+    benchmark->detection_date = 0;
+    sc_vector_init(&benchmark->latencies);
+    benchmark->missed = 0;
+    benchmark->cbs = cbs;
+    benchmark->cbs_userdata = cbs_userdata;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_touch_benchmark_frame_sink_open,
+        .close = sc_touch_benchmark_frame_sink_close,
+        .push = sc_touch_benchmark_frame_sink_push,
+    };
+
+    benchmark->frame_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_touch_benchmark_destroy(struct sc_touch_benchmark *benchmark) {
+    sc_vector_destroy(&benchmark->latencies);
+    sc_cond_destroy(&benchmark->cond);
+    sc_mutex_destroy(&benchmark->mutex);
+}
+
+bool
+sc_touch_benchmark_start(struct sc_touch_benchmark *benchmark) {
+    LOGD("Starting touch benchmark thread");
+
+    bool ok = sc_thread_create(&benchmark->thread, run_touch_benchmark,
+                               "scrcpy-touch", benchmark);
+    if (!ok) {
+        LOGE("Could not start touch benchmark thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_touch_benchmark_stop(struct sc_touch_benchmark *benchmark) {
+    sc_mutex_lock(&benchmark->mutex);
+    benchmark->stopped = true;
+    sc_cond_signal(&benchmark->cond);
+    sc_mutex_unlock(&benchmark->mutex);
+}
+
+void
+sc_touch_benchmark_join(struct sc_touch_benchmark *benchmark) {
+    sc_thread_join(&benchmark->thread, NULL);
+    sc_touch_benchmark_report(benchmark);
+}
@@ -0,0 +1,106 @@
+#ifndef SC_TOUCH_BENCHMARK_H
+#define SC_TOUCH_BENCHMARK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "controller.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+// Maximum side of the square region observed around the tap position
+#define SC_TOUCH_BENCHMARK_REGION_MAX 64
+// Delay before each tap, for the screen to settle
+#define SC_TOUCH_BENCHMARK_SETTLE SC_TICK_FROM_SEC(1)
+// A tap without visible change within this delay is counted as missed
+#define SC_TOUCH_BENCHMARK_TIMEOUT SC_TICK_FROM_SEC(2)
+// A luma sample of the region has changed if it differs by at least this value
+// from the frame before the tap (to ignore the compression noise)
+#define SC_TOUCH_BENCHMARK_SAMPLE_THRESHOLD 32
+// The region has changed if at least this fraction (1/N) of its samples have
+// changed (the pointer location crosshair is only a few pixels wide)
+#define SC_TOUCH_BENCHMARK_REGION_THRESHOLD 64
+
+struct sc_touch_benchmark_samples SC_VECTOR(sc_tick);
+
+/**
+ * Measure the latency from a tap injected on the device to its visible effect
+ * in the decoded video (--benchmark-touch)
+ *
+ * For each trial, it injects a tap at the center of the screen through the
+ * controller, and waits for the luma of a small region around the tap
+ * position to change in the decoded frames. The effect is the pointer location
+ * overlay drawn by the device (the "pointer location" developer option,
+ * enabled by the server).
+ *
+ * It must be added as a frame sink of the video decoder. The results are
+ * printed when all the trials are done.
+ */
+struct sc_touch_benchmark {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    struct sc_controller *controller;
+    unsigned trials;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    // The following fields are protected by the mutex
+
+    // Luma samples of the region in the last frame
+    uint8_t region[SC_TOUCH_BENCHMARK_REGION_MAX
+                       * SC_TOUCH_BENCHMARK_REGION_MAX];
+    // Luma samples of the region in the last frame before the tap
+    uint8_t reference[SC_TOUCH_BENCHMARK_REGION_MAX
+                          * SC_TOUCH_BENCHMARK_REGION_MAX];
+    bool has_frame;
+    int width;
+    int height;
+    bool format_warned;
+
+    // Set while waiting for the effect of a tap
+    bool armed;
+    bool detected;
+    // Set if the frame size changed during the trial
+    bool aborted;
+    sc_tick detection_date;
+
+    // The following fields are only accessed from the benchmark thread
+    struct sc_touch_benchmark_samples latencies;
+    unsigned missed;
+
+    const struct sc_touch_benchmark_callbacks *cbs;
+    void *cbs_userdata;
+};
+
+struct sc_touch_benchmark_callbacks {
+    // Called from the benchmark thread once all the trials are done
+    void (*on_end)(struct sc_touch_benchmark *benchmark, void *userdata);
+};
+
+bool
+sc_touch_benchmark_init(struct sc_touch_benchmark *benchmark,
+                        struct sc_controller *controller, unsigned trials,
+                        const struct sc_touch_benchmark_callbacks *cbs,
+                        void *cbs_userdata);
+
+void
+sc_touch_benchmark_destroy(struct sc_touch_benchmark *benchmark);
+
+bool
+sc_touch_benchmark_start(struct sc_touch_benchmark *benchmark);
+
+void
+sc_touch_benchmark_stop(struct sc_touch_benchmark *benchmark);
+
+void
+sc_touch_benchmark_join(struct sc_touch_benchmark *benchmark);
+
+#endif
@@ -0,0 +1,250 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__linux__) || defined(__APPLE__)
+# include <pthread.h>
+#endif
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/thread.h"
+
+#define SC_TRACE_CHUNK_CAPACITY 4096
+// Limit the memory used by each thread (about 12 MB)
+#define SC_TRACE_MAX_CHUNKS 128
+#define SC_TRACE_THREAD_NAME_MAX 16
+
+struct sc_trace_span {
+    const char *name;
+    sc_tick begin;
+    sc_tick duration;
+};
+
+struct sc_trace_chunk {
+    struct sc_trace_chunk *next;
+    unsigned count;
+    struct sc_trace_span spans[SC_TRACE_CHUNK_CAPACITY];
+};
+
+// Only accessed by its own thread until it is joined
+struct sc_trace_thread {
+    struct sc_trace_thread *next;
+    sc_thread_id tid;
+    char name[SC_TRACE_THREAD_NAME_MAX];
+    struct sc_trace_chunk *head;
+    struct sc_trace_chunk *tail;
+    unsigned chunk_count;
+    uint64_t dropped;
+};
+
+static atomic_bool sc_trace_enabled;
+static sc_tick sc_trace_origin; // written before enabling
+// Lock-free stack of all the threads which recorded spans
+static _Atomic(struct sc_trace_thread *) sc_trace_threads;
+static _Thread_local struct sc_trace_thread *sc_trace_current;
+
+void
+sc_trace_enable(void) {
+    sc_trace_origin = sc_tick_now();
+    atomic_store(&sc_trace_enabled, true);
+}
+
+sc_tick
+sc_trace_begin(void) {
+    if (!atomic_load_explicit(&sc_trace_enabled, memory_order_relaxed)) {
+        return 0;
+    }
+
+    return sc_tick_now();
+}
+
+static void
+sc_trace_get_thread_name(char *name) {
+#if defined(__linux__) || defined(__APPLE__)
+    // The threads are named by SDL_CreateThread()
+    if (!pthread_getname_np(pthread_self(), name, SC_TRACE_THREAD_NAME_MAX)) {
+        return;
+    }
+#endif
+    name[0] = '\0';
+}
+
+static struct sc_trace_thread *
+sc_trace_register_thread(void) {
+    struct sc_trace_thread *thread = malloc(sizeof(*thread));
+    if (!thread) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    thread->tid = sc_thread_get_id();
+    sc_trace_get_thread_name(thread->name);
+    thread->head = NULL;
+    thread->tail = NULL;
+    thread->chunk_count = 0;
+    thread->dropped = 0;
+
+    thread->next = atomic_load_explicit(&sc_trace_threads,
+                                        memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&sc_trace_threads,
+                                                  &thread->next, thread,
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+        // thread->next has been updated, retry
+    }
+
+    return thread;
+}
+
+static struct sc_trace_span *
+sc_trace_alloc_span(struct sc_trace_thread *thread) {
+    struct sc_trace_chunk *tail = thread->tail;
+    if (tail && tail->count < SC_TRACE_CHUNK_CAPACITY) {
+        return &tail->spans[tail->count++];
+    }
+
+    if (thread->chunk_count == SC_TRACE_MAX_CHUNKS) {
+        ++thread->dropped;
+        return NULL;
+    }
+
+    struct sc_trace_chunk *chunk = malloc(sizeof(*chunk));
+    if (!chunk) {
+        LOG_OOM();
+        ++thread->dropped;
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->count = 1;
+    if (tail) {
+        tail->next = chunk;
+    } else {
+        thread->head = chunk;
+    }
+    thread->tail = chunk;
+    ++thread->chunk_count;
+
+    return &chunk->spans[0];
+}
+
+void
+sc_trace_end(const char *name, sc_tick begin) {
+    if (!begin
+            || !atomic_load_explicit(&sc_trace_enabled, memory_order_relaxed)) {
+        // Tracing is disabled (or the trace has already been written)
+        return;
+    }
+
+    sc_tick now = sc_tick_now();
+
+    struct sc_trace_thread *thread = sc_trace_current;
+    if (!thread) {
+        thread = sc_trace_register_thread();
+        if (!thread) {
+            return;
+        }
+        sc_trace_current = thread;
+    }
+
+    struct sc_trace_span *span = sc_trace_alloc_span(thread);
+    if (span) {
+        span->name = name;
+        span->begin = begin;
+        span->duration = now - begin;
+    }
+}
+
+static void
+sc_trace_write_thread_name(FILE *file, struct sc_trace_thread *thread) {
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%u,\"args\":{\"name\":\"", thread->tid);
+    for (const char *c = thread->name; *c; ++c) {
+        // Do not bother escaping, the thread names are controlled by scrcpy
+        bool valid = *c >= ' ' && *c != '"' && *c != '\\';
+        fputc(valid ? *c : '_', file);
+    }
+    fputs("\"}}", file);
+}
+
+static bool
+sc_trace_write_file(FILE *file, struct sc_trace_thread *threads) {
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+    bool first = true;
+    for (struct sc_trace_thread *t = threads; t; t = t->next) {
+        if (t->name[0]) {
+            fputs(first ? "" : ",\n", file);
+            sc_trace_write_thread_name(file, t);
+            first = false;
+        }
+
+        for (struct sc_trace_chunk *c = t->head; c; c = c->next) {
+            for (unsigned i = 0; i < c->count; ++i) {
+                struct sc_trace_span *span = &c->spans[i];
+                sc_tick ts = SC_TICK_TO_US(span->begin - sc_trace_origin);
+                sc_tick dur = SC_TICK_TO_US(span->duration);
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                              "\"tid\":%u,\"ts\":%" PRItick ",\"dur\":%"
+                              PRItick "}",
+                        first ? "" : ",\n", span->name, t->tid, ts, dur);
+                first = false;
+            }
+        }
+    }
+
+    fputs("\n]}\n", file);
+
+    return !ferror(file);
+}
+
+bool
+sc_trace_write(const char *filename) {
+    atomic_store(&sc_trace_enabled, false);
+
+    struct sc_trace_thread *threads =
+        atomic_exchange_explicit(&sc_trace_threads, NULL,
+                                 memory_order_acquire);
+
+    bool ok = false;
+    FILE *file = sc_file_open(filename, "w");
+    if (file) {
+        ok = sc_trace_write_file(file, threads);
+        if (fclose(file)) {
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        LOGI("Trace written to %s", filename);
+    } else {
+        LOGE("Could not write trace file: %s", filename);
+    }
+
+    uint64_t dropped = 0;
+    struct sc_trace_thread *t = threads;
+    while (t) {
+        dropped += t->dropped;
+
+        struct sc_trace_chunk *c = t->head;
+        while (c) {
+            struct sc_trace_chunk *next_chunk = c->next;
+            free(c);
+            c = next_chunk;
+        }
+
+        struct sc_trace_thread *next = t->next;
+        free(t);
+        t = next;
+    }
+
+    if (dropped) {
+        LOGW("Trace: %" PRIu64 " spans dropped (buffers full)", dropped);
+    }
+
+    return ok;
+}
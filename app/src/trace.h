@@ -0,0 +1,54 @@
+#ifndef SC_TRACE_H
+#define SC_TRACE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/tick.h"
+
+/**
+ * Record spans of the hot-path operations of every thread (--trace-file)
+ *
+ * The spans are stored in per-thread buffers (so recording a span never
+ * takes a lock), and written at exit in the Chrome trace event format, which
+ * can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Usage:
+ *
+ *     sc_tick begin = sc_trace_begin();
+ *     do_something();
+ *     sc_trace_end("do_something", begin);
+ */
+
+/**
+ * Start recording the spans
+ *
+ * It must be called before any thread records a span.
+ */
+void
+sc_trace_enable(void);
+
+/**
+ * Stop recording, write the spans to the given file and release them
+ *
+ * It must be called once all the threads recording spans are joined.
+ */
+bool
+sc_trace_write(const char *filename);
+
+/**
+ * Return the beginning of a span, or 0 if tracing is disabled
+ */
+sc_tick
+sc_trace_begin(void);
+
+/**
+ * Record a span (from the current thread) started by sc_trace_begin()
+ *
+ * The name must be statically allocated. It does nothing if begin is 0.
+ */
+void
+sc_trace_end(const char *name, sc_tick begin);
+
+#endif
@@ -2,25 +2,111 @@
 
 #include <assert.h>
 
-void
+#include "util/log.h"
+
+bool
 sc_frame_source_init(struct sc_frame_source *source) {
-    source->sink_count = 0;
+    bool ok = sc_mutex_init(&source->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    sc_vector_init(&source->sinks);
+    source->static_sink_count = 0;
+    source->state = SC_FRAME_SOURCE_STATE_INIT;
+    source->ctx = NULL;
+
+    return true;
 }
 
 void
+sc_frame_source_destroy(struct sc_frame_source *source) {
+    sc_vector_destroy(&source->sinks);
+    sc_mutex_destroy(&source->mutex);
+}
+
+bool
 sc_frame_source_add_sink(struct sc_frame_source *source,
                          struct sc_frame_sink *sink) {
-    assert(source->sink_count < SC_FRAME_SOURCE_MAX_SINKS);
+    assert(source->state == SC_FRAME_SOURCE_STATE_INIT);
+    assert(source->sinks.size == source->static_sink_count);
     assert(sink);
     assert(sink->ops);
-    source->sinks[source->sink_count++] = sink;
+
+    bool ok = sc_vector_push(&source->sinks, sink);
+    if (!ok) {
+        LOG_OOM();
+        return false;
+    }
+
+    ++source->static_sink_count;
+    return true;
+}
+
+bool
+sc_frame_source_attach_sink(struct sc_frame_source *source,
+                            struct sc_frame_sink *sink) {
+    assert(sink);
+    assert(sink->ops);
+
+    sc_mutex_lock(&source->mutex);
+
+    bool ok = false;
+    if (source->state == SC_FRAME_SOURCE_STATE_CLOSED) {
+        LOGW("Could not attach sink: the stream has ended");
+        goto end;
+    }
+
+    // Reserve the slot first, so that the sink is never opened for nothing
+    ok = sc_vector_reserve(&source->sinks, source->sinks.size + 1);
+    if (!ok) {
+        LOG_OOM();
+        goto end;
+    }
+
+    if (source->state == SC_FRAME_SOURCE_STATE_OPEN) {
+        ok = sink->ops->open(sink, source->ctx);
+        if (!ok) {
+            goto end;
+        }
+    }
+
+    ok = sc_vector_push(&source->sinks, sink);
+    assert(ok); // the capacity has been reserved
+
+end:
+    sc_mutex_unlock(&source->mutex);
+
+    return ok;
+}
+
+bool
+sc_frame_source_detach_sink(struct sc_frame_source *source,
+                            struct sc_frame_sink *sink) {
+    sc_mutex_lock(&source->mutex);
+
+    bool found = false;
+    for (size_t i = source->static_sink_count; i < source->sinks.size; ++i) {
+        if (source->sinks.data[i] == sink) {
+            if (source->state == SC_FRAME_SOURCE_STATE_OPEN) {
+                sink->ops->close(sink);
+            }
+            sc_vector_remove(&source->sinks, i);
+            found = true;
+            break;
+        }
+    }
+
+    sc_mutex_unlock(&source->mutex);
+
+    return found;
 }
 
 static void
 sc_frame_source_sinks_close_firsts(struct sc_frame_source *source,
-                                    unsigned count) {
+                                   size_t count) {
     while (count) {
-        struct sc_frame_sink *sink = source->sinks[--count];
+        struct sc_frame_sink *sink = source->sinks.data[--count];
         sink->ops->close(sink);
     }
 }
@@ -28,34 +114,65 @@ sc_frame_source_sinks_close_firsts(struct sc_frame_source *source,
 bool
 sc_frame_source_sinks_open(struct sc_frame_source *source,
                            const AVCodecContext *ctx) {
-    assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_FRAME_SOURCE_STATE_INIT);
+
+    for (size_t i = 0; i < source->sinks.size; ++i) {
+        struct sc_frame_sink *sink = source->sinks.data[i];
         if (!sink->ops->open(sink, ctx)) {
             sc_frame_source_sinks_close_firsts(source, i);
+            // Do not accept any new sink
+            source->state = SC_FRAME_SOURCE_STATE_CLOSED;
+            sc_mutex_unlock(&source->mutex);
             return false;
         }
     }
 
+    source->ctx = ctx;
+    source->state = SC_FRAME_SOURCE_STATE_OPEN;
+
+    sc_mutex_unlock(&source->mutex);
+
     return true;
 }
 
 void
 sc_frame_source_sinks_close(struct sc_frame_source *source) {
-    assert(source->sink_count);
-    sc_frame_source_sinks_close_firsts(source, source->sink_count);
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_FRAME_SOURCE_STATE_OPEN);
+    sc_frame_source_sinks_close_firsts(source, source->sinks.size);
+    source->ctx = NULL;
+    source->state = SC_FRAME_SOURCE_STATE_CLOSED;
+    sc_mutex_unlock(&source->mutex);
 }
 
 bool
 sc_frame_source_sinks_push(struct sc_frame_source *source,
-                            const AVFrame *frame) {
-    assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
-        if (!sink->ops->push(sink, frame)) {
-            return false;
+                           const AVFrame *frame) {
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_FRAME_SOURCE_STATE_OPEN);
+
+    bool ok = true;
+    size_t i = 0;
+    while (i < source->sinks.size) {
+        struct sc_frame_sink *sink = source->sinks.data[i];
+        if (sink->ops->push(sink, frame)) {
+            ++i;
+            continue;
         }
+
+        if (i < source->static_sink_count) {
+            ok = false;
+            break;
+        }
+
+        // A sink attached at runtime must not stop the stream
+        LOGW("Sink failed, detaching it");
+        sink->ops->close(sink);
+        sc_vector_remove(&source->sinks, i);
     }
 
-    return true;
+    sc_mutex_unlock(&source->mutex);
+
+    return ok;
 }
@@ -4,28 +4,62 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/vector.h"
 
-#define SC_FRAME_SOURCE_MAX_SINKS 2
+enum sc_frame_source_state {
+    SC_FRAME_SOURCE_STATE_INIT,
+    SC_FRAME_SOURCE_STATE_OPEN,
+    SC_FRAME_SOURCE_STATE_CLOSED,
+};
 
 /**
  * Frame source trait
  *
  * Component able to send AVFrames should implement this trait.
+ *
+ * Like for the packet source, the sinks added by sc_frame_source_add_sink()
+ * are fixed before the source is started, and other sinks may be attached and
+ * detached at any time.
  */
 struct sc_frame_source {
-    struct sc_frame_sink *sinks[SC_FRAME_SOURCE_MAX_SINKS];
-    unsigned sink_count;
+    struct SC_VECTOR(struct sc_frame_sink *) sinks;
+    // The first static_sink_count sinks have been added before start
+    size_t static_sink_count;
+
+    // Protect the sinks against concurrent attach/detach
+    sc_mutex mutex;
+    enum sc_frame_source_state state;
+    const AVCodecContext *ctx; // valid while the state is OPEN
 };
 
-void
+bool
 sc_frame_source_init(struct sc_frame_source *source);
 
 void
+sc_frame_source_destroy(struct sc_frame_source *source);
+
+// Must be called before the source is started
+bool
 sc_frame_source_add_sink(struct sc_frame_source *source,
                          struct sc_frame_sink *sink);
 
+// Attach a sink at runtime (it is opened immediately if the source is open)
+bool
+sc_frame_source_attach_sink(struct sc_frame_source *source,
+                            struct sc_frame_sink *sink);
+
+// Detach (and close, if the source is open) a sink attached at runtime
+//
+// Return false if the sink was not attached (for example because it has
+// already been detached due to a failure).
+bool
+sc_frame_source_detach_sink(struct sc_frame_source *source,
+                            struct sc_frame_sink *sink);
+
 bool
 sc_frame_source_sinks_open(struct sc_frame_source *source,
                            const AVCodecContext *ctx);
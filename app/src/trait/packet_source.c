@@ -2,25 +2,170 @@
 
 #include <assert.h>
 
-void
+#include "util/log.h"
+
+bool
 sc_packet_source_init(struct sc_packet_source *source) {
-    source->sink_count = 0;
+    source->config = av_packet_alloc();
+    if (!source->config) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&source->mutex);
+    if (!ok) {
+        av_packet_free(&source->config);
+        return false;
+    }
+
+    sc_vector_init(&source->sinks);
+    source->static_sink_count = 0;
+    source->state = SC_PACKET_SOURCE_STATE_INIT;
+    source->ctx = NULL;
+    source->gop_cache_enabled = false;
+    sc_gop_cache_init(&source->gop_cache);
+
+    return true;
 }
 
 void
+sc_packet_source_destroy(struct sc_packet_source *source) {
+    sc_vector_destroy(&source->sinks);
+    sc_mutex_destroy(&source->mutex);
+    av_packet_free(&source->config);
+    sc_gop_cache_destroy(&source->gop_cache);
+}
+
+bool
 sc_packet_source_add_sink(struct sc_packet_source *source,
                           struct sc_packet_sink *sink) {
-    assert(source->sink_count < SC_PACKET_SOURCE_MAX_SINKS);
+    assert(source->state == SC_PACKET_SOURCE_STATE_INIT);
+    assert(source->sinks.size == source->static_sink_count);
     assert(sink);
     assert(sink->ops);
-    source->sinks[source->sink_count++] = sink;
+
+    bool ok = sc_vector_push(&source->sinks, sink);
+    if (!ok) {
+        LOG_OOM();
+        return false;
+    }
+
+    ++source->static_sink_count;
+    return true;
+}
+
+void
+sc_packet_source_enable_gop_cache(struct sc_packet_source *source) {
+    sc_mutex_lock(&source->mutex);
+    source->gop_cache_enabled = true;
+    sc_mutex_unlock(&source->mutex);
+}
+
+// Push the config packet and the cached GOP to a sink attached at runtime
+static bool
+sc_packet_source_prime_sink(struct sc_packet_source *source,
+                            struct sc_packet_sink *sink, bool *primed) {
+    if (source->config->data && !sink->ops->push(sink, source->config)) {
+        return false;
+    }
+
+    struct sc_gop_cache *cache = &source->gop_cache;
+    for (size_t i = 0; i < cache->packets.size; ++i) {
+        if (!sink->ops->push(sink, cache->packets.data[i])) {
+            return false;
+        }
+    }
+
+    *primed = !sc_gop_cache_is_empty(cache);
+    return true;
+}
+
+bool
+sc_packet_source_attach_sink(struct sc_packet_source *source,
+                             struct sc_packet_sink *sink, bool *primed) {
+    assert(sink);
+    assert(sink->ops);
+
+    bool local_primed = false;
+
+    sc_mutex_lock(&source->mutex);
+
+    bool ok = false;
+    switch (source->state) {
+        case SC_PACKET_SOURCE_STATE_CLOSED:
+            LOGW("Could not attach sink: the stream has ended");
+            goto end;
+        case SC_PACKET_SOURCE_STATE_DISABLED:
+            if (sink->ops->disable) {
+                sink->ops->disable(sink);
+            }
+            ok = true;
+            goto end;
+        case SC_PACKET_SOURCE_STATE_INIT:
+        case SC_PACKET_SOURCE_STATE_OPEN:
+            break;
+    }
+
+    // Reserve the slot first, so that the sink is never opened for nothing
+    ok = sc_vector_reserve(&source->sinks, source->sinks.size + 1);
+    if (!ok) {
+        LOG_OOM();
+        goto end;
+    }
+
+    if (source->state == SC_PACKET_SOURCE_STATE_OPEN) {
+        ok = sink->ops->open(sink, source->ctx);
+        if (!ok) {
+            goto end;
+        }
+
+        ok = sc_packet_source_prime_sink(source, sink, &local_primed);
+        if (!ok) {
+            sink->ops->close(sink);
+            goto end;
+        }
+    }
+
+    ok = sc_vector_push(&source->sinks, sink);
+    assert(ok); // the capacity has been reserved
+
+end:
+    sc_mutex_unlock(&source->mutex);
+
+    if (primed) {
+        *primed = ok && local_primed;
+    }
+
+    return ok;
+}
+
+bool
+sc_packet_source_detach_sink(struct sc_packet_source *source,
+                             struct sc_packet_sink *sink) {
+    sc_mutex_lock(&source->mutex);
+
+    bool found = false;
+    for (size_t i = source->static_sink_count; i < source->sinks.size; ++i) {
+        if (source->sinks.data[i] == sink) {
+            if (source->state == SC_PACKET_SOURCE_STATE_OPEN) {
+                sink->ops->close(sink);
+            }
+            sc_vector_remove(&source->sinks, i);
+            found = true;
+            break;
+        }
+    }
+
+    sc_mutex_unlock(&source->mutex);
+
+    return found;
 }
 
 static void
 sc_packet_source_sinks_close_firsts(struct sc_packet_source *source,
-                                    unsigned count) {
+                                    size_t count) {
     while (count) {
-        struct sc_packet_sink *sink = source->sinks[--count];
+        struct sc_packet_sink *sink = source->sinks.data[--count];
         sink->ops->close(sink);
     }
 }
@@ -28,45 +173,102 @@ sc_packet_source_sinks_close_firsts(struct sc_packet_source *source,
 bool
 sc_packet_source_sinks_open(struct sc_packet_source *source,
                             AVCodecContext *ctx) {
-    assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_PACKET_SOURCE_STATE_INIT);
+
+    for (size_t i = 0; i < source->sinks.size; ++i) {
+        struct sc_packet_sink *sink = source->sinks.data[i];
         if (!sink->ops->open(sink, ctx)) {
             sc_packet_source_sinks_close_firsts(source, i);
+            // Do not accept any new sink
+            source->state = SC_PACKET_SOURCE_STATE_CLOSED;
+            sc_mutex_unlock(&source->mutex);
             return false;
         }
     }
 
+    source->ctx = ctx;
+    source->state = SC_PACKET_SOURCE_STATE_OPEN;
+
+    sc_mutex_unlock(&source->mutex);
+
     return true;
 }
 
 void
 sc_packet_source_sinks_close(struct sc_packet_source *source) {
-    assert(source->sink_count);
-    sc_packet_source_sinks_close_firsts(source, source->sink_count);
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_PACKET_SOURCE_STATE_OPEN);
+    sc_packet_source_sinks_close_firsts(source, source->sinks.size);
+    source->ctx = NULL;
+    source->state = SC_PACKET_SOURCE_STATE_CLOSED;
+    av_packet_unref(source->config);
+    sc_gop_cache_clear(&source->gop_cache);
+    sc_mutex_unlock(&source->mutex);
 }
 
 bool
 sc_packet_source_sinks_push(struct sc_packet_source *source,
                             const AVPacket *packet) {
-    assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
-        if (!sink->ops->push(sink, packet)) {
-            return false;
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_PACKET_SOURCE_STATE_OPEN);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Keep the config packet for the sinks attached later
+        av_packet_unref(source->config);
+        if (av_packet_ref(source->config, packet)) {
+            LOGW("Could not keep the config packet");
         }
+    } else if (source->gop_cache_enabled) {
+        sc_gop_cache_push(&source->gop_cache, packet);
     }
 
-    return true;
+    bool ok = true;
+    size_t i = 0;
+    while (i < source->sinks.size) {
+        struct sc_packet_sink *sink = source->sinks.data[i];
+        if (sink->ops->push(sink, packet)) {
+            ++i;
+            continue;
+        }
+
+        if (i < source->static_sink_count) {
+            ok = false;
+            break;
+        }
+
+        // A sink attached at runtime must not stop the stream
+        LOGW("Sink failed, detaching it");
+        sink->ops->close(sink);
+        sc_vector_remove(&source->sinks, i);
+    }
+
+    sc_mutex_unlock(&source->mutex);
+
+    return ok;
 }
 
 void
 sc_packet_source_sinks_disable(struct sc_packet_source *source) {
-    assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_mutex_lock(&source->mutex);
+    assert(source->state == SC_PACKET_SOURCE_STATE_INIT);
+    for (size_t i = 0; i < source->sinks.size; ++i) {
+        struct sc_packet_sink *sink = source->sinks.data[i];
         if (sink->ops->disable) {
             sink->ops->disable(sink);
         }
     }
+    source->state = SC_PACKET_SOURCE_STATE_DISABLED;
+    sc_mutex_unlock(&source->mutex);
+}
+
+void
+sc_packet_source_end(struct sc_packet_source *source) {
+    sc_mutex_lock(&source->mutex);
+    if (source->state == SC_PACKET_SOURCE_STATE_INIT) {
+        // The stream failed before being opened, the sinks attached later
+        // must not wait for it
+        source->state = SC_PACKET_SOURCE_STATE_DISABLED;
+    }
+    sc_mutex_unlock(&source->mutex);
 }
@@ -4,28 +4,88 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <libavcodec/avcodec.h>
 
+#include "gop_cache.h"
 #include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/vector.h"
 
-#define SC_PACKET_SOURCE_MAX_SINKS 2
+enum sc_packet_source_state {
+    SC_PACKET_SOURCE_STATE_INIT,
+    SC_PACKET_SOURCE_STATE_OPEN,
+    SC_PACKET_SOURCE_STATE_CLOSED,
+    SC_PACKET_SOURCE_STATE_DISABLED,
+};
 
 /**
  * Packet source trait
  *
  * Component able to send AVPackets should implement this trait.
+ *
+ * The sinks added by sc_packet_source_add_sink() are fixed before the source
+ * is started. Other sinks may be attached and detached at any time (for
+ * example to start recording at runtime); a failure of such a sink only
+ * detaches it, instead of stopping the source.
  */
 struct sc_packet_source {
-    struct sc_packet_sink *sinks[SC_PACKET_SOURCE_MAX_SINKS];
-    unsigned sink_count;
+    struct SC_VECTOR(struct sc_packet_sink *) sinks;
+    // The first static_sink_count sinks have been added before start
+    size_t static_sink_count;
+
+    // Protect the sinks against concurrent attach/detach
+    sc_mutex mutex;
+    enum sc_packet_source_state state;
+    AVCodecContext *ctx; // valid while the state is OPEN
+    // The last config packet, provided to the sinks attached while open
+    AVPacket *config;
+    // The packets since the last keyframe, provided to the sinks attached
+    // while open (if enabled)
+    bool gop_cache_enabled;
+    struct sc_gop_cache gop_cache;
 };
 
-void
+bool
 sc_packet_source_init(struct sc_packet_source *source);
 
 void
+sc_packet_source_destroy(struct sc_packet_source *source);
+
+// Must be called before the source is started
+bool
 sc_packet_source_add_sink(struct sc_packet_source *source,
                           struct sc_packet_sink *sink);
 
+// Keep the packets since the last keyframe, to prime the sinks attached at
+// runtime (for video streams)
+void
+sc_packet_source_enable_gop_cache(struct sc_packet_source *source);
+
+// Attach a sink at runtime
+//
+// If the source is already open, the sink is opened immediately and receives
+// the last config packet (if any) first, then the packets of the current GOP
+// (if the GOP cache is enabled and not empty), then the next packets. If it
+// has not been primed with a GOP, its first packets may not start on a
+// keyframe, so it must skip them until the next keyframe.
+//
+// If `primed` is not NULL, it is set to true if the sink received the current
+// GOP (so that there is no need to request a keyframe).
+//
+// If the source is disabled, the sink is disabled immediately (and it is not
+// attached).
+bool
+sc_packet_source_attach_sink(struct sc_packet_source *source,
+                             struct sc_packet_sink *sink, bool *primed);
+
+// Detach (and close, if the source is open) a sink attached at runtime
+//
+// Return false if the sink was not attached (for example because it has
+// already been detached due to a failure).
+bool
+sc_packet_source_detach_sink(struct sc_packet_source *source,
+                             struct sc_packet_sink *sink);
+
 bool
 sc_packet_source_sinks_open(struct sc_packet_source *source,
                             AVCodecContext *ctx);
@@ -40,4 +100,8 @@ sc_packet_source_sinks_push(struct sc_packet_source *source,
 void
 sc_packet_source_sinks_disable(struct sc_packet_source *source);
 
+// Must be called by the source once it will not push any packet anymore
+void
+sc_packet_source_end(struct sc_packet_source *source);
+
 #endif
@@ -0,0 +1,528 @@
+#include "transcoder.h"
+
+#include <assert.h>
+#include <string.h>
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+# include <libavutil/hwcontext.h>
+#endif
+
+#include "util/log.h"
+
+/** Downcast frame sink to sc_transcoder */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_transcoder, frame_sink)
+
+// The packets are pushed with the same timestamps as the device packets
+static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
+
+// Maximum number of frames between two keyframes (in addition to the
+// keyframes forced every SC_TRANSCODER_KEYFRAME_INTERVAL)
+#define SC_TRANSCODER_GOP_SIZE 600
+
+// Each family of encoders exposes the constant quality rate control
+// differently
+enum sc_transcoder_rc {
+    SC_TRANSCODER_RC_NVENC,
+    SC_TRANSCODER_RC_QSV,
+    SC_TRANSCODER_RC_AMF,
+    SC_TRANSCODER_RC_VIDEOTOOLBOX,
+    SC_TRANSCODER_RC_VAAPI,
+    SC_TRANSCODER_RC_SOFTWARE,
+};
+
+struct sc_transcoder_encoder {
+    const char *name;
+    enum sc_transcoder_rc rc;
+};
+
+// For each codec, the encoders to try, in order (the software encoder last)
+static const struct sc_transcoder_encoder sc_transcoder_h264_encoders[] = {
+    {"h264_nvenc", SC_TRANSCODER_RC_NVENC},
+    {"h264_qsv", SC_TRANSCODER_RC_QSV},
+    {"h264_amf", SC_TRANSCODER_RC_AMF},
+    {"h264_videotoolbox", SC_TRANSCODER_RC_VIDEOTOOLBOX},
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    {"h264_vaapi", SC_TRANSCODER_RC_VAAPI},
+#endif
+    {"libx264", SC_TRANSCODER_RC_SOFTWARE},
+    {NULL, 0},
+};
+
+static const struct sc_transcoder_encoder sc_transcoder_h265_encoders[] = {
+    {"hevc_nvenc", SC_TRANSCODER_RC_NVENC},
+    {"hevc_qsv", SC_TRANSCODER_RC_QSV},
+    {"hevc_amf", SC_TRANSCODER_RC_AMF},
+    {"hevc_videotoolbox", SC_TRANSCODER_RC_VIDEOTOOLBOX},
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    {"hevc_vaapi", SC_TRANSCODER_RC_VAAPI},
+#endif
+    {"libx265", SC_TRANSCODER_RC_SOFTWARE},
+    {NULL, 0},
+};
+
+static const struct sc_transcoder_encoder sc_transcoder_av1_encoders[] = {
+    {"av1_nvenc", SC_TRANSCODER_RC_NVENC},
+    {"av1_qsv", SC_TRANSCODER_RC_QSV},
+    {"av1_amf", SC_TRANSCODER_RC_AMF},
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    {"av1_vaapi", SC_TRANSCODER_RC_VAAPI},
+#endif
+    {"libsvtav1", SC_TRANSCODER_RC_SOFTWARE},
+    {NULL, 0},
+};
+
+static const struct sc_transcoder_encoder *
+sc_transcoder_get_encoders(enum sc_codec codec) {
+    switch (codec) {
+        case SC_CODEC_H264:
+            return sc_transcoder_h264_encoders;
+        case SC_CODEC_H265:
+            return sc_transcoder_h265_encoders;
+        case SC_CODEC_AV1:
+            return sc_transcoder_av1_encoders;
+        default:
+            assert(!"unexpected codec");
+            return NULL;
+    }
+}
+
+static void
+sc_transcoder_set_quality(struct sc_transcoder *transcoder,
+                          AVCodecContext *ctx, enum sc_transcoder_rc rc,
+                          AVDictionary **opts) {
+    // On a QP scale: from 0 (best) to 51 (worst)
+    int quality = transcoder->quality;
+
+    switch (rc) {
+        case SC_TRANSCODER_RC_NVENC:
+            ctx->bit_rate = 0;
+            av_dict_set(opts, "rc", "vbr", 0);
+            av_dict_set_int(opts, "cq", quality, 0);
+            // Make the forced keyframes IDR frames
+            av_dict_set(opts, "forced-idr", "1", 0);
+            break;
+        case SC_TRANSCODER_RC_QSV:
+            // Intelligent constant quality
+            ctx->global_quality = quality;
+            break;
+        case SC_TRANSCODER_RC_AMF:
+            av_dict_set(opts, "rc", "cqp", 0);
+            av_dict_set_int(opts, "qp_i", quality, 0);
+            av_dict_set_int(opts, "qp_p", quality, 0);
+            break;
+        case SC_TRANSCODER_RC_VIDEOTOOLBOX:
+            // From 1 (worst) to 100 (best)
+            ctx->flags |= AV_CODEC_FLAG_QSCALE;
+            ctx->global_quality =
+                FF_QP2LAMBDA * MAX(1, 100 - quality * 100 / 51);
+            break;
+        case SC_TRANSCODER_RC_VAAPI:
+            av_dict_set(opts, "rc_mode", "CQP", 0);
+            // The AV1 quantizer ranges from 0 to 255
+            ctx->global_quality = transcoder->codec == SC_CODEC_AV1
+                                ? quality * 5 : quality;
+            break;
+        case SC_TRANSCODER_RC_SOFTWARE:
+            av_dict_set_int(opts, "crf", quality, 0);
+            av_dict_set(opts, "forced-idr", "1", 0);
+            break;
+        default:
+            assert(!"unexpected rate control");
+    }
+}
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+// The VA-API encoders only accept frames in GPU memory
+static bool
+sc_transcoder_init_vaapi(struct sc_transcoder *transcoder,
+                         AVCodecContext *ctx) {
+    AVBufferRef *device = NULL;
+    int r = av_hwdevice_ctx_create(&device, AV_HWDEVICE_TYPE_VAAPI, NULL,
+                                   NULL, 0);
+    if (r < 0) {
+        LOGD("Record transcoding: could not create the VA-API device");
+        return false;
+    }
+
+    AVBufferRef *frames = av_hwframe_ctx_alloc(device);
+    av_buffer_unref(&device);
+    if (!frames) {
+        LOG_OOM();
+        return false;
+    }
+
+    AVHWFramesContext *frames_ctx = (AVHWFramesContext *) frames->data;
+    frames_ctx->format = AV_PIX_FMT_VAAPI;
+    frames_ctx->sw_format = transcoder->sw_format;
+    frames_ctx->width = ctx->width;
+    frames_ctx->height = ctx->height;
+    frames_ctx->initial_pool_size = 16;
+
+    r = av_hwframe_ctx_init(frames);
+    if (r < 0) {
+        LOGD("Record transcoding: could not initialize the VA-API frames");
+        av_buffer_unref(&frames);
+        return false;
+    }
+
+    ctx->hw_frames_ctx = av_buffer_ref(frames);
+    if (!ctx->hw_frames_ctx) {
+        LOG_OOM();
+        av_buffer_unref(&frames);
+        return false;
+    }
+
+    ctx->pix_fmt = AV_PIX_FMT_VAAPI;
+    transcoder->hw_frames_ctx = frames;
+    return true;
+}
+#endif
+
+static bool
+sc_transcoder_open_encoder(struct sc_transcoder *transcoder,
+                           const AVCodec *codec, enum sc_transcoder_rc rc,
+                           const AVFrame *frame) {
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    // The hardware encoders take NV12, the software encoders YUV420P
+    transcoder->sw_format = rc == SC_TRANSCODER_RC_SOFTWARE
+                          ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NV12;
+
+    ctx->width = frame->width;
+    ctx->height = frame->height;
+    ctx->pix_fmt = transcoder->sw_format;
+    ctx->color_range = frame->color_range;
+    ctx->colorspace = frame->colorspace;
+    ctx->color_primaries = frame->color_primaries;
+    ctx->color_trc = frame->color_trc;
+    ctx->time_base = SCRCPY_TIME_BASE;
+    ctx->gop_size = SC_TRANSCODER_GOP_SIZE;
+    // The recorder expects the packets in presentation order
+    ctx->max_b_frames = 0;
+    // The extradata is sent in the config packet
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    AVDictionary *opts = NULL;
+    sc_transcoder_set_quality(transcoder, ctx, rc, &opts);
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+    if (rc == SC_TRANSCODER_RC_VAAPI
+            && !sc_transcoder_init_vaapi(transcoder, ctx)) {
+        goto error;
+    }
+#endif
+
+    if (avcodec_open2(ctx, codec, &opts) < 0) {
+        LOGD("Record transcoding: could not open the %s encoder",
+             codec->name);
+        goto error;
+    }
+
+    if (!ctx->extradata_size) {
+        LOGD("Record transcoding: no global header from the %s encoder",
+             codec->name);
+        goto error;
+    }
+
+    av_dict_free(&opts);
+    transcoder->ctx = ctx;
+    return true;
+
+error:
+    av_dict_free(&opts);
+    av_buffer_unref(&transcoder->hw_frames_ctx);
+    avcodec_free_context(&ctx);
+    return false;
+}
+
+static bool
+sc_transcoder_open(struct sc_transcoder *transcoder, const AVFrame *frame) {
+    const struct sc_transcoder_encoder *encoders =
+        sc_transcoder_get_encoders(transcoder->codec);
+
+    for (const struct sc_transcoder_encoder *enc = encoders; enc->name;
+            ++enc) {
+        const AVCodec *codec = avcodec_find_encoder_by_name(enc->name);
+        if (!codec) {
+            continue;
+        }
+
+        if (sc_transcoder_open_encoder(transcoder, codec, enc->rc, frame)) {
+            if (enc->rc == SC_TRANSCODER_RC_SOFTWARE) {
+                LOGW("Record transcoding: no hardware encoder available, "
+                     "using %s", codec->name);
+            }
+            LOGI("Record transcoding: %s, %dx%d, quality %u", codec->name,
+                 frame->width, frame->height, transcoder->quality);
+            return true;
+        }
+    }
+
+    LOGE("Record transcoding: could not open any encoder");
+    return false;
+}
+
+static bool
+sc_transcoder_push_config_packet(struct sc_transcoder *transcoder) {
+    AVCodecContext *ctx = transcoder->ctx;
+    AVPacket *packet = transcoder->packet;
+
+    if (av_new_packet(packet, ctx->extradata_size) < 0) {
+        LOG_OOM();
+        return false;
+    }
+
+    memcpy(packet->data, ctx->extradata, ctx->extradata_size);
+    // Like the config packets of the device stream
+    packet->pts = AV_NOPTS_VALUE;
+    packet->dts = AV_NOPTS_VALUE;
+
+    bool ok = sc_packet_source_sinks_push(&transcoder->packet_source, packet);
+    av_packet_unref(packet);
+    return ok;
+}
+
+// Push all the packets available from the encoder
+static bool
+sc_transcoder_drain(struct sc_transcoder *transcoder) {
+    for (;;) {
+        int r = avcodec_receive_packet(transcoder->ctx, transcoder->packet);
+        if (r == AVERROR(EAGAIN) || r == AVERROR_EOF) {
+            return true;
+        }
+        if (r < 0) {
+            LOGE("Record transcoding: could not encode: %d", r);
+            return false;
+        }
+
+        bool ok = sc_packet_source_sinks_push(&transcoder->packet_source,
+                                              transcoder->packet);
+        av_packet_unref(transcoder->packet);
+        if (!ok) {
+            return false;
+        }
+    }
+}
+
+// Make transcoder->frame the frame to encode, in the encoder format and size
+static bool
+sc_transcoder_prepare_frame(struct sc_transcoder *transcoder,
+                            const AVFrame *frame) {
+    AVCodecContext *ctx = transcoder->ctx;
+    AVFrame *dst = transcoder->frame;
+
+    bool same_size = frame->width == ctx->width
+                  && frame->height == ctx->height;
+    if (!same_size && !transcoder->size_warned) {
+        LOGW("Record transcoding: video size changed to %dx%d, scaled to "
+             "%dx%d", frame->width, frame->height, ctx->width, ctx->height);
+        transcoder->size_warned = true;
+    }
+
+    const AVFrame *src = frame;
+    if (!same_size || frame->format != transcoder->sw_format) {
+        // Convert into the upload frame if the frame must be uploaded
+        AVFrame *converted = transcoder->hw_frames_ctx ? transcoder->sw_frame
+                                                       : dst;
+        converted->format = transcoder->sw_format;
+        converted->width = ctx->width;
+        converted->height = ctx->height;
+        if (!sc_frame_converter_convert_frame(&transcoder->converter, frame,
+                                              converted, SWS_BILINEAR)) {
+            LOGE("Record transcoding: could not convert the frame");
+            return false;
+        }
+        src = converted;
+    }
+
+    if (transcoder->hw_frames_ctx) {
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+        int r = av_hwframe_get_buffer(transcoder->hw_frames_ctx, dst, 0);
+        if (r < 0) {
+            LOGE("Record transcoding: could not allocate a hardware frame");
+            av_frame_unref(transcoder->sw_frame);
+            return false;
+        }
+
+        r = av_hwframe_transfer_data(dst, src, 0);
+        if (!r) {
+            r = av_frame_copy_props(dst, src);
+        }
+        av_frame_unref(transcoder->sw_frame);
+        if (r < 0) {
+            LOGE("Record transcoding: could not upload the frame");
+            av_frame_unref(dst);
+            return false;
+        }
+#else
+        assert(!"unexpected hardware frames");
+#endif
+    } else if (src == frame) {
+        // Already in the encoder format
+        if (av_frame_ref(dst, frame)) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_transcoder_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    // The encoder is opened on the first frame, for its size
+    return true;
+}
+
+static void
+sc_transcoder_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_transcoder *transcoder = DOWNCAST(sink);
+
+    if (!transcoder->ctx) {
+        // No frame has been encoded, the sinks have never been opened
+        sc_packet_source_end(&transcoder->packet_source);
+        return;
+    }
+
+    // Flush the frames pending in the encoder
+    if (avcodec_send_frame(transcoder->ctx, NULL) >= 0) {
+        sc_transcoder_drain(transcoder);
+    }
+
+    sc_packet_source_sinks_close(&transcoder->packet_source);
+
+    avcodec_free_context(&transcoder->ctx);
+    av_buffer_unref(&transcoder->hw_frames_ctx);
+}
+
+static bool
+sc_transcoder_frame_sink_push(struct sc_frame_sink *sink,
+                              const AVFrame *frame) {
+    struct sc_transcoder *transcoder = DOWNCAST(sink);
+
+    if (frame->pts == AV_NOPTS_VALUE || (transcoder->last_pts != AV_NOPTS_VALUE
+                                     && frame->pts <= transcoder->last_pts)) {
+        // The encoders require strictly increasing timestamps
+        return true;
+    }
+
+    if (!transcoder->ctx) {
+        if (!sc_transcoder_open(transcoder, frame)) {
+            return false;
+        }
+
+        if (!sc_packet_source_sinks_open(&transcoder->packet_source,
+                                         transcoder->ctx)) {
+            avcodec_free_context(&transcoder->ctx);
+            av_buffer_unref(&transcoder->hw_frames_ctx);
+            return false;
+        }
+
+        if (!sc_transcoder_push_config_packet(transcoder)) {
+            return false;
+        }
+    }
+
+    if (!sc_transcoder_prepare_frame(transcoder, frame)) {
+        return false;
+    }
+
+    AVFrame *f = transcoder->frame;
+    // Do not inherit the picture type of the decoded frame
+    f->pict_type = AV_PICTURE_TYPE_NONE;
+    if (transcoder->next_keyframe_pts == AV_NOPTS_VALUE
+            || f->pts >= transcoder->next_keyframe_pts) {
+        f->pict_type = AV_PICTURE_TYPE_I;
+        transcoder->next_keyframe_pts =
+            f->pts + SC_TICK_TO_US(SC_TRANSCODER_KEYFRAME_INTERVAL);
+    }
+    transcoder->last_pts = f->pts;
+
+    int r = avcodec_send_frame(transcoder->ctx, f);
+    av_frame_unref(f);
+    if (r < 0) {
+        LOGE("Record transcoding: could not send the frame: %d", r);
+        return false;
+    }
+
+    return sc_transcoder_drain(transcoder);
+}
+
+bool
+sc_transcoder_init(struct sc_transcoder *transcoder, enum sc_codec codec,
+                   uint8_t quality) {
+    transcoder->frame = av_frame_alloc();
+    if (!transcoder->frame) {
+        LOG_OOM();
+        return false;
+    }
+
+    transcoder->sw_frame = av_frame_alloc();
+    if (!transcoder->sw_frame) {
+        LOG_OOM();
+        goto error_free_frame;
+    }
+
+    transcoder->packet = av_packet_alloc();
+    if (!transcoder->packet) {
+        LOG_OOM();
+        goto error_free_sw_frame;
+    }
+
+    if (!sc_frame_converter_init(&transcoder->converter)) {
+        goto error_free_packet;
+    }
+
+    if (!sc_packet_source_init(&transcoder->packet_source)) {
+        goto error_destroy_converter;
+    }
+
+    transcoder->codec = codec;
+    transcoder->quality = quality;
+    transcoder->ctx = NULL;
+    transcoder->hw_frames_ctx = NULL;
+    transcoder->sw_format = AV_PIX_FMT_NONE;
+    transcoder->last_pts = AV_NOPTS_VALUE;
+    transcoder->next_keyframe_pts = AV_NOPTS_VALUE;
+    transcoder->size_warned = false;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_transcoder_frame_sink_open,
+        .close = sc_transcoder_frame_sink_close,
+        .push = sc_transcoder_frame_sink_push,
+    };
+
+    transcoder->frame_sink.ops = &ops;
+
+    return true;
+
+error_destroy_converter:
+    sc_frame_converter_destroy(&transcoder->converter);
+error_free_packet:
+    av_packet_free(&transcoder->packet);
+error_free_sw_frame:
+    av_frame_free(&transcoder->sw_frame);
+error_free_frame:
+    av_frame_free(&transcoder->frame);
+
+    return false;
+}
+
+void
+sc_transcoder_destroy(struct sc_transcoder *transcoder) {
+    // Normally already freed on close
+    avcodec_free_context(&transcoder->ctx);
+    av_buffer_unref(&transcoder->hw_frames_ctx);
+
+    sc_packet_source_destroy(&transcoder->packet_source);
+    sc_frame_converter_destroy(&transcoder->converter);
+    av_packet_free(&transcoder->packet);
+    av_frame_free(&transcoder->sw_frame);
+    av_frame_free(&transcoder->frame);
+}
@@ -0,0 +1,64 @@
+#ifndef SC_TRANSCODER_H
+#define SC_TRANSCODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_converter.h"
+#include "options.h"
+#include "trait/frame_sink.h"
+#include "trait/packet_source.h"
+#include "util/tick.h"
+
+// Interval between two forced keyframes (so that the recording can be split
+// or seeked even if the screen content does not change much)
+#define SC_TRANSCODER_KEYFRAME_INTERVAL SC_TICK_FROM_SEC(10)
+
+/**
+ * Re-encode the decoded video frames for recording (--record-transcode)
+ *
+ * The frames are encoded by a hardware encoder if one is available (NVENC,
+ * Quick Sync, AMF, VideoToolbox or VA-API), or by a software encoder
+ * otherwise, at a constant quality. The encoded packets are pushed to its
+ * sinks (the recorder), as if they came from a demuxer: the first one is the
+ * config packet.
+ *
+ * The encoder is opened on the first frame, for its size. If the video size
+ * changes afterwards, the frames are scaled to the initial size (a recording
+ * has a single video size).
+ *
+ * The frames are encoded synchronously, so it is expected to be fed by a frame
+ * queue running on its own thread.
+ */
+struct sc_transcoder {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_packet_source packet_source; // packet source trait
+
+    enum sc_codec codec;
+    uint8_t quality;
+
+    AVCodecContext *ctx; // NULL until the first frame
+    AVBufferRef *hw_frames_ctx; // only for the VA-API encoders, else NULL
+    enum AVPixelFormat sw_format; // the format of the frames to encode
+
+    struct sc_frame_converter converter;
+    AVFrame *frame; // the frame to encode (converted or uploaded)
+    AVFrame *sw_frame; // the converted frame, before upload
+    AVPacket *packet;
+
+    int64_t last_pts;
+    int64_t next_keyframe_pts;
+    bool size_warned;
+};
+
+bool
+sc_transcoder_init(struct sc_transcoder *transcoder, enum sc_codec codec,
+                   uint8_t quality);
+
+void
+sc_transcoder_destroy(struct sc_transcoder *transcoder);
+
+#endif
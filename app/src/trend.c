@@ -0,0 +1,86 @@
+#include "trend.h"
+
+#include <assert.h>
+
+void
+sc_trend_init(struct sc_trend *trend) {
+    trend->count = 0;
+    trend->samples_per_point = 1;
+    trend->sum = 0;
+    trend->pending = 0;
+}
+
+static void
+sc_trend_decimate(struct sc_trend *trend) {
+    assert(trend->count == SC_TREND_CAPACITY);
+    static_assert(!(SC_TREND_CAPACITY % 2), "Capacity must be even");
+
+    for (unsigned i = 0; i < SC_TREND_CAPACITY / 2; ++i) {
+        trend->points[i] =
+            (trend->points[2 * i] + trend->points[2 * i + 1]) / 2;
+    }
+    trend->count = SC_TREND_CAPACITY / 2;
+    trend->samples_per_point *= 2;
+}
+
+void
+sc_trend_push(struct sc_trend *trend, double value) {
+    trend->sum += value;
+    if (++trend->pending < trend->samples_per_point) {
+        return;
+    }
+
+    trend->points[trend->count++] = trend->sum / trend->pending;
+    trend->sum = 0;
+    trend->pending = 0;
+
+    if (trend->count == SC_TREND_CAPACITY) {
+        sc_trend_decimate(trend);
+    }
+}
+
+static double
+sc_trend_mean(const double *points, unsigned count) {
+    assert(count);
+    double sum = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        sum += points[i];
+    }
+    return sum / count;
+}
+
+bool
+sc_trend_analyze(const struct sc_trend *trend,
+                 struct sc_trend_result *result) {
+    unsigned n = trend->count;
+    if (n < SC_TREND_MIN_POINTS) {
+        return false;
+    }
+
+    unsigned quarter = n / 4;
+    result->first = sc_trend_mean(trend->points, quarter);
+    result->last = sc_trend_mean(&trend->points[n - quarter], quarter);
+
+    // Kendall tau-a: the ties are neither concordant nor discordant
+    long balance = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        for (unsigned j = i + 1; j < n; ++j) {
+            if (trend->points[j] > trend->points[i]) {
+                ++balance;
+            } else if (trend->points[j] < trend->points[i]) {
+                --balance;
+            }
+        }
+    }
+    result->tau = (double) balance / (n * (n - 1) / 2);
+
+    return true;
+}
+
+bool
+sc_trend_is_growing(const struct sc_trend_result *result) {
+    double growth = result->last - result->first;
+    return result->tau >= SC_TREND_MIN_TAU
+        && growth > 0
+        && growth * 100 >= result->first * SC_TREND_MIN_GROWTH;
+}
@@ -0,0 +1,67 @@
+#ifndef SC_TREND_H
+#define SC_TREND_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+// Maximum number of points kept for a trend
+#define SC_TREND_CAPACITY 128
+// Minimum number of points to analyze a trend
+#define SC_TREND_MIN_POINTS 16
+// Minimum rank correlation with time for a steady growth
+#define SC_TREND_MIN_TAU 0.6
+// Minimum growth (in percent of the initial value) for a steady growth
+#define SC_TREND_MIN_GROWTH 10
+
+/**
+ * Long-term trend of a sampled value, to detect a slow monotonic growth (a
+ * leak or a creeping latency) over a session of unknown duration
+ *
+ * The memory is bounded whatever the duration: once the points are full,
+ * consecutive pairs of points are merged (averaged), and the next points
+ * average twice as many samples. The points always cover the whole session,
+ * and the averaging smooths the short-term variations.
+ */
+struct sc_trend {
+    double points[SC_TREND_CAPACITY];
+    unsigned count; // always lower than SC_TREND_CAPACITY between pushes
+
+    // Number of samples averaged per point
+    unsigned samples_per_point;
+    // Samples of the point being accumulated
+    double sum;
+    unsigned pending;
+};
+
+struct sc_trend_result {
+    // Mean of the first and last quarters of the points
+    double first;
+    double last;
+    // Kendall rank correlation of the points with time, in [-1, 1]
+    double tau;
+};
+
+void
+sc_trend_init(struct sc_trend *trend);
+
+void
+sc_trend_push(struct sc_trend *trend, double value);
+
+/**
+ * Analyze the trend
+ *
+ * Return false if there are not enough points yet.
+ */
+bool
+sc_trend_analyze(const struct sc_trend *trend,
+                 struct sc_trend_result *result);
+
+/**
+ * Return true if the value grew steadily (almost monotonically, and
+ * significantly)
+ */
+bool
+sc_trend_is_growing(const struct sc_trend_result *result);
+
+#endif
@@ -34,6 +34,49 @@ sc_gamepad_uhid_send_input(struct sc_gamepad_uhid *gamepad,
     }
 }
 
+// Called from the timer service thread: the pending reports (rate-limited)
+// are sent at their deadline even if the main thread is busy, so that the
+// device receives the reports at a steady rate (up to 1000 Hz)
+static sc_tick
+sc_gamepad_uhid_on_flush_timer(struct sc_timer *timer, sc_tick now,
+                               void *userdata) {
+    (void) timer;
+    (void) now;
+    struct sc_gamepad_uhid *gamepad = userdata;
+
+    sc_mutex_lock(&gamepad->mutex);
+
+    struct sc_hid_input hid_input;
+    while (sc_hid_gamepad_generate_pending_input(&gamepad->hid, &hid_input)) {
+        sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad axis");
+    }
+
+    sc_tick deadline;
+    if (!sc_hid_gamepad_get_pending_deadline(&gamepad->hid, &deadline)) {
+        deadline = SC_TIMER_NEVER;
+    }
+
+    sc_mutex_unlock(&gamepad->mutex);
+
+    return deadline;
+}
+
+// Send the pending reports (rate-limited) once their deadline is reached
+static void
+sc_gamepad_uhid_schedule_flush(struct sc_gamepad_uhid *gamepad) {
+    sc_mutex_assert(&gamepad->mutex);
+
+    sc_tick deadline;
+    if (!sc_hid_gamepad_get_pending_deadline(&gamepad->hid, &deadline)) {
+        return;
+    }
+
+    // There are pending reports only if the rate is limited
+    assert(gamepad->timer_service);
+    sc_timer_service_schedule(gamepad->timer_service, &gamepad->flush_timer,
+                              deadline);
+}
+
 static void
 sc_gamepad_uhid_send_open(struct sc_gamepad_uhid *gamepad,
                           const struct sc_hid_open *hid_open) {
@@ -68,9 +111,12 @@ sc_gamepad_processor_process_gamepad_added(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_device_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
+    sc_mutex_lock(&gamepad->mutex);
+
     struct sc_hid_open hid_open;
     if (!sc_hid_gamepad_generate_open(&gamepad->hid, &hid_open,
                                       event->gamepad_id)) {
+        sc_mutex_unlock(&gamepad->mutex);
         return;
     }
 
@@ -81,6 +127,8 @@ sc_gamepad_processor_process_gamepad_added(struct sc_gamepad_processor *gp,
     LOGI("Gamepad added: [%" PRIu32 "] %s", event->gamepad_id, name);
 
     sc_gamepad_uhid_send_open(gamepad, &hid_open);
+
+    sc_mutex_unlock(&gamepad->mutex);
 }
 
 static void
@@ -88,15 +136,20 @@ sc_gamepad_processor_process_gamepad_removed(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_device_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
+    sc_mutex_lock(&gamepad->mutex);
+
     struct sc_hid_close hid_close;
     if (!sc_hid_gamepad_generate_close(&gamepad->hid, &hid_close,
                                        event->gamepad_id)) {
+        sc_mutex_unlock(&gamepad->mutex);
         return;
     }
 
     LOGI("Gamepad removed: [%" PRIu32 "]", event->gamepad_id);
 
     sc_gamepad_uhid_send_close(gamepad, &hid_close);
+
+    sc_mutex_unlock(&gamepad->mutex);
 }
 
 static void
@@ -104,13 +157,18 @@ sc_gamepad_processor_process_gamepad_axis(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_axis_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
+    sc_mutex_lock(&gamepad->mutex);
+
     struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_axis(&gamepad->hid, &hid_input,
-                                                 event)) {
-        return;
+    if (sc_hid_gamepad_generate_input_from_axis(&gamepad->hid, &hid_input,
+                                                event)) {
+        sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad axis");
+    } else {
+        // Unchanged, or rate-limited
+        sc_gamepad_uhid_schedule_flush(gamepad);
     }
 
-    sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad axis");
+    sc_mutex_unlock(&gamepad->mutex);
 }
 
 static void
@@ -118,22 +176,43 @@ sc_gamepad_processor_process_gamepad_button(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_button_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
+    sc_mutex_lock(&gamepad->mutex);
+
     struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_button(&gamepad->hid, &hid_input,
-                                                   event)) {
-        return;
+    if (sc_hid_gamepad_generate_input_from_button(&gamepad->hid, &hid_input,
+                                                  event)) {
+        sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad button");
     }
 
-    sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad button");
-
+    sc_mutex_unlock(&gamepad->mutex);
 }
 
-void
+bool
 sc_gamepad_uhid_init(struct sc_gamepad_uhid *gamepad,
-                     struct sc_controller *controller) {
-    sc_hid_gamepad_init(&gamepad->hid);
+                     struct sc_controller *controller, unsigned rate,
+                     struct sc_timer_service *timer_service) {
+    // A timer service is required to send the rate-limited reports
+    assert(!rate || timer_service);
+
+    if (!sc_mutex_init(&gamepad->mutex)) {
+        return false;
+    }
+
+    sc_hid_gamepad_init(&gamepad->hid, rate);
 
     gamepad->controller = controller;
+    gamepad->timer_service = rate ? timer_service : NULL;
+
+    if (gamepad->timer_service) {
+        bool ok = sc_timer_service_add(gamepad->timer_service,
+                                       &gamepad->flush_timer,
+                                       sc_gamepad_uhid_on_flush_timer,
+                                       gamepad);
+        if (!ok) {
+            sc_mutex_destroy(&gamepad->mutex);
+            return false;
+        }
+    }
 
     static const struct sc_gamepad_processor_ops ops = {
         .process_gamepad_added = sc_gamepad_processor_process_gamepad_added,
@@ -143,4 +222,15 @@ sc_gamepad_uhid_init(struct sc_gamepad_uhid *gamepad,
     };
 
     gamepad->gamepad_processor.ops = &ops;
+
+    return true;
+}
+
+void
+sc_gamepad_uhid_destroy(struct sc_gamepad_uhid *gamepad) {
+    if (gamepad->timer_service) {
+        // Wait for the timer callback to return, if it is running
+        sc_timer_service_remove(gamepad->timer_service, &gamepad->flush_timer);
+    }
+    sc_mutex_destroy(&gamepad->mutex);
 }
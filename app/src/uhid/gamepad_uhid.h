@@ -3,19 +3,44 @@
 
 #include "common.h"
 
+#include <stdbool.h>
+
 #include "controller.h"
 #include "hid/hid_gamepad.h"
+#include "timer_service.h"
 #include "trait/gamepad_processor.h"
+#include "util/thread.h"
 
 struct sc_gamepad_uhid {
     struct sc_gamepad_processor gamepad_processor; // gamepad processor trait
 
+    // Protect the HID state, updated from the main thread and flushed from
+    // the timer thread (the reports are pushed with the mutex held, so that
+    // they are sent in order)
+    sc_mutex mutex;
     struct sc_hid_gamepad hid;
     struct sc_controller *controller;
+
+    // Send the rate-limited reports at their deadline, independently of the
+    // main thread (NULL if the rate is unlimited)
+    struct sc_timer_service *timer_service;
+    struct sc_timer flush_timer;
 };
 
+/**
+ * Initialize a UHID gamepad
+ *
+ * \param rate maximum number of reports per second per gamepad (0 for
+ *             unlimited)
+ * \param timer_service the service sending the rate-limited reports (may be
+ *                      NULL if the rate is unlimited)
+ */
+bool
+sc_gamepad_uhid_init(struct sc_gamepad_uhid *gamepad,
+                     struct sc_controller *controller, unsigned rate,
+                     struct sc_timer_service *timer_service);
+
 void
-sc_gamepad_uhid_init(struct sc_gamepad_uhid *mouse,
-                     struct sc_controller *controller);
+sc_gamepad_uhid_destroy(struct sc_gamepad_uhid *gamepad);
 
 #endif
@@ -4,10 +4,12 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <libusb-1.0/libusb.h>
 
 #include "events.h"
+#include "hid/hid_mouse.h"
 #include "util/log.h"
 #include "util/str.h"
 #include "util/tick.h"
@@ -24,6 +26,10 @@
 // Drop droppable events above this limit
 #define SC_AOA_EVENT_QUEUE_LIMIT 60
 
+// Maximum number of HID input transfers submitted but not completed yet (so
+// that a slow USB round-trip does not throttle the input)
+#define SC_AOA_MAX_IN_FLIGHT 4
+
 struct sc_vec_hid_ids SC_VECTOR(uint16_t);
 
 static void
@@ -79,6 +85,7 @@ sc_aoa_init(struct sc_aoa *aoa, struct sc_usb *usb,
     }
 
     aoa->stopped = false;
+    atomic_init(&aoa->in_flight, 0);
     aoa->acksync = acksync;
     aoa->usb = usb;
 
@@ -154,9 +161,57 @@ sc_aoa_set_hid_report_desc(struct sc_aoa *aoa, uint16_t accessory_id,
     return true;
 }
 
+static void LIBUSB_CALL
+sc_aoa_hid_event_callback(struct libusb_transfer *transfer) {
+    // Called from the thread handling the libusb events
+    struct sc_aoa *aoa = transfer->user_data;
+
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        LOGW("SEND_HID_EVENT: transfer failed (status %d)",
+             (int) transfer->status);
+        if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+            sc_usb_check_disconnected(aoa->usb, LIBUSB_ERROR_NO_DEVICE);
+        }
+    }
+
+    // The transfer and its buffer are freed by libusb
+    // (LIBUSB_TRANSFER_FREE_TRANSFER and LIBUSB_TRANSFER_FREE_BUFFER)
+    atomic_fetch_sub(&aoa->in_flight, 1);
+}
+
+// Process the libusb events until at most `max` transfers are in flight
+//
+// If the libusb event thread is running, the completions are processed there
+// (and this call just waits for them), otherwise they are processed from here.
+static void
+sc_aoa_wait_in_flight(struct sc_aoa *aoa, unsigned max) {
+    while (atomic_load(&aoa->in_flight) > max) {
+        struct timeval tv = {0, 100000}; // 100 ms
+        libusb_handle_events_timeout_completed(aoa->usb->context, &tv, NULL);
+    }
+}
+
 static bool
 sc_aoa_send_hid_event(struct sc_aoa *aoa,
                       const struct sc_hid_input *hid_input) {
+    // Do not wait for the completion of the previous HID events before
+    // submitting this one (but limit the number of pending transfers)
+    sc_aoa_wait_in_flight(aoa, SC_AOA_MAX_IN_FLIGHT - 1);
+
+    struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+    if (!transfer) {
+        LOG_OOM();
+        return false;
+    }
+
+    uint16_t length = hid_input->size;
+    unsigned char *buffer = malloc(LIBUSB_CONTROL_SETUP_SIZE + length);
+    if (!buffer) {
+        LOG_OOM();
+        libusb_free_transfer(transfer);
+        return false;
+    }
+
     uint8_t request_type = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR;
     uint8_t request = ACCESSORY_SEND_HID_EVENT;
     // <https://source.android.com/devices/accessories/aoa2.html#hid-support>
@@ -164,14 +219,24 @@ sc_aoa_send_hid_event(struct sc_aoa *aoa,
     // index (arg1): 0 (unused)
     uint16_t value = hid_input->hid_id;
     uint16_t index = 0;
-    unsigned char *data = (uint8_t *) hid_input->data; // discard const
-    uint16_t length = hid_input->size;
-    int result = libusb_control_transfer(aoa->usb->handle, request_type,
-                                         request, value, index, data, length,
-                                         DEFAULT_TIMEOUT);
+    libusb_fill_control_setup(buffer, request_type, request, value, index,
+                              length);
+    memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, hid_input->data, length);
+
+    libusb_fill_control_transfer(transfer, aoa->usb->handle, buffer,
+                                 sc_aoa_hid_event_callback, aoa,
+                                 DEFAULT_TIMEOUT);
+    transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER
+                    | LIBUSB_TRANSFER_FREE_TRANSFER;
+
+    atomic_fetch_add(&aoa->in_flight, 1);
+    int result = libusb_submit_transfer(transfer);
     if (result < 0) {
+        atomic_fetch_sub(&aoa->in_flight, 1);
         LOGE("SEND_HID_EVENT: libusb error: %s", libusb_strerror(result));
         sc_usb_check_disconnected(aoa->usb, result);
+        // Also frees the buffer (LIBUSB_TRANSFER_FREE_BUFFER)
+        libusb_free_transfer(transfer);
         return false;
     }
 
@@ -234,7 +299,14 @@ sc_aoa_push_input_with_ack_to_wait(struct sc_aoa *aoa,
     bool pushed = false;
 
     size_t size = sc_vecdeque_size(&aoa->queue);
-    if (size < SC_AOA_EVENT_QUEUE_LIMIT) {
+    struct sc_aoa_event *last = size ? sc_vecdeque_back(&aoa->queue) : NULL;
+    if (last && last->type == SC_AOA_EVENT_TYPE_INPUT
+            && ack_to_wait == SC_SEQUENCE_INVALID
+            && sc_hid_mouse_merge_input(&last->input.hid, hid_input)) {
+        // The AOA thread is busy, send the mouse motions not sent yet as a
+        // single report instead of building a backlog
+        pushed = true;
+    } else if (size < SC_AOA_EVENT_QUEUE_LIMIT) {
         bool was_empty = sc_vecdeque_is_empty(&aoa->queue);
 
         struct sc_aoa_event *aoa_event =
@@ -356,6 +428,9 @@ sc_aoa_process_event(struct sc_aoa *aoa, struct sc_aoa_event *event,
             break;
         }
         case SC_AOA_EVENT_TYPE_OPEN: {
+            // The HID events submitted before must be sent first
+            sc_aoa_wait_in_flight(aoa, 0);
+
             struct sc_hid_open *hid_open = &event->open.hid;
             bool ok = sc_aoa_setup_hid(aoa, hid_open->hid_id,
                                        hid_open->report_desc,
@@ -380,6 +455,9 @@ sc_aoa_process_event(struct sc_aoa *aoa, struct sc_aoa_event *event,
             break;
         }
         case SC_AOA_EVENT_TYPE_CLOSE: {
+            // The HID events submitted before must be sent first
+            sc_aoa_wait_in_flight(aoa, 0);
+
             struct sc_hid_close *hid_close = &event->close.hid;
             bool ok = sc_aoa_unregister_hid(aoa, hid_close->hid_id);
             if (ok) {
@@ -430,6 +508,10 @@ run_aoa_thread(void *data) {
         }
     }
 
+    // The pending transfers reference aoa, wait for their completion (they
+    // time out after DEFAULT_TIMEOUT anyway)
+    sc_aoa_wait_in_flight(aoa, 0);
+
     // Explicitly unregister all registered HID ids before exiting
     for (size_t i = 0; i < vec_open.size; ++i) {
         uint16_t hid_id = vec_open.data[i];
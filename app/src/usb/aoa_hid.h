@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -45,6 +46,9 @@ struct sc_aoa {
     bool stopped;
     struct sc_aoa_event_queue queue;
 
+    // Number of asynchronous HID input transfers not completed yet
+    atomic_uint in_flight;
+
     struct sc_acksync *acksync;
 };
 
@@ -1,13 +1,70 @@
 #include "gamepad_aoa.h"
 
+#include <assert.h>
 #include <stdbool.h>
 
+#include "events.h"
 #include "input_events.h"
 #include "util/log.h"
+#include "util/thread.h"
 
 /** Downcast gamepad processor to gamepad_aoa */
 #define DOWNCAST(GP) container_of(GP, struct sc_gamepad_aoa, gamepad_processor)
 
+static void
+sc_gamepad_aoa_schedule_flush(struct sc_gamepad_aoa *gamepad);
+
+static void
+sc_gamepad_aoa_flush(void *userdata) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    struct sc_gamepad_aoa *gamepad = userdata;
+    gamepad->flush_timer = 0;
+
+    struct sc_hid_input hid_input;
+    while (sc_hid_gamepad_generate_pending_input(&gamepad->hid, &hid_input)) {
+        if (!sc_aoa_push_input(gamepad->aoa, &hid_input)) {
+            LOGW("Could not push AOA HID input (gamepad axis)");
+        }
+    }
+
+    sc_gamepad_aoa_schedule_flush(gamepad);
+}
+
+static Uint32 SDLCALL
+sc_gamepad_aoa_on_flush_timer(Uint32 interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread, flush from the main thread
+    sc_post_to_main_thread(sc_gamepad_aoa_flush, userdata);
+
+    // One-shot timer
+    return 0;
+}
+
+// Send the pending reports (rate-limited) once their deadline is reached
+static void
+sc_gamepad_aoa_schedule_flush(struct sc_gamepad_aoa *gamepad) {
+    if (gamepad->flush_timer) {
+        // Already scheduled
+        return;
+    }
+
+    sc_tick deadline;
+    if (!sc_hid_gamepad_get_pending_deadline(&gamepad->hid, &deadline)) {
+        return;
+    }
+
+    sc_tick delay = deadline - sc_tick_now();
+    // Round up to the next millisecond
+    Uint32 ms = delay > 0 ? SC_TICK_TO_MS(delay) + 1 : 1;
+    gamepad->flush_timer =
+        SDL_AddTimer(ms, sc_gamepad_aoa_on_flush_timer, gamepad);
+    if (!gamepad->flush_timer) {
+        LOGW("Could not schedule gamepad report: %s", SDL_GetError());
+    }
+}
+
 static void
 sc_gamepad_processor_process_gamepad_added(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_device_event *event) {
@@ -49,6 +106,8 @@ sc_gamepad_processor_process_gamepad_axis(struct sc_gamepad_processor *gp,
     struct sc_hid_input hid_input;
     if (!sc_hid_gamepad_generate_input_from_axis(&gamepad->hid, &hid_input,
                                                  event)) {
+        // Unchanged, or rate-limited
+        sc_gamepad_aoa_schedule_flush(gamepad);
         return;
     }
 
@@ -74,10 +133,12 @@ sc_gamepad_processor_process_gamepad_button(struct sc_gamepad_processor *gp,
 }
 
 void
-sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa) {
+sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa,
+                    unsigned rate) {
     gamepad->aoa = aoa;
+    gamepad->flush_timer = 0;
 
-    sc_hid_gamepad_init(&gamepad->hid);
+    sc_hid_gamepad_init(&gamepad->hid, rate);
 
     static const struct sc_gamepad_processor_ops ops = {
         .process_gamepad_added = sc_gamepad_processor_process_gamepad_added,
@@ -91,6 +152,8 @@ sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa) {
 
 void
 sc_gamepad_aoa_destroy(struct sc_gamepad_aoa *gamepad) {
-    (void) gamepad;
-    // Do nothing, gamepad->aoa will automatically unregister all devices
+    if (gamepad->flush_timer) {
+        SDL_RemoveTimer(gamepad->flush_timer);
+    }
+    // gamepad->aoa will automatically unregister all devices
 }
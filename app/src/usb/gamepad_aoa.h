@@ -3,6 +3,8 @@
 
 #include "common.h"
 
+#include <SDL2/SDL_timer.h>
+
 #include "hid/hid_gamepad.h"
 #include "usb/aoa_hid.h"
 #include "trait/gamepad_processor.h"
@@ -12,10 +14,15 @@ struct sc_gamepad_aoa {
 
     struct sc_hid_gamepad hid;
     struct sc_aoa *aoa;
+
+    // Send the rate-limited reports, accessed only from the main thread
+    SDL_TimerID flush_timer;
 };
 
+// rate: maximum number of reports per second per gamepad (0 for unlimited)
 void
-sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa);
+sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa,
+                    unsigned rate);
 
 void
 sc_gamepad_aoa_destroy(struct sc_gamepad_aoa *gamepad);
@@ -9,6 +9,7 @@
 # include "adb/adb.h"
 #endif
 #include "events.h"
+#include "mouse_capture.h"
 #include "usb/screen_otg.h"
 #include "usb/aoa_hid.h"
 #include "usb/gamepad_aoa.h"
@@ -48,6 +49,13 @@ event_loop(struct scrcpy_otg *s) {
             case SDL_QUIT:
                 LOGD("User requested to quit");
                 return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_RUN_ON_MAIN_THREAD: {
+                // Used to send the rate-limited gamepad reports
+                sc_runnable_fn run = event.user.data1;
+                void *userdata = event.user.data2;
+                run(userdata);
+                break;
+            }
             default:
                 sc_screen_otg_handle_event(&s->screen_otg, &event);
                 break;
@@ -71,6 +79,8 @@ scrcpy_otg(struct scrcpy_options *options) {
         LOGW("Could not allow joystick background events");
     }
 
+    sc_mouse_capture_set_hints();
+
     // Minimal SDL initialization
     if (SDL_Init(SDL_INIT_EVENTS)) {
         LOGE("Could not initialize SDL: %s", SDL_GetError());
@@ -173,7 +183,8 @@ scrcpy_otg(struct scrcpy_options *options) {
     }
 
     if (enable_gamepad) {
-        sc_gamepad_aoa_init(&s->gamepad, &s->aoa);
+        sc_gamepad_aoa_init(&s->gamepad, &s->aoa,
+                            options->gamepad_report_rate);
         gamepad = &s->gamepad;
     }
 
@@ -0,0 +1,275 @@
+#include "async_file.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#include "util/file.h"
+#include "util/log.h"
+
+// Sync the written data to the storage every 8 MiB (rather than on every
+// write, which would be very slow, especially on network storage)
+#define SC_ASYNC_FILE_SYNC_BYTES (8 << 20)
+
+static bool
+sc_async_file_sync(FILE *file) {
+    if (fflush(file)) {
+        return false;
+    }
+
+#ifdef _WIN32
+    return !_commit(_fileno(file));
+#else
+    return !fsync(fileno(file));
+#endif
+}
+
+static int
+run_async_file(void *data) {
+    struct sc_async_file *file = data;
+
+    sc_mutex_lock(&file->mutex);
+
+    for (;;) {
+        while (!file->stopped && !file->pending) {
+            sc_cond_wait(&file->cond, &file->mutex);
+        }
+
+        if (!file->pending) {
+            // Stopped and all the pending chunks are written
+            assert(file->stopped);
+            break;
+        }
+
+        struct sc_async_file_chunk *chunk = &file->chunks[file->head];
+        bool error = file->error;
+
+        // The chunk is not modified while it is pending
+        sc_mutex_unlock(&file->mutex);
+
+        bool ok = true;
+        if (!error) {
+            size_t w = fwrite(chunk->data, 1, chunk->len, file->file);
+            ok = w == chunk->len;
+            if (ok) {
+                file->unsynced_bytes += w;
+                if (file->unsynced_bytes >= SC_ASYNC_FILE_SYNC_BYTES) {
+                    ok = sc_async_file_sync(file->file);
+                    file->unsynced_bytes = 0;
+                }
+            }
+            if (!ok) {
+                LOGE("Could not write to file: %s", strerror(errno));
+            }
+        }
+
+        sc_mutex_lock(&file->mutex);
+        if (!ok) {
+            file->error = true;
+        }
+        file->head = (file->head + 1) % SC_ASYNC_FILE_CHUNK_COUNT;
+        --file->pending;
+        // Wake up the producer waiting for a free chunk (or for all the
+        // pending chunks to be written)
+        sc_cond_signal(&file->cond);
+    }
+
+    sc_mutex_unlock(&file->mutex);
+
+    return 0;
+}
+
+bool
+sc_async_file_open(struct sc_async_file *file, const char *path) {
+    file->file = sc_file_open(path, "wb");
+    if (!file->file) {
+        LOGE("Could not open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&file->mutex);
+    if (!ok) {
+        goto error_close_file;
+    }
+
+    ok = sc_cond_init(&file->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    for (unsigned i = 0; i < SC_ASYNC_FILE_CHUNK_COUNT; ++i) {
+        // Allocated on first use
+        file->chunks[i].data = NULL;
+        file->chunks[i].len = 0;
+    }
+
+    file->head = 0;
+    file->pending = 0;
+    file->stopped = false;
+    file->error = false;
+    file->unsynced_bytes = 0;
+
+    ok = sc_thread_create(&file->thread, run_async_file, "scrcpy-file-io",
+                          file);
+    if (!ok) {
+        LOGE("Could not start file writer thread");
+        goto error_cond_destroy;
+    }
+
+    return true;
+
+error_cond_destroy:
+    sc_cond_destroy(&file->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&file->mutex);
+error_close_file:
+    fclose(file->file);
+
+    return false;
+}
+
+bool
+sc_async_file_write(struct sc_async_file *file, const uint8_t *data,
+                    size_t len) {
+    sc_mutex_lock(&file->mutex);
+
+    while (len && !file->error) {
+        while (file->pending == SC_ASYNC_FILE_CHUNK_COUNT) {
+            // The disk cannot keep up
+            sc_cond_wait(&file->cond, &file->mutex);
+        }
+
+        unsigned index =
+            (file->head + file->pending) % SC_ASYNC_FILE_CHUNK_COUNT;
+        struct sc_async_file_chunk *chunk = &file->chunks[index];
+
+        // The chunk is not pending, the writer thread does not access it
+        sc_mutex_unlock(&file->mutex);
+
+        if (!chunk->data) {
+            chunk->data = malloc(SC_ASYNC_FILE_CHUNK_SIZE);
+            if (!chunk->data) {
+                LOG_OOM();
+                sc_mutex_lock(&file->mutex);
+                file->error = true;
+                break;
+            }
+        }
+
+        size_t n = MIN(len, SC_ASYNC_FILE_CHUNK_SIZE);
+        memcpy(chunk->data, data, n);
+        chunk->len = n;
+        data += n;
+        len -= n;
+
+        sc_mutex_lock(&file->mutex);
+        ++file->pending;
+        sc_cond_signal(&file->cond);
+    }
+
+    bool ok = !file->error;
+    sc_mutex_unlock(&file->mutex);
+
+    return ok;
+}
+
+// Must be called with the mutex locked
+static void
+sc_async_file_drain(struct sc_async_file *file) {
+    while (file->pending) {
+        sc_cond_wait(&file->cond, &file->mutex);
+    }
+}
+
+static int
+sc_async_file_fseek(FILE *file, int64_t offset, int whence) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, whence);
+#else
+    return fseeko(file, offset, whence);
+#endif
+}
+
+static int64_t
+sc_async_file_ftell(FILE *file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+int64_t
+sc_async_file_seek(struct sc_async_file *file, int64_t offset, int whence) {
+    sc_mutex_lock(&file->mutex);
+    sc_async_file_drain(file);
+
+    // No chunk is pending, the writer thread does not access the file until
+    // the mutex is unlocked
+    int64_t pos = -1;
+    if (!file->error && !sc_async_file_fseek(file->file, offset, whence)) {
+        pos = sc_async_file_ftell(file->file);
+    }
+
+    sc_mutex_unlock(&file->mutex);
+
+    return pos;
+}
+
+int64_t
+sc_async_file_size(struct sc_async_file *file) {
+    sc_mutex_lock(&file->mutex);
+    sc_async_file_drain(file);
+
+    int64_t size = -1;
+    if (!file->error) {
+        int64_t pos = sc_async_file_ftell(file->file);
+        if (pos != -1 && !sc_async_file_fseek(file->file, 0, SEEK_END)) {
+            size = sc_async_file_ftell(file->file);
+            if (sc_async_file_fseek(file->file, pos, SEEK_SET)) {
+                file->error = true;
+                size = -1;
+            }
+        }
+    }
+
+    sc_mutex_unlock(&file->mutex);
+
+    return size;
+}
+
+bool
+sc_async_file_close(struct sc_async_file *file) {
+    sc_mutex_lock(&file->mutex);
+    file->stopped = true;
+    sc_cond_signal(&file->cond);
+    sc_mutex_unlock(&file->mutex);
+
+    sc_thread_join(&file->thread, NULL);
+
+    bool ok = !file->error;
+    if (ok && !sc_async_file_sync(file->file)) {
+        LOGE("Could not sync file: %s", strerror(errno));
+        ok = false;
+    }
+
+    if (fclose(file->file) && ok) {
+        LOGE("Could not close file: %s", strerror(errno));
+        ok = false;
+    }
+
+    for (unsigned i = 0; i < SC_ASYNC_FILE_CHUNK_COUNT; ++i) {
+        free(file->chunks[i].data);
+    }
+
+    sc_cond_destroy(&file->cond);
+    sc_mutex_destroy(&file->mutex);
+
+    return ok;
+}
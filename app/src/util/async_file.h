@@ -0,0 +1,74 @@
+#ifndef SC_ASYNC_FILE_H
+#define SC_ASYNC_FILE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "util/thread.h"
+
+#define SC_ASYNC_FILE_CHUNK_SIZE (1 << 20) // 1 MiB
+#define SC_ASYNC_FILE_CHUNK_COUNT 16
+
+/**
+ * File opened for writing, where the data is written to the disk by a
+ * separate thread
+ *
+ * A write only copies the data to a chunk and returns immediately, unless all
+ * the chunks are pending (the disk cannot keep up). The data is synced to the
+ * storage in batches (not on every write).
+ *
+ * Except for the writer thread, all the functions must be called from the
+ * same thread.
+ */
+struct sc_async_file {
+    FILE *file;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond; // signaled on new chunk, chunk written, or stop
+
+    struct sc_async_file_chunk {
+        uint8_t *data;
+        size_t len;
+    } chunks[SC_ASYNC_FILE_CHUNK_COUNT];
+
+    // pending chunks: [head, head + pending) modulo SC_ASYNC_FILE_CHUNK_COUNT
+    unsigned head;
+    unsigned pending;
+
+    bool stopped;
+    bool error; // a write has failed (the following writes are discarded)
+
+    // Only accessed by the writer thread
+    uint64_t unsynced_bytes;
+};
+
+bool
+sc_async_file_open(struct sc_async_file *file, const char *path);
+
+// Return false if the file is in error
+bool
+sc_async_file_write(struct sc_async_file *file, const uint8_t *data,
+                    size_t len);
+
+// Wait for the pending writes, then seek (like fseek())
+//
+// Return the new position, or -1 on error.
+int64_t
+sc_async_file_seek(struct sc_async_file *file, int64_t offset, int whence);
+
+// Wait for the pending writes, then return the file size, or -1 on error
+int64_t
+sc_async_file_size(struct sc_async_file *file);
+
+// Write the pending data, sync and close the file
+//
+// Return false if any write failed.
+bool
+sc_async_file_close(struct sc_async_file *file);
+
+#endif
@@ -0,0 +1,129 @@
+#include "audio_convert.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+#define SC_S16_SCALE (1.0f / 32768)
+
+void
+sc_audio_convert_s16_to_flt(float *dst, const int16_t *src, size_t count) {
+    size_t i = 0;
+
+    // SSE2 and NEON are always available on x86_64 and aarch64, so they are
+    // selected at compile time (the remaining samples are converted below)
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(SC_S16_SCALE);
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+        // Sign-extend each 16-bit value to 32 bits
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t scale = vdupq_n_f32(SC_S16_SCALE);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        int32x4_t lo = vmovl_s16(vget_low_s16(s));
+        int32x4_t hi = vmovl_s16(vget_high_s16(s));
+        vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(lo), scale));
+        vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(hi), scale));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        dst[i] = src[i] * SC_S16_SCALE;
+    }
+}
+
+void
+sc_audio_convert_fltp_to_flt(float *dst, const float *const *src,
+                             size_t channels, size_t samples) {
+    if (channels == 2) {
+        // The common case, let the compiler vectorize it
+        const float *l = src[0];
+        const float *r = src[1];
+        for (size_t i = 0; i < samples; ++i) {
+            dst[2 * i] = l[i];
+            dst[2 * i + 1] = r[i];
+        }
+        return;
+    }
+
+    for (size_t c = 0; c < channels; ++c) {
+        const float *plane = src[c];
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i * channels + c] = plane[i];
+        }
+    }
+}
+
+void
+sc_audio_convert_s16p_to_flt(float *dst, const int16_t *const *src,
+                             size_t channels, size_t samples) {
+    for (size_t c = 0; c < channels; ++c) {
+        const int16_t *plane = src[c];
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i * channels + c] = plane[i] * SC_S16_SCALE;
+        }
+    }
+}
+
+void
+sc_audio_scale_flt(float *samples, size_t count, float gain) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_loadu_ps(samples + i);
+        __m128 b = _mm_loadu_ps(samples + i + 4);
+        _mm_storeu_ps(samples + i, _mm_mul_ps(a, g));
+        _mm_storeu_ps(samples + i + 4, _mm_mul_ps(b, g));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 8 <= count; i += 8) {
+        float32x4_t a = vld1q_f32(samples + i);
+        float32x4_t b = vld1q_f32(samples + i + 4);
+        vst1q_f32(samples + i, vmulq_f32(a, g));
+        vst1q_f32(samples + i + 4, vmulq_f32(b, g));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        samples[i] *= gain;
+    }
+}
+
+void
+sc_audio_mix_flt(float *dst, const float *src, size_t count, float gain) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), g);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), a));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), b));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 8 <= count; i += 8) {
+        // dst + src * g
+        vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i),
+                                     vld1q_f32(src + i), g));
+        vst1q_f32(dst + i + 4, vmlaq_f32(vld1q_f32(dst + i + 4),
+                                         vld1q_f32(src + i + 4), g));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
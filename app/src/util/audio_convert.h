@@ -0,0 +1,52 @@
+#ifndef SC_AUDIO_CONVERT_H
+#define SC_AUDIO_CONVERT_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Convert count signed 16-bit samples to float samples in [-1, 1)
+ *
+ * It uses the same scaling as libswresample (1/32768). The buffers must not
+ * overlap.
+ */
+void
+sc_audio_convert_s16_to_flt(float *dst, const int16_t *src, size_t count);
+
+/**
+ * Interleave planar float samples (one plane per channel)
+ *
+ * The buffers must not overlap.
+ */
+void
+sc_audio_convert_fltp_to_flt(float *dst, const float *const *src,
+                             size_t channels, size_t samples);
+
+/**
+ * Interleave planar signed 16-bit samples and convert them to float samples
+ * (like sc_audio_convert_s16_to_flt())
+ *
+ * The buffers must not overlap.
+ */
+void
+sc_audio_convert_s16p_to_flt(float *dst, const int16_t *const *src,
+                             size_t channels, size_t samples);
+
+/**
+ * Multiply count float samples by gain, in place
+ */
+void
+sc_audio_scale_flt(float *samples, size_t count, float gain);
+
+/**
+ * Add count float samples multiplied by gain to dst
+ *
+ * The result is not clamped (the audio output clamps the final samples). The
+ * buffers must not overlap.
+ */
+void
+sc_audio_mix_flt(float *dst, const float *src, size_t count, float gain);
+
+#endif
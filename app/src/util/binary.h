@@ -56,6 +56,11 @@ sc_read32be(const uint8_t *buf) {
     return ((uint32_t) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
 }
 
+static inline uint32_t
+sc_read32le(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
 static inline uint64_t
 sc_read64be(const uint8_t *buf) {
     uint32_t msb = sc_read32be(buf);
@@ -92,4 +97,24 @@ sc_float_to_i16fp(float f) {
     return (int16_t) i;
 }
 
+/**
+ * Convert an unsigned 16-bit fixed-point value to a float between 0 and 1
+ *
+ * This is the inverse of sc_float_to_u16fp() (0xffff is converted to 1.0f).
+ */
+static inline float
+sc_u16fp_to_float(uint16_t u) {
+    return u == 0xffff ? 1.0f : u / 0x1p16f;
+}
+
+/**
+ * Convert a signed 16-bit fixed-point value to a float between -1 and 1
+ *
+ * This is the inverse of sc_float_to_i16fp() (0x7fff is converted to 1.0f).
+ */
+static inline float
+sc_i16fp_to_float(int16_t i) {
+    return i == 0x7fff ? 1.0f : i / 0x1p15f;
+}
+
 #endif
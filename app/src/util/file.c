@@ -1,10 +1,15 @@
 #include "file.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "util/log.h"
 
+// 64-bit FNV-1a
+#define SC_FNV_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define SC_FNV_PRIME UINT64_C(0x100000001b3)
+
 char *
 sc_file_get_local_path(const char *name) {
     char *executable_path = sc_file_get_executable_path();
@@ -46,3 +51,33 @@ sc_file_get_local_path(const char *name) {
     return file_path;
 }
 
+bool
+sc_file_hash(const char *path, uint64_t *hash) {
+    FILE *file = sc_file_open(path, "rb");
+    if (!file) {
+        LOGE("Could not open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    uint64_t h = SC_FNV_OFFSET_BASIS;
+
+    uint8_t buf[4096];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), file))) {
+        for (size_t i = 0; i < r; ++i) {
+            h = (h ^ buf[i]) * SC_FNV_PRIME;
+        }
+    }
+
+    bool ok = !ferror(file);
+    if (!ok) {
+        LOGE("Could not read \"%s\"", path);
+    }
+
+    fclose(file);
+
+    if (ok) {
+        *hash = h;
+    }
+    return ok;
+}
@@ -4,6 +4,8 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifdef _WIN32
 # define SC_PATH_SEPARATOR '\\'
@@ -46,4 +48,29 @@ sc_file_get_local_path(const char *name);
 bool
 sc_file_is_regular(const char *path);
 
+/**
+ * Open a file (like fopen(), but the path is always UTF-8 encoded)
+ */
+FILE *
+sc_file_open(const char *path, const char *mode);
+
+/**
+ * Delete a file (like remove(), but the path is always UTF-8 encoded)
+ */
+bool
+sc_file_remove(const char *path);
+
+/**
+ * Rename a file, replacing the destination if it exists (so that a reader
+ * never sees a partially written file)
+ */
+bool
+sc_file_replace(const char *from, const char *to);
+
+/**
+ * Compute a (non-cryptographic) 64-bit hash of the file content
+ */
+bool
+sc_file_hash(const char *path, uint64_t *hash);
+
 #endif
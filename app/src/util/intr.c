@@ -74,6 +74,13 @@ sc_intr_interrupt(struct sc_intr *intr) {
     sc_mutex_unlock(&intr->mutex);
 }
 
+void
+sc_intr_reset(struct sc_intr *intr) {
+    sc_mutex_lock(&intr->mutex);
+    atomic_store_explicit(&intr->interrupted, false, memory_order_relaxed);
+    sc_mutex_unlock(&intr->mutex);
+}
+
 void
 sc_intr_destroy(struct sc_intr *intr) {
     assert(intr->socket == SC_SOCKET_NONE);
@@ -0,0 +1,362 @@
+#include "log_async.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_log.h>
+
+#include "util/log.h"
+#include "util/memory.h"
+#include "util/notifier.h"
+#include "util/thread.h"
+
+#define SC_LOG_ASYNC_CAPACITY 2048 // must be a power of 2
+#define SC_LOG_ASYNC_MASK (SC_LOG_ASYNC_CAPACITY - 1)
+
+// A message is split into several consecutive records if necessary
+#define SC_LOG_ASYNC_RECORD_DATA_SIZE 240
+// SDL already truncates the messages to SDL_MAX_LOG_MESSAGE (4096) bytes
+#define SC_LOG_ASYNC_MAX_RECORDS_PER_MESSAGE 32
+#define SC_LOG_ASYNC_MESSAGE_MAX_SIZE \
+    (SC_LOG_ASYNC_MAX_RECORDS_PER_MESSAGE * SC_LOG_ASYNC_RECORD_DATA_SIZE)
+
+struct sc_log_record {
+    // Bounded multi-producer ring (Dmitry Vyukov's algorithm): the record at
+    // position pos is free if seq == pos, and published if seq == pos + 1
+    atomic_uint_least32_t seq;
+    int category;
+    SDL_LogPriority priority;
+    bool last; // last record of the message
+    uint16_t len;
+    char data[SC_LOG_ASYNC_RECORD_DATA_SIZE];
+};
+
+static struct {
+    struct sc_log_record *records;
+    // Next position to claim, written by the producers
+    atomic_uint_least32_t head;
+    // Next position to read, only accessed by the writer thread
+    uint32_t tail;
+    // Position of the end of the last message written to the output
+    atomic_uint_least32_t written;
+    // Set once the writer thread will not write anything anymore
+    atomic_bool finished;
+
+    // Messages dropped because the ring was full
+    atomic_uint dropped;
+    atomic_bool stopped;
+
+    struct sc_notifier notifier;
+    sc_thread thread;
+
+    // To wait until an error message is written
+    sc_mutex flush_mutex;
+    sc_cond flush_cond;
+    atomic_uint flush_waiters;
+
+    // The synchronous output function, called by the writer thread
+    SDL_LogOutputFunction output;
+    void *output_userdata;
+
+    // Message being reassembled, only accessed by the writer thread
+    char message[SC_LOG_ASYNC_MESSAGE_MAX_SIZE + 1];
+    size_t message_len;
+} sc_log_async;
+
+static bool
+sc_log_async_must_flush(SDL_LogPriority priority) {
+    // The process may abort just after logging an error, so never return
+    // before it is actually written
+    return priority >= SDL_LOG_PRIORITY_ERROR;
+}
+
+// Wait until the writer thread has written the records up to end (excluded)
+static void
+sc_log_async_wait_written(uint32_t end) {
+    sc_mutex_lock(&sc_log_async.flush_mutex);
+    // Pairs with the check in sc_log_async_notify_written() (both are
+    // sequentially consistent): either the writer sees the waiter, or the
+    // waiter sees the written position
+    atomic_fetch_add(&sc_log_async.flush_waiters, 1);
+    for (;;) {
+        uint32_t written = atomic_load(&sc_log_async.written);
+        if ((int32_t) (written - end) >= 0
+                || atomic_load(&sc_log_async.finished)) {
+            break;
+        }
+        sc_cond_wait(&sc_log_async.flush_cond, &sc_log_async.flush_mutex);
+    }
+    atomic_fetch_sub(&sc_log_async.flush_waiters, 1);
+    sc_mutex_unlock(&sc_log_async.flush_mutex);
+}
+
+static void
+sc_log_async_notify_written(void) {
+    // Only lock if an error is being flushed
+    if (atomic_load(&sc_log_async.flush_waiters)) {
+        sc_mutex_lock(&sc_log_async.flush_mutex);
+        sc_cond_broadcast(&sc_log_async.flush_cond);
+        sc_mutex_unlock(&sc_log_async.flush_mutex);
+    }
+}
+
+static void SDLCALL
+sc_log_async_output(void *userdata, int category, SDL_LogPriority priority,
+                    const char *message) {
+    (void) userdata;
+
+    bool flush = sc_log_async_must_flush(priority);
+
+    size_t len = strlen(message);
+    uint32_t count = (len + SC_LOG_ASYNC_RECORD_DATA_SIZE - 1)
+                   / SC_LOG_ASYNC_RECORD_DATA_SIZE;
+    if (!count) {
+        // Empty message
+        count = 1;
+    } else if (count > SC_LOG_ASYNC_MAX_RECORDS_PER_MESSAGE) {
+        count = SC_LOG_ASYNC_MAX_RECORDS_PER_MESSAGE;
+        len = SC_LOG_ASYNC_MESSAGE_MAX_SIZE; // truncate
+    }
+
+    // Claim count consecutive records
+    uint32_t pos = atomic_load_explicit(&sc_log_async.head,
+                                        memory_order_relaxed);
+    for (;;) {
+        // The records are released in order by the writer thread: if the last
+        // one is free, then all of them are
+        uint32_t last_pos = pos + count - 1;
+        struct sc_log_record *last =
+            &sc_log_async.records[last_pos & SC_LOG_ASYNC_MASK];
+        uint32_t seq = atomic_load_explicit(&last->seq, memory_order_acquire);
+        int32_t diff = (int32_t) (seq - last_pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&sc_log_async.head, &pos,
+                                                      pos + count,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+            // pos has been updated by the failed compare-exchange
+        } else if (diff < 0) {
+            if (flush) {
+                // Never drop an error, write it synchronously (possibly out of
+                // order)
+                sc_log_async.output(sc_log_async.output_userdata, category,
+                                    priority, message);
+                return;
+            }
+            // The ring is full, never block
+            atomic_fetch_add_explicit(&sc_log_async.dropped, 1,
+                                      memory_order_relaxed);
+            return;
+        } else {
+            // Claimed concurrently by another producer
+            pos = atomic_load_explicit(&sc_log_async.head,
+                                       memory_order_relaxed);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        struct sc_log_record *record =
+            &sc_log_async.records[(pos + i) & SC_LOG_ASYNC_MASK];
+        size_t offset = i * SC_LOG_ASYNC_RECORD_DATA_SIZE;
+        size_t record_len = len - offset;
+        if (record_len > SC_LOG_ASYNC_RECORD_DATA_SIZE) {
+            record_len = SC_LOG_ASYNC_RECORD_DATA_SIZE;
+        }
+
+        record->category = category;
+        record->priority = priority;
+        record->last = i == count - 1;
+        record->len = record_len;
+        memcpy(record->data, message + offset, record_len);
+
+        // Publish the record
+        atomic_store_explicit(&record->seq, pos + i + 1,
+                              memory_order_release);
+    }
+
+    sc_notifier_notify(&sc_log_async.notifier);
+
+    if (flush) {
+        sc_log_async_wait_written(pos + count);
+    }
+}
+
+static bool
+sc_log_async_has_record(void) {
+    uint32_t tail = sc_log_async.tail;
+    struct sc_log_record *record =
+        &sc_log_async.records[tail & SC_LOG_ASYNC_MASK];
+    uint32_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+    return seq == tail + 1;
+}
+
+static bool
+sc_log_async_is_ready(void *userdata) {
+    (void) userdata;
+    return sc_log_async_has_record()
+        || atomic_load_explicit(&sc_log_async.stopped, memory_order_relaxed);
+}
+
+static void
+sc_log_async_report_dropped(void) {
+    unsigned dropped = atomic_exchange_explicit(&sc_log_async.dropped, 0,
+                                                memory_order_relaxed);
+    if (dropped) {
+        char message[64];
+        snprintf(message, sizeof(message), "%u log messages dropped",
+                 dropped);
+        sc_log_async.output(sc_log_async.output_userdata,
+                            SDL_LOG_CATEGORY_APPLICATION,
+                            SDL_LOG_PRIORITY_WARN, message);
+    }
+}
+
+// Write all the complete messages available
+static void
+sc_log_async_drain(void) {
+    while (sc_log_async_has_record()) {
+        uint32_t tail = sc_log_async.tail;
+        struct sc_log_record *record =
+            &sc_log_async.records[tail & SC_LOG_ASYNC_MASK];
+
+        assert(sc_log_async.message_len + record->len
+                <= SC_LOG_ASYNC_MESSAGE_MAX_SIZE);
+        memcpy(&sc_log_async.message[sc_log_async.message_len], record->data,
+               record->len);
+        sc_log_async.message_len += record->len;
+
+        int category = record->category;
+        SDL_LogPriority priority = record->priority;
+        bool last = record->last;
+
+        // Release the record for the next lap
+        atomic_store_explicit(&record->seq, tail + SC_LOG_ASYNC_CAPACITY,
+                              memory_order_release);
+        sc_log_async.tail = tail + 1;
+
+        if (last) {
+            sc_log_async.message[sc_log_async.message_len] = '\0';
+            sc_log_async.message_len = 0;
+            sc_log_async.output(sc_log_async.output_userdata, category,
+                                priority, sc_log_async.message);
+
+            atomic_store(&sc_log_async.written, sc_log_async.tail);
+            sc_log_async_notify_written();
+
+            // Report the dropped messages between two complete messages
+            sc_log_async_report_dropped();
+        }
+    }
+}
+
+static int
+run_log_async(void *data) {
+    (void) data;
+
+    for (;;) {
+        sc_notifier_wait(&sc_log_async.notifier, sc_log_async_is_ready, NULL);
+
+        bool stopped = atomic_load_explicit(&sc_log_async.stopped,
+                                            memory_order_acquire);
+        sc_log_async_drain();
+        if (stopped) {
+            break;
+        }
+    }
+
+    // The remaining messages will be written by sc_log_async_stop(), do not
+    // make the threads logging an error wait for them
+    atomic_store(&sc_log_async.finished, true);
+    sc_mutex_lock(&sc_log_async.flush_mutex);
+    sc_cond_broadcast(&sc_log_async.flush_cond);
+    sc_mutex_unlock(&sc_log_async.flush_mutex);
+
+    return 0;
+}
+
+bool
+sc_log_async_start(void) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    sc_log_async.records =
+        sc_allocarray(SC_LOG_ASYNC_CAPACITY, sizeof(*sc_log_async.records));
+    if (!sc_log_async.records) {
+        LOG_OOM();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < SC_LOG_ASYNC_CAPACITY; ++i) {
+        atomic_init(&sc_log_async.records[i].seq, i);
+    }
+    atomic_init(&sc_log_async.head, 0);
+    sc_log_async.tail = 0;
+    atomic_init(&sc_log_async.written, 0);
+    atomic_init(&sc_log_async.finished, false);
+    atomic_init(&sc_log_async.dropped, 0);
+    atomic_init(&sc_log_async.stopped, false);
+    atomic_init(&sc_log_async.flush_waiters, 0);
+    sc_log_async.message_len = 0;
+
+    if (!sc_notifier_init(&sc_log_async.notifier)) {
+        goto error_free_records;
+    }
+
+    if (!sc_mutex_init(&sc_log_async.flush_mutex)) {
+        goto error_destroy_notifier;
+    }
+
+    if (!sc_cond_init(&sc_log_async.flush_cond)) {
+        goto error_destroy_flush_mutex;
+    }
+
+    SDL_LogGetOutputFunction(&sc_log_async.output,
+                             &sc_log_async.output_userdata);
+
+    bool ok = sc_thread_create(&sc_log_async.thread, run_log_async,
+                               "scrcpy-log", NULL);
+    if (!ok) {
+        LOGE("Could not start log thread");
+        goto error_destroy_flush_cond;
+    }
+
+    SDL_LogSetOutputFunction(sc_log_async_output, NULL);
+
+    return true;
+
+error_destroy_flush_cond:
+    sc_cond_destroy(&sc_log_async.flush_cond);
+error_destroy_flush_mutex:
+    sc_mutex_destroy(&sc_log_async.flush_mutex);
+error_destroy_notifier:
+    sc_notifier_destroy(&sc_log_async.notifier);
+error_free_records:
+    free(sc_log_async.records);
+
+    return false;
+}
+
+void
+sc_log_async_stop(void) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    atomic_store_explicit(&sc_log_async.stopped, true, memory_order_release);
+    sc_notifier_notify(&sc_log_async.notifier);
+    sc_thread_join(&sc_log_async.thread, NULL);
+
+    SDL_LogSetOutputFunction(sc_log_async.output,
+                             sc_log_async.output_userdata);
+
+    // Write the messages pushed after the writer thread has finished
+    sc_log_async_drain();
+    sc_log_async_report_dropped();
+
+    sc_cond_destroy(&sc_log_async.flush_cond);
+    sc_mutex_destroy(&sc_log_async.flush_mutex);
+    sc_notifier_destroy(&sc_log_async.notifier);
+    free(sc_log_async.records);
+}
@@ -0,0 +1,34 @@
+#ifndef SC_LOG_ASYNC_H
+#define SC_LOG_ASYNC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+/**
+ * Asynchronous logging
+ *
+ * Once started, the log messages (already formatted by SDL) are pushed to a
+ * lock-free multi-producer ring, and written to the output by a background
+ * thread. Logging from a hot thread therefore never blocks on the terminal or
+ * on a pipe.
+ *
+ * If the ring is full, the messages are dropped, and the number of dropped
+ * messages is logged once the writer has caught up.
+ *
+ * Errors are never lost: logging an error waits until it is written (the
+ * process may abort just after), and if the ring is full, it is written
+ * synchronously.
+ */
+
+// Must be called after sc_log_configure(), from the main thread
+bool
+sc_log_async_start(void);
+
+// Write the pending messages, then log synchronously again
+//
+// Must be called from the main thread, once the other threads are joined.
+void
+sc_log_async_stop(void);
+
+#endif
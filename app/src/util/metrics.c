@@ -0,0 +1,297 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/log.h"
+
+void
+sc_metrics_init(struct sc_metrics *metrics) {
+    atomic_init(&metrics->count, 0);
+}
+
+static struct sc_metric *
+sc_metrics_register(struct sc_metrics *metrics, const char *name,
+                    const char *help, enum sc_metric_type type) {
+    if (!metrics) {
+        return NULL;
+    }
+
+    // Only the registering thread writes the count
+    unsigned count = atomic_load_explicit(&metrics->count,
+                                          memory_order_relaxed);
+    if (count == SC_METRICS_CAPACITY) {
+        LOGW("Too many metrics, ignoring %s", name);
+        return NULL;
+    }
+
+    struct sc_metric *metric = &metrics->metrics[count];
+
+    size_t len = strlen(name);
+    assert(len && len < SC_METRIC_NAME_MAX);
+    memcpy(metric->name, name, len + 1);
+
+    metric->help = help;
+    metric->type = type;
+    atomic_init(&metric->value, 0);
+    metric->bounds = NULL;
+    metric->bound_count = 0;
+    for (unsigned i = 0; i <= SC_METRIC_MAX_BOUNDS; ++i) {
+        atomic_init(&metric->buckets[i], 0);
+    }
+
+    return metric;
+}
+
+static void
+sc_metrics_publish(struct sc_metrics *metrics) {
+    // Make the new metric visible to the exporting threads
+    atomic_fetch_add_explicit(&metrics->count, 1, memory_order_release);
+}
+
+struct sc_metric *
+sc_metrics_register_counter(struct sc_metrics *metrics, const char *name,
+                            const char *help) {
+    struct sc_metric *metric =
+        sc_metrics_register(metrics, name, help, SC_METRIC_TYPE_COUNTER);
+    if (metric) {
+        sc_metrics_publish(metrics);
+    }
+    return metric;
+}
+
+struct sc_metric *
+sc_metrics_register_gauge(struct sc_metrics *metrics, const char *name,
+                          const char *help) {
+    struct sc_metric *metric =
+        sc_metrics_register(metrics, name, help, SC_METRIC_TYPE_GAUGE);
+    if (metric) {
+        sc_metrics_publish(metrics);
+    }
+    return metric;
+}
+
+struct sc_metric *
+sc_metrics_register_histogram(struct sc_metrics *metrics, const char *name,
+                              const char *help, const int64_t *bounds,
+                              unsigned bound_count) {
+    assert(bound_count <= SC_METRIC_MAX_BOUNDS);
+    struct sc_metric *metric =
+        sc_metrics_register(metrics, name, help, SC_METRIC_TYPE_HISTOGRAM);
+    if (metric) {
+        metric->bounds = bounds;
+        metric->bound_count = bound_count;
+        sc_metrics_publish(metrics);
+    }
+    return metric;
+}
+
+static bool
+sc_metrics_append_int(struct sc_strbuf *buf, int64_t value) {
+    char tmp[24];
+    int len = snprintf(tmp, sizeof(tmp), "%" PRIi64, value);
+    assert(len > 0 && (size_t) len < sizeof(tmp));
+    return sc_strbuf_append(buf, tmp, len);
+}
+
+static bool
+sc_metrics_append_uint(struct sc_strbuf *buf, uint64_t value) {
+    char tmp[24];
+    int len = snprintf(tmp, sizeof(tmp), "%" PRIu64, value);
+    assert(len > 0 && (size_t) len < sizeof(tmp));
+    return sc_strbuf_append(buf, tmp, len);
+}
+
+static unsigned
+sc_metrics_get_count(struct sc_metrics *metrics) {
+    return atomic_load_explicit(&metrics->count, memory_order_acquire);
+}
+
+static int64_t
+sc_metric_get_value(struct sc_metric *metric) {
+    return atomic_load_explicit(&metric->value, memory_order_relaxed);
+}
+
+static uint64_t
+sc_metric_get_bucket(struct sc_metric *metric, unsigned i) {
+    return atomic_load_explicit(&metric->buckets[i], memory_order_relaxed);
+}
+
+static bool
+sc_metrics_append_json_histogram(struct sc_strbuf *buf,
+                                 struct sc_metric *metric) {
+    // Read the buckets first, so that the total count is consistent with
+    // them (the sum may include a few more values)
+    uint64_t cumulative[SC_METRIC_MAX_BOUNDS + 1];
+    uint64_t total = 0;
+    for (unsigned i = 0; i <= metric->bound_count; ++i) {
+        total += sc_metric_get_bucket(metric, i);
+        cumulative[i] = total;
+    }
+
+    bool ok = sc_strbuf_append_staticstr(buf, "{\"count\":")
+           && sc_metrics_append_uint(buf, total)
+           && sc_strbuf_append_staticstr(buf, ",\"sum\":")
+           && sc_metrics_append_int(buf, sc_metric_get_value(metric))
+           && sc_strbuf_append_staticstr(buf, ",\"buckets\":{");
+    for (unsigned i = 0; ok && i <= metric->bound_count; ++i) {
+        if (i) {
+            ok = sc_strbuf_append_char(buf, ',');
+        }
+        ok = ok && sc_strbuf_append_char(buf, '"');
+        if (i < metric->bound_count) {
+            ok = ok && sc_metrics_append_int(buf, metric->bounds[i]);
+        } else {
+            ok = ok && sc_strbuf_append_staticstr(buf, "+Inf");
+        }
+        ok = ok && sc_strbuf_append_staticstr(buf, "\":")
+                && sc_metrics_append_uint(buf, cumulative[i]);
+    }
+
+    return ok && sc_strbuf_append_staticstr(buf, "}}");
+}
+
+bool
+sc_metrics_format_json(struct sc_metrics *metrics, struct sc_strbuf *buf,
+                       int64_t timestamp) {
+    // The metric names only contain characters which need no escaping
+    bool ok = sc_strbuf_append_staticstr(buf, "{\"timestamp\":")
+           && sc_metrics_append_int(buf, timestamp);
+
+    unsigned count = sc_metrics_get_count(metrics);
+    for (unsigned i = 0; ok && i < count; ++i) {
+        struct sc_metric *metric = &metrics->metrics[i];
+        ok = sc_strbuf_append_staticstr(buf, ",\"")
+          && sc_strbuf_append_str(buf, metric->name)
+          && sc_strbuf_append_staticstr(buf, "\":");
+        if (!ok) {
+            break;
+        }
+
+        if (metric->type == SC_METRIC_TYPE_HISTOGRAM) {
+            ok = sc_metrics_append_json_histogram(buf, metric);
+        } else {
+            ok = sc_metrics_append_int(buf, sc_metric_get_value(metric));
+        }
+    }
+
+    return ok && sc_strbuf_append_char(buf, '}');
+}
+
+static const char *
+sc_metric_type_name(enum sc_metric_type type) {
+    switch (type) {
+        case SC_METRIC_TYPE_COUNTER:
+            return "counter";
+        case SC_METRIC_TYPE_GAUGE:
+            return "gauge";
+        case SC_METRIC_TYPE_HISTOGRAM:
+            return "histogram";
+        default:
+            assert(!"unexpected metric type");
+            return NULL;
+    }
+}
+
+static bool
+sc_metrics_append_prometheus_histogram(struct sc_strbuf *buf,
+                                       struct sc_metric *metric) {
+    uint64_t total = 0;
+    bool ok = true;
+    for (unsigned i = 0; ok && i <= metric->bound_count; ++i) {
+        total += sc_metric_get_bucket(metric, i);
+        ok = sc_strbuf_append_str(buf, metric->name)
+          && sc_strbuf_append_staticstr(buf, "_bucket{le=\"");
+        if (i < metric->bound_count) {
+            ok = ok && sc_metrics_append_int(buf, metric->bounds[i]);
+        } else {
+            ok = ok && sc_strbuf_append_staticstr(buf, "+Inf");
+        }
+        ok = ok && sc_strbuf_append_staticstr(buf, "\"} ")
+                && sc_metrics_append_uint(buf, total)
+                && sc_strbuf_append_char(buf, '\n');
+    }
+
+    return ok
+        && sc_strbuf_append_str(buf, metric->name)
+        && sc_strbuf_append_staticstr(buf, "_sum ")
+        && sc_metrics_append_int(buf, sc_metric_get_value(metric))
+        && sc_strbuf_append_char(buf, '\n')
+        && sc_strbuf_append_str(buf, metric->name)
+        && sc_strbuf_append_staticstr(buf, "_count ")
+        && sc_metrics_append_uint(buf, total)
+        && sc_strbuf_append_char(buf, '\n');
+}
+
+bool
+sc_metrics_format_prometheus(struct sc_metrics *metrics,
+                             struct sc_strbuf *buf) {
+    bool ok = true;
+
+    unsigned count = sc_metrics_get_count(metrics);
+    for (unsigned i = 0; ok && i < count; ++i) {
+        struct sc_metric *metric = &metrics->metrics[i];
+        ok = sc_strbuf_append_staticstr(buf, "# HELP ")
+          && sc_strbuf_append_str(buf, metric->name)
+          && sc_strbuf_append_char(buf, ' ')
+          && sc_strbuf_append_str(buf, metric->help)
+          && sc_strbuf_append_staticstr(buf, "\n# TYPE ")
+          && sc_strbuf_append_str(buf, metric->name)
+          && sc_strbuf_append_char(buf, ' ')
+          && sc_strbuf_append_str(buf, sc_metric_type_name(metric->type))
+          && sc_strbuf_append_char(buf, '\n');
+        if (!ok) {
+            break;
+        }
+
+        if (metric->type == SC_METRIC_TYPE_HISTOGRAM) {
+            ok = sc_metrics_append_prometheus_histogram(buf, metric);
+        } else {
+            ok = sc_strbuf_append_str(buf, metric->name)
+              && sc_strbuf_append_char(buf, ' ')
+              && sc_metrics_append_int(buf, sc_metric_get_value(metric))
+              && sc_strbuf_append_char(buf, '\n');
+        }
+    }
+
+    return ok;
+}
+
+static bool
+sc_metric_is_memory(struct sc_metric *metric) {
+    if (metric->type != SC_METRIC_TYPE_GAUGE) {
+        return false;
+    }
+
+    static const char *const suffixes[] = {"_bytes", "_frames", "_packets"};
+    size_t len = strlen(metric->name);
+    for (size_t i = 0; i < ARRAY_LEN(suffixes); ++i) {
+        size_t suffix_len = strlen(suffixes[i]);
+        if (len > suffix_len
+                && !strcmp(metric->name + len - suffix_len, suffixes[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+sc_metrics_format_memory(struct sc_metrics *metrics, struct sc_strbuf *buf) {
+    bool ok = true;
+
+    unsigned count = sc_metrics_get_count(metrics);
+    for (unsigned i = 0; ok && i < count; ++i) {
+        struct sc_metric *metric = &metrics->metrics[i];
+        if (sc_metric_is_memory(metric)) {
+            ok = sc_strbuf_append_str(buf, metric->name)
+              && sc_strbuf_append_staticstr(buf, ": ")
+              && sc_metrics_append_int(buf, sc_metric_get_value(metric))
+              && sc_strbuf_append_char(buf, '\n');
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,143 @@
+#ifndef SC_METRICS_H
+#define SC_METRICS_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/strbuf.h"
+
+#define SC_METRICS_CAPACITY 128
+#define SC_METRIC_NAME_MAX 48
+#define SC_METRIC_MAX_BOUNDS 16
+
+enum sc_metric_type {
+    SC_METRIC_TYPE_COUNTER,
+    SC_METRIC_TYPE_GAUGE,
+    SC_METRIC_TYPE_HISTOGRAM,
+};
+
+struct sc_metric {
+    // Prometheus-compatible name ([a-zA-Z_:][a-zA-Z0-9_:]*)
+    char name[SC_METRIC_NAME_MAX];
+    const char *help; // must be statically allocated
+    enum sc_metric_type type;
+
+    // Value of a counter or a gauge, or sum of the values observed by a
+    // histogram
+    atomic_int_least64_t value;
+
+    // Only for histograms: the upper bounds (inclusive, in increasing order)
+    // of the buckets, and the (non-cumulative) number of values observed in
+    // each bucket (the last bucket is +Inf)
+    const int64_t *bounds; // must be statically allocated
+    unsigned bound_count;
+    atomic_uint_least64_t buckets[SC_METRIC_MAX_BOUNDS + 1];
+};
+
+/**
+ * Registry of metrics, exported as JSON or in the Prometheus text format
+ *
+ * The metrics are registered by the components on initialization. They must
+ * all be registered from the same thread, but they may be exported
+ * concurrently (from any thread).
+ *
+ * The metric values are updated without locking, so the functions below may
+ * be called from any thread (including real-time threads). To avoid checking
+ * whether metrics are enabled at every call site, they accept a NULL metric
+ * (and do nothing).
+ */
+struct sc_metrics {
+    struct sc_metric metrics[SC_METRICS_CAPACITY];
+    // Number of metrics fully registered (written with release semantics)
+    atomic_uint count;
+};
+
+void
+sc_metrics_init(struct sc_metrics *metrics);
+
+/**
+ * Register a new metric
+ *
+ * Return NULL if metrics is NULL or if the registry is full (a warning is
+ * logged), so that the result can be passed to the update functions
+ * unconditionally.
+ */
+struct sc_metric *
+sc_metrics_register_counter(struct sc_metrics *metrics, const char *name,
+                            const char *help);
+
+struct sc_metric *
+sc_metrics_register_gauge(struct sc_metrics *metrics, const char *name,
+                          const char *help);
+
+// The bounds must be statically allocated
+struct sc_metric *
+sc_metrics_register_histogram(struct sc_metrics *metrics, const char *name,
+                              const char *help, const int64_t *bounds,
+                              unsigned bound_count);
+
+static inline void
+sc_metric_add(struct sc_metric *metric, int64_t delta) {
+    if (metric) {
+        atomic_fetch_add_explicit(&metric->value, delta,
+                                  memory_order_relaxed);
+    }
+}
+
+static inline void
+sc_metric_inc(struct sc_metric *metric) {
+    sc_metric_add(metric, 1);
+}
+
+static inline void
+sc_metric_set(struct sc_metric *metric, int64_t value) {
+    if (metric) {
+        atomic_store_explicit(&metric->value, value, memory_order_relaxed);
+    }
+}
+
+static inline void
+sc_metric_observe(struct sc_metric *metric, int64_t value) {
+    if (metric) {
+        unsigned i = 0;
+        while (i < metric->bound_count && value > metric->bounds[i]) {
+            ++i;
+        }
+        atomic_fetch_add_explicit(&metric->buckets[i], 1,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&metric->value, value,
+                                  memory_order_relaxed);
+    }
+}
+
+/**
+ * Append all the metrics as a single-line JSON object (without a final '\n')
+ *
+ * The timestamp (in seconds since the Epoch) is written as "timestamp".
+ *
+ * Counters and gauges are written as numbers, histograms as objects
+ * containing "count", "sum" and "buckets" (cumulative counts, indexed by
+ * their upper bound).
+ */
+bool
+sc_metrics_format_json(struct sc_metrics *metrics, struct sc_strbuf *buf,
+                       int64_t timestamp);
+
+/**
+ * Append all the metrics in the Prometheus text exposition format
+ */
+bool
+sc_metrics_format_prometheus(struct sc_metrics *metrics,
+                             struct sc_strbuf *buf);
+
+/**
+ * Append the memory accounting gauges (named "*_bytes", "*_frames" or
+ * "*_packets"), one "<name>: <value>" per line
+ */
+bool
+sc_metrics_format_memory(struct sc_metrics *metrics, struct sc_strbuf *buf);
+
+#endif
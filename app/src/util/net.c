@@ -1,8 +1,12 @@
 #include "net.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #ifdef _WIN32
 # include <ws2tcpip.h>
@@ -12,6 +16,7 @@
 # include <fcntl.h>
 # include <netinet/in.h>
 # include <netinet/tcp.h>
+# include <poll.h>
 # include <unistd.h>
 # include <sys/socket.h>
 # include <sys/types.h>
@@ -21,8 +26,15 @@
   typedef struct in_addr IN_ADDR;
 #endif
 
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+# define SC_NET_RECV_TIMESTAMPS
+#endif
+
 #include "util/log.h"
 
+// Maximum number of sockets for net_wait_readable()
+#define SC_NET_WAIT_MAX_SOCKETS 8
+
 bool
 net_init(void) {
 #ifdef _WIN32
@@ -181,6 +193,22 @@ net_listen(sc_socket server_socket, uint32_t addr, uint16_t port, int backlog) {
     return true;
 }
 
+bool
+net_get_local_port(sc_socket socket, uint16_t *port) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    SOCKADDR_IN sin;
+    socklen_t sinsize = sizeof(sin);
+
+    if (getsockname(raw_sock, (SOCKADDR *) &sin, &sinsize) == SOCKET_ERROR) {
+        net_perror("getsockname");
+        return false;
+    }
+
+    *port = ntohs(sin.sin_port);
+    return true;
+}
+
 sc_socket
 net_accept(sc_socket server_socket) {
     sc_raw_socket raw_server_socket = unwrap(server_socket);
@@ -203,6 +231,50 @@ net_accept(sc_socket server_socket) {
     return wrap(raw_sock);
 }
 
+bool
+net_socketpair(sc_socket *socket1, sc_socket *socket2) {
+    sc_socket server_socket = net_socket();
+    if (server_socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    // Let the system choose a free port
+    uint16_t port;
+    bool ok = net_listen(server_socket, IPV4_LOCALHOST, 0, 1)
+           && net_get_local_port(server_socket, &port);
+    if (!ok) {
+        goto error_close_server_socket;
+    }
+
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        goto error_close_server_socket;
+    }
+
+    // The connection completes in the listen backlog, before accept()
+    if (!net_connect(socket, IPV4_LOCALHOST, port)) {
+        goto error_close_socket;
+    }
+
+    sc_socket peer_socket = net_accept(server_socket);
+    if (peer_socket == SC_SOCKET_NONE) {
+        goto error_close_socket;
+    }
+
+    net_close(server_socket);
+
+    *socket1 = socket;
+    *socket2 = peer_socket;
+    return true;
+
+error_close_socket:
+    net_close(socket);
+error_close_server_socket:
+    net_close(server_socket);
+
+    return false;
+}
+
 ssize_t
 net_recv(sc_socket socket, void *buf, size_t len) {
     sc_raw_socket raw_sock = unwrap(socket);
@@ -236,6 +308,59 @@ net_send_all(sc_socket socket, const void *buf, size_t len) {
     return copied;
 }
 
+int
+net_wait_readable(const sc_socket *sockets, bool *readable, unsigned count,
+                  sc_tick timeout) {
+    assert(count && count <= SC_NET_WAIT_MAX_SOCKETS);
+
+#ifdef _WIN32
+    WSAPOLLFD fds[SC_NET_WAIT_MAX_SOCKETS];
+#else
+    struct pollfd fds[SC_NET_WAIT_MAX_SOCKETS];
+#endif
+
+    for (unsigned i = 0; i < count; ++i) {
+        fds[i].fd = unwrap(sockets[i]);
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    int timeout_ms;
+    if (timeout < 0) {
+        timeout_ms = -1;
+    } else {
+        // Round up, to never wake up before the deadline
+        sc_tick ms = SC_TICK_TO_MS(timeout + SC_TICK_FROM_MS(1) - 1);
+        timeout_ms = ms < INT_MAX ? (int) ms : INT_MAX;
+    }
+
+#ifdef _WIN32
+    int r = WSAPoll(fds, count, timeout_ms);
+    if (r == SOCKET_ERROR) {
+        net_perror("WSAPoll");
+        return -1;
+    }
+#else
+    int r = poll(fds, count, timeout_ms);
+    if (r == -1) {
+        if (errno == EINTR) {
+            // Spurious wake-up, the caller waits again
+            r = 0;
+        } else {
+            net_perror("poll");
+            return -1;
+        }
+    }
+#endif
+
+    for (unsigned i = 0; i < count; ++i) {
+        // POLLHUP and POLLERR are reported even if not requested
+        readable[i] = fds[i].revents != 0;
+    }
+
+    return r;
+}
+
 bool
 net_interrupt(sc_socket socket) {
     assert(socket != SC_SOCKET_NONE);
@@ -284,6 +409,45 @@ net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay) {
     return true;
 }
 
+bool
+net_set_recv_buffer_size(sc_socket socket, uint32_t size) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    int value = size;
+    int ret = setsockopt(raw_sock, SOL_SOCKET, SO_RCVBUF,
+                         (const void *) &value, sizeof(value));
+    if (ret == -1) {
+        net_perror("setsockopt(SO_RCVBUF)");
+        return false;
+    }
+
+    assert(ret == 0);
+    return true;
+}
+
+bool
+net_set_busy_poll(sc_socket socket, uint32_t usecs) {
+#ifdef SO_BUSY_POLL
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    int value = usecs;
+    int ret = setsockopt(raw_sock, SOL_SOCKET, SO_BUSY_POLL,
+                         (const void *) &value, sizeof(value));
+    if (ret == -1) {
+        net_perror("setsockopt(SO_BUSY_POLL)");
+        return false;
+    }
+
+    assert(ret == 0);
+    return true;
+#else
+    (void) socket;
+    (void) usecs;
+    LOGW("Socket busy polling is not supported on this platform");
+    return false;
+#endif
+}
+
 bool
 net_parse_ipv4(const char *s, uint32_t *ipv4) {
     struct in_addr addr;
@@ -295,3 +459,186 @@ net_parse_ipv4(const char *s, uint32_t *ipv4) {
     *ipv4 = ntohl(addr.s_addr);
     return true;
 }
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t cap) {
+    assert(cap);
+    reader->buf = malloc(cap);
+    if (!reader->buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    reader->socket = socket;
+    reader->cap = cap;
+    reader->head = 0;
+    reader->tail = 0;
+    reader->timestamps = false;
+    reader->recv_date = 0;
+    reader->capture = NULL;
+    return true;
+}
+
+void
+sc_net_reader_reset(struct sc_net_reader *reader, sc_socket socket) {
+    reader->socket = socket;
+    reader->head = 0;
+    reader->tail = 0;
+    reader->timestamps = false;
+    reader->recv_date = 0;
+}
+
+void
+sc_net_reader_set_capture(struct sc_net_reader *reader, FILE *file) {
+    reader->capture = file;
+}
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader) {
+    free(reader->buf);
+}
+
+#ifdef SC_NET_RECV_TIMESTAMPS
+static ssize_t
+sc_net_reader_recvmsg(struct sc_net_reader *reader, void *buf, size_t len,
+                      int flags) {
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = len,
+    };
+
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+
+    ssize_t r = recvmsg(unwrap(reader->socket), &msg, flags);
+    sc_tick now = sc_tick_now();
+    reader->recv_date = now;
+    if (r <= 0) {
+        return r;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET
+                && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+
+            // The kernel timestamp is in CLOCK_REALTIME, convert it to the
+            // local (monotonic) clock from the time elapsed since then
+            struct timespec realtime;
+            if (!clock_gettime(CLOCK_REALTIME, &realtime)) {
+                int64_t elapsed_ns =
+                    (int64_t) (realtime.tv_sec - ts.tv_sec) * 1000000000
+                        + (realtime.tv_nsec - ts.tv_nsec);
+                if (elapsed_ns > 0) {
+                    reader->recv_date = now - SC_TICK_FROM_NS(elapsed_ns);
+                }
+            }
+        }
+    }
+
+    return r;
+}
+#endif
+
+static void
+sc_net_reader_capture(struct sc_net_reader *reader, const void *buf,
+                      size_t len) {
+    size_t w = fwrite(buf, 1, len, reader->capture);
+    if (w != len) {
+        LOGW("Could not write the captured stream, capture stopped");
+        reader->capture = NULL;
+    }
+}
+
+static ssize_t
+sc_net_reader_recv(struct sc_net_reader *reader, void *buf, size_t len,
+                   bool all) {
+    ssize_t r;
+#ifdef SC_NET_RECV_TIMESTAMPS
+    if (reader->timestamps) {
+        r = sc_net_reader_recvmsg(reader, buf, len, all ? MSG_WAITALL : 0);
+    } else
+#endif
+    {
+        r = all ? net_recv_all(reader->socket, buf, len)
+                : net_recv(reader->socket, buf, len);
+        reader->recv_date = sc_tick_now();
+    }
+
+    if (r > 0 && reader->capture) {
+        sc_net_reader_capture(reader, buf, r);
+    }
+
+    return r;
+}
+
+bool
+sc_net_reader_enable_timestamps(struct sc_net_reader *reader) {
+#ifdef SC_NET_RECV_TIMESTAMPS
+    int value = 1;
+    int ret = setsockopt(unwrap(reader->socket), SOL_SOCKET, SO_TIMESTAMPNS,
+                         (const void *) &value, sizeof(value));
+    if (ret == -1) {
+        net_perror("setsockopt(SO_TIMESTAMPNS)");
+        return false;
+    }
+
+    reader->timestamps = true;
+    return true;
+#else
+    (void) reader;
+    return false;
+#endif
+}
+
+ssize_t
+sc_net_reader_recv_all(struct sc_net_reader *reader, void *buf, size_t len) {
+    uint8_t *dst = buf;
+    size_t done = 0;
+
+    for (;;) {
+        assert(reader->head <= reader->tail);
+        size_t available = reader->tail - reader->head;
+        if (available) {
+            size_t n = MIN(available, len - done);
+            memcpy(dst + done, &reader->buf[reader->head], n);
+            reader->head += n;
+            done += n;
+            if (done == len) {
+                return len;
+            }
+        }
+
+        // All the buffered data has been consumed
+        assert(reader->head == reader->tail);
+        reader->head = 0;
+        reader->tail = 0;
+
+        size_t remaining = len - done;
+        if (remaining >= reader->cap / 2) {
+            // Do not copy large chunks twice
+            ssize_t r = sc_net_reader_recv(reader, dst + done, remaining,
+                                           true);
+            if (r < 0) {
+                return done ? (ssize_t) done : r;
+            }
+            return done + r;
+        }
+
+        // Receive as much as possible, to serve the next reads from the buffer
+        ssize_t r = sc_net_reader_recv(reader, reader->buf, reader->cap,
+                                       false);
+        if (r <= 0) {
+            return done ? (ssize_t) done : r;
+        }
+        reader->tail = r;
+    }
+}
@@ -6,8 +6,11 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 
+#include "util/tick.h"
+
 #ifdef _WIN32
 # include <winsock2.h>
   typedef SOCKET sc_raw_socket;
@@ -57,9 +60,18 @@ net_connect(sc_socket socket, uint32_t addr, uint16_t port);
 bool
 net_listen(sc_socket server_socket, uint32_t addr, uint16_t port, int backlog);
 
+// Return the port the socket is bound to (typically after net_listen() on
+// port 0, to let the system choose a free port)
+bool
+net_get_local_port(sc_socket socket, uint16_t *port);
+
 sc_socket
 net_accept(sc_socket server_socket);
 
+// Create a pair of connected sockets on the loopback interface
+bool
+net_socketpair(sc_socket *socket1, sc_socket *socket2);
+
 // the _all versions wait/retry until len bytes have been written/read
 ssize_t
 net_recv(sc_socket socket, void *buf, size_t len);
@@ -73,6 +85,73 @@ net_send(sc_socket socket, const void *buf, size_t len);
 ssize_t
 net_send_all(sc_socket socket, const void *buf, size_t len);
 
+/**
+ * Buffered reader, to receive many small chunks of data (like packet headers)
+ * with few recv() calls
+ *
+ * Once a reader is used, the socket must not be read directly anymore, since
+ * the reader may have buffered data beyond what has been requested.
+ */
+struct sc_net_reader {
+    sc_socket socket;
+    uint8_t *buf;
+    size_t cap;
+    size_t head; // index of the first buffered byte
+    size_t tail; // index following the last buffered byte
+
+    bool timestamps; // kernel receive timestamps enabled
+    // Date when the data returned by the last recv() was received (from the
+    // kernel timestamp if enabled, otherwise when recv() returned)
+    sc_tick recv_date;
+
+    FILE *capture; // may be NULL
+};
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t cap);
+
+// Read from another socket (the buffered data are dropped)
+void
+sc_net_reader_reset(struct sc_net_reader *reader, sc_socket socket);
+
+// Write all the bytes received from the socket to a file (NULL to stop)
+//
+// The file is not closed by the reader. On write error, the capture is
+// stopped.
+void
+sc_net_reader_set_capture(struct sc_net_reader *reader, FILE *file);
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader);
+
+// Read len bytes (like net_recv_all()), from the buffer first
+//
+// Large reads are received directly into buf, so that the data is copied only
+// once.
+ssize_t
+sc_net_reader_recv_all(struct sc_net_reader *reader, void *buf, size_t len);
+
+// Use the kernel receive timestamps (SO_TIMESTAMPNS) for recv_date, to
+// exclude the time spent in the socket receive buffer
+//
+// Return false if it is not supported (only on Linux).
+bool
+sc_net_reader_enable_timestamps(struct sc_net_reader *reader);
+
+/**
+ * Wait until at least one of the sockets is readable (data available, end of
+ * stream or error), like poll()
+ *
+ * For each socket, readable[i] is set accordingly. The timeout is negative to
+ * wait indefinitely.
+ *
+ * Return the number of readable sockets (0 on timeout), or -1 on error.
+ */
+int
+net_wait_readable(const sc_socket *sockets, bool *readable, unsigned count,
+                  sc_tick timeout);
+
 // Shutdown the socket (or close on Windows) so that any blocking send() or
 // recv() are interrupted.
 bool
@@ -87,6 +166,17 @@ net_close(sc_socket socket);
 bool
 net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay);
 
+// Set the socket receive buffer size (SO_RCVBUF), in bytes
+bool
+net_set_recv_buffer_size(sc_socket socket, uint32_t size);
+
+// Busy poll the device queue on blocking receive for up to usecs microseconds
+// (SO_BUSY_POLL), to reduce the latency at the cost of CPU usage
+//
+// Return false if it is not supported (only on Linux).
+bool
+net_set_busy_poll(sc_socket socket, uint32_t usecs);
+
 /**
  * Parse `ip` "xxx.xxx.xxx.xxx" to an IPv4 host representation
  */
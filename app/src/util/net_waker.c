@@ -0,0 +1,46 @@
+#include "net_waker.h"
+
+#include <stdint.h>
+
+#include "util/log.h"
+
+bool
+sc_net_waker_init(struct sc_net_waker *waker) {
+    if (!net_socketpair(&waker->socket, &waker->peer_socket)) {
+        LOGE("Could not create wake-up sockets");
+        return false;
+    }
+
+    atomic_init(&waker->pending, false);
+
+    return true;
+}
+
+void
+sc_net_waker_destroy(struct sc_net_waker *waker) {
+    net_close(waker->peer_socket);
+    net_close(waker->socket);
+}
+
+void
+sc_net_waker_wake(struct sc_net_waker *waker) {
+    // The seq_cst exchange pairs with the store in sc_net_waker_reset(): either
+    // the waiting thread sees the updated state, or this thread sees that no
+    // wake-up is pending anymore (and sends a new one)
+    if (!atomic_exchange(&waker->pending, true)) {
+        uint8_t byte = 0;
+        if (net_send(waker->peer_socket, &byte, 1) != 1) {
+            LOGW("Could not wake up");
+        }
+    }
+}
+
+void
+sc_net_waker_reset(struct sc_net_waker *waker) {
+    // Exactly one byte is pending (the socket is readable)
+    uint8_t byte;
+    if (net_recv(waker->socket, &byte, 1) != 1) {
+        LOGW("Could not reset wake-up");
+    }
+    atomic_store(&waker->pending, false);
+}
@@ -0,0 +1,43 @@
+#ifndef SC_NET_WAKER_H
+#define SC_NET_WAKER_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "util/net.h"
+
+/**
+ * Wake up a thread waiting for sockets to be readable (see
+ * net_wait_readable()), from any thread
+ *
+ * The waiting thread waits for waker->socket along with its other sockets. It
+ * becomes readable once sc_net_waker_wake() is called, until the waiting
+ * thread calls sc_net_waker_reset().
+ *
+ * Like sc_notifier, a wake-up only costs a system call if no wake-up is
+ * already pending.
+ */
+struct sc_net_waker {
+    sc_socket socket; // to wait for
+    sc_socket peer_socket; // written to wake up
+    atomic_bool pending;
+};
+
+bool
+sc_net_waker_init(struct sc_net_waker *waker);
+
+void
+sc_net_waker_destroy(struct sc_net_waker *waker);
+
+// It must be called after the state checked by the waiting thread is updated
+void
+sc_net_waker_wake(struct sc_net_waker *waker);
+
+// Consume the pending wake-up (from the waiting thread, once waker->socket is
+// readable, before checking the state)
+void
+sc_net_waker_reset(struct sc_net_waker *waker);
+
+#endif
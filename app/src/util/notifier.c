@@ -0,0 +1,56 @@
+#include "notifier.h"
+
+bool
+sc_notifier_init(struct sc_notifier *notifier) {
+    bool ok = sc_mutex_init(&notifier->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&notifier->cond);
+    if (!ok) {
+        sc_mutex_destroy(&notifier->mutex);
+        return false;
+    }
+
+    atomic_init(&notifier->waiting, false);
+
+    return true;
+}
+
+void
+sc_notifier_destroy(struct sc_notifier *notifier) {
+    sc_cond_destroy(&notifier->cond);
+    sc_mutex_destroy(&notifier->mutex);
+}
+
+void
+sc_notifier_wait(struct sc_notifier *notifier, bool (*ready)(void *userdata),
+                 void *userdata) {
+    sc_mutex_lock(&notifier->mutex);
+
+    atomic_store_explicit(&notifier->waiting, true, memory_order_relaxed);
+    // Pairs with the fence in sc_notifier_notify(): either the consumer sees
+    // the state updated concurrently, or the producer sees that the consumer
+    // is waiting (and signals the cond once the consumer sleeps, since it
+    // needs the mutex)
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (!ready(userdata)) {
+        sc_cond_wait(&notifier->cond, &notifier->mutex);
+    }
+
+    atomic_store_explicit(&notifier->waiting, false, memory_order_relaxed);
+
+    sc_mutex_unlock(&notifier->mutex);
+}
+
+void
+sc_notifier_notify(struct sc_notifier *notifier) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&notifier->waiting, memory_order_relaxed)) {
+        sc_mutex_lock(&notifier->mutex);
+        sc_cond_signal(&notifier->cond);
+        sc_mutex_unlock(&notifier->mutex);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef SC_NOTIFIER_H
+#define SC_NOTIFIER_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "util/thread.h"
+
+/**
+ * Wake up a single consumer thread waiting for a lock-free queue (typically a
+ * sc_spsc_ring)
+ *
+ * The mutex and the condition variable are only used to sleep: as long as the
+ * consumer is busy, notifying costs a fence and a relaxed load, without any
+ * lock or system call.
+ */
+struct sc_notifier {
+    sc_mutex mutex;
+    sc_cond cond;
+    atomic_bool waiting;
+};
+
+bool
+sc_notifier_init(struct sc_notifier *notifier);
+
+void
+sc_notifier_destroy(struct sc_notifier *notifier);
+
+/**
+ * Wait until ready() returns true (from the consumer thread)
+ *
+ * The function ready() is called with the internal mutex locked. It must only
+ * check lock-free state (typically whether the queue is empty or a stop flag
+ * is set), which the producer must update before calling
+ * sc_notifier_notify().
+ */
+void
+sc_notifier_wait(struct sc_notifier *notifier, bool (*ready)(void *userdata),
+                 void *userdata);
+
+/**
+ * Wake up the consumer if it is waiting (from the producer thread)
+ *
+ * It must be called after the state checked by ready() is updated.
+ */
+void
+sc_notifier_notify(struct sc_notifier *notifier);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "util/thread.h"
 #include "util/tick.h"
 
@@ -118,6 +119,32 @@ sc_process_wait(sc_pid pid, bool close);
 void
 sc_process_close(sc_pid pid);
 
+/**
+ * Get the CPU time (user + system) consumed by the current process so far
+ *
+ * The sum of all its threads may exceed the elapsed time on multicore CPUs.
+ */
+bool
+sc_process_get_cpu_time(sc_tick *cpu_time);
+
+/**
+ * Get the resident set size of the current process, in bytes
+ *
+ * Return false if not supported on this platform.
+ */
+bool
+sc_process_get_rss(uint64_t *rss);
+
+/**
+ * Get the number of bytes currently allocated on the heap by the current
+ * process (through malloc() and friends)
+ *
+ * Return false if not supported on this platform (it is only supported with
+ * the GNU C library).
+ */
+bool
+sc_process_get_allocated(uint64_t *allocated);
+
 /**
  * Read from the pipe
  *
@@ -0,0 +1,20 @@
+#ifndef SC_RANDOM_H
+#define SC_RANDOM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Fill `buf` with random bytes from the cryptographically secure generator of
+ * the platform (/dev/urandom on Unix, BCryptGenRandom() on Windows)
+ *
+ * Unlike sc_rand (or av_get_random_seed(), which may fall back to timer
+ * entropy), it never returns weak random bytes: it fails instead (the error is
+ * logged).
+ */
+bool
+sc_random_bytes(void *buf, size_t len);
+
+#endif
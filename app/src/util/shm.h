@@ -0,0 +1,41 @@
+#ifndef SC_SHM_H
+#define SC_SHM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Named shared memory, readable by other processes
+ *
+ * It is a POSIX shared memory object (shm_open()) on Unix, and a file mapping
+ * backed by the paging file on Windows.
+ */
+struct sc_shm {
+    void *data;
+    size_t size;
+#ifdef _WIN32
+    void *handle; // HANDLE
+#else
+    char *name;
+#endif
+};
+
+/**
+ * Create a shared memory of the given size, and map it in memory
+ *
+ * The content is initially zeroed.
+ */
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size);
+
+/**
+ * Unmap and release the shared memory
+ *
+ * It is removed once all the processes have released it.
+ */
+void
+sc_shm_destroy(struct sc_shm *shm);
+
+#endif
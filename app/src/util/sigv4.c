@@ -0,0 +1,233 @@
+#include "sigv4.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/hmac.h>
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+
+#include "util/log.h"
+#include "util/strbuf.h"
+
+#define SC_SIGV4_HASH_LEN 32
+#define SC_SIGV4_ALGORITHM "AWS4-HMAC-SHA256"
+// Length of the date part ("YYYYMMDD") of the request date
+#define SC_SIGV4_DATE_LEN 8
+
+static void
+sc_sigv4_to_hex(const uint8_t *data, size_t len, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        out[2 * i] = hex[data[i] >> 4];
+        out[2 * i + 1] = hex[data[i] & 0xF];
+    }
+    out[2 * len] = '\0';
+}
+
+bool
+sc_sigv4_sha256_hex(const uint8_t *data, size_t len,
+                    char out[SC_SIGV4_HASH_HEX_LEN + 1]) {
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha) {
+        LOG_OOM();
+        return false;
+    }
+
+    uint8_t digest[SC_SIGV4_HASH_LEN];
+    av_sha_init(sha, 256);
+    av_sha_update(sha, data, len);
+    av_sha_final(sha, digest);
+    av_free(sha);
+
+    sc_sigv4_to_hex(digest, sizeof(digest), out);
+    return true;
+}
+
+static bool
+sc_sigv4_is_unreserved(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+        || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'
+        || c == '~';
+}
+
+char *
+sc_sigv4_uri_encode(const char *s, bool keep_slash) {
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, strlen(s) + 1)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    for (const char *p = s; *p; ++p) {
+        bool ok;
+        if (sc_sigv4_is_unreserved(*p) || (keep_slash && *p == '/')) {
+            ok = sc_strbuf_append_char(&buf, *p);
+        } else {
+            static const char hex[] = "0123456789ABCDEF";
+            uint8_t c = (uint8_t) *p;
+            char encoded[] = {'%', hex[c >> 4], hex[c & 0xF], '\0'};
+            ok = sc_strbuf_append(&buf, encoded, 3);
+        }
+
+        if (!ok) {
+            LOG_OOM();
+            free(buf.s);
+            return NULL;
+        }
+    }
+
+    return buf.s;
+}
+
+// Like sc_strbuf_append_str(), but accept an empty string
+static bool
+sc_sigv4_append(struct sc_strbuf *buf, const char *s) {
+    return !*s || sc_strbuf_append_str(buf, s);
+}
+
+static bool
+sc_sigv4_hmac(struct AVHMAC *hmac, const uint8_t *key, size_t key_len,
+              const char *data, uint8_t out[SC_SIGV4_HASH_LEN]) {
+    int r = av_hmac_calc(hmac, (const uint8_t *) data, strlen(data), key,
+                         key_len, out, SC_SIGV4_HASH_LEN);
+    return r == SC_SIGV4_HASH_LEN;
+}
+
+// Compute the signature of the string to sign into `out` (hex)
+static bool
+sc_sigv4_sign(const struct sc_sigv4_credentials *creds, const char *date,
+              const char *string_to_sign,
+              char out[SC_SIGV4_HASH_HEX_LEN + 1]) {
+    struct AVHMAC *hmac = av_hmac_alloc(AV_HMAC_SHA256);
+    if (!hmac) {
+        LOG_OOM();
+        return false;
+    }
+
+    char *secret;
+    if (asprintf(&secret, "AWS4%s", creds->secret_key) == -1) {
+        LOG_OOM();
+        av_hmac_free(hmac);
+        return false;
+    }
+
+    // The signing key is derived from the secret key, for the date, the
+    // region and the service of the request
+    uint8_t key[SC_SIGV4_HASH_LEN];
+    bool ok = sc_sigv4_hmac(hmac, (const uint8_t *) secret, strlen(secret),
+                            date, key)
+           && sc_sigv4_hmac(hmac, key, sizeof(key), creds->region, key)
+           && sc_sigv4_hmac(hmac, key, sizeof(key), creds->service, key)
+           && sc_sigv4_hmac(hmac, key, sizeof(key), "aws4_request", key);
+
+    uint8_t signature[SC_SIGV4_HASH_LEN];
+    ok = ok && sc_sigv4_hmac(hmac, key, sizeof(key), string_to_sign,
+                             signature);
+
+    free(secret);
+    av_hmac_free(hmac);
+
+    if (!ok) {
+        LOGE("Could not compute the request signature");
+        return false;
+    }
+
+    sc_sigv4_to_hex(signature, sizeof(signature), out);
+    return true;
+}
+
+char *
+sc_sigv4_authorization(const struct sc_sigv4_credentials *creds,
+                       const struct sc_sigv4_request *req) {
+    assert(strlen(req->date) > SC_SIGV4_DATE_LEN);
+
+    char date[SC_SIGV4_DATE_LEN + 1];
+    memcpy(date, req->date, SC_SIGV4_DATE_LEN);
+    date[SC_SIGV4_DATE_LEN] = '\0';
+
+    struct sc_strbuf signed_headers;
+    if (!sc_strbuf_init(&signed_headers, 64)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    struct sc_strbuf canonical;
+    if (!sc_strbuf_init(&canonical, 256)) {
+        LOG_OOM();
+        free(signed_headers.s);
+        return NULL;
+    }
+
+    char *auth = NULL;
+
+    bool ok = sc_sigv4_append(&canonical, req->method)
+           && sc_strbuf_append_char(&canonical, '\n')
+           && sc_sigv4_append(&canonical, req->path)
+           && sc_strbuf_append_char(&canonical, '\n')
+           && sc_sigv4_append(&canonical, req->query)
+           && sc_strbuf_append_char(&canonical, '\n');
+
+    for (size_t i = 0; ok && i < req->header_count; ++i) {
+        const struct sc_sigv4_header *header = &req->headers[i];
+        assert(!i || strcmp(req->headers[i - 1].name, header->name) < 0);
+        ok = sc_sigv4_append(&canonical, header->name)
+          && sc_strbuf_append_char(&canonical, ':')
+          && sc_sigv4_append(&canonical, header->value)
+          && sc_strbuf_append_char(&canonical, '\n')
+          && (!i || sc_strbuf_append_char(&signed_headers, ';'))
+          && sc_sigv4_append(&signed_headers, header->name);
+    }
+
+    ok = ok && sc_strbuf_append_char(&canonical, '\n')
+            && sc_sigv4_append(&canonical, signed_headers.s)
+            && sc_strbuf_append_char(&canonical, '\n')
+            && sc_sigv4_append(&canonical, req->payload_hash);
+    if (!ok) {
+        LOG_OOM();
+        goto end;
+    }
+
+    char canonical_hash[SC_SIGV4_HASH_HEX_LEN + 1];
+    if (!sc_sigv4_sha256_hex((const uint8_t *) canonical.s, canonical.len,
+                             canonical_hash)) {
+        goto end;
+    }
+
+    char *scope;
+    if (asprintf(&scope, "%s/%s/%s/aws4_request", date, creds->region,
+                 creds->service) == -1) {
+        LOG_OOM();
+        goto end;
+    }
+
+    char *string_to_sign;
+    if (asprintf(&string_to_sign, SC_SIGV4_ALGORITHM "\n%s\n%s\n%s",
+                 req->date, scope, canonical_hash) == -1) {
+        LOG_OOM();
+        free(scope);
+        goto end;
+    }
+
+    char signature[SC_SIGV4_HASH_HEX_LEN + 1];
+    ok = sc_sigv4_sign(creds, date, string_to_sign, signature);
+    free(string_to_sign);
+    if (!ok) {
+        free(scope);
+        goto end;
+    }
+
+    if (asprintf(&auth, SC_SIGV4_ALGORITHM " Credential=%s/%s, "
+                 "SignedHeaders=%s, Signature=%s", creds->access_key, scope,
+                 signed_headers.s, signature) == -1) {
+        LOG_OOM();
+        auth = NULL;
+    }
+    free(scope);
+
+end:
+    free(canonical.s);
+    free(signed_headers.s);
+
+    return auth;
+}
@@ -0,0 +1,71 @@
+#ifndef SC_SIGV4_H
+#define SC_SIGV4_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Length of a hex SHA-256 digest (excluding the nul terminator)
+#define SC_SIGV4_HASH_HEX_LEN 64
+
+/**
+ * AWS Signature Version 4 (used by S3 and S3-compatible object storage)
+ *
+ * <https://docs.aws.amazon.com/IAM/latest/UserGuide/reference_sigv-create-signed-request.html>
+ */
+
+struct sc_sigv4_credentials {
+    const char *access_key;
+    const char *secret_key;
+    const char *region;
+    const char *service; // e.g. "s3"
+};
+
+struct sc_sigv4_header {
+    const char *name; // lowercase
+    const char *value; // trimmed
+};
+
+struct sc_sigv4_request {
+    const char *method;
+    const char *path; // URI-encoded
+    const char *query; // canonical query string (sorted, URI-encoded)
+    // The signed headers, sorted by name (must include "host" and
+    // "x-amz-date")
+    const struct sc_sigv4_header *headers;
+    size_t header_count;
+    const char *payload_hash; // hex SHA-256 of the payload
+    const char *date; // "YYYYMMDDTHHMMSSZ", the value of "x-amz-date"
+};
+
+/**
+ * Compute the hex SHA-256 digest of `data` into `out`
+ *
+ * Return false on allocation failure.
+ */
+bool
+sc_sigv4_sha256_hex(const uint8_t *data, size_t len,
+                    char out[SC_SIGV4_HASH_HEX_LEN + 1]);
+
+/**
+ * URI-encode a string (every byte except the unreserved characters, and
+ * except '/' if `keep_slash` is set)
+ *
+ * Return a new allocated string, or NULL on allocation failure.
+ */
+char *
+sc_sigv4_uri_encode(const char *s, bool keep_slash);
+
+/**
+ * Sign a request
+ *
+ * Return the value of the "Authorization" header (a new allocated string), or
+ * NULL on allocation failure.
+ */
+char *
+sc_sigv4_authorization(const struct sc_sigv4_credentials *creds,
+                       const struct sc_sigv4_request *req);
+
+#endif
@@ -0,0 +1,98 @@
+#include "slab.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+#include "util/memory.h"
+
+// Index of the end of the stack (no free block)
+#define SC_SLAB_NONE UINT32_MAX
+
+static inline uint64_t
+sc_slab_make_top(uint32_t index, uint32_t tag) {
+    return (uint64_t) tag << 32 | index;
+}
+
+bool
+sc_slab_init(struct sc_slab *slab, size_t block_size, uint32_t block_count) {
+    assert(block_size && block_count && block_count < SC_SLAB_NONE);
+
+    slab->data = sc_allocarray(block_count, block_size);
+    if (!slab->data) {
+        LOG_OOM();
+        return false;
+    }
+
+    slab->next = sc_allocarray(block_count, sizeof(*slab->next));
+    if (!slab->next) {
+        LOG_OOM();
+        free(slab->data);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < block_count; ++i) {
+        uint32_t next = i + 1 < block_count ? i + 1 : SC_SLAB_NONE;
+        atomic_init(&slab->next[i], next);
+    }
+
+    slab->block_size = block_size;
+    slab->block_count = block_count;
+    atomic_init(&slab->top, sc_slab_make_top(0, 0));
+
+    return true;
+}
+
+void
+sc_slab_destroy(struct sc_slab *slab) {
+    free(slab->next);
+    free(slab->data);
+}
+
+void *
+sc_slab_alloc(struct sc_slab *slab) {
+    uint64_t top = atomic_load_explicit(&slab->top, memory_order_acquire);
+    for (;;) {
+        uint32_t index = (uint32_t) top;
+        if (index == SC_SLAB_NONE) {
+            // exhausted
+            return NULL;
+        }
+
+        // If the block has been popped concurrently, this value may be
+        // outdated, but then the tag has changed and the CAS fails
+        uint32_t next = atomic_load_explicit(&slab->next[index],
+                                             memory_order_relaxed);
+        uint64_t new_top = sc_slab_make_top(next, (uint32_t) (top >> 32) + 1);
+        if (atomic_compare_exchange_weak_explicit(&slab->top, &top, new_top,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            return slab->data + (size_t) index * slab->block_size;
+        }
+        // top has been updated, retry
+    }
+}
+
+void
+sc_slab_free(struct sc_slab *slab, void *block) {
+    assert(sc_slab_owns(slab, block));
+
+    size_t offset = (uint8_t *) block - slab->data;
+    assert(offset % slab->block_size == 0);
+    uint32_t index = offset / slab->block_size;
+
+    uint64_t top = atomic_load_explicit(&slab->top, memory_order_relaxed);
+    for (;;) {
+        atomic_store_explicit(&slab->next[index], (uint32_t) top,
+                              memory_order_relaxed);
+        uint64_t new_top = sc_slab_make_top(index, (uint32_t) (top >> 32) + 1);
+        // Release: the block content and its next index are written before
+        // it may be allocated again
+        if (atomic_compare_exchange_weak_explicit(&slab->top, &top, new_top,
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return;
+        }
+        // top has been updated, retry
+    }
+}
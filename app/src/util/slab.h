@@ -0,0 +1,63 @@
+#ifndef SC_SLAB_H
+#define SC_SLAB_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Pool of fixed-size blocks, allocated once
+ *
+ * Blocks may be allocated and released from any thread, without locking: the
+ * free blocks form a lock-free stack (its top is tagged with a counter to
+ * prevent the ABA problem).
+ *
+ * When the pool is exhausted, sc_slab_alloc() returns NULL, so that the
+ * caller can fall back to malloc() (sc_slab_owns() tells which allocator a
+ * block comes from).
+ */
+struct sc_slab {
+    uint8_t *data;
+    size_t block_size;
+    uint32_t block_count;
+    // Index of the next free block, for each free block
+    atomic_uint_least32_t *next;
+    // Top of the stack of free blocks: index (low 32 bits) and tag (high 32
+    // bits)
+    atomic_uint_least64_t top;
+};
+
+bool
+sc_slab_init(struct sc_slab *slab, size_t block_size, uint32_t block_count);
+
+void
+sc_slab_destroy(struct sc_slab *slab);
+
+/**
+ * Allocate a block of block_size bytes
+ *
+ * Return NULL if all the blocks are in use.
+ */
+void *
+sc_slab_alloc(struct sc_slab *slab);
+
+/**
+ * Release a block allocated by sc_slab_alloc()
+ */
+void
+sc_slab_free(struct sc_slab *slab, void *block);
+
+/**
+ * Indicate whether ptr is a block of the slab
+ */
+static inline bool
+sc_slab_owns(struct sc_slab *slab, const void *ptr) {
+    const uint8_t *p = ptr;
+    return p >= slab->data
+        && p < slab->data + slab->block_size * slab->block_count;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SC_SPSC_RING_H
+#define SC_SPSC_RING_H
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/memory.h"
+
+/**
+ * A fixed-capacity lock-free ring buffer, for a single producer thread and a
+ * single consumer thread.
+ *
+ * It is generic over the type of its items (stored by value), so it is
+ * implemented via macros, like SC_VECDEQUE.
+ *
+ * To use a ring, a new type must be defined:
+ *
+ *     struct ring_int SC_SPSC_RING(int);
+ *
+ * The struct may be anonymous:
+ *
+ *     struct SC_SPSC_RING(AVPacket *) packets;
+ *
+ * The producer calls sc_spsc_ring_push(), the consumer calls
+ * sc_spsc_ring_pop(). Neither ever blocks: a push or a pop costs one relaxed
+ * load, one acquire load and one release store. To wait for an item without
+ * spinning, see sc_notifier.
+ *
+ * Functions and macros having name ending with '_' are private.
+ */
+#define SC_SPSC_RING(type) { \
+    type *data; \
+    uint32_t mask; /* capacity - 1 */ \
+    /* Free-running cursors (only their difference is meaningful) */ \
+    atomic_uint_least32_t head; /* written by the producer */ \
+    atomic_uint_least32_t tail; /* written by the consumer */ \
+}
+
+/**
+ * Return the smallest power of 2 greater than or equal to capacity
+ *
+ * Private.
+ */
+static inline uint32_t
+sc_spsc_ring_alloc_size_(uint32_t capacity) {
+    assert(capacity && capacity <= UINT32_C(1) << 31);
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+/**
+ * Initialize an empty ring, able to contain at least capacity items
+ *
+ * The capacity is rounded up to a power of 2.
+ *
+ * Return false on allocation failure.
+ */
+#define sc_spsc_ring_init(pr, capacity) \
+({ \
+    uint32_t size_ = sc_spsc_ring_alloc_size_(capacity); \
+    (pr)->data = sc_allocarray(size_, sizeof(*(pr)->data)); \
+    (pr)->mask = size_ - 1; \
+    atomic_init(&(pr)->head, 0); \
+    atomic_init(&(pr)->tail, 0); \
+    (bool) (pr)->data; \
+})
+
+/**
+ * Destroy a ring
+ *
+ * The remaining items (if any) are not released.
+ */
+#define sc_spsc_ring_destroy(pr) \
+    free((pr)->data)
+
+/**
+ * Return the capacity of the ring (a power of 2)
+ */
+#define sc_spsc_ring_capacity(pr) \
+    ((pr)->mask + 1)
+
+/**
+ * Return the number of items in the ring
+ *
+ * It is exact from the producer or the consumer thread when the other thread
+ * is idle. Otherwise, it may be outdated as soon as it is returned.
+ */
+#define sc_spsc_ring_size(pr) \
+    ((uint32_t) ( \
+        atomic_load_explicit(&(pr)->head, memory_order_acquire) \
+      - atomic_load_explicit(&(pr)->tail, memory_order_acquire)))
+
+/**
+ * Return whether the ring is empty
+ */
+#define sc_spsc_ring_is_empty(pr) \
+    (sc_spsc_ring_size(pr) == 0)
+
+/**
+ * Push an item (from the producer thread)
+ *
+ * Return false if the ring is full (the item is not pushed).
+ */
+#define sc_spsc_ring_push(pr, item) \
+({ \
+    /* Only the producer writes head */ \
+    uint32_t head_ = \
+        atomic_load_explicit(&(pr)->head, memory_order_relaxed); \
+    /* The tail is updated after the item is consumed */ \
+    uint32_t tail_ = \
+        atomic_load_explicit(&(pr)->tail, memory_order_acquire); \
+    bool ok_ = head_ - tail_ <= (pr)->mask; \
+    if (ok_) { \
+        (pr)->data[head_ & (pr)->mask] = (item); \
+        atomic_store_explicit(&(pr)->head, head_ + 1, \
+                              memory_order_release); \
+    } \
+    ok_; \
+})
+
+/**
+ * Pop an item into *(pitem) (from the consumer thread)
+ *
+ * Return false if the ring is empty.
+ */
+#define sc_spsc_ring_pop(pr, pitem) \
+({ \
+    /* Only the consumer writes tail */ \
+    uint32_t tail_ = \
+        atomic_load_explicit(&(pr)->tail, memory_order_relaxed); \
+    /* The head is updated after the item is written */ \
+    uint32_t head_ = \
+        atomic_load_explicit(&(pr)->head, memory_order_acquire); \
+    bool ok_ = head_ != tail_; \
+    if (ok_) { \
+        *(pitem) = (pr)->data[tail_ & (pr)->mask]; \
+        atomic_store_explicit(&(pr)->tail, tail_ + 1, \
+                              memory_order_release); \
+    } \
+    ok_; \
+})
+
+#endif
@@ -201,6 +201,15 @@ sc_str_utf8_truncation_index(const char *utf8, size_t max_len) {
     return len;
 }
 
+uint64_t
+sc_str_hash(const char *s, size_t len) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t) s[i]) * UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
 #ifdef _WIN32
 
 wchar_t *
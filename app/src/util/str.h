@@ -91,6 +91,12 @@ sc_str_list_contains(const char *list, char sep, const char *s);
 size_t
 sc_str_utf8_truncation_index(const char *utf8, size_t max_len);
 
+/**
+ * Compute the 64-bit FNV-1a hash of the first `len` bytes of `s`
+ */
+uint64_t
+sc_str_hash(const char *s, size_t len);
+
 #ifdef _WIN32
 /**
  * Convert a UTF-8 string to a wchar_t string
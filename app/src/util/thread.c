@@ -5,6 +5,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL_thread.h>
+#ifdef _WIN32
+# include <windows.h>
+# include <avrt.h>
+#else
+# include <errno.h>
+# include <pthread.h>
+# include <sched.h>
+#endif
 
 #include "util/log.h"
 
@@ -60,6 +68,113 @@ sc_thread_set_priority(enum sc_thread_priority priority) {
     return true;
 }
 
+static bool
+sc_thread_set_affinity(uint64_t cpus) {
+#ifdef _WIN32
+    DWORD_PTR mask = (DWORD_PTR) cpus;
+    if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+        LOGW("Could not set thread affinity (error %lu)",
+             (unsigned long) GetLastError());
+        return false;
+    }
+    return true;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned i = 0; i < SC_THREAD_SCHED_MAX_CPUS; ++i) {
+        if (cpus & (UINT64_C(1) << i)) {
+            CPU_SET(i, &set);
+        }
+    }
+
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r) {
+        LOGW("Could not set thread affinity: %s", strerror(r));
+        return false;
+    }
+    return true;
+#else
+    (void) cpus;
+    LOGW("Thread affinity is not supported on this platform");
+    return false;
+#endif
+}
+
+static bool
+sc_thread_set_policy(enum sc_thread_sched_policy policy, uint8_t priority) {
+#ifdef _WIN32
+    (void) priority;
+
+    const wchar_t *task;
+    switch (policy) {
+        case SC_THREAD_SCHED_POLICY_MMCSS_PRO_AUDIO:
+            task = L"Pro Audio";
+            break;
+        case SC_THREAD_SCHED_POLICY_MMCSS_GAMES:
+            task = L"Games";
+            break;
+        default:
+            LOGW("Real-time thread policies are not supported on Windows");
+            return false;
+    }
+
+    // The thread is registered to the MMCSS task until it exits
+    DWORD task_index = 0;
+    HANDLE handle = AvSetMmThreadCharacteristicsW(task, &task_index);
+    if (!handle) {
+        LOGW("Could not register thread to MMCSS (error %lu)",
+             (unsigned long) GetLastError());
+        return false;
+    }
+    return true;
+#else
+    int sched_policy;
+    switch (policy) {
+        case SC_THREAD_SCHED_POLICY_FIFO:
+            sched_policy = SCHED_FIFO;
+            break;
+        case SC_THREAD_SCHED_POLICY_RR:
+            sched_policy = SCHED_RR;
+            break;
+        default:
+            LOGW("MMCSS thread policies are only supported on Windows");
+            return false;
+    }
+
+    struct sched_param param = {
+        .sched_priority = priority,
+    };
+    int r = pthread_setschedparam(pthread_self(), sched_policy, &param);
+    if (r) {
+        if (r == EPERM) {
+            LOGW("Could not set real-time thread policy: permission denied "
+                 "(it requires CAP_SYS_NICE or a RLIMIT_RTPRIO limit)");
+        } else {
+            LOGW("Could not set real-time thread policy: %s", strerror(r));
+        }
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool
+sc_thread_apply_sched(const struct sc_thread_sched *sched) {
+    if (!sched) {
+        return true;
+    }
+
+    bool ok = true;
+    if (sched->cpus) {
+        ok = sc_thread_set_affinity(sched->cpus);
+    }
+    if (sched->policy != SC_THREAD_SCHED_POLICY_DEFAULT) {
+        ok = sc_thread_set_policy(sched->policy, sched->priority) && ok;
+    }
+
+    return ok;
+}
+
 void
 sc_thread_join(sc_thread *thread, int *status) {
     SDL_WaitThread(thread->thread, status);
@@ -5,6 +5,7 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "tick.h"
 
@@ -28,6 +29,25 @@ enum sc_thread_priority {
     SC_THREAD_PRIORITY_TIME_CRITICAL,
 };
 
+enum sc_thread_sched_policy {
+    SC_THREAD_SCHED_POLICY_DEFAULT,
+    // Real-time policies (not available on Windows)
+    SC_THREAD_SCHED_POLICY_FIFO,
+    SC_THREAD_SCHED_POLICY_RR,
+    // Multimedia Class Scheduler Service tasks (only available on Windows)
+    SC_THREAD_SCHED_POLICY_MMCSS_PRO_AUDIO,
+    SC_THREAD_SCHED_POLICY_MMCSS_GAMES,
+};
+
+// Scheduling constraints, applied by a thread to itself
+struct sc_thread_sched {
+    uint64_t cpus; // bitmask of the allowed CPUs, 0 for no constraint
+    enum sc_thread_sched_policy policy;
+    uint8_t priority; // only for SC_THREAD_SCHED_POLICY_{FIFO,RR} (1-99)
+};
+
+#define SC_THREAD_SCHED_MAX_CPUS 64
+
 typedef struct sc_mutex {
     SDL_mutex *mutex;
 #ifndef NDEBUG
@@ -51,6 +71,14 @@ sc_thread_join(sc_thread *thread, int *status);
 bool
 sc_thread_set_priority(enum sc_thread_priority priority);
 
+// Apply the scheduling constraints to the current thread (sched may be NULL)
+//
+// The constraints may require privileges (e.g. CAP_SYS_NICE for real-time
+// policies on Linux), so a failure is logged but not fatal: return false if
+// any constraint could not be applied.
+bool
+sc_thread_apply_sched(const struct sc_thread_sched *sched);
+
 bool
 sc_mutex_init(sc_mutex *mutex);
 
@@ -378,4 +378,28 @@ sc_vecdeque_growsize_(size_t value)
 #define sc_vecdeque_pop(pv) \
     (*sc_vecdeque_popref(pv))
 
+/**
+ * Return a pointer to the last item (the most recently pushed), without
+ * removing it
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_back(pv) \
+({ \
+    assert(!sc_vecdeque_is_empty(pv)); \
+    &(pv)->data[((pv)->origin + (pv)->size - 1) % (pv)->cap]; \
+})
+
+/**
+ * Return a pointer to the item at the given index (0 is the oldest), without
+ * removing it
+ *
+ * It is an error to call this function with an index out of bounds.
+ */
+#define sc_vecdeque_at(pv, index) \
+({ \
+    assert((index) < sc_vecdeque_size(pv)); \
+    &(pv)->data[((pv)->origin + (index)) % (pv)->cap]; \
+})
+
 #endif
@@ -2,324 +2,619 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <stdint.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <libavutil/imgutils.h>
 
 #include "util/log.h"
-#include "util/str.h"
+#include "util/tick.h"
 
 /** Downcast frame_sink to sc_v4l2_sink */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_v4l2_sink, frame_sink)
 
-static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
+struct sc_v4l2_format_desc {
+    uint32_t fourcc;
+    enum AVPixelFormat pix_fmt;
+    const char *name;
+};
+
+static const struct sc_v4l2_format_desc sc_v4l2_formats[] = {
+    [SC_V4L2_FORMAT_YUV420P] = {
+        V4L2_PIX_FMT_YUV420, AV_PIX_FMT_YUV420P, "yuv420p",
+    },
+    [SC_V4L2_FORMAT_NV12] = {
+        V4L2_PIX_FMT_NV12, AV_PIX_FMT_NV12, "nv12",
+    },
+    [SC_V4L2_FORMAT_YUYV] = {
+        V4L2_PIX_FMT_YUYV, AV_PIX_FMT_YUYV422, "yuyv",
+    },
+    [SC_V4L2_FORMAT_UYVY] = {
+        V4L2_PIX_FMT_UYVY, AV_PIX_FMT_UYVY422, "uyvy",
+    },
+};
+
+static const struct sc_v4l2_format_desc *
+sc_v4l2_find_format(uint32_t fourcc) {
+    for (size_t i = 0; i < ARRAY_LEN(sc_v4l2_formats); ++i) {
+        if (sc_v4l2_formats[i].fourcc == fourcc) {
+            return &sc_v4l2_formats[i];
+        }
+    }
+    return NULL;
+}
+
+static bool
+sc_v4l2_is_packed(enum AVPixelFormat pix_fmt) {
+    return pix_fmt == AV_PIX_FMT_YUYV422 || pix_fmt == AV_PIX_FMT_UYVY422;
+}
 
-static const AVOutputFormat *
-find_muxer(const char *name) {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-    void *opaque = NULL;
-#endif
-    const AVOutputFormat *oformat = NULL;
+// Minimal image size for the given line size
+static size_t
+sc_v4l2_get_image_size(enum AVPixelFormat pix_fmt, unsigned bytesperline,
+                       unsigned height) {
+    if (sc_v4l2_is_packed(pix_fmt)) {
+        return (size_t) bytesperline * height;
+    }
+
+    // 4:2:0, the chroma planes (or the interleaved chroma plane for NV12) use
+    // (height + 1) / 2 lines of bytesperline bytes in total
+    return (size_t) bytesperline * (height + (height + 1) / 2);
+}
+
+static int
+xioctl(int fd, unsigned long request, void *arg) {
+    int r;
     do {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-        oformat = av_muxer_iterate(&opaque);
-#else
-        oformat = av_oformat_next(oformat);
-#endif
-        // until null or containing the requested name
-    } while (oformat && !sc_str_list_contains(oformat->name, ',', name));
-    return oformat;
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
 }
 
 static bool
-write_header(struct sc_v4l2_sink *vs, const AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-
-    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
-    if (!extradata) {
-        LOG_OOM();
+sc_v4l2_sink_set_format(struct sc_v4l2_sink *vs, unsigned width,
+                        unsigned height) {
+    const struct sc_v4l2_format_desc *desc = &sc_v4l2_formats[vs->format];
+    bool packed = sc_v4l2_is_packed(desc->pix_fmt);
+    unsigned bytesperline = packed ? width * 2 : width;
+
+    struct v4l2_format fmt = {0};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = desc->fourcc;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix.bytesperline = bytesperline;
+    fmt.fmt.pix.sizeimage =
+        sc_v4l2_get_image_size(desc->pix_fmt, bytesperline, height);
+
+    if (xioctl(vs->fd, VIDIOC_S_FMT, &fmt)) {
+        LOGE("Could not set v4l2 format %s %ux%u: %s", desc->name, width,
+             height, strerror(errno));
         return false;
     }
 
-    // copy the first packet to the extra data
-    memcpy(extradata, packet->data, packet->size);
+    if (fmt.fmt.pix.pixelformat != desc->fourcc) {
+        // The device may select another format, accept it if it is supported
+        const struct sc_v4l2_format_desc *selected =
+            sc_v4l2_find_format(fmt.fmt.pix.pixelformat);
+        if (!selected) {
+            LOGE("The v4l2 device does not support %s", desc->name);
+            return false;
+        }
+
+        LOGW("The v4l2 device selected the format %s (instead of %s)",
+             selected->name, desc->name);
+        desc = selected;
+        packed = sc_v4l2_is_packed(desc->pix_fmt);
+    }
 
-    ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
+    vs->fourcc = desc->fourcc;
+    vs->pix_fmt = desc->pix_fmt;
+    vs->width = fmt.fmt.pix.width;
+    vs->height = fmt.fmt.pix.height;
+    vs->bytesperline = fmt.fmt.pix.bytesperline;
+    unsigned min_bytesperline = packed ? vs->width * 2 : vs->width;
+    if (vs->bytesperline < min_bytesperline) {
+        vs->bytesperline = min_bytesperline;
+    }
+
+    size_t min_size =
+        sc_v4l2_get_image_size(vs->pix_fmt, vs->bytesperline, vs->height);
+    vs->sizeimage = fmt.fmt.pix.sizeimage;
+    if (vs->sizeimage < min_size) {
+        vs->sizeimage = min_size;
+    }
+
+    if (vs->width != width || vs->height != height) {
+        LOGW("The v4l2 device selected the size %ux%u (instead of %ux%u)",
+             vs->width, vs->height, width, height);
+    }
 
-    int ret = avformat_write_header(vs->format_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Failed to write header to %s", vs->device_name);
+    return true;
+}
+
+static void
+sc_v4l2_sink_unmap_buffers(struct sc_v4l2_sink *vs) {
+    for (unsigned i = 0; i < vs->buffer_count; ++i) {
+        munmap(vs->buffers[i].data, vs->buffers[i].length);
+    }
+
+    struct v4l2_requestbuffers req = {0};
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    req.count = 0;
+    // Release the buffers (ignore errors)
+    xioctl(vs->fd, VIDIOC_REQBUFS, &req);
+
+    vs->buffer_count = 0;
+}
+
+// Return false (without error) if the device does not support mmap buffers
+static bool
+sc_v4l2_sink_map_buffers(struct sc_v4l2_sink *vs) {
+    struct v4l2_requestbuffers req = {0};
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    req.count = SC_V4L2_BUFFER_COUNT;
+
+    if (xioctl(vs->fd, VIDIOC_REQBUFS, &req) || !req.count) {
+        LOGD("v4l2 mmap buffers not supported: %s", strerror(errno));
         return false;
     }
 
+    assert(!vs->buffer_count);
+    unsigned count = MIN(req.count, SC_V4L2_BUFFER_COUNT);
+    for (unsigned i = 0; i < count; ++i) {
+        struct v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (xioctl(vs->fd, VIDIOC_QUERYBUF, &buf)) {
+            LOGD("Could not query v4l2 buffer: %s", strerror(errno));
+            goto error;
+        }
+
+        if (buf.length < vs->sizeimage) {
+            LOGD("v4l2 buffer too small: %u < %zu", buf.length,
+                 vs->sizeimage);
+            goto error;
+        }
+
+        void *data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, vs->fd, buf.m.offset);
+        if (data == MAP_FAILED) {
+            LOGD("Could not map v4l2 buffer: %s", strerror(errno));
+            goto error;
+        }
+
+        vs->buffers[i].data = data;
+        vs->buffers[i].length = buf.length;
+        ++vs->buffer_count;
+    }
+
     return true;
+
+error:
+    sc_v4l2_sink_unmap_buffers(vs);
+    return false;
 }
 
+// Get the planes of an image of the negotiated format stored in dst
 static void
-rescale_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
+sc_v4l2_sink_get_planes(struct sc_v4l2_sink *vs, uint8_t *dst,
+                        uint8_t *dst_data[4], int dst_linesize[4]) {
+    dst_data[0] = dst;
+    dst_linesize[0] = vs->bytesperline;
+
+    if (vs->pix_fmt == AV_PIX_FMT_NV12) {
+        dst_data[1] = dst_data[0] + (size_t) vs->bytesperline * vs->height;
+        dst_linesize[1] = vs->bytesperline;
+    } else if (vs->pix_fmt == AV_PIX_FMT_YUV420P) {
+        unsigned chroma_linesize = vs->bytesperline / 2;
+        unsigned chroma_height = (vs->height + 1) / 2;
+        dst_data[1] = dst_data[0] + (size_t) vs->bytesperline * vs->height;
+        dst_data[2] = dst_data[1] + (size_t) chroma_linesize * chroma_height;
+        dst_linesize[1] = chroma_linesize;
+        dst_linesize[2] = chroma_linesize;
+    }
+    // else packed format, a single plane
 }
 
+// Copy (or convert) the frame into an image of the negotiated format
 static bool
-write_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    if (!vs->header_written) {
-        bool ok = write_header(vs, packet);
-        if (!ok) {
+sc_v4l2_sink_fill(struct sc_v4l2_sink *vs, uint8_t *dst,
+                  const AVFrame *frame) {
+    uint8_t *dst_data[4] = {0};
+    int dst_linesize[4] = {0};
+    sc_v4l2_sink_get_planes(vs, dst, dst_data, dst_linesize);
+
+    bool same_size = (unsigned) frame->width == vs->width
+                  && (unsigned) frame->height == vs->height;
+
+    if (frame->format == vs->pix_fmt && same_size) {
+        // Single copy from the decoded frame to the device buffer
+        av_image_copy(dst_data, dst_linesize,
+                      (const uint8_t **) frame->data, frame->linesize,
+                      vs->pix_fmt, vs->width, vs->height);
+        return true;
+    }
+
+    // The decoder may output frames in another pixel format than the device
+    // format (e.g. NV12 for hardware-decoded frames), or in another size (e.g.
+    // on device rotation), but the v4l2 stream format is fixed.
+    // swscale uses SIMD code paths for the common conversions, and it runs on
+    // the v4l2 thread, once for all the consumers of the device.
+    int flags = same_size ? SWS_POINT : SWS_BILINEAR;
+    // Convert directly into the device buffer
+    bool ok = sc_frame_converter_convert(&vs->converter, frame, dst_data,
+                                         dst_linesize, vs->pix_fmt, vs->width,
+                                         vs->height, flags);
+    if (!ok) {
+        LOGE("Could not convert the v4l2 pixel format");
+        return false;
+    }
+
+    return true;
+}
+
+// Get the memory to write the next image to
+static uint8_t *
+sc_v4l2_sink_acquire(struct sc_v4l2_sink *vs, struct v4l2_buffer *buf) {
+    if (!vs->streaming) {
+        return vs->write_buffer;
+    }
+
+    memset(buf, 0, sizeof(*buf));
+    buf->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf->memory = V4L2_MEMORY_MMAP;
+
+    if (vs->queued_count < vs->buffer_count) {
+        // This buffer has never been queued
+        buf->index = vs->queued_count;
+    } else if (xioctl(vs->fd, VIDIOC_DQBUF, buf)) {
+        LOGE("Could not dequeue v4l2 buffer: %s", strerror(errno));
+        return NULL;
+    }
+
+    assert(buf->index < vs->buffer_count);
+    return vs->buffers[buf->index].data;
+}
+
+// Send the image written to the memory returned by sc_v4l2_sink_acquire()
+static bool
+sc_v4l2_sink_submit(struct sc_v4l2_sink *vs, struct v4l2_buffer *buf,
+                    int64_t pts_us) {
+    if (!vs->streaming) {
+        ssize_t w;
+        do {
+            w = write(vs->fd, vs->write_buffer, vs->sizeimage);
+        } while (w == -1 && errno == EINTR);
+
+        if (w != (ssize_t) vs->sizeimage) {
+            LOGE("Could not write to v4l2 device: %s",
+                 w == -1 ? strerror(errno) : "short write");
             return false;
         }
-        vs->header_written = true;
+
         return true;
     }
 
-    rescale_packet(vs, packet);
+    buf->bytesused = vs->sizeimage;
+    buf->field = V4L2_FIELD_NONE;
+    buf->flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    buf->timestamp.tv_sec = pts_us / 1000000;
+    buf->timestamp.tv_usec = pts_us % 1000000;
 
-    bool ok = av_write_frame(vs->format_ctx, packet) >= 0;
+    if (xioctl(vs->fd, VIDIOC_QBUF, buf)) {
+        LOGE("Could not queue v4l2 buffer: %s", strerror(errno));
+        return false;
+    }
 
-    // Failing to write the last frame is not very serious, no future frame may
-    // depend on it, so the resulting file will still be valid
-    (void) ok;
+    if (vs->queued_count < vs->buffer_count) {
+        ++vs->queued_count;
+    }
+
+    if (!vs->stream_on) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (xioctl(vs->fd, VIDIOC_STREAMON, &type)) {
+            LOGE("Could not start v4l2 streaming: %s", strerror(errno));
+            return false;
+        }
+        vs->stream_on = true;
+    }
 
     return true;
 }
 
 static bool
-encode_and_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    int ret = avcodec_send_frame(vs->encoder_ctx, frame);
-    if (ret < 0 && ret != AVERROR(EAGAIN)) {
-        LOGE("Could not send v4l2 video frame: %d", ret);
+sc_v4l2_sink_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    struct v4l2_buffer buf;
+    uint8_t *dst = sc_v4l2_sink_acquire(vs, &buf);
+    if (!dst) {
         return false;
     }
 
-    AVPacket *packet = vs->packet;
-    ret = avcodec_receive_packet(vs->encoder_ctx, packet);
-    if (ret == 0) {
-        // A packet was received
+    if (!sc_v4l2_sink_fill(vs, dst, frame)) {
+        return false;
+    }
 
-        bool ok = write_packet(vs, packet);
-        av_packet_unref(packet);
-        if (!ok) {
-            LOGW("Could not send packet to v4l2 sink");
-            return false;
-        }
-    } else if (ret != AVERROR(EAGAIN)) {
-        LOGE("Could not receive v4l2 video packet: %d", ret);
+    // PTS (written by the server) are expressed in microseconds
+    return sc_v4l2_sink_submit(vs, &buf, frame->pts);
+}
+
+static bool
+sc_v4l2_sink_write_image(struct sc_v4l2_sink *vs, const uint8_t *image) {
+    struct v4l2_buffer buf;
+    uint8_t *dst = sc_v4l2_sink_acquire(vs, &buf);
+    if (!dst) {
         return false;
     }
 
-    return true;
+    // The image is already in the device format
+    memcpy(dst, image, vs->sizeimage);
+
+    return sc_v4l2_sink_submit(vs, &buf, SC_TICK_TO_US(sc_tick_now()));
 }
 
 static int
-run_v4l2_sink(void *data) {
+run_v4l2_timer(void *data) {
     struct sc_v4l2_sink *vs = data;
 
-    for (;;) {
-        sc_mutex_lock(&vs->mutex);
+    assert(vs->fps);
+    sc_tick period = SC_TICK_FROM_SEC(1) / vs->fps;
+    sc_tick deadline = sc_tick_now() + period;
+
+    sc_mutex_lock(&vs->mutex);
 
-        while (!vs->stopped && !vs->has_frame) {
-            sc_cond_wait(&vs->cond, &vs->mutex);
+    for (;;) {
+        while (!vs->stopped
+                && sc_cond_timedwait(&vs->cond, &vs->mutex, deadline)) {
+            // Spurious wakeup, wait until the deadline
         }
 
         if (vs->stopped) {
-            sc_mutex_unlock(&vs->mutex);
             break;
         }
 
-        vs->has_frame = false;
-        sc_mutex_unlock(&vs->mutex);
+        // Keep a constant rate, but never try to catch up if the write was
+        // too slow
+        sc_tick now = sc_tick_now();
+        do {
+            deadline += period;
+        } while (deadline <= now);
 
-        sc_frame_buffer_consume(&vs->fb, vs->frame);
+        if (!vs->has_image) {
+            // No frame received yet
+            continue;
+        }
 
-        bool ok = encode_and_write_frame(vs, vs->frame);
-        av_frame_unref(vs->frame);
+        // The last frame is emitted again (without conversion) if no new
+        // frame has been received during the period
+        bool ok = sc_v4l2_sink_write_image(vs, vs->ready_image);
         if (!ok) {
-            LOGE("Could not send frame to v4l2 sink");
+            LOGE("Could not send frame to v4l2 sink, disabling it");
+            vs->failed = true;
             break;
         }
     }
 
-    LOGD("V4l2 thread ended");
+    sc_mutex_unlock(&vs->mutex);
+
+    LOGD("V4l2 timer thread ended");
 
     return 0;
 }
 
 static bool
-sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
-    assert(ctx->pix_fmt == AV_PIX_FMT_YUV420P);
-    (void) ctx;
-
-    bool ok = sc_frame_buffer_init(&vs->fb);
-    if (!ok) {
+sc_v4l2_sink_start_timer(struct sc_v4l2_sink *vs) {
+    vs->image = malloc(vs->sizeimage);
+    if (!vs->image) {
+        LOG_OOM();
         return false;
     }
 
-    ok = sc_mutex_init(&vs->mutex);
+    vs->ready_image = malloc(vs->sizeimage);
+    if (!vs->ready_image) {
+        LOG_OOM();
+        goto error_free_image;
+    }
+
+    bool ok = sc_mutex_init(&vs->mutex);
     if (!ok) {
-        goto error_frame_buffer_destroy;
+        goto error_free_ready_image;
     }
 
     ok = sc_cond_init(&vs->cond);
     if (!ok) {
-        goto error_mutex_destroy;
+        goto error_destroy_mutex;
     }
 
-    const AVOutputFormat *format = find_muxer("v4l2");
-    if (!format) {
-        // Alternative name
-        format = find_muxer("video4linux2");
-    }
-    if (!format) {
-        LOGE("Could not find v4l2 muxer");
-        goto error_cond_destroy;
-    }
+    vs->has_image = false;
+    vs->stopped = false;
 
-    const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
-    if (!encoder) {
-        LOGE("Raw video encoder not found");
-        return false;
+    ok = sc_thread_create(&vs->thread, run_v4l2_timer, "scrcpy-v4l2", vs);
+    if (!ok) {
+        LOGE("Could not start v4l2 timer thread");
+        goto error_destroy_cond;
     }
 
-    vs->format_ctx = avformat_alloc_context();
-    if (!vs->format_ctx) {
-        LOG_OOM();
-        return false;
-    }
+    return true;
 
-    // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
-    // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
-    // still expects a pointer-to-non-const (it has not be updated accordingly)
-    // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    vs->format_ctx->oformat = (AVOutputFormat *) format;
-#ifdef SCRCPY_LAVF_HAS_AVFORMATCONTEXT_URL
-    vs->format_ctx->url = strdup(vs->device_name);
-    if (!vs->format_ctx->url) {
-        LOG_OOM();
-        goto error_avformat_free_context;
-    }
-#else
-    strncpy(vs->format_ctx->filename, vs->device_name,
-            sizeof(vs->format_ctx->filename));
-#endif
+error_destroy_cond:
+    sc_cond_destroy(&vs->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&vs->mutex);
+error_free_ready_image:
+    free(vs->ready_image);
+error_free_image:
+    free(vs->image);
 
-    AVStream *ostream = avformat_new_stream(vs->format_ctx, encoder);
-    if (!ostream) {
-        LOG_OOM();
-        goto error_avformat_free_context;
+    return false;
+}
+
+static void
+sc_v4l2_sink_stop_timer(struct sc_v4l2_sink *vs) {
+    sc_mutex_lock(&vs->mutex);
+    vs->stopped = true;
+    sc_cond_signal(&vs->cond);
+    sc_mutex_unlock(&vs->mutex);
+
+    sc_thread_join(&vs->thread, NULL);
+
+    sc_cond_destroy(&vs->cond);
+    sc_mutex_destroy(&vs->mutex);
+    free(vs->ready_image);
+    free(vs->image);
+}
+
+static void
+sc_v4l2_sink_release_buffers(struct sc_v4l2_sink *vs) {
+    if (vs->stream_on) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        xioctl(vs->fd, VIDIOC_STREAMOFF, &type);
     }
 
-    int r = avcodec_parameters_from_context(ostream->codecpar, ctx);
-    if (r < 0) {
-        goto error_avformat_free_context;
+    if (vs->streaming) {
+        sc_v4l2_sink_unmap_buffers(vs);
     }
 
-    // The codec is from the v4l2 encoder, not from the decoder
-    ostream->codecpar->codec_id = encoder->id;
+    free(vs->write_buffer);
+}
 
-    int ret = avio_open(&vs->format_ctx->pb, vs->device_name, AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        LOGE("Failed to open output device: %s", vs->device_name);
-        // ostream will be cleaned up during context cleaning
-        goto error_avformat_free_context;
+static bool
+sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
+    vs->fd = open(vs->device_name, O_RDWR | O_CLOEXEC);
+    if (vs->fd == -1) {
+        LOGE("Failed to open output device %s: %s", vs->device_name,
+             strerror(errno));
+        return false;
     }
 
-    vs->encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!vs->encoder_ctx) {
-        LOG_OOM();
-        goto error_avio_close;
+    struct v4l2_capability cap = {0};
+    if (xioctl(vs->fd, VIDIOC_QUERYCAP, &cap)) {
+        LOGE("%s is not a v4l2 device: %s", vs->device_name,
+             strerror(errno));
+        goto error_close;
     }
 
-    vs->encoder_ctx->width = ctx->width;
-    vs->encoder_ctx->height = ctx->height;
-    vs->encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    vs->encoder_ctx->time_base.num = 1;
-    vs->encoder_ctx->time_base.den = 1;
-
-    if (avcodec_open2(vs->encoder_ctx, encoder, NULL) < 0) {
-        LOGE("Could not open codec for v4l2");
-        goto error_avcodec_free_context;
+    uint32_t caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ? cap.device_caps
+                                                            : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_OUTPUT)) {
+        LOGE("%s is not a v4l2 output device", vs->device_name);
+        goto error_close;
     }
 
-    vs->frame = av_frame_alloc();
-    if (!vs->frame) {
-        LOG_OOM();
-        goto error_avcodec_free_context;
+    if (!sc_v4l2_sink_set_format(vs, ctx->width, ctx->height)) {
+        goto error_close;
     }
 
-    vs->packet = av_packet_alloc();
-    if (!vs->packet) {
-        LOG_OOM();
-        goto error_av_frame_free;
+    if (!sc_frame_converter_init(&vs->converter)) {
+        goto error_close;
     }
 
-    vs->has_frame = false;
-    vs->header_written = false;
-    vs->stopped = false;
+    vs->buffer_count = 0;
+    vs->queued_count = 0;
+    vs->stream_on = false;
+    vs->write_buffer = NULL;
+    vs->failed = false;
+
+    vs->streaming = caps & V4L2_CAP_STREAMING && sc_v4l2_sink_map_buffers(vs);
+    if (!vs->streaming) {
+        if (!(caps & V4L2_CAP_READWRITE)) {
+            LOGE("%s supports neither streaming nor write()", vs->device_name);
+            goto error_destroy_converter;
+        }
 
-    LOGD("Starting v4l2 thread");
-    ok = sc_thread_create(&vs->thread, run_v4l2_sink, "scrcpy-v4l2", vs);
-    if (!ok) {
-        LOGE("Could not start v4l2 thread");
-        goto error_av_packet_free;
+        vs->write_buffer = malloc(vs->sizeimage);
+        if (!vs->write_buffer) {
+            LOG_OOM();
+            goto error_destroy_converter;
+        }
+    }
+
+    if (vs->fps && !sc_v4l2_sink_start_timer(vs)) {
+        goto error_release_buffers;
     }
 
-    LOGI("v4l2 sink started to device: %s", vs->device_name);
+    LOGI("v4l2 sink started to device: %s (%s %ux%u, %s)", vs->device_name,
+         sc_v4l2_find_format(vs->fourcc)->name, vs->width, vs->height,
+         vs->streaming ? "mmap" : "write");
 
     return true;
 
-error_av_packet_free:
-    av_packet_free(&vs->packet);
-error_av_frame_free:
-    av_frame_free(&vs->frame);
-error_avcodec_free_context:
-    avcodec_free_context(&vs->encoder_ctx);
-error_avio_close:
-    avio_close(vs->format_ctx->pb);
-error_avformat_free_context:
-    avformat_free_context(vs->format_ctx);
-error_cond_destroy:
-    sc_cond_destroy(&vs->cond);
-error_mutex_destroy:
-    sc_mutex_destroy(&vs->mutex);
-error_frame_buffer_destroy:
-    sc_frame_buffer_destroy(&vs->fb);
+error_release_buffers:
+    sc_v4l2_sink_release_buffers(vs);
+error_destroy_converter:
+    sc_frame_converter_destroy(&vs->converter);
+error_close:
+    close(vs->fd);
 
     return false;
 }
 
 static void
 sc_v4l2_sink_close(struct sc_v4l2_sink *vs) {
+    if (vs->fps) {
+        sc_v4l2_sink_stop_timer(vs);
+    }
+
+    sc_v4l2_sink_release_buffers(vs);
+    sc_frame_converter_destroy(&vs->converter);
+    close(vs->fd);
+}
+
+static bool
+sc_v4l2_sink_push_constant_rate(struct sc_v4l2_sink *vs,
+                                const AVFrame *frame) {
     sc_mutex_lock(&vs->mutex);
-    vs->stopped = true;
-    sc_cond_signal(&vs->cond);
+    bool failed = vs->failed;
     sc_mutex_unlock(&vs->mutex);
 
-    sc_thread_join(&vs->thread, NULL);
+    if (failed) {
+        // Ignore the frames, but do not stop the stream
+        return true;
+    }
 
-    av_packet_free(&vs->packet);
-    av_frame_free(&vs->frame);
-    avcodec_free_context(&vs->encoder_ctx);
-    avio_close(vs->format_ctx->pb);
-    avformat_free_context(vs->format_ctx);
-    sc_cond_destroy(&vs->cond);
-    sc_mutex_destroy(&vs->mutex);
-    sc_frame_buffer_destroy(&vs->fb);
+    // vs->image is only accessed from this thread, convert it without lock
+    if (!sc_v4l2_sink_fill(vs, vs->image, frame)) {
+        LOGE("Could not convert v4l2 frame, disabling the v4l2 sink");
+        sc_mutex_lock(&vs->mutex);
+        vs->failed = true;
+        sc_mutex_unlock(&vs->mutex);
+        return true;
+    }
+
+    // Publish the new image, it will be written on the next tick
+    sc_mutex_lock(&vs->mutex);
+    uint8_t *tmp = vs->ready_image;
+    vs->ready_image = vs->image;
+    vs->image = tmp;
+    vs->has_image = true;
+    sc_mutex_unlock(&vs->mutex);
+
+    return true;
 }
 
 static bool
 sc_v4l2_sink_push(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    bool previous_skipped;
-    bool ok = sc_frame_buffer_push(&vs->fb, frame, &previous_skipped);
-    if (!ok) {
-        return false;
+    if (vs->fps) {
+        return sc_v4l2_sink_push_constant_rate(vs, frame);
     }
 
-    if (!previous_skipped) {
-        sc_mutex_lock(&vs->mutex);
-        vs->has_frame = true;
-        sc_cond_signal(&vs->cond);
-        sc_mutex_unlock(&vs->mutex);
+    if (vs->failed) {
+        // Ignore the frames, but do not stop the stream
+        return true;
+    }
+
+    if (!sc_v4l2_sink_write_frame(vs, frame)) {
+        LOGE("Could not send frame to v4l2 sink, disabling it");
+        vs->failed = true;
     }
 
     return true;
@@ -344,13 +639,19 @@ sc_v4l2_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
 }
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name) {
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_format format, uint16_t fps) {
+    assert(format < ARRAY_LEN(sc_v4l2_formats));
+
     vs->device_name = strdup(device_name);
     if (!vs->device_name) {
         LOGE("Could not strdup v4l2 device name");
         return false;
     }
 
+    vs->format = format;
+    vs->fps = fps;
+
     static const struct sc_frame_sink_ops ops = {
         .open = sc_v4l2_frame_sink_open,
         .close = sc_v4l2_frame_sink_close,
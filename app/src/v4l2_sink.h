@@ -4,35 +4,83 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
 
-#include "frame_buffer.h"
+#include "frame_converter.h"
+#include "options.h"
 #include "trait/frame_sink.h"
 #include "util/thread.h"
 
+#define SC_V4L2_BUFFER_COUNT 4
+
+struct sc_v4l2_buffer {
+    uint8_t *data; // mapped in memory
+    size_t length;
+};
+
+/**
+ * Frame sink writing to a V4L2 output device (typically v4l2loopback)
+ *
+ * The frames are copied (or converted to the requested pixel format) directly
+ * into the buffers of the device, using memory-mapped streaming I/O if the
+ * device supports it, or write() otherwise.
+ *
+ * The frames are written synchronously, so it is expected to be fed by a frame
+ * queue running on its own thread.
+ */
 struct sc_v4l2_sink {
     struct sc_frame_sink frame_sink; // frame sink trait
 
-    struct sc_frame_buffer fb;
-    AVFormatContext *format_ctx;
-    AVCodecContext *encoder_ctx;
-
     char *device_name;
+    enum sc_v4l2_format format; // requested format
+    int fd;
+
+    // Negotiated with the device
+    uint32_t fourcc;
+    enum AVPixelFormat pix_fmt;
+    unsigned width;
+    unsigned height;
+    unsigned bytesperline;
+    size_t sizeimage;
+
+    // If true, use memory-mapped buffers, otherwise write()
+    bool streaming;
+    struct sc_v4l2_buffer buffers[SC_V4L2_BUFFER_COUNT];
+    unsigned buffer_count;
+    // Number of buffers queued at least once (once all the buffers are owned
+    // by the driver, a buffer must be dequeued before writing a new frame)
+    unsigned queued_count;
+    bool stream_on;
+
+    uint8_t *write_buffer; // only used without streaming
+
+    // Only used if the frame is not in the device format or size
+    struct sc_frame_converter converter;
+
+    // If not 0, the last image is written at a constant rate (the frames are
+    // duplicated if necessary)
+    uint16_t fps;
 
+    // Constant rate only
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
-    bool has_frame;
     bool stopped;
-    bool header_written;
+    uint8_t *image; // owned by the pushing thread
+    // The last converted frame, written on every tick (protected by mutex)
+    uint8_t *ready_image;
+    bool has_image;
 
-    AVFrame *frame;
-    AVPacket *packet;
+    // A failure disables the sink, without stopping the other sinks
+    // (protected by mutex in constant rate mode)
+    bool failed;
 };
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name);
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_format format, uint16_t fps);
 
 void
 sc_v4l2_sink_destroy(struct sc_v4l2_sink *vs);
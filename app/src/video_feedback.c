@@ -0,0 +1,136 @@
+#include "video_feedback.h"
+
+#include <assert.h>
+
+#include "control_msg.h"
+#include "util/log.h"
+
+/** Downcast packet sink to sc_video_feedback */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_video_feedback, packet_sink)
+
+#define SC_VIDEO_FEEDBACK_PERIOD SC_TICK_FROM_SEC(1)
+#define SC_VIDEO_FEEDBACK_MIN_OFFSET_WINDOW SC_TICK_FROM_SEC(10)
+
+static void
+sc_video_feedback_reset_period(struct sc_video_feedback *feedback,
+                               sc_tick now) {
+    feedback->period_start = now;
+    feedback->bytes = 0;
+    feedback->delay_sum = 0;
+    feedback->frames = 0;
+}
+
+static void
+sc_video_feedback_send(struct sc_video_feedback *feedback, sc_tick now) {
+    sc_tick elapsed = now - feedback->period_start;
+    assert(elapsed > 0);
+
+    uint64_t rate = feedback->bytes * SC_TICK_FREQ / elapsed;
+    uint64_t delay = feedback->frames
+                   ? feedback->delay_sum / feedback->frames
+                   : 0;
+    unsigned skipped =
+        atomic_exchange_explicit(&feedback->skipped_frames, 0,
+                                 memory_order_relaxed);
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK;
+    msg.video_feedback.receive_rate = MIN(rate, UINT32_MAX);
+    msg.video_feedback.delay = MIN(delay, UINT32_MAX);
+    msg.video_feedback.frames = MIN(feedback->frames, UINT16_MAX);
+    msg.video_feedback.skipped_frames = MIN(skipped, UINT16_MAX);
+
+    if (!sc_controller_push_msg(feedback->controller, &msg)) {
+        LOGW("Could not send video feedback");
+    }
+}
+
+// Return the queuing delay of a packet received at offset (reception time -
+// PTS)
+static sc_tick
+sc_video_feedback_compute_delay(struct sc_video_feedback *feedback,
+                                int64_t offset, sc_tick now) {
+    if (!feedback->min_offset.initialized
+            || now - feedback->min_offset.window_start
+                    >= SC_VIDEO_FEEDBACK_MIN_OFFSET_WINDOW) {
+        // Start a new window
+        feedback->min_offset.previous = feedback->min_offset.initialized
+                                      ? feedback->min_offset.current
+                                      : offset;
+        feedback->min_offset.current = offset;
+        feedback->min_offset.window_start = now;
+        feedback->min_offset.initialized = true;
+    } else if (offset < feedback->min_offset.current) {
+        feedback->min_offset.current = offset;
+    }
+
+    int64_t min_offset = MIN(feedback->min_offset.current,
+                             feedback->min_offset.previous);
+    assert(offset >= min_offset);
+    return offset - min_offset;
+}
+
+static bool
+sc_video_feedback_packet_sink_open(struct sc_packet_sink *sink,
+                                   AVCodecContext *ctx) {
+    struct sc_video_feedback *feedback = DOWNCAST(sink);
+    assert(ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+    (void) ctx;
+
+    feedback->min_offset.initialized = false;
+    sc_video_feedback_reset_period(feedback, sc_tick_now());
+
+    return true;
+}
+
+static void
+sc_video_feedback_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_video_feedback_packet_sink_push(struct sc_packet_sink *sink,
+                                   const AVPacket *packet) {
+    struct sc_video_feedback *feedback = DOWNCAST(sink);
+
+    sc_tick now = sc_tick_now();
+    feedback->bytes += packet->size;
+
+    if (packet->pts != AV_NOPTS_VALUE) {
+        // Both the PTS and the ticks are in microseconds
+        int64_t offset = now - packet->pts;
+        feedback->delay_sum +=
+            sc_video_feedback_compute_delay(feedback, offset, now);
+        ++feedback->frames;
+    }
+
+    if (now - feedback->period_start >= SC_VIDEO_FEEDBACK_PERIOD) {
+        sc_video_feedback_send(feedback, now);
+        sc_video_feedback_reset_period(feedback, now);
+    }
+
+    // Never fail, the feedback is not essential
+    return true;
+}
+
+void
+sc_video_feedback_init(struct sc_video_feedback *feedback,
+                       struct sc_controller *controller) {
+    assert(controller);
+    feedback->controller = controller;
+    atomic_init(&feedback->skipped_frames, 0);
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_video_feedback_packet_sink_open,
+        .close = sc_video_feedback_packet_sink_close,
+        .push = sc_video_feedback_packet_sink_push,
+    };
+
+    feedback->packet_sink.ops = &ops;
+}
+
+void
+sc_video_feedback_report_skipped_frame(struct sc_video_feedback *feedback) {
+    atomic_fetch_add_explicit(&feedback->skipped_frames, 1,
+                              memory_order_relaxed);
+}
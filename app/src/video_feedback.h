@@ -0,0 +1,58 @@
+#ifndef SC_VIDEO_FEEDBACK_H
+#define SC_VIDEO_FEEDBACK_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "controller.h"
+#include "trait/packet_sink.h"
+#include "util/tick.h"
+
+/**
+ * Periodically report the reception statistics of the video stream to the
+ * device, so that it can adapt the encoding bit rate.
+ *
+ * It must be added as a packet sink of the video demuxer.
+ */
+struct sc_video_feedback {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    struct sc_controller *controller;
+
+    // frames skipped by the screen (reported from any thread)
+    atomic_uint skipped_frames;
+
+    // The following fields are only accessed from the demuxer thread
+
+    // Minimum difference between the reception time and the PTS, i.e. the
+    // reception offset of a packet not delayed by any queue. It is the
+    // minimum of the current and the previous windows, to follow the drift
+    // between the device and the computer clocks.
+    struct {
+        int64_t current;
+        int64_t previous;
+        sc_tick window_start;
+        bool initialized;
+    } min_offset;
+
+    sc_tick period_start;
+    uint64_t bytes;
+    uint64_t delay_sum;
+    unsigned frames;
+};
+
+void
+sc_video_feedback_init(struct sc_video_feedback *feedback,
+                       struct sc_controller *controller);
+
+// Report that a frame has not been rendered
+//
+// It may be called from any thread.
+void
+sc_video_feedback_report_skipped_frame(struct sc_video_feedback *feedback);
+
+#endif
@@ -0,0 +1,263 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+
+#include "audio_regulator.h"
+#include "util/tick.h"
+
+/**
+ * Offline benchmark of the audio regulator
+ *
+ * The producer (the demuxer) and the consumer (the audio output) run on
+ * synthetic clocks, in simulated time, so that the results are
+ * deterministic and a minute of audio is processed in a fraction of a second.
+ * The events of both sides are interleaved in time order on a single thread.
+ *
+ * The producer captures packets of 20ms on its own clock, which drifts from
+ * the consumer clock. Each packet is received after a random network delay
+ * (the jitter). Periodically, the network stalls (a burst): all the packets
+ * captured during the stall are received at once at its end.
+ *
+ * Parameters (all optional) are passed as key=value arguments:
+ *     duration=<s> buffer=<ms> drift=<ppm> jitter=<ms> burst-period=<ms>
+ *     burst=<ms>
+ */
+
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define PACKET_SAMPLES 960 // 20ms
+#define PULL_SAMPLES 240 // 5ms, the default --audio-output-buffer
+#define NETWORK_DELAY SC_TICK_FROM_MS(5)
+
+struct params {
+    long duration; // in seconds
+    long buffer; // in ms
+    long drift; // in ppm, positive if the producer clock is faster
+    long jitter; // in ms
+    long burst_period; // in ms, 0 to disable
+    long burst; // in ms
+};
+
+struct latencies {
+    sc_tick *data;
+    size_t size;
+    size_t cap;
+};
+
+static uint64_t rand_state = 0x853c49e6748fea9b;
+
+// Deterministic xorshift64*
+static uint32_t
+next_rand(void) {
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return (rand_state * UINT64_C(2685821657736338717)) >> 32;
+}
+
+static bool
+parse_param(const char *arg, const char *key, long *value) {
+    size_t len = strlen(key);
+    if (strncmp(arg, key, len) || arg[len] != '=') {
+        return false;
+    }
+
+    char *endptr;
+    *value = strtol(&arg[len + 1], &endptr, 10);
+    if (*endptr) {
+        fprintf(stderr, "Invalid value: %s\n", arg);
+        exit(1);
+    }
+    return true;
+}
+
+static void
+parse_params(struct params *params, int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool ok = parse_param(arg, "duration", &params->duration)
+               || parse_param(arg, "buffer", &params->buffer)
+               || parse_param(arg, "drift", &params->drift)
+               || parse_param(arg, "jitter", &params->jitter)
+               || parse_param(arg, "burst-period", &params->burst_period)
+               || parse_param(arg, "burst", &params->burst);
+        if (!ok) {
+            fprintf(stderr, "Unknown parameter: %s\n", arg);
+            exit(1);
+        }
+    }
+}
+
+static void
+push_latency(struct latencies *latencies, sc_tick latency) {
+    if (latencies->size == latencies->cap) {
+        latencies->cap = latencies->cap ? latencies->cap * 2 : 1024;
+        latencies->data = realloc(latencies->data,
+                                  latencies->cap * sizeof(*latencies->data));
+        assert(latencies->data);
+    }
+    latencies->data[latencies->size++] = latency;
+}
+
+static int
+compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+static double
+get_percentile_ms(const struct latencies *latencies, unsigned p) {
+    size_t index = (latencies->size - 1) * p / 100;
+    return (double) latencies->data[index] * 1000 / SC_TICK_FREQ;
+}
+
+// Simulated time at which the producer captures a sample at the given PTS
+static sc_tick
+capture_time(const struct params *params, int64_t pts) {
+    return pts * 1000000 / (1000000 + params->drift);
+}
+
+static sc_tick
+arrival_time(const struct params *params, sc_tick capture, sc_tick previous) {
+    sc_tick jitter = SC_TICK_FROM_MS(params->jitter);
+    sc_tick arrival = capture + NETWORK_DELAY;
+    if (jitter) {
+        arrival += next_rand() % jitter;
+    }
+
+    if (params->burst_period) {
+        // The packets captured during a stall are received at its end
+        sc_tick period = SC_TICK_FROM_MS(params->burst_period);
+        sc_tick stall_end = capture / period * period
+                          + SC_TICK_FROM_MS(params->burst);
+        arrival = MAX(arrival, stall_end);
+    }
+
+    // The packets are received in order (TCP)
+    return MAX(arrival, previous);
+}
+
+int main(int argc, char *argv[]) {
+    struct params params = {
+        .duration = 60,
+        .buffer = 50,
+        .drift = 100,
+        .jitter = 10,
+        .burst_period = 10000,
+        .burst = 60,
+    };
+    parse_params(&params, argc, argv);
+
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    assert(ctx);
+    ctx->sample_rate = SAMPLE_RATE;
+    ctx->sample_fmt = AV_SAMPLE_FMT_S16;
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    av_channel_layout_default(&ctx->ch_layout, CHANNELS);
+#else
+    ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+    ctx->channels = CHANNELS;
+#endif
+
+    struct sc_audio_regulator ar;
+    size_t sample_size = CHANNELS * sizeof(float);
+    uint32_t target = params.buffer * SAMPLE_RATE / 1000;
+    bool ok = sc_audio_regulator_init(&ar, sample_size, ctx, target, 0,
+                                      false);
+    assert(ok);
+    (void) ok;
+
+    // A 500Hz triangle wave (the content does not matter, it is never
+    // inspected)
+    static int16_t packet[PACKET_SAMPLES * CHANNELS];
+    for (int i = 0; i < PACKET_SAMPLES; ++i) {
+        int phase = i % 96; // 48000 / 500
+        int16_t value = (phase < 48 ? phase : 96 - phase) * 682 - 16384;
+        packet[i * CHANNELS] = value;
+        packet[i * CHANNELS + 1] = value;
+    }
+    const uint8_t *data = (const uint8_t *) packet;
+
+    static uint8_t out[PULL_SAMPLES * CHANNELS * sizeof(float)];
+
+    struct latencies latencies = {0};
+    uint64_t underflow_samples = 0;
+    unsigned underflow_events = 0;
+
+    sc_tick end = SC_TICK_FROM_SEC(params.duration);
+    sc_tick packet_duration = SC_TICK_FROM_SEC(PACKET_SAMPLES) / SAMPLE_RATE;
+    sc_tick pull_period = SC_TICK_FROM_SEC(PULL_SAMPLES) / SAMPLE_RATE;
+
+    int64_t next_pts = 0;
+    sc_tick next_arrival = arrival_time(&params, 0, 0);
+    sc_tick next_pull = 0;
+
+    clock_t cpu_start = clock();
+
+    while (next_pull < end) {
+        if (next_arrival <= next_pull) {
+            ok = sc_audio_regulator_push_samples(&ar, &data, PACKET_SAMPLES,
+                                                 next_pts);
+            assert(ok);
+
+            next_pts += packet_duration;
+            next_arrival = arrival_time(&params,
+                                        capture_time(&params, next_pts),
+                                        next_arrival);
+        } else {
+            // The producer resets the underflow counter, so only measure the
+            // silence inserted by this pull
+            uint32_t before = atomic_load(&ar.underflow);
+            int64_t pts = sc_audio_regulator_pull(&ar, out, PULL_SAMPLES);
+            uint32_t inserted = atomic_load(&ar.underflow) - before;
+            if (inserted) {
+                underflow_samples += inserted;
+                ++underflow_events;
+            }
+            if (pts != -1) {
+                push_latency(&latencies,
+                             next_pull - capture_time(&params, pts));
+            }
+
+            next_pull += pull_period;
+        }
+    }
+
+    clock_t cpu_end = clock();
+
+    sc_audio_regulator_destroy(&ar);
+    avcodec_free_context(&ctx);
+
+    printf("Audio regulator benchmark: %lds, buffer=%ldms, drift=%ldppm, "
+           "jitter=%ldms, burst=%ldms every %ldms\n", params.duration,
+           params.buffer, params.drift, params.jitter, params.burst,
+           params.burst_period);
+
+    if (latencies.size) {
+        qsort(latencies.data, latencies.size, sizeof(*latencies.data),
+              compare_ticks);
+        printf("    Latency:   p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, "
+               "max %.2f ms\n", get_percentile_ms(&latencies, 50),
+               get_percentile_ms(&latencies, 95),
+               get_percentile_ms(&latencies, 99),
+               get_percentile_ms(&latencies, 100));
+    } else {
+        printf("    Latency:   no sample played\n");
+    }
+    printf("    Underflow: %u events, %.2f ms of silence\n", underflow_events,
+           (double) underflow_samples * 1000 / SAMPLE_RATE);
+
+    double cpu_ms = (double) (cpu_end - cpu_start) * 1000 / CLOCKS_PER_SEC;
+    printf("    CPU time:  %.3f ms per second of audio\n",
+           cpu_ms / params.duration);
+
+    free(latencies.data);
+    return 0;
+}
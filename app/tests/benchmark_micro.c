@@ -0,0 +1,426 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+#include "control_msg.h"
+#include "demuxer.h"
+#include "device_msg.h"
+#include "frame_buffer.h"
+#include "packet_merger.h"
+#include "util/audiobuf.h"
+#include "util/binary.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+/**
+ * Micro-benchmarks of the hot data structures
+ *
+ * Each benchmark prints a single JSON line on stdout:
+ *
+ *     {"benchmark":"vecdeque_push_pop","iterations":10000000,"ns_per_op":2.41}
+ *
+ * (plus "bytes_per_sec" for throughput benchmarks), so that the results can
+ * be compared against a baseline by a script.
+ *
+ * The benchmarks to run may be passed as arguments (all by default):
+ *
+ *     benchmark_micro vecdeque_push_pop audiobuf_write_read
+ */
+
+// Prevent the compiler from optimizing the benchmarked code away
+static volatile uint64_t sink;
+
+static void
+report(const char *name, uint64_t iterations, sc_tick elapsed,
+       uint64_t bytes) {
+    double ns_per_op = (double) SC_TICK_TO_NS(elapsed) / iterations;
+    printf("{\"benchmark\":\"%s\",\"iterations\":%" PRIu64
+           ",\"ns_per_op\":%.2f", name, iterations, ns_per_op);
+    if (bytes) {
+        double seconds = (double) elapsed / SC_TICK_FREQ;
+        printf(",\"bytes_per_sec\":%.0f", bytes / seconds);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void
+bench_vecdeque_push_pop(const char *name) {
+    const uint64_t iterations = 10000000;
+
+    struct SC_VECDEQUE(int) queue;
+    sc_vecdeque_init(&queue);
+
+    // Keep some items in the queue, so that it wraps around
+    for (int i = 0; i < 32; ++i) {
+        bool ok = sc_vecdeque_push(&queue, i);
+        assert(ok);
+        (void) ok;
+    }
+
+    uint64_t sum = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bool ok = sc_vecdeque_push(&queue, (int) i);
+        assert(ok);
+        (void) ok;
+        sum += sc_vecdeque_pop(&queue);
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = sum;
+
+    sc_vecdeque_destroy(&queue);
+
+    report(name, iterations, elapsed, 0);
+}
+
+static void
+bench_audiobuf_write_read(const char *name) {
+    // 48kHz stereo float: 20ms packets written, 5ms chunks read
+    const size_t sample_size = 2 * sizeof(float);
+    const uint32_t write_samples = 960;
+    const uint32_t read_samples = 240;
+    const uint64_t iterations = 1000000; // packets
+
+    struct sc_audiobuf buf;
+    bool ok = sc_audiobuf_init(&buf, sample_size, 4 * write_samples);
+    assert(ok);
+    (void) ok;
+
+    uint8_t *data = calloc(write_samples, sample_size);
+    assert(data);
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        uint32_t w = sc_audiobuf_write(&buf, data, write_samples);
+        assert(w == write_samples);
+        (void) w;
+        for (uint32_t j = 0; j < write_samples / read_samples; ++j) {
+            uint32_t r = sc_audiobuf_read(&buf, data, read_samples);
+            assert(r == read_samples);
+            (void) r;
+        }
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = data[0];
+
+    free(data);
+    sc_audiobuf_destroy(&buf);
+
+    // Each byte is written once and read once
+    uint64_t bytes = iterations * write_samples * sample_size;
+    report(name, iterations, elapsed, bytes);
+}
+
+static void
+bench_control_msg_serialize(const char *name) {
+    const uint64_t iterations = 10000000;
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = SC_POINTER_ID_MOUSE,
+            .position = {
+                .point = {.x = 100, .y = 200},
+                .screen_size = {.width = 1080, .height = 1920},
+            },
+            .pressure = 1.0f,
+            .action_button = 0,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+        },
+    };
+
+    static uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+
+    uint64_t total = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        msg.inject_touch_event.position.point.x = i & 0x3ff;
+        total += sc_control_msg_serialize(&msg, buf);
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = total + buf[0];
+
+    report(name, iterations, elapsed, 0);
+}
+
+static void
+bench_device_msg_deserialize(const char *name) {
+    const uint64_t iterations = 10000000;
+
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_CLIPBOARD,
+        0x00, 0x00, 0x00, 0x03, // text length
+        0x41, 0x42, 0x43, // "ABC"
+    };
+
+    uint64_t total = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        struct sc_device_msg msg;
+        ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+        assert(r == sizeof(input));
+        total += r + msg.clipboard.length;
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = total;
+
+    report(name, iterations, elapsed, 0);
+}
+
+static void
+bench_packet_header_parse(const char *name) {
+    // Same decoding as the demuxer, on the 12-byte "meta" header preceding
+    // each packet (the demuxer itself reads from a socket)
+    const uint64_t iterations = 100000000;
+
+    uint8_t header[SC_PACKET_HEADER_SIZE];
+    sc_write64be(header, SC_PACKET_FLAG_KEY_FRAME | 123456789);
+    sc_write32be(&header[8], 4096);
+
+    uint64_t total = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        header[7] = i; // prevent hoisting out of the loop
+        uint64_t pts_flags = sc_read64be(header);
+        uint32_t len = sc_read32be(&header[8]);
+        bool config = pts_flags & SC_PACKET_FLAG_CONFIG;
+        bool key_frame = pts_flags & SC_PACKET_FLAG_KEY_FRAME;
+        int64_t pts = pts_flags & SC_PACKET_PTS_MASK;
+        total += pts + len + config + key_frame;
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = total;
+
+    report(name, iterations, elapsed, 0);
+}
+
+static void
+bench_packet_merger_merge(const char *name) {
+    // A config packet followed by a media packet (a new encoding session)
+    const uint64_t iterations = 1000000;
+    const int config_size = 32;
+    const int media_size = 16384;
+
+    AVPacket *config = av_packet_alloc();
+    AVPacket *media = av_packet_alloc();
+    assert(config && media);
+    int r = av_new_packet(config, config_size);
+    assert(!r);
+    r = av_new_packet(media, media_size);
+    assert(!r);
+    (void) r;
+    memset(config->data, 0x01, config_size);
+    memset(media->data, 0x02, media_size);
+    config->pts = AV_NOPTS_VALUE;
+    media->pts = 0;
+
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    struct sc_packet_merger merger;
+    sc_packet_merger_init(&merger);
+
+    uint64_t total = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bool ok = sc_packet_merger_merge(&merger, config);
+        assert(ok);
+
+        r = av_packet_ref(packet, media);
+        assert(!r);
+        ok = sc_packet_merger_merge(&merger, packet);
+        assert(ok);
+        (void) ok;
+        total += packet->size;
+        av_packet_unref(packet);
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = total;
+
+    sc_packet_merger_destroy(&merger);
+    av_packet_free(&packet);
+    av_packet_free(&media);
+    av_packet_free(&config);
+
+    report(name, iterations, elapsed, 0);
+}
+
+static void
+bench_packet_merger_merge_in_place(const char *name) {
+    // Same as bench_packet_merger_merge(), but the media packets are allocated
+    // from a pool with headroom, as the demuxer does
+    const uint64_t iterations = 1000000;
+    const int config_size = 32;
+    const int media_size = 16384;
+
+    AVPacket *config = av_packet_alloc();
+    assert(config);
+    int r = av_new_packet(config, config_size);
+    assert(!r);
+    (void) r;
+    memset(config->data, 0x01, config_size);
+    config->pts = AV_NOPTS_VALUE;
+
+    AVBufferPool *pool =
+        av_buffer_pool_init(config_size + media_size
+                                + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+    assert(pool);
+
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    struct sc_packet_merger merger;
+    sc_packet_merger_init(&merger);
+
+    uint64_t total = 0;
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bool ok = sc_packet_merger_merge(&merger, config);
+        assert(ok);
+
+        size_t headroom = sc_packet_merger_get_headroom(&merger);
+        packet->buf = av_buffer_pool_get(pool);
+        assert(packet->buf);
+        packet->data = packet->buf->data + headroom;
+        packet->size = media_size;
+        packet->pts = 0;
+        ok = sc_packet_merger_merge(&merger, packet);
+        assert(ok);
+        (void) ok;
+        total += packet->size;
+        av_packet_unref(packet);
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+    sink = total;
+
+    sc_packet_merger_destroy(&merger);
+    av_packet_free(&packet);
+    av_buffer_pool_uninit(&pool);
+    av_packet_free(&config);
+
+    report(name, iterations, elapsed, 0);
+}
+
+struct frame_buffer_bench {
+    struct sc_frame_buffer fb;
+    atomic_bool stopped;
+    uint64_t consumed;
+};
+
+static int
+run_frame_buffer_consumer(void *data) {
+    struct frame_buffer_bench *bench = data;
+
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    // Poll the ready slot as fast as possible, to maximize the contention
+    // (the screen is notified by an event instead)
+    while (!atomic_load_explicit(&bench->stopped, memory_order_relaxed)) {
+        unsigned ready = atomic_load_explicit(&bench->fb.ready,
+                                              memory_order_relaxed);
+        if (ready & SC_FRAME_BUFFER_READY_PENDING) {
+            sc_frame_buffer_consume(&bench->fb, frame);
+            av_frame_unref(frame);
+            ++bench->consumed;
+        }
+    }
+
+    av_frame_free(&frame);
+    return 0;
+}
+
+static void
+bench_frame_buffer_contention(const char *name) {
+    // Push frames while another thread consumes them concurrently
+    const uint64_t iterations = 2000000;
+
+    struct frame_buffer_bench bench;
+    bool ok = sc_frame_buffer_init(&bench.fb);
+    assert(ok);
+    atomic_init(&bench.stopped, false);
+    bench.consumed = 0;
+
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = 16;
+    frame->height = 16;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+
+    sc_thread thread;
+    ok = sc_thread_create(&thread, run_frame_buffer_consumer, "bench-consumer",
+                          &bench);
+    assert(ok);
+    (void) ok;
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        frame->pts = i;
+        bool skipped;
+        ok = sc_frame_buffer_push(&bench.fb, frame, &skipped);
+        assert(ok);
+    }
+    sc_tick elapsed = sc_tick_now() - start;
+
+    atomic_store_explicit(&bench.stopped, true, memory_order_relaxed);
+    sc_thread_join(&thread, NULL);
+    sink = bench.consumed;
+
+    av_frame_free(&frame);
+    sc_frame_buffer_destroy(&bench.fb);
+
+    report(name, iterations, elapsed, 0);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(const char *name);
+} benchmarks[] = {
+    {"vecdeque_push_pop", bench_vecdeque_push_pop},
+    {"audiobuf_write_read", bench_audiobuf_write_read},
+    {"control_msg_serialize", bench_control_msg_serialize},
+    {"device_msg_deserialize", bench_device_msg_deserialize},
+    {"packet_header_parse", bench_packet_header_parse},
+    {"packet_merger_merge", bench_packet_merger_merge},
+    {"packet_merger_merge_in_place", bench_packet_merger_merge_in_place},
+    {"frame_buffer_contention", bench_frame_buffer_contention},
+};
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        for (size_t i = 0; i < ARRAY_LEN(benchmarks); ++i) {
+            benchmarks[i].run(benchmarks[i].name);
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        bool found = false;
+        for (size_t j = 0; j < ARRAY_LEN(benchmarks); ++j) {
+            if (!strcmp(argv[i], benchmarks[j].name)) {
+                benchmarks[j].run(benchmarks[j].name);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown benchmark: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
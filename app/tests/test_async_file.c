@@ -0,0 +1,73 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/async_file.h"
+
+#define FILENAME "test_async_file.tmp"
+
+static void test_async_file(void) {
+    // More than the total size of the chunks, so that the writes must wait
+    // for the writer thread
+    size_t size = (SC_ASYNC_FILE_CHUNK_COUNT + 2) * SC_ASYNC_FILE_CHUNK_SIZE
+                + 42;
+    uint8_t *data = malloc(size);
+    assert(data);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 31 + i / 1000;
+    }
+
+    struct sc_async_file file;
+    bool ok = sc_async_file_open(&file, FILENAME);
+    assert(ok);
+
+    // Small writes, then a large one
+    size_t pos = 0;
+    for (int i = 0; i < 10; ++i) {
+        ok = sc_async_file_write(&file, &data[pos], 100);
+        assert(ok);
+        pos += 100;
+    }
+    ok = sc_async_file_write(&file, &data[pos], size - pos);
+    assert(ok);
+
+    assert(sc_async_file_size(&file) == (int64_t) size);
+
+    // Overwrite some bytes at the beginning (like a muxer writing a header)
+    int64_t r = sc_async_file_seek(&file, 10, SEEK_SET);
+    assert(r == 10);
+    ok = sc_async_file_write(&file, (const uint8_t *) "abcd", 4);
+    assert(ok);
+    memcpy(&data[10], "abcd", 4);
+
+    r = sc_async_file_seek(&file, 0, SEEK_END);
+    assert(r == (int64_t) size);
+
+    ok = sc_async_file_close(&file);
+    assert(ok);
+
+    FILE *f = fopen(FILENAME, "rb");
+    assert(f);
+    uint8_t *content = malloc(size + 1);
+    assert(content);
+    size_t n = fread(content, 1, size + 1, f);
+    assert(n == size);
+    assert(!memcmp(content, data, size));
+    fclose(f);
+
+    remove(FILENAME);
+    free(content);
+    free(data);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_async_file();
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "util/audio_convert.h"
+
+static void test_s16_to_flt(void) {
+    // More than one vector, with a remainder
+    int16_t src[19];
+    for (int i = 0; i < 19; ++i) {
+        src[i] = (i - 9) * 3641;
+    }
+    src[0] = INT16_MIN;
+    src[18] = INT16_MAX;
+
+    float dst[19];
+    sc_audio_convert_s16_to_flt(dst, src, 19);
+
+    for (int i = 0; i < 19; ++i) {
+        assert(dst[i] == src[i] / 32768.0f);
+    }
+    assert(dst[0] == -1.0f);
+    assert(dst[9] == 0.0f);
+    assert(dst[18] < 1.0f);
+}
+
+static void test_s16_to_flt_empty(void) {
+    float dst[1] = {42};
+    sc_audio_convert_s16_to_flt(dst, NULL, 0);
+    assert(dst[0] == 42);
+}
+
+static void test_fltp_to_flt_stereo(void) {
+    const float left[] = {0.1f, 0.2f, 0.3f};
+    const float right[] = {-0.1f, -0.2f, -0.3f};
+    const float *const planes[] = {left, right};
+
+    float dst[6];
+    sc_audio_convert_fltp_to_flt(dst, planes, 2, 3);
+
+    const float expected[] = {0.1f, -0.1f, 0.2f, -0.2f, 0.3f, -0.3f};
+    for (int i = 0; i < 6; ++i) {
+        assert(dst[i] == expected[i]);
+    }
+}
+
+static void test_fltp_to_flt_mono(void) {
+    const float mono[] = {0.5f, -0.5f};
+    const float *const planes[] = {mono};
+
+    float dst[2];
+    sc_audio_convert_fltp_to_flt(dst, planes, 1, 2);
+    assert(dst[0] == 0.5f);
+    assert(dst[1] == -0.5f);
+}
+
+static void test_s16p_to_flt(void) {
+    const int16_t left[] = {INT16_MIN, 0};
+    const int16_t right[] = {16384, -16384};
+    const int16_t *const planes[] = {left, right};
+
+    float dst[4];
+    sc_audio_convert_s16p_to_flt(dst, planes, 2, 2);
+    assert(dst[0] == -1.0f);
+    assert(dst[1] == 0.5f);
+    assert(dst[2] == 0.0f);
+    assert(dst[3] == -0.5f);
+}
+
+static void test_scale_flt(void) {
+    // More than one vector, with a remainder (the values are exact)
+    float samples[19];
+    for (int i = 0; i < 19; ++i) {
+        samples[i] = (i - 9) * 0.125f;
+    }
+
+    sc_audio_scale_flt(samples, 19, 0.5f);
+
+    for (int i = 0; i < 19; ++i) {
+        assert(samples[i] == (i - 9) * 0.0625f);
+    }
+}
+
+static void test_mix_flt(void) {
+    float dst[19];
+    float src[19];
+    for (int i = 0; i < 19; ++i) {
+        dst[i] = i * 0.125f;
+        src[i] = -i * 0.25f;
+    }
+
+    sc_audio_mix_flt(dst, src, 19, 0.5f);
+
+    // dst + src * 0.5 == 0
+    for (int i = 0; i < 19; ++i) {
+        assert(dst[i] == 0.0f);
+    }
+
+    sc_audio_mix_flt(dst, src, 19, 2.0f);
+
+    for (int i = 0; i < 19; ++i) {
+        assert(dst[i] == -i * 0.5f);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_s16_to_flt();
+    test_s16_to_flt_empty();
+    test_fltp_to_flt_stereo();
+    test_fltp_to_flt_mono();
+    test_s16p_to_flt();
+    test_scale_flt();
+    test_mix_flt();
+    return 0;
+}
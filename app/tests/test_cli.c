@@ -46,9 +46,15 @@ static void test_options(void) {
     char *argv[] = {
         "scrcpy",
         "--always-on-top",
+        "--automation-port", "27190",
+        "--background-max-fps", "5",
         "--video-bit-rate", "5M",
         "--crop", "100:200:300:400",
+        "--extra-display", "2",
+        "--extra-display", "new:1920x1080/240",
         "--fullscreen",
+        "--gamepad-report-rate", "125",
+        "--input-record", "input.rec",
         "--max-fps", "30",
         "--max-size", "1024",
         // "--no-control" is not compatible with "--turn-screen-off"
@@ -57,10 +63,16 @@ static void test_options(void) {
         "--push-target", "/sdcard/Movies",
         "--record", "file",
         "--record-format", "mkv",
+        "--record-stream",
+        "--record-video-bit-rate", "24M",
+        "--record-max-size", "1920",
         "--serial", "0123456789abcdef",
         "--show-touches",
         "--turn-screen-off",
         "--prefer-text",
+        "--video-idle-timeout", "30",
+        "--video-intra-refresh", "60",
+        "--video-latency", "low",
         "--window-title", "my device",
         "--window-x", "100",
         "--window-y", "-1",
@@ -74,9 +86,19 @@ static void test_options(void) {
 
     const struct scrcpy_options *opts = &args.opts;
     assert(opts->always_on_top);
+    assert(opts->automation_port == 27190);
+    assert(opts->background_max_fps == 5);
     assert(opts->video_bit_rate == 5000000);
     assert(!strcmp(opts->crop, "100:200:300:400"));
+    assert(opts->extra_display_count == 2);
+    assert(!strcmp(opts->extra_displays[0], "2"));
+    assert(!strcmp(opts->extra_displays[1], "new:1920x1080/240"));
     assert(opts->fullscreen);
+    assert(opts->gamepad_report_rate == 125);
+    assert(opts->video_low_latency);
+    assert(opts->video_idle_timeout == SC_TICK_FROM_SEC(30));
+    assert(opts->video_intra_refresh == 60);
+    assert(!strcmp(opts->input_record_filename, "input.rec"));
     assert(!strcmp(opts->max_fps, "30"));
     assert(opts->max_size == 1024);
     assert(opts->port_range.first == 1234);
@@ -84,6 +106,9 @@ static void test_options(void) {
     assert(!strcmp(opts->push_target, "/sdcard/Movies"));
     assert(!strcmp(opts->record_filename, "file"));
     assert(opts->record_format == SC_RECORD_FORMAT_MKV);
+    assert(opts->record_stream);
+    assert(opts->record_video_bit_rate == 24000000);
+    assert(opts->record_max_size == 1920);
     assert(!strcmp(opts->serial, "0123456789abcdef"));
     assert(opts->show_touches);
     assert(opts->turn_screen_off);
@@ -108,6 +133,26 @@ static void test_options2(void) {
         "--no-control",
         "--no-playback",
         "--record", "file.mp4", // cannot enable --no-playback without recording
+        "--record-segment-duration", "600",
+        "--record-segment-count", "6",
+        "--record-memory-limit", "64M",
+        "--record-fragment-duration", "500",
+        "--record-index",
+        "--record-sync",
+        "--record-on-demand",
+        "--replay-buffer", "30",
+        "--replay-file", "replay.mp4",
+        "--shm-sink", "frames",
+        "--restream", "srt://127.0.0.1:1234?mode=caller",
+        "--frame-sink-plugin", "libocr.so",
+        "--frame-sink-plugin", "./libdiff.so",
+        "--raw-video", "video.fifo",
+        "--raw-video-header",
+        "--thumbnail", "thumb.webp",
+        "--thumbnail-interval", "5000",
+        "--thumbnail-size", "160",
+        "--print-startup-timing",
+        "--reconnect",
     };
 
     bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
@@ -119,8 +164,440 @@ static void test_options2(void) {
     assert(!opts->audio_playback);
     assert(!strcmp(opts->record_filename, "file.mp4"));
     assert(opts->record_format == SC_RECORD_FORMAT_MP4);
+    assert(opts->record_segment_duration == SC_TICK_FROM_SEC(600));
+    assert(opts->record_segment_count == 6);
+    assert(opts->record_memory_limit == 64000000);
+    assert(opts->record_fragment_duration == SC_TICK_FROM_MS(500));
+    assert(opts->record_index);
+    assert(opts->record_sync);
+    assert(opts->record_on_demand);
+    assert(opts->replay_buffer == SC_TICK_FROM_SEC(30));
+    assert(!strcmp(opts->replay_filename, "replay.mp4"));
+    assert(opts->replay_format == SC_RECORD_FORMAT_MP4);
+    assert(!strcmp(opts->shm_name, "frames"));
+    assert(!strcmp(opts->restream_url, "srt://127.0.0.1:1234?mode=caller"));
+    assert(opts->frame_sink_plugin_count == 2);
+    assert(!strcmp(opts->frame_sink_plugins[0], "libocr.so"));
+    assert(!strcmp(opts->frame_sink_plugins[1], "./libdiff.so"));
+    assert(!strcmp(opts->raw_video_filename, "video.fifo"));
+    assert(opts->raw_video_header);
+    assert(!strcmp(opts->thumbnail_filename, "thumb.webp"));
+    assert(opts->thumbnail_format == SC_THUMBNAIL_FORMAT_WEBP);
+    assert(opts->thumbnail_interval == SC_TICK_FROM_MS(5000));
+    assert(opts->thumbnail_size == 160);
+    assert(opts->print_startup_timing);
+    assert(opts->reconnect);
 }
 
+static void test_latency_profile(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--video-buffer", "30", // explicit options take precedence
+        "--latency-profile", "ultra",
+        "--video-decoder-thread-type", "frame",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->latency_profile == SC_LATENCY_PROFILE_ULTRA);
+    assert(opts->video_buffer == SC_TICK_FROM_MS(30));
+    assert(opts->audio_buffer == SC_TICK_FROM_MS(20));
+    assert(opts->video_low_latency);
+    assert(opts->video_decoder_thread_type == SC_DECODER_THREAD_TYPE_FRAME);
+    assert(!opts->video_pacing);
+    assert(opts->present_mode == SC_PRESENT_MODE_IMMEDIATE);
+    assert(opts->latency_budget == SC_TICK_FROM_MS(20));
+}
+
+static void test_power_saving(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--power-saving",
+        "--video-hwaccel", "none", // explicit options take precedence
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->power_saving);
+    assert(opts->video_hwaccel == SC_HWACCEL_NONE);
+    assert(opts->video_idle_timeout == SC_TICK_FROM_SEC(10));
+}
+
+static void test_soak(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--soak",
+    };
+
+    // The time series is written to the metrics file
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--soak",
+        "--metrics-file", "soak.jsonl",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(args.opts.soak);
+}
+
+static void test_benchmark_touch(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--benchmark-touch",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.benchmark_touch == 20);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--benchmark-touch=5",
+        "--no-control",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_record_transcode(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record=file.mp4",
+        "--record-transcode=av1",
+        "--record-transcode-quality=23",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.record_transcode);
+    assert(args.opts.record_transcode_codec == SC_CODEC_AV1);
+    assert(args.opts.record_transcode_quality == 23);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--record-transcode",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--record=file.mp4",
+        "--record-transcode",
+        "--record-stream",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
+static void test_record_upload(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record=file.mkv",
+        "--record-upload=https://s3.example.com/bucket/prefix",
+        "--record-upload-only",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(!strcmp(args.opts.record_upload_url,
+                   "https://s3.example.com/bucket/prefix"));
+    assert(args.opts.record_upload_only);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--record=file.mp4",
+        "--record-fragment-duration=0",
+        "--record-upload=https://s3.example.com/bucket",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--record-upload-only",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
+static void test_audio_volume(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    assert(args.opts.audio_volume == 100);
+
+    char *argv[] = {"scrcpy", "--audio-volume=50"};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.audio_volume == 50);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--audio-volume=401"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_new_display_follow_window(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--new-display=/240",
+        "--new-display-follow-window",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.new_display_follow_window);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--new-display-follow-window"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--new-display",
+        "--new-display-follow-window",
+        "--crop=100:100:0:0",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
+static void test_video_bit_rate_mode(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--video-bit-rate-mode=cq",
+        "--video-quality=80",
+        "--video-max-bit-rate=12M",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.video_bit_rate_mode == SC_VIDEO_BIT_RATE_MODE_CQ);
+    assert(args.opts.video_quality == 80);
+    assert(args.opts.video_max_bit_rate == 12000000);
+
+    // The quality target only applies to the cq mode
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--video-bit-rate-mode=vbr",
+                     "--video-quality=80"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {"scrcpy", "-b", "8M", "--video-max-bit-rate=4M"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv4[] = {"scrcpy", "--video-bit-rate-mode=abr"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv4), argv4);
+    assert(!ok);
+}
+
+static void test_match_refresh_rate(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {"scrcpy", "--max-fps=30", "--match-refresh-rate"};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.match_refresh_rate);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--match-refresh-rate"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {"scrcpy", "--max-fps=30", "--match-refresh-rate",
+                     "--new-display"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
+static void test_direct_tcp(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {"scrcpy", "--tcpip", "--direct-tcp"};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.direct_tcp_port == SC_DIRECT_TCP_PORT_DEFAULT);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--direct-tcp=1234"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(args.opts.direct_tcp_port == 1234);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {"scrcpy", "--direct-tcp=0"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv4[] = {"scrcpy", "--direct-tcp", "--tunnel-port=1234"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv4), argv4);
+    assert(!ok);
+}
+
+static void test_auto_tunnel(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {"scrcpy", "--auto-tunnel"};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.auto_tunnel);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--auto-tunnel", "--force-adb-forward"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    // --direct-tcp allows to select the direct TCP connection
+    char *argv3[] = {"scrcpy", "--auto-tunnel", "--direct-tcp"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(ok);
+    assert(args.opts.auto_tunnel);
+    assert(args.opts.direct_tcp_port == SC_DIRECT_TCP_PORT_DEFAULT);
+}
+
+#ifdef HAVE_USB
+static void test_adb_usb(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {"scrcpy", "--adb-usb", "--serial=0123456789abcdef"};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.adb_usb);
+    assert(!strcmp(args.opts.serial, "0123456789abcdef"));
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {"scrcpy", "--adb-usb", "--tcpip"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {"scrcpy", "--adb-usb", "--otg"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv4[] = {"scrcpy", "--adb-usb", "--kill-adb-on-close"};
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv4), argv4);
+    assert(!ok);
+}
+#endif
+
 static void test_parse_shortcut_mods(void) {
     uint8_t mods;
     bool ok;
@@ -149,6 +626,98 @@ static void test_parse_shortcut_mods(void) {
     assert(!ok);
 }
 
+static void test_parse_video_profile(void) {
+    struct sc_video_profile profile;
+    bool ok;
+
+    ok = sc_parse_video_profile("max-size=1024,bit-rate=2M,max-fps=15",
+                                &profile);
+    assert(ok);
+    assert(profile.max_size == 1024);
+    assert(profile.bit_rate == 2000000);
+    assert(profile.max_fps == 15);
+    assert(profile.crop.width == 0);
+
+    ok = sc_parse_video_profile("crop=800:600:100:200", &profile);
+    assert(ok);
+    assert(profile.max_size == 0);
+    assert(profile.bit_rate == 0);
+    assert(profile.max_fps == 0);
+    assert(profile.crop.width == 800);
+    assert(profile.crop.height == 600);
+    assert(profile.crop.x == 100);
+    assert(profile.crop.y == 200);
+
+    ok = sc_parse_video_profile("", &profile);
+    assert(!ok);
+
+    ok = sc_parse_video_profile("max-size=1024,", &profile);
+    assert(!ok);
+
+    ok = sc_parse_video_profile("unknown=1", &profile);
+    assert(!ok);
+
+    ok = sc_parse_video_profile("crop=800:600", &profile);
+    assert(!ok);
+}
+
+static void test_parse_thread_sched(void) {
+    struct sc_thread_sched sched[SC_THREAD_ROLE_COUNT] = {0};
+    bool ok;
+
+    ok = sc_parse_thread_affinity("video=0,2-3", sched);
+    assert(ok);
+    assert(sched[SC_THREAD_ROLE_VIDEO].cpus == 0xD);
+
+    ok = sc_parse_thread_affinity("recorder=63", sched);
+    assert(ok);
+    assert(sched[SC_THREAD_ROLE_RECORDER].cpus == UINT64_C(1) << 63);
+    assert(sched[SC_THREAD_ROLE_VIDEO].cpus == 0xD);
+
+    ok = sc_parse_thread_affinity("video=64", sched);
+    assert(!ok);
+
+    ok = sc_parse_thread_affinity("video=3-2", sched);
+    assert(!ok);
+
+    ok = sc_parse_thread_affinity("video=1,", sched);
+    assert(!ok);
+
+    ok = sc_parse_thread_affinity("display=1", sched);
+    assert(!ok);
+
+#ifdef _WIN32
+    ok = sc_parse_thread_policy("audio-callback=mmcss-pro-audio", sched);
+    assert(ok);
+    assert(sched[SC_THREAD_ROLE_AUDIO_CALLBACK].policy
+            == SC_THREAD_SCHED_POLICY_MMCSS_PRO_AUDIO);
+
+    ok = sc_parse_thread_policy("controller=fifo", sched);
+    assert(!ok);
+#else
+    ok = sc_parse_thread_policy("audio-callback=fifo:10", sched);
+    assert(ok);
+    assert(sched[SC_THREAD_ROLE_AUDIO_CALLBACK].policy
+            == SC_THREAD_SCHED_POLICY_FIFO);
+    assert(sched[SC_THREAD_ROLE_AUDIO_CALLBACK].priority == 10);
+
+    ok = sc_parse_thread_policy("controller=rr", sched);
+    assert(ok);
+    assert(sched[SC_THREAD_ROLE_CONTROLLER].policy
+            == SC_THREAD_SCHED_POLICY_RR);
+    assert(sched[SC_THREAD_ROLE_CONTROLLER].priority == 1);
+
+    ok = sc_parse_thread_policy("controller=rr:100", sched);
+    assert(!ok);
+
+    ok = sc_parse_thread_policy("controller=mmcss-games", sched);
+    assert(!ok);
+#endif
+
+    ok = sc_parse_thread_policy("controller=idle", sched);
+    assert(!ok);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -157,6 +726,23 @@ int main(int argc, char *argv[]) {
     test_flag_help();
     test_options();
     test_options2();
+    test_latency_profile();
+    test_power_saving();
+    test_soak();
+    test_benchmark_touch();
+    test_record_transcode();
+    test_record_upload();
+    test_audio_volume();
+    test_new_display_follow_window();
+    test_video_bit_rate_mode();
+    test_match_refresh_rate();
+    test_direct_tcp();
+    test_auto_tunnel();
+#ifdef HAVE_USB
+    test_adb_usb();
+#endif
     test_parse_shortcut_mods();
+    test_parse_video_profile();
+    test_parse_thread_sched();
     return 0;
 }
@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
 #include "control_msg.h"
 
 static void test_serialize_inject_keycode(void) {
@@ -113,6 +117,36 @@ static void test_serialize_inject_touch_event(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_inject_text_stream(void) {
+    char text[SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH + 1];
+    memset(text, 'a', SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH);
+    text[SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH] = '\0';
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM,
+        .inject_text = {
+            .text = text,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 5 + SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH);
+
+    uint8_t expected[5 + SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH];
+    expected[0] = SC_CONTROL_MSG_TYPE_INJECT_TEXT_STREAM;
+    expected[1] = 0x00;
+    expected[2] = 0x00;
+    expected[3] = 0x10;
+    expected[4] = 0x00; // 4096
+    memset(&expected[5], 'a', SC_CONTROL_MSG_TEXT_STREAM_CHUNK_MAX_LENGTH);
+
+    assert(!memcmp(buf, expected, sizeof(expected)));
+
+    // A text stream chunk must never be dropped
+    assert(!sc_control_msg_is_droppable(&msg));
+}
+
 static void test_serialize_inject_scroll_event(void) {
     struct sc_control_msg msg = {
         .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
@@ -255,6 +289,33 @@ static void test_serialize_set_clipboard(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_set_clipboard_by_hash(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+        .set_clipboard = {
+            .sequence = UINT64_C(0x0102030405060708),
+            .paste = false,
+            .text = "hello",
+            .by_hash = true,
+            .hash = UINT64_C(0xa430d84680aabd0b),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 22);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        0, // paste
+        0x40, 0x00, 0x00, 0x08, // hash flag | length
+        0xa4, 0x30, 0xd8, 0x46, 0x80, 0xaa, 0xbd, 0x0b, // hash
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+#ifndef HAVE_ZLIB
 static void test_serialize_set_clipboard_long(void) {
     struct sc_control_msg msg = {
         .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
@@ -288,6 +349,69 @@ static void test_serialize_set_clipboard_long(void) {
 
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
+#else
+static void test_serialize_set_clipboard_compressed(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+        .set_clipboard = {
+            .sequence = UINT64_C(0x0102030405060708),
+            .paste = true,
+            .text = NULL,
+        },
+    };
+
+    static char text[SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH + 1];
+    memset(text, 'a', SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+    text[SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH] = '\0';
+    msg.set_clipboard.text = text;
+
+    static uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size > 18);
+    assert(size < 10000); // highly compressible
+
+    const uint8_t expected_header[] = {
+        SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        1, // paste
+    };
+    assert(!memcmp(buf, expected_header, sizeof(expected_header)));
+
+    uint32_t value = (uint32_t) buf[10] << 24 | buf[11] << 16 | buf[12] << 8
+                   | buf[13];
+    assert(value & SC_CLIPBOARD_COMPRESSED_FLAG);
+    uint32_t payload_len = value & ~SC_CLIPBOARD_COMPRESSED_FLAG;
+    assert(payload_len == size - 14);
+
+    uint32_t uncompressed_len = (uint32_t) buf[14] << 24 | buf[15] << 16
+                              | buf[16] << 8 | buf[17];
+    assert(uncompressed_len == SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+
+    static char decompressed[SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH];
+    uLongf out_len = sizeof(decompressed);
+    int r = uncompress((Bytef *) decompressed, &out_len, &buf[18],
+                       payload_len - 4);
+    assert(r == Z_OK);
+    assert(out_len == SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+    assert(!memcmp(decompressed, text, out_len));
+}
+#endif
+
+static void test_serialize_fragment(void) {
+    const uint8_t data[] = {0x11, 0x22, 0x33};
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize_fragment(data, 3, true, buf);
+    assert(size == 7);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_FRAGMENT,
+        1, // last
+        0x00, 0x03, // length
+        0x11, 0x22, 0x33, // data
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
 
 static void test_serialize_set_display_power(void) {
     struct sc_control_msg msg = {
@@ -446,6 +570,651 @@ static void test_serialize_reset_video(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_get_clock(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_GET_CLOCK,
+        .get_clock = {
+            .timestamp = UINT64_C(0x0102030405060708),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_GET_CLOCK,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // timestamp
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_ping(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_PING,
+        .ping = {
+            .sequence = UINT64_C(0x0102030405060708),
+            .timestamp = UINT64_C(0x1112131415161718),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 17);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_PING,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, // timestamp
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_video_feedback(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+        .video_feedback = {
+            .receive_rate = 0x01020304,
+            .delay = 0x05060708,
+            .frames = 0x090A,
+            .skipped_frames = 0x0B0C,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 13);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+        0x01, 0x02, 0x03, 0x04, // receive rate
+        0x05, 0x06, 0x07, 0x08, // delay
+        0x09, 0x0A, // frames
+        0x0B, 0x0C, // skipped frames
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_request_keyframe(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME,
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 1);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME,
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_set_video_throttle(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE,
+        .set_video_throttle = {
+            .max_fps = 0x0102,
+            .paused = true,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 4);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_VIDEO_THROTTLE,
+        0x01, 0x02, // max fps
+        0x01, // paused
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+    assert(!sc_control_msg_is_droppable(&msg));
+}
+
+static void test_serialize_set_video_profile(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE,
+        .set_video_profile = {
+            .max_size = 0x0400,
+            .bit_rate = 0x001E8480,
+            .max_fps = 0x000F,
+            .crop = {
+                .width = 0x0320,
+                .height = 0x0258,
+                .x = 0x0064,
+                .y = 0x00C8,
+            },
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 17);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_VIDEO_PROFILE,
+        0x04, 0x00, // max size
+        0x00, 0x1E, 0x84, 0x80, // bit rate
+        0x00, 0x0F, // max fps
+        0x03, 0x20, 0x02, 0x58, // crop size
+        0x00, 0x64, 0x00, 0xC8, // crop offset
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+    assert(!sc_control_msg_is_droppable(&msg));
+}
+
+static void test_serialize_set_video_view_size(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE,
+        .set_video_view_size = {
+            .max_size = 0x0280,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 3);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_VIDEO_VIEW_SIZE,
+        0x02, 0x80, // max size
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+    assert(!sc_control_msg_is_droppable(&msg));
+}
+
+static void test_serialize_resize_display(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY,
+        .resize_display = {
+            .width = 0x0500,
+            .height = 0x02d0,
+            .dpi = 0x00f0,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 7);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY,
+        0x05, 0x00, // width
+        0x02, 0xd0, // height
+        0x00, 0xf0, // dpi
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+    assert(!sc_control_msg_is_droppable(&msg));
+}
+
+static void test_deserialize_input_events(void) {
+    struct sc_control_msg msgs[] = {
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE,
+            .inject_keycode = {
+                .action = AKEY_EVENT_ACTION_UP,
+                .keycode = AKEYCODE_ENTER,
+                .repeat = 5,
+                .metastate = AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+            .inject_text = {
+                .text = "hello, world!",
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+            .inject_touch_event = {
+                .action = AMOTION_EVENT_ACTION_MOVE,
+                .pointer_id = UINT64_C(-2),
+                .position = {
+                    .point = {.x = -100, .y = 200},
+                    .screen_size = {.width = 1080, .height = 1920},
+                },
+                .pressure = 0.5f,
+                .action_button = 0,
+                .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+            .inject_scroll_event = {
+                .position = {
+                    .point = {.x = 260, .y = 1026},
+                    .screen_size = {.width = 1080, .height = 1920},
+                },
+                .hscroll = 16,
+                .vscroll = -8,
+                .buttons = 1,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON,
+            .back_or_screen_on = {
+                .action = AKEY_EVENT_ACTION_DOWN,
+            },
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t len = 0;
+    for (size_t i = 0; i < ARRAY_LEN(msgs); ++i) {
+        len += sc_control_msg_serialize(&msgs[i], &buf[len]);
+    }
+
+    size_t head = 0;
+    struct sc_control_msg msg;
+
+    ssize_t r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 14);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_KEYCODE);
+    assert(msg.inject_keycode.action == AKEY_EVENT_ACTION_UP);
+    assert(msg.inject_keycode.keycode == AKEYCODE_ENTER);
+    assert(msg.inject_keycode.repeat == 5);
+    assert(msg.inject_keycode.metastate
+            == (AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON));
+
+    // Incomplete message
+    r = sc_control_msg_deserialize(&buf[head], 10, &msg);
+    assert(r == 0);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 18);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_TEXT);
+    assert(!strcmp(msg.inject_text.text, "hello, world!"));
+    sc_control_msg_destroy(&msg);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 32);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    assert(msg.inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE);
+    assert(msg.inject_touch_event.pointer_id == UINT64_C(-2));
+    assert(msg.inject_touch_event.position.point.x == -100);
+    assert(msg.inject_touch_event.position.point.y == 200);
+    assert(msg.inject_touch_event.position.screen_size.width == 1080);
+    assert(msg.inject_touch_event.position.screen_size.height == 1920);
+    assert(msg.inject_touch_event.pressure == 0.5f);
+    assert(msg.inject_touch_event.action_button == 0);
+    assert(msg.inject_touch_event.buttons == AMOTION_EVENT_BUTTON_PRIMARY);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 21);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT);
+    assert(msg.inject_scroll_event.position.point.x == 260);
+    assert(msg.inject_scroll_event.position.point.y == 1026);
+    assert(msg.inject_scroll_event.hscroll == 16);
+    assert(msg.inject_scroll_event.vscroll == -8);
+    assert(msg.inject_scroll_event.buttons == 1);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 2);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON);
+    assert(msg.back_or_screen_on.action == AKEY_EVENT_ACTION_DOWN);
+
+    assert(head == len);
+
+    // Generated internally, not supported
+    buf[0] = SC_CONTROL_MSG_TYPE_GET_CLOCK;
+    r = sc_control_msg_deserialize(buf, 9, &msg);
+    assert(r == -1);
+}
+
+static void test_deserialize_commands(void) {
+    struct sc_control_msg msgs[] = {
+        {
+            .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+            .set_clipboard = {
+                .sequence = UINT64_C(0x0102030405060708),
+                .text = "hello",
+                .paste = true,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_UHID_INPUT,
+            .uhid_input = {
+                .id = 42,
+                .size = 3,
+                .data = {1, 2, 3},
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_START_APP,
+            .start_app = {
+                .name = "firefox",
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER,
+            .set_display_power = {
+                .on = true,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_ROTATE_DEVICE,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t len = 0;
+    for (size_t i = 0; i < ARRAY_LEN(msgs); ++i) {
+        len += sc_control_msg_serialize(&msgs[i], &buf[len]);
+    }
+
+    size_t head = 0;
+    struct sc_control_msg msg;
+
+    ssize_t r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 19);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD);
+    assert(msg.set_clipboard.sequence == UINT64_C(0x0102030405060708));
+    assert(!strcmp(msg.set_clipboard.text, "hello"));
+    assert(msg.set_clipboard.paste);
+    sc_control_msg_destroy(&msg);
+
+    // Incomplete message
+    r = sc_control_msg_deserialize(&buf[head], 6, &msg);
+    assert(r == 0);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 8);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_UHID_INPUT);
+    assert(msg.uhid_input.id == 42);
+    assert(msg.uhid_input.size == 3);
+    assert(!memcmp(msg.uhid_input.data, "\1\2\3", 3));
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 9);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_START_APP);
+    assert(!strcmp(msg.start_app.name, "firefox"));
+    sc_control_msg_destroy(&msg);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 2);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER);
+    assert(msg.set_display_power.on);
+
+    r = sc_control_msg_deserialize(&buf[head], len - head, &msg);
+    assert(r == 1);
+    head += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_ROTATE_DEVICE);
+
+    assert(head == len);
+}
+
+static void test_serialize_inject_touch_batch(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+        .inject_touch_batch = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .action_button = 0,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            .pointer_id = UINT64_C(0x1234567887654321),
+            .screen_size = {
+                .width = 1080,
+                .height = 1920,
+            },
+            .count = 2,
+            .samples = {
+                {
+                    .point = {.x = 100, .y = 200},
+                    .pressure = 1.0f,
+                    .timestamp = SC_TICK_FROM_MS(1000),
+                },
+                {
+                    .point = {.x = 110, .y = 210},
+                    .pressure = 0.0f,
+                    .timestamp = SC_TICK_FROM_MS(1004),
+                },
+            },
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 59);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0x12, 0x34, 0x56, 0x78, 0x87, 0x65, 0x43, 0x21, // pointer id
+        0x04, 0x38, 0x07, 0x80, // 1080 1920
+        0x00, 0x00, 0x00, 0x00, // action button
+        0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x51, 0xE0, // last sample at 1004ms
+        0x02, // count
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8, // 100 200
+        0xff, 0xff, // pressure
+        0x00, 0x00, 0x0f, 0xa0, // 4000us before the last sample
+        0x00, 0x00, 0x00, 0x6e, 0x00, 0x00, 0x00, 0xd2, // 110 210
+        0x00, 0x00, // pressure
+        0x00, 0x00, 0x00, 0x00, // last sample
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_compact(void) {
+    struct sc_control_msg_compact_state state;
+    sc_control_msg_compact_state_init(&state);
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_DOWN,
+            .pointer_id = SC_POINTER_ID_MOUSE,
+            .position = {
+                .point = {
+                    .x = 100,
+                    .y = 200,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .pressure = 1.0f,
+            .action_button = AMOTION_EVENT_BUTTON_PRIMARY,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            .timestamp = SC_TICK_FROM_MS(1000),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize_compact(&msg, &state, buf);
+    assert(size == 26);
+
+    const uint8_t expected_down[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_COMPACT,
+        0x00, // slot 0, AMOTION_EVENT_ACTION_DOWN
+        0x1F, // all the fields are present
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // pointer id
+        0xB8, 0x08, 0x80, 0x0F, // 1080 1920 (varints)
+        0xC8, 0x01, 0x90, 0x03, // +100 +200 (zigzag varints)
+        0x80, 0x89, 0x7A, // +1000000us (zigzag varint)
+        0xFF, 0xFF, // pressure
+        0x01, // AMOTION_EVENT_BUTTON_PRIMARY (action button)
+        0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+    };
+    assert(!memcmp(buf, expected_down, sizeof(expected_down)));
+
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+    msg.inject_touch_event.position.point.x = 98;
+    msg.inject_touch_event.position.point.y = 203;
+    msg.inject_touch_event.action_button = 0;
+    msg.inject_touch_event.timestamp = SC_TICK_FROM_MS(1008);
+
+    size = sc_control_msg_serialize_compact(&msg, &state, buf);
+    assert(size == 8);
+
+    const uint8_t expected_move[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_COMPACT,
+        0x02, // slot 0, AMOTION_EVENT_ACTION_MOVE
+        0x08, // action button
+        0x03, 0x06, // -2 +3
+        0x80, 0x7D, // +8000us
+        0x00, // no action button
+    };
+    assert(!memcmp(buf, expected_move, sizeof(expected_move)));
+
+    msg.inject_touch_event.position.point.x = 99;
+    msg.inject_touch_event.timestamp = SC_TICK_FROM_MS(1016);
+
+    size = sc_control_msg_serialize_compact(&msg, &state, buf);
+    assert(size == 7);
+
+    const uint8_t expected_move2[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_COMPACT,
+        0x02, // slot 0, AMOTION_EVENT_ACTION_MOVE
+        0x00, // no field changed
+        0x02, 0x00, // +1 +0
+        0x80, 0x7D, // +8000us
+    };
+    assert(!memcmp(buf, expected_move2, sizeof(expected_move2)));
+
+    // Another pointer gets another slot
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_DOWN;
+    msg.inject_touch_event.pointer_id = 2;
+    msg.inject_touch_event.timestamp = SC_TICK_FROM_MS(1017);
+
+    size = sc_control_msg_serialize_compact(&msg, &state, buf);
+    assert(size == 20);
+    assert(buf[1] == 0x10); // slot 1, AMOTION_EVENT_ACTION_DOWN
+    assert(buf[2] == 0x15); // pointer id, pressure and buttons
+
+    struct sc_control_msg scroll = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+        .inject_scroll_event = {
+            .position = {
+                .point = {
+                    .x = 260,
+                    .y = 1026,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .hscroll = 0,
+            .vscroll = -16,
+            .buttons = 0,
+            .timestamp = SC_TICK_FROM_MS(1033),
+        },
+    };
+
+    size = sc_control_msg_serialize_compact(&scroll, &state, buf);
+    assert(size == 11);
+
+    const uint8_t expected_scroll[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_SCROLL_COMPACT,
+        0x40, // vscroll only (the screen size is unchanged)
+        0x88, 0x04, 0x84, 0x10, // +260 +1026
+        0x80, 0xFA, 0x01, // +16000us
+        0x80, 0x00, // -16 (float encoded as i16 in the range [-16, 16])
+    };
+    assert(!memcmp(buf, expected_scroll, sizeof(expected_scroll)));
+
+    // The other messages are serialized as usual
+    struct sc_control_msg keyframe = {
+        .type = SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME,
+    };
+    size = sc_control_msg_serialize_compact(&keyframe, &state, buf);
+    assert(size == 1);
+    assert(buf[0] == SC_CONTROL_MSG_TYPE_REQUEST_KEYFRAME);
+}
+
+static void test_merge_touch_move(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = 1,
+            .position = {
+                .point = {.x = 100, .y = 200},
+                .screen_size = {.width = 1080, .height = 1920},
+            },
+            .pressure = 1.0f,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+        },
+    };
+    struct sc_control_msg initial = prev;
+
+    struct sc_control_msg msg = prev;
+    msg.inject_touch_event.position.point.x = 110;
+
+    // Another pointer
+    msg.inject_touch_event.pointer_id = 2;
+    assert(!sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+    msg.inject_touch_event.pointer_id = 1;
+
+    // Other buttons
+    msg.inject_touch_event.buttons = 0;
+    assert(!sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+    msg.inject_touch_event.buttons = AMOTION_EVENT_BUTTON_PRIMARY;
+
+    // Another screen size
+    msg.inject_touch_event.position.screen_size.width = 1920;
+    assert(!sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+    msg.inject_touch_event.position.screen_size.width = 1080;
+
+    // Not a move
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    assert(!sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+    prev.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    assert(!sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+
+    // Unchanged on failure
+    prev.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+    assert(!memcmp(&prev, &initial, sizeof(prev)));
+
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+    assert(sc_control_msg_merge_touch(&prev, 1, &msg, 2));
+    assert(prev.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH);
+    assert(prev.inject_touch_batch.action == AMOTION_EVENT_ACTION_MOVE);
+    assert(prev.inject_touch_batch.pointer_id == 1);
+    assert(prev.inject_touch_batch.buttons == AMOTION_EVENT_BUTTON_PRIMARY);
+    assert(prev.inject_touch_batch.screen_size.width == 1080);
+    assert(prev.inject_touch_batch.screen_size.height == 1920);
+    assert(prev.inject_touch_batch.count == 2);
+    assert(prev.inject_touch_batch.samples[0].point.x == 100);
+    assert(prev.inject_touch_batch.samples[0].timestamp == 1);
+    assert(prev.inject_touch_batch.samples[1].point.x == 110);
+    assert(prev.inject_touch_batch.samples[1].timestamp == 2);
+
+    // Append to the batch until it is full
+    for (unsigned i = 2; i < SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES; ++i) {
+        msg.inject_touch_event.position.point.x = 100 + 10 * i;
+        assert(sc_control_msg_merge_touch(&prev, 0, &msg, 1 + i));
+        assert(prev.inject_touch_batch.count == i + 1);
+        assert(prev.inject_touch_batch.samples[i].point.x
+                == (int32_t) (100 + 10 * i));
+        assert(prev.inject_touch_batch.samples[i].timestamp == 1 + i);
+    }
+    assert(!sc_control_msg_merge_touch(&prev, 0, &msg, 100));
+
+    // Hover moves
+    struct sc_control_msg hover = initial;
+    hover.inject_touch_event.action = AMOTION_EVENT_ACTION_HOVER_MOVE;
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_HOVER_MOVE;
+    assert(sc_control_msg_merge_touch(&hover, 1, &msg, 2));
+    assert(hover.inject_touch_batch.action == AMOTION_EVENT_ACTION_HOVER_MOVE);
+
+    struct sc_control_msg other = {
+        .type = SC_CONTROL_MSG_TYPE_GET_CLOCK,
+    };
+    assert(!sc_control_msg_merge_touch(&other, 1, &msg, 2));
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -454,6 +1223,7 @@ int main(int argc, char *argv[]) {
     test_serialize_inject_text();
     test_serialize_inject_text_long();
     test_serialize_inject_touch_event();
+    test_serialize_inject_text_stream();
     test_serialize_inject_scroll_event();
     test_serialize_back_or_screen_on();
     test_serialize_expand_notification_panel();
@@ -461,7 +1231,13 @@ int main(int argc, char *argv[]) {
     test_serialize_collapse_panels();
     test_serialize_get_clipboard();
     test_serialize_set_clipboard();
+    test_serialize_set_clipboard_by_hash();
+#ifndef HAVE_ZLIB
     test_serialize_set_clipboard_long();
+#else
+    test_serialize_set_clipboard_compressed();
+#endif
+    test_serialize_fragment();
     test_serialize_set_display_power();
     test_serialize_rotate_device();
     test_serialize_uhid_create();
@@ -470,5 +1246,18 @@ int main(int argc, char *argv[]) {
     test_serialize_open_hard_keyboard();
     test_serialize_start_app();
     test_serialize_reset_video();
+    test_serialize_get_clock();
+    test_serialize_ping();
+    test_serialize_video_feedback();
+    test_serialize_request_keyframe();
+    test_serialize_set_video_throttle();
+    test_serialize_set_video_profile();
+    test_serialize_set_video_view_size();
+    test_serialize_resize_display();
+    test_serialize_inject_touch_batch();
+    test_serialize_compact();
+    test_merge_touch_move();
+    test_deserialize_input_events();
+    test_deserialize_commands();
     return 0;
 }
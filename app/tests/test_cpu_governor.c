@@ -0,0 +1,96 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "cpu_governor.h"
+
+// Push one sample per second, with the given usage (in percent of one core)
+static bool
+push(struct sc_cpu_governor *governor, sc_tick *date, sc_tick *cpu_time,
+     unsigned usage) {
+    *date += SC_TICK_FROM_SEC(1);
+    *cpu_time += SC_TICK_FROM_SEC(1) * usage / 100;
+    return sc_cpu_governor_push(governor, *date, *cpu_time);
+}
+
+static void test_degrade_and_restore(void) {
+    struct sc_cpu_governor governor;
+    sc_cpu_governor_init(&governor, 50, NULL);
+
+    sc_tick date = SC_TICK_FROM_SEC(100);
+    sc_tick cpu_time = SC_TICK_FROM_SEC(10);
+    // The first sample is the reference
+    assert(!sc_cpu_governor_push(&governor, date, cpu_time));
+
+    // Degrade one step every 2 samples over budget
+    assert(!push(&governor, &date, &cpu_time, 80));
+    assert(push(&governor, &date, &cpu_time, 80));
+    assert(governor.level == SC_CPU_LEVEL_SKIP_NONREF);
+    assert(!push(&governor, &date, &cpu_time, 80));
+    assert(push(&governor, &date, &cpu_time, 80));
+    assert(governor.level == SC_CPU_LEVEL_RENDER_RATE);
+
+    for (int i = 0; i < 10; ++i) {
+        push(&governor, &date, &cpu_time, 80);
+    }
+    assert(governor.level == SC_CPU_LEVEL_RESOLUTION);
+
+    // Within budget but without enough headroom: keep the level
+    for (int i = 0; i < 10; ++i) {
+        assert(!push(&governor, &date, &cpu_time, 40));
+    }
+    assert(governor.level == SC_CPU_LEVEL_RESOLUTION);
+
+    // Restore one step every 5 samples with headroom
+    for (int i = 0; i < 4; ++i) {
+        assert(!push(&governor, &date, &cpu_time, 20));
+    }
+    assert(push(&governor, &date, &cpu_time, 20));
+    assert(governor.level == SC_CPU_LEVEL_MAX_FPS);
+
+    for (int i = 0; i < 20; ++i) {
+        push(&governor, &date, &cpu_time, 20);
+    }
+    assert(governor.level == SC_CPU_LEVEL_NONE);
+}
+
+static void test_hysteresis(void) {
+    struct sc_cpu_governor governor;
+    sc_cpu_governor_init(&governor, 100, NULL);
+
+    sc_tick date = 0;
+    sc_tick cpu_time = 0;
+    sc_cpu_governor_push(&governor, date, cpu_time);
+
+    // Isolated peaks do not degrade
+    for (int i = 0; i < 10; ++i) {
+        assert(!push(&governor, &date, &cpu_time, 150));
+        assert(!push(&governor, &date, &cpu_time, 90));
+    }
+    assert(governor.level == SC_CPU_LEVEL_NONE);
+
+    push(&governor, &date, &cpu_time, 150);
+    push(&governor, &date, &cpu_time, 150);
+    assert(governor.level == SC_CPU_LEVEL_SKIP_NONREF);
+
+    // A sample over budget resets the headroom count
+    for (int i = 0; i < 4; ++i) {
+        assert(!push(&governor, &date, &cpu_time, 10));
+    }
+    assert(!push(&governor, &date, &cpu_time, 150));
+    for (int i = 0; i < 4; ++i) {
+        assert(!push(&governor, &date, &cpu_time, 10));
+    }
+    assert(push(&governor, &date, &cpu_time, 10));
+    assert(governor.level == SC_CPU_LEVEL_NONE);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_degrade_and_restore();
+    test_hysteresis();
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_cache.h"
+
+static void test_find(void) {
+    const char *content = "brand/a:14/X h264\tc2.a.avc.encoder\n"
+                          "brand/b:13/Y h264\tOMX.b.h264.encoder\r\n"
+                          "brand/b:13/Y h265\tOMX.b.hevc.encoder";
+
+    char *encoder = sc_device_cache_find(content, "brand/a:14/X h264");
+    assert(encoder);
+    assert(!strcmp(encoder, "c2.a.avc.encoder"));
+    free(encoder);
+
+    encoder = sc_device_cache_find(content, "brand/b:13/Y h264");
+    assert(encoder);
+    assert(!strcmp(encoder, "OMX.b.h264.encoder"));
+    free(encoder);
+
+    // Last line, without '\n'
+    encoder = sc_device_cache_find(content, "brand/b:13/Y h265");
+    assert(encoder);
+    assert(!strcmp(encoder, "OMX.b.hevc.encoder"));
+    free(encoder);
+
+    encoder = sc_device_cache_find(content, "brand/a:14/X h265");
+    assert(!encoder);
+
+    // A prefix of a key must not match
+    encoder = sc_device_cache_find(content, "brand/a:14/X");
+    assert(!encoder);
+
+    encoder = sc_device_cache_find("", "brand/a:14/X h264");
+    assert(!encoder);
+}
+
+static void test_update(void) {
+    char *content = sc_device_cache_update("", "a h264", "enc1");
+    assert(content);
+    assert(!strcmp(content, "a h264\tenc1\n"));
+
+    char *updated = sc_device_cache_update(content, "b h264", "enc2");
+    free(content);
+    assert(updated);
+    assert(!strcmp(updated, "a h264\tenc1\nb h264\tenc2\n"));
+
+    // Replace an existing entry
+    content = sc_device_cache_update(updated, "a h264", "enc3");
+    free(updated);
+    assert(content);
+    assert(!strcmp(content, "b h264\tenc2\na h264\tenc3\n"));
+
+    free(content);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_find();
+    test_update();
+    return 0;
+}
@@ -19,10 +19,11 @@ static void test_deserialize_clipboard(void) {
     assert(r == 8);
 
     assert(msg.type == DEVICE_MSG_TYPE_CLIPBOARD);
-    assert(msg.clipboard.text);
-    assert(!strcmp("ABC", msg.clipboard.text));
-
-    sc_device_msg_destroy(&msg);
+    assert(!msg.clipboard.compressed);
+    assert(msg.clipboard.length == 3);
+    // parsed in place
+    assert(msg.clipboard.text == (const char *) &input[5]);
+    assert(!memcmp("ABC", msg.clipboard.text, 3));
 }
 
 static void test_deserialize_clipboard_big(void) {
@@ -41,10 +42,27 @@ static void test_deserialize_clipboard_big(void) {
 
     assert(msg.type == DEVICE_MSG_TYPE_CLIPBOARD);
     assert(msg.clipboard.text);
-    assert(strlen(msg.clipboard.text) == DEVICE_MSG_TEXT_MAX_LENGTH);
+    assert(msg.clipboard.length == DEVICE_MSG_TEXT_MAX_LENGTH);
     assert(msg.clipboard.text[0] == 'a');
+}
+
+static void test_deserialize_clipboard_compressed(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_CLIPBOARD,
+        0x80, 0x00, 0x00, 0x07, // compressed flag + payload length
+        0x00, 0x00, 0x10, 0x00, // uncompressed length
+        0x01, 0x02, 0x03, // compressed data
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 12);
 
-    sc_device_msg_destroy(&msg);
+    assert(msg.type == DEVICE_MSG_TYPE_CLIPBOARD);
+    assert(msg.clipboard.compressed);
+    assert(msg.clipboard.uncompressed_length == 0x1000);
+    assert(msg.clipboard.length == 3);
+    assert(msg.clipboard.text == (const char *) &input[9]);
 }
 
 static void test_deserialize_ack_set_clipboard(void) {
@@ -79,8 +97,52 @@ static void test_deserialize_uhid_output(void) {
 
     uint8_t expected[] = {1, 2, 3, 4, 5};
     assert(!memcmp(msg.uhid_output.data, expected, sizeof(expected)));
+}
+
+static void test_deserialize_clock(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_CLOCK,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // timestamp
+        0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, // device timestamp
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 17);
+
+    assert(msg.type == DEVICE_MSG_TYPE_CLOCK);
+    assert(msg.clock.timestamp == UINT64_C(0x0102030405060708));
+    assert(msg.clock.device_timestamp == UINT64_C(0x1112131415161718));
+}
+
+static void test_deserialize_ack_ping(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_ACK_PING,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, // timestamp
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 17);
+
+    assert(msg.type == DEVICE_MSG_TYPE_ACK_PING);
+    assert(msg.ack_ping.sequence == UINT64_C(0x0102030405060708));
+    assert(msg.ack_ping.timestamp == UINT64_C(0x1112131415161718));
+}
+
+static void test_deserialize_video_idle(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_VIDEO_IDLE,
+        0x01, // idle
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 2);
 
-    sc_device_msg_destroy(&msg);
+    assert(msg.type == DEVICE_MSG_TYPE_VIDEO_IDLE);
+    assert(msg.video_idle.idle);
 }
 
 int main(int argc, char *argv[]) {
@@ -89,7 +151,11 @@ int main(int argc, char *argv[]) {
 
     test_deserialize_clipboard();
     test_deserialize_clipboard_big();
+    test_deserialize_clipboard_compressed();
     test_deserialize_ack_set_clipboard();
     test_deserialize_uhid_output();
+    test_deserialize_clock();
+    test_deserialize_ack_ping();
+    test_deserialize_video_idle();
     return 0;
 }
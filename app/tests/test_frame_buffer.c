@@ -0,0 +1,106 @@
+#include "common.h"
+
+#include <assert.h>
+#include <libavutil/frame.h>
+
+#include "frame_buffer.h"
+
+static AVFrame *
+create_frame(int64_t pts) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = 16;
+    frame->height = 16;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+
+    frame->pts = pts;
+    return frame;
+}
+
+static void test_frame_buffer_push_consume(void) {
+    struct sc_frame_buffer fb;
+    bool ok = sc_frame_buffer_init(&fb);
+    assert(ok);
+
+    AVFrame *frame = create_frame(1);
+    AVFrame *out = av_frame_alloc();
+    assert(out);
+
+    bool skipped;
+    ok = sc_frame_buffer_push(&fb, frame, &skipped);
+    assert(ok);
+    assert(!skipped);
+
+    sc_frame_buffer_consume(&fb, out);
+    assert(out->pts == 1);
+    assert(out->buf[0]);
+    av_frame_unref(out);
+
+    frame->pts = 2;
+    ok = sc_frame_buffer_push(&fb, frame, &skipped);
+    assert(ok);
+    assert(!skipped);
+
+    sc_frame_buffer_consume(&fb, out);
+    assert(out->pts == 2);
+    av_frame_unref(out);
+
+    av_frame_free(&out);
+    av_frame_free(&frame);
+    sc_frame_buffer_destroy(&fb);
+}
+
+static void test_frame_buffer_skip(void) {
+    struct sc_frame_buffer fb;
+    bool ok = sc_frame_buffer_init(&fb);
+    assert(ok);
+
+    AVFrame *frame = create_frame(1);
+    AVFrame *out = av_frame_alloc();
+    assert(out);
+
+    bool skipped;
+    ok = sc_frame_buffer_push(&fb, frame, &skipped);
+    assert(ok);
+    assert(!skipped);
+
+    // Push several frames without consuming them: only the last one is kept
+    for (int64_t pts = 2; pts <= 5; ++pts) {
+        frame->pts = pts;
+        ok = sc_frame_buffer_push(&fb, frame, &skipped);
+        assert(ok);
+        assert(skipped);
+    }
+
+    sc_frame_buffer_consume(&fb, out);
+    assert(out->pts == 5);
+    av_frame_unref(out);
+
+    // The last frame has been consumed, so the next one does not skip any
+    frame->pts = 6;
+    ok = sc_frame_buffer_push(&fb, frame, &skipped);
+    assert(ok);
+    assert(!skipped);
+
+    sc_frame_buffer_consume(&fb, out);
+    assert(out->pts == 6);
+    av_frame_unref(out);
+
+    av_frame_free(&out);
+    av_frame_free(&frame);
+    sc_frame_buffer_destroy(&fb);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_frame_buffer_push_consume();
+    test_frame_buffer_skip();
+
+    return 0;
+}
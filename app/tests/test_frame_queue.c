@@ -0,0 +1,199 @@
+#include "common.h"
+
+#include <assert.h>
+#include <libavutil/frame.h>
+
+#include "frame_queue.h"
+
+#define MAX_FRAMES 16
+
+struct test_sink {
+    struct sc_frame_sink frame_sink;
+
+    sc_mutex mutex;
+    sc_cond cond;
+    // The sink does not consume any frame while it is paused
+    bool paused;
+    // Number of pushes entered (including the one blocked while paused)
+    unsigned entered;
+    int64_t received[MAX_FRAMES];
+    unsigned count;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct test_sink, frame_sink)
+
+static bool
+test_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+test_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+test_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct test_sink *ts = DOWNCAST(sink);
+
+    sc_mutex_lock(&ts->mutex);
+    ++ts->entered;
+    sc_cond_broadcast(&ts->cond);
+    while (ts->paused) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    assert(ts->count < MAX_FRAMES);
+    ts->received[ts->count++] = frame->pts;
+    sc_cond_broadcast(&ts->cond);
+    sc_mutex_unlock(&ts->mutex);
+
+    return true;
+}
+
+static void
+test_sink_init(struct test_sink *ts) {
+    bool ok = sc_mutex_init(&ts->mutex);
+    assert(ok);
+    ok = sc_cond_init(&ts->cond);
+    assert(ok);
+    (void) ok;
+
+    ts->paused = true;
+    ts->entered = 0;
+    ts->count = 0;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = test_sink_open,
+        .close = test_sink_close,
+        .push = test_sink_push,
+    };
+    ts->frame_sink.ops = &ops;
+}
+
+static void
+test_sink_destroy(struct test_sink *ts) {
+    sc_cond_destroy(&ts->cond);
+    sc_mutex_destroy(&ts->mutex);
+}
+
+static void
+test_sink_wait_entered(struct test_sink *ts, unsigned entered) {
+    sc_mutex_lock(&ts->mutex);
+    while (ts->entered < entered) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    sc_mutex_unlock(&ts->mutex);
+}
+
+static void
+test_sink_resume_and_wait(struct test_sink *ts, unsigned count) {
+    sc_mutex_lock(&ts->mutex);
+    ts->paused = false;
+    sc_cond_broadcast(&ts->cond);
+    while (ts->count < count) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    sc_mutex_unlock(&ts->mutex);
+}
+
+static void
+push_frames(struct sc_frame_queue *fq, AVFrame *frame, int64_t first,
+            int64_t last) {
+    for (int64_t pts = first; pts <= last; ++pts) {
+        frame->pts = pts;
+        bool ok = fq->frame_sink.ops->push(&fq->frame_sink, frame);
+        assert(ok);
+        (void) ok;
+    }
+}
+
+static void
+test_frame_queue_policy(enum sc_frame_queue_policy policy, size_t capacity) {
+    struct test_sink ts;
+    test_sink_init(&ts);
+
+    struct sc_frame_queue fq;
+    bool ok = sc_frame_queue_init(&fq, "test", policy, capacity);
+    assert(ok);
+
+    ok = sc_frame_source_add_sink(&fq.frame_source, &ts.frame_sink);
+    assert(ok);
+
+    ok = fq.frame_sink.ops->open(&fq.frame_sink, NULL);
+    assert(ok);
+
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = 16;
+    frame->height = 16;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+
+    // The first frame is blocked in the (paused) sink
+    push_frames(&fq, frame, 0, 0);
+    test_sink_wait_entered(&ts, 1);
+
+    // The queue is now full
+    push_frames(&fq, frame, 1, capacity);
+
+    // For the BLOCK policy, pushing more frames would block
+    unsigned expected = capacity + 1;
+    if (policy != SC_FRAME_QUEUE_POLICY_BLOCK) {
+        // Drop the 3 oldest pending frames
+        push_frames(&fq, frame, capacity + 1, capacity + 3);
+    }
+
+    test_sink_resume_and_wait(&ts, expected);
+
+    assert(ts.received[0] == 0);
+    int64_t first = policy == SC_FRAME_QUEUE_POLICY_BLOCK ? 1 : 4;
+    for (unsigned i = 1; i < expected; ++i) {
+        assert(ts.received[i] == first + i - 1);
+    }
+
+    // The counters are final once the queue is closed
+    fq.frame_sink.ops->close(&fq.frame_sink);
+
+    struct sc_frame_queue_stats stats;
+    sc_frame_queue_get_stats(&fq, &stats);
+    assert(stats.forwarded == expected);
+    assert(stats.blocked == 0);
+    if (policy == SC_FRAME_QUEUE_POLICY_BLOCK) {
+        assert(stats.pushed == expected);
+        assert(stats.dropped == 0);
+    } else {
+        assert(stats.pushed == expected + 3);
+        assert(stats.dropped == 3);
+    }
+
+    av_frame_free(&frame);
+    sc_frame_queue_destroy(&fq);
+    test_sink_destroy(&ts);
+}
+
+static void test_frame_queue_latest(void) {
+    test_frame_queue_policy(SC_FRAME_QUEUE_POLICY_LATEST, 1);
+}
+
+static void test_frame_queue_drop_oldest(void) {
+    test_frame_queue_policy(SC_FRAME_QUEUE_POLICY_DROP_OLDEST, 4);
+}
+
+static void test_frame_queue_block(void) {
+    test_frame_queue_policy(SC_FRAME_QUEUE_POLICY_BLOCK, 4);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_frame_queue_latest();
+    test_frame_queue_drop_oldest();
+    test_frame_queue_block();
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "common.h"
+
+#include <assert.h>
+#include <libavcodec/packet.h>
+
+#include "gop_cache.h"
+
+static AVPacket *
+create_packet(int64_t pts, int size, bool keyframe) {
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    int r = av_new_packet(packet, size);
+    assert(!r);
+    (void) r;
+
+    packet->pts = pts;
+    if (keyframe) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+    return packet;
+}
+
+static void
+push(struct sc_gop_cache *cache, int64_t pts, int size, bool keyframe) {
+    AVPacket *packet = create_packet(pts, size, keyframe);
+    sc_gop_cache_push(cache, packet);
+    av_packet_free(&packet);
+}
+
+static void test_gop_cache(void) {
+    struct sc_gop_cache cache;
+    sc_gop_cache_init(&cache);
+
+    // The packets before the first keyframe are not cached
+    push(&cache, 1, 100, false);
+    assert(sc_gop_cache_is_empty(&cache));
+
+    push(&cache, 2, 1000, true);
+    push(&cache, 3, 100, false);
+    push(&cache, 4, 100, false);
+    assert(cache.packets.size == 3);
+    assert(cache.packets.data[0]->pts == 2);
+    assert(cache.packets.data[2]->pts == 4);
+    // The whole buffers are counted (including the padding)
+    assert(cache.bytes == 1200 + 3 * AV_INPUT_BUFFER_PADDING_SIZE);
+
+    // A keyframe starts a new GOP
+    push(&cache, 5, 1000, true);
+    push(&cache, 6, 100, false);
+    assert(cache.packets.size == 2);
+    assert(cache.packets.data[0]->pts == 5);
+    assert(cache.bytes == 1100 + 2 * AV_INPUT_BUFFER_PADDING_SIZE);
+
+    sc_gop_cache_destroy(&cache);
+}
+
+static void test_gop_cache_overflow(void) {
+    struct sc_gop_cache cache;
+    sc_gop_cache_init(&cache);
+
+    push(&cache, 0, 100, true);
+    for (int64_t pts = 1; pts < SC_GOP_CACHE_MAX_PACKETS; ++pts) {
+        push(&cache, pts, 1, false);
+    }
+    assert(cache.packets.size == SC_GOP_CACHE_MAX_PACKETS);
+
+    // Too many packets: the GOP is dropped until the next keyframe
+    push(&cache, SC_GOP_CACHE_MAX_PACKETS, 1, false);
+    assert(sc_gop_cache_is_empty(&cache));
+    push(&cache, SC_GOP_CACHE_MAX_PACKETS + 1, 1, false);
+    assert(sc_gop_cache_is_empty(&cache));
+
+    push(&cache, SC_GOP_CACHE_MAX_PACKETS + 2, 100, true);
+    assert(cache.packets.size == 1);
+
+    // Too many bytes
+    push(&cache, SC_GOP_CACHE_MAX_PACKETS + 3, SC_GOP_CACHE_MAX_BYTES, false);
+    assert(sc_gop_cache_is_empty(&cache));
+
+    sc_gop_cache_destroy(&cache);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_gop_cache();
+    test_gop_cache_overflow();
+
+    return 0;
+}
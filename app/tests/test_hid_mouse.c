@@ -0,0 +1,68 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "hid/hid_mouse.h"
+
+static struct sc_hid_input
+mouse_input(uint8_t buttons, int8_t x, int8_t y, int8_t vscroll) {
+    struct sc_hid_input input = {
+        .hid_id = SC_HID_ID_MOUSE,
+        .size = 5,
+    };
+    input.data[0] = buttons;
+    input.data[1] = x;
+    input.data[2] = y;
+    input.data[3] = vscroll;
+    input.data[4] = 0;
+    return input;
+}
+
+static void test_merge_motion(void) {
+    struct sc_hid_input prev = mouse_input(1, 10, -20, 0);
+    struct sc_hid_input input = mouse_input(1, 5, -7, 0);
+
+    assert(sc_hid_mouse_merge_input(&prev, &input));
+    assert(prev.data[0] == 1);
+    assert((int8_t) prev.data[1] == 15);
+    assert((int8_t) prev.data[2] == -27);
+    assert(prev.data[3] == 0);
+    assert(prev.data[4] == 0);
+}
+
+static void test_merge_rejected(void) {
+    struct sc_hid_input prev = mouse_input(1, 10, -20, 0);
+    struct sc_hid_input initial = prev;
+
+    // Other buttons state
+    struct sc_hid_input input = mouse_input(0, 5, 5, 0);
+    assert(!sc_hid_mouse_merge_input(&prev, &input));
+
+    // Scrolling
+    input = mouse_input(1, 0, 0, 1);
+    assert(!sc_hid_mouse_merge_input(&prev, &input));
+
+    // Overflow
+    input = mouse_input(1, 120, 0, 0);
+    assert(!sc_hid_mouse_merge_input(&prev, &input));
+    input = mouse_input(1, 0, -120, 0);
+    assert(!sc_hid_mouse_merge_input(&prev, &input));
+
+    // Not a mouse
+    input = mouse_input(1, 5, 5, 0);
+    input.hid_id = SC_HID_ID_MOUSE + 1;
+    assert(!sc_hid_mouse_merge_input(&prev, &input));
+
+    // prev is left untouched
+    assert(!memcmp(&prev, &initial, sizeof(prev)));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_merge_motion();
+    test_merge_rejected();
+    return 0;
+}
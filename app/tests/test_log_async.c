@@ -0,0 +1,170 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL_log.h>
+
+#include "util/log_async.h"
+#include "util/thread.h"
+
+#define PRODUCERS 4
+#define MESSAGES_PER_PRODUCER 50000
+#define LONG_MESSAGE_INTERVAL 1000
+#define LONG_MESSAGE_LEN 1000
+
+// Only called by the writer thread, except for errors when the ring is full
+static struct {
+    sc_mutex mutex;
+    unsigned next[PRODUCERS]; // next expected message index per producer
+    unsigned received;
+    unsigned long_received;
+    unsigned dropped;
+    unsigned errors;
+    unsigned last_error;
+} output;
+
+static char long_message[LONG_MESSAGE_LEN + 1];
+
+static void SDLCALL
+test_output(void *userdata, int category, SDL_LogPriority priority,
+            const char *message) {
+    (void) userdata;
+    (void) category;
+
+    sc_mutex_lock(&output.mutex);
+
+    unsigned producer;
+    unsigned index;
+    unsigned count;
+    if (sscanf(message, "%u log messages dropped", &count) == 1) {
+        output.dropped += count;
+    } else if (message[0] == 'L') {
+        // Never truncated nor interleaved with another message
+        assert(!strcmp(message, long_message));
+        ++output.long_received;
+    } else if (sscanf(message, "error %u", &index) == 1) {
+        assert(priority == SDL_LOG_PRIORITY_ERROR);
+        output.last_error = index;
+        ++output.errors;
+    } else {
+        int r = sscanf(message, "p%u m%u", &producer, &index);
+        assert(r == 2);
+        assert(producer < PRODUCERS);
+        // The messages of a producer are written in order (some may be
+        // dropped)
+        assert(index >= output.next[producer]);
+        output.next[producer] = index + 1;
+        ++output.received;
+    }
+
+    sc_mutex_unlock(&output.mutex);
+}
+
+static void
+reset_output(void) {
+    memset(output.next, 0, sizeof(output.next));
+    output.received = 0;
+    output.long_received = 0;
+    output.dropped = 0;
+    output.errors = 0;
+    output.last_error = 0;
+}
+
+static int
+run_producer(void *data) {
+    unsigned producer = (unsigned) (uintptr_t) data;
+    for (unsigned i = 0; i < MESSAGES_PER_PRODUCER; ++i) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "p%u m%u", producer, i);
+        if (i % LONG_MESSAGE_INTERVAL == 0) {
+            // Split into several records
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "%s", long_message);
+        }
+    }
+    return 0;
+}
+
+static void test_concurrent_producers(void) {
+    reset_output();
+
+    bool ok = sc_log_async_start();
+    assert(ok);
+
+    sc_thread threads[PRODUCERS];
+    for (unsigned i = 0; i < PRODUCERS; ++i) {
+        ok = sc_thread_create(&threads[i], run_producer, "test-producer",
+                              (void *) (uintptr_t) i);
+        assert(ok);
+    }
+
+    for (unsigned i = 0; i < PRODUCERS; ++i) {
+        sc_thread_join(&threads[i], NULL);
+    }
+
+    sc_log_async_stop();
+
+    unsigned long_count = PRODUCERS
+                        * (MESSAGES_PER_PRODUCER / LONG_MESSAGE_INTERVAL);
+    unsigned total = PRODUCERS * MESSAGES_PER_PRODUCER + long_count;
+    // Every message is either written or reported as dropped
+    assert(output.received + output.long_received + output.dropped == total);
+}
+
+static int
+run_error_producer(void *data) {
+    (void) data;
+    for (unsigned i = 1; i <= 1000; ++i) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "error %u", i);
+
+        // Written before SDL_LogError() returns
+        sc_mutex_lock(&output.mutex);
+        assert(output.last_error == i);
+        sc_mutex_unlock(&output.mutex);
+    }
+    return 0;
+}
+
+static void test_errors_written_immediately(void) {
+    reset_output();
+
+    bool ok = sc_log_async_start();
+    assert(ok);
+
+    sc_thread threads[2];
+    ok = sc_thread_create(&threads[0], run_producer, "test-producer",
+                          (void *) (uintptr_t) 0);
+    assert(ok);
+    ok = sc_thread_create(&threads[1], run_error_producer,
+                          "test-error-producer", NULL);
+    assert(ok);
+
+    sc_thread_join(&threads[0], NULL);
+    sc_thread_join(&threads[1], NULL);
+
+    sc_log_async_stop();
+
+    // Errors are never dropped
+    assert(output.errors == 1000);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    SC_MAIN_THREAD_ID = sc_thread_get_id();
+
+    long_message[0] = 'L';
+    memset(&long_message[1], 'x', LONG_MESSAGE_LEN - 1);
+
+    bool ok = sc_mutex_init(&output.mutex);
+    assert(ok);
+
+    SDL_LogSetAllPriority(SDL_LOG_PRIORITY_VERBOSE);
+    SDL_LogSetOutputFunction(test_output, NULL);
+
+    test_concurrent_producers();
+    test_errors_written_immediately();
+
+    sc_mutex_destroy(&output.mutex);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/metrics.h"
+
+static const int64_t bounds[] = {10, 100};
+
+static void test_metrics_null(void) {
+    // The metrics are disabled
+    struct sc_metric *m = sc_metrics_register_counter(NULL, "test", "Test");
+    assert(!m);
+
+    // Must not crash
+    sc_metric_inc(m);
+    sc_metric_set(m, 42);
+    sc_metric_observe(m, 42);
+}
+
+static void test_metrics_json(void) {
+    struct sc_metrics metrics;
+    sc_metrics_init(&metrics);
+
+    struct sc_metric *counter =
+        sc_metrics_register_counter(&metrics, "test_total", "Counter");
+    struct sc_metric *gauge =
+        sc_metrics_register_gauge(&metrics, "test_gauge", "Gauge");
+    struct sc_metric *histogram =
+        sc_metrics_register_histogram(&metrics, "test_us", "Histogram",
+                                      bounds, ARRAY_LEN(bounds));
+    assert(counter && gauge && histogram);
+
+    sc_metric_inc(counter);
+    sc_metric_add(counter, 4);
+    sc_metric_set(gauge, 7);
+    sc_metric_set(gauge, -3);
+    sc_metric_observe(histogram, 10);
+    sc_metric_observe(histogram, 50);
+    sc_metric_observe(histogram, 1000);
+
+    struct sc_strbuf buf;
+    bool ok = sc_strbuf_init(&buf, 16);
+    assert(ok);
+
+    ok = sc_metrics_format_json(&metrics, &buf, 1234);
+    assert(ok);
+
+    const char *expected =
+        "{\"timestamp\":1234,\"test_total\":5,\"test_gauge\":-3,"
+        "\"test_us\":{\"count\":3,\"sum\":1060,"
+        "\"buckets\":{\"10\":1,\"100\":2,\"+Inf\":3}}}";
+    assert(!strcmp(buf.s, expected));
+
+    free(buf.s);
+}
+
+static void test_metrics_prometheus(void) {
+    struct sc_metrics metrics;
+    sc_metrics_init(&metrics);
+
+    struct sc_metric *counter =
+        sc_metrics_register_counter(&metrics, "test_total", "Counter");
+    struct sc_metric *histogram =
+        sc_metrics_register_histogram(&metrics, "test_us", "Histogram",
+                                      bounds, ARRAY_LEN(bounds));
+
+    sc_metric_add(counter, 2);
+    sc_metric_observe(histogram, 5);
+    sc_metric_observe(histogram, 200);
+
+    struct sc_strbuf buf;
+    bool ok = sc_strbuf_init(&buf, 16);
+    assert(ok);
+
+    ok = sc_metrics_format_prometheus(&metrics, &buf);
+    assert(ok);
+
+    const char *expected =
+        "# HELP test_total Counter\n"
+        "# TYPE test_total counter\n"
+        "test_total 2\n"
+        "# HELP test_us Histogram\n"
+        "# TYPE test_us histogram\n"
+        "test_us_bucket{le=\"10\"} 1\n"
+        "test_us_bucket{le=\"100\"} 1\n"
+        "test_us_bucket{le=\"+Inf\"} 2\n"
+        "test_us_sum 205\n"
+        "test_us_count 2\n";
+    assert(!strcmp(buf.s, expected));
+
+    free(buf.s);
+}
+
+static void test_metrics_memory(void) {
+    struct sc_metrics metrics;
+    sc_metrics_init(&metrics);
+
+    struct sc_metric *bytes =
+        sc_metrics_register_gauge(&metrics, "test_bytes", "Bytes");
+    struct sc_metric *frames =
+        sc_metrics_register_gauge(&metrics, "test_frames", "Frames");
+    struct sc_metric *other =
+        sc_metrics_register_gauge(&metrics, "test_gauge", "Gauge");
+    struct sc_metric *counter =
+        sc_metrics_register_counter(&metrics, "test_total_bytes", "Counter");
+
+    sc_metric_set(bytes, 4096);
+    sc_metric_set(frames, 3);
+    sc_metric_set(other, 7);
+    sc_metric_add(counter, 42);
+
+    struct sc_strbuf buf;
+    bool ok = sc_strbuf_init(&buf, 16);
+    assert(ok);
+
+    ok = sc_metrics_format_memory(&metrics, &buf);
+    assert(ok);
+
+    assert(!strcmp(buf.s, "test_bytes: 4096\ntest_frames: 3\n"));
+
+    free(buf.s);
+}
+
+static void test_metrics_full(void) {
+    struct sc_metrics metrics;
+    sc_metrics_init(&metrics);
+
+    for (unsigned i = 0; i < SC_METRICS_CAPACITY; ++i) {
+        struct sc_metric *m =
+            sc_metrics_register_counter(&metrics, "test", "Test");
+        assert(m);
+    }
+
+    struct sc_metric *m = sc_metrics_register_counter(&metrics, "test", "Test");
+    assert(!m);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_metrics_null();
+    test_metrics_json();
+    test_metrics_prometheus();
+    test_metrics_memory();
+    test_metrics_full();
+
+    return 0;
+}
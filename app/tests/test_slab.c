@@ -0,0 +1,71 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/slab.h"
+
+static void test_slab_alloc_free(void) {
+    struct sc_slab slab;
+    bool ok = sc_slab_init(&slab, 16, 3);
+    assert(ok);
+
+    char *a = sc_slab_alloc(&slab);
+    char *b = sc_slab_alloc(&slab);
+    char *c = sc_slab_alloc(&slab);
+    assert(a && b && c);
+    assert(a != b && b != c && a != c);
+    assert(sc_slab_owns(&slab, a));
+    assert(sc_slab_owns(&slab, b));
+    assert(sc_slab_owns(&slab, c));
+
+    // The blocks do not overlap
+    memset(a, 'a', 16);
+    memset(b, 'b', 16);
+    memset(c, 'c', 16);
+    assert(a[15] == 'a' && b[15] == 'b' && c[15] == 'c');
+
+    // exhausted
+    assert(!sc_slab_alloc(&slab));
+
+    sc_slab_free(&slab, b);
+    char *d = sc_slab_alloc(&slab);
+    assert(d == b);
+    assert(!sc_slab_alloc(&slab));
+
+    sc_slab_free(&slab, a);
+    sc_slab_free(&slab, c);
+    sc_slab_free(&slab, d);
+
+    for (int i = 0; i < 3; ++i) {
+        assert(sc_slab_alloc(&slab));
+    }
+    assert(!sc_slab_alloc(&slab));
+
+    sc_slab_destroy(&slab);
+}
+
+static void test_slab_owns(void) {
+    struct sc_slab slab;
+    bool ok = sc_slab_init(&slab, 8, 2);
+    assert(ok);
+
+    char other[8];
+    assert(!sc_slab_owns(&slab, other));
+
+    char *a = sc_slab_alloc(&slab);
+    assert(sc_slab_owns(&slab, a));
+    assert(sc_slab_owns(&slab, a + 7));
+
+    sc_slab_destroy(&slab);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_slab_alloc_free();
+    test_slab_owns();
+
+    return 0;
+}
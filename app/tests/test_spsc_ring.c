@@ -0,0 +1,92 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "util/spsc_ring.h"
+
+struct sc_ring_int SC_SPSC_RING(int);
+
+static void test_spsc_ring_simple(void) {
+    struct sc_ring_int ring;
+
+    bool ok = sc_spsc_ring_init(&ring, 3);
+    assert(ok);
+    // Rounded up to a power of 2
+    assert(sc_spsc_ring_capacity(&ring) == 4);
+
+    assert(sc_spsc_ring_is_empty(&ring));
+
+    int v;
+    ok = sc_spsc_ring_pop(&ring, &v);
+    assert(!ok);
+
+    for (int i = 0; i < 4; ++i) {
+        ok = sc_spsc_ring_push(&ring, i);
+        assert(ok);
+    }
+    assert(sc_spsc_ring_size(&ring) == 4);
+
+    // full
+    ok = sc_spsc_ring_push(&ring, 42);
+    assert(!ok);
+
+    ok = sc_spsc_ring_pop(&ring, &v);
+    assert(ok);
+    assert(v == 0);
+
+    ok = sc_spsc_ring_push(&ring, 4);
+    assert(ok);
+
+    for (int i = 1; i < 5; ++i) {
+        ok = sc_spsc_ring_pop(&ring, &v);
+        assert(ok);
+        assert(v == i);
+    }
+
+    assert(sc_spsc_ring_is_empty(&ring));
+    ok = sc_spsc_ring_pop(&ring, &v);
+    assert(!ok);
+
+    sc_spsc_ring_destroy(&ring);
+}
+
+static void test_spsc_ring_wrap(void) {
+    struct sc_ring_int ring;
+
+    bool ok = sc_spsc_ring_init(&ring, 4);
+    assert(ok);
+
+    // Make the cursors overflow
+    atomic_store(&ring.head, UINT32_MAX - 5);
+    atomic_store(&ring.tail, UINT32_MAX - 5);
+
+    for (int i = 0; i < 100; ++i) {
+        ok = sc_spsc_ring_push(&ring, i);
+        assert(ok);
+        ok = sc_spsc_ring_push(&ring, i + 1000);
+        assert(ok);
+        assert(sc_spsc_ring_size(&ring) == 2);
+
+        int v;
+        ok = sc_spsc_ring_pop(&ring, &v);
+        assert(ok);
+        assert(v == i);
+        ok = sc_spsc_ring_pop(&ring, &v);
+        assert(ok);
+        assert(v == i + 1000);
+    }
+
+    assert(sc_spsc_ring_is_empty(&ring));
+
+    sc_spsc_ring_destroy(&ring);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_spsc_ring_simple();
+    test_spsc_ring_wrap();
+
+    return 0;
+}
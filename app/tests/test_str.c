@@ -182,6 +182,13 @@ static void test_utf8_truncate(void) {
     assert(count == 7); // no more chars
 }
 
+static void test_hash(void) {
+    assert(sc_str_hash("", 0) == UINT64_C(0xcbf29ce484222325));
+    assert(sc_str_hash("hello", 5) == UINT64_C(0xa430d84680aabd0b));
+    // Only the first len bytes are hashed
+    assert(sc_str_hash("hello, world", 5) == UINT64_C(0xa430d84680aabd0b));
+}
+
 static void test_parse_integer(void) {
     long value;
     bool ok = sc_str_parse_integer("1234", &value);
@@ -401,6 +408,7 @@ int main(int argc, char *argv[]) {
     test_quote();
     test_concat();
     test_utf8_truncate();
+    test_hash();
     test_parse_integer();
     test_parse_integers();
     test_parse_integer_with_suffix();
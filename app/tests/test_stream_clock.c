@@ -0,0 +1,103 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "stream_clock.h"
+
+// Pseudo-random network jitter, between 0 and 20ms
+static sc_tick
+jitter(unsigned *state) {
+    *state = *state * 1103515245 + 12345;
+    return SC_TICK_FROM_US((*state >> 8) % 20000);
+}
+
+#define DURATION 150 // seconds
+
+// Feed 60 packets per second, received with a constant transit time (plus
+// jitter) from a device clock running slower by 50 ppm
+static void
+feed(struct sc_stream_clock *clock, enum sc_stream_clock_source source,
+     sc_tick transit, bool stall) {
+    unsigned state = 42;
+    for (int i = 0; i < 60 * DURATION; ++i) {
+        sc_tick system = SC_TICK_FROM_SEC(1000) + i * SC_TICK_FROM_US(16667);
+        sc_tick pts = (system - SC_TICK_FROM_SEC(1000)) * 999950 / 1000000;
+        sc_tick delay = transit + jitter(&state);
+        if (stall && i >= 60 * 100 && i < 60 * 102) {
+            // 2 seconds of backlog
+            delay += SC_TICK_FROM_SEC(2) - (i - 60 * 100) * SC_TICK_FROM_MS(16);
+        }
+        sc_stream_clock_update(clock, source, system + delay, pts);
+    }
+}
+
+static void test_drift(void) {
+    struct sc_stream_clock clock;
+    bool ok = sc_stream_clock_init(&clock);
+    assert(ok);
+
+    feed(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO, SC_TICK_FROM_MS(10), true);
+    feed(&clock, SC_STREAM_CLOCK_SOURCE_AUDIO, SC_TICK_FROM_MS(80), false);
+
+    double drift = sc_stream_clock_get_drift_ppm(&clock);
+    assert(drift > 45 && drift < 55);
+    (void) drift;
+
+    sc_stream_clock_destroy(&clock);
+}
+
+static void test_lag(void) {
+    struct sc_stream_clock clock;
+    bool ok = sc_stream_clock_init(&clock);
+    assert(ok);
+
+    sc_tick pts = SC_TICK_FROM_SEC(5);
+    sc_tick system;
+    ok = sc_stream_clock_to_system_time(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO,
+                                        pts, &system);
+    assert(!ok);
+    assert(!sc_stream_clock_get_lag(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO,
+                                    SC_TICK_FROM_SEC(1000), pts));
+
+    feed(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO, SC_TICK_FROM_MS(10), true);
+    feed(&clock, SC_STREAM_CLOCK_SOURCE_AUDIO, SC_TICK_FROM_MS(80), false);
+
+    // The packet following the last one fed (the device clock is 7.5ms late
+    // after 150s)
+    pts = SC_TICK_FROM_SEC(DURATION) - SC_TICK_FROM_US(7500);
+    sc_tick expected = SC_TICK_FROM_SEC(1000 + DURATION) + SC_TICK_FROM_MS(10);
+
+    ok = sc_stream_clock_to_system_time(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO,
+                                        pts, &system);
+    assert(ok);
+    assert(system > expected - SC_TICK_FROM_MS(3));
+    assert(system < expected + SC_TICK_FROM_MS(3));
+
+    sc_tick lag = sc_stream_clock_get_lag(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO,
+                                          expected + SC_TICK_FROM_MS(500),
+                                          pts);
+    assert(lag > SC_TICK_FROM_MS(497) && lag < SC_TICK_FROM_MS(503));
+
+    // The audio stream has its own offset
+    lag = sc_stream_clock_get_lag(&clock, SC_STREAM_CLOCK_SOURCE_AUDIO,
+                                  expected + SC_TICK_FROM_MS(70), pts);
+    assert(lag > -SC_TICK_FROM_MS(3) && lag < SC_TICK_FROM_MS(3));
+
+    sc_stream_clock_reset(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO);
+    ok = sc_stream_clock_to_system_time(&clock, SC_STREAM_CLOCK_SOURCE_VIDEO,
+                                        pts, &system);
+    assert(!ok);
+    (void) lag;
+
+    sc_stream_clock_destroy(&clock);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_drift();
+    test_lag();
+
+    return 0;
+}
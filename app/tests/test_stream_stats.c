@@ -0,0 +1,50 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "stream_stats.h"
+
+static void test_packets(void) {
+    struct sc_stream_stats stats;
+    sc_stream_stats_init(&stats);
+
+    sc_stream_stats_add_packet(&stats, 30, true, false);
+    sc_stream_stats_add_packet(&stats, 50000, false, true);
+    sc_stream_stats_add_packet(&stats, 2000, false, false);
+    sc_stream_stats_add_packet(&stats, 80000, false, true);
+    sc_stream_stats_add_packet(&stats, 60000, false, true);
+
+    assert(sc_stream_stats_get_bytes(&stats) == 192030);
+    assert(atomic_load(&stats.packets) == 5);
+    assert(atomic_load(&stats.config_packets) == 1);
+    assert(atomic_load(&stats.keyframes) == 3);
+    assert(atomic_load(&stats.keyframe_bytes) == 190000);
+
+    assert(sc_stream_stats_take_max_keyframe_size(&stats) == 80000);
+    assert(sc_stream_stats_take_max_keyframe_size(&stats) == 0);
+
+    sc_stream_stats_add_packet(&stats, 1000, false, false);
+    assert(sc_stream_stats_take_max_keyframe_size(&stats) == 0);
+    sc_stream_stats_add_packet(&stats, 40000, false, true);
+    assert(sc_stream_stats_take_max_keyframe_size(&stats) == 40000);
+}
+
+static void test_kbps(void) {
+    // 1 MB in 1 second
+    assert(sc_stream_stats_to_kbps(1000000, SC_TICK_FROM_SEC(1)) == 8000);
+    // 1 MB in 2 seconds
+    assert(sc_stream_stats_to_kbps(1000000, SC_TICK_FROM_SEC(2)) == 4000);
+    // rounded to the nearest integer
+    assert(sc_stream_stats_to_kbps(1000, SC_TICK_FROM_MS(1500)) == 5);
+    assert(sc_stream_stats_to_kbps(0, SC_TICK_FROM_SEC(1)) == 0);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_packets();
+    test_kbps();
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "trend.h"
+
+// Deterministic noise in [-amplitude, amplitude]
+static double
+noise(unsigned *state, double amplitude) {
+    *state = *state * 1103515245 + 12345;
+    double r = (double) ((*state >> 16) & 0x7FFF) / 0x7FFF;
+    return (2 * r - 1) * amplitude;
+}
+
+static void test_not_enough_points(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    struct sc_trend_result result;
+    for (unsigned i = 0; i < SC_TREND_MIN_POINTS - 1; ++i) {
+        sc_trend_push(&trend, i);
+        assert(!sc_trend_analyze(&trend, &result));
+    }
+
+    sc_trend_push(&trend, 42);
+    assert(sc_trend_analyze(&trend, &result));
+}
+
+static void test_decimate(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    for (unsigned i = 0; i < SC_TREND_CAPACITY - 1; ++i) {
+        sc_trend_push(&trend, i);
+    }
+    assert(trend.count == SC_TREND_CAPACITY - 1);
+    assert(trend.samples_per_point == 1);
+
+    // Once full, the points are merged by pairs
+    sc_trend_push(&trend, SC_TREND_CAPACITY - 1);
+    assert(trend.count == SC_TREND_CAPACITY / 2);
+    assert(trend.samples_per_point == 2);
+    assert(trend.points[0] == 0.5);
+    assert(trend.points[SC_TREND_CAPACITY / 2 - 1] == SC_TREND_CAPACITY - 1.5);
+
+    // The new points average 2 samples
+    sc_trend_push(&trend, SC_TREND_CAPACITY);
+    assert(trend.count == SC_TREND_CAPACITY / 2);
+    sc_trend_push(&trend, SC_TREND_CAPACITY + 1);
+    assert(trend.count == SC_TREND_CAPACITY / 2 + 1);
+    assert(trend.points[SC_TREND_CAPACITY / 2] == SC_TREND_CAPACITY + 0.5);
+
+    for (unsigned i = 0; i < 100000; ++i) {
+        sc_trend_push(&trend, i);
+        assert(trend.count < SC_TREND_CAPACITY);
+    }
+}
+
+static void test_leak(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    // A slow growth (+20% over the session) hidden in a larger noise
+    unsigned state = 1;
+    for (unsigned i = 0; i < 10000; ++i) {
+        double value = 100e6 + 20e6 * i / 10000 + noise(&state, 5e6);
+        sc_trend_push(&trend, value);
+    }
+
+    struct sc_trend_result result;
+    assert(sc_trend_analyze(&trend, &result));
+    assert(result.last > result.first);
+    assert(sc_trend_is_growing(&result));
+}
+
+static void test_stable(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    unsigned state = 42;
+    for (unsigned i = 0; i < 10000; ++i) {
+        sc_trend_push(&trend, 100e6 + noise(&state, 5e6));
+    }
+
+    struct sc_trend_result result;
+    assert(sc_trend_analyze(&trend, &result));
+    assert(!sc_trend_is_growing(&result));
+}
+
+static void test_sawtooth(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    // The value grows, but it is released periodically
+    for (unsigned i = 0; i < 10000; ++i) {
+        sc_trend_push(&trend, 1000 + i % 1000);
+    }
+
+    struct sc_trend_result result;
+    assert(sc_trend_analyze(&trend, &result));
+    assert(!sc_trend_is_growing(&result));
+}
+
+static void test_small_growth(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    // Monotonic, but not significant (+1%)
+    for (unsigned i = 0; i < 1000; ++i) {
+        sc_trend_push(&trend, 1000 + i / 100);
+    }
+
+    struct sc_trend_result result;
+    assert(sc_trend_analyze(&trend, &result));
+    assert(result.tau > SC_TREND_MIN_TAU);
+    assert(!sc_trend_is_growing(&result));
+}
+
+static void test_growth_from_zero(void) {
+    struct sc_trend trend;
+    sc_trend_init(&trend);
+
+    // For example, a queue which never drains
+    for (unsigned i = 0; i < 1000; ++i) {
+        sc_trend_push(&trend, i < 400 ? 0 : i / 10);
+    }
+
+    struct sc_trend_result result;
+    assert(sc_trend_analyze(&trend, &result));
+    assert(result.first == 0);
+    assert(sc_trend_is_growing(&result));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_not_enough_points();
+    test_decimate();
+    test_leak();
+    test_stable();
+    test_sawtooth();
+    test_small_growth();
+    test_growth_from_zero();
+
+    return 0;
+}
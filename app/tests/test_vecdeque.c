@@ -184,6 +184,67 @@ static void test_vecdeque_push_hole(void) {
     sc_vecdeque_destroy(&vdq);
 }
 
+static void test_vecdeque_back(void) {
+    struct SC_VECDEQUE(int) vdq = SC_VECDEQUE_INITIALIZER;
+
+    bool ok = sc_vecdeque_reserve(&vdq, 3);
+    assert(ok);
+
+    for (int i = 0; i < 10; ++i) {
+        // Make the ring buffer wrap around
+        ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+        assert(*sc_vecdeque_back(&vdq) == i);
+        if (i % 2) {
+            int v = sc_vecdeque_pop(&vdq);
+            assert(v == i / 2);
+        }
+    }
+
+    int *p = sc_vecdeque_back(&vdq);
+    *p = 42;
+    while (sc_vecdeque_size(&vdq) > 1) {
+        (void) sc_vecdeque_pop(&vdq);
+    }
+    assert(sc_vecdeque_pop(&vdq) == 42);
+
+    sc_vecdeque_destroy(&vdq);
+}
+
+static void test_vecdeque_at(void) {
+    struct SC_VECDEQUE(int) vdq = SC_VECDEQUE_INITIALIZER;
+
+    bool ok = sc_vecdeque_reserve(&vdq, 5);
+    assert(ok);
+
+    for (int i = 0; i < 5; ++i) {
+        ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+
+    // Make the ring buffer wrap around
+    int v = sc_vecdeque_pop(&vdq);
+    assert(v == 0);
+    v = sc_vecdeque_pop(&vdq);
+    assert(v == 1);
+    ok = sc_vecdeque_push(&vdq, 5);
+    assert(ok);
+    ok = sc_vecdeque_push(&vdq, 6);
+    assert(ok);
+
+    assert(sc_vecdeque_size(&vdq) == 5);
+    for (size_t i = 0; i < 5; ++i) {
+        assert(*sc_vecdeque_at(&vdq, i) == (int) i + 2);
+    }
+
+    *sc_vecdeque_at(&vdq, 3) = 42;
+    v = sc_vecdeque_pop(&vdq);
+    assert(v == 2);
+    assert(*sc_vecdeque_at(&vdq, 2) == 42);
+
+    sc_vecdeque_destroy(&vdq);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -192,6 +253,8 @@ int main(int argc, char *argv[]) {
     test_vecdeque_reserve();
     test_vecdeque_grow();
     test_vecdeque_push_hole();
+    test_vecdeque_back();
+    test_vecdeque_at();
 
     return 0;
 }
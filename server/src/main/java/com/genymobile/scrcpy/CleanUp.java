@@ -4,9 +4,11 @@ import com.genymobile.scrcpy.device.Device;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.Settings;
 import com.genymobile.scrcpy.util.SettingsException;
+import com.genymobile.scrcpy.video.VideoSource;
 import com.genymobile.scrcpy.wrappers.ServiceManager;
 
 import android.os.BatteryManager;
+import android.os.Build;
 import android.os.Looper;
 import android.system.ErrnoException;
 import android.system.Os;
@@ -22,6 +24,9 @@ import java.io.OutputStream;
  */
 public final class CleanUp {
 
+    // Tolerance when comparing a refresh rate to the max fps (for example 59.94 Hz matches 60 fps)
+    private static final float REFRESH_RATE_TOLERANCE = 0.5f;
+
     // Dynamic options
     private static final int PENDING_CHANGE_DISPLAY_POWER = 1 << 0;
     private int pendingChanges;
@@ -61,6 +66,17 @@ public final class CleanUp {
             }
         }
 
+        boolean disablePointerLocation = false;
+        if (options.getPointerLocation()) {
+            try {
+                // Unlike "show touches", the pointer location overlay also shows the injected events
+                String oldValue = Settings.getAndPutValue(Settings.TABLE_SYSTEM, "pointer_location", "1");
+                disablePointerLocation = !"1".equals(oldValue);
+            } catch (SettingsException e) {
+                Ln.e("Could not change \"pointer_location\"", e);
+            }
+        }
+
         int restoreStayOn = -1;
         if (options.getStayAwake()) {
             int stayOn = BatteryManager.BATTERY_PLUGGED_AC | BatteryManager.BATTERY_PLUGGED_USB | BatteryManager.BATTERY_PLUGGED_WIRELESS;
@@ -113,17 +129,82 @@ public final class CleanUp {
             }
         }
 
+        float restorePeakRefreshRate = -1;
+        if (options.getMatchRefreshRate() && options.getVideoSource() == VideoSource.DISPLAY && options.getNewDisplay() == null
+                && options.getMaxFps() > 0) {
+            restorePeakRefreshRate = matchRefreshRate(displayId, options.getMaxFps());
+        }
+
         boolean powerOffScreen = options.getPowerOffScreenOnClose();
+        boolean keepServerFile = options.getKeepServerFile();
 
         try {
-            run(displayId, restoreStayOn, disableShowTouches, powerOffScreen, restoreScreenOffTimeout, restoreDisplayImePolicy);
+            run(displayId, restoreStayOn, disableShowTouches, disablePointerLocation, powerOffScreen, restoreScreenOffTimeout,
+                    restoreDisplayImePolicy, restorePeakRefreshRate, keepServerFile);
         } catch (IOException e) {
             Ln.e("Clean up I/O exception", e);
         }
     }
 
-    private void run(int displayId, int restoreStayOn, boolean disableShowTouches, boolean powerOffScreen, int restoreScreenOffTimeout,
-            int restoreDisplayImePolicy) throws IOException {
+    /**
+     * Limit the refresh rate of the display to the lowest supported refresh rate not lower than the max fps, so that the device does not
+     * compose frames which would not be captured.
+     *
+     * @return the "peak_refresh_rate" value to restore on clean up, 0 to unset it, or -1 if it has not been changed
+     */
+    private static float matchRefreshRate(int displayId, float maxFps) {
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_29_ANDROID_10) {
+            Ln.w("Matching the refresh rate requires Android >= 10, ignored");
+            return -1;
+        }
+
+        float[] refreshRates = ServiceManager.getDisplayManager().getSupportedRefreshRates(displayId);
+        if (refreshRates == null) {
+            return -1;
+        }
+
+        float maxRefreshRate = 0;
+        float refreshRate = 0;
+        for (float rate : refreshRates) {
+            maxRefreshRate = Math.max(maxRefreshRate, rate);
+            if (rate >= maxFps - REFRESH_RATE_TOLERANCE && (refreshRate == 0 || rate < refreshRate)) {
+                refreshRate = rate;
+            }
+        }
+
+        if (refreshRate == 0 || refreshRate == maxRefreshRate) {
+            Ln.d("No lower refresh rate to match " + maxFps + " fps");
+            return -1;
+        }
+
+        try {
+            String oldValue = Settings.getValue(Settings.TABLE_SYSTEM, "peak_refresh_rate");
+            float currentPeak = 0;
+            if (oldValue != null) {
+                try {
+                    currentPeak = Float.parseFloat(oldValue);
+                } catch (NumberFormatException e) {
+                    // ignore
+                }
+            }
+            if (currentPeak > 0 && currentPeak <= refreshRate) {
+                // Already limited by the user
+                return -1;
+            }
+
+            Settings.putValue(Settings.TABLE_SYSTEM, "peak_refresh_rate", String.valueOf(refreshRate));
+            Ln.i("Device refresh rate limited to " + refreshRate + " Hz");
+            // currentPeak is 0 if the setting was unset (or invalid), then it must be unset on clean up
+            return currentPeak;
+        } catch (SettingsException e) {
+            Ln.e("Could not change \"peak_refresh_rate\"", e);
+            return -1;
+        }
+    }
+
+    private void run(int displayId, int restoreStayOn, boolean disableShowTouches, boolean disablePointerLocation, boolean powerOffScreen,
+            int restoreScreenOffTimeout, int restoreDisplayImePolicy, float restorePeakRefreshRate, boolean keepServerFile)
+            throws IOException {
         String[] cmd = {
                 "app_process",
                 "/",
@@ -131,9 +212,12 @@ public final class CleanUp {
                 String.valueOf(displayId),
                 String.valueOf(restoreStayOn),
                 String.valueOf(disableShowTouches),
+                String.valueOf(disablePointerLocation),
                 String.valueOf(powerOffScreen),
                 String.valueOf(restoreScreenOffTimeout),
                 String.valueOf(restoreDisplayImePolicy),
+                String.valueOf(restorePeakRefreshRate),
+                String.valueOf(keepServerFile),
         };
 
         ProcessBuilder builder = new ProcessBuilder(cmd);
@@ -192,7 +276,11 @@ public final class CleanUp {
         } catch (ErrnoException e) {
             Ln.e("setsid() failed", e);
         }
-        unlinkSelf();
+        // The client may reuse the server file on the next start
+        boolean keepServerFile = Boolean.parseBoolean(args[8]);
+        if (!keepServerFile) {
+            unlinkSelf();
+        }
 
         // Needed for workarounds
         prepareMainLooper();
@@ -201,9 +289,11 @@ public final class CleanUp {
         int displayId = Integer.parseInt(args[0]);
         int restoreStayOn = Integer.parseInt(args[1]);
         boolean disableShowTouches = Boolean.parseBoolean(args[2]);
-        boolean powerOffScreen = Boolean.parseBoolean(args[3]);
-        int restoreScreenOffTimeout = Integer.parseInt(args[4]);
-        int restoreDisplayImePolicy = Integer.parseInt(args[5]);
+        boolean disablePointerLocation = Boolean.parseBoolean(args[3]);
+        boolean powerOffScreen = Boolean.parseBoolean(args[4]);
+        int restoreScreenOffTimeout = Integer.parseInt(args[5]);
+        int restoreDisplayImePolicy = Integer.parseInt(args[6]);
+        float restorePeakRefreshRate = Float.parseFloat(args[7]);
 
         // Dynamic option
         boolean restoreDisplayPower = false;
@@ -231,6 +321,15 @@ public final class CleanUp {
             }
         }
 
+        if (disablePointerLocation) {
+            Ln.i("Disabling \"pointer location\"");
+            try {
+                Settings.putValue(Settings.TABLE_SYSTEM, "pointer_location", "0");
+            } catch (SettingsException e) {
+                Ln.e("Could not restore \"pointer_location\"", e);
+            }
+        }
+
         if (restoreStayOn != -1) {
             Ln.i("Restoring \"stay awake\"");
             try {
@@ -254,6 +353,17 @@ public final class CleanUp {
             ServiceManager.getWindowManager().setDisplayImePolicy(displayId, restoreDisplayImePolicy);
         }
 
+        if (restorePeakRefreshRate != -1) {
+            Ln.i("Restoring \"peak refresh rate\"");
+            try {
+                // A null value unsets the setting
+                String value = restorePeakRefreshRate != 0 ? String.valueOf(restorePeakRefreshRate) : null;
+                Settings.putValue(Settings.TABLE_SYSTEM, "peak_refresh_rate", value);
+            } catch (SettingsException e) {
+                Ln.e("Could not restore \"peak_refresh_rate\"", e);
+            }
+        }
+
         // Change the power of the main display when mirroring a virtual display
         int targetDisplayId = displayId != Device.DISPLAY_ID_NONE ? displayId : 0;
         if (Device.isScreenOn(targetDisplayId)) {
@@ -3,11 +3,13 @@ package com.genymobile.scrcpy;
 import com.genymobile.scrcpy.audio.AudioCodec;
 import com.genymobile.scrcpy.audio.AudioSource;
 import com.genymobile.scrcpy.device.Device;
+import com.genymobile.scrcpy.device.ExtraDisplay;
 import com.genymobile.scrcpy.device.NewDisplay;
 import com.genymobile.scrcpy.device.Orientation;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.CodecOption;
 import com.genymobile.scrcpy.util.Ln;
+import com.genymobile.scrcpy.video.BitRateModeConfig;
 import com.genymobile.scrcpy.video.CameraAspectRatio;
 import com.genymobile.scrcpy.video.CameraFacing;
 import com.genymobile.scrcpy.video.VideoCodec;
@@ -17,6 +19,7 @@ import com.genymobile.scrcpy.wrappers.WindowManager;
 import android.graphics.Rect;
 import android.util.Pair;
 
+import java.util.ArrayList;
 import java.util.List;
 import java.util.Locale;
 
@@ -28,16 +31,25 @@ public class Options {
     private boolean audio = true;
     private int maxSize;
     private VideoCodec videoCodec = VideoCodec.H264;
+    private List<VideoCodec> videoCodecCandidates; // ranked by the client (video_codec=auto), or null
     private AudioCodec audioCodec = AudioCodec.OPUS;
     private VideoSource videoSource = VideoSource.DISPLAY;
     private AudioSource audioSource = AudioSource.OUTPUT;
     private boolean audioDup;
     private int videoBitRate = 8000000;
+    private boolean recordStream;
+    private int recordVideoBitRate = 16000000;
+    private int recordMaxSize;
     private int audioBitRate = 128000;
     private float maxFps;
     private float angle;
     private boolean tunnelForward;
+    private int directTcpPort; // 0 if the client connects through adb
+    private String directTcpAddress;
+    private String directTcpTokens;
+    private int tunnelBenchmark; // size of the burst to send, 0 if disabled
     private Rect crop;
+    private List<Rect> crops;
     private boolean control = true;
     private int displayId;
     private String cameraId;
@@ -47,6 +59,8 @@ public class Options {
     private int cameraFps;
     private boolean cameraHighSpeed;
     private boolean showTouches;
+    private boolean pointerLocation;
+    private boolean matchRefreshRate;
     private boolean stayAwake;
     private int screenOffTimeout = -1;
     private int displayImePolicy = -1;
@@ -54,16 +68,29 @@ public class Options {
     private List<CodecOption> audioCodecOptions;
 
     private String videoEncoder;
+    private boolean videoLowLatency;
+    private int videoIntraRefresh;
+    private int videoBitRateMode = BitRateModeConfig.MODE_DEFAULT;
+    private int videoQuality = BitRateModeConfig.QUALITY_DEFAULT;
+    private int videoMaxBitRate; // 0 for no peak
+    private int inputPacing; // ms
+    private int videoIdleTimeout; // ms, 0 to disable
+    private boolean videoMarkRepeatedFrames; // set the repeated flag of the frames repeated by the encoder
     private String audioEncoder;
     private boolean powerOffScreenOnClose;
     private boolean clipboardAutosync = true;
+    private boolean clipboardCompression;
     private boolean downsizeOnError = true;
+    private boolean notifyMaxSize;
     private boolean cleanup = true;
+    private boolean keepServerFile; // do not delete the server file on cleanup (the client reuses it)
     private boolean powerOn = true;
 
     private NewDisplay newDisplay;
+    private List<ExtraDisplay> extraDisplays; // streamed on additional video sockets, or null
     private boolean vdDestroyContent = true;
     private boolean vdSystemDecorations = true;
+    private boolean sendFrameTimestamp; // send the device time of each video frame (to measure the latency)
 
     private Orientation.Lock captureOrientationLock = Orientation.Lock.Unlocked;
     private Orientation captureOrientation = Orientation.Orient0;
@@ -104,6 +131,14 @@ public class Options {
         return videoCodec;
     }
 
+    /**
+     * Return the video codecs the client can decode, from the preferred one, if the codec must be selected by the server (or null if
+     * {@link #getVideoCodec()} must be used).
+     */
+    public List<VideoCodec> getVideoCodecCandidates() {
+        return videoCodecCandidates;
+    }
+
     public AudioCodec getAudioCodec() {
         return audioCodec;
     }
@@ -124,6 +159,18 @@ public class Options {
         return videoBitRate;
     }
 
+    public boolean getRecordStream() {
+        return recordStream;
+    }
+
+    public int getRecordVideoBitRate() {
+        return recordVideoBitRate;
+    }
+
+    public int getRecordMaxSize() {
+        return recordMaxSize;
+    }
+
     public int getAudioBitRate() {
         return audioBitRate;
     }
@@ -140,10 +187,33 @@ public class Options {
         return tunnelForward;
     }
 
+    public int getDirectTcpPort() {
+        return directTcpPort;
+    }
+
+    public String getDirectTcpAddress() {
+        return directTcpAddress;
+    }
+
+    public String getDirectTcpTokens() {
+        return directTcpTokens;
+    }
+
+    public int getTunnelBenchmark() {
+        return tunnelBenchmark;
+    }
+
     public Rect getCrop() {
         return crop;
     }
 
+    /**
+     * Return all the crop areas (when several areas must be tiled into the video), or {@code null} if there is at most one.
+     */
+    public List<Rect> getCrops() {
+        return crops;
+    }
+
     public boolean getControl() {
         return control;
     }
@@ -172,14 +242,54 @@ public class Options {
         return cameraFps;
     }
 
+    public boolean getVideoLowLatency() {
+        return videoLowLatency;
+    }
+
+    public int getVideoIntraRefresh() {
+        return videoIntraRefresh;
+    }
+
+    public int getVideoBitRateMode() {
+        return videoBitRateMode;
+    }
+
+    public int getVideoQuality() {
+        return videoQuality;
+    }
+
+    public int getVideoMaxBitRate() {
+        return videoMaxBitRate;
+    }
+
+    public int getInputPacing() {
+        return inputPacing;
+    }
+
+    public int getVideoIdleTimeout() {
+        return videoIdleTimeout;
+    }
+
+    public boolean getVideoMarkRepeatedFrames() {
+        return videoMarkRepeatedFrames;
+    }
+
     public boolean getCameraHighSpeed() {
         return cameraHighSpeed;
     }
 
+    public boolean getMatchRefreshRate() {
+        return matchRefreshRate;
+    }
+
     public boolean getShowTouches() {
         return showTouches;
     }
 
+    public boolean getPointerLocation() {
+        return pointerLocation;
+    }
+
     public boolean getStayAwake() {
         return stayAwake;
     }
@@ -216,14 +326,26 @@ public class Options {
         return clipboardAutosync;
     }
 
+    public boolean getClipboardCompression() {
+        return clipboardCompression;
+    }
+
     public boolean getDownsizeOnError() {
         return downsizeOnError;
     }
 
+    public boolean getNotifyMaxSize() {
+        return notifyMaxSize;
+    }
+
     public boolean getCleanup() {
         return cleanup;
     }
 
+    public boolean getKeepServerFile() {
+        return keepServerFile;
+    }
+
     public boolean getPowerOn() {
         return powerOn;
     }
@@ -232,6 +354,17 @@ public class Options {
         return newDisplay;
     }
 
+    /**
+     * Return the additional displays to stream, each on its own video socket (or null if none).
+     */
+    public List<ExtraDisplay> getExtraDisplays() {
+        return extraDisplays;
+    }
+
+    public int getExtraDisplayCount() {
+        return extraDisplays != null ? extraDisplays.size() : 0;
+    }
+
     public Orientation getCaptureOrientation() {
         return captureOrientation;
     }
@@ -280,6 +413,10 @@ public class Options {
         return sendFrameMeta;
     }
 
+    public boolean getSendFrameTimestamp() {
+        return sendFrameTimestamp;
+    }
+
     public boolean getSendDummyByte() {
         return sendDummyByte;
     }
@@ -328,6 +465,11 @@ public class Options {
                     options.audio = Boolean.parseBoolean(value);
                     break;
                 case "video_codec":
+                    if (value.contains(",")) {
+                        // Ranked list of candidates (video_codec=auto on the client side)
+                        options.videoCodecCandidates = parseVideoCodecs(value);
+                        break;
+                    }
                     VideoCodec videoCodec = VideoCodec.findByName(value);
                     if (videoCodec == null) {
                         throw new IllegalArgumentException("Video codec " + value + " not supported");
@@ -364,6 +506,15 @@ public class Options {
                 case "video_bit_rate":
                     options.videoBitRate = Integer.parseInt(value);
                     break;
+                case "record_stream":
+                    options.recordStream = Boolean.parseBoolean(value);
+                    break;
+                case "record_video_bit_rate":
+                    options.recordVideoBitRate = Integer.parseInt(value);
+                    break;
+                case "record_max_size":
+                    options.recordMaxSize = Integer.parseInt(value) & ~7; // multiple of 8
+                    break;
                 case "audio_bit_rate":
                     options.audioBitRate = Integer.parseInt(value);
                     break;
@@ -376,9 +527,29 @@ public class Options {
                 case "tunnel_forward":
                     options.tunnelForward = Boolean.parseBoolean(value);
                     break;
+                case "direct_tcp_port":
+                    int directTcpPort = Integer.parseInt(value);
+                    if (directTcpPort <= 0 || directTcpPort > 0xFFFF) {
+                        throw new IllegalArgumentException("Invalid direct TCP port: " + directTcpPort);
+                    }
+                    options.directTcpPort = directTcpPort;
+                    break;
+                case "direct_tcp_address":
+                    options.directTcpAddress = value;
+                    break;
+                case "direct_tcp_tokens":
+                    options.directTcpTokens = value;
+                    break;
+                case "tunnel_benchmark":
+                    options.tunnelBenchmark = Integer.parseInt(value);
+                    break;
                 case "crop":
                     if (!value.isEmpty()) {
-                        options.crop = parseCrop(value);
+                        List<Rect> crops = parseCrops(value);
+                        options.crop = crops.get(0);
+                        if (crops.size() > 1) {
+                            options.crops = crops;
+                        }
                     }
                     break;
                 case "control":
@@ -390,6 +561,12 @@ public class Options {
                 case "show_touches":
                     options.showTouches = Boolean.parseBoolean(value);
                     break;
+                case "pointer_location":
+                    options.pointerLocation = Boolean.parseBoolean(value);
+                    break;
+                case "match_refresh_rate":
+                    options.matchRefreshRate = Boolean.parseBoolean(value);
+                    break;
                 case "stay_awake":
                     options.stayAwake = Boolean.parseBoolean(value);
                     break;
@@ -420,12 +597,21 @@ public class Options {
                 case "clipboard_autosync":
                     options.clipboardAutosync = Boolean.parseBoolean(value);
                     break;
+                case "clipboard_compression":
+                    options.clipboardCompression = Boolean.parseBoolean(value);
+                    break;
                 case "downsize_on_error":
                     options.downsizeOnError = Boolean.parseBoolean(value);
                     break;
+                case "notify_max_size":
+                    options.notifyMaxSize = Boolean.parseBoolean(value);
+                    break;
                 case "cleanup":
                     options.cleanup = Boolean.parseBoolean(value);
                     break;
+                case "keep_server_file":
+                    options.keepServerFile = Boolean.parseBoolean(value);
+                    break;
                 case "power_on":
                     options.powerOn = Boolean.parseBoolean(value);
                     break;
@@ -471,12 +657,45 @@ public class Options {
                 case "camera_fps":
                     options.cameraFps = Integer.parseInt(value);
                     break;
+                case "video_low_latency":
+                    options.videoLowLatency = Boolean.parseBoolean(value);
+                    break;
+                case "video_intra_refresh":
+                    options.videoIntraRefresh = Integer.parseInt(value);
+                    break;
+                case "video_bit_rate_mode":
+                    options.videoBitRateMode = BitRateModeConfig.parseMode(value);
+                    break;
+                case "video_quality":
+                    options.videoQuality = Integer.parseInt(value);
+                    break;
+                case "video_max_bit_rate":
+                    options.videoMaxBitRate = Integer.parseInt(value);
+                    break;
+                case "input_pacing":
+                    options.inputPacing = Integer.parseInt(value);
+                    if (options.inputPacing < 0) {
+                        throw new IllegalArgumentException("Invalid input pacing: " + options.inputPacing);
+                    }
+                    break;
+                case "video_idle_timeout":
+                    options.videoIdleTimeout = Integer.parseInt(value);
+                    if (options.videoIdleTimeout < 0) {
+                        throw new IllegalArgumentException("Invalid video idle timeout: " + options.videoIdleTimeout);
+                    }
+                    break;
+                case "video_mark_repeated_frames":
+                    options.videoMarkRepeatedFrames = Boolean.parseBoolean(value);
+                    break;
                 case "camera_high_speed":
                     options.cameraHighSpeed = Boolean.parseBoolean(value);
                     break;
                 case "new_display":
                     options.newDisplay = parseNewDisplay(value);
                     break;
+                case "extra_displays":
+                    options.extraDisplays = parseExtraDisplays(value);
+                    break;
                 case "vd_destroy_content":
                     options.vdDestroyContent = Boolean.parseBoolean(value);
                     break;
@@ -497,6 +716,9 @@ public class Options {
                 case "send_frame_meta":
                     options.sendFrameMeta = Boolean.parseBoolean(value);
                     break;
+                case "send_frame_timestamp":
+                    options.sendFrameTimestamp = Boolean.parseBoolean(value);
+                    break;
                 case "send_dummy_byte":
                     options.sendDummyByte = Boolean.parseBoolean(value);
                     break;
@@ -518,6 +740,17 @@ public class Options {
             }
         }
 
+        if (options.directTcpPort != 0) {
+            if (options.directTcpTokens == null || options.directTcpTokens.isEmpty()) {
+                // Anyone on the network could connect otherwise
+                throw new IllegalArgumentException("The direct TCP connection requires tokens");
+            }
+            if (options.directTcpAddress == null || options.directTcpAddress.isEmpty()) {
+                // Never listen on all the device networks
+                throw new IllegalArgumentException("The direct TCP connection requires a local address");
+            }
+        }
+
         if (options.newDisplay != null) {
             assert options.displayId == 0 : "Must not set both displayId and newDisplay";
             options.displayId = Device.DISPLAY_ID_NONE;
@@ -526,6 +759,46 @@ public class Options {
         return options;
     }
 
+    private static List<VideoCodec> parseVideoCodecs(String value) {
+        List<VideoCodec> codecs = new ArrayList<>();
+        for (String name : value.split(",")) {
+            VideoCodec codec = VideoCodec.findByName(name);
+            if (codec == null) {
+                throw new IllegalArgumentException("Video codec " + name + " not supported");
+            }
+            codecs.add(codec);
+        }
+        return codecs;
+    }
+
+    private static List<ExtraDisplay> parseExtraDisplays(String value) {
+        // input format: "<display_id>|new[:<new_display>][,...]"
+        List<ExtraDisplay> extraDisplays = new ArrayList<>();
+        for (String token : value.split(",")) {
+            if (token.equals("new")) {
+                extraDisplays.add(ExtraDisplay.ofNewDisplay(new NewDisplay()));
+            } else if (token.startsWith("new:")) {
+                extraDisplays.add(ExtraDisplay.ofNewDisplay(parseNewDisplay(token.substring(4))));
+            } else {
+                int displayId = Integer.parseInt(token);
+                if (displayId < 0) {
+                    throw new IllegalArgumentException("Invalid extra display id: " + token);
+                }
+                extraDisplays.add(ExtraDisplay.ofDisplayId(displayId));
+            }
+        }
+        return extraDisplays;
+    }
+
+    private static List<Rect> parseCrops(String value) {
+        // input format: "width:height:x:y[,width:height:x:y...]"
+        List<Rect> crops = new ArrayList<>();
+        for (String crop : value.split(",")) {
+            crops.add(parseCrop(crop));
+        }
+        return crops;
+    }
+
     private static Rect parseCrop(String crop) {
         // input format: "width:height:x:y"
         String[] tokens = crop.split(":");
@@ -12,17 +12,28 @@ import com.genymobile.scrcpy.control.Controller;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.DesktopConnection;
 import com.genymobile.scrcpy.device.Device;
+import com.genymobile.scrcpy.device.ExtraDisplay;
 import com.genymobile.scrcpy.device.NewDisplay;
 import com.genymobile.scrcpy.device.Streamer;
+import com.genymobile.scrcpy.device.TunnelBenchmark;
 import com.genymobile.scrcpy.opengl.OpenGLRunner;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
+import com.genymobile.scrcpy.util.StartupTimeline;
+import com.genymobile.scrcpy.video.BitRateAdapter;
 import com.genymobile.scrcpy.video.CameraCapture;
+import com.genymobile.scrcpy.video.EncoderBenchmark;
+import com.genymobile.scrcpy.video.KeyFrameRequester;
 import com.genymobile.scrcpy.video.NewDisplayCapture;
 import com.genymobile.scrcpy.video.ScreenCapture;
 import com.genymobile.scrcpy.video.SurfaceCapture;
 import com.genymobile.scrcpy.video.SurfaceEncoder;
+import com.genymobile.scrcpy.video.VideoCodec;
+import com.genymobile.scrcpy.video.VideoCodecSelector;
+import com.genymobile.scrcpy.video.VideoIdleDetector;
 import com.genymobile.scrcpy.video.VideoSource;
+import com.genymobile.scrcpy.video.VideoThrottle;
+import com.genymobile.scrcpy.wrappers.ServiceManager;
 
 import android.annotation.SuppressLint;
 import android.os.Build;
@@ -33,6 +44,8 @@ import java.io.IOException;
 import java.lang.reflect.Field;
 import java.util.ArrayList;
 import java.util.List;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.FutureTask;
 
 public final class Server {
 
@@ -92,16 +105,38 @@ public final class Server {
 
         int scid = options.getScid();
         boolean tunnelForward = options.isTunnelForward();
+        int directTcpPort = options.getDirectTcpPort();
+        String directTcpAddress = options.getDirectTcpAddress();
+        String directTcpTokens = options.getDirectTcpTokens();
         boolean control = options.getControl();
         boolean video = options.getVideo();
         boolean audio = options.getAudio();
         boolean sendDummyByte = options.getSendDummyByte();
 
+        List<AsyncProcessor> asyncProcessors = new ArrayList<>();
+
+        boolean recordStream = video && options.getRecordStream();
+        if (recordStream && (options.getVideoSource() != VideoSource.DISPLAY || options.getNewDisplay() != null)) {
+            Ln.e("The record stream is only supported for display mirroring");
+            throw new ConfigurationException("Record stream not supported");
+        }
+
+        int extraDisplayCount = video ? options.getExtraDisplayCount() : 0;
+
+        // Wait for the client connection on a separate thread, to apply the workarounds and initialize the services meanwhile
+        FutureTask<DesktopConnection> connectionTask = new FutureTask<>(
+                () -> DesktopConnection.open(scid, tunnelForward, directTcpPort, directTcpAddress, directTcpTokens, video, recordStream,
+                        extraDisplayCount, audio, control, sendDummyByte));
+        new Thread(connectionTask, "connection").start();
+
         Workarounds.apply();
+        StartupTimeline.mark("workarounds");
 
-        List<AsyncProcessor> asyncProcessors = new ArrayList<>();
+        preloadServices(options);
+        StartupTimeline.mark("services");
 
-        DesktopConnection connection = DesktopConnection.open(scid, tunnelForward, video, audio, control, sendDummyByte);
+        DesktopConnection connection = awaitConnection(connectionTask);
+        StartupTimeline.mark("connection");
         try {
             if (options.getSendDeviceMeta()) {
                 connection.sendDeviceMeta(Device.getDeviceName());
@@ -136,8 +171,15 @@ public final class Server {
             }
 
             if (video) {
-                Streamer videoStreamer = new Streamer(connection.getVideoFd(), options.getVideoCodec(), options.getSendCodecMeta(),
-                        options.getSendFrameMeta());
+                VideoCodec videoCodec = options.getVideoCodec();
+                List<VideoCodec> videoCodecCandidates = options.getVideoCodecCandidates();
+                if (videoCodecCandidates != null) {
+                    // The stream header tells the client which codec has been selected
+                    videoCodec = VideoCodecSelector.select(videoCodecCandidates);
+                }
+
+                Streamer videoStreamer = new Streamer(connection.getVideoFd(), videoCodec, options.getSendCodecMeta(),
+                        options.getSendFrameMeta(), options.getSendFrameTimestamp());
                 SurfaceCapture surfaceCapture;
                 if (options.getVideoSource() == VideoSource.DISPLAY) {
                     NewDisplay newDisplay = options.getNewDisplay();
@@ -153,8 +195,68 @@ public final class Server {
                 SurfaceEncoder surfaceEncoder = new SurfaceEncoder(surfaceCapture, videoStreamer, options);
                 asyncProcessors.add(surfaceEncoder);
 
+                int videoIdleTimeout = options.getVideoIdleTimeout();
+                if (videoIdleTimeout > 0) {
+                    // Without control, the client is not notified, but the idle video is not streamed anyway
+                    VideoIdleDetector idleDetector = new VideoIdleDetector(videoIdleTimeout * 1000L, controller);
+                    surfaceEncoder.setIdleDetector(idleDetector);
+                }
+
                 if (controller != null) {
                     controller.setSurfaceCapture(surfaceCapture);
+
+                    // Only used if the client sends video feedback (--adaptive-bit-rate)
+                    BitRateAdapter bitRateAdapter = new BitRateAdapter(options.getVideoBitRate());
+                    surfaceEncoder.setBitRateAdapter(bitRateAdapter);
+                    controller.setBitRateAdapter(bitRateAdapter);
+
+                    KeyFrameRequester keyFrameRequester = new KeyFrameRequester();
+                    surfaceEncoder.setKeyFrameRequester(keyFrameRequester);
+                    controller.setKeyFrameRequester(keyFrameRequester);
+
+                    // Only used if the client throttles the video (--background-max-fps or --cpu-budget)
+                    VideoThrottle videoThrottle = new VideoThrottle(options.getMaxFps());
+                    surfaceEncoder.setVideoThrottle(videoThrottle);
+                    controller.setVideoThrottle(videoThrottle);
+                }
+
+                if (recordStream) {
+                    // A second capture of the same display, encoded separately for recording (it does not receive any input events)
+                    // The frame timestamps are only sent on the main video stream (the only one with a latency tracker)
+                    Streamer recordStreamer = new Streamer(connection.getRecordFd(), videoCodec, options.getSendCodecMeta(),
+                            options.getSendFrameMeta(), false);
+                    SurfaceCapture recordCapture = new ScreenCapture(null, options, options.getRecordMaxSize());
+                    String encoderName = options.getVideoEncoder();
+                    if (EncoderBenchmark.AUTO_BENCHMARK.equals(encoderName)) {
+                        // The benchmark is only run for the main stream
+                        encoderName = null;
+                    }
+                    SurfaceEncoder recordEncoder = new SurfaceEncoder(recordCapture, recordStreamer, options, options.getRecordVideoBitRate(), 0,
+                            encoderName, 0); // no intra refresh, the recording relies on periodic keyframes
+                    asyncProcessors.add(recordEncoder);
+                }
+
+                for (int i = 0; i < extraDisplayCount; ++i) {
+                    // Each extra display is captured and encoded separately, and streamed on its own socket (it does not receive any input
+                    // events)
+                    ExtraDisplay extraDisplay = options.getExtraDisplays().get(i);
+                    Streamer extraStreamer = new Streamer(connection.getExtraDisplayFd(i), videoCodec, options.getSendCodecMeta(),
+                            options.getSendFrameMeta(), false); // no frame timestamps, like the record stream
+                    SurfaceCapture extraCapture;
+                    NewDisplay extraNewDisplay = extraDisplay.getNewDisplay();
+                    if (extraNewDisplay != null) {
+                        extraCapture = new NewDisplayCapture(extraNewDisplay, options);
+                    } else {
+                        extraCapture = new ScreenCapture(extraDisplay.getDisplayId(), options.getMaxSize());
+                    }
+                    String encoderName = options.getVideoEncoder();
+                    if (EncoderBenchmark.AUTO_BENCHMARK.equals(encoderName)) {
+                        // The benchmark is only run for the main stream
+                        encoderName = null;
+                    }
+                    SurfaceEncoder extraEncoder = new SurfaceEncoder(extraCapture, extraStreamer, options, options.getVideoBitRate(),
+                            options.getMaxFps(), encoderName, 0); // no intra refresh, no keyframe can be requested for this stream
+                    asyncProcessors.add(extraEncoder);
                 }
             }
 
@@ -165,6 +267,13 @@ public final class Server {
                 });
             }
 
+            if (video) {
+                // The timeline is printed on the first video frame
+                StartupTimeline.mark("start");
+            } else {
+                StartupTimeline.markAndPrint("start");
+            }
+
             Looper.loop(); // interrupted by the Completion implementation
         } finally {
             if (cleanUp != null) {
@@ -194,6 +303,44 @@ public final class Server {
         }
     }
 
+    private static DesktopConnection awaitConnection(FutureTask<DesktopConnection> connectionTask) throws IOException {
+        try {
+            return connectionTask.get();
+        } catch (ExecutionException e) {
+            Throwable cause = e.getCause();
+            if (cause instanceof IOException) {
+                throw (IOException) cause;
+            }
+            if (cause instanceof RuntimeException) {
+                throw (RuntimeException) cause;
+            }
+            throw new AssertionError(cause);
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+            throw new IOException("Interrupted while waiting for the client connection", e);
+        }
+    }
+
+    private static void preloadServices(Options options) {
+        // The service wrappers are initialized lazily (by reflection). Initialize the ones required by the options while waiting for the
+        // client connection, instead of delaying the first frame or the first input event.
+        if (options.getVideo()) {
+            if (options.getVideoSource() == VideoSource.DISPLAY) {
+                ServiceManager.getDisplayManager();
+            } else {
+                ServiceManager.getCameraManager();
+            }
+        }
+        if (options.getControl()) {
+            ServiceManager.getInputManager();
+            ServiceManager.getWindowManager();
+            ServiceManager.getPowerManager();
+            if (options.getClipboardAutosync()) {
+                ServiceManager.getClipboardManager();
+            }
+        }
+    }
+
     private static void prepareMainLooper() {
         // Like Looper.prepareMainLooper(), but with quitAllowed set to true
         Looper.prepare();
@@ -236,6 +383,7 @@ public final class Server {
         prepareMainLooper();
 
         Options options = Options.parse(args);
+        StartupTimeline.mark("process");
 
         Ln.disableSystemStreams();
         Ln.initLogLevel(options.getLogLevel());
@@ -243,7 +391,7 @@ public final class Server {
         Ln.i("Device: [" + Build.MANUFACTURER + "] " + Build.BRAND + " " + Build.MODEL + " (Android " + Build.VERSION.RELEASE + ")");
 
         if (options.getList()) {
-            if (options.getCleanup()) {
+            if (options.getCleanup() && !options.getKeepServerFile()) {
                 CleanUp.unlinkSelf();
             }
 
@@ -267,6 +415,12 @@ public final class Server {
             return;
         }
 
+        if (options.getTunnelBenchmark() > 0) {
+            // Only measure the connection to the client, do not mirror
+            TunnelBenchmark.run(options);
+            return;
+        }
+
         try {
             scrcpy(options);
         } catch (ConfigurationException e) {
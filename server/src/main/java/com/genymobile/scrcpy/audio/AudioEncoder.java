@@ -28,27 +28,24 @@ import java.util.concurrent.BlockingQueue;
 
 public final class AudioEncoder implements AsyncProcessor {
 
-    private static class InputTask {
-        private final int index;
-
-        InputTask(int index) {
-            this.index = index;
-        }
-    }
-
+    // Output tasks are recycled, to avoid allocations for every packet on the steady-state path
     private static class OutputTask {
-        private final int index;
-        private final MediaCodec.BufferInfo bufferInfo;
+        private int index;
+        private final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
-        OutputTask(int index, MediaCodec.BufferInfo bufferInfo) {
+        void set(int index, MediaCodec.BufferInfo bufferInfo) {
             this.index = index;
-            this.bufferInfo = bufferInfo;
+            this.bufferInfo.set(bufferInfo.offset, bufferInfo.size, bufferInfo.presentationTimeUs, bufferInfo.flags);
         }
     }
 
     private static final int SAMPLE_RATE = AudioConfig.SAMPLE_RATE;
     private static final int CHANNELS = AudioConfig.CHANNELS;
 
+    // Range of the Opus encoder complexity (lower values reduce the encoding time, at the cost of quality)
+    private static final int OPUS_MIN_COMPLEXITY = 0;
+    private static final int OPUS_MAX_COMPLEXITY = 10;
+
     private final AudioCapture capture;
     private final Streamer streamer;
     private final int bitRate;
@@ -60,8 +57,10 @@ public final class AudioEncoder implements AsyncProcessor {
 
     // Capacity of 64 is in practice "infinite" (it is limited by the number of available MediaCodec buffers, typically 4).
     // So many pending tasks would lead to an unacceptable delay anyway.
-    private final BlockingQueue<InputTask> inputTasks = new ArrayBlockingQueue<>(64);
+    // The input tasks are the buffer indices (small values, so boxing does not allocate)
+    private final BlockingQueue<Integer> inputTasks = new ArrayBlockingQueue<>(64);
     private final BlockingQueue<OutputTask> outputTasks = new ArrayBlockingQueue<>(64);
+    private final BlockingQueue<OutputTask> freeOutputTasks = new ArrayBlockingQueue<>(64);
 
     private Thread thread;
     private HandlerThread mediaCodecThread;
@@ -79,6 +78,23 @@ public final class AudioEncoder implements AsyncProcessor {
         this.encoderName = options.getAudioEncoder();
     }
 
+    private static void checkCodecOptions(Codec codec, List<CodecOption> codecOptions) throws ConfigurationException {
+        if (codecOptions == null || codec != AudioCodec.OPUS) {
+            return;
+        }
+
+        for (CodecOption option : codecOptions) {
+            if (MediaFormat.KEY_COMPLEXITY.equals(option.getKey())) {
+                Object value = option.getValue();
+                if (!(value instanceof Integer) || (int) value < OPUS_MIN_COMPLEXITY || (int) value > OPUS_MAX_COMPLEXITY) {
+                    Ln.e("Invalid Opus complexity: " + value + " (expected an integer between " + OPUS_MIN_COMPLEXITY + " and "
+                            + OPUS_MAX_COMPLEXITY + ")");
+                    throw new ConfigurationException("Invalid Opus complexity: " + value);
+                }
+            }
+        }
+    }
+
     private static MediaFormat createFormat(String mimeType, int bitRate, List<CodecOption> codecOptions) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, mimeType);
@@ -103,14 +119,14 @@ public final class AudioEncoder implements AsyncProcessor {
         final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
         while (!Thread.currentThread().isInterrupted()) {
-            InputTask task = inputTasks.take();
-            ByteBuffer buffer = mediaCodec.getInputBuffer(task.index);
+            int index = inputTasks.take();
+            ByteBuffer buffer = mediaCodec.getInputBuffer(index);
             int r = capture.read(buffer, bufferInfo);
             if (r <= 0) {
                 throw new IOException("Could not read audio: " + r);
             }
 
-            mediaCodec.queueInputBuffer(task.index, bufferInfo.offset, bufferInfo.size, bufferInfo.presentationTimeUs, bufferInfo.flags);
+            mediaCodec.queueInputBuffer(index, bufferInfo.offset, bufferInfo.size, bufferInfo.presentationTimeUs, bufferInfo.flags);
         }
     }
 
@@ -127,6 +143,7 @@ public final class AudioEncoder implements AsyncProcessor {
                 streamer.writePacket(buffer, task.bufferInfo);
             } finally {
                 mediaCodec.releaseOutputBuffer(task.index, false);
+                freeOutputTasks.offer(task);
             }
         }
     }
@@ -217,6 +234,7 @@ public final class AudioEncoder implements AsyncProcessor {
             capture.checkCompatibility(); // throws an AudioCaptureException on error
 
             Codec codec = streamer.getCodec();
+            checkCodecOptions(codec, codecOptions);
             mediaCodec = createMediaCodec(codec, encoderName);
 
             // The default OPUS and FLAC encoders overwrite the input PTS with a value that matches the number of samples. This is not the behavior
@@ -351,7 +369,7 @@ public final class AudioEncoder implements AsyncProcessor {
         @Override
         public void onInputBufferAvailable(MediaCodec codec, int index) {
             try {
-                inputTasks.put(new InputTask(index));
+                inputTasks.put(index);
             } catch (InterruptedException e) {
                 end();
             }
@@ -360,7 +378,12 @@ public final class AudioEncoder implements AsyncProcessor {
         @Override
         public void onOutputBufferAvailable(MediaCodec codec, int index, MediaCodec.BufferInfo bufferInfo) {
             try {
-                outputTasks.put(new OutputTask(index, bufferInfo));
+                OutputTask task = freeOutputTasks.poll();
+                if (task == null) {
+                    task = new OutputTask();
+                }
+                task.set(index, bufferInfo);
+                outputTasks.put(task);
             } catch (InterruptedException e) {
                 end();
             }
@@ -28,7 +28,9 @@ public class AudioRecordReader {
 
     @TargetApi(AndroidVersions.API_24_ANDROID_7_0)
     public int read(ByteBuffer outDirectBuffer, MediaCodec.BufferInfo outBufferInfo) {
-        int r = recorder.read(outDirectBuffer, AudioConfig.MAX_READ_SIZE);
+        // The data is always written at the start of the buffer (its position is ignored)
+        int size = Math.min(AudioConfig.MAX_READ_SIZE, outDirectBuffer.capacity());
+        int r = recorder.read(outDirectBuffer, size, AudioRecord.READ_BLOCKING);
         if (r <= 0) {
             return r;
         }
@@ -0,0 +1,79 @@
+package com.genymobile.scrcpy.control;
+
+import java.util.Arrays;
+import java.util.zip.DataFormatException;
+import java.util.zip.Deflater;
+import java.util.zip.Inflater;
+
+/**
+ * Compression of large clipboard texts.
+ * <p>
+ * If {@link #COMPRESSED_FLAG} is set in the length of a clipboard text, then the payload is the uncompressed length (4 bytes) followed by the
+ * zlib-compressed text.
+ */
+public final class ClipboardCompression {
+
+    public static final int COMPRESSED_FLAG = 0x80000000;
+
+    // Do not compress smaller clipboard texts
+    public static final int MIN_LENGTH = 1024;
+
+    private ClipboardCompression() {
+        // not instantiable
+    }
+
+    /**
+     * Compress the {@code len} first bytes of {@code data}.
+     *
+     * @return the compressed data, or {@code null} if it would not be smaller than the raw data (including the uncompressed length)
+     */
+    public static byte[] compress(byte[] data, int len) {
+        Deflater deflater = new Deflater(Deflater.BEST_SPEED);
+        try {
+            deflater.setInput(data, 0, len);
+            deflater.finish();
+
+            byte[] out = new byte[len - 4];
+            int outLen = 0;
+            while (!deflater.finished() && outLen < out.length) {
+                outLen += deflater.deflate(out, outLen, out.length - outLen);
+            }
+
+            if (!deflater.finished()) {
+                // Not compressible enough
+                return null;
+            }
+
+            return Arrays.copyOf(out, outLen);
+        } finally {
+            deflater.end();
+        }
+    }
+
+    public static byte[] decompress(byte[] data, int uncompressedLen) throws ControlProtocolException {
+        Inflater inflater = new Inflater();
+        try {
+            inflater.setInput(data);
+
+            byte[] out = new byte[uncompressedLen];
+            int outLen = 0;
+            while (!inflater.finished() && outLen < out.length) {
+                int r = inflater.inflate(out, outLen, out.length - outLen);
+                if (r == 0 && (inflater.needsInput() || inflater.needsDictionary())) {
+                    break;
+                }
+                outLen += r;
+            }
+
+            if (!inflater.finished() || outLen != uncompressedLen) {
+                throw new ControlProtocolException("Invalid compressed clipboard");
+            }
+
+            return out;
+        } catch (DataFormatException e) {
+            throw new ControlProtocolException("Invalid compressed clipboard: " + e.getMessage());
+        } finally {
+            inflater.end();
+        }
+    }
+}
@@ -0,0 +1,33 @@
+package com.genymobile.scrcpy.control;
+
+import java.nio.charset.StandardCharsets;
+
+/**
+ * Hash of clipboard texts, to avoid transferring a text that the other side already has.
+ * <p>
+ * If {@link #HASH_FLAG} is set in the length of a clipboard text, then the payload is only the hash (8 bytes) of a text that the device
+ * clipboard is expected to contain.
+ */
+public final class ClipboardHash {
+
+    public static final int HASH_FLAG = 0x40000000;
+
+    private static final long FNV_OFFSET_BASIS = 0xcbf29ce484222325L;
+    private static final long FNV_PRIME = 0x100000001b3L;
+
+    private ClipboardHash() {
+        // not instantiable
+    }
+
+    /**
+     * Compute the 64-bit FNV-1a hash of the UTF-8 representation of {@code text} (the same as {@code sc_str_hash()} on the client side).
+     */
+    public static long hash(String text) {
+        byte[] data = text.getBytes(StandardCharsets.UTF_8);
+        long h = FNV_OFFSET_BASIS;
+        for (byte b : data) {
+            h = (h ^ (b & 0xff)) * FNV_PRIME;
+        }
+        return h;
+    }
+}
@@ -1,24 +1,33 @@
 package com.genymobile.scrcpy.control;
 
-import android.net.LocalSocket;
-
 import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.List;
 
 public final class ControlChannel {
 
     private final ControlMessageReader reader;
     private final DeviceMessageWriter writer;
 
-    public ControlChannel(LocalSocket controlSocket) throws IOException {
-        reader = new ControlMessageReader(controlSocket.getInputStream());
-        writer = new DeviceMessageWriter(controlSocket.getOutputStream());
+    public ControlChannel(InputStream input, OutputStream output) {
+        reader = new ControlMessageReader(input);
+        writer = new DeviceMessageWriter(output);
     }
 
     public ControlMessage recv() throws IOException {
         return reader.read();
     }
 
+    public void setClipboardCompression(boolean clipboardCompression) {
+        writer.setClipboardCompression(clipboardCompression);
+    }
+
     public void send(DeviceMessage msg) throws IOException {
         writer.write(msg);
     }
+
+    public void send(List<DeviceMessage> msgs) throws IOException {
+        writer.write(msgs);
+    }
 }
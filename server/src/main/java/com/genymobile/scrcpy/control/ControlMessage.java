@@ -1,6 +1,8 @@
 package com.genymobile.scrcpy.control;
 
+import com.genymobile.scrcpy.device.Point;
 import com.genymobile.scrcpy.device.Position;
+import com.genymobile.scrcpy.device.Size;
 
 /**
  * Union of all supported event types, identified by their {@code type}.
@@ -25,6 +27,21 @@ public final class ControlMessage {
     public static final int TYPE_OPEN_HARD_KEYBOARD_SETTINGS = 15;
     public static final int TYPE_START_APP = 16;
     public static final int TYPE_RESET_VIDEO = 17;
+    public static final int TYPE_GET_CLOCK = 18;
+    public static final int TYPE_VIDEO_FEEDBACK = 19;
+    public static final int TYPE_REQUEST_KEYFRAME = 20;
+    public static final int TYPE_INJECT_TOUCH_BATCH = 21;
+    public static final int TYPE_PING = 22;
+    public static final int TYPE_INJECT_TEXT_STREAM = 23;
+    public static final int TYPE_SET_VIDEO_THROTTLE = 24;
+    public static final int TYPE_SET_VIDEO_PROFILE = 25;
+    public static final int TYPE_SET_VIDEO_VIEW_SIZE = 26;
+    // Only used on the wire, reassembled by the ControlMessageReader
+    public static final int TYPE_FRAGMENT = 27;
+    // Only used on the wire, decoded to TYPE_INJECT_TOUCH_EVENT and TYPE_INJECT_SCROLL_EVENT by the ControlMessageReader
+    public static final int TYPE_INJECT_TOUCH_COMPACT = 28;
+    public static final int TYPE_INJECT_SCROLL_COMPACT = 29;
+    public static final int TYPE_RESIZE_DISPLAY = 30;
 
     public static final long SEQUENCE_INVALID = 0;
 
@@ -42,31 +59,55 @@ public final class ControlMessage {
     private long pointerId;
     private float pressure;
     private Position position;
+    // For touch batches, one item per sample, oldest first
+    private Position[] positions;
+    private float[] pressures;
+    private int[] ages; // µs before the last sample
     private float hScroll;
     private float vScroll;
     private int copyKey;
     private boolean paste;
     private int repeat;
     private long sequence;
+    private long clipboardHash;
+    private long timestamp;
     private int id;
     private byte[] data;
     private boolean on;
     private int vendorId;
     private int productId;
-
-    private ControlMessage() {
+    private int receiveRate; // bytes per second
+    private int delay; // µs
+    private int frames;
+    private int skippedFrames;
+    private int maxFps; // 0 to restore the initial value
+    private boolean paused;
+    private int maxSize; // 0 to restore the initial value (or to remove the view limit)
+    private int bitRate; // 0 to restore the initial value
+    private Size cropSize; // null to restore the initial value
+    private Point cropOffset;
+    private Size displaySize;
+    private int dpi; // 0 to keep the current value
+
+    ControlMessage() {
     }
 
     public static ControlMessage createInjectKeycode(int action, int keycode, int repeat, int metaState) {
         ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_KEYCODE;
-        msg.action = action;
-        msg.keycode = keycode;
-        msg.repeat = repeat;
-        msg.metaState = metaState;
+        msg.setInjectKeycode(action, keycode, repeat, metaState);
         return msg;
     }
 
+    // The setters below refill a message owned by the ControlMessageReader, to avoid an allocation per input event
+
+    void setInjectKeycode(int action, int keycode, int repeat, int metaState) {
+        this.type = TYPE_INJECT_KEYCODE;
+        this.action = action;
+        this.keycode = keycode;
+        this.repeat = repeat;
+        this.metaState = metaState;
+    }
+
     public static ControlMessage createInjectText(String text) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_INJECT_TEXT;
@@ -74,29 +115,61 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createInjectTextStream(String text) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_INJECT_TEXT_STREAM;
+        msg.text = text;
+        return msg;
+    }
+
     public static ControlMessage createInjectTouchEvent(int action, long pointerId, Position position, float pressure, int actionButton,
             int buttons) {
         ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_TOUCH_EVENT;
+        msg.setInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons, 0);
+        return msg;
+    }
+
+    void setInjectTouchEvent(int action, long pointerId, Position position, float pressure, int actionButton, int buttons, long timestamp) {
+        this.type = TYPE_INJECT_TOUCH_EVENT;
+        this.action = action;
+        this.pointerId = pointerId;
+        this.pressure = pressure;
+        this.position = position;
+        this.actionButton = actionButton;
+        this.buttons = buttons;
+        this.timestamp = timestamp;
+    }
+
+    public static ControlMessage createInjectTouchBatch(int action, long pointerId, Position[] positions, float[] pressures, int[] ages,
+            int actionButton, int buttons, long timestamp) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_INJECT_TOUCH_BATCH;
         msg.action = action;
         msg.pointerId = pointerId;
-        msg.pressure = pressure;
-        msg.position = position;
+        msg.positions = positions;
+        msg.pressures = pressures;
+        msg.ages = ages;
         msg.actionButton = actionButton;
         msg.buttons = buttons;
+        msg.timestamp = timestamp;
         return msg;
     }
 
     public static ControlMessage createInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons) {
         ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_SCROLL_EVENT;
-        msg.position = position;
-        msg.hScroll = hScroll;
-        msg.vScroll = vScroll;
-        msg.buttons = buttons;
+        msg.setInjectScrollEvent(position, hScroll, vScroll, buttons, 0);
         return msg;
     }
 
+    void setInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons, long timestamp) {
+        this.type = TYPE_INJECT_SCROLL_EVENT;
+        this.position = position;
+        this.hScroll = hScroll;
+        this.vScroll = vScroll;
+        this.buttons = buttons;
+        this.timestamp = timestamp;
+    }
+
     public static ControlMessage createBackOrScreenOn(int action) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_BACK_OR_SCREEN_ON;
@@ -120,6 +193,18 @@ public final class ControlMessage {
         return msg;
     }
 
+    /**
+     * Set the device clipboard to the text it already contains, referenced by its hash (see {@link ClipboardHash})
+     */
+    public static ControlMessage createSetClipboardByHash(long sequence, long clipboardHash, boolean paste) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_CLIPBOARD;
+        msg.sequence = sequence;
+        msg.clipboardHash = clipboardHash;
+        msg.paste = paste;
+        return msg;
+    }
+
     public static ControlMessage createSetDisplayPower(boolean on) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_SET_DISPLAY_POWER;
@@ -159,6 +244,65 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createGetClock(long timestamp) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_GET_CLOCK;
+        msg.timestamp = timestamp;
+        return msg;
+    }
+
+    public static ControlMessage createPing(long sequence, long timestamp) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_PING;
+        msg.sequence = sequence;
+        msg.timestamp = timestamp;
+        return msg;
+    }
+
+    public static ControlMessage createVideoFeedback(int receiveRate, int delay, int frames, int skippedFrames) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_VIDEO_FEEDBACK;
+        msg.receiveRate = receiveRate;
+        msg.delay = delay;
+        msg.frames = frames;
+        msg.skippedFrames = skippedFrames;
+        return msg;
+    }
+
+    public static ControlMessage createSetVideoThrottle(int maxFps, boolean paused) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_VIDEO_THROTTLE;
+        msg.maxFps = maxFps;
+        msg.paused = paused;
+        return msg;
+    }
+
+    public static ControlMessage createSetVideoProfile(int maxSize, int bitRate, int maxFps, Size cropSize, Point cropOffset) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_VIDEO_PROFILE;
+        msg.maxSize = maxSize;
+        msg.bitRate = bitRate;
+        msg.maxFps = maxFps;
+        msg.cropSize = cropSize;
+        msg.cropOffset = cropOffset;
+        return msg;
+    }
+
+    public static ControlMessage createSetVideoViewSize(int maxSize) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_VIDEO_VIEW_SIZE;
+        msg.maxSize = maxSize;
+        return msg;
+    }
+
+    public static ControlMessage createResizeDisplay(Size displaySize, int dpi) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_RESIZE_DISPLAY;
+        msg.displaySize = displaySize;
+        msg.dpi = dpi;
+        return msg;
+    }
+
     public static ControlMessage createStartApp(String name) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_START_APP;
@@ -206,6 +350,18 @@ public final class ControlMessage {
         return position;
     }
 
+    public Position[] getPositions() {
+        return positions;
+    }
+
+    public float[] getPressures() {
+        return pressures;
+    }
+
+    public int[] getAges() {
+        return ages;
+    }
+
     public float getHScroll() {
         return hScroll;
     }
@@ -230,6 +386,14 @@ public final class ControlMessage {
         return sequence;
     }
 
+    public long getClipboardHash() {
+        return clipboardHash;
+    }
+
+    public long getTimestamp() {
+        return timestamp;
+    }
+
     public int getId() {
         return id;
     }
@@ -249,4 +413,52 @@ public final class ControlMessage {
     public int getProductId() {
         return productId;
     }
+
+    public int getReceiveRate() {
+        return receiveRate;
+    }
+
+    public int getDelay() {
+        return delay;
+    }
+
+    public int getFrames() {
+        return frames;
+    }
+
+    public int getSkippedFrames() {
+        return skippedFrames;
+    }
+
+    public int getMaxFps() {
+        return maxFps;
+    }
+
+    public boolean getPaused() {
+        return paused;
+    }
+
+    public int getMaxSize() {
+        return maxSize;
+    }
+
+    public int getBitRate() {
+        return bitRate;
+    }
+
+    public Size getCropSize() {
+        return cropSize;
+    }
+
+    public Point getCropOffset() {
+        return cropOffset;
+    }
+
+    public Size getDisplaySize() {
+        return displaySize;
+    }
+
+    public int getDpi() {
+        return dpi;
+    }
 }
@@ -1,38 +1,116 @@
 package com.genymobile.scrcpy.control;
 
+import com.genymobile.scrcpy.device.Point;
 import com.genymobile.scrcpy.device.Position;
+import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.Binary;
 
 import java.io.BufferedInputStream;
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
 import java.io.DataInputStream;
 import java.io.IOException;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
 import java.nio.charset.StandardCharsets;
 
+/**
+ * Parse the control messages received from the client.
+ * <p/>
+ * To avoid allocations for high-rate input events, the messages of type {@link ControlMessage#TYPE_INJECT_KEYCODE},
+ * {@link ControlMessage#TYPE_INJECT_TOUCH_EVENT} and {@link ControlMessage#TYPE_INJECT_SCROLL_EVENT} are refilled in place: the returned
+ * message is only valid until the next call to {@link #read()}. The other messages are always new instances.
+ * <p/>
+ * The compact touch and scroll events ({@link ControlMessage#TYPE_INJECT_TOUCH_COMPACT} and
+ * {@link ControlMessage#TYPE_INJECT_SCROLL_COMPACT}) are decoded relative to the previous ones: the reader keeps the last values of each
+ * pointer.
+ */
 public class ControlMessageReader {
 
     private static final int MESSAGE_MAX_SIZE = 1 << 18; // 256k
 
     public static final int CLIPBOARD_TEXT_MAX_LENGTH = MESSAGE_MAX_SIZE - 14; // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
     public static final int INJECT_TEXT_MAX_LENGTH = 300;
+    public static final int TEXT_STREAM_CHUNK_MAX_LENGTH = 4096;
+
+    private static final int INJECT_KEYCODE_PAYLOAD_LENGTH = 13;
+    private static final int INJECT_TOUCH_EVENT_PAYLOAD_LENGTH = 31;
+    private static final int INJECT_SCROLL_EVENT_PAYLOAD_LENGTH = 20;
+    private static final int PAYLOAD_BUFFER_SIZE = INJECT_TOUCH_EVENT_PAYLOAD_LENGTH;
+
+    private static final int INPUT_BUFFER_SIZE = 16 * 1024;
+
+    private static final int COMPACT_POINTERS = 16;
+    private static final int COMPACT_FLAG_POINTER_ID = 0x01;
+    private static final int COMPACT_FLAG_SCREEN_SIZE = 0x02;
+    private static final int COMPACT_FLAG_PRESSURE = 0x04;
+    private static final int COMPACT_FLAG_ACTION_BUTTON = 0x08;
+    private static final int COMPACT_FLAG_BUTTONS = 0x10;
+    private static final int COMPACT_FLAG_HSCROLL = 0x20;
+    private static final int COMPACT_FLAG_VSCROLL = 0x40;
 
     private final DataInputStream dis;
 
+    // Fixed-size payloads are read at once, then decoded without per-byte reads
+    private final ByteBuffer payload = ByteBuffer.allocate(PAYLOAD_BUFFER_SIZE);
+
+    private final ControlMessage injectKeycodeMsg = new ControlMessage();
+    private final ControlMessage injectTouchEventMsg = new ControlMessage();
+    private final ControlMessage injectScrollEventMsg = new ControlMessage();
+
+    // The screen size rarely changes between consecutive events
+    private Size lastScreenSize;
+
+    // Last values of the compact events, per pointer slot
+    private final boolean[] compactUsed = new boolean[COMPACT_POINTERS];
+    private final long[] compactPointerIds = new long[COMPACT_POINTERS];
+    private final int[] compactX = new int[COMPACT_POINTERS];
+    private final int[] compactY = new int[COMPACT_POINTERS];
+    private final short[] compactPressures = new short[COMPACT_POINTERS];
+    private final int[] compactActionButtons = new int[COMPACT_POINTERS];
+    private final int[] compactButtons = new int[COMPACT_POINTERS];
+    private Size compactScreenSize = new Size(0, 0);
+    private int compactScrollX;
+    private int compactScrollY;
+    private int compactScrollButtons;
+    private long compactTimestamp; // µs, client clock
+
+    // Reassembly of a large message received in fragments, interleaved with other messages
+    private final ByteArrayOutputStream fragments = new ByteArrayOutputStream();
+
     public ControlMessageReader(InputStream rawInputStream) {
-        dis = new DataInputStream(new BufferedInputStream(rawInputStream));
+        dis = new DataInputStream(new BufferedInputStream(rawInputStream, INPUT_BUFFER_SIZE));
     }
 
     public ControlMessage read() throws IOException {
-        int type = dis.readUnsignedByte();
+        int type;
+        while ((type = dis.readUnsignedByte()) == ControlMessage.TYPE_FRAGMENT) {
+            ControlMessage msg = parseFragment();
+            if (msg != null) {
+                return msg;
+            }
+        }
+        return parse(type);
+    }
+
+    private ControlMessage parse(int type) throws IOException {
         switch (type) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 return parseInjectKeycode();
             case ControlMessage.TYPE_INJECT_TEXT:
                 return parseInjectText();
+            case ControlMessage.TYPE_INJECT_TEXT_STREAM:
+                return parseInjectTextStream();
             case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
                 return parseInjectTouchEvent();
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 return parseInjectScrollEvent();
+            case ControlMessage.TYPE_INJECT_TOUCH_COMPACT:
+                return parseInjectTouchCompact();
+            case ControlMessage.TYPE_INJECT_SCROLL_COMPACT:
+                return parseInjectScrollCompact();
+            case ControlMessage.TYPE_INJECT_TOUCH_BATCH:
+                return parseInjectTouchBatch();
             case ControlMessage.TYPE_BACK_OR_SCREEN_ON:
                 return parseBackOrScreenOnEvent();
             case ControlMessage.TYPE_GET_CLIPBOARD:
@@ -47,6 +125,7 @@ public class ControlMessageReader {
             case ControlMessage.TYPE_ROTATE_DEVICE:
             case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
             case ControlMessage.TYPE_RESET_VIDEO:
+            case ControlMessage.TYPE_REQUEST_KEYFRAME:
                 return ControlMessage.createEmpty(type);
             case ControlMessage.TYPE_UHID_CREATE:
                 return parseUhidCreate();
@@ -56,17 +135,71 @@ public class ControlMessageReader {
                 return parseUhidDestroy();
             case ControlMessage.TYPE_START_APP:
                 return parseStartApp();
+            case ControlMessage.TYPE_GET_CLOCK:
+                return parseGetClock();
+            case ControlMessage.TYPE_PING:
+                return parsePing();
+            case ControlMessage.TYPE_VIDEO_FEEDBACK:
+                return parseVideoFeedback();
+            case ControlMessage.TYPE_SET_VIDEO_THROTTLE:
+                return parseSetVideoThrottle();
+            case ControlMessage.TYPE_SET_VIDEO_PROFILE:
+                return parseSetVideoProfile();
+            case ControlMessage.TYPE_SET_VIDEO_VIEW_SIZE:
+                return parseSetVideoViewSize();
+            case ControlMessage.TYPE_RESIZE_DISPLAY:
+                return parseResizeDisplay();
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
     }
 
+    /**
+     * Append a fragment to the message being reassembled.
+     *
+     * @return the reassembled message if this fragment was the last one, {@code null} otherwise
+     */
+    private ControlMessage parseFragment() throws IOException {
+        boolean last = dis.readByte() != 0;
+        byte[] data = parseByteArray(2);
+        if (fragments.size() + data.length > MESSAGE_MAX_SIZE) {
+            throw new ControlProtocolException("Fragmented message too large");
+        }
+        fragments.write(data, 0, data.length);
+        if (!last) {
+            return null;
+        }
+
+        byte[] packet = fragments.toByteArray();
+        fragments.reset();
+
+        ControlMessageReader reader = new ControlMessageReader(new ByteArrayInputStream(packet));
+        int type = reader.dis.readUnsignedByte();
+        if (type == ControlMessage.TYPE_FRAGMENT) {
+            throw new ControlProtocolException("Nested fragment");
+        }
+        ControlMessage msg = reader.parse(type);
+        if (reader.dis.available() != 0) {
+            throw new ControlProtocolException("Invalid fragmented message");
+        }
+        return msg;
+    }
+
+    private ByteBuffer readPayload(int length) throws IOException {
+        assert length <= PAYLOAD_BUFFER_SIZE;
+        dis.readFully(payload.array(), 0, length);
+        payload.clear();
+        return payload;
+    }
+
     private ControlMessage parseInjectKeycode() throws IOException {
-        int action = dis.readUnsignedByte();
-        int keycode = dis.readInt();
-        int repeat = dis.readInt();
-        int metaState = dis.readInt();
-        return ControlMessage.createInjectKeycode(action, keycode, repeat, metaState);
+        ByteBuffer buffer = readPayload(INJECT_KEYCODE_PAYLOAD_LENGTH);
+        int action = buffer.get() & 0xff;
+        int keycode = buffer.getInt();
+        int repeat = buffer.getInt();
+        int metaState = buffer.getInt();
+        injectKeycodeMsg.setInjectKeycode(action, keycode, repeat, metaState);
+        return injectKeycodeMsg;
     }
 
     private int parseBufferLength(int sizeBytes) throws IOException {
@@ -95,28 +228,176 @@ public class ControlMessageReader {
         return data;
     }
 
+    private String parseClipboardText(int value) throws IOException {
+        if ((value & ClipboardCompression.COMPRESSED_FLAG) == 0) {
+            byte[] data = new byte[value];
+            dis.readFully(data);
+            return new String(data, StandardCharsets.UTF_8);
+        }
+
+        int len = value & ~ClipboardCompression.COMPRESSED_FLAG;
+        if (len < 4) {
+            throw new ControlProtocolException("Invalid compressed clipboard");
+        }
+        int uncompressedLen = dis.readInt();
+        if (uncompressedLen < 0 || uncompressedLen > CLIPBOARD_TEXT_MAX_LENGTH) {
+            throw new ControlProtocolException("Compressed clipboard too large: " + uncompressedLen);
+        }
+        byte[] compressed = new byte[len - 4];
+        dis.readFully(compressed);
+        byte[] data = ClipboardCompression.decompress(compressed, uncompressedLen);
+        return new String(data, StandardCharsets.UTF_8);
+    }
+
     private ControlMessage parseInjectText() throws IOException {
         String text = parseString();
         return ControlMessage.createInjectText(text);
     }
 
+    private ControlMessage parseInjectTextStream() throws IOException {
+        int len = dis.readInt();
+        if (len < 0 || len > TEXT_STREAM_CHUNK_MAX_LENGTH) {
+            throw new ControlProtocolException("Text stream chunk too large: " + len);
+        }
+        byte[] data = new byte[len];
+        dis.readFully(data);
+        return ControlMessage.createInjectTextStream(new String(data, StandardCharsets.UTF_8));
+    }
+
     private ControlMessage parseInjectTouchEvent() throws IOException {
+        ByteBuffer buffer = readPayload(INJECT_TOUCH_EVENT_PAYLOAD_LENGTH);
+        int action = buffer.get() & 0xff;
+        long pointerId = buffer.getLong();
+        Position position = parsePosition(buffer);
+        float pressure = Binary.u16FixedPointToFloat(buffer.getShort());
+        int actionButton = buffer.getInt();
+        int buttons = buffer.getInt();
+        injectTouchEventMsg.setInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons, 0);
+        return injectTouchEventMsg;
+    }
+
+    private ControlMessage parseInjectTouchBatch() throws IOException {
         int action = dis.readUnsignedByte();
         long pointerId = dis.readLong();
-        Position position = parsePosition();
-        float pressure = Binary.u16FixedPointToFloat(dis.readShort());
+        int screenWidth = dis.readUnsignedShort();
+        int screenHeight = dis.readUnsignedShort();
         int actionButton = dis.readInt();
         int buttons = dis.readInt();
-        return ControlMessage.createInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons);
+        long timestamp = dis.readLong();
+        int count = dis.readUnsignedByte();
+        Position[] positions = new Position[count];
+        float[] pressures = new float[count];
+        int[] ages = new int[count];
+        for (int i = 0; i < count; ++i) {
+            int x = dis.readInt();
+            int y = dis.readInt();
+            positions[i] = new Position(x, y, screenWidth, screenHeight);
+            pressures[i] = Binary.u16FixedPointToFloat(dis.readShort());
+            // The unsigned 32-bit values never exceed Integer.MAX_VALUE in practice
+            ages[i] = (int) Math.min(dis.readInt() & 0xffffffffL, Integer.MAX_VALUE);
+        }
+        return ControlMessage.createInjectTouchBatch(action, pointerId, positions, pressures, ages, actionButton, buttons, timestamp);
     }
 
     private ControlMessage parseInjectScrollEvent() throws IOException {
-        Position position = parsePosition();
+        ByteBuffer buffer = readPayload(INJECT_SCROLL_EVENT_PAYLOAD_LENGTH);
+        Position position = parsePosition(buffer);
         // Binary.i16FixedPointToFloat() decodes values assuming the full range is [-1, 1], but the actual range is [-16, 16].
-        float hScroll = Binary.i16FixedPointToFloat(dis.readShort()) * 16;
-        float vScroll = Binary.i16FixedPointToFloat(dis.readShort()) * 16;
-        int buttons = dis.readInt();
-        return ControlMessage.createInjectScrollEvent(position, hScroll, vScroll, buttons);
+        float hScroll = Binary.i16FixedPointToFloat(buffer.getShort()) * 16;
+        float vScroll = Binary.i16FixedPointToFloat(buffer.getShort()) * 16;
+        int buttons = buffer.getInt();
+        injectScrollEventMsg.setInjectScrollEvent(position, hScroll, vScroll, buttons, 0);
+        return injectScrollEventMsg;
+    }
+
+    private ControlMessage parseInjectTouchCompact() throws IOException {
+        int header = dis.readUnsignedByte();
+        int action = header & 0xf;
+        int slot = header >> 4;
+        int flags = dis.readUnsignedByte();
+
+        if ((flags & COMPACT_FLAG_POINTER_ID) != 0) {
+            // New pointer in this slot, reset its values
+            compactUsed[slot] = true;
+            compactPointerIds[slot] = dis.readLong();
+            compactX[slot] = 0;
+            compactY[slot] = 0;
+            compactPressures[slot] = 0;
+            compactActionButtons[slot] = 0;
+            compactButtons[slot] = 0;
+        } else if (!compactUsed[slot]) {
+            throw new ControlProtocolException("Unknown compact pointer slot: " + slot);
+        }
+
+        parseCompactScreenSize(flags);
+        compactX[slot] = parseDelta(compactX[slot]);
+        compactY[slot] = parseDelta(compactY[slot]);
+        compactTimestamp += parseZigzag();
+        if ((flags & COMPACT_FLAG_PRESSURE) != 0) {
+            compactPressures[slot] = dis.readShort();
+        }
+        if ((flags & COMPACT_FLAG_ACTION_BUTTON) != 0) {
+            compactActionButtons[slot] = (int) parseVarLong();
+        }
+        if ((flags & COMPACT_FLAG_BUTTONS) != 0) {
+            compactButtons[slot] = (int) parseVarLong();
+        }
+
+        Position position = new Position(new Point(compactX[slot], compactY[slot]), compactScreenSize);
+        float pressure = Binary.u16FixedPointToFloat(compactPressures[slot]);
+        injectTouchEventMsg.setInjectTouchEvent(action, compactPointerIds[slot], position, pressure, compactActionButtons[slot],
+                compactButtons[slot], compactTimestamp);
+        return injectTouchEventMsg;
+    }
+
+    private ControlMessage parseInjectScrollCompact() throws IOException {
+        int flags = dis.readUnsignedByte();
+        parseCompactScreenSize(flags);
+        compactScrollX = parseDelta(compactScrollX);
+        compactScrollY = parseDelta(compactScrollY);
+        compactTimestamp += parseZigzag();
+        // Binary.i16FixedPointToFloat() decodes values assuming the full range is [-1, 1], but the actual range is [-16, 16].
+        float hScroll = (flags & COMPACT_FLAG_HSCROLL) != 0 ? Binary.i16FixedPointToFloat(dis.readShort()) * 16 : 0;
+        float vScroll = (flags & COMPACT_FLAG_VSCROLL) != 0 ? Binary.i16FixedPointToFloat(dis.readShort()) * 16 : 0;
+        if ((flags & COMPACT_FLAG_BUTTONS) != 0) {
+            compactScrollButtons = (int) parseVarLong();
+        }
+
+        Position position = new Position(new Point(compactScrollX, compactScrollY), compactScreenSize);
+        injectScrollEventMsg.setInjectScrollEvent(position, hScroll, vScroll, compactScrollButtons, compactTimestamp);
+        return injectScrollEventMsg;
+    }
+
+    private void parseCompactScreenSize(int flags) throws IOException {
+        if ((flags & COMPACT_FLAG_SCREEN_SIZE) != 0) {
+            int width = (int) parseVarLong();
+            int height = (int) parseVarLong();
+            compactScreenSize = new Size(width, height);
+        }
+    }
+
+    // Unsigned LEB128 variable-length integer
+    private long parseVarLong() throws IOException {
+        long value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int b = dis.readUnsignedByte();
+            value |= (long) (b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw new ControlProtocolException("Invalid variable-length integer");
+    }
+
+    // Zigzag-encoded signed variable-length integer
+    private long parseZigzag() throws IOException {
+        long zigzag = parseVarLong();
+        return (zigzag >>> 1) ^ -(zigzag & 1);
+    }
+
+    // Zigzag-encoded delta relative to the previous value
+    private int parseDelta(int prev) throws IOException {
+        return (int) (prev + parseZigzag());
     }
 
     private ControlMessage parseBackOrScreenOnEvent() throws IOException {
@@ -132,7 +413,15 @@ public class ControlMessageReader {
     private ControlMessage parseSetClipboard() throws IOException {
         long sequence = dis.readLong();
         boolean paste = dis.readByte() != 0;
-        String text = parseString();
+        int value = dis.readInt();
+        if ((value & ClipboardHash.HASH_FLAG) != 0) {
+            if ((value & ~ClipboardHash.HASH_FLAG) != 8) {
+                throw new ControlProtocolException("Invalid clipboard hash");
+            }
+            long hash = dis.readLong();
+            return ControlMessage.createSetClipboardByHash(sequence, hash, paste);
+        }
+        String text = parseClipboardText(value);
         return ControlMessage.createSetClipboard(sequence, text, paste);
     }
 
@@ -166,11 +455,75 @@ public class ControlMessageReader {
         return ControlMessage.createStartApp(name);
     }
 
-    private Position parsePosition() throws IOException {
-        int x = dis.readInt();
-        int y = dis.readInt();
-        int screenWidth = dis.readUnsignedShort();
-        int screenHeight = dis.readUnsignedShort();
-        return new Position(x, y, screenWidth, screenHeight);
+    private ControlMessage parseGetClock() throws IOException {
+        long timestamp = dis.readLong();
+        return ControlMessage.createGetClock(timestamp);
+    }
+
+    private ControlMessage parsePing() throws IOException {
+        long sequence = dis.readLong();
+        long timestamp = dis.readLong();
+        return ControlMessage.createPing(sequence, timestamp);
+    }
+
+    private ControlMessage parseVideoFeedback() throws IOException {
+        // The unsigned 32-bit values never exceed Integer.MAX_VALUE in practice
+        int receiveRate = (int) Math.min(dis.readInt() & 0xffffffffL, Integer.MAX_VALUE);
+        int delay = (int) Math.min(dis.readInt() & 0xffffffffL, Integer.MAX_VALUE);
+        int frames = dis.readUnsignedShort();
+        int skippedFrames = dis.readUnsignedShort();
+        return ControlMessage.createVideoFeedback(receiveRate, delay, frames, skippedFrames);
+    }
+
+    private ControlMessage parseSetVideoThrottle() throws IOException {
+        int maxFps = dis.readUnsignedShort();
+        boolean paused = dis.readBoolean();
+        return ControlMessage.createSetVideoThrottle(maxFps, paused);
+    }
+
+    private ControlMessage parseSetVideoProfile() throws IOException {
+        int maxSize = dis.readUnsignedShort();
+        // The unsigned 32-bit value never exceeds Integer.MAX_VALUE in practice
+        int bitRate = (int) Math.min(dis.readInt() & 0xffffffffL, Integer.MAX_VALUE);
+        int maxFps = dis.readUnsignedShort();
+        int cropWidth = dis.readUnsignedShort();
+        int cropHeight = dis.readUnsignedShort();
+        int cropX = dis.readUnsignedShort();
+        int cropY = dis.readUnsignedShort();
+        Size cropSize = null;
+        Point cropOffset = null;
+        if (cropWidth != 0 && cropHeight != 0) {
+            cropSize = new Size(cropWidth, cropHeight);
+            cropOffset = new Point(cropX, cropY);
+        }
+        return ControlMessage.createSetVideoProfile(maxSize, bitRate, maxFps, cropSize, cropOffset);
+    }
+
+    private ControlMessage parseSetVideoViewSize() throws IOException {
+        int maxSize = dis.readUnsignedShort();
+        return ControlMessage.createSetVideoViewSize(maxSize);
+    }
+
+    private ControlMessage parseResizeDisplay() throws IOException {
+        int width = dis.readUnsignedShort();
+        int height = dis.readUnsignedShort();
+        int dpi = dis.readUnsignedShort();
+        if (width == 0 || height == 0) {
+            throw new ControlProtocolException("Invalid display size: " + width + "x" + height);
+        }
+        return ControlMessage.createResizeDisplay(new Size(width, height), dpi);
+    }
+
+    private Position parsePosition(ByteBuffer buffer) {
+        int x = buffer.getInt();
+        int y = buffer.getInt();
+        int screenWidth = buffer.getShort() & 0xffff;
+        int screenHeight = buffer.getShort() & 0xffff;
+        Size screenSize = lastScreenSize;
+        if (screenSize == null || screenSize.getWidth() != screenWidth || screenSize.getHeight() != screenHeight) {
+            screenSize = new Size(screenWidth, screenHeight);
+            lastScreenSize = screenSize;
+        }
+        return new Position(new Point(x, y), screenSize);
     }
 }
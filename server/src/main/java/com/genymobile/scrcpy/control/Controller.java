@@ -12,14 +12,20 @@ import com.genymobile.scrcpy.device.Position;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
+import com.genymobile.scrcpy.video.BitRateAdapter;
+import com.genymobile.scrcpy.video.KeyFrameRequester;
 import com.genymobile.scrcpy.video.SurfaceCapture;
+import com.genymobile.scrcpy.video.VideoIdleDetector;
+import com.genymobile.scrcpy.video.VideoThrottle;
 import com.genymobile.scrcpy.video.VirtualDisplayListener;
 import com.genymobile.scrcpy.wrappers.ClipboardManager;
 import com.genymobile.scrcpy.wrappers.InputManager;
 import com.genymobile.scrcpy.wrappers.ServiceManager;
 
 import android.content.Intent;
+import android.graphics.Rect;
 import android.os.Build;
+import android.os.Process;
 import android.os.SystemClock;
 import android.util.Pair;
 import android.view.InputDevice;
@@ -29,6 +35,7 @@ import android.view.MotionEvent;
 
 import java.io.IOException;
 import java.util.List;
+import java.util.Objects;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
 import java.util.concurrent.ScheduledExecutorService;
@@ -36,7 +43,7 @@ import java.util.concurrent.TimeUnit;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicReference;
 
-public class Controller implements AsyncProcessor, VirtualDisplayListener {
+public class Controller implements AsyncProcessor, VirtualDisplayListener, VideoIdleDetector.Listener {
 
     /*
      * For event injection, there are two display ids:
@@ -70,6 +77,9 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
 
     private static final ScheduledExecutorService EXECUTOR = Executors.newSingleThreadScheduledExecutor();
     private ExecutorService startAppExecutor;
+    // The control messages are read and the input events are injected from the control thread (with a high priority), the slow commands are
+    // handled in order on a separate thread
+    private final ExecutorService slowCommandExecutor = Executors.newSingleThreadExecutor(r -> new Thread(r, "control-slow"));
 
     private Thread thread;
 
@@ -86,26 +96,56 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     private final KeyCharacterMap charMap = KeyCharacterMap.load(KeyCharacterMap.VIRTUAL_KEYBOARD);
 
     private final AtomicBoolean isSettingClipboard = new AtomicBoolean();
+    // Hash of the text set from the computer, to ignore the clipboard change notification if it is received late
+    private volatile Long setClipboardHash;
 
     private final AtomicReference<DisplayData> displayData = new AtomicReference<>();
     private final Object displayDataAvailable = new Object(); // condition variable
 
     private long lastTouchDown;
+    private final EventTimeMapper eventTimeMapper;
     private final PointersState pointersState = new PointersState();
     private final MotionEvent.PointerProperties[] pointerProperties = new MotionEvent.PointerProperties[PointersState.MAX_POINTERS];
     private final MotionEvent.PointerCoords[] pointerCoords = new MotionEvent.PointerCoords[PointersState.MAX_POINTERS];
 
-    private boolean keepDisplayPowerOff;
+    private volatile boolean keepDisplayPowerOff; // written by the slow command thread
 
-    // Used for resetting video encoding on RESET_VIDEO message
+    // Used for resetting video encoding on RESET_VIDEO and SET_VIDEO_PROFILE messages
     private SurfaceCapture surfaceCapture;
 
+    // Restored by a SET_VIDEO_PROFILE message without explicit values
+    private final int initialMaxSize;
+    private final Rect initialCrop;
+    // The values of the last SET_VIDEO_PROFILE message
+    private int profileMaxSize;
+    private Rect videoCrop;
+    // The max size requested by SET_VIDEO_VIEW_SIZE messages (0 for no limit)
+    private int viewMaxSize;
+    // The max size applied to the capture
+    private int videoMaxSize;
+
+    // Notified on VIDEO_FEEDBACK and SET_VIDEO_PROFILE messages
+    private BitRateAdapter bitRateAdapter;
+
+    // Notified on REQUEST_KEYFRAME message
+    private KeyFrameRequester keyFrameRequester;
+
+    // Notified on SET_VIDEO_THROTTLE and SET_VIDEO_PROFILE messages
+    private VideoThrottle videoThrottle;
+
     public Controller(ControlChannel controlChannel, CleanUp cleanUp, Options options) {
         this.displayId = options.getDisplayId();
         this.controlChannel = controlChannel;
         this.cleanUp = cleanUp;
         this.clipboardAutosync = options.getClipboardAutosync();
         this.powerOn = options.getPowerOn();
+        this.initialMaxSize = options.getMaxSize();
+        this.initialCrop = options.getCrop();
+        this.profileMaxSize = initialMaxSize;
+        this.videoMaxSize = initialMaxSize;
+        this.videoCrop = initialCrop;
+        this.eventTimeMapper = new EventTimeMapper(options.getInputPacing() * 1000L);
+        controlChannel.setClipboardCompression(options.getClipboardCompression());
         initPointers();
         sender = new DeviceMessageSender(controlChannel);
 
@@ -125,6 +165,13 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                         return;
                     }
                     String text = Device.getClipboardText();
+                    Long expectedHash = setClipboardHash;
+                    setClipboardHash = null;
+                    if (text != null && expectedHash != null && ClipboardHash.hash(text) == expectedHash) {
+                        // The computer already has this text
+                        Ln.d("Device clipboard unchanged");
+                        return;
+                    }
                     if (text != null) {
                         DeviceMessage msg = DeviceMessage.createClipboard(text);
                         sender.send(msg);
@@ -148,10 +195,27 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         }
     }
 
+    @Override
+    public void onVideoIdle(boolean idle) {
+        sender.send(DeviceMessage.createVideoIdle(idle));
+    }
+
     public void setSurfaceCapture(SurfaceCapture surfaceCapture) {
         this.surfaceCapture = surfaceCapture;
     }
 
+    public void setBitRateAdapter(BitRateAdapter bitRateAdapter) {
+        this.bitRateAdapter = bitRateAdapter;
+    }
+
+    public void setKeyFrameRequester(KeyFrameRequester keyFrameRequester) {
+        this.keyFrameRequester = keyFrameRequester;
+    }
+
+    public void setVideoThrottle(VideoThrottle videoThrottle) {
+        this.videoThrottle = videoThrottle;
+    }
+
     private UhidManager getUhidManager() {
         if (uhidManager == null) {
             int uhidDisplayId = displayId;
@@ -200,6 +264,8 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     }
 
     private void control() throws IOException {
+        raiseThreadPriority();
+
         // on start, power on the device
         if (powerOn && displayId == 0 && !Device.isScreenOn(displayId)) {
             Device.pressReleaseKeycode(KeyEvent.KEYCODE_POWER, displayId, Device.INJECT_MODE_ASYNC);
@@ -220,6 +286,15 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         }
     }
 
+    private static void raiseThreadPriority() {
+        try {
+            Process.setThreadPriority(Process.THREAD_PRIORITY_URGENT_DISPLAY);
+        } catch (IllegalArgumentException | SecurityException e) {
+            // Not permitted for the shell user on some devices, this is not fatal
+            Ln.d("Could not raise the control thread priority: " + e.getMessage());
+        }
+    }
+
     @Override
     public void start(TerminationListener listener) {
         thread = new Thread(() -> {
@@ -244,6 +319,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         if (thread != null) {
             thread.interrupt();
         }
+        slowCommandExecutor.shutdownNow();
         sender.stop();
     }
 
@@ -252,6 +328,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         if (thread != null) {
             thread.join();
         }
+        slowCommandExecutor.awaitTermination(Long.MAX_VALUE, TimeUnit.MILLISECONDS);
         sender.join();
     }
 
@@ -264,6 +341,12 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             return false;
         }
 
+        if (isSlowCommand(msg.getType())) {
+            // Their handling may block for a while (binder calls to system services), they must not delay the input events
+            slowCommandExecutor.execute(() -> handleSlowCommand(msg));
+            return true;
+        }
+
         switch (msg.getType()) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 if (supportsInputEvents) {
@@ -275,14 +358,26 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                     injectText(msg.getText());
                 }
                 break;
+            case ControlMessage.TYPE_INJECT_TEXT_STREAM:
+                if (supportsInputEvents) {
+                    injectTextBatch(msg.getText());
+                }
+                break;
             case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
                 if (supportsInputEvents) {
-                    injectTouch(msg.getAction(), msg.getPointerId(), msg.getPosition(), msg.getPressure(), msg.getActionButton(), msg.getButtons());
+                    injectTouch(msg.getAction(), msg.getPointerId(), msg.getPosition(), msg.getPressure(), msg.getActionButton(), msg.getButtons(),
+                            msg.getTimestamp());
+                }
+                break;
+            case ControlMessage.TYPE_INJECT_TOUCH_BATCH:
+                if (supportsInputEvents) {
+                    injectTouchBatch(msg.getAction(), msg.getPointerId(), msg.getPositions(), msg.getPressures(), msg.getAges(),
+                            msg.getActionButton(), msg.getButtons(), msg.getTimestamp());
                 }
                 break;
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 if (supportsInputEvents) {
-                    injectScroll(msg.getPosition(), msg.getHScroll(), msg.getVScroll(), msg.getButtons());
+                    injectScroll(msg.getPosition(), msg.getHScroll(), msg.getVScroll(), msg.getButtons(), msg.getTimestamp());
                 }
                 break;
             case ControlMessage.TYPE_BACK_OR_SCREEN_ON:
@@ -290,6 +385,77 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                     pressBackOrTurnScreenOn(msg.getAction());
                 }
                 break;
+            case ControlMessage.TYPE_UHID_CREATE:
+                getUhidManager().open(msg.getId(), msg.getVendorId(), msg.getProductId(), msg.getText(), msg.getData());
+                break;
+            case ControlMessage.TYPE_UHID_INPUT:
+                getUhidManager().writeInput(msg.getId(), msg.getData());
+                break;
+            case ControlMessage.TYPE_UHID_DESTROY:
+                getUhidManager().close(msg.getId());
+                break;
+            case ControlMessage.TYPE_START_APP:
+                startAppAsync(msg.getText());
+                break;
+            case ControlMessage.TYPE_RESET_VIDEO:
+                resetVideo();
+                break;
+            case ControlMessage.TYPE_GET_CLOCK:
+                sendClock(msg.getTimestamp());
+                break;
+            case ControlMessage.TYPE_PING:
+                // The messages are handled in order: the previous input events have been injected
+                sender.send(DeviceMessage.createAckPing(msg.getSequence(), msg.getTimestamp()));
+                break;
+            case ControlMessage.TYPE_VIDEO_FEEDBACK:
+                if (bitRateAdapter != null) {
+                    bitRateAdapter.onFeedback(msg.getReceiveRate(), msg.getDelay(), msg.getFrames(), msg.getSkippedFrames());
+                }
+                break;
+            case ControlMessage.TYPE_REQUEST_KEYFRAME:
+                if (keyFrameRequester != null) {
+                    keyFrameRequester.requestKeyFrame();
+                }
+                break;
+            case ControlMessage.TYPE_SET_VIDEO_THROTTLE:
+                if (videoThrottle != null) {
+                    videoThrottle.setThrottle(msg.getMaxFps(), msg.getPaused());
+                }
+                break;
+            case ControlMessage.TYPE_SET_VIDEO_PROFILE:
+                setVideoProfile(msg.getMaxSize(), msg.getBitRate(), msg.getMaxFps(), msg.getCropSize(), msg.getCropOffset());
+                break;
+            case ControlMessage.TYPE_SET_VIDEO_VIEW_SIZE:
+                setVideoViewSize(msg.getMaxSize());
+                break;
+            case ControlMessage.TYPE_RESIZE_DISPLAY:
+                resizeDisplay(msg.getDisplaySize(), msg.getDpi());
+                break;
+            default:
+                // do nothing
+        }
+
+        return true;
+    }
+
+    private static boolean isSlowCommand(int type) {
+        switch (type) {
+            case ControlMessage.TYPE_EXPAND_NOTIFICATION_PANEL:
+            case ControlMessage.TYPE_EXPAND_SETTINGS_PANEL:
+            case ControlMessage.TYPE_COLLAPSE_PANELS:
+            case ControlMessage.TYPE_GET_CLIPBOARD:
+            case ControlMessage.TYPE_SET_CLIPBOARD:
+            case ControlMessage.TYPE_SET_DISPLAY_POWER:
+            case ControlMessage.TYPE_ROTATE_DEVICE:
+            case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    private void handleSlowCommand(ControlMessage msg) {
+        switch (msg.getType()) {
             case ControlMessage.TYPE_EXPAND_NOTIFICATION_PANEL:
                 Device.expandNotificationPanel();
                 break;
@@ -303,7 +469,11 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                 getClipboard(msg.getCopyKey());
                 break;
             case ControlMessage.TYPE_SET_CLIPBOARD:
-                setClipboard(msg.getText(), msg.getPaste(), msg.getSequence());
+                if (msg.getText() != null) {
+                    setClipboard(msg.getText(), msg.getPaste(), msg.getSequence());
+                } else {
+                    setClipboardByHash(msg.getClipboardHash(), msg.getPaste(), msg.getSequence());
+                }
                 break;
             case ControlMessage.TYPE_SET_DISPLAY_POWER:
                 if (supportsInputEvents) {
@@ -313,29 +483,12 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             case ControlMessage.TYPE_ROTATE_DEVICE:
                 Device.rotateDevice(getActionDisplayId());
                 break;
-            case ControlMessage.TYPE_UHID_CREATE:
-                getUhidManager().open(msg.getId(), msg.getVendorId(), msg.getProductId(), msg.getText(), msg.getData());
-                break;
-            case ControlMessage.TYPE_UHID_INPUT:
-                getUhidManager().writeInput(msg.getId(), msg.getData());
-                break;
-            case ControlMessage.TYPE_UHID_DESTROY:
-                getUhidManager().close(msg.getId());
-                break;
             case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
                 openHardKeyboardSettings();
                 break;
-            case ControlMessage.TYPE_START_APP:
-                startAppAsync(msg.getText());
-                break;
-            case ControlMessage.TYPE_RESET_VIDEO:
-                resetVideo();
-                break;
             default:
-                // do nothing
+                throw new AssertionError("Not a slow command: " + msg.getType());
         }
-
-        return true;
     }
 
     private boolean injectKeycode(int action, int keycode, int repeat, int metaState) {
@@ -375,6 +528,39 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return successCount;
     }
 
+    /**
+     * Inject a chunk of a large text (typically pasted) in a single batch: the key events of all the characters are generated at once, and
+     * injected to the same display.
+     */
+    private void injectTextBatch(String text) {
+        StringBuilder builder = new StringBuilder(text.length());
+        for (char c : text.toCharArray()) {
+            String decomposed = KeyComposition.decompose(c);
+            if (decomposed != null) {
+                builder.append(decomposed);
+            } else {
+                builder.append(c);
+            }
+        }
+
+        char[] chars = new char[builder.length()];
+        builder.getChars(0, chars.length, chars, 0);
+        KeyEvent[] events = charMap.getEvents(chars);
+        if (events == null) {
+            // Some characters cannot be generated by the key character map, inject them one by one to skip only these ones
+            injectText(text);
+            return;
+        }
+
+        int actionDisplayId = getActionDisplayId();
+        for (KeyEvent event : events) {
+            if (!Device.injectEvent(event, actionDisplayId, Device.INJECT_MODE_ASYNC)) {
+                Ln.w("Could not inject text stream event");
+                return;
+            }
+        }
+    }
+
     private Pair<Point, Integer> getEventPointAndDisplayId(Position position) {
         // it hides the field on purpose, to read it with atomic access
         @SuppressWarnings("checkstyle:HiddenField")
@@ -405,8 +591,34 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return Pair.create(point, targetDisplayId);
     }
 
-    private boolean injectTouch(int action, long pointerId, Position position, float pressure, int actionButton, int buttons) {
-        long now = SystemClock.uptimeMillis();
+    /**
+     * Return the event time (in the {@link SystemClock#uptimeMillis()} time base) of an event having the given client timestamp.
+     * <p>
+     * If the event must be delayed (for --input-pacing), wait until its time.
+     *
+     * @param clientTimestamp the client timestamp (in µs), or 0 if unknown
+     */
+    private long getEventTime(long clientTimestamp) {
+        if (clientTimestamp == 0) {
+            return SystemClock.uptimeMillis();
+        }
+
+        // System.nanoTime() and SystemClock.uptimeMillis() use the same clock (CLOCK_MONOTONIC)
+        long now = System.nanoTime() / 1000;
+        long eventTime = eventTimeMapper.map(clientTimestamp, now);
+        long wait = eventTime - now;
+        if (wait > 0) {
+            try {
+                Thread.sleep(wait / 1000, (int) (wait % 1000) * 1000);
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+            }
+        }
+        return eventTime / 1000;
+    }
+
+    private boolean injectTouch(int action, long pointerId, Position position, float pressure, int actionButton, int buttons, long timestamp) {
+        long now = getEventTime(timestamp);
 
         Pair<Point, Integer> pair = getEventPointAndDisplayId(position);
         if (pair == null) {
@@ -516,8 +728,72 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
     }
 
-    private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons) {
-        long now = SystemClock.uptimeMillis();
+    /**
+     * Inject consecutive moves of a single pointer as one MotionEvent, the older samples being added as historical points.
+     */
+    private boolean injectTouchBatch(int action, long pointerId, Position[] positions, float[] pressures, int[] ages, int actionButton,
+            int buttons, long timestamp) {
+        assert action == MotionEvent.ACTION_MOVE || action == MotionEvent.ACTION_HOVER_MOVE;
+        // The event time of the last sample
+        long now = getEventTime(timestamp);
+
+        int source;
+        boolean activeSecondaryButtons = ((actionButton | buttons) & ~MotionEvent.BUTTON_PRIMARY) != 0;
+        boolean mouse = pointerId == POINTER_ID_MOUSE && (action == MotionEvent.ACTION_HOVER_MOVE || activeSecondaryButtons);
+        if (mouse) {
+            source = InputDevice.SOURCE_MOUSE;
+        } else {
+            source = InputDevice.SOURCE_TOUCHSCREEN;
+            // Buttons must not be set for touch events
+            buttons = 0;
+        }
+
+        MotionEvent event = null;
+        int targetDisplayId = 0;
+        for (int i = 0; i < positions.length; ++i) {
+            Pair<Point, Integer> pair = getEventPointAndDisplayId(positions[i]);
+            if (pair == null) {
+                return false;
+            }
+
+            // The pointer may have been removed by the previous update() if it is up (hovering mouse)
+            int pointerIndex = pointersState.getPointerIndex(pointerId);
+            if (pointerIndex == -1) {
+                Ln.w("Too many pointers for touch event");
+                return false;
+            }
+            Pointer pointer = pointersState.get(pointerIndex);
+            pointer.setPoint(pair.first);
+            pointer.setPressure(pressures[i]);
+            pointer.setUp(mouse && buttons == 0);
+            pointerProperties[pointerIndex].toolType = mouse ? MotionEvent.TOOL_TYPE_MOUSE : MotionEvent.TOOL_TYPE_FINGER;
+
+            int pointerCount = pointersState.update(pointerProperties, pointerCoords);
+
+            // The ages are decreasing, so the event times are monotonic
+            long eventTime = now - ages[i] / 1000;
+            if (event != null && (pointerCount != event.getPointerCount() || pair.second != targetDisplayId)) {
+                // Cannot be added as a historical sample
+                if (!Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC)) {
+                    return false;
+                }
+                event = null;
+            }
+
+            if (event == null) {
+                event = MotionEvent.obtain(lastTouchDown, eventTime, action, pointerCount, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
+                        DEFAULT_DEVICE_ID, 0, source, 0);
+                targetDisplayId = pair.second;
+            } else {
+                event.addBatch(eventTime, pointerCoords, 0);
+            }
+        }
+
+        return event == null || Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
+    }
+
+    private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons, long timestamp) {
+        long now = getEventTime(timestamp);
 
         Pair<Point, Integer> pair = getEventPointAndDisplayId(position);
         if (pair == null) {
@@ -591,6 +867,9 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     }
 
     private boolean setClipboard(String text, boolean paste, long sequence) {
+        if (clipboardAutosync) {
+            setClipboardHash = ClipboardHash.hash(text);
+        }
         isSettingClipboard.set(true);
         boolean ok = Device.setClipboardText(text);
         isSettingClipboard.set(false);
@@ -598,6 +877,26 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             Ln.i("Device clipboard set");
         }
 
+        pasteAndAckClipboard(paste, sequence);
+        return ok;
+    }
+
+    private boolean setClipboardByHash(long hash, boolean paste, long sequence) {
+        // The computer only sent the hash of the text that the device clipboard is expected to contain
+        String text = Device.getClipboardText();
+        boolean ok = text != null && ClipboardHash.hash(text) == hash;
+        if (ok) {
+            Ln.d("Device clipboard already set");
+            pasteAndAckClipboard(paste, sequence);
+        } else {
+            // The device clipboard changed in the meantime, its new content is (or will be) synchronized to the computer
+            Ln.w("Device clipboard changed, could not set it");
+            pasteAndAckClipboard(false, sequence);
+        }
+        return ok;
+    }
+
+    private void pasteAndAckClipboard(boolean paste, long sequence) {
         // On Android >= 7, also press the PASTE key if requested
         if (paste && Build.VERSION.SDK_INT >= AndroidVersions.API_24_ANDROID_7_0 && supportsInputEvents) {
             pressReleaseKeycode(KeyEvent.KEYCODE_PASTE, Device.INJECT_MODE_ASYNC);
@@ -608,8 +907,6 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             DeviceMessage msg = DeviceMessage.createAckClipboard(sequence);
             sender.send(msg);
         }
-
-        return ok;
     }
 
     private void openHardKeyboardSettings() {
@@ -754,4 +1051,103 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             surfaceCapture.requestInvalidate();
         }
     }
+
+    private void setVideoProfile(int maxSize, int bitRate, int maxFps, Size cropSize, Point cropOffset) {
+        if (surfaceCapture == null) {
+            // No video
+            return;
+        }
+
+        // The bit rate and the max fps are applied to the running encoder
+        bitRateAdapter.setMaxBitRate(bitRate);
+        videoThrottle.setBaseMaxFps(maxFps);
+
+        // A new size or crop requires to reset the capture, the client decoder handles the new resolution from the stream
+        boolean reset = false;
+
+        profileMaxSize = maxSize > 0 ? maxSize : initialMaxSize;
+        if (applyMaxSize()) {
+            reset = true;
+        }
+
+        Rect newCrop = initialCrop;
+        if (cropSize != null) {
+            int x = cropOffset.getX();
+            int y = cropOffset.getY();
+            newCrop = new Rect(x, y, x + cropSize.getWidth(), y + cropSize.getHeight());
+        }
+        if (!Objects.equals(newCrop, videoCrop)) {
+            if (surfaceCapture.setCrop(newCrop)) {
+                videoCrop = newCrop;
+                reset = true;
+            } else {
+                Ln.w("Video crop " + newCrop + " not supported by the capture, ignored");
+            }
+        }
+
+        // The bit rate and max fps changes are logged by their handlers
+        Ln.i("Video profile changed (max size: " + videoMaxSize + ", crop: " + videoCrop + ")");
+
+        if (reset) {
+            surfaceCapture.requestInvalidate();
+        }
+    }
+
+    private void setVideoViewSize(int maxSize) {
+        if (surfaceCapture == null) {
+            // No video
+            return;
+        }
+
+        viewMaxSize = maxSize;
+        if (applyMaxSize()) {
+            Ln.i("Video max size changed to " + videoMaxSize + " to match the client window");
+            surfaceCapture.requestInvalidate();
+        }
+    }
+
+    private void resizeDisplay(Size size, int dpi) {
+        if (surfaceCapture == null) {
+            // No video
+            return;
+        }
+
+        if (surfaceCapture.resizeDisplay(size, dpi)) {
+            surfaceCapture.requestInvalidate();
+        } else {
+            Ln.w("Display resize not supported by the capture, ignored");
+        }
+    }
+
+    /**
+     * Apply the most restrictive of the profile max size and the view max size to the capture.
+     *
+     * @return {@code true} if the capture must be reset
+     */
+    private boolean applyMaxSize() {
+        int newMaxSize = profileMaxSize;
+        if (viewMaxSize > 0 && (newMaxSize == 0 || viewMaxSize < newMaxSize)) {
+            newMaxSize = viewMaxSize;
+        }
+
+        if (newMaxSize == videoMaxSize) {
+            return false;
+        }
+
+        if (!surfaceCapture.setMaxSize(newMaxSize)) {
+            Ln.w("Video max size change not supported by the capture, ignored");
+            return false;
+        }
+
+        videoMaxSize = newMaxSize;
+        return true;
+    }
+
+    private void sendClock(long timestamp) {
+        // Reply with the device monotonic time (in microseconds), in the same time base as the video frame timestamps, so that the
+        // client can estimate the clock offset between the device and the computer
+        long deviceTimestamp = System.nanoTime() / 1000;
+        DeviceMessage msg = DeviceMessage.createClock(timestamp, deviceTimestamp);
+        sender.send(msg);
+    }
 }
@@ -5,12 +5,18 @@ public final class DeviceMessage {
     public static final int TYPE_CLIPBOARD = 0;
     public static final int TYPE_ACK_CLIPBOARD = 1;
     public static final int TYPE_UHID_OUTPUT = 2;
+    public static final int TYPE_CLOCK = 3;
+    public static final int TYPE_ACK_PING = 4;
+    public static final int TYPE_VIDEO_IDLE = 5;
 
     private int type;
     private String text;
     private long sequence;
+    private long timestamp;
+    private long deviceTimestamp;
     private int id;
     private byte[] data;
+    private boolean idle;
 
     private DeviceMessage() {
     }
@@ -37,6 +43,29 @@ public final class DeviceMessage {
         return event;
     }
 
+    public static DeviceMessage createClock(long timestamp, long deviceTimestamp) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_CLOCK;
+        event.timestamp = timestamp;
+        event.deviceTimestamp = deviceTimestamp;
+        return event;
+    }
+
+    public static DeviceMessage createAckPing(long sequence, long timestamp) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_ACK_PING;
+        event.sequence = sequence;
+        event.timestamp = timestamp;
+        return event;
+    }
+
+    public static DeviceMessage createVideoIdle(boolean idle) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_VIDEO_IDLE;
+        event.idle = idle;
+        return event;
+    }
+
     public int getType() {
         return type;
     }
@@ -49,6 +78,14 @@ public final class DeviceMessage {
         return sequence;
     }
 
+    public long getTimestamp() {
+        return timestamp;
+    }
+
+    public long getDeviceTimestamp() {
+        return deviceTimestamp;
+    }
+
     public int getId() {
         return id;
     }
@@ -56,4 +93,8 @@ public final class DeviceMessage {
     public byte[] getData() {
         return data;
     }
+
+    public boolean getIdle() {
+        return idle;
+    }
 }
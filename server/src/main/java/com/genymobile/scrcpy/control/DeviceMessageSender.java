@@ -3,15 +3,23 @@ package com.genymobile.scrcpy.control;
 import com.genymobile.scrcpy.util.Ln;
 
 import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
 import java.util.concurrent.ArrayBlockingQueue;
 import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.TimeUnit;
 
 public final class DeviceMessageSender {
 
+    private static final int QUEUE_CAPACITY = 16;
+
+    // UHID outputs (keyboard LEDs, gamepad rumble) may be delayed a bit to be sent along with the following messages
+    private static final long MAX_BATCH_DELAY_NS = 2_000_000; // 2 ms
+
     private final ControlChannel controlChannel;
 
     private Thread thread;
-    private final BlockingQueue<DeviceMessage> queue = new ArrayBlockingQueue<>(16);
+    private final BlockingQueue<DeviceMessage> queue = new ArrayBlockingQueue<>(QUEUE_CAPACITY);
 
     public DeviceMessageSender(ControlChannel controlChannel) {
         this.controlChannel = controlChannel;
@@ -23,10 +31,34 @@ public final class DeviceMessageSender {
         }
     }
 
+    private static boolean canDelay(DeviceMessage msg) {
+        // Acks and clock responses are awaited by the client, so they must not be delayed
+        return msg.getType() == DeviceMessage.TYPE_UHID_OUTPUT;
+    }
+
     private void loop() throws IOException, InterruptedException {
+        List<DeviceMessage> batch = new ArrayList<>(QUEUE_CAPACITY);
         while (!Thread.currentThread().isInterrupted()) {
             DeviceMessage msg = queue.take();
-            controlChannel.send(msg);
+            long deadline = System.nanoTime() + MAX_BATCH_DELAY_NS;
+            boolean delayable = true;
+            while (msg != null) {
+                batch.add(msg);
+                delayable &= canDelay(msg);
+                if (batch.size() == QUEUE_CAPACITY) {
+                    break;
+                }
+                msg = queue.poll();
+                if (msg == null && delayable) {
+                    long timeout = deadline - System.nanoTime();
+                    if (timeout > 0) {
+                        msg = queue.poll(timeout, TimeUnit.NANOSECONDS);
+                    }
+                }
+            }
+
+            controlChannel.send(batch);
+            batch.clear();
         }
     }
 
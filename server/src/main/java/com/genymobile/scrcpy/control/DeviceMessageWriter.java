@@ -7,6 +7,7 @@ import java.io.DataOutputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.nio.charset.StandardCharsets;
+import java.util.List;
 
 public class DeviceMessageWriter {
 
@@ -15,11 +16,35 @@ public class DeviceMessageWriter {
 
     private final DataOutputStream dos;
 
+    // Whether the client accepts compressed clipboard texts
+    private boolean clipboardCompression;
+
     public DeviceMessageWriter(OutputStream rawOutputStream) {
         dos = new DataOutputStream(new BufferedOutputStream(rawOutputStream));
     }
 
+    public void setClipboardCompression(boolean clipboardCompression) {
+        this.clipboardCompression = clipboardCompression;
+    }
+
     public void write(DeviceMessage msg) throws IOException {
+        append(msg);
+        dos.flush();
+    }
+
+    /**
+     * Write several messages at once, in a single flush.
+     *
+     * @param msgs the messages to write, in order
+     */
+    public void write(List<DeviceMessage> msgs) throws IOException {
+        for (DeviceMessage msg : msgs) {
+            append(msg);
+        }
+        dos.flush();
+    }
+
+    private void append(DeviceMessage msg) throws IOException {
         int type = msg.getType();
         dos.writeByte(type);
         switch (type) {
@@ -27,8 +52,7 @@ public class DeviceMessageWriter {
                 String text = msg.getText();
                 byte[] raw = text.getBytes(StandardCharsets.UTF_8);
                 int len = StringUtils.getUtf8TruncationIndex(raw, CLIPBOARD_TEXT_MAX_LENGTH);
-                dos.writeInt(len);
-                dos.write(raw, 0, len);
+                writeClipboardText(raw, len);
                 break;
             case DeviceMessage.TYPE_ACK_CLIPBOARD:
                 dos.writeLong(msg.getSequence());
@@ -39,9 +63,35 @@ public class DeviceMessageWriter {
                 dos.writeShort(data.length);
                 dos.write(data);
                 break;
+            case DeviceMessage.TYPE_CLOCK:
+                dos.writeLong(msg.getTimestamp());
+                dos.writeLong(msg.getDeviceTimestamp());
+                break;
+            case DeviceMessage.TYPE_ACK_PING:
+                dos.writeLong(msg.getSequence());
+                dos.writeLong(msg.getTimestamp());
+                break;
+            case DeviceMessage.TYPE_VIDEO_IDLE:
+                dos.writeBoolean(msg.getIdle());
+                break;
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
-        dos.flush();
+    }
+
+    private void writeClipboardText(byte[] raw, int len) throws IOException {
+        if (clipboardCompression && len >= ClipboardCompression.MIN_LENGTH) {
+            byte[] compressed = ClipboardCompression.compress(raw, len);
+            if (compressed != null) {
+                dos.writeInt((compressed.length + 4) | ClipboardCompression.COMPRESSED_FLAG);
+                dos.writeInt(len);
+                dos.write(compressed);
+                return;
+            }
+            // Otherwise, the text is not compressible enough, write it raw
+        }
+
+        dos.writeInt(len);
+        dos.write(raw, 0, len);
     }
 }
@@ -0,0 +1,52 @@
+package com.genymobile.scrcpy.control;
+
+/**
+ * Map the client timestamps of the input events to the device clock.
+ * <p>
+ * The clock offset is estimated from the fastest transit (the difference between the reception time and the client timestamp): the events
+ * received late because of the network jitter keep their original spacing instead of being injected in a burst.
+ */
+public final class EventTimeMapper {
+
+    // Maximum increase of the offset, relative to the elapsed time, to follow the clock drift and the network route changes
+    private static final long MAX_OFFSET_INCREASE_PPM = 1000;
+
+    private final long delayUs;
+
+    private boolean hasOffset;
+    private long offset; // device time - client time, in µs
+    private long lastUpdate;
+    private long lastEventTime;
+
+    /**
+     * @param delayUs fixed delay added to every event time, to absorb the network jitter (in µs)
+     */
+    public EventTimeMapper(long delayUs) {
+        this.delayUs = delayUs;
+    }
+
+    /**
+     * Return the device time of an event.
+     * <p>
+     * The returned values are monotonic. If the delay is 0, they are never in the future.
+     *
+     * @param clientTime the client timestamp of the event (in µs)
+     * @param now the current device time (in µs)
+     * @return the event time on the device (in µs)
+     */
+    public long map(long clientTime, long now) {
+        long transit = now - clientTime;
+        if (!hasOffset || transit < offset) {
+            offset = transit;
+            hasOffset = true;
+        } else {
+            long maxIncrease = (now - lastUpdate) * MAX_OFFSET_INCREASE_PPM / 1_000_000;
+            offset = Math.min(offset + maxIncrease, transit);
+        }
+        lastUpdate = now;
+
+        long eventTime = Math.max(clientTime + offset + delayUs, lastEventTime);
+        lastEventTime = eventTime;
+        return eventTime;
+    }
+}
@@ -5,14 +5,29 @@ import com.genymobile.scrcpy.device.Position;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.AffineMatrix;
 
+import android.graphics.Rect;
+
+import java.util.ArrayList;
+import java.util.List;
+
 public final class PositionMapper {
 
     private final Size videoSize;
     private final AffineMatrix videoToDeviceMatrix;
 
+    // For a tiled video, each tile (an area of the video, in pixels) has its own mapper
+    private final List<Rect> tiles;
+    private final List<PositionMapper> tileMappers;
+
     public PositionMapper(Size videoSize, AffineMatrix videoToDeviceMatrix) {
+        this(videoSize, videoToDeviceMatrix, null, null);
+    }
+
+    private PositionMapper(Size videoSize, AffineMatrix videoToDeviceMatrix, List<Rect> tiles, List<PositionMapper> tileMappers) {
         this.videoSize = videoSize;
         this.videoToDeviceMatrix = videoToDeviceMatrix;
+        this.tiles = tiles;
+        this.tileMappers = tileMappers;
     }
 
     public static PositionMapper create(Size videoSize, AffineMatrix filterTransform, Size targetSize) {
@@ -27,6 +42,26 @@ public final class PositionMapper {
         return new PositionMapper(videoSize, transform);
     }
 
+    /**
+     * Create a mapper for a video composed of several tiles, each one having its own transform.
+     *
+     * @param videoSize the whole video size
+     * @param tiles the area of each tile in the video, in pixels
+     * @param tileTransforms the filter transform of each tile
+     * @param targetSize the target size
+     * @return the position mapper
+     */
+    public static PositionMapper createTiled(Size videoSize, List<Rect> tiles, List<AffineMatrix> tileTransforms, Size targetSize) {
+        assert tiles.size() == tileTransforms.size();
+        List<PositionMapper> tileMappers = new ArrayList<>(tiles.size());
+        for (int i = 0; i < tiles.size(); ++i) {
+            Rect tile = tiles.get(i);
+            Size tileSize = new Size(tile.width(), tile.height());
+            tileMappers.add(create(tileSize, tileTransforms.get(i), targetSize));
+        }
+        return new PositionMapper(videoSize, null, tiles, tileMappers);
+    }
+
     public Size getVideoSize() {
         return videoSize;
     }
@@ -40,9 +75,27 @@ public final class PositionMapper {
         }
 
         Point point = position.getPoint();
+        if (tiles != null) {
+            return mapTiled(point);
+        }
         if (videoToDeviceMatrix != null) {
             point = videoToDeviceMatrix.apply(point);
         }
         return point;
     }
+
+    private Point mapTiled(Point point) {
+        for (int i = 0; i < tiles.size(); ++i) {
+            Rect tile = tiles.get(i);
+            if (tile.contains(point.getX(), point.getY())) {
+                PositionMapper tileMapper = tileMappers.get(i);
+                Point tilePoint = new Point(point.getX() - tile.left, point.getY() - tile.top);
+                AffineMatrix matrix = tileMapper.videoToDeviceMatrix;
+                return matrix != null ? matrix.apply(tilePoint) : tilePoint;
+            }
+        }
+
+        // Outside any tile
+        return null;
+    }
 }
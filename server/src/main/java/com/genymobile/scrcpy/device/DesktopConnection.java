@@ -2,6 +2,7 @@ package com.genymobile.scrcpy.device;
 
 import com.genymobile.scrcpy.control.ControlChannel;
 import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.StringUtils;
 
 import android.net.LocalServerSocket;
@@ -11,7 +12,14 @@ import android.net.LocalSocketAddress;
 import java.io.Closeable;
 import java.io.FileDescriptor;
 import java.io.IOException;
+import java.io.InputStream;
+import java.net.InetAddress;
+import java.net.InetSocketAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
 import java.nio.charset.StandardCharsets;
+import java.security.MessageDigest;
+import java.util.Arrays;
 
 public final class DesktopConnection implements Closeable {
 
@@ -19,29 +27,131 @@ public final class DesktopConnection implements Closeable {
 
     private static final String SOCKET_NAME_PREFIX = "scrcpy";
 
-    private final LocalSocket videoSocket;
+    // Delay for a direct TCP client to send its token once connected
+    private static final int DIRECT_TCP_TOKEN_TIMEOUT_MS = 2000;
+    // Length of each token (there is one per socket)
+    private static final int DIRECT_TCP_TOKEN_LENGTH = 32;
+
+    private interface Acceptor {
+        DesktopSocket accept() throws IOException;
+    }
+
+    // Accept the direct TCP connections from the client
+    //
+    // Each socket must start with its own one-time token (the tokens are sent in clear, so a token seen on the network is never accepted
+    // again), and all the sockets must come from the address of the first one.
+    private static final class TcpAcceptor implements Acceptor {
+        private final ServerSocket serverSocket;
+        private final byte[] tokens;
+        private int index;
+        private InetAddress clientAddress;
+
+        TcpAcceptor(ServerSocket serverSocket, byte[] tokens) {
+            this.serverSocket = serverSocket;
+            this.tokens = tokens;
+        }
+
+        @Override
+        public DesktopSocket accept() throws IOException {
+            int offset = index * DIRECT_TCP_TOKEN_LENGTH;
+            if (offset + DIRECT_TCP_TOKEN_LENGTH > tokens.length) {
+                throw new IOException("No direct TCP token left");
+            }
+            byte[] token = Arrays.copyOfRange(tokens, offset, offset + DIRECT_TCP_TOKEN_LENGTH);
+
+            while (true) {
+                Socket socket = serverSocket.accept();
+                InetAddress address = socket.getInetAddress();
+                String host = address.getHostAddress();
+                if (clientAddress != null && !clientAddress.equals(address)) {
+                    Ln.w("Direct TCP connection rejected from " + host + ": unexpected address");
+                    socket.close();
+                    continue;
+                }
+
+                if (readToken(socket, token)) {
+                    try {
+                        socket.setTcpNoDelay(true);
+                    } catch (IOException e) {
+                        socket.close();
+                        throw e;
+                    }
+                    clientAddress = address;
+                    ++index;
+                    return DesktopSocket.of(socket);
+                }
+
+                Ln.w("Direct TCP connection rejected from " + host + ": invalid token");
+                socket.close();
+            }
+        }
+    }
+
+    private final DesktopSocket videoSocket;
     private final FileDescriptor videoFd;
 
-    private final LocalSocket audioSocket;
+    // Separate video stream for recording (may be null)
+    private final DesktopSocket recordSocket;
+    private final FileDescriptor recordFd;
+
+    // Video streams of the extra displays (may be empty)
+    private final DesktopSocket[] extraDisplaySockets;
+    private final FileDescriptor[] extraDisplayFds;
+
+    private final DesktopSocket audioSocket;
     private final FileDescriptor audioFd;
 
-    private final LocalSocket controlSocket;
+    private final DesktopSocket controlSocket;
     private final ControlChannel controlChannel;
 
-    private DesktopConnection(LocalSocket videoSocket, LocalSocket audioSocket, LocalSocket controlSocket) throws IOException {
+    private DesktopConnection(DesktopSocket videoSocket, DesktopSocket recordSocket, DesktopSocket[] extraDisplaySockets,
+            DesktopSocket audioSocket, DesktopSocket controlSocket) throws IOException {
         this.videoSocket = videoSocket;
+        this.recordSocket = recordSocket;
+        this.extraDisplaySockets = extraDisplaySockets;
         this.audioSocket = audioSocket;
         this.controlSocket = controlSocket;
 
         videoFd = videoSocket != null ? videoSocket.getFileDescriptor() : null;
+        recordFd = recordSocket != null ? recordSocket.getFileDescriptor() : null;
+        extraDisplayFds = new FileDescriptor[extraDisplaySockets.length];
+        for (int i = 0; i < extraDisplaySockets.length; ++i) {
+            extraDisplayFds[i] = extraDisplaySockets[i].getFileDescriptor();
+        }
         audioFd = audioSocket != null ? audioSocket.getFileDescriptor() : null;
-        controlChannel = controlSocket != null ? new ControlChannel(controlSocket) : null;
+        controlChannel = controlSocket != null ? new ControlChannel(controlSocket.getInputStream(), controlSocket.getOutputStream()) : null;
     }
 
-    private static LocalSocket connect(String abstractName) throws IOException {
+    private static DesktopSocket connect(String abstractName) throws IOException {
         LocalSocket localSocket = new LocalSocket();
-        localSocket.connect(new LocalSocketAddress(abstractName));
-        return localSocket;
+        try {
+            localSocket.connect(new LocalSocketAddress(abstractName));
+            return DesktopSocket.of(localSocket);
+        } catch (IOException e) {
+            localSocket.close();
+            throw e;
+        }
+    }
+
+    private static boolean readToken(Socket socket, byte[] token) {
+        try {
+            socket.setSoTimeout(DIRECT_TCP_TOKEN_TIMEOUT_MS);
+            byte[] received = new byte[token.length];
+            InputStream input = socket.getInputStream();
+            int len = 0;
+            while (len < received.length) {
+                int r = input.read(received, len, received.length - len);
+                if (r == -1) {
+                    return false;
+                }
+                len += r;
+            }
+            socket.setSoTimeout(0);
+            // Constant-time comparison
+            return MessageDigest.isEqual(received, token);
+        } catch (IOException e) {
+            return false;
+        }
     }
 
     private static String getSocketName(int scid) {
@@ -53,56 +163,91 @@ public final class DesktopConnection implements Closeable {
         return SOCKET_NAME_PREFIX + String.format("_%08x", scid);
     }
 
-    public static DesktopConnection open(int scid, boolean tunnelForward, boolean video, boolean audio, boolean control, boolean sendDummyByte)
-            throws IOException {
+    public static DesktopConnection open(int scid, boolean tunnelForward, int directTcpPort, String directTcpAddress, String directTcpTokens,
+            boolean video, boolean record, int extraDisplayCount, boolean audio, boolean control, boolean sendDummyByte) throws IOException {
+        assert !record || video : "The record stream requires video";
+        assert extraDisplayCount == 0 || video : "The extra displays require video";
         String socketName = getSocketName(scid);
 
-        LocalSocket videoSocket = null;
-        LocalSocket audioSocket = null;
-        LocalSocket controlSocket = null;
+        if (directTcpPort != 0) {
+            // The client connects to the device directly, adb is only used to start the server
+            byte[] tokens = directTcpTokens.getBytes(StandardCharsets.US_ASCII);
+            // A numeric address, so no name resolution
+            InetAddress address = InetAddress.getByName(directTcpAddress);
+            try (ServerSocket serverSocket = new ServerSocket()) {
+                serverSocket.setReuseAddress(true);
+                // Only listen on the interface the client connects to, not on all the device networks (e.g. mobile data)
+                serverSocket.bind(new InetSocketAddress(address, directTcpPort));
+                // The client waits for this notification to connect
+                Ln.notifyReady();
+                return accept(new TcpAcceptor(serverSocket, tokens), video, record, extraDisplayCount, audio, control, sendDummyByte);
+            }
+        }
+
+        if (tunnelForward) {
+            try (LocalServerSocket localServerSocket = new LocalServerSocket(socketName)) {
+                // The client waits for this notification to connect
+                Ln.notifyReady();
+                return accept(() -> DesktopSocket.of(localServerSocket.accept()), video, record, extraDisplayCount, audio, control,
+                        sendDummyByte);
+            }
+        }
+
+        // In reverse mode, the device connects to the client (which does not expect any dummy byte)
+        return accept(() -> connect(socketName), video, record, extraDisplayCount, audio, control, false);
+    }
+
+    private static DesktopConnection accept(Acceptor acceptor, boolean video, boolean record, int extraDisplayCount, boolean audio,
+            boolean control, boolean sendDummyByte) throws IOException {
+        DesktopSocket videoSocket = null;
+        DesktopSocket recordSocket = null;
+        DesktopSocket[] extraDisplaySockets = new DesktopSocket[extraDisplayCount];
+        DesktopSocket audioSocket = null;
+        DesktopSocket controlSocket = null;
         try {
-            if (tunnelForward) {
-                try (LocalServerSocket localServerSocket = new LocalServerSocket(socketName)) {
-                    if (video) {
-                        videoSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            videoSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
-                    if (audio) {
-                        audioSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            audioSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
-                    if (control) {
-                        controlSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            controlSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
-                }
-            } else {
-                if (video) {
-                    videoSocket = connect(socketName);
+            if (video) {
+                videoSocket = acceptor.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    videoSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
-                if (audio) {
-                    audioSocket = connect(socketName);
+            }
+            if (record) {
+                // The dummy byte, if any, has already been sent on the video socket
+                recordSocket = acceptor.accept();
+            }
+            for (int i = 0; i < extraDisplayCount; ++i) {
+                extraDisplaySockets[i] = acceptor.accept();
+            }
+            if (audio) {
+                audioSocket = acceptor.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    audioSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
-                if (control) {
-                    controlSocket = connect(socketName);
+            }
+            if (control) {
+                controlSocket = acceptor.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    controlSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
             }
         } catch (IOException | RuntimeException e) {
             if (videoSocket != null) {
                 videoSocket.close();
             }
+            if (recordSocket != null) {
+                recordSocket.close();
+            }
+            for (DesktopSocket extraDisplaySocket : extraDisplaySockets) {
+                if (extraDisplaySocket != null) {
+                    extraDisplaySocket.close();
+                }
+            }
             if (audioSocket != null) {
                 audioSocket.close();
             }
@@ -112,10 +257,10 @@ public final class DesktopConnection implements Closeable {
             throw e;
         }
 
-        return new DesktopConnection(videoSocket, audioSocket, controlSocket);
+        return new DesktopConnection(videoSocket, recordSocket, extraDisplaySockets, audioSocket, controlSocket);
     }
 
-    private LocalSocket getFirstSocket() {
+    private DesktopSocket getFirstSocket() {
         if (videoSocket != null) {
             return videoSocket;
         }
@@ -127,16 +272,19 @@ public final class DesktopConnection implements Closeable {
 
     public void shutdown() throws IOException {
         if (videoSocket != null) {
-            videoSocket.shutdownInput();
-            videoSocket.shutdownOutput();
+            videoSocket.shutdown();
+        }
+        if (recordSocket != null) {
+            recordSocket.shutdown();
+        }
+        for (DesktopSocket extraDisplaySocket : extraDisplaySockets) {
+            extraDisplaySocket.shutdown();
         }
         if (audioSocket != null) {
-            audioSocket.shutdownInput();
-            audioSocket.shutdownOutput();
+            audioSocket.shutdown();
         }
         if (controlSocket != null) {
-            controlSocket.shutdownInput();
-            controlSocket.shutdownOutput();
+            controlSocket.shutdown();
         }
     }
 
@@ -144,6 +292,12 @@ public final class DesktopConnection implements Closeable {
         if (videoSocket != null) {
             videoSocket.close();
         }
+        if (recordSocket != null) {
+            recordSocket.close();
+        }
+        for (DesktopSocket extraDisplaySocket : extraDisplaySockets) {
+            extraDisplaySocket.close();
+        }
         if (audioSocket != null) {
             audioSocket.close();
         }
@@ -168,6 +322,14 @@ public final class DesktopConnection implements Closeable {
         return videoFd;
     }
 
+    public FileDescriptor getRecordFd() {
+        return recordFd;
+    }
+
+    public FileDescriptor getExtraDisplayFd(int index) {
+        return extraDisplayFds[index];
+    }
+
     public FileDescriptor getAudioFd() {
         return audioFd;
     }
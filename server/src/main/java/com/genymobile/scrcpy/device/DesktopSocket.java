@@ -0,0 +1,72 @@
+package com.genymobile.scrcpy.device;
+
+import android.net.LocalSocket;
+import android.os.ParcelFileDescriptor;
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
+
+import java.io.Closeable;
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.net.Socket;
+
+/**
+ * A socket connected to the client: a local socket (through an adb tunnel), or a TCP socket (direct TCP connection).
+ */
+public final class DesktopSocket implements Closeable {
+
+    private final Closeable socket;
+    private final ParcelFileDescriptor pfd; // only for TCP sockets, which do not expose their file descriptor
+    private final FileDescriptor fd;
+    private final InputStream inputStream;
+    private final OutputStream outputStream;
+
+    private DesktopSocket(Closeable socket, ParcelFileDescriptor pfd, FileDescriptor fd, InputStream inputStream, OutputStream outputStream) {
+        this.socket = socket;
+        this.pfd = pfd;
+        this.fd = fd;
+        this.inputStream = inputStream;
+        this.outputStream = outputStream;
+    }
+
+    public static DesktopSocket of(LocalSocket socket) throws IOException {
+        return new DesktopSocket(socket, null, socket.getFileDescriptor(), socket.getInputStream(), socket.getOutputStream());
+    }
+
+    public static DesktopSocket of(Socket socket) throws IOException {
+        // The ParcelFileDescriptor holds a dup of the socket file descriptor
+        ParcelFileDescriptor pfd = ParcelFileDescriptor.fromSocket(socket);
+        return new DesktopSocket(socket, pfd, pfd.getFileDescriptor(), socket.getInputStream(), socket.getOutputStream());
+    }
+
+    public FileDescriptor getFileDescriptor() {
+        return fd;
+    }
+
+    public InputStream getInputStream() {
+        return inputStream;
+    }
+
+    public OutputStream getOutputStream() {
+        return outputStream;
+    }
+
+    public void shutdown() throws IOException {
+        try {
+            Os.shutdown(fd, OsConstants.SHUT_RDWR);
+        } catch (ErrnoException e) {
+            throw new IOException(e);
+        }
+    }
+
+    @Override
+    public void close() throws IOException {
+        if (pfd != null) {
+            pfd.close();
+        }
+        socket.close();
+    }
+}
@@ -0,0 +1,30 @@
+package com.genymobile.scrcpy.device;
+
+/**
+ * Additional display streamed in the same session (--extra-display): either an existing display, or a new virtual display.
+ */
+public final class ExtraDisplay {
+    private final int displayId;
+    private final NewDisplay newDisplay;
+
+    private ExtraDisplay(int displayId, NewDisplay newDisplay) {
+        this.displayId = displayId;
+        this.newDisplay = newDisplay;
+    }
+
+    public static ExtraDisplay ofDisplayId(int displayId) {
+        return new ExtraDisplay(displayId, null);
+    }
+
+    public static ExtraDisplay ofNewDisplay(NewDisplay newDisplay) {
+        return new ExtraDisplay(Device.DISPLAY_ID_NONE, newDisplay);
+    }
+
+    public int getDisplayId() {
+        return displayId;
+    }
+
+    public NewDisplay getNewDisplay() {
+        return newDisplay;
+    }
+}
@@ -16,19 +16,32 @@ public final class Streamer {
 
     private static final long PACKET_FLAG_CONFIG = 1L << 63;
     private static final long PACKET_FLAG_KEY_FRAME = 1L << 62;
+    private static final long PACKET_FLAG_REPEATED = 1L << 61;
+
+    private static final int HEADER_MAX_SIZE = 20;
+    // Small packets are copied after their header, to write both in a single syscall (larger packets are written separately, to avoid the
+    // copy)
+    private static final int COALESCE_MAX_SIZE = 64 * 1024;
 
     private final FileDescriptor fd;
     private final Codec codec;
     private final boolean sendCodecMeta;
     private final boolean sendFrameMeta;
+    private final boolean sendFrameTimestamp;
 
-    private final ByteBuffer headerBuffer = ByteBuffer.allocate(12);
+    private final ByteBuffer headerBuffer = ByteBuffer.allocate(HEADER_MAX_SIZE);
+    private ByteBuffer packetBuffer; // lazily allocated, only used if sendFrameMeta
 
     public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta) {
+        this(fd, codec, sendCodecMeta, sendFrameMeta, false);
+    }
+
+    public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta, boolean sendFrameTimestamp) {
         this.fd = fd;
         this.codec = codec;
         this.sendCodecMeta = sendCodecMeta;
         this.sendFrameMeta = sendFrameMeta;
+        this.sendFrameTimestamp = sendFrameTimestamp;
     }
 
     public Codec getCodec() {
@@ -67,6 +80,10 @@ public final class Streamer {
     }
 
     public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame) throws IOException {
+        writePacket(buffer, pts, config, keyFrame, false);
+    }
+
+    public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame, boolean repeated) throws IOException {
         if (config) {
             if (codec == AudioCodec.OPUS) {
                 fixOpusConfigPacket(buffer);
@@ -76,20 +93,44 @@ public final class Streamer {
         }
 
         if (sendFrameMeta) {
-            writeFrameMeta(fd, buffer.remaining(), pts, config, keyFrame);
+            int packetSize = buffer.remaining();
+            prepareFrameMeta(packetSize, pts, config, keyFrame, repeated);
+            if (packetSize <= COALESCE_MAX_SIZE) {
+                if (packetBuffer == null) {
+                    packetBuffer = ByteBuffer.allocateDirect(HEADER_MAX_SIZE + COALESCE_MAX_SIZE);
+                }
+                packetBuffer.clear();
+                packetBuffer.put(headerBuffer);
+                packetBuffer.put(buffer);
+                packetBuffer.flip();
+                IO.writeFully(fd, packetBuffer);
+                return;
+            }
+
+            IO.writeFully(fd, headerBuffer);
         }
 
         IO.writeFully(fd, buffer);
     }
 
     public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo) throws IOException {
+        writePacket(codecBuffer, bufferInfo, false);
+    }
+
+    /**
+     * Write a packet produced by the encoder.
+     *
+     * @param repeated the packet contains a frame repeated by the encoder (the picture is unchanged, only its quality may be
+     * refined), so the client may decode it without displaying it
+     */
+    public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo, boolean repeated) throws IOException {
         long pts = bufferInfo.presentationTimeUs;
         boolean config = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
         boolean keyFrame = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_KEY_FRAME) != 0;
-        writePacket(codecBuffer, pts, config, keyFrame);
+        writePacket(codecBuffer, pts, config, keyFrame, repeated);
     }
 
-    private void writeFrameMeta(FileDescriptor fd, int packetSize, long pts, boolean config, boolean keyFrame) throws IOException {
+    private void prepareFrameMeta(int packetSize, long pts, boolean config, boolean keyFrame, boolean repeated) {
         headerBuffer.clear();
 
         long ptsAndFlags;
@@ -100,12 +141,19 @@ public final class Streamer {
             if (keyFrame) {
                 ptsAndFlags |= PACKET_FLAG_KEY_FRAME;
             }
+            if (repeated) {
+                ptsAndFlags |= PACKET_FLAG_REPEATED;
+            }
         }
 
         headerBuffer.putLong(ptsAndFlags);
         headerBuffer.putInt(packetSize);
+        if (sendFrameTimestamp) {
+            // Device monotonic time (in microseconds) when the packet is output by the encoder, in the same time base as the clock
+            // replies (see DeviceMessage.createClock())
+            headerBuffer.putLong(System.nanoTime() / 1000);
+        }
         headerBuffer.flip();
-        IO.writeFully(fd, headerBuffer);
     }
 
     private static void fixOpusConfigPacket(ByteBuffer buffer) throws IOException {
@@ -0,0 +1,88 @@
+package com.genymobile.scrcpy.device;
+
+import com.genymobile.scrcpy.Options;
+import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+
+/**
+ * Answer the measurements of the client on a single connection, to select the fastest tunnel mode (for --auto-tunnel).
+ * <p>
+ * The client sends one-byte commands:
+ * <ul>
+ *     <li>{@link #CMD_PING}: the same byte is sent back (to measure the round-trip time);</li>
+ *     <li>{@link #CMD_BURST}: a burst of the requested size is sent (to measure the throughput).</li>
+ * </ul>
+ * The benchmark ends when the client closes the connection.
+ */
+public final class TunnelBenchmark {
+
+    private static final byte CMD_PING = 'p';
+    private static final byte CMD_BURST = 'b';
+
+    private static final int CHUNK_SIZE = 64 * 1024;
+
+    private TunnelBenchmark() {
+        // not instantiable
+    }
+
+    public static void run(Options options) throws IOException {
+        int burstSize = options.getTunnelBenchmark();
+
+        // A single socket, whatever the requested streams
+        DesktopConnection connection = DesktopConnection.open(options.getScid(), options.isTunnelForward(), options.getDirectTcpPort(),
+                options.getDirectTcpAddress(), options.getDirectTcpTokens(), true, false, 0, false, false, options.getSendDummyByte());
+        try {
+            if (options.getSendDeviceMeta()) {
+                connection.sendDeviceMeta(Device.getDeviceName());
+            }
+
+            FileDescriptor fd = connection.getVideoFd();
+            byte[] chunk = new byte[CHUNK_SIZE];
+            int cmd;
+            while ((cmd = readCommand(fd)) != -1) {
+                if (cmd == CMD_PING) {
+                    IO.writeFully(fd, new byte[] {CMD_PING}, 0, 1);
+                } else if (cmd == CMD_BURST) {
+                    int remaining = burstSize;
+                    while (remaining > 0) {
+                        int len = Math.min(remaining, chunk.length);
+                        IO.writeFully(fd, chunk, 0, len);
+                        remaining -= len;
+                    }
+                } else {
+                    Ln.w("Unknown tunnel benchmark command: " + cmd);
+                    break;
+                }
+            }
+        } catch (IOException e) {
+            // The client closed the connection
+            if (!IO.isBrokenPipe(e)) {
+                throw e;
+            }
+        } finally {
+            connection.close();
+        }
+    }
+
+    // Return the command byte, or -1 on end of stream
+    private static int readCommand(FileDescriptor fd) throws IOException {
+        byte[] buffer = new byte[1];
+        while (true) {
+            try {
+                int r = Os.read(fd, buffer, 0, 1);
+                return r == 1 ? buffer[0] : -1;
+            } catch (ErrnoException e) {
+                if (e.errno != OsConstants.EINTR) {
+                    throw new IOException(e);
+                }
+            }
+        }
+    }
+}
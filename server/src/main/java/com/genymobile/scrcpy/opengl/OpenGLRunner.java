@@ -21,6 +21,15 @@ import java.util.concurrent.Semaphore;
 
 public final class OpenGLRunner {
 
+    public interface FrameListener {
+        /**
+         * Called (from the OpenGL thread) for each input frame, before it is rendered.
+         *
+         * @param timestampNs the frame timestamp, in nanoseconds
+         */
+        void onFrame(long timestampNs);
+    }
+
     private static HandlerThread handlerThread;
     private static Handler handler;
     private static boolean quit;
@@ -31,6 +40,7 @@ public final class OpenGLRunner {
 
     private final OpenGLFilter filter;
     private final float[] overrideTransformMatrix;
+    private FrameListener frameListener; // may be null
 
     private SurfaceTexture surfaceTexture;
     private Surface inputSurface;
@@ -47,6 +57,13 @@ public final class OpenGLRunner {
         this(filter, null);
     }
 
+    /**
+     * Set a listener notified of each input frame (must be called before {@link #start(Size, Size, Surface)}).
+     */
+    public void setFrameListener(FrameListener frameListener) {
+        this.frameListener = frameListener;
+    }
+
     public static synchronized void initOnce() {
         if (handlerThread == null) {
             if (quit) {
@@ -207,7 +224,12 @@ public final class OpenGLRunner {
 
         filter.draw(textureId, matrix);
 
-        EGLExt.eglPresentationTimeANDROID(eglDisplay, eglSurface, surfaceTexture.getTimestamp());
+        long timestampNs = surfaceTexture.getTimestamp();
+        if (frameListener != null) {
+            frameListener.onFrame(timestampNs);
+        }
+
+        EGLExt.eglPresentationTimeANDROID(eglDisplay, eglSurface, timestampNs);
         EGL14.eglSwapBuffers(eglDisplay, eglSurface);
     }
 
@@ -0,0 +1,72 @@
+package com.genymobile.scrcpy.opengl;
+
+import com.genymobile.scrcpy.device.Size;
+
+import android.graphics.Rect;
+import android.opengl.GLES20;
+
+import java.util.List;
+
+/**
+ * Render several filters into distinct areas (tiles) of the same output.
+ * <p/>
+ * Each filter is rendered in its own viewport, and a scissor box prevents it from clearing the other tiles.
+ */
+public class TiledOpenGLFilter implements OpenGLFilter {
+
+    private final List<OpenGLFilter> filters;
+    private final List<Rect> tiles;
+    private final int outputHeight;
+
+    /**
+     * Create a tiled filter.
+     *
+     * @param filters the filters, one per tile
+     * @param tiles the area of each tile in the output, in pixels (the origin is top-left)
+     * @param outputSize the output size
+     */
+    public TiledOpenGLFilter(List<OpenGLFilter> filters, List<Rect> tiles, Size outputSize) {
+        assert filters.size() == tiles.size();
+        this.filters = filters;
+        this.tiles = tiles;
+        this.outputHeight = outputSize.getHeight();
+    }
+
+    @Override
+    public void init() throws OpenGLException {
+        for (OpenGLFilter filter : filters) {
+            filter.init();
+        }
+    }
+
+    @Override
+    public void draw(int textureId, float[] texMatrix) {
+        // Clear the whole output, including the areas not covered by any tile
+        GLES20.glClear(GLES20.GL_COLOR_BUFFER_BIT);
+        GLUtils.checkGlError();
+
+        GLES20.glEnable(GLES20.GL_SCISSOR_TEST);
+        GLUtils.checkGlError();
+
+        for (int i = 0; i < filters.size(); ++i) {
+            Rect tile = tiles.get(i);
+            int y = outputHeight - tile.bottom; // OpenGL origin is bottom-left
+            GLES20.glViewport(tile.left, y, tile.width(), tile.height());
+            GLUtils.checkGlError();
+            GLES20.glScissor(tile.left, y, tile.width(), tile.height());
+            GLUtils.checkGlError();
+
+            filters.get(i).draw(textureId, texMatrix);
+        }
+
+        GLES20.glDisable(GLES20.GL_SCISSOR_TEST);
+        GLUtils.checkGlError();
+    }
+
+    @Override
+    public void release() {
+        for (OpenGLFilter filter : filters) {
+            filter.release();
+        }
+    }
+}
@@ -23,6 +23,8 @@ import com.genymobile.scrcpy.device.Size;
  */
 public class AffineMatrix {
 
+    private static final double EPSILON = 1e-9;
+
     private final double a, b, c, d, e, f;
 
     /**
@@ -130,6 +132,19 @@ public class AffineMatrix {
         return result;
     }
 
+    /**
+     * Indicate whether this matrix is the identity, with a tolerance for the rounding errors (for example, a rotation by 360°).
+     *
+     * @return {@code true} if this matrix transforms any point to itself
+     */
+    public boolean isIdentity() {
+        return isZero(a - 1) && isZero(b) && isZero(c) && isZero(d - 1) && isZero(e) && isZero(f);
+    }
+
+    private static boolean isZero(double value) {
+        return Math.abs(value) < EPSILON;
+    }
+
     /**
      * Invert the matrix.
      *
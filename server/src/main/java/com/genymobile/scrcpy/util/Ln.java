@@ -50,6 +50,33 @@ public final class Ln {
         return level.ordinal() >= threshold.ordinal();
     }
 
+    /**
+     * Notify the client that the server is ready to accept connections, by writing a marker line on the standard output.
+     * <p>
+     * The marker is written regardless of the log level (the client does not print it).
+     */
+    public static void notifyReady() {
+        CONSOLE_OUT.print(PREFIX + "READY\n");
+    }
+
+    /**
+     * Notify the client of the video encoder selected by the benchmark, by writing a marker line on the standard output.
+     * <p>
+     * The client caches it for the device build.
+     */
+    public static void notifyVideoEncoder(String encoderName) {
+        CONSOLE_OUT.print(PREFIX + "VIDEO_ENCODER " + encoderName + '\n');
+    }
+
+    /**
+     * Notify the client of the max size selected by downsizing on error, by writing a marker line on the standard output.
+     * <p>
+     * The client caches it for the device build, to start directly with this max size the next time.
+     */
+    public static void notifyMaxSize(int maxSize) {
+        CONSOLE_OUT.print(PREFIX + "MAX_SIZE " + maxSize + '\n');
+    }
+
     public static void v(String message) {
         if (isEnabled(Level.VERBOSE)) {
             Log.v(TAG, message);
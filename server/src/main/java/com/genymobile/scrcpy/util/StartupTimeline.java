@@ -0,0 +1,63 @@
+package com.genymobile.scrcpy.util;
+
+import com.genymobile.scrcpy.AndroidVersions;
+
+import android.os.Build;
+import android.os.Process;
+import android.os.SystemClock;
+
+/**
+ * Measure the duration of each server startup phase, until the first video frame (or the end of the startup if there is no video).
+ * <p/>
+ * The timeline is printed once (in debug), so that it is relayed to the client output.
+ */
+public final class StartupTimeline {
+
+    private static final long START_TIME = getStartTime();
+
+    private static final StringBuilder TIMELINE = new StringBuilder();
+    private static long lastTime = START_TIME;
+    private static boolean printed;
+
+    private StartupTimeline() {
+        // not instantiable
+    }
+
+    private static long getStartTime() {
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_24_ANDROID_7_0) {
+            // Include the app_process startup
+            return Process.getStartUptimeMillis();
+        }
+        return SystemClock.uptimeMillis();
+    }
+
+    /**
+     * Record the end of a startup phase.
+     *
+     * @param phase the name of the phase which just ended
+     */
+    public static synchronized void mark(String phase) {
+        if (printed) {
+            return;
+        }
+
+        long now = SystemClock.uptimeMillis();
+        TIMELINE.append(' ').append(phase).append('=').append(now - lastTime).append("ms");
+        lastTime = now;
+    }
+
+    /**
+     * Record the end of the last startup phase, and print the whole timeline.
+     *
+     * @param phase the name of the phase which just ended
+     */
+    public static synchronized void markAndPrint(String phase) {
+        if (printed) {
+            return;
+        }
+
+        mark(phase);
+        printed = true;
+        Ln.d("Startup timeline:" + TIMELINE + " (total=" + (lastTime - START_TIME) + "ms)");
+    }
+}
@@ -0,0 +1,152 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+import android.os.Bundle;
+
+/**
+ * Adapt the video bit rate to the network conditions, from the feedback periodically sent by the client.
+ * <p>
+ * The bit rate is decreased multiplicatively when the connection cannot keep up (the packets are queued or the client skips frames), and
+ * increased additively when it can, never above the configured bit rate.
+ * <p>
+ * The configured bit rate may be changed at runtime on client request (SET_VIDEO_PROFILE).
+ */
+public class BitRateAdapter {
+
+    private static final int CONGESTION_DELAY_US = 100_000; // 100ms
+    private static final int UNCONGESTED_DELAY_US = 20_000; // 20ms
+
+    // At least 1 frame out of 4 skipped
+    private static final int SKIPPED_FRAMES_RATIO = 4;
+
+    private static final float DECREASE_FACTOR = 0.75f;
+    private static final int INCREASE_STEPS = 20; // from minBitRate to maxBitRate
+
+    // Number of feedback messages (i.e. seconds) ignored after a change, to let the encoder and the network react before adapting again
+    private static final int HOLD_FEEDBACKS_AFTER_DECREASE = 2;
+
+    private static final int MIN_BIT_RATE = 250_000;
+
+    private final int initialMaxBitRate;
+
+    private int maxBitRate;
+    private int minBitRate;
+
+    private int bitRate;
+    private int hold;
+
+    // Current instance of MediaCodec to apply the bit rate changes to
+    private MediaCodec runningMediaCodec;
+
+    public BitRateAdapter(int maxBitRate) {
+        this.initialMaxBitRate = maxBitRate;
+        setLimits(maxBitRate);
+        this.bitRate = maxBitRate;
+    }
+
+    private void setLimits(int maxBitRate) {
+        this.maxBitRate = maxBitRate;
+        this.minBitRate = Math.min(maxBitRate, Math.max(maxBitRate / 10, MIN_BIT_RATE));
+    }
+
+    public synchronized int getBitRate() {
+        return bitRate;
+    }
+
+    public synchronized void setRunningMediaCodec(MediaCodec runningMediaCodec) {
+        this.runningMediaCodec = runningMediaCodec;
+    }
+
+    /**
+     * Change the configured bit rate, and apply it immediately.
+     *
+     * @param maxBitRate the new bit rate, or 0 to restore the initial value
+     */
+    public synchronized void setMaxBitRate(int maxBitRate) {
+        int newMaxBitRate = maxBitRate > 0 ? maxBitRate : initialMaxBitRate;
+        if (newMaxBitRate == this.maxBitRate) {
+            return;
+        }
+
+        Ln.d("Video max bit rate: " + this.maxBitRate + " -> " + newMaxBitRate);
+        setLimits(newMaxBitRate);
+        // Start again from the new value, the adaptation (if enabled) will decrease it if necessary
+        bitRate = newMaxBitRate;
+        hold = 0;
+        apply();
+    }
+
+    /**
+     * Handle a feedback from the client.
+     *
+     * @param receiveRate the receive rate, in bytes per second
+     * @param delay the average queuing delay of the video packets, in microseconds
+     * @param frames the number of frames received
+     * @param skippedFrames the number of frames not rendered
+     */
+    public synchronized void onFeedback(int receiveRate, int delay, int frames, int skippedFrames) {
+        if (hold > 0) {
+            --hold;
+            return;
+        }
+
+        boolean congested = delay > CONGESTION_DELAY_US || skippedFrames * SKIPPED_FRAMES_RATIO > frames;
+        int newBitRate;
+        if (congested) {
+            newBitRate = (int) (bitRate * DECREASE_FACTOR);
+            // The network could not deliver more than the receive rate
+            long receiveBitRate = receiveRate * 8L;
+            if (receiveBitRate > 0 && receiveBitRate < newBitRate) {
+                newBitRate = (int) receiveBitRate;
+            }
+            newBitRate = Math.max(newBitRate, minBitRate);
+            hold = HOLD_FEEDBACKS_AFTER_DECREASE;
+        } else if (delay < UNCONGESTED_DELAY_US) {
+            int step = Math.max((maxBitRate - minBitRate) / INCREASE_STEPS, 1);
+            newBitRate = Math.min(bitRate + step, maxBitRate);
+        } else {
+            // Keep the current bit rate
+            return;
+        }
+
+        if (newBitRate != bitRate) {
+            Ln.d("Video bit rate: " + bitRate + " -> " + newBitRate + " (receive rate: " + receiveRate * 8L + " bps, delay: " + delay / 1000
+                    + " ms, skipped: " + skippedFrames + "/" + frames + ")");
+            bitRate = newBitRate;
+            apply();
+        }
+    }
+
+    /**
+     * Handle a congestion of the socket detected on the device (the packets cannot be written as fast as they are produced).
+     * <p>
+     * This reacts faster than the client feedback, which is only received once per second.
+     */
+    public synchronized void onSocketCongestion() {
+        if (hold > 0) {
+            return;
+        }
+
+        int newBitRate = Math.max((int) (bitRate * DECREASE_FACTOR), minBitRate);
+        hold = HOLD_FEEDBACKS_AFTER_DECREASE;
+        if (newBitRate != bitRate) {
+            Ln.d("Video bit rate: " + bitRate + " -> " + newBitRate + " (socket congested)");
+            bitRate = newBitRate;
+            apply();
+        }
+    }
+
+    private void apply() {
+        if (runningMediaCodec != null) {
+            Bundle params = new Bundle();
+            params.putInt(MediaCodec.PARAMETER_KEY_VIDEO_BITRATE, bitRate);
+            try {
+                runningMediaCodec.setParameters(params);
+            } catch (IllegalStateException e) {
+                // The encoder is being stopped, the new bit rate will be used on the next configuration
+            }
+        }
+    }
+}
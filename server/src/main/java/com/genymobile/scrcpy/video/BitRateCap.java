@@ -0,0 +1,100 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+import android.os.Bundle;
+
+/**
+ * Enforce a peak bit rate (--video-max-bit-rate), measured over each second of encoded video.
+ * <p>
+ * In CBR and VBR modes, the target bit rate is lowered proportionally for the next second, then restored once the peak is respected. In CQ
+ * mode, the encoder has no bit rate control at all, so it must fall back to VBR (which requires to reconfigure the encoder).
+ */
+public class BitRateCap {
+
+    private static final long WINDOW_US = 1_000_000;
+    // Restore the target bit rate below this fraction of the peak
+    private static final float RESTORE_RATIO = 0.8f;
+
+    private final int maxBitRate;
+
+    private long windowStartUs = -1;
+    private long windowBytes;
+    private boolean lowered;
+    private boolean exceeded; // the peak has been exceeded in CQ mode (never reset)
+
+    public BitRateCap(int maxBitRate) {
+        assert maxBitRate > 0;
+        this.maxBitRate = maxBitRate;
+    }
+
+    public boolean isExceeded() {
+        return exceeded;
+    }
+
+    public void reset() {
+        windowStartUs = -1;
+        windowBytes = 0;
+        lowered = false;
+    }
+
+    /**
+     * Account for an encoded packet.
+     *
+     * @param codec the running encoder
+     * @param ptsUs the packet timestamp
+     * @param size the packet size
+     * @param targetBitRate the configured target bit rate (possibly adapted)
+     * @param cq {@code true} if the encoder runs in CQ mode
+     * @return {@code true} if the peak is exceeded in CQ mode, so that the encoder must fall back to VBR
+     */
+    public boolean onPacket(MediaCodec codec, long ptsUs, int size, int targetBitRate, boolean cq) {
+        if (windowStartUs == -1) {
+            windowStartUs = ptsUs;
+        }
+
+        long elapsedUs = ptsUs - windowStartUs;
+        if (elapsedUs < WINDOW_US) {
+            windowBytes += size;
+            return false;
+        }
+
+        long bitRate = windowBytes * 8 * 1_000_000 / elapsedUs;
+        windowStartUs = ptsUs;
+        windowBytes = size;
+
+        if (bitRate > maxBitRate) {
+            if (cq) {
+                if (exceeded) {
+                    // The fallback is already requested
+                    return false;
+                }
+                Ln.w("Video bit rate " + bitRate + " above the peak " + maxBitRate + " in CQ mode, fall back to VBR");
+                exceeded = true;
+                return true;
+            }
+
+            int newBitRate = (int) (targetBitRate * maxBitRate / bitRate);
+            Ln.d("Video bit rate " + bitRate + " above the peak " + maxBitRate + ", target lowered to " + newBitRate);
+            setBitRate(codec, newBitRate);
+            lowered = true;
+        } else if (lowered && bitRate < maxBitRate * RESTORE_RATIO) {
+            Ln.d("Video bit rate target restored to " + targetBitRate);
+            setBitRate(codec, targetBitRate);
+            lowered = false;
+        }
+
+        return false;
+    }
+
+    private static void setBitRate(MediaCodec codec, int bitRate) {
+        Bundle bundle = new Bundle();
+        bundle.putInt(MediaCodec.PARAMETER_KEY_VIDEO_BITRATE, bitRate);
+        try {
+            codec.setParameters(bundle);
+        } catch (IllegalStateException e) {
+            // The codec is being stopped
+        }
+    }
+}
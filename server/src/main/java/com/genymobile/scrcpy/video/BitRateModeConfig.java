@@ -0,0 +1,91 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.annotation.SuppressLint;
+import android.media.MediaCodec;
+import android.media.MediaCodecInfo;
+import android.media.MediaFormat;
+import android.os.Build;
+import android.util.Range;
+
+/**
+ * Bit rate mode encoder configuration (--video-bit-rate-mode and --video-quality).
+ * <p>
+ * The mode is only set if the encoder supports it, otherwise the encoder default mode (often CBR) is kept.
+ */
+public final class BitRateModeConfig {
+
+    public static final int MODE_DEFAULT = -1;
+    public static final int MODE_CQ = MediaCodecInfo.EncoderCapabilities.BITRATE_MODE_CQ;
+    public static final int MODE_VBR = MediaCodecInfo.EncoderCapabilities.BITRATE_MODE_VBR;
+    public static final int MODE_CBR = MediaCodecInfo.EncoderCapabilities.BITRATE_MODE_CBR;
+
+    public static final int QUALITY_DEFAULT = -1;
+
+    private BitRateModeConfig() {
+        // not instantiable
+    }
+
+    public static int parseMode(String value) {
+        switch (value) {
+            case "cbr":
+                return MODE_CBR;
+            case "vbr":
+                return MODE_VBR;
+            case "cq":
+                return MODE_CQ;
+            default:
+                throw new IllegalArgumentException("Invalid video bit rate mode: " + value);
+        }
+    }
+
+    public static String getModeName(int mode) {
+        switch (mode) {
+            case MODE_CBR:
+                return "cbr";
+            case MODE_VBR:
+                return "vbr";
+            case MODE_CQ:
+                return "cq";
+            default:
+                return "default";
+        }
+    }
+
+    /**
+     * Apply the bit rate mode (and the quality target in CQ mode) to the format.
+     *
+     * @return the mode applied, or {@link #MODE_DEFAULT} if the encoder does not support the requested mode
+     */
+    @SuppressLint("InlinedApi")
+    public static int apply(MediaCodec mediaCodec, MediaFormat format, int mode, int quality) {
+        String mimeType = format.getString(MediaFormat.KEY_MIME);
+        MediaCodecInfo.CodecCapabilities capabilities = mediaCodec.getCodecInfo().getCapabilitiesForType(mimeType);
+        MediaCodecInfo.EncoderCapabilities encoderCapabilities = capabilities.getEncoderCapabilities();
+        if (encoderCapabilities == null || !encoderCapabilities.isBitrateModeSupported(mode)) {
+            Ln.w("Video bit rate mode " + getModeName(mode) + " not supported by the encoder, ignored");
+            return MODE_DEFAULT;
+        }
+
+        format.setInteger(MediaFormat.KEY_BITRATE_MODE, mode);
+        Ln.d("Video encoder bit rate mode: " + getModeName(mode));
+
+        if (mode == MODE_CQ && quality != QUALITY_DEFAULT) {
+            if (Build.VERSION.SDK_INT < AndroidVersions.API_28_ANDROID_9) {
+                Ln.w("Video quality requires Android >= 9, ignored");
+            } else {
+                Range<Integer> range = encoderCapabilities.getQualityRange();
+                int clamped = range.clamp(quality);
+                if (clamped != quality) {
+                    Ln.w("Video quality " + quality + " out of the encoder range " + range + ", clamped to " + clamped);
+                }
+                format.setInteger(MediaFormat.KEY_QUALITY, clamped);
+                Ln.d("Video encoder quality: " + clamped);
+            }
+        }
+
+        return mode;
+    }
+}
@@ -70,6 +70,8 @@ public class CameraCapture extends SurfaceCapture {
 
     private AffineMatrix transform;
     private OpenGLRunner glRunner;
+    // The crop applied by the camera pipeline (in sensor active array coordinates), or null if the crop is applied by OpenGL
+    private Rect cropRegion;
 
     private HandlerThread cameraThread;
     private Handler cameraHandler;
@@ -115,10 +117,22 @@ public class CameraCapture extends SurfaceCapture {
     @Override
     public void prepare() throws IOException {
         try {
-            captureSize = selectSize(cameraId, explicitSize, maxSize, aspectRatio, highSpeed);
+            captureSize = selectSize(cameraId, explicitSize, maxSize, aspectRatio, highSpeed, fps);
             if (captureSize == null) {
                 throw new IOException("Could not select camera size");
             }
+
+            cropRegion = null;
+            if (crop != null && captureOrientation == Orientation.Orient0 && angle == 0) {
+                // A plain crop may be applied by the camera pipeline (ISP) instead of an additional OpenGL pass
+                Size outputSize = selectIspCrop(captureSize);
+                if (outputSize != null) {
+                    captureSize = outputSize;
+                    videoSize = outputSize;
+                    transform = null;
+                    return;
+                }
+            }
         } catch (CameraAccessException e) {
             throw new IOException(e);
         }
@@ -170,8 +184,8 @@ public class CameraCapture extends SurfaceCapture {
     }
 
     @TargetApi(AndroidVersions.API_24_ANDROID_7_0)
-    private static Size selectSize(String cameraId, Size explicitSize, int maxSize, CameraAspectRatio aspectRatio, boolean highSpeed)
-            throws CameraAccessException {
+    private static Size selectSize(String cameraId, Size explicitSize, int maxSize, CameraAspectRatio aspectRatio, boolean highSpeed,
+            int fps) throws CameraAccessException {
         if (explicitSize != null) {
             return explicitSize;
         }
@@ -186,6 +200,10 @@ public class CameraCapture extends SurfaceCapture {
         }
 
         Stream<android.util.Size> stream = Arrays.stream(sizes);
+        if (highSpeed) {
+            // In a constrained high speed session, only some sizes support the requested frame rate
+            stream = stream.filter(it -> supportsHighSpeedFps(configs, it, fps));
+        }
         if (maxSize > 0) {
             stream = stream.filter(it -> it.getWidth() <= maxSize && it.getHeight() <= maxSize);
         }
@@ -237,6 +255,92 @@ public class CameraCapture extends SurfaceCapture {
         return null;
     }
 
+    /**
+     * Select a native output size having the aspect ratio of the crop, and the matching crop region of the sensor, so that the crop and the
+     * scaling are applied by the camera pipeline.
+     *
+     * @param fullSize the capture size without crop (in which the crop is defined)
+     * @return the output size (the crop region is stored in {@link #cropRegion}), or {@code null} if the crop must be applied by OpenGL
+     */
+    private Size selectIspCrop(Size fullSize) throws CameraAccessException {
+        if (!VideoFilter.isCropValid(crop, fullSize, false)) {
+            // Reported by the OpenGL filter
+            return null;
+        }
+
+        CameraCharacteristics characteristics = ServiceManager.getCameraManager().getCameraCharacteristics(cameraId);
+        Rect activeArray = characteristics.get(CameraCharacteristics.SENSOR_INFO_ACTIVE_ARRAY_SIZE);
+        Float maxZoom = characteristics.get(CameraCharacteristics.SCALER_AVAILABLE_MAX_DIGITAL_ZOOM);
+        StreamConfigurationMap configs = characteristics.get(CameraCharacteristics.SCALER_STREAM_CONFIGURATION_MAP);
+        if (activeArray == null || maxZoom == null || configs == null) {
+            return null;
+        }
+
+        // The full capture is the largest centered area of the active array having its aspect ratio
+        float scale = Math.min((float) activeArray.width() / fullSize.getWidth(), (float) activeArray.height() / fullSize.getHeight());
+        float x = activeArray.left + (activeArray.width() - fullSize.getWidth() * scale) / 2;
+        float y = activeArray.top + (activeArray.height() - fullSize.getHeight() * scale) / 2;
+        Rect region = new Rect(Math.round(x + crop.left * scale), Math.round(y + crop.top * scale), Math.round(x + crop.right * scale),
+                Math.round(y + crop.bottom * scale));
+        if (region.width() * maxZoom < activeArray.width() || region.height() * maxZoom < activeArray.height()) {
+            Ln.d("Camera crop beyond the digital zoom capabilities, applied by OpenGL");
+            return null;
+        }
+
+        android.util.Size[] sizes = highSpeed ? configs.getHighSpeedVideoSizes() : configs.getOutputSizes(MediaCodec.class);
+        if (sizes == null) {
+            return null;
+        }
+
+        // The output size must have the aspect ratio of the crop, otherwise the camera would crop the region further
+        float cropAspectRatio = (float) crop.width() / crop.height();
+        Size target = new Size(crop.width(), crop.height()).limit(maxSize);
+        Size selected = null;
+        for (android.util.Size size : sizes) {
+            int w = size.getWidth();
+            int h = size.getHeight();
+            if ((w & 7) != 0 || (h & 7) != 0 || (maxSize > 0 && (w > maxSize || h > maxSize))) {
+                continue;
+            }
+            if (highSpeed && !supportsHighSpeedFps(configs, size, fps)) {
+                continue;
+            }
+            float arRatio = ((float) w / h) / cropAspectRatio;
+            if (arRatio < 0.99f || arRatio > 1.01f) {
+                continue;
+            }
+
+            // Prefer the largest size not exceeding the target (no upscaling), otherwise the smallest size above
+            boolean fits = w <= target.getWidth();
+            if (selected == null) {
+                selected = new Size(w, h);
+            } else {
+                boolean selectedFits = selected.getWidth() <= target.getWidth();
+                if (fits ? !selectedFits || w > selected.getWidth() : !selectedFits && w < selected.getWidth()) {
+                    selected = new Size(w, h);
+                }
+            }
+        }
+
+        if (selected == null) {
+            Ln.d("No camera output size matching the crop aspect ratio, crop applied by OpenGL");
+            return null;
+        }
+
+        cropRegion = region;
+        Ln.i("Camera crop applied by the camera pipeline: sensor region " + region + ", output " + selected);
+        return selected;
+    }
+
+    private static boolean supportsHighSpeedFps(StreamConfigurationMap configs, android.util.Size size, int fps) {
+        for (Range<Integer> range : configs.getHighSpeedVideoFpsRangesFor(size)) {
+            if (range.getUpper() == fps) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     private static Float resolveAspectRatio(CameraAspectRatio ratio, CameraCharacteristics characteristics) {
         if (ratio == null) {
             return null;
@@ -250,6 +354,12 @@ public class CameraCapture extends SurfaceCapture {
         return ratio.getAspectRatio();
     }
 
+    @Override
+    public float[] getOpenGLTransformMatrix() {
+        // The transform matrix returned by SurfaceTexture is incorrect for camera capture
+        return VFLIP_MATRIX;
+    }
+
     @Override
     public void start(Surface surface) throws IOException {
         if (transform != null) {
@@ -294,6 +404,12 @@ public class CameraCapture extends SurfaceCapture {
         return videoSize;
     }
 
+    @Override
+    public int getFrameRate() {
+        // The AE target FPS range is fixed to [fps, fps]
+        return fps;
+    }
+
     @Override
     public boolean setMaxSize(int maxSize) {
         if (explicitSize != null) {
@@ -304,6 +420,12 @@ public class CameraCapture extends SurfaceCapture {
         return true;
     }
 
+    @Override
+    public boolean setCrop(Rect crop) {
+        // The camera capture size depends on the max size, a crop could not be validated in advance
+        return false;
+    }
+
     @SuppressLint("MissingPermission")
     @TargetApi(AndroidVersions.API_31_ANDROID_12)
     private CameraDevice openCamera(String id) throws CameraAccessException, InterruptedException {
@@ -388,6 +510,10 @@ public class CameraCapture extends SurfaceCapture {
             requestBuilder.set(CaptureRequest.CONTROL_AE_TARGET_FPS_RANGE, new Range<>(fps, fps));
         }
 
+        if (cropRegion != null) {
+            requestBuilder.set(CaptureRequest.SCALER_CROP_REGION, cropRegion);
+        }
+
         return requestBuilder.build();
     }
 
@@ -0,0 +1,60 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.opengl.OpenGLRunner;
+
+import java.util.ArrayDeque;
+
+/**
+ * Track the frames actually produced by the capture, to distinguish them from the frames repeated by the encoder.
+ * <p/>
+ * When no new frame is produced, the encoder repeats the last one (after {@code KEY_REPEAT_PREVIOUS_FRAME_AFTER}). Its output does not tell
+ * which frames are repeated, so the captured frames are observed on their way to the encoder (via an OpenGL pass), and their timestamps
+ * are matched against the PTS of the encoded frames.
+ */
+public class CapturedFrameTracker implements OpenGLRunner.FrameListener {
+
+    // The encoder outputs the frames shortly after they are captured, keep a margin for the frames it drops (on max fps)
+    private static final int CAPACITY = 64;
+
+    // Timestamps (in microseconds, like the encoder PTS) of the captured frames not encoded yet, in increasing order
+    private final ArrayDeque<Long> timestamps = new ArrayDeque<>(CAPACITY);
+
+    @Override
+    public synchronized void onFrame(long timestampNs) {
+        if (timestamps.size() == CAPACITY) {
+            // The encoder is far behind (or dropped many frames), forget the oldest one
+            timestamps.poll();
+        }
+        // Like the encoder, convert the input timestamp to microseconds
+        timestamps.add(timestampNs / 1000);
+    }
+
+    /**
+     * Indicate whether an encoded frame comes from a new captured frame.
+     * <p/>
+     * Must be called with the PTS of the encoded frames, in increasing order.
+     *
+     * @param pts the encoded frame PTS, in microseconds
+     * @return {@code true} if the frame has been produced by the capture, {@code false} if it has been repeated by the encoder
+     */
+    public synchronized boolean isCaptured(long pts) {
+        // Forget the frames dropped by the encoder
+        while (!timestamps.isEmpty() && timestamps.peek() < pts) {
+            timestamps.poll();
+        }
+
+        if (!timestamps.isEmpty() && timestamps.peek() == pts) {
+            timestamps.poll();
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * Forget the frames of the previous encoding session.
+     */
+    public synchronized void reset() {
+        timestamps.clear();
+    }
+}
@@ -0,0 +1,99 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.control.PositionMapper;
+import com.genymobile.scrcpy.device.Orientation;
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.opengl.AffineOpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLFilter;
+import com.genymobile.scrcpy.opengl.TiledOpenGLFilter;
+import com.genymobile.scrcpy.util.AffineMatrix;
+
+import android.graphics.Rect;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Layout of several crop areas of the same display, tiled into a single video.
+ * <p/>
+ * Each area is filtered independently (crop, orientation, angle) at full resolution. The tiles are placed side by side or stacked,
+ * whichever gives the smaller video, then the whole video is limited to the max size.
+ */
+public final class CropTiles {
+
+    private final Size videoSize;
+    private final List<Rect> tiles;
+    private final List<AffineMatrix> transforms;
+
+    private CropTiles(Size videoSize, List<Rect> tiles, List<AffineMatrix> transforms) {
+        this.videoSize = videoSize;
+        this.tiles = tiles;
+        this.transforms = transforms;
+    }
+
+    public static CropTiles create(Size displaySize, List<Rect> crops, int displayRotation, boolean locked, Orientation captureOrientation,
+            float angle, int maxSize) {
+        List<Size> tileSizes = new ArrayList<>(crops.size());
+        List<AffineMatrix> transforms = new ArrayList<>(crops.size());
+        int sumWidth = 0;
+        int sumHeight = 0;
+        int maxWidth = 0;
+        int maxHeight = 0;
+        for (Rect crop : crops) {
+            VideoFilter filter = new VideoFilter(displaySize);
+            boolean transposed = (displayRotation % 2) != 0;
+            filter.addCrop(crop, transposed);
+            filter.addOrientation(displayRotation, locked, captureOrientation);
+            filter.addAngle(angle);
+
+            Size size = filter.getOutputSize();
+            tileSizes.add(size);
+            AffineMatrix transform = filter.getInverseTransform();
+            // Every tile is rendered by OpenGL, even if its transform is the identity
+            transforms.add(transform != null ? transform : AffineMatrix.IDENTITY);
+
+            sumWidth += size.getWidth();
+            sumHeight += size.getHeight();
+            maxWidth = Math.max(maxWidth, size.getWidth());
+            maxHeight = Math.max(maxHeight, size.getHeight());
+        }
+
+        boolean horizontal = (long) sumWidth * maxHeight <= (long) maxWidth * sumHeight;
+        Size fullSize = horizontal ? new Size(sumWidth, maxHeight) : new Size(maxWidth, sumHeight);
+        Size videoSize = fullSize.limit(maxSize).round8();
+
+        double scaleX = (double) videoSize.getWidth() / fullSize.getWidth();
+        double scaleY = (double) videoSize.getHeight() / fullSize.getHeight();
+
+        List<Rect> tiles = new ArrayList<>(crops.size());
+        int offset = 0;
+        for (Size size : tileSizes) {
+            int x = horizontal ? offset : 0;
+            int y = horizontal ? 0 : offset;
+            int left = (int) Math.round(x * scaleX);
+            int top = (int) Math.round(y * scaleY);
+            int right = (int) Math.round((x + size.getWidth()) * scaleX);
+            int bottom = (int) Math.round((y + size.getHeight()) * scaleY);
+            tiles.add(new Rect(left, top, right, bottom));
+            offset += horizontal ? size.getWidth() : size.getHeight();
+        }
+
+        return new CropTiles(videoSize, tiles, transforms);
+    }
+
+    public Size getVideoSize() {
+        return videoSize;
+    }
+
+    public OpenGLFilter createOpenGLFilter() {
+        List<OpenGLFilter> filters = new ArrayList<>(transforms.size());
+        for (AffineMatrix transform : transforms) {
+            filters.add(new AffineOpenGLFilter(transform));
+        }
+        return new TiledOpenGLFilter(filters, tiles, videoSize);
+    }
+
+    public PositionMapper createPositionMapper(Size targetSize) {
+        return PositionMapper.createTiled(videoSize, tiles, transforms, targetSize);
+    }
+}
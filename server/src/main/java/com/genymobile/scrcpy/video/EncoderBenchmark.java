@@ -0,0 +1,205 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.util.Codec;
+import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.Paint;
+import android.media.MediaCodec;
+import android.media.MediaCodecInfo;
+import android.media.MediaCodecList;
+import android.media.MediaFormat;
+import android.os.Build;
+import android.view.Surface;
+
+import java.io.IOException;
+
+/**
+ * Select the video encoder by briefly encoding a synthetic surface with each candidate (for --video-encoder=auto-benchmark).
+ */
+public final class EncoderBenchmark {
+
+    public static final String AUTO_BENCHMARK = "auto-benchmark";
+
+    private static final int WIDTH = 1280;
+    private static final int HEIGHT = 720;
+    private static final int FRAME_COUNT = 30;
+    private static final long FRAME_INTERVAL_US = 16_666; // 60 fps
+    // Frames not output after this delay are considered lost
+    private static final long DRAIN_TIMEOUT_US = 500_000;
+
+    private static final class Result {
+        private int frames;
+        private long totalLatencyUs;
+        private long durationUs;
+
+        long getAverageLatencyUs() {
+            return totalLatencyUs / frames;
+        }
+
+        float getFps() {
+            return frames * 1_000_000f / durationUs;
+        }
+    }
+
+    private EncoderBenchmark() {
+        // not instantiable
+    }
+
+    /**
+     * Benchmark all the encoders for the codec.
+     *
+     * @return the name of the encoder having the lowest latency among those which output most of the frames, or {@code null} to use the
+     * default encoder
+     */
+    public static String selectEncoder(Codec codec, int bitRate) {
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_23_ANDROID_6_0) {
+            Ln.w("Video encoder benchmark not supported before Android 6, using the default encoder");
+            return null;
+        }
+
+        MediaCodecList codecList = new MediaCodecList(MediaCodecList.REGULAR_CODECS);
+        MediaCodecInfo[] encoders = CodecUtils.getEncoders(codecList, codec.getMimeType());
+
+        String selected = null;
+        long selectedLatencyUs = Long.MAX_VALUE;
+        for (MediaCodecInfo info : encoders) {
+            if (Build.VERSION.SDK_INT >= AndroidVersions.API_29_ANDROID_10 && info.isAlias()) {
+                // Already benchmarked under its canonical name
+                continue;
+            }
+
+            String name = info.getName();
+            Result result = benchmark(name, codec.getMimeType(), bitRate);
+            if (result == null) {
+                continue;
+            }
+
+            long latencyUs = result.getAverageLatencyUs();
+            Ln.i("Video encoder benchmark: '" + name + "': " + String.format("%.1f", result.getFps()) + " fps, latency " + latencyUs / 1000
+                    + " ms (" + result.frames + "/" + FRAME_COUNT + " frames)");
+            if (result.frames >= FRAME_COUNT / 2 && latencyUs < selectedLatencyUs) {
+                selected = name;
+                selectedLatencyUs = latencyUs;
+            }
+        }
+
+        if (selected == null) {
+            Ln.w("Video encoder benchmark failed, using the default encoder");
+        } else {
+            Ln.i("Video encoder selected by benchmark: '" + selected + "'");
+        }
+        return selected;
+    }
+
+    private static Result benchmark(String encoderName, String mimeType, int bitRate) {
+        MediaCodec mediaCodec = null;
+        Surface surface = null;
+        try {
+            mediaCodec = MediaCodec.createByCodecName(encoderName);
+
+            MediaFormat format = MediaFormat.createVideoFormat(mimeType, WIDTH, HEIGHT);
+            format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
+            format.setInteger(MediaFormat.KEY_FRAME_RATE, 60);
+            format.setInteger(MediaFormat.KEY_COLOR_FORMAT, MediaCodecInfo.CodecCapabilities.COLOR_FormatSurface);
+            format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, 10);
+            mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
+            surface = mediaCodec.createInputSurface();
+            mediaCodec.start();
+
+            return run(mediaCodec, surface);
+        } catch (IOException | IllegalArgumentException | IllegalStateException e) {
+            Ln.d("Video encoder benchmark: '" + encoderName + "' failed: " + e.getMessage());
+            return null;
+        } finally {
+            if (mediaCodec != null) {
+                try {
+                    mediaCodec.stop();
+                } catch (IllegalStateException e) {
+                    // ignore (the codec may not be started)
+                }
+                mediaCodec.release();
+            }
+            if (surface != null) {
+                surface.release();
+            }
+        }
+    }
+
+    private static long nowUs() {
+        // Same time base as the surface timestamps, used as the presentation times of the output buffers
+        return System.nanoTime() / 1000;
+    }
+
+    private static Result run(MediaCodec mediaCodec, Surface surface) {
+        Result result = new Result();
+        MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        Paint paint = new Paint();
+
+        long startUs = nowUs();
+        for (int i = 0; i < FRAME_COUNT; ++i) {
+            drawFrame(surface, paint, i);
+
+            // Collect the output until the next frame is due
+            long nextFrameUs = startUs + (i + 1) * FRAME_INTERVAL_US;
+            long now;
+            while ((now = nowUs()) < nextFrameUs) {
+                drain(mediaCodec, bufferInfo, nextFrameUs - now, result);
+            }
+        }
+
+        mediaCodec.signalEndOfInputStream();
+        long deadlineUs = nowUs() + DRAIN_TIMEOUT_US;
+        long now;
+        while ((now = nowUs()) < deadlineUs) {
+            if (!drain(mediaCodec, bufferInfo, deadlineUs - now, result)) {
+                break;
+            }
+        }
+
+        if (result.frames == 0) {
+            return null;
+        }
+
+        result.durationUs = nowUs() - startUs;
+        return result;
+    }
+
+    private static void drawFrame(Surface surface, Paint paint, int index) {
+        // A moving pattern, so that each frame differs from the previous one
+        Canvas canvas = surface.lockHardwareCanvas();
+        try {
+            canvas.drawColor(Color.rgb(index * 8 % 256, 64, 128));
+            paint.setColor(Color.WHITE);
+            int x = index * WIDTH / FRAME_COUNT;
+            canvas.drawRect(x, 0, x + WIDTH / 8f, HEIGHT, paint);
+        } finally {
+            surface.unlockCanvasAndPost(canvas);
+        }
+    }
+
+    /**
+     * Wait for one output buffer, and account for it.
+     *
+     * @return {@code false} on end of stream
+     */
+    private static boolean drain(MediaCodec mediaCodec, MediaCodec.BufferInfo bufferInfo, long timeoutUs, Result result) {
+        int outputBufferId = mediaCodec.dequeueOutputBuffer(bufferInfo, timeoutUs);
+        if (outputBufferId < 0) {
+            // Timeout or format/buffers changed
+            return true;
+        }
+
+        boolean isConfig = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+        if (!isConfig && bufferInfo.size > 0) {
+            ++result.frames;
+            result.totalLatencyUs += nowUs() - bufferInfo.presentationTimeUs;
+        }
+        mediaCodec.releaseOutputBuffer(outputBufferId, false);
+
+        return (bufferInfo.flags & MediaCodec.BUFFER_FLAG_END_OF_STREAM) == 0;
+    }
+}
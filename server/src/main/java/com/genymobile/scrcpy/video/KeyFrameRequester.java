@@ -0,0 +1,49 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+import android.os.Bundle;
+import android.os.SystemClock;
+
+/**
+ * Request the running encoder to produce a keyframe as soon as possible, on client request (for example to recover from a decoding error
+ * without waiting for the next periodic keyframe).
+ */
+public class KeyFrameRequester {
+
+    // Each keyframe is large, do not let a misbehaving client flood the stream
+    private static final long MIN_INTERVAL_MS = 500;
+
+    private long lastRequest = -MIN_INTERVAL_MS;
+
+    // Current instance of MediaCodec to request the keyframes to
+    private MediaCodec runningMediaCodec;
+
+    public synchronized void setRunningMediaCodec(MediaCodec runningMediaCodec) {
+        this.runningMediaCodec = runningMediaCodec;
+    }
+
+    public synchronized void requestKeyFrame() {
+        if (runningMediaCodec == null) {
+            // The next encoding session will start with a keyframe anyway
+            return;
+        }
+
+        long now = SystemClock.uptimeMillis();
+        if (now - lastRequest < MIN_INTERVAL_MS) {
+            Ln.v("Keyframe request ignored (rate-limited)");
+            return;
+        }
+        lastRequest = now;
+
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_REQUEST_SYNC_FRAME, 0);
+        try {
+            runningMediaCodec.setParameters(params);
+            Ln.d("Keyframe requested");
+        } catch (IllegalStateException e) {
+            // The encoder is being stopped, the next encoding session will start with a keyframe
+        }
+    }
+}
@@ -0,0 +1,67 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.annotation.SuppressLint;
+import android.media.MediaCodec;
+import android.media.MediaCodecInfo;
+import android.media.MediaFormat;
+import android.os.Build;
+
+import java.util.List;
+
+/**
+ * Low-latency encoder configuration (--video-latency=low).
+ * <p>
+ * The standard keys are set if the encoder supports them, and the vendor extensions only if the encoder exposes them.
+ */
+public final class LowLatencyConfig {
+
+    // Vendor extensions enabling the low-latency mode of some encoders
+    private static final String[] VENDOR_LOW_LATENCY_KEYS = {
+            "vendor.qti-ext-enc-low-latency.enable", // Qualcomm
+            "vendor.rtc-ext-enc-low-latency.enable", // Exynos
+    };
+
+    private static final int DEFAULT_OPERATING_RATE = 60;
+
+    private LowLatencyConfig() {
+        // not instantiable
+    }
+
+    @SuppressLint("InlinedApi")
+    public static void apply(MediaCodec mediaCodec, MediaFormat format, float maxFps) {
+        String mimeType = format.getString(MediaFormat.KEY_MIME);
+        MediaCodecInfo.CodecCapabilities capabilities = mediaCodec.getCodecInfo().getCapabilitiesForType(mimeType);
+
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_30_ANDROID_11) {
+            if (capabilities.isFeatureSupported(MediaCodecInfo.CodecCapabilities.FEATURE_LowLatency)) {
+                format.setInteger(MediaFormat.KEY_LOW_LATENCY, 1);
+                Ln.d("Video encoder low latency enabled");
+            } else {
+                Ln.d("Video encoder low latency feature not supported");
+            }
+        }
+
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_23_ANDROID_6_0) {
+            format.setInteger(MediaFormat.KEY_PRIORITY, 0); // realtime
+            // Run the encoder as fast as frames may be produced
+            int operatingRate = maxFps > 0 ? (int) Math.ceil(maxFps) : DEFAULT_OPERATING_RATE;
+            format.setInteger(MediaFormat.KEY_OPERATING_RATE, operatingRate);
+        }
+
+        // No B-frames: each frame can be output as soon as it is encoded ("max-bframes" was honored privately before Android 10)
+        format.setInteger("max-bframes", 0);
+
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_31_ANDROID_12) {
+            List<String> vendorParameters = mediaCodec.getSupportedVendorParameters();
+            for (String key : VENDOR_LOW_LATENCY_KEYS) {
+                if (vendorParameters.contains(key)) {
+                    format.setInteger(key, 1);
+                    Ln.d("Video encoder vendor low latency extension enabled: " + key);
+                }
+            }
+        }
+    }
+}
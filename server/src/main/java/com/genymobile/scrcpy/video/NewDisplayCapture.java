@@ -51,7 +51,7 @@ public class NewDisplayCapture extends SurfaceCapture {
     private int mainDisplayDpi;
     private int maxSize;
     private int displayImePolicy;
-    private final Rect crop;
+    private Rect crop;
     private final boolean captureOrientationLocked;
     private final Orientation captureOrientation;
     private final float angle;
@@ -65,6 +65,10 @@ public class NewDisplayCapture extends SurfaceCapture {
 
     private int dpi;
 
+    // The display size (including rotation) and density requested by the client, applied on the next prepare()
+    private Size requestedDisplaySize;
+    private int requestedDpi; // 0 to keep the current density
+
     public NewDisplayCapture(VirtualDisplayListener vdListener, Options options) {
         this.vdListener = vdListener;
         this.newDisplay = options.getNewDisplay();
@@ -81,6 +85,25 @@ public class NewDisplayCapture extends SurfaceCapture {
         this.vdSystemDecorations = options.getVDSystemDecorations();
     }
 
+    /**
+     * Capture a new virtual display created as an extra display (--extra-display), without the crop and orientation options of the
+     * main display.
+     * <p>
+     * It does not receive input events.
+     */
+    public NewDisplayCapture(NewDisplay newDisplay, Options options) {
+        this.vdListener = null;
+        this.newDisplay = newDisplay;
+        this.maxSize = options.getMaxSize();
+        this.displayImePolicy = options.getDisplayImePolicy();
+        this.crop = null;
+        this.captureOrientationLocked = false;
+        this.captureOrientation = Orientation.Orient0;
+        this.angle = 0;
+        this.vdDestroyContent = options.getVDDestroyContent();
+        this.vdSystemDecorations = options.getVDSystemDecorations();
+    }
+
     @Override
     protected void init() {
         displaySize = newDisplay.getSize();
@@ -121,6 +144,18 @@ public class NewDisplayCapture extends SurfaceCapture {
             displaySize = displayInfo.getSize();
             dpi = displayInfo.getDpi();
             displayRotation = displayInfo.getRotation();
+
+            Size requestedSize;
+            int requestedDensity;
+            synchronized (this) {
+                requestedSize = requestedDisplaySize;
+                requestedDensity = requestedDpi;
+                requestedDisplaySize = null;
+            }
+
+            if (requestedSize != null) {
+                resizeVirtualDisplay(requestedSize, requestedDensity != 0 ? requestedDensity : dpi, displayRotation);
+            }
         }
 
         VideoFilter filter = new VideoFilter(displaySize);
@@ -164,6 +199,25 @@ public class NewDisplayCapture extends SurfaceCapture {
         //                    = DISPLAY_FILTER_MATRIX⁻¹ * FILTER_MATRIX⁻¹
         //                    = displayRotationMatrix * eventTransform
         displayTransform = AffineMatrix.multiplyAll(displayRotationMatrix, eventTransform);
+        if (displayTransform != null && displayTransform.isIdentity() && physicalSize.equals(videoSize)) {
+            // The display rotation is compensated by the filter, so the virtual display can render directly to the encoder surface
+            displayTransform = null;
+        }
+    }
+
+    private void resizeVirtualDisplay(Size size, int newDpi, int displayRotation) {
+        if (size.equals(displaySize) && newDpi == dpi) {
+            return;
+        }
+
+        // The virtual display size is defined in its natural orientation
+        Size naturalSize = (displayRotation % 2) == 0 ? size : size.rotate();
+        virtualDisplay.resize(naturalSize.getWidth(), naturalSize.getHeight(), newDpi);
+        displaySize = size;
+        dpi = newDpi;
+        // The resize is requested, do not invalidate again on the resulting display change
+        displaySizeMonitor.setSessionDisplaySize(displaySize);
+        Ln.i("New display resized: " + displaySize.getWidth() + "x" + displaySize.getHeight() + "/" + dpi);
     }
 
     public void startNew(Surface surface) {
@@ -256,6 +310,27 @@ public class NewDisplayCapture extends SurfaceCapture {
         return true;
     }
 
+    @Override
+    public synchronized boolean setCrop(Rect newCrop) {
+        if (newCrop != null && physicalSize != null) {
+            // The crop is defined in the natural orientation of the display
+            if (!VideoFilter.isCropValid(newCrop, physicalSize, false)) {
+                return false;
+            }
+        }
+
+        crop = newCrop;
+        return true;
+    }
+
+    @Override
+    public synchronized boolean resizeDisplay(Size size, int newDpi) {
+        requestedDisplaySize = size;
+        // An explicit density (--new-display=/<dpi>) is preserved
+        requestedDpi = newDisplay.hasExplicitDpi() ? 0 : newDpi;
+        return true;
+    }
+
     private static int scaleDpi(Size initialSize, int initialDpi, Size size) {
         int den = initialSize.getMax();
         int num = size.getMax();
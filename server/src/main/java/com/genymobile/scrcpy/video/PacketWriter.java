@@ -0,0 +1,230 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.Streamer;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+
+import java.io.IOException;
+import java.io.InterruptedIOException;
+import java.nio.ByteBuffer;
+import java.util.ArrayDeque;
+
+/**
+ * Write the encoded packets to the socket from a separate thread.
+ * <p>
+ * The packets are copied to pooled buffers, so that the encoder output buffers are released immediately: a slow socket does not hold
+ * them (which could stall the encoder). If the socket cannot keep up, the packets are queued up to a limit, then the encoder thread
+ * blocks until a packet is written.
+ * <p>
+ * The queue length is the measure of the congestion: the listener is notified when it reaches a threshold, and when it is empty again, so
+ * that the latency remains bounded (the packets already encoded are never dropped, the decoding of the following frames depends on
+ * them).
+ */
+public final class PacketWriter {
+
+    public interface CongestionListener {
+        /**
+         * Called (from the encoder thread or the writer thread) when the queued packets reach {@link #CONGESTION_THRESHOLD}.
+         * <p>
+         * The listener methods are called without the writer lock held (they may take time, for example to set the encoder parameters), but
+         * never concurrently and always in order.
+         */
+        void onCongestion();
+
+        /**
+         * Called (from the encoder thread or the writer thread) when all the queued packets are written after a congestion.
+         */
+        void onCongestionEnd();
+    }
+
+    private static final class Packet {
+        private ByteBuffer buffer; // direct, reallocated if too small
+        private final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        private boolean repeated;
+    }
+
+    // Maximum number of packets not written yet (the encoder thread blocks beyond)
+    private static final int CAPACITY = 16;
+    private static final int CONGESTION_THRESHOLD = CAPACITY / 2;
+
+    private final Streamer streamer;
+    private final CongestionListener congestionListener; // may be null
+
+    private final ArrayDeque<Packet> queue = new ArrayDeque<>(CAPACITY);
+    private final ArrayDeque<Packet> freePackets = new ArrayDeque<>(CAPACITY);
+    private int allocatedPackets;
+
+    private Thread thread;
+    private boolean stopped;
+    private IOException error; // the write error, rethrown to the encoder thread
+    private boolean congested;
+    private int congestionCount;
+
+    // The congestion state the listener has been notified of, only accessed with listenerLock held
+    private final Object listenerLock = new Object();
+    private boolean notifiedCongested;
+    private int notifiedCongestionCount;
+
+    public PacketWriter(Streamer streamer, CongestionListener congestionListener) {
+        this.streamer = streamer;
+        this.congestionListener = congestionListener;
+    }
+
+    public void start() {
+        thread = new Thread(this::run, "video-writer");
+        thread.start();
+    }
+
+    /**
+     * Stop once all the queued packets are written.
+     */
+    public synchronized void stop() {
+        stopped = true;
+        notifyAll();
+    }
+
+    public void join() throws InterruptedException {
+        if (thread != null) {
+            thread.join();
+        }
+    }
+
+    private void run() {
+        try {
+            while (true) {
+                Packet packet;
+                synchronized (this) {
+                    while (!stopped && queue.isEmpty()) {
+                        wait();
+                    }
+                    if (queue.isEmpty()) {
+                        // Stopped, and all the packets are written
+                        return;
+                    }
+                    packet = queue.poll();
+                }
+
+                streamer.writePacket(packet.buffer, packet.bufferInfo, packet.repeated);
+
+                boolean congestionEnded = false;
+                synchronized (this) {
+                    freePackets.push(packet);
+                    if (congested && queue.isEmpty()) {
+                        congested = false;
+                        congestionEnded = true;
+                        Ln.d("Video socket no longer congested");
+                    }
+                    notifyAll();
+                }
+
+                if (congestionEnded) {
+                    notifyCongestionListener();
+                }
+            }
+        } catch (IOException e) {
+            synchronized (this) {
+                error = e;
+                notifyAll();
+            }
+        } catch (InterruptedException e) {
+            // stop
+        }
+    }
+
+    private synchronized Packet obtainPacket() throws IOException {
+        while (error == null && freePackets.isEmpty() && allocatedPackets == CAPACITY) {
+            try {
+                // The socket cannot keep up, block the encoder
+                wait();
+            } catch (InterruptedException e) {
+                throw new InterruptedIOException();
+            }
+        }
+
+        if (error != null) {
+            throw error;
+        }
+
+        if (!freePackets.isEmpty()) {
+            return freePackets.pop();
+        }
+
+        ++allocatedPackets;
+        return new Packet();
+    }
+
+    /**
+     * Copy the packet and queue it for writing.
+     * <p>
+     * The codec buffer may be released as soon as this method returns.
+     *
+     * @throws IOException if a previous packet could not be written
+     */
+    public void write(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo, boolean repeated) throws IOException {
+        Packet packet = obtainPacket();
+
+        // Copy without holding the lock, the writer thread may write the previous packets meanwhile
+        int size = codecBuffer.remaining();
+        if (packet.buffer == null || packet.buffer.capacity() < size) {
+            // Leave some margin, the packet sizes vary from frame to frame
+            packet.buffer = ByteBuffer.allocateDirect(size + size / 4);
+        }
+        packet.buffer.clear();
+        packet.buffer.put(codecBuffer);
+        packet.buffer.flip();
+        packet.bufferInfo.set(0, size, bufferInfo.presentationTimeUs, bufferInfo.flags);
+        packet.repeated = repeated;
+
+        boolean congestionStarted = false;
+        synchronized (this) {
+            queue.add(packet);
+            if (!congested && queue.size() >= CONGESTION_THRESHOLD) {
+                congested = true;
+                ++congestionCount;
+                congestionStarted = true;
+                Ln.d("Video socket congested (" + queue.size() + " packets queued)");
+            }
+            notifyAll();
+        }
+
+        if (congestionStarted) {
+            notifyCongestionListener();
+        }
+    }
+
+    /**
+     * Notify the listener of the congestion state changes, without holding the writer lock.
+     * <p>
+     * The encoder thread and the writer thread may both change the state meanwhile: the notifications are serialized, and each caller
+     * notifies the changes not notified yet (so that the last state is always notified, and each congestion is notified even if it has
+     * already ended).
+     */
+    private void notifyCongestionListener() {
+        if (congestionListener == null) {
+            return;
+        }
+
+        synchronized (listenerLock) {
+            while (true) {
+                boolean currentCongested;
+                int currentCongestionCount;
+                synchronized (this) {
+                    currentCongested = congested;
+                    currentCongestionCount = congestionCount;
+                }
+
+                if (currentCongestionCount != notifiedCongestionCount) {
+                    notifiedCongestionCount = currentCongestionCount;
+                    notifiedCongested = true;
+                    congestionListener.onCongestion();
+                } else if (!currentCongested && notifiedCongested) {
+                    notifiedCongested = false;
+                    congestionListener.onCongestionEnd();
+                } else {
+                    return;
+                }
+            }
+        }
+    }
+}
@@ -24,13 +24,15 @@ import android.os.IBinder;
 import android.view.Surface;
 
 import java.io.IOException;
+import java.util.List;
 
 public class ScreenCapture extends SurfaceCapture {
 
     private final VirtualDisplayListener vdListener;
     private final int displayId;
     private int maxSize;
-    private final Rect crop;
+    private Rect crop;
+    private final List<Rect> crops;
     private Orientation.Lock captureOrientationLock;
     private Orientation captureOrientation;
     private final float angle;
@@ -44,14 +46,20 @@ public class ScreenCapture extends SurfaceCapture {
     private VirtualDisplay virtualDisplay;
 
     private AffineMatrix transform;
+    private CropTiles cropTiles;
     private OpenGLRunner glRunner;
 
     public ScreenCapture(VirtualDisplayListener vdListener, Options options) {
+        this(vdListener, options, options.getMaxSize());
+    }
+
+    public ScreenCapture(VirtualDisplayListener vdListener, Options options, int maxSize) {
         this.vdListener = vdListener;
         this.displayId = options.getDisplayId();
         assert displayId != Device.DISPLAY_ID_NONE;
-        this.maxSize = options.getMaxSize();
+        this.maxSize = maxSize;
         this.crop = options.getCrop();
+        this.crops = options.getCrops();
         this.captureOrientationLock = options.getCaptureOrientationLock();
         this.captureOrientation = options.getCaptureOrientation();
         assert captureOrientationLock != null;
@@ -59,6 +67,23 @@ public class ScreenCapture extends SurfaceCapture {
         this.angle = options.getAngle();
     }
 
+    /**
+     * Capture an extra display (--extra-display), without the crop and orientation options of the main display.
+     * <p>
+     * It does not receive input events.
+     */
+    public ScreenCapture(int displayId, int maxSize) {
+        this.vdListener = null;
+        this.displayId = displayId;
+        assert displayId != Device.DISPLAY_ID_NONE;
+        this.maxSize = maxSize;
+        this.crop = null;
+        this.crops = null;
+        this.captureOrientationLock = Orientation.Lock.Unlocked;
+        this.captureOrientation = Orientation.Orient0;
+        this.angle = 0;
+    }
+
     @Override
     public void init() {
         displaySizeMonitor.start(displayId, this::invalidate);
@@ -85,6 +110,16 @@ public class ScreenCapture extends SurfaceCapture {
             captureOrientation = Orientation.fromRotation(displayInfo.getRotation());
         }
 
+        boolean locked = captureOrientationLock != Orientation.Lock.Unlocked;
+
+        if (crops != null) {
+            // Several crop areas, tiled into the video
+            cropTiles = CropTiles.create(displaySize, crops, displayInfo.getRotation(), locked, captureOrientation, angle, maxSize);
+            transform = null;
+            videoSize = cropTiles.getVideoSize();
+            return;
+        }
+
         VideoFilter filter = new VideoFilter(displaySize);
 
         if (crop != null) {
@@ -92,7 +127,6 @@ public class ScreenCapture extends SurfaceCapture {
             filter.addCrop(crop, transposed);
         }
 
-        boolean locked = captureOrientationLock != Orientation.Lock.Unlocked;
         filter.addOrientation(displayInfo.getRotation(), locked, captureOrientation);
         filter.addAngle(angle);
 
@@ -106,13 +140,15 @@ public class ScreenCapture extends SurfaceCapture {
             SurfaceControl.destroyDisplay(display);
             display = null;
         }
-        if (virtualDisplay != null) {
-            virtualDisplay.release();
-            virtualDisplay = null;
-        }
 
         Size inputSize;
-        if (transform != null) {
+        if (cropTiles != null) {
+            // The tiles are filtered from the full display content
+            inputSize = displayInfo.getSize();
+            assert glRunner == null;
+            glRunner = new OpenGLRunner(cropTiles.createOpenGLFilter());
+            surface = glRunner.start(inputSize, videoSize, surface);
+        } else if (transform != null) {
             // If there is a filter, it must receive the full display content
             inputSize = displayInfo.getSize();
             assert glRunner == null;
@@ -124,10 +160,17 @@ public class ScreenCapture extends SurfaceCapture {
             inputSize = videoSize;
         }
 
+        if (virtualDisplay != null && !reuseVirtualDisplay(inputSize, surface)) {
+            virtualDisplay.release();
+            virtualDisplay = null;
+        }
+
         try {
-            virtualDisplay = ServiceManager.getDisplayManager()
-                    .createVirtualDisplay("scrcpy", inputSize.getWidth(), inputSize.getHeight(), displayId, surface);
-            Ln.d("Display: using DisplayManager API");
+            if (virtualDisplay == null) {
+                virtualDisplay = ServiceManager.getDisplayManager()
+                        .createVirtualDisplay("scrcpy", inputSize.getWidth(), inputSize.getHeight(), displayId, surface);
+                Ln.d("Display: using DisplayManager API");
+            }
         } catch (Exception displayManagerException) {
             try {
                 display = createDisplay();
@@ -149,19 +192,42 @@ public class ScreenCapture extends SurfaceCapture {
             if (virtualDisplay == null || displayId == 0) {
                 // Surface control or main display: send all events to the original display, relative to the device size
                 Size deviceSize = displayInfo.getSize();
-                positionMapper = PositionMapper.create(videoSize, transform, deviceSize);
+                positionMapper = createPositionMapper(deviceSize);
                 virtualDisplayId = displayId;
             } else {
                 // The positions are relative to the virtual display, not the original display (so use inputSize, not deviceSize!)
-                positionMapper = PositionMapper.create(videoSize, transform, inputSize);
+                positionMapper = createPositionMapper(inputSize);
                 virtualDisplayId = virtualDisplay.getDisplay().getDisplayId();
             }
             vdListener.onNewVirtualDisplay(virtualDisplayId, positionMapper);
         }
     }
 
+    private boolean reuseVirtualDisplay(Size inputSize, Surface surface) {
+        // On capture reset (typically on rotation), resizing the existing virtual display is faster than recreating it
+        try {
+            virtualDisplay.resize(inputSize.getWidth(), inputSize.getHeight(), displayInfo.getDpi());
+            virtualDisplay.setSurface(surface);
+            return true;
+        } catch (RuntimeException e) {
+            Ln.w("Could not reuse the virtual display", e);
+            return false;
+        }
+    }
+
+    private PositionMapper createPositionMapper(Size targetSize) {
+        if (cropTiles != null) {
+            return cropTiles.createPositionMapper(targetSize);
+        }
+        return PositionMapper.create(videoSize, transform, targetSize);
+    }
+
     @Override
     public void stop() {
+        if (virtualDisplay != null) {
+            // The surface is about to be released, the virtual display is kept for the next start()
+            virtualDisplay.setSurface(null);
+        }
         if (glRunner != null) {
             glRunner.stopAndRelease();
             glRunner = null;
@@ -193,6 +259,24 @@ public class ScreenCapture extends SurfaceCapture {
         return true;
     }
 
+    @Override
+    public boolean setCrop(Rect newCrop) {
+        if (crops != null) {
+            // The crop areas are tiled into the video
+            return false;
+        }
+
+        if (newCrop != null && displayInfo != null) {
+            boolean transposed = (displayInfo.getRotation() % 2) != 0;
+            if (!VideoFilter.isCropValid(newCrop, displayInfo.getSize(), transposed)) {
+                return false;
+            }
+        }
+
+        crop = newCrop;
+        return true;
+    }
+
     private static IBinder createDisplay() throws Exception {
         // Since Android 12 (preview), secure displays could not be created with shell permissions anymore.
         // On Android 12 preview, SDK_INT is still R (not S), but CODENAME is "S".
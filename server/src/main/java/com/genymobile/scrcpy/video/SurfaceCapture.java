@@ -3,6 +3,7 @@ package com.genymobile.scrcpy.video;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.Size;
 
+import android.graphics.Rect;
 import android.view.Surface;
 
 import java.io.IOException;
@@ -71,6 +72,26 @@ public abstract class SurfaceCapture {
      */
     public abstract Size getSize();
 
+    /**
+     * Return the frame rate of the capture, if it is known in advance.
+     * <p/>
+     * The encoder is configured accordingly, so that it keeps up with high frame rates.
+     *
+     * @return the frame rate, or 0 if it is variable or unknown
+     */
+    public int getFrameRate() {
+        return 0;
+    }
+
+    /**
+     * Return the transform matrix to apply when the captured frames are rendered with OpenGL.
+     *
+     * @return the transform matrix, or {@code null} to use the one provided by the {@code SurfaceTexture}
+     */
+    public float[] getOpenGLTransformMatrix() {
+        return null;
+    }
+
     /**
      * Set the maximum capture size (set by the encoder if it does not support the current size).
      *
@@ -78,6 +99,27 @@ public abstract class SurfaceCapture {
      */
     public abstract boolean setMaxSize(int maxSize);
 
+    /**
+     * Set the crop area applied on the next capture (requested by the client at runtime).
+     *
+     * @param crop the crop area, or {@code null} to disable cropping
+     * @return {@code true} if the crop is accepted, {@code false} otherwise
+     */
+    public abstract boolean setCrop(Rect crop);
+
+    /**
+     * Resize the captured display on the next capture (requested by the client to match its window).
+     * <p>
+     * Only a display created by scrcpy may be resized.
+     *
+     * @param size the new logical size of the display
+     * @param dpi the new density, or 0 to keep the current one
+     * @return {@code true} if the resize is accepted, {@code false} otherwise
+     */
+    public boolean resizeDisplay(Size size, int dpi) {
+        return false;
+    }
+
     /**
      * Indicate if the capture has been closed internally.
      *
@@ -6,13 +6,19 @@ import com.genymobile.scrcpy.Options;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.device.Streamer;
+import com.genymobile.scrcpy.opengl.AffineOpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLRunner;
+import com.genymobile.scrcpy.util.AffineMatrix;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.CodecOption;
 import com.genymobile.scrcpy.util.CodecUtils;
 import com.genymobile.scrcpy.util.IO;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
+import com.genymobile.scrcpy.util.StartupTimeline;
 
+import android.annotation.SuppressLint;
 import android.media.MediaCodec;
 import android.media.MediaCodecInfo;
 import android.media.MediaFormat;
@@ -29,8 +35,10 @@ import java.util.concurrent.atomic.AtomicBoolean;
 public class SurfaceEncoder implements AsyncProcessor {
 
     private static final int DEFAULT_I_FRAME_INTERVAL = 10; // seconds
+    // With intra refresh, keyframes are only produced on request
+    private static final int INTRA_REFRESH_I_FRAME_INTERVAL = 3600; // seconds
     private static final int REPEAT_FRAME_DELAY_US = 100_000; // repeat after 100ms
-    private static final String KEY_MAX_FPS_TO_ENCODER = "max-fps-to-encoder";
+    static final String KEY_MAX_FPS_TO_ENCODER = "max-fps-to-encoder";
 
     // Keep the values in descending order
     private static final int[] MAX_SIZE_FALLBACK = {2560, 1920, 1600, 1280, 1024, 800};
@@ -38,13 +46,21 @@ public class SurfaceEncoder implements AsyncProcessor {
 
     private final SurfaceCapture capture;
     private final Streamer streamer;
-    private final String encoderName;
+    private String encoderName;
     private final List<CodecOption> codecOptions;
     private final int videoBitRate;
     private final float maxFps;
     private final boolean downsizeOnError;
+    private boolean notifyMaxSize; // only for the main video stream
+    private boolean markRepeatedFrames; // only for the main video stream
+    private final boolean lowLatency;
+    private final int intraRefreshPeriod; // in frames, 0 to disable
+    private final int bitRateMode;
+    private final int quality;
+    private final BitRateCap bitRateCap; // may be null
 
     private boolean firstFrameSent;
+    private int fallbackMaxSize; // 0 if not downsized
     private int consecutiveErrors;
 
     private Thread thread;
@@ -52,23 +68,108 @@ public class SurfaceEncoder implements AsyncProcessor {
 
     private final CaptureReset reset = new CaptureReset();
 
+    private BitRateAdapter bitRateAdapter; // may be null
+    private KeyFrameRequester keyFrameRequester; // may be null
+    private VideoThrottle videoThrottle; // may be null
+    private VideoIdleDetector idleDetector; // may be null
+
     public SurfaceEncoder(SurfaceCapture capture, Streamer streamer, Options options) {
+        this(capture, streamer, options, options.getVideoBitRate(), options.getMaxFps(), options.getVideoEncoder(),
+                options.getVideoIntraRefresh());
+        this.notifyMaxSize = options.getNotifyMaxSize();
+        this.markRepeatedFrames = options.getVideoMarkRepeatedFrames();
+    }
+
+    public SurfaceEncoder(SurfaceCapture capture, Streamer streamer, Options options, int videoBitRate, float maxFps, String encoderName,
+            int intraRefreshPeriod) {
         this.capture = capture;
         this.streamer = streamer;
-        this.videoBitRate = options.getVideoBitRate();
-        this.maxFps = options.getMaxFps();
+        this.videoBitRate = videoBitRate;
+        this.maxFps = maxFps;
         this.codecOptions = options.getVideoCodecOptions();
-        this.encoderName = options.getVideoEncoder();
+        this.encoderName = encoderName;
         this.downsizeOnError = options.getDownsizeOnError();
+        this.lowLatency = options.getVideoLowLatency();
+        this.intraRefreshPeriod = intraRefreshPeriod;
+        this.bitRateMode = options.getVideoBitRateMode();
+        this.quality = options.getVideoQuality();
+        int maxBitRate = options.getVideoMaxBitRate();
+        this.bitRateCap = maxBitRate > 0 ? new BitRateCap(maxBitRate) : null;
+    }
+
+    public void setBitRateAdapter(BitRateAdapter bitRateAdapter) {
+        this.bitRateAdapter = bitRateAdapter;
+    }
+
+    public void setKeyFrameRequester(KeyFrameRequester keyFrameRequester) {
+        this.keyFrameRequester = keyFrameRequester;
+    }
+
+    public void setVideoThrottle(VideoThrottle videoThrottle) {
+        this.videoThrottle = videoThrottle;
+    }
+
+    public void setIdleDetector(VideoIdleDetector idleDetector) {
+        this.idleDetector = idleDetector;
     }
 
     private void streamCapture() throws IOException, ConfigurationException {
         Codec codec = streamer.getCodec();
+        if (EncoderBenchmark.AUTO_BENCHMARK.equals(encoderName)) {
+            encoderName = EncoderBenchmark.selectEncoder(codec, videoBitRate);
+            if (encoderName != null) {
+                Ln.notifyVideoEncoder(encoderName);
+            }
+        }
         MediaCodec mediaCodec = createMediaCodec(codec, encoderName);
-        MediaFormat format = createFormat(codec.getMimeType(), videoBitRate, maxFps, codecOptions);
+        MediaFormat format = createFormat(codec.getMimeType(), videoBitRate, maxFps);
+
+        // The repeated frames are only known by observing the captured frames (at the cost of an OpenGL pass)
+        CapturedFrameTracker frameTracker = markRepeatedFrames || idleDetector != null ? new CapturedFrameTracker() : null;
 
         capture.init(reset);
 
+        if (lowLatency) {
+            LowLatencyConfig.apply(mediaCodec, format, maxFps);
+        }
+        int captureFrameRate = capture.getFrameRate();
+        if (captureFrameRate > 0) {
+            applyFrameRate(format, captureFrameRate);
+        }
+        if (intraRefreshPeriod > 0) {
+            applyIntraRefresh(mediaCodec, format, intraRefreshPeriod);
+        }
+        int appliedBitRateMode = BitRateModeConfig.MODE_DEFAULT;
+        if (bitRateMode != BitRateModeConfig.MODE_DEFAULT) {
+            appliedBitRateMode = BitRateModeConfig.apply(mediaCodec, format, bitRateMode, quality);
+        }
+        // Applied last, so that the explicit codec options take precedence over the low-latency preset
+        applyCodecOptions(format, codecOptions);
+
+        if (videoThrottle == null) {
+            // Only used to suspend the encoder on congestion
+            videoThrottle = new VideoThrottle(maxFps);
+        }
+
+        // The packets are written from a separate thread, so that a slow socket does not hold the encoder output buffers
+        PacketWriter packetWriter = new PacketWriter(streamer, new PacketWriter.CongestionListener() {
+            @Override
+            public void onCongestion() {
+                // Drop the captured frames until the queued packets are written, so that the latency remains bounded (at the cost of a
+                // temporarily lower frame rate), and lower the bit rate so that it does not happen again
+                videoThrottle.setCongested(true);
+                if (bitRateAdapter != null) {
+                    bitRateAdapter.onSocketCongestion();
+                }
+            }
+
+            @Override
+            public void onCongestionEnd() {
+                videoThrottle.setCongested(false);
+            }
+        });
+        packetWriter.start();
+
         try {
             boolean alive;
             boolean headerWritten = false;
@@ -84,15 +185,40 @@ public class SurfaceEncoder implements AsyncProcessor {
 
                 format.setInteger(MediaFormat.KEY_WIDTH, size.getWidth());
                 format.setInteger(MediaFormat.KEY_HEIGHT, size.getHeight());
+                if (bitRateAdapter != null) {
+                    // Keep the adapted bit rate across capture resets
+                    format.setInteger(MediaFormat.KEY_BIT_RATE, bitRateAdapter.getBitRate());
+                }
+                if (videoThrottle != null) {
+                    // Keep the requested max fps across capture resets
+                    videoThrottle.applyTo(format);
+                }
+                if (appliedBitRateMode == BitRateModeConfig.MODE_CQ && bitRateCap != null && bitRateCap.isExceeded()) {
+                    // The peak bit rate cannot be enforced in CQ mode
+                    appliedBitRateMode = BitRateModeConfig.apply(mediaCodec, format, BitRateModeConfig.MODE_VBR,
+                            BitRateModeConfig.QUALITY_DEFAULT);
+                }
 
                 Surface surface = null;
+                OpenGLRunner frameObserver = null;
                 boolean mediaCodecStarted = false;
                 boolean captureStarted = false;
                 try {
                     mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
                     surface = mediaCodec.createInputSurface();
 
-                    capture.start(surface);
+                    Surface captureSurface = surface;
+                    if (frameTracker != null) {
+                        frameTracker.reset();
+                        // Render the captured frames unchanged, only to observe them
+                        OpenGLFilter filter = new AffineOpenGLFilter(AffineMatrix.IDENTITY);
+                        OpenGLRunner observer = new OpenGLRunner(filter, capture.getOpenGLTransformMatrix());
+                        observer.setFrameListener(frameTracker);
+                        captureSurface = observer.start(size, size, surface);
+                        frameObserver = observer;
+                    }
+
+                    capture.start(captureSurface);
                     captureStarted = true;
 
                     mediaCodec.start();
@@ -100,6 +226,15 @@ public class SurfaceEncoder implements AsyncProcessor {
 
                     // Set the MediaCodec instance to "interrupt" (by signaling an EOS) on reset
                     reset.setRunningMediaCodec(mediaCodec);
+                    if (bitRateAdapter != null) {
+                        bitRateAdapter.setRunningMediaCodec(mediaCodec);
+                    }
+                    if (keyFrameRequester != null) {
+                        keyFrameRequester.setRunningMediaCodec(mediaCodec);
+                    }
+                    if (videoThrottle != null) {
+                        videoThrottle.setRunningMediaCodec(mediaCodec);
+                    }
 
                     if (stopped.get()) {
                         alive = false;
@@ -107,7 +242,7 @@ public class SurfaceEncoder implements AsyncProcessor {
                         boolean resetRequested = reset.consumeReset();
                         if (!resetRequested) {
                             // If a reset is requested during encode(), it will interrupt the encoding by an EOS
-                            encode(mediaCodec, streamer);
+                            encode(mediaCodec, packetWriter, frameTracker, appliedBitRateMode == BitRateModeConfig.MODE_CQ);
                         }
                         // The capture might have been closed internally (for example if the camera is disconnected)
                         alive = !stopped.get() && !capture.isClosed();
@@ -124,23 +259,47 @@ public class SurfaceEncoder implements AsyncProcessor {
                     alive = true;
                 } finally {
                     reset.setRunningMediaCodec(null);
+                    if (bitRateAdapter != null) {
+                        bitRateAdapter.setRunningMediaCodec(null);
+                    }
+                    if (keyFrameRequester != null) {
+                        keyFrameRequester.setRunningMediaCodec(null);
+                    }
+                    if (videoThrottle != null) {
+                        videoThrottle.setRunningMediaCodec(null);
+                    }
                     if (captureStarted) {
                         capture.stop();
                     }
+                    if (frameObserver != null) {
+                        frameObserver.stopAndRelease();
+                    }
+                    boolean mediaCodecStopped = false;
                     if (mediaCodecStarted) {
                         try {
                             mediaCodec.stop();
+                            mediaCodecStopped = true;
                         } catch (IllegalStateException e) {
                             // ignore (just in case)
                         }
                     }
-                    mediaCodec.reset();
+                    if (!mediaCodecStopped) {
+                        // A stopped codec may be configured again directly, while reset() reallocates the codec component, which may take
+                        // hundreds of milliseconds (this matters on rotation), so only reset on error
+                        mediaCodec.reset();
+                    }
                     if (surface != null) {
                         surface.release();
                     }
                 }
             } while (alive);
         } finally {
+            packetWriter.stop();
+            try {
+                packetWriter.join();
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+            }
             mediaCodec.release();
             capture.release();
         }
@@ -177,6 +336,8 @@ public class SurfaceEncoder implements AsyncProcessor {
             return false;
         }
 
+        fallbackMaxSize = newMaxSize;
+
         // Retry with a smaller size
         Ln.i("Retrying with -m" + newMaxSize + "...");
         return true;
@@ -194,8 +355,14 @@ public class SurfaceEncoder implements AsyncProcessor {
         return 0;
     }
 
-    private void encode(MediaCodec codec, Streamer streamer) throws IOException {
+    private void encode(MediaCodec codec, PacketWriter packetWriter, CapturedFrameTracker frameTracker, boolean cq) throws IOException {
         MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        if (idleDetector != null) {
+            idleDetector.reset();
+        }
+        if (bitRateCap != null) {
+            bitRateCap.reset();
+        }
 
         boolean eos;
         do {
@@ -207,13 +374,43 @@ public class SurfaceEncoder implements AsyncProcessor {
                     ByteBuffer codecBuffer = codec.getOutputBuffer(outputBufferId);
 
                     boolean isConfig = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+                    boolean repeated = false;
+                    boolean skipped = false;
                     if (!isConfig) {
                         // If this is not a config packet, then it contains a frame
+                        if (!firstFrameSent) {
+                            StartupTimeline.markAndPrint("first-frame");
+                            if (notifyMaxSize && fallbackMaxSize != 0) {
+                                // This max size works, the client may use it directly the next time
+                                Ln.notifyMaxSize(fallbackMaxSize);
+                            }
+                        }
                         firstFrameSent = true;
                         consecutiveErrors = 0;
+
+                        // When no new frame is produced, the encoder input repeats the last frame after REPEAT_FRAME_DELAY_US (the picture
+                        // is unchanged, only its quality may be refined)
+                        long pts = bufferInfo.presentationTimeUs;
+                        repeated = frameTracker != null && !frameTracker.isCaptured(pts);
+
+                        if (idleDetector != null) {
+                            boolean keyFrame = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_KEY_FRAME) != 0;
+                            skipped = !idleDetector.onFrame(codec, pts, repeated, keyFrame);
+                        }
+
+                        if (bitRateCap != null && !skipped) {
+                            int targetBitRate = bitRateAdapter != null ? bitRateAdapter.getBitRate() : videoBitRate;
+                            if (bitRateCap.onPacket(codec, pts, bufferInfo.size, targetBitRate, cq)) {
+                                // Reconfigure the encoder in VBR mode
+                                reset.reset();
+                            }
+                        }
                     }
 
-                    streamer.writePacket(codecBuffer, bufferInfo);
+                    if (!skipped) {
+                        // Copied, so that the output buffer is released immediately
+                        packetWriter.write(codecBuffer, bufferInfo, repeated);
+                    }
                 }
             } finally {
                 if (outputBufferId >= 0) {
@@ -253,7 +450,7 @@ public class SurfaceEncoder implements AsyncProcessor {
         }
     }
 
-    private static MediaFormat createFormat(String videoMimeType, int bitRate, float maxFps, List<CodecOption> codecOptions) {
+    private static MediaFormat createFormat(String videoMimeType, int bitRate, float maxFps) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, videoMimeType);
         format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
@@ -273,6 +470,39 @@ public class SurfaceEncoder implements AsyncProcessor {
             format.setFloat(KEY_MAX_FPS_TO_ENCODER, maxFps);
         }
 
+        return format;
+    }
+
+    private static void applyFrameRate(MediaFormat format, int frameRate) {
+        // The encoder may select its profile level and its clocks from these values, so that it keeps up with high frame rates (for
+        // example with a high speed camera capture)
+        format.setInteger(MediaFormat.KEY_FRAME_RATE, frameRate);
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_23_ANDROID_6_0) {
+            format.setInteger(MediaFormat.KEY_OPERATING_RATE, frameRate);
+        }
+    }
+
+    @SuppressLint("InlinedApi")
+    private static void applyIntraRefresh(MediaCodec mediaCodec, MediaFormat format, int period) {
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_24_ANDROID_7_0) {
+            Ln.w("Intra refresh requires Android >= 7, ignored");
+            return;
+        }
+
+        String mimeType = format.getString(MediaFormat.KEY_MIME);
+        MediaCodecInfo.CodecCapabilities capabilities = mediaCodec.getCodecInfo().getCapabilitiesForType(mimeType);
+        if (!capabilities.isFeatureSupported(MediaCodecInfo.CodecCapabilities.FEATURE_IntraRefresh)) {
+            Ln.w("Intra refresh not supported by the encoder, ignored");
+            return;
+        }
+
+        format.setInteger(MediaFormat.KEY_INTRA_REFRESH_PERIOD, period);
+        // The whole picture is refreshed every period, keyframes are only needed on request
+        format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, INTRA_REFRESH_I_FRAME_INTERVAL);
+        Ln.d("Video encoder intra refresh enabled (period=" + period + " frames)");
+    }
+
+    private static void applyCodecOptions(MediaFormat format, List<CodecOption> codecOptions) {
         if (codecOptions != null) {
             for (CodecOption option : codecOptions) {
                 String key = option.getKey();
@@ -281,8 +511,6 @@ public class SurfaceEncoder implements AsyncProcessor {
                 Ln.d("Video codec option set: " + key + " (" + value.getClass().getSimpleName() + ") = " + value);
             }
         }
-
-        return format;
     }
 
     @Override
@@ -0,0 +1,76 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodecInfo;
+import android.media.MediaCodecList;
+import android.os.Build;
+
+import java.util.List;
+
+/**
+ * Select the video codec among the candidates ranked by the client (for --video-codec=auto).
+ */
+public final class VideoCodecSelector {
+
+    private VideoCodecSelector() {
+        // not instantiable
+    }
+
+    /**
+     * Select the first candidate having a hardware encoder, or the first candidate having any encoder.
+     *
+     * @param candidates the codecs the client can decode, from the preferred one
+     * @return the selected codec
+     */
+    public static VideoCodec select(List<VideoCodec> candidates) {
+        MediaCodecList codecList = new MediaCodecList(MediaCodecList.REGULAR_CODECS);
+
+        VideoCodec fallback = null;
+        for (VideoCodec codec : candidates) {
+            MediaCodecInfo[] encoders = CodecUtils.getEncoders(codecList, codec.getMimeType());
+            if (encoders.length == 0) {
+                Ln.d("No " + codec.getName() + " encoder");
+                continue;
+            }
+
+            if (hasHardwareEncoder(encoders)) {
+                Ln.i("Video codec selected: " + codec.getName());
+                return codec;
+            }
+
+            Ln.d("No hardware " + codec.getName() + " encoder");
+            if (fallback == null) {
+                fallback = codec;
+            }
+        }
+
+        if (fallback == null) {
+            // Should never happen, H.264 encoders are mandatory
+            Ln.w("No encoder for the requested video codecs, fallback to h264");
+            return VideoCodec.H264;
+        }
+
+        Ln.i("Video codec selected: " + fallback.getName() + " (no hardware encoder)");
+        return fallback;
+    }
+
+    private static boolean hasHardwareEncoder(MediaCodecInfo[] encoders) {
+        for (MediaCodecInfo info : encoders) {
+            if (Build.VERSION.SDK_INT >= AndroidVersions.API_29_ANDROID_10) {
+                if (info.isHardwareAccelerated()) {
+                    return true;
+                }
+            } else {
+                // Before Android 10, the software encoders are identified by their name
+                String name = info.getName();
+                if (!name.startsWith("OMX.google.") && !name.startsWith("c2.android.")) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}
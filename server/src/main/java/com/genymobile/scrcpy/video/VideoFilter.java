@@ -8,10 +8,12 @@ import android.graphics.Rect;
 
 public class VideoFilter {
 
+    private final Size inputSize;
     private Size size;
     private AffineMatrix transform;
 
     public VideoFilter(Size inputSize) {
+        this.inputSize = inputSize;
         this.size = inputSize;
     }
 
@@ -23,6 +25,17 @@ public class VideoFilter {
         return transform;
     }
 
+    /**
+     * Indicate whether the filter leaves the input unchanged (for example, a rotation compensated by a locked capture orientation).
+     * <p/>
+     * In that case, the OpenGL pass can be skipped.
+     *
+     * @return {@code true} if the output is identical to the input
+     */
+    public boolean isIdentity() {
+        return (transform == null || transform.isIdentity()) && size.equals(inputSize);
+    }
+
     /**
      * Return the inverse transform.
      * <p/>
@@ -34,10 +47,10 @@ public class VideoFilter {
      *     <li>The click positions must be transformed back to the device positions, using the inverse transform too.</li>
      * </ul>
      *
-     * @return the inverse transform
+     * @return the inverse transform, or {@code null} if the filter is the identity
      */
     public AffineMatrix getInverseTransform() {
-        if (transform == null) {
+        if (isIdentity()) {
             return null;
         }
         return transform.invert();
@@ -48,6 +61,10 @@ public class VideoFilter {
     }
 
     public void addCrop(Rect crop, boolean transposed) {
+        if (!isCropValid(crop, size, transposed)) {
+            throw new IllegalArgumentException("Crop " + crop + " exceeds the input area (" + size + ")");
+        }
+
         if (transposed) {
             crop = transposeRect(crop);
         }
@@ -55,10 +72,6 @@ public class VideoFilter {
         double inputWidth = size.getWidth();
         double inputHeight = size.getHeight();
 
-        if (crop.left < 0 || crop.top < 0 || crop.right > inputWidth || crop.bottom > inputHeight) {
-            throw new IllegalArgumentException("Crop " + crop + " exceeds the input area (" + size + ")");
-        }
-
         double x = crop.left / inputWidth;
         double y = 1 - (crop.bottom / inputHeight); // OpenGL origin is bottom-left
         double w = crop.width() / inputWidth;
@@ -68,6 +81,21 @@ public class VideoFilter {
         size = new Size(crop.width(), crop.height());
     }
 
+    /**
+     * Indicate whether the crop area is contained in the input area.
+     *
+     * @param crop the crop area (in the natural device orientation)
+     * @param inputSize the input size
+     * @param transposed {@code true} if the input is rotated by 90° or 270°
+     * @return {@code true} if the crop is valid
+     */
+    public static boolean isCropValid(Rect crop, Size inputSize, boolean transposed) {
+        if (transposed) {
+            crop = transposeRect(crop);
+        }
+        return crop.left >= 0 && crop.top >= 0 && crop.right <= inputSize.getWidth() && crop.bottom <= inputSize.getHeight();
+    }
+
     public void addRotation(int ccwRotation) {
         if (ccwRotation == 0) {
             return;
@@ -0,0 +1,111 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+import android.os.Bundle;
+
+/**
+ * Stop streaming the video while the device screen is idle.
+ * <p/>
+ * When the screen content does not change, the encoder still repeats the last frame every 100 ms. Once only repeated frames have been
+ * produced for the idle timeout, they are not streamed anymore, so that the client has nothing to decode nor render.
+ * <p/>
+ * The frames skipped this way are still references for the next ones, so when the screen changes again, the streaming only resumes on a
+ * keyframe (requested immediately).
+ */
+public class VideoIdleDetector {
+
+    public interface Listener {
+        void onVideoIdle(boolean idle);
+    }
+
+    private enum State {
+        ACTIVE,
+        IDLE,
+        RESUMING, // waiting for a keyframe
+    }
+
+    private final long timeoutUs;
+    private final Listener listener; // may be null
+
+    private State state = State.ACTIVE;
+    private long lastNewFramePts = -1;
+
+    public VideoIdleDetector(long timeoutUs, Listener listener) {
+        assert timeoutUs > 0;
+        this.timeoutUs = timeoutUs;
+        this.listener = listener;
+    }
+
+    /**
+     * Reset the state for a new encoding session (which starts with a keyframe).
+     */
+    public void reset() {
+        if (state != State.ACTIVE) {
+            setIdle(false);
+        }
+        state = State.ACTIVE;
+        lastNewFramePts = -1;
+    }
+
+    /**
+     * Process a frame produced by the encoder.
+     *
+     * @param codec the running encoder, to request a keyframe on resume
+     * @param pts the frame PTS, in microseconds
+     * @param repeated whether the frame is a repetition of the previous one
+     * @param keyFrame whether the frame is a keyframe
+     * @return {@code true} if the frame must be streamed, {@code false} if it must be skipped
+     */
+    public boolean onFrame(MediaCodec codec, long pts, boolean repeated, boolean keyFrame) {
+        switch (state) {
+            case ACTIVE:
+                if (!repeated || lastNewFramePts == -1) {
+                    lastNewFramePts = pts;
+                } else if (pts - lastNewFramePts >= timeoutUs) {
+                    state = State.IDLE;
+                    setIdle(true);
+                }
+                // The frame which starts the idle period is still streamed
+                return true;
+            case IDLE:
+                if (repeated) {
+                    return false;
+                }
+                state = State.RESUMING;
+                setIdle(false);
+                break;
+            default:
+                // RESUMING
+                break;
+        }
+
+        if (keyFrame) {
+            state = State.ACTIVE;
+            lastNewFramePts = pts;
+            return true;
+        }
+
+        // This frame references skipped frames, it may not be decoded by the client
+        requestKeyFrame(codec);
+        return false;
+    }
+
+    private void setIdle(boolean idle) {
+        Ln.d(idle ? "Video idle" : "Video active");
+        if (listener != null) {
+            listener.onVideoIdle(idle);
+        }
+    }
+
+    private static void requestKeyFrame(MediaCodec codec) {
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_REQUEST_SYNC_FRAME, 0);
+        try {
+            codec.setParameters(params);
+        } catch (IllegalStateException e) {
+            // The encoder is being stopped, the next encoding session will start with a keyframe
+        }
+    }
+}
@@ -0,0 +1,126 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.media.MediaCodec;
+import android.media.MediaFormat;
+import android.os.Bundle;
+
+/**
+ * Change the frame rate cap of the running encoder, or suspend it, on client request (for example while the client window is unfocused or
+ * minimized).
+ * <p/>
+ * The encoder is also suspended while the socket is congested, so that the frames captured meanwhile are dropped rather than queued.
+ * <p/>
+ * The values are applied to the running encoder via {@link MediaCodec#setParameters(Bundle)}, and to the format of the next encoding
+ * sessions. Some encoders ignore a max fps change at runtime, in that case it only takes effect on the next capture reset.
+ * <p/>
+ * The base max fps (initially {@code --max-fps}), restored when the video is not throttled, may be changed by a video profile.
+ */
+public class VideoThrottle {
+
+    private final float initialMaxFps;
+
+    private float baseMaxFps;
+    private int throttleMaxFps; // 0 if not throttled
+    private float maxFps;
+    private boolean paused; // on client request
+    private boolean congested;
+    private boolean suspended; // applied to the encoder (paused or congested)
+
+    // Current instance of MediaCodec to apply the parameters to
+    private MediaCodec runningMediaCodec;
+
+    public VideoThrottle(float initialMaxFps) {
+        this.initialMaxFps = initialMaxFps;
+        this.baseMaxFps = initialMaxFps;
+        this.maxFps = initialMaxFps;
+    }
+
+    public synchronized void setRunningMediaCodec(MediaCodec runningMediaCodec) {
+        this.runningMediaCodec = runningMediaCodec;
+        if (runningMediaCodec != null && suspended) {
+            // A new encoding session is not suspended
+            Bundle params = new Bundle();
+            params.putInt(MediaCodec.PARAMETER_KEY_SUSPEND, 1);
+            setParameters(params);
+        }
+    }
+
+    /**
+     * Set the max fps to the format of the next encoding session.
+     *
+     * @param format the encoder format
+     */
+    public synchronized void applyTo(MediaFormat format) {
+        if (maxFps > 0) {
+            format.setFloat(SurfaceEncoder.KEY_MAX_FPS_TO_ENCODER, maxFps);
+        } else if (format.containsKey(SurfaceEncoder.KEY_MAX_FPS_TO_ENCODER)) {
+            // A negative value disables the limit
+            format.setFloat(SurfaceEncoder.KEY_MAX_FPS_TO_ENCODER, -1);
+        }
+    }
+
+    /**
+     * Throttle the video.
+     *
+     * @param maxFps the max frame rate, or 0 to restore the base value
+     * @param paused {@code true} to suspend the encoding
+     */
+    public synchronized void setThrottle(int maxFps, boolean paused) {
+        throttleMaxFps = maxFps;
+        this.paused = paused;
+        apply();
+    }
+
+    /**
+     * Suspend the encoder while the socket is congested.
+     *
+     * @param congested {@code true} to drop the captured frames until the congestion ends
+     */
+    public synchronized void setCongested(boolean congested) {
+        this.congested = congested;
+        apply();
+    }
+
+    /**
+     * Change the max fps applied when the video is not throttled.
+     *
+     * @param maxFps the max frame rate, or 0 to restore the initial value
+     */
+    public synchronized void setBaseMaxFps(int maxFps) {
+        baseMaxFps = maxFps > 0 ? maxFps : initialMaxFps;
+        apply();
+    }
+
+    private void apply() {
+        float newMaxFps = throttleMaxFps > 0 ? throttleMaxFps : baseMaxFps;
+        boolean newSuspended = paused || congested;
+
+        Bundle params = new Bundle();
+        if (newMaxFps != this.maxFps) {
+            this.maxFps = newMaxFps;
+            params.putFloat(SurfaceEncoder.KEY_MAX_FPS_TO_ENCODER, newMaxFps > 0 ? newMaxFps : -1);
+        }
+        if (newSuspended != suspended) {
+            suspended = newSuspended;
+            // PARAMETER_KEY_SUSPEND ("drop-input-frames"): the frames from the input surface are dropped
+            params.putInt(MediaCodec.PARAMETER_KEY_SUSPEND, suspended ? 1 : 0);
+        }
+
+        Ln.d("Video throttle: max fps " + (newMaxFps > 0 ? newMaxFps : "unlimited") + (paused ? ", paused" : "")
+                + (congested ? ", congested" : ""));
+
+        if (runningMediaCodec != null && !params.isEmpty()) {
+            setParameters(params);
+        }
+    }
+
+    private void setParameters(Bundle params) {
+        try {
+            runningMediaCodec.setParameters(params);
+        } catch (IllegalStateException e) {
+            // The encoder is being stopped, the values will be applied to the next encoding session
+        }
+    }
+}
@@ -152,6 +152,28 @@ public final class DisplayManager {
         }
     }
 
+    /**
+     * Return the refresh rates of the display modes supported by the display, or {@code null} if they could not be retrieved.
+     */
+    @TargetApi(AndroidVersions.API_23_ANDROID_6_0)
+    public float[] getSupportedRefreshRates(int displayId) {
+        try {
+            Object displayInfo = getGetDisplayInfoMethod().invoke(manager, displayId);
+            if (displayInfo == null) {
+                return null;
+            }
+            Display.Mode[] modes = (Display.Mode[]) displayInfo.getClass().getDeclaredField("supportedModes").get(displayInfo);
+            float[] refreshRates = new float[modes.length];
+            for (int i = 0; i < modes.length; ++i) {
+                refreshRates[i] = modes[i].getRefreshRate();
+            }
+            return refreshRates;
+        } catch (ReflectiveOperationException e) {
+            Ln.e("Could not get the display modes", e);
+            return null;
+        }
+    }
+
     public int[] getDisplayIds() {
         try {
             return (int[]) manager.getClass().getMethod("getDisplayIds").invoke(manager);
@@ -1,5 +1,7 @@
 package com.genymobile.scrcpy.control;
 
+import com.genymobile.scrcpy.device.Size;
+
 import android.view.KeyEvent;
 import android.view.MotionEvent;
 import org.junit.Assert;
@@ -59,6 +61,27 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseTextStream() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_INJECT_TEXT_STREAM);
+        byte[] text = new byte[ControlMessageReader.TEXT_STREAM_CHUNK_MAX_LENGTH];
+        Arrays.fill(text, (byte) 'a');
+        dos.writeInt(text.length);
+        dos.write(text);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TEXT_STREAM, event.getType());
+        Assert.assertEquals(new String(text, StandardCharsets.US_ASCII), event.getText());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testParseLongTextEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -115,6 +138,162 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseTouchEventsReused() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        for (int i = 0; i < 2; ++i) {
+            dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT);
+            dos.writeByte(i == 0 ? MotionEvent.ACTION_DOWN : MotionEvent.ACTION_MOVE);
+            dos.writeLong(-42); // pointerId
+            dos.writeInt(100 + i);
+            dos.writeInt(200 + i);
+            dos.writeShort(1080);
+            dos.writeShort(1920);
+            dos.writeShort(0xffff); // pressure
+            dos.writeInt(0); // action button
+            dos.writeInt(MotionEvent.BUTTON_PRIMARY); // buttons
+        }
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage first = reader.read();
+        Assert.assertEquals(MotionEvent.ACTION_DOWN, first.getAction());
+        Assert.assertEquals(100, first.getPosition().getPoint().getX());
+        Size firstScreenSize = first.getPosition().getScreenSize();
+
+        // The touch event message is refilled in place, and the unchanged screen size is shared
+        ControlMessage second = reader.read();
+        Assert.assertSame(first, second);
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, second.getAction());
+        Assert.assertEquals(101, second.getPosition().getPoint().getX());
+        Assert.assertEquals(201, second.getPosition().getPoint().getY());
+        Assert.assertSame(firstScreenSize, second.getPosition().getScreenSize());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseTouchBatch() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_BATCH);
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeLong(-42); // pointerId
+        dos.writeShort(1080);
+        dos.writeShort(1920);
+        dos.writeInt(0); // action button
+        dos.writeInt(MotionEvent.BUTTON_PRIMARY); // buttons
+        dos.writeLong(1000000); // timestamp of the last sample
+        dos.writeByte(2); // count
+        dos.writeInt(100);
+        dos.writeInt(200);
+        dos.writeShort(0xffff); // pressure
+        dos.writeInt(4000); // age
+        dos.writeInt(110);
+        dos.writeInt(210);
+        dos.writeShort(0); // pressure
+        dos.writeInt(0); // age
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_BATCH, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, event.getAction());
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(0, event.getActionButton());
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+        Assert.assertEquals(2, event.getPositions().length);
+        Assert.assertEquals(100, event.getPositions()[0].getPoint().getX());
+        Assert.assertEquals(200, event.getPositions()[0].getPoint().getY());
+        Assert.assertEquals(110, event.getPositions()[1].getPoint().getX());
+        Assert.assertEquals(210, event.getPositions()[1].getPoint().getY());
+        Assert.assertEquals(1080, event.getPositions()[1].getScreenSize().getWidth());
+        Assert.assertEquals(1920, event.getPositions()[1].getScreenSize().getHeight());
+        Assert.assertEquals(1f, event.getPressures()[0], 0f); // must be exact
+        Assert.assertEquals(0f, event.getPressures()[1], 0f);
+        Assert.assertEquals(4000, event.getAges()[0]);
+        Assert.assertEquals(0, event.getAges()[1]);
+        Assert.assertEquals(1000000, event.getTimestamp());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseCompactEvents() throws IOException {
+        // Same encoding as in test_control_msg_serialize.c
+        byte[] packet = {
+                ControlMessage.TYPE_INJECT_TOUCH_COMPACT, 0x00, 0x1F, // slot 0, ACTION_DOWN, all fields
+                -1, -1, -1, -1, -1, -1, -1, -1, // pointer id
+                (byte) 0xB8, 0x08, (byte) 0x80, 0x0F, // 1080 1920
+                (byte) 0xC8, 0x01, (byte) 0x90, 0x03, // +100 +200
+                (byte) 0x80, (byte) 0x89, 0x7A, // timestamp +1000000µs
+                -1, -1, // pressure
+                0x01, 0x01, // action button, buttons
+                ControlMessage.TYPE_INJECT_TOUCH_COMPACT, 0x02, 0x08, // slot 0, ACTION_MOVE, action button
+                0x03, 0x06, // -2 +3
+                (byte) 0x80, 0x7D, // timestamp +8000µs
+                0x00, // action button
+                ControlMessage.TYPE_INJECT_SCROLL_COMPACT, 0x40, // vscroll only
+                (byte) 0x88, 0x04, (byte) 0x84, 0x10, // +260 +1026
+                (byte) 0x80, (byte) 0xFA, 0x01, // timestamp +16000µs
+                (byte) 0x80, 0x00, // -16
+        };
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_EVENT, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_DOWN, event.getAction());
+        Assert.assertEquals(-1, event.getPointerId());
+        Assert.assertEquals(100, event.getPosition().getPoint().getX());
+        Assert.assertEquals(200, event.getPosition().getPoint().getY());
+        Assert.assertEquals(1080, event.getPosition().getScreenSize().getWidth());
+        Assert.assertEquals(1920, event.getPosition().getScreenSize().getHeight());
+        Assert.assertEquals(1f, event.getPressure(), 0f);
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getActionButton());
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+        Assert.assertEquals(1000000, event.getTimestamp());
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_EVENT, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, event.getAction());
+        Assert.assertEquals(-1, event.getPointerId());
+        Assert.assertEquals(98, event.getPosition().getPoint().getX());
+        Assert.assertEquals(203, event.getPosition().getPoint().getY());
+        Assert.assertEquals(1080, event.getPosition().getScreenSize().getWidth());
+        Assert.assertEquals(1f, event.getPressure(), 0f);
+        Assert.assertEquals(0, event.getActionButton());
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+        Assert.assertEquals(1008000, event.getTimestamp());
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_SCROLL_EVENT, event.getType());
+        Assert.assertEquals(260, event.getPosition().getPoint().getX());
+        Assert.assertEquals(1026, event.getPosition().getPoint().getY());
+        Assert.assertEquals(1920, event.getPosition().getScreenSize().getHeight());
+        Assert.assertEquals(0f, event.getHScroll(), 0f);
+        Assert.assertEquals(-16f, event.getVScroll(), 0f);
+        Assert.assertEquals(0, event.getButtons());
+        Assert.assertEquals(1024000, event.getTimestamp());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseCompactEventUnknownSlot() throws IOException {
+        byte[] packet = {ControlMessage.TYPE_INJECT_TOUCH_COMPACT, 0x32, 0x00, 0x00, 0x00};
+        ControlMessageReader reader = new ControlMessageReader(new ByteArrayInputStream(packet));
+        Assert.assertThrows(ControlProtocolException.class, reader::read);
+    }
+
     @Test
     public void testParseScrollEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -253,6 +432,105 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseFragmentedSetClipboardEvent() throws IOException {
+        ByteArrayOutputStream msgBos = new ByteArrayOutputStream();
+        DataOutputStream msgDos = new DataOutputStream(msgBos);
+        msgDos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        msgDos.writeLong(0x0102030405060708L); // sequence
+        msgDos.writeByte(1); // paste
+        byte[] text = "testé".getBytes(StandardCharsets.UTF_8);
+        msgDos.writeInt(text.length);
+        msgDos.write(text);
+        byte[] msg = msgBos.toByteArray();
+
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_FRAGMENT);
+        dos.writeByte(0); // not last
+        dos.writeShort(10);
+        dos.write(msg, 0, 10);
+        // A message in between the fragments
+        dos.writeByte(ControlMessage.TYPE_INJECT_KEYCODE);
+        dos.writeByte(KeyEvent.ACTION_UP);
+        dos.writeInt(KeyEvent.KEYCODE_ENTER);
+        dos.writeInt(0); // repeat
+        dos.writeInt(0); // metaState
+        dos.writeByte(ControlMessage.TYPE_FRAGMENT);
+        dos.writeByte(1); // last
+        dos.writeShort(msg.length - 10);
+        dos.write(msg, 10, msg.length - 10);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_KEYCODE, event.getType());
+        Assert.assertEquals(KeyEvent.KEYCODE_ENTER, event.getKeycode());
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals("testé", event.getText());
+        Assert.assertTrue(event.getPaste());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetClipboardByHashEvent() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeByte(0); // paste
+        dos.writeInt(ClipboardHash.HASH_FLAG | 8);
+        dos.writeLong(0xa430d84680aabd0bL); // hash
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertNull(event.getText());
+        Assert.assertEquals(ClipboardHash.hash("hello"), event.getClipboardHash());
+        Assert.assertFalse(event.getPaste());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseCompressedSetClipboardEvent() throws IOException {
+        byte[] rawText = new byte[4096];
+        Arrays.fill(rawText, (byte) 'a');
+        byte[] compressed = ClipboardCompression.compress(rawText, rawText.length);
+        Assert.assertNotNull(compressed);
+
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeByte(0); // no paste
+        dos.writeInt((compressed.length + 4) | ClipboardCompression.COMPRESSED_FLAG);
+        dos.writeInt(rawText.length);
+        dos.write(compressed);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals(new String(rawText, StandardCharsets.UTF_8), event.getText());
+        Assert.assertFalse(event.getPaste());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testParseBigSetClipboardEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -422,6 +700,195 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseGetClock() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_GET_CLOCK);
+        dos.writeLong(0x0102030405060708L);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_GET_CLOCK, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getTimestamp());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParsePing() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_PING);
+        dos.writeLong(0x0102030405060708L);
+        dos.writeLong(0x1112131415161718L);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_PING, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals(0x1112131415161718L, event.getTimestamp());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseVideoFeedback() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_VIDEO_FEEDBACK);
+        dos.writeInt(1000000);
+        dos.writeInt(0xffffffff); // saturated
+        dos.writeShort(60);
+        dos.writeShort(0xffff);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_VIDEO_FEEDBACK, event.getType());
+        Assert.assertEquals(1000000, event.getReceiveRate());
+        Assert.assertEquals(Integer.MAX_VALUE, event.getDelay());
+        Assert.assertEquals(60, event.getFrames());
+        Assert.assertEquals(0xffff, event.getSkippedFrames());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseRequestKeyFrame() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_REQUEST_KEYFRAME);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_REQUEST_KEYFRAME, event.getType());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetVideoThrottle() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIDEO_THROTTLE);
+        dos.writeShort(15);
+        dos.writeByte(1); // paused
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIDEO_THROTTLE, event.getType());
+        Assert.assertEquals(15, event.getMaxFps());
+        Assert.assertTrue(event.getPaused());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetVideoProfile() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIDEO_PROFILE);
+        dos.writeShort(1024); // max size
+        dos.writeInt(2_000_000); // bit rate
+        dos.writeShort(15); // max fps
+        dos.writeShort(800); // crop width
+        dos.writeShort(600); // crop height
+        dos.writeShort(100); // crop x
+        dos.writeShort(200); // crop y
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIDEO_PROFILE, event.getType());
+        Assert.assertEquals(1024, event.getMaxSize());
+        Assert.assertEquals(2_000_000, event.getBitRate());
+        Assert.assertEquals(15, event.getMaxFps());
+        Assert.assertEquals(800, event.getCropSize().getWidth());
+        Assert.assertEquals(600, event.getCropSize().getHeight());
+        Assert.assertEquals(100, event.getCropOffset().getX());
+        Assert.assertEquals(200, event.getCropOffset().getY());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetVideoProfileInitial() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIDEO_PROFILE);
+        dos.write(new byte[16]); // restore all the initial values
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIDEO_PROFILE, event.getType());
+        Assert.assertEquals(0, event.getMaxSize());
+        Assert.assertEquals(0, event.getBitRate());
+        Assert.assertEquals(0, event.getMaxFps());
+        Assert.assertNull(event.getCropSize());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetVideoViewSize() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIDEO_VIEW_SIZE);
+        dos.writeShort(640); // max size
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIDEO_VIEW_SIZE, event.getType());
+        Assert.assertEquals(640, event.getMaxSize());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseResizeDisplay() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_RESIZE_DISPLAY);
+        dos.writeShort(1280); // width
+        dos.writeShort(720); // height
+        dos.writeShort(240); // dpi
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_RESIZE_DISPLAY, event.getType());
+        Assert.assertEquals(1280, event.getDisplaySize().getWidth());
+        Assert.assertEquals(720, event.getDisplaySize().getHeight());
+        Assert.assertEquals(240, event.getDpi());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testMultiEvents() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
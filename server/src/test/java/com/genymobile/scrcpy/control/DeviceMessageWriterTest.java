@@ -3,10 +3,13 @@ package com.genymobile.scrcpy.control;
 import org.junit.Assert;
 import org.junit.Test;
 
+import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
 import java.io.DataOutputStream;
 import java.io.IOException;
 import java.nio.charset.StandardCharsets;
+import java.util.Arrays;
 
 public class DeviceMessageWriterTest {
 
@@ -32,6 +35,34 @@ public class DeviceMessageWriterTest {
         Assert.assertArrayEquals(expected, actual);
     }
 
+    @Test
+    public void testSerializeCompressedClipboard() throws IOException {
+        byte[] data = new byte[4096];
+        Arrays.fill(data, (byte) 'a');
+        String text = new String(data, StandardCharsets.UTF_8);
+
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+        writer.setClipboardCompression(true);
+
+        DeviceMessage msg = DeviceMessage.createClipboard(text);
+        writer.write(msg);
+
+        DataInputStream dis = new DataInputStream(new ByteArrayInputStream(bos.toByteArray()));
+        Assert.assertEquals(DeviceMessage.TYPE_CLIPBOARD, dis.readUnsignedByte());
+        int value = dis.readInt();
+        Assert.assertNotEquals(0, value & ClipboardCompression.COMPRESSED_FLAG);
+        int len = value & ~ClipboardCompression.COMPRESSED_FLAG;
+        Assert.assertTrue(len < data.length);
+        Assert.assertEquals(data.length, dis.readInt());
+
+        byte[] compressed = new byte[len - 4];
+        dis.readFully(compressed);
+        Assert.assertEquals(-1, dis.read()); // EOS
+
+        Assert.assertArrayEquals(data, ClipboardCompression.decompress(compressed, data.length));
+    }
+
     @Test
     public void testSerializeAckSetClipboard() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -72,4 +103,88 @@ public class DeviceMessageWriterTest {
 
         Assert.assertArrayEquals(expected, actual);
     }
+
+    @Test
+    public void testSerializeClock() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_CLOCK);
+        dos.writeLong(0x0102030405060708L); // timestamp
+        dos.writeLong(0x1112131415161718L); // device timestamp
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createClock(0x0102030405060708L, 0x1112131415161718L);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeAckPing() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_ACK_PING);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeLong(0x1112131415161718L); // timestamp
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createAckPing(0x0102030405060708L, 0x1112131415161718L);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeVideoIdle() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_VIDEO_IDLE);
+        dos.writeBoolean(true);
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createVideoIdle(true);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeBatch() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_UHID_OUTPUT);
+        dos.writeShort(42); // id
+        dos.writeShort(1); // size
+        dos.writeByte(0x02); // keyboard LEDs
+        dos.writeByte(DeviceMessage.TYPE_ACK_PING);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeLong(0x1112131415161718L); // timestamp
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage uhidOutput = DeviceMessage.createUhidOutput(42, new byte[] {0x02});
+        DeviceMessage ackPing = DeviceMessage.createAckPing(0x0102030405060708L, 0x1112131415161718L);
+        writer.write(Arrays.asList(uhidOutput, ackPing));
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
 }
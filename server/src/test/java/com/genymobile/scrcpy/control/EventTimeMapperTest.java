@@ -0,0 +1,40 @@
+package com.genymobile.scrcpy.control;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+public class EventTimeMapperTest {
+
+    @Test
+    public void testJitterIsAbsorbed() {
+        EventTimeMapper mapper = new EventTimeMapper(0);
+
+        // Client events every 8ms, the device clock is 5s ahead, the transit takes 10ms
+        Assert.assertEquals(5_010_000, mapper.map(0, 5_010_000));
+        // Received 30ms late, in a burst with the next one (the offset may only increase by 1000 ppm)
+        Assert.assertEquals(5_018_046, mapper.map(8_000, 5_056_000));
+        Assert.assertEquals(5_026_046, mapper.map(16_000, 5_056_000));
+        // Faster transit (8ms): the offset decreases immediately
+        Assert.assertEquals(5_032_000, mapper.map(24_000, 5_032_000));
+        Assert.assertEquals(5_040_000, mapper.map(32_000, 5_040_000));
+    }
+
+    @Test
+    public void testOffsetIncreaseIsBounded() {
+        EventTimeMapper mapper = new EventTimeMapper(0);
+
+        Assert.assertEquals(1_000_000, mapper.map(0, 1_000_000));
+        // The transit increases by 100ms after 10s: the offset follows by at most 10ms
+        Assert.assertEquals(10_910_000, mapper.map(9_900_000, 11_000_000));
+    }
+
+    @Test
+    public void testMonotonicWithDelay() {
+        EventTimeMapper mapper = new EventTimeMapper(50_000);
+
+        Assert.assertEquals(1_050_000, mapper.map(0, 1_000_000));
+        // The offset decreases by 20ms, the event time must not go backwards
+        Assert.assertEquals(1_050_000, mapper.map(10_000, 990_000));
+        Assert.assertEquals(1_060_000, mapper.map(30_000, 1_010_000));
+    }
+}
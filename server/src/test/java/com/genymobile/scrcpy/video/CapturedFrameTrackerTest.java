@@ -0,0 +1,44 @@
+package com.genymobile.scrcpy.video;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+public class CapturedFrameTrackerTest {
+
+    @Test
+    public void testRepeatedFrames() {
+        CapturedFrameTracker tracker = new CapturedFrameTracker();
+
+        tracker.onFrame(1_000_000_000L);
+        Assert.assertTrue(tracker.isCaptured(1_000_000));
+        // Repeated by the encoder 100ms later
+        Assert.assertFalse(tracker.isCaptured(1_100_000));
+
+        // A captured frame exactly 100ms after the previous one is not a repeated frame
+        tracker.onFrame(1_200_000_000L);
+        Assert.assertTrue(tracker.isCaptured(1_200_000));
+    }
+
+    @Test
+    public void testFramesDroppedByEncoder() {
+        CapturedFrameTracker tracker = new CapturedFrameTracker();
+
+        tracker.onFrame(1_000_000_000L);
+        tracker.onFrame(1_016_666_666L);
+        tracker.onFrame(1_033_333_333L);
+
+        // The second frame is dropped by the encoder (max fps)
+        Assert.assertTrue(tracker.isCaptured(1_000_000));
+        Assert.assertTrue(tracker.isCaptured(1_033_333));
+        Assert.assertFalse(tracker.isCaptured(1_133_333));
+    }
+
+    @Test
+    public void testReset() {
+        CapturedFrameTracker tracker = new CapturedFrameTracker();
+
+        tracker.onFrame(1_000_000_000L);
+        tracker.reset();
+        Assert.assertFalse(tracker.isCaptured(1_000_000));
+    }
+}